@@ -0,0 +1,308 @@
+// Copyright 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Copies a finished parse tree into one block laid out as
+//
+//   [GumboOutput][nodes][child pointers][attribute pointers][attributes][strings]
+//
+// Every vector is exactly as long as it needs to be, and attribute names,
+// attribute values and whitespace text are stored once however often they
+// occur.  The first pass sizes the block and numbers the shared strings;
+// the second fills it in.
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gumbo.h"
+#include "util.h"
+
+typedef struct {
+  const char* data;
+  size_t length;
+  size_t offset;
+  bool written;
+} InternEntry;
+
+typedef struct {
+  InternEntry* entries;
+  size_t capacity;
+  size_t count;
+
+  // The sizes found by the first pass
+  size_t nodes;
+  size_t child_slots;
+  size_t attributes;
+  size_t interned_bytes;
+  size_t copied_bytes;
+
+  // Where the second pass writes next
+  GumboNode* next_node;
+  GumboNode** next_child;
+  GumboAttribute** next_attribute_pointer;
+  GumboAttribute* next_attribute;
+  char* strings;
+  char* next_copied;
+
+  const GumboNode* source_root;
+  GumboNode* root;
+} Compactor;
+
+static const size_t kFirstInternCapacity = 256;
+
+static size_t hash_string(const char* data, size_t length) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= (unsigned char) data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static InternEntry* intern_slot(
+    InternEntry* entries, size_t capacity, const char* data, size_t length) {
+  size_t i = hash_string(data, length) & (capacity - 1);
+  while (entries[i].data != NULL) {
+    if (entries[i].length == length && memcmp(entries[i].data, data, length) == 0) {
+      return &entries[i];
+    }
+    i = (i + 1) & (capacity - 1);
+  }
+  return &entries[i];
+}
+
+static bool intern_grow(Compactor* c) {
+  size_t capacity = c->capacity ? c->capacity * 2 : kFirstInternCapacity;
+  InternEntry* entries = gumbo_malloc(capacity * sizeof(InternEntry));
+  if (entries == NULL) {
+    return false;
+  }
+  memset(entries, 0, capacity * sizeof(InternEntry));
+  for (size_t i = 0; i < c->capacity; ++i) {
+    if (c->entries[i].data != NULL) {
+      *intern_slot(entries, capacity, c->entries[i].data, c->entries[i].length) =
+          c->entries[i];
+    }
+  }
+  gumbo_free(c->entries);
+  c->entries = entries;
+  c->capacity = capacity;
+  return true;
+}
+
+// First pass: number a shared string the first time it is seen
+static bool measure_interned(Compactor* c, const char* s) {
+  if (c->count + 1 > c->capacity / 4 * 3 && !intern_grow(c)) {
+    return false;
+  }
+  size_t length = strlen(s);
+  InternEntry* entry = intern_slot(c->entries, c->capacity, s, length);
+  if (entry->data == NULL) {
+    entry->data = s;
+    entry->length = length;
+    entry->offset = c->interned_bytes;
+    entry->written = false;
+    c->interned_bytes += length + 1;
+    c->count++;
+  }
+  return true;
+}
+
+static void measure_copied(Compactor* c, const char* s) {
+  if (s != NULL) {
+    c->copied_bytes += strlen(s) + 1;
+  }
+}
+
+static bool measure_node(Compactor* c, const GumboNode* node) {
+  c->nodes++;
+  const GumboVector* children = NULL;
+  switch (node->type) {
+    case GUMBO_NODE_DOCUMENT:
+      measure_copied(c, node->v.document.name);
+      measure_copied(c, node->v.document.public_identifier);
+      measure_copied(c, node->v.document.system_identifier);
+      children = &node->v.document.children;
+      break;
+    case GUMBO_NODE_ELEMENT:
+    case GUMBO_NODE_TEMPLATE: {
+      const GumboVector* attributes = &node->v.element.attributes;
+      c->attributes += attributes->length;
+      for (unsigned int i = 0; i < attributes->length; ++i) {
+        const GumboAttribute* attr = attributes->data[i];
+        if (!measure_interned(c, attr->name) || !measure_interned(c, attr->value)) {
+          return false;
+        }
+      }
+      children = &node->v.element.children;
+      break;
+    }
+    case GUMBO_NODE_WHITESPACE:
+      return measure_interned(c, node->v.text.text);
+    default:
+      measure_copied(c, node->v.text.text);
+      return true;
+  }
+  c->child_slots += children->length;
+  for (unsigned int i = 0; i < children->length; ++i) {
+    if (!measure_node(c, children->data[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Second pass: the string's place in the block, writing it there once
+static const char* place_interned(Compactor* c, const char* s) {
+  InternEntry* entry = intern_slot(c->entries, c->capacity, s, strlen(s));
+  assert(entry->data != NULL);
+  char* placed = c->strings + entry->offset;
+  if (!entry->written) {
+    memcpy(placed, entry->data, entry->length + 1);
+    entry->written = true;
+  }
+  return placed;
+}
+
+static const char* place_copied(Compactor* c, const char* s) {
+  if (s == NULL) {
+    return NULL;
+  }
+  size_t size = strlen(s) + 1;
+  char* placed = c->next_copied;
+  memcpy(placed, s, size);
+  c->next_copied += size;
+  return placed;
+}
+
+static GumboNode* copy_node(Compactor* c, const GumboNode* node, GumboNode* parent);
+
+static void copy_children(
+    Compactor* c, const GumboVector* from, GumboVector* to, GumboNode* parent) {
+  to->length = from->length;
+  to->capacity = from->length;
+  to->data = NULL;
+  if (from->length == 0) {
+    return;
+  }
+  GumboNode** slots = c->next_child;
+  c->next_child += from->length;
+  to->data = (void**) slots;
+  for (unsigned int i = 0; i < from->length; ++i) {
+    slots[i] = copy_node(c, from->data[i], parent);
+  }
+}
+
+static GumboNode* copy_node(Compactor* c, const GumboNode* node, GumboNode* parent) {
+  GumboNode* copy = c->next_node++;
+  *copy = *node;
+  copy->parent = parent;
+  if (node == c->source_root) {
+    c->root = copy;
+  }
+
+  switch (node->type) {
+    case GUMBO_NODE_DOCUMENT: {
+      GumboDocument* doc = &copy->v.document;
+      doc->name = place_copied(c, node->v.document.name);
+      doc->public_identifier = place_copied(c, node->v.document.public_identifier);
+      doc->system_identifier = place_copied(c, node->v.document.system_identifier);
+      copy_children(c, &node->v.document.children, &doc->children, copy);
+      break;
+    }
+    case GUMBO_NODE_ELEMENT:
+    case GUMBO_NODE_TEMPLATE: {
+      const GumboVector* from = &node->v.element.attributes;
+      GumboVector* to = &copy->v.element.attributes;
+      to->length = from->length;
+      to->capacity = from->length;
+      to->data = NULL;
+      if (from->length > 0) {
+        GumboAttribute** pointers = c->next_attribute_pointer;
+        c->next_attribute_pointer += from->length;
+        to->data = (void**) pointers;
+        for (unsigned int i = 0; i < from->length; ++i) {
+          const GumboAttribute* attr = from->data[i];
+          GumboAttribute* attr_copy = c->next_attribute++;
+          *attr_copy = *attr;
+          attr_copy->name = place_interned(c, attr->name);
+          attr_copy->value = place_interned(c, attr->value);
+          pointers[i] = attr_copy;
+        }
+      }
+      copy_children(c, &node->v.element.children, &copy->v.element.children, copy);
+      break;
+    }
+    case GUMBO_NODE_WHITESPACE:
+      copy->v.text.text = place_interned(c, node->v.text.text);
+      break;
+    default:
+      copy->v.text.text = place_copied(c, node->v.text.text);
+      break;
+  }
+  return copy;
+}
+
+GumboOutput* gumbo_compact_output(GumboOutput* output) {
+  if (output == NULL || output->compact_size != 0) {
+    return output;
+  }
+
+  Compactor c;
+  memset(&c, 0, sizeof(c));
+  if (!measure_node(&c, output->document)) {
+    gumbo_free(c.entries);
+    return output;
+  }
+
+  size_t size = sizeof(GumboOutput) +
+                c.nodes * sizeof(GumboNode) +
+                c.child_slots * sizeof(GumboNode*) +
+                c.attributes * sizeof(GumboAttribute*) +
+                c.attributes * sizeof(GumboAttribute) +
+                c.interned_bytes + c.copied_bytes;
+  char* block = gumbo_malloc(size);
+  if (block == NULL) {
+    gumbo_free(c.entries);
+    return output;
+  }
+
+  // Every section but the strings holds pointer-aligned structs, so each
+  // starts suitably aligned after the one before
+  GumboOutput* compact = (GumboOutput*) block;
+  char* next = block + sizeof(GumboOutput);
+  c.next_node = (GumboNode*) next;
+  next += c.nodes * sizeof(GumboNode);
+  c.next_child = (GumboNode**) next;
+  next += c.child_slots * sizeof(GumboNode*);
+  c.next_attribute_pointer = (GumboAttribute**) next;
+  next += c.attributes * sizeof(GumboAttribute*);
+  c.next_attribute = (GumboAttribute*) next;
+  next += c.attributes * sizeof(GumboAttribute);
+  c.strings = next;
+  c.next_copied = next + c.interned_bytes;
+  c.source_root = output->root;
+
+  compact->document = copy_node(&c, output->document, NULL);
+  compact->root = c.root;
+  compact->errors = kGumboEmptyVector;
+  compact->status = output->status;
+  compact->compact_size = size;
+  assert(c.next_copied == block + size);
+
+  gumbo_free(c.entries);
+  gumbo_destroy_output(output);
+  return compact;
+}
@@ -599,6 +599,15 @@ typedef struct GumboInternalOptions {
    * Default: 50
    */
   int max_errors;
+
+  /**
+   * Whether only the errors are wanted.  The parser then builds just the
+   * elements it has to consult to go on: text, whitespace, CDATA and
+   * comments are checked as usual but never made into nodes, so the
+   * returned tree is only good for its errors.
+   * Default: false.
+   */
+  bool errors_only;
 } GumboOptions;
 
 /** Default options struct; use this with gumbo_parse_with_options. */
@@ -659,6 +668,13 @@ typedef struct GumboInternalOutput {
    */
   GumboOutputStatus status;
 
+  /**
+   * Zero for an ordinary parse.  For an output made by gumbo_compact_output,
+   * the size in bytes of the single block holding the output and its whole
+   * tree.
+   */
+  size_t compact_size;
+
 } GumboOutput;
 
 /**
@@ -688,6 +704,17 @@ GumboOutput* gumbo_parse_fragment(
 /** Release the memory used for the parse tree & parse errors. */
 void gumbo_destroy_output(GumboOutput* output);
 
+/**
+ * Copies a parse tree into a single allocation and destroys the original,
+ * returning the copy.  Vectors are trimmed to their length, and attribute
+ * names, attribute values and whitespace text are stored once each however
+ * often they occur.  The parse errors are not kept.  The compact tree must
+ * only be read: it cannot be edited, and gumbo_destroy_node must not be
+ * called on any of its nodes.  Like the original, it still points into the
+ * source buffer.  If the copy cannot be allocated, the original is returned.
+ */
+GumboOutput* gumbo_compact_output(GumboOutput* output);
+
 /** Allocate a new freestanding node */
 GumboNode *gumbo_create_node(GumboNodeType type);
 
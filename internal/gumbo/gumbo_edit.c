@@ -74,6 +74,8 @@ GumboOutput*  gumbo_new_output_init(void) {
   output->root = NULL;
   output->document = gumbo_new_document_node();
   gumbo_vector_init(0, &output->errors);
+  output->status = GUMBO_STATUS_OK;
+  output->compact_size = 0;
   return output;
 }
 
@@ -60,6 +60,7 @@ const GumboOptions kGumboDefaultOptions = {
   false,   /* stop_on_first_error */
   400,     /* max_tree_depth */
   50,      /* max_errors */
+  false,   /* errors_only */
 };
 
 static const GumboStringPiece kDoctypeHtml = GUMBO_STRING("html");
@@ -352,6 +353,7 @@ static void output_init(GumboParser* parser) {
   output->root = NULL;
   output->document = new_document_node();
   output->status = GUMBO_STATUS_OK;
+  output->compact_size = 0;
   parser->_output = output;
   gumbo_init_errors(parser);
 }
@@ -765,6 +767,11 @@ static void maybe_flush_text_node_buffer(GumboParser* parser) {
   assert(buffer_state->_type == GUMBO_NODE_WHITESPACE ||
          buffer_state->_type == GUMBO_NODE_TEXT ||
          buffer_state->_type == GUMBO_NODE_CDATA);
+  if (parser->_options->errors_only) {
+    gumbo_string_buffer_clear(&buffer_state->_buffer);
+    buffer_state->_type = GUMBO_NODE_WHITESPACE;
+    return;
+  }
   GumboNode* text_node = create_node(buffer_state->_type);
   GumboText* text_node_data = &text_node->v.text;
   text_node_data->text = gumbo_string_buffer_to_string(&buffer_state->_buffer);
@@ -831,6 +838,10 @@ static GumboNode* pop_current_node(GumboParser* parser) {
 static void append_comment_node(
     GumboParser* parser, GumboNode* node, const GumboToken* token) {
   maybe_flush_text_node_buffer(parser);
+  if (parser->_options->errors_only) {
+    gumbo_free((void*) token->v.text);
+    return;
+  }
   GumboNode* comment = create_node(GUMBO_NODE_COMMENT);
   comment->type = GUMBO_NODE_COMMENT;
   comment->parse_flags = GUMBO_INSERTION_NORMAL;
@@ -4671,6 +4682,11 @@ const char* gumbo_status_to_string(GumboOutputStatus status) {
 
 
 void gumbo_destroy_output(GumboOutput* output) {
+  if (output->compact_size != 0) {
+    // The whole tree is in the one block
+    gumbo_free(output);
+    return;
+  }
   free_node(output->document);
   for (unsigned int i = 0; i < output->errors.length; ++i) {
     gumbo_error_destroy(output->errors.data[i]);
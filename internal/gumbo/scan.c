@@ -0,0 +1,102 @@
+// Copyright 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scan.h"
+
+#include <stdint.h>
+
+#if defined(GUMBO_USE_SIMD) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define GUMBO_SCAN_SSE2 1
+#include <emmintrin.h>
+#elif defined(GUMBO_USE_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#define GUMBO_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static inline int is_plain(unsigned char c, char quote) {
+  return c >= 0x20 && c < 0x7F && c != '&' && c != (unsigned char) quote;
+}
+
+#if defined(GUMBO_SCAN_SSE2) || defined(GUMBO_SCAN_NEON)
+static inline int count_trailing_zeros64(uint64_t bits) {
+#if defined(_MSC_VER)
+  unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+  _BitScanForward64(&index, bits);
+#else
+  if ((uint32_t) bits) {
+    _BitScanForward(&index, (uint32_t) bits);
+  } else {
+    _BitScanForward(&index, (uint32_t) (bits >> 32));
+    index += 32;
+  }
+#endif
+  return (int) index;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+#endif
+
+size_t gumbo_scan_plain_ascii(const char* start, const char* end, char quote) {
+  const char* p = start;
+
+#if defined(GUMBO_SCAN_SSE2)
+  // Bytes 0x80 and up are negative as signed chars, so one signed compare
+  // against 0x20 catches both the control characters and non-ASCII.
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i del = _mm_set1_epi8(0x7F);
+  const __m128i amp = _mm_set1_epi8('&');
+  const __m128i quot = _mm_set1_epi8(quote);
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+    __m128i stops = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi8(chunk, space), _mm_cmpeq_epi8(chunk, del)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, quot)));
+    int mask = _mm_movemask_epi8(stops);
+    if (mask) {
+      return (size_t) (p - start) + count_trailing_zeros64((uint64_t) mask);
+    }
+    p += 16;
+  }
+#elif defined(GUMBO_SCAN_NEON)
+  const uint8x16_t space = vdupq_n_u8(0x20);
+  const uint8x16_t del = vdupq_n_u8(0x7F);
+  const uint8x16_t amp = vdupq_n_u8('&');
+  const uint8x16_t quot = vdupq_n_u8((uint8_t) quote);
+  while (end - p >= 16) {
+    uint8x16_t chunk = vld1q_u8((const uint8_t*) p);
+    uint8x16_t stops = vorrq_u8(
+        vorrq_u8(vcltq_u8(chunk, space), vcgeq_u8(chunk, del)),
+        vorrq_u8(vceqq_u8(chunk, amp), vceqq_u8(chunk, quot)));
+    // Narrow each 0x00/0xFF byte to a nibble of one 64 bit word.
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(stops), 4);
+    uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+    if (bits) {
+      return (size_t) (p - start) + (count_trailing_zeros64(bits) >> 2);
+    }
+    p += 16;
+  }
+#endif
+
+  while (p < end && is_plain((unsigned char) *p, quote)) {
+    ++p;
+  }
+  return (size_t) (p - start);
+}
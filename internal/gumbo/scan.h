@@ -0,0 +1,39 @@
+// Copyright 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Bulk scanning of the input for runs of characters the tokenizer would
+// otherwise consume one code point at a time.
+
+#ifndef GUMBO_SCAN_H_
+#define GUMBO_SCAN_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns how many bytes from start on are printable ASCII (0x20 - 0x7E)
+// other than '&' and the given quote character.  None of these need any
+// special handling: no character references, no newline or tab position
+// bookkeeping, no NUL or CR replacement and no utf-8 decoding.
+//
+// Uses SSE2 or NEON when sigilgumbo is built with GUMBO_USE_SIMD and the
+// target has them, and a plain loop otherwise; the results are the same.
+size_t gumbo_scan_plain_ascii(const char* start, const char* end, char quote);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // GUMBO_SCAN_H_
@@ -216,6 +216,17 @@ void utf8iterator_next(Utf8Iterator* iter) {
   read_char(iter);
 }
 
+void utf8iterator_skip_plain_ascii(Utf8Iterator* iter, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  assert(iter->_width == 1);
+  iter->_pos.offset += count;
+  iter->_pos.column += (unsigned int) count;
+  iter->_start += count;
+  read_char(iter);
+}
+
 int utf8iterator_current(const Utf8Iterator* iter) {
   return iter->_current;
 }
@@ -88,6 +88,12 @@ void utf8iterator_init(
 // Advances the current position by one code point.
 void utf8iterator_next(Utf8Iterator* iter);
 
+// Advances the iterator by count characters at once.  The current character
+// and the count - 1 after it must all be printable ASCII with no newline or
+// tab, as found by gumbo_scan_plain_ascii, so the positions move by one
+// column per byte.
+void utf8iterator_skip_plain_ascii(Utf8Iterator* iter, size_t count);
+
 // Returns the current code point as an integer.
 int utf8iterator_current(const Utf8Iterator* iter);
 
@@ -28,21 +28,31 @@
 #include <QtWidgets/QProgressDialog>
 
 #include "BookManipulation/Book.h"
+#include "BookManipulation/BookCheckpoints.h"
+#include "BookManipulation/BookIndex.h"
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/FolderKeeper.h"
+#include "Misc/GumboCache.h"
 #include "Misc/GumboInterface.h"
 #include "Misc/TempFolder.h"
 #include "Misc/Utility.h"
 #include "Misc/HTMLSpellCheck.h"
+#include "Misc/ImageOptimizer.h"
 #include "Misc/Landmarks.h"
 #include "ResourceObjects/HTMLResource.h"
+#include "ResourceObjects/ImageResource.h"
 #include "ResourceObjects/NCXResource.h"
 #include "ResourceObjects/OPFResource.h"
 #include "sigil_constants.h"
+#include "sigil_exception.h"
 #include "SourceUpdates/AnchorUpdates.h"
 #include "SourceUpdates/PerformHTMLUpdates.h"
 #include "SourceUpdates/UniversalUpdates.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/TaskScheduler.h"
+
+// At most this many resources are written to disk at once
+static const int MAX_PARALLEL_SAVES = 4;
 
 static const QString FIRST_CSS_NAME   = "Style0001.css";
 static const QString FIRST_SVG_NAME   = "Image0001.svg";
@@ -225,15 +235,19 @@ const QString HTML5_COVER_SOURCE =
     "</body>\n"
     "</html>\n";
 
-Book::Book()
+Book::Book(qint64 workspace_size)
     :
-    m_Mainfolder(new FolderKeeper(this)),
+    m_Mainfolder(new FolderKeeper(this, workspace_size)),
+    m_Index(new BookIndex(m_Mainfolder)),
+    m_Checkpoints(new BookCheckpoints(m_Mainfolder, workspace_size)),
     m_IsModified(false)
 {
 }
 
 Book::~Book()
 {
+    delete m_Checkpoints;
+    delete m_Index;
     delete m_Mainfolder;
 }
 
@@ -257,6 +271,18 @@ const FolderKeeper *Book::GetFolderKeeper() const
 }
 
 
+BookIndex *Book::GetIndex()
+{
+    return m_Index;
+}
+
+
+BookCheckpoints *Book::GetCheckpoints()
+{
+    return m_Checkpoints;
+}
+
+
 
 OPFResource *Book::GetOPF()
 {
@@ -555,7 +581,7 @@ HTMLResource *Book::CreateSectionBreakOriginalResource(const QString &content, H
 }
 
 
-void Book::CreateNewSections(const QStringList &new_sections, HTMLResource *original_resource)
+void Book::CreateNewSections(const XhtmlDoc::SGFSections &new_sections, HTMLResource *original_resource)
 {
     int original_position = GetOPF()->GetReadingOrder(original_resource);
     Q_ASSERT(original_position >= 0);
@@ -567,12 +593,7 @@ void Book::CreateNewSections(const QStringList &new_sections, HTMLResource *orig
     }
 
     TempFolder tempfolder;
-    QFutureSynchronizer<NewSectionResult> sync;
     QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(true);
-    // A list of all the files that have not been involved in the split.
-    // This will be used later when anchors are updated.
-    QList<HTMLResource *> other_files = html_resources;
-    other_files.removeOne(original_resource);
     int next_reading_order;
 
     if (original_position == -1) {
@@ -581,53 +602,50 @@ void Book::CreateNewSections(const QStringList &new_sections, HTMLResource *orig
         next_reading_order = original_position + 1;
     }
 
-    for (int i = 0; i < new_sections.count(); ++i) {
-        int reading_order = next_reading_order + i;
-        NewSection sectionInfo;
-        sectionInfo.source = new_sections.at(i);
-        sectionInfo.reading_order = reading_order;
-        sectionInfo.temp_folder_path = tempfolder.GetPath();
-        sectionInfo.new_file_prefix = new_file_prefix;
-        sectionInfo.file_suffix = i;
-        sectionInfo.file_extension = file_extension;
-        sync.addFuture(
-            QtConcurrent::run(
-                this,
-                &Book::CreateOneNewSection,
-                sectionInfo));
+    // The sections are built a window at a time so that only a window's
+    // worth of section text is held in memory besides the source
+    const int window = qMax(1, TaskScheduler::ThreadCount() * 2);
+    QList<HTMLResource *> created_sections;
+
+    for (int start = 0; start < new_sections.count(); start += window) {
+        QFutureSynchronizer<NewSectionResult> sync;
+        int end = qMin(start + window, new_sections.count());
+
+        for (int i = start; i < end; ++i) {
+            NewSection sectionInfo;
+            sectionInfo.source = new_sections.Section(i);
+            sectionInfo.reading_order = next_reading_order + i;
+            sectionInfo.temp_folder_path = tempfolder.GetPath();
+            sectionInfo.new_file_prefix = new_file_prefix;
+            sectionInfo.file_suffix = i;
+            sectionInfo.file_extension = file_extension;
+            sync.addFuture(
+                TaskScheduler::Run(
+                    TaskScheduler::Foreground,
+                    "Book::CreateOneNewSection",
+                    std::bind(static_cast<NewSectionResult (Book::*)(NewSection)>(&Book::CreateOneNewSection),
+                              this, sectionInfo)));
+        }
+
+        sync.waitForFinished();
+        // The futures are kept in the order they were added
+        foreach(QFuture<NewSectionResult> future, sync.futures()) {
+            created_sections.append(future.result().created_section);
+        }
     }
 
-    sync.waitForFinished();
     QList<HTMLResource *> new_files;
     new_files.append(original_resource);
-    QList<QFuture<NewSectionResult>> futures = sync.futures();
 
-    if (original_position == -1) {
-        // Add new sections to the end of the book
-        for (int i = 0; i < futures.count(); ++i) {
-            html_resources.append(futures.at(i).result().created_section);
-            new_files.append(futures.at(i).result().created_section);
-        }
-    } else {
-        // Insert the new files at the correct positions in the list
-        // The new files need to be inserted in order from first to last
-        for (int i = 0; i < new_sections.count(); ++i) {
-            int reading_order = next_reading_order + i;
-
-            if (futures.at(i).result().reading_order == reading_order) {
-                html_resources.insert(reading_order , futures.at(i).result().created_section);
-                new_files.append(futures.at(i).result().created_section);
-            } else {
-                // This is security code to protect against any mangling of the futures list by Qt
-                for (int j = 0 ; j < futures.count() ; ++j) {
-                    if (futures.at(j).result().reading_order == reading_order) {
-                        html_resources.insert(reading_order , futures.at(j).result().created_section);
-                        new_files.append(futures.at(j).result().created_section);
-                        break;
-                    }
-                }
-            }
+    for (int i = 0; i < created_sections.count(); ++i) {
+        if (original_position == -1) {
+            // Add new sections to the end of the book
+            html_resources.append(created_sections.at(i));
+        } else {
+            html_resources.insert(next_reading_order + i, created_sections.at(i));
         }
+
+        new_files.append(created_sections.at(i));
     }
 
     // Update anchor references between fragment ids in the new files. Since these all came from one single
@@ -635,6 +653,22 @@ void Book::CreateNewSections(const QStringList &new_sections, HTMLResource *orig
     AnchorUpdates::UpdateAllAnchorsWithIDs(new_files);
     // Now, update references to the original file that are made in other files.
     // We can't assume that ids are unique in this case, and so need to use a different mechanism.
+    // Only the files the index knows to link to the original file can need it.
+    QList<HTMLResource *> other_files;
+    QSet<HTMLResource *> new_file_set = new_files.toSet();
+    foreach(QString filename, m_Index->GetFilesLinkingTo(original_resource->Filename())) {
+        HTMLResource *html_resource = NULL;
+
+        try {
+            html_resource = qobject_cast<HTMLResource *>(m_Mainfolder->GetResourceByFilename(filename));
+        } catch (ResourceDoesNotExist) {
+            continue;
+        }
+
+        if (html_resource && !new_file_set.contains(html_resource)) {
+            other_files.append(html_resource);
+        }
+    }
     AnchorUpdates::UpdateExternalAnchors(other_files, Utility::URLEncodePath(original_resource->Filename()), new_files);
     // Update TOC entries as well
     AnchorUpdates::UpdateTOCEntries(GetNCX(), Utility::URLEncodePath(original_resource->Filename()), new_files);
@@ -645,14 +679,17 @@ void Book::CreateNewSections(const QStringList &new_sections, HTMLResource *orig
 
 bool Book::IsDataWellFormed(HTMLResource *html_resource)
 {
-    XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(html_resource->GetText(), 
-                                                                         html_resource->GetEpubVersion());
-    return error.line == -1;
+    return m_Index->GetFacts(html_resource, BookIndex::WellFormedErrors).isEmpty();
 }
 
 
 bool Book::IsDataOnDiskWellFormed(HTMLResource *html_resource)
 {
+    // What is on disk is what is in memory unless the text was edited since
+    if (!html_resource->IsDirty()) {
+        return IsDataWellFormed(html_resource);
+    }
+
     XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(Utility::ReadUnicodeTextFile(html_resource->GetFullPath()), 
                                                                        html_resource->GetEpubVersion());
     return error.line == -1;
@@ -691,12 +728,14 @@ QHash <QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElements()
 {
     QHash<QString, QList<XhtmlDoc::XMLElement>> links_in_html;
     const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QList<XhtmlDoc::XMLElement>>> future = QtConcurrent::mapped(html_resources, GetLinkElementsInHTMLFileMapped);
+    // Each file is scanned on its own thread
+    const QList<std::tuple<QString, QList<XhtmlDoc::XMLElement>>> results =
+        QtConcurrent::blockingMapped<QList<std::tuple<QString, QList<XhtmlDoc::XMLElement>>>>(html_resources, GetLinkElementsInHTMLFileMapped);
 
-    for (int i = 0; i < future.results().count(); i++) {
+    for (int i = 0; i < results.count(); i++) {
         QString filename;
         QList<XhtmlDoc::XMLElement> links;
-        std::tie(filename, links) = future.resultAt(i);
+        std::tie(filename, links) = results.at(i);
         // Each target entry has a list of filenames that contain it
         links_in_html[filename] = links;
     }
@@ -706,6 +745,7 @@ QHash <QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElements()
 
 std::tuple<QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElementsInHTMLFileMapped(HTMLResource *html_resource)
 {
+    // A file that is not well formed still has its links reported
     return std::make_tuple(html_resource->Filename(),
                       XhtmlDoc::GetTagsInDocument(html_resource->GetText(), "a"));
 }
@@ -714,17 +754,10 @@ std::tuple<QString, QList<XhtmlDoc::XMLElement>> Book::GetLinkElementsInHTMLFile
 QStringList Book::GetStyleUrlsInHTMLFiles()
 {
     QStringList images_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetStyleUrlsInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList images;
-        std::tie(filename, images) = future.resultAt(i);
-        // Each target entry has a list of filenames that contain it
+    const QHash<QString, QStringList> urls_by_file = m_Index->GetFactsByFile(BookIndex::StyleUrls);
+    foreach(QStringList images, urls_by_file.values()) {
         images_in_html.append(images);
     }
-
     return images_in_html;
 }
 
@@ -736,19 +769,7 @@ std::tuple<QString, QStringList> Book::GetStyleUrlsInHTMLFileMapped(HTMLResource
 
 QHash<QString, QStringList> Book::GetIdsInHTMLFiles()
 {
-    QHash<QString, QStringList> ids_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetIdsInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList ids;
-        std::tie(filename, ids) = future.resultAt(i);
-        // Each target entry has a list of filenames that contain it
-        ids_in_html[filename] = ids;
-    }
-
-    return ids_in_html;
+    return m_Index->GetFactsByFile(BookIndex::Ids);
 }
 
 std::tuple<QString, QStringList> Book::GetIdsInHTMLFileMapped(HTMLResource *html_resource)
@@ -759,7 +780,7 @@ std::tuple<QString, QStringList> Book::GetIdsInHTMLFileMapped(HTMLResource *html
 
 QStringList Book::GetIdsInHTMLFile(HTMLResource *html_resource)
 {
-    return XhtmlDoc::GetAllDescendantIDs(html_resource->GetText());
+    return m_Index->GetFacts(html_resource, BookIndex::Ids);
 }
 
 
@@ -789,19 +810,7 @@ QStringList Book::GetIdsInHrefs()
 
 QHash<QString, QStringList> Book::GetHrefsInHTMLFiles()
 {
-    QHash<QString, QStringList> hrefs_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetHrefsInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList hrefs;
-        std::tie(filename, hrefs) = future.resultAt(i);
-        // Each target entry has a list of filenames that contain it
-        hrefs_in_html[filename] = hrefs;
-    }
-
-    return hrefs_in_html;
+    return m_Index->GetFactsByFile(BookIndex::Hrefs);
 }
 
 std::tuple<QString, QStringList> Book::GetHrefsInHTMLFileMapped(HTMLResource *html_resource)
@@ -812,21 +821,8 @@ std::tuple<QString, QStringList> Book::GetHrefsInHTMLFileMapped(HTMLResource *ht
 
 QHash<QString, QStringList> Book::GetClassesInHTMLFiles()
 {
-    QHash<QString, QStringList> classes_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetClassesInHTMLFileMapped);
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList class_names;
-        std::tie(filename, class_names) = future.resultAt(i);
-        // Each class entry has a list of filenames that contain it
-        foreach(QString class_name, class_names) {
-            classes_in_html[class_name].append(filename);
-        }
-    }
-
-    return classes_in_html;
+    // Each class entry has a list of filenames that contain it
+    return m_Index->GetFilesByFact(BookIndex::Classes);
 }
 
 std::tuple<QString, QStringList> Book::GetClassesInHTMLFileMapped(HTMLResource *html_resource)
@@ -840,7 +836,7 @@ QStringList Book::GetClassesInHTMLFile(QString filename)
     QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(true);
     foreach(HTMLResource *html_resource, html_resources) {
         if (html_resource->Filename() == filename) {
-            return XhtmlDoc::GetAllDescendantClasses(html_resource->GetText());
+            return m_Index->GetFacts(html_resource, BookIndex::Classes);
         }
     }
     return QStringList();
@@ -848,88 +844,27 @@ QStringList Book::GetClassesInHTMLFile(QString filename)
 
 QHash<QString, QStringList> Book::GetImagesInHTMLFiles()
 {
-    QHash<QString, QStringList> media_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetImagesInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList media_files;
-        std::tie(filename, media_files) = future.resultAt(i);
-        media_in_html[filename] = media_files;
-    }
-
-    return media_in_html;
+    return m_Index->GetFactsByFile(BookIndex::Images);
 }
 
 QHash<QString, QStringList> Book::GetVideoInHTMLFiles()
 {
-    QHash<QString, QStringList> media_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetVideoInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList media_files;
-        std::tie(filename, media_files) = future.resultAt(i);
-        media_in_html[filename] = media_files;
-    }
-
-    return media_in_html;
+    return m_Index->GetFactsByFile(BookIndex::Video);
 }
 
 QHash<QString, QStringList> Book::GetAudioInHTMLFiles()
 {
-    QHash<QString, QStringList> media_in_html;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetAudioInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList media_files;
-        std::tie(filename, media_files) = future.resultAt(i);
-        media_in_html[filename] = media_files;
-    }
-
-    return media_in_html;
+    return m_Index->GetFactsByFile(BookIndex::Audio);
 }
 
 QHash<QString, QStringList> Book::GetHTMLFilesUsingMedia()
 {
-    QHash<QString, QStringList> html_files;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetMediaInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString html_filename;
-        QStringList media_filenames;
-        std::tie(html_filename, media_filenames) = future.resultAt(i);
-        foreach(QString media_filename, media_filenames) {
-            html_files[media_filename].append(html_filename);
-        }
-    }
-
-    return html_files;
+    return m_Index->GetFilesByFact(BookIndex::Media);
 }
 
 QHash<QString, QStringList> Book::GetHTMLFilesUsingImages()
 {
-    QHash<QString, QStringList> html_files;
-    const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetImagesInHTMLFileMapped);
-
-    for (int i = 0; i < future.results().count(); i++) {
-        QString html_filename;
-        QStringList media_filenames;
-        std::tie(html_filename, media_filenames) = future.resultAt(i);
-        foreach(QString media_filename, media_filenames) {
-            html_files[media_filename].append(html_filename);
-        }
-    }
-
-    return html_files;
+    return m_Index->GetFilesByFact(BookIndex::Images);
 }
 
 
@@ -961,9 +896,10 @@ std::tuple<QString, QStringList> Book::GetAudioInHTMLFileMapped(HTMLResource *ht
 QList<HTMLResource *> Book::GetNonWellFormedHTMLFiles()
 {
     QList<HTMLResource *> malformed_resources;
+    const QHash<QString, QStringList> errors_by_file = m_Index->GetFactsByFile(BookIndex::WellFormedErrors);
 
     foreach (HTMLResource *h, m_Mainfolder->GetResourceTypeList<HTMLResource>(false)) {
-      if (!IsDataWellFormed(h)) {
+        if (!errors_by_file.value(h->Filename()).isEmpty()) {
             malformed_resources << h;
         }
     }
@@ -992,38 +928,66 @@ QStringList Book::GetWordsInHTMLFileMapped(HTMLResource *html_resource)
 
 QHash<QString, int> Book::GetUniqueWordsInHTMLFiles()
 {
-    QHash<QString, int> all_words;
     const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<QStringList> future = QtConcurrent::mapped(html_resources, GetWordsInHTMLFileMapped);
+    // Each file is counted on its own thread and the counts merged as they come in
+    return QtConcurrent::blockingMappedReduced(html_resources, GetWordCountsInHTMLFileMapped, MergeWordCounts,
+                                               QtConcurrent::UnorderedReduce);
+}
 
-    for (int i = 0; i < future.results().count(); i++) {
-        QStringList result = future.resultAt(i);
-        foreach (QString word, result) {
-            if (all_words.contains(word)) {
-                all_words[word]++;
-            } else {
-                all_words[word] = 1;
-            }
-        }
+QHash<QString, int> Book::GetWordCountsInHTMLFileMapped(HTMLResource *html_resource)
+{
+    QHash<QString, int> word_counts;
+    foreach(QString word, GetWordsInHTMLFileMapped(html_resource)) {
+        word_counts[word]++;
+    }
+    return word_counts;
+}
+
+void Book::MergeWordCounts(QHash<QString, int> &all_words, const QHash<QString, int> &word_counts)
+{
+    if (all_words.isEmpty()) {
+        all_words = word_counts;
+        return;
     }
 
-    return all_words;
+    QHashIterator<QString, int> it(word_counts);
+
+    while (it.hasNext()) {
+        it.next();
+        all_words[it.key()] += it.value();
+    }
 }
 
-QHash<QString, QStringList> Book::GetStylesheetsInHTMLFiles()
+QHash<QString, QHash<QString, int>> Book::GetUniqueWordsByLanguageInHTMLFiles()
 {
-    QHash<QString, QStringList> links_in_html;
     const QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(false);
-    QFuture<std::tuple<QString, QStringList>> future = QtConcurrent::mapped(html_resources, GetStylesheetsInHTMLFileMapped);
+    return QtConcurrent::blockingMappedReduced(html_resources, GetLanguageWordCountsInHTMLFileMapped,
+                                               MergeLanguageWordCounts, QtConcurrent::UnorderedReduce);
+}
 
-    for (int i = 0; i < future.results().count(); i++) {
-        QString filename;
-        QStringList links;
-        std::tie(filename, links) = future.resultAt(i);
-        links_in_html[filename] = links;
+QHash<QString, QHash<QString, int>> Book::GetLanguageWordCountsInHTMLFileMapped(HTMLResource *html_resource)
+{
+    QHash<QString, QHash<QString, int>> word_counts;
+    foreach(HTMLSpellCheck::MisspelledWord word, HTMLSpellCheck::GetWords(html_resource->GetText())) {
+        word_counts[word.lang][word.text]++;
     }
+    return word_counts;
+}
 
-    return links_in_html;
+void Book::MergeLanguageWordCounts(QHash<QString, QHash<QString, int>> &all_words,
+                                   const QHash<QString, QHash<QString, int>> &word_counts)
+{
+    QHashIterator<QString, QHash<QString, int>> it(word_counts);
+
+    while (it.hasNext()) {
+        it.next();
+        MergeWordCounts(all_words[it.key()], it.value());
+    }
+}
+
+QHash<QString, QStringList> Book::GetStylesheetsInHTMLFiles()
+{
+    return m_Index->GetFactsByFile(BookIndex::Stylesheets);
 }
 
 std::tuple<QString, QStringList> Book::GetStylesheetsInHTMLFileMapped(HTMLResource *html_resource)
@@ -1034,7 +998,7 @@ std::tuple<QString, QStringList> Book::GetStylesheetsInHTMLFileMapped(HTMLResour
 
 QStringList Book::GetStylesheetsInHTMLFile(HTMLResource *html_resource)
 {
-    return XhtmlDoc::GetLinkedStylesheets(html_resource->GetText());
+    return m_Index->GetFacts(html_resource, BookIndex::Stylesheets);
 }
 
 
@@ -1058,59 +1022,278 @@ Resource *Book::MergeResources(QList<Resource *> resources)
         return sink_resource;
     }
 
-    QStringList new_bodies;
-    QList<QString> merged_filenames;
-    QString version = sink_html_resource->GetEpubVersion();
-    {
-        GumboInterface gi = GumboInterface(sink_html_resource->GetText(), version);
-        new_bodies << gi.get_body_contents();
-        Resource *failed_resource = NULL;
-        
-        // Now iterate across all the other resources merging them into this resource
-        foreach(Resource *source_resource, resources) {
-
-            // Set progress value and ensure dialog has time to display when doing extensive updates
-            progress.setValue(progress_value++);
-            qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
-
-            HTMLResource *source_html_resource = qobject_cast<HTMLResource *>(source_resource);
-            if (!IsDataWellFormed(source_html_resource)) {
-                failed_resource = source_resource;
-                break;
-            }
+    // Every file is checked before anything is changed, so a failed merge leaves the book as it was
+    QList<HTMLResource *> source_html_resources;
+    foreach(Resource *source_resource, resources) {
+        // Set progress value and ensure dialog has time to display when doing extensive updates
+        progress.setValue(progress_value++);
+        qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
 
-            // Get the html document for this source resource.
-            GumboInterface ngi = GumboInterface(source_html_resource->GetText(), version);
-            new_bodies << ngi.get_body_contents();
-            merged_filenames.append(Utility::URLEncodePath(source_resource->Filename()));
+        HTMLResource *source_html_resource = qobject_cast<HTMLResource *>(source_resource);
+        if (!IsDataWellFormed(source_html_resource)) {
+            return source_resource;
         }
+        source_html_resources.append(source_html_resource);
+    }
 
-        if (failed_resource != NULL) {
-            // Abort the merge process. We will discard whatever we had merged so far
-            return failed_resource;
+    QSet<QString> merged_filenames;
+    QStringList merged_links;
+    foreach(HTMLResource *source_html_resource, source_html_resources) {
+        merged_filenames.insert(source_html_resource->Filename());
+        merged_links.append(Utility::URLEncodePath(source_html_resource->Filename()));
+    }
+    QSet<QString> merged_hrefs;
+    foreach(QString merged_link, merged_links) {
+        merged_hrefs.insert("../" % TEXT_FOLDER_NAME % "/" % merged_link);
+    }
+    const QString sink_href = "../" % TEXT_FOLDER_NAME % "/" % Utility::URLEncodePath(sink_resource->Filename());
+
+    // Only the files that link to one of the merged files need their links reconciled
+    QList<HTMLResource *> linking_resources;
+    foreach(QString filename, m_Index->GetFilesLinkingTo(merged_filenames)) {
+        if (merged_filenames.contains(filename) || filename == sink_resource->Filename()) {
+            continue;
         }
-        QString new_body = new_bodies.join("");
-        QString new_source = gi.perform_body_updates(new_body);
-        // Now all fragments have been merged into this sink document, serialize and store it.
-        sink_html_resource->SetText(new_source);
-        // Now safe to do the delete
-        foreach(Resource *source_resource, resources) {
-            // Need to alert FolderKeeper that these are going away to properly update its
-            // m_Resources hash to prevent stale values from deleted resources hanging around
-            m_Mainfolder->RemoveResource(source_resource);
-            source_resource->Delete();
+
+        try {
+            HTMLResource *html_resource = qobject_cast<HTMLResource *>(m_Mainfolder->GetResourceByFilename(filename));
+            if (html_resource) {
+                linking_resources.append(html_resource);
+            }
+        } catch (ResourceDoesNotExist) {
+            continue;
         }
     }
+
+    // One parse per file. Links between the merged files are pointed at the sink
+    // as each body is taken, so the merged document needs no anchor pass of its own.
+    const QStringList source_bodies = QtConcurrent::blockingMapped<QStringList>(source_html_resources,
+            std::bind(GetMergeBodyContents, std::placeholders::_1, merged_hrefs, sink_href));
+    GumboInterface gi = GumboInterface(sink_html_resource->GetText(), sink_html_resource->GetEpubVersion());
+    gi.parse();
+    UpdateMergeLinks(gi, merged_hrefs, sink_href);
+    const QString sink_body = gi.get_body_contents();
+    int new_body_length = sink_body.length();
+    foreach(const QString &body, source_bodies) {
+        new_body_length += body.length();
+    }
+    QString new_body;
+    new_body.reserve(new_body_length);
+    new_body.append(sink_body);
+    foreach(const QString &body, source_bodies) {
+        new_body.append(body);
+    }
+    // Now all fragments have been merged into this sink document, serialize and store it.
+    sink_html_resource->SetText(gi.perform_body_updates(new_body));
+    // Now safe to do the delete
+    foreach(Resource *source_resource, resources) {
+        // Need to alert FolderKeeper that these are going away to properly update its
+        // m_Resources hash to prevent stale values from deleted resources hanging around
+        m_Mainfolder->RemoveResource(source_resource);
+        source_resource->Delete();
+    }
     progress.setValue(progress_value++);
     qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
     // It is the user's responsibility to ensure that all ids used across the two merged files are unique.
     // Reconcile all references to the files that were merged.
-    QList<HTMLResource *> html_resources = m_Mainfolder->GetResourceTypeList<HTMLResource>(true);
-    AnchorUpdates::UpdateAllAnchors(html_resources, merged_filenames, sink_html_resource);
+    if (!linking_resources.isEmpty()) {
+        AnchorUpdates::UpdateAllAnchors(linking_resources, merged_links, sink_html_resource);
+    }
     SetModified(true);
     return NULL;
 }
 
+
+QString Book::GetMergeBodyContents(HTMLResource *html_resource, const QSet<QString> &merged_hrefs, const QString &sink_href)
+{
+    Q_ASSERT(html_resource);
+    // Parsed from a snapshot of the text, without a lock held
+    GumboInterface gi = GumboInterface(html_resource->GetText(), html_resource->GetEpubVersion());
+    gi.parse();
+    UpdateMergeLinks(gi, merged_hrefs, sink_href);
+    return gi.get_body_contents();
+}
+
+
+void Book::UpdateMergeLinks(GumboInterface &gi, const QSet<QString> &merged_hrefs, const QString &sink_href)
+{
+    const QList<GumboNode*> anchor_nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_A);
+
+    for (int i = 0; i < anchor_nodes.length(); ++i) {
+        GumboNode* node = anchor_nodes.at(i);
+        GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "href");
+
+        if (attr && QUrl(QString::fromUtf8(attr->value)).isRelative()) {
+            QString href = QString::fromUtf8(attr->value);
+            int hash_index = href.indexOf(QChar('#'));
+            QString file_part = hash_index == -1 ? href : href.left(hash_index);
+
+            if (merged_hrefs.contains(file_part)) {
+                // Everything after the first # is the fragment, as in AnchorUpdates
+                QString fragment_id = href.mid(file_part.length() + 1);
+                QString new_href = fragment_id.isEmpty() ? sink_href : sink_href % "#" % fragment_id;
+                gumbo_attribute_set_value(attr, new_href.toUtf8().constData());
+            }
+        }
+    }
+}
+
+QList<QList<Resource *>> Book::GetDuplicateMediaGroups()
+{
+    // Only files of the same type and size can be identical, so only those are read
+    QHash<QString, QList<Resource *>> same_size;
+    QList<QString> size_keys;
+    foreach(Resource *resource, m_Mainfolder->GetResourceList()) {
+        Resource::ResourceType type = resource->Type();
+
+        if ((type != Resource::ImageResourceType && type != Resource::FontResourceType &&
+             type != Resource::AudioResourceType && type != Resource::VideoResourceType) ||
+            resource->HasDeferredContent()) {
+            continue;
+        }
+
+        QString key = QString::number(type) % "/" % QString::number(QFileInfo(resource->GetFullPath()).size());
+        if (!same_size.contains(key)) {
+            size_keys.append(key);
+        }
+        same_size[key].append(resource);
+    }
+
+    QList<Resource *> candidates;
+    foreach(QString key, size_keys) {
+        if (same_size.value(key).count() > 1) {
+            candidates.append(same_size.value(key));
+        }
+    }
+
+    QList<QList<Resource *>> groups;
+    if (candidates.isEmpty()) {
+        return groups;
+    }
+
+    const QList<QByteArray> hashes = QtConcurrent::blockingMapped<QList<QByteArray> >(candidates, GetFileContentHash);
+    QHash<QByteArray, int> group_of_hash;
+    for (int i = 0; i < candidates.count(); ++i) {
+        if (hashes.at(i).isEmpty()) {
+            continue;
+        }
+
+        QByteArray key = QByteArray::number(candidates.at(i)->Type()) + "/" + hashes.at(i);
+        int group = group_of_hash.value(key, -1);
+        if (group == -1) {
+            group_of_hash.insert(key, groups.count());
+            groups.append(QList<Resource *>() << candidates.at(i));
+        } else {
+            groups[group].append(candidates.at(i));
+        }
+    }
+
+    for (int i = groups.count() - 1; i >= 0; --i) {
+        if (groups.at(i).count() < 2) {
+            groups.removeAt(i);
+        }
+    }
+
+    return groups;
+}
+
+
+void Book::CollapseDuplicateMedia(const QList<QList<Resource *>> &groups)
+{
+    QHash<QString, QString> update;
+    QList<Resource *> duplicates;
+    {
+        // The cover moves to the kept file and the copies leave the manifest in one OPF update
+        OPFResource::Transaction opf_transaction(GetOPF());
+        foreach(const QList<Resource *> &group, groups) {
+            Resource *kept = group.first();
+            for (int i = 1; i < group.count(); ++i) {
+                Resource *duplicate = group.at(i);
+                ImageResource *image_resource = qobject_cast<ImageResource *>(duplicate);
+
+                if (image_resource && GetOPF()->IsCoverImage(image_resource)) {
+                    GetOPF()->SetResourceAsCoverImage(qobject_cast<ImageResource *>(kept));
+                }
+
+                update[ duplicate->GetRelativePathToRoot() ] = "../" + kept->GetRelativePathToOEBPS();
+                duplicates.append(duplicate);
+            }
+        }
+        m_Mainfolder->DeleteResources(duplicates);
+        opf_transaction.Commit();
+    }
+
+    if (update.isEmpty()) {
+        return;
+    }
+
+    // Only the HTML files that use one of the copies need to be rewritten
+    QList<Resource *> to_update;
+    foreach(HTMLResource *html_resource, m_Index->GetFilesReferencing(update.keys().toSet())) {
+        to_update.append(html_resource);
+    }
+    foreach(Resource *resource, m_Mainfolder->GetResourceList()) {
+        if (resource->Type() != Resource::HTMLResourceType) {
+            to_update.append(resource);
+        }
+    }
+    UniversalUpdates::PerformUniversalUpdates(true, to_update, update);
+    SetModified(true);
+}
+
+
+QByteArray Book::GetFileContentHash(Resource *resource)
+{
+    return resource->GetContentHash();
+}
+
+
+QList<Resource *> Book::OptimizeImages(qint64 &bytes_saved)
+{
+    QList<Resource *> images;
+    foreach(Resource *resource, m_Mainfolder->GetResourceList()) {
+        if (resource->Type() == Resource::ImageResourceType && !resource->HasDeferredContent()) {
+            images.append(resource);
+        }
+    }
+
+    bytes_saved = 0;
+    QList<Resource *> optimized;
+    if (images.isEmpty()) {
+        return optimized;
+    }
+
+    // The rewrites are Sigil's own, not changes made outside it
+    m_Mainfolder->SuspendWatchingResources();
+    const QList<qint64> savings = QtConcurrent::blockingMapped<QList<qint64> >(images, OptimizeImageFile);
+    m_Mainfolder->ResumeWatchingResources();
+
+    for (int i = 0; i < images.count(); ++i) {
+        if (savings.at(i) > 0) {
+            bytes_saved += savings.at(i);
+            optimized.append(images.at(i));
+        }
+    }
+
+    // Refreshes the image tabs, thumbnails and the pages showing the images
+    foreach(Resource *resource, optimized) {
+        resource->FileReplaced();
+    }
+
+    if (!optimized.isEmpty()) {
+        SetModified(true);
+    }
+
+    return optimized;
+}
+
+
+qint64 Book::OptimizeImageFile(Resource *resource)
+{
+    return ImageOptimizer::OptimizeFile(resource->GetFullPath());
+}
+
+
 QList <Resource *> Book::GetAllResources()
 {
     return m_Mainfolder->GetResourceList();
@@ -1118,9 +1301,29 @@ QList <Resource *> Book::GetAllResources()
 
 void Book::SaveAllResourcesToDisk()
 {
-    QList<Resource *> resources = m_Mainfolder->GetResourceList();
+    // Only what changed since it was last read or written goes to disk.
+    // The OPF and NCX are always written since saving them also tidies them.
+    QList<Resource *> dirty_resources;
+    foreach(Resource *resource, m_Mainfolder->GetResourceList()) {
+        if (resource->IsDirty() ||
+            resource->Type() == Resource::OPFResourceType ||
+            resource->Type() == Resource::NCXResourceType) {
+            dirty_resources.append(resource);
+        }
+    }
+
+    if (dirty_resources.isEmpty()) {
+        return;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(qBound(1, TaskScheduler::ThreadCount(), MAX_PARALLEL_SAVES));
+    QFutureSynchronizer<void> sync;
     m_Mainfolder->SuspendWatchingResources();
-    QtConcurrent::blockingMap(resources, SaveOneResourceToDisk);
+    foreach(Resource *resource, dirty_resources) {
+        sync.addFuture(QtConcurrent::run(&pool, SaveOneResourceToDisk, resource));
+    }
+    sync.waitForFinished();
     m_Mainfolder->ResumeWatchingResources();
 }
 
@@ -1161,54 +1364,20 @@ void Book::SetModified(bool modified)
     if (modified != old_modified_state) {
         emit ModifiedStateChanged(m_IsModified);
     }
+
+    if (modified) {
+        emit Changed();
+    }
 }
 
 std::tuple<bool, QString, QString> Book::HasUndefinedURLFragments()
 {
-    QList<HTMLResource *> html_resources = GetHTMLResources();
-    QStringList html_filenames;
-    bool hasUndefinedUrlFrags = false;
-
-    foreach(HTMLResource *html_resource, html_resources) {
-        html_filenames.append(html_resource->Filename());
-    }
-
-    QString filename = QString();
-    QString href = QString();
-    QString href_file = QString();
-    QString href_id = QString();
-    QString file = QString();
-
-    QHash<QString, QStringList> links = GetRelLinksInAllFiles(html_resources);
-    QHash<QString, QStringList> all_ids = GetIDsInAllFiles(html_resources);
+    const QList<QPair<QString, QString>> undefined = m_Index->GetUndefinedFragments();
 
-    foreach(HTMLResource *html_resource, html_resources) {
-        filename = html_resource->Filename();
-        foreach(href, links[filename]) {
-            QUrl url(href);
-            bool is_target_file = false;
-            if (url.scheme().isEmpty() || url.scheme() == "file") {
-                href_file = url.fileName();
-                href_id = url.fragment();
-                is_target_file = true;
-            }
-
-            if (is_target_file && !href_id.isEmpty()) {
-                file = href_file;
-                if (href_file.isEmpty()) {
-                    file = filename;
-                }
-                if (html_filenames.contains(file) && !all_ids[file].contains(href_id)) {
-                    hasUndefinedUrlFrags = true;
-                    break;
-                }
-            }
-        }
-        if (hasUndefinedUrlFrags) {
-            break;
-        }
+    if (undefined.isEmpty()) {
+        return std::make_tuple(false, QString(), QString());
     }
-    return std::make_tuple(hasUndefinedUrlFrags, href, filename);
+    return std::make_tuple(true, undefined.first().second, undefined.first().first);
 }
 
 QHash<QString, QStringList> Book::GetRelLinksInAllFiles(const QList<HTMLResource *> &html_resources)
@@ -1237,6 +1406,8 @@ QHash<QString, QStringList> Book::GetIDsInAllFiles(const QList<HTMLResource *> &
 
 void Book::SaveOneResourceToDisk(Resource *resource)
 {
+    // Lazily opened media must be on disk before the folder is used as a whole
+    resource->LoadDeferredContent();
     resource->SaveToDisk(true);
 }
 
@@ -1252,20 +1423,30 @@ Book::NewSectionResult Book::CreateOneNewSection(NewSection section_info,
 {
     QString filename = section_info.new_file_prefix % "_" % QString("%1").arg(section_info.file_suffix + 1, 4, 10, QChar('0')) + section_info.file_extension;
     QString fullfilepath = section_info.temp_folder_path + "/" + filename;
+
+    if (html_updates.isEmpty()) {
+        // Written straight to disk and loaded from there, the section
+        // starts out clean and can be evicted like any other
+        Utility::WriteUnicodeTextFile(CleanSource::Mend(section_info.source, GetConstOPF()->GetEpubVersion()), fullfilepath);
+        section_info.source.clear();
+        HTMLResource *html_resource = qobject_cast<HTMLResource *>(m_Mainfolder->AddContentFileToFolder(fullfilepath));
+        Q_ASSERT(html_resource);
+        html_resource->InitialLoad();
+        NewSectionResult section;
+        section.created_section = html_resource;
+        section.reading_order = section_info.reading_order;
+        return section;
+    }
+
     Utility::WriteUnicodeTextFile("PLACEHOLDER", fullfilepath);
     HTMLResource *html_resource = qobject_cast<HTMLResource *>(m_Mainfolder->AddContentFileToFolder(fullfilepath));
     Q_ASSERT(html_resource);
     QString version = html_resource->GetEpubVersion();
-
-    if (html_updates.isEmpty()) {
-        html_resource->SetText(CleanSource::Mend(section_info.source, version));
-    } else {
-        QString currentpath = html_resource->GetCurrentBookRelPath();
-        html_resource->SetText(PerformHTMLUpdates(CleanSource::Mend(section_info.source, version),
-                                             html_updates, QHash<QString, QString>(), 
-                                             currentpath, version)() );
-        html_resource->SetCurrentBookRelPath("");
-    }
+    QString currentpath = html_resource->GetCurrentBookRelPath();
+    html_resource->SetText(PerformHTMLUpdates(CleanSource::Mend(section_info.source, version),
+                                         html_updates, QHash<QString, QString>(), 
+                                         currentpath, version)() );
+    html_resource->SetCurrentBookRelPath("");
 
     NewSectionResult section;
     section.created_section = html_resource;
@@ -1273,13 +1454,9 @@ Book::NewSectionResult Book::CreateOneNewSection(NewSection section_info,
     return section;
 }
 
-QPair<QString, QStringList> Book::GetRelLinksInOneFile(HTMLResource *html_resource)
+static QStringList GetRelLinks(const QSharedPointer<const GumboTree> &tree, const QString &version)
 {
-    Q_ASSERT(html_resource);
-    QReadLocker locker(&html_resource->GetLock());
-    GumboInterface gi = GumboInterface(html_resource->GetText(), html_resource->GetEpubVersion());
-    gi.parse();
-    QPair<QString, QStringList> link_pair;
+    GumboInterface gi(tree, version);
     QStringList hreflist;
     const QList<GumboNode*> anchor_nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_A);
     for (int i = 0; i < anchor_nodes.length(); ++i) {
@@ -1291,23 +1468,43 @@ QPair<QString, QStringList> Book::GetRelLinksInOneFile(HTMLResource *html_resour
             hreflist.append(QString::fromUtf8(attr->value));
         }
     }
-    link_pair.first = html_resource->Filename();
-    link_pair.second = hreflist;
-    return link_pair;
+    return hreflist;
+}
+
+
+static QStringList GetIDs(const QSharedPointer<const GumboTree> &tree, const QString &version)
+{
+    GumboInterface gi(tree, version);
+    return gi.get_all_values_for_attribute(QString("id"));
+}
+
+
+QPair<QString, QStringList> Book::GetRelLinksInOneFile(HTMLResource *html_resource)
+{
+    Q_ASSERT(html_resource);
+    // The cached tree is of a snapshot of the text, no lock is needed
+    QStringList hreflist = GetRelLinks(GumboCache::Get(html_resource), html_resource->GetEpubVersion());
+    return qMakePair(html_resource->Filename(), hreflist);
+}
+
+
+QStringList Book::GetRelLinksInOneSnapshot(HTMLResource *html_resource, const TextResource::Snapshot &snapshot)
+{
+    Q_ASSERT(html_resource);
+    return GetRelLinks(GumboCache::Get(html_resource, snapshot), html_resource->GetEpubVersion());
 }
 
 
 QPair<QString, QStringList> Book::GetOneFileIDs(HTMLResource *html_resource)
 {
     Q_ASSERT(html_resource);
-    QReadLocker locker(&html_resource->GetLock());
-    QString newsource = html_resource->GetText();
-    QString version = html_resource->GetEpubVersion();
-    GumboInterface gi = GumboInterface(newsource, version);
-    gi.parse();
-    QPair<QString, QStringList> id_pair;
-    QStringList ids = gi.get_all_values_for_attribute(QString("id"));
-    id_pair.first = html_resource->Filename();
-    id_pair.second = ids;
-    return id_pair;
+    QStringList ids = GetIDs(GumboCache::Get(html_resource), html_resource->GetEpubVersion());
+    return qMakePair(html_resource->Filename(), ids);
+}
+
+
+QStringList Book::GetOneSnapshotIDs(HTMLResource *html_resource, const TextResource::Snapshot &snapshot)
+{
+    Q_ASSERT(html_resource);
+    return GetIDs(GumboCache::Get(html_resource, snapshot), html_resource->GetEpubVersion());
 }
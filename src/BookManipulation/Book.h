@@ -26,12 +26,16 @@
 
 #include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 #include <QtCore/QUrl>
 #include <QtCore/QVariant>
 #include "ResourceObjects/OPFParser.h"
 #include "BookManipulation/XhtmlDoc.h"
 #include "ResourceObjects/Resource.h"
+#include "ResourceObjects/TextResource.h"
 
+class BookCheckpoints;
+class BookIndex;
 class CSSResource;
 class SVGResource;
 class FolderKeeper;
@@ -53,8 +57,10 @@ public:
 
     /**
      * Constructor.
+     *
+     * @param workspace_size The expected size of the unpacked book in bytes.
      */
-    Book();
+    Book(qint64 workspace_size = 0);
 
     ~Book();
 
@@ -79,6 +85,16 @@ public:
      */
     const FolderKeeper *GetFolderKeeper() const;
 
+    /**
+     * Returns the index of the references in the book's HTML files.
+     */
+    BookIndex *GetIndex();
+
+    /**
+     * Returns the states of the book kept from before book-wide changes.
+     */
+    BookCheckpoints *GetCheckpoints();
+
     /**
      * Returns the book's OPF file.
      *
@@ -197,11 +213,11 @@ public:
      * The only reason why we have an overload instead of just one function
      * with a default argument is because then Apple GCC 4.2 flakes out here.
      *
-     * @param new_sections The contents of the new sections.
+     * @param new_sections The new sections, made one at a time as needed.
      * @param originating_resource The original HTML section that sections
      * will be created after.
      */
-    void CreateNewSections(const QStringList &new_sections,
+    void CreateNewSections(const XhtmlDoc::SGFSections &new_sections,
                            HTMLResource *originalResource);
 
     /**
@@ -232,6 +248,17 @@ public:
     static QStringList GetWordsInHTMLFileMapped(HTMLResource *html_resource);
 
     QHash<QString, int> GetUniqueWordsInHTMLFiles();
+    static QHash<QString, int> GetWordCountsInHTMLFileMapped(HTMLResource *html_resource);
+    static void MergeWordCounts(QHash<QString, int> &all_words, const QHash<QString, int> &word_counts);
+
+    /**
+     * The same as GetUniqueWordsInHTMLFiles(), with the words kept apart
+     * by the language of the text they are in, "" where none is given.
+     */
+    QHash<QString, QHash<QString, int>> GetUniqueWordsByLanguageInHTMLFiles();
+    static QHash<QString, QHash<QString, int>> GetLanguageWordCountsInHTMLFileMapped(HTMLResource *html_resource);
+    static void MergeLanguageWordCounts(QHash<QString, QHash<QString, int>> &all_words,
+                                        const QHash<QString, QHash<QString, int>> &word_counts);
 
     QHash<QString, QStringList> GetStylesheetsInHTMLFiles();
     static std::tuple<QString, QStringList> GetStylesheetsInHTMLFileMapped(HTMLResource *html_resource);
@@ -258,6 +285,29 @@ public:
      */
     Resource *MergeResources(QList<Resource *> resources);
 
+    /**
+     * Finds the image, font, audio and video files whose content is
+     * identical. Files not yet extracted from the archive are left out.
+     *
+     * @return Groups of two or more identical files, the one to keep first.
+     */
+    QList<QList<Resource *>> GetDuplicateMediaGroups();
+
+    /**
+     * Keeps the first file of each group, points every reference to the
+     * others at it and deletes them.
+     */
+    void CollapseDuplicateMedia(const QList<QList<Resource *>> &groups);
+
+    /**
+     * Makes the PNG and JPEG files smaller without changing how they look.
+     * Files not yet extracted from the archive are left out.
+     *
+     * @param bytes_saved Set to how much smaller the files got in total.
+     * @return The image files that were rewritten.
+     */
+    QList<Resource *> OptimizeImages(qint64 &bytes_saved);
+
     QList <Resource *> GetAllResources();
 
     /**
@@ -323,6 +373,30 @@ public:
      */
     static QHash<QString, QStringList> GetIDsInAllFiles(const QList<HTMLResource *> &html_resources);
 
+    /**
+     * Get all href values in all relative links from one HTMLResource
+     * Return QPair(filename, hrefs).
+     */
+    static QPair<QString, QStringList> GetRelLinksInOneFile(HTMLResource *html_resource);
+
+    /**
+     * Get all href values in all relative links from the text of one
+     * snapshot of an HTMLResource.
+     */
+    static QStringList GetRelLinksInOneSnapshot(HTMLResource *html_resource,
+                                                const TextResource::Snapshot &snapshot);
+
+    /**
+     * Get all id values from one HTMLResource. Return QPair(filename, ids).
+     */
+    static QPair<QString, QStringList> GetOneFileIDs(HTMLResource *html_resource);
+
+    /**
+     * Get all id values from the text of one snapshot of an HTMLResource.
+     */
+    static QStringList GetOneSnapshotIDs(HTMLResource *html_resource,
+                                         const TextResource::Snapshot &snapshot);
+
 public slots:
 
     /**
@@ -346,6 +420,12 @@ signals:
      */
     void ModifiedStateChanged(bool new_state);
 
+    /**
+     * Emitted every time the book is marked as modified,
+     * whether or not it already was.
+     */
+    void Changed();
+
     void ResourceUpdatedFromDiskRequest(Resource *resource);
 
 private:
@@ -391,6 +471,32 @@ private:
      */
     static void SaveOneResourceToDisk(Resource *resource);
 
+    /**
+     * @return The hash of a resource's file, empty if it cannot be read.
+     */
+    static QByteArray GetFileContentHash(Resource *resource);
+
+    /**
+     * @return The bytes saved by optimizing one image file.
+     */
+    static qint64 OptimizeImageFile(Resource *resource);
+
+    /**
+     * @return The body contents of one file being merged, with its links
+     *         to the merged files pointed at the sink.
+     */
+    static QString GetMergeBodyContents(HTMLResource *html_resource,
+                                        const QSet<QString> &merged_hrefs,
+                                        const QString &sink_href);
+
+    /**
+     * Points the links in gi to any of merged_hrefs at sink_href,
+     * keeping their fragments.
+     */
+    static void UpdateMergeLinks(GumboInterface &gi,
+                                 const QSet<QString> &merged_hrefs,
+                                 const QString &sink_href);
+
     /**
      * Creates one new section/XHTML document.
      *
@@ -409,17 +515,6 @@ private:
     NewSectionResult CreateOneNewSection(NewSection section_info,
                                          const QHash<QString, QString> &html_updates);
 
-    /**
-     * Get all href values in all relative links from one HTMLResource
-     * Return QPair(filename, hrefs).
-     */
-    static QPair<QString, QStringList> GetRelLinksInOneFile(HTMLResource *html_resource);
-
-    /**
-     * Get all id values from one HTMLResource. Return QPair(filename, ids).
-     */
-    static QPair<QString, QStringList> GetOneFileIDs(HTMLResource *html_resource);
-
 
     ////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -431,6 +526,15 @@ private:
      */
     FolderKeeper *m_Mainfolder;
 
+    /**
+     * What the HTML files reference, kept up to date per file.
+     */
+    BookIndex *m_Index;
+
+    /**
+     * The states of the book that can be brought back.
+     */
+    BookCheckpoints *m_Checkpoints;
 
     /**
      * Stores the modified state of the book.
@@ -0,0 +1,373 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <utility>
+
+#include <QtConcurrent/QtConcurrent>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+
+#include "BookManipulation/BookCheckpoints.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "Misc/Utility.h"
+#include "ResourceObjects/Resource.h"
+
+// How many checkpoints are kept, the oldest is dropped first
+static const int MAX_CHECKPOINTS = 10;
+
+
+BookCheckpoints::BookCheckpoints(FolderKeeper *folder, qint64 workspace_size)
+    :
+    m_Folder(folder),
+    m_Store(workspace_size)
+{
+}
+
+
+void BookCheckpoints::Create(const QString &description)
+{
+    Checkpoint checkpoint;
+    checkpoint.description = description;
+    checkpoint.time = QDateTime::currentDateTime();
+    const QList<Resource *> resources = m_Folder->GetResourceList();
+    // Hashing and keeping the files not kept yet is the only real work
+    const QList<Entry> entries = QtConcurrent::blockingMapped<QList<Entry> >(resources,
+                                 std::bind(&BookCheckpoints::CreateEntry, this, std::placeholders::_1));
+
+    for (int i = 0; i < resources.count(); ++i) {
+        checkpoint.entries.insert(resources.at(i)->GetRelativePath(), entries.at(i));
+    }
+
+    m_Checkpoints.append(checkpoint);
+
+    while (m_Checkpoints.count() > MAX_CHECKPOINTS) {
+        m_Checkpoints.removeFirst();
+    }
+
+    RemoveUnusedFiles();
+}
+
+
+int BookCheckpoints::Count() const
+{
+    return m_Checkpoints.count();
+}
+
+
+QStringList BookCheckpoints::GetDescriptions() const
+{
+    QStringList descriptions;
+
+    for (int i = m_Checkpoints.count() - 1; i >= 0; --i) {
+        const Checkpoint &checkpoint = m_Checkpoints.at(i);
+        descriptions.append(checkpoint.time.toString(Qt::DefaultLocaleShortDate) + " - " + checkpoint.description);
+    }
+
+    return descriptions;
+}
+
+
+QList<Resource *> BookCheckpoints::GetAddedSince(int checkpoint) const
+{
+    QList<Resource *> added;
+
+    if (checkpoint < 0 || checkpoint >= m_Checkpoints.count()) {
+        return added;
+    }
+
+    const Checkpoint &state = m_Checkpoints.at(m_Checkpoints.count() - 1 - checkpoint);
+    foreach(Resource *resource, m_Folder->GetResourceList()) {
+        // The book never goes without these, they are restored in place
+        if (resource->Type() == Resource::OPFResourceType || resource->Type() == Resource::NCXResourceType) {
+            continue;
+        }
+
+        if (!state.entries.contains(resource->GetRelativePath())) {
+            added.append(resource);
+        }
+    }
+    return added;
+}
+
+
+bool BookCheckpoints::Restore(int checkpoint, QString &error)
+{
+    if (checkpoint < 0 || checkpoint >= m_Checkpoints.count()) {
+        return false;
+    }
+
+    const Checkpoint &state = m_Checkpoints.at(m_Checkpoints.count() - 1 - checkpoint);
+    QStringList failed;
+    m_Folder->SuspendWatchingResources();
+    const QList<Resource *> added = GetAddedSince(checkpoint);
+
+    if (!added.isEmpty()) {
+        m_Folder->DeleteResources(added);
+    }
+
+    QHash<QString, Resource *> current;
+    foreach(Resource *resource, m_Folder->GetResourceList()) {
+        current.insert(resource->GetRelativePath(), resource);
+    }
+
+    // The files deleted since are written out and added back as new resources,
+    // each to its own folder in case two had the same name
+    TempFolder scratch;
+    QList<std::pair<QString, QString>> files;
+    QStringList readded_paths;
+    QHash<QString, Entry>::const_iterator it;
+
+    for (it = state.entries.constBegin(); it != state.entries.constEnd(); ++it) {
+        if (current.contains(it.key())) {
+            continue;
+        }
+
+        const QString folder = scratch.GetPath() + "/" + QString::number(files.count());
+        const QString path = folder + "/" + QFileInfo(it.key()).fileName();
+
+        if (!QDir().mkpath(folder) || !WriteEntry(it.value(), path)) {
+            failed.append(it.key());
+            continue;
+        }
+
+        files.append(std::make_pair(path, it.value().media_type));
+        readded_paths.append(it.key());
+    }
+
+    const QList<Resource *> readded = m_Folder->AddContentFilesToFolder(files, false);
+
+    for (int i = 0; i < readded.count(); ++i) {
+        // Added where its type goes, which may not be where it was
+        if (!readded.at(i) || readded.at(i)->GetRelativePath() != readded_paths.at(i)) {
+            failed.append(readded_paths.at(i));
+        }
+    }
+
+    // The OPF and NCX last, the deletions and additions above change them
+    QList<Resource *> package_resources;
+
+    for (it = state.entries.constBegin(); it != state.entries.constEnd(); ++it) {
+        Resource *resource = current.value(it.key());
+
+        if (!resource) {
+            continue;
+        }
+
+        if (resource->Type() == Resource::OPFResourceType || resource->Type() == Resource::NCXResourceType) {
+            package_resources.append(resource);
+            continue;
+        }
+
+        if (!RestoreEntry(resource, it.value())) {
+            failed.append(it.key());
+        }
+    }
+
+    foreach(Resource *resource, package_resources) {
+        if (!RestoreEntry(resource, state.entries.value(resource->GetRelativePath()))) {
+            failed.append(resource->GetRelativePath());
+        }
+    }
+
+    m_Folder->ResumeWatchingResources();
+
+    if (!failed.isEmpty()) {
+        error = QObject::tr("These files could not be restored: %1").arg(failed.join(", "));
+        return false;
+    }
+
+    return true;
+}
+
+
+void BookCheckpoints::Clear()
+{
+    m_Checkpoints.clear();
+    RemoveUnusedFiles();
+}
+
+
+BookCheckpoints::Entry BookCheckpoints::CreateEntry(Resource *resource)
+{
+    Entry entry;
+    entry.media_type = resource->GetMediaType();
+    entry.has_text = false;
+    TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+    // Held by reference; an edit made afterwards gets its own copy
+    if (text_resource && text_resource->HasTextInMemory()) {
+        entry.has_text = true;
+        entry.text = text_resource->GetSnapshot();
+        return entry;
+    }
+
+    if (resource->HasDeferredContent()) {
+        entry.loader = resource->GetDeferredContent();
+
+        // Unless it was written out in the meantime
+        if (entry.loader) {
+            if (resource->HasContentHash()) {
+                entry.hash = resource->GetContentHash();
+            }
+
+            return entry;
+        }
+    }
+
+    entry.hash = StoreFile(resource);
+    return entry;
+}
+
+
+QByteArray BookCheckpoints::StoreFile(Resource *resource)
+{
+    const QByteArray hash = resource->GetContentHash();
+
+    if (hash.isEmpty()) {
+        return hash;
+    }
+
+    {
+        QMutexLocker locker(&m_StoreMutex);
+
+        if (m_StoredFiles.contains(hash)) {
+            return hash;
+        }
+    }
+
+    const QString stored_path = m_Store.GetPath() + "/" + QString::fromLatin1(hash.toHex());
+    // Another resource with the same content may be kept at the same time
+    const QString cloned_path = stored_path + "." + resource->GetIdentifier();
+
+    if (!Utility::CloneFile(resource->GetFullPath(), cloned_path)) {
+        QFile::remove(cloned_path);
+        return QByteArray();
+    }
+
+    QMutexLocker locker(&m_StoreMutex);
+
+    if (m_StoredFiles.contains(hash) || !QFile::rename(cloned_path, stored_path)) {
+        QFile::remove(cloned_path);
+        return m_StoredFiles.contains(hash) ? hash : QByteArray();
+    }
+
+    m_StoredFiles.insert(hash, stored_path);
+    return hash;
+}
+
+
+bool BookCheckpoints::WriteEntry(const Entry &entry, const QString &path) const
+{
+    if (entry.has_text) {
+        Utility::WriteUnicodeTextFile(entry.text.text, path);
+        return QFileInfo(path).exists();
+    }
+
+    if (entry.loader) {
+        return entry.loader(path);
+    }
+
+    const QString stored_path = m_StoredFiles.value(entry.hash);
+    return !stored_path.isEmpty() && Utility::CloneFile(stored_path, path);
+}
+
+
+bool BookCheckpoints::RestoreEntry(Resource *resource, const Entry &entry) const
+{
+    if (entry.has_text) {
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        if (!text_resource) {
+            return false;
+        }
+
+        if (text_resource->GetTextRevision() != entry.text.revision) {
+            text_resource->SetText(entry.text.text);
+        }
+
+        return true;
+    }
+
+    if (entry.loader) {
+        if (resource->HasDeferredContent() ||
+            (!entry.hash.isEmpty() && resource->GetContentHash() == entry.hash)) {
+            return true;
+        }
+
+        if (!entry.loader(resource->GetFullPath())) {
+            return false;
+        }
+    } else {
+        if (resource->GetContentHash() == entry.hash) {
+            return true;
+        }
+
+        const QString stored_path = m_StoredFiles.value(entry.hash);
+
+        if (stored_path.isEmpty()) {
+            return false;
+        }
+
+        // A clone of its own, the kept file may be shared
+        const QString path = resource->GetFullPath();
+        QFile::remove(path);
+
+        if (!Utility::CloneFile(stored_path, path)) {
+            return false;
+        }
+    }
+
+    resource->FileReplaced();
+
+    if (!entry.hash.isEmpty()) {
+        resource->SetContentHash(entry.hash);
+    }
+
+    return true;
+}
+
+
+void BookCheckpoints::RemoveUnusedFiles()
+{
+    QSet<QByteArray> used;
+    foreach(const Checkpoint &checkpoint, m_Checkpoints) {
+        foreach(const Entry &entry, checkpoint.entries) {
+            if (!entry.has_text && !entry.loader && !entry.hash.isEmpty()) {
+                used.insert(entry.hash);
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_StoreMutex);
+    QHash<QByteArray, QString>::iterator it = m_StoredFiles.begin();
+
+    while (it != m_StoredFiles.end()) {
+        if (used.contains(it.key())) {
+            ++it;
+        } else {
+            QFile::remove(it.value());
+            it = m_StoredFiles.erase(it);
+        }
+    }
+}
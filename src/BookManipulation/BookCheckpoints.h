@@ -0,0 +1,175 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef BOOKCHECKPOINTS_H
+#define BOOKCHECKPOINTS_H
+
+#include <functional>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/TempFolder.h"
+#include "ResourceObjects/TextResource.h"
+
+class FolderKeeper;
+class Resource;
+
+/**
+ * States of the whole book kept from before book-wide changes such as
+ * Replace All, Mend or a plugin run, so that any one of them can be
+ * brought back in a single step.
+ *
+ * A checkpoint holds no copy of the text that is in memory: it keeps
+ * the implicitly shared snapshot of each text, which a later edit
+ * replaces rather than changes. Other files are kept once per content
+ * hash, cloned where the file system can (so that only the blocks
+ * written afterwards take space) and shared by every checkpoint that
+ * has them; a lazily opened file that was never written keeps only
+ * its loader. Only the most recent MAX_CHECKPOINTS are kept.
+ */
+class BookCheckpoints
+{
+public:
+
+    BookCheckpoints(FolderKeeper *folder, qint64 workspace_size = 0);
+
+    /**
+     * Keeps the current state of the book as the newest checkpoint,
+     * dropping the oldest one if there are too many. GUI thread only,
+     * with the tab content saved to the resources.
+     *
+     * @param description What is about to be done, shown to the user.
+     */
+    void Create(const QString &description);
+
+    /**
+     * @return The number of checkpoints kept.
+     */
+    int Count() const;
+
+    /**
+     * @return The time and description of each checkpoint, newest first.
+     */
+    QStringList GetDescriptions() const;
+
+    /**
+     * @return The resources that are in the book now but were not at
+     *         the checkpoint; Restore() deletes them.
+     */
+    QList<Resource *> GetAddedSince(int checkpoint) const;
+
+    /**
+     * Brings the book back to the state it was in at a checkpoint,
+     * newest first. The checkpoint and the older ones are kept.
+     * Views of the resources that Restore() deletes must be closed first.
+     *
+     * @param error Set to the files that could not be restored.
+     * @return \c true if every file was restored.
+     */
+    bool Restore(int checkpoint, QString &error);
+
+    /**
+     * Drops all the checkpoints.
+     */
+    void Clear();
+
+private:
+
+    /**
+     * What one resource was at a checkpoint.
+     */
+    struct Entry {
+        QString media_type;
+
+        // The text when it was in memory
+        bool has_text;
+        TextResource::Snapshot text;
+
+        // The hash of the file otherwise, kept in m_StoredFiles;
+        // also known for a lazily opened file when it was given
+        QByteArray hash;
+
+        // Writes the content of a file that was not yet opened
+        std::function<bool (const QString &)> loader;
+    };
+
+    struct Checkpoint {
+        QString description;
+        QDateTime time;
+
+        // Keyed by the path relative to the main folder
+        QHash<QString, Entry> entries;
+    };
+
+    Entry CreateEntry(Resource *resource);
+
+    /**
+     * Keeps a copy of the resource's file under its content hash,
+     * unless one is kept already.
+     *
+     * @return The hash, or an empty array if the file could not be kept.
+     */
+    QByteArray StoreFile(Resource *resource);
+
+    /**
+     * Writes the content of entry to path, which does not exist.
+     */
+    bool WriteEntry(const Entry &entry, const QString &path) const;
+
+    /**
+     * Puts entry back into an existing resource unless it still has it.
+     */
+    bool RestoreEntry(Resource *resource, const Entry &entry) const;
+
+    /**
+     * Deletes the kept files no checkpoint refers to any more.
+     */
+    void RemoveUnusedFiles();
+
+    FolderKeeper *m_Folder;
+
+    /**
+     * The newest checkpoint last.
+     */
+    QList<Checkpoint> m_Checkpoints;
+
+    /**
+     * Where the files are kept, on the same volume as the book
+     * so that they can be cloned.
+     */
+    TempFolder m_Store;
+
+    /**
+     * The path of each kept file, by content hash.
+     * Guarded by m_StoreMutex while a checkpoint is created.
+     */
+    QHash<QByteArray, QString> m_StoredFiles;
+    QMutex m_StoreMutex;
+};
+
+#endif // BOOKCHECKPOINTS_H
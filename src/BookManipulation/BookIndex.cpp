@@ -0,0 +1,435 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+#include <QtCore/QUrl>
+#include <QtConcurrent/QtConcurrent>
+
+#include "BookManipulation/Book.h"
+#include "BookManipulation/BookIndex.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "BookManipulation/XhtmlDoc.h"
+#include "Misc/GumboCache.h"
+#include "Misc/GumboInterface.h"
+#include "Misc/Utility.h"
+#include "ResourceObjects/HTMLResource.h"
+
+BookIndex::FileFacts::FileFacts()
+    :
+    trigrams_revision(-1),
+    id_set_revision(-1),
+    checked_revision(-1)
+{
+    for (int i = 0; i < FactCount; ++i) {
+        revision[i] = -1;
+    }
+}
+
+
+BookIndex::BookIndex(FolderKeeper *folder)
+    :
+    m_Folder(folder)
+{
+}
+
+
+QStringList BookIndex::GetFacts(HTMLResource *html_resource, Fact fact)
+{
+    Refresh(QList<HTMLResource *>() << html_resource, fact);
+    QMutexLocker locker(&m_Mutex);
+    return m_Files.value(html_resource->GetIdentifier()).values[fact];
+}
+
+
+QHash<QString, QStringList> BookIndex::GetFactsByFile(Fact fact)
+{
+    const QList<HTMLResource *> html_resources = m_Folder->GetResourceTypeList<HTMLResource>(false);
+    Prune(html_resources);
+    Refresh(html_resources, fact);
+    QHash<QString, QStringList> facts_by_file;
+    QMutexLocker locker(&m_Mutex);
+    foreach(HTMLResource *html_resource, html_resources) {
+        facts_by_file[html_resource->Filename()] = m_Files.value(html_resource->GetIdentifier()).values[fact];
+    }
+    return facts_by_file;
+}
+
+
+QHash<QString, QStringList> BookIndex::GetFilesByFact(Fact fact)
+{
+    const QList<HTMLResource *> html_resources = m_Folder->GetResourceTypeList<HTMLResource>(false);
+    Prune(html_resources);
+    Refresh(html_resources, fact);
+    QHash<QString, QStringList> files_by_fact;
+    QMutexLocker locker(&m_Mutex);
+    foreach(HTMLResource *html_resource, html_resources) {
+        QString filename = html_resource->Filename();
+        foreach(QString value, m_Files.value(html_resource->GetIdentifier()).values[fact]) {
+            files_by_fact[value].append(filename);
+        }
+    }
+    return files_by_fact;
+}
+
+
+QStringList BookIndex::GetFilesLinkingTo(const QString &filename)
+{
+    return GetFilesLinkingTo(QSet<QString>() << filename);
+}
+
+
+QStringList BookIndex::GetFilesLinkingTo(const QSet<QString> &filenames)
+{
+    QStringList linking_files;
+    QHash<QString, QStringList> hrefs_by_file = GetFactsByFile(Hrefs);
+    QHashIterator<QString, QStringList> it(hrefs_by_file);
+
+    while (it.hasNext()) {
+        it.next();
+        foreach(QString href, it.value()) {
+            QUrl url(href);
+
+            if ((url.scheme().isEmpty() || url.scheme() == "file") && filenames.contains(url.fileName())) {
+                linking_files.append(it.key());
+                break;
+            }
+        }
+    }
+
+    return linking_files;
+}
+
+
+QList<HTMLResource *> BookIndex::GetFilesReferencing(const QSet<QString> &bookpaths)
+{
+    const QList<HTMLResource *> html_resources = m_Folder->GetResourceTypeList<HTMLResource>(false);
+    Prune(html_resources);
+    Refresh(html_resources, References);
+    QList<HTMLResource *> referencing;
+    QMutexLocker locker(&m_Mutex);
+    foreach(HTMLResource *html_resource, html_resources) {
+        // Resolved the same way GumboInterface does when it updates them
+        QString html_dir = QFileInfo(html_resource->GetCurrentBookRelPath()).dir().path();
+        foreach(QString reference, m_Files.value(html_resource->GetIdentifier()).values[References]) {
+            QString path = Utility::URLDecodePath(reference);
+            int fragment = path.lastIndexOf('#');
+            if (fragment != -1) {
+                path = path.left(fragment);
+            }
+            if (path.isEmpty()) {
+                continue;
+            }
+            if (bookpaths.contains(QDir::cleanPath(html_dir + "/" + path))) {
+                referencing.append(html_resource);
+                break;
+            }
+        }
+    }
+    return referencing;
+}
+
+
+QList<QPair<QString, QString>> BookIndex::GetUndefinedFragments()
+{
+    const QList<HTMLResource *> html_resources = m_Folder->GetResourceTypeList<HTMLResource>(false);
+    Prune(html_resources);
+    Refresh(html_resources, RelativeHrefs);
+    Refresh(html_resources, IdAttributes);
+    QHash<QString, QString> identifiers_by_filename;
+    foreach(HTMLResource *html_resource, html_resources) {
+        identifiers_by_filename[html_resource->Filename()] = html_resource->GetIdentifier();
+    }
+    QList<QPair<QString, QString>> undefined;
+    QMutexLocker locker(&m_Mutex);
+    foreach(HTMLResource *html_resource, html_resources) {
+        FileFacts &facts = m_Files[html_resource->GetIdentifier()];
+        const QString filename = html_resource->Filename();
+
+        if (!FragmentsChecked(facts, identifiers_by_filename)) {
+            CheckFragments(facts, filename, identifiers_by_filename);
+        }
+
+        foreach(QString href, facts.undefined_fragments) {
+            undefined.append(qMakePair(filename, href));
+        }
+    }
+    return undefined;
+}
+
+
+QList<HTMLResource *> BookIndex::GetFilesThatMayMatch(const QList<HTMLResource *> &html_resources,
+                                                      const QString &search_regex)
+{
+    const TrigramIndex::Trigrams required = TrigramIndex::Extract(TrigramIndex::RequiredLiterals(search_regex));
+
+    if (required.isEmpty()) {
+        return html_resources;
+    }
+
+    RefreshTrigrams(html_resources);
+    QList<HTMLResource *> candidates;
+    QMutexLocker locker(&m_Mutex);
+    foreach(HTMLResource *html_resource, html_resources) {
+        QHash<QString, FileFacts>::const_iterator it = m_Files.constFind(html_resource->GetIdentifier());
+
+        // Edited since, so nothing can be ruled out
+        if (it == m_Files.constEnd() ||
+            it.value().trigrams_revision != html_resource->GetTextRevision() ||
+            TrigramIndex::MayContain(it.value().trigrams, required)) {
+            candidates.append(html_resource);
+        }
+    }
+    return candidates;
+}
+
+
+void BookIndex::Clear()
+{
+    QMutexLocker locker(&m_Mutex);
+    m_Files.clear();
+}
+
+
+void BookIndex::Refresh(const QList<HTMLResource *> &html_resources, Fact fact)
+{
+    QList<Job> stale;
+    {
+        QMutexLocker locker(&m_Mutex);
+        foreach(HTMLResource *html_resource, html_resources) {
+            QHash<QString, FileFacts>::const_iterator it = m_Files.constFind(html_resource->GetIdentifier());
+
+            if (it == m_Files.constEnd() || it.value().revision[fact] != html_resource->GetTextRevision()) {
+                Job job;
+                job.resource = html_resource;
+                job.fact = fact;
+                stale.append(job);
+            }
+        }
+    }
+
+    if (stale.isEmpty()) {
+        return;
+    }
+
+    // The parsing is done without the lock held.
+    const QList<Extracted> extracted = QtConcurrent::blockingMapped(stale, ExtractOne);
+    QMutexLocker locker(&m_Mutex);
+    foreach(const Extracted &one, extracted) {
+        FileFacts &facts = m_Files[one.identifier];
+        facts.revision[one.fact] = one.revision;
+        facts.values[one.fact] = one.values;
+    }
+}
+
+
+void BookIndex::RefreshTrigrams(const QList<HTMLResource *> &html_resources)
+{
+    QList<HTMLResource *> stale;
+    {
+        QMutexLocker locker(&m_Mutex);
+        foreach(HTMLResource *html_resource, html_resources) {
+            QHash<QString, FileFacts>::const_iterator it = m_Files.constFind(html_resource->GetIdentifier());
+
+            if (it == m_Files.constEnd() || it.value().trigrams_revision != html_resource->GetTextRevision()) {
+                stale.append(html_resource);
+            }
+        }
+    }
+
+    if (stale.isEmpty()) {
+        return;
+    }
+
+    const QList<ExtractedTrigrams> extracted = QtConcurrent::blockingMapped(stale, ExtractTrigrams);
+    QMutexLocker locker(&m_Mutex);
+    foreach(const ExtractedTrigrams &one, extracted) {
+        FileFacts &facts = m_Files[one.identifier];
+        facts.trigrams_revision = one.revision;
+        facts.trigrams = one.trigrams;
+    }
+}
+
+
+const QSet<QString> &BookIndex::IdSet(FileFacts &facts)
+{
+    if (facts.id_set_revision != facts.revision[IdAttributes]) {
+        facts.id_set = facts.values[IdAttributes].toSet();
+        facts.id_set_revision = facts.revision[IdAttributes];
+    }
+    return facts.id_set;
+}
+
+
+bool BookIndex::FragmentsChecked(const FileFacts &facts, const QHash<QString, QString> &identifiers_by_filename)
+{
+    if (facts.checked_revision == -1 || facts.checked_revision != facts.revision[RelativeHrefs]) {
+        return false;
+    }
+
+    QHashIterator<QString, QPair<QString, int>> it(facts.checked_targets);
+
+    while (it.hasNext()) {
+        it.next();
+        // A file added, removed or renamed under the name counts as a change
+        const QString identifier = identifiers_by_filename.value(it.key());
+        QHash<QString, FileFacts>::const_iterator target = m_Files.constFind(identifier);
+        int revision = target == m_Files.constEnd() ? -1 : target.value().revision[IdAttributes];
+        if (identifier != it.value().first || revision != it.value().second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void BookIndex::CheckFragments(FileFacts &facts, const QString &filename,
+                               const QHash<QString, QString> &identifiers_by_filename)
+{
+    facts.checked_revision = facts.revision[RelativeHrefs];
+    facts.checked_targets.clear();
+    facts.undefined_fragments.clear();
+
+    foreach(QString href, facts.values[RelativeHrefs]) {
+        QUrl url(href);
+        if (!url.scheme().isEmpty() && url.scheme() != "file") {
+            continue;
+        }
+        const QString href_id = url.fragment();
+        if (href_id.isEmpty()) {
+            continue;
+        }
+        QString target = url.fileName();
+        if (target.isEmpty()) {
+            target = filename;
+        }
+        const QString identifier = identifiers_by_filename.value(target);
+        QHash<QString, FileFacts>::iterator target_facts = m_Files.find(identifier);
+
+        if (target_facts == m_Files.end()) {
+            // Only links into the book's HTML files are checked, but a
+            // file of that name may be added later
+            facts.checked_targets[target] = qMakePair(identifier, -1);
+            continue;
+        }
+
+        facts.checked_targets[target] = qMakePair(identifier, target_facts.value().revision[IdAttributes]);
+
+        if (!IdSet(target_facts.value()).contains(href_id)) {
+            facts.undefined_fragments.append(href);
+        }
+    }
+}
+
+
+void BookIndex::Prune(const QList<HTMLResource *> &html_resources)
+{
+    QSet<QString> identifiers;
+    foreach(HTMLResource *html_resource, html_resources) {
+        identifiers.insert(html_resource->GetIdentifier());
+    }
+    QMutexLocker locker(&m_Mutex);
+    QHash<QString, FileFacts>::iterator it = m_Files.begin();
+
+    while (it != m_Files.end()) {
+        if (!identifiers.contains(it.key())) {
+            it = m_Files.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+
+BookIndex::Extracted BookIndex::ExtractOne(const Job &job)
+{
+    Extracted extracted;
+    extracted.identifier = job.resource->GetIdentifier();
+    extracted.fact = job.fact;
+    TextResource::Snapshot snapshot = job.resource->GetSnapshot();
+    extracted.revision = snapshot.revision;
+    extracted.values = Extract(job.resource, snapshot, job.fact);
+    return extracted;
+}
+
+
+BookIndex::ExtractedTrigrams BookIndex::ExtractTrigrams(HTMLResource *html_resource)
+{
+    ExtractedTrigrams extracted;
+    extracted.identifier = html_resource->GetIdentifier();
+    TextResource::Snapshot snapshot = html_resource->GetSnapshot();
+    extracted.revision = snapshot.revision;
+    extracted.trigrams = TrigramIndex::Extract(snapshot.text);
+    return extracted;
+}
+
+
+QStringList BookIndex::Extract(HTMLResource *html_resource, const TextResource::Snapshot &snapshot, Fact fact)
+{
+    // Linked stylesheets come from the xml reader, not a parse tree
+    if (fact == Stylesheets) {
+        return XhtmlDoc::GetLinkedStylesheets(snapshot.text);
+    }
+    if (fact == IdAttributes) {
+        return Book::GetOneSnapshotIDs(html_resource, snapshot);
+    }
+    if (fact == RelativeHrefs) {
+        return Book::GetRelLinksInOneSnapshot(html_resource, snapshot);
+    }
+    if (fact == WellFormedErrors) {
+        XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(snapshot.text,
+                                                                             html_resource->GetEpubVersion());
+        if (error.line == -1) {
+            return QStringList();
+        }
+        return QStringList() << QString::number(error.line) << QString::number(error.column) << error.message;
+    }
+
+    // Every other kind reads the one shared parse of this revision
+    GumboInterface gi(GumboCache::Get(html_resource, snapshot), "any_version");
+
+    switch (fact) {
+        case Ids:
+            return XhtmlDoc::GetAllDescendantIDs(gi);
+        case Hrefs:
+            return XhtmlDoc::GetAllDescendantHrefs(gi);
+        case Classes:
+            return XhtmlDoc::GetAllDescendantClasses(gi);
+        case StyleUrls:
+            return XhtmlDoc::GetAllDescendantStyleUrls(gi);
+        case Images:
+            return XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GIMAGE_TAGS);
+        case Video:
+            return XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GVIDEO_TAGS);
+        case Audio:
+            return XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GAUDIO_TAGS);
+        case Media:
+            return XhtmlDoc::GetAllMediaPathsFromMediaChildren(gi, GIMAGE_TAGS + GVIDEO_TAGS + GAUDIO_TAGS);
+        case References:
+            return gi.get_all_references();
+        default:
+            break;
+    }
+
+    return QStringList();
+}
@@ -0,0 +1,224 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef BOOKINDEX_H
+#define BOOKINDEX_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/TrigramIndex.h"
+#include "ResourceObjects/TextResource.h"
+
+class FolderKeeper;
+class HTMLResource;
+
+/**
+ * The references found in the book's HTML files: ids, hrefs, classes,
+ * linked stylesheets and media.
+ *
+ * What is extracted from a file is kept together with the text revision
+ * it was extracted from. A query only re-parses the files that changed
+ * since the last time that kind of fact was asked for, and does so on the
+ * thread pool; everything else is answered from memory.
+ */
+class BookIndex
+{
+public:
+
+    /**
+     * The kinds of facts kept for each file.
+     */
+    enum Fact {
+        Ids = 0,         // id attributes, and name attributes of <a>
+        IdAttributes,    // id attributes only
+        Hrefs,           // every href
+        RelativeHrefs,   // the relative hrefs of <a>
+        Classes,
+        Stylesheets,     // linked stylesheets
+        StyleUrls,       // url()s in style attributes and elements
+        Images,
+        Video,
+        Audio,
+        Media,           // images, video and audio
+        References,      // everything a rename may have to update
+        WellFormedErrors, // line, column and message of the first error; empty if well-formed
+        FactCount
+    };
+
+    BookIndex(FolderKeeper *folder);
+
+    /**
+     * @return The facts of one kind found in one file.
+     */
+    QStringList GetFacts(HTMLResource *html_resource, Fact fact);
+
+    /**
+     * @return The facts of one kind found in every HTML file,
+     *         keyed by the filename they were found in.
+     */
+    QHash<QString, QStringList> GetFactsByFile(Fact fact);
+
+    /**
+     * The reverse: for every fact value, the HTML files it was found in,
+     * e.g. for Media the files that use each media file.
+     */
+    QHash<QString, QStringList> GetFilesByFact(Fact fact);
+
+    /**
+     * @return The HTML files with an href that points to filename.
+     */
+    QStringList GetFilesLinkingTo(const QString &filename);
+
+    /**
+     * @return The HTML files with an href that points to one of filenames.
+     */
+    QStringList GetFilesLinkingTo(const QSet<QString> &filenames);
+
+    /**
+     * @param bookpaths Book relative paths, e.g. OEBPS/Images/a.jpg
+     * @return The HTML files with a reference to one of the paths.
+     */
+    QList<HTMLResource *> GetFilesReferencing(const QSet<QString> &bookpaths);
+
+    /**
+     * The fragment links of <a> that point to an id missing from the
+     * HTML file they point to, as filename and href, in book order.
+     *
+     * A file's links are only looked at again when they, or the ids of
+     * one of the files they point to, have changed since the last call,
+     * so between edits this costs a lookup per linked file.
+     */
+    QList<QPair<QString, QString>> GetUndefinedFragments();
+
+    /**
+     * Narrows down the files a search has to look at, using the
+     * trigrams of each file's text. Files whose trigrams are out of date
+     * have them extracted again, on the thread pool.
+     *
+     * @param search_regex A pattern as SPCRE compiles it.
+     * @return The files, in the same order, that may have a match; all
+     *         of them when the pattern has no required literals.
+     */
+    QList<HTMLResource *> GetFilesThatMayMatch(const QList<HTMLResource *> &html_resources,
+                                               const QString &search_regex);
+
+    /**
+     * Drops everything; the next queries re-parse the whole book.
+     */
+    void Clear();
+
+private:
+
+    struct FileFacts {
+        FileFacts();
+
+        int revision[FactCount];
+        QStringList values[FactCount];
+        int trigrams_revision;
+        TrigramIndex::Trigrams trigrams;
+
+        // The IdAttributes as a set, and the revision they are from
+        int id_set_revision;
+        QSet<QString> id_set;
+
+        // The RelativeHrefs revision the undefined fragments were found
+        // in, and the identifier and id set revision of every file the
+        // links were checked against, by filename
+        int checked_revision;
+        QHash<QString, QPair<QString, int>> checked_targets;
+        QStringList undefined_fragments;
+    };
+
+    struct Job {
+        HTMLResource *resource;
+        Fact fact;
+    };
+
+    struct Extracted {
+        QString identifier;
+        Fact fact;
+        int revision;
+        QStringList values;
+    };
+
+    struct ExtractedTrigrams {
+        QString identifier;
+        int revision;
+        TrigramIndex::Trigrams trigrams;
+    };
+
+    /**
+     * Re-extracts the facts of one kind that are out of date
+     * in the given files.
+     */
+    void Refresh(const QList<HTMLResource *> &html_resources, Fact fact);
+
+    /**
+     * Forgets the files that no longer are in the book.
+     */
+    void Prune(const QList<HTMLResource *> &html_resources);
+
+    void RefreshTrigrams(const QList<HTMLResource *> &html_resources);
+
+    /**
+     * The id set of a file, brought up to date with its IdAttributes.
+     * Called with the lock held.
+     */
+    const QSet<QString> &IdSet(FileFacts &facts);
+
+    /**
+     * @return true if nothing the undefined fragments of a file were
+     *         found from has changed. Called with the lock held.
+     */
+    bool FragmentsChecked(const FileFacts &facts, const QHash<QString, QString> &identifiers_by_filename);
+
+    /**
+     * Finds the undefined fragments of a file again.
+     * Called with the lock held.
+     */
+    void CheckFragments(FileFacts &facts, const QString &filename,
+                        const QHash<QString, QString> &identifiers_by_filename);
+
+    static Extracted ExtractOne(const Job &job);
+
+    static ExtractedTrigrams ExtractTrigrams(HTMLResource *html_resource);
+
+    static QStringList Extract(HTMLResource *html_resource, const TextResource::Snapshot &snapshot, Fact fact);
+
+    FolderKeeper *m_Folder;
+
+    /**
+     * Keyed by resource identifier, so a deleted resource is never
+     * confused with a new one that reuses its address.
+     */
+    QHash<QString, FileFacts> m_Files;
+
+    QMutex m_Mutex;
+};
+
+#endif // BOOKINDEX_H
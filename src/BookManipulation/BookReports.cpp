@@ -21,7 +21,12 @@
 *************************************************************************/
 
 
+#include <functional>
+
+#include <QtConcurrent/QtConcurrent>
+#include <QtCore/QEventLoop>
 #include <QtCore/QFile>
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QHashIterator>
 #include <QtGui/QFont>
 #include <QtWidgets/QMessageBox>
@@ -29,148 +34,144 @@
 #include <QtWidgets/QProgressDialog>
 
 #include "BookManipulation/Book.h"
+#include "BookManipulation/BookIndex.h"
 #include "BookManipulation/BookReports.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "Misc/CSSInfo.h"
 #include "Misc/SettingsStore.h"
 
 QList<BookReports::StyleData *> BookReports::GetHTMLClassUsage(QSharedPointer<Book> book, bool show_progress)
+{
+    return GetClassUsage(book, show_progress, false);
+}
+
+// needed because one use of a class in html can actually match more than one selector with same specificity
+QList<BookReports::StyleData *> BookReports::GetAllHTMLClassUsage(QSharedPointer<Book> book, bool show_progress)
+{
+    return GetClassUsage(book, show_progress, true);
+}
+
+
+QList<BookReports::StyleData *> BookReports::GetClassUsage(QSharedPointer<Book> book, bool show_progress, bool all_matches)
 {
     QList<HTMLResource *> html_resources = book->GetFolderKeeper()->GetResourceTypeList<HTMLResource>(false);
-    QList<CSSResource *> css_resources = book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
-    QList<BookReports::StyleData *> html_classes_usage;
-    // Save each CSS file's text so we don't have to reload it when checking each HTML file
-    QHash<QString, QString> css_text;
-    foreach(CSSResource * css_resource, css_resources) {
-        QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
+    const ParsedStylesheets stylesheets = ParseStylesheets(book);
 
-        if (!css_text.contains(css_filename)) {
-            css_text[css_filename] = css_resource->GetText();
-        }
+    // The classes and linked stylesheets of every file, from the index
+    QHash<QString, QStringList> classes_by_file = book->GetIndex()->GetFactsByFile(BookIndex::Classes);
+    QHash<QString, QStringList> stylesheets_by_file = book->GetIndex()->GetFactsByFile(BookIndex::Stylesheets);
+    QList<HTMLFileClasses> files;
+    foreach(HTMLResource * html_resource, html_resources) {
+        HTMLFileClasses file;
+        file.html_filename = html_resource->Filename();
+        // Get the unique list of classes in this file
+        file.classes = classes_by_file.value(file.html_filename);
+        file.classes.removeDuplicates();
+        file.linked_stylesheets = stylesheets_by_file.value(file.html_filename);
+        files.append(file);
     }
 
-    // Display progress dialog
-    QProgressDialog progress(QObject::tr("Collecting classes..."), 0, 0, html_resources.count(), QApplication::activeWindow());
-    int progress_value = 0;
+    QFuture<QList<BookReports::StyleData *> > future =
+        QtConcurrent::mapped(files, std::bind(ClassifyFile, std::placeholders::_1, stylesheets, all_matches));
+
     if (show_progress) {
+        // Display progress dialog
+        QProgressDialog progress(QObject::tr("Collecting classes..."), 0, 0, html_resources.count(), QApplication::activeWindow());
         progress.setMinimumDuration(0);
-        progress.setValue(progress_value);
-        qApp->processEvents();
-    }
-
-    // Check each file for classes to look for in inline and linked stylesheets
-    foreach(HTMLResource * html_resource, html_resources) {
-        if (show_progress) {
-            progress.setValue(progress_value++);
-            qApp->processEvents();
+        QFutureWatcher<QList<BookReports::StyleData *> > watcher;
+        QEventLoop loop;
+        QObject::connect(&watcher, SIGNAL(progressValueChanged(int)), &progress, SLOT(setValue(int)));
+        QObject::connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+        watcher.setFuture(future);
+
+        if (!future.isFinished()) {
+            loop.exec();
         }
+    }
 
-        QString html_filename = html_resource->Filename();
-        // Get the unique list of classes in this file
-        QStringList classes_in_file = book->GetClassesInHTMLFile(html_filename);
-        classes_in_file.removeDuplicates();
-        // Get the linked stylesheets for this file
-        QStringList linked_stylesheets = book->GetStylesheetsInHTMLFile(html_resource);
-        // Look at each class from the HTML file
-        foreach(QString class_name, classes_in_file) {
-            QString found_location;
-            QString selector_text;
-            QString element_part = class_name.split(".").at(0);
-            QString class_part = class_name.split(".").at(1);
-            // Save the details for found or not found classes
-            BookReports::StyleData *class_usage = new BookReports::StyleData();
-            class_usage->html_filename = html_resource->Filename();
-            class_usage->html_element_name = element_part;
-            class_usage->html_class_name = class_part;
-            // Look in each stylesheet
-            foreach(QString css_filename, linked_stylesheets) {
-                if (css_text.contains(css_filename)) {
-                    CSSInfo css_info(css_text[css_filename], true);
-                    CSSInfo::CSSSelector *selector = css_info.getCSSSelectorForElementClass(element_part, class_part);
-
-                    // If class matched a selector in a linked stylesheet, we're done
-                    if (selector && (selector->classNames.count() > 0)) {
-                        class_usage->css_filename = css_filename;
-                        class_usage->css_selector_text = selector->groupText;
-                        class_usage->css_selector_position = selector->position;
-                        class_usage->css_selector_line = selector->line;
-                        break;
-                    }
-                }
-            }
-            html_classes_usage.append(class_usage);
-        }
+    QList<BookReports::StyleData *> html_classes_usage;
+    foreach(QList<BookReports::StyleData *> file_usage, future.results()) {
+        html_classes_usage.append(file_usage);
     }
     return html_classes_usage;
 }
 
-// needed because one use of a class in html can actually match more than one selector with same specificity
-QList<BookReports::StyleData *> BookReports::GetAllHTMLClassUsage(QSharedPointer<Book> book, bool show_progress)
+
+BookReports::ParsedStylesheets BookReports::ParseStylesheets(QSharedPointer<Book> book)
 {
-    QList<HTMLResource *> html_resources = book->GetFolderKeeper()->GetResourceTypeList<HTMLResource>(false);
+    ParsedStylesheets stylesheets;
     QList<CSSResource *> css_resources = book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
-    QList<BookReports::StyleData *> html_classes_usage;
-    // Save each CSS file's text so we don't have to reload it when checking each HTML file
-    QHash<QString, QString> css_text;
     foreach(CSSResource * css_resource, css_resources) {
         QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
 
-        if (!css_text.contains(css_filename)) {
-            css_text[css_filename] = css_resource->GetText();
+        if (!stylesheets.contains(css_filename)) {
+            stylesheets[css_filename] = css_resource->GetCSSInfo();
         }
     }
+    return stylesheets;
+}
 
-    // Display progress dialog
-    QProgressDialog progress(QObject::tr("Collecting classes..."), 0, 0, html_resources.count(), QApplication::activeWindow());
-    int progress_value = 0;
-    if (show_progress) {
-        progress.setMinimumDuration(0);
-        progress.setValue(progress_value);
-        qApp->processEvents();
-    }
 
-    // Check each file for classes to look for in inline and linked stylesheets
-    foreach(HTMLResource * html_resource, html_resources) {
-        if (show_progress) {
-            progress.setValue(progress_value++);
-            qApp->processEvents();
+QList<BookReports::StyleData *> BookReports::ClassifyFile(const HTMLFileClasses &file,
+                                                          const ParsedStylesheets &stylesheets,
+                                                          bool all_matches)
+{
+    QList<BookReports::StyleData *> html_classes_usage;
+    // Look at each class from the HTML file
+    foreach(QString class_name, file.classes) {
+        QString element_part = class_name.split(".").at(0);
+        QString class_part = class_name.split(".").at(1);
+        BookReports::StyleData *class_usage = NULL;
+
+        if (!all_matches) {
+            // Save the details for found or not found classes
+            class_usage = new BookReports::StyleData();
+            class_usage->html_filename = file.html_filename;
+            class_usage->html_element_name = element_part;
+            class_usage->html_class_name = class_part;
         }
 
-        QString html_filename = html_resource->Filename();
-        // Get the unique list of classes in this file
-        QStringList classes_in_file = book->GetClassesInHTMLFile(html_filename);
-        classes_in_file.removeDuplicates();
-        // Get the linked stylesheets for this file
-        QStringList linked_stylesheets = book->GetStylesheetsInHTMLFile(html_resource);
-        // Look at each class from the HTML file
-        foreach(QString class_name, classes_in_file) {
-            QString found_location;
-            QString selector_text;
-            QString element_part = class_name.split(".").at(0);
-            QString class_part = class_name.split(".").at(1);
-            // Look in each stylesheet
-            foreach(QString css_filename, linked_stylesheets) {
-                if (css_text.contains(css_filename)) {
-                    CSSInfo css_info(css_text[css_filename], true);
-                    QList<CSSInfo::CSSSelector *> selectors = css_info.getAllCSSSelectorsForElementClass(element_part, class_part);
-                    foreach(CSSInfo::CSSSelector * selector, selectors) {
-                        // If class matched a selector in a linked stylesheet, we're done
-                        if (selector && (selector->classNames.count() > 0)) {
-                            // Save the details for found or not found classes
-                            BookReports::StyleData *class_usage = new BookReports::StyleData();
-                            class_usage->html_filename = html_resource->Filename();
-                            class_usage->html_element_name = element_part;
-                            class_usage->html_class_name = class_part;
-                            class_usage->css_filename = css_filename;
-                            class_usage->css_selector_text = selector->groupText;
-                            class_usage->css_selector_position = selector->position;
-                            class_usage->css_selector_line = selector->line;
-                            html_classes_usage.append(class_usage);
-                        }
+        // Look in each stylesheet
+        foreach(QString css_filename, file.linked_stylesheets) {
+            QSharedPointer<CSSInfo> css_info = stylesheets.value(css_filename);
+
+            if (!css_info) {
+                continue;
+            }
+
+            if (all_matches) {
+                QList<CSSInfo::CSSSelector *> selectors = css_info->getAllCSSSelectorsForElementClass(element_part, class_part);
+                foreach(CSSInfo::CSSSelector * selector, selectors) {
+                    if (selector && (selector->classNames.count() > 0)) {
+                        BookReports::StyleData *selector_usage = new BookReports::StyleData();
+                        selector_usage->html_filename = file.html_filename;
+                        selector_usage->html_element_name = element_part;
+                        selector_usage->html_class_name = class_part;
+                        selector_usage->css_filename = css_filename;
+                        selector_usage->css_selector_text = selector->groupText;
+                        selector_usage->css_selector_position = selector->position;
+                        selector_usage->css_selector_line = selector->line;
+                        html_classes_usage.append(selector_usage);
                     }
                 }
+                continue;
+            }
+
+            CSSInfo::CSSSelector *selector = css_info->getCSSSelectorForElementClass(element_part, class_part);
+
+            // If class matched a selector in a linked stylesheet, we're done
+            if (selector && (selector->classNames.count() > 0)) {
+                class_usage->css_filename = css_filename;
+                class_usage->css_selector_text = selector->groupText;
+                class_usage->css_selector_position = selector->position;
+                class_usage->css_selector_line = selector->line;
+                break;
             }
         }
+
+        if (class_usage) {
+            html_classes_usage.append(class_usage);
+        }
     }
     return html_classes_usage;
 }
@@ -181,27 +182,32 @@ QList<BookReports::StyleData *> BookReports::GetCSSSelectorUsage(QSharedPointer<
 {
     QList<CSSResource *> css_resources = book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
     QList<BookReports::StyleData *> css_selectors_usage;
+    // The first HTML file using each selector, so each selector below
+    // is a lookup rather than a walk over every class used
+    QHash<QString, QString> first_user;
+    foreach(BookReports::StyleData *html_class, html_classes_usage) {
+        QString key = html_class->css_filename + QChar(0) +
+                      QString::number(html_class->css_selector_position) + QChar(0) +
+                      html_class->css_selector_text;
+        if (!first_user.contains(key)) {
+            first_user.insert(key, html_class->html_filename);
+        }
+    }
     // Now check the CSS files to see if their classes appear in an HTML file
     foreach(CSSResource *css_resource, css_resources) {
-        QString text = css_resource->GetText();
-        CSSInfo css_info(text, true);
-        QList<CSSInfo::CSSSelector *> selectors = css_info.getClassSelectors();
+        QSharedPointer<CSSInfo> css_info = css_resource->GetCSSInfo();
+        QList<CSSInfo::CSSSelector *> selectors = css_info->getClassSelectors();
+        QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
         foreach(CSSInfo::CSSSelector * selector, selectors) {
-            QString css_filename = "../" + css_resource->GetRelativePathToOEBPS();
             // Save the details for found or not found classes
             BookReports::StyleData *selector_usage = new BookReports::StyleData();
             selector_usage->css_filename = css_filename;
             selector_usage->css_selector_text = selector->groupText;
             selector_usage->css_selector_position = selector->position;
             selector_usage->css_selector_line = selector->line;
-            foreach(BookReports::StyleData *html_class, html_classes_usage) {
-                if (css_filename == html_class->css_filename && 
-                    selector->position == html_class->css_selector_position &&
-                    selector->groupText == html_class->css_selector_text) {
-                    selector_usage->html_filename = html_class->html_filename;
-                    break;
-                }
-            }
+            selector_usage->html_filename = first_user.value(css_filename + QChar(0) +
+                                                             QString::number(selector->position) + QChar(0) +
+                                                             selector->groupText);
             css_selectors_usage.append(selector_usage);
         }
     }
@@ -23,10 +23,14 @@
 #ifndef BOOKREPORTS_H
 #define BOOKREPORTS_H
 
+#include <QtCore/QHash>
+#include <QtCore/QSharedPointer>
+
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/CSSResource.h"
 #include "BookManipulation/Book.h"
 
+class CSSInfo;
 class QString;
 
 
@@ -49,6 +53,35 @@ public:
     static QList<BookReports::StyleData *> GetHTMLClassUsage(QSharedPointer<Book> book, bool show_progress = false);
     static QList<BookReports::StyleData *> GetAllHTMLClassUsage(QSharedPointer<Book> book, bool show_progress = false);
     static QList<BookReports::StyleData *> GetCSSSelectorUsage(QSharedPointer<Book> book, const QList<BookReports::StyleData *> html_classes_usage);
+
+private:
+
+    /**
+     * Every stylesheet parsed once, keyed by its path relative to
+     * the HTML files, e.g. ../Styles/style.css.
+     */
+    typedef QHash<QString, QSharedPointer<CSSInfo> > ParsedStylesheets;
+
+    struct HTMLFileClasses {
+        QString html_filename;
+        QStringList classes;
+        QStringList linked_stylesheets;
+    };
+
+    static QList<BookReports::StyleData *> GetClassUsage(QSharedPointer<Book> book, bool show_progress, bool all_matches);
+
+    static ParsedStylesheets ParseStylesheets(QSharedPointer<Book> book);
+
+    /**
+     * Looks up the classes of one HTML file in the stylesheets it links.
+     * Only reads the parsed stylesheets, so files are done in parallel.
+     *
+     * @param all_matches Whether to report every matching selector
+     *                    instead of the first, and skip unmatched classes.
+     */
+    static QList<BookReports::StyleData *> ClassifyFile(const HTMLFileClasses &file,
+                                                        const ParsedStylesheets &stylesheets,
+                                                        bool all_matches);
 };
 
 #endif // BOOKREPORTS_H
@@ -22,11 +22,16 @@
 
 #include "Misc/EmbeddedPython.h"
 
+#include <functional>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSet>
 #include <QtCore/QString>
+#include <QtCore/QStringBuilder>
 #include <QtCore/QStringList>
-#include <QtCore/QWriteLocker>
-#include <QtWidgets/QApplication>
-#include <QtWidgets/QProgressDialog>
+#include <QtCore/QXmlStreamReader>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 
@@ -34,13 +39,16 @@
 #include "BookManipulation/XhtmlDoc.h"
 #include "Misc/HTMLPrettyPrint.h"
 #include "Misc/GumboInterface.h"
+#include "Misc/SettingsSnapshot.h"
 #include "Misc/SettingsStore.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 #include "Misc/Utility.h"
+#include "SourceUpdates/UpdateJob.h"
 #include <utility>
 
 static const QString HEAD_END = "</\\s*head\\s*>";
+static const QRegularExpression XML_DECLARATION("<\\s*\\?xml\\s*[^\\?>]*\\?*>\\s*", QRegularExpression::CaseInsensitiveOption);
 const QString SVG_NAMESPACE_PREFIX = "<\\s*[^>]*(xmlns\\s*:\\s*svg\\s*=\\s*(?:\"|')[^\"']+(?:\"|'))[^>]*>";
 
 // Performs general cleaning (and improving)
@@ -177,9 +185,44 @@ bool CleanSource::IsWellFormedXML(const QString &source, const QString mtype)
 
 QString CleanSource::ProcessXML(const QString &source, const QString mtype)
 {
+    // The Python repair hands well-formed XML back untouched; only what
+    // has to be mended is reparsed and pretty printed there
+    if (IsWellFormedXMLNative(source)) {
+        return source;
+    }
     return XMLPrettyPrintBS4(source, mtype);
 }
 
+bool CleanSource::IsWellFormedXMLNative(const QString &source)
+{
+    // Characters XML does not allow at all, which the reader lets through
+    const QChar *data = source.constData();
+    for (int i = 0; i < source.length(); ++i) {
+        ushort c = data[i].unicode();
+        if ((c < 0x20 && c != '\t' && c != '\n' && c != '\r') || c == 0xFFFE || c == 0xFFFF) {
+            return false;
+        }
+    }
+
+    // As xmlprocessor does, the XML declaration is not checked, since
+    // the encoding it names no longer applies to the text
+    QString text = source;
+    QRegularExpressionMatch header = XML_DECLARATION.match(source);
+    if (header.hasMatch()) {
+        text.remove(header.capturedStart(), header.capturedLength());
+    }
+
+    QXmlStreamReader reader(text);
+
+    while (!reader.atEnd()) {
+        // lxml has no definitions for the entities of a DTD
+        if (reader.readNext() == QXmlStreamReader::EntityReference) {
+            return false;
+        }
+    }
+    return !reader.hasError();
+}
+
 QString CleanSource::RemoveMetaCharset(const QString &source)
 {
     int head_end = source.indexOf(QRegularExpression(HEAD_END));
@@ -276,35 +319,95 @@ QString CleanSource::PrettifyDOCTYPEHeader(const QString &source)
 
 QString CleanSource::CharToEntity(const QString &source)
 {
-    SettingsStore settings;
-    QString new_source = source;
-    QList<std::pair <ushort, QString>> codenames = settings.preserveEntityCodeNames();
-    std::pair <ushort, QString> epair;
-    foreach(epair, codenames) {
-        new_source.replace(QChar(epair.first), epair.second);
+    QSharedPointer<const SettingsSnapshot::Values> settings = SettingsSnapshot::Current();
+    const quint32 *bits = settings->preserve_entity_bits.constData();
+    const QChar *data = source.constData();
+    const int length = source.length();
+
+    // One pass; the source is only copied once a character has to be replaced
+    QString new_source;
+    bool replaced = false;
+    int copied = 0;
+    for (int i = 0; i < length; ++i) {
+        ushort code = data[i].unicode();
+        if (!(bits[code >> 5] & (1u << (code & 31)))) {
+            continue;
+        }
+
+        if (!replaced) {
+            new_source.reserve(length + length / 16);
+            replaced = true;
+        }
+        new_source.append(data + copied, i - copied);
+        new_source.append(settings->preserve_entities.value(code));
+        copied = i + 1;
+    }
+
+    if (!replaced) {
+        return source;
     }
+
+    new_source.append(data + copied, length - copied);
     return new_source;
 }
 
 
+// Hashes of the text each cleaner has already produced, by cleaner and
+// epub version. Cleaning is repeatable, so text with one of these hashes
+// would come back unchanged and is not cleaned again.
+static QMutex s_CleanedMutex;
+static QHash<QString, QSet<QByteArray>> s_CleanedHashes;
+static const int MAX_CLEANED_HASHES = 100000;
+
+static QString CleanedKey(QString(clean_func)(const QString &source, const QString &version), const QString &version)
+{
+    return QString::number(reinterpret_cast<quintptr>(clean_func)) % ":" % version;
+}
+
+static QByteArray TextHash(const QString &text)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char *>(text.constData()), text.size() * sizeof(QChar)),
+                                    QCryptographicHash::Md5);
+}
+
+static void RememberCleaned(const QString &key, const QByteArray &hash)
+{
+    QMutexLocker locker(&s_CleanedMutex);
+    QSet<QByteArray> &hashes = s_CleanedHashes[key];
+    if (hashes.count() >= MAX_CLEANED_HASHES) {
+        hashes.clear();
+    }
+    hashes.insert(hash);
+}
+
+static QString ReformatOneFile(TextResource *resource, const QString &text, QString(clean_func)(const QString &source, const QString &version))
+{
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+    QString version = html_resource ? html_resource->GetEpubVersion() : QString();
+    QString key = CleanedKey(clean_func, version);
+    {
+        QMutexLocker locker(&s_CleanedMutex);
+        if (s_CleanedHashes.value(key).contains(TextHash(text))) {
+            return QString();
+        }
+    }
+    QString newsource = clean_func(text, version);
+    RememberCleaned(key, TextHash(newsource));
+    return newsource;
+}
+
 bool CleanSource::ReformatAll(QList <HTMLResource *> resources, QString(clean_func)(const QString &source, const QString &version))
 {
-    QProgressDialog progress(QObject::tr("Cleaning..."), 0, 0, resources.count(), Utility::GetMainWindow());
-    progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
-    int progress_value = 0;
-    progress.setValue(progress_value);
-    bool book_modified = false;
+    // The files are cleaned on the thread pool and the results written
+    // back together, only if nothing was cancelled or edited meanwhile
+    QList<TextResource *> text_resources;
     foreach(HTMLResource * resource, resources) {
-        progress.setValue(progress_value++);
-        qApp->processEvents();
-        QWriteLocker locker(&resource->GetLock());
-        QString source = resource->GetText();
-        QString version = resource->GetEpubVersion();
-        QString newsource = clean_func(source, version);
-        if (newsource != source) {
-            book_modified = true;
-            resource->SetText(newsource);
-        }
+        text_resources.append(resource);
+    }
+    UpdateJob job(text_resources, std::bind(ReformatOneFile, std::placeholders::_1, std::placeholders::_2, clean_func));
+    job.Run(QObject::tr("Cleaning..."));
+    if (!job.WasCancelled() && !job.Errors().isEmpty()) {
+        Utility::DisplayStdErrorDialog(QObject::tr("The files could not be cleaned."), job.Errors().join("\n"));
     }
-    return book_modified;
+    return job.ChangedCount() > 0;
 }
@@ -78,6 +78,13 @@ private:
      */
     static QString RemoveMetaCharset(const QString &source);
 
+    /**
+     * Checks XML the way the Python repair does before deciding whether
+     * it has anything to mend, but without leaving C++. Anything this
+     * is unsure of counts as not well-formed, so it is left to Python.
+     */
+    static bool IsWellFormedXMLNative(const QString &source);
+
 };
 
 
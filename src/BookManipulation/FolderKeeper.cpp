@@ -20,15 +20,18 @@
 **
 *************************************************************************/
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDataStream>
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 #include <QtCore/QThread>
-#include <QtCore/QTime>
 #include <QtWidgets/QApplication>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
+#include <QtConcurrent/QtConcurrent>
 
 #include "BookManipulation/FolderKeeper.h"
 #include "sigil_constants.h"
@@ -37,6 +40,7 @@
 #include "ResourceObjects/NCXResource.h"
 #include "ResourceObjects/Resource.h"
 #include "ResourceObjects/VideoResource.h"
+#include "Misc/DirectoryWatcher.h"
 #include "Misc/Utility.h"
 #include "Misc/OpenExternally.h"
 #include "Misc/SettingsStore.h"
@@ -71,6 +75,9 @@ const QString AUDIO_FOLDER_NAME = "Audio";
 const QString VIDEO_FOLDER_NAME = "Video";
 const QString MISC_FOLDER_NAME  = "Misc";
 
+// In the preferences folder, one file per EPUB
+const QString CONTENT_HASHES_FOLDER = "content_hashes";
+
 const QStringList IMAGE_MIMEYPES     = QStringList() << "image/gif" << "image/jpeg" << "image/png";
 const QStringList SVG_MIMETYPES      = QStringList() << "image/svg+xml";
 const QStringList TEXT_MIMETYPES     = QStringList() << "application/xhtml+xml" << "application/x-dtbook+xml";
@@ -93,12 +100,40 @@ static const QString CONTAINER_XML = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>
                                      "</container>\n";
 
 
-FolderKeeper::FolderKeeper(QObject *parent)
+// Rename files that start with a '.'
+// These merely introduce needless difficulties
+static QString NormalisedFilePath(const QString &fullfilepath)
+{
+    QFileInfo fileInformation(fullfilepath);
+    QString fileName = fileInformation.fileName();
+
+    if (fileName.left(1) == ".") {
+        return fileInformation.canonicalPath() % "/" % fileName.right(fileName.size() - 1);
+    }
+
+    return fullfilepath;
+}
+
+
+static void CopyOneFile(const std::pair<QString, QString> &copy)
+{
+    Utility::CloneFile(copy.first, copy.second);
+}
+
+
+static bool DeleteOneFile(Resource *resource)
+{
+    return resource->DeleteFromDisk();
+}
+
+
+FolderKeeper::FolderKeeper(QObject *parent, qint64 workspace_size)
     :
     QObject(parent),
     m_OPF(NULL),
     m_NCX(NULL),
-    m_FSWatcher(new QFileSystemWatcher()),
+    m_TempFolder(workspace_size),
+    m_Watcher(new DirectoryWatcher()),
     m_FullPathToMainFolder(m_TempFolder.GetPath())
 {
     CreateExtensionToMediaTypeMap();
@@ -113,9 +148,9 @@ FolderKeeper::~FolderKeeper()
         return;
     }
 
-    if (m_FSWatcher) {
-        delete m_FSWatcher;
-        m_FSWatcher = 0;
+    if (m_Watcher) {
+        delete m_Watcher;
+        m_Watcher = 0;
     }
 
     foreach(Resource *resource, m_Resources.values()) {
@@ -135,16 +170,8 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
     }
 
     QString new_file_path;
-    QString normalised_file_path = fullfilepath;
+    QString normalised_file_path = NormalisedFilePath(fullfilepath);
     Resource *resource = NULL;
-    // Rename files that start with a '.'
-    // These merely introduce needless difficulties
-    QFileInfo fileInformation(normalised_file_path);
-    QString fileName = fileInformation.fileName();
-
-    if (fileName.left(1) == ".") {
-        normalised_file_path = fileInformation.canonicalPath() % "/" % fileName.right(fileName.size() - 1);
-    }
 
     // We need to lock here because otherwise
     // several threads can get the same "unique" name.
@@ -152,58 +179,166 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
     {
         QMutexLocker locker(&m_AccessMutex);
         QString filename  = GetUniqueFilenameVersion(QFileInfo(normalised_file_path).fileName());
-        QString extension = QFileInfo(normalised_file_path).suffix().toLower();
-
-        if (fullfilepath.contains(FILE_EXCEPTIONS)) {
-            // This is a big hack that assumes the new and old filepaths use root paths
-            // of the same length. I can't see how to fix this without refactoring
-            // a lot of the code to provide a more generalised interface.
-            new_file_path = m_FullPathToMainFolder % fullfilepath.right(fullfilepath.size() - m_FullPathToMainFolder.size());
-            resource = new Resource(m_FullPathToMainFolder, new_file_path);
-        } else if (MISC_TEXT_EXTENSIONS.contains(extension)) {
-            new_file_path = m_FullPathToMiscFolder + "/" + filename;
-            resource = new MiscTextResource(m_FullPathToMainFolder, new_file_path);
-        } else if (AUDIO_EXTENSIONS.contains(extension) || AUDIO_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToAudioFolder + "/" + filename;
-            resource = new AudioResource(m_FullPathToMainFolder, new_file_path);
-        } else if (VIDEO_EXTENSIONS.contains(extension) || VIDEO_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToVideoFolder + "/" + filename;
-            resource = new VideoResource(m_FullPathToMainFolder, new_file_path);
-        } else if (IMAGE_EXTENSIONS.contains(extension) || IMAGE_MIMEYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToImagesFolder + "/" + filename;
-            resource = new ImageResource(m_FullPathToMainFolder, new_file_path);
-        } else if (SVG_EXTENSIONS.contains(extension) || SVG_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToImagesFolder + "/" + filename;
-            resource = new SVGResource(m_FullPathToMainFolder, new_file_path);
-        } else if (FONT_EXTENSIONS.contains(extension) || FONT_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToFontsFolder + "/" + filename;
-            resource = new FontResource(m_FullPathToMainFolder, new_file_path);
-        } else if (TEXT_EXTENSIONS.contains(extension) || TEXT_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToTextFolder + "/" + filename;
-            resource = new HTMLResource(m_FullPathToMainFolder, new_file_path, m_Resources);
-        } else if (STYLE_EXTENSIONS.contains(extension) || STYLE_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToStylesFolder + "/" + filename;
-            resource = new CSSResource(m_FullPathToMainFolder, new_file_path);
-        } else if (MISC_XML_EXTENSIONS.contains(extension) || MISC_XML_MIMETYPES.contains(mimetype)) {
-            new_file_path = m_FullPathToMiscFolder + "/" + filename;
-            resource = new XMLResource(m_FullPathToMainFolder, new_file_path);
-        } else {
-            // Fallback mechanism
-            new_file_path = m_FullPathToMiscFolder + "/" + filename;
-            resource = new Resource(m_FullPathToMainFolder, new_file_path);
+        resource = CreateResourceForFile(fullfilepath, filename, mimetype, new_file_path);
+    }
+    Utility::CloneFile(fullfilepath, new_file_path);
+    AdoptResource(resource);
+
+    if (update_opf) {
+        emit ResourceAdded(resource);
+    }
+
+    return resource;
+}
+
+
+QList<Resource *> FolderKeeper::AddContentFilesToFolder(const QList<std::pair<QString, QString>> &files, bool update_opf)
+{
+    QList<Resource *> resources;
+    QList<std::pair<QString, QString>> copies;
+    {
+        QMutexLocker locker(&m_AccessMutex);
+        // One snapshot of the taken names instead of one per file
+        QSet<QString> taken_names;
+        foreach(const QString &name, m_ResourcesByFilename.keys()) {
+            taken_names.insert(name.toLower());
         }
 
-        m_Resources[ resource->GetIdentifier() ] = resource;
-        resource->SetEpubVersion(m_OPF->GetEpubVersion());
-        if (!mimetype.isEmpty()) {
-            resource->SetMediaType(mimetype);
-        } else {
-           resource->SetMediaType(m_ExtToMType.value(extension));
+        for (int i = 0; i < files.count(); ++i) {
+            const QString &fullfilepath = files.at(i).first;
+
+            if (!QFileInfo(fullfilepath).exists()) {
+                resources.append(NULL);
+                continue;
+            }
+
+            QString filename = QFileInfo(NormalisedFilePath(fullfilepath)).fileName();
+
+            if (taken_names.contains(filename.toLower())) {
+                filename = GetUniqueFilenameVersion(filename);
+            }
+
+            QString new_file_path;
+            Resource *resource = CreateResourceForFile(fullfilepath, filename, files.at(i).second, new_file_path);
+            taken_names.insert(filename.toLower());
+            resources.append(resource);
+            copies.append(std::make_pair(fullfilepath, new_file_path));
         }
+    }
+
+    QtConcurrent::blockingMap(copies, CopyOneFile);
+    QList<const Resource *> added;
+    foreach(Resource *resource, resources) {
+        if (resource) {
+            AdoptResource(resource);
+            added.append(resource);
+        }
+    }
 
+    if (update_opf && !added.isEmpty()) {
+        emit ResourcesAdded(added);
     }
-    QFile::copy(fullfilepath, new_file_path);
 
+    return resources;
+}
+
+
+QList<Resource *> FolderKeeper::DeleteResources(const QList<Resource *> &resources)
+{
+    const QList<bool> deleted = QtConcurrent::blockingMapped<QList<bool> >(resources, DeleteOneFile);
+    QList<Resource *> deleted_resources;
+    QList<const Resource *> removed;
+
+    for (int i = 0; i < resources.count(); ++i) {
+        if (!deleted.at(i)) {
+            continue;
+        }
+
+        Resource *resource = resources.at(i);
+        // Forgotten here so that Deleted does not update the OPF once per resource
+        disconnect(resource, SIGNAL(Deleted(const Resource *)), this, SLOT(RemoveResource(const Resource *)));
+        m_Resources.remove(resource->GetIdentifier());
+        UnindexResource(resource, resource->GetFullPath());
+        m_Watcher->RemovePath(resource->GetFullPath());
+        deleted_resources.append(resource);
+        removed.append(resource);
+    }
+
+    if (!removed.isEmpty()) {
+        emit ResourcesRemoved(removed);
+    }
+
+    // Tabs and linked resources hear about the deletions once the OPF is up to date
+    foreach(Resource *resource, deleted_resources) {
+        resource->NotifyDeleted();
+    }
+
+    return deleted_resources;
+}
+
+
+Resource *FolderKeeper::CreateResourceForFile(const QString &fullfilepath,
+                                              const QString &filename,
+                                              const QString &mimetype,
+                                              QString &new_file_path)
+{
+    Resource *resource = NULL;
+    QString extension = QFileInfo(filename).suffix().toLower();
+
+    if (fullfilepath.contains(FILE_EXCEPTIONS)) {
+        // This is a big hack that assumes the new and old filepaths use root paths
+        // of the same length. I can't see how to fix this without refactoring
+        // a lot of the code to provide a more generalised interface.
+        new_file_path = m_FullPathToMainFolder % fullfilepath.right(fullfilepath.size() - m_FullPathToMainFolder.size());
+        resource = new Resource(m_FullPathToMainFolder, new_file_path);
+    } else if (MISC_TEXT_EXTENSIONS.contains(extension)) {
+        new_file_path = m_FullPathToMiscFolder + "/" + filename;
+        resource = new MiscTextResource(m_FullPathToMainFolder, new_file_path);
+    } else if (AUDIO_EXTENSIONS.contains(extension) || AUDIO_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToAudioFolder + "/" + filename;
+        resource = new AudioResource(m_FullPathToMainFolder, new_file_path);
+    } else if (VIDEO_EXTENSIONS.contains(extension) || VIDEO_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToVideoFolder + "/" + filename;
+        resource = new VideoResource(m_FullPathToMainFolder, new_file_path);
+    } else if (IMAGE_EXTENSIONS.contains(extension) || IMAGE_MIMEYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToImagesFolder + "/" + filename;
+        resource = new ImageResource(m_FullPathToMainFolder, new_file_path);
+    } else if (SVG_EXTENSIONS.contains(extension) || SVG_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToImagesFolder + "/" + filename;
+        resource = new SVGResource(m_FullPathToMainFolder, new_file_path);
+    } else if (FONT_EXTENSIONS.contains(extension) || FONT_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToFontsFolder + "/" + filename;
+        resource = new FontResource(m_FullPathToMainFolder, new_file_path);
+    } else if (TEXT_EXTENSIONS.contains(extension) || TEXT_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToTextFolder + "/" + filename;
+        resource = new HTMLResource(m_FullPathToMainFolder, new_file_path, m_Resources);
+    } else if (STYLE_EXTENSIONS.contains(extension) || STYLE_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToStylesFolder + "/" + filename;
+        resource = new CSSResource(m_FullPathToMainFolder, new_file_path);
+    } else if (MISC_XML_EXTENSIONS.contains(extension) || MISC_XML_MIMETYPES.contains(mimetype)) {
+        new_file_path = m_FullPathToMiscFolder + "/" + filename;
+        resource = new XMLResource(m_FullPathToMainFolder, new_file_path);
+    } else {
+        // Fallback mechanism
+        new_file_path = m_FullPathToMiscFolder + "/" + filename;
+        resource = new Resource(m_FullPathToMainFolder, new_file_path);
+    }
+
+    m_Resources[ resource->GetIdentifier() ] = resource;
+    IndexResource(resource);
+    resource->SetEpubVersion(m_OPF->GetEpubVersion());
+    if (!mimetype.isEmpty()) {
+        resource->SetMediaType(mimetype);
+    } else {
+       resource->SetMediaType(m_ExtToMType.value(extension));
+    }
+
+    return resource;
+}
+
+
+void FolderKeeper::AdoptResource(Resource *resource)
+{
     if (QThread::currentThread() != QApplication::instance()->thread()) {
         resource->moveToThread(QApplication::instance()->thread());
     }
@@ -212,32 +347,123 @@ Resource *FolderKeeper::AddContentFileToFolder(const QString &fullfilepath, bool
             this,     SLOT(RemoveResource(const Resource *)), Qt::DirectConnection);
     connect(resource, SIGNAL(Renamed(const Resource *, QString)),
             this,     SLOT(ResourceRenamed(const Resource *, QString)), Qt::DirectConnection);
+}
 
-    if (update_opf) {
-        emit ResourceAdded(resource);
+
+// Splits "Section0012.xhtml" into the key of its name prefix and
+// extension, and its number suffix with the digits it was written with.
+static bool SplitNumberSuffix(const QString &filename, QString &key, int &number, int &digits)
+{
+    static const QRegularExpression trailing_digits("\\d+$");
+    QFileInfo info(filename);
+    QString base_name = info.baseName();
+    QRegularExpressionMatch match = trailing_digits.match(base_name);
+    QString prefix = base_name.left(base_name.length() - match.capturedLength());
+    key = prefix.toLower() + "/" + info.completeSuffix().toLower();
+
+    if (!match.hasMatch()) {
+        return false;
     }
 
-    return resource;
+    bool conversion_successful = false;
+    number = match.captured().toInt(&conversion_successful);
+    digits = match.capturedLength();
+    return conversion_successful;
 }
 
 
-int FolderKeeper::GetHighestReadingOrder() const
+void FolderKeeper::IndexFilename(const QString &filename)
 {
-    int count_of_html_resources = 0;
-    foreach(Resource * resource, m_Resources.values()) {
-        if (resource->Type() == Resource::HTMLResourceType) {
-            ++count_of_html_resources;
+    m_FoldedFilenames[ filename.toLower() ]++;
+    QString key;
+    int number;
+    int digits;
+
+    if (SplitNumberSuffix(filename, key, number, digits)) {
+        m_NumberSuffixes[ key ][ number ].append(digits);
+    }
+}
+
+
+void FolderKeeper::UnindexFilename(const QString &filename)
+{
+    QString folded = filename.toLower();
+
+    if (--m_FoldedFilenames[ folded ] <= 0) {
+        m_FoldedFilenames.remove(folded);
+    }
+
+    QString key;
+    int number;
+    int digits;
+
+    if (!SplitNumberSuffix(filename, key, number, digits)) {
+        return;
+    }
+
+    QHash<QString, QMap<int, QList<int>>>::iterator numbers = m_NumberSuffixes.find(key);
+
+    if (numbers == m_NumberSuffixes.end()) {
+        return;
+    }
+
+    QMap<int, QList<int>>::iterator lengths = numbers.value().find(number);
+
+    if (lengths != numbers.value().end()) {
+        lengths.value().removeOne(digits);
+        if (lengths.value().isEmpty()) {
+            numbers.value().erase(lengths);
         }
     }
-    return count_of_html_resources - 1;
+
+    if (numbers.value().isEmpty()) {
+        m_NumberSuffixes.erase(numbers);
+    }
 }
 
 
-QString FolderKeeper::GetUniqueFilenameVersion(const QString &filename) const
+void FolderKeeper::IndexResource(Resource *resource)
+{
+    if (!m_ResourcesByFilename.contains(resource->Filename())) {
+        IndexFilename(resource->Filename());
+    }
+    m_ResourcesByFilename[ resource->Filename() ] = resource;
+    m_ResourcesByFullPath[ resource->GetFullPath() ] = resource;
+    m_ResourcesByType[ resource->Type() ].append(resource);
+}
+
+
+void FolderKeeper::UnindexResource(const Resource *resource, const QString &fullfilepath)
+{
+    // Only drop the entries that still point at this resource.
+    QString filename = QFileInfo(fullfilepath).fileName();
+
+    if (m_ResourcesByFilename.value(filename) == resource) {
+        m_ResourcesByFilename.remove(filename);
+        UnindexFilename(filename);
+    }
+
+    if (m_ResourcesByFullPath.value(fullfilepath) == resource) {
+        m_ResourcesByFullPath.remove(fullfilepath);
+    }
+
+    QHash<int, QList<Resource *>>::iterator it = m_ResourcesByType.find(resource->Type());
+
+    if (it != m_ResourcesByType.end()) {
+        it.value().removeOne(const_cast<Resource *>(resource));
+    }
+}
+
+
+int FolderKeeper::GetHighestReadingOrder() const
 {
-    const QStringList &filenames = GetAllFilenames();
+    return GetResourceListByType(Resource::HTMLResourceType).count() - 1;
+}
 
-    if (!filenames.contains(filename, Qt::CaseInsensitive)) {
+
+QString FolderKeeper::GetUniqueFilenameVersion(const QString &filename) const
+{
+    if (!m_FoldedFilenames.contains(filename.toLower())) {
         return filename;
     }
 
@@ -245,29 +471,16 @@ QString FolderKeeper::GetUniqueFilenameVersion(const QString &filename) const
     // So for "Section0001.xhtml", it is "Section"
     QString name_prefix = QFileInfo(filename).baseName().remove(QRegularExpression("\\d+$"));
     QString extension   = QFileInfo(filename).completeSuffix();
-    // Used to search for the filename number suffixes.
-    QString search_string = QRegularExpression::escape(name_prefix).prepend("^") +
-                            "(\\d*)" +
-                            (!extension.isEmpty() ? ("\\." + QRegularExpression::escape(extension)) : QString()) +
-                            "$";
-
-    QRegularExpression filename_search(search_string);
-    filename_search.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+    QString key = name_prefix.toLower() + "/" + extension.toLower();
+
+    // The highest number in use after the same prefix and extension
     int max_num_length = -1;
     int max_num = -1;
-    foreach(QString existing_file, filenames) {
-        QRegularExpressionMatch match = filename_search.match(existing_file);
-        if (!match.hasMatch()) {
-            continue;
-        }
+    QHash<QString, QMap<int, QList<int>>>::const_iterator numbers = m_NumberSuffixes.constFind(key);
 
-        bool conversion_successful = false;
-        int number_suffix = match.captured(1).toInt(&conversion_successful);
-        
-        if (conversion_successful && number_suffix > max_num) {
-            max_num = number_suffix;
-            max_num_length = match.capturedLength(1);
-        }
+    if (numbers != m_NumberSuffixes.constEnd() && !numbers.value().isEmpty()) {
+        max_num = numbers.value().lastKey();
+        max_num_length = numbers.value().last().first();
     }
 
     if (max_num == -1) {
@@ -302,13 +515,8 @@ QList<Resource *> FolderKeeper::GetResourceList() const
 
 QList<Resource *> FolderKeeper::GetResourceListByType(Resource::ResourceType type) const
 {
-    QList <Resource *> resources;
-    foreach (Resource *resource, m_Resources.values()) {
-        if (resource->Type() == type) {
-            resources.append(resource);
-        }
-    }
-    return resources;
+    // Implicitly shared, so the copy is only made if the index changes
+    return m_ResourcesByType.value(type);
 }
 
 Resource *FolderKeeper::GetResourceByIdentifier(const QString &identifier) const
@@ -319,12 +527,19 @@ Resource *FolderKeeper::GetResourceByIdentifier(const QString &identifier) const
 
 Resource *FolderKeeper::GetResourceByFilename(const QString &filename) const
 {
-    foreach(Resource *resource, m_Resources.values()) {
-        if (resource->Filename() == filename) {
-            return resource;
-        }
+    Resource *resource = m_ResourcesByFilename.value(filename);
+
+    if (!resource) {
+        throw(ResourceDoesNotExist(filename.toStdString()));
     }
-    throw(ResourceDoesNotExist(filename.toStdString()));
+
+    return resource;
+}
+
+
+Resource *FolderKeeper::GetResourceByFullPath(const QString &fullfilepath) const
+{
+    return m_ResourcesByFullPath.value(fullfilepath);
 }
 
 
@@ -373,58 +588,43 @@ QString FolderKeeper::GetFullPathToVideoFolder() const
     return m_FullPathToVideoFolder;
 }
 
+QString FolderKeeper::GetMediaTypeForExtension(const QString &extension) const
+{
+    return m_ExtToMType.value(extension.toLower());
+}
+
 
 QStringList FolderKeeper::GetAllFilenames() const
 {
-    QStringList filelist;
-    foreach(Resource *resource, m_Resources.values()) {
-        filelist.append(resource->Filename());
-    }
-    return filelist;
+    return m_ResourcesByFilename.keys();
 }
 
 
 void FolderKeeper::RemoveResource(const Resource *resource)
 {
     m_Resources.remove(resource->GetIdentifier());
+    UnindexResource(resource, resource->GetFullPath());
 
-    if (m_FSWatcher->files().contains(resource->GetFullPath())) {
-        m_FSWatcher->removePath(resource->GetFullPath());
-    }
-
-    m_SuspendedWatchedFiles.removeAll(resource->GetFullPath());
+    m_Watcher->RemovePath(resource->GetFullPath());
     emit ResourceRemoved(resource);
 }
 
 void FolderKeeper::ResourceRenamed(const Resource *resource, const QString &old_full_path)
 {
+    UnindexResource(resource, old_full_path);
+    IndexResource(const_cast<Resource *>(resource));
     m_OPF->ResourceRenamed(resource, old_full_path);
 }
 
-void FolderKeeper::ResourceFileChanged(const QString &path) const
+void FolderKeeper::ResourceFilesChanged(const QStringList &paths) const
 {
-    // The file may have been deleted prior to writing a new version - give it a chance to write.
-    QTime wake_time = QTime::currentTime().addMSecs(1000);
-
-    while (!QFile::exists(path) && QTime::currentTime() < wake_time) {
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
-    }
+    // The watcher only reports files that exist and really changed,
+    // after any burst of writes has settled.
+    foreach(QString path, paths) {
+        Resource *resource = m_ResourcesByFullPath.value(path);
 
-    // The signal is also received after resource files are removed / renamed,
-    // but it can be safely ignored because QFileSystemWatcher automatically stops watching them.
-    if (QFile::exists(path)) {
-        // Some editors write the updated contents to a temporary file
-        // and then atomically move it over the watched file.
-        // In this case QFileSystemWatcher loses track of the file, so we have to add it again.
-        if (!m_FSWatcher->files().contains(path)) {
-            m_FSWatcher->addPath(path);
-        }
-
-        foreach(Resource *resource, m_Resources.values()) {
-            if (resource->GetFullPath() == path) {
-                resource->FileChangedOnDisk();
-                return;
-            }
+        if (resource) {
+            resource->FileChangedOnDisk();
         }
     }
 }
@@ -432,9 +632,7 @@ void FolderKeeper::ResourceFileChanged(const QString &path) const
 void FolderKeeper::WatchResourceFile(const Resource *resource)
 {
     if (OpenExternally::mayOpen(resource->Type())) {
-        if (!m_FSWatcher->files().contains(resource->GetFullPath())) {
-            m_FSWatcher->addPath(resource->GetFullPath());
-        }
+        m_Watcher->AddPath(resource->GetFullPath());
 
         // when the file is changed externally, mark the owning Book as modified
         // parent() is the Book object
@@ -445,21 +643,133 @@ void FolderKeeper::WatchResourceFile(const Resource *resource)
 
 void FolderKeeper::SuspendWatchingResources()
 {
-    if (m_SuspendedWatchedFiles.isEmpty() && !m_FSWatcher->files().isEmpty()) {
-        m_SuspendedWatchedFiles.append(m_FSWatcher->files());
-        m_FSWatcher->removePaths(m_SuspendedWatchedFiles);
-    }
+    m_Watcher->Suspend();
 }
 
 void FolderKeeper::ResumeWatchingResources()
 {
-    if (!m_SuspendedWatchedFiles.isEmpty()) {
-        foreach(QString path, m_SuspendedWatchedFiles) {
-            if (QFile::exists(path)) {
-                m_FSWatcher->addPath(path);
-            }
+    m_Watcher->Resume();
+}
+
+void FolderKeeper::UpdateContentHashes()
+{
+    QList<Resource *> resources;
+
+    foreach(Resource *resource, m_Resources.values()) {
+        if (!resource->HasDeferredContent() && !resource->HasContentHash()) {
+            resources.append(resource);
+        }
+    }
+
+    QtConcurrent::blockingMap(resources, [](Resource *resource) {
+        resource->GetContentHash();
+    });
+}
+
+// Where the content hashes of the EPUB at epub_path are kept
+static QString ContentHashesPath(const QString &epub_path)
+{
+    QByteArray name = QCryptographicHash::hash(QFileInfo(epub_path).absoluteFilePath().toUtf8(),
+                                               QCryptographicHash::Sha1).toHex();
+    return Utility::DefinePrefsDir() + "/" + CONTENT_HASHES_FOLDER + "/" + QString::fromLatin1(name);
+}
+
+void FolderKeeper::SaveContentHashes(const QString &epub_path) const
+{
+    QFileInfo epub_info(epub_path);
+
+    if (!epub_info.exists()) {
+        return;
+    }
+
+    QMap<QString, QPair<qint64, QByteArray>> entries;
+
+    foreach(Resource *resource, m_Resources.values()) {
+        QByteArray hash = resource->GetContentHash();
+
+        if (!hash.isEmpty()) {
+            entries.insert(resource->GetRelativePathToRoot(),
+                           qMakePair(QFileInfo(resource->GetFullPath()).size(), hash));
+        }
+    }
+
+    QString path = ContentHashesPath(epub_path);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_4);
+    out << epub_info.size() << epub_info.lastModified().toMSecsSinceEpoch() << entries;
+}
+
+// Reads the size and content hash of each file kept for the EPUB at
+// epub_path; false if there are none or they are for another version
+static bool ReadContentHashes(const QString &epub_path, QMap<QString, QPair<qint64, QByteArray>> &entries)
+{
+    QFile file(ContentHashesPath(epub_path));
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_4);
+    qint64 epub_size = 0;
+    qint64 epub_modified = 0;
+    in >> epub_size >> epub_modified >> entries;
+    QFileInfo epub_info(epub_path);
+
+    // Kept for some other version of the EPUB
+    return in.status() == QDataStream::Ok &&
+           epub_size == epub_info.size() &&
+           epub_modified == epub_info.lastModified().toMSecsSinceEpoch();
+}
+
+QHash<QString, QByteArray> FolderKeeper::GetSavedContentHashes(const QString &epub_path) const
+{
+    QHash<QString, QByteArray> hashes;
+    QMap<QString, QPair<qint64, QByteArray>> entries;
+
+    if (!ReadContentHashes(epub_path, entries)) {
+        return hashes;
+    }
+
+    QMap<QString, QPair<qint64, QByteArray>>::const_iterator entry;
+
+    for (entry = entries.constBegin(); entry != entries.constEnd(); ++entry) {
+        hashes.insert(entry.key(), entry.value().second);
+    }
+
+    return hashes;
+}
+
+void FolderKeeper::LoadContentHashes(const QString &epub_path)
+{
+    QMap<QString, QPair<qint64, QByteArray>> entries;
+
+    if (!ReadContentHashes(epub_path, entries)) {
+        return;
+    }
+
+    foreach(Resource *resource, m_Resources.values()) {
+        QMap<QString, QPair<qint64, QByteArray>>::const_iterator entry =
+            entries.constFind(resource->GetRelativePathToRoot());
+
+        if (entry == entries.constEnd()) {
+            continue;
+        }
+
+        // Files not yet written out of the EPUB are as it has them
+        if (!resource->HasDeferredContent() &&
+            QFileInfo(resource->GetFullPath()).size() != entry.value().first) {
+            continue;
         }
-        m_SuspendedWatchedFiles.clear();
+
+        resource->SetContentHash(entry.value().second);
     }
 }
 
@@ -506,6 +816,8 @@ void FolderKeeper::CreateInfrastructureFiles()
     m_NCX->SetEpubVersion(version);
     m_Resources[ m_OPF->GetIdentifier() ] = m_OPF;
     m_Resources[ m_NCX->GetIdentifier() ] = m_NCX;
+    IndexResource(m_OPF);
+    IndexResource(m_NCX);
     // TODO: change from Resource* to const Resource&
     connect(m_OPF, SIGNAL(Deleted(const Resource *)), this, SLOT(RemoveResource(const Resource *)));
     connect(m_NCX, SIGNAL(Deleted(const Resource *)), this, SLOT(RemoveResource(const Resource *)));
@@ -514,10 +826,14 @@ void FolderKeeper::CreateInfrastructureFiles()
     // AddContentFileToFolder is called from multiple threads.
     connect(this,  SIGNAL(ResourceAdded(const Resource *)),
             m_OPF, SLOT(AddResource(const Resource *)), Qt::DirectConnection);
+    connect(this,  SIGNAL(ResourcesAdded(const QList<const Resource *> &)),
+            m_OPF, SLOT(AddResources(const QList<const Resource *> &)), Qt::DirectConnection);
     connect(this,  SIGNAL(ResourceRemoved(const Resource *)),
             m_OPF, SLOT(RemoveResource(const Resource *)));
-    connect(m_FSWatcher, SIGNAL(fileChanged(const QString &)),
-            this,        SLOT(ResourceFileChanged(const QString &)), Qt::DirectConnection);
+    connect(this,  SIGNAL(ResourcesRemoved(const QList<const Resource *> &)),
+            m_OPF, SLOT(RemoveResources(const QList<const Resource *> &)));
+    connect(m_Watcher, SIGNAL(FilesChanged(const QStringList &)),
+            this,      SLOT(ResourceFilesChanged(const QStringList &)));
     Utility::WriteUnicodeTextFile(CONTAINER_XML, m_FullPathToMetaInfFolder + "/container.xml");
 }
 
@@ -558,6 +874,7 @@ void FolderKeeper::CreateExtensionToMediaTypeMap()
   m_ExtToMType[ "ttml"  ] = "application/ttml+xml";
   m_ExtToMType[ "vtt"   ] = "text/vtt";
   m_ExtToMType[ "webm"  ] = "video/webm";
+  m_ExtToMType[ "webp"  ] = "image/webp";
   m_ExtToMType[ "woff"  ] = "application/font-woff";
   m_ExtToMType[ "woff2"  ] = "font/woff2";
   m_ExtToMType[ "xpgt"  ] = "application/adobe-page-template+xml";
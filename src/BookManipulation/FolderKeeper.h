@@ -23,12 +23,15 @@
 #ifndef FOLDERKEEPER_H
 #define FOLDERKEEPER_H
 
+#include <utility>
+
+#include <QtCore/QByteArray>
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QHash>
 #include <QtCore/QList>
+#include <QtCore/QMap>
 #include <QtCore/QMutex>
-#include <QFileSystemWatcher>
 
 // These have to be included directly because
 // of the template functions.
@@ -42,6 +45,7 @@
 
 #include "Misc/TempFolder.h"
 
+class DirectoryWatcher;
 class NCXResource;
 
 /**
@@ -63,8 +67,9 @@ public:
      * Constructor.
      *
      * @param parent The object's parent.
+     * @param workspace_size The expected size of the book's files in bytes.
      */
-    FolderKeeper(QObject *parent = NULL);
+    FolderKeeper(QObject *parent = NULL, qint64 workspace_size = 0);
 
     /**
      *  Destructor.
@@ -87,6 +92,33 @@ public:
                                      bool update_opf = true,
                                      const QString &mimetype = QString());
 
+    /**
+     * Adds many content files at once. Equivalent to calling
+     * AddContentFileToFolder for each (path, mimetype) pair, but the
+     * resource hash is locked once, unique names are resolved against
+     * a single snapshot of the existing names, the files are copied in
+     * parallel and the OPF (if requested) is updated in a single pass.
+     * Paths that do not exist are skipped.
+     *
+     * @param files The full paths and (possibly empty) mimetypes to add.
+     * @param update_opf If set to \c true, the new resources are added
+     *                   to the OPF manifest (and spine) in one update.
+     * @return The new resources, in the order of \a files; missing paths
+     *         get a NULL entry.
+     */
+    QList<Resource *> AddContentFilesToFolder(const QList<std::pair<QString, QString>> &files,
+                                              bool update_opf = true);
+
+    /**
+     * Deletes many resources at once. Equivalent to calling
+     * Resource::Delete for each, but the files are removed from disk
+     * in parallel and the OPF is updated once for all of them.
+     *
+     * @param resources The resources to delete.
+     * @return The resources that were deleted; the others are kept.
+     */
+    QList<Resource *> DeleteResources(const QList<Resource *> &resources);
+
     /**
      * Returns the highest reading order number present in the book.
      *
@@ -122,6 +154,14 @@ public:
      */
     QList<Resource *> GetResourceList() const;
 
+    /**
+     * Returns the resources of one type, from an index kept up to date
+     * as resources are added, renamed and removed.
+     * The order of the items is random.
+     *
+     * @param type The resource type.
+     * @return A copy of the resource list, which later changes to the book leave alone.
+     */
     QList<Resource *> GetResourceListByType(Resource::ResourceType type) const;
 
     /**
@@ -156,9 +196,8 @@ public:
     /**
      * Returns the resource with the given filename.
      * @note NOTE THAT RESOURCE FILENAMES CAN CHANGE,
-     *       while identifiers don't. Also, retrieving
-     *       resources by identifier is O(1), this is O(n)
-     *       (and a \b very slow O(n) since we query the filesystem).
+     *       while identifiers don't. The lookup is O(1)
+     *       through an index updated on every rename.
      * @throws ResourceDoesNotExist if the filename is not found.
      *
      * @param filename The filename to search for.
@@ -166,6 +205,14 @@ public:
      */
     Resource *GetResourceByFilename(const QString &filename) const;
 
+    /**
+     * Returns the resource stored at the given full path.
+     *
+     * @param fullfilepath The full path to search for.
+     * @return The resource, or NULL if there is none.
+     */
+    Resource *GetResourceByFullPath(const QString &fullfilepath) const;
+
     /**
      * Returns the book's OPF file.
      *
@@ -211,6 +258,15 @@ public:
     QString GetFullPathToAudioFolder() const;
     QString GetFullPathToVideoFolder() const;
 
+    /**
+     * Returns the media type we associate with a file extension,
+     * or an empty string if the extension is unknown.
+     *
+     * @param extension The lowercase extension, without the dot.
+     * @return The media type.
+     */
+    QString GetMediaTypeForExtension(const QString &extension) const;
+
     /**
      * Returns a list of all the resource filenames in the book.
      *
@@ -229,6 +285,38 @@ public:
     void SuspendWatchingResources();
     void ResumeWatchingResources();
 
+    /**
+     * Works out, in parallel, the content hash of every resource
+     * that does not have one yet. Files not yet written out of
+     * the EPUB are left alone.
+     */
+    void UpdateContentHashes();
+
+    /**
+     * Keeps the content hashes of the resources, so that they are
+     * not worked out again the next time the EPUB is opened.
+     *
+     * @param epub_path The full path of the EPUB just saved.
+     */
+    void SaveContentHashes(const QString &epub_path) const;
+
+    /**
+     * Returns the content hashes kept by SaveContentHashes, keyed by
+     * path in the book, if the EPUB has not changed since they were
+     * kept; an empty hash otherwise.
+     *
+     * @param epub_path The full path of the EPUB that was saved.
+     */
+    QHash<QString, QByteArray> GetSavedContentHashes(const QString &epub_path) const;
+
+    /**
+     * Takes the content hashes kept by SaveContentHashes for the
+     * resources, if the EPUB has not changed since they were kept.
+     *
+     * @param epub_path The full path of the EPUB being opened.
+     */
+    void LoadContentHashes(const QString &epub_path);
+
 signals:
 
     /**
@@ -238,6 +326,13 @@ signals:
      */
     void ResourceAdded(const Resource *resource);
 
+    /**
+     * Emitted once for a batch added by AddContentFilesToFolder.
+     *
+     * @param resources The new resources.
+     */
+    void ResourcesAdded(const QList<const Resource *> &resources);
+
     /**
      * Emitted when a resource is removed from the FolderKeeper.
      *
@@ -245,6 +340,13 @@ signals:
      */
     void ResourceRemoved(const Resource *resource);
 
+    /**
+     * Emitted once for a batch deleted by DeleteResources.
+     *
+     * @param resources The removed resources.
+     */
+    void ResourcesRemoved(const QList<const Resource *> &resources);
+
 public slots:
 
     /**
@@ -264,9 +366,9 @@ private slots:
     void ResourceRenamed(const Resource *resource, const QString &old_full_path);
 
     /**
-     * Called by the FSWatcher when a watched file has changed on disk.
+     * Called by the watcher with a batch of watched files that changed on disk.
      */
-    void ResourceFileChanged(const QString &path) const;
+    void ResourceFilesChanged(const QStringList &paths) const;
 
 private:
 
@@ -283,6 +385,45 @@ private:
 
     void CreateExtensionToMediaTypeMap();
 
+    /**
+     * Creates the Resource subclass matching a file's extension or
+     * mimetype, with its final path in the matching folder. The caller
+     * must hold m_AccessMutex and copy the file into place.
+     *
+     * @param fullfilepath The full path of the file being added.
+     * @param filename The (already unique) name the file gets in the book.
+     * @param mimetype The mimetype of the file, if known.
+     * @param new_file_path Set to the full path of the file in the book.
+     * @return The new resource, already registered in m_Resources.
+     */
+    Resource *CreateResourceForFile(const QString &fullfilepath,
+                                    const QString &filename,
+                                    const QString &mimetype,
+                                    QString &new_file_path);
+
+    /**
+     * Re-parents a resource created on a worker thread to the GUI
+     * thread and connects its lifetime signals to us.
+     */
+    void AdoptResource(Resource *resource);
+
+    /**
+     * Adds a resource to the filename, full path and type indexes.
+     */
+    void IndexResource(Resource *resource);
+
+    /**
+     * Drops a resource from the indexes, under the full path
+     * it had when it was indexed.
+     */
+    void UnindexResource(const Resource *resource, const QString &fullfilepath);
+
+    /**
+     * Adds or drops one filename in m_FoldedFilenames and m_NumberSuffixes.
+     */
+    void IndexFilename(const QString &filename);
+    void UnindexFilename(const QString &filename);
+
     /**
      * Dereferences two pointers and compares the values with "<".
      *
@@ -320,6 +461,25 @@ private:
      */
     QHash<QString, Resource *> m_Resources;
 
+    /**
+     * Secondary indexes of m_Resources by filename, by full path
+     * and by resource type. Kept current by IndexResource and
+     * UnindexResource.
+     */
+    QHash<QString, Resource *> m_ResourcesByFilename;
+    QHash<QString, Resource *> m_ResourcesByFullPath;
+    QHash<int, QList<Resource *>> m_ResourcesByType;
+
+    /**
+     * What GetUniqueFilenameVersion needs, kept with the indexes above:
+     * how many files have each lower cased filename, and for each lower
+     * cased name prefix and extension, the number suffixes in use with
+     * the digit counts they were written with. "Section0012.xhtml"
+     * is number 12, written with 4 digits, under "section" and "xhtml".
+     */
+    QHash<QString, int> m_FoldedFilenames;
+    QHash<QString, QMap<int, QList<int>>> m_NumberSuffixes;
+
     /**
      * Ensures thread-safe access to the m_Resources hash.
      */
@@ -333,8 +493,7 @@ private:
     /**
      * Watches the files on disk for any changes in case the resources have been modified from outside Sigil.
      */
-    QFileSystemWatcher *m_FSWatcher;
-    QStringList m_SuspendedWatchedFiles;
+    DirectoryWatcher *m_Watcher;
 
     // Full paths to all the folders in the publication
     QString m_FullPathToMainFolder;
@@ -24,12 +24,16 @@
 #include <functional>
 
 #include <QtCore/QtCore>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 #include <QtConcurrent/QtConcurrent>
 
 #include "BookManipulation/Headings.h"
 #include "BookManipulation/XhtmlDoc.h"
+#include "Misc/GumboCache.h"
 #include "Misc/GumboInterface.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -49,6 +53,19 @@ const QStringList HEADING_TAGS = QStringList() << "h1" << "h2" << "h3" << "h4" <
 const QString SIGIL_NOT_IN_TOC_CLASS = "sigil_not_in_toc";
 const QString OLD_SIGIL_NOT_IN_TOC_CLASS = "sigilNotInTOC";
 
+// The headings of each file, by resource identifier, for the text
+// revision they were read from. Heading lists are small, so one is
+// kept for every file and only changed files are parsed again.
+struct CachedHeadings {
+    int revision;
+    QString version;
+    QList<Headings::Heading> headings;
+};
+
+static QMutex s_HeadingsMutex;
+
+static QHash<QString, CachedHeadings> s_Headings;
+
 
 // Returns a list of headings from the provided XHTML source;
 // the list is flat, the headings are *not* in a hierarchy tree
@@ -72,10 +89,62 @@ QList<Headings::Heading> Headings::GetHeadingListForOneFile(HTMLResource *html_r
         bool include_unwanted_headings)
 {
     Q_ASSERT(html_resource);
-    QString source = html_resource->GetText();
+    QString identifier = html_resource->GetIdentifier();
     QString version = html_resource->GetEpubVersion();
-    GumboInterface gi = GumboInterface(source, version);
-    gi.parse();
+    QList<Heading> headings;
+    bool cached = false;
+    {
+        QMutexLocker locker(&s_HeadingsMutex);
+        QHash<QString, CachedHeadings>::const_iterator it = s_Headings.constFind(identifier);
+        if (it != s_Headings.constEnd() && it.value().revision == html_resource->GetTextRevision() &&
+            it.value().version == version) {
+            headings = it.value().headings;
+            cached = true;
+        }
+    }
+
+    if (!cached) {
+        TextResource::Snapshot snapshot = html_resource->GetSnapshot();
+        headings = ExtractHeadings(html_resource, snapshot, version);
+        QMutexLocker locker(&s_HeadingsMutex);
+        QHash<QString, CachedHeadings>::iterator it = s_Headings.find(identifier);
+        // Another thread may already have cached a newer text
+        if (it == s_Headings.end() || it.value().revision <= snapshot.revision) {
+            CachedHeadings entry;
+            entry.revision = snapshot.revision;
+            entry.version = version;
+            entry.headings = headings;
+            s_Headings.insert(identifier, entry);
+        }
+    }
+
+    if (include_unwanted_headings) {
+        return headings;
+    }
+
+    QList<Heading> wanted_headings;
+    foreach(const Heading &heading, headings) {
+        if (heading.include_in_toc) {
+            wanted_headings.append(heading);
+        }
+    }
+    return wanted_headings;
+}
+
+
+void Headings::ClearCache()
+{
+    QMutexLocker locker(&s_HeadingsMutex);
+    s_Headings.clear();
+}
+
+
+// Every heading of the file, wanted or not
+QList<Headings::Heading> Headings::ExtractHeadings(HTMLResource *html_resource,
+                                                  const TextResource::Snapshot &snapshot,
+                                                  const QString &version)
+{
+    GumboInterface gi(GumboCache::Get(html_resource, snapshot), version);
 
     // get original source line number of body element
     unsigned int body_line = 0;
@@ -132,9 +201,7 @@ QList<Headings::Heading> Headings::GetHeadingListForOneFile(HTMLResource *html_r
         heading.at_file_start = (i == 0) && ((node_line - body_line) < ALLOWED_HEADING_DISTANCE);
         heading.is_changed     = false;
 
-        if (heading.include_in_toc || include_unwanted_headings) {
-            headings.append(heading);
-        }
+        headings.append(heading);
     }
 
     return headings;
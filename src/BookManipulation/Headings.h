@@ -26,7 +26,9 @@
 
 #include <QtCore/QList>
 #include <QtCore/QMetaType>
+#include <QtCore/QString>
 
+#include "ResourceObjects/TextResource.h"
 
 class HTMLResource;
 class QString;
@@ -91,9 +93,14 @@ public:
     static QList<Heading> GetHeadingList(QList<HTMLResource *> html_resources,
                                          bool include_unwanted_headings = false);
 
+    // The headings of a file are read once per text revision
+    // and cached; only files edited since are parsed again
     static QList<Heading> GetHeadingListForOneFile(HTMLResource *html_resource,
             bool include_unwanted_headings = false);
 
+    // Drops every cached heading list
+    static void ClearCache();
+
     // Takes a flat list of headings and returns a list with those
     // headings sorted into a hierarchy
     static QList<Heading> MakeHeadingHeirarchy(const QList<Heading> &headings);
@@ -102,6 +109,10 @@ public:
     static QList<Heading> GetFlattenedHeadings(const QList<Heading> &headings);
 
 private:
+    static QList<Heading> ExtractHeadings(HTMLResource *html_resource,
+                                          const TextResource::Snapshot &snapshot,
+                                          const QString &version);
+
     // Flattens the provided heading node and its children
     // into a list and returns it
     static QList<Heading> FlattenHeadingNode(Heading heading);
@@ -34,6 +34,7 @@
 #include "BookManipulation/XhtmlDoc.h"
 #include "MiscEditors/IndexEditorModel.h"
 #include "BookManipulation/Index.h"
+#include "BookManipulation/IndexMatcher.h"
 #include "MiscEditors/IndexEntries.h"
 #include "sigil_constants.h"
 
@@ -49,28 +50,79 @@ bool Index::BuildIndex(QList<HTMLResource *> html_resources)
     int progress_value = 0;
     progress.setValue(progress_value);
     qApp->processEvents();
-    // Must do sequentially in order to keep sections in order
+    // The patterns are compiled once for the whole book
+    QList<IndexEditorModel::indexEntry *> entries = IndexEditorModel::instance()->GetEntries();
+    QStringList patterns;
+    foreach(IndexEditorModel::indexEntry * entry, entries) {
+        patterns.append(entry->pattern);
+    }
+    IndexMatcher matcher(patterns);
+    // The files are worked on in parallel, but their entries are added
+    // in order to keep the sections in order
+    TaskScheduler::CancelToken cancel;
+    QList<QFuture<Indexed>> indexed_files;
     foreach(HTMLResource * html_resource, html_resources) {
+        indexed_files.append(QtConcurrent::run(AddIndexIDsOneFile, html_resource, &matcher, entries, cancel));
+    }
+    bool completed = true;
+    foreach(QFuture<Indexed> indexed_file, indexed_files) {
         // Set progress value and ensure dialog has time to display when doing extensive updates
         if (progress.wasCanceled()) {
-            return false;
+            completed = false;
+            break;
         }
 
         progress.setValue(progress_value++);
         qApp->processEvents();
-        AddIndexIDsOneFile(html_resource);
+        CommitIndexed(indexed_file.result(), &matcher, entries);
     }
-    return true;
+    // The workers still running use the matcher and entries
+    cancel.Cancel();
+    foreach(QFuture<Indexed> indexed_file, indexed_files) {
+        indexed_file.waitForFinished();
+    }
+    qDeleteAll(entries);
+    return completed;
 }
 
-void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
+void Index::CommitIndexed(const Indexed &indexed,
+                          const IndexMatcher *matcher,
+                          const QList<IndexEditorModel::indexEntry *> &entries)
 {
-    QWriteLocker locker(&html_resource->GetLock());
-    QString source = html_resource->GetText();
-    QString version = html_resource->GetEpubVersion();
-    GumboInterface gi = GumboInterface(source, version);
+    bool unchanged = indexed.resource_updated ?
+                     indexed.resource->SetTextIfUnchanged(indexed.new_text, indexed.revision) :
+                     indexed.resource->GetTextRevision() == indexed.revision;
+
+    if (!unchanged) {
+        // Edited since the worker read it, so it is done again here
+        CommitIndexed(AddIndexIDsOneFile(indexed.resource, matcher, entries, TaskScheduler::CancelToken()), matcher, entries);
+        return;
+    }
+
+    QString filename = indexed.resource->Filename();
+    foreach(const IndexedEntry &entry, indexed.entries) {
+        IndexEntries::instance()->AddOneEntry(entry.text, filename, entry.index_id_value);
+    }
+}
+
+Index::Indexed Index::AddIndexIDsOneFile(HTMLResource *html_resource,
+                                         const IndexMatcher *matcher,
+                                         const QList<IndexEditorModel::indexEntry *> &entries,
+                                         TaskScheduler::CancelToken cancel)
+{
+    Indexed indexed;
+    indexed.resource = html_resource;
+    indexed.resource_updated = false;
+
+    if (cancel.IsCancelled()) {
+        indexed.revision = -1;
+        return indexed;
+    }
+
+    TextResource::Snapshot snapshot = html_resource->GetSnapshot();
+    indexed.revision = snapshot.revision;
+    GumboInterface gi = GumboInterface(snapshot.text, html_resource->GetEpubVersion());
     QList<GumboNode*> nodes = XhtmlDoc::GetIDNodes(gi, gi.get_root_node());
-    bool resource_updated = false;
     int index_id_number = 1;
     foreach(GumboNode * node, nodes) {
         QString index_id_value;
@@ -86,7 +138,7 @@ void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
             if (index_id_value.startsWith(SIGIL_INDEX_ID_PREFIX)) {
                 GumboElement* element = &node->v.element;
                 gumbo_element_remove_attribute(element, attr);
-                resource_updated = true;
+                indexed.resource_updated = true;
             }
         }
 
@@ -115,61 +167,70 @@ void Index::AddIndexIDsOneFile(HTMLResource *html_resource)
         // Use the existing id if there is one, else add one if node contains index item
         attr = gumbo_get_attribute(&node->v.element.attributes, "id");
         if (attr) {
-            CreateIndexEntry(text_node_text, html_resource, index_id_value, is_custom_index_entry, custom_index_value);
+            CreateIndexEntry(text_node_text, index_id_value, is_custom_index_entry, custom_index_value, matcher, entries, indexed.entries);
         } else {
             index_id_value = SIGIL_INDEX_ID_PREFIX + QString::number(index_id_number);
 
-            if (CreateIndexEntry(text_node_text, html_resource, index_id_value, is_custom_index_entry, custom_index_value)) {
+            if (CreateIndexEntry(text_node_text, index_id_value, is_custom_index_entry, custom_index_value, matcher, entries, indexed.entries)) {
                 GumboElement* element = &node->v.element;
                 gumbo_element_set_attribute(element, "id", index_id_value.toUtf8().constData()); 
-                resource_updated = true;
+                indexed.resource_updated = true;
                 index_id_number++;
             }
         }
     }
 
-    if (resource_updated) {
-        html_resource->SetText(gi.getxhtml());
+    if (indexed.resource_updated) {
+        indexed.new_text = gi.getxhtml();
     }
+
+    return indexed;
 }
 
 
-bool Index::CreateIndexEntry(const QString text, HTMLResource *html_resource, QString index_id_value, bool is_custom_index_entry, QString custom_index_value)
+bool Index::CreateIndexEntry(const QString text,
+                             QString index_id_value,
+                             bool is_custom_index_entry,
+                             QString custom_index_value,
+                             const IndexMatcher *matcher,
+                             const QList<IndexEditorModel::indexEntry *> &entries,
+                             QList<IndexedEntry> &indexed_entries)
 {
-    bool created_index = false;
-    QList<IndexEditorModel::indexEntry *> entries;
-
     if (is_custom_index_entry) {
-        IndexEditorModel::indexEntry *custom_entry = new IndexEditorModel::indexEntry();
-        custom_entry->pattern = text;
-        custom_entry->index_entry = custom_index_value;
-        entries.append(custom_entry);
-    } else {
-        entries = IndexEditorModel::instance()->GetEntries();
+        if (text.isEmpty() || !text.contains(QRegularExpression(text))) {
+            return false;
+        }
+
+        AppendIndexedEntry(text, custom_index_value, index_id_value, indexed_entries);
+        return true;
     }
 
-    foreach(IndexEditorModel::indexEntry * entry, entries) {
-        QString index_pattern = entry->pattern;
-        if (index_pattern.isEmpty()) {
-            continue;
-        }
+    const QList<int> matched = matcher->Match(text);
+    foreach(int i, matched) {
+        AppendIndexedEntry(entries.at(i)->pattern, entries.at(i)->index_entry, index_id_value, indexed_entries);
+    }
+    return !matched.isEmpty();
+}
 
-        QRegularExpression index_regex(index_pattern);
-
-        if (text.contains(index_regex)) {
-            created_index = true;
-            QString index_entry = entry->index_entry;
-            if (index_entry.isEmpty()) {
-                // If no index text, use the pattern
-                IndexEntries::instance()->AddOneEntry(index_pattern, html_resource->Filename(), index_id_value);
-            } else if (entry->index_entry.endsWith("/")) {
-                // If index text is a category then append the pattern
-                IndexEntries::instance()->AddOneEntry(index_entry + index_pattern, html_resource->Filename(), index_id_value);
-            } else {
-                // Use the given index text
-                IndexEntries::instance()->AddOneEntry(index_entry, html_resource->Filename(), index_id_value);
-            }
-        }
+
+void Index::AppendIndexedEntry(const QString &index_pattern,
+                               const QString &index_entry,
+                               const QString &index_id_value,
+                               QList<IndexedEntry> &indexed_entries)
+{
+    IndexedEntry indexed_entry;
+    indexed_entry.index_id_value = index_id_value;
+
+    if (index_entry.isEmpty()) {
+        // If no index text, use the pattern
+        indexed_entry.text = index_pattern;
+    } else if (index_entry.endsWith("/")) {
+        // If index text is a category then append the pattern
+        indexed_entry.text = index_entry + index_pattern;
+    } else {
+        // Use the given index text
+        indexed_entry.text = index_entry;
     }
-    return created_index;
+
+    indexed_entries.append(indexed_entry);
 }
@@ -25,7 +25,14 @@
 #ifndef INDEX_H
 #define INDEX_H
 
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "Misc/TaskScheduler.h"
+#include "MiscEditors/IndexEditorModel.h"
+
 class HTMLResource;
+class IndexMatcher;
 
 /**
  * Houses the Index process.
@@ -39,9 +46,54 @@ public:
     static bool BuildIndex(QList<HTMLResource *> html_resources);
 
 private:
-    static void AddIndexIDsOneFile(HTMLResource *html_resource);
+    /**
+     * One entry to add to the index, for the element with index_id_value.
+     */
+    struct IndexedEntry {
+        QString text;
+        QString index_id_value;
+    };
+
+    /**
+     * What was worked out for one file, from its text as it was at
+     * revision: the new text if ids were added or removed, and its
+     * entries in document order.
+     */
+    struct Indexed {
+        HTMLResource *resource;
+        int revision;
+        bool resource_updated;
+        QString new_text;
+        QList<IndexedEntry> entries;
+    };
+
+    /**
+     * Runs on a worker thread; the resource is only read.
+     */
+    static Indexed AddIndexIDsOneFile(HTMLResource *html_resource,
+                                      const IndexMatcher *matcher,
+                                      const QList<IndexEditorModel::indexEntry *> &entries,
+                                      TaskScheduler::CancelToken cancel);
+
+    /**
+     * Sets the new text and adds the entries; on the GUI thread.
+     */
+    static void CommitIndexed(const Indexed &indexed,
+                              const IndexMatcher *matcher,
+                              const QList<IndexEditorModel::indexEntry *> &entries);
+
+    static bool CreateIndexEntry(const QString text,
+                                 QString index_id_name,
+                                 bool is_custom_index_entry,
+                                 QString custom_index_name,
+                                 const IndexMatcher *matcher,
+                                 const QList<IndexEditorModel::indexEntry *> &entries,
+                                 QList<IndexedEntry> &indexed_entries);
 
-    static bool CreateIndexEntry(const QString text, HTMLResource *html_resource, QString index_id_name, bool is_custom_index_entry, QString custom_index_name);
+    static void AppendIndexedEntry(const QString &index_pattern,
+                                   const QString &index_entry,
+                                   const QString &index_id_value,
+                                   QList<IndexedEntry> &indexed_entries);
 };
 
 #endif // INDEX_H
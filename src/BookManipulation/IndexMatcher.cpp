@@ -0,0 +1,185 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <algorithm>
+
+#include <QtCore/QQueue>
+
+#include "BookManipulation/IndexMatcher.h"
+#include "PCRE/LiteralSearch.h"
+
+static bool CharBefore(const QPair<ushort, int> &edge, ushort c)
+{
+    return edge.first < c;
+}
+
+
+IndexMatcher::IndexMatcher(const QStringList &patterns)
+    :
+    m_PatternCount(patterns.count())
+{
+    // The root
+    m_States.append(State());
+
+    for (int i = 0; i < patterns.count(); ++i) {
+        const QString &pattern = patterns.at(i);
+
+        if (pattern.isEmpty()) {
+            continue;
+        }
+
+        QString literal;
+        bool caseless = false;
+
+        // Caseless ones are left to the regex, which knows the case rules
+        if (LiteralSearch::ToLiteral(pattern, literal, caseless) && !caseless) {
+            AddLiteral(literal, i);
+        } else {
+            QRegularExpression regex(pattern);
+            regex.optimize();
+            m_Regexes.append(qMakePair(i, regex));
+        }
+    }
+
+    LinkFailures();
+}
+
+
+QList<int> IndexMatcher::Match(const QString &text) const
+{
+    QVector<bool> found(m_PatternCount, false);
+    const ushort *chars = text.utf16();
+    int length = text.length();
+    int state = 0;
+
+    for (int pos = 0; pos < length; ++pos) {
+        state = Next(state, chars[pos]);
+        int hit = m_States.at(state).output >= 0 ? state : m_States.at(state).next_output;
+
+        while (hit != -1) {
+            found[m_States.at(hit).output] = true;
+            hit = m_States.at(hit).next_output;
+        }
+    }
+
+    for (int i = 0; i < m_Duplicates.count(); ++i) {
+        found[m_Duplicates.at(i).second] = found.at(m_Duplicates.at(i).first);
+    }
+
+    for (int i = 0; i < m_Regexes.count(); ++i) {
+        const QPair<int, QRegularExpression> &regex = m_Regexes.at(i);
+
+        if (text.contains(regex.second)) {
+            found[regex.first] = true;
+        }
+    }
+
+    QList<int> matched;
+
+    for (int i = 0; i < m_PatternCount; ++i) {
+        if (found.at(i)) {
+            matched.append(i);
+        }
+    }
+
+    return matched;
+}
+
+
+void IndexMatcher::AddLiteral(const QString &literal, int pattern)
+{
+    int state = 0;
+    const ushort *chars = literal.utf16();
+
+    for (int pos = 0; pos < literal.length(); ++pos) {
+        int child = Child(state, chars[pos]);
+
+        if (child < 0) {
+            child = m_States.count();
+            m_States.append(State());
+            QVector<QPair<ushort, int>> &next = m_States[state].next;
+            QVector<QPair<ushort, int>>::iterator it = std::lower_bound(next.begin(), next.end(), chars[pos], CharBefore);
+            next.insert(it, qMakePair(chars[pos], child));
+        }
+
+        state = child;
+    }
+
+    if (m_States.at(state).output >= 0) {
+        m_Duplicates.append(qMakePair(m_States.at(state).output, pattern));
+    } else {
+        m_States[state].output = pattern;
+    }
+}
+
+
+void IndexMatcher::LinkFailures()
+{
+    // Breadth first, so the state a failure falls back to
+    // is always linked before the states that fall back to it
+    QQueue<int> queue;
+    queue.enqueue(0);
+
+    while (!queue.isEmpty()) {
+        int state = queue.dequeue();
+        const QVector<QPair<ushort, int>> next = m_States.at(state).next;
+
+        for (int i = 0; i < next.count(); ++i) {
+            int child = next.at(i).second;
+            int fail = state == 0 ? 0 : Next(m_States.at(state).fail, next.at(i).first);
+            m_States[child].fail = fail;
+            m_States[child].next_output = m_States.at(fail).output >= 0 ? fail : m_States.at(fail).next_output;
+            queue.enqueue(child);
+        }
+    }
+}
+
+
+int IndexMatcher::Next(int state, ushort c) const
+{
+    while (true) {
+        int child = Child(state, c);
+
+        if (child >= 0) {
+            return child;
+        }
+
+        if (state == 0) {
+            return 0;
+        }
+
+        state = m_States.at(state).fail;
+    }
+}
+
+
+int IndexMatcher::Child(int state, ushort c) const
+{
+    const QVector<QPair<ushort, int>> &next = m_States.at(state).next;
+    QVector<QPair<ushort, int>>::const_iterator it = std::lower_bound(next.constBegin(), next.constEnd(), c, CharBefore);
+
+    if (it == next.constEnd() || it->first != c) {
+        return -1;
+    }
+
+    return it->second;
+}
@@ -0,0 +1,93 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef INDEXMATCHER_H
+#define INDEXMATCHER_H
+
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <QRegularExpression>
+
+/**
+ * Finds which of the Index Editor patterns a piece of text contains,
+ * for all of the patterns at once.
+ *
+ * The patterns are compiled when the matcher is made, not for every
+ * element that is looked at. Those that are plain, case sensitive text
+ * go into one Aho-Corasick automaton, so each text is read only once
+ * for all of them; the rest are compiled to regexes up front. Once made
+ * the matcher is only read, and may be shared by several threads.
+ */
+class IndexMatcher
+{
+public:
+
+    /**
+     * @param patterns The pattern of each index entry, in order.
+     *        Empty patterns never match.
+     */
+    IndexMatcher(const QStringList &patterns);
+
+    /**
+     * @return The positions in the pattern list of the patterns found
+     *         in text, in ascending order.
+     */
+    QList<int> Match(const QString &text) const;
+
+private:
+
+    struct State {
+        State() : fail(0), output(-1), next_output(-1) {}
+
+        // Sorted by character
+        QVector<QPair<ushort, int>> next;
+        int fail;
+        // The pattern that ends here, if any
+        int output;
+        // The nearest state down the fail links with an output
+        int next_output;
+    };
+
+    void AddLiteral(const QString &literal, int pattern);
+
+    void LinkFailures();
+
+    int Next(int state, ushort c) const;
+
+    int Child(int state, ushort c) const;
+
+    QVector<State> m_States;
+
+    // The patterns with the same literal as one before them, in
+    // pairs of (the first of them, the duplicate)
+    QList<QPair<int, int>> m_Duplicates;
+
+    QList<QPair<int, QRegularExpression>> m_Regexes;
+
+    int m_PatternCount;
+};
+
+#endif // INDEXMATCHER_H
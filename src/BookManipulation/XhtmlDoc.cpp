@@ -103,74 +103,545 @@ QString XhtmlDoc::ResolveCustomEntities(const QString &source)
         new_source.replace(match.captured(), "");
     }
 
-    // ...and now replace all occurrences
+    // ...and now replace all occurrences, in one pass
+    int max_key_length = 0;
     foreach(QString key, entities.keys()) {
-        new_source.replace(key, entities[ key ]);
+        max_key_length = qMax(max_key_length, key.length());
     }
+
+    QString resolved;
+    resolved.reserve(new_source.length());
+    int copied = 0;
+    int amp = new_source.indexOf(QChar('&'));
+    while (amp != -1) {
+        int semi = -1;
+        int limit = qMin(new_source.length(), amp + max_key_length);
+        for (int i = amp + 1; i < limit; ++i) {
+            if (new_source.at(i) == QChar(';')) {
+                semi = i;
+                break;
+            }
+        }
+
+        QHash<QString, QString>::const_iterator entity = entities.constEnd();
+        if (semi != -1) {
+            entity = entities.constFind(new_source.mid(amp, semi - amp + 1));
+        }
+        if (entity == entities.constEnd()) {
+            amp = new_source.indexOf(QChar('&'), amp + 1);
+            continue;
+        }
+
+        resolved.append(new_source.midRef(copied, amp - copied));
+        resolved.append(entity.value());
+        copied = semi + 1;
+        amp = new_source.indexOf(QChar('&'), copied);
+    }
+    resolved.append(new_source.midRef(copied));
+    new_source = resolved;
+
     // Clean up what's left of the custom entity declaration field
     new_source.replace(QRegularExpression("\\[\\s*\\]>"), "");
     return new_source;
 }
 
 
+static const QStringList HEAD_VOID_TAGS = QStringList() << "base" << "link" << "meta";
+
+// Decodes the character references and the predefined
+// entities, as an XML reader would
+static QString DecodeXmlText(const QString &text)
+{
+    if (!text.contains('&')) {
+        return text;
+    }
+
+    QString decoded;
+    decoded.reserve(text.length());
+    int pos = 0;
+
+    while (pos < text.length()) {
+        int amp = text.indexOf('&', pos);
+        int semi = amp == -1 ? -1 : text.indexOf(';', amp);
+
+        if (semi == -1) {
+            decoded.append(text.midRef(pos));
+            break;
+        }
+
+        decoded.append(text.midRef(pos, amp - pos));
+        QString entity = text.mid(amp + 1, semi - amp - 1);
+        bool ok = false;
+        uint code = 0;
+
+        if (entity.startsWith("#x") || entity.startsWith("#X")) {
+            code = entity.mid(2).toUInt(&ok, 16);
+        } else if (entity.startsWith('#')) {
+            code = entity.mid(1).toUInt(&ok, 10);
+        }
+
+        if (ok) {
+            decoded.append(QString::fromUcs4(&code, 1));
+        } else if (entity == "amp") {
+            decoded.append('&');
+        } else if (entity == "lt") {
+            decoded.append('<');
+        } else if (entity == "gt") {
+            decoded.append('>');
+        } else if (entity == "quot") {
+            decoded.append('"');
+        } else if (entity == "apos") {
+            decoded.append('\'');
+        } else {
+            decoded.append(text.midRef(amp, semi - amp + 1));
+        }
+
+        pos = semi + 1;
+    }
+
+    return decoded;
+}
+
+
+// Returns the position of the > that ends the tag
+// whose attributes start at pos, or -1
+static int FindTagEnd(const QString &source, int pos)
+{
+    QChar quote;
+
+    for (int i = pos; i < source.length(); ++i) {
+        QChar c = source.at(i);
+
+        if (!quote.isNull()) {
+            if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+// Parses the attributes the way CreateXMLElement reports them:
+// local names, namespace declarations left out, values decoded
+static QHash<QString, QString> ParseTagAttributes(const QString &attributes)
+{
+    static const QRegularExpression attribute("([^\\s=/>]+)\\s*=\\s*(?:\"([^\"]*)\"|'([^']*)')");
+    static const QRegularExpression whitespace("[\\t\\r\\n]");
+    QHash<QString, QString> parsed;
+    QRegularExpressionMatchIterator matches = attribute.globalMatch(attributes);
+
+    while (matches.hasNext()) {
+        QRegularExpressionMatch match = matches.next();
+        QString name = match.captured(1);
+
+        if (name == "xmlns" || name.startsWith("xmlns:")) {
+            continue;
+        }
+
+        name = name.mid(name.indexOf(':') + 1);
+
+        if (!Utility::IsMixedCase(name)) {
+            name = name.toLower();
+        }
+
+        QString value = match.capturedStart(2) != -1 ? match.captured(2) : match.captured(3);
+        value.replace(whitespace, " ");
+        parsed[ name ] = DecodeXmlText(value);
+    }
+
+    return parsed;
+}
+
+
+// Collects the elements of the specified tag name in the head
+// section of the provided XHTML source code, with where each is
+// in the source as start and length, and sets head_close to
+// where </head> starts, or -1 if the head has no end tag.
+// The source is scanned a tag at a time and only up to the end
+// of the head (or the start of the body), so the cost does not
+// depend on how long the body is. Comments, processing
+// instructions, the doctype and CDATA sections are skipped.
+static void ScanHead(const QString &source, const QString &tag_name,
+                     QList<XhtmlDoc::XMLElement> &matching_elements,
+                     QList<QPair<int, int>> &ranges, int &head_close)
+{
+    head_close = -1;
+    int length = source.length();
+    int pos = 0;
+    int lineno = 1;
+    int counted = 0;
+    bool in_head = false;
+
+    while (pos < length) {
+        int lt = source.indexOf('<', pos);
+
+        if (lt == -1 || lt + 1 >= length) {
+            break;
+        }
+
+        QChar next = source.at(lt + 1);
+
+        if (next == '!' || next == '?') {
+            int end;
+
+            if (source.midRef(lt, 4) == QLatin1String("<!--")) {
+                end = source.indexOf("-->", lt + 4);
+                end = end == -1 ? -1 : end + 3;
+            } else if (source.midRef(lt, 9) == QLatin1String("<![CDATA[")) {
+                end = source.indexOf("]]>", lt + 9);
+                end = end == -1 ? -1 : end + 3;
+            } else {
+                end = FindTagEnd(source, lt + 2);
+                end = end == -1 ? -1 : end + 1;
+            }
+
+            if (end == -1) {
+                break;
+            }
+
+            pos = end;
+            continue;
+        }
+
+        bool end_tag = next == '/';
+        int name_start = lt + (end_tag ? 2 : 1);
+        int name_end = name_start;
+
+        while (name_end < length && !source.at(name_end).isSpace() &&
+               source.at(name_end) != '>' && source.at(name_end) != '/') {
+            name_end++;
+        }
+
+        QString name = source.mid(name_start, name_end - name_start);
+        QString local_name = name.mid(name.indexOf(':') + 1);
+        int gt = FindTagEnd(source, name_end);
+
+        if (gt == -1) {
+            break;
+        }
+
+        pos = gt + 1;
+
+        if (end_tag) {
+            if (local_name.compare("head", Qt::CaseInsensitive) == 0) {
+                head_close = lt;
+                break;
+            }
+
+            continue;
+        }
+
+        if (local_name.compare("body", Qt::CaseInsensitive) == 0) {
+            break;
+        }
+
+        if (local_name.compare("head", Qt::CaseInsensitive) == 0) {
+            in_head = true;
+            continue;
+        }
+
+        // Void elements may be written without the slash in HTML;
+        // looking for their end tag would scan the whole document
+        bool self_closing = source.at(gt - 1) == '/' || HEAD_VOID_TAGS.contains(local_name.toLower());
+        int close = !in_head || self_closing ? -1 : source.indexOf("</" + name, pos);
+
+        if (in_head && local_name == tag_name) {
+            lineno += source.midRef(counted, lt - counted).count('\n');
+            counted = lt;
+            XhtmlDoc::XMLElement element;
+            element.name = local_name;
+            element.lineno = lineno;
+            element.attributes = ParseTagAttributes(source.mid(name_end, gt - name_end));
+
+            if (close != -1) {
+                // Includes child text, as CreateXMLElement does
+                QString text = source.mid(pos, close - pos);
+                text.remove(QRegularExpression("<[^>]*>"));
+                element.text = DecodeXmlText(text);
+            }
+
+            matching_elements.append(element);
+
+            // The end tag is part of the element, even after a void one
+            int end = pos;
+            int after = close;
+
+            if (after == -1 && source.at(gt - 1) != '/') {
+                after = pos;
+                while (after < length && source.at(after).isSpace()) {
+                    after++;
+                }
+                if (source.midRef(after, name.length() + 2) != QString("</" + name)) {
+                    after = -1;
+                }
+            }
+
+            if (after != -1) {
+                int after_gt = FindTagEnd(source, after + 2);
+                end = after_gt == -1 ? pos : after_gt + 1;
+            }
+
+            ranges.append(qMakePair(lt, end - lt));
+        }
+
+        // Skip over the content of elements in the head;
+        // style and script content is not markup at all
+        if (close != -1) {
+            pos = close;
+        }
+    }
+}
+
+
 // Returns a list of XMLElements representing all
 // the elements of the specified tag name
 // in the head section of the provided XHTML source code
 QList<XhtmlDoc::XMLElement> XhtmlDoc::GetTagsInHead(const QString &source, const QString &tag_name)
 {
-    // TODO: how about replacing uses of this function
-    // with XPath expressions? Profile for speed.
-    QXmlStreamReader reader(source);
-    bool in_head = false;
     QList<XMLElement> matching_elements;
+    QList<QPair<int, int>> ranges;
+    int head_close;
+    ScanHead(source, tag_name, matching_elements, ranges, head_close);
+    return matching_elements;
+}
 
-    while (!reader.atEnd()) {
-        reader.readNext();
 
-        if (reader.isStartElement()) {
-            if (reader.name() == "head" || reader.name() == "HEAD") {
-                in_head = true;
-            } else if (in_head && reader.name() == tag_name) {
-                matching_elements.append(CreateXMLElement(reader));
-            }
-        } else if (reader.isEndElement() &&
-                   (reader.name() == "head" || reader.name() == "HEAD")
-                  ) {
+bool XhtmlDoc::GetLinksInHead(const QString &source, QList<XMLElement> &links,
+                              QList<QPair<int, int>> &ranges, int &head_close)
+{
+    ScanHead(source, "link", links, ranges, head_close);
+    return head_close != -1;
+}
+
+
+// The text of the element content between start and end, with the
+// text of child elements included and comments left out, as
+// QXmlStreamReader::readElementText(IncludeChildElements) gives it
+static QString ElementText(const QString &source, int start, int end)
+{
+    QString text;
+    int pos = start;
+
+    while (pos < end) {
+        int lt = source.indexOf('<', pos);
+
+        if (lt == -1 || lt >= end) {
+            text.append(DecodeXmlText(source.mid(pos, end - pos)));
             break;
         }
-    }
 
-    if (reader.hasError()) {
-        std::string msg = reader.errorString().toStdString() + ": " + QString::number(reader.lineNumber()).toStdString() + ": " + QString::number(reader.columnNumber()).toStdString();
-        throw (ErrorParsingXml(msg));
+        text.append(DecodeXmlText(source.mid(pos, lt - pos)));
+        int after;
+
+        if (source.midRef(lt, 4) == QLatin1String("<!--")) {
+            after = source.indexOf("-->", lt + 4);
+            after = after == -1 ? end : after + 3;
+        } else if (source.midRef(lt, 9) == QLatin1String("<![CDATA[")) {
+            after = source.indexOf("]]>", lt + 9);
+            after = after == -1 || after > end ? end : after;
+            text.append(source.midRef(lt + 9, after - lt - 9));
+            after += 3;
+        } else {
+            after = FindTagEnd(source, lt + 1);
+            after = after == -1 ? end : after + 1;
+        }
+
+        pos = after;
     }
 
-    return matching_elements;
+    return text;
+}
+
+
+// Where the error at pos is, as QXmlStreamReader reports it
+static QString ScanError(const QString &source, int pos, const QString &message)
+{
+    int line_start = source.lastIndexOf('\n', pos - 1) + 1;
+    int lineno = source.leftRef(pos).count('\n') + 1;
+    return message + ": " + QString::number(lineno) + ": " + QString::number(pos - line_start + 1);
 }
 
 
 // Returns a list of XMLElements representing all
 // the elements of the specified tag name
 // in the entire document of the provided XHTML source code
-QList<XhtmlDoc::XMLElement> XhtmlDoc::GetTagsInDocument(const QString &source, const QString &tag_name)
+QList<XhtmlDoc::XMLElement> XhtmlDoc::GetTagsInDocument(const QString &source, const QString &tag_name, QString *error)
 {
-    // TODO: how about replacing uses of this function
-    // with XPath expressions? Profile for speed.
-    QXmlStreamReader reader(source);
+    // The elements open at the tag being read, and for each the
+    // element found it is, if it is one, and where its content starts
+    struct OpenElement {
+        QString name;
+        int match;
+        int content_start;
+    };
+
     QList<XMLElement> matching_elements;
+    QList<OpenElement> open_elements;
+    QString first_error;
+    int length = source.length();
+    int pos = 0;
+    int lineno = 1;
+    int counted = 0;
 
-    while (!reader.atEnd()) {
-        reader.readNext();
+    while (pos < length) {
+        int lt = source.indexOf('<', pos);
 
-        if (reader.isStartElement() &&
-            reader.name() == tag_name) {
-            matching_elements.append(CreateXMLElement(reader));
+        if (lt == -1) {
+            break;
+        }
+
+        if (lt + 1 >= length) {
+            first_error = ScanError(source, lt, "Unexpected end of document");
+            break;
+        }
+
+        QChar next = source.at(lt + 1);
+
+        if (next == '!' || next == '?') {
+            int end;
+
+            if (source.midRef(lt, 4) == QLatin1String("<!--")) {
+                end = source.indexOf("-->", lt + 4);
+                end = end == -1 ? -1 : end + 3;
+            } else if (source.midRef(lt, 9) == QLatin1String("<![CDATA[")) {
+                end = source.indexOf("]]>", lt + 9);
+                end = end == -1 ? -1 : end + 3;
+            } else {
+                end = FindTagEnd(source, lt + 2);
+                end = end == -1 ? -1 : end + 1;
+            }
+
+            if (end == -1) {
+                first_error = ScanError(source, lt, "Unexpected end of document");
+                break;
+            }
+
+            pos = end;
+            continue;
+        }
+
+        bool end_tag = next == '/';
+        int name_start = lt + (end_tag ? 2 : 1);
+        int name_end = name_start;
+
+        while (name_end < length && !source.at(name_end).isSpace() &&
+               source.at(name_end) != '>' && source.at(name_end) != '/') {
+            name_end++;
+        }
+
+        QString name = source.mid(name_start, name_end - name_start);
+        int gt = FindTagEnd(source, name_end);
+
+        if (gt == -1) {
+            first_error = ScanError(source, lt, "Unexpected end of document");
+            break;
+        }
+
+        pos = gt + 1;
+
+        if (end_tag) {
+            int open = open_elements.count() - 1;
+
+            while (open >= 0 && open_elements.at(open).name != name) {
+                open--;
+            }
+
+            if (open == -1) {
+                if (first_error.isEmpty()) {
+                    first_error = ScanError(source, lt, "Unexpected end tag");
+                }
+
+                continue;
+            }
+
+            if (open != open_elements.count() - 1 && first_error.isEmpty()) {
+                first_error = ScanError(source, lt, "Opening and ending tag mismatch");
+            }
+
+            // Closes the elements left open inside it too
+            while (open_elements.count() > open) {
+                OpenElement closed = open_elements.takeLast();
+
+                if (closed.match != -1) {
+                    matching_elements[ closed.match ].text = ElementText(source, closed.content_start, lt);
+                }
+            }
+
+            continue;
+        }
+
+        if (name.isEmpty()) {
+            if (first_error.isEmpty()) {
+                first_error = ScanError(source, lt, "Invalid tag name");
+            }
+
+            continue;
+        }
+
+        QString local_name = name.mid(name.indexOf(':') + 1);
+        bool self_closing = source.at(gt - 1) == '/';
+        int match = -1;
+
+        if (local_name == tag_name) {
+            // Where the start tag ends, as the reader counts it
+            lineno += source.midRef(counted, gt - counted).count('\n');
+            counted = gt;
+            XMLElement element;
+            element.name = local_name;
+            element.lineno = lineno;
+            element.attributes = ParseTagAttributes(source.mid(name_end, gt - name_end));
+            match = matching_elements.count();
+            matching_elements.append(element);
         }
+
+        if (self_closing) {
+            continue;
+        }
+
+        // Script and style content holds no elements to look for,
+        // so it is passed over in one step
+        if (local_name == "script" || local_name == "style") {
+            int close = source.indexOf("</" + name, pos);
+
+            if (close != -1) {
+                if (match != -1) {
+                    matching_elements[ match ].text = ElementText(source, pos, close);
+                }
+
+                int close_gt = FindTagEnd(source, close + 2);
+                pos = close_gt == -1 ? length : close_gt + 1;
+                continue;
+            }
+        }
+
+        OpenElement open;
+        open.name = name;
+        open.match = match;
+        open.content_start = pos;
+        open_elements.append(open);
     }
 
-    if (reader.hasError()) {
-        std::string msg = reader.errorString().toStdString() + ": " + QString::number(reader.lineNumber()).toStdString() + ": " + QString::number(reader.columnNumber()).toStdString();
-        throw(msg);
+    if (!open_elements.isEmpty() && first_error.isEmpty()) {
+        first_error = ScanError(source, length, "Premature end of document");
+    }
+
+    // What is left open holds everything up to the end
+    while (!open_elements.isEmpty()) {
+        OpenElement closed = open_elements.takeLast();
+
+        if (closed.match != -1) {
+            matching_elements[ closed.match ].text = ElementText(source, closed.content_start, length);
+        }
+    }
+
+    if (error) {
+        *error = first_error;
     }
 
     return matching_elements;
@@ -181,6 +652,12 @@ QList<QString> XhtmlDoc::GetAllDescendantClasses(const QString & source)
 {
     QString version = "any_version";
     GumboInterface gi = GumboInterface(source, version);
+    return GetAllDescendantClasses(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantClasses(GumboInterface &gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("class"));
     QStringList classes;
     foreach(GumboNode * node, nodes) {
@@ -201,6 +678,12 @@ QList<QString> XhtmlDoc::GetAllDescendantStyleUrls(const QString & source)
 {
     QString version = "any_version";
     GumboInterface gi = GumboInterface(source, version);
+    return GetAllDescendantStyleUrls(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantStyleUrls(GumboInterface &gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("style"));
     QStringList styles;
     foreach(GumboNode * node, nodes) {
@@ -222,6 +705,12 @@ QList<QString> XhtmlDoc::GetAllDescendantIDs(const QString & source)
 {
     QString version = "any_version";
     GumboInterface gi = GumboInterface(source, version);
+    return GetAllDescendantIDs(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantIDs(GumboInterface &gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("id"));
     nodes.append(gi.get_all_nodes_with_attribute(QString("name")));
     QStringList IDs;
@@ -248,6 +737,12 @@ QList<QString> XhtmlDoc::GetAllDescendantHrefs(const QString & source)
 {
     QString version = "any_version";
     GumboInterface gi = GumboInterface(source, version);
+    return GetAllDescendantHrefs(gi);
+}
+
+
+QList<QString> XhtmlDoc::GetAllDescendantHrefs(GumboInterface &gi)
+{
     QList<GumboNode*> nodes = gi.get_all_nodes_with_attribute(QString("href"));
     QStringList hrefs;
     foreach(GumboNode * node, nodes) {
@@ -346,7 +841,7 @@ QList<QWebElement> XhtmlDoc::QWebElementChildren(const QWebElement &element)
 }
 
 
-QStringList XhtmlDoc::GetSGFSectionSplits(const QString &source,
+XhtmlDoc::SGFSections XhtmlDoc::GetSGFSections(const QString &source,
         const QString &custom_header)
 {
     QRegularExpression body_start_tag(BODY_START);
@@ -356,27 +851,46 @@ QStringList XhtmlDoc::GetSGFSectionSplits(const QString &source,
     int body_end   = source.indexOf(body_end_tag, 0);
     int main_index = body_start_tag_match.capturedEnd();
 
-    QString header = !custom_header.isEmpty() ? custom_header + "<body>\n" : source.left(main_index);
-    QStringList sections;
+    SGFSections sections;
+    sections.source = source;
+    sections.header = !custom_header.isEmpty() ? custom_header + "<body>\n" : source.left(main_index);
     QRegularExpression break_tag(BREAK_TAG_SEARCH);
 
     while (main_index != body_end) {
         QRegularExpressionMatch match = break_tag.match(source, main_index);
-        QString body;
 
         // We search for our HR break tag
         if (match.hasMatch()) {
             // We break up the remainder of the file on the HR tag index if it's found
             int break_index = match.capturedStart();
-            body = Utility::Substring(main_index, break_index, source);
+            sections.bodies.append(qMakePair(main_index, break_index));
             main_index = break_index + match.capturedLength();
         } else {
             // Otherwise, we take the rest of the file
-            body = Utility::Substring(main_index, body_end, source);
+            sections.bodies.append(qMakePair(main_index, body_end));
             main_index = body_end;
         }
+    }
+
+    return sections;
+}
 
-        sections.append(header + body + "</body> </html>");
+
+QString XhtmlDoc::SGFSections::Section(int index) const
+{
+    const QPair<int, int> &body = bodies.at(index);
+    return header + Utility::Substring(body.first, body.second, source) + "</body> </html>";
+}
+
+
+QStringList XhtmlDoc::GetSGFSectionSplits(const QString &source,
+        const QString &custom_header)
+{
+    SGFSections splits = GetSGFSections(source, custom_header);
+    QStringList sections;
+
+    for (int i = 0; i < splits.count(); ++i) {
+        sections.append(splits.Section(i));
     }
 
     return sections;
@@ -540,6 +1054,38 @@ GumboNode *XhtmlDoc::GetAncestorIDElement(GumboInterface &gi, GumboNode *node)
 }
 
 
+// The decoded path a media element refers to, or a null string
+static QString MediaPath(GumboNode *node)
+{
+    GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "src");
+    if (!attr) {
+        // search for xlink:href using gumbo attribute namespace
+        attr = gumbo_get_attribute(&node->v.element.attributes, "href");
+        if (attr && attr->attr_namespace != GUMBO_ATTR_NAMESPACE_XLINK) attr = NULL;
+    }
+    if (attr) {
+        return Utility::URLDecodePath(QString::fromUtf8(attr->value));
+    }
+    return QString();
+}
+
+
+// The decoded path a link element refers to if it is
+// a stylesheet, or a null string
+static QString StylePath(GumboNode *node)
+{
+    GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "href");
+    if (attr) {
+        QString relative_path = Utility::URLDecodePath(QString::fromUtf8(attr->value));
+        QFileInfo file_info(relative_path);
+        if (file_info.suffix().toLower() == "css") {
+            return relative_path;
+        }
+    }
+    return QString();
+}
+
+
 QStringList XhtmlDoc::GetPathsToMediaFiles(const QString &source)
 {
   QList<GumboTag> tags = QList<GumboTag>() << GIMAGE_TAGS << GVIDEO_TAGS << GAUDIO_TAGS;
@@ -556,20 +1102,42 @@ QStringList XhtmlDoc::GetPathsToStyleFiles(const QString &source)
     QStringList style_paths;
     QList<GumboNode*> nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_LINK);
     for (int i = 0; i < nodes.count(); ++i) {
-        GumboNode* node = nodes.at(i);
-        GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "href");
-        if (attr) {
-            QString relative_path = Utility::URLDecodePath(QString::fromUtf8(attr->value));
-            QFileInfo file_info(relative_path);
-            if (file_info.suffix().toLower() == "css") {
-                style_paths << relative_path;
-            }
+        QString relative_path = StylePath(nodes.at(i));
+        if (!relative_path.isNull()) {
+            style_paths << relative_path;
         }
   }
   style_paths.removeDuplicates();
   return style_paths;
 }
 
+QPair<QStringList, QStringList> XhtmlDoc::GetPathsToMediaAndStyleFiles(const QString &source)
+{
+    QString version = "any_version";
+    GumboInterface gi = GumboInterface(source, version);
+    QList<GumboTag> tags = QList<GumboTag>() << GIMAGE_TAGS << GVIDEO_TAGS << GAUDIO_TAGS << GUMBO_TAG_LINK;
+    QStringList media_paths;
+    QStringList style_paths;
+    QList<GumboNode*> nodes = gi.get_all_nodes_with_tags(tags);
+    for (int i = 0; i < nodes.count(); ++i) {
+        GumboNode* node = nodes.at(i);
+        if (node->v.element.tag == GUMBO_TAG_LINK) {
+            QString relative_path = StylePath(node);
+            if (!relative_path.isNull()) {
+                style_paths << relative_path;
+            }
+        } else {
+            QString relative_path = MediaPath(node);
+            if (!relative_path.isNull()) {
+                media_paths << relative_path;
+            }
+        }
+    }
+    media_paths.removeDuplicates();
+    style_paths.removeDuplicates();
+    return qMakePair(media_paths, style_paths);
+}
+
 QStringList XhtmlDoc::GetAllURLPathsFromStylesheet(const QString & source, const QString & csspath)
 {
     QStringList urlpaths;
@@ -607,18 +1175,17 @@ QStringList XhtmlDoc::GetAllMediaPathsFromMediaChildren(const QString & source,
 {
     QString version = "any_version";
     GumboInterface gi = GumboInterface(source, version);
+    return GetAllMediaPathsFromMediaChildren(gi, tags);
+}
+
+
+QStringList XhtmlDoc::GetAllMediaPathsFromMediaChildren(GumboInterface &gi, QList<GumboTag> tags)
+{
     QStringList media_paths;
     QList<GumboNode*> nodes = gi.get_all_nodes_with_tags(tags);
     for (int i = 0; i < nodes.count(); ++i) {
-        GumboNode* node = nodes.at(i);
-        GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "src");
-        if (!attr) {
-            // search for xlink:href using gumbo attribute namespace
-            attr = gumbo_get_attribute(&node->v.element.attributes, "href");
-            if (attr && attr->attr_namespace != GUMBO_ATTR_NAMESPACE_XLINK) attr = NULL;
-        }
-        if (attr) {
-            QString relative_path = Utility::URLDecodePath(QString::fromUtf8(attr->value));
+        QString relative_path = MediaPath(nodes.at(i));
+        if (!relative_path.isNull()) {
             media_paths << relative_path;
         }
     }
@@ -26,6 +26,7 @@
 
 #include <memory>
 
+#include <QtCore/QPair>
 #include <QtWebKit/QWebElement>
 #include "Misc/GumboInterface.h"
 #include "ViewEditors/ViewEditor.h"
@@ -67,10 +68,22 @@ public:
     // in the head section of the provided XHTML source code
     static QList<XMLElement> GetTagsInHead(const QString &source, const QString &tag_name);
 
+    // Finds the <link> elements of the head of the provided XHTML source
+    // code, each with where it is in the source as start and length, and
+    // where </head> starts, without looking at the body. Returns false
+    // if the head has no end tag.
+    static bool GetLinksInHead(const QString &source, QList<XMLElement> &links,
+                               QList<QPair<int, int>> &ranges, int &head_close);
+
     // Returns a list of XMLElements representing all
     // the elements of the specified tag name
-    // in the entire document of the provided XHTML source code
-    static QList<XMLElement> GetTagsInDocument(const QString &source, const QString &tag_name);
+    // in the entire document of the provided XHTML source code.
+    // The source is scanned a tag at a time rather than parsed, and
+    // nothing is shared, so many documents can be scanned at once.
+    // If it is not well formed the elements found are returned all
+    // the same, and error, if given, is set to what is wrong first.
+    static QList<XMLElement> GetTagsInDocument(const QString &source, const QString &tag_name,
+                                               QString *error = NULL);
 
     // static QList<xc::DOMNode *> GetNodeChildren(const xc::DOMNode &node);
 
@@ -79,6 +92,12 @@ public:
     static QList<QString> GetAllDescendantIDs(const QString & );
     static QList<QString> GetAllDescendantClasses(const QString & source);
 
+    // The same, reading an already parsed document (e.g. from GumboCache)
+    static QList<QString> GetAllDescendantStyleUrls(GumboInterface &gi);
+    static QList<QString> GetAllDescendantHrefs(GumboInterface &gi);
+    static QList<QString> GetAllDescendantIDs(GumboInterface &gi);
+    static QList<QString> GetAllDescendantClasses(GumboInterface &gi);
+
     struct WellFormedError {
         int line;
         int column;
@@ -109,6 +128,38 @@ public:
 
     static QList<QWebElement> QWebElementChildren(const QWebElement &element);
 
+    /**
+     * The sections of a source split on SGF section breaks. Only where
+     * each body starts and ends is kept; a section is made into a whole
+     * document when asked for, so a huge source is never held once per
+     * section.
+     */
+    struct SGFSections {
+        QString source;
+        QString header;
+        QList<QPair<int, int> > bodies;
+
+        int count() const {
+            return bodies.count();
+        }
+
+        bool isEmpty() const {
+            return bodies.isEmpty();
+        }
+
+        QString Section(int index) const;
+    };
+
+    /**
+     * Finds the SGF section breaks in the provided source.
+     *
+     * @param source The source which we want to split.
+     * @param custom_header An option custom header to be used instead of
+     *                      the one in the current source.
+     */
+    static SGFSections GetSGFSections(const QString &source,
+                                      const QString &custom_header = QString());
+
     /**
      * Splits the provided source on SGF section breaks.
      *
@@ -142,9 +193,14 @@ public:
 
     static QStringList GetPathsToStyleFiles(const QString &source);
 
+    // Both of the above from a single parse of the source;
+    // first is the media paths, second the style paths
+    static QPair<QStringList, QStringList> GetPathsToMediaAndStyleFiles(const QString &source);
+
     static QStringList GetAllURLPathsFromStylesheet(const QString & source, const QString & csspath);
 
     static QStringList GetAllMediaPathsFromMediaChildren(const QString &source, QList<GumboTag> tags);
+    static QStringList GetAllMediaPathsFromMediaChildren(GumboInterface &gi, QList<GumboTag> tags);
 
 
 private:
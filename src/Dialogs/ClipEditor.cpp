@@ -131,6 +131,7 @@ bool ClipEditor::eventFilter(QObject *obj, QEvent *event)
 
 void ClipEditor::SettingsFileModelUpdated()
 {
+    m_ClipEditorModel->FetchAllEntries();
     ui.ClipEditorTree->expandAll();
     emit ShowStatusMessageRequest(tr("Clip entries loaded from file."));
     emit ClipsUpdated();
@@ -474,6 +475,7 @@ void ClipEditor::CollapseAll()
 
 void ClipEditor::ExpandAll()
 {
+    m_ClipEditorModel->FetchAllEntries();
     ui.ClipEditorTree->expandAll();
 }
 
@@ -488,8 +490,7 @@ void ClipEditor::AutoFill()
     QList<CSSResource *> css_resources = m_Book->GetFolderKeeper()->GetResourceTypeList<CSSResource>(false);
 
     foreach(CSSResource * css_resource, css_resources) {
-        CSSInfo css_info(css_resource->GetText(), true);
-        QList<CSSInfo::CSSSelector *> selectors = css_info.getClassSelectors();
+        QList<CSSInfo::CSSSelector *> selectors = css_resource->GetCSSInfo()->getClassSelectors();
         foreach(CSSInfo::CSSSelector *selector, selectors) {
             QString group = selector->groupText;
             if (!group.contains(".")) {
@@ -566,6 +567,7 @@ bool ClipEditor::FilterEntries(const QString &text, QStandardItem *item)
 
 void ClipEditor::FilterEditTextChangedSlot(const QString &text)
 {
+    m_ClipEditorModel->FetchAllEntries();
     FilterEntries(text);
     ui.ClipEditorTree->expandAll();
     ui.ClipEditorTree->selectionModel()->clear();
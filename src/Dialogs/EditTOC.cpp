@@ -21,7 +21,6 @@
 *************************************************************************/
 
 #include <QtCore/QStringList>
-#include <QtGui/QStandardItem>
 #include <QKeyEvent>
 
 #include "BookManipulation/Book.h"
@@ -35,13 +34,15 @@
 
 static const QString SETTINGS_GROUP   = "edit_toc";
 static const int COLUMN_INDENTATION = 20;
+// TOCs with more entries than this open with only the top level shown
+static const int EXPAND_ALL_LIMIT = 2000;
 
 EditTOC::EditTOC(QSharedPointer<Book> book, QList<Resource *> resources, QWidget *parent)
     :
     QDialog(parent),
     m_Book(book),
     m_Resources(resources),
-    m_TableOfContents(new QStandardItemModel(this)),
+    m_TableOfContents(new TOCEntryTreeModel(this)),
     m_ContextMenu(new QMenu(this)),
     m_TOCModel(new TOCModel(this))
 {
@@ -71,22 +72,17 @@ EditTOC::~EditTOC()
 
 void EditTOC::UpdateTreeViewDisplay()
 {
-    ui.TOCTree->expandAll();
+    // The children of an entry are only made into rows when it is expanded
+    if (m_TableOfContents->EntryCount() <= EXPAND_ALL_LIMIT) {
+        ui.TOCTree->expandAll();
+    }
 }
 
 void EditTOC::CreateTOCModel()
 {
     m_TOCModel->SetBook(m_Book);
 
-    TOCModel::TOCEntry toc_entry = m_TOCModel->GetRootTOCEntry();
-
-    m_TableOfContents->clear();
-    QStringList header;
-    header.append(tr("TOC Entry"));
-    header.append(tr("Target"));
-    m_TableOfContents->setHorizontalHeaderLabels(header);
-
-    BuildModel(toc_entry);
+    m_TableOfContents->SetRootEntry(m_TOCModel->GetRootTOCEntry());
 }
 
 void EditTOC::Save()
@@ -94,188 +90,76 @@ void EditTOC::Save()
     QString version = m_Book->GetConstOPF()->GetEpubVersion();
     if (version.startsWith('3')) {
         NavProcessor navproc(m_Book->GetConstOPF()->GetNavResource());
-        navproc.GenerateNavTOCFromTOCEntries(ConvertTableToEntries());
+        navproc.GenerateNavTOCFromTOCEntries(m_TableOfContents->GetRootEntry());
     } else {
-        m_Book->GetNCX()->GenerateNCXFromTOCEntries(m_Book.data(), ConvertTableToEntries());
+        m_Book->GetNCX()->GenerateNCXFromTOCEntries(m_Book.data(), m_TableOfContents->GetRootEntry());
     }
 }
 
-TOCModel::TOCEntry EditTOC::ConvertTableToEntries()
-{
-    return ConvertItemToEntry(m_TableOfContents->invisibleRootItem());
-}
-
-TOCModel::TOCEntry EditTOC::ConvertItemToEntry(QStandardItem *item)
+void EditTOC::SelectEntry(const QModelIndex &index)
 {
-    TOCModel::TOCEntry entry;
-
-    if (item != m_TableOfContents->invisibleRootItem()) {
-        entry.text = item->text();
-        QStandardItem *parent_item = item->parent();
-        if (!parent_item) {
-            parent_item = m_TableOfContents->invisibleRootItem();
-        }
-        entry.target = parent_item->child(item->row(), 1)->text();
-    } else {
-        entry.is_root = true;
-    }
-
-    if (!item->hasChildren()) {
-        return entry;
-    }
-
-    for (int row = 0; row < item->rowCount(); row++) {
-        entry.children.append(ConvertItemToEntry(item->child(row, 0)));
-    }
-    return entry;
+    ui.TOCTree->selectionModel()->clear();
+    ui.TOCTree->setCurrentIndex(index);
+    ui.TOCTree->selectionModel()->select(index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
 }
 
-void EditTOC::ExpandChildren(QStandardItem *item)
+void EditTOC::ExpandChildren(const QModelIndex &index)
 {
-    QModelIndexList indexes;
+    m_TableOfContents->FetchChildren(index);
 
-    if (item->hasChildren()) {
-        for (int i = 0; i < item->rowCount(); i++) {
-            ExpandChildren(item->child(i, 0));
-        }
+    for (int i = 0; i < m_TableOfContents->rowCount(index); i++) {
+        ExpandChildren(m_TableOfContents->index(i, 0, index));
     }
 
-    ui.TOCTree->expand(item->index());
+    ui.TOCTree->expand(index);
 }
 
 void EditTOC::MoveLeft()
 {
-    QModelIndex index = CheckSelection(0);
+    QModelIndex index = m_TableOfContents->MoveLeft(CheckSelection(0));
     if (!index.isValid()) {
         return;
     }
 
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    QStandardItem *parent_item = item->parent();
-    // Can't indent above top level
-    if (!parent_item) {
-        return;
-    }
-
-    QStandardItem *grandparent_item = parent_item->parent();
-    if (!grandparent_item) {
-        grandparent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    // Make siblings following the entry into children
-    int row = item->row() ;
-    while (row + 1 < parent_item->rowCount()) {
-        QList<QStandardItem *> row_items = parent_item->takeRow(row + 1);
-        int row_count = item->rowCount();
-        item->setChild(row_count, 0, row_items[0]);
-        item->setChild(row_count, 1, row_items[1]);
-    }
-
-    // Make item child of grandparent
-    int parent_row = parent_item->row();
-    QList<QStandardItem *> row_items = parent_item->takeRow(row);
-    grandparent_item->insertRow(parent_row + 1, row_items);
-
     // Reselect the item
-    QModelIndex item_index = grandparent_item->child(parent_row + 1)->index();
-    ui.TOCTree->selectionModel()->clear();
-    ui.TOCTree->setCurrentIndex(item_index);
-    ui.TOCTree->selectionModel()->select(item_index, QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
-    ExpandChildren(grandparent_item->child(parent_row + 1));
+    SelectEntry(index);
+    ExpandChildren(index);
 }
 
 void EditTOC::MoveRight()
 {
-    QModelIndex index = CheckSelection(0);
+    QModelIndex index = m_TableOfContents->MoveRight(CheckSelection(0));
     if (!index.isValid()) {
         return;
     }
 
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-    int item_row = item->row();
-
-    // Can't indent if row above is already parent
-    if (item_row == 0) {
-        return;
-    }
-
-    QStandardItem *parent_item = item->parent();
-    if (!parent_item) {
-        parent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    // Make the item above the parent of this item
-    QList<QStandardItem *> row_items = parent_item->takeRow(item_row);
-    QStandardItem *new_parent = parent_item->child(item_row - 1, 0);
-    new_parent->insertRow(new_parent->rowCount(), row_items);
-    QStandardItem *new_item = new_parent->child(new_parent->rowCount() - 1, 0);
-
     // Reselect the item
-    ui.TOCTree->selectionModel()->clear();
-    ui.TOCTree->setCurrentIndex(item->index());
-    ui.TOCTree->selectionModel()->select(item->index(), QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
-    ExpandChildren(new_item);
+    SelectEntry(index);
+    ExpandChildren(index);
 }
 
 void EditTOC::MoveUp()
 {
-    QModelIndex index = CheckSelection(0);
+    QModelIndex index = m_TableOfContents->MoveUp(CheckSelection(0));
     if (!index.isValid()) {
         return;
     }
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    int item_row = item->row();
-
-    // Can't move up if this row is already the top most one of its parent
-    if (item_row == 0) {
-        return;
-    }
-
-    QStandardItem *parent_item = item->parent();
-    if (!parent_item) {
-        parent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    QList<QStandardItem *> row_items = parent_item->takeRow(item_row);
-    parent_item->insertRow(item_row - 1, row_items);
 
     // Reselect the item
-    ui.TOCTree->selectionModel()->clear();
-    ui.TOCTree->setCurrentIndex(item->index());
-    ui.TOCTree->selectionModel()->select(item->index(), QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
-    ExpandChildren(item);
+    SelectEntry(index);
+    ExpandChildren(index);
 }
 
 void EditTOC::MoveDown()
 {
-    QModelIndex index = CheckSelection(0);
+    QModelIndex index = m_TableOfContents->MoveDown(CheckSelection(0));
     if (!index.isValid()) {
         return;
     }
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    QStandardItem *parent_item = item->parent();
-    if (!parent_item) {
-        parent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    int item_row = item->row();
-
-    // Can't move down if this row is already the last one of its parent
-    if (item_row == parent_item->rowCount() - 1) {
-        return;
-    }
-
-    QList<QStandardItem *> row_items = parent_item->takeRow(item_row);
-    parent_item->insertRow(item_row + 1, row_items);
 
     // Reselect the item
-    ui.TOCTree->selectionModel()->clear();
-    ui.TOCTree->setCurrentIndex(item->index());
-    ui.TOCTree->selectionModel()->select(item->index(), QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
-    ExpandChildren(item);
+    SelectEntry(index);
+    ExpandChildren(index);
 }
 
 void EditTOC::AddEntryAbove()
@@ -295,28 +179,8 @@ void EditTOC::AddEntry(bool above)
         return;
     }
 
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    QStandardItem *parent_item = item->parent();
-    if (!parent_item) {
-        parent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    // Add a new empty row of items
-    QStandardItem *entry_item = new QStandardItem();
-    QStandardItem *target_item = new QStandardItem();
-    QList<QStandardItem *> row_items;
-    row_items << entry_item << target_item ;
-    int location = 1;
-    if (above) {
-        location = 0;
-    }
-    parent_item->insertRow(item->row() + location,row_items);
-
-    // Select the new row
-    ui.TOCTree->selectionModel()->clear();
-    ui.TOCTree->setCurrentIndex(entry_item->index());
-    ui.TOCTree->selectionModel()->select(entry_item->index(), QItemSelectionModel::SelectCurrent | QItemSelectionModel::Rows);
+    // Add a new empty row and select it
+    SelectEntry(m_TableOfContents->InsertEntry(index, above));
 }
 
 QModelIndex EditTOC::CheckSelection(int row)
@@ -341,14 +205,7 @@ void EditTOC::DeleteEntry()
         return;
     }
 
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    QStandardItem *parent_item = item->parent();
-    if (!parent_item) {
-        parent_item = m_TableOfContents->invisibleRootItem();
-    }
-
-    parent_item->takeRow(item->row());
+    m_TableOfContents->RemoveEntry(index);
 }
 
 void EditTOC::SelectTarget()
@@ -358,12 +215,10 @@ void EditTOC::SelectTarget()
         return;
     }
 
-    QStandardItem *item = m_TableOfContents->itemFromIndex(index);
-
-    SelectHyperlink select_target(item->text(), NULL, m_Resources, m_Book, this);
+    SelectHyperlink select_target(index.data().toString(), NULL, m_Resources, m_Book, this);
 
     if (select_target.exec() == QDialog::Accepted) {
-        item->setText(select_target.GetTarget());
+        m_TableOfContents->setData(index, select_target.GetTarget());
     }
 }
 
@@ -495,28 +350,6 @@ bool EditTOC::eventFilter(QObject *obj, QEvent *event)
     return QDialog::eventFilter(obj, event);
 }
 
-void EditTOC::BuildModel(const TOCModel::TOCEntry &root_entry)
-{
-    foreach(const TOCModel::TOCEntry& child_entry, root_entry.children) {
-        AddEntryToParentItem(child_entry, m_TableOfContents->invisibleRootItem(), 1);
-    }
-}
-
-void EditTOC::AddEntryToParentItem(const TOCModel::TOCEntry &entry, QStandardItem *parent, int level)
-{
-    Q_ASSERT(parent);
-    QStandardItem *entry_item = new QStandardItem(entry.text);
-    QStandardItem *target_item = new QStandardItem(entry.target);
-
-    QList<QStandardItem *> row_items;
-    row_items << entry_item << target_item ;
-    parent->appendRow(row_items);
-
-    foreach(const TOCModel::TOCEntry &child_entry, entry.children) {
-        AddEntryToParentItem(child_entry, entry_item, level + 1);
-    }
-}
-
 void EditTOC::ConnectSignalsToSlots()
 {
     connect(this,               SIGNAL(accepted()),           this, SLOT(Save()));
@@ -27,18 +27,17 @@
 #include <QtCore/QList>
 #include <QtCore/QSharedPointer>
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QMenu>
 
 #include "MainUI/TOCModel.h"
 #include "BookManipulation/Headings.h"
+#include "Dialogs/TOCEntryTreeModel.h"
 #include "ResourceObjects/NCXResource.h"
 
 #include "ui_EditTOC.h"
 
 class Book;
-class QStandardItem;
 
 class EditTOC : public QDialog
 {
@@ -75,13 +74,9 @@ private:
     void AddEntry(bool above);
     QModelIndex CheckSelection(int row);
 
-    TOCModel::TOCEntry ConvertTableToEntries();
-    TOCModel::TOCEntry ConvertItemToEntry(QStandardItem *item);
+    void SelectEntry(const QModelIndex &index);
 
-    void BuildModel(const TOCModel::TOCEntry &root_entry);
-    void AddEntryToParentItem(const TOCModel::TOCEntry &entry, QStandardItem *parent, int level);
-
-    void ExpandChildren(QStandardItem *item);
+    void ExpandChildren(const QModelIndex &index);
 
     void CreateContextMenuActions();
     void SetupContextMenu(const QPoint &point);
@@ -103,7 +98,7 @@ private:
 
     QList<Resource *> m_Resources;
 
-    QStandardItemModel *m_TableOfContents;
+    TOCEntryTreeModel *m_TableOfContents;
 
     QMenu *m_ContextMenu;
 
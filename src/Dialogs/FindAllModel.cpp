@@ -0,0 +1,117 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include "Dialogs/FindAllModel.h"
+
+FindAllModel::FindAllModel(QObject *parent)
+    :
+    QAbstractTableModel(parent)
+{
+}
+
+
+int FindAllModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_Matches.count();
+}
+
+
+int FindAllModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+
+QVariant FindAllModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_Matches.count()) {
+        return QVariant();
+    }
+
+    const FindAllSearch::Match &match = m_Matches.at(index.row());
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case FileColumn:
+                return match.filename;
+            case LineColumn:
+                return match.line;
+            case TextColumn:
+                return match.context;
+            default:
+                break;
+        }
+    } else if (role == Qt::TextAlignmentRole && index.column() == LineColumn) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+
+    return QVariant();
+}
+
+
+QVariant FindAllModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case FileColumn:
+            return tr("File");
+        case LineColumn:
+            return tr("Line");
+        case TextColumn:
+            return tr("Text");
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+
+const FindAllSearch::Match &FindAllModel::MatchAt(int row) const
+{
+    return m_Matches.at(row);
+}
+
+
+void FindAllModel::AddMatches(const QList<FindAllSearch::Match> &matches)
+{
+    if (matches.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(QModelIndex(), m_Matches.count(), m_Matches.count() + matches.count() - 1);
+    foreach(const FindAllSearch::Match &match, matches) {
+        m_Matches.append(match);
+    }
+    endInsertRows();
+}
+
+
+void FindAllModel::Clear()
+{
+    beginResetModel();
+    m_Matches.clear();
+    endResetModel();
+}
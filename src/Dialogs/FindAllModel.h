@@ -0,0 +1,71 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef FINDALLMODEL_H
+#define FINDALLMODEL_H
+
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QVector>
+
+#include "Misc/FindAllSearch.h"
+
+/**
+ * The matches of a Find All, one row each. Rows are only turned into
+ * text when the view asks for them, so a search with a great many
+ * matches costs little more than the matches themselves.
+ */
+class FindAllModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+
+    enum Column {
+        FileColumn = 0,
+        LineColumn,
+        TextColumn,
+        ColumnCount
+    };
+
+    FindAllModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    const FindAllSearch::Match &MatchAt(int row) const;
+
+public slots:
+    void AddMatches(const QList<FindAllSearch::Match> &matches);
+
+    void Clear();
+
+private:
+    QVector<FindAllSearch::Match> m_Matches;
+};
+
+#endif // FINDALLMODEL_H
@@ -0,0 +1,134 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtGui/QCloseEvent>
+#include <QtWidgets/QHeaderView>
+
+#include "Dialogs/FindAllModel.h"
+#include "Dialogs/FindAllResults.h"
+#include "MainUI/MainWindow.h"
+#include "Misc/FindAllSearch.h"
+#include "Misc/SettingsStore.h"
+
+static const QString SETTINGS_GROUP = "find_all_results";
+
+FindAllResults::FindAllResults(MainWindow *main_window, QWidget *parent)
+    :
+    QDialog(parent),
+    m_MainWindow(main_window),
+    m_Model(new FindAllModel(this)),
+    m_Search(new FindAllSearch(this))
+{
+    ui.setupUi(this);
+    ui.results->setModel(m_Model);
+    // Every row is one line high, so the view never has to measure
+    // the rows it does not show.
+    QHeaderView *rows = ui.results->verticalHeader();
+    rows->setSectionResizeMode(QHeaderView::Fixed);
+    rows->setDefaultSectionSize(fontMetrics().height() + 4);
+    rows->hide();
+    ui.results->horizontalHeader()->setStretchLastSection(true);
+    connectSignalsSlots();
+    ReadSettings();
+}
+
+
+void FindAllResults::Search(const QString &search_regex, const QList<Resource *> &resources)
+{
+    m_Model->Clear();
+    ui.status->setText(tr("Searching..."));
+    m_Search->Start(search_regex, resources);
+}
+
+
+void FindAllResults::closeEvent(QCloseEvent *event)
+{
+    m_Search->Cancel();
+    WriteSettings();
+    QDialog::closeEvent(event);
+}
+
+
+void FindAllResults::Found()
+{
+    ui.status->setText(tr("Searching... %n match(es) found.", "", m_Model->rowCount()));
+}
+
+
+void FindAllResults::Finished(int count)
+{
+    ui.status->setText(tr("%n match(es) found.", "", count));
+}
+
+
+void FindAllResults::OpenMatch(const QModelIndex &index)
+{
+    if (!index.isValid()) {
+        return;
+    }
+
+    const FindAllSearch::Match &match = m_Model->MatchAt(index.row());
+
+    // The file was deleted since the search
+    if (!match.resource) {
+        return;
+    }
+
+    m_MainWindow->OpenResource(match.resource, -1, match.position, QString(), MainWindow::ViewState_CodeView);
+}
+
+
+void FindAllResults::ReadSettings()
+{
+    SettingsStore settings;
+    settings.beginGroup(SETTINGS_GROUP);
+    // The size of the window and it's full screen status
+    QByteArray geometry = settings.value("geometry").toByteArray();
+
+    if (!geometry.isNull()) {
+        restoreGeometry(geometry);
+    }
+
+    settings.endGroup();
+}
+
+
+void FindAllResults::WriteSettings()
+{
+    SettingsStore settings;
+    settings.beginGroup(SETTINGS_GROUP);
+    // The size of the window and it's full screen status
+    settings.setValue("geometry", saveGeometry());
+    settings.endGroup();
+}
+
+
+void FindAllResults::connectSignalsSlots()
+{
+    connect(m_Search, SIGNAL(Found(const QList<FindAllSearch::Match> &)),
+            m_Model,  SLOT(AddMatches(const QList<FindAllSearch::Match> &)));
+    connect(m_Search, SIGNAL(Found(const QList<FindAllSearch::Match> &)), this, SLOT(Found()));
+    connect(m_Search, SIGNAL(Finished(int)), this, SLOT(Finished(int)));
+    connect(ui.results, SIGNAL(activated(const QModelIndex &)), this, SLOT(OpenMatch(const QModelIndex &)));
+    connect(ui.results, SIGNAL(clicked(const QModelIndex &)), this, SLOT(OpenMatch(const QModelIndex &)));
+    connect(ui.buttonBox, SIGNAL(rejected()), this, SLOT(close()));
+}
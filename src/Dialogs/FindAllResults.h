@@ -0,0 +1,79 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef FINDALLRESULTS_H
+#define FINDALLRESULTS_H
+
+#include <QtCore/QList>
+#include <QtWidgets/QDialog>
+
+#include "ui_FindAllResults.h"
+
+class FindAllModel;
+class FindAllSearch;
+class MainWindow;
+class QModelIndex;
+class Resource;
+
+/**
+ * Lists every match of a search, filled in while the search runs in
+ * the background. Activating a row opens its file at the match.
+ */
+class FindAllResults : public QDialog
+{
+    Q_OBJECT
+
+public:
+    FindAllResults(MainWindow *main_window, QWidget *parent = 0);
+
+    /**
+     * Drops the current results and starts a new search.
+     */
+    void Search(const QString &search_regex, const QList<Resource *> &resources);
+
+protected:
+    void closeEvent(QCloseEvent *event);
+
+private slots:
+    void Found();
+
+    void Finished(int count);
+
+    void OpenMatch(const QModelIndex &index);
+
+    void WriteSettings();
+
+private:
+    void ReadSettings();
+    void connectSignalsSlots();
+
+    MainWindow *m_MainWindow;
+
+    FindAllModel *m_Model;
+
+    FindAllSearch *m_Search;
+
+    Ui::FindAllResults ui;
+};
+
+#endif // FINDALLRESULTS_H
@@ -20,8 +20,9 @@
 **
 *************************************************************************/
 
+#include <functional>
+
 #include <QtCore/QStringList>
-#include <QtGui/QStandardItem>
 #include <QKeyEvent>
 
 #include "BookManipulation/Book.h"
@@ -30,6 +31,7 @@
 #include "Dialogs/HeadingSelector.h"
 #include "Misc/GumboInterface.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/TaskScheduler.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/OPFResource.h"
@@ -37,6 +39,8 @@
 
 static const QString SETTINGS_GROUP   = "heading_selector";
 static const int FIRST_COLUMN_PADDING = 30;
+// Books with more headings than this open with only the top level shown
+static const int EXPAND_ALL_LIMIT = 2000;
 
 const QString SIGIL_TOC_ID_PREFIX = "sigil_toc_id_";
 const QString OLD_SIGIL_TOC_ID_PREFIX = "heading_id_";
@@ -49,7 +53,10 @@ HeadingSelector::HeadingSelector(QSharedPointer<Book> book, QWidget *parent)
     QDialog(parent),
     m_Book(book),
     m_ContextMenu(new QMenu(this)),
-    m_book_changed(false)
+    m_book_changed(false),
+    m_RefreshInProgress(false),
+    m_RefreshQueued(false),
+    m_SelectRowAfterRefresh(-1)
 {
     ui.setupUi(this);
     ui.tvTOCDisplay->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -66,10 +73,15 @@ HeadingSelector::HeadingSelector(QSharedPointer<Book> book, QWidget *parent)
         htmlresources.removeOne(nav_resource);
     }
 
-    QList<Headings::Heading> flat_headings = Headings::GetHeadingList(htmlresources, true);
-    m_Headings = Headings::MakeHeadingHeirarchy(flat_headings);
-    PopulateSelectHeadingCombo(GetMaxHeadingLevel(flat_headings));
-    RefreshTOCModelDisplay();
+    m_Headings = Headings::GetHeadingList(htmlresources, true);
+    m_TableOfContents.SetHeadings(m_Headings);
+    PopulateSelectHeadingCombo(GetMaxHeadingLevel(m_Headings));
+    RefreshCounts();
+    // The first outline is worked out here so the dialog opens filled in
+    m_TableOfContents.SetOutline(HeadingTreeModel::BuildOutline(GetHeadingLevels(),
+                                 GetHeadingInclusions(),
+                                 ui.cbTOCItemsOnly->checkState() == Qt::Checked));
+    UpdateTreeViewDisplay();
     ReadSettings();
 }
 
@@ -88,7 +100,7 @@ bool HeadingSelector::IsBookChanged()
 
 int HeadingSelector::GetAbsoluteRowForIndex(QModelIndex current_index)
 {
-    QModelIndex index = m_TableOfContents.invisibleRootItem()->child(0)->index();
+    QModelIndex index = m_TableOfContents.index(0, 0);
     int row = 0;
     bool past_last_row = false;
 
@@ -122,7 +134,7 @@ QModelIndex HeadingSelector::GetIndexForAbsoluteRow(int row)
         return found_index;
     }
 
-    QModelIndex index = m_TableOfContents.invisibleRootItem()->child(0)->index();
+    QModelIndex index = m_TableOfContents.index(0, 0);
     bool past_last_row = false;
 
     for (int i = 0; i < row; i++) {
@@ -144,11 +156,11 @@ QModelIndex HeadingSelector::GetIndexForAbsoluteRow(int row)
 QModelIndex HeadingSelector::SelectAbsoluteRow(int row)
 {
     // Select the item that was below the original item if any.
-    if (m_TableOfContents.invisibleRootItem()->rowCount() == 0) {
+    if (m_TableOfContents.rowCount() == 0) {
         return QModelIndex();
     }
 
-    QModelIndex first_index = m_TableOfContents.invisibleRootItem()->child(0)->index();
+    QModelIndex first_index = m_TableOfContents.index(0, 0);
     QModelIndex index = first_index;
     QModelIndex previous_index = index;
 
@@ -173,85 +185,27 @@ QModelIndex HeadingSelector::SelectAbsoluteRow(int row)
 }
 
 
-// We need to filter the calls to functions that would normally
-// connect directly to the itemChanged( QStandardItem* ) signal
-// because some would-be slots delete the item in question.
-// So, the signal connects here and this function calls the
-// appropriate item-handling functions.
-void HeadingSelector::ModelItemFilter(QStandardItem *item)
-{
-    Q_ASSERT(item);
-
-    if (!item->isCheckable()) {
-        // Heading changed
-        UpdateOneHeadingTitle(item, item->text());
-        return;
-    }
-
-    // Get the absolute row of the index in the table for later re-selection
-    QModelIndex current_index = item->index().sibling(item->index().row(), 0);
-    int row = GetAbsoluteRowForIndex(current_index);
-    // Do the actual update of the list
-    UpdateHeadingInclusion(item);
-    QModelIndex new_index = SelectAbsoluteRow(row);
-
-    // Expand the item and all its children
-    if (new_index.isValid()) {
-        QStandardItem *new_item = m_TableOfContents.itemFromIndex(new_index);
-        QStandardItem *parent_item = GetActualItemParent(new_item);
-
-        if (new_item) {
-            for (int i = 0; i < parent_item->rowCount(); i++) {
-                if (i >= new_item->row()) {
-                    ExpandChildren(parent_item->child(i));
-                }
-            }
-        }
-    }
-}
-
-void HeadingSelector::ExpandChildren(QStandardItem *item)
-{
-    QModelIndexList indexes;
-
-    if (item->hasChildren()) {
-        for (int i = 0; i < item->rowCount(); i++) {
-            ExpandChildren(item->child(i, 0));
-        }
-    }
-
-    ui.tvTOCDisplay->expand(item->index());
-}
-
-
 // Switches the display between showing all headings
 // and showing only headings that are to be included in the TOC
 void HeadingSelector::ChangeDisplayType(int new_check_state)
 {
-    // If checked, show only TOC items
-    if (new_check_state == Qt::Checked) {
-        RemoveExcludedItems(m_TableOfContents.invisibleRootItem());
-    }
-    // If unchecked, show all items
-    else {
-        CreateTOCModel();
-        UpdateTreeViewDisplay();
-    }
+    RefreshTOCModelDisplay();
 }
 
 
 void HeadingSelector::UpdateHeadingElements()
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    // We recreate the model to make sure even those
-    // headings marked as "don't include" are in the model.
-    CreateTOCModel();
     // Identify any existing hrefs to an id that will indicate we can't change it
     QStringList used_ids = m_Book->GetIdsInHrefs();
     // Iterate through our headings, applying their changes to the underlying resources
     // if required, setting ids etc.
     int next_toc_id = 1;
-    QList<Headings::Heading *> ItemHeadings = ItemOrderHeadingList(m_TableOfContents.invisibleRootItem());
+    // Every heading, even those marked as "don't include", in document order
+    QList<Headings::Heading *> ItemHeadings;
+    for (int i = 0; i < m_Headings.count(); ++i) {
+        ItemHeadings.append(&m_Headings[ i ]);
+    }
     PerformHeadingUpdates(ItemHeadings, used_ids, next_toc_id);
     // If we changed anything remember to update the changed resource
     // and properly record we did make a change to the book.
@@ -278,22 +232,6 @@ void HeadingSelector::UpdateHeadingElements()
 }
 
 
-QList<Headings::Heading *> HeadingSelector::ItemOrderHeadingList(QStandardItem * item)
-{
-    QList<Headings::Heading *> headings;
-    Headings::Heading * heading = GetItemHeading(item);
-    if (heading != NULL) {
-        headings.append(heading);
-    }
-    if (item->hasChildren()) {
-        for (int i = 0; i < item->rowCount(); ++i) {
-            headings.append(ItemOrderHeadingList(item->child(i)));
-        }
-    }
-    return headings;
-}
-
-
 void HeadingSelector::PerformHeadingUpdates(QList<Headings::Heading *> & headings, QStringList used_ids, int next_toc_id)
 {
     HTMLResource* prev_resource = NULL;
@@ -414,10 +352,8 @@ void HeadingSelector::PerformHeadingUpdates(QList<Headings::Heading *> & heading
 }
         
 
-void HeadingSelector::UpdateOneHeadingTitle(QStandardItem *item, const QString &title)
+void HeadingSelector::UpdateOneHeadingTitle(Headings::Heading *heading, const QString &title)
 {
-    Headings::Heading *heading = GetItemHeading(item);
-
     if (heading != NULL) {
         QString title_attribute = heading->title;
 
@@ -461,14 +397,12 @@ void HeadingSelector::ChangeHeadingLevel(int change_amount)
     }
 
     QModelIndex selected_index = ui.tvTOCDisplay->selectionModel()->selectedRows(0).first();
-    QStandardItem *item = m_TableOfContents.itemFromIndex(selected_index);
+    Headings::Heading *heading = NULL;
 
-    if (!item) {
-        return;
+    if (selected_index.isValid()) {
+        heading = m_TableOfContents.HeadingAt(m_TableOfContents.PositionForIndex(selected_index));
     }
 
-    Headings::Heading *heading = GetItemHeading(item);
-
     if (heading == NULL) {
         return;
     }
@@ -483,7 +417,11 @@ void HeadingSelector::ChangeHeadingLevel(int change_amount)
         return;
     }
 
+    // Only the counts of the old and new level change
+    QHash<QString, int> &counts = heading->include_in_toc ? m_HeadingsIncluded : m_HeadingsHidden;
+    counts["h" % QString::number(heading->level)]--;
     heading->level += change_amount;
+    counts["h" % QString::number(heading->level)]++;
     // Update whether we have made changes to the document for this heading element
     heading->is_changed = (heading->level != heading->orig_level) || (heading->title != heading->orig_title);
 
@@ -503,39 +441,27 @@ void HeadingSelector::ChangeHeadingLevel(int change_amount)
             heading->resource_file->SetText(source);
         }
     }
-    // Clear all children information then rebuild hierarchy
-    QList<Headings::Heading> flat_headings = Headings::GetFlattenedHeadings(m_Headings);
-
-    for (int i = 0; i < flat_headings.count(); i++) {
-        flat_headings[i].children.clear();
-    }
-
-    m_Headings = Headings::MakeHeadingHeirarchy(flat_headings);
-    // Save selected row, refresh the display, restore selection
-    int row = GetAbsoluteRowForIndex(selected_index);
-    RefreshTOCModelDisplay();
-    SelectAbsoluteRow(row);
-    PopulateSelectHeadingCombo(GetMaxHeadingLevel(flat_headings));
+    DisplayCounts();
+    // The heading moves in the tree once the new outline is
+    // worked out; the same row is selected again then
+    RefreshTOCModelDisplay(GetAbsoluteRowForIndex(selected_index));
+    PopulateSelectHeadingCombo(GetMaxHeadingLevel(m_Headings));
 }
 
 
 // Updates the inclusion of the heading in the TOC
 // whenever that heading's "include in TOC" checkbox
 // is checked/unchecked.
-void HeadingSelector::UpdateHeadingInclusion(QStandardItem *checkbox_item)
+void HeadingSelector::UpdateHeadingInclusion(const QModelIndex &index)
 {
-    Q_ASSERT(checkbox_item);
-    QStandardItem *item_parent = GetActualItemParent(checkbox_item);
-    Headings::Heading *heading = GetItemHeading(item_parent->child(checkbox_item->row(), 0));
+    Headings::Heading *heading = m_TableOfContents.HeadingAt(m_TableOfContents.PositionForIndex(index));
     Q_ASSERT(heading);
-    QString heading_level = item_parent->child(checkbox_item->row(), 1)->text();
+    QString heading_level = "h" % QString::number(heading->level);
 
-    if (checkbox_item->checkState() == Qt::Unchecked) {
-        heading->include_in_toc = false;
+    if (!heading->include_in_toc) {
         m_HeadingsIncluded[heading_level]--;
         m_HeadingsHidden[heading_level]++;
     } else {
-        heading->include_in_toc = true;
         m_HeadingsIncluded[heading_level]++;
         m_HeadingsHidden[heading_level]--;
     }
@@ -543,7 +469,7 @@ void HeadingSelector::UpdateHeadingInclusion(QStandardItem *checkbox_item)
     DisplayCounts();
 
     if (ui.cbTOCItemsOnly->checkState() == Qt::Checked) {
-        RemoveExcludedItems(m_TableOfContents.invisibleRootItem());
+        RefreshTOCModelDisplay(GetAbsoluteRowForIndex(index.sibling(index.row(), 0)));
     }
 }
 
@@ -553,7 +479,19 @@ void HeadingSelector::UpdateHeadingInclusion(QStandardItem *checkbox_item)
 // (resizes columns etc.)
 void HeadingSelector::UpdateTreeViewDisplay()
 {
-    ui.tvTOCDisplay->expandAll();
+    if (m_TableOfContents.VisibleCount() <= EXPAND_ALL_LIMIT) {
+        ui.tvTOCDisplay->expandAll();
+    } else {
+        // Only the branches the user opened are laid out again
+        foreach(int position, m_Expanded) {
+            QModelIndex index = m_TableOfContents.IndexForPosition(position);
+
+            if (index.isValid()) {
+                ui.tvTOCDisplay->expand(index);
+            }
+        }
+    }
+
     // Make the header fill all the available space not used by the checkbox
     ui.tvTOCDisplay->header()->setStretchLastSection(false);
     ui.tvTOCDisplay->resizeColumnToContents(1);
@@ -561,37 +499,21 @@ void HeadingSelector::UpdateTreeViewDisplay()
     ui.tvTOCDisplay->header()->setSectionResizeMode(0, QHeaderView::Stretch);
 }
 
-void HeadingSelector::CountHeadings(QStandardItem *item)
-{
-    // Recursively call itself on the item's children
-    for (int i = 0; i < item->rowCount(); i++) {
-        CountHeadings(item->child(i));
-    }
-
-    // The root item is always present
-    if (item == m_TableOfContents.invisibleRootItem()) {
-        return;
-    }
-
-    // We query the "include in TOC" checkbox
-    QStandardItem *item_parent = GetActualItemParent(item);
-    Qt::CheckState check_state = item_parent->child(item->row(), 2)->checkState();
-    QString heading_level = item_parent->child(item->row(), 1)->text();
-
-    if (check_state) {
-        m_HeadingsIncluded[heading_level]++;
-    } else {
-        m_HeadingsHidden[heading_level]++;
-    }
-}
-
 void HeadingSelector::RefreshCounts()
 {
     foreach(QString h, HEADING_TAGS) {
         m_HeadingsIncluded[h] = 0;
         m_HeadingsHidden[h] = 0;
     }
-    CountHeadings(m_TableOfContents.invisibleRootItem());
+    foreach(const Headings::Heading &heading, m_Headings) {
+        QString heading_level = "h" % QString::number(heading.level);
+
+        if (heading.include_in_toc) {
+            m_HeadingsIncluded[heading_level]++;
+        } else {
+            m_HeadingsHidden[heading_level]++;
+        }
+    }
     DisplayCounts();
 }
 
@@ -608,257 +530,109 @@ void HeadingSelector::DisplayCounts()
 }
 
 
-// Creates the model that is displayed
-// in the tree view
-void HeadingSelector::CreateTOCModel()
-{
-    m_TableOfContents.clear();
-    QStringList header;
-    header.append(tr("TOC Entry / Heading Title"));
-    header.append(tr("Level") % " ");
-    header.append(tr("Include") % " ");
-    m_TableOfContents.setHorizontalHeaderLabels(header);
-
-    // Recursively inserts all headings
-    for (int i = 0; i < m_Headings.count(); ++i) {
-        InsertHeadingIntoModel(m_Headings[ i ], m_TableOfContents.invisibleRootItem());
-    }
-
-    RefreshCounts();
-}
-
-
-// Inserts the specified heading into the model
-// as the child of the specified parent item;
-// recursively calls itself on the headings children,
-// thus building a TOC tree
-void HeadingSelector::InsertHeadingIntoModel(Headings::Heading &heading, QStandardItem *parent_item)
+// Get the maximum heading level for all headings
+int HeadingSelector::GetMaxHeadingLevel(QList<Headings::Heading> flat_headings)
 {
-    Q_ASSERT(parent_item);
-    // Compress whitespace that pretty-print may add inside of header text.
-    QString heading_text = !heading.title.isNull() ? heading.title : heading.text.simplified();
-    QStandardItem *item_heading           = new QStandardItem(heading_text);
-    QStandardItem *heading_level          = new QStandardItem("h" % QString::number(heading.level));
-    QStandardItem *heading_included_check = new QStandardItem();
-    heading_level->setEditable(false);
-    heading_included_check->setEditable(false);
-    heading_included_check->setCheckable(true);
-    item_heading->setEditable(true);
-    item_heading->setDragEnabled(false);
-    item_heading->setDropEnabled(false);
-
-    if (heading.include_in_toc) {
-        heading_included_check->setCheckState(Qt::Checked);
-    } else {
-        heading_included_check->setCheckState(Qt::Unchecked);
-    }
-
-    // Storing a pointer to the heading that
-    // is represented by this QStandardItem
-    Headings::HeadingPointer wrap;
-    wrap.heading = &heading;
-    item_heading->setData(QVariant::fromValue(wrap));
-    // Apparently using \n in the string means you don't have to replace < with &lt; or > with &gt;
-    // QString html = XhtmlDoc::GetDomNodeAsString(*heading.element).remove("xmlns=\"http://www.w3.org/1999/xhtml\"");
-    // item_heading->setToolTip(heading.resource_file->Filename() + ":\n\n" + html);
-    item_heading->setToolTip(heading.resource_file->Filename() + ":\n\n");
-    QList<QStandardItem *> items;
-    items << item_heading << heading_level << heading_included_check;
-    parent_item->appendRow(items);
-
-    if (!heading.children.isEmpty()) {
-        for (int i = 0; i < heading.children.count(); ++i) {
-            InsertHeadingIntoModel(heading.children[ i ], item_heading);
+    int maxLevel = 0;
+    foreach(Headings::Heading heading, flat_headings) {
+        if (heading.level > maxLevel) {
+            maxLevel = heading.level;
         }
     }
+    return maxLevel;
 }
 
 
-// Removes from the tree items that represent headings
-// that are not to be included in the TOC; the children
-// of those items rise to their parent's hierarchy level
-// OR (more likely) are attached as children to the first
-// previous heading that is lower in level.
-void HeadingSelector::RemoveExcludedItems(QStandardItem *item)
+// Add the selectable entries to the Select Heading combo box
+void HeadingSelector::PopulateSelectHeadingCombo(int max_heading_level)
 {
-    Q_ASSERT(item);
-
-    // Recursively call itself on the item's children
-    if (item->hasChildren()) {
-        int row_index = 0;
-
-        while (row_index < item->rowCount()) {
-            QStandardItem *oldchild = item->child(row_index);
-            RemoveExcludedItems(item->child(row_index));
-
-            // We only increment the row_index if the
-            // RemoveExcludedItems operation didn't end up
-            // removing the child at that index.. if it did,
-            // the next child is now at that index.
-            if (oldchild == item->child(row_index)) {
-                row_index++;
-            }
-        }
-    }
-
-    // The root item is always present
-    if (item == m_TableOfContents.invisibleRootItem()) {
-        return;
-    }
-
-    QStandardItem *item_parent = GetActualItemParent(item);
-    // We query the "include in TOC" checkbox
-    Qt::CheckState check_state = item_parent->child(item->row(), 2)->checkState();
+    QString entry = tr("Up to level");
+    ui.cbTOCSetHeadingLevel->clear();
+    ui.cbTOCSetHeadingLevel->addItem(tr("<Select headings to include in TOC>"));
 
-    // We remove the current item if it shouldn't
-    // be included in the TOC
-    if (check_state == Qt::Unchecked) {
-        if (item->hasChildren()) {
-            while (item->rowCount() > 0) {
-                QList<QStandardItem *> child_row = item->takeRow(0);
+    if (max_heading_level > 0) {
+        ui.cbTOCSetHeadingLevel->addItem(tr("None"));
 
-                if (!AddRowToVisiblePredecessorSucceeded(child_row, item)) {
-                    item_parent->insertRow(item->row(), child_row);
-                }
-            }
+        for (int i = 1; i < max_heading_level; ++i) {
+            ui.cbTOCSetHeadingLevel->addItem(entry + " " + QString::number(i));
         }
 
-        // Item removes itself
-        item_parent->removeRow(item->row());
+        ui.cbTOCSetHeadingLevel->addItem(tr("All"));
     }
 }
 
-
-bool HeadingSelector::AddRowToVisiblePredecessorSucceeded(const QList<QStandardItem *> &child_row,
-        QStandardItem *row_parent)
+void HeadingSelector::RefreshTOCModelDisplay(int select_row)
 {
-    Q_ASSERT(row_parent);
-    QStandardItem *row_grandparent = GetActualItemParent(row_parent);
+    m_SelectRowAfterRefresh = select_row;
 
-    if (row_grandparent == NULL) {
-        return false;
+    // Whatever changes arrive while an outline is worked out
+    // are picked up by a single refresh after it
+    if (m_RefreshInProgress) {
+        m_RefreshQueued = true;
+        return;
     }
 
-    return AddRowToCorrectItem(row_grandparent, child_row, row_parent->row());
+    m_RefreshInProgress = true;
+    m_OutlineWatcher.setFuture(TaskScheduler::Run(TaskScheduler::Interactive, "HeadingTreeModel::BuildOutline",
+                               std::bind(&HeadingTreeModel::BuildOutline,
+                                         GetHeadingLevels(),
+                                         GetHeadingInclusions(),
+                                         ui.cbTOCItemsOnly->checkState() == Qt::Checked)));
 }
 
 
-// Basically we're looking for the first heading of a lower level that comes
-// before the child_row heading whose parent heading is disappearing. The new parent
-// needs to also be marked as "include_in_toc".
-bool HeadingSelector::AddRowToCorrectItem(QStandardItem *item,
-        const QList<QStandardItem *> &child_row,
-        int child_index_limit)
+void HeadingSelector::RefreshEnd()
 {
-    int child_start_index = child_index_limit != -1 ? child_index_limit - 1 : item->rowCount() - 1;
+    m_RefreshInProgress = false;
 
-    for (int i = child_start_index; i > -1; --i) {
-        bool row_placed = AddRowToCorrectItem(item->child(i), child_row);
-
-        if (row_placed) {
-            return true;
-        }
-    }
-
-    Headings::Heading *heading = GetItemHeading(item);
-
-    if (heading == NULL) {
-        return false;
+    if (m_RefreshQueued) {
+        m_RefreshQueued = false;
+        RefreshTOCModelDisplay(m_SelectRowAfterRefresh);
+        return;
     }
 
-    Headings::Heading *child_heading = GetItemHeading(child_row[ 0 ]);
+    m_TableOfContents.SetOutline(m_OutlineWatcher.result());
+    UpdateTreeViewDisplay();
 
-    if (heading->include_in_toc &&
-        heading->level < child_heading->level) {
-        item->insertRow(child_start_index + 1, child_row);
-        return true;
+    if (m_SelectRowAfterRefresh >= 0) {
+        SelectAbsoluteRow(m_SelectRowAfterRefresh);
     }
-
-    return false;
 }
 
 
-//    Unfortunately, while the invisible root of a QStandardItemModel
-// can have children, those children do not have a parent set.
-// Of course, their parent is the invisible root, but their
-// parent() function returns 0. So now you have *two* tree levels
-// for which parent() returns 0. This is clearly inconsistent
-// and makes the whole idea of using the same recursive
-// functions for tree traversal rather difficult to implement.
-// The only item for which parent() should return 0 should be
-// the invisible root.
-//    Admittedly, Qt has some design issues. The next few lines
-// try to work around them by manually setting an item parent.
-QStandardItem *HeadingSelector::GetActualItemParent(const QStandardItem *item)
+void HeadingSelector::BranchExpanded(const QModelIndex &index)
 {
-    Q_ASSERT(item);
-
-    if (item == m_TableOfContents.invisibleRootItem()) {
-        return NULL;
+    if (m_TableOfContents.VisibleCount() > EXPAND_ALL_LIMIT) {
+        m_Expanded.insert(m_TableOfContents.PositionForIndex(index));
     }
-
-    if (item->parent() == 0) {
-        return m_TableOfContents.invisibleRootItem();
-    }
-
-    return item->parent();
 }
 
 
-// CAN RETURN NULL!
-Headings::Heading *HeadingSelector::GetItemHeading(const QStandardItem *item)
+void HeadingSelector::BranchCollapsed(const QModelIndex &index)
 {
-    Q_ASSERT(item);
-
-    if (item == m_TableOfContents.invisibleRootItem()) {
-        return NULL;
-    }
-
-    Headings::Heading *heading = item->data().value<Headings::HeadingPointer>().heading;
-    return heading;
+    m_Expanded.remove(m_TableOfContents.PositionForIndex(index));
 }
 
 
-// Get the maximum heading level for all headings
-int HeadingSelector::GetMaxHeadingLevel(QList<Headings::Heading> flat_headings)
+QVector<int> HeadingSelector::GetHeadingLevels()
 {
-    int maxLevel = 0;
-    foreach(Headings::Heading heading, flat_headings) {
-        if (heading.level > maxLevel) {
-            maxLevel = heading.level;
-        }
+    QVector<int> levels;
+    levels.reserve(m_Headings.count());
+    foreach(const Headings::Heading &heading, m_Headings) {
+        levels.append(heading.level);
     }
-    return maxLevel;
+    return levels;
 }
 
 
-// Add the selectable entries to the Select Heading combo box
-void HeadingSelector::PopulateSelectHeadingCombo(int max_heading_level)
+QVector<bool> HeadingSelector::GetHeadingInclusions()
 {
-    QString entry = tr("Up to level");
-    ui.cbTOCSetHeadingLevel->clear();
-    ui.cbTOCSetHeadingLevel->addItem(tr("<Select headings to include in TOC>"));
-
-    if (max_heading_level > 0) {
-        ui.cbTOCSetHeadingLevel->addItem(tr("None"));
-
-        for (int i = 1; i < max_heading_level; ++i) {
-            ui.cbTOCSetHeadingLevel->addItem(entry + " " + QString::number(i));
-        }
-
-        ui.cbTOCSetHeadingLevel->addItem(tr("All"));
+    QVector<bool> included;
+    included.reserve(m_Headings.count());
+    foreach(const Headings::Heading &heading, m_Headings) {
+        included.append(heading.include_in_toc);
     }
-}
-
-void HeadingSelector::RefreshTOCModelDisplay()
-{
-    CreateTOCModel();
-
-    if (ui.cbTOCItemsOnly->checkState() == Qt::Checked) {
-        RemoveExcludedItems(m_TableOfContents.invisibleRootItem());
-    }
-
-    UpdateTreeViewDisplay();
+    return included;
 }
 
 // Set all headings to be in or not in the TOC
@@ -869,6 +643,7 @@ void HeadingSelector::SetAllHeadingInclusion(int upToLevel)
         SetOneHeadingInclusion(m_Headings[ i ], upToLevel);
     }
 
+    RefreshCounts();
     RefreshTOCModelDisplay();
 }
 
@@ -1013,8 +788,14 @@ bool HeadingSelector::eventFilter(QObject *obj, QEvent *event)
 
 void HeadingSelector::ConnectSignalsToSlots()
 {
-    connect(&m_TableOfContents, SIGNAL(itemChanged(QStandardItem *)),
-            this,               SLOT(ModelItemFilter(QStandardItem *))
+    connect(&m_TableOfContents, SIGNAL(TitleEdited(Headings::Heading *, const QString &)),
+            this,               SLOT(UpdateOneHeadingTitle(Headings::Heading *, const QString &))
+           );
+    connect(&m_TableOfContents, SIGNAL(InclusionChanged(const QModelIndex &)),
+            this,               SLOT(UpdateHeadingInclusion(const QModelIndex &))
+           );
+    connect(&m_OutlineWatcher,  SIGNAL(finished()),
+            this,               SLOT(RefreshEnd())
            );
     connect(ui.cbTOCItemsOnly,  SIGNAL(stateChanged(int)),
             this,               SLOT(ChangeDisplayType(int))
@@ -1029,6 +810,10 @@ void HeadingSelector::ConnectSignalsToSlots()
     connect(ui.left,             SIGNAL(clicked()), this, SLOT(DecreaseHeadingLevel()));
     connect(ui.right,            SIGNAL(clicked()), this, SLOT(IncreaseHeadingLevel()));
     connect(ui.rename,           SIGNAL(clicked()), this, SLOT(Rename()));
+    connect(ui.tvTOCDisplay,     SIGNAL(expanded(const QModelIndex &)),
+            this,                SLOT(BranchExpanded(const QModelIndex &)));
+    connect(ui.tvTOCDisplay,     SIGNAL(collapsed(const QModelIndex &)),
+            this,                SLOT(BranchCollapsed(const QModelIndex &)));
     connect(ui.tvTOCDisplay,     SIGNAL(customContextMenuRequested(const QPoint &)),
             this,                SLOT(OpenContextMenu(const QPoint &)));
     connect(m_Rename,            SIGNAL(triggered()), this, SLOT(Rename()));
@@ -23,18 +23,20 @@
 #ifndef HEADINGSELECTOR_H
 #define HEADINGSELECTOR_H
 
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QList>
+#include <QtCore/QSet>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QMenu>
 
 #include "ui_HeadingSelector.h"
 #include "BookManipulation/Headings.h"
+#include "Dialogs/HeadingTreeModel.h"
 
 class Book;
-class QStandardItem;
 
 class HeadingSelector : public QDialog
 {
@@ -64,12 +66,18 @@ private slots:
 
     void Rename();
 
-    // We need to filter the calls to functions that would normally
-    // connect directly to the itemChanged( QStandardItem* ) signal
-    // because some would-be slots delete the item in question.
-    // So, the signal connects here and this function calls the
-    // appropriate item-handling functions.
-    void ModelItemFilter(QStandardItem *item);
+    void UpdateOneHeadingTitle(Headings::Heading *heading, const QString &title);
+
+    // Updates the inclusion of the heading in the TOC
+    // whenever that heading's "include in TOC" checkbox
+    // is checked/unchecked.
+    void UpdateHeadingInclusion(const QModelIndex &index);
+
+    // Shows the outline worked out by RefreshTOCModelDisplay
+    void RefreshEnd();
+
+    void BranchExpanded(const QModelIndex &index);
+    void BranchCollapsed(const QModelIndex &index);
 
     // Switches the display between showing all headings
     // and showing only headings that are to be included in the TOC
@@ -83,8 +91,6 @@ private slots:
     void SelectHeadingLevelInclusion(const QString &heading_level);
 
 private:
-    void ExpandChildren(QStandardItem *item);
-
     int GetAbsoluteRowForIndex(QModelIndex current_index);
     QModelIndex GetIndexForAbsoluteRow(int row);
     QModelIndex SelectAbsoluteRow(int row);
@@ -101,59 +107,16 @@ private:
     //  Performance Fix: update headings but be careful not to repeatedly reparse a resource multiple times
     void PerformHeadingUpdates(QList<Headings::Heading*> & headings, QStringList used_ids, int next_toc_id);
 
-    // Get Flat List of Headings in their Item Hierarchical Order
-    QList<Headings::Heading *> ItemOrderHeadingList(QStandardItem * item);
-
-    void UpdateOneHeadingTitle(QStandardItem *item, const QString &title);
-
-    // Updates the inclusion of the heading in the TOC
-    // whenever that heading's "include in TOC" checkbox
-    // is checked/unchecked.
-    void UpdateHeadingInclusion(QStandardItem *checkbox_item);
-
     // Updates the display of the tree view
     // (resizes columns etc.)
     void UpdateTreeViewDisplay();
 
-    // Creates the model that is displayed
-    // in the tree view
-    void CreateTOCModel();
-
-    void RefreshTOCModelDisplay();
-
-    // Inserts the specified heading into the model
-    // as the child of the specified parent item;
-    // recursively calls itself on the headings children,
-    // thus building a TOC tree
-    void InsertHeadingIntoModel(Headings::Heading &heading, QStandardItem *parent_item);
-
-    // Removes from the tree items that represent headings
-    // that are not to be included in the TOC; the children
-    // of those items rise to their parent's hierarchy level
-    void RemoveExcludedItems(QStandardItem *item);
+    // Works out the tree shown on the thread pool; the
+    // absolute row select_row is selected once it is shown
+    void RefreshTOCModelDisplay(int select_row = -1);
 
-    bool AddRowToVisiblePredecessorSucceeded(const QList<QStandardItem *> &child_row,
-            QStandardItem *row_parent);
-
-    /**
-     * Adds the child row to the "correct" item in the hierarchy below the
-     * specified item. We are looking for the first previous item/heading
-     * that has a lower level and that should be included in the TOC.
-     *
-     * @param item The item in which hierarchy the row should be placed.
-     * @param child_row The row that we want to add.
-     * @param child_index_limit If specified, then it's the index of the
-     *                          row's (disappearing) parent in row's grandparent
-     *                          children list. We only look at children with
-     *                          a lower index than this.
-     */
-    bool AddRowToCorrectItem(QStandardItem *item,
-                             const QList<QStandardItem *> &child_row,
-                             int child_index_limit = -1);
-
-    QStandardItem *GetActualItemParent(const QStandardItem *item);
-
-    Headings::Heading *GetItemHeading(const QStandardItem *item);
+    QVector<int> GetHeadingLevels();
+    QVector<bool> GetHeadingInclusions();
 
 
     // Get the maximum heading level for all headings
@@ -182,7 +145,6 @@ private:
 
     void ConnectSignalsToSlots();
 
-    void CountHeadings(QStandardItem *item);
     void RefreshCounts();
     void DisplayCounts();
 
@@ -195,11 +157,21 @@ private:
     QSharedPointer<Book> m_Book;
 
     // The model displayed and edited in the tree view
-    QStandardItemModel m_TableOfContents;
+    HeadingTreeModel m_TableOfContents;
 
-    // The tree of all the headings in the book
+    // All the headings in the book, in document order;
+    // the tree is kept by the model
     QList<Headings::Heading> m_Headings;
 
+    QFutureWatcher<HeadingTreeModel::Outline> m_OutlineWatcher;
+    bool m_RefreshInProgress;
+    bool m_RefreshQueued;
+    int m_SelectRowAfterRefresh;
+
+    // The headings whose branches the user has expanded,
+    // by position; only kept for books with many headings
+    QSet<int> m_Expanded;
+
     QMenu *m_ContextMenu;
 
     QAction *m_Rename;
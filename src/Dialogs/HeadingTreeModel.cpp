@@ -0,0 +1,262 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include "Dialogs/HeadingTreeModel.h"
+#include "ResourceObjects/HTMLResource.h"
+
+HeadingTreeModel::HeadingTreeModel(QObject *parent)
+    :
+    QAbstractItemModel(parent)
+{
+}
+
+
+void HeadingTreeModel::SetHeadings(QList<Headings::Heading> &headings)
+{
+    beginResetModel();
+    m_Headings.clear();
+    m_Headings.reserve(headings.count());
+
+    for (int i = 0; i < headings.count(); ++i) {
+        m_Headings.append(&headings[ i ]);
+    }
+
+    m_Outline = Outline();
+    endResetModel();
+}
+
+
+void HeadingTreeModel::SetOutline(const Outline &outline)
+{
+    Q_ASSERT(outline.rows.count() == m_Headings.count());
+    beginResetModel();
+    m_Outline = outline;
+    endResetModel();
+}
+
+
+HeadingTreeModel::Outline HeadingTreeModel::BuildOutline(const QVector<int> &levels,
+        const QVector<bool> &included,
+        bool toc_items_only)
+{
+    const int count = levels.count();
+    Outline outline;
+    outline.parents.fill(-1, count);
+    outline.rows.fill(-1, count);
+    outline.children.resize(count);
+    // The headings shown so far that the next one could be a child of
+    QVector<int> open;
+
+    for (int i = 0; i < count; ++i) {
+        if (toc_items_only && !included.at(i)) {
+            continue;
+        }
+
+        while (!open.isEmpty() && levels.at(open.last()) >= levels.at(i)) {
+            open.removeLast();
+        }
+
+        QVector<int> &siblings = open.isEmpty() ? outline.top_level : outline.children[ open.last() ];
+        outline.parents[ i ] = open.isEmpty() ? -1 : open.last();
+        outline.rows[ i ] = siblings.count();
+        siblings.append(i);
+        open.append(i);
+        outline.visible++;
+    }
+
+    return outline;
+}
+
+
+int HeadingTreeModel::VisibleCount() const
+{
+    return m_Outline.visible;
+}
+
+
+Headings::Heading *HeadingTreeModel::HeadingAt(int position) const
+{
+    return m_Headings.at(position);
+}
+
+
+int HeadingTreeModel::PositionForIndex(const QModelIndex &index) const
+{
+    return index.isValid() ? int(index.internalId()) : -1;
+}
+
+
+QModelIndex HeadingTreeModel::IndexForPosition(int position, int column) const
+{
+    if (position < 0 || position >= m_Outline.rows.count() || m_Outline.rows.at(position) < 0) {
+        return QModelIndex();
+    }
+
+    return createIndex(m_Outline.rows.at(position), column, quintptr(position));
+}
+
+
+QModelIndex HeadingTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() && parent.column() != TitleColumn) {
+        return QModelIndex();
+    }
+
+    const QVector<int> &siblings = parent.isValid() ? m_Outline.children.at(parent.internalId())
+                                                    : m_Outline.top_level;
+
+    if (row < 0 || row >= siblings.count() || column < 0 || column >= ColumnCount) {
+        return QModelIndex();
+    }
+
+    return createIndex(row, column, quintptr(siblings.at(row)));
+}
+
+
+QModelIndex HeadingTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+
+    return IndexForPosition(m_Outline.parents.at(child.internalId()));
+}
+
+
+int HeadingTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return m_Outline.top_level.count();
+    }
+
+    return parent.column() == TitleColumn ? m_Outline.children.at(parent.internalId()).count() : 0;
+}
+
+
+int HeadingTreeModel::columnCount(const QModelIndex &parent) const
+{
+    return ColumnCount;
+}
+
+
+QVariant HeadingTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+
+    const Headings::Heading *heading = m_Headings.at(index.internalId());
+
+    switch (index.column()) {
+        case TitleColumn:
+            if (role == Qt::DisplayRole || role == Qt::EditRole) {
+                // Compress whitespace that pretty-print may add inside of header text.
+                return !heading->title.isNull() ? heading->title : heading->text.simplified();
+            } else if (role == Qt::ToolTipRole) {
+                return heading->resource_file->Filename() + ":\n\n";
+            }
+            break;
+        case LevelColumn:
+            if (role == Qt::DisplayRole) {
+                return "h" + QString::number(heading->level);
+            }
+            break;
+        case IncludeColumn:
+            if (role == Qt::CheckStateRole) {
+                return heading->include_in_toc ? Qt::Checked : Qt::Unchecked;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+
+bool HeadingTreeModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid()) {
+        return false;
+    }
+
+    Headings::Heading *heading = m_Headings.at(index.internalId());
+
+    if (index.column() == TitleColumn && role == Qt::EditRole) {
+        emit TitleEdited(heading, value.toString());
+        emit dataChanged(index, index);
+        return true;
+    }
+
+    if (index.column() == IncludeColumn && role == Qt::CheckStateRole) {
+        bool include = value.toInt() == Qt::Checked;
+
+        if (include != heading->include_in_toc) {
+            heading->include_in_toc = include;
+            emit dataChanged(index, index);
+            emit InclusionChanged(index);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+Qt::ItemFlags HeadingTreeModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+
+    Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+
+    if (index.column() == TitleColumn) {
+        flags |= Qt::ItemIsEditable;
+    } else if (index.column() == IncludeColumn) {
+        flags |= Qt::ItemIsUserCheckable;
+    }
+
+    return flags;
+}
+
+
+QVariant HeadingTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case TitleColumn:
+            return tr("TOC Entry / Heading Title");
+        case LevelColumn:
+            return tr("Level") + " ";
+        case IncludeColumn:
+            return tr("Include") + " ";
+        default:
+            break;
+    }
+
+    return QVariant();
+}
@@ -0,0 +1,142 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef HEADINGTREEMODEL_H
+#define HEADINGTREEMODEL_H
+
+#include <QtCore/QAbstractItemModel>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+#include "BookManipulation/Headings.h"
+
+/**
+ * The headings of a book as the tree the Heading Selector shows.
+ *
+ * The headings are kept in a flat list in document order and the tree
+ * is an outline over their positions in it, so changing a level or
+ * hiding a heading never moves a heading. Outlines are plain numbers
+ * and are worked out on the thread pool; rows are only made into
+ * indexes when the view asks for them, which it does for the branches
+ * that are expanded.
+ */
+class HeadingTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+
+    enum Column {
+        TitleColumn = 0,
+        LevelColumn,
+        IncludeColumn,
+        ColumnCount
+    };
+
+    /**
+     * Where each heading sits in the tree, by position in document
+     * order. A heading that is not shown has a row of -1.
+     */
+    struct Outline {
+        QVector<int> parents;
+        QVector<int> rows;
+        QVector<QVector<int> > children;
+        QVector<int> top_level;
+        int visible;
+
+        Outline() : visible(0) {}
+    };
+
+    HeadingTreeModel(QObject *parent = 0);
+
+    /**
+     * Sets the headings shown, which must outlive the model and
+     * stay where they are. The model shows nothing until an outline
+     * for them is set.
+     */
+    void SetHeadings(QList<Headings::Heading> &headings);
+
+    void SetOutline(const Outline &outline);
+
+    /**
+     * Works out the tree for headings of the given levels: each heading
+     * shown is a child of the closest heading shown before it that has
+     * a lower level. With toc_items_only, the headings not included in
+     * the TOC are not shown. Safe to run on any thread.
+     */
+    static Outline BuildOutline(const QVector<int> &levels,
+                                const QVector<bool> &included,
+                                bool toc_items_only);
+
+    int VisibleCount() const;
+
+    Headings::Heading *HeadingAt(int position) const;
+
+    /**
+     * @return The position of the heading in document order,
+     *         or -1 for an invalid index.
+     */
+    int PositionForIndex(const QModelIndex &index) const;
+
+    /**
+     * @return The index of the heading at position, or an invalid
+     *         index if that heading is not shown.
+     */
+    QModelIndex IndexForPosition(int position, int column = TitleColumn) const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+
+    QModelIndex parent(const QModelIndex &child) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+signals:
+    /**
+     * Emitted when the user renames a heading,
+     * before the heading's title is changed.
+     */
+    void TitleEdited(Headings::Heading *heading, const QString &title);
+
+    /**
+     * Emitted after the user includes the heading at
+     * index in the TOC or excludes it.
+     */
+    void InclusionChanged(const QModelIndex &index);
+
+private:
+    QVector<Headings::Heading *> m_Headings;
+
+    Outline m_Outline;
+};
+
+#endif // HEADINGTREEMODEL_H
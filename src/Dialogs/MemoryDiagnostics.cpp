@@ -0,0 +1,233 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtGui/QStandardItemModel>
+#include <QtWebKit/QWebSettings>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QHeaderView>
+
+#include "BookManipulation/Book.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "Dialogs/MemoryDiagnostics.h"
+#include "Misc/BookNetworkAccess.h"
+#include "Misc/GumboCache.h"
+#include "Misc/MatchOffsets.h"
+#include "Misc/NumericItem.h"
+#include "Misc/SettingsStore.h"
+#include "Misc/ThumbnailService.h"
+#include "Misc/Trace.h"
+#include "Misc/Utility.h"
+#include "Misc/VisibleText.h"
+#include "PCRE/PCRECache.h"
+#include "ResourceObjects/TextMemoryBudget.h"
+#include "ResourceObjects/TextResource.h"
+#include "Tabs/TabManager.h"
+
+static const QString SETTINGS_GROUP = "memory_diagnostics";
+
+static const int SIZE_COLUMN = 2;
+
+
+MemoryDiagnostics::MemoryDiagnostics(QSharedPointer<Book> book, TabManager *tab_manager, QWidget *parent)
+    :
+    QDialog(parent),
+    m_Book(book),
+    m_TabManager(tab_manager),
+    m_ItemModel(new QStandardItemModel(this))
+{
+    ui.setupUi(this);
+    ui.memoryTree->setModel(m_ItemModel);
+    ui.memoryTree->header()->setSortIndicator(SIZE_COLUMN, Qt::DescendingOrder);
+    connectSignalsSlots();
+    ReadSettings();
+    Refresh();
+}
+
+
+MemoryDiagnostics::~MemoryDiagnostics()
+{
+    WriteSettings();
+}
+
+
+void MemoryDiagnostics::Refresh()
+{
+    m_ItemModel->clear();
+    QStringList header;
+    header.append(tr("Category"));
+    header.append(tr("Item"));
+    header.append(tr("Size (KB)"));
+    m_ItemModel->setHorizontalHeaderLabels(header);
+
+    qint64 text_bytes = 0;
+    qint64 undo_bytes = 0;
+    foreach(Resource * resource, m_Book->GetFolderKeeper()->GetResourceList()) {
+        qint64 bytes = resource->MemoryUsage();
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+        qint64 undo = text_resource ? text_resource->UndoMemoryUsage() : 0;
+
+        if (bytes - undo > 0) {
+            AddRow(tr("Text"), resource->GetRelativePath(), bytes - undo);
+            text_bytes += bytes - undo;
+        }
+
+        if (undo > 0) {
+            AddRow(tr("Undo history"), resource->GetRelativePath(), undo);
+            undo_bytes += undo;
+        }
+    }
+
+    qint64 tree_bytes = GumboCache::Size();
+    qint64 visible_text_bytes = VisibleText::CacheSize();
+    qint64 match_bytes = MatchOffsets::CacheSize();
+    qint64 regex_bytes = PCRECache::instance()->memoryUsage();
+    qint64 thumbnail_bytes = ThumbnailService::instance()->MemoryUsage();
+    qint64 served_bytes = BookNetworkAccess::instance()->MemoryUsage();
+    AddRow(tr("Cache"), tr("Parse trees"), tree_bytes);
+    AddRow(tr("Cache"), tr("Book View search text"), visible_text_bytes);
+    AddRow(tr("Cache"), tr("Search matches"), match_bytes);
+    AddRow(tr("Cache"), tr("Regular expressions"), regex_bytes);
+    AddRow(tr("Cache"), tr("Image thumbnails"), thumbnail_bytes);
+    AddRow(tr("Cache"), tr("Files served to the web views"), served_bytes);
+
+    qint64 accounted = text_bytes + undo_bytes + tree_bytes + visible_text_bytes + match_bytes + regex_bytes +
+                       thumbnail_bytes + served_bytes;
+    qint64 resident = Utility::ProcessResidentBytes();
+
+    if (resident >= 0) {
+        // WebKit keeps its pages and caches to itself
+        AddRow(tr("Other"), tr("Web pages, fonts, images and the application"), qMax(resident - accounted, qint64(0)));
+        ui.summary->setText(tr("Sigil is using %1 MB, %2 MB of it measured below.")
+                            .arg(QLocale().toString(resident / 1048576.0, 'f', 1))
+                            .arg(QLocale().toString(accounted / 1048576.0, 'f', 1)));
+    } else {
+        ui.summary->setText(tr("%1 MB is measured below.").arg(QLocale().toString(accounted / 1048576.0, 'f', 1)));
+    }
+
+    // Not memory, but what the open tabs cost in time
+    int tab_flushes = m_TabManager->GetTabFlushCount();
+    int skipped_tab_flushes = m_TabManager->GetSkippedTabFlushCount();
+    ui.summary->setText(ui.summary->text() + "\n" +
+                        tr("%1 of %2 tab saves were skipped as the tabs had not been edited.")
+                        .arg(skipped_tab_flushes).arg(tab_flushes));
+
+    SIGIL_TRACE_COUNTER("Memory: text", text_bytes);
+    SIGIL_TRACE_COUNTER("Memory: undo history", undo_bytes);
+    SIGIL_TRACE_COUNTER("Memory: parse trees", tree_bytes);
+    SIGIL_TRACE_COUNTER("Memory: search text", visible_text_bytes);
+    SIGIL_TRACE_COUNTER("Memory: search matches", match_bytes);
+    SIGIL_TRACE_COUNTER("Memory: regular expressions", regex_bytes);
+    SIGIL_TRACE_COUNTER("Memory: thumbnails", thumbnail_bytes);
+    SIGIL_TRACE_COUNTER("Memory: served files", served_bytes);
+    SIGIL_TRACE_COUNTER("Tab saves skipped", skipped_tab_flushes);
+
+    if (resident >= 0) {
+        SIGIL_TRACE_COUNTER("Memory: resident", resident);
+    }
+
+    QHeaderView *tree_header = ui.memoryTree->header();
+    ui.memoryTree->sortByColumn(tree_header->sortIndicatorSection(), tree_header->sortIndicatorOrder());
+
+    for (int i = 0; i < tree_header->count(); i++) {
+        ui.memoryTree->resizeColumnToContents(i);
+    }
+}
+
+
+void MemoryDiagnostics::DropCaches()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    GumboCache::Clear();
+    VisibleText::ClearCache();
+    MatchOffsets::ClearCache();
+    PCRECache::instance()->clear();
+    ThumbnailService::instance()->ClearMemoryCache();
+    BookNetworkAccess::instance()->ClearCache();
+    TextMemoryBudget::EvictAll();
+    QWebSettings::clearMemoryCaches();
+    QApplication::restoreOverrideCursor();
+    Refresh();
+}
+
+
+void MemoryDiagnostics::HibernateTabs()
+{
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    m_TabManager->HibernateInactiveTabs();
+    QApplication::restoreOverrideCursor();
+    Refresh();
+}
+
+
+void MemoryDiagnostics::AddRow(const QString &category, const QString &item, qint64 bytes)
+{
+    QList<QStandardItem *> row_items;
+    QStandardItem *category_item = new QStandardItem(category);
+    row_items << category_item;
+    QStandardItem *name_item = new QStandardItem(item);
+    row_items << name_item;
+    NumericItem *size_item = new NumericItem();
+    size_item->setText(QString::number(bytes / 1024.0, 'f', 1));
+    size_item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+    row_items << size_item;
+
+    for (int i = 0; i < row_items.count(); i++) {
+        row_items[i]->setEditable(false);
+    }
+
+    m_ItemModel->appendRow(row_items);
+}
+
+
+void MemoryDiagnostics::ReadSettings()
+{
+    SettingsStore settings;
+    settings.beginGroup(SETTINGS_GROUP);
+    // The size of the window and it's full screen status
+    QByteArray geometry = settings.value("geometry").toByteArray();
+
+    if (!geometry.isNull()) {
+        restoreGeometry(geometry);
+    }
+
+    settings.endGroup();
+}
+
+
+void MemoryDiagnostics::WriteSettings()
+{
+    SettingsStore settings;
+    settings.beginGroup(SETTINGS_GROUP);
+    // The size of the window and it's full screen status
+    settings.setValue("geometry", saveGeometry());
+    settings.endGroup();
+}
+
+
+void MemoryDiagnostics::connectSignalsSlots()
+{
+    connect(ui.refresh,       SIGNAL(clicked()),
+            this,             SLOT(Refresh()));
+    connect(ui.dropCaches,    SIGNAL(clicked()),
+            this,             SLOT(DropCaches()));
+    connect(ui.hibernateTabs, SIGNAL(clicked()),
+            this,             SLOT(HibernateTabs()));
+}
@@ -0,0 +1,73 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef MEMORYDIAGNOSTICS_H
+#define MEMORYDIAGNOSTICS_H
+
+#include <QtCore/QSharedPointer>
+#include <QtWidgets/QDialog>
+
+#include "ui_MemoryDiagnostics.h"
+
+class Book;
+class QStandardItemModel;
+class TabManager;
+
+/**
+ * Shows what the memory of the session is held by: the text and undo
+ * history of every file, the caches, and what is left over for the
+ * WebKit pages and everything else that cannot be measured.
+ *
+ * Every refresh also records the totals as trace counters, so they
+ * are in the next Save Performance Trace.
+ */
+class MemoryDiagnostics : public QDialog
+{
+    Q_OBJECT
+
+public:
+    MemoryDiagnostics(QSharedPointer<Book> book, TabManager *tab_manager, QWidget *parent = 0);
+    ~MemoryDiagnostics();
+
+private slots:
+    void Refresh();
+
+    void DropCaches();
+
+    void HibernateTabs();
+
+private:
+    void AddRow(const QString &category, const QString &item, qint64 bytes);
+
+    void ReadSettings();
+    void WriteSettings();
+
+    void connectSignalsSlots();
+
+    QSharedPointer<Book> m_Book;
+    TabManager *m_TabManager;
+    QStandardItemModel *m_ItemModel;
+
+    Ui::MemoryDiagnostics ui;
+};
+
+#endif // MEMORYDIAGNOSTICS_H
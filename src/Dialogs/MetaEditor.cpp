@@ -31,11 +31,19 @@
 #include "Dialogs/MetaEditor.h"
 #include "MainUI/MainWindow.h"
 #include "Misc/Language.h"
+#include "Misc/MetadataProcessor.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/PythonRoutines.h"
 
 static const QString SETTINGS_GROUP = "meta_editor";
 
+// The metadata is read and written natively unless this is set,
+// in which case metaproc2.py and metaproc3.py are used instead
+static bool UsePythonMetadata()
+{
+    return qEnvironmentVariableIsSet("SIGIL_USE_PYTHON_METADATA");
+}
+
 MetaEditor::MetaEditor(QWidget *parent)
   : QDialog(parent),
     m_mainWindow(qobject_cast<MainWindow *>(parent)),
@@ -102,8 +110,13 @@ MetaEditor::~MetaEditor()
 
 
 QString MetaEditor::GetOPFMetadata() {
-    PythonRoutines pr;
-    MetadataPieces mdp = pr.GetMetadataInPython(m_opfdata, m_version);
+    MetadataPieces mdp;
+    if (UsePythonMetadata()) {
+        PythonRoutines pr;
+        mdp = pr.GetMetadataInPython(m_opfdata, m_version);
+    } else {
+        mdp = MetadataProcessor::GetMetadata(m_opfdata, m_version);
+    }
     QString data = mdp.data;
     m_otherxml = mdp.otherxml;
     m_metatag = mdp.metatag;
@@ -120,8 +133,13 @@ QString MetaEditor::SetNewOPFMetadata(QString& data)
     mdp.otherxml = m_otherxml;
     mdp.metatag = m_metatag;
     mdp.idlist = m_idlist;
-    PythonRoutines pr;
-    QString results = pr.SetNewMetadataInPython(mdp, m_opfdata, m_version);
+    QString results;
+    if (UsePythonMetadata()) {
+        PythonRoutines pr;
+        results = pr.SetNewMetadataInPython(mdp, m_opfdata, m_version);
+    } else {
+        results = MetadataProcessor::SetNewMetadata(mdp, m_opfdata, m_version);
+    }
     if (!results.isEmpty()) {
         newopfdata = results;
     }
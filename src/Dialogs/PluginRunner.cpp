@@ -1,3 +1,5 @@
+#include <functional>
+
 #include <Qt>
 #include <QString>
 #include <QDir>
@@ -9,6 +11,7 @@
 #include <QMessageBox>
 #include <QStandardPaths>
 #include <QProcessEnvironment>
+#include <QtConcurrent/QtConcurrent>
 
 #include "MainUI/MainWindow.h"
 #include "MainUI/BookBrowser.h"
@@ -17,6 +20,7 @@
 #include "Misc/SettingsStore.h"
 #include "Misc/Utility.h"
 #include "Misc/TempFolder.h"
+#include "Misc/Trace.h"
 #include "Tabs/TabManager.h"
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/XhtmlDoc.h"
@@ -32,6 +36,61 @@ const QString PluginRunner::OPFFILEINFO = "OEBPS/content.opf" + SEP + SEP + "app
 const QString PluginRunner::NCXFILEINFO = "OEBPS/toc.ncx" + SEP + SEP + "application/x-dtbncx+xml";
 const QStringList PluginRunner::CHANGESTAGS = QStringList() << "deleted" << "added" << "modified";
 
+// Plugins often write a file back as it was read, which the result xml
+// still reports as modified. Such files need not be copied and reloaded.
+static bool SameFileContents(const QString &path1, const QString &path2)
+{
+    QFileInfo fi1(path1);
+    QFileInfo fi2(path2);
+    if (!fi1.exists() || !fi2.exists() || fi1.size() != fi2.size()) {
+        return false;
+    }
+    QFile file1(path1);
+    QFile file2(path2);
+    if (!file1.open(QIODevice::ReadOnly) || !file2.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return file1.readAll() == file2.readAll();
+}
+
+// Returns the well-formedness error of one plugin output xhtml file, if any
+static QString CheckOneXhtmlFile(const QString &href, const QString &output_dir)
+{
+    QString data = Utility::ReadUnicodeTextFile(output_dir + "/" + href);
+    XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(data);
+    if (error.line == -1) {
+        return QString();
+    }
+    return PluginRunner::tr("Incorrect XHTML:") + " " + href + " " + PluginRunner::tr("Line/Col") + " " + QString::number(error.line) +
+           "," + QString::number(error.column) + " " + error.message;
+}
+
+static void RepairOneXmlFile(const QString &href, const QString &output_dir)
+{
+    // can't really validate without a full dtd so
+    // auto repair any xml file changes to be safe
+    QString filePath = output_dir + "/" + href;
+    QString mtype = "application/oebs-page-map+xml";
+    if (href.endsWith(".opf")) mtype = "application/oebps-package+xml";
+    if (href.endsWith(".ncx")) mtype = "application/x-dtbncx+xml";
+    if (href.endsWith(".smil")) mtype = "application/oebps-package+xml";
+    QString data = Utility::ReadUnicodeTextFile(filePath);
+    QString newdata = CleanSource::ProcessXML(data, mtype);
+    Utility::WriteUnicodeTextFile(newdata, filePath);
+}
+
+// Copies one modified file into the book and, for text resources,
+// returns its new text
+static QString CopyAndLoadOneFile(const std::pair<QString, bool> &file, const QString &output_dir, const QString &book_root)
+{
+    QString outpath = book_root + "/" + file.first;
+    Utility::ForceCopyFile(output_dir + "/" + file.first, outpath);
+    if (!file.second) {
+        return QString();
+    }
+    return Utility::ReadUnicodeTextFile(outpath);
+}
+
 
 PluginRunner::PluginRunner(TabManager *tabMgr, QWidget *parent)
     : QDialog(parent),
@@ -43,7 +102,8 @@ PluginRunner::PluginRunner(TabManager *tabMgr, QWidget *parent)
       m_algorithm(""),
       m_result(""),
       m_xhtml_net_change(0),
-      m_ready(false)
+      m_ready(false),
+      m_TraceStart(0)
 
 {
     // get book manipulation objects
@@ -80,6 +140,10 @@ PluginRunner::PluginRunner(TabManager *tabMgr, QWidget *parent)
 
 PluginRunner::~PluginRunner()
 {
+    // A run the dialog no longer waits for must not go on in the host
+    if (m_host && m_host->IsRunning()) {
+        m_host->Kill();
+    }
 }
 
 QStringList PluginRunner::SupportedEngines()
@@ -367,7 +431,26 @@ void PluginRunner::startPlugin()
     }
 #endif
 
-    m_process.start(executable, args);
+    // The plugin host runs the launcher in an interpreter kept running
+    // between plugin runs, in the same environment the launcher would get
+    QString host_script = QFileInfo(m_launcherPath).absolutePath() + "/pluginhost.py";
+    if (settings.usePluginHost() && QFileInfo(host_script).exists()) {
+        int launcher_pos = args.indexOf(QDir::toNativeSeparators(m_launcherPath));
+        m_host = PluginHost::Instance(executable, args.mid(0, launcher_pos),
+                                      QDir::toNativeSeparators(host_script),
+                                      m_process.processEnvironment(),
+                                      m_process.workingDirectory());
+        connect(m_host, SIGNAL(StandardOutput(const QByteArray &)), this, SLOT(hostOutput(const QByteArray &)), Qt::UniqueConnection);
+        connect(m_host, SIGNAL(StandardError(const QByteArray &)), this, SLOT(hostError(const QByteArray &)), Qt::UniqueConnection);
+        connect(m_host, SIGNAL(RunFinished()), this, SLOT(hostRunFinished()), Qt::UniqueConnection);
+        connect(m_host, SIGNAL(HostExited(int, QProcess::ExitStatus)), this, SLOT(pluginFinished(int, QProcess::ExitStatus)), Qt::UniqueConnection);
+        connect(m_host, SIGNAL(HostError(QProcess::ProcessError)), this, SLOT(processError(QProcess::ProcessError)), Qt::UniqueConnection);
+        m_TraceStart = Trace::Now();
+        m_host->Run(args.mid(launcher_pos + 1));
+    } else {
+        m_TraceStart = Trace::Now();
+        m_process.start(executable, args);
+    }
     ui.statusLbl->setText(tr("Status: running"));
 
     // this starts the infinite progress bar
@@ -382,8 +465,25 @@ void PluginRunner::processOutput()
     m_pluginOutput = m_pluginOutput + newbytedata;
 }
 
+void PluginRunner::hostOutput(const QByteArray &data)
+{
+    ui.textEdit->insertPlainText(data);
+    m_pluginOutput = m_pluginOutput + data;
+}
+
+void PluginRunner::hostError(const QByteArray &data)
+{
+    ui.textEdit->append(data);
+}
+
+void PluginRunner::hostRunFinished()
+{
+    pluginFinished(0, QProcess::NormalExit);
+}
+
 void PluginRunner::pluginFinished(int exitcode, QProcess::ExitStatus exitstatus)
 {
+    Trace::Complete("Plugin run", m_TraceStart);
     if (exitstatus == QProcess::CrashExit) {
         ui.textEdit->append(tr("Launcher process crashed"));
     }
@@ -426,6 +526,10 @@ void PluginRunner::pluginFinished(int exitcode, QProcess::ExitStatus exitstatus)
     // everthing looks good so now make any necessary changes
     bool book_modified = false;
 
+    if (!m_filesToAdd.isEmpty() || !m_filesToDelete.isEmpty() || !m_filesToModify.isEmpty()) {
+        m_mainWindow->CreateCheckpoint(tr("Plugin %1").arg(m_pluginName));
+    }
+
     m_book->GetFolderKeeper()->SuspendWatchingResources();
 
     if (!m_filesToAdd.isEmpty()) {
@@ -525,6 +629,9 @@ void PluginRunner::cancelPlugin()
     if (m_process.state() == QProcess::Running) {
         m_process.kill();
     }
+    if (m_host && m_host->IsRunning()) {
+        m_host->Kill();
+    }
     ui.okButton->setEnabled(true);
 
     ui.progressBar->setRange(0,100);
@@ -582,7 +689,7 @@ bool PluginRunner::processResultXML()
                     if (mime == "application/xhtml+xml") {
                         m_xhtml_net_change++;
                     }
-                } else {
+                } else if (!SameFileContents(m_outputDir + "/" + href, m_bookRoot + "/" + href)) {
                     m_filesToModify.append(fileinfo);
                 }
             } else if (name == "validationresult") {
@@ -678,33 +785,19 @@ bool PluginRunner::checkIsWellFormed()
             }
         }
     }
+    ui.statusLbl->setText(tr("Status: checking files"));
     if (!xhtmlFilesToCheck.isEmpty()) {
-        foreach (QString href, xhtmlFilesToCheck) {
-            QString filePath = m_outputDir + "/" + href;
-            ui.statusLbl->setText(tr("Status: checking") + " " + href);
-            QString data = Utility::ReadUnicodeTextFile(filePath);
-            XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(data);
-            if (error.line != -1) {
-                errors.append(tr("Incorrect XHTML:") + " " + href + " " + tr("Line/Col") + " " + QString::number(error.line) +
-                              "," + QString::number(error.column) + " " + error.message);
+        QStringList file_errors = QtConcurrent::blockingMapped<QStringList>(xhtmlFilesToCheck,
+                                  std::bind(CheckOneXhtmlFile, std::placeholders::_1, m_outputDir));
+        foreach (QString error, file_errors) {
+            if (!error.isEmpty()) {
+                errors.append(error);
                 well_formed = false;
             }
         }
     }
     if (!xmlFilesToCheck.isEmpty()) {
-        foreach (QString href, xmlFilesToCheck) {
-            // can't really validate without a full dtd so
-            // auto repair any xml file changes to be safe
-            QString filePath = m_outputDir + "/" + href;
-            ui.statusLbl->setText(tr("Status: checking") + " " + href);
-            QString mtype = "application/oebs-page-map+xml";
-            if (href.endsWith(".opf")) mtype = "application/oebps-package+xml";
-            if (href.endsWith(".ncx")) mtype = "application/x-dtbncx+xml";
-            if (href.endsWith(".smil")) mtype = "application/oebps-package+xml";
-            QString data = Utility::ReadUnicodeTextFile(filePath);
-            QString newdata = CleanSource::ProcessXML(data, mtype);
-            Utility::WriteUnicodeTextFile(newdata, filePath);
-        }
+        QtConcurrent::blockingMap(xmlFilesToCheck, std::bind(RepairOneXmlFile, std::placeholders::_1, m_outputDir));
     }
     if ((!well_formed) && (!errors.isEmpty())) {
         // Throw Up a Dialog to See if they want to proceed
@@ -732,6 +825,8 @@ bool PluginRunner::deleteFiles(const QStringList &files)
     QList <Resource *> tabResources=m_tabManager->GetTabResources();
     bool changes_made = false;
     ui.statusLbl->setText(tr("Status: cleaning up - deleting files"));
+    // Collect the manifest and spine removals into a single OPF update
+    OPFResource::Transaction opf_transaction(m_book->GetOPF());
     foreach (QString fileinfo, files) {
         QStringList fdata = fileinfo.split(SEP);
         QString href = fdata[ hrefField ];
@@ -775,6 +870,7 @@ bool PluginRunner::deleteFiles(const QStringList &files)
            }
         }
     }
+    opf_transaction.Commit();
     if (changes_made) {
         m_bookBrowser->ResourcesDeleted();
     }
@@ -785,6 +881,7 @@ bool PluginRunner::deleteFiles(const QStringList &files)
 bool PluginRunner::addFiles(const QStringList &files)
 {
     ui.statusLbl->setText("Status: adding files");
+    QList<std::pair<QString, QString>> new_files;
     foreach (QString fileinfo, files) {
         QStringList fdata = fileinfo.split(SEP);
         QString href = fdata[ hrefField ];
@@ -830,20 +927,27 @@ bool PluginRunner::addFiles(const QStringList &files)
             continue;
         }
 
-        // No need to copy to ebook root as AddContentToFolder does that for us
-        QString inpath = m_outputDir + "/" + href;
-        QFileInfo fi(inpath);
-        ui.statusLbl->setText(tr("Status: adding") + " " + fi.fileName());
+        // No need to copy to ebook root as AddContentFilesToFolder does that for us
+        new_files.append(std::make_pair(m_outputDir + "/" + href, QString()));
+    }
+
+    // Add them in one batch: names are resolved once and the files
+    // are copied in parallel
+    QList<Resource *> resources = m_book->GetFolderKeeper()->AddContentFilesToFolder(new_files, false);
+
+    for (int i = 0; i < resources.count(); ++i) {
+        Resource *resource = resources.at(i);
+        QString inpath = new_files.at(i).first;
 
-        Resource *resource = m_book->GetFolderKeeper()->AddContentFileToFolder(inpath,false);
+        if (!resource) {
+            continue;
+        }
 
         // AudioResource, VideoResource, FontResource, ImageResource do not appear to be cached
 
         // For new Editable Resources must do the equivalent of the InitialLoad
         // Order is important as some resource types inherit from other resource types
 
-        // NOTE! AddContentFileToFolder returns a resource reference and not a pointer
-
         if (resource->Type() == Resource::FontResourceType && !m_algorithm.isEmpty()) {
             FontResource *font_resource = qobject_cast<FontResource *>(resource);
             font_resource->SetObfuscationAlgorithm(m_algorithm);
@@ -895,58 +999,61 @@ bool PluginRunner::modifyFiles(const QStringList &files)
         newfiles.append(modifyncx);
     }
 
+    // Copy the files and read the new text of text resources in parallel,
+    // then hand the texts to their resources here on the GUI thread
+    QList<std::pair<QString, bool>> copies;
     foreach (QString fileinfo, newfiles) {
-        QStringList fdata = fileinfo.split(SEP);
-        QString href = fdata[ hrefField ];
-        QString id   = fdata[ idField   ];
-        QString mime = fdata[ mimeField ];
-        QString inpath = m_outputDir + "/" + href;
-        QString outpath = m_bookRoot + "/" + href;
-        QFileInfo fi(outpath);
-        ui.statusLbl->setText(tr("Status: modifying") + " " + fi.fileName());
-        Utility::ForceCopyFile(inpath, outpath);
+        QString href = fileinfo.split(SEP)[ hrefField ];
+        copies.append(std::make_pair(href, qobject_cast<TextResource *>(m_hrefToRes.value(href)) != NULL));
+    }
+    QStringList texts = QtConcurrent::blockingMapped<QStringList>(copies,
+                        std::bind(CopyAndLoadOneFile, std::placeholders::_1, m_outputDir, m_bookRoot));
+
+    for (int i = 0; i < copies.count(); ++i) {
+        QString href = copies.at(i).first;
+        const QString &text = texts.at(i);
         Resource *resource = m_hrefToRes.value(href);
         if (resource) {
 
             // AudioResource, VideoResource, FontResource, ImageResource do not appear to be editable
 
-            // For Editable Resources must relaod them from modified file
+            // For Editable Resources must reload them from modified file
             // Order below is important as some resouirce types inherit from other resource types
 
             if (resource->Type() == Resource::HTMLResourceType) {
 
                 HTMLResource *html_resource = qobject_cast<HTMLResource *> (resource);
-                html_resource->SetText(Utility::ReadUnicodeTextFile(inpath));
+                html_resource->SetText(text);
 
             } else if (resource->Type() == Resource::CSSResourceType) {
 
                 CSSResource *css_resource = qobject_cast<CSSResource *> (resource);
-                css_resource->SetText(Utility::ReadUnicodeTextFile(inpath));
+                css_resource->SetText(text);
 
             } else if (resource->Type() == Resource::SVGResourceType) {
 
                 SVGResource *svg_resource = qobject_cast<SVGResource *> (resource);
-                svg_resource->SetText(Utility::ReadUnicodeTextFile(inpath));
+                svg_resource->SetText(text);
 
             } else if (resource->Type() == Resource::MiscTextResourceType) {
 
                 MiscTextResource *misctext_resource = qobject_cast<MiscTextResource *> (resource);
-                misctext_resource->SetText(Utility::ReadUnicodeTextFile(inpath));
+                misctext_resource->SetText(text);
 
             } else if (resource->Type() == Resource::OPFResourceType) {
 
                 OPFResource *opf_resource = qobject_cast<OPFResource *> (resource);
-                opf_resource->SetText(Utility::ReadUnicodeTextFile(outpath));
+                opf_resource->SetText(text);
 
             } else if (resource->Type() == Resource::NCXResourceType) {
 
                 NCXResource *ncx_resource = qobject_cast<NCXResource *> (resource);
-                ncx_resource->SetText(Utility::ReadUnicodeTextFile(outpath));
+                ncx_resource->SetText(text);
 
             } else if (resource->Type() == Resource::XMLResourceType) {
 
                 XMLResource *xml_resource = qobject_cast<XMLResource *> (resource);
-                xml_resource->SetText(Utility::ReadUnicodeTextFile(inpath));
+                xml_resource->SetText(text);
             }
         }
     }
@@ -27,6 +27,8 @@
 #include <QDialog>
 #include <QProgressBar>
 #include <QProcess>
+#include <QPointer>
+#include "Misc/PluginHost.h"
 #include "Misc/TempFolder.h"
 #include "Misc/ValidationResult.h"
 
@@ -81,6 +83,9 @@ private slots:
     void processError();
     void processError(QProcess::ProcessError error);
     void processOutput();
+    void hostOutput(const QByteArray &data);
+    void hostError(const QByteArray &data);
+    void hostRunFinished();
     void pluginFinished(int exitcode, QProcess::ExitStatus exitstatus );
     void showConsole();
 
@@ -98,6 +103,9 @@ private:
 
     QProcess m_process;
 
+    // The plugin host of the current run, if one is used
+    QPointer<PluginHost> m_host;
+
     MainWindow *m_mainWindow;
     TabManager *m_tabManager;
     QSharedPointer<Book> m_book;
@@ -131,6 +139,9 @@ private:
 
     bool m_ready;
 
+    // When the run started, on the trace clock
+    qint64 m_TraceStart;
+
     static const QString SEP;
     static const QString OPFFILEINFO;
     static const QString NCXFILEINFO;
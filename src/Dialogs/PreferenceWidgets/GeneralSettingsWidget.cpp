@@ -27,6 +27,8 @@
 #include <QDir>
 #include <QFileDialog>
 #include <QFileInfo>
+#include <QApplication>
+#include "Misc/TempFolder.h"
 #include "Misc/Utility.h"
 
 #include "sigil_constants.h"
@@ -91,6 +93,8 @@ PreferencesWidget::ResultAction GeneralSettingsWidget::saveSettings()
     settings.setRemoteOn(new_remote_on_level);
     settings.setClipboardHistoryLimit(int(ui.clipLimitSpin->value()));
     settings.setTempFolderHome(new_temp_folder_home);
+    settings.setRamWorkspace(ui.ramWorkspaceCheck->isChecked());
+    settings.setRamWorkspaceLimit(ui.ramLimitSpin->value());
 
     if (!m_refreshClipboardHistoryLimit) {
         return PreferencesWidget::ResultAction_None;
@@ -120,6 +124,8 @@ void GeneralSettingsWidget::readSettings()
     ui.clipLimitSpin->setValue(int(settings.clipboardHistoryLimit()));
     QString temp_folder_home = settings.tempFolderHome();
     ui.lineEdit->setText(temp_folder_home);
+    ui.ramWorkspaceCheck->setChecked(settings.ramWorkspace());
+    ui.ramLimitSpin->setValue(settings.ramWorkspaceLimit());
 }
 
 void GeneralSettingsWidget::autoTempFolder()
@@ -151,6 +157,28 @@ void GeneralSettingsWidget::tempFolderPathChanged()
     }
 }
 
+void GeneralSettingsWidget::measureWorkspace()
+{
+    QString temp_path = ui.lineEdit->text();
+    if (temp_path.isEmpty() || temp_path == "<SIGIL_DEFAULT_TEMP_HOME>") {
+        temp_path = QDir::tempPath();
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QStringList results;
+    double speed = TempFolder::MeasureWriteThroughput(temp_path);
+    results << (speed < 0 ? tr("Temporary folder: not writable") :
+                            tr("Temporary folder: %1 MB/s").arg(speed, 0, 'f', 0));
+    QString ram_path = TempFolder::GetPathToRamWorkspace();
+    if (!ram_path.isEmpty()) {
+        speed = TempFolder::MeasureWriteThroughput(ram_path);
+        results << (speed < 0 ? tr("RAM folder: not writable") :
+                                tr("RAM folder: %1 MB/s").arg(speed, 0, 'f', 0));
+    }
+    QApplication::restoreOverrideCursor();
+    ui.throughputLabel->setText(results.join("   "));
+}
+
 void GeneralSettingsWidget::clipLimitValueChanged() {
     m_refreshClipboardHistoryLimit = true;
 }
@@ -159,6 +187,10 @@ void GeneralSettingsWidget::ExtendUI() {
     // Make sure no one can enter anything other than 0 - CLIPBOARD_HISTORY_MAX
     ui.clipLimitSpin->setMinimum(0);
     ui.clipLimitSpin->setMaximum(CLIPBOARD_HISTORY_MAX);
+    // Only systems with a tmpfs Sigil can write to have a RAM backed folder
+    bool has_ram_workspace = !TempFolder::GetPathToRamWorkspace().isEmpty();
+    ui.ramWorkspaceCheck->setEnabled(has_ram_workspace);
+    ui.ramLimitSpin->setEnabled(has_ram_workspace);
 }
 
 void GeneralSettingsWidget::connectSignalsToSlots()
@@ -166,5 +198,6 @@ void GeneralSettingsWidget::connectSignalsToSlots()
     connect(ui.autoButton, SIGNAL(clicked()), this, SLOT(autoTempFolder()));
     connect(ui.browseButton, SIGNAL(clicked()), this, SLOT(setTempFolder()));
     connect(ui.lineEdit, SIGNAL(editingFinished()), this, SLOT(tempFolderPathChanged()));
+    connect(ui.measureButton, SIGNAL(clicked()), this, SLOT(measureWorkspace()));
     connect(ui.clipLimitSpin, SIGNAL(valueChanged(int)), this, SLOT(clipLimitValueChanged()));
 }
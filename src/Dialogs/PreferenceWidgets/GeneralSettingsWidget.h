@@ -43,6 +43,7 @@ private slots:
     void autoTempFolder();
     void setTempFolder();
     void tempFolderPathChanged();
+    void measureWorkspace();
     void clipLimitValueChanged();
 
 private:
@@ -21,7 +21,8 @@ PluginWidget::PluginWidget()
     :
     m_isDirty(false),
     m_LastFolderOpen(QString()),
-    m_useBundledInterp(false)
+    m_useBundledInterp(false),
+    m_usePluginHost(false)
 {
     ui.setupUi(this);
     readSettings();
@@ -67,6 +68,7 @@ PluginWidget::ResultAction PluginWidget::saveSettings()
     } else {
         settings.setUseBundledInterp(m_useBundledInterp);
     }
+    settings.setUsePluginHost(m_usePluginHost);
 
     m_isDirty = false;
     return PreferencesWidget::ResultAction_None;
@@ -97,6 +99,10 @@ void PluginWidget::readSettings()
     // Should the bundled Python interpreter be used?
     m_useBundledInterp = settings.useBundledInterp();
 
+    // Should plugins be run by a Python interpreter kept running between runs?
+    m_usePluginHost = settings.usePluginHost();
+    ui.chkUsePluginHost->setChecked(m_usePluginHost);
+
     // Load the available plugin information
     PluginDB *pdb = PluginDB::instance();
     QHash<QString, Plugin *> plugins;
@@ -405,6 +411,12 @@ void PluginWidget::useBundledPy3Changed(int)
     m_isDirty = true;
 }
 
+void PluginWidget::usePluginHostChanged(int)
+{
+    m_usePluginHost = ui.chkUsePluginHost->isChecked();
+    m_isDirty = true;
+}
+
 void PluginWidget::connectSignalsToSlots()
 {
     connect(ui.Py3Auto, SIGNAL(clicked()), this, SLOT(AutoFindPy3()));
@@ -415,6 +427,7 @@ void PluginWidget::connectSignalsToSlots()
     connect(ui.pluginTable, SIGNAL(cellDoubleClicked(int,int)), this, SLOT(pluginSelected(int,int)));
     connect(ui.editPathPy3, SIGNAL(editingFinished()), this, SLOT(enginePy3PathChanged()));
     connect(ui.chkUseBundled, SIGNAL(stateChanged(int)), this, SLOT(useBundledPy3Changed(int)));
+    connect(ui.chkUsePluginHost, SIGNAL(stateChanged(int)), this, SLOT(usePluginHostChanged(int)));
     connect(ui.comboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(pluginMapChanged(int)));
     connect(ui.comboBox_2, SIGNAL(currentIndexChanged(int)), this, SLOT(pluginMapChanged(int)));
     connect(ui.comboBox_3, SIGNAL(currentIndexChanged(int)), this, SLOT(pluginMapChanged(int)));
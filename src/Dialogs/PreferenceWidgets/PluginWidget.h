@@ -25,6 +25,7 @@ private slots:
     void enginePy3PathChanged();
     void enable_disable_controls();
     void useBundledPy3Changed(int);
+    void usePluginHostChanged(int);
     void removePlugin();
     void removeAllPlugins();
     void pluginSelected(int row, int col);
@@ -48,6 +49,7 @@ private:
     bool m_isDirty;
     QString m_LastFolderOpen;
     bool m_useBundledInterp;
+    bool m_usePluginHost;
 };
 
 #endif // PLUGINWIDGET_H
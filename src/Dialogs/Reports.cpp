@@ -21,12 +21,18 @@
 **
 *************************************************************************/
 
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTimer>
+#include <QtWidgets/QApplication>
 #include <QtWidgets/QScrollArea>
-#include <QtWidgets/QProgressDialog>
 
 #include "Dialogs/Reports.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/CSSInfo.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "ResourceObjects/TextResource.h"
 #include "ReportsWidgets/AllFilesWidget.h"
 #include "ReportsWidgets/HTMLFilesWidget.h"
 #include "ReportsWidgets/LinksWidget.h"
@@ -110,46 +116,68 @@ Reports::~Reports()
 
 void Reports::CreateReports(QSharedPointer<Book> book)
 {
+    if (book != m_Book) {
+        m_ReportSignatures.clear();
+    }
+
+    m_Book = book;
+    m_BookSignature = BookSignature(book);
+    // Only the report shown is made, once the dialog is up
+    QTimer::singleShot(0, this, SLOT(CreateCurrentReport()));
+}
+
+void Reports::CreateCurrentReport()
+{
+    ReportsWidget *widget = qobject_cast<ReportsWidget *>(ui.pWidget->currentWidget());
+
+    if (!widget || m_Book.isNull()) {
+        return;
+    }
+
+    // Still right for the book as it is
+    if (m_ReportSignatures.value(widget) == m_BookSignature) {
+        return;
+    }
+
     QApplication::setOverrideCursor(Qt::WaitCursor);
-    // Display progress dialog
-    QProgressDialog progress(QObject::tr("Creating reports..."), 0, 0, ui.availableWidgets->count(), this);
-    progress.setMinimumDuration(0);
-    int progress_value = 0;
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    // Populate all of our report widgets
-    m_AllFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_HTMLFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_LinksWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_ImageFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_CSSFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_ClassesInHTMLFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_StylesInCSSFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
-    m_CharactersInHTMLFilesWidget->CreateReport(book);
-    progress.setValue(progress_value++);
-    qApp->processEvents();
+    widget->CreateReport(m_Book);
+    m_ReportSignatures[widget] = m_BookSignature;
     QApplication::restoreOverrideCursor();
 }
 
+void Reports::RefreshAll()
+{
+    // Everything is made again, even if the book looks unchanged
+    m_ReportSignatures.clear();
+    emit Refresh();
+}
+
+QByteArray Reports::BookSignature(QSharedPointer<Book> book)
+{
+    // Any change to a file, its name or the set of files changes the signature
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    foreach(Resource *resource, book->GetFolderKeeper()->GetResourceList()) {
+        hash.addData(resource->GetIdentifier().toUtf8());
+        hash.addData(resource->GetRelativePath().toUtf8());
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        if (text_resource) {
+            hash.addData(QByteArray::number(text_resource->GetTextRevision()));
+        } else {
+            QFileInfo info(resource->GetFullPath());
+            hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+            hash.addData(QByteArray::number(info.size()));
+        }
+    }
+    return hash.result();
+}
+
 void Reports::selectPWidget(QListWidgetItem *current, QListWidgetItem *previous)
 {
     Q_UNUSED(previous)
     int index = ui.availableWidgets->row(current);
     ui.pWidget->setCurrentIndex(index);
+    QTimer::singleShot(0, this, SLOT(CreateCurrentReport()));
 }
 
 void Reports::saveSettings()
@@ -205,5 +233,5 @@ void Reports::connectSignalsSlots()
 
     connect(ui.availableWidgets, SIGNAL(currentItemChanged(QListWidgetItem *, QListWidgetItem *)), this, SLOT(selectPWidget(QListWidgetItem *, QListWidgetItem *)));
     connect(this, SIGNAL(finished(int)), this, SLOT(saveSettings()));
-    connect(ui.Refresh, SIGNAL(clicked()), this, SIGNAL(Refresh()));
+    connect(ui.Refresh, SIGNAL(clicked()), this, SLOT(RefreshAll()));
 }
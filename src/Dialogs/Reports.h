@@ -24,6 +24,8 @@
 #ifndef REPORTS_H
 #define REPORTS_H
 
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
 #include <QtWidgets/QDialog>
 
 #include "ResourceObjects/Resource.h"
@@ -46,6 +48,10 @@ public:
     Reports(QWidget *parent = 0);
     ~Reports();
 
+    /**
+     * Sets the book to report on. Reports are made when first shown,
+     * and are only made again once a file in the book has changed.
+     */
     void CreateReports(QSharedPointer<Book> book);
 
 signals:
@@ -68,7 +74,20 @@ private slots:
      */
     void saveSettings();
 
+    /**
+     * Makes the report shown if it is missing or out of date.
+     */
+    void CreateCurrentReport();
+
+    void RefreshAll();
+
 private:
+    /**
+     * @return A hash of every file's name and text revision, or
+     *         modification time for binary files, in the book.
+     */
+    static QByteArray BookSignature(QSharedPointer<Book> book);
+
     void readSettings();
 
     /**
@@ -93,6 +112,15 @@ private:
     ReportsWidget *m_StylesInCSSFilesWidget;
     ReportsWidget *m_CharactersInHTMLFilesWidget;
 
+    QSharedPointer<Book> m_Book;
+
+    QByteArray m_BookSignature;
+
+    /**
+     * The book signature each report was last made for.
+     */
+    QHash<ReportsWidget *, QByteArray> m_ReportSignatures;
+
     Ui::Reports ui;
 };
 
@@ -21,6 +21,7 @@
 **
 *************************************************************************/
 
+#include <QtConcurrent/QtConcurrent>
 #include <QtCore/QFile>
 #include <QtCore/QHashIterator>
 #include <QtWidgets/QFileDialog>
@@ -80,6 +81,7 @@ void CharactersInHTMLFilesWidget::SetupTable()
     header.append(tr("Hexadecimal"));
     header.append(tr("Entity Name"));
     header.append(tr("Entity Description"));
+    header.append(tr("Count"));
     m_ItemModel->setHorizontalHeaderLabels(header);
     ui.fileTree->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui.fileTree->setModel(m_ItemModel);
@@ -92,38 +94,49 @@ void CharactersInHTMLFilesWidget::SetupTable()
 void CharactersInHTMLFilesWidget::AddTableData()
 {
     const QList<HTMLResource *> html_resources = m_Book->GetHTMLResources();
-    QList <QChar> characters = GetDisplayedCharacters(html_resources);
+    QMap<uint, quint32> characters = GetDisplayedCharacters(html_resources);
     QString all_characters;
-    foreach (QChar c, characters) {
-        all_characters.append(c);
+    QMapIterator<uint, quint32> it(characters);
+    while (it.hasNext()) {
+        it.next();
+        uint code = it.key();
+        all_characters.append(QString::fromUcs4(&code, 1));
     }
     ui.Characters->setText(all_characters);
 
-    foreach (QChar c, characters) {
+    it.toFront();
+    while (it.hasNext()) {
+        it.next();
+        uint code = it.key();
         // Write the table entries
         QList<QStandardItem *> rowItems;
         // Character
         QStandardItem *item = new QStandardItem();
-        item->setText(QString(c));
+        item->setText(QString::fromUcs4(&code, 1));
         rowItems << item;
         // Decimal number
-        item = new QStandardItem();
-        ushort char_number = c.unicode();
-        item->setText(QString::number(char_number));
+        item = new NumericItem();
+        item->setText(QString::number(code));
         rowItems << item;
         // Hex number
         item = new QStandardItem();
         QString hexadecimal;
-        hexadecimal.setNum(char_number,16);
+        hexadecimal.setNum(code, 16);
         item->setText(hexadecimal.toUpper());
         rowItems << item;
+        // Entities only exist for the Basic Multilingual Plane
+        bool has_entity = code <= 0xFFFF;
         // Name
         item = new QStandardItem();
-        item->setText(XMLEntities::instance()->GetEntityName(char_number));
+        item->setText(has_entity ? XMLEntities::instance()->GetEntityName(code) : QString());
         rowItems << item;
         // Description
         item = new QStandardItem();
-        item->setText(XMLEntities::instance()->GetEntityDescription(char_number));
+        item->setText(has_entity ? XMLEntities::instance()->GetEntityDescription(code) : QString());
+        rowItems << item;
+        // Occurrences
+        item = new NumericItem();
+        item->setText(QString::number(it.value()));
         rowItems << item;
 
         for (int i = 0; i < rowItems.count(); i++) {
@@ -134,28 +147,76 @@ void CharactersInHTMLFilesWidget::AddTableData()
     }
 }
 
-QList <QChar> CharactersInHTMLFilesWidget::GetDisplayedCharacters(QList<HTMLResource *> resources)
+CharactersInHTMLFilesWidget::CharacterCounts CharactersInHTMLFilesWidget::CountCharactersInOneFile(HTMLResource *resource)
 {
-    QString all_characters;
-    foreach (HTMLResource *resource, resources) {
-        QString replaced_html = resource->GetText();
-        replaced_html = replaced_html.replace("<html>", "<html xmlns=\"http://www.w3.org/1999/xhtml\">");
-	QString version = "any_version";
-	GumboInterface gi = GumboInterface(replaced_html, version);
-	QString text = gi.get_body_text();
-        all_characters.append(text);
+    QString replaced_html = resource->GetText();
+    replaced_html = replaced_html.replace("<html>", "<html xmlns=\"http://www.w3.org/1999/xhtml\">");
+    QString version = "any_version";
+    GumboInterface gi = GumboInterface(replaced_html, version);
+    QString text = gi.get_body_text();
+
+    CharacterCounts counts;
+    counts.bmp = QVector<quint32>(0x10000, 0);
+    quint32 *table = counts.bmp.data();
+    const ushort *code = text.utf16();
+    const int length = text.length();
+
+    for (int i = 0; i < length; i++) {
+        ushort unit = code[i];
+        // A surrogate pair is one character; a lone surrogate is
+        // counted as it is
+        if (QChar::isHighSurrogate(unit) && i + 1 < length && QChar::isLowSurrogate(code[i + 1])) {
+            counts.supplementary[QChar::surrogateToUcs4(unit, code[i + 1])]++;
+            i++;
+        } else {
+            table[unit]++;
+        }
     }
 
-    QMap <QChar, QChar> character_map;
-    foreach (const QChar c, all_characters) {
-        if (c != '\n') {
-            character_map.insert(c, c);
+    return counts;
+}
+
+void CharactersInHTMLFilesWidget::AddCharacterCounts(CharacterCounts &total, const CharacterCounts &counts)
+{
+    if (total.bmp.isEmpty()) {
+        total.bmp = QVector<quint32>(0x10000, 0);
+    }
+
+    quint32 *sum = total.bmp.data();
+    const quint32 *table = counts.bmp.constData();
+    for (int i = 0; i < 0x10000; i++) {
+        sum[i] += table[i];
+    }
+
+    QHashIterator<uint, quint32> it(counts.supplementary);
+    while (it.hasNext()) {
+        it.next();
+        total.supplementary[it.key()] += it.value();
+    }
+}
+
+QMap<uint, quint32> CharactersInHTMLFilesWidget::GetDisplayedCharacters(QList<HTMLResource *> resources)
+{
+    // Each file is parsed and counted on the thread pool into its own
+    // table, and the tables are summed as they come in
+    CharacterCounts total = QtConcurrent::blockingMappedReduced(resources,
+                            CountCharactersInOneFile,
+                            AddCharacterCounts,
+                            QtConcurrent::UnorderedReduce);
+
+    QMap<uint, quint32> characters;
+    for (int i = 0; i < total.bmp.count(); i++) {
+        if (total.bmp.at(i) > 0 && i != '\n') {
+            characters.insert(i, total.bmp.at(i));
         }
     }
-    QList <QChar> character_list;
-    character_list = character_map.values();
+    QHashIterator<uint, quint32> it(total.supplementary);
+    while (it.hasNext()) {
+        it.next();
+        characters.insert(it.key(), it.value());
+    }
 
-    return character_list;
+    return characters;
 }
 
 
@@ -26,6 +26,8 @@
 #define CHARACTERSINHTMLFILESWIDGET_H
 
 #include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QVector>
 #include <QtWidgets/QDialog>
 #include <QtGui/QStandardItemModel>
 #include <QtCore/QSharedPointer>
@@ -69,7 +71,25 @@ private:
     void SetupTable();
     void AddTableData();
 
-    QList <QChar> GetDisplayedCharacters(QList<HTMLResource *> resources);
+    /**
+     * How often each character occurs. Characters of the Basic
+     * Multilingual Plane are counted in a table indexed by UTF-16
+     * code unit, the rare ones outside it in a hash.
+     */
+    struct CharacterCounts {
+        QVector<quint32> bmp;
+        QHash<uint, quint32> supplementary;
+    };
+
+    static CharacterCounts CountCharactersInOneFile(HTMLResource *resource);
+
+    static void AddCharacterCounts(CharacterCounts &total, const CharacterCounts &counts);
+
+    /**
+     * @return Each character shown in the body text of the resources,
+     *         by code point, with the number of times it occurs.
+     */
+    QMap<uint, quint32> GetDisplayedCharacters(QList<HTMLResource *> resources);
 
     QSharedPointer<Book> m_Book;
 
@@ -24,7 +24,6 @@
 #include <QtCore/QFile>
 #include <QtCore/QHashIterator>
 #include <QtWidgets/QFileDialog>
-#include <QtGui/QFont>
 #include <QtWidgets/QPushButton>
 #include <QtWidgets/QMessageBox>
 
@@ -33,7 +32,6 @@
 #include "BookManipulation/FolderKeeper.h"
 #include "Dialogs/ReportsWidgets/ClassesInHTMLFilesWidget.h"
 #include "Misc/CSSInfo.h"
-#include "Misc/NumericItem.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -44,7 +42,7 @@ static const QString DEFAULT_REPORT_FILE = "StyleClassesInHTMLFilesReport.csv";
 
 ClassesInHTMLFilesWidget::ClassesInHTMLFilesWidget()
     :
-    m_ItemModel(new QStandardItemModel),
+    m_ItemModel(new ReportTableModel),
     m_LastDirSaved(QString()),
     m_LastFileSaved(QString())
 {
@@ -78,14 +76,14 @@ void ClassesInHTMLFilesWidget::CreateReport(QSharedPointer<Book> book)
 
 void ClassesInHTMLFilesWidget::SetupTable()
 {
-    m_ItemModel->clear();
     QStringList header;
     header.append(tr("HTML File"));
     header.append(tr("Element"));
     header.append(tr("Class"));
     header.append(tr("Matched Selector"));
     header.append(tr("Found In"));
-    m_ItemModel->setHorizontalHeaderLabels(header);
+    m_ItemModel->BeginReport(header);
+    m_ItemModel->EndReport();
     ui.fileTree->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui.fileTree->setModel(m_ItemModel);
     ui.fileTree->header()->setSortIndicatorShown(true);
@@ -98,6 +96,7 @@ void ClassesInHTMLFilesWidget::SetupTable()
 
 void ClassesInHTMLFilesWidget::AddTableData(const QList<BookReports::StyleData *> html_classes_usage)
 {
+    m_ItemModel->BeginReport(m_ItemModel->Header());
     foreach(BookReports::StyleData *class_usage, html_classes_usage) {
         // Skip custom Sigil classes that are only used as markers not styles
         if (class_usage->html_class_name == SIGIL_NOT_IN_TOC_CLASS ||
@@ -107,65 +106,33 @@ void ClassesInHTMLFilesWidget::AddTableData(const QList<BookReports::StyleData *
         }
 
         // Write the table entries
-        QList<QStandardItem *> rowItems;
+        QStringList cells;
         // File name
-        QStandardItem *filename_item = new QStandardItem();
-        filename_item->setText(class_usage->html_filename);
-        rowItems << filename_item;
+        cells << class_usage->html_filename;
         // Element name
-        QStandardItem *element_name_item = new QStandardItem();
-        element_name_item->setText(class_usage->html_element_name);
-        rowItems << element_name_item;
+        cells << class_usage->html_element_name;
         // Class name
-        QStandardItem *class_name_item = new QStandardItem();
-        class_name_item->setText(class_usage->html_class_name);
-        rowItems << class_name_item;
+        cells << class_usage->html_class_name;
         // Selector
-        QStandardItem *selector_text_item = new QStandardItem();
-        selector_text_item->setText(class_usage->css_selector_text);
-        rowItems << selector_text_item;
+        cells << class_usage->css_selector_text;
         // Found in
-        QStandardItem *found_in_item = new QStandardItem();
         QString css_short_filename = class_usage->css_filename;
         css_short_filename = css_short_filename.right(css_short_filename.length() - css_short_filename.lastIndexOf('/') - 1);
-        found_in_item->setText(css_short_filename);
-        found_in_item->setToolTip(class_usage->css_filename);
-        rowItems << found_in_item;
+        cells << css_short_filename;
 
-        for (int i = 0; i < rowItems.count(); i++) {
-            rowItems[i]->setEditable(false);
-        }
-
-        m_ItemModel->appendRow(rowItems);
+        m_ItemModel->AppendRow(cells);
+        m_ItemModel->SetToolTip(4, class_usage->css_filename);
     }
+    m_ItemModel->EndReport();
 }
 
 void ClassesInHTMLFilesWidget::FilterEditTextChangedSlot(const QString &text)
 {
-    const QString lowercaseText = text.toLower();
-    QStandardItem *root_item = m_ItemModel->invisibleRootItem();
-    QModelIndex parent_index;
-    // Hide rows that don't contain the filter text
-    int first_visible_row = -1;
-
-    for (int row = 0; row < root_item->rowCount(); row++) {
-        if (text.isEmpty() || root_item->child(row, 0)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 1)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 2)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 3)->text().toLower().contains(lowercaseText)) {
-            ui.fileTree->setRowHidden(row, parent_index, false);
-
-            if (first_visible_row == -1) {
-                first_visible_row = row;
-            }
-        } else {
-            ui.fileTree->setRowHidden(row, parent_index, true);
-        }
-    }
+    m_ItemModel->Filter(text, QList<int>() << 0 << 1 << 2 << 3);
 
-    if (!text.isEmpty() && first_visible_row != -1) {
+    if (!text.isEmpty() && m_ItemModel->rowCount() > 0) {
         // Select the first non-hidden row
-        ui.fileTree->setCurrentIndex(root_item->child(first_visible_row, 0)->index());
+        ui.fileTree->setCurrentIndex(m_ItemModel->index(0, 0));
     } else {
         // Clear current and selection, which clears preview image
         ui.fileTree->setCurrentIndex(QModelIndex());
@@ -175,50 +142,13 @@ void ClassesInHTMLFilesWidget::FilterEditTextChangedSlot(const QString &text)
 void ClassesInHTMLFilesWidget::DoubleClick()
 {
     QModelIndex index = ui.fileTree->selectionModel()->selectedRows(0).first();
-    QString filename = m_ItemModel->itemFromIndex(index)->text();
+    QString filename = m_ItemModel->Text(index.row(), 0);
     emit OpenFileRequest(filename, 1);
 }
 
 void ClassesInHTMLFilesWidget::Save()
 {
-    QString report_info;
-    QString row_text;
-
-    // Get headings
-    for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-        QStandardItem *item = m_ItemModel->horizontalHeaderItem(col);
-        QString text = "";
-        if (item) {
-            text = item->text();
-        }
-        if (col == 0) {
-            row_text.append(text);
-        } else {
-            row_text.append("," % text);
-        }
-    }
-
-    report_info.append(row_text % "\n");
-
-    // Get data from table
-    for (int row = 0; row < m_ItemModel->rowCount(); row++) {
-        row_text = "";
-
-        for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-            QStandardItem *item = m_ItemModel->item(row, col);
-            QString text = "";
-            if (item) {
-                text = item->text();
-            }
-            if (col == 0) {
-                row_text.append(text);
-            } else {
-                row_text.append("," % text);
-            }
-        }
-
-        report_info.append(row_text % "\n");
-    }
+    QString report_info = m_ItemModel->CSVText();
 
     // Save the file
     ReadSettings();
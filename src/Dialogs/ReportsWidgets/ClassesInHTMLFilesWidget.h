@@ -27,13 +27,13 @@
 
 #include <QtCore/QHash>
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtCore/QSharedPointer>
 
 #include "ResourceObjects/Resource.h"
 #include "BookManipulation/Book.h"
 #include "BookManipulation/BookReports.h"
 #include "Dialogs/ReportsWidgets/ReportsWidget.h"
+#include "Dialogs/ReportsWidgets/ReportTableModel.h"
 
 #include "ui_ReportsClassesInHTMLFilesWidget.h"
 
@@ -70,7 +70,7 @@ private:
 
     QSharedPointer<Book> m_Book;
 
-    QStandardItemModel *m_ItemModel;
+    ReportTableModel *m_ItemModel;
 
     QString m_LastDirSaved;
     QString m_LastFileSaved;
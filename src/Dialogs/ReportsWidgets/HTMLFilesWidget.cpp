@@ -24,7 +24,6 @@
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtWidgets/QFileDialog>
-#include <QtGui/QFont>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QPushButton>
 
@@ -32,7 +31,6 @@
 #include "BookManipulation/FolderKeeper.h"
 #include "Dialogs/ReportsWidgets/HTMLFilesWidget.h"
 #include "Misc/HTMLSpellCheck.h"
-#include "Misc/NumericItem.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -43,7 +41,7 @@ static const QString DEFAULT_REPORT_FILE = "HTMLFilesReport.csv";
 
 HTMLFilesWidget::HTMLFilesWidget()
     :
-    m_ItemModel(new QStandardItemModel),
+    m_ItemModel(new ReportTableModel),
     m_ContextMenu(new QMenu(this)),
     m_LastDirSaved(QString()),
     m_LastFileSaved(QString())
@@ -69,7 +67,6 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
 {
     // Need to rebuild m_HTMLResources since deletes can happen behind the scenes
     m_HTMLResources = m_Book->GetFolderKeeper()->GetResourceTypeList<HTMLResource>(false);
-    m_ItemModel->clear();
     QStringList header;
     header.append(tr("Name"));
     header.append(tr("File Size (KB)"));
@@ -80,7 +77,10 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
     header.append(tr("Audio"));
     header.append(tr("Stylesheets"));
     header.append(tr("Well Formed"));
-    m_ItemModel->setHorizontalHeaderLabels(header);
+    m_ItemModel->BeginReport(header);
+    for (int i = 1; i < header.count() - 1; i++) {
+        m_ItemModel->SetNumericColumn(i);
+    }
     ui.fileTree->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui.fileTree->setModel(m_ItemModel);
     ui.fileTree->header()->setSortIndicatorShown(true);
@@ -101,135 +101,84 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
         QString filepath = "../" + html_resource->GetRelativePathToOEBPS();
         QString path = html_resource->GetFullPath();
         QString filename = html_resource->Filename();
-        QList<QStandardItem *> rowItems;
+        QStringList cells;
         // Filename
-        QStandardItem *name_item = new QStandardItem();
-        name_item->setText(filename);
-        name_item->setToolTip(filepath);
-        rowItems << name_item;
+        cells << filename;
         // File Size
         double ffsize = QFile(path).size() / 1024.0;
         total_size += ffsize;
-        QString fsize = QString::number(ffsize, 'f', 2);
-        NumericItem *size_item = new NumericItem();
-        size_item->setText(fsize);
-        rowItems << size_item;
+        cells << QString::number(ffsize, 'f', 2);
         // All words
         int all_words = HTMLSpellCheck::CountAllWords(html_resource->GetText());
         total_all_words += all_words;
-        NumericItem *words_item = new NumericItem();
-        words_item->setText(QString::number(all_words));
-        rowItems << words_item;
+        cells << QString::number(all_words);
         // Misspelled words
         int misspelled_words = HTMLSpellCheck::CountMisspelledWords(html_resource->GetText());
         total_misspelled_words += misspelled_words;
-        NumericItem *misspelled_item = new NumericItem();
-        misspelled_item->setText(QString::number(misspelled_words));
-        rowItems << misspelled_item;
+        cells << QString::number(misspelled_words);
         // Images
-        NumericItem *image_item = new NumericItem();
         QStringList image_names = image_names_hash[filename];
         total_images += image_names.count();
-        image_item->setText(QString::number(image_names.count()));
-        if (!image_names.isEmpty()) {
-            image_item->setToolTip(image_names.join("\n"));
-        }
-        rowItems << image_item;
+        cells << QString::number(image_names.count());
         // Video
-        NumericItem *video_item = new NumericItem();
         QStringList video_names = video_names_hash[filename];
         total_video += video_names.count();
-        video_item->setText(QString::number(video_names.count()));
-        if (!video_names.isEmpty()) {
-            video_item->setToolTip(video_names.join("\n"));
-        }
-        rowItems << video_item;
+        cells << QString::number(video_names.count());
         // Audio
-        NumericItem *audio_item = new NumericItem();
         QStringList audio_names = audio_names_hash[filename];
         total_audio += audio_names.count();
-        audio_item->setText(QString::number(audio_names.count()));
-        if (!audio_names.isEmpty()) {
-            audio_item->setToolTip(audio_names.join("\n"));
-        }
-        rowItems << audio_item;
+        cells << QString::number(audio_names.count());
         // Linked Stylesheets
-        NumericItem *stylesheet_item = new NumericItem();
         QStringList stylesheet_names = stylesheet_names_hash[filename];
         total_stylesheets += stylesheet_names.count();
-        stylesheet_item->setText(QString::number(stylesheet_names.count()));
-        if (!stylesheet_names.isEmpty()) {
-            stylesheet_item->setToolTip(stylesheet_names.join("\n"));
-        }
-        rowItems << stylesheet_item;
+        cells << QString::number(stylesheet_names.count());
         // Well formed
-        QStandardItem *wellformed_item = new QStandardItem();
         wellformed = html_resource->FileIsWellFormed();
         if (wellformed) {
             total_wellformed++;
         }
-        wellformed_item->setText(wellformed ? tr("Yes") : tr("No"));
-        rowItems << wellformed_item;
+        cells << (wellformed ? tr("Yes") : tr("No"));
 
-        // Add item to table
-        m_ItemModel->appendRow(rowItems);
-        for (int i = 0; i < rowItems.count(); i++) {
-            rowItems[i]->setEditable(false);
+        // Add row to table
+        m_ItemModel->AppendRow(cells);
+        m_ItemModel->SetToolTip(0, filepath);
+        if (!image_names.isEmpty()) {
+            m_ItemModel->SetToolTip(4, image_names.join("\n"));
+        }
+        if (!video_names.isEmpty()) {
+            m_ItemModel->SetToolTip(5, video_names.join("\n"));
+        }
+        if (!audio_names.isEmpty()) {
+            m_ItemModel->SetToolTip(6, audio_names.join("\n"));
+        }
+        if (!stylesheet_names.isEmpty()) {
+            m_ItemModel->SetToolTip(7, stylesheet_names.join("\n"));
         }
     }
-    // Sort before adding the totals row
-    // Since sortIndicator calls this routine, must disconnect/reconnect while resorting
-    disconnect(ui.fileTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
-    ui.fileTree->header()->setSortIndicator(sort_column, sort_order);
-    connect(ui.fileTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
-    // Totals
-    NumericItem *nitem;
-    QList<QStandardItem *> rowItems;
+    // Totals - the model keeps them after the sorted rows
+    QStringList totals;
     // Files
-    nitem = new NumericItem();
-    nitem->setText(QString(tr("%n file(s)", "", m_HTMLResources.count())));
-    rowItems << nitem;
+    totals << QString(tr("%n file(s)", "", m_HTMLResources.count()));
     // File size
-    nitem = new NumericItem();
-    nitem->setText(QLocale().toString(total_size, 'f', 2));
-    rowItems << nitem;
+    totals << QLocale().toString(total_size, 'f', 2);
     // All Words
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_all_words));
-    rowItems << nitem;
+    totals << QString::number(total_all_words);
     // Misspelled Words
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_misspelled_words));
-    rowItems << nitem;
+    totals << QString::number(total_misspelled_words);
     // Images
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_images));
-    rowItems << nitem;
+    totals << QString::number(total_images);
     // Video
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_video));
-    rowItems << nitem;
+    totals << QString::number(total_video);
     // Audio
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_audio));
-    rowItems << nitem;
+    totals << QString::number(total_audio);
     // Stylesheets
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_stylesheets));
-    rowItems << nitem;
+    totals << QString::number(total_stylesheets);
     // Well formed
-    nitem = new NumericItem();
-    nitem->setText(QString::number(total_wellformed));
-    rowItems << nitem;
-
-    QFont font;
-    font.setWeight(QFont::Bold);
-    for (int i = 0; i < rowItems.count(); i++) {
-        rowItems[i]->setEditable(false);
-        rowItems[i]->setFont(font);
-    }
+    totals << QString::number(total_wellformed);
+    m_ItemModel->SetTotalsRow(totals);
+    m_ItemModel->EndReport();
 
-    m_ItemModel->appendRow(rowItems);
+    ui.fileTree->sortByColumn(sort_column, sort_order);
 
     for (int i = 0; i < ui.fileTree->header()->count(); i++) {
         ui.fileTree->resizeColumnToContents(i);
@@ -239,88 +188,30 @@ void HTMLFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
 
 void HTMLFilesWidget::FilterEditTextChangedSlot(const QString &text)
 {
-    const QString lowercaseText = text.toLower();
-    QStandardItem *root_item = m_ItemModel->invisibleRootItem();
-    QModelIndex parent_index;
-    // Hide rows that don't contain the filter text
-    int first_visible_row = -1;
-
-    for (int row = 0; row < root_item->rowCount(); row++) {
-        if (text.isEmpty() || root_item->child(row, 0)->text().toLower().contains(lowercaseText)) {
-            ui.fileTree->setRowHidden(row, parent_index, false);
-
-            if (first_visible_row == -1) {
-                first_visible_row = row;
-            }
-        } else {
-            ui.fileTree->setRowHidden(row, parent_index, true);
-        }
-    }
+    m_ItemModel->Filter(text, QList<int>() << 0);
 
-    if (!text.isEmpty() && first_visible_row != -1) {
+    if (!text.isEmpty() && !m_ItemModel->IsTotalsRow(0)) {
         // Select the first non-hidden row
-        ui.fileTree->setCurrentIndex(root_item->child(first_visible_row, 0)->index());
+        ui.fileTree->setCurrentIndex(m_ItemModel->index(0, 0));
     } else {
         // Clear current and selection, which clears preview image
         ui.fileTree->setCurrentIndex(QModelIndex());
     }
 }
 
-void HTMLFilesWidget::Sort(int logicalindex, Qt::SortOrder order)
-{
-    SetupTable(logicalindex, order);
-}
-
 void HTMLFilesWidget::DoubleClick()
 {
     QModelIndex index = ui.fileTree->selectionModel()->selectedRows(0).first();
 
-    if (index.row() != m_ItemModel->rowCount() - 1) {
-        QString filename = m_ItemModel->itemFromIndex(index)->text();
+    if (!m_ItemModel->IsTotalsRow(index.row())) {
+        QString filename = m_ItemModel->Text(index.row(), 0);
         emit OpenFileRequest(filename, 1);
     }
 }
 
 void HTMLFilesWidget::Save()
 {
-    QString report_info;
-    QString row_text;
-
-    // Get headings
-    for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-        QStandardItem *item = m_ItemModel->horizontalHeaderItem(col);
-        QString text = "";
-        if (item) {
-            text = item->text();
-        }
-        if (col == 0) {
-            row_text.append(text);
-        } else {
-            row_text.append("," % text);
-        }
-    }
-
-    report_info.append(row_text % "\n");
-
-    // Get data from table
-    for (int row = 0; row < m_ItemModel->rowCount(); row++) {
-        row_text = "";
-
-        for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-            QStandardItem *item = m_ItemModel->item(row, col);
-            QString text = "";
-            if (item) {
-                text = item->text();
-            }
-            if (col == 0) {
-                row_text.append(text);
-            } else {
-                row_text.append("," % text);
-            }
-        }
-
-        report_info.append(row_text % "\n");
-    }
+    QString report_info = m_ItemModel->CSVText();
 
     // Save the file
     ReadSettings();
@@ -355,12 +246,14 @@ void HTMLFilesWidget::Delete()
 
     if (ui.fileTree->selectionModel()->hasSelection()) {
         foreach(QModelIndex index, ui.fileTree->selectionModel()->selectedRows(0)) {
-            files_to_delete.append(m_ItemModel->itemFromIndex(index)->text());
+            if (!m_ItemModel->IsTotalsRow(index.row())) {
+                files_to_delete.append(m_ItemModel->Text(index.row(), 0));
+            }
         }
     }
 
     emit DeleteFilesRequest(files_to_delete);
-    SetupTable();
+    SetupTable(ui.fileTree->header()->sortIndicatorSection(), ui.fileTree->header()->sortIndicatorOrder());
 }
 
 void HTMLFilesWidget::CreateContextMenuActions()
@@ -385,7 +278,7 @@ void HTMLFilesWidget::SetupContextMenu(const QPoint &point)
     m_Delete->setEnabled(ui.fileTree->selectionModel()->selectedRows().count() > 0);
     int last_row = ui.fileTree->model()->rowCount() - 1;
 
-    if (ui.fileTree->selectionModel()->isRowSelected(last_row, QModelIndex())) {
+    if (m_ItemModel->IsTotalsRow(last_row) && ui.fileTree->selectionModel()->isRowSelected(last_row, QModelIndex())) {
         m_Delete->setEnabled(false);
     }
 }
@@ -422,7 +315,6 @@ void HTMLFilesWidget::connectSignalsSlots()
             this,         SLOT(FilterEditTextChangedSlot(QString)));
     connect(ui.fileTree, SIGNAL(doubleClicked(const QModelIndex &)),
             this,         SLOT(DoubleClick()));
-    connect(ui.fileTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
     connect(ui.fileTree,  SIGNAL(customContextMenuRequested(const QPoint &)),
             this,         SLOT(OpenContextMenu(const QPoint &)));
     connect(m_Delete,     SIGNAL(triggered()), this, SLOT(Delete()));
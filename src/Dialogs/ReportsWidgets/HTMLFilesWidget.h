@@ -27,7 +27,6 @@
 
 #include <QtCore/QHash>
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtCore/QSharedPointer>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QMenu>
@@ -35,6 +34,7 @@
 #include "ResourceObjects/Resource.h"
 #include "BookManipulation/Book.h"
 #include "Dialogs/ReportsWidgets/ReportsWidget.h"
+#include "Dialogs/ReportsWidgets/ReportTableModel.h"
 
 #include "ui_ReportsHTMLFilesWidget.h"
 
@@ -62,8 +62,6 @@ signals:
 private slots:
     void OpenContextMenu(const QPoint &point);
 
-    void Sort(int logicalindex, Qt::SortOrder order);
-
     void FilterEditTextChangedSlot(const QString &text);
 
     void Delete();
@@ -83,7 +81,7 @@ private:
 
     QSharedPointer<Book> m_Book;
 
-    QStandardItemModel *m_ItemModel;
+    ReportTableModel *m_ItemModel;
 
     QMenu *m_ContextMenu;
 
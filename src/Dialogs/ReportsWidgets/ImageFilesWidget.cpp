@@ -31,13 +31,17 @@
 #include "BookManipulation/FolderKeeper.h"
 #include "Dialogs/ReportsWidgets/ImageFilesWidget.h"
 #include "Misc/NumericItem.h"
+#include "Misc/RasterizeImageResource.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/ThumbnailService.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/ImageResource.h"
 #include "ResourceObjects/SVGResource.h"
 
 static const int THUMBNAIL_SIZE = 100;
 static const int THUMBNAIL_SIZE_INCREMENT = 50;
+// The thumbnail size used to tell the color when no thumbnails are shown
+static const int COLOR_SAMPLE_SIZE = 32;
 
 static const QString SETTINGS_GROUP = "reports";
 static const QString DEFAULT_REPORT_FILE = "ImageFilesReport.csv";
@@ -46,6 +50,7 @@ ImageFilesWidget::ImageFilesWidget()
     :
     m_ItemModel(new QStandardItemModel),
     m_ThumbnailSize(THUMBNAIL_SIZE),
+    m_RequestedThumbnailSize(THUMBNAIL_SIZE),
     m_ContextMenu(new QMenu(this)),
     m_LastDirSaved(QString()),
     m_LastFileSaved(QString())
@@ -106,10 +111,14 @@ void ImageFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
     double total_size = 0;
     int total_links = 0;
     QHash<QString, QStringList> image_html_files_hash = m_Book->GetHTMLFilesUsingImages();
+    // Rows of an earlier table are gone, and their thumbnails unwanted
+    m_ThumbnailRows.clear();
+    m_RequestedThumbnailSize = m_ThumbnailSize ? m_ThumbnailSize : COLOR_SAMPLE_SIZE;
     foreach(Resource * resource, m_AllImageResources) {
         QString filepath = "../" + resource->GetRelativePathToOEBPS();
         QString path = resource->GetFullPath();
-        QImage image(path);
+        // Read from the header only; the pixels come with the thumbnail
+        QSize image_size = RasterizeImageResource::ImageSize(path);
         QList<QStandardItem *> rowItems;
         // Filename
         QStandardItem *name_item = new QStandardItem();
@@ -137,34 +146,34 @@ void ImageFilesWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
         rowItems << link_item;
         // Width
         NumericItem *width_item = new NumericItem();
-        width_item->setText(QString::number(image.width()));
+        width_item->setText(QString::number(image_size.width()));
         rowItems << width_item;
         // Height
         NumericItem *height_item = new NumericItem();
-        height_item->setText(QString::number(image.height()));
+        height_item->setText(QString::number(image_size.height()));
         rowItems << height_item;
         // Pixels
         NumericItem *pixel_item = new NumericItem();
-        pixel_item->setText(QString::number(image.width() * image.height()));
+        pixel_item->setText(QString::number(image_size.width() * image_size.height()));
         rowItems << pixel_item;
-        // Color
+        // Color, told from the thumbnail
         QStandardItem *color_item = new QStandardItem();
-        color_item->setText(image.allGray() ? "Grayscale" : "Color");
         rowItems << color_item;
 
         // Thumbnail
+        QStandardItem *icon_item = NULL;
         if (m_ThumbnailSize) {
-            QPixmap pixmap(resource->GetFullPath());
-
-            if (pixmap.height() > m_ThumbnailSize || pixmap.width() > m_ThumbnailSize) {
-                pixmap = pixmap.scaled(QSize(m_ThumbnailSize, m_ThumbnailSize), Qt::KeepAspectRatio);
-            }
-
-            QStandardItem *icon_item = new QStandardItem();
-            icon_item->setIcon(QIcon(pixmap));
+            icon_item = new QStandardItem();
             rowItems << icon_item;
         }
 
+        QImage thumbnail;
+        if (ThumbnailService::instance()->Request(path, m_RequestedThumbnailSize, thumbnail)) {
+            SetThumbnail(color_item, icon_item, thumbnail);
+        } else {
+            m_ThumbnailRows.insert(path, qMakePair(color_item, icon_item));
+        }
+
         for (int i = 0; i < rowItems.count(); i++) {
             rowItems[i]->setEditable(false);
         }
@@ -281,6 +290,29 @@ void ImageFilesWidget::Sort(int logicalindex, Qt::SortOrder order)
     SetupTable(logicalindex, order);
 }
 
+void ImageFilesWidget::ThumbnailReady(const QString &path, int max_side, const QImage &thumbnail)
+{
+    if (max_side != m_RequestedThumbnailSize || !m_ThumbnailRows.contains(path)) {
+        return;
+    }
+
+    QPair<QStandardItem *, QStandardItem *> row = m_ThumbnailRows.take(path);
+    SetThumbnail(row.first, row.second, thumbnail);
+}
+
+void ImageFilesWidget::SetThumbnail(QStandardItem *color_item, QStandardItem *icon_item, const QImage &thumbnail)
+{
+    if (thumbnail.isNull()) {
+        return;
+    }
+
+    color_item->setText(thumbnail.allGray() ? "Grayscale" : "Color");
+
+    if (icon_item) {
+        icon_item->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+    }
+}
+
 void ImageFilesWidget::Save()
 {
     QString report_info;
@@ -454,6 +486,8 @@ void ImageFilesWidget::connectSignalsSlots()
     connect(ui.fileTree,  SIGNAL(customContextMenuRequested(const QPoint &)),
             this,         SLOT(OpenContextMenu(const QPoint &)));
     connect(m_Delete,     SIGNAL(triggered()), this, SLOT(Delete()));
+    connect(ThumbnailService::instance(), SIGNAL(ThumbnailReady(const QString &, int, const QImage &)),
+            this,                         SLOT(ThumbnailReady(const QString &, int, const QImage &)));
     connect(ui.buttonBox->button(QDialogButtonBox::Close), SIGNAL(clicked()), this, SIGNAL(CloseDialog()));
     connect(ui.buttonBox->button(QDialogButtonBox::Save), SIGNAL(clicked()), this, SLOT(Save()));
 }
@@ -31,6 +31,8 @@
 
 #include "ResourceObjects/Resource.h"
 #include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtGui/QImage>
 #include <QtWidgets/QDialog>
 #include <QtGui/QStandardItemModel>
 #include "BookManipulation/Book.h"
@@ -74,6 +76,8 @@ private slots:
 
     void Save();
 
+    void ThumbnailReady(const QString &path, int max_side, const QImage &thumbnail);
+
 private:
     void ReadSettings();
     void WriteSettings();
@@ -83,6 +87,11 @@ private:
 
     void connectSignalsSlots();
 
+    /**
+     * Fills in the color, and the thumbnail if shown, of one row.
+     */
+    void SetThumbnail(QStandardItem *color_item, QStandardItem *icon_item, const QImage &thumbnail);
+
     QList<Resource *> m_AllImageResources;
 
     QSharedPointer<Book> m_Book;
@@ -91,6 +100,17 @@ private:
 
     int m_ThumbnailSize;
 
+    /**
+     * The size the thumbnails of the current table were asked for in.
+     */
+    int m_RequestedThumbnailSize;
+
+    /**
+     * The color and thumbnail items of the rows still waiting
+     * for their thumbnail, keyed by full path.
+     */
+    QHash<QString, QPair<QStandardItem *, QStandardItem *> > m_ThumbnailRows;
+
     QMenu *m_ContextMenu;
 
     QAction *m_Delete;
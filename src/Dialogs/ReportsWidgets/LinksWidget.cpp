@@ -23,6 +23,7 @@
 
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 #include <QtWidgets/QFileDialog>
 #include <QtGui/QFont>
 #include <QtWidgets/QMessageBox>
@@ -33,7 +34,6 @@
 #include "BookManipulation/XhtmlDoc.h"
 #include "Dialogs/ReportsWidgets/LinksWidget.h"
 #include "Misc/HTMLSpellCheck.h"
-#include "Misc/NumericItem.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -43,7 +43,7 @@ static const QString DEFAULT_REPORT_FILE = "LinksReport.csv";
 
 LinksWidget::LinksWidget()
     :
-    m_ItemModel(new QStandardItemModel),
+    m_ItemModel(new ReportTableModel),
     m_LastDirSaved(QString()),
     m_LastFileSaved(QString())
 {
@@ -66,7 +66,6 @@ void LinksWidget::CreateReport(QSharedPointer<Book> book)
 
 void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
 {
-    m_ItemModel->clear();
     QStringList header;
     header.append(tr("File"));
     header.append(tr("Line"));
@@ -79,7 +78,8 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
     header.append(tr("Target's Target File"));
     header.append(tr("Target's Target ID"));
     header.append(tr("Match?"));
-    m_ItemModel->setHorizontalHeaderLabels(header);
+    m_ItemModel->BeginReport(header);
+    m_ItemModel->SetNumericColumn(1);
     ui.fileTree->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui.fileTree->setModel(m_ItemModel);
     ui.fileTree->header()->setSortIndicatorShown(true);
@@ -89,43 +89,46 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
 
     QHash<QString, QList<XhtmlDoc::XMLElement>> links = m_Book->GetLinkElements();
     QHash<QString, QStringList> all_ids = m_Book->GetIdsInHTMLFiles();
-    QStringList html_filenames;
+    QSet<QString> html_filenames;
     foreach(Resource *resource, m_HTMLResources) {
-        html_filenames.append(resource->Filename());
+        html_filenames.insert(resource->Filename());
+    }
+
+    // The first anchor with each id in each file, so finding the
+    // target of a link does not walk every anchor of its file
+    QHash<QString, QHash<QString, int>> anchor_ids;
+    foreach(Resource *resource, m_HTMLResources) {
+        QString filename = resource->Filename();
+        const QList<XhtmlDoc::XMLElement> &elements = links[filename];
+        QHash<QString, int> &ids = anchor_ids[filename];
+        for (int i = elements.count() - 1; i >= 0; i--) {
+            QString id = elements.at(i).attributes.value("id");
+            if (!id.isEmpty()) {
+                ids.insert(id, i);
+            }
+        }
     }
 
     foreach(Resource *resource, m_HTMLResources) {
         QString filepath = "../" + resource->GetRelativePathToOEBPS();
-        QString path = resource->GetFullPath();
         QString filename = resource->Filename();
 
         foreach(XhtmlDoc::XMLElement element, links[filename]) {
-            QList<QStandardItem *> rowItems;
+            QStringList cells;
 
             // Source file
-            QStandardItem *item = new QStandardItem();
             QString source_file = filename;
-            item->setText(source_file);
-            item->setToolTip(filepath);
-            rowItems << item;
+            cells << source_file;
 
             // Source Line Number
-            item = new QStandardItem();
-            QString lineno = QString::number(element.lineno);
-            item->setText(lineno);
-            item->setToolTip(filepath);
-            rowItems << item;
+            cells << QString::number(element.lineno);
 
             // Source id
-            item = new QStandardItem();
             QString source_id = element.attributes["id"];
-            item->setText(source_id);
-            rowItems << item;
+            cells << source_id;
 
             // Source text
-            item = new QStandardItem();
-            item->setText(element.text);
-            rowItems << item;
+            cells << element.text;
 
             // Source target file & id
             QString href = element.attributes["href"];
@@ -144,13 +147,8 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
                 // Just show url
                 href_file = href;
             }
-            item = new QStandardItem();
-            item->setText(href_file);
-            rowItems << item;
-
-            item = new QStandardItem();
-            item->setText(href_id);
-            rowItems << item;
+            cells << href_file;
+            cells << href_id;
 
             // Target exists in book
             QString target_valid = tr("n/a");
@@ -168,33 +166,21 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
                     }
                 }
             }
-            item = new QStandardItem();
-            item->setText(target_valid);
-            rowItems << item;
+            cells << target_valid;
 
             if (is_target_file && !href_id.isEmpty()) {
                 // Find the target element for this link
                 // As long as an anchor tag was used!
-                XhtmlDoc::XMLElement target;
-                bool found = false;
-
                 QString target_file = href_file;
                 if (target_file.isEmpty()) {
                     target_file = filename;
                 }
-                foreach(XhtmlDoc::XMLElement target_element, links[target_file]) {
-                    if (href_id == target_element.attributes["id"]) {
-                        target = target_element;
-                        found = true;
-                        break;
-                    }
-                }
-                if (found) {
+                int target_index = anchor_ids.value(target_file).value(href_id, -1);
+                if (target_index >= 0) {
+                    const XhtmlDoc::XMLElement &target = links[target_file].at(target_index);
 
                     // Target Text
-                    item = new QStandardItem();
-                    item->setText(target.text);
-                    rowItems << item;
+                    cells << target.text;
 
                     // Target's Target file and id
                     QString target_href = target.attributes["href"];
@@ -212,13 +198,8 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
                         target_href_file = target_href;
                     }
 
-                    item = new QStandardItem();
-                    item->setText(target_href_file);
-                    rowItems << item;
-
-                    item = new QStandardItem();
-                    item->setText(target_href_id);
-                    rowItems << item;
+                    cells << target_href_file;
+                    cells << target_href_id;
 
                     // Match - destination link points to source
                     if (target_href_file.isEmpty()) {
@@ -228,18 +209,16 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
                     if (!source_id.isEmpty() && !target_href_id.isEmpty() && source_file == target_href_file && source_id == target_href_id) {
                         match = tr("yes");
                     }
-                    item = new QStandardItem();
-                    item->setText(match);
-                    rowItems << item;
+                    cells << match;
                 }
             }
-            // Add item to table
-            m_ItemModel->appendRow(rowItems);
-            for (int i = 0; i < rowItems.count(); i++) {
-                rowItems[i]->setEditable(false);
-            }
+            // Add row to table
+            m_ItemModel->AppendRow(cells);
+            m_ItemModel->SetToolTip(0, filepath);
+            m_ItemModel->SetToolTip(1, filepath);
         }
     }
+    m_ItemModel->EndReport();
 
     for (int i = 0; i < ui.fileTree->header()->count(); i++) {
         ui.fileTree->resizeColumnToContents(i);
@@ -249,32 +228,11 @@ void LinksWidget::SetupTable(int sort_column, Qt::SortOrder sort_order)
 
 void LinksWidget::FilterEditTextChangedSlot(const QString &text)
 {
-    const QString lowercaseText = text.toLower();
-    QStandardItem *root_item = m_ItemModel->invisibleRootItem();
-    QModelIndex parent_index;
-    // Hide rows that don't contain the filter text
-    int first_visible_row = -1;
-
-    for (int row = 0; row < root_item->rowCount(); row++) {
-        if (text.isEmpty() || root_item->child(row, 0)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 2)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 3)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 4)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 5)->text().toLower().contains(lowercaseText) ||
-            root_item->child(row, 6)->text().toLower().contains(lowercaseText)) {
-            ui.fileTree->setRowHidden(row, parent_index, false);
-
-            if (first_visible_row == -1) {
-                first_visible_row = row;
-            }
-        } else {
-            ui.fileTree->setRowHidden(row, parent_index, true);
-        }
-    }
+    m_ItemModel->Filter(text, QList<int>() << 0 << 2 << 3 << 4 << 5 << 6);
 
-    if (!text.isEmpty() && first_visible_row != -1) {
+    if (!text.isEmpty() && m_ItemModel->rowCount() > 0) {
         // Select the first non-hidden row
-        ui.fileTree->setCurrentIndex(root_item->child(first_visible_row, 0)->index());
+        ui.fileTree->setCurrentIndex(m_ItemModel->index(0, 0));
     } else {
         // Clear current and selection, which clears preview image
         ui.fileTree->setCurrentIndex(QModelIndex());
@@ -284,55 +242,16 @@ void LinksWidget::FilterEditTextChangedSlot(const QString &text)
 void LinksWidget::DoubleClick()
 {
     QModelIndex index = ui.fileTree->selectionModel()->selectedRows(0).first();
-    if (index.row() != m_ItemModel->rowCount() - 1) {
-        // IMPORTANT:  file name is in column 0, and line number is in column 1
-        // This should match order of header above
-        QString filename = m_ItemModel->item(index.row(), 0)->text();
-        QString lineno = m_ItemModel->item(index.row(), 1)->text();
-        emit OpenFileRequest(filename, lineno.toInt());
-    }
+    // IMPORTANT:  file name is in column 0, and line number is in column 1
+    // This should match order of header above
+    QString filename = m_ItemModel->Text(index.row(), 0);
+    QString lineno = m_ItemModel->Text(index.row(), 1);
+    emit OpenFileRequest(filename, lineno.toInt());
 }
 
 void LinksWidget::Save()
 {
-    QString report_info;
-    QString row_text;
-
-    // Get headings
-    for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-        QStandardItem *item = m_ItemModel->horizontalHeaderItem(col);
-        QString text = "";
-        if (item) {
-            text = item->text();
-        }
-        if (col == 0) {
-            row_text.append(text);
-        } else {
-            row_text.append("," % text);
-        }
-    }
-
-    report_info.append(row_text % "\n");
-
-    // Get data from table
-    for (int row = 0; row < m_ItemModel->rowCount(); row++) {
-        row_text = "";
-
-        for (int col = 0; col < ui.fileTree->header()->count(); col++) {
-            QStandardItem *item = m_ItemModel->item(row, col);
-            QString text = "";
-            if (item) {
-                text = item->text();
-            }
-            if (col == 0) {
-                row_text.append(text);
-            } else {
-                row_text.append("," % text);
-            }
-        }
-
-        report_info.append(row_text % "\n");
-    }
+    QString report_info = m_ItemModel->CSVText();
 
     // Save the file
     ReadSettings();
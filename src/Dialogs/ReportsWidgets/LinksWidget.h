@@ -27,7 +27,6 @@
 
 #include <QtCore/QHash>
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtCore/QSharedPointer>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QMenu>
@@ -35,6 +34,7 @@
 #include "ResourceObjects/Resource.h"
 #include "BookManipulation/Book.h"
 #include "Dialogs/ReportsWidgets/ReportsWidget.h"
+#include "Dialogs/ReportsWidgets/ReportTableModel.h"
 
 #include "ui_ReportsLinksWidget.h"
 
@@ -77,7 +77,7 @@ private:
 
     QSharedPointer<Book> m_Book;
 
-    QStandardItemModel *m_ItemModel;
+    ReportTableModel *m_ItemModel;
 
     QString m_LastDirSaved;
     QString m_LastFileSaved;
@@ -0,0 +1,336 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <algorithm>
+#include <functional>
+
+#include <QtConcurrent/QtConcurrent>
+#include <QtCore/QStringBuilder>
+#include <QtGui/QFont>
+
+#include "Dialogs/ReportsWidgets/ReportTableModel.h"
+#include "Misc/TaskScheduler.h"
+
+// Below this many rows the filter runs on the GUI thread; splitting
+// the work costs more than it saves.
+static const int PARALLEL_FILTER_ROWS = 20000;
+
+namespace
+{
+struct FilterChunk {
+    int first;
+    int last;
+};
+}
+
+static void FilterOneChunk(const FilterChunk &chunk,
+                           const QVector<const QVector<QString> *> &columns,
+                           const QString &filter,
+                           char *matches)
+{
+    for (int row = chunk.first; row < chunk.last; row++) {
+        foreach(const QVector<QString> *column, columns) {
+            if (column->at(row).contains(filter, Qt::CaseInsensitive)) {
+                matches[row] = 1;
+                break;
+            }
+        }
+    }
+}
+
+
+ReportTableModel::ReportTableModel(QObject *parent)
+    :
+    QAbstractTableModel(parent),
+    m_RowCount(0)
+{
+}
+
+
+void ReportTableModel::BeginReport(const QStringList &header)
+{
+    beginResetModel();
+    m_Header = header;
+    m_Columns = QVector<Column>(header.count());
+    for (int i = 0; i < m_Columns.count(); i++) {
+        m_Columns[i].numeric = false;
+    }
+    m_Totals.clear();
+    m_RowCount = 0;
+    m_Order.clear();
+    m_Visible.clear();
+}
+
+
+QStringList ReportTableModel::Header() const
+{
+    return m_Header;
+}
+
+
+void ReportTableModel::SetNumericColumn(int column)
+{
+    m_Columns[column].numeric = true;
+}
+
+
+void ReportTableModel::AppendRow(const QStringList &cells)
+{
+    for (int i = 0; i < m_Columns.count(); i++) {
+        m_Columns[i].text.append(i < cells.count() ? cells.at(i) : QString());
+    }
+    m_RowCount++;
+}
+
+
+void ReportTableModel::SetToolTip(int column, const QString &tool_tip)
+{
+    // Tool tips are rare, so a column only stores them once it has one
+    QVector<QString> &tool_tips = m_Columns[column].toolTip;
+    tool_tips.resize(m_RowCount);
+    tool_tips[m_RowCount - 1] = tool_tip;
+}
+
+
+void ReportTableModel::SetTotalsRow(const QStringList &cells)
+{
+    m_Totals = cells;
+}
+
+
+void ReportTableModel::EndReport()
+{
+    for (int i = 0; i < m_Columns.count(); i++) {
+        Column &column = m_Columns[i];
+        column.toolTip.resize(column.toolTip.isEmpty() ? 0 : m_RowCount);
+        if (column.numeric) {
+            column.value.resize(m_RowCount);
+            for (int row = 0; row < m_RowCount; row++) {
+                column.value[row] = column.text.at(row).toDouble();
+            }
+        }
+    }
+
+    m_Order.resize(m_RowCount);
+    for (int row = 0; row < m_RowCount; row++) {
+        m_Order[row] = row;
+    }
+
+    m_Filter.clear();
+    m_FilterColumns.clear();
+    m_Visible = m_Order;
+    endResetModel();
+}
+
+
+void ReportTableModel::Filter(const QString &filter, const QList<int> &columns)
+{
+    m_Filter = filter;
+    m_FilterColumns = columns;
+    UpdateVisibleRows();
+}
+
+
+QString ReportTableModel::Text(int row, int column) const
+{
+    int stored_row = StoredRow(row);
+    if (stored_row < 0) {
+        return m_Totals.value(column);
+    }
+    return m_Columns.at(column).text.at(stored_row);
+}
+
+
+bool ReportTableModel::IsTotalsRow(int row) const
+{
+    return !m_Totals.isEmpty() && row == m_Visible.count();
+}
+
+
+QString ReportTableModel::CSVText() const
+{
+    QString csv = m_Header.join(",") % "\n";
+
+    foreach(int stored_row, m_Order) {
+        QStringList cells;
+        foreach(const Column &column, m_Columns) {
+            cells.append(column.text.at(stored_row));
+        }
+        csv.append(cells.join(",") % "\n");
+    }
+
+    if (!m_Totals.isEmpty()) {
+        csv.append(m_Totals.join(",") % "\n");
+    }
+
+    return csv;
+}
+
+
+int ReportTableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_Visible.count() + (m_Totals.isEmpty() ? 0 : 1);
+}
+
+
+int ReportTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_Columns.count();
+}
+
+
+QVariant ReportTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rowCount() || index.column() >= m_Columns.count()) {
+        return QVariant();
+    }
+
+    int stored_row = StoredRow(index.row());
+
+    if (role == Qt::DisplayRole) {
+        return Text(index.row(), index.column());
+    } else if (role == Qt::ToolTipRole && stored_row >= 0) {
+        const QVector<QString> &tool_tips = m_Columns.at(index.column()).toolTip;
+        if (!tool_tips.isEmpty() && !tool_tips.at(stored_row).isEmpty()) {
+            return tool_tips.at(stored_row);
+        }
+    } else if (role == Qt::FontRole && stored_row < 0) {
+        QFont font;
+        font.setWeight(QFont::Bold);
+        return font;
+    }
+
+    return QVariant();
+}
+
+
+QVariant ReportTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    return m_Header.value(section);
+}
+
+
+void ReportTableModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= m_Columns.count()) {
+        return;
+    }
+
+    // Stable, so sorting on one column after another orders by several
+    const Column &key = m_Columns.at(column);
+    if (key.numeric) {
+        const QVector<double> &value = key.value;
+        if (order == Qt::AscendingOrder) {
+            std::stable_sort(m_Order.begin(), m_Order.end(), [&value](int a, int b) { return value.at(a) < value.at(b); });
+        } else {
+            std::stable_sort(m_Order.begin(), m_Order.end(), [&value](int a, int b) { return value.at(b) < value.at(a); });
+        }
+    } else {
+        const QVector<QString> &text = key.text;
+        if (order == Qt::AscendingOrder) {
+            std::stable_sort(m_Order.begin(), m_Order.end(), [&text](int a, int b) { return text.at(a) < text.at(b); });
+        } else {
+            std::stable_sort(m_Order.begin(), m_Order.end(), [&text](int a, int b) { return text.at(b) < text.at(a); });
+        }
+    }
+
+    UpdateVisibleRows();
+}
+
+
+void ReportTableModel::UpdateVisibleRows()
+{
+    emit layoutAboutToBeChanged();
+
+    // Remember which stored row each persistent index was on
+    QModelIndexList old_indexes = persistentIndexList();
+    QVector<int> old_rows;
+    foreach(QModelIndex index, old_indexes) {
+        old_rows.append(StoredRow(index.row()));
+    }
+
+    if (m_Filter.isEmpty() || m_FilterColumns.isEmpty()) {
+        m_Visible = m_Order;
+    } else {
+        QVector<const QVector<QString> *> columns;
+        foreach(int column, m_FilterColumns) {
+            columns.append(&m_Columns.at(column).text);
+        }
+
+        QVector<char> matches(m_RowCount, 0);
+        QList<FilterChunk> chunks;
+        int chunk_count = m_RowCount < PARALLEL_FILTER_ROWS ? 1 : qMax(1, TaskScheduler::ThreadCount());
+        int chunk_size = (m_RowCount + chunk_count - 1) / chunk_count;
+        for (int first = 0; first < m_RowCount; first += chunk_size) {
+            FilterChunk chunk = { first, qMin(first + chunk_size, m_RowCount) };
+            chunks.append(chunk);
+        }
+
+        if (chunks.count() > 1) {
+            QtConcurrent::blockingMap(chunks, std::bind(FilterOneChunk, std::placeholders::_1, columns, m_Filter, matches.data()));
+        } else {
+            foreach(const FilterChunk &chunk, chunks) {
+                FilterOneChunk(chunk, columns, m_Filter, matches.data());
+            }
+        }
+
+        m_Visible.clear();
+        foreach(int stored_row, m_Order) {
+            if (matches.at(stored_row)) {
+                m_Visible.append(stored_row);
+            }
+        }
+    }
+
+    // Put each persistent index back on its stored row, if still shown
+    QVector<int> view_rows(m_RowCount, -1);
+    for (int row = 0; row < m_Visible.count(); row++) {
+        view_rows[m_Visible.at(row)] = row;
+    }
+    QModelIndexList new_indexes;
+    for (int i = 0; i < old_indexes.count(); i++) {
+        int stored_row = old_rows.at(i);
+        int row = stored_row < 0 ? m_Visible.count() : view_rows.at(stored_row);
+        if (row < 0 || (stored_row < 0 && m_Totals.isEmpty())) {
+            new_indexes.append(QModelIndex());
+        } else {
+            new_indexes.append(index(row, old_indexes.at(i).column()));
+        }
+    }
+    changePersistentIndexList(old_indexes, new_indexes);
+
+    emit layoutChanged();
+}
+
+
+int ReportTableModel::StoredRow(int row) const
+{
+    if (row >= 0 && row < m_Visible.count()) {
+        return m_Visible.at(row);
+    }
+    return -1;
+}
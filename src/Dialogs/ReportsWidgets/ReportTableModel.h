@@ -0,0 +1,145 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef REPORTTABLEMODEL_H
+#define REPORTTABLEMODEL_H
+
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+ * The table of a report, stored a column at a time.
+ *
+ * A report with a great many rows costs one string per cell rather
+ * than one item object per cell. Sorting and filtering work on the
+ * stored columns and only change which stored row each view row shows,
+ * so nothing is rebuilt when the user sorts or types a filter.
+ *
+ * A report is filled between BeginReport() and EndReport(). An optional
+ * totals row is shown in bold after every other row and is never
+ * sorted or filtered out.
+ */
+class ReportTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    ReportTableModel(QObject *parent = 0);
+
+    /**
+     * Drops the current report and starts a new one with these columns.
+     */
+    void BeginReport(const QStringList &header);
+
+    QStringList Header() const;
+
+    /**
+     * Columns whose cells hold numbers are sorted by their value.
+     */
+    void SetNumericColumn(int column);
+
+    void AppendRow(const QStringList &cells);
+
+    /**
+     * Sets the tool tip of a cell of the last appended row.
+     */
+    void SetToolTip(int column, const QString &tool_tip);
+
+    void SetTotalsRow(const QStringList &cells);
+
+    void EndReport();
+
+    /**
+     * Shows only the rows with text in one of the columns that
+     * contains filter, ignoring case. An empty filter shows every row.
+     */
+    void Filter(const QString &filter, const QList<int> &columns);
+
+    /**
+     * @return The text of a cell, by view row.
+     */
+    QString Text(int row, int column) const;
+
+    bool IsTotalsRow(int row) const;
+
+    /**
+     * @return The header and every row in the current sort order,
+     *         including the rows filtered out, as comma separated values.
+     */
+    QString CSVText() const;
+
+    // inherited
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+private:
+    struct Column {
+        QVector<QString> text;
+        QVector<QString> toolTip;
+        QVector<double> value;
+        bool numeric;
+    };
+
+    /**
+     * Rebuilds m_Visible from m_Order and the current filter,
+     * keeping the persistent indexes of the views on their rows.
+     */
+    void UpdateVisibleRows();
+
+    /**
+     * @return The stored row shown at a view row; -1 for the totals row.
+     */
+    int StoredRow(int row) const;
+
+    QStringList m_Header;
+
+    QVector<Column> m_Columns;
+
+    QStringList m_Totals;
+
+    int m_RowCount;
+
+    /**
+     * Every stored row, in sort order.
+     */
+    QVector<int> m_Order;
+
+    /**
+     * The stored rows that pass the filter, in sort order.
+     */
+    QVector<int> m_Visible;
+
+    QString m_Filter;
+
+    QList<int> m_FilterColumns;
+};
+
+#endif // REPORTTABLEMODEL_H
@@ -166,6 +166,7 @@ bool SearchEditor::eventFilter(QObject *obj, QEvent *event)
 
 void SearchEditor::SettingsFileModelUpdated()
 {
+    m_SearchEditorModel->FetchAllEntries();
     ui.SearchEditorTree->expandAll();
     emit ShowStatusMessageRequest(tr("Saved Searches loaded from file."));
 }
@@ -526,6 +527,7 @@ void SearchEditor::CollapseAll()
 
 void SearchEditor::ExpandAll()
 {
+    m_SearchEditorModel->FetchAllEntries();
     ui.SearchEditorTree->expandAll();
 }
 
@@ -570,6 +572,7 @@ bool SearchEditor::FilterEntries(const QString &text, QStandardItem *item)
 
 void SearchEditor::FilterEditTextChangedSlot(const QString &text)
 {
+    m_SearchEditorModel->FetchAllEntries();
     FilterEntries(text);
     ui.SearchEditorTree->expandAll();
     ui.SearchEditorTree->selectionModel()->clear();
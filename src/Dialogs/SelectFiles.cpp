@@ -23,15 +23,18 @@
 
 #include <QApplication>
 #include <QtCore/QFileInfo>
+#include <QtCore/QTimer>
 #include <QImage>
 #include <QPixmap>
 #include <QtWidgets/QLayout>
+#include <QtWidgets/QScrollBar>
 #include <QtWebKitWidgets/QWebFrame>
 #include <QtWebKitWidgets/QWebView>
 
 #include "MainUI/MainWindow.h"
 #include "Dialogs/SelectFiles.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/ThumbnailService.h"
 #include "sigil_constants.h"
 
 static const int COL_NAME = 0;
@@ -138,6 +141,9 @@ void SelectFiles::SetImages()
     ui.imageTree->setSortingEnabled(true);
     int row = 0;
 
+    // Rows of an earlier list are gone, and their thumbnails unwanted
+    m_ThumbnailRows.clear();
+    m_ResourcesByPath.clear();
     foreach(Resource *resource, m_MediaResources) {
         // Don't show resources not matching the selected type
         Resource::ResourceType type = resource->Type();
@@ -154,20 +160,18 @@ void SelectFiles::SetImages()
         name_item->setToolTip(filepath);
         name_item->setData(static_cast<int>(type), Qt::UserRole);
         name_item->setData(resource->GetFullPath(), Qt::UserRole + 1);
+        m_ResourcesByPath.insert(resource->GetFullPath(), resource);
         name_item->setEditable(false);
         rowItems << name_item;
 
-        // Do not show thumbnail if file is not an image
+        // Do not show thumbnail if file is not an image; it is
+        // only made once the row is scrolled into view
         if ((type == Resource::ImageResourceType || type == Resource::SVGResourceType) && m_ThumbnailSize) {
-              QPixmap pixmap(resource->GetFullPath());
-
-            if (pixmap.height() > m_ThumbnailSize || pixmap.width() > m_ThumbnailSize) {
-                pixmap = pixmap.scaled(QSize(m_ThumbnailSize, m_ThumbnailSize), Qt::KeepAspectRatio);
-            }
             QStandardItem *icon_item = new QStandardItem();
-            icon_item->setIcon(QIcon(pixmap));
+            icon_item->setSizeHint(icon_size);
             icon_item->setEditable(false);
             rowItems << icon_item;
+            m_ThumbnailRows.insert(resource->GetFullPath(), icon_item);
         }
 
         m_SelectFilesModel->appendRow(rowItems);
@@ -184,6 +188,62 @@ void SelectFiles::SetImages()
 
     FilterEditTextChangedSlot(ui.Filter->text());
     SelectDefaultImage();
+
+    // Once the rows are laid out
+    QTimer::singleShot(0, this, SLOT(RequestVisibleThumbnails()));
+}
+
+void SelectFiles::RequestVisibleThumbnails()
+{
+    if (m_ThumbnailRows.isEmpty()) {
+        return;
+    }
+
+    // Hidden rows are skipped by indexBelow
+    const int viewport_height = ui.imageTree->viewport()->height();
+    QModelIndex index = ui.imageTree->indexAt(QPoint(0, 0));
+
+    while (index.isValid() && ui.imageTree->visualRect(index).top() < viewport_height) {
+        QString path = index.sibling(index.row(), COL_NAME).data(Qt::UserRole + 1).toString();
+
+        if (m_ThumbnailRows.contains(path)) {
+            QImage thumbnail;
+            LoadContent(path);
+
+            if (ThumbnailService::instance()->Request(path, m_ThumbnailSize, thumbnail)) {
+                SetThumbnail(path, thumbnail);
+            }
+        }
+
+        index = ui.imageTree->indexBelow(index);
+    }
+}
+
+void SelectFiles::ThumbnailReady(const QString &path, int max_side, const QImage &thumbnail)
+{
+    if (max_side != m_ThumbnailSize || !m_ThumbnailRows.contains(path)) {
+        return;
+    }
+
+    SetThumbnail(path, thumbnail);
+}
+
+void SelectFiles::SetThumbnail(const QString &path, const QImage &thumbnail)
+{
+    QStandardItem *icon_item = m_ThumbnailRows.take(path);
+
+    if (icon_item && !thumbnail.isNull()) {
+        icon_item->setIcon(QIcon(QPixmap::fromImage(thumbnail)));
+    }
+}
+
+void SelectFiles::LoadContent(const QString &path)
+{
+    Resource *resource = m_ResourcesByPath.value(path);
+
+    if (resource) {
+        resource->LoadDeferredContent();
+    }
 }
 
 void SelectFiles::SelectDefaultImage()
@@ -248,6 +308,7 @@ void SelectFiles::SplitterMoved(int pos, int index)
 void SelectFiles::resizeEvent(QResizeEvent *event)
 {
     ReloadPreview();
+    RequestVisibleThumbnails();
 }
 
 void SelectFiles::SetPreviewImage()
@@ -269,6 +330,7 @@ void SelectFiles::SetPreviewImage()
 
     // Basic file details
     QString path = item->data(Qt::UserRole + 1).toString();
+    LoadContent(path);
     const QFileInfo fileInfo = QFileInfo(path);
     const double ffsize = fileInfo.size() / 1024.0;
     const QString fsize = QLocale().toString(ffsize, 'f', 2);
@@ -375,6 +437,8 @@ void SelectFiles::FilterEditTextChangedSlot(const QString &text)
         // Clear current and selection, which clears preview image
         ui.imageTree->setCurrentIndex(QModelIndex());
     }
+
+    RequestVisibleThumbnails();
 }
 
 QStandardItem *SelectFiles::GetLastSelectedImageItem()
@@ -466,4 +530,8 @@ void SelectFiles::connectSignalsSlots()
     connect(ui.FileTypes,       SIGNAL(itemSelectionChanged()), this, SLOT(SetImages()));
     connect(m_WebView,          SIGNAL(loadFinished(bool)), this, SLOT(PreviewLoadComplete(bool)));
     connect(ui.splitter,    SIGNAL(splitterMoved(int, int)), this, SLOT(SplitterMoved(int, int)));
+    connect(ui.imageTree->verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(RequestVisibleThumbnails()));
+    connect(m_SelectFilesModel, SIGNAL(layoutChanged()), this, SLOT(RequestVisibleThumbnails()));
+    connect(ThumbnailService::instance(), SIGNAL(ThumbnailReady(const QString &, int, const QImage &)),
+            this,                         SLOT(ThumbnailReady(const QString &, int, const QImage &)));
 }
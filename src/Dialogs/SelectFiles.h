@@ -25,6 +25,7 @@
 #ifndef SELECTFILES_H
 #define SELECTFILES_H
 
+#include <QtCore/QHash>
 #include <QtWidgets/QDialog>
 #include <QtGui/QStandardItemModel>
 
@@ -32,6 +33,7 @@
 
 #include "ui_SelectFiles.h"
 
+class QImage;
 class QString;
 class QStringList;
 class QWebView;
@@ -84,6 +86,12 @@ private slots:
 
     void SplitterMoved(int pos, int index);
 
+    /**
+     * Asks for the thumbnails of the rows in view that do not have one yet.
+     */
+    void RequestVisibleThumbnails();
+    void ThumbnailReady(const QString &path, int max_side, const QImage &thumbnail);
+
 private:
     bool IsPreviewLoaded();
     
@@ -92,6 +100,11 @@ private:
 
     void SetPreviewImage();
 
+    void SetThumbnail(const QString &path, const QImage &thumbnail);
+
+    // Writes out the file of the resource at path if it was lazily opened
+    void LoadContent(const QString &path);
+
     QList<Resource *> m_MediaResources;
 
     QStandardItemModel *m_SelectFilesModel;
@@ -107,6 +120,17 @@ private:
 
     int m_ThumbnailSize;
 
+    /**
+     * The thumbnail items still waiting for their image, by full path.
+     */
+    QHash<QString, QStandardItem *> m_ThumbnailRows;
+
+    /**
+     * The resource listed in each row, by full path, so that a lazily
+     * opened file is only written out once it is shown.
+     */
+    QHash<QString, Resource *> m_ResourcesByPath;
+
     bool m_IsInsertFromDisk;
 
     QListWidgetItem *m_AllItem;
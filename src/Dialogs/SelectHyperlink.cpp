@@ -57,13 +57,14 @@ SelectHyperlink::SelectHyperlink(QString default_href, HTMLResource *html_resour
 void SelectHyperlink::SetList()
 {
     m_SelectHyperlinkModel->clear();
+    m_UnloadedEntries.clear();
     QStringList header;
     header.append(tr("Targets in the Book"));
     m_SelectHyperlinkModel->setHorizontalHeaderLabels(header);
     ui.list->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui.list->setModel(m_SelectHyperlinkModel);
-    // Get the complete list of valid targets
-    m_IDNames = m_Book->GetIdsInHTMLFiles();
+    // Only the files are listed up front, the targets in each are
+    // read from the book index when it is expanded
     // Display in-file targets first, then in order
     AddEntry(m_CurrentHTMLResource);
     foreach(Resource * resource, m_Resources) {
@@ -71,6 +72,10 @@ void SelectHyperlink::SetList()
             AddEntry(resource);
         }
     }
+
+    if (m_CurrentHTMLResource && m_SelectHyperlinkModel->rowCount() > 0) {
+        ui.list->expand(m_SelectHyperlinkModel->index(0, 0));
+    }
 }
 
 void SelectHyperlink::AddEntry(Resource *resource)
@@ -79,42 +84,87 @@ void SelectHyperlink::AddEntry(Resource *resource)
         return;
     }
 
+    QStandardItem *file_item = NewTargetItem(resource, QString());
+    m_SelectHyperlinkModel->appendRow(file_item);
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+
+    if (html_resource) {
+        // Placeholder so the entry can be expanded
+        file_item->appendRow(new QStandardItem());
+        m_UnloadedEntries.insert(file_item, html_resource);
+    }
+}
+
+QStandardItem *SelectHyperlink::NewTargetItem(Resource *resource, const QString &id)
+{
     QString filename = resource->Filename();
-    QStringList ids = QStringList() << "" << m_IDNames[filename];
+    QString target = filename;
+    QString filepath;
+    // Only relative paths if inserting hyperlink not editing TOC
+    if (m_CurrentHTMLResource) {
+        filepath = "../";
+    }
+    filepath += resource->GetRelativePathToOEBPS();
+
+    if (!id.isEmpty()) {
+        QString fragment = "#" % id;
+        filepath.append(fragment);
+
+        // Show the short version if this is the same file
+        if (m_CurrentHTMLResource && filename == m_CurrentHTMLResource->Filename()) {
+            target = fragment;
+        } else {
+            target.append(fragment);
+        }
+    }
+
+    QStandardItem *target_item = new QStandardItem();
+    target_item->setText(target);
+    target_item->setData(filepath);
+    target_item->setEditable(false);
+    return target_item;
+}
+
+void SelectHyperlink::LoadEntry(QStandardItem *file_item, const QStringList &ids)
+{
+    Resource *resource = m_UnloadedEntries.take(file_item);
+
+    if (!resource) {
+        return;
+    }
+
+    file_item->removeRows(0, file_item->rowCount());
     foreach(QString id, ids) {
         // Do not allow linking to index entries because they can be regenerated
         // and because they can take up a lot of room.
-        if (id.startsWith(SIGIL_INDEX_ID_PREFIX)) {
+        if (id.isEmpty() || id.startsWith(SIGIL_INDEX_ID_PREFIX)) {
             continue;
         }
 
-        QString target = filename;
-        QString filepath;
-        // Only relative paths if inserting hyperlink not editing TOC
-        if (m_CurrentHTMLResource) {
-            filepath = "../";
-        }
-        filepath += resource->GetRelativePathToOEBPS();
+        file_item->appendRow(NewTargetItem(resource, id));
+    }
+}
 
-        if (!id.isEmpty()) {
-            QString fragment = "#" % id;
-            filepath.append(fragment);
+void SelectHyperlink::LoadAllEntries()
+{
+    if (m_UnloadedEntries.isEmpty()) {
+        return;
+    }
 
-            // Show the short version if this is the same file
-            if (m_CurrentHTMLResource && filename == m_CurrentHTMLResource->Filename()) {
-                target = fragment;
-            } else {
-                target.append(fragment);
-            }
-        }
+    // One pass over the index for the whole book rather than file by file
+    QHash<QString, QStringList> ids = m_Book->GetIdsInHTMLFiles();
+    foreach(QStandardItem *file_item, m_UnloadedEntries.keys()) {
+        LoadEntry(file_item, ids.value(m_UnloadedEntries.value(file_item)->Filename()));
+    }
+}
+
+void SelectHyperlink::Expanded(const QModelIndex &index)
+{
+    QStandardItem *file_item = m_SelectHyperlinkModel->itemFromIndex(index);
+    HTMLResource *html_resource = m_UnloadedEntries.value(file_item);
 
-        QList<QStandardItem *> rowItems;
-        QStandardItem *target_item = new QStandardItem();
-        target_item->setText(target);
-        target_item->setData(filepath);
-        rowItems << target_item;
-        m_SelectHyperlinkModel->appendRow(rowItems);
-        rowItems[0]->setEditable(false);
+    if (html_resource) {
+        LoadEntry(file_item, m_Book->GetIdsInHTMLFile(html_resource));
     }
 }
 
@@ -140,7 +190,6 @@ QString SelectHyperlink::GetSelectedText()
 void SelectHyperlink::SelectText(QString &text)
 {
     if (!text.isEmpty()) {
-        QModelIndex parent_index;
         QStandardItem *root_item = m_SelectHyperlinkModel->invisibleRootItem();
         // Convert search text to filename#fragment
         QString target = text;
@@ -153,19 +202,45 @@ void SelectHyperlink::SelectText(QString &text)
             target = target.right(target.length() - target.lastIndexOf("/") - 1);
         }
 
-        for (int row = 0; row < root_item->rowCount(); row++) {
-            QStandardItem *child = root_item->child(row, 0);
-            // Convert selection text to filename#fragment
-            QString selection = child->data().toString();
+        QString target_file = target.left(target.indexOf("#"));
 
-            if (selection.contains("/")) {
-                selection = selection.right(selection.length() - selection.lastIndexOf("/") - 1);
+        for (int row = 0; row < root_item->rowCount(); row++) {
+            QStandardItem *file_item = root_item->child(row, 0);
+            QStandardItem *match = NULL;
+
+            if (target == file_item->text()) {
+                match = file_item;
+            } else if (target_file == file_item->text()) {
+                // Only the file the target is in needs its targets read
+                HTMLResource *html_resource = m_UnloadedEntries.value(file_item);
+
+                if (html_resource) {
+                    LoadEntry(file_item, m_Book->GetIdsInHTMLFile(html_resource));
+                }
+
+                for (int child_row = 0; child_row < file_item->rowCount(); child_row++) {
+                    QStandardItem *child = file_item->child(child_row, 0);
+                    // Convert selection text to filename#fragment
+                    QString selection = child->data().toString();
+
+                    if (selection.contains("/")) {
+                        selection = selection.right(selection.length() - selection.lastIndexOf("/") - 1);
+                    }
+
+                    if (target == selection) {
+                        match = child;
+                        break;
+                    }
+                }
             }
 
-            if (target == selection) {
-                ui.list->selectionModel()->select(m_SelectHyperlinkModel->index(row, 0, parent_index), QItemSelectionModel::Select | QItemSelectionModel::Rows);
+            if (match) {
+                ui.list->expand(file_item->index());
+                ui.list->selectionModel()->select(match->index(), QItemSelectionModel::Select | QItemSelectionModel::Rows);
                 ui.list->setFocus();
-                ui.list->setCurrentIndex(child->index());
+                ui.list->setCurrentIndex(match->index());
+                ui.list->scrollTo(match->index());
+                break;
             }
         }
     }
@@ -177,23 +252,48 @@ void SelectHyperlink::FilterEditTextChangedSlot(const QString &text)
     QStandardItem *root_item = m_SelectHyperlinkModel->invisibleRootItem();
     QModelIndex parent_index;
     // Hide rows that don't contain the filter text
-    int first_visible_row = -1;
+    QStandardItem *first_visible_item = NULL;
+
+    // The filter searches the targets in every file
+    if (!text.isEmpty()) {
+        LoadAllEntries();
+    }
 
     for (int row = 0; row < root_item->rowCount(); row++) {
-        if (text.isEmpty() || root_item->child(row, 0)->text().toLower().contains(lowercaseText)) {
-            ui.list->setRowHidden(row, parent_index, false);
+        QStandardItem *file_item = root_item->child(row, 0);
+        bool file_visible = text.isEmpty() || file_item->text().toLower().contains(lowercaseText);
+
+        if (file_visible && !first_visible_item) {
+            first_visible_item = file_item;
+        }
+
+        bool child_visible = false;
+
+        for (int child_row = 0; child_row < file_item->rowCount(); child_row++) {
+            QStandardItem *child = file_item->child(child_row, 0);
 
-            if (first_visible_row == -1) {
-                first_visible_row = row;
+            if (text.isEmpty() || child->text().toLower().contains(lowercaseText)) {
+                ui.list->setRowHidden(child_row, file_item->index(), false);
+                child_visible = true;
+
+                if (!first_visible_item) {
+                    first_visible_item = child;
+                }
+            } else {
+                ui.list->setRowHidden(child_row, file_item->index(), true);
             }
-        } else {
-            ui.list->setRowHidden(row, parent_index, true);
+        }
+
+        ui.list->setRowHidden(row, parent_index, !file_visible && !child_visible);
+
+        if (!text.isEmpty() && child_visible) {
+            ui.list->expand(file_item->index());
         }
     }
 
-    if (!text.isEmpty() && first_visible_row != -1) {
+    if (!text.isEmpty() && first_visible_item) {
         // Select the first non-hidden row
-        ui.list->setCurrentIndex(root_item->child(first_visible_row, 0)->index());
+        ui.list->setCurrentIndex(first_visible_item->index());
     } else {
         // Clear current and selection, which clears preview image
         ui.list->setCurrentIndex(QModelIndex());
@@ -261,4 +361,6 @@ void SelectHyperlink::connectSignalsSlots()
             this,         SLOT(DoubleClicked(const QModelIndex &)));
     connect(ui.list,     SIGNAL(clicked(const QModelIndex &)),
             this,         SLOT(Clicked(const QModelIndex &)));
+    connect(ui.list,     SIGNAL(expanded(const QModelIndex &)),
+            this,         SLOT(Expanded(const QModelIndex &)));
 }
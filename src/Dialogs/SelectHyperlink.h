@@ -52,6 +52,11 @@ private slots:
     void DoubleClicked(const QModelIndex &);
     void Clicked(const QModelIndex &);
 
+    /**
+     * Fills in the targets in a file the first time it is expanded.
+     */
+    void Expanded(const QModelIndex &index);
+
 private:
     void SetSelectedText();
 
@@ -60,6 +65,18 @@ private:
 
     void AddEntry(Resource *resource);
 
+    /**
+     * Adds the targets for ids under the entry for their file.
+     */
+    void LoadEntry(QStandardItem *file_item, const QStringList &ids);
+
+    /**
+     * Fills in the targets of every file not yet expanded.
+     */
+    void LoadAllEntries();
+
+    QStandardItem *NewTargetItem(Resource *resource, const QString &id);
+
     QString GetSelectedText();
 
     void SelectText(QString &text);
@@ -69,7 +86,10 @@ private:
     QString m_DefaultTarget;
     QString m_SavedTarget;
 
-    QHash<QString, QStringList> m_IDNames;
+    /**
+     * The file entries whose targets have not been filled in yet.
+     */
+    QHash<QStandardItem *, HTMLResource *> m_UnloadedEntries;
 
     QList<Resource *> m_Resources;
 
@@ -20,6 +20,8 @@
 **
 *************************************************************************/
 
+#include <algorithm>
+
 #include <QtCore/QHashIterator>
 #include <QtCore/QSignalMapper>
 #include <QtGui/QContextMenuEvent>
@@ -27,8 +29,6 @@
 #include <QtWidgets/QPushButton>
 
 #include "Dialogs/SpellcheckEditor.h"
-#include "Misc/CaseInsensitiveItem.h"
-#include "Misc/NumericItem.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/SpellCheck.h"
 #include "Misc/Utility.h"
@@ -46,7 +46,7 @@ SpellcheckEditor::SpellcheckEditor(QWidget *parent)
     :
     QDialog(parent),
     m_Book(NULL),
-    m_SpellcheckEditorModel(new QStandardItemModel(this)),
+    m_SpellcheckEditorModel(new SpellcheckWordsModel(this)),
     m_ContextMenu(new QMenu(this)),
     m_MultipleSelection(false),
     m_SelectRow(-1),
@@ -79,10 +79,15 @@ void SpellcheckEditor::SetupSpellcheckEditorTree()
 {
     ui.SpellcheckEditorTree->setModel(m_SpellcheckEditorModel);
     ui.SpellcheckEditorTree->setContextMenuPolicy(Qt::CustomContextMenu);
+    // The model sorts itself when the sort indicator changes
+    ui.SpellcheckEditorTree->header()->setSortIndicator(SpellcheckWordsModel::CountColumn, Qt::AscendingOrder);
     ui.SpellcheckEditorTree->setSortingEnabled(true);
     ui.SpellcheckEditorTree->setWordWrap(true);
     ui.SpellcheckEditorTree->setAlternatingRowColors(true);
+    // Every row is one line, so the view need not measure them all
+    ui.SpellcheckEditorTree->setUniformRowHeights(true);
     ui.SpellcheckEditorTree->header()->setStretchLastSection(false);
+    ui.SpellcheckEditorTree->header()->setSectionResizeMode(SpellcheckWordsModel::WordColumn, QHeaderView::Stretch);
 }
 
 void SpellcheckEditor::showEvent(QShowEvent *event)
@@ -132,20 +137,20 @@ int SpellcheckEditor::SelectedRowsCount()
     return count;
 }
 
-QList<QStandardItem *> SpellcheckEditor::GetSelectedItems()
+QList<int> SpellcheckEditor::GetSelectedRows()
 {
-    QList<QStandardItem *> selected_items;
+    QList<int> selected_rows;
     if (SelectedRowsCount() < 1) {
-        return selected_items;
+        return selected_rows;
     }
 
     // Shift-click order is top to bottom regardless of starting position
     // Ctrl-click order is first clicked to last clicked (included shift-clicks stay ordered as is)
     QModelIndexList selected_indexes = ui.SpellcheckEditorTree->selectionModel()->selectedRows(0);
     foreach(QModelIndex index, selected_indexes) {
-        selected_items.append(m_SpellcheckEditorModel->itemFromIndex(index));
+        selected_rows.append(index.row());
     }
-    return selected_items;
+    return selected_rows;
 }
 
 void SpellcheckEditor::Ignore()
@@ -158,10 +163,11 @@ void SpellcheckEditor::Ignore()
     m_MultipleSelection = SelectedRowsCount() > 1;
 
     SpellCheck *sc = SpellCheck::instance();
-    foreach (QStandardItem *item, GetSelectedItems()) {
-        sc->ignoreWord(item->text());
-        MarkSpelledOkay(item->row());
+    QList<int> rows = GetSelectedRows();
+    foreach (int row, rows) {
+        sc->ignoreWord(m_SpellcheckEditorModel->WordAt(row));
     }
+    MarkSpelledOkay(rows);
 
     if (m_MultipleSelection) {
         m_MultipleSelection = false;
@@ -188,13 +194,13 @@ void SpellcheckEditor::Add()
     SpellCheck *sc = SpellCheck::instance();
     SettingsStore settings;
     QStringList enabled_dicts = settings.enabledUserDictionaries();
-    bool enabled = false;
-    foreach (QStandardItem *item, GetSelectedItems()) {
-        sc->addToUserDictionary(item->text(), dict_name);
-        if (enabled_dicts.contains(dict_name)) {
-            enabled = true;
-            MarkSpelledOkay(item->row());
-        }
+    bool enabled = enabled_dicts.contains(dict_name);
+    QList<int> rows = GetSelectedRows();
+    foreach (int row, rows) {
+        sc->addToUserDictionary(m_SpellcheckEditorModel->WordAt(row), dict_name);
+    }
+    if (enabled) {
+        MarkSpelledOkay(rows);
     }
 
     if (m_MultipleSelection) {
@@ -211,8 +217,8 @@ void SpellcheckEditor::Add()
 
 void SpellcheckEditor::ChangeAll()
 {
-    QString old_word = GetSelectedWord();
-    if (old_word.isEmpty()) {
+    QList<int> rows = GetSelectedRows();
+    if (rows.isEmpty()) {
         emit ShowStatusMessageRequest(tr("No words selected."));
         return;
     }
@@ -223,18 +229,36 @@ void SpellcheckEditor::ChangeAll()
         return;
     }
 
-    m_SelectRow = GetSelectedRow();
+    // Every selected word is changed in the same pass over the files
+    QHash<QString, QString> substitutions;
+    foreach(int row, rows) {
+        QString old_word = m_SpellcheckEditorModel->WordAt(row);
+        if (!old_word.isEmpty() && old_word != new_word) {
+            substitutions.insert(old_word, new_word);
+        }
+    }
+    if (substitutions.isEmpty()) {
+        return;
+    }
+
+    m_SelectRow = *std::min_element(rows.begin(), rows.end());
 
-    emit UpdateWordRequest(old_word, new_word);
+    emit UpdateWordsRequest(substitutions);
 }
 
-void SpellcheckEditor::MarkSpelledOkay(int row)
+void SpellcheckEditor::MarkSpelledOkay(const QList<int> &rows)
 {
-    m_SpellcheckEditorModel->invisibleRootItem()->child(row, 2)->setText(tr("No"));
+    if (rows.isEmpty()) {
+        return;
+    }
+
+    int row = *std::min_element(rows.begin(), rows.end());
+    m_SpellcheckEditorModel->MarkSpelledOkay(rows);
+    UpdateWordCounts();
+
     if (ui.ShowAllWords->checkState() == Qt::Unchecked) {
-        m_SpellcheckEditorModel->removeRows(row, 1);
         if (row >= m_SpellcheckEditorModel->rowCount()) {
-            row--;
+            row = m_SpellcheckEditorModel->rowCount() - 1;
         }
         if (row >= 0) {
             ui.SpellcheckEditorTree->selectionModel()->clear();
@@ -245,81 +269,64 @@ void SpellcheckEditor::MarkSpelledOkay(int row)
     }
 }
 
-void SpellcheckEditor::CreateModel(int sort_column, Qt::SortOrder sort_order)
+void SpellcheckEditor::CreateModel()
 {
-    m_SpellcheckEditorModel->clear();
-    QStringList header;
-    header.append(tr("Word"));
-    header.append(tr("Count"));
-    header.append(tr("Misspelled?"));
-    m_SpellcheckEditorModel->setHorizontalHeaderLabels(header);
-    ui.SpellcheckEditorTree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
-    ui.SpellcheckEditorTree->resizeColumnToContents(1);
-    ui.SpellcheckEditorTree->resizeColumnToContents(2);
-
-    QHash<QString, int> unique_words = m_Book->GetUniqueWordsInHTMLFiles();
+    QHash<QString, QHash<QString, int>> words_by_language = m_Book->GetUniqueWordsByLanguageInHTMLFiles();
+    QHash<QString, int> unique_words;
+    QHash<QString, bool> verdicts;
 
-    int total_misspelled_words = 0;
     SpellCheck *sc = SpellCheck::instance();
+    QHashIterator<QString, QHash<QString, int>> language(words_by_language);
+
+    // Each language with its own dictionary; a word is misspelled if
+    // it is in any language it is used in
+    while (language.hasNext()) {
+        language.next();
+        // The current dictionary's are checked on the thread pool
+        QHash<QString, bool> language_verdicts = sc->spellWords(language.value().keys(), language.key());
+        QHashIterator<QString, int> word(language.value());
+
+        while (word.hasNext()) {
+            word.next();
+            unique_words[word.key()] += word.value();
+
+            if (!language_verdicts.value(word.key(), true)) {
+                verdicts[word.key()] = false;
+            }
+        }
+    }
 
+    QVector<SpellcheckWordsModel::Word> words;
+    words.reserve(unique_words.count());
     QHashIterator<QString, int> i(unique_words);
     while (i.hasNext()) {
         i.next();
-        QString word = i.key();
-        int count = unique_words.value(word);
-
-        bool misspelled = !sc->spell(word);
-        if (misspelled) {
-            total_misspelled_words++;
-        }
-
-        if (ui.ShowAllWords->checkState() == Qt::Unchecked && !misspelled) {
-            continue;
-        }
-
-        QList<QStandardItem *> row_items;
-
-        if (ui.CaseInsensitiveSort->checkState() == Qt::Unchecked) {
-            QStandardItem *word_item = new QStandardItem(word);
-            word_item->setEditable(false);
-            row_items << word_item;
-        } else {
-            CaseInsensitiveItem *word_item = new CaseInsensitiveItem();
-            word_item->setText(word);
-            word_item->setEditable(false);
-            row_items << word_item;
-        }
-        NumericItem *count_item = new NumericItem();
-        count_item->setText(QString::number(count));
-        row_items << count_item;
-
-        QStandardItem *misspelled_item = new QStandardItem();
-        misspelled_item->setEditable(false);
-        if (misspelled) {
-            misspelled_item->setText(tr("Yes"));
-        } else {
-            misspelled_item->setText(tr("No"));
-        }
-        row_items << misspelled_item ;
-
-        m_SpellcheckEditorModel->invisibleRootItem()->appendRow(row_items);
+        SpellcheckWordsModel::Word word;
+        word.text = i.key();
+        word.count = i.value();
+        word.misspelled = !verdicts.value(i.key(), true);
+        words.append(word);
     }
 
-    // Since sortIndicator calls this routine, must disconnect/reconnect while resorting
-    disconnect(ui.SpellcheckEditorTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
-    ui.SpellcheckEditorTree->header()->setSortIndicator(sort_column, sort_order);
-    connect(ui.SpellcheckEditorTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
-
+    m_SpellcheckEditorModel->SetShowAllWords(ui.ShowAllWords->checkState() == Qt::Checked);
+    m_SpellcheckEditorModel->SetCaseInsensitiveSort(ui.CaseInsensitiveSort->checkState() == Qt::Checked);
+    m_SpellcheckEditorModel->SetWords(words);
+    ui.SpellcheckEditorTree->resizeColumnToContents(SpellcheckWordsModel::CountColumn);
+    ui.SpellcheckEditorTree->resizeColumnToContents(SpellcheckWordsModel::MisspelledColumn);
+    UpdateWordCounts();
+}
 
-    ui.SpellcheckEditorTree->header()->setToolTip("<table><tr><td>" % tr("Misspelled Words") % ":</td><td>" % QString::number(total_misspelled_words) % "</td></tr><tr><td>" % tr("Total Unique Words") % ":</td><td>" % QString::number(unique_words.count()) % "</td></tr></table>");
+void SpellcheckEditor::UpdateWordCounts()
+{
+    ui.SpellcheckEditorTree->header()->setToolTip("<table><tr><td>" % tr("Misspelled Words") % ":</td><td>" % QString::number(m_SpellcheckEditorModel->MisspelledCount()) % "</td></tr><tr><td>" % tr("Total Unique Words") % ":</td><td>" % QString::number(m_SpellcheckEditorModel->WordCount()) % "</td></tr></table>");
 }
 
-void SpellcheckEditor::Refresh(int sort_column, Qt::SortOrder sort_order)
+void SpellcheckEditor::Refresh()
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
 
     WriteSettings();
-    CreateModel(sort_column, sort_order);
+    CreateModel();
     UpdateDictionaries();
 
     ReadSettings();
@@ -350,7 +357,9 @@ void SpellcheckEditor::DictionaryChanged(QString dictionary)
 
 void SpellcheckEditor::ChangeState(int state)
 {
-    Refresh();
+    // The words are filtered and sorted again without checking them again
+    m_SpellcheckEditorModel->SetShowAllWords(ui.ShowAllWords->checkState() == Qt::Checked);
+    m_SpellcheckEditorModel->SetCaseInsensitiveSort(ui.CaseInsensitiveSort->checkState() == Qt::Checked);
 }
 
 void SpellcheckEditor::SelectAll()
@@ -367,7 +376,7 @@ QString SpellcheckEditor::GetSelectedWord()
     }
 
     QModelIndex index = ui.SpellcheckEditorTree->selectionModel()->selectedRows(0).first();
-    word = m_SpellcheckEditorModel->itemFromIndex(index)->text();
+    word = m_SpellcheckEditorModel->WordAt(index.row());
     return word;
 }
 
@@ -384,20 +393,17 @@ int SpellcheckEditor::GetSelectedRow()
 
 void SpellcheckEditor::SelectRow(int row)
 {
-    QStandardItem *root_item = m_SpellcheckEditorModel->invisibleRootItem();
+    int row_count = m_SpellcheckEditorModel->rowCount();
 
-    if (root_item->rowCount() > 0 && row >= 0) {
-        if (row >= root_item->rowCount()) {
-            row = root_item->rowCount() - 1;
+    if (row_count > 0 && row >= 0) {
+        if (row >= row_count) {
+            row = row_count - 1;
         }
 
-        QStandardItem *child = root_item->child(row, 0);
-        if (child) {
-            QModelIndex index = child->index();
-            ui.SpellcheckEditorTree->setFocus();
-            ui.SpellcheckEditorTree->selectionModel()->select(index, QItemSelectionModel::Select | QItemSelectionModel::Rows);
-            ui.SpellcheckEditorTree->setCurrentIndex(child->index());
-        }
+        QModelIndex index = m_SpellcheckEditorModel->index(row, 0);
+        ui.SpellcheckEditorTree->setFocus();
+        ui.SpellcheckEditorTree->selectionModel()->select(index, QItemSelectionModel::Select | QItemSelectionModel::Rows);
+        ui.SpellcheckEditorTree->setCurrentIndex(index);
     }
 
     m_SelectRow = -1;
@@ -429,19 +435,7 @@ void SpellcheckEditor::SelectionChanged(const QItemSelection &selected, const QI
 
 void SpellcheckEditor::FilterEditTextChangedSlot(const QString &text)
 {
-    const QString lowercaseText = text.toLower();
-    QModelIndex root_index = m_SpellcheckEditorModel->indexFromItem(m_SpellcheckEditorModel->invisibleRootItem());
-
-    for (int row = 0; row < m_SpellcheckEditorModel->invisibleRootItem()->rowCount(); row++) {
-        QStandardItem *item = m_SpellcheckEditorModel->item(row, 0);
-        bool hidden = !(text.isEmpty() || item->text().toLower().contains(lowercaseText));
-        ui.SpellcheckEditorTree->setRowHidden(item->row(), root_index, hidden);
-    }
-}
-
-void SpellcheckEditor::Sort(int logicalindex, Qt::SortOrder order)
-{
-    Refresh(logicalindex, order);
+    m_SpellcheckEditorModel->SetFilter(text);
 }
 
 void SpellcheckEditor::ReadSettings()
@@ -499,10 +493,7 @@ void SpellcheckEditor::ReadSettings()
         if (!settings.value(SORT_ORDER).toBool()) {
             sort_order = Qt::DescendingOrder;
         }
-        // Since sortIndicator calls this routine, must disconnect/reconnect while resorting
-        disconnect(ui.SpellcheckEditorTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
         ui.SpellcheckEditorTree->header()->setSortIndicator(sort_column, sort_order);
-        connect(ui.SpellcheckEditorTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)), this, SLOT(Sort(int, Qt::SortOrder)));
     }
 
     settings.endGroup();
@@ -585,8 +576,6 @@ void SpellcheckEditor::ConnectSignalsSlots()
     connect(ui.ChangeAll, SIGNAL(clicked()), this, SLOT(ChangeAll()));
     connect(ui.SpellcheckEditorTree, SIGNAL(customContextMenuRequested(const QPoint &)),
             this,        SLOT(OpenContextMenu(const QPoint &)));
-    connect(ui.SpellcheckEditorTree->header(), SIGNAL(sortIndicatorChanged(int, Qt::SortOrder)),
-            this, SLOT(Sort(int, Qt::SortOrder)));
     connect(m_Ignore,       SIGNAL(triggered()), this, SLOT(Ignore()));
     connect(m_Add,      SIGNAL(triggered()), this, SLOT(Add()));
     connect(m_Find,      SIGNAL(triggered()), this, SLOT(FindSelectedWord()));
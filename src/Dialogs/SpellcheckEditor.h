@@ -25,14 +25,15 @@
 #define SPELLCHECKEDITOR_H
 
 #include <QtWidgets/QDialog>
-#include <QtGui/QStandardItemModel>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QMenu>
 #include <QShortcut>
+#include <QtCore/QHash>
 #include <QtCore/QSharedPointer>
 
 #include "Misc/SettingsStore.h"
 #include "BookManipulation/Book.h"
+#include "Dialogs/SpellcheckWordsModel.h"
 
 #include "ui_SpellcheckEditor.h"
 
@@ -53,13 +54,13 @@ public:
     void ForceClose();
 
 public slots:
-    void Refresh(int sort_column = 1, Qt::SortOrder sort_order = Qt::AscendingOrder);
+    void Refresh();
 
 signals:
     void ShowStatusMessageRequest(const QString &message);
     void SpellingHighlightRefreshRequest();
     void FindWordRequest(QString word);
-    void UpdateWordRequest(QString old_word, QString new_word);
+    void UpdateWordsRequest(const QHash<QString, QString> &substitutions);
 
 protected:
     bool eventFilter(QObject *obj, QEvent *ev);
@@ -87,13 +88,16 @@ private slots:
 
     void OpenContextMenu(const QPoint &point);
 
-    void Sort(int logicalindex, Qt::SortOrder order);
-
 private:
-    void CreateModel(int logicalindex, Qt::SortOrder order);
+    void CreateModel();
     void UpdateDictionaries();
     void SetupSpellcheckEditorTree();
-    void MarkSpelledOkay(int row);
+
+    /**
+     * Updates the rows in place, keeping a row selected where they were.
+     */
+    void MarkSpelledOkay(const QList<int> &rows);
+    void UpdateWordCounts();
     QString GetSelectedWord();
     int GetSelectedRow();
 
@@ -101,7 +105,7 @@ private:
 
     void SelectRow(int row);
 
-    QList<QStandardItem *> GetSelectedItems();
+    QList<int> GetSelectedRows();
 
     void ReadSettings();
     void WriteSettings();
@@ -118,7 +122,7 @@ private:
 
     QSharedPointer<Book> m_Book;
 
-    QStandardItemModel *m_SpellcheckEditorModel;
+    SpellcheckWordsModel *m_SpellcheckEditorModel;
 
     QMenu *m_ContextMenu;
 
@@ -0,0 +1,347 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <algorithm>
+#include <functional>
+
+#include <QtCore/QCoreApplication>
+
+#include "Dialogs/SpellcheckWordsModel.h"
+
+// The texts were the editor's before this model, and are translated as such
+static const char *TRANSLATION_CONTEXT = "SpellcheckEditor";
+
+// Orders the indices of words by one column, then by the word
+class WordLessThan
+{
+public:
+    WordLessThan(const QVector<SpellcheckWordsModel::Word> &words, const QVector<QString> &keys, int column)
+        :
+        m_Words(words),
+        m_Keys(keys),
+        m_Column(column)
+    {
+    }
+
+    bool operator()(int left, int right) const
+    {
+        const SpellcheckWordsModel::Word &a = m_Words.at(left);
+        const SpellcheckWordsModel::Word &b = m_Words.at(right);
+
+        if (m_Column == SpellcheckWordsModel::CountColumn && a.count != b.count) {
+            return a.count < b.count;
+        }
+
+        if (m_Column == SpellcheckWordsModel::MisspelledColumn && a.misspelled != b.misspelled) {
+            return b.misspelled;
+        }
+
+        // Case insensitive sorts compare the words lowercased first
+        if (!m_Keys.isEmpty() && m_Keys.at(left) != m_Keys.at(right)) {
+            return m_Keys.at(left) < m_Keys.at(right);
+        }
+
+        return a.text < b.text;
+    }
+
+private:
+    const QVector<SpellcheckWordsModel::Word> &m_Words;
+    const QVector<QString> &m_Keys;
+    int m_Column;
+};
+
+
+SpellcheckWordsModel::SpellcheckWordsModel(QObject *parent)
+    :
+    QAbstractTableModel(parent),
+    m_MisspelledCount(0),
+    m_ShowAllWords(false),
+    m_CaseInsensitiveSort(false),
+    m_SortColumn(CountColumn),
+    m_SortOrder(Qt::AscendingOrder)
+{
+}
+
+
+int SpellcheckWordsModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : m_Rows.count();
+}
+
+
+int SpellcheckWordsModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+
+QVariant SpellcheckWordsModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_Rows.count() || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    const Word &word = m_Words.at(m_Rows.at(index.row()));
+
+    switch (index.column()) {
+        case WordColumn:
+            return word.text;
+        case CountColumn:
+            return word.count;
+        case MisspelledColumn:
+            return word.misspelled ? QCoreApplication::translate(TRANSLATION_CONTEXT, "Yes")
+                                   : QCoreApplication::translate(TRANSLATION_CONTEXT, "No");
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+
+QVariant SpellcheckWordsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case WordColumn:
+            return QCoreApplication::translate(TRANSLATION_CONTEXT, "Word");
+        case CountColumn:
+            return QCoreApplication::translate(TRANSLATION_CONTEXT, "Count");
+        case MisspelledColumn:
+            return QCoreApplication::translate(TRANSLATION_CONTEXT, "Misspelled?");
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+
+void SpellcheckWordsModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0 || column >= ColumnCount) {
+        return;
+    }
+
+    m_SortColumn = column;
+    m_SortOrder = order;
+    emit layoutAboutToBeChanged();
+    // The selection and current row follow their words
+    QModelIndexList old_indexes = persistentIndexList();
+    QVector<int> old_words;
+    foreach(const QModelIndex &index, old_indexes) {
+        old_words.append(m_Rows.at(index.row()));
+    }
+
+    SortRows();
+
+    QVector<int> row_of_word(m_Words.count(), -1);
+
+    for (int row = 0; row < m_Rows.count(); ++row) {
+        row_of_word[m_Rows.at(row)] = row;
+    }
+
+    QModelIndexList new_indexes;
+
+    for (int i = 0; i < old_indexes.count(); ++i) {
+        new_indexes.append(index(row_of_word.at(old_words.at(i)), old_indexes.at(i).column()));
+    }
+
+    changePersistentIndexList(old_indexes, new_indexes);
+    emit layoutChanged();
+}
+
+
+void SpellcheckWordsModel::SetWords(const QVector<Word> &words)
+{
+    beginResetModel();
+    m_Words = words;
+    m_MisspelledCount = 0;
+    foreach(const Word &word, m_Words) {
+        if (word.misspelled) {
+            m_MisspelledCount++;
+        }
+    }
+    UpdateRows();
+    endResetModel();
+}
+
+
+void SpellcheckWordsModel::SetShowAllWords(bool show_all_words)
+{
+    if (show_all_words == m_ShowAllWords) {
+        return;
+    }
+
+    beginResetModel();
+    m_ShowAllWords = show_all_words;
+    UpdateRows();
+    endResetModel();
+}
+
+
+void SpellcheckWordsModel::SetCaseInsensitiveSort(bool case_insensitive)
+{
+    if (case_insensitive == m_CaseInsensitiveSort) {
+        return;
+    }
+
+    m_CaseInsensitiveSort = case_insensitive;
+    sort(m_SortColumn, m_SortOrder);
+}
+
+
+void SpellcheckWordsModel::SetFilter(const QString &text)
+{
+    const QString filter = text.toLower();
+
+    if (filter == m_Filter) {
+        return;
+    }
+
+    beginResetModel();
+    m_Filter = filter;
+    UpdateRows();
+    endResetModel();
+}
+
+
+QString SpellcheckWordsModel::WordAt(int row) const
+{
+    if (row < 0 || row >= m_Rows.count()) {
+        return QString();
+    }
+
+    return m_Words.at(m_Rows.at(row)).text;
+}
+
+
+int SpellcheckWordsModel::WordCount() const
+{
+    return m_Words.count();
+}
+
+
+int SpellcheckWordsModel::MisspelledCount() const
+{
+    return m_MisspelledCount;
+}
+
+
+void SpellcheckWordsModel::MarkSpelledOkay(const QList<int> &rows)
+{
+    QList<int> sorted_rows = rows;
+    std::sort(sorted_rows.begin(), sorted_rows.end(), std::greater<int>());
+    sorted_rows.erase(std::unique(sorted_rows.begin(), sorted_rows.end()), sorted_rows.end());
+
+    foreach(int row, sorted_rows) {
+        if (row < 0 || row >= m_Rows.count()) {
+            continue;
+        }
+
+        Word &word = m_Words[m_Rows.at(row)];
+
+        if (word.misspelled) {
+            word.misspelled = false;
+            m_MisspelledCount--;
+        }
+
+        if (m_ShowAllWords) {
+            QModelIndex changed = index(row, MisspelledColumn);
+            emit dataChanged(changed, changed);
+        }
+    }
+
+    if (m_ShowAllWords) {
+        return;
+    }
+
+    // From the bottom up, a run of neighbouring rows at a time
+    int i = 0;
+
+    while (i < sorted_rows.count()) {
+        int last = sorted_rows.at(i);
+        int first = last;
+
+        while (++i < sorted_rows.count() && sorted_rows.at(i) == first - 1) {
+            first--;
+        }
+
+        if (first < 0 || last >= m_Rows.count()) {
+            continue;
+        }
+
+        beginRemoveRows(QModelIndex(), first, last);
+        m_Rows.remove(first, last - first + 1);
+        endRemoveRows();
+    }
+}
+
+
+bool SpellcheckWordsModel::IsListed(const Word &word) const
+{
+    if (!m_ShowAllWords && !word.misspelled) {
+        return false;
+    }
+
+    return m_Filter.isEmpty() || word.text.toLower().contains(m_Filter);
+}
+
+
+void SpellcheckWordsModel::UpdateRows()
+{
+    m_Rows.clear();
+
+    for (int i = 0; i < m_Words.count(); ++i) {
+        if (IsListed(m_Words.at(i))) {
+            m_Rows.append(i);
+        }
+    }
+
+    SortRows();
+}
+
+
+void SpellcheckWordsModel::SortRows()
+{
+    QVector<QString> keys;
+
+    if (m_CaseInsensitiveSort && m_SortColumn == WordColumn) {
+        keys.resize(m_Words.count());
+
+        foreach(int i, m_Rows) {
+            keys[i] = m_Words.at(i).text.toLower();
+        }
+    }
+
+    WordLessThan less_than(m_Words, keys, m_SortColumn);
+
+    if (m_SortOrder == Qt::AscendingOrder) {
+        std::sort(m_Rows.begin(), m_Rows.end(), less_than);
+    } else {
+        std::sort(m_Rows.begin(), m_Rows.end(), [&less_than](int left, int right) {
+            return less_than(right, left);
+        });
+    }
+}
@@ -0,0 +1,121 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef SPELLCHECKWORDSMODEL_H
+#define SPELLCHECKWORDSMODEL_H
+
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+/**
+ * The words of a book for the Spellcheck editor, one row each, with how
+ * often each is used and whether it is misspelled.
+ *
+ * The words are kept in one array and the rows shown are indices into
+ * it, filtered and sorted here rather than by a proxy. Rows are only
+ * turned into text when the view asks for them, and marking words as
+ * spelled correctly changes or removes just their rows.
+ */
+class SpellcheckWordsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+
+    enum Column {
+        WordColumn = 0,
+        CountColumn,
+        MisspelledColumn,
+        ColumnCount
+    };
+
+    struct Word {
+        QString text;
+        int count;
+        bool misspelled;
+    };
+
+    SpellcheckWordsModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+    void SetWords(const QVector<Word> &words);
+
+    /**
+     * Whether the words spelled correctly are listed too.
+     */
+    void SetShowAllWords(bool show_all_words);
+
+    void SetCaseInsensitiveSort(bool case_insensitive);
+
+    /**
+     * Lists only the words that contain text, in any case.
+     */
+    void SetFilter(const QString &text);
+
+    QString WordAt(int row) const;
+
+    int WordCount() const;
+
+    int MisspelledCount() const;
+
+    /**
+     * Marks the words in rows as spelled correctly. Unless all words
+     * are shown, their rows are removed.
+     */
+    void MarkSpelledOkay(const QList<int> &rows);
+
+private:
+    bool IsListed(const Word &word) const;
+
+    /**
+     * Works out the rows shown again. Called between a
+     * beginResetModel() and an endResetModel().
+     */
+    void UpdateRows();
+
+    void SortRows();
+
+    QVector<Word> m_Words;
+
+    // The index in m_Words of the word in each row
+    QVector<int> m_Rows;
+
+    int m_MisspelledCount;
+    bool m_ShowAllWords;
+    bool m_CaseInsensitiveSort;
+    QString m_Filter;
+    int m_SortColumn;
+    Qt::SortOrder m_SortOrder;
+};
+
+#endif // SPELLCHECKWORDSMODEL_H
@@ -0,0 +1,432 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include "Dialogs/TOCEntryTreeModel.h"
+
+TOCEntryTreeModel::TOCEntryTreeModel(QObject *parent)
+    :
+    QAbstractItemModel(parent),
+    m_Root(new Node()),
+    m_EntryCount(0)
+{
+}
+
+
+TOCEntryTreeModel::~TOCEntryTreeModel()
+{
+    delete m_Root;
+}
+
+
+void TOCEntryTreeModel::SetRootEntry(const TOCModel::TOCEntry &root_entry)
+{
+    beginResetModel();
+    delete m_Root;
+    m_Root = new Node();
+    m_Root->pending = root_entry.children;
+    Materialize(m_Root);
+    m_EntryCount = CountEntries(root_entry.children);
+    endResetModel();
+}
+
+
+TOCModel::TOCEntry TOCEntryTreeModel::GetRootEntry() const
+{
+    TOCModel::TOCEntry root_entry = NodeToEntry(m_Root);
+    root_entry.is_root = true;
+    return root_entry;
+}
+
+
+int TOCEntryTreeModel::EntryCount() const
+{
+    return m_EntryCount;
+}
+
+
+void TOCEntryTreeModel::FetchChildren(const QModelIndex &index)
+{
+    if (canFetchMore(index)) {
+        fetchMore(index);
+    }
+}
+
+
+QModelIndex TOCEntryTreeModel::InsertEntry(const QModelIndex &index, bool above)
+{
+    Node *node = NodeForIndex(index);
+
+    if (node == m_Root) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = node->parent;
+    int row = above ? node->row : node->row + 1;
+    Node *entry_node = new Node();
+    entry_node->parent = parent_node;
+
+    beginInsertRows(IndexForNode(parent_node), row, row);
+    parent_node->children.insert(row, entry_node);
+    Renumber(parent_node, row);
+    endInsertRows();
+
+    return IndexForNode(entry_node);
+}
+
+
+void TOCEntryTreeModel::RemoveEntry(const QModelIndex &index)
+{
+    Node *node = NodeForIndex(index);
+
+    if (node == m_Root) {
+        return;
+    }
+
+    Node *parent_node = node->parent;
+    int row = node->row;
+
+    beginRemoveRows(IndexForNode(parent_node), row, row);
+    parent_node->children.removeAt(row);
+    Renumber(parent_node, row);
+    endRemoveRows();
+
+    delete node;
+}
+
+
+QModelIndex TOCEntryTreeModel::MoveLeft(const QModelIndex &index)
+{
+    Node *node = NodeForIndex(index);
+
+    // Can't indent above top level
+    if (node == m_Root || node->parent == m_Root) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = node->parent;
+    Node *grandparent_node = parent_node->parent;
+    int row = node->row;
+    int parent_row = parent_node->row;
+
+    // Make siblings following the entry into children
+    FetchChildren(IndexForNode(node));
+    int last_row = parent_node->children.count() - 1;
+
+    if (row < last_row) {
+        int child_row = node->children.count();
+        beginMoveRows(IndexForNode(parent_node), row + 1, last_row, IndexForNode(node), child_row);
+
+        while (parent_node->children.count() > row + 1) {
+            Node *sibling = parent_node->children.takeAt(row + 1);
+            sibling->parent = node;
+            node->children.append(sibling);
+        }
+
+        Renumber(node, child_row);
+        endMoveRows();
+    }
+
+    // Make entry child of grandparent
+    beginMoveRows(IndexForNode(parent_node), row, row, IndexForNode(grandparent_node), parent_row + 1);
+    parent_node->children.removeAt(row);
+    node->parent = grandparent_node;
+    grandparent_node->children.insert(parent_row + 1, node);
+    Renumber(grandparent_node, parent_row + 1);
+    endMoveRows();
+
+    return IndexForNode(node);
+}
+
+
+QModelIndex TOCEntryTreeModel::MoveRight(const QModelIndex &index)
+{
+    Node *node = NodeForIndex(index);
+
+    // Can't indent if row above is already parent
+    if (node == m_Root || node->row == 0) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = node->parent;
+    int row = node->row;
+
+    // Make the entry above the parent of this entry
+    Node *new_parent = parent_node->children.at(row - 1);
+    FetchChildren(IndexForNode(new_parent));
+    int child_row = new_parent->children.count();
+
+    beginMoveRows(IndexForNode(parent_node), row, row, IndexForNode(new_parent), child_row);
+    parent_node->children.removeAt(row);
+    Renumber(parent_node, row);
+    node->parent = new_parent;
+    new_parent->children.append(node);
+    Renumber(new_parent, child_row);
+    endMoveRows();
+
+    return IndexForNode(node);
+}
+
+
+QModelIndex TOCEntryTreeModel::MoveUp(const QModelIndex &index)
+{
+    Node *node = NodeForIndex(index);
+
+    // Can't move up if this row is already the top most one of its parent
+    if (node == m_Root || node->row == 0) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = node->parent;
+    int row = node->row;
+
+    beginMoveRows(IndexForNode(parent_node), row, row, IndexForNode(parent_node), row - 1);
+    parent_node->children.move(row, row - 1);
+    Renumber(parent_node, row - 1);
+    endMoveRows();
+
+    return IndexForNode(node);
+}
+
+
+QModelIndex TOCEntryTreeModel::MoveDown(const QModelIndex &index)
+{
+    Node *node = NodeForIndex(index);
+
+    // Can't move down if this row is already the last one of its parent
+    if (node == m_Root || node->row == node->parent->children.count() - 1) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = node->parent;
+    int row = node->row;
+
+    // The destination is given as a row before the move
+    beginMoveRows(IndexForNode(parent_node), row, row, IndexForNode(parent_node), row + 2);
+    parent_node->children.move(row, row + 1);
+    Renumber(parent_node, row);
+    endMoveRows();
+
+    return IndexForNode(node);
+}
+
+
+QModelIndex TOCEntryTreeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() && parent.column() != TextColumn) {
+        return QModelIndex();
+    }
+
+    Node *parent_node = NodeForIndex(parent);
+
+    if (row < 0 || row >= parent_node->children.count() || column < 0 || column >= ColumnCount) {
+        return QModelIndex();
+    }
+
+    return createIndex(row, column, parent_node->children.at(row));
+}
+
+
+QModelIndex TOCEntryTreeModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid()) {
+        return QModelIndex();
+    }
+
+    return IndexForNode(NodeForIndex(child)->parent);
+}
+
+
+int TOCEntryTreeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() && parent.column() != TextColumn) {
+        return 0;
+    }
+
+    return NodeForIndex(parent)->children.count();
+}
+
+
+int TOCEntryTreeModel::columnCount(const QModelIndex &parent) const
+{
+    return ColumnCount;
+}
+
+
+bool TOCEntryTreeModel::hasChildren(const QModelIndex &parent) const
+{
+    if (parent.isValid() && parent.column() != TextColumn) {
+        return false;
+    }
+
+    Node *node = NodeForIndex(parent);
+    return !node->children.isEmpty() || !node->pending.isEmpty();
+}
+
+
+bool TOCEntryTreeModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid() && parent.column() != TextColumn) {
+        return false;
+    }
+
+    return !NodeForIndex(parent)->pending.isEmpty();
+}
+
+
+void TOCEntryTreeModel::fetchMore(const QModelIndex &parent)
+{
+    Node *node = NodeForIndex(parent);
+
+    if (node->pending.isEmpty()) {
+        return;
+    }
+
+    beginInsertRows(parent.sibling(parent.row(), TextColumn), 0, node->pending.count() - 1);
+    Materialize(node);
+    endInsertRows();
+}
+
+
+QVariant TOCEntryTreeModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole)) {
+        return QVariant();
+    }
+
+    Node *node = NodeForIndex(index);
+    return index.column() == TextColumn ? node->text : node->target;
+}
+
+
+bool TOCEntryTreeModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole) {
+        return false;
+    }
+
+    Node *node = NodeForIndex(index);
+
+    if (index.column() == TextColumn) {
+        node->text = value.toString();
+    } else {
+        node->target = value.toString();
+    }
+
+    emit dataChanged(index, index);
+    return true;
+}
+
+
+Qt::ItemFlags TOCEntryTreeModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return Qt::NoItemFlags;
+    }
+
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsEditable;
+}
+
+
+QVariant TOCEntryTreeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    switch (section) {
+        case TextColumn:
+            return tr("TOC Entry");
+        case TargetColumn:
+            return tr("Target");
+        default:
+            break;
+    }
+
+    return QVariant();
+}
+
+
+TOCEntryTreeModel::Node *TOCEntryTreeModel::NodeForIndex(const QModelIndex &index) const
+{
+    return index.isValid() ? static_cast<Node *>(index.internalPointer()) : m_Root;
+}
+
+
+QModelIndex TOCEntryTreeModel::IndexForNode(Node *node, int column) const
+{
+    if (node == m_Root) {
+        return QModelIndex();
+    }
+
+    return createIndex(node->row, column, node);
+}
+
+
+void TOCEntryTreeModel::Renumber(Node *node, int from)
+{
+    for (int i = from; i < node->children.count(); ++i) {
+        node->children.at(i)->row = i;
+    }
+}
+
+
+void TOCEntryTreeModel::Materialize(Node *node)
+{
+    foreach(const TOCModel::TOCEntry &entry, node->pending) {
+        Node *child = new Node();
+        child->text = entry.text;
+        child->target = entry.target;
+        child->parent = node;
+        child->row = node->children.count();
+        child->pending = entry.children;
+        node->children.append(child);
+    }
+    node->pending.clear();
+}
+
+
+TOCModel::TOCEntry TOCEntryTreeModel::NodeToEntry(const Node *node)
+{
+    TOCModel::TOCEntry entry;
+    entry.text = node->text;
+    entry.target = node->target;
+
+    if (!node->pending.isEmpty()) {
+        entry.children = node->pending;
+    } else {
+        foreach(const Node *child, node->children) {
+            entry.children.append(NodeToEntry(child));
+        }
+    }
+
+    return entry;
+}
+
+
+int TOCEntryTreeModel::CountEntries(const QList<TOCModel::TOCEntry> &entries)
+{
+    int count = entries.count();
+    foreach(const TOCModel::TOCEntry &entry, entries) {
+        count += CountEntries(entry.children);
+    }
+    return count;
+}
@@ -0,0 +1,168 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef TOCENTRYTREEMODEL_H
+#define TOCENTRYTREEMODEL_H
+
+#include <QtCore/QAbstractItemModel>
+#include <QtCore/QList>
+
+#include "MainUI/TOCModel.h"
+
+/**
+ * The TOC entries edited in the Edit Table of Contents dialog.
+ *
+ * An entry's children are only made into rows when its branch is
+ * expanded; until then they are kept as the TOC entries they were
+ * read from, and saved as they are. Moving entries keeps the rows
+ * the view has, so their expansion and selection stay put.
+ */
+class TOCEntryTreeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+
+    enum Column {
+        TextColumn = 0,
+        TargetColumn,
+        ColumnCount
+    };
+
+    TOCEntryTreeModel(QObject *parent = 0);
+    ~TOCEntryTreeModel();
+
+    void SetRootEntry(const TOCModel::TOCEntry &root_entry);
+
+    /**
+     * @return The entries as they are now, under an invisible root entry.
+     */
+    TOCModel::TOCEntry GetRootEntry() const;
+
+    /**
+     * @return The number of entries the TOC was set with, counting
+     *         those not yet made into rows.
+     */
+    int EntryCount() const;
+
+    /**
+     * Makes the children of the entry at index into rows.
+     */
+    void FetchChildren(const QModelIndex &index);
+
+    /**
+     * Adds an empty entry as a sibling of the one at index,
+     * above or below it.
+     *
+     * @return The index of the new entry.
+     */
+    QModelIndex InsertEntry(const QModelIndex &index, bool above);
+
+    void RemoveEntry(const QModelIndex &index);
+
+    /**
+     * Moves the entry at index up a level, after its parent. The
+     * siblings that followed it become its children.
+     *
+     * @return The entry's new index, or an invalid index if it is
+     *         already at the top level.
+     */
+    QModelIndex MoveLeft(const QModelIndex &index);
+
+    /**
+     * Makes the entry at index the last child of the sibling above it.
+     *
+     * @return The entry's new index, or an invalid index if it has
+     *         no sibling above it.
+     */
+    QModelIndex MoveRight(const QModelIndex &index);
+
+    /**
+     * Swaps the entry at index with the sibling above or below it.
+     *
+     * @return The entry's new index, or an invalid index if there is
+     *         no sibling that way.
+     */
+    QModelIndex MoveUp(const QModelIndex &index);
+    QModelIndex MoveDown(const QModelIndex &index);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
+
+    QModelIndex parent(const QModelIndex &child) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+
+    bool canFetchMore(const QModelIndex &parent) const;
+
+    void fetchMore(const QModelIndex &parent);
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole);
+
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+
+private:
+
+    struct Node {
+        Node() : parent(NULL), row(0) {}
+        ~Node() {
+            qDeleteAll(children);
+        }
+
+        QString text;
+        QString target;
+        Node *parent;
+        // The row of this node in its parent
+        int row;
+        QList<Node *> children;
+        // The children not made into rows yet; a node has
+        // either these or children, never both
+        QList<TOCModel::TOCEntry> pending;
+    };
+
+    Node *NodeForIndex(const QModelIndex &index) const;
+
+    QModelIndex IndexForNode(Node *node, int column = TextColumn) const;
+
+    static void Renumber(Node *node, int from);
+
+    // Turns the pending children of node into child nodes
+    static void Materialize(Node *node);
+
+    static TOCModel::TOCEntry NodeToEntry(const Node *node);
+
+    static int CountEntries(const QList<TOCModel::TOCEntry> &entries);
+
+    Node *m_Root;
+
+    int m_EntryCount;
+};
+
+#endif // TOCENTRYTREEMODEL_H
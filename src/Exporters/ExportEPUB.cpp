@@ -23,30 +23,59 @@
 #define NOMINMAX
 #endif
 
+#include <algorithm>
 #include <string>
 #include <string.h>
 #include <zip.h>
+#include <unzip.h>
 #ifdef _WIN32
 #include <iowin32.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+#if defined(Q_OS_MAC) || defined(__APPLE__) || defined(__linux__)
+#include <sys/xattr.h>
 #endif
 
+#include <QtCore/QBuffer>
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QDirIterator>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
-#include <QtCore/QTemporaryFile>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
 #include <QtCore/QTextStream>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtConcurrent/QtConcurrent>
 
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "BookManipulation/XhtmlDoc.h"
 #include "Exporters/EncryptionXmlWriter.h"
 #include "Exporters/ExportEPUB.h"
+#include "Exporters/NCXWriter.h"
+#include "MainUI/TOCModel.h"
 #include "Misc/Utility.h"
+#include "Misc/SettingsStore.h"
 #include "Misc/TempFolder.h"
+#include "Misc/Trace.h"
 #include "Misc/FontObfuscation.h"
+#include "Misc/ZipIndex.h"
+#include "Misc/RemoteFile.h"
+#include "Misc/TaskScheduler.h"
 #include "ResourceObjects/FontResource.h"
+#include "ResourceObjects/HTMLResource.h"
+#include "ResourceObjects/NavProcessor.h"
+#include "ResourceObjects/NCXResource.h"
+#include "ResourceObjects/OPFParser.h"
+#include "ResourceObjects/OPFResource.h"
+#include "ResourceObjects/TextResource.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
@@ -65,6 +94,682 @@ static const QString OEBPS_FOLDER_SUFFIX   = "/OEBPS";
 
 static const char * EPUB_MIME_DATA = "application/epub+zip";
 
+// Media types whose content is already compressed
+static const QStringList COMPRESSED_IMAGE_TYPES = QStringList() << "image/jpeg" << "image/png" << "image/gif" << "image/webp";
+static const QStringList COMPRESSED_FONT_TYPES  = QStringList() << "application/font-woff" << "font/woff"
+                                                                << "application/font-woff2" << "font/woff2";
+
+// Upper bound on the uncompressed bytes compressed ahead of the writer
+// in one batch. Two batches are in memory at most (one being written
+// while the next one is being deflated).
+static const qint64 PIPELINE_BATCH_BYTES = 32 * 1024 * 1024;
+
+// One file of the publication on its way into the archive
+struct ZipEntryData {
+    QString fullpath;
+    QString relpath;
+    qint64 size;
+
+    // The resource the file belongs to, NULL for generated files
+    const Resource *resource;
+
+    // Compression chosen for this entry; method 0 (stored)
+    // or Z_DEFLATED with the given level and strategy
+    int method;
+    int level;
+    int strategy;
+
+    // Font obfuscation applied to the bytes on their way into
+    // the archive; empty key for anything but obfuscated fonts
+    QByteArray obfuscation_key;
+    int obfuscated_length;
+
+    // Content taken from the resource in memory rather than from
+    // the file at fullpath; encoded to UTF-8 by the compressor
+    bool has_text;
+    QString text;
+
+    // Raw deflate stream and CRC of the uncompressed data,
+    // valid only when deflated is true
+    QByteArray data;
+    uLong crc;
+    bool deflated;
+
+    // Location of the same path in the archive being replaced,
+    // used to copy the entry through untouched when its content
+    // has not changed since the last save
+    bool has_previous;
+    unz64_file_pos previous_pos;
+    int previous_method;
+    qint64 previous_size;
+    uLong previous_crc;
+    int previous_index;
+    bool reused;
+
+    // Never extracted from the archive being copied, so the entry at
+    // previous_pos is its content and it is copied through unread
+    bool unchanged;
+
+    // Has the content hash saved for the entry at previous_pos; copied
+    // through if its size and CRC agree with that entry as well
+    bool same_hash;
+};
+
+// Central directory facts about one entry of the archive being replaced
+struct PreviousZipEntry {
+    // Position in the central directory
+    int index;
+    unz64_file_pos pos;
+    qint64 size;
+    uLong crc;
+    int method;
+};
+
+
+// The path of the resource's file in the archive
+static QString PathInBook(const Resource *resource)
+{
+    QString relpath = resource->GetRelativePath();
+
+    while (relpath.startsWith("/")) {
+        relpath = relpath.remove(0, 1);
+    }
+
+    return relpath;
+}
+
+
+// The path in the archive of the file href points to from folder
+static QString ResolveHref(const QString &folder, const QString &href)
+{
+    return QDir::cleanPath(folder + "/" + href.split('#').at(0));
+}
+
+
+// Drops the children of entry whose target, resolved against folder,
+// is one of excluded, with everything under them
+static void RemoveTOCEntries(TOCModel::TOCEntry &entry, const QString &folder, const QSet<QString> &excluded)
+{
+    QList<TOCModel::TOCEntry> children;
+    foreach(TOCModel::TOCEntry child, entry.children) {
+        if (excluded.contains(ResolveHref(folder, child.target))) {
+            continue;
+        }
+
+        RemoveTOCEntries(child, folder, excluded);
+        // Parsed decoded, written as it is
+        child.target = Utility::URLEncodePath(child.target);
+        children.append(child);
+    }
+    entry.children = children;
+}
+
+
+// Reads the central directory of the archive we are about to
+// overwrite. Only plain (unencrypted, stored or deflated) entries
+// with UTF-8 names are eligible for reuse.
+static QHash<QString, PreviousZipEntry> ReadPreviousEntries(unzFile uzfile)
+{
+    QHash<QString, PreviousZipEntry> previous;
+    ZipIndex index;
+    index.Load(uzfile);
+    const QVector<ZipIndex::Entry> &zentries = index.Entries();
+
+    for (int i = 0; i < zentries.count(); ++i) {
+        const ZipIndex::Entry &zentry = zentries.at(i);
+
+        if (!zentry.IsUtf8Name() || zentry.IsEncrypted() ||
+            (zentry.method != 0 && zentry.method != Z_DEFLATED)) {
+            continue;
+        }
+
+        PreviousZipEntry entry;
+        entry.index = i;
+        entry.pos = zentry.pos;
+        entry.size = zentry.uncompressed_size;
+        entry.crc = zentry.crc;
+        entry.method = zentry.method;
+        previous.insert(zentry.name, entry);
+    }
+
+    return previous;
+}
+
+
+// Adds one file to the archive by streaming it from disk
+// through minizip's own deflate.
+static void WriteEntryStreamed(zipFile zfile, const zip_fileinfo &fileInfo, const ZipEntryData &entry, const QString &tempFile)
+{
+    // Add the file entry to the archive.
+    // We should check the uncompressed file size. If it's over >= 0xffffffff the last parameter (zip64) should be 1.
+    if (zipOpenNewFileInZip4_64(zfile, entry.relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL, entry.method, entry.level, 0, 15, 8, entry.strategy, NULL, 0, 0x0b00, 1<<11, 0) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    // Open the file on disk (or the text held in memory). We will read
+    // this and write what we read into the archive.
+    QFile dfile(entry.fullpath);
+    QByteArray text_data;
+    QBuffer text_buffer(&text_data);
+    QIODevice *source = &dfile;
+
+    if (entry.has_text) {
+        text_data = entry.text.toUtf8();
+        source = &text_buffer;
+    }
+
+    if (!source->open(QIODevice::ReadOnly)) {
+        zipCloseFileInZip(zfile);
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotOpenFile(QFileInfo(entry.fullpath).fileName().toStdString()));
+    }
+
+    // Write the data from the file on disk into the archive.
+    char buff[BUFF_SIZE] = {0};
+    qint64 read = 0;
+    qint64 offset = 0;
+
+    while ((read = source->read(buff, BUFF_SIZE)) > 0) {
+        if (offset < entry.obfuscated_length) {
+            FontObfuscation::ObfuscateBuffer(buff, read, offset, entry.obfuscation_key, entry.obfuscated_length);
+        }
+
+        offset += read;
+
+        if (zipWriteInFileInZip(zfile, buff, read) != ZIP_OK) {
+            source->close();
+            zipCloseFileInZip(zfile);
+            zipClose(zfile, NULL);
+            QFile::remove(tempFile);
+            throw(CannotStoreFile(entry.relpath.toStdString()));
+        }
+    }
+
+    source->close();
+
+    // There was an error reading the file on disk.
+    if (read < 0) {
+        zipCloseFileInZip(zfile);
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    if (zipCloseFileInZip(zfile) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+}
+
+
+// Whether the bytes going into the entry have the size and CRC of
+// the entry being replaced. Files are read in pieces, not held whole.
+static bool MatchesPreviousEntry(const ZipEntryData &entry)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    qint64 size = 0;
+
+    if (entry.has_text) {
+        QByteArray input = entry.text.toUtf8();
+        size = input.size();
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(input.constData()), input.size());
+    } else {
+        QFile dfile(entry.fullpath);
+
+        if (!dfile.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        char buff[BUFF_SIZE];
+        qint64 read = 0;
+
+        while ((read = dfile.read(buff, BUFF_SIZE)) > 0) {
+            size += read;
+            crc = crc32(crc, reinterpret_cast<const Bytef *>(buff), static_cast<uInt>(read));
+        }
+
+        if (read < 0) {
+            return false;
+        }
+    }
+
+    return size == entry.previous_size && crc == entry.previous_crc;
+}
+
+
+// Compresses one file into a raw (headerless) deflate buffer
+// with the same parameters the streamed writer uses.
+// Runs on the global thread pool; on any failure the entry
+// is left undeflated and the writer streams it instead.
+static void DeflateEntry(ZipEntryData &entry)
+{
+    entry.deflated = false;
+    entry.reused = false;
+    entry.data.clear();
+
+    if (entry.unchanged) {
+        entry.reused = true;
+        return;
+    }
+
+    // Reuse is decided by the content hash alone; the size and CRC
+    // only catch a hash that does not belong to the old entry
+    if (entry.same_hash && MatchesPreviousEntry(entry)) {
+        entry.size = entry.previous_size;
+        entry.crc = entry.previous_crc;
+        entry.reused = true;
+        return;
+    }
+
+    // Very large entries are not worth holding in memory whole
+    if (entry.size > TaskScheduler::InFlightBytes(PIPELINE_BATCH_BYTES)) {
+        return;
+    }
+
+    QByteArray input;
+
+    if (entry.has_text) {
+        input = entry.text.toUtf8();
+    } else {
+        QFile dfile(entry.fullpath);
+
+        if (!dfile.open(QIODevice::ReadOnly)) {
+            return;
+        }
+
+        input = dfile.readAll();
+        dfile.close();
+    }
+
+    entry.size = input.size();
+
+    if (entry.obfuscated_length > 0) {
+        FontObfuscation::ObfuscateBuffer(input.data(), input.size(), 0, entry.obfuscation_key, entry.obfuscated_length);
+    }
+
+    entry.crc = crc32(0L, Z_NULL, 0);
+    entry.crc = crc32(entry.crc, reinterpret_cast<const Bytef *>(input.constData()), input.size());
+
+    // Stored entries are written as they are
+    if (entry.method == 0) {
+        entry.data = input;
+        entry.deflated = true;
+        return;
+    }
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+
+    if (deflateInit2(&strm, entry.level, Z_DEFLATED, -MAX_WBITS, 8, entry.strategy) != Z_OK) {
+        return;
+    }
+
+    entry.data.resize(deflateBound(&strm, input.size()));
+    strm.next_in = reinterpret_cast<Bytef *>(input.data());
+    strm.avail_in = input.size();
+    strm.next_out = reinterpret_cast<Bytef *>(entry.data.data());
+    strm.avail_out = entry.data.size();
+
+    if (deflate(&strm, Z_FINISH) == Z_STREAM_END) {
+        entry.data.resize(strm.total_out);
+        entry.deflated = true;
+    } else {
+        entry.data.clear();
+    }
+
+    deflateEnd(&strm);
+}
+
+
+// Appends an entry that was already compressed by DeflateEntry
+// using minizip's raw write API.
+static void WriteEntryRaw(zipFile zfile, const zip_fileinfo &fileInfo, const ZipEntryData &entry, const QString &tempFile)
+{
+    if (zipOpenNewFileInZip4_64(zfile, entry.relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL, entry.method, entry.level, 1, -MAX_WBITS, 8, entry.strategy, NULL, 0, 0x0b00, 1<<11, 0) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    if (!entry.data.isEmpty() &&
+        zipWriteInFileInZip(zfile, entry.data.constData(), (unsigned int)entry.data.size()) != ZIP_OK) {
+        zipCloseFileInZipRaw64(zfile, entry.size, entry.crc);
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    if (zipCloseFileInZipRaw64(zfile, entry.size, entry.crc) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+}
+
+
+// Appends an entry by copying its compressed bytes unchanged from the
+// archive being replaced. Returns false, without touching the new
+// archive, when the old entry can't be read; the caller then compresses
+// the file normally.
+static bool CopyEntryRaw(zipFile zfile, const zip_fileinfo &fileInfo, const ZipEntryData &entry, unzFile uzfile, const QString &tempFile)
+{
+    if (uzfile == NULL || unzGoToFilePos64(uzfile, &entry.previous_pos) != UNZ_OK) {
+        return false;
+    }
+
+    int method = 0;
+    int level = 0;
+
+    // The level is the one the entry's header flags stand for, so
+    // passing it on keeps those flags as they were
+    if (unzOpenCurrentFile2(uzfile, &method, &level, 1) != UNZ_OK) {
+        return false;
+    }
+
+    QByteArray compressed;
+    char buff[BUFF_SIZE] = {0};
+    int read = 0;
+
+    while ((read = unzReadCurrentFile(uzfile, buff, BUFF_SIZE)) > 0) {
+        compressed.append(buff, read);
+    }
+
+    unzCloseCurrentFile(uzfile);
+
+    if (read < 0) {
+        return false;
+    }
+
+    if (zipOpenNewFileInZip4_64(zfile, entry.relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL, method, level, 1, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY, NULL, 0, 0x0b00, 1<<11, 0) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    if (!compressed.isEmpty() &&
+        zipWriteInFileInZip(zfile, compressed.constData(), (unsigned int)compressed.size()) != ZIP_OK) {
+        zipCloseFileInZipRaw64(zfile, entry.size, entry.crc);
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    if (zipCloseFileInZipRaw64(zfile, entry.size, entry.crc) != ZIP_OK) {
+        zipClose(zfile, NULL);
+        QFile::remove(tempFile);
+        throw(CannotStoreFile(entry.relpath.toStdString()));
+    }
+
+    return true;
+}
+
+
+// Appends one entry after DeflateEntry: copied from the previous archive,
+// written from its compressed data, or streamed when neither worked out.
+// Whichever way it goes the bytes are the same for the same content,
+// so the archive does not depend on how many threads compressed it.
+static void WriteEntry(zipFile zfile, const zip_fileinfo &fileInfo, ZipEntryData &entry, unzFile uzfile, const QString &tempFile)
+{
+    if (entry.reused && CopyEntryRaw(zfile, fileInfo, entry, uzfile, tempFile)) {
+        // copied through from the previous archive
+    } else if (entry.deflated) {
+        WriteEntryRaw(zfile, fileInfo, entry, tempFile);
+    } else {
+        // An entry that was to be copied through may not be out of the EPUB yet;
+        // its placeholder must not go into the archive in its place
+        if (entry.resource && !entry.resource->LoadDeferredContent()) {
+            zipClose(zfile, NULL);
+            QFile::remove(tempFile);
+            throw(CannotReadFile(entry.fullpath.toStdString()));
+        }
+
+        WriteEntryStreamed(zfile, fileInfo, entry, tempFile);
+    }
+
+    // Release the compressed data as soon as it is written
+    entry.data = QByteArray();
+}
+
+
+// Compresses the entries on the global thread pool in bounded batches
+// while this thread appends the previous batch to the archive in order.
+static void WriteEntriesPipelined(zipFile zfile, const zip_fileinfo &fileInfo, QVector<ZipEntryData> &entries, unzFile uzfile, const QString &tempFile)
+{
+    // Split the entries into batches of roughly PIPELINE_BATCH_BYTES,
+    // less under a memory limit; two batches are in flight at once
+    const qint64 batch_limit = TaskScheduler::InFlightBytes(PIPELINE_BATCH_BYTES);
+    QList<int> batch_starts;
+    qint64 batch_bytes = 0;
+
+    for (int i = 0; i < entries.count(); ++i) {
+        if (i == 0 || batch_bytes >= batch_limit) {
+            batch_starts.append(i);
+            batch_bytes = 0;
+        }
+
+        batch_bytes += entries.at(i).size;
+    }
+
+    batch_starts.append(entries.count());
+
+    if (batch_starts.count() < 2) {
+        return;
+    }
+
+    QFuture<void> current = QtConcurrent::map(entries.begin() + batch_starts.at(0),
+                                              entries.begin() + batch_starts.at(1),
+                                              DeflateEntry);
+
+    for (int b = 0; b < batch_starts.count() - 1; ++b) {
+        current.waitForFinished();
+        QFuture<void> next;
+
+        if (b + 2 < batch_starts.count()) {
+            next = QtConcurrent::map(entries.begin() + batch_starts.at(b + 1),
+                                     entries.begin() + batch_starts.at(b + 2),
+                                     DeflateEntry);
+        }
+
+        try {
+            for (int i = batch_starts.at(b); i < batch_starts.at(b + 1); ++i) {
+                WriteEntry(zfile, fileInfo, entries[i], uzfile, tempFile);
+            }
+        } catch (...) {
+            // The workers still reference the entries
+            next.waitForFinished();
+            throw;
+        }
+
+        current = next;
+    }
+}
+
+
+
+// Orders entries by their path in the archive, compared code unit
+// by code unit so that the locale has no say in it
+static bool EntryInPathOrder(const ZipEntryData &first, const ZipEntryData &second)
+{
+    return first.relpath < second.relpath;
+}
+
+
+// Orders entries as they were in the archive being replaced,
+// with those new to it last
+static bool EntryInPreviousOrder(const ZipEntryData &first, const ZipEntryData &second)
+{
+    if (first.has_previous != second.has_previous) {
+        return first.has_previous;
+    }
+
+    if (first.has_previous && first.previous_index != second.previous_index) {
+        return first.previous_index < second.previous_index;
+    }
+
+    return first.relpath < second.relpath;
+}
+
+
+// Decides how one file is compressed from its media type.
+// Formats that are already compressed gain nothing from deflate
+// and are stored; everything else uses level 8 like before.
+// Each class can be overridden in the settings as "level,strategy".
+static void SetCompressionPolicy(ZipEntryData &entry, const QString &media_type, SettingsStore &settings)
+{
+    QString media_class = "text";
+
+    if (COMPRESSED_IMAGE_TYPES.contains(media_type)) {
+        media_class = "image";
+    } else if (media_type.startsWith("audio/")) {
+        media_class = "audio";
+    } else if (media_type.startsWith("video/")) {
+        media_class = "video";
+    } else if (COMPRESSED_FONT_TYPES.contains(media_type)) {
+        media_class = "compressed_font";
+    } else if (media_type.contains("font") || media_type.contains("opentype")) {
+        media_class = "font";
+    }
+
+    int level = (media_class == "text" || media_class == "font") ? 8 : 0;
+    int strategy = Z_DEFAULT_STRATEGY;
+    QStringList policy = settings.exportCompression(media_class).split(',', QString::SkipEmptyParts);
+
+    if (!policy.isEmpty()) {
+        bool ok = false;
+        int value = policy.at(0).trimmed().toInt(&ok);
+
+        if (ok && value >= 0 && value <= 9) {
+            level = value;
+        }
+
+        if (policy.count() > 1) {
+            value = policy.at(1).trimmed().toInt(&ok);
+
+            if (ok && value >= Z_DEFAULT_STRATEGY && value <= Z_FIXED) {
+                strategy = value;
+            }
+        }
+    }
+
+    entry.method = level == 0 ? 0 : Z_DEFLATED;
+    entry.level = level;
+    entry.strategy = strategy;
+}
+
+
+// Forces the written data of a closed file out to stable storage
+static bool SyncFileToDisk(const QString &path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN32
+    bool synced = _commit(file.handle()) == 0;
+#else
+    bool synced = fsync(file.handle()) == 0;
+#endif
+    file.close();
+    return synced;
+}
+
+
+// Carries the extended attributes (Finder labels, tags, quarantine, etc.)
+// of the file being replaced over to its replacement. Best effort.
+static void CopyExtendedAttributes(const QString &source, const QString &destination)
+{
+#if defined(Q_OS_MAC) || defined(__APPLE__)
+    QByteArray src = QFile::encodeName(source);
+    QByteArray dst = QFile::encodeName(destination);
+    ssize_t length = listxattr(src.constData(), NULL, 0, XATTR_NOFOLLOW);
+
+    if (length <= 0) {
+        return;
+    }
+
+    QByteArray names(length, 0);
+    length = listxattr(src.constData(), names.data(), names.size(), XATTR_NOFOLLOW);
+
+    for (const char *name = names.constData(); length > 0 && name < names.constData() + length; name += strlen(name) + 1) {
+        ssize_t size = getxattr(src.constData(), name, NULL, 0, 0, XATTR_NOFOLLOW);
+
+        if (size < 0) {
+            continue;
+        }
+
+        QByteArray value(size, 0);
+
+        if (getxattr(src.constData(), name, value.data(), value.size(), 0, XATTR_NOFOLLOW) == size) {
+            setxattr(dst.constData(), name, value.constData(), value.size(), 0, XATTR_NOFOLLOW);
+        }
+    }
+#elif defined(__linux__)
+    QByteArray src = QFile::encodeName(source);
+    QByteArray dst = QFile::encodeName(destination);
+    ssize_t length = llistxattr(src.constData(), NULL, 0);
+
+    if (length <= 0) {
+        return;
+    }
+
+    QByteArray names(length, 0);
+    length = llistxattr(src.constData(), names.data(), names.size());
+
+    for (const char *name = names.constData(); length > 0 && name < names.constData() + length; name += strlen(name) + 1) {
+        ssize_t size = lgetxattr(src.constData(), name, NULL, 0);
+
+        if (size < 0) {
+            continue;
+        }
+
+        QByteArray value(size, 0);
+
+        if (lgetxattr(src.constData(), name, value.data(), value.size()) == size) {
+            lsetxattr(dst.constData(), name, value.constData(), value.size(), 0);
+        }
+    }
+#else
+    Q_UNUSED(source);
+    Q_UNUSED(destination);
+#endif
+}
+
+
+// Replaces target with source in one rename so that the target is
+// never seen half written. Returns false if the platform refused the
+// rename, in which case both files are left as they were.
+static bool ReplaceFileAtomically(const QString &source, const QString &target)
+{
+    if (!SyncFileToDisk(source)) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN32
+    std::wstring wsource = Utility::QStringToStdWString(QDir::toNativeSeparators(source));
+    std::wstring wtarget = Utility::QStringToStdWString(QDir::toNativeSeparators(target));
+
+    // ReplaceFile keeps the target's attributes, ACLs and alternate streams
+    if (QFileInfo(target).exists()) {
+        return ReplaceFileW(wtarget.c_str(), wsource.c_str(), NULL, REPLACEFILE_IGNORE_MERGE_ERRORS, NULL, NULL) != 0;
+    }
+
+    return MoveFileExW(wsource.c_str(), wtarget.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (QFileInfo(target).exists()) {
+        QFile::setPermissions(source, QFile::permissions(target));
+        CopyExtendedAttributes(target, source);
+    }
+
+    return ::rename(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0;
+#endif
+}
+
 
 // Constructor;
 // the first parameter is the location where the book
@@ -87,6 +792,7 @@ ExportEPUB::~ExportEPUB()
 // specified in the constructor
 void ExportEPUB::WriteBook()
 {
+    SIGIL_TRACE_SCOPE("Export EPUB");
     // Obfuscating fonts needs an UUID ident
     if (m_Book->HasObfuscatedFonts()) {
         m_Book->GetOPF()->EnsureUUIDIdentifierPresent();
@@ -97,12 +803,58 @@ void ExportEPUB::WriteBook()
     m_Book->SaveAllResourcesToDisk();
     TempFolder tempfolder;
     CreatePublication(tempfolder.GetPath());
+    CollectInMemoryText();
 
     if (m_Book->HasObfuscatedFonts()) {
-        ObfuscateFonts(tempfolder.GetPath());
+        PrepareFontObfuscation();
     }
 
-    SaveFolderAsEpubToLocation(tempfolder.GetPath(), m_FullFilePath);
+    // The book folder is zipped in place; only the generated files
+    // live in the temp folder and text comes from memory.
+    SaveFolderAsEpubToLocation(m_Book->GetFolderKeeper()->GetFullPathToMainFolder(), m_FullFilePath);
+}
+
+
+// Writes a copy of the book, or of a subset of its resources,
+// leaving the book as it is
+void ExportEPUB::WriteCopy(const QString &source_path, const QList<Resource *> &subset)
+{
+    SIGIL_TRACE_SCOPE("Export EPUB copy");
+    m_SourcePath = source_path;
+
+    if (!subset.isEmpty()) {
+        QSet<Resource *> kept = QSet<Resource *>::fromList(subset);
+        kept.insert(m_Book->GetOPF());
+
+        if (m_Book->GetNCX()) {
+            kept.insert(m_Book->GetNCX());
+        }
+
+        if (m_Book->GetConstOPF()->GetNavResource()) {
+            kept.insert(m_Book->GetConstOPF()->GetNavResource());
+        }
+
+        foreach(Resource *resource, m_Book->GetFolderKeeper()->GetResourceList()) {
+            if (!kept.contains(resource)) {
+                m_ExcludedResources.append(resource);
+                m_ExcludedPaths.insert(PathInBook(resource));
+            }
+        }
+    }
+
+    TempFolder tempfolder;
+    CreatePublication(tempfolder.GetPath());
+    CollectInMemoryText();
+
+    if (!m_ExcludedResources.isEmpty()) {
+        CollectSubsetText();
+    }
+
+    if (m_Book->HasObfuscatedFonts()) {
+        PrepareFontObfuscation();
+    }
+
+    SaveFolderAsEpubToLocation(m_Book->GetFolderKeeper()->GetFullPathToMainFolder(), m_FullFilePath);
 }
 
 
@@ -110,17 +862,205 @@ void ExportEPUB::WriteBook()
 // (creates XHTML, CSS, OPF, NCX files etc.)
 void ExportEPUB::CreatePublication(const QString &fullfolderpath)
 {
-    Utility::CopyFiles(m_Book->GetFolderKeeper()->GetFullPathToMainFolder(), fullfolderpath);
-
     if (m_Book->HasObfuscatedFonts()) {
+        QDir(fullfolderpath).mkpath(METAINF_FOLDER_SUFFIX.mid(1));
         CreateEncryptionXML(fullfolderpath + METAINF_FOLDER_SUFFIX);
+        m_GeneratedFiles.insert(METAINF_FOLDER_SUFFIX.mid(1) + "/" + ENCRYPTION_XML_FILE_NAME,
+                                fullfolderpath + METAINF_FOLDER_SUFFIX + "/" + ENCRYPTION_XML_FILE_NAME);
+    }
+}
+
+
+// Takes a snapshot of the text of every text resource that is
+// held in memory, so that it is zipped without being read back
+void ExportEPUB::CollectInMemoryText()
+{
+    QList<TextResource *> text_resources = m_Book->GetFolderKeeper()->GetResourceTypeList<TextResource>();
+    foreach(TextResource *text_resource, text_resources) {
+        if (!text_resource->HasTextInMemory()) {
+            continue;
+        }
+
+        QString relpath = text_resource->GetRelativePath();
+
+        while (relpath.startsWith("/")) {
+            relpath = relpath.remove(0, 1);
+        }
+
+        m_InMemoryText.insert(relpath, text_resource->GetText());
+    }
+}
+
+void ExportEPUB::CollectSubsetText()
+{
+    // The OPF without the manifest items of the files left out, nor
+    // the spine, guide, bindings and refining metadata that use them
+    OPFResource *opf = m_Book->GetOPF();
+    const QString opf_path = PathInBook(opf);
+    const QString opf_folder = QFileInfo(opf_path).path();
+    OPFParser opf_parser;
+    opf_parser.parse(opf->GetText());
+    QSet<QString> removed_ids;
+
+    for (int i = opf_parser.m_manifest.count() - 1; i >= 0; --i) {
+        const ManifestEntry &item = opf_parser.m_manifest.at(i);
+
+        if (m_ExcludedPaths.contains(ResolveHref(opf_folder, Utility::URLDecodePath(item.m_href)))) {
+            removed_ids.insert(item.m_id);
+            opf_parser.m_manifest.removeAt(i);
+        }
+    }
+
+    for (int i = opf_parser.m_spine.count() - 1; i >= 0; --i) {
+        if (removed_ids.contains(opf_parser.m_spine.at(i).m_idref)) {
+            opf_parser.m_spine.removeAt(i);
+        }
+    }
+
+    for (int i = opf_parser.m_guide.count() - 1; i >= 0; --i) {
+        if (m_ExcludedPaths.contains(ResolveHref(opf_folder, Utility::URLDecodePath(opf_parser.m_guide.at(i).m_href)))) {
+            opf_parser.m_guide.removeAt(i);
+        }
+    }
+
+    for (int i = opf_parser.m_bindings.count() - 1; i >= 0; --i) {
+        if (removed_ids.contains(opf_parser.m_bindings.at(i).m_handler)) {
+            opf_parser.m_bindings.removeAt(i);
+        }
+    }
+
+    for (int i = opf_parser.m_metadata.count() - 1; i >= 0; --i) {
+        QString refines = opf_parser.m_metadata.at(i).m_atts.value("refines");
+
+        if (refines.startsWith("#") && removed_ids.contains(refines.mid(1))) {
+            opf_parser.m_metadata.removeAt(i);
+        }
+    }
+
+    m_InMemoryText.insert(opf_path, opf_parser.convert_to_xml());
+
+    // The NCX without the navPoints into the files left out
+    NCXResource *ncx = m_Book->GetNCX();
+
+    if (ncx) {
+        const QString ncx_path = PathInBook(ncx);
+        TOCModel::TOCEntry root = TOCModel::ParseNCX(ncx->GetText());
+        RemoveTOCEntries(root, QFileInfo(ncx_path).path(), m_ExcludedPaths);
+        QByteArray raw_ncx;
+        QBuffer buffer(&raw_ncx);
+        buffer.open(QIODevice::WriteOnly);
+        NCXWriter ncx_writer(m_Book.data(), buffer, root);
+        ncx_writer.WriteXML();
+        buffer.close();
+        m_InMemoryText.insert(ncx_path, CleanSource::ProcessXML(QString::fromUtf8(raw_ncx.constData(), raw_ncx.size()),
+                                                                "application/x-dtbncx+xml"));
+    }
+
+    // The nav without the entries into the files left out
+    HTMLResource *nav = m_Book->GetConstOPF()->GetNavResource();
+
+    if (nav) {
+        QSet<QString> excluded_oebps_paths;
+        foreach(Resource *resource, m_ExcludedResources) {
+            excluded_oebps_paths.insert(resource->GetRelativePathToOEBPS());
+        }
+        NavProcessor navproc(nav);
+        m_InMemoryText.insert(PathInBook(nav), navproc.GetTextWithout(excluded_oebps_paths));
+    }
+}
+
+
+QDateTime ExportEPUB::GetEntryTimestamp() const
+{
+    // The time reproducible builds agree on, in seconds since the epoch
+    bool ok = false;
+    qint64 epoch = qgetenv("SOURCE_DATE_EPOCH").trimmed().toLongLong(&ok);
+    QDateTime timestamp;
+
+    if (ok) {
+        timestamp = QDateTime::fromMSecsSinceEpoch(epoch * 1000, Qt::UTC);
+    } else {
+        // Otherwise the modification date of the book
+        OPFParser opf_parser;
+        opf_parser.parse(m_Book->GetOPF()->GetText());
+
+        foreach(const MetaEntry &me, opf_parser.m_metadata) {
+            if ((me.m_name == "meta" && me.m_atts.value("property") == "dcterms:modified") ||
+                (me.m_name == "dc:date" && me.m_atts.value("opf:event") == "modification")) {
+                timestamp = QDateTime::fromString(me.m_content.trimmed(), Qt::ISODate);
+
+                // A date without a zone is taken as UTC wherever we are
+                if (timestamp.timeSpec() == Qt::LocalTime) {
+                    timestamp.setTimeSpec(Qt::UTC);
+                }
+
+                timestamp = timestamp.toUTC();
+                break;
+            }
+        }
+    }
+
+    // Zip times start in 1980
+    if (!timestamp.isValid() || timestamp.date().year() < 1980) {
+        timestamp = QDateTime(QDate(1980, 1, 1), QTime(0, 0), Qt::UTC);
+    }
+
+    return timestamp;
+}
+
+
+ZipEntryData ExportEPUB::CreateZipEntry(const QString &fullpath, const QString &relpath, SettingsStore &settings) const
+{
+    ZipEntryData entry;
+    entry.fullpath = m_GeneratedFiles.value(relpath, fullpath);
+    entry.relpath = relpath;
+    entry.resource = NULL;
+    entry.has_text = m_InMemoryText.contains(relpath);
+
+    if (entry.has_text) {
+        entry.text = m_InMemoryText.value(relpath);
+        // Good enough for batching, the exact size is known once encoded
+        entry.size = entry.text.size();
+    } else {
+        entry.size = QFileInfo(entry.fullpath).size();
+    }
+
+    SetCompressionPolicy(entry, m_Book->GetFolderKeeper()->GetMediaTypeForExtension(QFileInfo(relpath).suffix()), settings);
+    entry.obfuscated_length = 0;
+
+    if (m_FontObfuscation.contains(relpath)) {
+        entry.obfuscation_key = m_FontObfuscation.value(relpath).first;
+        entry.obfuscated_length = m_FontObfuscation.value(relpath).second;
     }
+
+    entry.crc = 0;
+    entry.deflated = false;
+    entry.has_previous = false;
+    entry.previous_method = 0;
+    entry.previous_size = 0;
+    entry.previous_crc = 0;
+    entry.previous_index = -1;
+    entry.reused = false;
+    entry.unchanged = false;
+    entry.same_hash = false;
+    return entry;
 }
 
+
 void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const QString &fullfilepath)
 {
-    QString tempFile = fullfolderpath + "-tmp.epub";
-    QDateTime timeNow = QDateTime::currentDateTime();
+    // Write the archive next to the target when we can, so that it can be
+    // renamed over the target instead of being copied back into it.
+    // A remote target is written locally and uploaded whole
+    const bool remote = RemoteFile::IsRemote(fullfilepath);
+    QFileInfo target_info(fullfilepath);
+    bool atomic_replace = !remote && !target_info.isSymLink() && QFileInfo(target_info.absolutePath()).isWritable();
+    QString tempFile = atomic_replace ?
+                       target_info.absolutePath() + "/." + target_info.fileName() + "-tmp.epub" :
+                       fullfolderpath + "-tmp.epub";
+    // Every entry gets the same time, so that saving the same book
+    // twice gives the same archive
+    QDateTime timestamp = GetEntryTimestamp();
     zip_fileinfo fileInfo;
 #ifdef Q_OS_WIN32
     zlib_filefunc64_def ffunc;
@@ -135,12 +1075,12 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
     }
 
     memset(&fileInfo, 0, sizeof(fileInfo));
-    fileInfo.tmz_date.tm_sec = timeNow.time().second();
-    fileInfo.tmz_date.tm_min = timeNow.time().minute();
-    fileInfo.tmz_date.tm_hour = timeNow.time().hour();
-    fileInfo.tmz_date.tm_mday = timeNow.date().day();
-    fileInfo.tmz_date.tm_mon = timeNow.date().month() - 1;
-    fileInfo.tmz_date.tm_year = timeNow.date().year();
+    fileInfo.tmz_date.tm_sec = timestamp.time().second();
+    fileInfo.tmz_date.tm_min = timestamp.time().minute();
+    fileInfo.tmz_date.tm_hour = timestamp.time().hour();
+    fileInfo.tmz_date.tm_mday = timestamp.date().day();
+    fileInfo.tmz_date.tm_mon = timestamp.date().month() - 1;
+    fileInfo.tmz_date.tm_year = timestamp.date().year();
 
     // Write the mimetype. This must be uncompressed and the first entry in the archive.
     if (zipOpenNewFileInZip64(zfile, "mimetype", &fileInfo, NULL, 0, NULL, 0, NULL, Z_NO_COMPRESSION, 0, 0) != ZIP_OK) {
@@ -158,6 +1098,9 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
 
     zipCloseFileInZip(zfile);
     // Write all the files in our directory path to the archive.
+    QVector<ZipEntryData> entries;
+    SettingsStore settings;
+    QSet<QString> generated = QSet<QString>::fromList(m_GeneratedFiles.keys());
     QDirIterator it(fullfolderpath, QDir::Files | QDir::NoDotAndDotDot | QDir::Readable | QDir::Hidden, QDirIterator::Subdirectories);
 
     while (it.hasNext()) {
@@ -168,60 +1111,142 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
             relpath = relpath.remove(0, 1);
         }
 
-        // Add the file entry to the archive.
-        // We should check the uncompressed file size. If it's over >= 0xffffffff the last parameter (zip64) should be 1.
-        if (zipOpenNewFileInZip4_64(zfile, relpath.toUtf8().constData(), &fileInfo, NULL, 0, NULL, 0, NULL, Z_DEFLATED, 8, 0, 15, 8, Z_DEFAULT_STRATEGY, NULL, 0, 0x0b00, 1<<11, 0) != ZIP_OK) {
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
+        if (m_ExcludedPaths.contains(relpath)) {
+            continue;
         }
 
-        // Open the file on disk. We will read this and write what we read into
-        // the archive.
-        QFile dfile(it.filePath());
+        ZipEntryData entry = CreateZipEntry(it.filePath(), relpath, settings);
+        entry.resource = m_Book->GetFolderKeeper()->GetResourceByFullPath(it.filePath());
+        entries.append(entry);
+        generated.remove(relpath);
+    }
 
-        if (!dfile.open(QIODevice::ReadOnly)) {
-            zipCloseFileInZip(zfile);
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotOpenFile(it.fileName().toStdString()));
-        }
+    // Generated files that have no counterpart in the folder
+    foreach(QString relpath, generated) {
+        entries.append(CreateZipEntry(m_GeneratedFiles.value(relpath), relpath, settings));
+    }
 
-        // Write the data from the file on disk into the archive.
-        char buff[BUFF_SIZE] = {0};
-        qint64 read = 0;
+    // Entries whose content is unchanged since the book was saved to the
+    // archive being replaced (or copied) are copied from it without
+    // inflating and deflating again. That is known either from where the
+    // content still lives or from its content hash, never from the CRC.
+    const QString previous_path = m_SourcePath.isEmpty() ? fullfilepath : m_SourcePath;
+    unzFile uzfile = NULL;
 
-        while ((read = dfile.read(buff, BUFF_SIZE)) > 0) {
-            if (zipWriteInFileInZip(zfile, buff, read) != ZIP_OK) {
-                dfile.close();
-                zipCloseFileInZip(zfile);
-                zipClose(zfile, NULL);
-                QFile::remove(tempFile);
-                throw(CannotStoreFile(relpath.toStdString()));
+    if (!m_SourcePath.isEmpty() || QFileInfo(fullfilepath).isFile()) {
+        uzfile = ZipIndex::OpenZip(previous_path);
+    }
+
+    if (uzfile != NULL) {
+        QHash<QString, PreviousZipEntry> previous = ReadPreviousEntries(uzfile);
+        QHash<QString, QByteArray> saved_hashes = m_Book->GetFolderKeeper()->GetSavedContentHashes(previous_path);
+        const bool replacing_source = QFileInfo(previous_path) == QFileInfo(fullfilepath);
+
+        for (int i = 0; i < entries.count(); ++i) {
+            ZipEntryData &entry = entries[i];
+            QHash<QString, PreviousZipEntry>::const_iterator prev = previous.constFind(entry.relpath);
+
+            if (prev == previous.constEnd()) {
+                continue;
+            }
+
+            entry.has_previous = true;
+            entry.previous_pos = prev.value().pos;
+            entry.previous_method = prev.value().method;
+            entry.previous_size = prev.value().size;
+            entry.previous_crc = prev.value().crc;
+            entry.previous_index = prev.value().index;
+
+            if (!entry.resource || entry.obfuscated_length != 0 || entry.previous_method != entry.method) {
+                continue;
+            }
+
+            // Never extracted from the archive being copied, so its entry
+            // there is the content. When that archive is being replaced the
+            // content must come out of it first, so it is loaded below.
+            if (!replacing_source && entry.resource->IsDeferredFrom(previous_path, entry.relpath)) {
+                entry.unchanged = true;
+                entry.size = entry.previous_size;
+                entry.crc = entry.previous_crc;
+                continue;
+            }
+
+            // The hash is of the file, which is only the content if nothing
+            // newer is held in memory; obfuscated fonts depend on the identifier too
+            if (!entry.resource->IsDirty() && entry.resource->HasContentHash()) {
+                const QByteArray saved_hash = saved_hashes.value(entry.resource->GetRelativePathToRoot());
+
+                if (!saved_hash.isEmpty() && saved_hash == entry.resource->GetContentHash()) {
+                    entry.same_hash = true;
+                }
             }
         }
+    }
 
-        dfile.close();
+    // The folder is listed in whatever order the file system keeps it;
+    // the archive is sorted by path, or kept in the order of the archive
+    // being replaced with anything new after it, sorted by path too
+    if (settings.exportKeepEntryOrder()) {
+        std::sort(entries.begin(), entries.end(), EntryInPreviousOrder);
+    } else {
+        std::sort(entries.begin(), entries.end(), EntryInPathOrder);
+    }
+
+    // Anything else is read from the folder, so lazily opened files must be in it
+    foreach(const ZipEntryData &entry, entries) {
+        if (entry.resource && !entry.unchanged && !entry.resource->LoadDeferredContent()) {
+            if (uzfile != NULL) {
+                unzClose(uzfile);
+            }
 
-        // There was an error reading the file on disk.
-        if (read < 0) {
-            zipCloseFileInZip(zfile);
             zipClose(zfile, NULL);
             QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
+            throw(CannotReadFile(entry.fullpath.toStdString()));
         }
+    }
 
-        if (zipCloseFileInZip(zfile) != ZIP_OK) {
-            zipClose(zfile, NULL);
-            QFile::remove(tempFile);
-            throw(CannotStoreFile(relpath.toStdString()));
+    try {
+        if (QThreadPool::globalInstance()->maxThreadCount() > 1) {
+            WriteEntriesPipelined(zfile, fileInfo, entries, uzfile, tempFile);
+        } else {
+            for (int i = 0; i < entries.count(); ++i) {
+                DeflateEntry(entries[i]);
+                WriteEntry(zfile, fileInfo, entries[i], uzfile, tempFile);
+            }
+        }
+    } catch (...) {
+        if (uzfile != NULL) {
+            unzClose(uzfile);
         }
+
+        throw;
+    }
+
+    if (uzfile != NULL) {
+        unzClose(uzfile);
     }
 
     zipClose(zfile, NULL);
-    // Overwrite the contents of the real file with the contents from the temp
-    // file we saved the data do. We do this instead of simply copying the file
-    // because a file copy will lose extended attributes such as labels on OS X.
+
+    if (remote) {
+        QString error;
+        bool uploaded = RemoteFile::Upload(tempFile, fullfilepath, error);
+        QFile::remove(tempFile);
+
+        if (!uploaded) {
+            throw(CannotWriteFile(QString("%1: %2").arg(fullfilepath).arg(error).toStdString()));
+        }
+
+        return;
+    }
+
+    if (atomic_replace && ReplaceFileAtomically(tempFile, fullfilepath)) {
+        return;
+    }
+
+    // Fallback: overwrite the contents of the real file with the contents from
+    // the temp file we saved the data do. We do this instead of simply copying
+    // the file because a file copy will lose extended attributes such as labels on OS X.
     QFile temp_epub(tempFile);
 
     if (!temp_epub.open(QFile::ReadOnly)) {
@@ -266,22 +1291,20 @@ void ExportEPUB::SaveFolderAsEpubToLocation(const QString &fullfolderpath, const
 
 void ExportEPUB::CreateEncryptionXML(const QString &fullfolderpath)
 {
-    QTemporaryFile file;
+    // Written straight into the new folder; it has no earlier copy to replace
+    QFile file(fullfolderpath + "/" + ENCRYPTION_XML_FILE_NAME);
 
-    if (!file.open()) {
-    std::string msg = file.fileName().toStdString() + ": " + file.errorString().toStdString();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::string msg = file.fileName().toStdString() + ": " + file.errorString().toStdString();
         throw (CannotOpenFile(msg));
     }
 
     EncryptionXmlWriter enc(m_Book.data(), file);
     enc.WriteXML();
-    // Write to disk immediately
-    file.flush();
-    QFile::copy(file.fileName(), fullfolderpath + "/" + ENCRYPTION_XML_FILE_NAME);
 }
 
 
-void ExportEPUB::ObfuscateFonts(const QString &fullfolderpath)
+void ExportEPUB::PrepareFontObfuscation()
 {
     QString uuid_id = m_Book->GetOPF()->GetUUIDIdentifierValue();
     QString main_id = m_Book->GetPublicationIdentifier();
@@ -293,12 +1316,15 @@ void ExportEPUB::ObfuscateFonts(const QString &fullfolderpath)
             continue;
         }
 
-        QString font_path = fullfolderpath + "/" + font_resource->GetRelativePathToRoot();
+        QString identifier = algorithm == ADOBE_FONT_ALGO_ID ? uuid_id : main_id;
+        QByteArray key = FontObfuscation::ObfuscationKey(algorithm, identifier);
 
-        if (algorithm == ADOBE_FONT_ALGO_ID) {
-            FontObfuscation::ObfuscateFile(font_path, algorithm, uuid_id);
-        } else {
-            FontObfuscation::ObfuscateFile(font_path, algorithm, main_id);
+        if (identifier.isEmpty() || key.isEmpty()) {
+            std::string msg = font_resource->GetRelativePathToRoot().toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
+            throw(FontObfuscationError(msg));
         }
+
+        m_FontObfuscation.insert(font_resource->GetRelativePathToRoot(),
+                                 qMakePair(key, FontObfuscation::ObfuscatedLength(algorithm)));
     }
 }
@@ -23,10 +23,20 @@
 #ifndef EXPORTEPUB_H
 #define EXPORTEPUB_H
 
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+
 #include "BookManipulation/FolderKeeper.h"
 #include "BookManipulation/Book.h"
 #include "Exporters/Exporter.h"
 
+class SettingsStore;
+struct ZipEntryData;
+
 class ExportEPUB : public Exporter
 {
 
@@ -44,12 +54,35 @@ public:
     // specified in the constructor
     virtual void WriteBook();
 
+    // Writes a copy of the book, or of just the resources in subset
+    // when it is not empty, without changing the book: nothing is saved
+    // to the book's folder and the OPF is left as it is. The OPF, NCX
+    // and nav are always written; for a subset their entries for the
+    // resources left out are dropped. Entries unchanged since the book
+    // was saved to source_path are copied from it still compressed.
+    void WriteCopy(const QString &source_path, const QList<Resource *> &subset = QList<Resource *>());
+
 private:
 
-    // Creates the publication from the Book
-    // (creates XHTML, CSS, OPF, NCX files etc.)
+    // Creates the files that exist only in the exported
+    // publication (encryption.xml) in the specified folder
     void virtual CreatePublication(const QString &fullfolderpath);
 
+    // Snapshots the text of the text resources held in memory
+    void CollectInMemoryText();
+
+    // Works out the OPF, NCX and nav of a subset
+    // without the entries for the resources left out
+    void CollectSubsetText();
+
+    // The time given to every entry: SOURCE_DATE_EPOCH when set,
+    // else the book's modification date, else the start of 1980
+    QDateTime GetEntryTimestamp() const;
+
+    // Describes one archive entry: where its bytes come from
+    // and how they are compressed and obfuscated
+    ZipEntryData CreateZipEntry(const QString &fullpath, const QString &relpath, SettingsStore &settings) const;
+
     // Saves the publication in the specified folder
     // to the specified file path as an epub;
     // the second optional parameter specifies the
@@ -60,8 +93,9 @@ private:
     // if there are any fonts to obfuscate
     void CreateEncryptionXML(const QString &fullfolderpath);
 
-    // Obfuscates the fonts marked for obfuscation
-    void ObfuscateFonts(const QString &fullfolderpath);
+    // Works out the keys of the fonts marked for obfuscation;
+    // the obfuscation itself is applied as the fonts are zipped
+    void PrepareFontObfuscation();
 
 
     ///////////////////////////////
@@ -75,6 +109,25 @@ private:
     // The book being exported
     QSharedPointer<Book> m_Book;
 
+    // Obfuscation key and obfuscated length of each font
+    // to obfuscate, keyed by the font's root-relative path
+    QHash<QString, QPair<QByteArray, int>> m_FontObfuscation;
+
+    // Files generated for the export, keyed by archive path,
+    // valued by their full path in the temp folder
+    QHash<QString, QString> m_GeneratedFiles;
+
+    // Text of the resources held in memory, keyed by archive path
+    QHash<QString, QString> m_InMemoryText;
+
+    // The archive unchanged entries are copied from;
+    // the one being replaced when empty
+    QString m_SourcePath;
+
+    // The resources left out of a subset, and their archive paths
+    QList<Resource *> m_ExcludedResources;
+    QSet<QString> m_ExcludedPaths;
+
 };
 
 #endif // EXPORTEPUB_H
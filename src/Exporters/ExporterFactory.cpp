@@ -19,10 +19,9 @@
 **
 *************************************************************************/
 
-#include <QtCore/QFileInfo>
-
 #include "Exporters/ExportEPUB.h"
 #include "Exporters/ExporterFactory.h"
+#include "Misc/RemoteFile.h"
 
 // Constructor
 ExporterFactory::ExporterFactory()
@@ -41,7 +40,7 @@ ExporterFactory::~ExporterFactory()
 // appropriate for the given filename
 Exporter *ExporterFactory::GetExporter(const QString &filename, QSharedPointer<Book> book)
 {
-    QString extension = QFileInfo(filename).suffix().toLower();
+    QString extension = RemoteFile::Suffix(filename);
 
     if ((extension == "epub")) {
         m_Exporter = new ExportEPUB(filename, book);
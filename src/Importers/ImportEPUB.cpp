@@ -37,7 +37,6 @@
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
-#include <QtCore/QFutureSynchronizer>
 #include <QtConcurrent/QtConcurrent>
 #include <QtCore/QXmlStreamReader>
 #include <QDirIterator>
@@ -52,9 +51,12 @@
 #include "Importers/ImportEPUB.h"
 #include "Misc/FontObfuscation.h"
 #include "Misc/HTMLEncodingResolver.h"
-#include "Misc/QCodePage437Codec.h"
+#include "Misc/RemoteFile.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
+#include "Misc/ZipIndex.h"
 #include "ResourceObjects/CSSResource.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/OPFResource.h"
@@ -65,16 +67,12 @@
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
-#ifndef MAX_PATH
-// Set Max length to 256 because that's the max path size on many systems.
-#define MAX_PATH 256
-#endif
-// This is the same read buffer size used by Java and Perl.
-#define BUFF_SIZE 8192
+// Below this many entries per worker, extracting in parallel
+// costs more in archive reopening than it saves.
+#define PARALLEL_EXTRACT_MIN_ENTRIES 32
 
 const QString DUBLIN_CORE_NS             = "http://purl.org/dc/elements/1.1/";
 static const QString OEBPS_MIMETYPE      = "application/oebps-package+xml";
-static const QString UPDATE_ERROR_STRING = "SG_ERROR";
 const QString NCX_MIMETYPE               = "application/x-dtbncx+xml";
 static const QString NCX_EXTENSION       = "ncx";
 const QString ADOBE_FONT_ALGO_ID         = "http://ns.adobe.com/pdf/enc#RC";
@@ -86,16 +84,16 @@ static const QString CONTAINER_XML       = "<?xml version=\"1.0\" encoding=\"UTF
         "   </rootfiles>\n"
         "</container>\n";
 
-static QCodePage437Codec *cp437 = 0;
-
 // Constructor;
 // The parameter is the file to be imported
 ImportEPUB::ImportEPUB(const QString &fullfilepath)
     : Importer(fullfilepath),
+      m_TempFolder(UnpackedSize(fullfilepath)),
       m_ExtractedFolderPath(m_TempFolder.GetPath()),
       m_HasSpineItems(false),
       m_NCXNotInManifest(false),
-      m_NavResource(NULL)
+      m_NavResource(NULL),
+      m_LazyLoadMedia(false)
 {
 }
 
@@ -103,14 +101,19 @@ ImportEPUB::ImportEPUB(const QString &fullfilepath)
 // and returns the created Book
 QSharedPointer<Book> ImportEPUB::GetBook(bool extract_metadata)
 {
+    SIGIL_TRACE_SCOPE("Import EPUB");
     QList<XMLResource *> non_well_formed;
     SettingsStore ss;
 
-    if (!Utility::IsFileReadable(m_FullFilePath)) {
+    const bool remote = RemoteFile::IsRemote(m_FullFilePath);
+
+    if (!remote && !Utility::IsFileReadable(m_FullFilePath)) {
         throw (EPUBLoadParseError(QString(QObject::tr("Cannot read EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
     }
 
-    // These read the EPUB file
+    // These read the EPUB file. From remote storage only the text
+    // is fetched now, the media when it is first used.
+    m_LazyLoadMedia = remote || ss.lazyLoadMedia();
     ExtractContainer();
     QHash<QString, QString> encrypted_files = ParseEncryptionXml();
 
@@ -143,6 +146,9 @@ QSharedPointer<Book> ImportEPUB::GetBook(bool extract_metadata)
         Utility::DisplayStdWarningDialog(tr("Files exist in epub that are not listed in the manifest, they will be ignored"), notInManifest.join("\n"));
     }
     const QHash<QString, QString> updates = LoadFolderStructure();
+    // Hashes kept from the last save are taken rather than worked out again
+    m_Book->GetFolderKeeper()->LoadContentHashes(m_FullFilePath);
+    m_Book->GetFolderKeeper()->UpdateContentHashes();
     const QList<Resource *> resources     = m_Book->GetFolderKeeper()->GetResourceList();
 
     // We're going to check all html files until we find one that isn't well formed then we'll prompt
@@ -173,7 +179,10 @@ QSharedPointer<Book> ImportEPUB::GetBook(bool extract_metadata)
             }
         }
     }
-    if (!non_well_formed.isEmpty()) {
+    if (!non_well_formed.isEmpty() && Utility::IsHeadless()) {
+        // Nobody to ask, so the files are left as they are
+        AddLoadWarning(tr("%n HTML file(s) are not well formed and were not fixed.", "", non_well_formed.count()));
+    } else if (!non_well_formed.isEmpty()) {
         QApplication::restoreOverrideCursor();
         if (QMessageBox::Yes == QMessageBox::warning(QApplication::activeWindow(),
                 tr("Sigil"),
@@ -196,6 +205,10 @@ QSharedPointer<Book> ImportEPUB::GetBook(bool extract_metadata)
 
     ProcessFontFiles(resources, updates, encrypted_files);
 
+    if (ss.dedupMediaOnImport()) {
+        CollapseDuplicateMedia();
+    }
+
     if (m_PackageVersion.startsWith('3')) {
         HTMLResource * nav_resource = NULL;
         if (m_NavResource) {
@@ -247,7 +260,9 @@ QHash<QString, QString> ImportEPUB::ParseEncryptionXml()
 {
     QString encrpytion_xml_path = m_ExtractedFolderPath + "/META-INF/encryption.xml";
 
-    if (!QFileInfo(encrpytion_xml_path).exists()) {
+    // The archive listing answers this without touching the disk; the
+    // file check still catches names that differ only by case.
+    if (!m_ZipIndex.Contains("META-INF/encryption.xml") && !QFileInfo(encrpytion_xml_path).exists()) {
         return QHash<QString, QString>();
     }
 
@@ -366,6 +381,7 @@ void ImportEPUB::ProcessFontFiles(const QList<Resource *> &resources,
             }
         }
     }
+    QList<QFuture<bool> > futures;
     foreach(FontResource * font_resource, font_resources) {
         QString match_path = "../" + font_resource->GetRelativePathToOEBPS();
         QString algorithm  = new_font_paths_to_algorithms.value(match_path);
@@ -375,129 +391,192 @@ void ImportEPUB::ProcessFontFiles(const QList<Resource *> &resources,
         }
 
         font_resource->SetObfuscationAlgorithm(algorithm);
+        // The font is rewritten in place, so it can't stay in the archive
+        bool loaded = font_resource->LoadDeferredContent();
+        QString filepath = font_resource->GetFullPath();
+        QString identifier = algorithm == ADOBE_FONT_ALGO_ID ? m_UuidIdentifierValue : m_UniqueIdentifierValue;
+        int obfuscated_length = FontObfuscation::ObfuscatedLength(algorithm);
+
+        if (!loaded || !QFileInfo(filepath).exists() || identifier.isEmpty() || obfuscated_length == 0) {
+            std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
+            throw(FontObfuscationError(msg));
+        }
 
         // Actually we are de-obfuscating, but the inverse operations of the obfuscation methods
         // are the obfuscation methods themselves. For the math oriented, the obfuscation methods
         // are involutary [ f( f( x ) ) = x ].
-        if (algorithm == ADOBE_FONT_ALGO_ID) {
-            FontObfuscation::ObfuscateFile(font_resource->GetFullPath(), algorithm, m_UuidIdentifierValue);
-        } else {
-            FontObfuscation::ObfuscateFile(font_resource->GetFullPath(), algorithm, m_UniqueIdentifierValue);
+        // The key is derived once; the fonts are rewritten at the same time.
+        futures.append(TaskScheduler::Run(TaskScheduler::Foreground, "ImportEPUB::ProcessFontFiles",
+                                          std::bind(FontObfuscation::ObfuscateFileWithKey, filepath,
+                                                    FontObfuscation::ObfuscationKey(algorithm, identifier),
+                                                    obfuscated_length)));
+    }
+
+    foreach(QFuture<bool> future, futures) {
+        future.waitForFinished();
+    }
+}
+
+// Extracts a run of entries through its own handle on the archive,
+// so that several runs can be inflated at the same time.
+// Returns the name of the entry that failed, or an empty string.
+static QString ExtractZipEntries(const QString &zippath,
+                                 const QString &destination,
+                                 const QVector<ZipIndex::Entry> &entries,
+                                 int first,
+                                 int last)
+{
+    unzFile zfile = ZipIndex::OpenZip(zippath);
+
+    if (zfile == NULL) {
+        return entries.at(first).name;
+    }
+
+    for (int i = first; i < last; ++i) {
+        const ZipIndex::Entry &zentry = entries.at(i);
+        QString file_path = destination + "/" + zentry.name;
+
+        if (!ZipIndex::ExtractEntry(zfile, zentry.pos, file_path)) {
+            unzClose(zfile);
+            return zentry.name;
         }
+
+        if (!zentry.cp437_name.isEmpty()) {
+            QString cp437_file_path = destination + "/" + zentry.cp437_name;
+            QFile::copy(file_path, cp437_file_path);
+        }
+    }
+
+    unzClose(zfile);
+    return QString();
+}
+
+
+// Loader for a lazily opened resource: inflates its entry
+// on first use over the placeholder file.
+static bool ExtractDeferredZipEntry(const QString &zippath, QPair<quint64, quint64> location, const QString &file_path)
+{
+    unzFile zfile = ZipIndex::OpenZip(zippath);
+
+    if (zfile == NULL) {
+        return false;
     }
+
+    unz64_file_pos pos;
+    pos.pos_in_zip_directory = location.first;
+    pos.num_of_file = location.second;
+    bool extracted = ZipIndex::ExtractEntry(zfile, pos, file_path);
+    unzClose(zfile);
+    return extracted;
 }
 
+
 void ImportEPUB::ExtractContainer()
 {
-    int res = 0;
-    if (!cp437) {
-        cp437 = new QCodePage437Codec();
-    }
-#ifdef Q_OS_WIN32
-    zlib_filefunc64_def ffunc;
-    fill_win32_filefunc64W(&ffunc);
-    unzFile zfile = unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(m_FullFilePath)).c_str(), &ffunc);
-#else
-    unzFile zfile = unzOpen64(QDir::toNativeSeparators(m_FullFilePath).toUtf8().constData());
-#endif
+    // Read the central directory once to list the entries and create
+    // every folder up front; the entries are inflated afterwards.
+    unzFile zfile = ZipIndex::OpenZip(m_FullFilePath);
 
     if (zfile == NULL) {
         throw (EPUBLoadParseError(QString(QObject::tr("Cannot unzip EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
     }
 
-    res = unzGoToFirstFile(zfile);
-
-    if (res == UNZ_OK) {
-        do {
-            // Get the name of the file in the archive.
-            char file_name[MAX_PATH] = {0};
-            unz_file_info64 file_info;
-            unzGetCurrentFileInfo64(zfile, &file_info, file_name, MAX_PATH, NULL, 0, NULL, 0);
-            QString qfile_name;
-            QString cp437_file_name;
-            qfile_name = QString::fromUtf8(file_name);
-            if (!(file_info.flag & (1<<11))) {
-                // General purpose bit 11 says the filename is utf-8 encoded. If not set then
-                // IBM 437 encoding might be used.
-                cp437_file_name = cp437->toUnicode(file_name);
+    bool listed = m_ZipIndex.Load(zfile);
+    unzClose(zfile);
+
+    if (!listed) {
+        throw (EPUBLoadParseError(QString(QObject::tr("Cannot open EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
+    }
+
+    QVector<ZipIndex::Entry> entries;
+    qint64 total_size = 0;
+    QDir dir(m_ExtractedFolderPath);
+    QSet<QString> created_paths;
+
+    foreach(const ZipIndex::Entry &zentry, m_ZipIndex.Entries()) {
+        // Full file path in the temporary directory.
+        QString file_path = m_ExtractedFolderPath + "/" + zentry.name;
+        QFileInfo qfile_info(file_path);
+
+        // Is this entry a directory?
+        if (zentry.IsDirectory()) {
+            dir.mkpath(zentry.name);
+            continue;
+        }
+
+        if (!created_paths.contains(qfile_info.path())) {
+            dir.mkpath(qfile_info.path());
+            created_paths.insert(qfile_info.path());
+        }
+
+        // add it to the list of files found inside the zip
+        m_ZipFilePaths << zentry.DisplayName();
+
+        // In lazy mode media files get an empty placeholder now
+        // and are inflated when the resource is first used.
+        QString extension = qfile_info.suffix().toLower();
+
+        if (m_LazyLoadMedia && !zentry.name.startsWith("META-INF") &&
+            (IMAGE_EXTENSIONS.contains(extension) || FONT_EXTENSIONS.contains(extension) ||
+             AUDIO_EXTENSIONS.contains(extension) || VIDEO_EXTENSIONS.contains(extension))) {
+            QPair<quint64, quint64> location(zentry.pos.pos_in_zip_directory, zentry.pos.num_of_file);
+            QFile placeholder(file_path);
+            placeholder.open(QIODevice::WriteOnly | QIODevice::Truncate);
+            placeholder.close();
+            m_DeferredZipEntries.insert(zentry.name, location);
+
+            if (!zentry.cp437_name.isEmpty()) {
+                QFile::copy(file_path, m_ExtractedFolderPath + "/" + zentry.cp437_name);
+                m_DeferredZipEntries.insert(zentry.cp437_name, location);
             }
 
-            // If there is no file name then we can't do anything with it.
-            if (!qfile_name.isEmpty()) {
-                // We use the dir object to create the path in the temporary directory.
-                // Unfortunately, we need a dir ojbect to do this as it's not a static function.
-                QDir dir(m_ExtractedFolderPath);
-                // Full file path in the temporary directory.
-                QString file_path = m_ExtractedFolderPath + "/" + qfile_name;
-                QFileInfo qfile_info(file_path);
-
-                // Is this entry a directory?
-                if (file_info.uncompressed_size == 0 && qfile_name.endsWith('/')) {
-                    dir.mkpath(qfile_name);
-                    continue;
-                } else {
-                    dir.mkpath(qfile_info.path());
-		    // add it to the list of files found inside the zip
-		    if (cp437_file_name.isEmpty()) {
-		        m_ZipFilePaths << qfile_name;
-		    } else {
-                        m_ZipFilePaths << cp437_file_name;
-		    }
-                }
+            continue;
+        }
 
-                // Open the file entry in the archive for reading.
-                if (unzOpenCurrentFile(zfile) != UNZ_OK) {
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
-                }
+        entries.append(zentry);
+        total_size += zentry.uncompressed_size;
+    }
 
-                // Open the file on disk to write the entry in the archive to.
-                QFile entry(file_path);
+    if (entries.isEmpty()) {
+        return;
+    }
 
-                if (!entry.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
-                }
+    // Split the entries into contiguous runs of about the same
+    // uncompressed size, one per worker, each with its own handle.
+    int workers = qMin(TaskScheduler::Pool(TaskScheduler::Foreground)->maxThreadCount(), entries.count() / PARALLEL_EXTRACT_MIN_ENTRIES);
+    QString failed;
 
-                // Buffered reading and writing.
-                char buff[BUFF_SIZE] = {0};
-                int read = 0;
+    if (workers > 1) {
+        QList<QFuture<QString>> futures;
+        qint64 share = total_size / workers + 1;
+        qint64 run_size = 0;
+        int first = 0;
 
-                while ((read = unzReadCurrentFile(zfile, buff, BUFF_SIZE)) > 0) {
-                    entry.write(buff, read);
-                }
+        for (int i = 0; i < entries.count(); ++i) {
+            run_size += entries.at(i).uncompressed_size;
 
-                entry.close();
+            if (run_size >= share || i == entries.count() - 1) {
+                futures.append(TaskScheduler::Run(TaskScheduler::Foreground, "ImportEPUB::ExtractZipEntries",
+                                                  std::bind(ExtractZipEntries, m_FullFilePath, m_ExtractedFolderPath, entries, first, i + 1)));
+                first = i + 1;
+                run_size = 0;
+            }
+        }
 
-                // Read errors are marked by a negative read amount.
-                if (read < 0) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
-                }
+        foreach(QFuture<QString> future, futures) {
+            future.waitForFinished();
 
-                // The file was read but the CRC did not match.
-                // We don't check the read file size vs the uncompressed file size
-                // because if they're different there should be a CRC error.
-                if (unzCloseCurrentFile(zfile) == UNZ_CRCERROR) {
-                    unzClose(zfile);
-                    throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(qfile_name).toStdString()));
-                }
-                if (!cp437_file_name.isEmpty() && cp437_file_name != qfile_name) {
-                    QString cp437_file_path = m_ExtractedFolderPath + "/" + cp437_file_name;
-                    QFile::copy(file_path, cp437_file_path);
-                }
+            if (failed.isEmpty()) {
+                failed = future.result();
             }
-        } while ((res = unzGoToNextFile(zfile)) == UNZ_OK);
+        }
+    } else {
+        failed = ExtractZipEntries(m_FullFilePath, m_ExtractedFolderPath, entries, 0, entries.count());
     }
 
-    if (res != UNZ_END_OF_LIST_OF_FILE) {
-        unzClose(zfile);
-        throw (EPUBLoadParseError(QString(QObject::tr("Cannot open EPUB: %1")).arg(QDir::toNativeSeparators(m_FullFilePath)).toStdString()));
+    if (!failed.isEmpty()) {
+        throw (EPUBLoadParseError(QString(QObject::tr("Cannot extract file: %1")).arg(failed).toStdString()));
     }
-
-    unzClose(zfile);
 }
 
 void ImportEPUB::LocateOPF()
@@ -811,52 +890,89 @@ void ImportEPUB::LoadInfrastructureFiles()
 }
 
 
+void ImportEPUB::CollapseDuplicateMedia()
+{
+    const QList<QList<Resource *>> groups = m_Book->GetDuplicateMediaGroups();
+
+    if (groups.isEmpty()) {
+        return;
+    }
+
+    int copies = 0;
+    qint64 copy_bytes = 0;
+    foreach(const QList<Resource *> &group, groups) {
+        copies += group.count() - 1;
+        copy_bytes += (group.count() - 1) * QFileInfo(group.first()->GetFullPath()).size();
+    }
+
+    if (Utility::IsHeadless()) {
+        AddLoadWarning(tr("%n media file(s) are exact copies of other files and were kept.", "", copies));
+        return;
+    }
+
+    QApplication::restoreOverrideCursor();
+    bool collapse = QMessageBox::Yes == QMessageBox::question(QApplication::activeWindow(),
+            tr("Sigil"),
+            tr("This EPUB has %n media file(s) that are exact copies of other files "
+               "under a different name, taking %1 KB.\n\n"
+               "Do you want to keep one copy of each and point all references to it?", "", copies)
+            .arg(copy_bytes / 1024),
+            QMessageBox::Yes|QMessageBox::No);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    if (collapse) {
+        m_Book->CollapseDuplicateMedia(groups);
+        AddLoadWarning(tr("%n duplicate media file(s) were removed.", "", copies));
+    }
+}
+
+
 QHash<QString, QString> ImportEPUB::LoadFolderStructure()
 {
     QList<QString> keys = m_Files.keys();
     int num_files = keys.count();
-    QFutureSynchronizer<std::tuple<QString, QString>> sync;
+    QList<std::pair<QString, QString>> files;
+    QStringList current_paths;
 
     for (int i = 0; i < num_files; ++i) {
         QString id = keys.at(i);
-        sync.addFuture(QtConcurrent::run(
-                           this,
-                           &ImportEPUB::LoadOneFile,
-                           m_Files.value(id),
-                           m_FileMimetypes.value(id)));
+        QString fullfilepath = QDir::cleanPath(QFileInfo(m_OPFFilePath).absolutePath() + "/" + m_Files.value(id));
+        files.append(std::make_pair(fullfilepath, m_FileMimetypes.value(id)));
+        current_paths.append(fullfilepath.remove(0, m_ExtractedFolderPath.length() + 1));
     }
 
-    sync.waitForFinished();
-    QList<QFuture<std::tuple<QString, QString>>> futures = sync.futures();
-    int num_futures = futures.count();
+    // All manifest items go into the folder in one batch; files
+    // missing from the archive come back as NULL and are skipped.
+    QList<Resource *> resources = m_Book->GetFolderKeeper()->AddContentFilesToFolder(files, false);
     QHash<QString, QString> updates;
 
-    for (int i = 0; i < num_futures; ++i) {
-        std::tuple<QString, QString> result = futures.at(i).result();
-        updates[std::get<0>(result)] = std::get<1>(result);
-    }
+    for (int i = 0; i < num_files; ++i) {
+        Resource *resource = resources.at(i);
 
-    updates.remove(UPDATE_ERROR_STRING);
-    return updates;
-}
+        if (!resource) {
+            continue;
+        }
 
+        const QString &currentpath = current_paths.at(i);
 
-std::tuple<QString, QString> ImportEPUB::LoadOneFile(const QString &path, const QString &mimetype)
-{
-    QString fullfilepath = QDir::cleanPath(QFileInfo(m_OPFFilePath).absolutePath() + "/" + path);
-    QString currentpath = fullfilepath;
-    currentpath = currentpath.remove(0,m_ExtractedFolderPath.length()+1);
-    try {
-        Resource *resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(fullfilepath, false, mimetype);
-        if (path == m_NavHref) {
+        if (m_Files.value(keys.at(i)) == m_NavHref) {
             m_NavResource = resource;
         }
+
         resource->SetCurrentBookRelPath(currentpath);
-        QString newpath = "../" + resource->GetRelativePathToOEBPS();
-        return std::make_tuple(currentpath, newpath);
-    } catch (FileDoesNotExist) {
-        return std::make_tuple(UPDATE_ERROR_STRING, UPDATE_ERROR_STRING);
+
+        if (m_DeferredZipEntries.contains(currentpath)) {
+            QString zippath = m_FullFilePath;
+            QPair<quint64, quint64> location = m_DeferredZipEntries.value(currentpath);
+            resource->SetDeferredContent([zippath, location](const QString &file_path) {
+                return ExtractDeferredZipEntry(zippath, location, file_path);
+            }, zippath, currentpath);
+        }
+
+        updates[currentpath] = "../" + resource->GetRelativePathToOEBPS();
     }
+
+    return updates;
 }
 
 
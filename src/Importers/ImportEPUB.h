@@ -32,6 +32,7 @@
 
 #include "Importers/Importer.h"
 #include "Misc/TempFolder.h"
+#include "Misc/ZipIndex.h"
 
 class HTMLResource;
 class CSSResource;
@@ -115,15 +116,10 @@ private:
     QHash<QString, QString> LoadFolderStructure();
 
     /**
-     * Loads a single file.
-     *
-     * @param path A full path to the file to load.
-     * @param mimetype The mimetype of the file to load.
-     * @return A tuple where the first member is the old path to the file,
-     *         and the new member is the new, OEBPS-relative path to it.
+     * Offers to keep one copy of the media files that are stored
+     * more than once under different names.
      */
-    std::tuple<QString, QString> LoadOneFile(const QString &path,
-                                        const QString &mimetype = QString());
+    void CollapseDuplicateMedia();
 
     /**
      * Performs the necessary modifications to the OPF
@@ -210,6 +206,23 @@ private:
 
     QSet<QString> m_ZipFilePaths;
 
+    /**
+     * The central directory of the EPUB, read once by ExtractContainer.
+     */
+    ZipIndex m_ZipIndex;
+
+    /**
+     * Set when media files are extracted on first use only.
+     */
+    bool m_LazyLoadMedia;
+
+    /**
+     * The archive entries left unextracted in lazy mode. The keys are
+     * the paths inside the zip, the values are the positions of the
+     * entries in the central directory (minizip's unz64_file_pos).
+     */
+    QHash<QString, QPair<quint64, quint64>> m_DeferredZipEntries;
+
     QDir m_opfDir;
 
     /**
@@ -38,6 +38,8 @@
 #include "Misc/HTMLEncodingResolver.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/TempFolder.h"
+#include "Misc/TextFileStream.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/CSSResource.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -47,12 +49,17 @@
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
+// Sections are cut before one of these, in that order of preference
+static const QString HEADING_START = "<h[1-6][\\s>]";
+static const QString BLOCK_START   = "<(?:p|div|section|article|blockquote|table|ul|ol|dl)[\\s>/]";
+
 // Constructor;
 // The parameter is the file to be imported
 ImportHTML::ImportHTML(const QString &fullfilepath)
     :
     Importer(fullfilepath),
     m_IgnoreDuplicates(false),
+    m_AddToBook(false),
     m_CachedSource(QString())
 {
     SettingsStore ss;
@@ -64,6 +71,7 @@ void ImportHTML::SetBook(QSharedPointer<Book> book, bool ignore_duplicates)
 {
     m_Book = book;
     m_IgnoreDuplicates = ignore_duplicates;
+    m_AddToBook = true;
     // update epub version to match the book that was just set
     m_EpubVersion = m_Book->GetConstOPF()->GetEpubVersion();
 }
@@ -71,6 +79,12 @@ void ImportHTML::SetBook(QSharedPointer<Book> book, bool ignore_duplicates)
 
 XhtmlDoc::WellFormedError ImportHTML::CheckValidToLoad()
 {
+    // A file imported in sections is not read whole to check it;
+    // every section is mended instead
+    if (StreamsSections()) {
+        return XhtmlDoc::WellFormedError();
+    }
+
     // For HTML & XML documents we will perform a well-formed check
     return XhtmlDoc::WellFormedErrorForSource(LoadSource());
 }
@@ -80,11 +94,13 @@ XhtmlDoc::WellFormedError ImportHTML::CheckValidToLoad()
 // and returns the created Book
 QSharedPointer<Book> ImportHTML::GetBook(bool extract_metadata)
 {
-    QString source = LoadSource();
-    if (extract_metadata) {
-        LoadMetadata(source);
+    if (!StreamsSections() || !StreamSections(extract_metadata)) {
+        QString source = LoadSource();
+        if (extract_metadata) {
+            LoadMetadata(source);
+        }
+        UpdateFiles(CreateHTMLResource(), source, LoadFolderStructure(source));
     }
-    UpdateFiles(CreateHTMLResource(), source, LoadFolderStructure(source));
 
     // Before returning the new book, if it is epub3, make sure it has a nav
     if (m_EpubVersion.startsWith('3')) {
@@ -109,17 +125,197 @@ QString ImportHTML::LoadSource()
             throw (CannotReadFile(m_FullFilePath.toStdString()));
         }
 
-        m_CachedSource = HTMLEncodingResolver::ReadHTMLFile(m_FullFilePath);
-        m_CachedSource = CleanSource::CharToEntity(m_CachedSource);
-        if (ss.cleanOn() & CLEANON_OPEN) {
-            m_CachedSource = XhtmlDoc::ResolveCustomEntities(m_CachedSource);
-            m_CachedSource = CleanSource::Mend(m_CachedSource, m_EpubVersion);
-        }
+        m_CachedSource = PrepareSource(HTMLEncodingResolver::ReadHTMLFile(m_FullFilePath), ss.cleanOn() & CLEANON_OPEN);
     }
     return m_CachedSource;
 }
 
 
+QString ImportHTML::PrepareSource(const QString &source, bool mend) const
+{
+    QString prepared = CleanSource::CharToEntity(source);
+    if (mend) {
+        prepared = XhtmlDoc::ResolveCustomEntities(prepared);
+        prepared = CleanSource::Mend(prepared, m_EpubVersion);
+    }
+    return prepared;
+}
+
+
+// Files large enough for Code View's large file mode are split
+// into sections as they are read when they start a new book
+bool ImportHTML::StreamsSections() const
+{
+    SettingsStore ss;
+    qint64 threshold = qint64(ss.largeFileThreshold()) * 1024 * 1024;
+    return !m_AddToBook && threshold > 0 && ss.importSplitSize() > 0 &&
+           QFileInfo(m_FullFilePath).size() >= threshold;
+}
+
+
+// Reads the file a chunk at a time, writing a section out whenever
+// enough of the body has been read, so no more than a couple of
+// sections' worth of the text is held at once. The head of the file
+// is the head of every section. The references in all the sections
+// are updated once they have been collected from each.
+bool ImportHTML::StreamSections(bool extract_metadata)
+{
+    SIGIL_TRACE_SCOPE("Import HTML in sections");
+
+    if (!Utility::IsFileReadable(m_FullFilePath)) {
+        throw (CannotReadFile(m_FullFilePath.toStdString()));
+    }
+
+    SettingsStore ss;
+    int split_size = ss.importSplitSize() * 1024;
+    TextFileStream stream(m_FullFilePath, true);
+    QRegularExpression body_start(BODY_START, QRegularExpression::CaseInsensitiveOption);
+    QString header;
+    QString pending;
+
+    while (header.isEmpty() && !stream.AtEnd()) {
+        // The tag may straddle two chunks
+        int from = qMax(0, pending.length() - 1024);
+        pending.append(stream.ReadChunk());
+        QRegularExpressionMatch match = body_start.match(pending, from);
+
+        if (match.hasMatch()) {
+            header = pending.left(match.capturedEnd());
+            pending.remove(0, match.capturedEnd());
+        }
+    }
+
+    // Without a body there is nothing to split on; all
+    // of the file has been read by now, so import it whole
+    if (header.isEmpty()) {
+        m_CachedSource = PrepareSource(pending, ss.cleanOn() & CLEANON_OPEN);
+        return false;
+    }
+
+    if (extract_metadata) {
+        LoadMetadata(header + "</body></html>");
+    }
+
+    TempFolder tempfolder;
+    QStringList section_paths;
+    QStringList file_paths;
+
+    forever {
+        bool at_end = stream.AtEnd();
+
+        if (at_end) {
+            int body_end = pending.lastIndexOf(QRegularExpression(BODY_END, QRegularExpression::CaseInsensitiveOption));
+
+            if (body_end != -1) {
+                pending.truncate(body_end);
+            }
+        } else {
+            pending.append(stream.ReadChunk());
+        }
+
+        while (pending.length() >= split_size * 2 || (at_end && (!pending.isEmpty() || section_paths.isEmpty()))) {
+            int cut = at_end && pending.length() < split_size * 2 ? pending.length() : FindSectionCut(pending, split_size);
+            QString source = PrepareSource(header + pending.left(cut) + "</body>\n</html>\n", true);
+            pending.remove(0, cut);
+            QPair<QStringList, QStringList> paths = XhtmlDoc::GetPathsToMediaAndStyleFiles(source);
+            file_paths.append(paths.first + paths.second);
+            QString fullfilepath = tempfolder.GetPath() + "/" + SectionFilename(section_paths.count());
+            Utility::WriteUnicodeTextFile(source, fullfilepath);
+            section_paths.append(fullfilepath);
+        }
+
+        if (at_end) {
+            break;
+        }
+    }
+
+    UpdateSectionFiles(section_paths, LoadFolderStructure(file_paths));
+
+    QList<std::pair<QString, QString>> files;
+    foreach(QString fullfilepath, section_paths) {
+        files.append(std::make_pair(fullfilepath, QString()));
+    }
+    m_Book->GetFolderKeeper()->AddContentFilesToFolder(files);
+    return true;
+}
+
+
+// Returns where the section text starts with should end: before the
+// heading nearest the split size between half and twice it, failing
+// that before the block nearest it, and failing that before the last
+// tag ahead of it. A cut can leave elements open on
+// either side, which mending the sections closes again.
+int ImportHTML::FindSectionCut(const QString &text, int split_size)
+{
+    int from = split_size / 2;
+    int to = qMin(text.length(), split_size * 2);
+    QStringList patterns = QStringList() << HEADING_START << BLOCK_START;
+
+    foreach(QString pattern, patterns) {
+        QRegularExpression start(pattern, QRegularExpression::CaseInsensitiveOption);
+        QRegularExpressionMatchIterator matches = start.globalMatch(text, from);
+        int best = -1;
+
+        while (matches.hasNext()) {
+            int index = matches.next().capturedStart();
+
+            if (index >= to) {
+                break;
+            }
+
+            if (best == -1 || qAbs(index - split_size) < qAbs(best - split_size)) {
+                best = index;
+            }
+        }
+
+        if (best != -1) {
+            return best;
+        }
+    }
+
+    int tag = text.lastIndexOf(QChar('<'), split_size);
+    return tag > 0 ? tag : split_size;
+}
+
+
+// The first section keeps the name of the file
+QString ImportHTML::SectionFilename(int index) const
+{
+    QFileInfo fileinfo(m_FullFilePath);
+
+    if (index == 0) {
+        return fileinfo.fileName();
+    }
+
+    return QString("%1_%2.%3").arg(fileinfo.completeBaseName())
+                              .arg(index + 1, 4, 10, QChar('0'))
+                              .arg(fileinfo.suffix());
+}
+
+
+// Applies the reference updates to the section files in
+// place, one at a time, and to the CSS files of the book
+void ImportHTML::UpdateSectionFiles(const QStringList &fullfilepaths, const QHash<QString, QString> &updates)
+{
+    QHash<QString, QString> html_updates;
+    QHash<QString, QString> css_updates;
+    std::tie(html_updates, css_updates, std::ignore) =
+        UniversalUpdates::SeparateHtmlCssXmlUpdates(updates);
+    QList<CSSResource *> css_resources = m_Book->GetFolderKeeper()->GetResourceTypeList<CSSResource>();
+    QFutureSynchronizer<void> sync;
+    sync.addFuture(QtConcurrent::map(css_resources,
+                                     std::bind(UniversalUpdates::LoadAndUpdateOneCSSFile, std::placeholders::_1, css_updates)));
+
+    foreach(QString fullfilepath, fullfilepaths) {
+        QString source = Utility::ReadUnicodeTextFile(fullfilepath);
+        source = PerformHTMLUpdates(source, html_updates, css_updates, m_FullFilePath, m_EpubVersion)();
+        Utility::WriteUnicodeTextFile(source, fullfilepath);
+    }
+
+    sync.waitForFinished();
+}
+
+
 // Searches for meta information in the HTML file
 // and tries to convert it to Dublin Core
 void ImportHTML::LoadMetadata(const QString & source)
@@ -187,78 +383,46 @@ void ImportHTML::UpdateFiles(HTMLResource *html_resource,
 // as the files get a new name, the references are updated
 QHash<QString, QString> ImportHTML::LoadFolderStructure(const QString &source)
 {
-    QStringList mediapaths = XhtmlDoc::GetPathsToMediaFiles(source);
-    QStringList stylepaths = XhtmlDoc::GetPathsToStyleFiles(source);
-    QFutureSynchronizer<QHash<QString, QString>> sync;
-    sync.addFuture(QtConcurrent::run(this, &ImportHTML::LoadMediaFiles,  mediapaths));
-    sync.addFuture(QtConcurrent::run(this, &ImportHTML::LoadStyleFiles,  stylepaths));
-    sync.waitForFinished();
-    QList<QFuture<QHash<QString, QString>>> futures = sync.futures();
-    int num_futures = futures.count();
-    QHash<QString, QString> updates;
-
-    for (int i = 0; i < num_futures; ++i) {
-        updates.unite(futures.at(i).result());
-    }
-
-    return updates;
+    QPair<QStringList, QStringList> paths = XhtmlDoc::GetPathsToMediaAndStyleFiles(source);
+    return LoadFolderStructure(paths.first + paths.second);
 }
 
 
-QHash<QString, QString> ImportHTML::LoadMediaFiles(const QStringList & file_paths)
+// Paths are resolved against the folder of the file once each, and
+// every file is loaded once however many paths lead to it. All the
+// files are copied in one batch, which spreads them over the pool.
+QHash<QString, QString> ImportHTML::LoadFolderStructure(const QStringList &file_paths)
 {
     QHash<QString, QString> updates;
     QDir folder(QFileInfo(m_FullFilePath).absoluteDir());
     QStringList current_filenames = m_Book->GetFolderKeeper()->GetAllFilenames();
-    // Load the media files (images, video, audio) into the book and
-    // update all references with new urls
+    QList<std::pair<QString, QString>> files;
+    QSet<QString> resolved;
+
     foreach(QString file_path, file_paths) {
-        try {
-            QString filename = QFileInfo(file_path).fileName();
-            QString fullfilepath  = QFileInfo(folder, file_path).absoluteFilePath();
-            QString newpath;
-
-            if (m_IgnoreDuplicates && current_filenames.contains(filename)) {
-                newpath = "../" + m_Book->GetFolderKeeper()->GetResourceByFilename(filename)->GetRelativePathToOEBPS();
-            } else {
-                Resource * resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(fullfilepath);
-                newpath = "../" + resource->GetRelativePathToOEBPS();
-            }
+        QString fullfilepath = QDir::cleanPath(folder.absoluteFilePath(file_path));
 
-            updates[ fullfilepath ] = newpath;
-        } catch (FileDoesNotExist) {
-            // Do nothing. If the referenced file does not exist,
-            // well then we don't load it.
-            // TODO: log this.
+        if (resolved.contains(fullfilepath)) {
+            continue;
         }
-    }
-    return updates;
-}
 
+        resolved.insert(fullfilepath);
+        QString filename = QFileInfo(fullfilepath).fileName();
 
-QHash<QString, QString> ImportHTML::LoadStyleFiles(const QStringList & file_paths )
-{
-    QHash<QString, QString> updates;
-    QDir folder(QFileInfo(m_FullFilePath).absoluteDir());
-    QStringList current_filenames = m_Book->GetFolderKeeper()->GetAllFilenames();
-    foreach(QString file_path, file_paths) {
-        try {
-            QString filename = QFileInfo(file_path).fileName();
-            QString fullfilepath  = QFileInfo(folder, file_path).absoluteFilePath();
-            QString newpath;
-
-            if (m_IgnoreDuplicates && current_filenames.contains(filename)) {
-                newpath = "../" + m_Book->GetFolderKeeper()->GetResourceByFilename(filename)->GetRelativePathToOEBPS();
-            } else {
-                Resource * resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(fullfilepath);
-                newpath = "../" + resource->GetRelativePathToOEBPS();
-            }
+        if (m_IgnoreDuplicates && current_filenames.contains(filename)) {
+            updates[ fullfilepath ] = "../" + m_Book->GetFolderKeeper()->GetResourceByFilename(filename)->GetRelativePathToOEBPS();
+        } else {
+            files.append(std::make_pair(fullfilepath, QString()));
+        }
+    }
+
+    QList<Resource *> resources = m_Book->GetFolderKeeper()->AddContentFilesToFolder(files);
 
-            updates[ fullfilepath ] = newpath;
-        } catch (FileDoesNotExist) {
-            // Do nothing. If the referenced file does not exist,
-            // well then we don't load it.
-            // TODO: log this.
+    for (int i = 0; i < resources.count(); ++i) {
+        // If the referenced file does not exist,
+        // well then we don't load it.
+        if (resources.at(i)) {
+            updates[ files.at(i).first ] = "../" + resources.at(i)->GetRelativePathToOEBPS();
         }
     }
 
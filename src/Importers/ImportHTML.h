@@ -55,6 +55,21 @@ private:
     // Loads the source code into the Book
     QString LoadSource();
 
+    QString PrepareSource(const QString &source, bool mend) const;
+
+    bool StreamsSections() const;
+
+    // Imports the file as a series of sections without reading it whole.
+    // Returns false, with the file read into the cached source, if it
+    // has no body to split.
+    bool StreamSections(bool extract_metadata);
+
+    static int FindSectionCut(const QString &text, int split_size);
+
+    QString SectionFilename(int index) const;
+
+    void UpdateSectionFiles(const QStringList &fullfilepaths, const QHash<QString, QString> &updates);
+
     // Searches for meta information in the HTML file
     // and tries to convert it to Dublin Core
     void LoadMetadata(const QString &source);
@@ -71,9 +86,7 @@ private:
 
     // Returns a hash with keys being old references (URLs) to resources,
     // and values being the new references to those resources.
-    QHash<QString, QString> LoadMediaFiles(const QStringList & file_paths);
-
-    QHash<QString, QString> LoadStyleFiles(const QStringList & file_paths);
+    QHash<QString, QString> LoadFolderStructure(const QStringList &file_paths);
 
 
     ///////////////////////////////
@@ -82,6 +95,9 @@ private:
 
     bool m_IgnoreDuplicates;
 
+    // Set when the file is loaded into an existing book
+    bool m_AddToBook;
+
     QString m_CachedSource;
    
     QString m_EpubVersion;
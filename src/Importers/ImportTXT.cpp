@@ -19,12 +19,16 @@
 **
 *************************************************************************/
 
+#include <QtCore/QFileInfo>
+
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "BookManipulation/XhtmlDoc.h"
 #include "Importers/ImportTXT.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/TempFolder.h"
+#include "Misc/TextFileStream.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "sigil_constants.h"
@@ -33,6 +37,26 @@
 const QString FIRST_SECTION_PREFIX = "Section0001";
 const QString FIRST_SECTION_NAME   = FIRST_SECTION_PREFIX + ".xhtml";
 
+static const QString SECTION_START   = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                                       "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.1//EN\"\n"
+                                       "  \"http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd\">\n\n"
+                                       "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+                                       "<head>\n"
+                                       "<title></title>\n"
+                                       "</head>\n"
+                                       "<body>\n";
+
+static const QString SECTION5_START  = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                                       "<!DOCTYPE html>\n\n"
+                                       "<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">\n"
+                                       "<head>\n"
+                                       "<title></title>\n"
+                                       "</head>\n"
+                                       "<body>\n";
+
+static const QString SECTION_END     = "</body>\n"
+                                       "</html>\n";
+
 // Constructor;
 // The parameter is the file to be imported
 ImportTXT::ImportTXT(const QString &fullfilepath)
@@ -51,8 +75,13 @@ QSharedPointer<Book> ImportTXT::GetBook(bool extract_metadata)
         throw(CannotReadFile(m_FullFilePath.toStdString()));
     }
 
-    QString source = LoadSource();
-    InitializeHTMLResource(source, CreateHTMLResource(source));
+    if (StreamsSections()) {
+        StreamSections();
+    } else {
+        QString source = LoadSource();
+        InitializeHTMLResource(source, CreateHTMLResource(source));
+    }
+
     // Before returning the new book, if it is epub3, make sure it has a nav
     if (m_EpubVersion.startsWith('3')) {
         HTMLResource* nav_resource = m_Book->GetConstOPF()->GetNavResource();
@@ -66,6 +95,16 @@ QSharedPointer<Book> ImportTXT::GetBook(bool extract_metadata)
 }
 
 
+// Files large enough for Code View's large file mode are
+// split into sections as they are read
+bool ImportTXT::StreamsSections() const
+{
+    SettingsStore ss;
+    qint64 threshold = qint64(ss.largeFileThreshold()) * 1024 * 1024;
+    return threshold > 0 && ss.importSplitSize() > 0 && QFileInfo(m_FullFilePath).size() >= threshold;
+}
+
+
 QString ImportTXT::LoadSource() const
 {
     SettingsStore ss;
@@ -91,6 +130,59 @@ HTMLResource *ImportTXT::CreateHTMLResource(const QString &source)
 }
 
 
+// Converts the file a chunk at a time, writing the paragraphs out
+// to a new section whenever the current one reaches the split size,
+// so no more than a section and a chunk of the text are held at once.
+// Sections only ever end between paragraphs.
+void ImportTXT::StreamSections()
+{
+    SIGIL_TRACE_SCOPE("Import TXT in sections");
+    SettingsStore ss;
+    int split_size = ss.importSplitSize() * 1024;
+    TextFileStream stream(m_FullFilePath, false);
+    TempFolder tempfolder;
+    QList<std::pair<QString, QString>> files;
+    QString text;
+    QString paragraph = "<p>";
+    // The end of the last chunk, whose line goes on in the next one
+    QString partial_line;
+
+    while (!stream.AtEnd()) {
+        QStringList lines = (partial_line + stream.ReadChunk()).split(QChar('\n'));
+        partial_line = lines.takeLast();
+
+        foreach(QString line, lines) {
+            AppendLine(line, paragraph, text);
+
+            if (text.length() >= split_size) {
+                files.append(std::make_pair(WriteSection(text, tempfolder.GetPath(), files.count() + 1), QString()));
+                text.clear();
+            }
+        }
+    }
+
+    AppendLine(partial_line, paragraph, text);
+    text.append(paragraph.append("</p>\n"));
+    files.append(std::make_pair(WriteSection(text, tempfolder.GetPath(), files.count() + 1), QString()));
+    m_Book->GetFolderKeeper()->AddContentFilesToFolder(files);
+}
+
+
+QString ImportTXT::WriteSection(const QString &paragraphs, const QString &folder, int number) const
+{
+    SettingsStore ss;
+    QString source = (m_EpubVersion.startsWith('3') ? SECTION5_START : SECTION_START) + paragraphs + SECTION_END;
+
+    if (ss.cleanOn() & CLEANON_OPEN) {
+        source = CleanSource::Mend(source, m_EpubVersion);
+    }
+
+    QString fullfilepath = folder + "/" + QString("Section%1.xhtml").arg(number, 4, 10, QChar('0'));
+    Utility::WriteUnicodeTextFile(source, fullfilepath);
+    return fullfilepath;
+}
+
+
 void ImportTXT::InitializeHTMLResource(const QString &source, HTMLResource *resource)
 {
     resource->SetText(source);
@@ -106,16 +198,7 @@ QString ImportTXT::CreateParagraphs(const QStringList &lines) const
     int num_lines = lines.count();
 
     for (int i = 0; i < num_lines; ++i) {
-        QString line = lines.at(i);
-
-        if (line.isEmpty() || line[ 0 ].isSpace()) {
-            text.append(paragraph.append("</p>\n"));
-            paragraph = "<p>";
-        }
-
-        // We prepend a space so words on
-        // line breaks don't get merged
-        paragraph.append(QString(line.prepend(" ")).toHtmlEscaped());
+        AppendLine(lines.at(i), paragraph, text);
     }
 
     text.append(paragraph.append("</p>\n"));
@@ -123,3 +206,18 @@ QString ImportTXT::CreateParagraphs(const QStringList &lines) const
 }
 
 
+// Adds a line to the open paragraph, first closing
+// it onto text if the line starts a new one
+void ImportTXT::AppendLine(QString line, QString &paragraph, QString &text) const
+{
+    if (line.isEmpty() || line[ 0 ].isSpace()) {
+        text.append(paragraph.append("</p>\n"));
+        paragraph = "<p>";
+    }
+
+    // We prepend a space so words on
+    // line breaks don't get merged
+    paragraph.append(QString(line.prepend(" ")).toHtmlEscaped());
+}
+
+
@@ -43,8 +43,16 @@ public:
 
 private:
 
+    bool StreamsSections() const;
+
     QString LoadSource() const;
 
+    void StreamSections();
+
+    // Wraps the paragraphs into a complete document and
+    // writes it to folder as the section with the given number
+    QString WriteSection(const QString &paragraphs, const QString &folder, int number) const;
+
     HTMLResource *CreateHTMLResource(const QString &source);
 
     void InitializeHTMLResource(const QString &source, HTMLResource *resource);
@@ -53,6 +61,8 @@ private:
     // a string with paragraphs wrapped into <p> tags
     QString CreateParagraphs(const QStringList &lines) const;
 
+    void AppendLine(QString line, QString &paragraph, QString &text) const;
+
     QString m_EpubVersion;
 };
 
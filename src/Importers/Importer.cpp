@@ -19,12 +19,16 @@
 **
 *************************************************************************/
 
+#include <QtCore/QFileInfo>
+
 #include "Importers/Importer.h"
+#include "Misc/RemoteFile.h"
+#include "Misc/ZipIndex.h"
 
 Importer::Importer(const QString &fullfilepath)
     :
     m_FullFilePath(fullfilepath),
-    m_Book(new Book()),
+    m_Book(new Book(UnpackedSize(fullfilepath))),
     m_LoadWarnings(QStringList())
 {
 }
@@ -46,3 +50,23 @@ void Importer::AddLoadWarning(const QString &warning)
 {
     m_LoadWarnings.append(warning % "\n");
 }
+
+qint64 Importer::UnpackedSize(const QString &fullfilepath)
+{
+    QFileInfo info(fullfilepath);
+
+    if (RemoteFile::Suffix(fullfilepath) == "epub") {
+        // Only the central directory is read, and only once for the book and the importer
+        ZipIndex index = ZipIndex::Cached(fullfilepath);
+
+        if (index.IsValid()) {
+            qint64 size = 0;
+            foreach(const ZipIndex::Entry &entry, index.Entries()) {
+                size += entry.uncompressed_size;
+            }
+            return size;
+        }
+    }
+
+    return info.size();
+}
@@ -72,6 +72,12 @@ protected:
 
     void AddLoadWarning(const QString &warning);
 
+    /**
+     * @return The size in bytes of the file once unpacked: the
+     *         inflated entries of an EPUB, else the file itself.
+     */
+    static qint64 UnpackedSize(const QString &fullfilepath);
+
     ///////////////////////////////
     // PROTECTED MEMBER VARIABLES
     ///////////////////////////////
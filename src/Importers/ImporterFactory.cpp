@@ -19,12 +19,11 @@
 **
 *************************************************************************/
 
-#include <QtCore/QFileInfo>
-
 #include "Importers/ImporterFactory.h"
 #include "Importers/ImportEPUB.h"
 #include "Importers/ImportHTML.h"
 #include "Importers/ImportTXT.h"
+#include "Misc/RemoteFile.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
@@ -54,7 +53,12 @@ ImporterFactory::~ImporterFactory()
 
 Importer *ImporterFactory::GetImporter(const QString &filename)
 {
-    QString extension = QFileInfo(filename).suffix().toLower();
+    QString extension = RemoteFile::Suffix(filename);
+
+    // Only EPUBs can be read from remote storage
+    if (RemoteFile::IsRemote(filename) && extension != "epub") {
+        return NULL;
+    }
 
     if ((extension == "xhtml") ||
         (extension == "html")  ||
@@ -21,6 +21,7 @@
 *************************************************************************/
 
 #include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 #include <QtCore/QSignalMapper>
 #include <QtWidgets/QFileDialog>
 #include <QtWidgets/QMenu>
@@ -67,12 +68,14 @@ BookBrowser::BookBrowser(QWidget *parent)
     m_OpenWithContextMenu(new QMenu(this)),
     m_openWithMapper(new QSignalMapper(this)),
     m_LastContextMenuType(Resource::GenericResourceType),
-    m_RenamedResource(NULL)
+    m_RenamedResource(NULL),
+    m_CountsReset(true)
 {
     m_FontObfuscationContextMenu->setTitle(tr("Font Obfuscation"));
     m_OpenWithContextMenu->setTitle(tr("Open With"));
     setWidget(m_TreeView);
     setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
+    m_CountsTimer.setSingleShot(true);
     ReadSettings();
     SetupTreeView();
     CreateContextMenuActions();
@@ -105,7 +108,6 @@ void BookBrowser::SetBook(QSharedPointer<Book> book)
     m_OPFModel->SetBook(book);
     connect(this, SIGNAL(BookContentModified()), m_Book.data(), SLOT(SetModified()));
     ExpandTextFolder();
-    RefreshCounts();
 
     try {
         // Here we fake that the "first" HTML file has been double clicked
@@ -119,21 +121,63 @@ void BookBrowser::SetBook(QSharedPointer<Book> book)
     }
 }
 
+void BookBrowser::FolderRowsChanged(const QModelIndex &parent)
+{
+    QStandardItem *folder = m_OPFModel->itemFromIndex(parent);
+
+    if (folder) {
+        m_ChangedFolders.insert(folder);
+    } else {
+        // Rows of the root are the folders themselves
+        m_CountsReset = true;
+    }
+
+    if (!m_CountsTimer.isActive()) {
+        m_CountsTimer.start();
+    }
+}
+
+void BookBrowser::FolderCountsReset()
+{
+    m_CountsReset = true;
+
+    if (!m_CountsTimer.isActive()) {
+        m_CountsTimer.start();
+    }
+}
+
 void BookBrowser::RefreshCounts()
 {
-    for (int i = 0; i < m_OPFModel->invisibleRootItem()->rowCount(); i++) {
-        QStandardItem *folder = m_OPFModel->invisibleRootItem()->child(i);
+    if (m_CountsReset) {
+        // The items noted may be gone
+        m_CountsReset = false;
+        m_FolderCounts.clear();
+        m_ChangedFolders.clear();
+
+        for (int i = 0; i < m_OPFModel->invisibleRootItem()->rowCount(); i++) {
+            m_ChangedFolders.insert(m_OPFModel->invisibleRootItem()->child(i));
+        }
+    }
+
+    foreach(QStandardItem *folder, m_ChangedFolders) {
         int count = folder->rowCount();
+
+        // Setting the tooltip repaints the folder, even to the same text
+        if (m_FolderCounts.value(folder, -1) == count) {
+            continue;
+        }
+
+        m_FolderCounts.insert(folder, count);
         QString tooltip = QString(tr("%n file(s)","", count));
 
         folder->setToolTip(tooltip);
     }
+    m_ChangedFolders.clear();
 }
 
 void BookBrowser::Refresh()
 {
     m_OPFModel->Refresh();
-    RefreshCounts();
     emit UpdateBrowserSelection();
 }
 
@@ -584,6 +628,11 @@ QStringList BookBrowser::AddExisting(bool only_multimedia, bool only_images)
         progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
         progress.setValue(progress_value);
     }
+    // Every add, replace and spine move goes into one OPF update
+    OPFResource::Transaction opf_transaction(m_Book->GetOPF());
+    // Files that need no import step are copied in parallel after the loop
+    QList<std::pair<QString, QString>> plain_files;
+    QSet<QString> cover_filepaths;
     foreach(QString filepath, filepaths) {
         if (file_count > 1) {
             // Set progress value and ensure dialog has time to display when doing extensive updates
@@ -651,6 +700,7 @@ QStringList BookBrowser::AddExisting(bool only_multimedia, bool only_images)
           m_Book->GetFolderKeeper()->AddContentFileToFolder(filepath, true, QString("application/oebps-page-map+xml"));
         } else if (TEXT_EXTENSIONS.contains(QFileInfo(filepath).suffix().toLower())) {
             ImportHTML html_import(filepath);
+            html_import.SetBook(m_Book, true);
             XhtmlDoc::WellFormedError error = html_import.CheckValidToLoad();
 
             if (error.line != -1) {
@@ -658,7 +708,6 @@ QStringList BookBrowser::AddExisting(bool only_multimedia, bool only_images)
                 continue;
             }
 
-            html_import.SetBook(m_Book, true);
             // Since we set the Book manually,
             // this call merely mutates our Book.
             bool extract_metadata = false;
@@ -678,9 +727,25 @@ QStringList BookBrowser::AddExisting(bool only_multimedia, bool only_images)
                 }
             }
         } else {
-            Resource *resource = m_Book->GetFolderKeeper()->AddContentFileToFolder(filepath);
+            plain_files.append(std::make_pair(filepath, QString()));
+            if (CoverImageSemanticsSet) {
+                cover_filepaths.insert(filepath);
+            }
+        }
+
+        added_files.append(filepath);
+    }
+
+    if (!plain_files.isEmpty()) {
+        QList<Resource *> resources = m_Book->GetFolderKeeper()->AddContentFilesToFolder(plain_files);
+        for (int i = 0; i < resources.count(); ++i) {
+            Resource *resource = resources.at(i);
+            if (!resource) {
+                added_files.removeOne(plain_files.at(i).first);
+                continue;
+            }
 	    // if replacing a cover image, set the cover image semantics
-	    if (CoverImageSemanticsSet) {
+	    if (cover_filepaths.contains(plain_files.at(i).first)) {
 		ImageResource* new_image_resource = qobject_cast<ImageResource *>(resource);
 		if (new_image_resource) {
 		    m_Book->GetOPF()->SetResourceAsCoverImage(new_image_resource);
@@ -692,9 +757,8 @@ QStringList BookBrowser::AddExisting(bool only_multimedia, bool only_images)
                 css_resource->InitialLoad();
             }
         }
-
-        added_files.append(filepath);
     }
+    opf_transaction.Commit();
 
     if (!invalid_filenames.isEmpty()) {
         progress.cancel();
@@ -763,6 +827,7 @@ void BookBrowser::SaveAsFile(Resource *resource)
     m_Book->GetFolderKeeper()->SuspendWatchingResources();
     resource->SaveToDisk();
     m_Book->GetFolderKeeper()->ResumeWatchingResources();
+    resource->LoadDeferredContent();
     QString source = resource->GetFullPath();
 
     if (QFileInfo(destination).exists()) {
@@ -810,6 +875,7 @@ void BookBrowser::SaveAsFiles()
     m_Book->GetFolderKeeper()->SuspendWatchingResources();
     foreach(Resource * resource, resources) {
         resource->SaveToDisk();
+        resource->LoadDeferredContent();
         QString source = resource->GetFullPath();
         QString destination = dirname + "/" + resource->Filename();
 
@@ -838,6 +904,7 @@ void BookBrowser::OpenWith() const
         m_Book->GetFolderKeeper()->SuspendWatchingResources();
         resource->SaveToDisk();
         m_Book->GetFolderKeeper()->ResumeWatchingResources();
+        resource->LoadDeferredContent();
         const QString &editorPath = OpenExternally::selectEditorForResourceType(resource->Type());
 
         if (!editorPath.isEmpty()) {
@@ -856,6 +923,7 @@ void BookBrowser::OpenWithEditor(int slotnum) const
         m_Book->GetFolderKeeper()->SuspendWatchingResources();
         resource->SaveToDisk();
         m_Book->GetFolderKeeper()->ResumeWatchingResources();
+        resource->LoadDeferredContent();
 	QAction * oeaction = NULL;
 	if (slotnum == 0) oeaction = m_OpenWithEditor0;
 	if (slotnum == 1) oeaction = m_OpenWithEditor1;
@@ -1146,15 +1214,14 @@ void BookBrowser::RemoveResources(QList<Resource *> tab_resources, QList<Resourc
         emit ResourceActivated(next_resource);
     }
 
-    // Delete the resources
-    foreach(Resource * resource, resources) {
-        resource->Delete();
-    }
+    // Delete the resources, updating the OPF once for all of them
+    OPFResource::Transaction opf_transaction(m_Book->GetOPF());
+    m_Book->GetFolderKeeper()->DeleteResources(resources);
+    opf_transaction.Commit();
     emit ResourcesDeleted();
     emit BookContentModified();
     // Avoid full refresh so selection stays for non-openable resources
     m_OPFModel->Refresh();
-    RefreshCounts();
 
     if (keep_selection) {
         SelectResources(selected_resources);
@@ -1669,6 +1736,13 @@ void BookBrowser::ConnectSignalsToSlots()
             this,        SLOT(OpenContextMenu(const QPoint &)));
     connect(m_OPFModel, SIGNAL(ResourceRenamed()),
             this,        SLOT(SelectRenamedResource()));
+    connect(m_OPFModel, SIGNAL(rowsInserted(const QModelIndex &, int, int)),
+            this,        SLOT(FolderRowsChanged(const QModelIndex &)));
+    connect(m_OPFModel, SIGNAL(rowsRemoved(const QModelIndex &, int, int)),
+            this,        SLOT(FolderRowsChanged(const QModelIndex &)));
+    connect(m_OPFModel, SIGNAL(modelReset()),
+            this,        SLOT(FolderCountsReset()));
+    connect(&m_CountsTimer, SIGNAL(timeout()), this, SLOT(RefreshCounts()));
     connect(m_SelectAll,               SIGNAL(triggered()), this, SLOT(SelectAll()));
     connect(m_CopyHTML,                SIGNAL(triggered()), this, SLOT(CopyHTML()));
     connect(m_CopyCSS,                 SIGNAL(triggered()), this, SLOT(CopyCSS()));
@@ -23,7 +23,10 @@
 #ifndef BOOKBROWSER_H
 #define BOOKBROWSER_H
 
+#include <QtCore/QHash>
+#include <QtCore/QSet>
 #include <QtCore/QSharedPointer>
+#include <QtCore/QTimer>
 #include <QtWidgets/QDockWidget>
 
 #include "BookManipulation/Book.h"
@@ -38,6 +41,7 @@ class QAction;
 class QMenu;
 class QModelIndex;
 class QPoint;
+class QStandardItem;
 class QToolButton;
 class QTreeView;
 class QVBoxLayout;
@@ -232,6 +236,23 @@ signals:
 
 private slots:
 
+    /**
+     * Notes that the rows under parent changed, so that
+     * the count of that folder is shown again.
+     */
+    void FolderRowsChanged(const QModelIndex &parent);
+
+    /**
+     * Notes that every folder count has to be shown again.
+     */
+    void FolderCountsReset();
+
+    /**
+     * Shows the file count of each folder that changed since the last
+     * time. Runs once after the model changes, however many rows changed.
+     */
+    void RefreshCounts();
+
     /**
      * Emits the ResourceActivated signal.
      *
@@ -412,8 +433,6 @@ private:
      */
     QList <Resource *> ValidSelectedResources(Resource::ResourceType resource_type);
 
-    void RefreshCounts();
-
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -496,6 +515,24 @@ private:
     QList <QModelIndex> m_SavedSelection;
 
     Resource *m_RenamedResource;
+
+    /**
+     * The count shown for each folder, and the folders
+     * whose rows changed since it was shown.
+     */
+    QHash<QStandardItem *, int> m_FolderCounts;
+    QSet<QStandardItem *> m_ChangedFolders;
+
+    /**
+     * Set when the folders themselves changed; all the counts
+     * are worked out again then.
+     */
+    bool m_CountsReset;
+
+    /**
+     * Collects the changes of a refresh into one update of the counts.
+     */
+    QTimer m_CountsTimer;
 };
 
 #endif // BOOKBROWSER_H
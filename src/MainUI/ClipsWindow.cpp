@@ -34,7 +34,8 @@ ClipsWindow::ClipsWindow(QWidget *parent)
     QDockWidget(tr("Clips"), parent),
     m_MainWidget(new QWidget(this)),
     m_Layout(new QVBoxLayout(m_MainWidget)),
-    m_TreeView(new QTreeView(m_MainWidget))
+    m_TreeView(new QTreeView(m_MainWidget)),
+    m_IsExpanded(false)
 {
     m_Layout->setContentsMargins(0, 0, 0, 0);
 #ifdef Q_OS_MAC
@@ -53,6 +54,13 @@ ClipsWindow::ClipsWindow(QWidget *parent)
 void ClipsWindow::showEvent(QShowEvent *event)
 {
     QDockWidget::showEvent(event);
+
+    // The groups are only read in once the clips are first shown
+    if (!m_IsExpanded) {
+        ExpandAll();
+        m_IsExpanded = true;
+    }
+
     raise();
 }
 
@@ -76,7 +84,12 @@ void ClipsWindow::SetupTreeView()
     m_TreeView->setHeaderHidden(true);
 
     m_TreeView->setColumnHidden(1, true);
+}
 
+
+void ClipsWindow::ExpandAll()
+{
+    m_ClipsModel->FetchAllEntries();
     m_TreeView->expandAll();
 }
 
@@ -101,6 +114,6 @@ void ClipsWindow::contextMenuEvent(QContextMenuEvent *event)
     menu->addAction(collapseAction);
     connect(collapseAction, SIGNAL(triggered()), m_TreeView, SLOT(collapseAll()));
     menu->addAction(expandAction);
-    connect(expandAction, SIGNAL(triggered()), m_TreeView, SLOT(expandAll()));
+    connect(expandAction, SIGNAL(triggered()), this, SLOT(ExpandAll()));
     menu->exec(mapToGlobal(event->pos()));
 }
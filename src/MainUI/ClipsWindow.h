@@ -57,6 +57,11 @@ private slots:
      */
     void ItemClickedHandler(const QModelIndex &index);
 
+    /**
+     * Reads in every group and expands them all.
+     */
+    void ExpandAll();
+
 protected:
 
     void contextMenuEvent(QContextMenuEvent *event);
@@ -88,6 +93,8 @@ private:
     QTreeView *m_TreeView;
 
     ClipEditorModel *m_ClipsModel;
+
+    bool m_IsExpanded;
 };
 
 #endif // CLIPSWINDOW_H
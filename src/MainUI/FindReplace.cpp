@@ -23,15 +23,21 @@
 *************************************************************************/
 #include <pcre.h>
 
+#include <QtCore/QSet>
 #include <QtGui/QKeyEvent>
 #include <QtWidgets/QLineEdit>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QCompleter>
 #include <QRegularExpression>
 
+#include "BookManipulation/Book.h"
+#include "BookManipulation/BookIndex.h"
+#include "Dialogs/FindAllResults.h"
 #include "MainUI/FindReplace.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/FindReplaceQLineEdit.h"
+#include "PCRE/PCRECache.h"
+#include "ResourceObjects/HTMLResource.h"
 
 static const QString SETTINGS_GROUP = "find_replace";
 static const QString REGEX_OPTION_UCP = "(*UCP)";
@@ -179,11 +185,41 @@ void FindReplace::ShowMessage(const QString &message)
         new_message.append(" (" % tr("Current File") % ")");
     }
 
+    // The count or replace is then only of what was found before
+    if (IsValidFindText() && !m_SpellCheck &&
+        PCRECache::instance()->getObject(GetSearchRegex())->takeMatchLimitExceeded()) {
+        new_message.append(" - " % tr("search stopped in some files: the pattern is too expensive"));
+    }
+
     ui.message->setText(new_message);
+    ui.message->setToolTip(JitStatus());
     m_timer.start(SHOW_FIND_RESULTS_MESSAGE_DELAY_MS);
     emit ShowMessageRequest(new_message);
 }
 
+QString FindReplace::JitStatus()
+{
+    if (GetSearchMode() != FindReplace::SearchMode_Regex || !IsValidFindText()) {
+        return QString();
+    }
+
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(GetSearchRegex());
+
+    if (!spcre->isValid()) {
+        return QString();
+    }
+
+    if (spcre->isJitCompiled()) {
+        return tr("The regex is compiled to machine code (JIT).");
+    }
+
+    if (!SPCRE::JitAvailable()) {
+        return tr("The regex is interpreted: JIT is not available in this build.");
+    }
+
+    return tr("The regex is interpreted: it could not be compiled to machine code.");
+}
+
 void FindReplace::SetKeyModifiers()
 {
     // Only use with mouse click not menu/shortcuts to avoid modifying actions
@@ -223,6 +259,13 @@ void FindReplace::CountClicked()
     ResetKeyModifiers();
 }
 
+void FindReplace::FindAllClicked()
+{
+    SetKeyModifiers();
+    FindAll();
+    ResetKeyModifiers();
+}
+
 bool FindReplace::FindAnyText(QString text, bool escape)
 {
     SetCodeViewIfNeeded(true);
@@ -320,7 +363,7 @@ int FindReplace::Count()
         // If wrap, all files are counted, otherwise only files before/after
         // the current file are counted, and then added to the count of current file.
         count = CountInFiles();
-        if (!m_OptionWrap) {
+        if (count >= 0 && !m_OptionWrap) {
             Searchable *searchable = GetAvailableSearchable();
             if (searchable) {
                 count += searchable->Count(GetSearchRegex(), GetSearchableDirection(), m_OptionWrap);
@@ -333,6 +376,8 @@ int FindReplace::Count()
     } else if (count > 0) {
         QString message = tr("Matches found: %n", "", count);
         ShowMessage(message);
+    } else {
+        ShowMessage(tr("Search cancelled"));
     }
 
     UpdatePreviousFindStrings();
@@ -340,6 +385,54 @@ int FindReplace::Count()
 }
 
 
+void FindReplace::FindAll()
+{
+    clearMessage();
+
+    if (!IsValidFindText()) {
+        return;
+    }
+
+    SetCodeViewIfNeeded(true);
+    QList<Resource *> resources;
+
+    // Marked text is searched as the whole of the current file
+    if (GetLookWhere() == FindReplace::LookWhere_CurrentFile || m_LookWhereCurrentFile) {
+        Resource *current_resource = GetCurrentResource();
+
+        if (current_resource) {
+            resources.append(current_resource);
+        }
+    } else if (GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles) {
+        resources = m_MainWindow->GetAllHTMLResources();
+    } else {
+        resources = m_MainWindow->GetValidSelectedHTMLResources();
+    }
+
+    if (resources.isEmpty()) {
+        CannotFindSearchTerm();
+        return;
+    }
+
+    // The search reads the resources, not the editors
+    ContentTab *tab = m_MainWindow->GetCurrentContentTab();
+
+    if (tab) {
+        tab->SaveTabContent();
+    }
+
+    if (!m_FindAllResults) {
+        m_FindAllResults = new FindAllResults(m_MainWindow, this);
+    }
+
+    m_FindAllResults->show();
+    m_FindAllResults->raise();
+    m_FindAllResults->activateWindow();
+    m_FindAllResults->Search(GetSearchRegex(), resources);
+    UpdatePreviousFindStrings();
+}
+
+
 bool FindReplace::Replace()
 {
     bool found = false;
@@ -752,6 +845,7 @@ int FindReplace::ReplaceInAllFiles()
     // For now, this must hold
     Q_ASSERT(GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles || GetLookWhere() == FindReplace::LookWhere_SelectedHTMLFiles);
     m_MainWindow->GetCurrentContentTab()->SaveTabContent();
+    m_MainWindow->CreateCheckpoint(tr("Replace All"));
     // When not wrapping remove the current resource as it's replace separately
     QList<Resource *>html_files = GetHTMLFiles();
     if (!m_OptionWrap) {
@@ -835,6 +929,16 @@ HTMLResource *FindReplace::GetNextContainingHTMLResource(Searchable::Direction d
         }
     }
 
+    // Files that cannot have a match are passed over without a search
+    QSet<HTMLResource *> candidates;
+    QList<HTMLResource *> html_resources;
+    foreach(Resource *resource, resources) {
+        html_resources.append(qobject_cast<HTMLResource *>(resource));
+    }
+    foreach(HTMLResource *html_resource, m_MainWindow->GetCurrentBook()->GetIndex()->GetFilesThatMayMatch(html_resources, GetSearchRegex())) {
+        candidates.insert(html_resource);
+    }
+
     HTMLResource *next_html_resource = starting_html_resource;
     bool passed_starting_html_resource = false;
 
@@ -849,7 +953,7 @@ HTMLResource *FindReplace::GetNextContainingHTMLResource(Searchable::Direction d
         }
 
         if (next_html_resource) {
-            if (ResourceContainsCurrentRegex(next_html_resource)) {
+            if (candidates.contains(next_html_resource) && ResourceContainsCurrentRegex(next_html_resource)) {
                 return next_html_resource;
             }
 
@@ -1084,6 +1188,7 @@ void FindReplace::ShowHideAdvancedOptions()
     ui.chkRegexOptionAutoTokenise->setVisible(show_advanced);
     ui.chkOptionWrap->setVisible(show_advanced);
     ui.count->setVisible(show_advanced);
+    ui.findAll->setVisible(show_advanced);
     QIcon icon;
 
     if (show_advanced) {
@@ -1178,6 +1283,37 @@ void FindReplace::LoadSearch(SearchEditorModel::searchEntry *search_entry)
     ShowMessage(message);
 }
 
+bool FindReplace::IsSearchGroupOnePass()
+{
+    // Otherwise what each search does depends on where the one
+    // before it left the caret.
+    return !m_LookWhereCurrentFile &&
+           !IsMarkedText() &&
+           m_OptionWrap &&
+           (GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles ||
+            GetLookWhere() == FindReplace::LookWhere_SelectedHTMLFiles);
+}
+
+QList<SearchOperations::ChainedSearch> FindReplace::LoadSearchChain(QList<SearchEditorModel::searchEntry *> search_entries)
+{
+    // Each search is loaded in turn so that it is read with the
+    // options of the dialog, as if it was run on its own.
+    QList<SearchOperations::ChainedSearch> searches;
+    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+        LoadSearch(search_entry);
+
+        if (!IsValidFindText()) {
+            continue;
+        }
+
+        SearchOperations::ChainedSearch search;
+        search.search_regex = GetSearchRegex();
+        search.replacement = ui.cbReplace->lineEdit()->text();
+        searches.append(search);
+    }
+    return searches;
+}
+
 void FindReplace::FindSearch(QList<SearchEditorModel::searchEntry *> search_entries)
 {
     if (search_entries.isEmpty()) {
@@ -1246,10 +1382,26 @@ void FindReplace::CountAllSearch(QList<SearchEditorModel::searchEntry *> search_
     SetKeyModifiers();
     m_IsSearchGroupRunning = true;
     int count = 0;
-    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
-        LoadSearch(search_entry);
-        count += Count();
+
+    if (IsSearchGroupOnePass()) {
+        QList<SearchOperations::ChainedSearch> searches = LoadSearchChain(search_entries);
+        SetCodeViewIfNeeded(true);
+        m_MainWindow->GetCurrentContentTab()->SaveTabContent();
+        count = SearchOperations::CountChainInFiles(searches, GetHTMLFiles(), SearchOperations::CodeViewSearch);
+    } else {
+        foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+            LoadSearch(search_entry);
+            int search_count = Count();
+
+            if (search_count < 0) {
+                count = -1;
+                break;
+            }
+
+            count += search_count;
+        }
     }
+
     m_IsSearchGroupRunning = false;
 
     if (count == 0) {
@@ -1257,6 +1409,8 @@ void FindReplace::CountAllSearch(QList<SearchEditorModel::searchEntry *> search_
     } else if (count > 0) {
         QString message = tr("Matches found: %n", "", count);
         ShowMessage(message);
+    } else {
+        ShowMessage(tr("Search cancelled"));
     }
 
     ResetKeyModifiers();
@@ -1272,10 +1426,25 @@ void FindReplace::ReplaceAllSearch(QList<SearchEditorModel::searchEntry *> searc
     SetKeyModifiers();
     m_IsSearchGroupRunning = true;
     int count = 0;
-    foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
-        LoadSearch(search_entry);
-        count += ReplaceAll();
+
+    if (IsSearchGroupOnePass()) {
+        QList<SearchOperations::ChainedSearch> searches = LoadSearchChain(search_entries);
+        SetCodeViewIfNeeded(true);
+        m_MainWindow->GetCurrentContentTab()->SaveTabContent();
+        count = SearchOperations::ReplaceChainInAllFiles(searches, GetHTMLFiles(), SearchOperations::CodeViewSearch);
+
+        if (count > 0) {
+            // Signal that the contents have changed and update the view
+            m_MainWindow->GetCurrentBook()->SetModified(true);
+            m_MainWindow->GetCurrentContentTab()->ContentChangedExternally();
+        }
+    } else {
+        foreach(SearchEditorModel::searchEntry * search_entry, search_entries) {
+            LoadSearch(search_entry);
+            count += ReplaceAll();
+        }
     }
+
     m_IsSearchGroupRunning = false;
 
     if (count == 0) {
@@ -1464,6 +1633,7 @@ void FindReplace::ConnectSignalsToSlots()
     connect(ui.findNext, SIGNAL(clicked()), this, SLOT(FindClicked()));
     connect(ui.cbFind->lineEdit(), SIGNAL(returnPressed()), this, SLOT(Find()));
     connect(ui.count, SIGNAL(clicked()), this, SLOT(CountClicked()));
+    connect(ui.findAll, SIGNAL(clicked()), this, SLOT(FindAllClicked()));
     connect(ui.replaceCurrent, SIGNAL(clicked()), this, SLOT(ReplaceCurrent()));
     connect(ui.replaceFind, SIGNAL(clicked()), this, SLOT(ReplaceClicked()));
     connect(ui.cbReplace->lineEdit(), SIGNAL(returnPressed()), this, SLOT(Replace()));
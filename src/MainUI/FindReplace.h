@@ -26,15 +26,18 @@
 #ifndef FINDREPLACE_H
 #define FINDREPLACE_H
 
+#include <QtCore/QPointer>
 #include <QtCore/QTimer>
 
 #include "ui_FindReplace.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "MainUI/MainWindow.h"
+#include "Misc/MatchOffsets.h"
 #include "Misc/SearchOperations.h"
 #include "MiscEditors/SearchEditorModel.h"
 #include "ViewEditors/Searchable.h"
 
+class FindAllResults;
 class HTMLResource;
 class Resource;
 class MainWindow;
@@ -126,6 +129,7 @@ private slots:
 
     void FindClicked();
     void CountClicked();
+    void FindAllClicked();
     void ReplaceClicked();
     void ReplaceAllClicked();
 
@@ -139,6 +143,10 @@ private slots:
     // term in the document.
     int Count();
 
+    // Lists every match in a results window, searching
+    // in the background.
+    void FindAll();
+
     // Uses the find direction to determine if we should replace next
     // or previous.
     bool Replace();
@@ -204,6 +212,14 @@ private:
 
     int CountInFiles();
 
+    /**
+     * Whether the searches of a group can be run together, each file
+     * taken through all of them at once.
+     */
+    bool IsSearchGroupOnePass();
+
+    QList<SearchOperations::ChainedSearch> LoadSearchChain(QList<SearchEditorModel::searchEntry *> search_entries);
+
     int ReplaceInAllFiles();
 
     bool FindInAllFiles(Searchable::Direction direction);
@@ -256,6 +272,9 @@ private:
     // Checks if Find is empty when not checking spelling
     bool IsValidFindText();
 
+    // Describes whether the regex being searched for runs JIT compiled
+    QString JitStatus();
+
     // Reads all the stored dialog settings
     void ReadSettings();
 
@@ -307,6 +326,8 @@ private:
     QString m_LastFindText;
 
     bool m_IsSearchGroupRunning;
+
+    QPointer<FindAllResults> m_FindAllResults;
 };
 
 
@@ -315,6 +336,12 @@ bool FindReplace::ResourceContainsCurrentRegex(T *resource)
 {
     // For now, this must hold
     Q_ASSERT(GetLookWhere() == FindReplace::LookWhere_AllHTMLFiles || GetLookWhere() == FindReplace::LookWhere_SelectedHTMLFiles);
+
+    // Looked up rather than searched again if the file was not edited
+    if (!m_SpellCheck) {
+        return !MatchOffsets::Get(GetSearchRegex(), resource, SearchOperations::CodeViewSearch)->isEmpty();
+    }
+
     Resource *generic_resource = resource;
     return SearchOperations::CountInFiles(
                GetSearchRegex(),
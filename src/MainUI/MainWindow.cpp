@@ -23,6 +23,8 @@
 *************************************************************************/
 
 #include <QtCore/QFileInfo>
+#include <QtCore/QLocale>
+#include <QtCore/QSet>
 #include <QtCore/QSignalMapper>
 #include <QtCore/QThread>
 #include <QtCore/QTimer>
@@ -45,9 +47,11 @@
 #include <QFont>
 #include <QFontMetrics>
 
+#include "BookManipulation/BookCheckpoints.h"
 #include "BookManipulation/CleanSource.h"
 #include "BookManipulation/Index.h"
 #include "BookManipulation/FolderKeeper.h"
+#include "BookManipulation/Headings.h"
 #include "Dialogs/About.h"
 #include "Dialogs/ClipEditor.h"
 #include "Dialogs/ClipboardHistorySelector.h"
@@ -55,6 +59,7 @@
 #include "Dialogs/EditTOC.h"
 #include "Dialogs/HeadingSelector.h"
 #include "Dialogs/LinkStylesheets.h"
+#include "Dialogs/MemoryDiagnostics.h"
 #include "Dialogs/MetaEditor.h"
 #include "Dialogs/PluginRunner.h"
 #include "Dialogs/Preferences.h"
@@ -75,16 +80,20 @@
 #include "MainUI/PreviewWindow.h"
 #include "MainUI/TableOfContents.h"
 #include "MainUI/ValidationResultsView.h"
+#include "Misc/BookNetworkAccess.h"
 #include "Misc/HTMLSpellCheck.h"
 #include "Misc/KeyboardShortcutManager.h"
+#include "Misc/NCXGenerator.h"
 #include "Misc/Plugin.h"
 #include "Misc/PluginDB.h"
-#include "Misc/PythonRoutines.h"
+#include "Misc/SaveJournal.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/SleepFunctions.h"
 #include "Misc/SpellCheck.h"
+#include "Misc/StartupProfiler.h"
 #include "Misc/TempFolder.h"
 #include "Misc/TOCHTMLWriter.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "MiscEditors/IndexHTMLWriter.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -94,6 +103,7 @@
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 #include "SourceUpdates/LinkUpdates.h"
+#include "SourceUpdates/StyleUpdates.h"
 #include "SourceUpdates/WordUpdates.h"
 #include "Tabs/FlowTab.h"
 #include "Tabs/OPFTab.h"
@@ -110,10 +120,20 @@ static const int ZOOM_SLIDER_MAX    = 1000;
 static const int ZOOM_SLIDER_MIDDLE = 500;
 static const int ZOOM_SLIDER_WIDTH  = 140;
 
+// Bounds on the wait between an edit and the Preview update it causes
+static const int PREVIEW_DELAY_MIN     = 200;
+static const int PREVIEW_DELAY_MAX     = 5000;
+static const int PREVIEW_DELAY_DEFAULT = 1000;
+// Added to the wait per this many characters of page
+static const int PREVIEW_CHARS_PER_MS  = 5000;
+
 static const QString DONATE         = "http://sigil-ebook.com/donate";
 static const QString SIGIL_WEBSITE  = "http://sigil-ebook.com";
 static const QString USER_GUIDE_URL = "http://sigil-ebook.com/documentation";
 
+// How far back a saved performance trace goes
+static const int PERFORMANCE_TRACE_SECONDS = 120;
+
 static const QString BOOK_BROWSER_NAME            = "bookbrowser";
 static const QString FIND_REPLACE_NAME            = "findreplace";
 static const QString VALIDATION_RESULTS_VIEW_NAME = "validationresultsname";
@@ -182,31 +202,46 @@ MainWindow::MainWindow(const QString &openfilepath, bool is_internal, QWidget *p
     m_PreviousHTMLResource(NULL),
     m_PreviousHTMLText(QString()),
     m_PreviousHTMLLocation(QList<ViewEditor::ElementIndex>()),
+    m_PreviewRenderCost(-1),
+    m_PreviewTextLength(0),
+    m_PreviewUpdateQueued(false),
     m_menuPluginsInput(NULL),
     m_menuPluginsOutput(NULL),
     m_menuPluginsEdit(NULL),
     m_menuPluginsValidation(NULL),
     m_pluginList(QStringList()),
-    m_SaveCSS(false)
+    m_SaveCSS(false),
+    m_SaveJournal(new SaveJournal(this))
 {
+    StartupProfiler::Phase setup_phase("MainWindow: set up ui");
     ui.setupUi(this);
 
     // Telling Qt to delete this window
     // from memory when it is closed
     setAttribute(Qt::WA_DeleteOnClose);
+    setup_phase.End();
+    StartupProfiler::Phase extend_phase("MainWindow: extend ui and register shortcuts");
     ExtendUI();
     PlatformSpecificTweaks();
+    extend_phase.End();
+    StartupProfiler::Phase settings_phase("MainWindow: read settings");
     // Needs to come before signals connect
     // (avoiding side-effects)
     ReadSettings();
     // Ensure the UI is properly set to the saved view state.
     SetDefaultViewState();
     SetupPreviewTimer();
+    settings_phase.End();
+    StartupProfiler::Phase connect_phase("MainWindow: connect signals");
     ConnectSignalsToSlots();
     CreateRecentFilesActions();
     UpdateRecentFileActions();
     ChangeSignalsWhenTabChanges(NULL, m_TabManager->GetCurrentContentTab());
+    connect_phase.End();
+    StartupProfiler::Phase load_phase("MainWindow: load initial file");
     LoadInitialFile(openfilepath, is_internal);
+    load_phase.End();
+    StartupProfiler::Phase plugins_phase("MainWindow: plugins menu");
     loadPluginsMenu();
 }
 
@@ -698,6 +733,9 @@ void MainWindow::closeEvent(QCloseEvent *event)
         if ((m_PreviewWindow)  && m_PreviewWindow->isVisible()) {
             m_PreviewWindow->hide();
         }
+
+        // Whatever was not saved was meant to be discarded
+        m_SaveJournal->Stop();
         event->accept();
     } else {
         event->ignore();
@@ -890,6 +928,52 @@ bool MainWindow::SaveAs()
 
 
 bool MainWindow::SaveACopy()
+{
+    QString filename = GetCopyFilename(tr("Save a Copy"));
+
+    if (filename.isEmpty()) {
+        return false;
+    }
+
+    return SaveCopy(filename);
+}
+
+bool MainWindow::SaveASample()
+{
+    SaveTabData();
+    QList<Resource *> html_resources = GetAllHTMLResources();
+
+    if (html_resources.isEmpty()) {
+        return false;
+    }
+
+    bool ok = false;
+    int count = QInputDialog::getInt(this, tr("Save a Sample"), tr("Number of files from the start of the reading order:"),
+                                     qMin(3, html_resources.count()), 1, html_resources.count(), 1, &ok);
+
+    if (!ok) {
+        return false;
+    }
+
+    QString filename = GetCopyFilename(tr("Save a Sample"));
+
+    if (filename.isEmpty()) {
+        return false;
+    }
+
+    // The first files in reading order with everything that is not HTML,
+    // so that the stylesheets, fonts and media they use come along
+    QList<Resource *> subset = html_resources.mid(0, count);
+    foreach(Resource *resource, m_Book->GetFolderKeeper()->GetResourceList()) {
+        if (resource->Type() != Resource::HTMLResourceType) {
+            subset.append(resource);
+        }
+    }
+
+    return SaveCopy(filename, subset);
+}
+
+QString MainWindow::GetCopyFilename(const QString &title)
 {
     if (m_CurrentFilePath.isEmpty()) {
         m_CurrentFilePath = (m_CurrentFileName.isEmpty())?DEFAULT_FILENAME:m_CurrentFileName;
@@ -899,12 +983,10 @@ bool MainWindow::SaveACopy()
         m_SaveACopyFilename = m_LastFolderOpen + "/" + QFileInfo(m_CurrentFilePath).completeBaseName() + "_copy." + QFileInfo(m_CurrentFilePath).suffix();
     }
 
-    QStringList filters(c_SaveFilters.values());
-    filters.removeDuplicates();
     QString filter_string = "*.epub";
     QString default_filter  = "*.epub";
     QString filename = QFileDialog::getSaveFileName(this,
-                       tr("Save a Copy"),
+                       title,
                        m_SaveACopyFilename,
                        filter_string,
 #if !defined(Q_OS_WIN32) && !defined(Q_OS_MAC)
@@ -922,7 +1004,7 @@ bool MainWindow::SaveACopy()
         if (m_CurrentFilePath == DEFAULT_FILENAME) {
             m_CurrentFilePath.clear();
         }
-        return false;
+        return QString();
     }
 
     QString extension = QFileInfo(filename).suffix();
@@ -931,9 +1013,42 @@ bool MainWindow::SaveACopy()
         filename += ".epub";
     }
 
+    // Files not yet used are still read from the open EPUB
+    if (QFileInfo(filename) == QFileInfo(m_CurrentFilePath)) {
+        QMessageBox::warning(this, tr("Sigil"), tr("A copy cannot be saved over the open EPUB. Use Save instead."));
+        return QString();
+    }
+
     // Store the filename the user saved to
     m_SaveACopyFilename = filename;
-    return SaveFile(filename, false);
+    return filename;
+}
+
+bool MainWindow::SaveCopy(const QString &fullfilepath, const QList<Resource *> &subset)
+{
+    try {
+        ShowMessageOnStatusBar(tr("Saving EPUB..."), 0);
+        SaveTabData();
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        // Unchanged files come compressed from the EPUB last saved
+        ExportEPUB(fullfilepath, m_Book).WriteCopy(m_CurrentFilePath, subset);
+
+        ContentTab *tab = GetCurrentContentTab();
+
+        if (tab != NULL) {
+            tab->setFocus();
+        }
+
+        ShowMessageOnStatusBar(tr("EPUB copy saved."));
+        QApplication::restoreOverrideCursor();
+    } catch (std::runtime_error e) {
+        ShowMessageOnStatusBar();
+        QApplication::restoreOverrideCursor();
+        Utility::DisplayExceptionErrorDialog(tr("Cannot save file %1: %2").arg(fullfilepath).arg(e.what()));
+        return false;
+    }
+
+    return true;
 }
 
 void MainWindow::Exit()
@@ -986,6 +1101,7 @@ void MainWindow::ViewImageDialog(const QUrl &url)
     try {
         Resource *resource = m_Book->GetFolderKeeper()->GetResourceByFilename(filename);
         if (resource->Type() == Resource::ImageResourceType || resource->Type() == Resource::SVGResourceType) {
+            resource->LoadDeferredContent();
             m_ViewImage->ShowImage(resource->GetFullPath());
         }
     } catch (ResourceDoesNotExist) {
@@ -1029,12 +1145,12 @@ void MainWindow::GoToLinkedStyleDefinition(const QString &element_name, const QS
                 }
             }
             if (css_resource) {
-                CSSInfo css_info(css_resource->GetText(), true);
-                CSSInfo::CSSSelector *selector = css_info.getCSSSelectorForElementClass(element_name, style_class_name);
+                QSharedPointer<CSSInfo> css_info = css_resource->GetCSSInfo();
+                CSSInfo::CSSSelector *selector = css_info->getCSSSelectorForElementClass(element_name, style_class_name);
 
                 // If we fail to find a matching class, search again with just the element
                 if (!style_class_name.isEmpty() && !selector) {
-                    selector = css_info.getCSSSelectorForElementClass(element_name, "");
+                    selector = css_info->getCSSSelectorForElementClass(element_name, "");
                 }
 
                 if (selector) {
@@ -1237,6 +1353,7 @@ void MainWindow::AddCover()
 
             // Add the filename and dimensions of the image to the HTML source.
             QString image_relative_path = "../" + image_resource->GetRelativePathToOEBPS();
+            image_resource->LoadDeferredContent();
             QImage img(image_resource->GetFullPath());
             QString text = html_cover_resource->GetText();
             QString width = QString::number(img.width());
@@ -1285,8 +1402,9 @@ void MainWindow::UpdateManifestProperties()
     SaveTabData();
     QApplication::setOverrideCursor(Qt::WaitCursor);
     QList<Resource *> resources = GetAllHTMLResources();
-    m_Book->GetOPF()->UpdateManifestProperties(resources);
-    m_Book->SetModified();
+    if (m_Book->GetOPF()->UpdateManifestProperties(resources)) {
+        m_Book->SetModified();
+    }
     ShowMessageOnStatusBar(tr("OPF Manifest Properties Updated."));
     QApplication::restoreOverrideCursor();
 }
@@ -1324,11 +1442,7 @@ void MainWindow::GenerateNCXFromNav()
     } 
     QString mainid = m_Book->GetConstOPF()->GetMainIdentifierValue();
 
-    // Now build the ncx in python in a separate thread since may be an long job
-    PythonRoutines pr;
-    QFuture<QString> future = QtConcurrent::run(&pr, &PythonRoutines::GenerateNcxInPython, navdata, navname, doctitle, mainid);
-    future.waitForFinished();
-    QString ncxdata = future.result();
+    QString ncxdata = NCXGenerator::GenerateNCX(navdata, navname, doctitle, mainid);
 
     if (!ncxdata.isEmpty()) {
         NCXResource * ncx_resource = m_Book->GetNCX();
@@ -1339,28 +1453,8 @@ void MainWindow::GenerateNCXFromNav()
         m_BookBrowser->Refresh();
         m_Book->SetModified();
 
-        // now update the guide entries as well
-        PythonRoutines pr;
-        QList<QStringList> results = pr.UpdateGuideFromNavInPython(navdata, navname);
-        foreach(QStringList entry, results) {
-           QString gtype = entry.at(0);
-           QString href  = entry.at(1);
-           if (!gtype.isEmpty() && !href.isEmpty()) {
-               // remove any fragment identifier and extract file name
-               QStringList parts = href.split('#', QString::KeepEmptyParts);
-               QString base = parts.at(0);
-               QStringList path_pieces = base.split("/");
-               int last = path_pieces.count() - 1;
-               QString filename = path_pieces.at(last);
-               Resource * resource = m_Book->GetFolderKeeper()->GetResourceByFilename(filename);
-               HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
-               if (html_resource) {
-                   // The OPFResource AddSemantic code defaults to remove by adding again (ie. toggling)
-                   // Setting the last parameter (toggle) to false disables toggling
-                   m_Book->GetOPF()->AddGuideSemanticCode(html_resource, gtype, false); 
-               }
-           }
-        }
+        // now bring the guide entries in line with the nav landmarks
+        m_Book->GetOPF()->UpdateGuideFromNav();
 
         ShowMessageOnStatusBar(tr("NCX generated."));
         QApplication::restoreOverrideCursor();
@@ -1405,6 +1499,7 @@ void MainWindow::CreateIndex()
 
     HTMLResource *index_resource = NULL;
     QList<HTMLResource *> html_resources;
+    QMap<int, HTMLResource *> index_sections;
 
     // Turn the list of Resources that are really HTMLResources to a real list
     // of HTMLResources stripping out any front or back matter
@@ -1448,6 +1543,17 @@ void MainWindow::CreateIndex()
     // Make sure you not indexing the index page itself
     html_resources.removeOne(index_resource);
 
+    // Nor its later pages, if it was split
+    foreach(Resource * resource, resources) {
+        HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+        int section = IndexHTMLWriter::SectionNumber(index_resource->Filename(), resource->Filename());
+        if (html_resource && section > 0) {
+            m_TabManager->CloseTabForResource(html_resource);
+            index_sections.insert(section, html_resource);
+            html_resources.removeOne(html_resource);
+        }
+    }
+
     // Skip indexing any epub3 nav document
     HTMLResource * nav_resource = m_Book->GetConstOPF()->GetNavResource();
     if (nav_resource) {
@@ -1460,10 +1566,32 @@ void MainWindow::CreateIndex()
         return;
     }
 
-    // Write out the HTML index file.
+    // Write out the HTML index file, split into pages if it is large.
     QString version = index_resource->GetEpubVersion();
     IndexHTMLWriter index;
-    index_resource->SetText(index.WriteXML(version));
+    SettingsStore ss;
+    QStringList pages = index.WriteSections(version, ss.indexSectionSize() * 1024, index_resource->Filename());
+    HTMLResource *previous_page = NULL;
+    for (int i = 0; i < pages.count(); i++) {
+        HTMLResource *page_resource = index_resource;
+        if (i > 0) {
+            page_resource = index_sections.take(i);
+            if (!page_resource) {
+                page_resource = m_Book->CreateEmptyHTMLFile(previous_page);
+                page_resource->RenameTo(IndexHTMLWriter::SectionFilename(index_resource->Filename(), i));
+            }
+        }
+        // Pages that come out the same are left alone
+        if (page_resource->GetText() != pages.at(i)) {
+            page_resource->SetText(pages.at(i));
+        }
+        previous_page = page_resource;
+    }
+    // Pages the index no longer needs
+    foreach(HTMLResource *section_resource, index_sections) {
+        m_Book->GetFolderKeeper()->RemoveResource(section_resource);
+        section_resource->Delete();
+    }
 
     // Normally Setting a semantic on a resource that already has it set will remove the semantic.
     //  Pass along toggle as false to disable this default behaviour
@@ -1506,13 +1634,29 @@ void MainWindow::DeleteReportsStyles(QList<BookReports::StyleData *> reports_sty
     }
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    // Save our tabs data as we will be modifying the underlying resources
+    SaveTabData();
 
-    // Actually delete the styles
-    QHashIterator<QString, QList<CSSInfo::CSSSelector *>> stylesheets_to_delete(css_styles_to_delete);
+    // Stylesheets are the most likely place for a style; a filename
+    // that is not one names an HTML file with inline styles
+    QList<TextResource *> resources;
+    QSet<QString> found;
+    foreach(Resource * resource, m_BookBrowser->AllCSSResources()) {
+        if (css_styles_to_delete.contains(resource->Filename()) && !found.contains(resource->Filename())) {
+            resources.append(qobject_cast<TextResource *>(resource));
+            found.insert(resource->Filename());
+        }
+    }
+    foreach(Resource * resource, GetAllHTMLResources()) {
+        if (css_styles_to_delete.contains(resource->Filename()) && !found.contains(resource->Filename())) {
+            resources.append(qobject_cast<TextResource *>(resource));
+            found.insert(resource->Filename());
+        }
+    }
 
-    while (stylesheets_to_delete.hasNext()) {
-        stylesheets_to_delete.next();
-        DeleteCSSStyles(stylesheets_to_delete.key(), stylesheets_to_delete.value());
+    // Actually delete the styles, every file at once
+    if (StyleUpdates::DeleteStylesInAllFiles(resources, css_styles_to_delete) > 0) {
+        m_Book->SetModified();
     }
 
     ShowMessageOnStatusBar(tr("Styles deleted."));
@@ -1577,42 +1721,6 @@ void MainWindow::DeleteFilenames(QStringList files_to_delete)
     RemoveResources(resources);
 }
 
-bool MainWindow::DeleteCSSStyles(const QString &filename, QList<CSSInfo::CSSSelector *> css_selectors)
-{
-    // Save our tabs data as we will be modifying the underlying resources
-    SaveTabData();
-    bool is_modified = false;
-    bool is_found = false;
-    // Try our CSS resources first as most likely place for a style
-    QList<Resource *> css_resources = m_BookBrowser->AllCSSResources();
-    foreach(Resource * resource, css_resources) {
-        if (resource->Filename() == filename) {
-            CSSResource *css_resource = qobject_cast<CSSResource *>(resource);
-            is_found = true;
-            is_modified = css_resource->DeleteCSStyles(css_selectors);
-            break;
-        }
-    }
-
-    if (!is_found) {
-        // Try an inline style instead
-        QList<Resource *> html_resources = GetAllHTMLResources();
-        foreach(Resource * resource, html_resources) {
-            if (resource->Filename() == filename) {
-                HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
-                is_modified = html_resource->DeleteCSStyles(css_selectors);
-                break;
-            }
-        }
-    }
-
-    if (is_modified) {
-        m_Book->SetModified();
-    }
-
-    return is_modified;
-}
-
 void MainWindow::DeleteUnusedMedia()
 {
     SaveTabData();
@@ -1631,9 +1739,7 @@ void MainWindow::DeleteUnusedMedia()
     QList<Resource *> css_resources = m_BookBrowser->AllCSSResources();
     foreach(Resource *resource, css_resources) {
         CSSResource *css_resource = dynamic_cast<CSSResource *>(resource);
-        CSSInfo css_info(css_resource->GetText(), true);
-
-        style_urls.append(css_info.getAllPropertyValues(""));
+        style_urls.append(css_resource->GetCSSInfo()->getAllPropertyValues(""));
     }
     // Get file urls from HTML CSS files
     QList<Resource *> html_resources = GetAllHTMLResources();
@@ -1676,6 +1782,24 @@ void MainWindow::DeleteUnusedMedia()
     }
 }
 
+void MainWindow::OptimizeImages()
+{
+    SaveTabData();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    qint64 bytes_saved = 0;
+    QList<Resource *> optimized = m_Book->OptimizeImages(bytes_saved);
+    QApplication::restoreOverrideCursor();
+
+    if (optimized.isEmpty()) {
+        QMessageBox::information(this, tr("Sigil"), tr("There are no image files that can be made smaller."));
+        return;
+    }
+
+    QString kb_saved = QString::number(bytes_saved / 1024.0, 'f', 2);
+    QMessageBox::information(this, tr("Sigil"), tr("Optimized %1 image files, saving %2 KB.").arg(optimized.count()).arg(kb_saved));
+    ShowMessageOnStatusBar(tr("Image files optimized."));
+}
+
 void MainWindow::DeleteUnusedStyles()
 {
     SaveTabData();
@@ -1695,6 +1819,7 @@ void MainWindow::DeleteUnusedStyles()
     }
 
     if (css_selectors_to_delete.count() > 0) {
+        CreateCheckpoint(tr("Delete Unused Stylesheet Classes"));
         DeleteReportsStyles(css_selectors_to_delete);
     } else {
         QMessageBox::information(this, tr("Sigil"), tr("There are no unused stylesheet classes to delete."));
@@ -1702,6 +1827,93 @@ void MainWindow::DeleteUnusedStyles()
     qDeleteAll(css_selector_usage);
 }
 
+void MainWindow::CreateCheckpoint(const QString &description)
+{
+    SaveTabData();
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    m_Book->GetCheckpoints()->Create(description);
+    QApplication::restoreOverrideCursor();
+}
+
+void MainWindow::RestoreCheckpoint()
+{
+    SaveTabData();
+    BookCheckpoints *checkpoints = m_Book->GetCheckpoints();
+
+    if (checkpoints->Count() == 0) {
+        QMessageBox::information(this, tr("Sigil"), tr("There are no checkpoints to restore. One is kept before each "
+                                 "Replace All in several files, Mend, Delete Unused Stylesheet Classes and plugin run."));
+        return;
+    }
+
+    // Numbered, two checkpoints can be alike
+    QStringList items;
+    QStringList descriptions = checkpoints->GetDescriptions();
+    for (int i = 0; i < descriptions.count(); ++i) {
+        items.append(QString("%1. %2").arg(i + 1).arg(descriptions.at(i)));
+    }
+
+    bool ok = false;
+    QString item = QInputDialog::getItem(this, tr("Restore Checkpoint"), tr("Restore the book as it was before:"),
+                                         items, 0, false, &ok);
+
+    if (!ok) {
+        return;
+    }
+
+    const int checkpoint = items.indexOf(item);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    // The files the book did not have then are deleted, so close their tabs
+    // while making sure one tab stays open
+    QList<Resource *> added = checkpoints->GetAddedSince(checkpoint);
+    QList<Resource *> tab_resources = m_TabManager->GetTabResources();
+    bool tabs_will_remain = false;
+    foreach(Resource *tab_resource, tab_resources) {
+        if (!added.contains(tab_resource)) {
+            tabs_will_remain = true;
+            break;
+        }
+    }
+
+    if (!tabs_will_remain) {
+        foreach(Resource *html_resource, GetAllHTMLResources()) {
+            if (!added.contains(html_resource)) {
+                OpenResource(html_resource);
+                break;
+            }
+        }
+    }
+
+    foreach(Resource *resource, added) {
+        if (tab_resources.contains(resource)) {
+            m_TabManager->CloseTabForResource(resource);
+        }
+    }
+
+    QString error;
+    bool restored = checkpoints->Restore(checkpoint, error);
+
+    QList<Resource *> current_resources = m_Book->GetFolderKeeper()->GetResourceListByType(Resource::HTMLResourceType);
+    if (!current_resources.contains(m_PreviousHTMLResource)) {
+        m_PreviousHTMLResource = NULL;
+        m_PreviousHTMLText = "";
+        m_PreviousHTMLLocation = QList<ViewEditor::ElementIndex>();
+    }
+
+    m_BookBrowser->BookContentModified();
+    m_BookBrowser->Refresh();
+    m_Book->SetModified();
+    ResourcesAddedOrDeleted();
+    QApplication::restoreOverrideCursor();
+
+    if (!restored) {
+        QMessageBox::warning(this, tr("Sigil"), error);
+    }
+
+    ShowMessageOnStatusBar(tr("Checkpoint restored."));
+}
+
 void MainWindow::InsertFileDialog()
 {
     SaveTabData();
@@ -2342,7 +2554,7 @@ void MainWindow::FindWord(QString word)
     }
 }
 
-void MainWindow::UpdateWord(QString old_word, QString new_word)
+void MainWindow::UpdateWords(const QHash<QString, QString> &substitutions)
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
 
@@ -2358,7 +2570,7 @@ void MainWindow::UpdateWord(QString old_word, QString new_word)
         }
     }
 
-    WordUpdates::UpdateWordInAllFiles(html_resources, old_word, new_word);
+    WordUpdates::UpdateWordsInAllFiles(html_resources, substitutions);
     m_Book->SetModified();
     m_SpellcheckEditor->Refresh();
     ShowMessageOnStatusBar(tr("Word updated."));
@@ -2370,12 +2582,30 @@ QList<std::pair<QString, bool>> MainWindow::GetStylesheetsMap(QList<Resource *>
 {
     QList<std::pair<QString, bool>> stylesheet_map;
     QList<Resource *> css_resources = m_BookBrowser->AllCSSResources();
+    QSet<QString> existing_stylesheets;
+    foreach(Resource * css_resource, css_resources) {
+        existing_stylesheets.insert("../" + css_resource->GetRelativePathToOEBPS());
+    }
+    // The book index has the linked stylesheets of every file, and only
+    // scans the heads of the files changed since it last did
+    const QHash<QString, QStringList> linked_by_file = m_Book->GetStylesheetsInHTMLFiles();
     // Use the first resource to get a list of known linked stylesheets in order.
-    QStringList checked_linked_paths = GetStylesheetsAlreadyLinked(resources.at(0));
     // Then only consider them included if every selected resource includes
     // the same stylesheets in the same order.
-    foreach(Resource * valid_resource, resources) {
-        QStringList linked_paths = GetStylesheetsAlreadyLinked(valid_resource);
+    QStringList checked_linked_paths;
+    for (int i = 0; i < resources.count(); ++i) {
+        QStringList linked_paths;
+        foreach(QString pathname, linked_by_file.value(resources.at(i)->Filename())) {
+            pathname = Utility::URLDecodePath(pathname);
+            // Only list the stylesheet if it exists in the book
+            if (existing_stylesheets.contains(pathname)) {
+                linked_paths.append(pathname);
+            }
+        }
+        if (i == 0) {
+            checked_linked_paths = linked_paths;
+            continue;
+        }
         foreach(QString path, checked_linked_paths) {
             if (!linked_paths.contains(path)) {
                 checked_linked_paths.removeOne(path);
@@ -2578,7 +2808,11 @@ void MainWindow::CreateHTMLTOC()
     }
     TOCHTMLWriter toc(m_TableOfContents->GetRootEntry());
     QString version = tocResource->GetEpubVersion();
-    tocResource->SetText(toc.WriteXML(version));
+    QString toc_text = toc.WriteXML(version);
+    // Left alone when regenerated unchanged, so nothing that caches its text starts over
+    if (tocResource->GetText() != toc_text) {
+        tocResource->SetText(toc_text);
+    }
 
     // Setting a semantic on a resource that already has it set will remove the semantic.
     // Unless you pass toggle as false as the final parameter
@@ -2772,6 +3006,38 @@ void MainWindow::SigilWebsite()
 }
 
 
+void MainWindow::SavePerformanceTrace()
+{
+    QString filename = QFileDialog::getSaveFileName(this,
+                       tr("Save Performance Trace"),
+                       m_LastFolderOpen + "/sigil_trace.json",
+                       tr("Trace files (*.json)")
+#if !defined(Q_OS_WIN32) && !defined(Q_OS_MAC)
+                       , NULL,
+                       QFileDialog::DontUseNativeDialog
+#endif
+                                                   );
+
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    if (!Trace::WriteChromeTrace(filename, PERFORMANCE_TRACE_SECONDS)) {
+        Utility::DisplayStdErrorDialog(tr("Cannot write the trace to %1").arg(QDir::toNativeSeparators(filename)));
+        return;
+    }
+
+    ShowMessageOnStatusBar(tr("Performance trace saved."));
+}
+
+
+void MainWindow::MemoryDiagnosticsDialog()
+{
+    MemoryDiagnostics diagnostics(m_Book, m_TabManager, this);
+    diagnostics.exec();
+}
+
+
 void MainWindow::AboutDialog()
 {
     About about(this);
@@ -2994,6 +3260,7 @@ void MainWindow::UpdateUIOnTabChanges()
     UpdateZoomLabel(zoom_factor);
     UpdateZoomSlider(zoom_factor);
     UpdateCursorPositionLabel(tab->GetCursorLine(), tab->GetCursorColumn());
+    UpdateUndoMemoryLabel(tab->GetUndoMemory());
     SelectEntryOnHeadingToolbar(tab->GetCaretElementName());
 }
 
@@ -3330,16 +3597,88 @@ void MainWindow::SetStateActionsStaticView()
 void MainWindow::SetupPreviewTimer()
 {
     m_PreviewTimer.setSingleShot(true);
-    m_PreviewTimer.setInterval(1000);
+    m_PreviewTimer.setInterval(PREVIEW_DELAY_DEFAULT);
     connect(&m_PreviewTimer, SIGNAL(timeout()), this, SLOT(UpdatePreview()));
 }
 
+int MainWindow::PreviewDelay() const
+{
+    if (m_PreviewRenderCost < 0) {
+        return PREVIEW_DELAY_DEFAULT;
+    }
+
+    // Long enough that a burst of typing is one render, and that pages
+    // which are slow to render do not queue them up
+    int delay = qRound(m_PreviewRenderCost * 2) + m_PreviewTextLength / PREVIEW_CHARS_PER_MS;
+    return qBound(PREVIEW_DELAY_MIN, delay, PREVIEW_DELAY_MAX);
+}
+
 void MainWindow::UpdatePreviewRequest()
 {
+    // Requests that come in while waiting are coalesced into one update
     if (m_PreviewTimer.isActive()) {
         m_PreviewTimer.stop();
     }
-    m_PreviewTimer.start();
+    m_PreviewTimer.start(PreviewDelay());
+}
+
+void MainWindow::PreviewRendered(int prepare_ms, int load_ms, int layout_ms, bool patched)
+{
+    int total = prepare_ms + load_ms + layout_ms;
+
+    if (m_PreviewRenderCost < 0) {
+        m_PreviewRenderCost = total;
+    } else {
+        m_PreviewRenderCost = m_PreviewRenderCost * 0.7 + total * 0.3;
+    }
+
+    m_lbPreviewTime->setText(tr("Preview: %1 ms").arg(total));
+    m_lbPreviewTime->setToolTip(tr("Prepare: %1 ms, %2: %3 ms, Layout: %4 ms")
+                                .arg(prepare_ms)
+                                .arg(patched ? tr("Patch") : tr("Load"))
+                                .arg(load_ms)
+                                .arg(layout_ms));
+    m_lbPreviewTime->show();
+
+    if (m_PreviewUpdateQueued) {
+        m_PreviewUpdateQueued = false;
+        UpdatePreviewRequest();
+        return;
+    }
+
+    PreRenderPreviewNeighbours();
+}
+
+void MainWindow::PreRenderPreviewNeighbours()
+{
+    SettingsStore settings;
+
+    if (!settings.previewPreRender() || !m_PreviousHTMLResource) {
+        m_PreviewWindow->ClearPreRendered();
+        return;
+    }
+
+    const QList<HTMLResource *> html_resources = m_Book->GetFolderKeeper()->GetResourceTypeList<HTMLResource>(true);
+    int current = html_resources.indexOf(m_PreviousHTMLResource);
+
+    if (current == -1) {
+        return;
+    }
+
+    // The next file first, as reading moves forward more often
+    QList<QPair<QString, QString> > pages;
+    int max_pages = settings.previewPreRenderPages();
+    for (int distance = 1; pages.count() < max_pages && distance < html_resources.count(); ++distance) {
+        if (current + distance < html_resources.count()) {
+            HTMLResource *next = html_resources.at(current + distance);
+            pages.append(qMakePair(next->GetFullPath(), next->GetText()));
+        }
+        if (pages.count() < max_pages && current - distance >= 0) {
+            HTMLResource *previous = html_resources.at(current - distance);
+            pages.append(qMakePair(previous->GetFullPath(), previous->GetText()));
+        }
+    }
+    m_PreviewWindow->PreRenderPages(pages);
 }
 
 void MainWindow::UpdatePreviewCSSRequest()
@@ -3373,6 +3712,13 @@ void MainWindow::UpdatePreview()
 {
     m_PreviewTimer.stop();
 
+    // Never more than one render at a time; this one is done
+    // once the page being loaded is in
+    if (m_PreviewWindow->IsRendering()) {
+        m_PreviewUpdateQueued = true;
+        return;
+    }
+
     QString text;
     QList<ViewEditor::ElementIndex> location;
     HTMLResource *html_resource;
@@ -3383,7 +3729,18 @@ void MainWindow::UpdatePreview()
         // Save CSS if update requested from CSS tab
         if (m_SaveCSS) {
             m_SaveCSS = false;
+            // The page shown takes the new stylesheet in place, unless
+            // only loading it again can show the change
+            CSSResource *css_resource = qobject_cast<CSSResource *>(tab->GetLoadedResource());
+            bool stylesheet_updated = css_resource && m_PreviousHTMLResource &&
+                                      m_PreviewWindow->UpdateStylesheet(css_resource->GetFullPath(), css_resource->GetText());
             tab->SaveTabContent();
+            // Loaded with the stylesheet as it was
+            m_PreviewWindow->ClearPreRendered();
+
+            if (stylesheet_updated) {
+                return;
+            }
         }
 
         html_resource = qobject_cast<HTMLResource *>(tab->GetLoadedResource());
@@ -3421,6 +3778,7 @@ void MainWindow::UpdatePreview()
             m_PreviousHTMLResource = html_resource;
             m_PreviousHTMLText = text;
             m_PreviousHTMLLocation = location;
+            m_PreviewTextLength = text.length();
 
             m_PreviewWindow->UpdatePage(html_resource->GetFullPath(), text, location);
         }
@@ -3447,6 +3805,19 @@ void MainWindow::UpdateCursorPositionLabel(int line, int column)
     }
 }
 
+void MainWindow::UpdateUndoMemoryLabel(qint64 bytes)
+{
+    if (bytes >= 0) {
+        const QString size = QLocale().toString(bytes / (1024.0 * 1024.0), 'f', 1);
+        m_lbUndoMemory->setText(tr("Undo: %1 MB").arg(size));
+        m_lbUndoMemory->setToolTip(tr("Memory held by the undo history of this tab"));
+        m_lbUndoMemory->show();
+    } else {
+        m_lbUndoMemory->clear();
+        m_lbUndoMemory->hide();
+    }
+}
+
 void MainWindow::SliderZoom(int slider_value)
 {
     ContentTab *tab = m_TabManager->GetCurrentContentTab();
@@ -3500,11 +3871,13 @@ void MainWindow::SetAutoSpellCheck(bool new_state)
 
 void MainWindow::MendPrettifyHTML()
 {
+    CreateCheckpoint(tr("Mend and Prettify All HTML Files"));
     m_Book->ReformatAllHTML(false);
 }
 
 void MainWindow::MendHTML()
 {
+    CreateCheckpoint(tr("Mend All HTML Files"));
     m_Book->ReformatAllHTML(true);
 }
 
@@ -3626,7 +3999,7 @@ void MainWindow::SplitOnSGFSectionMarkers()
     QList<Resource *> changed_resources;
     foreach(Resource * resource, html_resources) {
         HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
-        QStringList new_sections = html_resource->SplitOnSGFSectionMarkers();
+        XhtmlDoc::SGFSections new_sections = html_resource->SplitOnSGFSectionMarkers();
 
         if (!new_sections.isEmpty()) {
             m_Book->CreateNewSections(new_sections, html_resource);
@@ -3786,6 +4159,8 @@ void MainWindow::SetNewBook(QSharedPointer<Book> new_book)
     m_TabManager->CloseOtherTabs();
     m_TabManager->CloseAllTabs(true);
     m_Book = new_book;
+    BookNetworkAccess::instance()->AddBook(m_Book);
+    Headings::ClearCache();
     m_BookBrowser->SetBook(m_Book);
     m_TableOfContents->SetBook(m_Book);
     m_ValidationResultsView->SetBook(m_Book);
@@ -3816,6 +4191,77 @@ void MainWindow::ResourcesAddedOrDeleted()
 }
 
 
+void MainWindow::RecoverUnsavedChanges()
+{
+    foreach(QString journal_path, SaveJournal::FindAbandoned()) {
+        const QString epub_path = SaveJournal::JournaledEpub(journal_path);
+
+        if (epub_path.isEmpty()) {
+            SaveJournal::Discard(journal_path);
+            continue;
+        }
+
+        QMessageBox::StandardButton button_pressed;
+        button_pressed = QMessageBox::warning(this,
+                                              tr("Sigil"),
+                                              tr("Sigil did not close properly while %1 had unsaved changes.\n\n"
+                                                 "Do you want to recover them? If not, they are discarded.")
+                                              .arg(QDir::toNativeSeparators(epub_path)),
+                                              QMessageBox::Yes | QMessageBox::No
+                                             );
+
+        if (button_pressed != QMessageBox::Yes) {
+            SaveJournal::Discard(journal_path);
+            continue;
+        }
+
+        // Into this window if it only holds the empty new book
+        MainWindow *window = this;
+
+        if (!m_CurrentFilePath.isEmpty() || isWindowModified()) {
+            window = new MainWindow();
+            window->show();
+        }
+
+        window->RecoverFromJournal(journal_path, epub_path);
+    }
+}
+
+
+void MainWindow::RecoverFromJournal(const QString &journal_path, const QString &epub_path)
+{
+    // The journal stays to be offered again if the EPUB is only
+    // missing for now, e.g. on a drive that is not mounted
+    if (!LoadFile(epub_path)) {
+        return;
+    }
+
+    // Files may be removed or renamed under open tabs otherwise
+    m_TabManager->CloseAllTabs(true);
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    QString error;
+    int changes = SaveJournal::Replay(journal_path, m_Book, error);
+    QApplication::restoreOverrideCursor();
+
+    if (changes < 0) {
+        SaveJournal::Discard(journal_path);
+        Utility::DisplayStdErrorDialog(tr("The unsaved changes could not be recovered."), error);
+        return;
+    }
+
+    m_SaveJournal->Resume(m_Book, journal_path);
+    m_BookBrowser->Refresh();
+    QList<HTMLResource *> html_resources = m_Book->GetHTMLResources();
+
+    if (!html_resources.isEmpty()) {
+        OpenResource(html_resources.first());
+    }
+
+    m_Book->SetModified(true);
+    ShowMessageOnStatusBar(tr("Unsaved changes recovered."));
+}
+
+
 void MainWindow::CreateNewBook()
 {
     QSharedPointer<Book> new_book = QSharedPointer<Book>(new Book());
@@ -3830,6 +4276,7 @@ void MainWindow::CreateNewBook()
     new_book->SetModified(false);
     m_SaveACopyFilename = "";
     UpdateUiWithCurrentFile("");
+    m_SaveJournal->Stop();
 }
 
 
@@ -3887,9 +4334,11 @@ bool MainWindow::LoadFile(const QString &fullfilepath, bool is_internal)
                 // Clear the last inserted file
                 m_LastInsertedFile = "";
                 UpdateUiWithCurrentFile(fullfilepath);
+                m_SaveJournal->Start(m_Book, fullfilepath);
             } else {
                 UpdateUiWithCurrentFile("");
                 m_Book->SetModified();
+                m_SaveJournal->Stop();
             }
 
             return true;
@@ -3989,6 +4438,7 @@ bool MainWindow::SaveFile(const QString &fullfilepath, bool update_current_filen
         }
 
         ExporterFactory().GetExporter(fullfilepath, m_Book)->WriteBook();
+        m_Book->GetFolderKeeper()->SaveContentHashes(fullfilepath);
 
         // Return the focus back to the current tab
         ContentTab *tab = GetCurrentContentTab();
@@ -4000,6 +4450,8 @@ bool MainWindow::SaveFile(const QString &fullfilepath, bool update_current_filen
         if (update_current_filename) {
             m_Book->SetModified(false);
             UpdateUiWithCurrentFile(fullfilepath);
+            // The saved EPUB is what the changes are journaled over now
+            m_SaveJournal->Start(m_Book, fullfilepath);
         }
 
         if (not_well_formed) {
@@ -4397,6 +4849,12 @@ void MainWindow::ExtendUI()
     m_lbCursorPosition = new QLabel(QString(""), statusBar());
     statusBar()->addPermanentWidget(m_lbCursorPosition);
     UpdateCursorPositionLabel(0, 0);
+    m_lbUndoMemory = new QLabel(QString(""), statusBar());
+    statusBar()->addPermanentWidget(m_lbUndoMemory);
+    UpdateUndoMemoryLabel(-1);
+    m_lbPreviewTime = new QLabel(QString(""), statusBar());
+    statusBar()->addPermanentWidget(m_lbPreviewTime);
+    m_lbPreviewTime->hide();
     // Creating the zoom controls in the status bar
     m_slZoomSlider = new QSlider(Qt::Horizontal, statusBar());
     m_slZoomSlider->setTracking(false);
@@ -4439,12 +4897,14 @@ void MainWindow::ExtendUI()
     sm->registerAction(this, ui.actionSave, "MainWindow.Save");
     sm->registerAction(this, ui.actionSaveAs, "MainWindow.SaveAs");
     sm->registerAction(this, ui.actionSaveACopy, "MainWindow.SaveACopy");
+    sm->registerAction(this, ui.actionSaveASample, "MainWindow.SaveASample");
     sm->registerAction(this, ui.actionPrintPreview, "MainWindow.PrintPreview");
     sm->registerAction(this, ui.actionPrint, "MainWindow.Print");
     sm->registerAction(this, ui.actionExit, "MainWindow.Exit");
     // Edit
     sm->registerAction(this, ui.actionUndo, "MainWindow.Undo");
     sm->registerAction(this, ui.actionRedo, "MainWindow.Redo");
+    sm->registerAction(this, ui.actionRestoreCheckpoint, "MainWindow.RestoreCheckpoint");
     sm->registerAction(this, ui.actionCut, "MainWindow.Cut");
     sm->registerAction(this, ui.actionCopy, "MainWindow.Copy");
     sm->registerAction(this, ui.actionPaste, "MainWindow.Paste");
@@ -4538,6 +4998,7 @@ void MainWindow::ExtendUI()
     sm->registerAction(this, ui.actionCreateIndex, "MainWindow.CreateIndex");
     sm->registerAction(this, ui.actionDeleteUnusedMedia, "MainWindow.DeleteUnusedMedia");
     sm->registerAction(this, ui.actionDeleteUnusedStyles, "MainWindow.DeleteUnusedStyles");
+    sm->registerAction(this, ui.actionOptimizeImages, "MainWindow.OptimizeImages");
     // View
     sm->registerAction(this, ui.actionBookView, "MainWindow.BookView");
     sm->registerAction(this, ui.actionCodeView, "MainWindow.CodeView");
@@ -4561,6 +5022,8 @@ void MainWindow::ExtendUI()
     sm->registerAction(this, ui.actionTutorials, "MainWindow.FAQ");
     sm->registerAction(this, ui.actionDonate, "MainWindow.Donate");
     sm->registerAction(this, ui.actionSigilWebsite, "MainWindow.SigilWebsite");
+    sm->registerAction(this, ui.actionSavePerformanceTrace, "MainWindow.SavePerformanceTrace");
+    sm->registerAction(this, ui.actionMemoryDiagnostics, "MainWindow.MemoryDiagnostics");
     sm->registerAction(this, ui.actionAbout, "MainWindow.About");
     // Clips
     sm->registerAction(this, ui.actionClip1, "MainWindow.Clip1");
@@ -4866,11 +5329,14 @@ void MainWindow::LoadInitialFile(const QString &openfilepath, bool is_internal)
 
 void MainWindow::ConnectSignalsToSlots()
 {
+    // Also starts loading the dictionary, if that has not started yet
+    connect(SpellCheck::instance(), SIGNAL(dictionaryLoaded()), this, SLOT(RefreshSpellingHighlighting()));
     connect(m_PreviewWindow, SIGNAL(Shown()), this, SLOT(UpdatePreview()));
     connect(m_PreviewWindow, SIGNAL(ZoomFactorChanged(float)),     this, SLOT(UpdateZoomLabel(float)));
     connect(m_PreviewWindow, SIGNAL(ZoomFactorChanged(float)),     this, SLOT(UpdateZoomSlider(float)));
     connect(m_PreviewWindow, SIGNAL(GoToPreviewLocationRequest()), this, SLOT(GoToPreviewLocation()));
     connect(m_PreviewWindow, SIGNAL(OpenUrlRequest(const QUrl &)), this, SLOT(OpenUrl(const QUrl &)));
+    connect(m_PreviewWindow, SIGNAL(PageRendered(int, int, int, bool)), this, SLOT(PreviewRendered(int, int, int, bool)));
     connect(qApp, SIGNAL(focusChanged(QWidget *, QWidget *)), this, SLOT(ApplicationFocusChanged(QWidget *, QWidget *)));
     // Setup signal mapping for heading actions.
     connect(ui.actionHeading1, SIGNAL(triggered()), m_headingMapper, SLOT(map()));
@@ -4897,6 +5363,7 @@ void MainWindow::ConnectSignalsToSlots()
     connect(ui.actionSave,          SIGNAL(triggered()), this, SLOT(Save()));
     connect(ui.actionSaveAs,        SIGNAL(triggered()), this, SLOT(SaveAs()));
     connect(ui.actionSaveACopy,     SIGNAL(triggered()), this, SLOT(SaveACopy()));
+    connect(ui.actionSaveASample,   SIGNAL(triggered()), this, SLOT(SaveASample()));
     connect(ui.actionClose,         SIGNAL(triggered()), this, SLOT(close()));
     connect(ui.actionExit,          SIGNAL(triggered()), this, SLOT(Exit()));
     // Edit
@@ -4924,6 +5391,10 @@ void MainWindow::ConnectSignalsToSlots()
     connect(ui.actionUserGuide,     SIGNAL(triggered()), this, SLOT(UserGuide()));
     connect(ui.actionDonate,        SIGNAL(triggered()), this, SLOT(Donate()));
     connect(ui.actionSigilWebsite,  SIGNAL(triggered()), this, SLOT(SigilWebsite()));
+    connect(ui.actionSavePerformanceTrace, SIGNAL(triggered()), this, SLOT(SavePerformanceTrace()));
+    connect(ui.actionMemoryDiagnostics, SIGNAL(triggered()), this, SLOT(MemoryDiagnosticsDialog()));
+    // Nothing is recorded in builds without tracing
+    ui.actionSavePerformanceTrace->setVisible(Trace::IsEnabled());
     connect(ui.actionAbout,         SIGNAL(triggered()), this, SLOT(AboutDialog()));
     // Tools
     connect(ui.actionAddCover,      SIGNAL(triggered()), this, SLOT(AddCover()));
@@ -4949,6 +5420,8 @@ void MainWindow::ConnectSignalsToSlots()
     connect(ui.actionCreateIndex,   SIGNAL(triggered()), this, SLOT(CreateIndex()));
     connect(ui.actionDeleteUnusedMedia,    SIGNAL(triggered()), this, SLOT(DeleteUnusedMedia()));
     connect(ui.actionDeleteUnusedStyles,    SIGNAL(triggered()), this, SLOT(DeleteUnusedStyles()));
+    connect(ui.actionRestoreCheckpoint,    SIGNAL(triggered()), this, SLOT(RestoreCheckpoint()));
+    connect(ui.actionOptimizeImages,    SIGNAL(triggered()), this, SLOT(OptimizeImages()));
     // Change case
     connect(ui.actionCasingLowercase,  SIGNAL(triggered()), m_casingChangeMapper, SLOT(map()));
     connect(ui.actionCasingUppercase,  SIGNAL(triggered()), m_casingChangeMapper, SLOT(map()));
@@ -5076,7 +5549,7 @@ void MainWindow::ConnectSignalsToSlots()
             this,            SLOT(ShowMessageOnStatusBar(const QString &)));
     connect(m_SpellcheckEditor,   SIGNAL(SpellingHighlightRefreshRequest()), this,  SLOT(RefreshSpellingHighlighting()));
     connect(m_SpellcheckEditor,   SIGNAL(FindWordRequest(QString)), this,  SLOT(FindWord(QString)));
-    connect(m_SpellcheckEditor,   SIGNAL(UpdateWordRequest(QString, QString)), this,  SLOT(UpdateWord(QString, QString)));
+    connect(m_SpellcheckEditor,   SIGNAL(UpdateWordsRequest(const QHash<QString, QString> &)), this,  SLOT(UpdateWords(const QHash<QString, QString> &)));
     connect(m_SpellcheckEditor,   SIGNAL(ShowStatusMessageRequest(const QString &)),
             this,  SLOT(ShowMessageOnStatusBar(const QString &)));
     connect(m_Reports,       SIGNAL(Refresh()), this, SLOT(ReportsDialog()));
@@ -5191,6 +5664,7 @@ void MainWindow::MakeTabConnections(ContentTab *tab)
         connect(ui.actionPrint,                    SIGNAL(triggered()),  tab,   SLOT(Print()));
         connect(tab,   SIGNAL(ContentChanged()),             m_Book.data(), SLOT(SetModified()));
         connect(tab,   SIGNAL(UpdateCursorPosition(int, int)), this,          SLOT(UpdateCursorPositionLabel(int, int)));
+        connect(tab,   SIGNAL(UpdateUndoMemory(qint64)),    this,          SLOT(UpdateUndoMemoryLabel(qint64)));
         connect(tab,   SIGNAL(ZoomFactorChanged(float)),   this,          SLOT(UpdateZoomLabel(float)));
         connect(tab,   SIGNAL(ZoomFactorChanged(float)),   this,          SLOT(UpdateZoomSlider(float)));
         connect(tab,   SIGNAL(ShowStatusMessageRequest(const QString &)), this, SLOT(ShowMessageOnStatusBar(const QString &)));
@@ -26,6 +26,7 @@
 #ifndef SIGIL_H
 #define SIGIL_H
 
+#include <QtCore/QHash>
 #include <QtCore/QSharedPointer>
 #include <QtWidgets/QMainWindow>
 
@@ -68,6 +69,7 @@ class ClipsWindow;
 class SelectCharacter;
 class ViewImage;
 class FlowTab;
+class SaveJournal;
 
 
 /**
@@ -180,6 +182,14 @@ public:
 
     void SaveTabData();
 
+    /**
+     * Keeps the state of the whole book before a book-wide change,
+     * so that RestoreCheckpoint() can bring it back.
+     *
+     * @param description The change about to be made.
+     */
+    void CreateCheckpoint(const QString &description);
+
     SearchEditorModel *GetSearchEditorModel();
 
     /**
@@ -245,6 +255,12 @@ public slots:
 
     void ResourcesAddedOrDeleted();
 
+    /**
+     * Offers to recover the changes of the books that were open, and
+     * modified, when an earlier session of Sigil ended without closing them.
+     */
+    void RecoverUnsavedChanges();
+
 
 signals:
     void SettingsChanged();
@@ -300,6 +316,12 @@ private slots:
      */
     bool SaveACopy();
 
+    /**
+     * Saves a copy of the first files in reading order, with all
+     * the files that are not HTML.
+     */
+    bool SaveASample();
+
     void Exit();
 
     void ShowMessageOnStatusBar(const QString &message = "", int millisecond_duration = STATUSBAR_MSG_DISPLAY_TIME);
@@ -336,11 +358,16 @@ private slots:
 
     void ReportsDialog();
 
-    bool DeleteCSSStyles(const QString &filename, QList<CSSInfo::CSSSelector *> css_selectors);
-
     void DeleteUnusedMedia();
     void DeleteUnusedStyles();
 
+    /**
+     * Asks which checkpoint to go back to and restores the book to it.
+     */
+    void RestoreCheckpoint();
+
+    void OptimizeImages();
+
     void InsertFileDialog();
 
     void InsertSpecialCharacter();
@@ -430,6 +457,16 @@ private slots:
      */
     void SigilWebsite();
 
+    /**
+     * Writes the trace of the last minutes for a report of slowness.
+     */
+    void SavePerformanceTrace();
+
+    /**
+     * Shows what the memory of the session is used for.
+     */
+    void MemoryDiagnosticsDialog();
+
     /**
      * Implements About action functionality.
      */
@@ -515,6 +552,12 @@ private slots:
     void UpdatePreviewRequest();
     void UpdatePreviewCSSRequest();
     void UpdatePreview();
+
+    /**
+     * Records and shows how long Preview took on a page, and starts
+     * the update asked for while it was busy.
+     */
+    void PreviewRendered(int prepare_ms, int load_ms, int layout_ms, bool patched);
     void ScrollPreview();
     void InspectHTML();
 
@@ -529,6 +572,13 @@ private slots:
      */
     void UpdateCursorPositionLabel(int line, int column);
 
+    /**
+     * Shows the estimated memory of the current tab's undo history.
+     *
+     * @param bytes A negative value hides the label.
+     */
+    void UpdateUndoMemoryLabel(qint64 bytes);
+
     /**
      * Zooms the current view with the new zoom slider value.
      *
@@ -599,7 +649,11 @@ private slots:
 
     void ResourceUpdatedFromDisk(Resource *resource);
 
-    void UpdateWord(QString old_word, QString new_word);
+    /**
+     * Changes every word in substitutions, keyed by the old word,
+     * in one pass over the HTML files.
+     */
+    void UpdateWords(const QHash<QString, QString> &substitutions);
     void FindWord(QString word);
 
     /**
@@ -711,6 +765,19 @@ private:
      */
     bool SaveFile(const QString &fullfilepath, bool update_current_filename = true);
 
+    /**
+     * Writes a copy of the book, or of the resources in subset, to
+     * fullfilepath. Unlike SaveFile, the book is left as it is.
+     */
+    bool SaveCopy(const QString &fullfilepath, const QList<Resource *> &subset = QList<Resource *>());
+
+    /**
+     * Asks where to save a copy of the book.
+     *
+     * @return The path chosen, empty if the dialog was cancelled.
+     */
+    QString GetCopyFilename(const QString &title);
+
     /**
      * Performs zoom operations in the views using the default
      * zoom step. Setting zoom_in to \c true zooms the views *in*,
@@ -763,6 +830,12 @@ private:
      */
     void UpdateUiWithCurrentFile(const QString &fullfilepath);
 
+    /**
+     * Loads the EPUB the journal was started over and applies the
+     * changes in the journal to it.
+     */
+    void RecoverFromJournal(const QString &journal_path, const QString &epub_path);
+
     /**
      * Selects the appropriate entry in the heading combo box
      * based on the provided name of the element.
@@ -841,6 +914,18 @@ private:
 
     void SetupPreviewTimer();
 
+    /**
+     * @return How long to wait after an edit before updating Preview,
+     *         sized from recent render times and the page's length.
+     */
+    int PreviewDelay() const;
+
+    /**
+     * Has Preview load the files around the one it shows, in reading
+     * order, in the background when that is turned on.
+     */
+    void PreRenderPreviewNeighbours();
+
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
     ///////////////////////////////
@@ -932,6 +1017,16 @@ private:
      */
     QLabel *m_lbCursorPosition;
 
+    /**
+     * The label that displays the undo memory of the current tab.
+     */
+    QLabel *m_lbUndoMemory;
+
+    /**
+     * The label that displays how long Preview took on the last page.
+     */
+    QLabel *m_lbPreviewTime;
+
     /**
      * The slider which the user can use to zoom.
      */
@@ -1012,6 +1107,22 @@ private:
     QString m_PreviousHTMLText;
     QList<ViewEditor::ElementIndex> m_PreviousHTMLLocation;
 
+    /**
+     * A running average of what rendering a page in Preview takes,
+     * in milliseconds; negative until the first page is rendered.
+     */
+    double m_PreviewRenderCost;
+
+    /**
+     * The length of the text last sent to Preview.
+     */
+    int m_PreviewTextLength;
+
+    /**
+     * An update was asked for while Preview was still rendering.
+     */
+    bool m_PreviewUpdateQueued;
+
     /**
      * dynamically updated plugin menus and actions
      */
@@ -1025,6 +1136,11 @@ private:
     QStringList m_pluginList;
     bool m_SaveCSS;
 
+    /**
+     * The changes made to the book since it was last saved.
+     */
+    SaveJournal *m_SaveJournal;
+
     /**
      * Holds all the widgets Qt Designer created for us.
      */
@@ -21,11 +21,13 @@
 
 #include <limits>
 
+#include <QtCore/QSet>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QFileIconProvider>
 #include <QMessageBox>
 
 #include "BookManipulation/Book.h"
+#include "BookManipulation/BookIndex.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "MainUI/OPFModel.h"
 #include "MainUI/OPFModelItem.h"
@@ -93,9 +95,11 @@ void OPFModel::SetBook(QSharedPointer<Book> book)
 void OPFModel::Refresh()
 {
     m_RefreshInProgress = true;
-    InitializeModel();
-    SortFilesByFilenames();
-    SortHTMLFilesByReadingOrder();
+    if (!UpdateModel()) {
+        InitializeModel();
+        SortFilesByFilenames();
+        SortHTMLFilesByReadingOrder();
+    }
     m_RefreshInProgress = false;
 }
 
@@ -299,6 +303,12 @@ void OPFModel::RowsRemovedHandler(const QModelIndex &parent, int start, int end)
 void OPFModel::ItemChangedHandler(QStandardItem *item)
 {
     Q_ASSERT(item);
+
+    // Only the user renaming an item is of interest
+    if (m_RefreshInProgress) {
+        return;
+    }
+
     const QString &identifier = item->data().toString();
 
     if (!identifier.isEmpty()) {
@@ -332,8 +342,10 @@ bool OPFModel:: RenameResourceList(QList<Resource *> resources, QList<QString> n
     QApplication::setOverrideCursor(Qt::WaitCursor);
     QStringList not_renamed;
     QHash<QString, QString> update;
+    // Every new name is settled before any file is renamed
+    QList<std::pair<Resource *, QString>> renames;
+    QSet<QString> new_names;
     foreach(Resource * resource, resources) {
-        const QString &old_bookrelpath = resource->GetRelativePathToRoot();
         QString old_filename = resource->Filename();
         QString extension = old_filename.right(old_filename.length() - old_filename.lastIndexOf('.'));
 
@@ -354,18 +366,57 @@ bool OPFModel:: RenameResourceList(QList<Resource *> resources, QList<QString> n
             continue;
         }
 
-        bool rename_success = resource->RenameTo(new_filename_with_extension);
-
-        if (!rename_success) {
+        // Two files of the batch may not be given the same name
+        if (new_names.contains(new_filename_with_extension.toLower())) {
+            Utility::DisplayStdErrorDialog(
+                tr("The filename \"%1\" is already in use.\n")
+                .arg(new_filename_with_extension)
+            );
             not_renamed.append(resource->Filename());
             continue;
         }
 
-        update[ old_bookrelpath ] = "../" + resource->GetRelativePathToOEBPS();
+        new_names.insert(new_filename_with_extension.toLower());
+        renames.append(std::make_pair(resource, new_filename_with_extension));
+    }
+
+    {
+        // The manifest changes of all the renames go into one OPF update
+        OPFResource::Transaction opf_transaction(m_Book->GetOPF());
+        for (int i = 0; i < renames.count(); ++i) {
+            Resource *resource = renames.at(i).first;
+            const QString &old_bookrelpath = resource->GetRelativePathToRoot();
+            bool rename_success = resource->RenameTo(renames.at(i).second);
+
+            if (!rename_success) {
+                not_renamed.append(resource->Filename());
+                continue;
+            }
+
+            update[ old_bookrelpath ] = "../" + resource->GetRelativePathToOEBPS();
+        }
+        opf_transaction.Commit();
     }
 
     if (update.count() > 0) {
-        UniversalUpdates::PerformUniversalUpdates(true, m_Book->GetFolderKeeper()->GetResourceList(), update);
+        // Only the HTML files that reference a renamed path need to be
+        // rewritten; the rest of the resources are cheap to check as they are.
+        QList<Resource *> to_update;
+        foreach(HTMLResource * html_resource, m_Book->GetIndex()->GetFilesReferencing(update.keys().toSet())) {
+            to_update.append(html_resource);
+        }
+        foreach(Resource * resource, m_Book->GetFolderKeeper()->GetResourceList()) {
+            if (resource->Type() != Resource::HTMLResourceType) {
+                to_update.append(resource);
+            }
+        }
+        QStringList update_errors = UniversalUpdates::PerformUniversalUpdates(true, to_update, update);
+        if (!update_errors.isEmpty()) {
+            QApplication::restoreOverrideCursor();
+            Utility::DisplayStdWarningDialog(tr("The files were renamed but the links to them could not be updated."),
+                                             update_errors.join("\n"));
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+        }
         emit BookContentModified();
     }
 
@@ -384,71 +435,173 @@ void OPFModel::InitializeModel()
     Q_ASSERT(m_Book);
     ClearModel();
     QList<Resource *> resources = m_Book->GetFolderKeeper()->GetResourceList();
-    QHash <Resource *, int> reading_order_all = m_Book->GetOPF()->GetReadingOrderAll(resources);
+    BookState state = GetBookState(resources);
+
+    foreach(Resource * resource, resources) {
+        AlphanumericItem *item = new AlphanumericItem(resource->Icon(), resource->Filename());
+        SetItemData(item, resource, state);
+        GetFolderItem(resource)->appendRow(item);
+    }
+}
+
+
+bool OPFModel::UpdateModel()
+{
+    Q_ASSERT(m_Book);
+    QList<Resource *> resources = m_Book->GetFolderKeeper()->GetResourceList();
+
+    QHash<QString, QStandardItem *> items;
+    for (int i = 0; i < invisibleRootItem()->rowCount(); ++i) {
+        QStandardItem *child = invisibleRootItem()->child(i);
+        if (!child->data().toString().isEmpty()) {
+            items.insert(child->data().toString(), child);
+            continue;
+        }
+        for (int j = 0; j < child->rowCount(); ++j) {
+            items.insert(child->child(j)->data().toString(), child->child(j));
+        }
+    }
+
+    QSet<QString> identifiers;
+    int added = 0;
+    foreach(Resource *resource, resources) {
+        identifiers.insert(resource->GetIdentifier());
+        if (!items.contains(resource->GetIdentifier())) {
+            added++;
+        }
+    }
+    int removed = items.count() - (resources.count() - added);
+
+    // Past this, clearing and refilling the model is as quick
+    if (added + removed > resources.count() / 2) {
+        return false;
+    }
+
+    BookState state = GetBookState(resources);
+    QSet<QStandardItem *> changed_folders;
+
+    foreach(QString identifier, items.keys()) {
+        if (!identifiers.contains(identifier)) {
+            QStandardItem *item = items.take(identifier);
+            QStandardItem *parent = item->parent() ? item->parent() : invisibleRootItem();
+            parent->removeRow(item->row());
+            changed_folders.insert(parent);
+        }
+    }
+
+    foreach(Resource *resource, resources) {
+        QStandardItem *item = items.value(resource->GetIdentifier());
+        QStandardItem *folder = GetFolderItem(resource);
+
+        if (!item) {
+            item = new AlphanumericItem(resource->Icon(), resource->Filename());
+            SetItemData(item, resource, state);
+            folder->appendRow(item);
+            changed_folders.insert(folder);
+            continue;
+        }
+
+        QString old_text = item->text();
+        QVariant old_reading_order = item->data(READING_ORDER_ROLE);
+        SetItemData(item, resource, state);
+        if (item->text() != old_text || item->data(READING_ORDER_ROLE) != old_reading_order) {
+            changed_folders.insert(folder);
+        }
+    }
+
+    // Only the folders that changed are sorted again
+    changed_folders.remove(invisibleRootItem());
+    foreach(QStandardItem *folder, changed_folders) {
+        folder->sortChildren(0);
+    }
+    if (changed_folders.contains(m_TextFolderItem)) {
+        SortHTMLFilesByReadingOrder();
+    }
+
+    return true;
+}
+
+
+OPFModel::BookState OPFModel::GetBookState(const QList<Resource *> &resources)
+{
+    BookState state;
+    state.reading_order_all = m_Book->GetOPF()->GetReadingOrderAll(resources);
     QString version = m_Book->GetConstOPF()->GetEpubVersion();
-    QHash <QString, QString> semantic_type_all;
-    QHash <QString, QString> manifest_properties_all;
     if (version.startsWith('3')) {
         NavProcessor navproc(m_Book->GetConstOPF()->GetNavResource());
-        semantic_type_all = navproc.GetLandmarkNameForPaths();
-        manifest_properties_all = m_Book->GetOPF()->GetManifestPropertiesForPaths();
+        state.semantic_type_all = navproc.GetLandmarkNameForPaths();
+        state.manifest_properties_all = m_Book->GetOPF()->GetManifestPropertiesForPaths();
     } else { 
-        semantic_type_all = m_Book->GetOPF()->GetGuideSemanticNameForPaths();
+        state.semantic_type_all = m_Book->GetOPF()->GetGuideSemanticNameForPaths();
     }
+    return state;
+}
 
-    foreach(Resource * resource, resources) {
-        AlphanumericItem *item = new AlphanumericItem(resource->Icon(), resource->Filename());
-        item->setDropEnabled(false);
-        item->setData(resource->GetIdentifier());
-        QString tooltip = resource->Filename();
-        QString path = resource->GetRelativePathToOEBPS();
 
-        if (semantic_type_all.contains(path)) {
-            tooltip += " (" + semantic_type_all[path] + ")";
-        }
-        if (manifest_properties_all.contains(path)) {
-            tooltip += " [" + manifest_properties_all[path] + "]";
+QStandardItem *OPFModel::GetFolderItem(const Resource *resource)
+{
+    switch (resource->Type()) {
+        case Resource::HTMLResourceType:
+            return m_TextFolderItem;
+        case Resource::CSSResourceType:
+            return m_StylesFolderItem;
+        case Resource::ImageResourceType:
+        case Resource::SVGResourceType:
+            return m_ImagesFolderItem;
+        case Resource::FontResourceType:
+            return m_FontsFolderItem;
+        case Resource::AudioResourceType:
+            return m_AudioFolderItem;
+        case Resource::VideoResourceType:
+            return m_VideoFolderItem;
+        case Resource::OPFResourceType:
+        case Resource::NCXResourceType:
+            return invisibleRootItem();
+        default:
+            return m_MiscFolderItem;
+    }
+}
+
+
+void OPFModel::SetItemData(QStandardItem *item, Resource *resource, const BookState &state)
+{
+    // QStandardItem ignores values that do not change, so setting
+    // everything again on an existing item costs no signals
+    item->setText(resource->Filename());
+    item->setDropEnabled(false);
+    item->setData(resource->GetIdentifier());
+    QString tooltip = resource->Filename();
+    QString path = resource->GetRelativePathToOEBPS();
+
+    if (state.semantic_type_all.contains(path)) {
+        tooltip += " (" + state.semantic_type_all[path] + ")";
+    }
+    if (state.manifest_properties_all.contains(path)) {
+        tooltip += " [" + state.manifest_properties_all[path] + "]";
+    }
+    item->setToolTip(tooltip);
+
+    if (resource->Type() == Resource::HTMLResourceType) {
+        int reading_order = -1;
+        if (state.reading_order_all.contains(resource)) {
+            reading_order = state.reading_order_all[resource];
+        } else {
+            reading_order = NO_READING_ORDER;
         }
-        item->setToolTip(tooltip);
-
-        if (resource->Type() == Resource::HTMLResourceType) {
-            int reading_order = -1;
-            if (reading_order_all.contains(resource)) {
-                reading_order = reading_order_all[resource];
-            } else {
-                reading_order = NO_READING_ORDER;
-            }
 
-            item->setData(reading_order, READING_ORDER_ROLE);
-            // Remove the extension for alphanumeric sorting
-            QString name = resource->Filename().left(resource->Filename().lastIndexOf('.'));
-            item->setData(name, ALPHANUMERIC_ORDER_ROLE);
-            m_TextFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::CSSResourceType) {
-            item->setDragEnabled(false);
-            m_StylesFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::ImageResourceType ||
-                   resource->Type() == Resource::SVGResourceType
-                  ) {
-            item->setDragEnabled(false);
-            m_ImagesFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::FontResourceType) {
-            item->setDragEnabled(false);
-            m_FontsFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::AudioResourceType) {
-            item->setDragEnabled(false);
-            m_AudioFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::VideoResourceType) {
-            item->setDragEnabled(false);
-            m_VideoFolderItem->appendRow(item);
-        } else if (resource->Type() == Resource::OPFResourceType ||
-                   resource->Type() == Resource::NCXResourceType) {
+        item->setData(reading_order, READING_ORDER_ROLE);
+        // Remove the extension for alphanumeric sorting; the key is
+        // only made again when the name changes
+        QString name = resource->Filename().left(resource->Filename().lastIndexOf('.'));
+        if (item->data(ALPHANUMERIC_NAME_ROLE).toString() != name) {
+            item->setData(name, ALPHANUMERIC_NAME_ROLE);
+            item->setData(AlphanumericItem::SortKey(name), ALPHANUMERIC_ORDER_ROLE);
+        }
+    } else {
+        item->setDragEnabled(false);
+        if (resource->Type() == Resource::OPFResourceType ||
+            resource->Type() == Resource::NCXResourceType) {
             item->setEditable(false);
-            item->setDragEnabled(false);
-            appendRow(item);
-        } else {
-            item->setDragEnabled(false);
-            m_MiscFolderItem->appendRow(item);
         }
     }
 }
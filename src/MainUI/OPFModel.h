@@ -193,12 +193,41 @@ private slots:
 
 private:
 
+    /**
+     * What the items show of the book besides the resources themselves.
+     */
+    struct BookState {
+        QHash<Resource *, int> reading_order_all;
+        QHash<QString, QString> semantic_type_all;
+        QHash<QString, QString> manifest_properties_all;
+    };
+
     /**
      * Initializes an empty model with data. It is filled
      * using information from the stored book.
      */
     void InitializeModel();
 
+    /**
+     * Brings the existing items in line with the stored book: rows are
+     * removed, added, renamed and re-sorted only where something changed,
+     * so views keep their selection and scroll position.
+     *
+     * @return \c false if so much changed that the model should be
+     *         initialized again instead. Nothing is changed then.
+     */
+    bool UpdateModel();
+
+    BookState GetBookState(const QList<Resource *> &resources);
+
+    /**
+     * @return The folder item a resource is listed in; the root item
+     *         for the OPF and NCX.
+     */
+    QStandardItem *GetFolderItem(const Resource *resource);
+
+    void SetItemData(QStandardItem *item, Resource *resource, const BookState &state);
+
     /**
      * Updates the reading orders of the HTMLResources
      * with their order in the model.
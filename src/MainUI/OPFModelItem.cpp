@@ -30,6 +30,37 @@ AlphanumericItem::AlphanumericItem(const QIcon icon, const QString text) : QStan
 {
 }
 
+// Digit runs become their length and then their digits, without leading
+// zeros, so plain string comparison orders them by value
+QString AlphanumericItem::SortKey(const QString &name)
+{
+    QString key;
+    key.reserve(name.length() + 8);
+    int i = 0;
+
+    while (i < name.length()) {
+        if (!name.at(i).isDigit()) {
+            key.append(name.at(i++));
+            continue;
+        }
+
+        int start = i;
+
+        while (i < name.length() && name.at(i).isDigit()) {
+            i++;
+        }
+
+        while (start < i - 1 && name.at(start) == QChar('0')) {
+            start++;
+        }
+
+        key.append(QChar('0' + (i - start)));
+        key.append(name.midRef(start, i - start));
+    }
+
+    return key;
+}
+
 // Override standard sort operator to allow sorting alphanumerically case-sensitive
 bool AlphanumericItem::operator<(const QStandardItem &item) const
 {
@@ -39,68 +70,18 @@ bool AlphanumericItem::operator<(const QStandardItem &item) const
         return text().compare(item.text()) < 0;
     }
 
-    QString s1 = data(ALPHANUMERIC_ORDER_ROLE).toString();
-    QString s2 = item.data(ALPHANUMERIC_ORDER_ROLE).toString();
+    // The keys are made once per name, by SortKey
+    const QString key1 = data(ALPHANUMERIC_ORDER_ROLE).toString();
+    const QString key2 = item.data(ALPHANUMERIC_ORDER_ROLE).toString();
 
-    if (s1 == NULL || s2 == NULL) {
+    if (key1.isEmpty() || key2.isEmpty()) {
         return false;
     }
 
-    int len1 = s1.length();
-    int len2 = s2.length();
-    int marker1 = 0;
-    int marker2 = 0;
-    int result  = 0;
-
-    // Loop through both strings with separate markers
-    while (marker1 < len1 && marker2 < len2) {
-        QChar ch1 = s1[marker1];
-        QChar ch2 = s2[marker2];
-        QString space1(s1);
-        QString space2(s2);
-        int loc1 = 0;
-        int loc2 = 0;
-
-        // Loop over first string at marker collecting consecutive digits (or non-digits)
-        do {
-            space1[loc1++] = ch1;
-            marker1++;
-
-            if (marker1 < len1) {
-                ch1 = s1[marker1];
-            } else {
-                break;
-            }
-        } while (ch1.isDigit() == space1[0].isDigit());
-
-        // Loop over second string at marker collecting consecutive digits (or non-digits)
-        do {
-            space2[loc2++] = ch2;
-            marker2++;
-
-            if (marker2 < len2) {
-                ch2 = s2[marker2];
-            } else {
-                break;
-            }
-        } while (ch2.isDigit() == space2[0].isDigit());
-
-        QString str1 = space1.left(loc1);
-        QString str2 = space2.left(loc2);
-
-        // If we collected numbers, compare them numerically
-        if (space1[0].isDigit() && space2[0].isDigit()) {
-            int n1 = str1.toInt();
-            int n2 = str2.toInt();
-            result = n1 - n2;
-        } else {
-            result = str1.compare(str2);
-        }
-
-        if (result != 0) {
-            return result < 0;
-        }
+    if (key1 != key2) {
+        return key1 < key2;
     }
 
-    return len1 < len2;
+    // The same but for leading zeros
+    return data(ALPHANUMERIC_NAME_ROLE).toString().length() < item.data(ALPHANUMERIC_NAME_ROLE).toString().length();
 }
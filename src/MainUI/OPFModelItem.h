@@ -32,6 +32,8 @@
 static const int NO_READING_ORDER        = std::numeric_limits<int>::max();
 static const int READING_ORDER_ROLE      = Qt::UserRole + 2;
 static const int ALPHANUMERIC_ORDER_ROLE = Qt::UserRole + 3;
+// The name the ALPHANUMERIC_ORDER_ROLE key was made from
+static const int ALPHANUMERIC_NAME_ROLE  = Qt::UserRole + 4;
 
 /**
  * A re-implementation of QStandardItem to
@@ -44,6 +46,12 @@ public:
     AlphanumericItem();
     AlphanumericItem(QIcon, QString);
 
+    /**
+     * @return A key for name that sorts alphanumerically, numbers by
+     *         their value, when compared as a plain string.
+     */
+    static QString SortKey(const QString &name);
+
 private:
     virtual bool operator<(const QStandardItem &item) const;
 };
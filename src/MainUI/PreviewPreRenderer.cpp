@@ -0,0 +1,147 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtWebKitWidgets/QWebFrame>
+
+#include "MainUI/PreviewPreRenderer.h"
+#include "Misc/SettingsStore.h"
+#include "Misc/Utility.h"
+#include "ViewEditors/BookViewPreview.h"
+#include "ViewEditors/ViewWebPage.h"
+
+PreviewPreRenderer::PreviewPreRenderer(QObject *parent)
+    :
+    QObject(parent)
+{
+}
+
+
+PreviewPreRenderer::~PreviewPreRenderer()
+{
+    Clear();
+}
+
+
+void PreviewPreRenderer::SetPages(const QList<QPair<QString, QString> > &pages, const QSize &viewport_size, float zoom_factor)
+{
+    SettingsStore settings;
+    int max_pages = qMax(settings.previewPreRenderPages(), 0);
+    QList<Entry> kept;
+
+    for (int i = 0; i < pages.count() && kept.count() < max_pages; ++i) {
+        bool found = false;
+
+        for (int j = 0; j < m_Entries.count(); ++j) {
+            if (m_Entries.at(j).filepath == pages.at(i).first && m_Entries.at(j).text == pages.at(i).second) {
+                kept.append(m_Entries.takeAt(j));
+                found = true;
+                break;
+            }
+        }
+
+        if (found) {
+            continue;
+        }
+
+        // Checked only before starting a page; what is loaded stays
+        if (!HasRoom()) {
+            break;
+        }
+
+        Entry entry;
+        entry.filepath = pages.at(i).first;
+        entry.text = pages.at(i).second;
+        entry.page = new ViewWebPage(this);
+        entry.ready = false;
+        BookViewPreview::ConfigurePage(entry.page);
+        entry.page->setViewportSize(viewport_size);
+        entry.page->mainFrame()->setZoomFactor(zoom_factor);
+        connect(entry.page, SIGNAL(loadFinished(bool)), this, SLOT(PageLoaded(bool)));
+        BookViewPreview::LoadIntoPage(entry.page, entry.filepath, entry.text);
+        kept.append(entry);
+    }
+
+    Clear();
+    m_Entries = kept;
+}
+
+
+ViewWebPage *PreviewPreRenderer::TakePage(const QString &filepath, const QString &text)
+{
+    for (int i = 0; i < m_Entries.count(); ++i) {
+        if (m_Entries.at(i).filepath == filepath) {
+            if (!m_Entries.at(i).ready || m_Entries.at(i).text != text) {
+                return NULL;
+            }
+
+            ViewWebPage *page = m_Entries.takeAt(i).page;
+            page->disconnect(this);
+            page->setParent(0);
+            return page;
+        }
+    }
+
+    return NULL;
+}
+
+
+void PreviewPreRenderer::Clear()
+{
+    foreach(Entry entry, m_Entries) {
+        delete entry.page;
+    }
+    m_Entries.clear();
+}
+
+
+void PreviewPreRenderer::PageLoaded(bool okay)
+{
+    ViewWebPage *page = qobject_cast<ViewWebPage *>(sender());
+
+    for (int i = 0; i < m_Entries.count(); ++i) {
+        if (m_Entries.at(i).page == page) {
+            if (okay) {
+                m_Entries[ i ].ready = true;
+            } else {
+                // Still in its own signal
+                m_Entries.takeAt(i).page->deleteLater();
+            }
+
+            return;
+        }
+    }
+}
+
+
+bool PreviewPreRenderer::HasRoom() const
+{
+    SettingsStore settings;
+    qint64 budget = qint64(settings.previewPreRenderBudget()) * 1024 * 1024;
+
+    if (budget <= 0) {
+        return true;
+    }
+
+    // Where it can not be read, nothing is pre-rendered
+    qint64 resident = Utility::ProcessResidentBytes();
+    return resident >= 0 && resident < budget;
+}
@@ -0,0 +1,93 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef PREVIEWPRERENDERER_H
+#define PREVIEWPRERENDERER_H
+
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPair>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+
+class ViewWebPage;
+
+/**
+ * Keeps the files next to the one shown in Preview loaded in pages of
+ * their own, off screen, so Preview can swap a ready page in when the
+ * user moves to one of them instead of waiting for a load.
+ *
+ * No more than the set number of pages are kept, and none are started
+ * while the process uses more memory than the set budget.
+ */
+class PreviewPreRenderer : public QObject
+{
+    Q_OBJECT
+
+public:
+    PreviewPreRenderer(QObject *parent = 0);
+    ~PreviewPreRenderer();
+
+    /**
+     * Makes the given pages the ones kept loaded, in order of
+     * preference. Pages already loaded with the same text are kept;
+     * the others are dropped.
+     *
+     * @param pages Full file paths with the text to load for them,
+     *              as Preview would load it.
+     */
+    void SetPages(const QList<QPair<QString, QString> > &pages, const QSize &viewport_size, float zoom_factor);
+
+    /**
+     * Hands over the page loaded for filepath, if it is done loading
+     * and was loaded with this text. The caller owns it from then on.
+     *
+     * @return The page, or NULL.
+     */
+    ViewWebPage *TakePage(const QString &filepath, const QString &text);
+
+    /**
+     * Drops every page, e.g. because a stylesheet they use changed.
+     */
+    void Clear();
+
+private slots:
+    void PageLoaded(bool okay);
+
+private:
+    struct Entry {
+        QString filepath;
+        QString text;
+        ViewWebPage *page;
+        bool ready;
+    };
+
+    /**
+     * @return false if the memory budget leaves no room for another page.
+     */
+    bool HasRoom() const;
+
+    QList<Entry> m_Entries;
+};
+
+#endif // PREVIEWPRERENDERER_H
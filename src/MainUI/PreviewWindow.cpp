@@ -23,18 +23,22 @@
 #include <QApplication>
 #include <QtWidgets/QSplitter>
 #include <QtWidgets/QStackedWidget>
+#include <QtWebKit/QWebSettings>
 #include <QVBoxLayout>
 #include <QtWebKitWidgets/QWebInspector>
 #include <QDir>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 
+#include "MainUI/PreviewPreRenderer.h"
 #include "MainUI/PreviewWindow.h"
-#include "Misc/SleepFunctions.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "ViewEditors/BookViewPreview.h"
+#include "ViewEditors/ViewWebPage.h"
 #include "sigil_constants.h"
+#include "sigil_exception.h"
 
 static const QString SETTINGS_GROUP = "previewwindow";
 
@@ -47,7 +51,13 @@ PreviewWindow::PreviewWindow(QWidget *parent)
     m_Inspector(new QWebInspector(this)),
     m_Splitter(new QSplitter(this)),
     m_StackedViews(new QStackedWidget(this)),
-    m_Filepath(QString())
+    m_PreRenderer(new PreviewPreRenderer(this)),
+    m_Filepath(QString()),
+    m_LoadPending(false),
+    m_ReloadRequired(false),
+    m_TraceStart(0),
+    m_PrepareTime(0),
+    m_LoadTime(0)
 {
     SetupView();
     LoadSettings();
@@ -101,6 +111,8 @@ void PreviewWindow::resizeEvent(QResizeEvent *event)
 
 void PreviewWindow::hideEvent(QHideEvent * event)
 {
+    // Nothing is shown to swap them in for
+    m_PreRenderer->Clear();
     if (m_Inspector) {
         // break the link between the inspector and the page it is inspecting
         // to prevent memory corruption from Qt modified after free issue
@@ -194,6 +206,12 @@ void PreviewWindow::ScrollTo(QList<ViewEditor::ElementIndex> location)
     if (!m_Preview->isVisible()) {
         return;
     }
+    // Applied once the page being loaded is in
+    if (m_LoadPending) {
+        m_PendingLocation = location;
+        return;
+    }
+
     m_Preview->StoreCaretLocationUpdate(location);
     m_Preview->ExecuteCaretUpdate();
 }
@@ -204,61 +222,222 @@ void PreviewWindow::UpdatePage(QString filename, QString text, QList<ViewEditor:
         return;
     }
 
-    // If this page uses the mathml, inject a polyfill
-    // MathJax.js so that the mathml appears in the Preview Window
+    m_RenderTimer.start();
+    m_TraceStart = Trace::Now();
+
+    if (UsesMath(text)) {
+        text = InjectMathJax(text);
+    }
+
+    // Another version of the page already shown only has its changed
+    // parts patched in. On a page with math that keeps MathJax loaded
+    // and set up, and only the math patched in is typeset.
+    if (!m_LoadPending && !m_ReloadRequired && filename == m_Filepath) {
+        m_PrepareTime = m_RenderTimer.elapsed();
+
+        if (m_Preview->PatchDocument(filename, text)) {
+            m_PendingLocation = location;
+            m_LoadTime = m_RenderTimer.elapsed();
+            PageReady(true);
+            return;
+        }
+    }
+
+    m_Filepath = filename;
+    m_PendingLocation = location;
+    m_PrepareTime = m_RenderTimer.elapsed();
+    // What was put into the page shown goes with it
+    m_StylesheetRules.clear();
+
+    if (m_ReloadRequired) {
+        m_ReloadRequired = false;
+        // Or WebKit serves the stylesheet as it was
+        QWebSettings::clearMemoryCaches();
+    }
+
+    // A page already loaded in the background is shown at once
+    if (!m_LoadPending) {
+        ViewWebPage *page = m_PreRenderer->TakePage(filename, text);
+
+        if (page) {
+            // The inspector must let go of the page before it is deleted
+            m_Inspector->setPage(0);
+            m_Preview->SwapInPage(page, text);
+            m_Inspector->setPage(m_Preview->page());
+            m_LoadTime = m_RenderTimer.elapsed();
+            PageReady(false);
+            return;
+        }
+    }
+
+    m_LoadPending = true;
+    // The cursor is moved once the page has loaded, in PageLoaded()
+    m_Preview->CustomSetDocument(filename, text);
+}
+
+void PreviewWindow::PreRenderPages(const QList<QPair<QString, QString> > &pages)
+{
+    if (!m_Preview->isVisible()) {
+        m_PreRenderer->Clear();
+        return;
+    }
+
+    QList<QPair<QString, QString> > prepared;
+    for (int i = 0; i < pages.count(); ++i) {
+        QString text = pages.at(i).second;
+
+        if (UsesMath(text)) {
+            text = InjectMathJax(text);
+        }
+
+        prepared.append(qMakePair(pages.at(i).first, text));
+    }
+    m_PreRenderer->SetPages(prepared, m_Preview->size(), m_Preview->GetZoomFactor());
+}
+
+void PreviewWindow::ClearPreRendered()
+{
+    m_PreRenderer->Clear();
+}
+
+bool PreviewWindow::UpdateStylesheet(const QString &css_path, const QString &css)
+{
+    if (!m_Preview->isVisible() || m_LoadPending || m_Filepath.isEmpty()) {
+        return false;
+    }
+
+    qint64 trace_start = Trace::Now();
+    QString old_rules;
+
+    if (m_StylesheetRules.contains(css_path)) {
+        old_rules = m_StylesheetRules.value(css_path);
+    } else {
+        // The page was loaded with what is still on disk
+        try {
+            old_rules = LoadTimeRules(Utility::ReadUnicodeTextFile(css_path));
+        } catch (CannotOpenFile) {
+            m_ReloadRequired = true;
+            return false;
+        }
+    }
+
+    QString new_rules = LoadTimeRules(css);
+
+    if (new_rules != old_rules || !m_Preview->ReplaceStylesheet(css_path, css)) {
+        m_ReloadRequired = true;
+        return false;
+    }
+
+    m_StylesheetRules.insert(css_path, new_rules);
+    Trace::Complete("Preview stylesheet update", trace_start);
+    return true;
+}
+
+QString PreviewWindow::LoadTimeRules(const QString &css)
+{
+    static const QRegularExpression comment("/\\*.*?\\*/", QRegularExpression::DotMatchesEverythingOption);
+    static const QRegularExpression load_time_rule("@import[^;]*;?|@font-face\\s*\\{[^}]*\\}",
+                                                   QRegularExpression::CaseInsensitiveOption);
+    QString uncommented = css;
+    uncommented.remove(comment);
+    QStringList rules;
+    QRegularExpressionMatchIterator matches = load_time_rule.globalMatch(uncommented);
+
+    while (matches.hasNext()) {
+        rules.append(matches.next().captured(0));
+    }
+
+    return rules.join("\n");
+}
+
+bool PreviewWindow::UsesMath(const QString &text)
+{
     QRegularExpression mathused("<\\s*math [^>]*>");
     QRegularExpressionMatch mo = mathused.match(text);
-    if (mo.hasMatch()) {
-        QString mathjaxurl;
+    return mo.hasMatch();
+}
+
+QString PreviewWindow::InjectMathJax(const QString &text)
+{
+    // Must run before MathJax.js, so that later versions of the page
+    // can be patched in
+    static const QString track_source = Utility::ReadUnicodeTextFile(":/javascript/track_math_source.js");
+
+    // If this page uses the mathml, inject a polyfill
+    // MathJax.js so that the mathml appears in the Preview Window
+    QString mathjaxurl;
 
-        // The path to MathJax.js is platform dependent
+    // The path to MathJax.js is platform dependent
 #ifdef Q_OS_MAC
-        // On Mac OS X QCoreApplication::applicationDirPath() points to Sigil.app/Contents/MacOS/ 
-        QDir execdir(QCoreApplication::applicationDirPath());
-        execdir.cdUp();
-        mathjaxurl = execdir.absolutePath() + "/polyfills/MJ/MathJax.js";
+    // On Mac OS X QCoreApplication::applicationDirPath() points to Sigil.app/Contents/MacOS/ 
+    QDir execdir(QCoreApplication::applicationDirPath());
+    execdir.cdUp();
+    mathjaxurl = execdir.absolutePath() + "/polyfills/MJ/MathJax.js";
 #elif defined(Q_OS_WIN32)
-        mathjaxurl = "/" + QCoreApplication::applicationDirPath() + "/polyfills/MJ/MathJax.js";
+    mathjaxurl = "/" + QCoreApplication::applicationDirPath() + "/polyfills/MJ/MathJax.js";
 #else
-        // all flavours of linux / unix
-        // First check if system MathJax was configured to be used at compile time
-        if (!mathjax_dir.isEmpty()) {
-            mathjaxurl = mathjax_dir + "/MathJax.js";
+    // all flavours of linux / unix
+    // First check if system MathJax was configured to be used at compile time
+    if (!mathjax_dir.isEmpty()) {
+        mathjaxurl = mathjax_dir + "/MathJax.js";
+    } else {
+        // otherwise user supplied environment variable to 'share/sigil'
+        // takes precedence over Sigil's usual share location.
+        if (!sigil_extra_root.isEmpty()) {
+            mathjaxurl = sigil_extra_root + "/polyfills/MJ/MathJax.js";
         } else {
-            // otherwise user supplied environment variable to 'share/sigil'
-            // takes precedence over Sigil's usual share location.
-            if (!sigil_extra_root.isEmpty()) {
-                mathjaxurl = sigil_extra_root + "/polyfills/MJ/MathJax.js";
-            } else {
-                mathjaxurl = sigil_share_root + "/polyfills/MJ/MathJax.js";
-            }
+            mathjaxurl = sigil_share_root + "/polyfills/MJ/MathJax.js";
         }
+    }
 #endif
 
-        mathjaxurl = "file://" + Utility::URLEncodePath(mathjaxurl);
-        mathjaxurl = mathjaxurl + "?config=local/SIGIL_EBOOK_MML_SVG";
-        int endheadpos = text.indexOf("</head>");
-        if (endheadpos > 1) {
-            QString inject_mathjax = 
-              "<script type=\"text/javascript\" async=\"async\" "
-              "src=\"" + mathjaxurl + "\"></script>";
-            text.insert(endheadpos, inject_mathjax);
-        }
+    mathjaxurl = "file://" + Utility::URLEncodePath(mathjaxurl);
+    mathjaxurl = mathjaxurl + "?config=local/SIGIL_EBOOK_MML_SVG";
+    QString injected = text;
+    int endheadpos = injected.indexOf("</head>");
+    if (endheadpos > 1) {
+        QString inject_mathjax = 
+          "<script type=\"text/javascript\">//<![CDATA[\n" + track_source + "//]]></script>"
+          "<script type=\"text/javascript\" async=\"async\" "
+          "src=\"" + mathjaxurl + "\"></script>";
+        injected.insert(endheadpos, inject_mathjax);
     }
+    return injected;
+}
 
-    m_Filepath = filename;
-    m_Preview->CustomSetDocument(filename, text);
+bool PreviewWindow::IsRendering() const
+{
+    return m_LoadPending;
+}
 
-    // Wait until the preview is loaded before moving cursor.
-    while (!m_Preview->IsLoadingFinished()) {
-        qApp->processEvents();
-        SleepFunctions::msleep(100);
+void PreviewWindow::PageLoaded(bool okay)
+{
+    if (!m_LoadPending) {
+        return;
     }
 
-    m_Preview->StoreCaretLocationUpdate(location);
+    m_LoadPending = false;
+    m_LoadTime = m_RenderTimer.elapsed();
+
+    if (!okay) {
+        Trace::Complete("Preview update", m_TraceStart);
+        emit PageRendered(m_PrepareTime, m_LoadTime - m_PrepareTime, 0, false);
+        return;
+    }
+
+    PageReady(false);
+}
+
+void PreviewWindow::PageReady(bool patched)
+{
+    m_Preview->StoreCaretLocationUpdate(m_PendingLocation);
     m_Preview->ExecuteCaretUpdate();
     m_Preview->InspectElement();
     UpdateWindowTitle();
+    // Scrolling to the caret is what makes WebKit lay the page out
+    int layout_time = m_RenderTimer.elapsed() - m_LoadTime;
+    Trace::Complete("Preview update", m_TraceStart);
+    emit PageRendered(m_PrepareTime, m_LoadTime - m_PrepareTime, layout_time, patched);
 }
 
 void PreviewWindow::UpdateWindowTitle()
@@ -326,5 +505,7 @@ void PreviewWindow::ConnectSignalsToSlots()
     connect(m_Preview,   SIGNAL(ZoomFactorChanged(float)), this, SIGNAL(ZoomFactorChanged(float)));
     connect(m_Preview,   SIGNAL(LinkClicked(const QUrl &)), this, SLOT(LinkClicked(const QUrl &)));
     connect(m_Preview,   SIGNAL(GoToPreviewLocationRequest()), this, SIGNAL(GoToPreviewLocationRequest()));
+    // Queued so the page's own handlers, which load jQuery, have all run
+    connect(m_Preview,   SIGNAL(loadFinished(bool)), this, SLOT(PageLoaded(bool)), Qt::QueuedConnection);
 }
 
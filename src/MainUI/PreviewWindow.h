@@ -23,10 +23,14 @@
 #ifndef PREVIEWWINDOW_H
 #define PREVIEWWINDOW_H
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
 #include <QtWidgets/QDockWidget>
 #include <ViewEditors/ViewEditor.h>
 
 class BookViewPreview;
+class PreviewPreRenderer;
 class QSplitter;
 class QStackedWidget;
 class QWebInspector;
@@ -44,6 +48,35 @@ public:
     bool HasFocus();
     float GetZoomFactor();
 
+    /**
+     * @return true while a page set by UpdatePage is still loading.
+     */
+    bool IsRendering() const;
+
+    /**
+     * Loads pages in the background, so UpdatePage can show them at
+     * once if it is asked for one of them with the same text.
+     *
+     * @param pages Full file paths with their text, in order of preference.
+     */
+    void PreRenderPages(const QList<QPair<QString, QString> > &pages);
+
+    /**
+     * Drops the pages loaded in the background.
+     */
+    void ClearPreRendered();
+
+    /**
+     * Puts a new version of the stylesheet at css_path into the page
+     * shown, in place of the one it was loaded with. Must be called
+     * before the new version is saved to disk.
+     *
+     * @return false if the page does not link to the stylesheet, or
+     *         the @import or @font-face rules of the stylesheet changed.
+     *         The next UpdatePage then loads the page in full.
+     */
+    bool UpdateStylesheet(const QString &css_path, const QString &css);
+
 public slots:
     void UpdatePage(QString filename, QString text, QList<ViewEditor::ElementIndex> location);
     void ScrollTo(QList<ViewEditor::ElementIndex> location);
@@ -51,6 +84,9 @@ public slots:
     void SplitterMoved(int pos, int index);
     void LinkClicked(const QUrl &url);
 
+private slots:
+    void PageLoaded(bool okay);
+
 signals:
     void Shown();
     void ZoomFactorChanged(float factor);
@@ -61,6 +97,13 @@ signals:
      */
     void OpenUrlRequest(const QUrl &url);
 
+    /**
+     * Emitted when a page set by UpdatePage is done, with the
+     * milliseconds spent preparing the text, loading or patching it
+     * in, and laying it out to scroll to the caret.
+     */
+    void PageRendered(int prepare_ms, int load_ms, int layout_ms, bool patched);
+
 
 protected:
     virtual void hideEvent(QHideEvent* event);
@@ -73,6 +116,24 @@ private:
     void ConnectSignalsToSlots();
     void UpdateWindowTitle();
 
+    /**
+     * Moves the caret to m_PendingLocation on a page that is ready.
+     */
+    void PageReady(bool patched);
+
+    static bool UsesMath(const QString &text);
+
+    /**
+     * @return text with the MathJax polyfill added to its head.
+     */
+    static QString InjectMathJax(const QString &text);
+
+    /**
+     * @return The @import and @font-face rules of css, which only
+     *         take effect when the page is loaded.
+     */
+    static QString LoadTimeRules(const QString &css);
+
     QWidget *m_MainWidget;
     QVBoxLayout *m_Layout;
 
@@ -80,7 +141,40 @@ private:
     QWebInspector *m_Inspector;
     QSplitter *m_Splitter;
     QStackedWidget *m_StackedViews;
+    PreviewPreRenderer *m_PreRenderer;
     QString m_Filepath;
+
+    /**
+     * True from a full load of a page until it has finished loading.
+     */
+    bool m_LoadPending;
+
+    /**
+     * Set when a stylesheet changed in a way only a load picks up.
+     */
+    bool m_ReloadRequired;
+
+    /**
+     * The LoadTimeRules of the stylesheets put into the page shown,
+     * by full path.
+     */
+    QHash<QString, QString> m_StylesheetRules;
+
+    QList<ViewEditor::ElementIndex> m_PendingLocation;
+
+    /**
+     * Times the page being rendered, from the start of UpdatePage.
+     */
+    QElapsedTimer m_RenderTimer;
+
+    /**
+     * When UpdatePage started, on the trace clock.
+     */
+    qint64 m_TraceStart;
+
+    int m_PrepareTime;
+
+    int m_LoadTime;
 };
 
 #endif // PREVIEWWINDOW_H
@@ -26,6 +26,7 @@
 #include <QtWidgets/QApplication>
 
 #include "MainUI/TOCModel.h"
+#include "Misc/TaskScheduler.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/NCXResource.h"
 #include "ResourceObjects/OPFResource.h"
@@ -37,7 +38,9 @@ TOCModel::TOCModel(QObject *parent)
     QStandardItemModel(parent),
     m_Book(NULL),
     m_RefreshInProgress(false),
-    m_TocRootWatcher(new QFutureWatcher<TOCModel::TOCEntry>(this))
+    m_RefreshQueued(false),
+    m_TocRootWatcher(new QFutureWatcher<TOCModel::TOCEntry>(this)),
+    m_CachedRevision(-1)
 {
     connect(m_TocRootWatcher, SIGNAL(finished()), this, SLOT(RefreshEnd()));
 }
@@ -51,6 +54,10 @@ void TOCModel::SetBook(QSharedPointer<Book> book)
         m_Book = book;
         m_EpubVersion = m_Book->GetConstOPF()->GetEpubVersion();
     }
+    {
+        QMutexLocker cache_lock(&m_CacheMutex);
+        m_CachedSource.clear();
+    }
     Refresh();
 }
 
@@ -75,12 +82,16 @@ void TOCModel::Refresh()
 {
     Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
 
+    // Whatever changes arrive during a refresh are picked up
+    // by a single refresh after it
     if (m_RefreshInProgress) {
+        m_RefreshQueued = true;
         return;
     }
 
     m_RefreshInProgress = true;
-    m_TocRootWatcher->setFuture(QtConcurrent::run(this, &TOCModel::GetRootTOCEntry));
+    m_TocRootWatcher->setFuture(TaskScheduler::Run(TaskScheduler::Interactive, "TOCModel::GetRootTOCEntry",
+                                std::bind(&TOCModel::GetRootTOCEntry, this)));
 }
 
 
@@ -89,16 +100,59 @@ void TOCModel::RefreshEnd()
     BuildModel(m_TocRootWatcher->result());
     m_RefreshInProgress = false;
     emit RefreshDone();
+
+    if (m_RefreshQueued) {
+        m_RefreshQueued = false;
+        Refresh();
+    }
 }
 
 
 TOCModel::TOCEntry TOCModel::GetRootTOCEntry()
 {
-    if (m_EpubVersion.startsWith('3')) {
-        NavProcessor navproc(m_Book->GetConstOPF()->GetNavResource());
-        return navproc.GetRootTOCEntry();
+    TextResource *resource = NULL;
+    HTMLResource *nav_resource = NULL;
+    bool epub3 = false;
+    {
+        QMutexLocker book_lock(&m_UsingBookMutex);
+        epub3 = m_EpubVersion.startsWith('3');
+        if (epub3) {
+            nav_resource = m_Book->GetConstOPF()->GetNavResource();
+            resource = nav_resource;
+        } else {
+            resource = m_Book->GetNCX();
+        }
+    }
+
+    // The nav's links are made relative to its own path, so a move
+    // changes the TOC just as an edit does. The revision is read
+    // before the text so a concurrent edit only makes the TOC look stale.
+    QString source;
+    int revision = -1;
+    if (resource) {
+        source = resource->GetIdentifier() + resource->GetFullPath();
+        revision = resource->GetTextRevision();
+        QMutexLocker cache_lock(&m_CacheMutex);
+        if (source == m_CachedSource && revision == m_CachedRevision) {
+            return m_CachedRoot;
+        }
+    }
+
+    TOCModel::TOCEntry root;
+    if (epub3) {
+        NavProcessor navproc(nav_resource);
+        root = navproc.GetRootTOCEntry();
+    } else {
+        root = ParseNCX(GetNCXText());
+    }
+
+    if (resource) {
+        QMutexLocker cache_lock(&m_CacheMutex);
+        m_CachedRoot = root;
+        m_CachedSource = source;
+        m_CachedRevision = revision;
     }
-    return ParseNCX(GetNCXText());
+    return root;
 }
 
 
@@ -183,10 +237,9 @@ TOCModel::TOCEntry TOCModel::ParseNavPoint(QXmlStreamReader &ncx)
 
 void TOCModel::BuildModel(const TOCModel::TOCEntry &root_entry)
 {
-    clear();
-    foreach(const TOCModel::TOCEntry & child_entry, root_entry.children) {
-        AddEntryToParentItem(child_entry, invisibleRootItem());
-    }
+    // Updating the items in place rather than clearing the model keeps
+    // the view's expanded branches and selection across an edit
+    UpdateChildItems(root_entry.children, invisibleRootItem());
 }
 
 
@@ -204,3 +257,32 @@ void TOCModel::AddEntryToParentItem(const TOCEntry &entry, QStandardItem *parent
         AddEntryToParentItem(child_entry, item);
     }
 }
+
+
+void TOCModel::UpdateChildItems(const QList<TOCEntry> &entries, QStandardItem *parent)
+{
+    Q_ASSERT(parent);
+    int count = entries.count();
+    for (int row = 0; row < count; row++) {
+        const TOCModel::TOCEntry &entry = entries.at(row);
+        QStandardItem *item = parent->child(row);
+
+        if (!item) {
+            AddEntryToParentItem(entry, parent);
+            continue;
+        }
+
+        if (item->text() != entry.text) {
+            item->setText(entry.text);
+        }
+        if (item->toolTip() != entry.target) {
+            item->setData(QUrl(entry.target));
+            item->setToolTip(entry.target);
+        }
+        UpdateChildItems(entry.children, item);
+    }
+
+    if (parent->rowCount() > count) {
+        parent->removeRows(count, parent->rowCount() - count);
+    }
+}
@@ -120,6 +120,14 @@ public:
      */
     TOCEntry GetRootTOCEntry();
 
+    /**
+     * Parses the NCX source and returns the root TOC entry.
+     *
+     * @param ncx_source The NCX source code.
+     * @return The root TOCEntry.
+     */
+    static TOCEntry ParseNCX(const QString &ncx_source);
+
 signals:
     void RefreshDone();
 
@@ -141,14 +149,6 @@ private:
      */
     QString GetNCXText();
 
-    /**
-     * Parses the NCX source and returns the root TOC entry.
-     *
-     * @param ncx_source The NCX source code.
-     * @return The root TOCEntry.
-     */
-    static TOCEntry ParseNCX(const QString &ncx_source);
-
     /**
      * Parses an NCX navPoint element. Calls itself recursively
      * if there are navPoint children.
@@ -171,6 +171,14 @@ private:
      */
     static void AddEntryToParentItem(const TOCEntry &entry, QStandardItem *parent);
 
+    /**
+     * Makes the children of parent show the entries, reusing and
+     * updating the items already there and only adding or removing
+     * items where the entries differ in number.
+     * Calls itself recursively for the children's children.
+     */
+    static void UpdateChildItems(const QList<TOCEntry> &entries, QStandardItem *parent);
+
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -186,6 +194,12 @@ private:
      */
     bool m_RefreshInProgress;
 
+    /**
+     * If \c true, then Refresh was called while a refresh was
+     * in progress, and one more refresh follows it.
+     */
+    bool m_RefreshQueued;
+
     /**
      * Guards the use of the m_Book variable.
      */
@@ -198,6 +212,20 @@ private:
     QFutureWatcher<TOCEntry> *m_TocRootWatcher;
 
     QString m_EpubVersion;
+
+    /**
+     * The last TOC read, and the NCX or nav file and text revision
+     * it was read from. It is reused while that file is unchanged.
+     */
+    TOCEntry m_CachedRoot;
+    QString m_CachedSource;
+    int m_CachedRevision;
+
+    /**
+     * Guards the cached TOC, which is read and written
+     * on the background thread.
+     */
+    QMutex m_CacheMutex;
 };
 
 
@@ -19,25 +19,23 @@
 **
 *************************************************************************/
 
-#include "Misc/EmbeddedPython.h"
-
 #include <QtCore/QFileInfo>
+#include <QtConcurrent/QtConcurrent>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QHeaderView>
 #include <QtWidgets/QTableWidget>
 #include <QRegularExpression>
-#include <QVariant>
 
 #include "BookManipulation/Book.h"
 #include "BookManipulation/FolderKeeper.h"
 #include "MainUI/ValidationResultsView.h"
-#include "Misc/Utility.h"
+#include "Misc/GumboInterface.h"
+#include "ResourceObjects/HTMLResource.h"
 #include "sigil_exception.h"
 
 static const QBrush INFO_BRUSH    = QBrush(QColor(224, 255, 255));
 static const QBrush WARNING_BRUSH = QBrush(QColor(255, 255, 230));
 static const QBrush ERROR_BRUSH   = QBrush(QColor(255, 230, 230));
-const QString ValidationResultsView::SEP = QString(QChar(31));
 
 ValidationResultsView::ValidationResultsView(QWidget *parent)
     :
@@ -49,6 +47,8 @@ ValidationResultsView::ValidationResultsView(QWidget *parent)
     SetUpTable();
     connect(m_ResultTable, SIGNAL(itemDoubleClicked(QTableWidgetItem *)),
             this,           SLOT(ResultDoubleClicked(QTableWidgetItem *)));
+    connect(&m_CheckWatcher, SIGNAL(resultReadyAt(int)), this, SLOT(CheckResultReady(int)));
+    connect(&m_CheckWatcher, SIGNAL(finished()), this, SLOT(CheckFinished()));
 }
 
 void ValidationResultsView::showEvent(QShowEvent *event)
@@ -58,76 +58,114 @@ void ValidationResultsView::showEvent(QShowEvent *event)
 }
 
 
-QStringList ValidationResultsView::ValidateFile(QString &apath)
+QList<ValidationResult> ValidationResultsView::CheckSnapshot(const FileSnapshot &snapshot)
 {
-    int rv = 0;
-    QString error_traceback;
-    QStringList results;
-
-    QList<QVariant> args;
-    args.append(QVariant(apath));
-
-    EmbeddedPython * epython  = EmbeddedPython::instance();
-
-    QVariant res = epython->runInPython( QString("sanitycheck"),
-                                         QString("perform_sanity_check"),
-                                         args,
-                                         &rv,
-                                         error_traceback);    
-    if (rv != 0) {
-        Utility::DisplayStdWarningDialog(QString("error in sanitycheck perform_sanity_check: ") + QString::number(rv), 
-                                         error_traceback);
-        // an error happened - make no changes
-        return results;
+    QList<ValidationResult> results;
+    GumboInterface gi = GumboInterface(snapshot.text, snapshot.version);
+    foreach(GumboWellFormedError error, gi.error_check()) {
+        results.append(ValidationResult(ValidationResult::ResType_Error, snapshot.filename, error.line, -1, error.message));
     }
-    return res.toStringList();
+    return results;
 }
 
 
 void ValidationResultsView::ValidateCurrentBook()
 {
+    CancelCheck();
     ClearResults();
-    QList<ValidationResult> results;
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    m_Book->SaveAllResourcesToDisk();
+    ConfigureTableForResults();
+    show();
+    raise();
 
+    // Only the text is taken on this thread, from memory; nothing is saved first
     QList<Resource *> resources = m_Book->GetFolderKeeper()->GetResourceList();
     foreach (Resource * resource, resources) {
-        if (resource->Type() == Resource::HTMLResourceType) {
-            QString apath = resource->GetFullPath();
-            QStringList reslst = ValidateFile(apath);
-            if (!reslst.isEmpty()) {
-                foreach (QString res, reslst) {
-                    QStringList details = res.split(SEP);
-                    ValidationResult::ResType vtype;
-                    QString etype = details[0];
-                    if (etype == "info") {
-                        vtype = ValidationResult::ResType_Info;
-                    } else if (etype == "warning") {
-                        vtype = ValidationResult::ResType_Warn;
-                    } else if (etype == "error") {
-                        vtype = ValidationResult::ResType_Error;
-                    } else {
-                        continue;
-                    }
-                    QString filename = details[1];
-                    int lineno = details[2].toInt();
-                    int charoffset = details[3].toInt();
-                    QString msg = details[4];
-                    results.append(ValidationResult(vtype,filename,lineno,charoffset,msg));
-                }
-            }
+        HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+        if (!html_resource) {
+            continue;
+        }
+
+        FileSnapshot snapshot;
+        snapshot.identifier = html_resource->GetIdentifier();
+        snapshot.filename = html_resource->Filename();
+        snapshot.version = html_resource->GetEpubVersion();
+        snapshot.revision = html_resource->GetTextRevision();
+
+        QHash<QString, CachedCheck>::const_iterator cached = m_CheckCache.constFind(snapshot.identifier);
+        if (cached != m_CheckCache.constEnd() &&
+            cached->revision == snapshot.revision &&
+            cached->filename == snapshot.filename &&
+            cached->version == snapshot.version) {
+            AppendResults(cached->results);
+            continue;
         }
+
+        snapshot.text = html_resource->GetText();
+        m_Snapshots.append(snapshot);
     }
-    QApplication::restoreOverrideCursor();
-    DisplayResults(results);
-    show();
-    raise();
+
+    if (m_Snapshots.isEmpty()) {
+        FinishDisplay();
+        return;
+    }
+
+    m_CheckWatcher.setFuture(QtConcurrent::mapped(m_Snapshots, CheckSnapshot));
+}
+
+
+void ValidationResultsView::CheckResultReady(int index)
+{
+    const FileSnapshot &snapshot = m_Snapshots.at(index);
+    CachedCheck check;
+    check.filename = snapshot.filename;
+    check.version = snapshot.version;
+    check.revision = snapshot.revision;
+    check.results = m_CheckWatcher.resultAt(index);
+    m_CheckCache.insert(snapshot.identifier, check);
+    AppendResults(check.results);
+}
+
+
+void ValidationResultsView::CheckFinished()
+{
+    if (m_CheckWatcher.isCanceled()) {
+        return;
+    }
+
+    FinishDisplay();
+}
+
+
+void ValidationResultsView::CancelCheck()
+{
+    if (m_CheckWatcher.isRunning()) {
+        m_CheckWatcher.cancel();
+        m_CheckWatcher.waitForFinished();
+    }
+    m_Snapshots.clear();
+}
+
+
+void ValidationResultsView::FinishDisplay()
+{
+    m_Snapshots.clear();
+
+    if (m_ResultTable->rowCount() == 0) {
+        DisplayNoProblemsMessage();
+        return;
+    }
+
+    // Make Line and Offset columns as small as possible
+    // Ditto for Filename
+    m_ResultTable->resizeColumnToContents(0);
+    m_ResultTable->resizeColumnToContents(1);
+    m_ResultTable->resizeColumnToContents(2);
 }
 
 
 void ValidationResultsView::LoadResults(const QList<ValidationResult> &results)
 {
+    CancelCheck();
     ClearResults();
     DisplayResults(results);
     show();
@@ -144,6 +182,8 @@ void ValidationResultsView::ClearResults()
 
 void ValidationResultsView::SetBook(QSharedPointer<Book> book)
 {
+    CancelCheck();
+    m_CheckCache.clear();
     m_Book = book;
     ClearResults();
 }
@@ -205,7 +245,19 @@ void ValidationResultsView::DisplayResults(const QList<ValidationResult> &result
     }
 
     ConfigureTableForResults();
+    AppendResults(results);
 
+    // Make Line and Offset columns as small as possible
+    // Ditto for Filename
+    m_ResultTable->resizeColumnToContents(0);
+    m_ResultTable->resizeColumnToContents(1);
+    m_ResultTable->resizeColumnToContents(2);
+    //m_ResultTable->resizeColumnsToContents();
+}
+
+
+void ValidationResultsView::AppendResults(const QList<ValidationResult> &results)
+{
     Q_FOREACH(ValidationResult result, results) {
         int rownum = m_ResultTable->rowCount();
         QTableWidgetItem *item = NULL;
@@ -236,13 +288,6 @@ void ValidationResultsView::DisplayResults(const QList<ValidationResult> &result
         item->setBackground(row_brush);
         m_ResultTable->setItem(rownum, 3, item);
     }
-
-    // Make Line and Offset columns as small as possible
-    // Ditto for Filename
-    m_ResultTable->resizeColumnToContents(0);
-    m_ResultTable->resizeColumnToContents(1);
-    m_ResultTable->resizeColumnToContents(2);
-    //m_ResultTable->resizeColumnsToContents();
 }
 
 
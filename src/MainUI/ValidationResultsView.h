@@ -25,6 +25,8 @@
 
 #include <vector>
 
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
 #include <QtCore/QSharedPointer>
 #include <QtWidgets/QDockWidget>
 
@@ -53,12 +55,14 @@ public:
     ValidationResultsView(QWidget *parent = 0);
 
     /**
-     * Validates the epub file given and displays the results.
+     * Checks that the HTML files of the book are well formed.
+     *
+     * The files are checked in parallel from their text in memory and
+     * the results are added to the table as each file is done. Files
+     * not changed since the last check reuse its results.
      */
     void ValidateCurrentBook();
 
-    QStringList ValidateFile(QString &apath);
-
     void LoadResults(const QList<ValidationResult> &results);
 
     /**
@@ -100,11 +104,56 @@ private slots:
      */
     void ResultDoubleClicked(QTableWidgetItem *item);
 
+    void CheckResultReady(int index);
+    void CheckFinished();
+
 protected:
     virtual void showEvent(QShowEvent *event);
 
 private:
 
+    /**
+     * The text of one HTML file as it was when the check started.
+     */
+    struct FileSnapshot {
+        QString identifier;
+        QString filename;
+        QString version;
+        int revision;
+        QString text;
+    };
+
+    /**
+     * The results of checking one HTML file at a text revision.
+     */
+    struct CachedCheck {
+        QString filename;
+        QString version;
+        int revision;
+        QList<ValidationResult> results;
+    };
+
+    /**
+     * Runs on a worker thread.
+     */
+    static QList<ValidationResult> CheckSnapshot(const FileSnapshot &snapshot);
+
+    /**
+     * Stops a check still running; its results are dropped.
+     */
+    void CancelCheck();
+
+    /**
+     * Shows the no problems message or sizes the columns
+     * once all the results are in the table.
+     */
+    void FinishDisplay();
+
+    /**
+     * Adds rows for the results to a table set up for them.
+     */
+    void AppendResults(const QList<ValidationResult> &results);
+
     /**
      * Sets up the table widget to our liking.
      */
@@ -150,7 +199,17 @@ private:
      */
     QSharedPointer<Book> m_Book;
 
-    static const QString SEP;
+    QFutureWatcher<QList<ValidationResult>> m_CheckWatcher;
+
+    /**
+     * The files being checked, in the order of the check's results.
+     */
+    QList<FileSnapshot> m_Snapshots;
+
+    /**
+     * The last results of each HTML file, by resource identifier.
+     */
+    QHash<QString, CachedCheck> m_CheckCache;
 };
 
 #endif // VALIDATIONRESULTSVIEW_H
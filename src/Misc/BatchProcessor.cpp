@@ -0,0 +1,416 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <string.h>
+#include <stdexcept>
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QProcess>
+#include <QtCore/QTextStream>
+#include <QtCore/QUrl>
+
+#include "BookManipulation/Book.h"
+#include "Exporters/ExporterFactory.h"
+#include "Importers/Importer.h"
+#include "Importers/ImporterFactory.h"
+#include "Misc/BatchProcessor.h"
+#include "Misc/RemoteFile.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/Utility.h"
+#include "MiscEditors/SearchEditorModel.h"
+#include "ResourceObjects/HTMLResource.h"
+#include "ResourceObjects/NavProcessor.h"
+#include "ResourceObjects/NCXResource.h"
+#include "ResourceObjects/OPFResource.h"
+
+static const QString BATCH_OPTION = "--batch";
+static const QString JOBS_OPTION = "--jobs";
+static const QString OUTPUT_DIR_OPTION = "--output-dir";
+
+// How long to wait on a child before looking at the others again
+static const int JOB_POLL_MS = 100;
+
+static const int EXIT_OK = 0;
+static const int EXIT_BOOK_FAILED = 1;
+static const int EXIT_USAGE = 2;
+
+
+static void Print(const QString &message)
+{
+    QTextStream out(stdout);
+    out << message << "\n";
+    out.flush();
+}
+
+
+static void PrintError(const QString &message)
+{
+    QTextStream err(stderr);
+    err << message << "\n";
+    err.flush();
+}
+
+
+bool BatchProcessor::IsBatchRun(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int BatchProcessor::Run(const QStringList &arguments)
+{
+    Utility::SetHeadless(true);
+
+    if (!ParseArguments(arguments) || !LoadScript(m_ScriptPath)) {
+        return EXIT_USAGE;
+    }
+
+    if (m_Jobs > 1 && m_Books.count() > 1) {
+        return RunJobs();
+    }
+
+    int result = EXIT_OK;
+    foreach(QString path, m_Books) {
+        if (!ProcessBook(path)) {
+            result = EXIT_BOOK_FAILED;
+        }
+    }
+    return result;
+}
+
+
+bool BatchProcessor::ParseArguments(const QStringList &arguments)
+{
+    m_Jobs = 1;
+
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+
+        if (argument == BATCH_OPTION || argument == JOBS_OPTION || argument == OUTPUT_DIR_OPTION) {
+            if (i + 1 >= arguments.count()) {
+                PrintError(tr("Missing value for %1").arg(argument));
+                return false;
+            }
+
+            const QString value = arguments.at(++i);
+            if (argument == BATCH_OPTION) {
+                m_ScriptPath = value;
+            } else if (argument == JOBS_OPTION) {
+                bool ok = false;
+                m_Jobs = value.toInt(&ok);
+                if (!ok || m_Jobs < 1) {
+                    PrintError(tr("Invalid number of jobs: %1").arg(value));
+                    return false;
+                }
+            } else {
+                m_OutputDir = value;
+            }
+        } else {
+            m_Books.append(argument);
+        }
+    }
+
+    if (m_Books.isEmpty()) {
+        PrintError(tr("Usage: sigil --batch SCRIPT [--jobs N] [--output-dir DIR] [--threads N] [--memory-limit MB] BOOK..."));
+        return false;
+    }
+
+    if (!m_OutputDir.isEmpty() && !QDir().mkpath(m_OutputDir)) {
+        PrintError(tr("Cannot create the output folder %1").arg(m_OutputDir));
+        return false;
+    }
+
+    return true;
+}
+
+
+bool BatchProcessor::LoadScript(const QString &path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        PrintError(tr("Cannot read the script %1").arg(path));
+        return false;
+    }
+
+    QTextStream in(&file);
+    in.setCodec("UTF-8");
+    int line_number = 0;
+
+    while (!in.atEnd()) {
+        ++line_number;
+        const QString line = in.readLine().trimmed();
+
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        QString error;
+
+        if (!AddOperation(line, error)) {
+            PrintError(QString("%1:%2: %3").arg(path).arg(line_number).arg(error));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool BatchProcessor::AddOperation(const QString &line, QString &error)
+{
+    const QString name = line.trimmed().section(' ', 0, 0);
+    Operation operation;
+    operation.argument = line.trimmed().section(' ', 1).trimmed();
+
+    if (name == "mend") {
+        operation.type = Operation_Mend;
+    } else if (name == "prettify") {
+        operation.type = Operation_Prettify;
+    } else if (name == "generate-toc") {
+        operation.type = Operation_GenerateTOC;
+    } else if (name == "optimize-images") {
+        operation.type = Operation_OptimizeImages;
+    } else if (name == "search") {
+        operation.type = Operation_Search;
+        SearchEditorModel *model = SearchEditorModel::instance();
+        QStandardItem *item = model->GetItemFromName(operation.argument);
+
+        if (!item) {
+            error = tr("No saved search named \"%1\"").arg(operation.argument);
+            return false;
+        }
+
+        // Saved searches are run as regular expressions, the way
+        // the Find & Replace dialog runs them in Regex mode
+        QList<SearchEditorModel::searchEntry *> entries = model->GetEntries(model->GetNonGroupItems(item));
+        foreach(SearchEditorModel::searchEntry * entry, entries) {
+            if (!entry->find.isEmpty()) {
+                SearchOperations::ChainedSearch search;
+                search.search_regex = entry->find;
+                search.replacement = entry->replace;
+                operation.searches.append(search);
+            }
+            delete entry;
+        }
+    } else if (name == "plugin") {
+        error = tr("Plugins cannot be run in batch mode");
+        return false;
+    } else {
+        error = tr("Unknown operation \"%1\"").arg(name);
+        return false;
+    }
+
+    m_Operations.append(operation);
+    return true;
+}
+
+
+int BatchProcessor::RunJobs()
+{
+    QStringList child_arguments;
+    child_arguments << BATCH_OPTION << m_ScriptPath;
+    if (!m_OutputDir.isEmpty()) {
+        child_arguments << OUTPUT_DIR_OPTION << m_OutputDir;
+    }
+
+    // The jobs share the CPUs and memory this process may use
+    const int jobs = qMin(m_Jobs, m_Books.count());
+    child_arguments << "--threads" << QString::number(qMax(1, TaskScheduler::ThreadCount() / jobs));
+    if (TaskScheduler::MemoryLimit() > 0) {
+        child_arguments << "--memory-limit" << QString::number(qMax<qint64>(1, TaskScheduler::MemoryLimit() / jobs / (1024 * 1024)));
+    }
+
+    QStringList pending = m_Books;
+    QList<QProcess *> running;
+    int result = EXIT_OK;
+
+    while (!pending.isEmpty() || !running.isEmpty()) {
+        while (!pending.isEmpty() && running.count() < m_Jobs) {
+            QProcess *process = new QProcess();
+            process->setProcessChannelMode(QProcess::ForwardedChannels);
+            process->start(QCoreApplication::applicationFilePath(), QStringList(child_arguments) << pending.takeFirst());
+            running.append(process);
+        }
+
+        running.first()->waitForFinished(JOB_POLL_MS);
+
+        for (int i = running.count() - 1; i >= 0; --i) {
+            QProcess *process = running.at(i);
+
+            if (process->state() != QProcess::NotRunning) {
+                continue;
+            }
+
+            if (process->exitStatus() != QProcess::NormalExit || process->exitCode() != EXIT_OK) {
+                result = EXIT_BOOK_FAILED;
+            }
+
+            running.removeAt(i);
+            delete process;
+        }
+    }
+
+    return result;
+}
+
+
+bool BatchProcessor::ProcessBook(const QString &path)
+{
+    const QString output_path = OutputPath(path);
+    QSharedPointer<Book> book;
+    QStringList messages;
+    bool written = TransformBook(path, output_path, book, messages);
+    foreach(QString message, messages) {
+        PrintError(QString("%1: %2").arg(path).arg(message));
+    }
+
+    if (written) {
+        Print(tr("%1: Written to %2").arg(path).arg(output_path));
+    }
+
+    return written;
+}
+
+
+bool BatchProcessor::TransformBook(const QString &path,
+                                   const QString &output_path,
+                                   QSharedPointer<Book> &book,
+                                   QStringList &messages)
+{
+    if (!RemoteFile::IsRemote(path) && !Utility::IsFileReadable(path)) {
+        messages.append(tr("Cannot read the file"));
+        return false;
+    }
+
+    try {
+        ImporterFactory importer_factory;
+        Importer *importer = importer_factory.GetImporter(path);
+
+        if (!importer) {
+            messages.append(tr("No importer for file type: %1").arg(RemoteFile::Suffix(path)));
+            return false;
+        }
+
+        XhtmlDoc::WellFormedError error = importer->CheckValidToLoad();
+
+        if (error.line != -1) {
+            messages.append(tr("Not loaded, line %1: %2").arg(error.line).arg(error.message));
+            return false;
+        }
+
+        book = importer->GetBook();
+        messages.append(importer->GetLoadWarnings());
+
+        foreach(Operation operation, m_Operations) {
+            ApplyOperation(operation, book);
+        }
+
+        if (!output_path.isEmpty()) {
+            ExporterFactory().GetExporter(output_path, book)->WriteBook();
+        }
+    } catch (const std::runtime_error &e) {
+        messages.append(QString::fromUtf8(e.what()));
+        return false;
+    } catch (QString err) {
+        messages.append(err);
+        return false;
+    }
+
+    return true;
+}
+
+
+void BatchProcessor::ApplyOperation(const Operation &operation, QSharedPointer<Book> book)
+{
+    switch (operation.type) {
+        case Operation_Mend:
+            book->ReformatAllHTML(true);
+            break;
+
+        case Operation_Prettify:
+            book->ReformatAllHTML(false);
+            break;
+
+        case Operation_GenerateTOC:
+            // As Tools > Table Of Contents > Generate does, minus the
+            // dialog for choosing which headings to include
+            if (book->GetConstOPF()->GetEpubVersion().startsWith('3')) {
+                HTMLResource *nav_resource = book->GetOPF()->GetNavResource();
+                if (nav_resource) {
+                    NavProcessor navproc(nav_resource);
+                    if (navproc.GenerateTOCFromBookContents(book.data())) {
+                        book->SetModified();
+                    }
+                }
+            } else if (book->GetNCX()) {
+                if (book->GetNCX()->GenerateNCXFromBookContents(book.data())) {
+                    book->SetModified();
+                }
+            }
+            break;
+
+        case Operation_OptimizeImages: {
+            qint64 bytes_saved = 0;
+            book->OptimizeImages(bytes_saved);
+            break;
+        }
+
+        case Operation_Search: {
+            QList<Resource *> resources;
+            foreach(HTMLResource * html_resource, book->GetHTMLResources()) {
+                resources.append(html_resource);
+            }
+            if (SearchOperations::ReplaceChainInAllFiles(operation.searches, resources, SearchOperations::CodeViewSearch) > 0) {
+                book->SetModified();
+            }
+            break;
+        }
+    }
+}
+
+
+QString BatchProcessor::OutputPath(const QString &path) const
+{
+    const bool remote = RemoteFile::IsRemote(path);
+    QFileInfo info(remote ? QUrl(path).path() : path);
+    // Books are always written as EPUB
+    const QString filename = info.completeBaseName() + ".epub";
+
+    if (!m_OutputDir.isEmpty()) {
+        return QDir(m_OutputDir).absoluteFilePath(filename);
+    }
+
+    // Remote books are written back where they came from
+    if (remote) {
+        return path;
+    }
+
+    return info.absoluteDir().absoluteFilePath(filename);
+}
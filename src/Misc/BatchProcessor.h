@@ -0,0 +1,134 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QList>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/SearchOperations.h"
+
+class Book;
+
+/**
+ * Runs a script of operations over many books without a main window.
+ *
+ *   sigil --batch SCRIPT [--jobs N] [--output-dir DIR] BOOK...
+ *
+ * Each book is opened through the ImporterFactory, the script is applied
+ * to it and it is written back through the ExporterFactory, to DIR when
+ * given and over the original otherwise. The script has one operation
+ * per line; empty lines and lines starting with # are skipped:
+ *
+ *   mend                 Mend all HTML files
+ *   prettify             Mend and prettify all HTML files
+ *   generate-toc         Generate the TOC from the headings
+ *   optimize-images      Shrink PNG and JPEG files losslessly
+ *   search NAME          Replace all with a saved search, or with each
+ *                        search of a saved search group, in order
+ *
+ * With more than one job each book is handed to a child process of its
+ * own, so books never share a TempFolder, a Book or a file watcher.
+ */
+class BatchProcessor
+{
+    Q_DECLARE_TR_FUNCTIONS(BatchProcessor)
+
+public:
+
+    /**
+     * @return true if Sigil was started to run a batch. Looked at before
+     *         the application object exists, so the raw arguments are used.
+     */
+    static bool IsBatchRun(int argc, char *argv[]);
+
+    /**
+     * Processes the books named by the arguments.
+     *
+     * @return 0 if every book was written, 1 if any failed,
+     *         2 if the arguments or the script are unusable.
+     */
+    int Run(const QStringList &arguments);
+
+    /**
+     * Adds the operation a line of a script names to those applied.
+     *
+     * @return false, with the reason in error, if it is not usable.
+     */
+    bool AddOperation(const QString &line, QString &error);
+
+    /**
+     * Opens the book at path, applies the operations to it and writes
+     * it to output_path, unless that is empty.
+     *
+     * @param book Set to the book once it is open.
+     * @param messages Receives the load warnings and, on failure, why.
+     * @return true if the book was opened and, if asked, written.
+     */
+    bool TransformBook(const QString &path,
+                       const QString &output_path,
+                       QSharedPointer<Book> &book,
+                       QStringList &messages);
+
+private:
+
+    enum OperationType {
+        Operation_Mend,
+        Operation_Prettify,
+        Operation_GenerateTOC,
+        Operation_OptimizeImages,
+        Operation_Search
+    };
+
+    struct Operation {
+        OperationType type;
+        QString argument;
+        QList<SearchOperations::ChainedSearch> searches;
+    };
+
+    bool ParseArguments(const QStringList &arguments);
+
+    bool LoadScript(const QString &path);
+
+    /**
+     * Runs the books in child processes, at most m_Jobs at a time.
+     */
+    int RunJobs();
+
+    bool ProcessBook(const QString &path);
+
+    void ApplyOperation(const Operation &operation, QSharedPointer<Book> book);
+
+    QString OutputPath(const QString &path) const;
+
+    QString m_ScriptPath;
+    QString m_OutputDir;
+    int m_Jobs;
+    QStringList m_Books;
+    QList<Operation> m_Operations;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,754 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <zip.h>
+#ifdef _WIN32
+#include <iowin32.h>
+#endif
+
+#include <QtCore/QBuffer>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QTextStream>
+#include <QtCore/QXmlStreamReader>
+#include <QtGui/QColor>
+#include <QtGui/QImage>
+
+#include "BookManipulation/Book.h"
+#include "BookManipulation/CleanSource.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "BookManipulation/Headings.h"
+#include "BookManipulation/Index.h"
+#include "BookManipulation/XhtmlDoc.h"
+#include "Exporters/ExporterFactory.h"
+#include "Importers/Importer.h"
+#include "Importers/ImporterFactory.h"
+#include "Misc/Benchmark.h"
+#include "Misc/GumboInterface.h"
+#include "Misc/GumboReparse.h"
+#include "Misc/HTMLSpellCheck.h"
+#include "Misc/SearchOperations.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/TempFolder.h"
+#include "Misc/Utility.h"
+#include "MiscEditors/IndexEditorModel.h"
+#include "ResourceObjects/HTMLResource.h"
+#include "ResourceObjects/OPFResource.h"
+#include "SourceUpdates/UniversalUpdates.h"
+
+static const QString BENCHMARK_OPTION = "--benchmark";
+static const QString OUTPUT_OPTION = "--output";
+static const QString ITERATIONS_OPTION = "--iterations";
+
+static const int DEFAULT_FILES = 50;
+static const int DEFAULT_CHAPTER_KB = 20;
+static const int DEFAULT_IMAGES = 20;
+static const int DEFAULT_CSS_KB = 10;
+static const int DEFAULT_ANCHORS = 20;
+static const int DEFAULT_ITERATIONS = 3;
+
+static const int IMAGE_WIDTH = 320;
+static const int IMAGE_HEIGHT = 240;
+static const int IMAGE_BLOCK = 16;
+static const int PARAGRAPHS_PER_SECTION = 8;
+static const int CSS_CLASSES = 20;
+static const int LARGE_MANIFEST_ITEMS = 5000;
+static const quint32 SEED = 20190601;
+static const int REPARSE_EDITS = 20;
+
+static const char *WORDS[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit",
+    "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore", "et", "dolore",
+    "magna", "aliqua", "the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+    "book", "chapter", "reader", "page", "story", "river", "mountain", "window",
+    "garden", "letter", "evening", "morning", "journey", "teh", "recieve", "seperate"
+};
+static const int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+// What the reparse check types into a chapter, among them end tags that
+// close an element further up
+static const char *EDITS[] = {
+    "word ", "&#160;", "<b>bold</b>", "<i>", "</i>", "</b>", "</a>", "</p>", "</div>",
+    "<b></b>&#160;</b>", "<br/>", "<span class=\"x\">", "<div>block</div>", "<!-- </p> -->", "\n"
+};
+static const int EDIT_COUNT = sizeof(EDITS) / sizeof(EDITS[0]);
+
+static const int EXIT_OK = 0;
+static const int EXIT_FAILED = 1;
+static const int EXIT_USAGE = 2;
+
+
+namespace
+{
+// The same seed gives the same book on every platform, which qrand
+// does not promise
+class Random
+{
+public:
+    Random(quint32 seed) : m_State(seed) {}
+
+    int Next(int bound)
+    {
+        m_State = m_State * 1664525u + 1013904223u;
+        return int((m_State >> 8) % quint32(bound));
+    }
+
+private:
+    quint32 m_State;
+};
+}
+
+
+static void PrintError(const QString &message)
+{
+    QTextStream err(stderr);
+    err << message << "\n";
+    err.flush();
+}
+
+
+static QString ChapterName(int index)
+{
+    return QString("chapter%1.xhtml").arg(index, 4, 10, QChar('0'));
+}
+
+
+static QString ImageName(int index)
+{
+    return QString("image%1.png").arg(index, 4, 10, QChar('0'));
+}
+
+
+static QString Sentence(Random &random)
+{
+    QStringList words;
+    int count = 6 + random.Next(14);
+    for (int i = 0; i < count; ++i) {
+        words.append(WORDS[random.Next(WORD_COUNT)]);
+    }
+    QString sentence = words.join(" ");
+    sentence[0] = sentence[0].toUpper();
+    return sentence + ".";
+}
+
+
+static QByteArray GenerateChapter(int index, int files, int images, int size, int anchors, Random &random)
+{
+    QString body;
+    body += QString("<h1 id=\"c%1\">Chapter %1</h1>\n").arg(index);
+
+    for (int image = index; image < images; image += files) {
+        body += QString("<p class=\"figure\"><img src=\"../Images/%1\" alt=\"Figure %2\"/></p>\n")
+                .arg(ImageName(image)).arg(image);
+    }
+
+    int paragraph = 0;
+    int links = 0;
+    while (body.size() < size) {
+        if (paragraph > 0 && paragraph % PARAGRAPHS_PER_SECTION == 0) {
+            body += QString("<h2 id=\"c%1s%2\">Section %2</h2>\n").arg(index).arg(paragraph / PARAGRAPHS_PER_SECTION);
+        }
+
+        QString text = Sentence(random) + " " + Sentence(random) + " " + Sentence(random);
+        if (links < anchors) {
+            // Links go to the start of a chapter, often another one
+            int target = random.Next(files);
+            text += QString(" <a href=\"%1#c%2\">%3</a>").arg(ChapterName(target)).arg(target).arg(Sentence(random));
+            ++links;
+        }
+        body += QString("<p id=\"c%1p%2\" class=\"c%3\">%4</p>\n")
+                .arg(index).arg(paragraph).arg(random.Next(CSS_CLASSES)).arg(text);
+        ++paragraph;
+    }
+
+    return QString("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                   "<!DOCTYPE html>\n\n"
+                   "<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">\n"
+                   "<head>\n"
+                   "  <title>Chapter %1</title>\n"
+                   "  <link href=\"../Styles/style.css\" type=\"text/css\" rel=\"stylesheet\"/>\n"
+                   "</head>\n\n"
+                   "<body>\n%2</body>\n"
+                   "</html>\n").arg(index).arg(body).toUtf8();
+}
+
+
+static QByteArray GenerateCSS(int size, Random &random)
+{
+    QString css = "body { margin: 0 5%; }\n"
+                  "h1, h2 { text-align: center; }\n"
+                  "p.figure { text-align: center; text-indent: 0; }\n";
+    int rule = 0;
+    while (css.size() < size) {
+        css += QString(".c%1 p, p.c%1 { margin: %2em 0; text-indent: %3em; color: #%4; }\n")
+               .arg(rule % CSS_CLASSES)
+               .arg(random.Next(3))
+               .arg(random.Next(4))
+               .arg(random.Next(0xFFFFFF), 6, 16, QChar('0'));
+        ++rule;
+    }
+    return css.toUtf8();
+}
+
+
+static QByteArray GenerateImage(Random &random)
+{
+    QImage image(IMAGE_WIDTH, IMAGE_HEIGHT, QImage::Format_RGB32);
+    for (int y = 0; y < IMAGE_HEIGHT; y += IMAGE_BLOCK) {
+        for (int x = 0; x < IMAGE_WIDTH; x += IMAGE_BLOCK) {
+            QColor color(random.Next(256), random.Next(256), random.Next(256));
+            for (int row = y; row < y + IMAGE_BLOCK && row < IMAGE_HEIGHT; ++row) {
+                QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(row));
+                std::fill(line + x, line + std::min(x + IMAGE_BLOCK, IMAGE_WIDTH), color.rgb());
+            }
+        }
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+    return data;
+}
+
+
+static QByteArray GenerateNav(int files)
+{
+    QString items;
+    for (int i = 0; i < files; ++i) {
+        items += QString("      <li><a href=\"%1\">Chapter %2</a></li>\n").arg(ChapterName(i)).arg(i);
+    }
+    return QString("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                   "<!DOCTYPE html>\n\n"
+                   "<html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">\n"
+                   "<head>\n"
+                   "  <title>Contents</title>\n"
+                   "</head>\n\n"
+                   "<body>\n"
+                   "  <nav epub:type=\"toc\" id=\"toc\">\n"
+                   "    <h1>Contents</h1>\n"
+                   "    <ol>\n%1    </ol>\n"
+                   "  </nav>\n"
+                   "</body>\n"
+                   "</html>\n").arg(items).toUtf8();
+}
+
+
+static QByteArray GenerateOPF(int files, int images)
+{
+    QString manifest = "    <item id=\"nav.xhtml\" href=\"Text/nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>\n"
+                       "    <item id=\"style.css\" href=\"Styles/style.css\" media-type=\"text/css\"/>\n";
+    QString spine;
+    for (int i = 0; i < files; ++i) {
+        manifest += QString("    <item id=\"%1\" href=\"Text/%1\" media-type=\"application/xhtml+xml\"/>\n").arg(ChapterName(i));
+        spine += QString("    <itemref idref=\"%1\"/>\n").arg(ChapterName(i));
+    }
+    for (int i = 0; i < images; ++i) {
+        manifest += QString("    <item id=\"%1\" href=\"Images/%1\" media-type=\"image/png\"/>\n").arg(ImageName(i));
+    }
+    return QString("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                   "<package version=\"3.0\" unique-identifier=\"BookId\" xmlns=\"http://www.idpf.org/2007/opf\">\n"
+                   "  <metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+                   "    <dc:identifier id=\"BookId\">urn:uuid:5b4d5bd1-1c5e-4a8e-9b0e-5c0d1e5e0b1a</dc:identifier>\n"
+                   "    <dc:title>Sigil Benchmark</dc:title>\n"
+                   "    <dc:language>en</dc:language>\n"
+                   "    <meta property=\"dcterms:modified\">2019-06-01T00:00:00Z</meta>\n"
+                   "  </metadata>\n"
+                   "  <manifest>\n%1  </manifest>\n"
+                   "  <spine>\n    <itemref idref=\"nav.xhtml\" linear=\"no\"/>\n%2  </spine>\n"
+                   "</package>\n").arg(manifest).arg(spine).toUtf8();
+}
+
+
+// What XhtmlDoc::GetTagsInDocument did before it scanned tags itself,
+// kept to compare the two
+static QList<XhtmlDoc::XMLElement> GetTagsWithXmlReader(const QString &source, const QString &tag_name)
+{
+    QXmlStreamReader reader(source);
+    QList<XhtmlDoc::XMLElement> matching_elements;
+
+    while (!reader.atEnd()) {
+        reader.readNext();
+
+        if (reader.isStartElement() && reader.name() == tag_name) {
+            XhtmlDoc::XMLElement element;
+            element.lineno = reader.lineNumber();
+            foreach(QXmlStreamAttribute attribute, reader.attributes()) {
+                QString attribute_name = attribute.name().toString();
+
+                if (!Utility::IsMixedCase(attribute_name)) {
+                    attribute_name = attribute_name.toLower();
+                }
+
+                element.attributes[ attribute_name ] = attribute.value().toString();
+            }
+            element.name = reader.name().toString();
+            element.text = reader.readElementText(QXmlStreamReader::IncludeChildElements);
+            matching_elements.append(element);
+        }
+    }
+
+    return matching_elements;
+}
+
+
+// The options GumboInterface parses a whole file with
+static GumboOptions XhtmlOptions()
+{
+    GumboOptions options = kGumboDefaultOptions;
+    options.tab_stop = 4;
+    options.use_xhtml_rules = true;
+    options.stop_on_first_error = false;
+    options.max_tree_depth = 400;
+    options.max_errors = 50;
+    return options;
+}
+
+
+// Makes edits anywhere in the body of a chapter, one after another, and
+// compares every tree GumboReparse patches with a full parse of the
+// edited source. Returns the number of edits where they differ.
+static int CheckReparse(const QString &text, Random &random)
+{
+    std::string source = text.toStdString();
+
+    // Parsed as GumboInterface does, without the xml header
+    if (source.compare(0, 5, "<?xml") == 0) {
+        size_t start = source.find("?>");
+        start = start == std::string::npos ? source.length() : source.find_first_not_of("\n\r\t\v\f ", start + 2);
+        source.erase(0, start);
+    }
+
+    const GumboOptions options = XhtmlOptions();
+    GumboOutput *output = gumbo_parse_with_options(&options, source.data(), source.length());
+    int mismatches = 0;
+
+    for (int i = 0; i < REPARSE_EDITS; ++i) {
+        size_t body_start = source.find("<body>");
+        size_t body_end = source.rfind("</body>");
+
+        if (body_start == std::string::npos || body_end == std::string::npos || body_end <= body_start + 6) {
+            break;
+        }
+
+        body_start += 6;
+        std::string edited = source;
+        size_t offset = body_start + random.Next(int(body_end - body_start));
+
+        if (random.Next(4) == 0) {
+            edited.erase(offset, std::min(size_t(1 + random.Next(8)), body_end - offset));
+        } else {
+            edited.insert(offset, EDITS[random.Next(EDIT_COUNT)]);
+        }
+
+        bool patched = GumboReparse::Apply(output, options, source.data(), source.length(),
+                                           edited.data(), edited.length());
+        bool same = !patched || GumboReparse::MatchesFullParse(output, options, edited.data(), edited.length());
+
+        if (!same) {
+            ++mismatches;
+        }
+
+        // A long string keeps its buffer on a swap, so a patched tree
+        // still points into it
+        source.swap(edited);
+
+        if (!patched || !same) {
+            gumbo_destroy_output(output);
+            output = gumbo_parse_with_options(&options, source.data(), source.length());
+        }
+    }
+
+    gumbo_destroy_output(output);
+    return mismatches;
+}
+
+
+static bool AddToZip(zipFile zfile, const QString &relpath, const QByteArray &data, bool compress)
+{
+    zip_fileinfo info;
+    memset(&info, 0, sizeof(info));
+    info.tmz_date.tm_mday = 1;
+    info.tmz_date.tm_mon = 5;
+    info.tmz_date.tm_year = 2019;
+
+    if (zipOpenNewFileInZip64(zfile, relpath.toUtf8().constData(), &info, NULL, 0, NULL, 0, NULL,
+                              compress ? Z_DEFLATED : 0, compress ? Z_DEFAULT_COMPRESSION : 0, 0) != ZIP_OK) {
+        return false;
+    }
+
+    bool written = zipWriteInFileInZip(zfile, data.constData(), (unsigned int)data.size()) == ZIP_OK;
+    return zipCloseFileInZip(zfile) == ZIP_OK && written;
+}
+
+
+bool Benchmark::IsBenchmarkRun(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int Benchmark::Run(const QStringList &arguments)
+{
+    Utility::SetHeadless(true);
+
+    if (!ParseArguments(arguments)) {
+        PrintError(tr("Usage: sigil --benchmark [--files N] [--chapter-kb K] [--images N] "
+                      "[--css-kb K] [--anchors N] [--iterations N] [--output FILE] [--threads N] [--memory-limit MB]"));
+        return EXIT_USAGE;
+    }
+
+    TempFolder workspace;
+    const QString epub_path = workspace.GetPath() + "/benchmark.epub";
+    const QString export_path = workspace.GetPath() + "/exported.epub";
+
+    if (!GenerateEPUB(epub_path)) {
+        PrintError(tr("Cannot write the benchmark book to %1").arg(epub_path));
+        return EXIT_FAILED;
+    }
+    m_EpubBytes = QFileInfo(epub_path).size();
+
+    try {
+        for (int i = 0; i < m_Iterations; ++i) {
+            RunIteration(epub_path, export_path);
+        }
+    } catch (const std::runtime_error &e) {
+        PrintError(tr("Benchmark failed: %1").arg(e.what()));
+        return EXIT_FAILED;
+    } catch (QString err) {
+        PrintError(tr("Benchmark failed: %1").arg(err));
+        return EXIT_FAILED;
+    }
+
+    const QByteArray json = ResultsAsJson();
+
+    if (m_OutputPath.isEmpty()) {
+        QTextStream out(stdout);
+        out << json;
+        out.flush();
+        return EXIT_OK;
+    }
+
+    QFile file(m_OutputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        PrintError(tr("Cannot write the results to %1").arg(m_OutputPath));
+        return EXIT_FAILED;
+    }
+    return EXIT_OK;
+}
+
+
+bool Benchmark::ParseArguments(const QStringList &arguments)
+{
+    m_Corpus.files = DEFAULT_FILES;
+    m_Corpus.chapter_kb = DEFAULT_CHAPTER_KB;
+    m_Corpus.images = DEFAULT_IMAGES;
+    m_Corpus.css_kb = DEFAULT_CSS_KB;
+    m_Corpus.anchors = DEFAULT_ANCHORS;
+    m_Iterations = DEFAULT_ITERATIONS;
+
+    QHash<QString, int *> counts;
+    counts["--files"] = &m_Corpus.files;
+    counts["--chapter-kb"] = &m_Corpus.chapter_kb;
+    counts["--images"] = &m_Corpus.images;
+    counts["--css-kb"] = &m_Corpus.css_kb;
+    counts["--anchors"] = &m_Corpus.anchors;
+    counts[ITERATIONS_OPTION] = &m_Iterations;
+
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+
+        if (argument == BENCHMARK_OPTION) {
+            continue;
+        }
+
+        if (i + 1 >= arguments.count()) {
+            return false;
+        }
+
+        const QString value = arguments.at(++i);
+        if (argument == OUTPUT_OPTION) {
+            m_OutputPath = value;
+        } else if (counts.contains(argument)) {
+            bool ok = false;
+            *counts[argument] = value.toInt(&ok);
+            if (!ok || *counts[argument] < 0) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return m_Corpus.files > 0 && m_Iterations > 0;
+}
+
+
+bool Benchmark::GenerateEPUB(const QString &path) const
+{
+#ifdef Q_OS_WIN32
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64W(&ffunc);
+    zipFile zfile = zipOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(path)).c_str(), APPEND_STATUS_CREATE, NULL, &ffunc);
+#else
+    zipFile zfile = zipOpen64(QDir::toNativeSeparators(path).toUtf8().constData(), APPEND_STATUS_CREATE);
+#endif
+
+    if (zfile == NULL) {
+        return false;
+    }
+
+    Random random(SEED);
+    bool written =
+        AddToZip(zfile, "mimetype", "application/epub+zip", false) &&
+        AddToZip(zfile, "META-INF/container.xml",
+                 "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                 "<container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">\n"
+                 "  <rootfiles>\n"
+                 "    <rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/>\n"
+                 "  </rootfiles>\n"
+                 "</container>\n", true) &&
+        AddToZip(zfile, "OEBPS/content.opf", GenerateOPF(m_Corpus.files, m_Corpus.images), true) &&
+        AddToZip(zfile, "OEBPS/Text/nav.xhtml", GenerateNav(m_Corpus.files), true) &&
+        AddToZip(zfile, "OEBPS/Styles/style.css", GenerateCSS(m_Corpus.css_kb * 1024, random), true);
+
+    for (int i = 0; written && i < m_Corpus.files; ++i) {
+        written = AddToZip(zfile, "OEBPS/Text/" + ChapterName(i),
+                           GenerateChapter(i, m_Corpus.files, m_Corpus.images, m_Corpus.chapter_kb * 1024,
+                                           m_Corpus.anchors, random), true);
+    }
+
+    for (int i = 0; written && i < m_Corpus.images; ++i) {
+        // Already compressed, as they would be in a real book
+        written = AddToZip(zfile, "OEBPS/Images/" + ImageName(i), GenerateImage(random), false);
+    }
+
+    return zipClose(zfile, NULL) == ZIP_OK && written;
+}
+
+
+void Benchmark::RunIteration(const QString &epub_path, const QString &export_path)
+{
+    QElapsedTimer timer;
+    timer.start();
+    ImporterFactory importer_factory;
+    Importer *importer = importer_factory.GetImporter(epub_path);
+    if (!importer) {
+        throw tr("No importer for %1").arg(epub_path);
+    }
+    QSharedPointer<Book> book = importer->GetBook();
+    Record("ImportEPUB", timer.nsecsElapsed());
+
+    const QList<HTMLResource *> html_resources = book->GetHTMLResources();
+    QList<Resource *> resources;
+    foreach(HTMLResource * html_resource, html_resources) {
+        resources.append(html_resource);
+    }
+    const QString version = book->GetConstOPF()->GetEpubVersion();
+
+    timer.restart();
+    foreach(HTMLResource * html_resource, html_resources) {
+        GumboInterface gi(html_resource->GetText(), version);
+        gi.getxhtml();
+    }
+    Record("GumboParseSerialize", timer.nsecsElapsed());
+
+    // Reparsing after an edit must give what a full parse gives
+    timer.restart();
+    Random random(SEED);
+    int mismatches = 0;
+    foreach(HTMLResource * html_resource, html_resources) {
+        mismatches += CheckReparse(html_resource->GetText(), random);
+    }
+    Record("GumboReparse", timer.nsecsElapsed());
+    if (mismatches > 0) {
+        throw tr("%1 reparsed trees differ from a full parse").arg(mismatches);
+    }
+
+    // The read-only trees the caches keep, and what parsing them took
+    m_ParseBytes = 0;
+    m_TreeBytes = 0;
+    timer.restart();
+    foreach(HTMLResource * html_resource, html_resources) {
+        GumboTree tree(html_resource->GetText());
+        m_ParseBytes += tree.parse_size();
+        m_TreeBytes += tree.output() ? qint64(tree.output()->compact_size) : 0;
+    }
+    Record("GumboTreeBuild", timer.nsecsElapsed());
+
+    // The anchors the Links report collects, read both ways
+    timer.restart();
+    foreach(HTMLResource * html_resource, html_resources) {
+        GetTagsWithXmlReader(html_resource->GetText(), "a");
+    }
+    Record("TagsXmlReader", timer.nsecsElapsed());
+
+    timer.restart();
+    foreach(HTMLResource * html_resource, html_resources) {
+        XhtmlDoc::GetTagsInDocument(html_resource->GetText(), "a");
+    }
+    Record("TagsScanner", timer.nsecsElapsed());
+
+    timer.restart();
+    SearchOperations::CountInFiles("<a\\s[^>]*href=\"[^\"]*#", resources, SearchOperations::CodeViewSearch);
+    Record("SearchCount", timer.nsecsElapsed());
+
+    timer.restart();
+    SearchOperations::ReplaceInAllFIles("\\b(ipsum|dolor)\\b", "\\U\\1", resources, SearchOperations::CodeViewSearch);
+    Record("SearchReplace", timer.nsecsElapsed());
+
+    // What the Reports dialog gathers from the book
+    timer.restart();
+    book->GetClassesInHTMLFiles();
+    book->GetIdsInHTMLFiles();
+    book->GetHTMLFilesUsingImages();
+    book->CountAllLinksInHTML();
+    book->GetUniqueWordsInHTMLFiles();
+    Record("BookReports", timer.nsecsElapsed());
+
+    Headings::ClearCache();
+    timer.restart();
+    Headings::GetHeadingList(html_resources);
+    Record("Headings", timer.nsecsElapsed());
+
+    timer.restart();
+    foreach(HTMLResource * html_resource, html_resources) {
+        HTMLSpellCheck::CountMisspelledWords(html_resource->GetText());
+    }
+    Record("SpellCheck", timer.nsecsElapsed());
+
+    timer.restart();
+    Index::BuildIndex(html_resources);
+    Record("BuildIndex", timer.nsecsElapsed());
+
+    // The repair every OPF getter, NCX update and XML save goes
+    // through, on a large manifest, and the Python repair it skips
+    const QString large_opf = QString::fromUtf8(GenerateOPF(LARGE_MANIFEST_ITEMS, 0));
+    timer.restart();
+    CleanSource::ProcessXML(large_opf, "application/oebps-package+xml");
+    Record("ProcessXML", timer.nsecsElapsed());
+
+    timer.restart();
+    CleanSource::XMLPrettyPrintBS4(large_opf, "application/oebps-package+xml");
+    Record("ProcessXMLPython", timer.nsecsElapsed());
+
+    // As Rename in the Book Browser does it for a selection of every file
+    timer.restart();
+    QHash<QString, QString> update;
+    {
+        OPFResource::Transaction opf_transaction(book->GetOPF());
+        for (int i = 0; i < html_resources.count(); ++i) {
+            HTMLResource *html_resource = html_resources.at(i);
+            const QString old_bookrelpath = html_resource->GetRelativePathToRoot();
+            if (html_resource->RenameTo(QString("renamed%1.xhtml").arg(i, 4, 10, QChar('0')))) {
+                update[old_bookrelpath] = "../" + html_resource->GetRelativePathToOEBPS();
+            }
+        }
+        opf_transaction.Commit();
+    }
+    UniversalUpdates::PerformUniversalUpdates(true, book->GetFolderKeeper()->GetResourceList(), update);
+    Record("UniversalUpdatesRename", timer.nsecsElapsed());
+
+    timer.restart();
+    ExporterFactory().GetExporter(export_path, book)->WriteBook();
+    Record("ExportEPUB", timer.nsecsElapsed());
+}
+
+
+void Benchmark::Record(const QString &name, qint64 nsecs)
+{
+    if (!m_Timings.contains(name)) {
+        m_Steps.append(name);
+    }
+    m_Timings[name].append(nsecs);
+}
+
+
+QByteArray Benchmark::ResultsAsJson() const
+{
+    QJsonObject corpus;
+    corpus["files"] = m_Corpus.files;
+    corpus["chapter_kb"] = m_Corpus.chapter_kb;
+    corpus["images"] = m_Corpus.images;
+    corpus["css_kb"] = m_Corpus.css_kb;
+    corpus["anchors"] = m_Corpus.anchors;
+    corpus["epub_bytes"] = double(m_EpubBytes);
+
+    // BuildIndex works on the user's index entries, so their number
+    // is needed to compare its times
+    QList<IndexEditorModel::indexEntry *> index_entries = IndexEditorModel::instance()->GetEntries();
+    const int index_entry_count = index_entries.count();
+    qDeleteAll(index_entries);
+
+    QJsonArray steps;
+    foreach(QString name, m_Steps) {
+        QList<qint64> runs = m_Timings.value(name);
+        QJsonArray runs_ms;
+        double total = 0;
+        foreach(qint64 run, runs) {
+            runs_ms.append(run / 1e6);
+            total += run;
+        }
+        std::sort(runs.begin(), runs.end());
+
+        QJsonObject step;
+        step["step"] = name;
+        step["min_ms"] = runs.first() / 1e6;
+        step["median_ms"] = runs.at(runs.count() / 2) / 1e6;
+        step["mean_ms"] = total / runs.count() / 1e6;
+        step["runs_ms"] = runs_ms;
+        steps.append(step);
+    }
+
+    QJsonObject memory;
+    memory["gumbo_parse_bytes"] = double(m_ParseBytes);
+    memory["gumbo_tree_bytes"] = double(m_TreeBytes);
+
+    QJsonObject results;
+    results["sigil_version"] = QString(SIGIL_FULL_VERSION);
+    results["qt_version"] = QString(qVersion());
+    results["threads"] = TaskScheduler::ThreadCount();
+    results["iterations"] = m_Iterations;
+    results["index_entries"] = index_entry_count;
+    results["corpus"] = corpus;
+    results["steps"] = steps;
+    results["memory"] = memory;
+    return QJsonDocument(results).toJson();
+}
@@ -0,0 +1,106 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * Times Sigil's engines on a synthetic EPUB, without a main window.
+ *
+ *   sigil --benchmark [--files N] [--chapter-kb K] [--images N]
+ *                     [--css-kb K] [--anchors N] [--iterations N]
+ *                     [--output FILE]
+ *
+ * The book is generated from a fixed seed, so the same options always
+ * give the same book. Each iteration imports it, runs every engine on
+ * it and exports it again. It also edits the chapters and fails if a
+ * reparsed tree differs from a full parse. The timings are written as JSON, to FILE or
+ * to stdout, for comparing one build with another, along with the
+ * memory the parse trees of the chapters take. The sigil_bench
+ * build target runs it with the default options.
+ */
+class Benchmark
+{
+    Q_DECLARE_TR_FUNCTIONS(Benchmark)
+
+public:
+
+    /**
+     * @return true if Sigil was started to run the benchmark.
+     */
+    static bool IsBenchmarkRun(int argc, char *argv[]);
+
+    /**
+     * @return 0 if the benchmark ran, 1 if it failed and
+     *         2 if the arguments are unusable.
+     */
+    int Run(const QStringList &arguments);
+
+private:
+
+    struct Corpus {
+        int files;
+        int chapter_kb;
+        int images;
+        int css_kb;
+        int anchors;
+    };
+
+    bool ParseArguments(const QStringList &arguments);
+
+    /**
+     * Writes the synthetic book as an EPUB.
+     */
+    bool GenerateEPUB(const QString &path) const;
+
+    void RunIteration(const QString &epub_path, const QString &export_path);
+
+    void Record(const QString &name, qint64 nsecs);
+
+    QByteArray ResultsAsJson() const;
+
+    Corpus m_Corpus;
+    qint64 m_EpubBytes;
+    int m_Iterations;
+    QString m_OutputPath;
+
+    /**
+     * The steps in the order they first ran, and their times.
+     */
+    QStringList m_Steps;
+    QHash<QString, QList<qint64>> m_Timings;
+
+    /**
+     * What the parse trees of the chapters took to build and what they
+     * take to keep, in bytes.
+     */
+    qint64 m_ParseBytes;
+    qint64 m_TreeBytes;
+};
+
+#endif // BENCHMARK_H
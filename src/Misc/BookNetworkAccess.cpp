@@ -0,0 +1,229 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMetaObject>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+#include "BookManipulation/Book.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "Misc/BookNetworkAccess.h"
+#include "ResourceObjects/TextResource.h"
+
+// The most file content kept in memory, in bytes
+static const int MEMORY_CACHE_BYTES = 64 * 1024 * 1024;
+
+BookNetworkAccess *BookNetworkAccess::m_instance = 0;
+
+
+/**
+ * Answers a request with bytes already in memory. Like the replies
+ * for files on disk, it is finished as soon as the event loop runs.
+ */
+class MemoryReply : public QNetworkReply
+{
+public:
+    MemoryReply(const QNetworkRequest &request, const QByteArray &data, const QString &media_type, QObject *parent)
+        :
+        QNetworkReply(parent),
+        m_Data(data),
+        m_Offset(0)
+    {
+        setRequest(request);
+        setUrl(request.url());
+        setOperation(QNetworkAccessManager::GetOperation);
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+
+        if (!media_type.isEmpty()) {
+            setHeader(QNetworkRequest::ContentTypeHeader, media_type);
+        }
+
+        setHeader(QNetworkRequest::ContentLengthHeader, m_Data.size());
+        setFinished(true);
+        QMetaObject::invokeMethod(this, "metaDataChanged", Qt::QueuedConnection);
+        QMetaObject::invokeMethod(this, "readyRead", Qt::QueuedConnection);
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+    }
+
+    void abort()
+    {
+    }
+
+    bool isSequential() const
+    {
+        return true;
+    }
+
+    qint64 bytesAvailable() const
+    {
+        return m_Data.size() - m_Offset + QNetworkReply::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 max_size)
+    {
+        if (m_Offset >= m_Data.size()) {
+            return -1;
+        }
+
+        qint64 count = qMin(max_size, qint64(m_Data.size() - m_Offset));
+        memcpy(data, m_Data.constData() + m_Offset, count);
+        m_Offset += count;
+        return count;
+    }
+
+private:
+    QByteArray m_Data;
+    qint64 m_Offset;
+};
+
+
+BookNetworkAccess *BookNetworkAccess::instance()
+{
+    if (m_instance == 0) {
+        m_instance = new BookNetworkAccess();
+    }
+
+    return m_instance;
+}
+
+
+BookNetworkAccess::BookNetworkAccess()
+    :
+    m_Entries(MEMORY_CACHE_BYTES)
+{
+}
+
+
+void BookNetworkAccess::AddBook(QSharedPointer<Book> book)
+{
+    m_Books.append(book.toWeakRef());
+}
+
+
+qint64 BookNetworkAccess::MemoryUsage() const
+{
+    return m_Entries.totalCost();
+}
+
+
+void BookNetworkAccess::ClearCache()
+{
+    m_Entries.clear();
+}
+
+
+QNetworkReply *BookNetworkAccess::createRequest(Operation operation, const QNetworkRequest &request,
+                                                QIODevice *outgoing_data)
+{
+    if (operation == GetOperation && request.url().isLocalFile()) {
+        Resource *resource = FindResource(request.url().toLocalFile());
+        QByteArray data;
+
+        if (resource && ContentOf(resource, data)) {
+            QString media_type = resource->GetMediaType();
+
+            // Text is served as it is held, whatever the file says
+            if (!media_type.isEmpty() && qobject_cast<TextResource *>(resource)) {
+                media_type += "; charset=utf-8";
+            }
+
+            return new MemoryReply(request, data, media_type, this);
+        }
+    }
+
+    return QNetworkAccessManager::createRequest(operation, request, outgoing_data);
+}
+
+
+Resource *BookNetworkAccess::FindResource(const QString &path)
+{
+    for (int i = m_Books.count() - 1; i >= 0; --i) {
+        QSharedPointer<Book> book = m_Books.at(i).toStrongRef();
+
+        if (!book) {
+            m_Books.removeAt(i);
+            continue;
+        }
+
+        Resource *resource = book->GetFolderKeeper()->GetResourceByFullPath(path);
+
+        if (resource) {
+            return resource;
+        }
+    }
+
+    return NULL;
+}
+
+
+bool BookNetworkAccess::ContentOf(Resource *resource, QByteArray &data)
+{
+    // A lazily opened file is written out first
+    if (!resource->LoadDeferredContent()) {
+        return false;
+    }
+
+    const QString path = resource->GetFullPath();
+    TextResource *text_resource = qobject_cast<TextResource *>(resource);
+    TextResource::Snapshot snapshot;
+    QString revision;
+
+    if (text_resource) {
+        snapshot = text_resource->GetSnapshot();
+        revision = "text|" + QString::number(snapshot.revision);
+    } else {
+        QFileInfo info(path);
+        revision = QString::number(info.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(info.size());
+    }
+
+    Entry *cached = m_Entries.object(path);
+
+    if (cached && cached->revision == revision) {
+        data = cached->data;
+        return true;
+    }
+
+    Entry *entry = new Entry();
+    entry->revision = revision;
+
+    if (text_resource) {
+        entry->data = snapshot.text.toUtf8();
+    } else {
+        QFile file(path);
+
+        if (!file.open(QIODevice::ReadOnly)) {
+            delete entry;
+            m_Entries.remove(path);
+            return false;
+        }
+
+        entry->data = file.readAll();
+    }
+
+    data = entry->data;
+    // Too large for the cache and it is not kept; served all the same
+    m_Entries.insert(path, entry, qMax(entry->data.size(), 1));
+    return true;
+}
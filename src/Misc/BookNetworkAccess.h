@@ -0,0 +1,107 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef BOOKNETWORKACCESS_H
+#define BOOKNETWORKACCESS_H
+
+#include <QtCore/QCache>
+#include <QtCore/QList>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QWeakPointer>
+#include <QtNetwork/QNetworkAccessManager>
+
+class Book;
+class Resource;
+
+/**
+ * Serves the files of the open books to the web views from memory.
+ *
+ * The views load their pages with file:// URLs into the book folders.
+ * Requests for a file that is a resource of an open book are answered
+ * here rather than from disk: text files with the text as it is in
+ * memory, so unsaved edits show without a save, and everything else
+ * with the bytes of the file, read once. Both are cached with the
+ * revision they are from, the text revision for text files and the
+ * modification time and size for the rest, and served again until that
+ * changes. Requests for anything else go to the disk as usual.
+ *
+ * One instance is shared by every web view, Book View and Preview
+ * alike, so a file is read once for all of them.
+ */
+class BookNetworkAccess : public QNetworkAccessManager
+{
+    Q_OBJECT
+
+public:
+    static BookNetworkAccess *instance();
+
+    /**
+     * Serves the resources of book too, for as long as it lives.
+     */
+    void AddBook(QSharedPointer<Book> book);
+
+    /**
+     * @return The size of the file contents held in memory, in bytes.
+     */
+    qint64 MemoryUsage() const;
+
+    /**
+     * Drops the file contents held in memory.
+     */
+    void ClearCache();
+
+protected:
+    virtual QNetworkReply *createRequest(Operation operation, const QNetworkRequest &request,
+                                         QIODevice *outgoing_data = 0);
+
+private:
+    BookNetworkAccess();
+
+    struct Entry {
+        QString revision;
+        QByteArray data;
+    };
+
+    /**
+     * @return The resource of an open book at path, or NULL.
+     */
+    Resource *FindResource(const QString &path);
+
+    /**
+     * Gets the current content of resource, from the cache if
+     * it has not changed since it was put there.
+     *
+     * @return false if the file could not be read.
+     */
+    bool ContentOf(Resource *resource, QByteArray &data);
+
+    /**
+     * Keyed by full path, with the size in bytes of each entry as its cost.
+     */
+    QCache<QString, Entry> m_Entries;
+
+    QList<QWeakPointer<Book> > m_Books;
+
+    static BookNetworkAccess *m_instance;
+};
+
+#endif // BOOKNETWORKACCESS_H
@@ -19,65 +19,52 @@
 **
 *************************************************************************/
 
+#include <QtGui/QTextBlock>
+
 #include "Misc/CSSHighlighter.h"
+#include "Misc/CSSTokenizer.h"
 #include "Misc/SettingsStore.h"
 
-// TODO: This code was written by Nokia for Qt Designer, and it's horribly ugly.
-// I've tried to clean it up, but it's hopeless. Write a new CSS parser to replace this.
-
-enum State {
-    Selector,
-    Property,
-    Value,
-    Pseudo,
-    Pseudo1,
-    Pseudo2,
-    Quote,
-    MaybeComment,
-    Comment,
-    MaybeCommentEnd
-};
-
-enum Token {
-    ALNUM,
-    LBRACE,
-    RBRACE,
-    COLON,
-    SEMICOLON,
-    COMMA,
-    QUOTE,
-    SLASH,
-    STAR
-};
-
-// Transitions for the DFA
-static const int transitions[ 10 ][ 9 ] = {
-    { Selector, Property, Selector, Pseudo,  Property, Selector, Quote,   MaybeComment, Selector        }, // Selector
-    { Property, Property, Selector, Value,   Property, Property, Quote,   MaybeComment, Property        }, // Property
-    { Value,    Property, Selector, Value,   Property, Value,    Quote,   MaybeComment, Value           }, // Value
-    { Pseudo1,  Property, Selector, Pseudo2, Selector, Selector, Quote,   MaybeComment, Pseudo          }, // Pseudo
-    { Pseudo1,  Property, Selector, Pseudo,  Selector, Selector, Quote,   MaybeComment, Pseudo1         }, // Pseudo1
-    { Pseudo2,  Property, Selector, Pseudo,  Selector, Selector, Quote,   MaybeComment, Pseudo2         }, // Pseudo2
-    { Quote,    Quote,    Quote,    Quote,   Quote,    Quote,    -1,      Quote,        Quote           }, // Quote
-    { -1,       -1,       -1,       -1,     -1,        -1,       -1,      -1,           Comment         }, // MaybeComment
-    { Comment,  Comment,  Comment,  Comment, Comment,  Comment,  Comment, Comment,      MaybeCommentEnd }, // Comment
-    { Comment,  Comment,  Comment,  Comment, Comment,  Comment,  Comment, -1,           MaybeCommentEnd }  // MaybeCommentEnd
-};
+// Where in a rule a line ends, in the low bits of the block state
+static const int CONTEXT_MASK = 0x3;
+static const int CONTEXT_SELECTOR = 0;
+static const int CONTEXT_PROPERTY = 1;
+static const int CONTEXT_VALUE = 2;
+
+// Inside a comment that is not closed yet
+static const int IN_COMMENT = 0x4;
+
+// After an at-keyword, up to the ; or { that ends its prelude
+static const int IN_AT_RULE = 0x8;
+
+// The at-rule's block holds rules rather than declarations
+static const int GROUP_RULE = 0x10;
+
+static bool IsGroupRule(const QStringRef &name)
+{
+    return name.compare(QLatin1String("media"), Qt::CaseInsensitive) == 0 ||
+           name.compare(QLatin1String("supports"), Qt::CaseInsensitive) == 0 ||
+           name.compare(QLatin1String("document"), Qt::CaseInsensitive) == 0 ||
+           name.compare(QLatin1String("-moz-document"), Qt::CaseInsensitive) == 0;
+}
 
 
 CSSHighlighter::CSSHighlighter(QObject *parent)
     : QSyntaxHighlighter(parent)
 {
     SettingsStore settings;
-    m_codeViewAppearance = settings.codeViewAppearance();
+    SettingsStore::CodeViewAppearance appearance = settings.codeViewAppearance();
+    m_Colors[Span_Selector] = appearance.css_selector_color;
+    m_Colors[Span_Property] = appearance.css_property_color;
+    m_Colors[Span_Value] = appearance.css_value_color;
+    m_Colors[Span_Quote] = appearance.css_quote_color;
+    m_Colors[Span_Comment] = appearance.css_comment_color;
 }
 
+
 void CSSHighlighter::highlightBlock(const QString &text)
 {
-    int lastIndex = 0;
-    bool lastWasSlash = false;
     int state = previousBlockState();
-    int save_state = 0;
 
     if (state == -1) {
         // As long as the text is empty, leave the state undetermined
@@ -89,115 +76,161 @@ void CSSHighlighter::highlightBlock(const QString &text)
         // The initial state is based on the presence of a ":" and the absence of a "{".
         // This is because Qt style sheets support both a full stylesheet as well as
         // an inline form with just properties.
-        state = save_state = (text.indexOf(QLatin1Char(':')) > -1 &&
-                              text.indexOf(QLatin1Char('{')) == -1) ? Property : Selector;
-    } else {
-        save_state = state >> 16;
-        state &= 0x00ff;
+        state = (text.indexOf(QLatin1Char(':')) > -1 &&
+                 text.indexOf(QLatin1Char('{')) == -1) ? CONTEXT_PROPERTY : CONTEXT_SELECTOR;
     }
 
-    if (state == MaybeCommentEnd) {
-        state = Comment;
-    } else if (state == MaybeComment) {
-        state = save_state;
+    QTextBlock block = currentBlock();
+    BlockData *data = dynamic_cast<BlockData *>(block.userData());
+
+    // Nothing about the line changed since it was last lexed
+    if (data && data->revision == block.revision() && data->start_state == state) {
+        ApplySpans(data->spans);
+        setCurrentBlockState(data->end_state);
+        return;
     }
 
-    for (int i = 0; i < text.length(); i++) {
-        int token = ALNUM;
-        const char character = text.at(i).toLatin1();
+    if (!data) {
+        data = new BlockData();
+        // Takes ownership, and deletes any data of another kind
+        setCurrentBlockUserData(data);
+    }
 
-        if (state == Quote) {
-            if (character == '\\') {
-                lastWasSlash = true;
-            } else {
-                if (character == '\"' && !lastWasSlash) {
-                    token = QUOTE;
-                }
+    data->revision = block.revision();
+    data->start_state = state;
+    data->spans.clear();
+    data->end_state = LexLine(text, state, data->spans);
+    ApplySpans(data->spans);
+    setCurrentBlockState(data->end_state);
+}
 
-                lastWasSlash = false;
-            }
-        } else {
-            token = character == '{'  ? LBRACE    :
-                    character == '}'  ? RBRACE    :
-                    character == ':'  ? COLON     :
-                    character == ';'  ? SEMICOLON :
-                    character == ','  ? COMMA     :
-                    character == '\"' ? QUOTE     :
-                    character == '/'  ? SLASH     :
-                    character == '*'  ? STAR      :
-                    ALNUM;
-        }
 
-        int new_state = transitions[ state ][ token ];
+int CSSHighlighter::LexLine(const QString &text, int state, QVector<Span> &spans) const
+{
+    int pos = 0;
 
-        if (new_state != state) {
-            bool include_token = new_state == MaybeCommentEnd ||
-                                 (state == MaybeCommentEnd && new_state != Comment) ||
-                                 state == Quote;
-            highlight(text, lastIndex, i - lastIndex + include_token, state);
+    if (state & IN_COMMENT) {
+        int close = text.indexOf(QLatin1String("*/"));
 
-            if (new_state == Comment) {
-                lastIndex = i - 1;    // include the slash and star
-            } else {
-                lastIndex = i + ((token == ALNUM || new_state == Quote) ? 0 : 1);
-            }
+        if (close == -1) {
+            AddSpan(spans, 0, text.length(), Span_Comment);
+            return state;
         }
 
-        if (new_state == -1) {
-            state = save_state;
-        } else if (state <= Pseudo2) {
-            save_state = state;
-            state = new_state;
-        } else {
-            state = new_state;
-        }
+        pos = close + 2;
+        AddSpan(spans, 0, pos, Span_Comment);
+        state &= ~IN_COMMENT;
     }
 
-    highlight(text, lastIndex, text.length() - lastIndex, state);
-    setCurrentBlockState(state + (save_state << 16));
-}
+    CSSTokenizer tokenizer(text, pos);
 
+    while (!tokenizer.AtEnd()) {
+        CSSTokenizer::Token token = tokenizer.Next();
+        int context = state & CONTEXT_MASK;
+        int kind = context == CONTEXT_SELECTOR ? Span_Selector :
+                   context == CONTEXT_PROPERTY ? Span_Property : Span_Value;
 
-void CSSHighlighter::highlight(const QString &text, int start, int length, int state)
-{
-    if (start >= text.length() || length <= 0) {
-        return;
-    }
+        switch (token.type) {
+            case CSSTokenizer::Whitespace:
+                continue;
+
+            case CSSTokenizer::Comment:
+                AddSpan(spans, token.start, token.length, Span_Comment);
+
+                // An unclosed comment runs to the end of the line
+                if (token.length < 4 || text.midRef(token.end() - 2, 2) != QLatin1String("*/")) {
+                    state |= IN_COMMENT;
+                }
+
+                continue;
 
-    QTextCharFormat format;
+            case CSSTokenizer::String:
+                AddSpan(spans, token.start, token.length, Span_Quote);
+                continue;
 
-    switch (state) {
-        case Selector:
-            setFormat(start, length, m_codeViewAppearance.css_selector_color);
-            break;
+            case CSSTokenizer::AtKeyword:
+                if (context == CONTEXT_SELECTOR) {
+                    state |= IN_AT_RULE;
 
-        case Property:
-            setFormat(start, length, m_codeViewAppearance.css_property_color);
-            break;
+                    if (IsGroupRule(tokenizer.Value(token))) {
+                        state |= GROUP_RULE;
+                    }
+                }
+
+                break;
+
+            case CSSTokenizer::Colon:
+                if (context == CONTEXT_PROPERTY) {
+                    state = (state & ~CONTEXT_MASK) | CONTEXT_VALUE;
+                }
+
+                break;
+
+            case CSSTokenizer::Semicolon:
+                if (context == CONTEXT_SELECTOR) {
+                    // The end of an @import or @charset, or a bare
+                    // declaration of an inline style
+                    if (!(state & IN_AT_RULE)) {
+                        state = (state & ~CONTEXT_MASK) | CONTEXT_PROPERTY;
+                    }
+                } else {
+                    state = (state & ~CONTEXT_MASK) | CONTEXT_PROPERTY;
+                }
+
+                state &= ~(IN_AT_RULE | GROUP_RULE);
+                break;
+
+            case CSSTokenizer::LeftBrace:
+                // The block of @media holds rules, any other declarations
+                if (!(context == CONTEXT_SELECTOR && (state & GROUP_RULE))) {
+                    state = (state & ~CONTEXT_MASK) | CONTEXT_PROPERTY;
+                }
+
+                state &= ~(IN_AT_RULE | GROUP_RULE);
+                break;
+
+            case CSSTokenizer::RightBrace:
+                state = (state & ~CONTEXT_MASK) | CONTEXT_SELECTOR;
+                state &= ~(IN_AT_RULE | GROUP_RULE);
+                break;
+
+            default:
+                break;
+        }
+
+        // In the colour of the part of the rule it was found in,
+        // so punctuation takes the colour of what it ends
+        AddSpan(spans, token.start, token.length, kind);
+    }
 
-        case Value:
-            setFormat(start, length, m_codeViewAppearance.css_value_color);
-            break;
+    return state;
+}
 
-        case Pseudo1:
-            setFormat(start, length, m_codeViewAppearance.css_selector_color);
-            break;
 
-        case Pseudo2:
-            setFormat(start, length, m_codeViewAppearance.css_selector_color);
-            break;
+void CSSHighlighter::ApplySpans(const QVector<Span> &spans)
+{
+    foreach(const Span &span, spans) {
+        setFormat(span.start, span.length, m_Colors[span.kind]);
+    }
+}
 
-        case Quote:
-            setFormat(start, length, m_codeViewAppearance.css_quote_color);
-            break;
 
-        case Comment:
-        case MaybeCommentEnd:
-            format.setForeground(m_codeViewAppearance.css_comment_color);
-            setFormat(start, length, format);
-            break;
+void CSSHighlighter::AddSpan(QVector<Span> &spans, int start, int length, int kind)
+{
+    if (length <= 0) {
+        return;
+    }
 
-        default:
-            break;
+    // Neighbouring tokens of a kind share one setFormat
+    if (!spans.isEmpty() && spans.last().kind == kind &&
+        spans.last().start + spans.last().length == start) {
+        spans.last().length += length;
+        return;
     }
+
+    Span span;
+    span.start = start;
+    span.length = length;
+    span.kind = kind;
+    spans.append(span);
 }
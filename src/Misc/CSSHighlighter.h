@@ -22,10 +22,23 @@
 #ifndef CSSHIGHLIGHTER_H
 #define CSSHIGHLIGHTER_H
 
+#include <QtCore/QVector>
 #include <QtGui/QSyntaxHighlighter>
+#include <QtGui/QTextBlockUserData>
 
 #include "Misc/SettingsStore.h"
 
+/**
+ * Highlights stylesheets a line at a time with the tokens of
+ * CSSTokenizer, the same lexer the stylesheet rewriting code uses.
+ *
+ * The state a line ends in is only where in a rule it is (selector,
+ * property or value) and whether it is inside a comment, so an edit
+ * stops changing the lines after it as soon as one of them ends the
+ * way it did before. The formats worked out for a line are kept with
+ * it and reused for as long as neither its text nor the state it
+ * starts in change, e.g. when the whole document is rehighlighted.
+ */
 class CSSHighlighter : public QSyntaxHighlighter
 {
 
@@ -36,11 +49,46 @@ public:
 protected:
 
     void highlightBlock(const QString &text);
-    void highlight(const QString &, int start, int length, int state);
 
 private:
 
-    SettingsStore::CodeViewAppearance m_codeViewAppearance;
+    enum SpanKind {
+        Span_Selector = 0,
+        Span_Property,
+        Span_Value,
+        Span_Quote,
+        Span_Comment
+    };
+
+    struct Span {
+        int start;
+        int length;
+        int kind;
+    };
+
+    /**
+     * What was worked out for a block the last time it was lexed.
+     */
+    class BlockData : public QTextBlockUserData
+    {
+    public:
+        int revision;
+        int start_state;
+        int end_state;
+        QVector<Span> spans;
+    };
+
+    /**
+     * Splits the line into spans; state is the state the previous line
+     * ended in, the state this line ends in is returned.
+     */
+    int LexLine(const QString &text, int state, QVector<Span> &spans) const;
+
+    void ApplySpans(const QVector<Span> &spans);
+
+    static void AddSpan(QVector<Span> &spans, int start, int length, int kind);
+
+    QColor m_Colors[Span_Comment + 1];
 };
 
 #endif // CSSHIGHLIGHTER_H
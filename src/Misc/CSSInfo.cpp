@@ -27,10 +27,10 @@
 #include <QRegularExpression>
 #include "Misc/Utility.h"
 #include "Misc/CSSInfo.h"
+#include "Misc/CSSTokenizer.h"
 
 const int TAB_SPACES_WIDTH = 4;
 const QString LINE_MARKER("[SIGIL_NEWLINE]");
-static const QString DELIMITERS = "}{;";
 
 
 // Note: CSSProperties and CSSSelectors are simple struct that this code
@@ -55,6 +55,8 @@ CSSInfo::CSSInfo(const QString &text, bool isCSSFile)
             offset = style_end;
         }
     }
+
+    indexCSSSelectors();
 }
 
 // Need to manually clean up the Selector List
@@ -68,12 +70,14 @@ CSSInfo::~CSSInfo()
 
 QList<CSSInfo::CSSSelector *> CSSInfo::getClassSelectors(const QString filterClassName)
 {
+    if (!filterClassName.isEmpty()) {
+        return m_ClassIndex.value(filterClassName);
+    }
+
     QList<CSSInfo::CSSSelector *> selectors;
     foreach(CSSInfo::CSSSelector * cssSelector, m_CSSSelectors) {
         if (cssSelector->classNames.count() > 0) {
-            if (filterClassName.isEmpty() || cssSelector->classNames.contains(filterClassName)) {
-                selectors.append(cssSelector);
-            }
+            selectors.append(cssSelector);
         }
     }
     return selectors;
@@ -83,11 +87,11 @@ CSSInfo::CSSSelector *CSSInfo::getCSSSelectorForElementClass(const QString &elem
 {
     if (!className.isEmpty()) {
         // Find the selector(s) if any with this class name
-        QList<CSSInfo::CSSSelector *> class_selectors = getClassSelectors(className);
+        QHash<QString, QList<CSSSelector *> >::const_iterator it = m_ClassIndex.constFind(className);
 
-        if (class_selectors.count() > 0) {
+        if (it != m_ClassIndex.constEnd()) {
             // First look for match on element and class
-            foreach(CSSInfo::CSSSelector * cssSelector, class_selectors) {
+            foreach(CSSInfo::CSSSelector * cssSelector, it.value()) {
                 // Always match on wildcard class selector
                 if (cssSelector->elementNames.isEmpty()) {
                     return cssSelector;
@@ -102,12 +106,11 @@ CSSInfo::CSSSelector *CSSInfo::getCSSSelectorForElementClass(const QString &elem
             }
         }
     } else {
-
         // try match on element name alone
-        foreach(CSSInfo::CSSSelector * cssSelector, m_CSSSelectors) {
-            if (cssSelector->elementNames.contains(elementName) && cssSelector->classNames.isEmpty()) {
-                return cssSelector;
-            }
+        QHash<QString, QList<CSSSelector *> >::const_iterator it = m_ElementIndex.constFind(elementName);
+
+        if (it != m_ElementIndex.constEnd()) {
+            return it.value().first();
         }
     }
     return NULL;
@@ -118,11 +121,11 @@ QList<CSSInfo::CSSSelector *> CSSInfo::getAllCSSSelectorsForElementClass(const Q
     QList<CSSInfo::CSSSelector *> matches;
     if (!className.isEmpty()) {
         // Find the selector(s) if any with this class name
-        QList<CSSInfo::CSSSelector *> class_selectors = getClassSelectors(className);
+        QHash<QString, QList<CSSSelector *> >::const_iterator it = m_ClassIndex.constFind(className);
 
-        if (class_selectors.count() > 0) {
+        if (it != m_ClassIndex.constEnd()) {
             // First look for match on element and class
-            foreach(CSSInfo::CSSSelector * cssSelector, class_selectors) {
+            foreach(CSSInfo::CSSSelector * cssSelector, it.value()) {
                 // Always match on wildcard class selector
                 if (cssSelector->elementNames.isEmpty()) {
                     matches.append(cssSelector);;
@@ -138,11 +141,7 @@ QList<CSSInfo::CSSSelector *> CSSInfo::getAllCSSSelectorsForElementClass(const Q
         }
     } else {
         // try match on element name alone
-        foreach(CSSInfo::CSSSelector * cssSelector, m_CSSSelectors) {
-            if (cssSelector->elementNames.contains(elementName) && cssSelector->classNames.isEmpty()) {
-                matches.append(cssSelector);
-            }
-        }
+        matches = m_ElementIndex.value(elementName);
     }
     return matches;
 }
@@ -300,14 +299,20 @@ QString CSSInfo::getReformattedCSSText(bool multipleLineFormat)
 QString CSSInfo::removeMatchingSelectors(QList<CSSSelector *> cssSelectors)
 {
     // First try to find a CSS selector currently parsed that matches each of the selectors supplied.
+    // The parsed selectors are looked up by line, the first of each line first.
+    QMultiHash<int, CSSSelector *> selectors_by_line;
+    for (int i = m_CSSSelectors.count() - 1; i >= 0; i--) {
+        selectors_by_line.insert(m_CSSSelectors.at(i)->line, m_CSSSelectors.at(i));
+    }
     QList<CSSSelector *> remove_selectors;
     foreach(CSSSelector * css_selector, cssSelectors) {
-        foreach(CSSSelector * match_selector, m_CSSSelectors) {
-            if ((match_selector->line == css_selector->line) &&
-                (match_selector->groupText == css_selector->groupText)) {
-                remove_selectors.append(match_selector);
+        QMultiHash<int, CSSSelector *>::const_iterator it = selectors_by_line.constFind(css_selector->line);
+        while (it != selectors_by_line.constEnd() && it.key() == css_selector->line) {
+            if (it.value()->groupText == css_selector->groupText) {
+                remove_selectors.append(it.value());
                 break;
             }
+            ++it;
         }
     }
 
@@ -465,72 +470,82 @@ void CSSInfo::parseCSSSelectors(const QString &text, const int &offsetLines, con
     QRegularExpression strip_ids_regex("#[^\\s\\.]+");
     // QRegularExpression strip_non_name_chars_regex("[^A-Za-z0-9_\\-\\.:]+");
     QRegularExpression strip_non_name_chars_regex("[^\\w_\\-\\.:]+", QRegularExpression::UseUnicodePropertiesOption);
-    QString search_text = replaceBlockComments(text);
     // CSS selectors can be in a myriad of formats... the class based selectors could be:
     //    .c1 / e1.c1 / e1.c1.c2 / e1[class~=c1] / e1#id1.c1 / e1.c1#id1 / .c1, .c2 / ...
     // Then the element based selectors could be:
     //    e1 / e1 > e2 / e1 e2 / e1 + e2 / e1[attribs...] / e1#id1 / e1, e2 / ...
     // Really needs a parser to do this properly, this will only handle the 90% scenarios.
 
+    // One pass of the tokenizer: the text since the last delimiter is the
+    // selector of the next block. Comments and strings can not end it.
     // Note: selector groups can be sepaparated by line feeds so you can not stop
     // at the beginning of line when searching for the start of a selector
-
-    int pos = 0;
-    int open_brace_pos = -1;
-    int close_brace_pos = -1;
-
-    while (true) {
-        open_brace_pos = search_text.indexOf(QChar('{'), pos);
-
-        if (open_brace_pos < 0) {
-            break;
+    CSSTokenizer tokenizer(text);
+    int lines = 0;
+    int pos = -1;
+    int line = 0;
+    // The selectors whose block has not been closed yet
+    QList<CSSSelector *> open_selectors;
+
+    while (!tokenizer.AtEnd()) {
+        CSSTokenizer::Token token = tokenizer.Next();
+
+        switch (token.type) {
+            case CSSTokenizer::Whitespace:
+            case CSSTokenizer::Comment:
+                lines += text.midRef(token.start, token.length).count(QChar('\n'));
+                continue;
+            case CSSTokenizer::Semicolon:
+                pos = -1;
+                continue;
+            case CSSTokenizer::RightBrace:
+                foreach(CSSSelector * selector, open_selectors) {
+                    selector->closingBracePos = token.start + offsetPos;
+                    m_CSSSelectors.append(selector);
+                }
+                open_selectors.clear();
+                pos = -1;
+                continue;
+            case CSSTokenizer::LeftBrace:
+                break;
+            default:
+                if (pos == -1) {
+                    pos = token.start;
+                    line = lines + 1;
+                }
+                lines += text.midRef(token.start, token.length).count(QChar('\n'));
+                continue;
         }
 
-        // Now search backwards until we get a line (or more)  containing text .
-        bool have_text = false;
-        pos = open_brace_pos - 1;
+        int open_brace_pos = token.start;
+        QString selector_text = pos == -1 ? QString() : text.mid(pos, open_brace_pos - pos);
+        int selector_pos = pos;
+        pos = -1;
 
-        while ((pos >= 0) && (!DELIMITERS.contains(search_text.at(pos)) || !have_text)) {
-            if (search_text.at(pos).isLetter()) {
+        // Really badly formed CSS document - skip ahead
+        bool have_text = false;
+        foreach(QChar c, selector_text) {
+            if (c.isLetter()) {
                 have_text = true;
+                break;
             }
-
-            pos--;
         }
-
-        pos++;
-
         if (!have_text) {
-            // Really badly formed CSS document - try to skip ahead
-            pos = open_brace_pos + 1;
             continue;
         }
 
-        close_brace_pos = search_text.indexOf(QChar('}'), open_brace_pos + 1);
-
-        if (close_brace_pos < 0) {
-            // Another badly formed scenario - no point in looking further
-            break;
-        }
-
-        // Skip past leading whitespace/newline.
-        while (search_text.at(pos).isSpace()) {
-            pos++;
-        }
-
-        int line = search_text.left(pos + 1).count(QChar('\n')) + 1;
-        QString selector_text = search_text.mid(pos, open_brace_pos - pos).trimmed();
+        selector_text = replaceBlockComments(selector_text).trimmed();
         // Handle case of a selector group containing multiple declarations
         QStringList matches = selector_text.split(QChar(','), QString::SkipEmptyParts);
         foreach(QString match, matches) {
             CSSSelector *selector = new CSSSelector();
             selector->originalText = selector_text;
             selector->groupText = match.trimmed();
-            selector->position = pos + offsetPos;
+            selector->position = selector_pos + offsetPos;
             selector->line = line + offsetLines;
             selector->isGroup = matches.length() > 1;
             selector->openingBracePos = open_brace_pos + offsetPos;
-            selector->closingBracePos = close_brace_pos + offsetPos;
+            selector->closingBracePos = -1;
             // Need to parse our selector text to determine what sort of selector it contains.
             // First strip out any attributes and then identifiers
             match.replace(strip_attributes_regex, "");
@@ -554,46 +569,42 @@ void CSSInfo::parseCSSSelectors(const QString &text, const int &offsetLines, con
                     selector->elementNames.append(element);
                 }
             }
-            m_CSSSelectors.append(selector);
+            open_selectors.append(selector);
         }
-        pos = open_brace_pos + 1;
+    }
+
+    // Another badly formed scenario - a block that is never closed
+    foreach(CSSSelector * selector, open_selectors) {
+        delete selector;
     }
 }
 
-QString CSSInfo::replaceBlockComments(const QString &text)
+void CSSInfo::indexCSSSelectors()
 {
-    // We take a copy of the text and remove all block comments from it.
-    // However we must be careful to replace with spaces/keep line feeds
-    // so that do not corrupt the position information used by the parser.
-    QString new_text(text);
-    QRegularExpression comment_search("/\\*.*\\*/", QRegularExpression::InvertedGreedinessOption|QRegularExpression::DotMatchesEverythingOption);
-    int start = 0;
-    int comment_index;
-
-    while (true) {
-        int comment_len = 0;
-        comment_index = -1;
-        QRegularExpressionMatch match = comment_search.match(new_text, start);
-        if (match.hasMatch()) {
-            comment_index = match.capturedStart();
-            comment_len = match.capturedLength();
-        }
-
-        if (comment_index < 0) {
-            break;
+    foreach(CSSSelector * selector, m_CSSSelectors) {
+        foreach(QString class_name, selector->classNames) {
+            QList<CSSSelector *> &selectors = m_ClassIndex[class_name];
+            // e.g. .c1.c1 is indexed once
+            if (selectors.isEmpty() || selectors.last() != selector) {
+                selectors.append(selector);
+            }
         }
 
-        QString match_text = new_text.mid(comment_index, comment_len);
-        match_text.replace(QRegularExpression("[^\r\n]"), QChar(' '));
-        new_text.remove(comment_index, match_text.length());
-        new_text.insert(comment_index, match_text);
-        // Prepare for the next comment.
-        start = comment_index + comment_len;
-
-        if (start >= new_text.length() - 2) {
-            break;
+        if (selector->classNames.isEmpty()) {
+            foreach(QString element_name, selector->elementNames) {
+                QList<CSSSelector *> &selectors = m_ElementIndex[element_name];
+                if (selectors.isEmpty() || selectors.last() != selector) {
+                    selectors.append(selector);
+                }
+            }
         }
     }
+}
 
-    return new_text;
+QString CSSInfo::replaceBlockComments(const QString &text)
+{
+    // We take a copy of the text and remove all block comments from it.
+    // However we must be careful to replace with spaces/keep line feeds
+    // so that do not corrupt the position information used by the parser.
+    return CSSTokenizer::BlankComments(text);
 }
@@ -26,6 +26,7 @@
 #ifndef CSSINFO_H
 #define CSSINFO_H
 
+#include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 
@@ -110,9 +111,25 @@ public:
 private:
     bool findInlineStyleBlock(const QString &text, const int &offset, int &styleStart, int &styleEnd);
     void parseCSSSelectors(const QString &text, const int &offsetLines, const int &offsetPos);
+
+    /**
+     * Fills the class and element indexes from m_CSSSelectors.
+     */
+    void indexCSSSelectors();
     QString replaceBlockComments(const QString &text);
 
     QList<CSSSelector *> m_CSSSelectors;
+
+    /**
+     * The selectors with each class name, in the order of the text.
+     */
+    QHash<QString, QList<CSSSelector *> > m_ClassIndex;
+
+    /**
+     * The selectors without a class with each element name,
+     * in the order of the text.
+     */
+    QHash<QString, QList<CSSSelector *> > m_ElementIndex;
     QString m_OriginalText;
     bool m_IsCSSFile;
 };
@@ -0,0 +1,210 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include "Misc/CSSTokenizer.h"
+
+CSSTokenizer::CSSTokenizer(const QString &text, int start)
+    :
+    m_Text(text),
+    m_Pos(start)
+{
+}
+
+
+bool CSSTokenizer::AtEnd() const
+{
+    return m_Pos >= m_Text.length();
+}
+
+
+QStringRef CSSTokenizer::Value(const Token &token) const
+{
+    return m_Text.midRef(token.valueStart, token.valueLength);
+}
+
+
+CSSTokenizer::Token CSSTokenizer::Next()
+{
+    Token token;
+    token.start = m_Pos;
+    token.valueStart = m_Pos;
+    token.valueLength = 0;
+    int len = m_Text.length();
+
+    if (m_Pos >= len) {
+        token.type = EndOfInput;
+        token.length = 0;
+        return token;
+    }
+
+    QChar c = m_Text.at(m_Pos);
+
+    if (c.isSpace()) {
+        token.type = Whitespace;
+        while (m_Pos < len && m_Text.at(m_Pos).isSpace()) {
+            ++m_Pos;
+        }
+    } else if (c == '/' && m_Pos + 1 < len && m_Text.at(m_Pos + 1) == '*') {
+        token.type = Comment;
+        int close = m_Text.indexOf("*/", m_Pos + 2);
+        // An unterminated comment runs to the end of the text
+        m_Pos = close == -1 ? len : close + 2;
+    } else if (c == '"' || c == '\'') {
+        token.type = String;
+        ++m_Pos;
+        token.valueStart = m_Pos;
+        ScanString(c);
+        token.valueLength = m_Pos - token.valueStart;
+        if (m_Pos < len && m_Text.at(m_Pos) == c) {
+            ++m_Pos;
+        }
+    } else if (c == '@' && IsNameChar(m_Pos + 1)) {
+        token.type = AtKeyword;
+        ++m_Pos;
+        token.valueStart = m_Pos;
+        while (IsNameChar(m_Pos)) {
+            m_Pos += m_Text.at(m_Pos) == '\\' ? 2 : 1;
+        }
+        token.valueLength = qMin(m_Pos, len) - token.valueStart;
+    } else if (IsNameChar(m_Pos)) {
+        token.type = Name;
+        while (IsNameChar(m_Pos)) {
+            m_Pos += m_Text.at(m_Pos) == '\\' ? 2 : 1;
+        }
+        m_Pos = qMin(m_Pos, len);
+        token.valueLength = m_Pos - token.valueStart;
+        if (m_Pos < len && m_Text.at(m_Pos) == '(' && token.valueLength == 3 &&
+            m_Text.midRef(token.start, 3).compare(QLatin1String("url"), Qt::CaseInsensitive) == 0) {
+            ScanUrl(token);
+        }
+    } else {
+        switch (c.unicode()) {
+            case ':':
+                token.type = Colon;
+                break;
+            case ';':
+                token.type = Semicolon;
+                break;
+            case '{':
+                token.type = LeftBrace;
+                break;
+            case '}':
+                token.type = RightBrace;
+                break;
+            default:
+                token.type = Delim;
+                break;
+        }
+        ++m_Pos;
+    }
+
+    token.length = m_Pos - token.start;
+    return token;
+}
+
+
+QString CSSTokenizer::BlankComments(const QString &text)
+{
+    QString new_text(text);
+    CSSTokenizer tokenizer(text);
+
+    while (!tokenizer.AtEnd()) {
+        Token token = tokenizer.Next();
+        if (token.type != Comment) {
+            continue;
+        }
+        for (int i = token.start; i < token.end(); ++i) {
+            QChar c = new_text.at(i);
+            if (c != '\r' && c != '\n') {
+                new_text[i] = ' ';
+            }
+        }
+    }
+
+    return new_text;
+}
+
+
+// Leaves m_Pos on the closing quote, or where the string was cut short
+// by a line feed or the end of the text.
+void CSSTokenizer::ScanString(QChar quote)
+{
+    int len = m_Text.length();
+
+    while (m_Pos < len) {
+        QChar c = m_Text.at(m_Pos);
+        if (c == quote || c == '\n') {
+            return;
+        }
+        m_Pos += c == '\\' ? 2 : 1;
+    }
+
+    m_Pos = len;
+}
+
+
+// Called with m_Pos on the ( after url. Consumes through the closing )
+// and sets the value to the path, without quotes and surrounding space.
+void CSSTokenizer::ScanUrl(Token &token)
+{
+    int len = m_Text.length();
+    token.type = Url;
+    ++m_Pos;
+
+    while (m_Pos < len && m_Text.at(m_Pos).isSpace()) {
+        ++m_Pos;
+    }
+
+    if (m_Pos < len && (m_Text.at(m_Pos) == '"' || m_Text.at(m_Pos) == '\'')) {
+        QChar quote = m_Text.at(m_Pos);
+        ++m_Pos;
+        token.valueStart = m_Pos;
+        ScanString(quote);
+        token.valueLength = m_Pos - token.valueStart;
+    } else {
+        token.valueStart = m_Pos;
+        while (m_Pos < len && m_Text.at(m_Pos) != ')' && !m_Text.at(m_Pos).isSpace()) {
+            m_Pos += m_Text.at(m_Pos) == '\\' ? 2 : 1;
+        }
+        m_Pos = qMin(m_Pos, len);
+        token.valueLength = m_Pos - token.valueStart;
+    }
+
+    int close = m_Text.indexOf(')', m_Pos);
+    m_Pos = close == -1 ? len : close + 1;
+}
+
+
+bool CSSTokenizer::IsNameChar(int pos) const
+{
+    if (pos >= m_Text.length()) {
+        return false;
+    }
+
+    QChar c = m_Text.at(pos);
+    // A . belongs to a name only as the decimal point of a number
+    if (c == '.') {
+        return pos + 1 < m_Text.length() && m_Text.at(pos + 1).isDigit();
+    }
+
+    return c.isLetterOrNumber() || c == '-' || c == '_' || c == '\\' || c.unicode() > 0x7f;
+}
@@ -0,0 +1,103 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef CSSTOKENIZER_H
+#define CSSTOKENIZER_H
+
+#include <QtCore/QString>
+
+/**
+ * A small streaming tokenizer for CSS.
+ *
+ * It makes one linear pass over the text and hands out tokens as
+ * offsets into it, so nothing is copied. It only knows as much of
+ * the CSS grammar as the code that rewrites and inspects stylesheets
+ * needs: comments, strings, url()s, at-keywords, names and the
+ * punctuation that ends declarations and blocks.
+ */
+class CSSTokenizer
+{
+public:
+
+    enum TokenType {
+        EndOfInput = 0,
+        Whitespace,
+        Comment,      // including the /* and */
+        String,       // value is the text between the quotes
+        Url,          // url(...); value is the path, without quotes
+        AtKeyword,    // value is the name without the @
+        Name,         // identifiers, numbers and dimensions
+        Colon,
+        Semicolon,
+        LeftBrace,
+        RightBrace,
+        Delim         // any other single character
+    };
+
+    struct Token {
+        TokenType type;
+        int start;
+        int length;
+        int valueStart;
+        int valueLength;
+
+        int end() const {
+            return start + length;
+        }
+    };
+
+    CSSTokenizer(const QString &text, int start = 0);
+
+    /**
+     * @return The next token; EndOfInput once the text is used up.
+     */
+    Token Next();
+
+    bool AtEnd() const;
+
+    /**
+     * @return The value of a token, e.g. the text of a string
+     *         without its quotes.
+     */
+    QStringRef Value(const Token &token) const;
+
+    /**
+     * @return A copy of text with every comment blanked out by spaces.
+     *         Line feeds are kept so positions and lines do not move.
+     */
+    static QString BlankComments(const QString &text);
+
+private:
+
+    void ScanString(QChar quote);
+
+    void ScanUrl(Token &token);
+
+    bool IsNameChar(int pos) const;
+
+    const QString &m_Text;
+
+    int m_Pos;
+};
+
+#endif // CSSTOKENIZER_H
@@ -0,0 +1,251 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QFileInfo>
+#include <QtCore/QFileSystemWatcher>
+#include <QtConcurrent/QtConcurrent>
+
+#include "Misc/DirectoryWatcher.h"
+#include "Misc/TaskScheduler.h"
+
+// How long events are collected before the files are checked
+static const int QUIET_PERIOD_MS = 250;
+
+// A file missing for this many rounds is taken as deleted
+static const int MAX_MISSING_ROUNDS = 4;
+
+
+DirectoryWatcher::FileStamp::FileStamp()
+    :
+    exists(false),
+    size(-1)
+{
+}
+
+
+bool DirectoryWatcher::FileStamp::operator==(const FileStamp &other) const
+{
+    return exists == other.exists && size == other.size && modified == other.modified;
+}
+
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    :
+    QObject(parent),
+    m_Watcher(new QFileSystemWatcher(this)),
+    m_Suspended(false)
+{
+    m_QuietTimer.setSingleShot(true);
+    m_QuietTimer.setInterval(QUIET_PERIOD_MS);
+    connect(&m_QuietTimer, SIGNAL(timeout()), this, SLOT(CheckPending()));
+    connect(&m_Check, SIGNAL(finished()), this, SLOT(CheckFinished()));
+    connect(m_Watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(FileChanged(const QString &)));
+    connect(m_Watcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(DirectoryChanged(const QString &)));
+}
+
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    m_QuietTimer.stop();
+    m_Check.waitForFinished();
+}
+
+
+void DirectoryWatcher::AddPath(const QString &path)
+{
+    if (m_Files.contains(path)) {
+        return;
+    }
+
+    m_Files.insert(path, Stat(QStringList() << path).value(path));
+
+    if (QFile::exists(path)) {
+        m_Watcher->addPath(path);
+    }
+
+    QString dir = QFileInfo(path).absolutePath();
+
+    if (m_Directories[dir]++ == 0) {
+        m_Watcher->addPath(dir);
+    }
+}
+
+
+void DirectoryWatcher::RemovePath(const QString &path)
+{
+    if (!m_Files.remove(path)) {
+        return;
+    }
+
+    m_Pending.remove(path);
+    m_MissingRounds.remove(path);
+
+    if (m_Watcher->files().contains(path)) {
+        m_Watcher->removePath(path);
+    }
+
+    QString dir = QFileInfo(path).absolutePath();
+
+    if (--m_Directories[dir] <= 0) {
+        m_Directories.remove(dir);
+        m_Watcher->removePath(dir);
+    }
+}
+
+
+void DirectoryWatcher::Suspend()
+{
+    m_Suspended = true;
+}
+
+
+void DirectoryWatcher::Resume()
+{
+    if (!m_Suspended) {
+        return;
+    }
+
+    m_Suspended = false;
+    // Whatever was written meanwhile is the new baseline
+    m_Files = Stat(m_Files.keys());
+    m_Pending.clear();
+    m_MissingRounds.clear();
+}
+
+
+void DirectoryWatcher::FileChanged(const QString &path)
+{
+    Schedule(path);
+}
+
+
+void DirectoryWatcher::DirectoryChanged(const QString &path)
+{
+    QHash<QString, FileStamp>::const_iterator it = m_Files.constBegin();
+
+    for (; it != m_Files.constEnd(); ++it) {
+        if (QFileInfo(it.key()).absolutePath() == path) {
+            Schedule(it.key());
+        }
+    }
+}
+
+
+void DirectoryWatcher::Schedule(const QString &path)
+{
+    if (m_Suspended || !m_Files.contains(path)) {
+        return;
+    }
+
+    m_Pending.insert(path);
+    // Every new event pushes the check back, so a burst is checked once
+    m_QuietTimer.start();
+}
+
+
+void DirectoryWatcher::CheckPending()
+{
+    if (m_Check.isRunning()) {
+        // Picked up once the running check is done
+        m_QuietTimer.start();
+        return;
+    }
+
+    if (m_Pending.isEmpty()) {
+        return;
+    }
+
+    QStringList paths = m_Pending.toList();
+    m_Pending.clear();
+    m_Check.setFuture(TaskScheduler::Run(TaskScheduler::Background, "DirectoryWatcher::Stat", std::bind(Stat, paths)));
+}
+
+
+void DirectoryWatcher::CheckFinished()
+{
+    const QHash<QString, FileStamp> stamps = m_Check.result();
+
+    if (m_Suspended) {
+        return;
+    }
+
+    QStringList changed;
+    QHash<QString, FileStamp>::const_iterator it = stamps.constBegin();
+
+    for (; it != stamps.constEnd(); ++it) {
+        const QString &path = it.key();
+
+        // Removed from the watch while the check ran
+        if (!m_Files.contains(path)) {
+            continue;
+        }
+
+        if (!it.value().exists) {
+            // Probably being replaced; look again next round
+            if (++m_MissingRounds[path] < MAX_MISSING_ROUNDS) {
+                m_Pending.insert(path);
+            } else {
+                m_MissingRounds.remove(path);
+            }
+
+            continue;
+        }
+
+        m_MissingRounds.remove(path);
+
+        // A file moved over the watched one is not watched anymore
+        if (!m_Watcher->files().contains(path)) {
+            m_Watcher->addPath(path);
+        }
+
+        if (!(it.value() == m_Files.value(path))) {
+            m_Files[path] = it.value();
+            changed.append(path);
+        }
+    }
+
+    if (!m_Pending.isEmpty()) {
+        m_QuietTimer.start();
+    }
+
+    if (!changed.isEmpty()) {
+        emit FilesChanged(changed);
+    }
+}
+
+
+QHash<QString, DirectoryWatcher::FileStamp> DirectoryWatcher::Stat(const QStringList &paths)
+{
+    QHash<QString, FileStamp> stamps;
+    foreach(QString path, paths) {
+        QFileInfo info(path);
+        FileStamp stamp;
+        stamp.exists = info.exists();
+
+        if (stamp.exists) {
+            stamp.size = info.size();
+            stamp.modified = info.lastModified();
+        }
+
+        stamps.insert(path, stamp);
+    }
+    return stamps;
+}
@@ -0,0 +1,129 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <QtCore/QDateTime>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+class QFileSystemWatcher;
+
+/**
+ * Watches a set of files for changes made outside Sigil.
+ *
+ * The folders holding the files are watched, which catches editors and
+ * tools that write a new file and move it over the old one, and so are
+ * the files themselves for in place writes. Events are collected for a
+ * short quiet period; the collected files are then checked on a worker
+ * thread against the size and modification time last seen, and all the
+ * files that really changed are reported in one FilesChanged() signal.
+ * A file that is briefly missing (deleted before its new version is
+ * written) is checked again on the next round instead of waited for.
+ */
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    DirectoryWatcher(QObject *parent = 0);
+    ~DirectoryWatcher();
+
+    void AddPath(const QString &path);
+    void RemovePath(const QString &path);
+
+    /**
+     * Ignores all events until Resume(). Changes made in between,
+     * e.g. by Sigil saving the files itself, are never reported.
+     */
+    void Suspend();
+    void Resume();
+
+signals:
+
+    /**
+     * Emitted once per burst of changes with the full paths
+     * of the watched files that changed.
+     */
+    void FilesChanged(const QStringList &paths);
+
+private slots:
+
+    void FileChanged(const QString &path);
+    void DirectoryChanged(const QString &path);
+
+    /**
+     * Starts the check of the collected files on a worker thread.
+     */
+    void CheckPending();
+
+    void CheckFinished();
+
+private:
+
+    struct FileStamp {
+        FileStamp();
+
+        bool exists;
+        qint64 size;
+        QDateTime modified;
+
+        bool operator==(const FileStamp &other) const;
+    };
+
+    static QHash<QString, FileStamp> Stat(const QStringList &paths);
+
+    void Schedule(const QString &path);
+
+    QFileSystemWatcher *m_Watcher;
+
+    /**
+     * The watched files and how they were when last seen.
+     */
+    QHash<QString, FileStamp> m_Files;
+
+    /**
+     * The watched folders and how many watched files each holds.
+     */
+    QHash<QString, int> m_Directories;
+
+    QSet<QString> m_Pending;
+
+    /**
+     * How many rounds in a row a pending file was found missing.
+     */
+    QHash<QString, int> m_MissingRounds;
+
+    QTimer m_QuietTimer;
+
+    QFutureWatcher<QHash<QString, FileStamp>> m_Check;
+
+    bool m_Suspended;
+};
+
+#endif // DIRECTORYWATCHER_H
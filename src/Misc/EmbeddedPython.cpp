@@ -29,6 +29,10 @@
 #include <QMetaType>
 #include <QStandardPaths>
 #include <QDir>
+#include <QtConcurrent/QtConcurrent>
+#include <QDebug>
+#include "Misc/StartupProfiler.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "sigil_constants.h"
 
@@ -162,22 +166,112 @@
  */
 
 
+// Holds a reference to a QByteArray and hands its bytes out through
+// the buffer protocol, so a memoryview can be made onto them
+typedef struct {
+    PyObject_HEAD
+    QByteArray *data;
+} SharedBufferObject;
+
+static void SharedBuffer_dealloc(SharedBufferObject *self)
+{
+    delete self->data;
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int SharedBuffer_getbuffer(SharedBufferObject *self, Py_buffer *view, int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject *) self, const_cast<char *>(self->data->constData()),
+                             self->data->size(), 1, flags);
+}
+
+static PyBufferProcs SharedBuffer_as_buffer = { (getbufferproc) SharedBuffer_getbuffer, NULL };
+
+static PyTypeObject SharedBufferType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+// QString's UTF-16 becomes a str in one go: straight from the buffer,
+// leaving Python to pick the narrowest storage for it, unless there are
+// surrogate pairs, which the UTF-16 decoder has to join
+static PyObject *QStringToPyObject(const QString &text)
+{
+    const ushort *data = text.utf16();
+    int length = text.length();
+
+    for (int i = 0; i < length; i++) {
+        if (QChar::isSurrogate(data[i])) {
+            int byteorder = Q_BYTE_ORDER == Q_LITTLE_ENDIAN ? -1 : 1;
+            return PyUnicode_DecodeUTF16(reinterpret_cast<const char *>(data), length * 2, "replace", &byteorder);
+        }
+    }
+
+    return PyUnicode_FromKindAndData(PyUnicode_2BYTE_KIND, data, length);
+}
+
+// Copies a str straight from Python's own storage
+static QString PyUnicodeToQString(PyObject *po)
+{
+    Py_ssize_t length = PyUnicode_GET_LENGTH(po);
+    int kind = PyUnicode_KIND(po);
+
+    if (kind == PyUnicode_1BYTE_KIND) {
+        // latin 1 according to PEP 393
+        return QString::fromLatin1(reinterpret_cast<const char *>(PyUnicode_1BYTE_DATA(po)), length);
+    } else if (kind == PyUnicode_2BYTE_KIND) {
+        // not fromUtf16, which would take a leading U+FEFF for a BOM
+        return QString(reinterpret_cast<const QChar *>(PyUnicode_2BYTE_DATA(po)), length);
+    } else if (kind == PyUnicode_4BYTE_KIND) {
+        return QString::fromUcs4(PyUnicode_4BYTE_DATA(po), length);
+    }
+
+    // convert to utf8 since not a known
+    return QString::fromUtf8(PyUnicode_AsUTF8(po), -1);
+}
+
+
 QMutex EmbeddedPython::m_mutex;
 
 EmbeddedPython* EmbeddedPython::m_instance = 0;
 int EmbeddedPython::m_pyobjmetaid = 0;
+int EmbeddedPython::m_sharedbuffermetaid = 0;
 PyThreadState * EmbeddedPython::m_threadstate = NULL;
+QThreadPool * EmbeddedPython::m_workerpool = NULL;
+QFuture<void> EmbeddedPython::m_ready;
 
 EmbeddedPython* EmbeddedPython::instance()
 {
     if (m_instance == 0) {
-        m_instance = new EmbeddedPython();
+        initializeInBackground(QStringList());
     }
+    m_ready.waitForFinished();
     return m_instance;
 }
 
+void EmbeddedPython::initializeInBackground(const QStringList &syspaths)
+{
+    if (m_instance != 0) {
+        return;
+    }
+    m_instance = new EmbeddedPython();
+    m_ready = QtConcurrent::run(m_workerpool, m_instance, &EmbeddedPython::initializePython, syspaths);
+}
+
 EmbeddedPython::EmbeddedPython()
 {
+    m_pyobjmetaid = qMetaTypeId<PyObjectPtr>();
+    m_sharedbuffermetaid = qMetaTypeId<PySharedBuffer>();
+
+    // One thread that is kept around, so asynchronous calls neither
+    // compete with each other for the interpreter nor pay for a new thread.
+    // Python is started (and stopped) on it too.
+    m_workerpool = new QThreadPool();
+    m_workerpool->setMaxThreadCount(1);
+    m_workerpool->setExpiryTimeout(-1);
+}
+
+void EmbeddedPython::initializePython(const QStringList &syspaths)
+{
+    StartupProfiler::Phase phase("Python start-up (worker thread)");
+
     // Build string list of paths that will
     // comprise the embedded Python's sys.path
 #if defined(BUNDLING_PYTHON)
@@ -215,8 +309,26 @@ EmbeddedPython::EmbeddedPython()
 
     Py_Initialize();
     PyEval_InitThreads();
+
+    SharedBufferType.tp_name = "sigil.SharedBuffer";
+    SharedBufferType.tp_basicsize = sizeof(SharedBufferObject);
+    SharedBufferType.tp_flags = Py_TPFLAGS_DEFAULT;
+    SharedBufferType.tp_dealloc = (destructor) SharedBuffer_dealloc;
+    SharedBufferType.tp_as_buffer = &SharedBuffer_as_buffer;
+    SharedBufferType.tp_doc = "Bytes shared with Sigil";
+    PyType_Ready(&SharedBufferType);
+
     m_threadstate = PyEval_SaveThread();
-    m_pyobjmetaid = qMetaTypeId<PyObjectPtr>();
+
+    foreach (const QString &syspath, syspaths) {
+        addToPythonSysPath(syspath);
+    }
+}
+
+void EmbeddedPython::finalizePython()
+{
+    PyEval_RestoreThread(m_threadstate);
+    Py_Finalize();
 }
 
 
@@ -227,8 +339,13 @@ EmbeddedPython::~EmbeddedPython()
         m_instance = 0;
     }
     m_pyobjmetaid = 0;
-    PyEval_RestoreThread(m_threadstate);
-    Py_Finalize();
+    m_sharedbuffermetaid = 0;
+    if (m_workerpool) {
+        m_ready.waitForFinished();
+        QtConcurrent::run(m_workerpool, &EmbeddedPython::finalizePython).waitForFinished();
+        delete m_workerpool;
+        m_workerpool = NULL;
+    }
 }
 
 QString EmbeddedPython::embeddedRoot()
@@ -295,6 +412,42 @@ QVariant EmbeddedPython::runInPython(const QString &mname,
                                      QString &tb,
                                      bool ret_python_object)
 {
+    return callInPython(mname, fname, args, rv, tb, ret_python_object, true);
+}
+
+
+QFuture<QVariant> EmbeddedPython::runInPythonAsync(const QString &mname,
+                                                   const QString &fname,
+                                                   const QVariantList &args)
+{
+    return QtConcurrent::run(m_workerpool, this, &EmbeddedPython::runInPythonJob, mname, fname, args);
+}
+
+
+QVariant EmbeddedPython::runInPythonJob(const QString &mname,
+                                        const QString &fname,
+                                        const QVariantList &args)
+{
+    int rv = -1;
+    QString tb;
+    QVariant res = callInPython(mname, fname, args, &rv, tb, false, false);
+    if (rv != 0) {
+        qDebug() << "Embedded Python error in" << mname + "." + fname << rv << tb;
+        return QVariant();
+    }
+    return res;
+}
+
+
+QVariant EmbeddedPython::callInPython(const QString &mname,
+                                      const QString &fname,
+                                      const QVariantList &args,
+                                      int *rv,
+                                      QString &tb,
+                                      bool ret_python_object,
+                                      bool useMsgBox)
+{
+    SIGIL_TRACE_SCOPE("Python call");
     EmbeddedPython::m_mutex.lock();
     PyGILState_STATE gstate = PyGILState_Ensure();
         
@@ -349,7 +502,7 @@ QVariant EmbeddedPython::runInPython(const QString &mname,
 
 cleanup:
     if (PyErr_Occurred() != NULL) {
-        tb = getPythonErrorTraceback();
+        tb = getPythonErrorTraceback(useMsgBox);
     }
     Py_XDECREF(pyres);
     Py_XDECREF(pyargs);
@@ -445,46 +598,42 @@ QVariant EmbeddedPython::PyObjectToQVariant(PyObject *po, bool ret_python_object
         res = QVariant(PyFloat_AsDouble(po));
 
     } else if (PyBytes_Check(po)) {
-        res = QVariant(QByteArray(PyBytes_AsString(po)));
+        res = QVariant(QByteArray(PyBytes_AS_STRING(po), PyBytes_GET_SIZE(po)));
 
     } else if (PyUnicode_Check(po)) {
 
-        int kind = PyUnicode_KIND(po);
-
         if (PyUnicode_READY(po) != 0)
             return res;
 
-        if (kind == PyUnicode_1BYTE_KIND) {
-            // latin 1 according to PEP 393
-            res = QVariant(QString::fromLatin1(reinterpret_cast<const char *>PyUnicode_1BYTE_DATA(po), -1));
-
-        } else if (kind == PyUnicode_2BYTE_KIND) {
-            res = QVariant(QString::fromUtf16(PyUnicode_2BYTE_DATA(po), -1));
+        res = QVariant(PyUnicodeToQString(po));
 
-        } else if (kind == PyUnicode_4BYTE_KIND) {
-            // PyUnicode_4BYTE_KIND
-            res = QVariant(QString::fromUcs4(PyUnicode_4BYTE_DATA(po), -1));
+    } else if (PyTuple_Check(po) || PyList_Check(po)) {
+        PyObject **items = PySequence_Fast_ITEMS(po);
+        int n = PySequence_Fast_GET_SIZE(po);
 
-        } else {
-            // convert to utf8 since not a known
-            res = QVariant(QString::fromUtf8(PyUnicode_AsUTF8(po),-1));
-        }
-
-    } else if (PyTuple_Check(po)) {
-        QVariantList vlist;
-        int n = PyTuple_Size(po);
-        for (int i=0; i< n; i++) {
-            vlist.append(PyObjectToQVariant(PyTuple_GetItem(po,i)));
+        // A sequence of nothing but strings, the most common result
+        // by far, is converted in one go as a string list (which
+        // toList() still turns into a list of variants)
+        bool all_strings = n > 0;
+        for (int i=0; i < n && all_strings; i++) {
+            all_strings = PyUnicode_Check(items[i]) && PyUnicode_READY(items[i]) == 0;
         }
-        res = QVariant(vlist);
 
-    } else if (PyList_Check(po)) {
-        QVariantList vlist;
-        int n = PyList_Size(po);
-        for (int i=0; i< n; i++) {
-            vlist.append(PyObjectToQVariant(PyList_GetItem(po,i)));
+        if (all_strings) {
+            QStringList slist;
+            slist.reserve(n);
+            for (int i=0; i < n; i++) {
+                slist.append(PyUnicodeToQString(items[i]));
+            }
+            res = QVariant(slist);
+        } else {
+            QVariantList vlist;
+            vlist.reserve(n);
+            for (int i=0; i < n; i++) {
+                vlist.append(PyObjectToQVariant(items[i]));
+            }
+            res = QVariant(vlist);
         }
-        res = QVariant(vlist);
 
     } else if (ret_python_object) {
         QVariant var;
@@ -496,6 +645,13 @@ QVariant EmbeddedPython::PyObjectToQVariant(PyObject *po, bool ret_python_object
     return res;
 }
 
+QVariant EmbeddedPython::sharedBuffer(const QByteArray &data)
+{
+    PySharedBuffer buffer;
+    buffer.data = data;
+    return QVariant::fromValue(buffer);
+}
+
 // Convert QVariant to a Python Equivalent Type
 // call recursively to allow populating tuples/lists and lists of lists
 PyObject* EmbeddedPython::QVariantToPyObject(const QVariant &v)
@@ -525,10 +681,13 @@ PyObject* EmbeddedPython::QVariantToPyObject(const QVariant &v)
             // since QString's utf-16 may contain surrogates or may only be pure ascii we have no easy
             // to know the proper string storage type to use internal to python (latin1, ucs2, ucs4)
             // so punt and create utf-8 and let python handle the conversion internally via its c-api
-            value = Py_BuildValue("s", v.toString().toUtf8().constData());
+            value = QStringToPyObject(v.toString());
             break;
         case QMetaType::QByteArray:
-            value = Py_BuildValue("y", v.toByteArray().constData());
+            {
+              QByteArray bytes = v.toByteArray();
+              value = PyBytes_FromStringAndSize(bytes.constData(), bytes.size());
+            }
             break;
         case QMetaType::QStringList:
             {
@@ -536,11 +695,7 @@ PyObject* EmbeddedPython::QVariantToPyObject(const QVariant &v)
               value = PyList_New(vlist.size());
               int pos = 0;
               foreach(QString av, vlist) {
-                  // since QString's utf-16 may contain surrogates or may only be pure ascii we have no easy
-                  // to know the proper string storage type to use internal to python (latin1, ucs2, ucs4)
-                  // so punt and create utf-8 and let python handle the conversion internally via its c-api
-                  PyObject* strval = Py_BuildValue("s", av.toUtf8().constData());
-                  PyList_SetItem(value, pos, strval);
+                  PyList_SetItem(value, pos, QStringToPyObject(av));
                   pos++;
                }
             }
@@ -566,6 +721,14 @@ PyObject* EmbeddedPython::QVariantToPyObject(const QVariant &v)
               // Need to increment object count otherwise will go away when Py_XDECREF used on pyargs
               Py_XINCREF(value);
 
+            } else if ((QMetaType::Type)v.type() >= QMetaType::User && (v.userType() == m_sharedbuffermetaid)) {
+
+              SharedBufferObject *holder = PyObject_New(SharedBufferObject, &SharedBufferType);
+              // Another reference to the same bytes, not a copy
+              holder->data = new QByteArray(v.value<PySharedBuffer>().data);
+              value = PyMemoryView_FromObject((PyObject *) holder);
+              Py_DECREF(holder);
+
             } else {
 
               // Ensure we don't have any holes.
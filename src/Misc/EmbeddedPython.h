@@ -25,11 +25,25 @@
 
 #include <Python.h>
 #include <QCoreApplication>
+#include <QFuture>
 #include <QString>
+#include <QStringList>
 #include <QVariant>
 #include <QMutex>
+#include <QThreadPool>
 #include "Misc/PyObjectPtr.h"
 
+/**
+ * A large payload for Python that is not copied on the way in: it
+ * arrives as a read-only memoryview onto these bytes, which stay alive
+ * for as long as Python holds on to the view.
+ */
+struct PySharedBuffer
+{
+    QByteArray data;
+};
+Q_DECLARE_METATYPE(PySharedBuffer)
+
 /**
  * Singleton.
  */
@@ -40,13 +54,30 @@ class EmbeddedPython
 
 
 public:
+    /**
+     * Waits for Python to be ready, starting it if needed.
+     */
     static EmbeddedPython* instance();
+
+    /**
+     * Starts Python on the worker thread without waiting for it,
+     * with the given paths added to sys.path. Does nothing
+     * if Python was started already.
+     */
+    static void initializeInBackground(const QStringList &syspaths);
+
     ~EmbeddedPython();
 
-    QString embeddedRoot();
+    static QString embeddedRoot();
 
     bool addToPythonSysPath(const QString& modulepath);
 
+    /**
+     * Wraps data to be passed to Python as a memoryview rather than
+     * as bytes, sharing the buffer instead of copying it.
+     */
+    static QVariant sharedBuffer(const QByteArray &data);
+
     QVariant runInPython(const QString &module_name,
                          const QString &function_name,
                          const QVariantList &args,
@@ -54,6 +85,18 @@ public:
                          QString &error_traceback,
                          bool ret_python_object = false);
 
+    /**
+     * Runs module_name.function_name(args) on the Python worker thread
+     * so the caller is not blocked while Python works.
+     *
+     * The result is an invalid QVariant if the call failed. The traceback
+     * is logged rather than shown since no dialog can be raised off the
+     * GUI thread.
+     */
+    QFuture<QVariant> runInPythonAsync(const QString &module_name,
+                                       const QString &function_name,
+                                       const QVariantList &args);
+
     QVariant callPyObjMethod(PyObjectPtr &pyobj, 
                              const QString &methname, 
                              const QVariantList &args, 
@@ -65,6 +108,22 @@ private:
 
     EmbeddedPython();
 
+    void initializePython(const QStringList &syspaths);
+
+    static void finalizePython();
+
+    QVariant callInPython(const QString &module_name,
+                          const QString &function_name,
+                          const QVariantList &args,
+                          int *pRV,
+                          QString &error_traceback,
+                          bool ret_python_object,
+                          bool useMsgBox);
+
+    QVariant runInPythonJob(const QString &module_name,
+                            const QString &function_name,
+                            const QVariantList &args);
+
     QVariant PyObjectToQVariant(PyObject *po, bool ret_python_object = false);
 
     PyObject *QVariantToPyObject(const QVariant &v);
@@ -74,6 +133,17 @@ private:
     static QMutex m_mutex;
     static EmbeddedPython *m_instance;
     static int m_pyobjmetaid;
+    static int m_sharedbuffermetaid;
     static PyThreadState *m_threadstate;
+
+    /**
+     * The single worker thread asynchronous calls run on, in order.
+     */
+    static QThreadPool *m_workerpool;
+
+    /**
+     * Finishes when Python is initialized.
+     */
+    static QFuture<void> m_ready;
 };
 #endif // EMBEDDEDPYTHON_H
@@ -0,0 +1,157 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <functional>
+
+#include "Misc/FindAllSearch.h"
+#include "PCRE/PCRECache.h"
+#include "ResourceObjects/TextResource.h"
+
+// How much of a long line is shown on either side of a match
+static const int CONTEXT_CHARS = 80;
+
+
+FindAllSearch::FindAllSearch(QObject *parent)
+    :
+    QObject(parent),
+    m_Generation(0)
+{
+    qRegisterMetaType<QList<FindAllSearch::Match> >("QList<FindAllSearch::Match>");
+}
+
+
+FindAllSearch::~FindAllSearch()
+{
+    Cancel();
+    m_Future.waitForFinished();
+}
+
+
+void FindAllSearch::Start(const QString &search_regex, const QList<Resource *> &resources)
+{
+    Cancel();
+    m_Future.waitForFinished();
+    m_Cancel = TaskScheduler::CancelToken();
+    m_Generation++;
+
+    QList<Snapshot> snapshots;
+    foreach(Resource *resource, resources) {
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        if (!text_resource) {
+            continue;
+        }
+
+        Snapshot snapshot;
+        snapshot.resource = resource;
+        snapshot.filename = resource->Filename();
+        snapshot.text = text_resource->GetText();
+        snapshots.append(snapshot);
+    }
+
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
+    m_Future = TaskScheduler::Run(TaskScheduler::Foreground, "FindAllSearch::Search",
+                                  std::bind(&FindAllSearch::Search, this, snapshots, spcre, m_Cancel, m_Generation));
+}
+
+
+void FindAllSearch::Cancel()
+{
+    m_Cancel.Cancel();
+}
+
+
+bool FindAllSearch::IsRunning() const
+{
+    return m_Future.isRunning();
+}
+
+
+void FindAllSearch::DeliverFound(int generation, const QList<FindAllSearch::Match> &matches)
+{
+    if (generation == m_Generation) {
+        emit Found(matches);
+    }
+}
+
+
+void FindAllSearch::DeliverFinished(int generation, int count)
+{
+    if (generation == m_Generation) {
+        emit Finished(count);
+    }
+}
+
+
+void FindAllSearch::Search(QList<Snapshot> snapshots, QSharedPointer<SPCRE> spcre, TaskScheduler::CancelToken cancel, int generation)
+{
+    int count = 0;
+    foreach(const Snapshot &snapshot, snapshots) {
+        if (cancel.IsCancelled()) {
+            return;
+        }
+
+        QList<Match> matches = MatchesInText(snapshot, spcre.data());
+
+        if (!matches.isEmpty()) {
+            count += matches.count();
+            QMetaObject::invokeMethod(this, "DeliverFound", Qt::QueuedConnection,
+                                      Q_ARG(int, generation), Q_ARG(QList<FindAllSearch::Match>, matches));
+        }
+    }
+    QMetaObject::invokeMethod(this, "DeliverFinished", Qt::QueuedConnection,
+                              Q_ARG(int, generation), Q_ARG(int, count));
+}
+
+
+QList<FindAllSearch::Match> FindAllSearch::MatchesInText(const Snapshot &snapshot, SPCRE *spcre)
+{
+    QList<Match> matches;
+    const QString &text = snapshot.text;
+    QList<SPCRE::MatchInfo> match_info = spcre->getEveryMatchInfo(text);
+    // The matches come in order, so lines are counted in one pass
+    int line = 1;
+    int counted_to = 0;
+    foreach(const SPCRE::MatchInfo &info, match_info) {
+        int start = info.offset.first;
+        line += text.midRef(counted_to, start - counted_to).count(QChar('\n'));
+        counted_to = start;
+        int line_start = start == 0 ? 0 : text.lastIndexOf(QChar('\n'), start - 1) + 1;
+        int line_end = text.indexOf(QChar('\n'), start);
+
+        if (line_end == -1) {
+            line_end = text.length();
+        }
+
+        int context_start = qMax(line_start, start - CONTEXT_CHARS);
+        int context_end = qMin(line_end, info.offset.second + CONTEXT_CHARS);
+        Match match;
+        match.resource = snapshot.resource;
+        match.filename = snapshot.filename;
+        match.line = line;
+        match.position = start;
+        match.length = info.offset.second - start;
+        match.context = text.mid(context_start, context_end - context_start).trimmed();
+        matches.append(match);
+    }
+    return matches;
+}
@@ -0,0 +1,116 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef FINDALLSEARCH_H
+#define FINDALLSEARCH_H
+
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+
+#include "Misc/TaskScheduler.h"
+
+class Resource;
+class SPCRE;
+
+/**
+ * Finds every match of a search in a set of files, in the background.
+ *
+ * The text of the files is copied when the search starts, so the
+ * search never touches a resource. Matches are reported a file at a
+ * time as they are found.
+ */
+class FindAllSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    struct Match {
+        // Null once the resource is gone
+        QPointer<Resource> resource;
+        QString filename;
+        // Counted from 1
+        int line;
+        // In the text of the file
+        int position;
+        int length;
+        // The line the match is on
+        QString context;
+    };
+
+    FindAllSearch(QObject *parent = 0);
+
+    /**
+     * Cancels the search, and waits for it to stop.
+     */
+    ~FindAllSearch();
+
+    /**
+     * Starts searching, cancelling any search still running.
+     */
+    void Start(const QString &search_regex, const QList<Resource *> &resources);
+
+    void Cancel();
+
+    bool IsRunning() const;
+
+signals:
+    void Found(const QList<FindAllSearch::Match> &matches);
+
+    void Finished(int count);
+
+private slots:
+    // Run in this object's thread. What an earlier search sends after
+    // it was replaced is dropped.
+    void DeliverFound(int generation, const QList<FindAllSearch::Match> &matches);
+
+    void DeliverFinished(int generation, int count);
+
+private:
+
+    struct Snapshot {
+        QPointer<Resource> resource;
+        QString filename;
+        QString text;
+    };
+
+    void Search(QList<Snapshot> snapshots, QSharedPointer<SPCRE> spcre, TaskScheduler::CancelToken cancel, int generation);
+
+    static QList<Match> MatchesInText(const Snapshot &snapshot, SPCRE *spcre);
+
+    QFuture<void> m_Future;
+
+    TaskScheduler::CancelToken m_Cancel;
+
+    // Counts the searches started
+    int m_Generation;
+};
+
+Q_DECLARE_METATYPE(QList<FindAllSearch::Match>)
+
+#endif // FINDALLSEARCH_H
@@ -74,6 +74,8 @@ void FindReplaceQLineEdit::contextMenuEvent(QContextMenuEvent *event)
     menu->insertSeparator(topAction);
     topAction = saveSearchAction;
 
+    SearchEditorModel::instance()->FetchAllEntries();
+
     if (CreateMenuEntries(menu, topAction, SearchEditorModel::instance()->invisibleRootItem())) {
         menu->insertSeparator(topAction);
     }
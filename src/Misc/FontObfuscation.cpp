@@ -23,6 +23,9 @@
 #include <QtCore/QCryptographicHash>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
 
 #include "Misc/FontObfuscation.h"
 #include "sigil_constants.h"
@@ -55,75 +58,105 @@ QByteArray AdobeKeyFromIdentifier(const QString &identifier)
 }
 
 
-void IdpfObfuscate(const QString &filepath, const QString &identifier)
-{
-    QFile file(filepath);
+// Keys derived so far, by algorithm and identifier; a book
+// only ever needs one or two of them
+QHash<QString, QByteArray> derived_keys;
+QMutex derived_keys_mutex;
 
-    if (!file.open(QFile::ReadWrite)) {
-        return;
-    }
+};
 
-    QByteArray contents = file.readAll();
-    QByteArray key = IdpfKeyFromIdentifier(identifier);
-    int key_size   = key.size();
-    if (key_size == 0) {
-        return;
+
+void FontObfuscation::ObfuscateFile(const QString &filepath,
+                                    const QString &algorithm,
+                                    const QString &identifier)
+{
+    if (!QFileInfo(filepath).exists() ||
+        algorithm.isEmpty()             ||
+        identifier.isEmpty()) {
+        std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
+        throw(FontObfuscationError(msg));
     }
 
-    for (int i = 0; (i < IDPF_METHOD_NUM_BYTES) && (i < contents.size()); ++i) {
-        contents[ i ] = contents[ i ] ^ key[ i % key_size ];
+    int obfuscated_length = ObfuscatedLength(algorithm);
+
+    if (obfuscated_length == 0) {
+        std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
+        throw(FontObfuscationError(msg));
     }
 
-    file.seek(0);
-    file.write(contents);
+    ObfuscateFileWithKey(filepath, ObfuscationKey(algorithm, identifier), obfuscated_length);
 }
 
 
-void AdobeObfuscate(const QString &filepath, const QString &identifier)
+bool FontObfuscation::ObfuscateFileWithKey(const QString &filepath,
+                                           const QByteArray &key,
+                                           int obfuscated_length)
 {
+    if (key.isEmpty()) {
+        return true;
+    }
+
     QFile file(filepath);
 
     if (!file.open(QFile::ReadWrite)) {
-        return;
+        return false;
     }
 
-    QByteArray contents = file.readAll();
-    QByteArray key = AdobeKeyFromIdentifier(identifier);
-    int key_size   = key.size();
-    if (key_size == 0) {
-        return;
+    // Only the leading bytes are obfuscated, so only those are rewritten
+    QByteArray contents = file.read(obfuscated_length);
+    ObfuscateBuffer(contents.data(), contents.size(), 0, key, obfuscated_length);
+    file.seek(0);
+    return file.write(contents) == contents.size();
+}
+
+
+QByteArray FontObfuscation::ObfuscationKey(const QString &algorithm, const QString &identifier)
+{
+    QMutexLocker locker(&derived_keys_mutex);
+    const QString cache_key = algorithm + "|" + identifier;
+
+    if (derived_keys.contains(cache_key)) {
+        return derived_keys.value(cache_key);
     }
 
-    for (int i = 0; (i < ADOBE_METHOD_NUM_BYTES) && (i < contents.size()); ++i) {
-        contents[ i ] = contents[ i ] ^ key[ i % key_size ];
+    QByteArray key;
+
+    if (algorithm == ADOBE_FONT_ALGO_ID) {
+        key = AdobeKeyFromIdentifier(identifier);
+    } else if (algorithm == IDPF_FONT_ALGO_ID) {
+        key = IdpfKeyFromIdentifier(identifier);
     }
 
-    file.seek(0);
-    file.write(contents);
+    derived_keys.insert(cache_key, key);
+    return key;
 }
 
-};
 
-
-void FontObfuscation::ObfuscateFile(const QString &filepath,
-                                    const QString &algorithm,
-                                    const QString &identifier)
+int FontObfuscation::ObfuscatedLength(const QString &algorithm)
 {
-    if (!QFileInfo(filepath).exists() ||
-        algorithm.isEmpty()             ||
-        identifier.isEmpty()) {
-        std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
-        throw(FontObfuscationError(msg));
-    }
-
     if (algorithm == ADOBE_FONT_ALGO_ID) {
-        AdobeObfuscate(filepath, identifier);
+        return ADOBE_METHOD_NUM_BYTES;
     } else if (algorithm == IDPF_FONT_ALGO_ID) {
-        IdpfObfuscate(filepath, identifier);
-    } else {
-        std::string msg = filepath.toStdString() + ": " + algorithm.toStdString() + ": " + identifier.toStdString();
-        throw(FontObfuscationError(msg));
+        return IDPF_METHOD_NUM_BYTES;
     }
+
+    return 0;
 }
 
 
+void FontObfuscation::ObfuscateBuffer(char *data,
+                                      qint64 size,
+                                      qint64 offset,
+                                      const QByteArray &key,
+                                      int obfuscated_length)
+{
+    int key_size = key.size();
+
+    if (key_size == 0) {
+        return;
+    }
+
+    for (qint64 i = 0; (i < size) && (offset + i < obfuscated_length); ++i) {
+        data[ i ] = data[ i ] ^ key[ (int)((offset + i) % key_size) ];
+    }
+}
@@ -23,6 +23,8 @@
 #ifndef FONTOBFUSCATION_H
 #define FONTOBFUSCATION_H
 
+#include <QtCore/QByteArray>
+
 class QString;
 
 namespace FontObfuscation
@@ -30,6 +32,45 @@ namespace FontObfuscation
 void ObfuscateFile(const QString &filepath,
                    const QString &algorithm,
                    const QString &identifier);
+
+/**
+ * (De)obfuscates the leading bytes of a font file in place with a key
+ * from ObfuscationKey(). Unlike ObfuscateFile it never throws, so it
+ * can be run on any thread.
+ *
+ * @return false if the file could not be rewritten.
+ */
+bool ObfuscateFileWithKey(const QString &filepath,
+                          const QByteArray &key,
+                          int obfuscated_length);
+
+/**
+ * Returns the XOR key an algorithm derives from a book identifier,
+ * or an empty key if the algorithm is unknown. Keys are derived once
+ * and kept.
+ */
+QByteArray ObfuscationKey(const QString &algorithm, const QString &identifier);
+
+/**
+ * Returns how many leading bytes of a font an algorithm obfuscates.
+ */
+int ObfuscatedLength(const QString &algorithm);
+
+/**
+ * (De)obfuscates a chunk of a font stream in place. The operation is
+ * its own inverse, so this serves both directions.
+ *
+ * @param data The chunk.
+ * @param size The size of the chunk.
+ * @param offset The position of the chunk in the font file.
+ * @param key The key from ObfuscationKey().
+ * @param obfuscated_length The length from ObfuscatedLength().
+ */
+void ObfuscateBuffer(char *data,
+                     qint64 size,
+                     qint64 offset,
+                     const QByteArray &key,
+                     int obfuscated_length);
 }
 
 #endif // FONTOBFUSCATION_H
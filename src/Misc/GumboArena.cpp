@@ -0,0 +1,284 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
+
+#include <QtCore/QAtomicInteger>
+#include <QtCore/QThreadStorage>
+
+#include "gumbo.h"
+#include "Misc/GumboArena.h"
+
+// Chunks start small for small files and double up to the limit
+static const size_t FIRST_CHUNK_SIZE = 64 * 1024;
+static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+static const qint64 DEFAULT_THREAD_CACHE_LIMIT = 4 * 1024 * 1024;
+
+// Put in front of every block Gumbo gets, and keeps the block aligned.
+// arena is NULL for blocks from the heap.
+union BlockHeader {
+    struct {
+        GumboArena *arena;
+        size_t size;
+    } block;
+    double align_double;
+    void *align_pointer;
+    long long align_long;
+};
+
+static const size_t HEADER_SIZE = (sizeof(BlockHeader) + 15) & ~size_t(15);
+
+struct ThreadChunks {
+    ~ThreadChunks() {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            free(chunks[i].first);
+        }
+    }
+
+    // data and size
+    std::vector<std::pair<char *, size_t>> chunks;
+    qint64 bytes = 0;
+};
+
+static QAtomicInteger<qint64> s_ThreadCacheLimit(DEFAULT_THREAD_CACHE_LIMIT);
+
+static QThreadStorage<GumboArena *> s_CurrentArena;
+
+static QThreadStorage<ThreadChunks *> s_ThreadChunks;
+
+static const bool s_Installed = GumboArena::Install();
+
+
+static inline BlockHeader *HeaderOf(void *ptr)
+{
+    return reinterpret_cast<BlockHeader *>(static_cast<char *>(ptr) - HEADER_SIZE);
+}
+
+
+static inline GumboArena *CurrentArena()
+{
+    return s_CurrentArena.hasLocalData() ? s_CurrentArena.localData() : NULL;
+}
+
+
+GumboArena::GumboArena()
+    :
+    m_NextChunkSize(FIRST_CHUNK_SIZE)
+{
+}
+
+
+GumboArena::~GumboArena()
+{
+    qint64 limit = s_ThreadCacheLimit.load();
+    ThreadChunks *cache = NULL;
+
+    if (limit > 0) {
+        if (!s_ThreadChunks.hasLocalData()) {
+            s_ThreadChunks.setLocalData(new ThreadChunks());
+        }
+        cache = s_ThreadChunks.localData();
+    }
+
+    for (size_t i = 0; i < m_Chunks.size(); ++i) {
+        const Chunk &chunk = m_Chunks[i];
+        if (cache && cache->bytes + qint64(chunk.size) <= limit) {
+            cache->chunks.push_back(std::make_pair(chunk.data, chunk.size));
+            cache->bytes += chunk.size;
+        } else {
+            free(chunk.data);
+        }
+    }
+}
+
+
+GumboArena::Scope::Scope(GumboArena *arena)
+    :
+    m_Previous(CurrentArena())
+{
+    s_CurrentArena.setLocalData(arena);
+}
+
+
+GumboArena::Scope::~Scope()
+{
+    s_CurrentArena.setLocalData(m_Previous);
+}
+
+
+qint64 GumboArena::Size() const
+{
+    qint64 size = 0;
+
+    for (size_t i = 0; i < m_Chunks.size(); ++i) {
+        size += m_Chunks[i].size;
+    }
+
+    return size;
+}
+
+
+void GumboArena::SetThreadCacheLimit(qint64 bytes)
+{
+    s_ThreadCacheLimit.store(qMax(bytes, qint64(0)));
+}
+
+
+qint64 GumboArena::ThreadCacheLimit()
+{
+    return s_ThreadCacheLimit.load();
+}
+
+
+bool GumboArena::Install()
+{
+    gumbo_memory_set_allocator(Realloc);
+    gumbo_memory_set_free(Free);
+    return true;
+}
+
+
+void *GumboArena::Realloc(void *ptr, size_t size)
+{
+    GumboArena *arena = CurrentArena();
+
+    if (ptr == NULL) {
+        if (arena) {
+            return arena->Allocate(size);
+        }
+
+        BlockHeader *header = static_cast<BlockHeader *>(malloc(HEADER_SIZE + size));
+        if (!header) {
+            return NULL;
+        }
+        header->block.arena = NULL;
+        header->block.size = size;
+        return reinterpret_cast<char *>(header) + HEADER_SIZE;
+    }
+
+    BlockHeader *header = HeaderOf(ptr);
+
+    if (header->block.arena) {
+        return header->block.arena->Grow(ptr, size);
+    }
+
+    // Heap blocks stay on the heap
+    header = static_cast<BlockHeader *>(realloc(header, HEADER_SIZE + size));
+    if (!header) {
+        return NULL;
+    }
+    header->block.size = size;
+    return reinterpret_cast<char *>(header) + HEADER_SIZE;
+}
+
+
+void GumboArena::Free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+
+    BlockHeader *header = HeaderOf(ptr);
+
+    // Arena blocks go when the arena does
+    if (header->block.arena == NULL) {
+        free(header);
+    }
+}
+
+
+void *GumboArena::Allocate(size_t size)
+{
+    size_t needed = (HEADER_SIZE + size + 15) & ~size_t(15);
+
+    if (m_Chunks.empty() || m_Chunks.back().size - m_Chunks.back().used < needed) {
+        NewChunk(needed);
+    }
+
+    Chunk &chunk = m_Chunks.back();
+    BlockHeader *header = reinterpret_cast<BlockHeader *>(chunk.data + chunk.used);
+    chunk.used += needed;
+    header->block.arena = this;
+    header->block.size = size;
+    return reinterpret_cast<char *>(header) + HEADER_SIZE;
+}
+
+
+void *GumboArena::Grow(void *ptr, size_t size)
+{
+    BlockHeader *header = HeaderOf(ptr);
+    size_t old_size = header->block.size;
+    Chunk &chunk = m_Chunks.back();
+    char *block_start = reinterpret_cast<char *>(header);
+    size_t old_needed = (HEADER_SIZE + old_size + 15) & ~size_t(15);
+
+    // The string buffers grow one after another; the last block of the
+    // current chunk can grow where it is
+    if (block_start >= chunk.data && block_start + old_needed == chunk.data + chunk.used) {
+        size_t needed = (HEADER_SIZE + size + 15) & ~size_t(15);
+        size_t offset = block_start - chunk.data;
+        if (offset + needed <= chunk.size) {
+            chunk.used = offset + needed;
+            header->block.size = size;
+            return ptr;
+        }
+    }
+
+    // Grown outside a scope, or on another thread: move it to the heap
+    void *grown = CurrentArena() == this ? Allocate(size) : Realloc(NULL, size);
+    if (grown) {
+        memcpy(grown, ptr, qMin(old_size, size));
+    }
+    return grown;
+}
+
+
+void GumboArena::NewChunk(size_t minimum)
+{
+    Chunk chunk;
+    chunk.size = qMax(m_NextChunkSize, minimum);
+    chunk.data = NULL;
+    chunk.used = 0;
+
+    if (s_ThreadChunks.hasLocalData()) {
+        ThreadChunks *cache = s_ThreadChunks.localData();
+        for (size_t i = 0; i < cache->chunks.size(); ++i) {
+            if (cache->chunks[i].second >= minimum) {
+                chunk.data = cache->chunks[i].first;
+                chunk.size = cache->chunks[i].second;
+                cache->bytes -= chunk.size;
+                cache->chunks.erase(cache->chunks.begin() + i);
+                break;
+            }
+        }
+    }
+
+    if (!chunk.data) {
+        chunk.data = static_cast<char *>(malloc(chunk.size));
+        m_NextChunkSize = qMin(m_NextChunkSize * 2, MAX_CHUNK_SIZE);
+    }
+
+    m_Chunks.push_back(chunk);
+}
@@ -0,0 +1,110 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef GUMBOARENA_H
+#define GUMBOARENA_H
+
+#include <stddef.h>
+#include <vector>
+
+#include <QtCore/QtGlobal>
+
+/**
+ * A bump pointer arena for the memory of one Gumbo parse.
+ *
+ * While a Scope is open on a thread, everything Gumbo allocates on that
+ * thread comes from the arena. Freeing a block from the arena does
+ * nothing; the whole arena is let go at once when it is destroyed, which
+ * must be after the gumbo output built in it is destroyed.
+ *
+ * Gumbo's allocation hooks are process wide, so they are installed once
+ * when the program loads. Outside a Scope they fall back to the heap.
+ * Every block carries a small header saying where it came from, so a
+ * block can be freed or grown on any thread.
+ *
+ * Released chunks are kept in a small per-thread cache, so a worker that
+ * parses one file after another reuses the same memory.
+ */
+class GumboArena
+{
+public:
+
+    GumboArena();
+    ~GumboArena();
+
+    /**
+     * Makes an arena the one Gumbo allocates from on this thread.
+     */
+    class Scope
+    {
+    public:
+        Scope(GumboArena *arena);
+        ~Scope();
+
+    private:
+        Q_DISABLE_COPY(Scope)
+
+        GumboArena *m_Previous;
+    };
+
+    /**
+     * @return The bytes held by the arena.
+     */
+    qint64 Size() const;
+
+    /**
+     * Sets how many bytes of released chunks each thread may keep for
+     * reuse; 0 turns the reuse off.
+     */
+    static void SetThreadCacheLimit(qint64 bytes);
+
+    static qint64 ThreadCacheLimit();
+
+    static bool Install();
+
+    // The gumbo allocation hooks
+    static void *Realloc(void *ptr, size_t size);
+    static void Free(void *ptr);
+
+private:
+
+    Q_DISABLE_COPY(GumboArena)
+
+    struct Chunk {
+        char *data;
+        size_t size;
+        size_t used;
+    };
+
+    void *Allocate(size_t size);
+
+    void *Grow(void *ptr, size_t size);
+
+    void NewChunk(size_t minimum);
+
+    std::vector<Chunk> m_Chunks;
+
+    size_t m_NextChunkSize;
+};
+
+#endif // GUMBOARENA_H
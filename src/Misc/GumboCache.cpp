@@ -0,0 +1,164 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <list>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QString>
+
+#include "Misc/GumboCache.h"
+#include "Misc/GumboInterface.h"
+#include "ResourceObjects/TextResource.h"
+
+static const qint64 DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+struct CachedTree {
+    std::list<QString>::iterator lru_pos;
+    int revision;
+    QSharedPointer<const GumboTree> tree;
+};
+
+static QMutex s_CacheMutex;
+
+// Resource identifiers, most recently used first
+static std::list<QString> s_LRU;
+
+static QHash<QString, CachedTree> s_Trees;
+
+static qint64 s_Size = 0;
+
+static qint64 s_Capacity = DEFAULT_CAPACITY;
+
+
+static void DropLocked(QHash<QString, CachedTree>::iterator it)
+{
+    s_Size -= it.value().tree->size();
+    s_LRU.erase(it.value().lru_pos);
+    s_Trees.erase(it);
+}
+
+
+static void TrimLocked(const QString &keep)
+{
+    while (s_Size > s_Capacity && !s_LRU.empty()) {
+        QString identifier = s_LRU.back();
+
+        if (identifier == keep) {
+            break;
+        }
+
+        DropLocked(s_Trees.find(identifier));
+    }
+}
+
+
+QSharedPointer<const GumboTree> GumboCache::Get(const TextResource *resource)
+{
+    {
+        QMutexLocker locker(&s_CacheMutex);
+        QHash<QString, CachedTree>::iterator it = s_Trees.find(resource->GetIdentifier());
+
+        if (it != s_Trees.end() && it.value().revision == resource->GetTextRevision()) {
+            s_LRU.splice(s_LRU.begin(), s_LRU, it.value().lru_pos);
+            return it.value().tree;
+        }
+    }
+
+    return Get(resource, resource->GetSnapshot());
+}
+
+
+QSharedPointer<const GumboTree> GumboCache::Get(const TextResource *resource, const TextResource::Snapshot &snapshot)
+{
+    QString identifier = resource->GetIdentifier();
+    {
+        QMutexLocker locker(&s_CacheMutex);
+        QHash<QString, CachedTree>::iterator it = s_Trees.find(identifier);
+
+        if (it != s_Trees.end() && it.value().revision == snapshot.revision) {
+            s_LRU.splice(s_LRU.begin(), s_LRU, it.value().lru_pos);
+            return it.value().tree;
+        }
+    }
+
+    // The parse is done without the lock held, and the tree is cached
+    // under the revision of the very text that was parsed.
+    QSharedPointer<const GumboTree> tree(new GumboTree(snapshot.text));
+    QMutexLocker locker(&s_CacheMutex);
+
+    if (s_Capacity <= 0) {
+        return tree;
+    }
+
+    QHash<QString, CachedTree>::iterator it = s_Trees.find(identifier);
+
+    if (it != s_Trees.end()) {
+        if (it.value().revision > snapshot.revision) {
+            // Another thread already cached a newer text
+            return tree;
+        }
+
+        DropLocked(it);
+    }
+
+    s_LRU.push_front(identifier);
+    CachedTree cached;
+    cached.lru_pos = s_LRU.begin();
+    cached.revision = snapshot.revision;
+    cached.tree = tree;
+    s_Trees.insert(identifier, cached);
+    s_Size += tree->size();
+    TrimLocked(identifier);
+    return tree;
+}
+
+
+void GumboCache::Clear()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    s_Trees.clear();
+    s_LRU.clear();
+    s_Size = 0;
+}
+
+
+void GumboCache::SetCapacity(qint64 bytes)
+{
+    QMutexLocker locker(&s_CacheMutex);
+    s_Capacity = qMax(bytes, qint64(0));
+    TrimLocked(QString());
+}
+
+
+qint64 GumboCache::Capacity()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    return s_Capacity;
+}
+
+
+qint64 GumboCache::Size()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    return s_Size;
+}
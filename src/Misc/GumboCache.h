@@ -0,0 +1,78 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef GUMBOCACHE_H
+#define GUMBOCACHE_H
+
+#include <QtCore/QSharedPointer>
+#include <QtCore/QtGlobal>
+
+#include "ResourceObjects/TextResource.h"
+
+class GumboTree;
+
+/**
+ * The parse trees of the text resources, shared between everything
+ * that only reads them.
+ *
+ * One tree is kept per resource, for its latest text revision, so
+ * extractors that run one after the other on the same file parse it
+ * once. The handles are reference counted: a tree dropped from the
+ * cache lives on until the last reader lets go of it. The least
+ * recently used trees are dropped once the cache goes over its size cap.
+ */
+class GumboCache
+{
+public:
+
+    /**
+     * @return The parse tree of the current text of the resource,
+     *         parsing it if it is not cached.
+     */
+    static QSharedPointer<const GumboTree> Get(const TextResource *resource);
+
+    /**
+     * @return The parse tree of the snapshot of the resource, so a
+     *         caller can tell exactly which revision it reads.
+     */
+    static QSharedPointer<const GumboTree> Get(const TextResource *resource,
+                                               const TextResource::Snapshot &snapshot);
+
+    /**
+     * Drops every cached tree.
+     */
+    static void Clear();
+
+    /**
+     * Sets the size cap in bytes; 0 turns caching off.
+     */
+    static void SetCapacity(qint64 bytes);
+
+    static qint64 Capacity();
+
+    /**
+     * @return The approximate size of the cached trees, in bytes.
+     */
+    static qint64 Size();
+};
+
+#endif // GUMBOCACHE_H
@@ -25,16 +25,22 @@
 #include <QRegularExpressionMatch>
 #include <QDir>
 #include <QUrl>
+#include <QVector>
+#include <QScopedPointer>
 #include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 // #include <QDebug>
 
+#include "Misc/GumboReparse.h"
 #include "Misc/Utility.h"
 #include "GumboInterface.h"
 #include "string_buffer.h"
 #include "error.h"
 
 
-static std::unordered_set<std::string> nonbreaking_inline  = { 
+static const std::unordered_set<std::string> nonbreaking_inline  = { 
   "a","abbr","acronym","b","bdo","big","br","button","cite","code","del",
   "dfn","em","font","i","image","img","input","ins","kbd","label","map",
   "mark", "nobr","object","q","ruby","rt","s","samp","select","small",
@@ -43,22 +49,22 @@ static std::unordered_set<std::string> nonbreaking_inline  = {
 };
 
 
-static std::unordered_set<std::string> preserve_whitespace = {
+static const std::unordered_set<std::string> preserve_whitespace = {
   "pre","textarea","script","style"
 };
 
 
-static std::unordered_set<std::string> special_handling    = { 
+static const std::unordered_set<std::string> special_handling    = { 
   "html","body"
 };
 
 
-static std::unordered_set<std::string> no_entity_sub       = {
+static const std::unordered_set<std::string> no_entity_sub       = {
   "script","style"
 };
 
 
-static std::unordered_set<std::string> void_tags          = {
+static const std::unordered_set<std::string> void_tags          = {
   "area","base","basefont","bgsound","br","col","command","embed",
   "event-source","frame","hr","img","input","keygen","link",
   "meta","param","source","spacer","track","wbr", 
@@ -67,37 +73,103 @@ static std::unordered_set<std::string> void_tags          = {
 };
 
 
-static std::unordered_set<std::string> structural_tags     = {
+static const std::unordered_set<std::string> structural_tags     = {
   "article","aside","blockquote","body","canvas","colgroup","div","dl",
   "figure","footer","head","header","hr","html","ol","section",
   "table","tbody","tfoot","thead","td","th","tr","ul"
 };
 
 
-static std::unordered_set<std::string> other_text_holders = {
+static const std::unordered_set<std::string> other_text_holders = {
   "address","caption","dd","div","dt","h1","h2","h3","h4","h5","h6",
   "legend","li","option","p","td","th","title"
 };
 
 
-static std::unordered_set<std::string> manifest_properties = {
+static const std::unordered_set<std::string> manifest_properties = {
   "math","nav","script","svg","epub:switch"
 };
 
 
-static std::unordered_set<std::string> href_src_tags       = {
+static const std::unordered_set<std::string> href_src_tags       = {
   "a","area","audio","base","embed","font-face-uri","frame","iframe",
   "image","img","input","link","object","script","source","track","video"
 };
 
 
+// The sets above as bits, looked up by GumboTag instead of hashing the
+// tag name. Only unknown tags, and svg tags whose names keep their case,
+// still go to the sets.
+enum TagProperty {
+    NonbreakingInline  = 1 << 0,
+    PreserveWhitespace = 1 << 1,
+    SpecialHandling    = 1 << 2,
+    NoEntitySub        = 1 << 3,
+    VoidTag            = 1 << 4,
+    StructuralTag      = 1 << 5,
+    OtherTextHolder    = 1 << 6,
+    ManifestProperty   = 1 << 7,
+    HrefSrcTag         = 1 << 8
+};
+
+
+static unsigned int properties_of_name(const std::string &tagname)
+{
+    unsigned int properties = 0;
+    if (nonbreaking_inline.count(tagname))  properties |= NonbreakingInline;
+    if (preserve_whitespace.count(tagname)) properties |= PreserveWhitespace;
+    if (special_handling.count(tagname))    properties |= SpecialHandling;
+    if (no_entity_sub.count(tagname))       properties |= NoEntitySub;
+    if (void_tags.count(tagname))           properties |= VoidTag;
+    if (structural_tags.count(tagname))     properties |= StructuralTag;
+    if (other_text_holders.count(tagname))  properties |= OtherTextHolder;
+    if (manifest_properties.count(tagname)) properties |= ManifestProperty;
+    if (href_src_tags.count(tagname))       properties |= HrefSrcTag;
+    return properties;
+}
+
+
+// Filled from the sets once, during static initialization, so the
+// two can never disagree
+struct TagPropertyTable {
+    unsigned short properties[GUMBO_TAG_LAST];
+
+    TagPropertyTable() {
+        for (int tag = 0; tag < GUMBO_TAG_LAST; ++tag) {
+            properties[tag] = 0;
+            if (tag != GUMBO_TAG_UNKNOWN) {
+                properties[tag] = properties_of_name(gumbo_normalized_tagname(static_cast<GumboTag>(tag)));
+            }
+        }
+    }
+};
+
+static const TagPropertyTable tag_property_table;
+
+
+// The urls in css that reference files, used for style updates
+static const QString STYLE_URL_SEARCH =
+    "(?:(?:src|background|background-image|list-style|list-style-image|border-image|border-image-source|content)\\s*:|@import)\\s*"
+    "[^;\\}\\(\"']*"
+    "(?:"
+    "url\\([\"']?([^\\(\\)\"']*)[\"']?\\)"
+    "|"
+    "[\"']([^\\(\\)\"']*)[\"']"
+    ")";
+
 static const QChar POUND_SIGN    = QChar::fromLatin1('#');
 static const QChar FORWARD_SLASH = QChar::fromLatin1('/');
 static const std::string aSRC = std::string("src");
 static const std::string aHREF = std::string("href");
 static const std::string aPOSTER = std::string("poster");
 static const std::string aDATA = std::string("data");
-QHash<QString,QString> EmptyHash = QHash<QString,QString>();
+static const QHash<QString,QString> EmptyHash;
+
+// Below this length a std::string may keep its text inline
+static const size_t MIN_REPARSE_LENGTH = 64;
+
+// How far the arena of a patched tree may grow, relative to its source
+static const int MAX_ARENA_GROWTH = 32;
 
 // These need to match the GumboAttributeNamespaceEnum sequence
 static const char * attribute_nsprefixes[4] = { "", "xlink:", "xml:", "xmlns:" };
@@ -112,15 +184,135 @@ static const char * attribute_nsprefixes[4] = { "", "xlink:", "xml:", "xmlns:" }
 // Do NOT change or delete m_utf8src once set until after you 
 // have properly destroyed the gumbo output tree
 
+static const std::string XML_HEADER = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+
+// The length of any xml header line and the whitespace after it
+static size_t xml_header_length(const std::string &utf8src)
+{
+    if (utf8src.compare(0,5,"<?xml") != 0) {
+        return 0;
+    }
+    size_t end = utf8src.find_first_of('>', 5);
+    if (end == std::string::npos) {
+        return utf8src.length();
+    }
+    end = utf8src.find_first_not_of("\n\r\t\v\f ",end+1);
+    return end == std::string::npos ? utf8src.length() : end;
+}
+
+
+// The options every xhtml parse of a whole file is made with
+static GumboOptions xhtml_options()
+{
+    // In case we ever have to revert to earlier versions, please note the following
+    // additional initialization is needed because Microsoft Visual Studio 2013 (and earlier?)
+    // do not properly initialize myoptions from the static const kGumboDefaultOptions defined
+    // in the gumbo library.  Instead whatever was in memory at the time is used causing random 
+    // issues later on so if reverting remember to keep these specific changes as the bug 
+    // they work around took a long long time to track down
+    GumboOptions myoptions = kGumboDefaultOptions;
+    myoptions.tab_stop = 4;
+    myoptions.use_xhtml_rules = true;
+    myoptions.stop_on_first_error = false;
+    myoptions.max_tree_depth = 400;
+    myoptions.max_errors = 50;
+    return myoptions;
+}
+
+
+// Parses the way GumboInterface::parse always has, skipping any xml
+// header line and the whitespace after it rather than erasing them,
+// so the buffer is never moved. The tree is built in arena, which
+// must outlive it.
+static GumboOutput * parse_xhtml(const std::string &utf8src, GumboArena *arena)
+{
+    size_t start = xml_header_length(utf8src);
+    GumboOptions myoptions = xhtml_options();
+    GumboArena::Scope scope(arena);
+    return gumbo_parse_with_options(&myoptions, utf8src.data() + start, utf8src.length() - start);
+}
+
+
+// One conversion of the serialized utf-8, with the xml header in front
+static QString to_xhtml(const std::string &utf8out)
+{
+    QString result;
+    result.reserve(int(XML_HEADER.length() + utf8out.length()));
+    result.append(QLatin1String(XML_HEADER.data(), int(XML_HEADER.length())));
+    result.append(QString::fromUtf8(utf8out.data(), int(utf8out.length())));
+    return result;
+}
+
+
+GumboTree::GumboTree(const QString &source)
+        : m_source(source),
+          m_utf8src(source.toStdString()),
+          m_output(NULL),
+          m_parsesize(0)
+{
+    if (!m_source.isEmpty()) {
+        // The tree is copied out of the arena onto the heap, and the
+        // arena goes with everything else the parse left behind
+        GumboArena arena;
+        GumboOutput *parsed = parse_xhtml(m_utf8src, &arena);
+        m_parsesize = arena.Size();
+        m_output = gumbo_compact_output(parsed);
+    }
+}
+
+
+GumboTree::~GumboTree()
+{
+    if (m_output != NULL) {
+        gumbo_destroy_output(m_output);
+        m_output = NULL;
+    }
+}
+
+
+const QString & GumboTree::source() const
+{
+    return m_source;
+}
+
+
+const std::string & GumboTree::utf8source() const
+{
+    return m_utf8src;
+}
+
+
+GumboOutput * GumboTree::output() const
+{
+    return m_output;
+}
+
+
+qint64 GumboTree::size() const
+{
+    qint64 tree_size = m_output ? qint64(m_output->compact_size) : 0;
+    return qint64(m_source.size()) * sizeof(QChar) + qint64(m_utf8src.size()) + tree_size;
+}
+
+
+qint64 GumboTree::parse_size() const
+{
+    return m_parsesize;
+}
+
+
 GumboInterface::GumboInterface(const QString &source, const QString &version)
         : m_source(source),
           m_output(NULL),
           m_utf8src(""),
           m_sourceupdates(EmptyHash),
+          m_styleupdates(EmptyHash),
+          m_updatesmade(false),
           m_newcsslinks(""),
           m_currentdir(""),
           m_newbody(""),
-          m_version(version)
+          m_version(version),
+          m_reparsable(false)
 {
 }
 
@@ -130,21 +322,62 @@ GumboInterface::GumboInterface(const QString &source, const QString &version, co
           m_output(NULL),
           m_utf8src(""),
           m_sourceupdates(source_updates),
+          m_styleupdates(source_updates),
+          m_updatesmade(false),
+          m_newcsslinks(""),
+          m_currentdir(""),
+          m_newbody(""),
+          m_version(version),
+          m_reparsable(false)
+{
+}
+
+
+GumboInterface::GumboInterface(const QString &source, const QString &version,
+                               const QHash<QString,QString> & source_updates,
+                               const QHash<QString,QString> & style_updates)
+        : m_source(source),
+          m_output(NULL),
+          m_utf8src(""),
+          m_sourceupdates(source_updates),
+          m_styleupdates(style_updates),
+          m_updatesmade(false),
+          m_newcsslinks(""),
+          m_currentdir(""),
+          m_newbody(""),
+          m_version(version),
+          m_reparsable(false)
+{
+}
+
+
+GumboInterface::GumboInterface(const QSharedPointer<const GumboTree> &tree, const QString &version)
+        : m_source(tree->source()),
+          m_tree(tree),
+          m_output(tree->output()),
+          m_utf8src(""),
+          m_sourceupdates(EmptyHash),
+          m_styleupdates(EmptyHash),
+          m_updatesmade(false),
           m_newcsslinks(""),
           m_currentdir(""),
           m_newbody(""),
-          m_version(version)
+          m_version(version),
+          m_reparsable(false)
 {
 }
 
 
 GumboInterface::~GumboInterface()
 {
-    if (m_output != NULL) {
+    // A shared tree is destroyed with its last reference
+    if (m_tree.isNull() && m_output != NULL) {
         gumbo_destroy_output(m_output);
         m_output = NULL;
         m_utf8src = "";
     }
+    // The arena goes after the tree that lives in it
+    m_arena.reset();
 }
 
 
@@ -153,30 +386,57 @@ void GumboInterface::parse()
     if (!m_source.isEmpty() && (m_output == NULL)) {
 
         m_utf8src = m_source.toStdString();
-        // remove any xml header line and any trailing whitespace
-        if (m_utf8src.compare(0,5,"<?xml") == 0) {
-            size_t end = m_utf8src.find_first_of('>', 5);
-            end = m_utf8src.find_first_not_of("\n\r\t\v\f ",end+1);
-            m_utf8src.erase(0,end);
-        }
+        m_arena.reset(new GumboArena());
+        m_output = parse_xhtml(m_utf8src, m_arena.data());
+        m_reparsable = true;
+    }
+}
 
-        // In case we ever have to revert to earlier versions, please note the following
-        // additional initialization is needed because Microsoft Visual Studio 2013 (and earlier?)
-        // do not properly initialize myoptions from the static const kGumboDefaultOptions defined
-        // in the gumbo library.  Instead whatever was in memory at the time is used causing random 
-        // issues later on so if reverting remember to keep these specific changes as the bug 
-        // they work around took a long long time to track down
-        GumboOptions myoptions = kGumboDefaultOptions;
-        myoptions.tab_stop = 4;
-        myoptions.use_xhtml_rules = true;
-        myoptions.stop_on_first_error = false;
-	myoptions.max_tree_depth = 400;
-        myoptions.max_errors = 50;
 
-        // GumboInterface::m_mutex.lock();
-        m_output = gumbo_parse_with_options(&myoptions, m_utf8src.data(), m_utf8src.length());
-        // GumboInterface::m_mutex.unlock();
+bool GumboInterface::reparse(const QString &source)
+{
+    if (m_output != NULL && source == m_source) {
+        return true;
+    }
+
+    std::string utf8src = source.toStdString();
+
+    // Only a tree of our own that came from parse() can be patched. A
+    // short string lives inside the std::string itself and would move
+    // on the swap below; and since an arena never frees, a tree patched
+    // over and over is rebuilt once its arena has grown too large.
+    if (m_tree.isNull() && m_output != NULL && m_reparsable &&
+        utf8src.length() >= MIN_REPARSE_LENGTH && m_utf8src.length() >= MIN_REPARSE_LENGTH &&
+        m_arena->Size() <= qint64(MAX_ARENA_GROWTH) * qint64(utf8src.length())) {
+        size_t old_start = xml_header_length(m_utf8src);
+        size_t new_start = xml_header_length(utf8src);
+        GumboOptions myoptions = xhtml_options();
+        bool reparsed;
+        {
+            GumboArena::Scope scope(m_arena.data());
+            reparsed = GumboReparse::Apply(m_output, myoptions,
+                                           m_utf8src.data() + old_start, m_utf8src.length() - old_start,
+                                           utf8src.data() + new_start, utf8src.length() - new_start);
+        }
+        if (reparsed) {
+            m_utf8src.swap(utf8src);
+            m_source = source;
+            m_nodeindex.clear();
+            return true;
+        }
     }
+
+    if (m_tree.isNull() && m_output != NULL) {
+        gumbo_destroy_output(m_output);
+    }
+    m_tree.clear();
+    m_output = NULL;
+    m_arena.reset();
+    m_nodeindex.clear();
+    m_source = source;
+    m_reparsable = false;
+    parse();
+    return false;
 }
 
 
@@ -189,7 +449,7 @@ QString GumboInterface::repair()
         }
         std::string utf8out = serialize(m_output->document);
         rtrim(utf8out);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        result = to_xhtml(utf8out);
     }
     return result;
 }
@@ -204,7 +464,7 @@ QString GumboInterface::getxhtml()
         }
         std::string utf8out = serialize(m_output->document);
         rtrim(utf8out);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        result = to_xhtml(utf8out);
     }
     return result;
 }
@@ -220,7 +480,7 @@ QString GumboInterface::prettyprint(QString indent_chars)
         std::string ind = indent_chars.toStdString();
         std::string utf8out = prettyprint(m_output->document, 0, ind);
         rtrim(utf8out);
-        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+        result = to_xhtml(utf8out);
     }
     return result;
 }
@@ -242,6 +502,7 @@ QStringList GumboInterface::get_all_properties()
 QString GumboInterface::perform_source_updates(const QString& my_current_book_relpath)
 {
     m_currentdir = QFileInfo(my_current_book_relpath).dir().path();
+    m_updatesmade = false;
     QString result = "";
     if (!m_source.isEmpty()) {
         if (m_output == NULL) {
@@ -259,6 +520,7 @@ QString GumboInterface::perform_source_updates(const QString& my_current_book_re
 QString GumboInterface::perform_style_updates(const QString& my_current_book_relpath)
 {
     m_currentdir = QFileInfo(my_current_book_relpath).dir().path();
+    m_updatesmade = false;
     QString result = "";
     if (!m_source.isEmpty()) {
         if (m_output == NULL) {
@@ -273,6 +535,31 @@ QString GumboInterface::perform_style_updates(const QString& my_current_book_rel
 }
 
 
+// Both kinds of reference in one serialization
+QString GumboInterface::perform_source_and_style_updates(const QString& my_current_book_relpath)
+{
+    m_currentdir = QFileInfo(my_current_book_relpath).dir().path();
+    m_updatesmade = false;
+    QString result = "";
+    if (!m_source.isEmpty()) {
+        if (m_output == NULL) {
+            parse();
+        }
+        enum UpdateTypes doupdates = static_cast<UpdateTypes>(SourceUpdates | StyleUpdates);
+        std::string utf8out = serialize(m_output->document, doupdates);
+        rtrim(utf8out);
+        result =  "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n" + QString::fromStdString(utf8out);
+    }
+    return result;
+}
+
+
+bool GumboInterface::updates_made() const
+{
+    return m_updatesmade;
+}
+
+
 QString GumboInterface::perform_link_updates(const QString& newcsslinks)
 {
     m_newcsslinks = newcsslinks.toStdString();
@@ -340,9 +627,8 @@ QStringList GumboInterface::get_properties(GumboNode* node)
         return QStringList();
     }
     QStringList properties;
-    std::string tagname = get_tag_name(node);
-    if (in_set(manifest_properties, tagname)) {
-        properties.append(QString::fromStdString(tagname));
+    if (tag_properties(node) & ManifestProperty) {
+        properties.append(QString::fromStdString(get_tag_name(node)));
     }
     GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, "src");
     if (attr && !QUrl(QString::fromUtf8(attr->value)).isRelative()) {
@@ -356,8 +642,124 @@ QStringList GumboInterface::get_properties(GumboNode* node)
 }
 
 
+// The side table behind the path and offset lookups
+struct GumboInterface::NodeIndex {
+    QHash<GumboNode*, QString> paths;
+
+    // filled by get_node_from_qwebpath as paths are resolved
+    QHash<QString, GumboNode*> resolved;
+
+    // the element children of each element, so an index into them is
+    // one step instead of a scan
+    QHash<GumboNode*, QVector<GumboNode*> > elements;
+
+    // every node by where it starts, in document order
+    std::vector<std::pair<unsigned int, GumboNode*> > starts;
+};
+
+
+static bool start_before(const std::pair<unsigned int, GumboNode*> &a,
+                         const std::pair<unsigned int, GumboNode*> &b)
+{
+    return a.first < b.first;
+}
+
+
+static bool offset_before(unsigned int offset, const std::pair<unsigned int, GumboNode*> &b)
+{
+    return offset < b.first;
+}
+
+
+static bool node_contains(GumboNode* node, unsigned int offset)
+{
+    if ((node->type == GUMBO_NODE_ELEMENT) || (node->type == GUMBO_NODE_TEMPLATE)) {
+        const GumboElement &element = node->v.element;
+        return (offset >= element.start_pos.offset) &&
+               (offset < element.end_pos.offset + element.original_end_tag.length);
+    }
+    if (node->type == GUMBO_NODE_DOCUMENT) {
+        return true;
+    }
+    const GumboText &text = node->v.text;
+    return (offset >= text.start_pos.offset) && (offset < text.start_pos.offset + text.original_text.length);
+}
+
+
+void GumboInterface::build_node_index()
+{
+    if (!m_nodeindex.isNull()) {
+        return;
+    }
+    GumboNode* root = get_root_node();
+    m_nodeindex = QSharedPointer<NodeIndex>(new NodeIndex());
+    m_nodeindex->paths.insert(root, QString());
+    m_nodeindex->starts.push_back(std::make_pair(root->v.element.start_pos.offset, root));
+    index_children(root, QString());
+    // Implied elements may start after the text that follows them
+    std::stable_sort(m_nodeindex->starts.begin(), m_nodeindex->starts.end(), start_before);
+}
+
+
+void GumboInterface::index_children(GumboNode* node, const QString & path)
+{
+    if ((node->type != GUMBO_NODE_ELEMENT) && (node->type != GUMBO_NODE_TEMPLATE)) {
+        return;
+    }
+    // The same pieces get_qwebpath_to_node puts together
+    QString prefix = path;
+    if (!prefix.isEmpty()) {
+        prefix.append(",");
+    }
+    prefix.append(QString::fromStdString(get_tag_name(node)) + " ");
+    GumboVector* children = &node->v.element.children;
+    QVector<GumboNode*> elements;
+    int elnum = 0;
+    for (unsigned int i = 0; i < children->length; ++i) {
+        GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+        bool is_text = (child->type == GUMBO_NODE_TEXT) || (child->type == GUMBO_NODE_WHITESPACE);
+        QString child_path = prefix + QString::number(is_text ? i : elnum);
+        m_nodeindex->paths.insert(child, child_path);
+        if ((child->type == GUMBO_NODE_ELEMENT) || (child->type == GUMBO_NODE_TEMPLATE)) {
+            m_nodeindex->starts.push_back(std::make_pair(child->v.element.start_pos.offset, child));
+            elements.append(child);
+            elnum++;
+            index_children(child, child_path);
+        } else {
+            m_nodeindex->starts.push_back(std::make_pair(child->v.text.start_pos.offset, child));
+        }
+    }
+    m_nodeindex->elements.insert(node, elements);
+}
+
+
+GumboNode* GumboInterface::get_node_at_offset(unsigned int offset)
+{
+    build_node_index();
+    const std::vector<std::pair<unsigned int, GumboNode*> > &starts = m_nodeindex->starts;
+    std::vector<std::pair<unsigned int, GumboNode*> >::const_iterator it =
+        std::upper_bound(starts.begin(), starts.end(), offset, offset_before);
+    if (it == starts.begin()) {
+        return NULL;
+    }
+    // The last node to start at or before offset, or the first of its
+    // ancestors still open there
+    GumboNode* node = (it - 1)->second;
+    while (node->parent && !node_contains(node, offset)) {
+        node = node->parent;
+    }
+    return node;
+}
+
+
 QString GumboInterface::get_qwebpath_to_node(GumboNode* node) 
 {
+    if (!m_nodeindex.isNull()) {
+        QHash<GumboNode*, QString>::const_iterator it = m_nodeindex->paths.constFind(node);
+        if (it != m_nodeindex->paths.constEnd()) {
+            return it.value();
+        }
+    }
     QStringList path_pieces;
     GumboNode* anode = node;
     while (anode && !((anode->type == GUMBO_NODE_ELEMENT) && (anode->v.element.tag == GUMBO_TAG_HTML))) {
@@ -391,6 +793,12 @@ QString GumboInterface::get_qwebpath_to_node(GumboNode* node)
 
 GumboNode* GumboInterface::get_node_from_qwebpath(QString webpath) 
 {
+    if (!m_nodeindex.isNull()) {
+        QHash<QString, GumboNode*>::const_iterator it = m_nodeindex->resolved.constFind(webpath);
+        if (it != m_nodeindex->resolved.constEnd()) {
+            return it.value();
+        }
+    }
     QStringList path_pieces = webpath.split(",", QString::SkipEmptyParts);
     GumboNode* node = get_root_node();
     GumboNode* end_node = node;
@@ -410,6 +818,11 @@ GumboNode* GumboInterface::get_node_from_qwebpath(QString webpath)
                 if (index >= children->length) index = children->length - 1;
                 if (index < 0) index = 0;
                 next_node = static_cast<GumboNode*>(children->data[index]);
+            } else if (!m_nodeindex.isNull()) {
+                const QVector<GumboNode*> elements = m_nodeindex->elements.value(node);
+                if ((index >= 0) && (index < elements.count())) {
+                    next_node = elements.at(index);
+                }
             } else {
                 // need to index correct child index when only counting elements
                 int elnum = -1;
@@ -432,6 +845,9 @@ GumboNode* GumboInterface::get_node_from_qwebpath(QString webpath)
             }
          }
      }
+     if (!m_nodeindex.isNull()) {
+         m_nodeindex->resolved.insert(webpath, end_node);
+     }
      return end_node;
 }
 
@@ -505,30 +921,50 @@ QList<GumboWellFormedError> GumboInterface::error_check()
     myoptions.stop_on_first_error = false;
     myoptions.max_tree_depth = 400;
     myoptions.max_errors = -1;
+    // No tree is kept for the errors alone, so only what the parser
+    // needs of one is built, and it is dropped straight after
+    myoptions.errors_only = true;
+
+    GumboOutput *output = m_output;
+    QScopedPointer<GumboArena> arena;
+    std::string checked;
 
     if (!m_source.isEmpty() && (m_output == NULL)) {
 
-        m_utf8src = m_source.toStdString();
-        // remove any xml header line and trailing whitespace
-        if (m_utf8src.compare(0,5,"<?xml") == 0) {
-            size_t end = m_utf8src.find_first_of('>', 0);
-            end = m_utf8src.find_first_not_of("\n\r\t\v\f ",end+1);
-            m_utf8src.erase(0,end);
+        std::string utf8src = m_source.toStdString();
+        // skip any xml header line and trailing whitespace
+        size_t start = xml_header_length(utf8src);
+        if (start > 0) {
             line_offset++;
         }
         // add in epub version specific doctype if missing
-        if ((m_utf8src.compare(0,9,"<!DOCTYPE") != 0) && (m_utf8src.compare(0,9,"<!doctype") != 0)) {
+        std::string doctype;
+        if ((utf8src.compare(start,9,"<!DOCTYPE") != 0) && (utf8src.compare(start,9,"<!doctype") != 0)) {
             if (m_version.startsWith('3')) {
-                m_utf8src.insert(0,"<!DOCTYPE html>\n");
+                doctype = "<!DOCTYPE html>\n";
             } else {
-                m_utf8src.insert(0, "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.1//EN\"\n  \"http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd\">\n\n");
+                doctype = "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.1//EN\"\n  \"http://www.w3.org/TR/xhtml11/DTD/xhtml11.dtd\">\n\n";
             }
             line_offset--;
         }
-        m_output = gumbo_parse_with_options(&myoptions, m_utf8src.data(), m_utf8src.length());
+        // Only copied when a doctype has to go in front; otherwise the
+        // header is skipped by parsing from an offset
+        if (doctype.empty()) {
+            checked.swap(utf8src);
+        } else {
+            checked.reserve(doctype.length() + utf8src.length() - start);
+            checked.append(doctype);
+            checked.append(utf8src, start, std::string::npos);
+            start = 0;
+        }
+        arena.reset(new GumboArena());
+        GumboArena::Scope scope(arena.data());
+        output = gumbo_parse_with_options(&myoptions, checked.data() + start, checked.length() - start);
     }
-    // qDebug() << QString::fromStdString(m_utf8src);
-    const GumboVector* errors  = &m_output->errors;
+    if (output == NULL) {
+        return errlist;
+    }
+    const GumboVector* errors  = &output->errors;
     for (unsigned int i=0; i< errors->length; ++i) {
         GumboError* er = static_cast<GumboError*>(errors->data[i]);
         GumboWellFormedError gperror;
@@ -544,6 +980,10 @@ QList<GumboWellFormedError> GumboInterface::error_check()
         gumbo_string_buffer_destroy(&text);
         errlist.append(gperror);
     }
+    if (output != m_output) {
+        GumboArena::Scope scope(arena.data());
+        gumbo_destroy_output(output);
+    }
     return errlist;
 }
 
@@ -567,8 +1007,11 @@ QList<GumboWellFormedError> GumboInterface::fragment_error_check()
     if (!m_source.isEmpty() && (m_output == NULL)) {
 
         m_utf8src = m_source.toStdString();
+        m_arena.reset(new GumboArena());
+        GumboArena::Scope scope(m_arena.data());
         m_output = gumbo_parse_fragment(&myoptions, m_utf8src.data(), m_utf8src.length(),
 					GUMBO_TAG_BODY, GUMBO_NAMESPACE_HTML);
+        m_reparsable = false;
     }
     const GumboVector* errors  = &m_output->errors;
     for (unsigned int i=0; i< errors->length; ++i) {
@@ -651,6 +1094,67 @@ QStringList  GumboInterface::get_values_for_attr(GumboNode* node, const char* at
 }
 
 
+QStringList GumboInterface::get_all_references()
+{
+    QStringList references;
+    if (!m_source.isEmpty()) {
+        if (m_output == NULL) {
+            parse();
+        }
+        get_references(m_output->root, references);
+    }
+    return references;
+}
+
+
+// Mirrors what serialize() hands to update_attribute_value and update_style_urls
+void GumboInterface::get_references(GumboNode* node, QStringList & references)
+{
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return;
+    }
+    bool is_href_src_tag = tag_properties(node) & HrefSrcTag;
+    QStringList style_sources;
+    const GumboVector * attribs = &node->v.element.attributes;
+    for (unsigned int i = 0; i < attribs->length; ++i) {
+        GumboAttribute* at = static_cast<GumboAttribute*>(attribs->data[i]);
+        std::string local_name = at->name;
+        if (is_href_src_tag && (local_name == aHREF || local_name == aSRC ||
+                                local_name == aPOSTER || local_name == aDATA)) {
+            references.append(QString::fromUtf8(at->value));
+        } else if (local_name == "style") {
+            style_sources.append(QString::fromUtf8(at->value));
+        }
+    }
+    GumboVector* children = &node->v.element.children;
+    if ((node->v.element.tag == GUMBO_TAG_STYLE) &&
+        (node->parent->type == GUMBO_NODE_ELEMENT) &&
+        (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
+        for (unsigned int i = 0; i < children->length; ++i) {
+            GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+            if (child->type == GUMBO_NODE_TEXT || child->type == GUMBO_NODE_CDATA) {
+                style_sources.append(QString::fromUtf8(child->v.text.text));
+            }
+        }
+    }
+    QRegularExpression reference(STYLE_URL_SEARCH);
+    foreach(QString style_source, style_sources) {
+        QRegularExpressionMatchIterator mi = reference.globalMatch(style_source);
+        while (mi.hasNext()) {
+            QRegularExpressionMatch mo = mi.next();
+            for (int i = 1; i <= reference.captureCount(); ++i) {
+                if (!mo.captured(i).trimmed().isEmpty()) {
+                    references.append(mo.captured(i));
+                }
+            }
+        }
+    }
+    for (unsigned int i = 0; i < children->length; ++i) {
+        get_references(static_cast<GumboNode*>(children->data[i]), references);
+    }
+}
+
+
 QHash<QString,QString> GumboInterface::get_attributes_of_node(GumboNode* node)
 {
     QHash<QString,QString> node_atts;
@@ -741,12 +1245,33 @@ QList<GumboNode*>  GumboInterface::get_nodes_with_tags(GumboNode* node, const QL
 }
 
 
-bool GumboInterface::in_set(std::unordered_set<std::string> &s, std::string &key)
+bool GumboInterface::in_set(const std::unordered_set<std::string> &s, const std::string &key)
 {
   return s.find(key) != s.end();
 }
 
 
+unsigned int GumboInterface::tag_properties(GumboNode *node)
+{
+  if ((node->type != GUMBO_NODE_ELEMENT) && (node->type != GUMBO_NODE_TEMPLATE)) {
+    return 0;
+  }
+  GumboTag tag = node->v.element.tag;
+  if ((tag == GUMBO_TAG_UNKNOWN) || (tag >= GUMBO_TAG_LAST) ||
+      (node->v.element.tag_namespace == GUMBO_NAMESPACE_SVG)) {
+    return properties_of_name(get_tag_name(node));
+  }
+  return tag_property_table.properties[tag];
+}
+
+
+bool GumboInterface::is_element_tag(GumboNode *node, GumboTag tag)
+{
+  return ((node->type == GUMBO_NODE_ELEMENT) || (node->type == GUMBO_NODE_TEMPLATE)) &&
+         (node->v.element.tag == tag);
+}
+
+
 void GumboInterface::rtrim(std::string &s) 
 {
     s.erase(s.find_last_not_of(" \n\r\t\v\f")+1);
@@ -828,6 +1353,7 @@ std::string GumboInterface::update_attribute_value(const std::string &attvalue)
         new_href += fragment;
         new_href = Utility::URLEncodePath(new_href);
         result =  new_href.toStdString();
+        m_updatesmade = true;
     } 
     return result;
 }
@@ -837,14 +1363,7 @@ std::string GumboInterface::update_style_urls(const std::string &source)
 {
     QString result = QString::fromStdString(source);
     // Now parse the text once looking urls and replacing them where needed
-    QRegularExpression reference(
-        "(?:(?:src|background|background-image|list-style|list-style-image|border-image|border-image-source|content)\\s*:|@import)\\s*"
-        "[^;\\}\\(\"']*"
-        "(?:"
-        "url\\([\"']?([^\\(\\)\"']*)[\"']?\\)"
-        "|"
-        "[\"']([^\\(\\)\"']*)[\"']"
-        ")");
+    QRegularExpression reference(STYLE_URL_SEARCH);
     int start_index = 0;
     QRegularExpressionMatch mo = reference.match(result, start_index);
     do {
@@ -855,12 +1374,13 @@ std::string GumboInterface::update_style_urls(const std::string &source)
             QString apath = Utility::URLDecodePath(mo.captured(i));
             QString search_key = QDir::cleanPath(m_currentdir + FORWARD_SLASH + apath);
             QString new_href;
-            if (m_sourceupdates.contains(search_key)) {
-                new_href = m_sourceupdates.value(search_key);
+            if (m_styleupdates.contains(search_key)) {
+                new_href = m_styleupdates.value(search_key);
             }
             if (!new_href.isEmpty()) {
                 new_href = Utility::URLEncodePath(new_href);
                 result.replace(mo.capturedStart(i), mo.capturedLength(i), new_href);
+                m_updatesmade = true;
             }
         }
         start_index += mo.capturedLength();
@@ -872,25 +1392,45 @@ std::string GumboInterface::update_style_urls(const std::string &source)
 
 
 
+// Appends text with &, <, > and the quote character, if any, replaced
+// by entities, in one pass and without a temporary copy
+void GumboInterface::append_xml_escaped(std::string &out, const char *text, size_t len, char quote)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < len; ++i) {
+        const char *entity = NULL;
+        switch (text[i]) {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': if (quote == '"') entity = "&quot;"; break;
+            case '\'': if (quote == '\'') entity = "&apos;"; break;
+            default: break;
+        }
+        if (entity) {
+            out.append(text + run, i - run);
+            out.append(entity);
+            run = i + 1;
+        }
+    }
+    out.append(text + run, len - run);
+}
+
+
 std::string GumboInterface::substitute_xml_entities_into_text(const std::string &text)
 {
-    std::string result = text;
-    // replacing & must come first 
-    replace_all(result, "&", "&amp;");
-    replace_all(result, "<", "&lt;");
-    replace_all(result, ">", "&gt;");
+    std::string result;
+    result.reserve(text.length());
+    append_xml_escaped(result, text.data(), text.length(), 0);
     return result;
 }
 
 
 std::string GumboInterface::substitute_xml_entities_into_attributes(char quote, const std::string &text)
 {
-    std::string result = substitute_xml_entities_into_text(text);
-    if (quote == '"') {
-        replace_all(result,"\"","&quot;");
-    } else if (quote == '\'') {
-        replace_all(result,"'","&apos;");
-    }
+    std::string result;
+    result.reserve(text.length());
+    append_xml_escaped(result, text.data(), text.length(), quote);
     return result;
 }
 
@@ -980,13 +1520,12 @@ std::string GumboInterface::get_attribute_name(GumboAttribute * at)
 }
 
 
-std::string GumboInterface::build_attributes(GumboAttribute * at, bool no_entities, 
-                                             bool run_src_updates, bool run_style_updates)
+void GumboInterface::build_attributes(std::string &out, GumboAttribute * at, bool no_entities,
+                                      bool run_src_updates, bool run_style_updates)
 {
-    std::string atts = " ";
-    std::string name = get_attribute_name(at);
+    out.append(" ");
+    out.append(get_attribute_name(at));
     std::string local_name = at->name;
-    atts.append(name);
     std::string attvalue = at->value;
 
     if (run_src_updates && (local_name == aHREF || local_name == aSRC || 
@@ -1000,7 +1539,7 @@ std::string GumboInterface::build_attributes(GumboAttribute * at, bool no_entiti
 
     // we handle empty attribute values like so: alt=""
     char quote = '"';
-    std::string qs="\"";
+    char qs = '"';
 
     // verify an original value existed since we create our own attributes
     // and if so determine the original quote character used if any
@@ -1011,61 +1550,85 @@ std::string GumboInterface::build_attributes(GumboAttribute * at, bool no_entiti
              (at->original_value.data[0] == '\'') ) {
 
           quote = at->original_value.data[0];
-          if (quote == '\'') qs = std::string("'");
-          if (quote == '"') qs = std::string("\"");
+          if (quote == '\'') qs = '\'';
+          if (quote == '"') qs = '"';
         }
     }
 
-    atts.append("=");
-    atts.append(qs);
+    out.push_back('=');
+    out.push_back(qs);
     if (no_entities) {
-        atts.append(attvalue);
+        out.append(attvalue);
     } else {
-        atts.append(substitute_xml_entities_into_attributes(quote, attvalue));
+        append_xml_escaped(out, attvalue.data(), attvalue.length(), quote);
     }
-    atts.append(qs);
-    return atts;
+    out.push_back(qs);
+}
+
+
+// The serialized output is about the size of the source; reserving that
+// up front saves growing the buffer over and over
+size_t GumboInterface::estimated_output_size() const
+{
+    size_t estimate = qMax(m_utf8src.length(), size_t(m_source.length()));
+    return estimate + estimate / 16;
+}
+
+
+std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes doupdates)
+{
+    std::string contents;
+    contents.reserve(estimated_output_size());
+    serialize_contents(node, doupdates, contents);
+    return contents;
+}
+
+
+std::string GumboInterface::serialize(GumboNode* node, enum UpdateTypes doupdates)
+{
+    std::string results;
+    results.reserve(estimated_output_size());
+    serialize(node, doupdates, results);
+    return results;
 }
 
 
 // serialize children of a node
-// may be invoked recursively
+// may be invoked recursively, everything is appended to out
 
-std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes doupdates) {
-    std::string contents        = "";
-    std::string tagname         = get_tag_name(node);
-    bool no_entity_substitution = in_set(no_entity_sub, tagname);
-    bool keep_whitespace        = in_set(preserve_whitespace, tagname);
-    bool is_inline              = in_set(nonbreaking_inline, tagname);
-    bool is_structural          = in_set(structural_tags, tagname);
+void GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes doupdates, std::string &out) {
+    unsigned int properties     = tag_properties(node);
+    bool no_entity_substitution = properties & NoEntitySub;
+    bool keep_whitespace        = properties & PreserveWhitespace;
+    bool is_inline              = properties & NonbreakingInline;
+    bool is_structural          = properties & StructuralTag;
 
     // build up result for each child, recursively if need be
     GumboVector* children = &node->v.element.children;
 
     bool inject_newline = false;
-    bool in_head_without_title = (tagname == "head");
+    bool in_head_without_title = is_element_tag(node, GUMBO_TAG_HEAD);
 
     for (unsigned int i = 0; i < children->length; ++i) {
         GumboNode* child = static_cast<GumboNode*> (children->data[i]);
 
         if (child->type == GUMBO_NODE_TEXT) {
-            std::string text;
+            // entity substitution never changes a leading newline
+            const char * text = child->v.text.text;
+            if (inject_newline && (text[0] == '\n')) text++;
+            inject_newline = false;
             if (no_entity_substitution) {
-                text = std::string(child->v.text.text);
+                out.append(text);
             } else {
-                text = substitute_xml_entities_into_text(std::string(child->v.text.text));
+                append_xml_escaped(out, text, strlen(text), 0);
             }
-            if (inject_newline && !text.empty() && (text.at(0) == '\n')) text.erase(0,1);
-            inject_newline = false;
-            contents.append(text);
 
         } else if (child->type == GUMBO_NODE_ELEMENT || child->type == GUMBO_NODE_TEMPLATE) {
-            contents.append(serialize(child, doupdates));
+            serialize(child, doupdates, out);
             inject_newline = false;
-            std::string childname = get_tag_name(child);
-            if (in_head_without_title && (childname == "title")) in_head_without_title = false;
-            if (!is_inline && !keep_whitespace && !in_set(nonbreaking_inline,childname) && is_structural) {
-                contents.append("\n");
+            if (in_head_without_title && is_element_tag(child, GUMBO_TAG_TITLE)) in_head_without_title = false;
+            if (!is_inline && !keep_whitespace && !(tag_properties(child) & NonbreakingInline) && is_structural) {
+                out.append("\n");
                 inject_newline = true;
             }
 
@@ -1076,15 +1639,19 @@ std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes
                 newlinetrim(wspace);
                 inject_newline = false;
             }
-            contents.append(wspace);
+            out.append(wspace);
             inject_newline = false;
 
         } else if (child->type == GUMBO_NODE_CDATA) {
-            contents.append("<![CDATA[" + std::string(child->v.text.text) + "]]>");
+            out.append("<![CDATA[");
+            out.append(child->v.text.text);
+            out.append("]]>");
             inject_newline = false;
 
         } else if (child->type == GUMBO_NODE_COMMENT) {
-            contents.append("<!--" + std::string(child->v.text.text) + "-->");
+            out.append("<!--");
+            out.append(child->v.text.text);
+            out.append("-->");
  
         } else {
             fprintf(stderr, "unknown element of type: %d\n", child->type); 
@@ -1092,98 +1659,115 @@ std::string GumboInterface::serialize_contents(GumboNode* node, enum UpdateTypes
         }
 
     }
-    if (in_head_without_title) contents.append("<title></title>");
-    return contents;
+    if (in_head_without_title) out.append("<title></title>");
 }
 
 
 // serialize a GumboNode back to html/xhtml
-// may be invoked recursively
+// may be invoked recursively, everything is appended to out
 
-std::string GumboInterface::serialize(GumboNode* node, enum UpdateTypes doupdates) {
+void GumboInterface::serialize(GumboNode* node, enum UpdateTypes doupdates, std::string &out) {
     // special case the document node
     if (node->type == GUMBO_NODE_DOCUMENT) {
-        std::string results = build_doctype(node);
-        results.append(serialize_contents(node, doupdates));
-        return results;
+        out.append(build_doctype(node));
+        serialize_contents(node, doupdates, out);
+        return;
     }
 
-    std::string close = "";
-    std::string closeTag = "";
-    std::string atts = "";
     std::string tagname            = get_tag_name(node);
-    bool need_special_handling     = in_set(special_handling, tagname);
-    bool is_void_tag               = in_set(void_tags, tagname);
-    bool no_entity_substitution    = in_set(no_entity_sub, tagname);
-    bool is_href_src_tag           = in_set(href_src_tags, tagname);
+    unsigned int properties        = tag_properties(node);
+    bool need_special_handling     = properties & SpecialHandling;
+    bool is_void_tag               = properties & VoidTag;
+    bool no_entity_substitution    = properties & NoEntitySub;
+    bool is_href_src_tag           = properties & HrefSrcTag;
     bool in_xml_ns                 = node->v.element.tag_namespace != GUMBO_NAMESPACE_HTML;
-    // bool is_inline                 = in_set(nonbreaking_inline, tagname);
+    // bool is_inline                 = properties & NonbreakingInline;
+
+    // the old links in the head are dropped, the new ones go in at its end
+    if ((doupdates & LinkUpdates) && (tagname == "link") && 
+        (node->parent->type == GUMBO_NODE_ELEMENT) && 
+        (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
+      return;
+    }
+
+    out.append("<");
+    out.append(tagname);
 
     // build attr string  
+    size_t atts_start = out.length();
     const GumboVector * attribs = &node->v.element.attributes;
     for (unsigned int i=0; i< attribs->length; ++i) {
         GumboAttribute* at = static_cast<GumboAttribute*>(attribs->data[i]);
-        atts.append(build_attributes(at, no_entity_substitution, ((doupdates & SourceUpdates) && is_href_src_tag), (doupdates & StyleUpdates)));
+        build_attributes(out, at, no_entity_substitution, ((doupdates & SourceUpdates) && is_href_src_tag), (doupdates & StyleUpdates));
     }
 
     // Make sure that the xmlns attribute exists as an html tag attribute
     if (tagname == "html") {
-      if (atts.find("xmlns=") == std::string::npos) {
-        atts.append(" xmlns=\"http://www.w3.org/1999/xhtml\"");
+      if (out.find("xmlns=", atts_start) == std::string::npos) {
+        out.append(" xmlns=\"http://www.w3.org/1999/xhtml\"");
       }
     }
 
-    // determine contents
-    std::string contents;
+    // the contents go straight in after the start tag, which gets
+    // its / once it is known whether the contents are empty
+    size_t close_pos = out.length();
+    out.append(">");
+    size_t contents_start = out.length();
 
     if ((tagname == "body") && (doupdates & BodyUpdates)) {
-        contents = m_newbody;
+        out.append(m_newbody);
     } else {
         // serialize your contents
-        contents = serialize_contents(node, doupdates);
+        serialize_contents(node, doupdates, out);
     }
 
     // determine closing tag type
-    std::string testcontents = contents;
-    ltrim(testcontents);
-    if (is_void_tag || (in_xml_ns && testcontents.empty())) {
-        close = "/";
-    } else {
-        closeTag = "</" + tagname + ">";
+    bool contents_empty = out.find_first_not_of(" \n\r\t\v\f", contents_start) == std::string::npos;
+    bool self_closed = is_void_tag || (in_xml_ns && contents_empty);
+    if (self_closed) {
+        out.insert(close_pos, 1, '/');
+        contents_start++;
     }
 
     if ((doupdates & StyleUpdates) && (tagname == "style") && 
         (node->parent->type == GUMBO_NODE_ELEMENT) && 
         (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
-        contents = update_style_urls(contents);
+        std::string contents = out.substr(contents_start);
+        out.erase(contents_start);
+        out.append(update_style_urls(contents));
     }
 
     if (need_special_handling) {
-        ltrimnewlines(contents);
-        rtrim(contents);
-        contents.append("\n");
-    }
-
-    // build results
-    std::string results;
-
-    if ((doupdates & LinkUpdates) && (tagname == "link") && 
-        (node->parent->type == GUMBO_NODE_ELEMENT) && 
-        (node->parent->v.element.tag == GUMBO_TAG_HEAD)) {
-      return "";
+        // a newline after the start tag, then the contents with leading
+        // newlines and trailing whitespace trimmed, then a newline
+        size_t last = out.find_last_not_of(" \n\r\t\v\f");
+        if ((last == std::string::npos) || (last < contents_start)) {
+            out.erase(contents_start);
+        } else {
+            out.erase(last + 1);
+        }
+        size_t first = out.find_first_not_of("\n\r", contents_start);
+        if (first == std::string::npos) first = out.length();
+        if (first > contents_start) {
+            // reuse one of the leading newlines rather than moving the contents
+            out.erase(contents_start + 1, first - contents_start - 1);
+            out[contents_start] = '\n';
+        } else {
+            out.insert(contents_start, 1, '\n');
+        }
+        out.append("\n");
     }
 
-    results.append("<"+tagname+atts+close+">");
-    if (need_special_handling) results.append("\n");
-    results.append(contents);
-
     if ((doupdates & LinkUpdates) && (tagname == "head")) {
-        results.append(m_newcsslinks);
+        out.append(m_newcsslinks);
     }
 
-    results.append(closeTag);
-    if (need_special_handling) results.append("\n");
-    return results;
+    if (!self_closed) {
+        out.append("</");
+        out.append(tagname);
+        out.append(">");
+    }
+    if (need_special_handling) out.append("\n");
 }
 
 
@@ -1191,11 +1775,13 @@ std::string GumboInterface::serialize(GumboNode* node, enum UpdateTypes doupdate
 std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const std::string indent_chars) 
 {
     std::string contents        = "";
-    std::string tagname         = get_tag_name(node);
-    bool no_entity_substitution = in_set(no_entity_sub, tagname);
-    bool keep_whitespace        = in_set(preserve_whitespace, tagname);
-    bool is_inline              = in_set(nonbreaking_inline, tagname);
-    bool is_structural          = in_set(structural_tags, tagname);
+    unsigned int properties     = tag_properties(node);
+    bool no_entity_substitution = properties & NoEntitySub;
+    bool keep_whitespace        = properties & PreserveWhitespace;
+    bool is_inline              = properties & NonbreakingInline;
+    bool is_structural          = properties & StructuralTag;
+    bool is_head                = is_element_tag(node, GUMBO_TAG_HEAD);
+    bool is_html                = is_element_tag(node, GUMBO_TAG_HTML);
     char c                      = indent_chars.at(0);
     int  n                      = indent_chars.length(); 
     std::string indent_space    = std::string((lvl-1)*n,c);
@@ -1204,8 +1790,8 @@ std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const
 
     GumboVector* children = &node->v.element.children;
 
-    if (is_structural || (tagname == "#document")) last_char = '\n';
-    bool in_head_without_title = (tagname == "head");
+    if (is_structural || (node->type == GUMBO_NODE_DOCUMENT)) last_char = '\n';
+    bool in_head_without_title = is_head;
 
     for (unsigned int i = 0; i < children->length; ++i) {
 
@@ -1217,7 +1803,7 @@ std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const
             if (no_entity_substitution) {
                 val = std::string(child->v.text.text);
             } else {
-                val = substitute_xml_entities_into_text(std::string(child->v.text.text));
+                append_xml_escaped(val, child->v.text.text, strlen(child->v.text.text), 0);
             }
 
             // if child of a structual element is text and follows a newline, indent it properly
@@ -1234,18 +1820,18 @@ std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const
         } else if (child->type == GUMBO_NODE_ELEMENT || child->type == GUMBO_NODE_TEMPLATE) {
 
             std::string val = prettyprint(child, lvl, indent_chars);
-            std::string childname = get_tag_name(child);
-            if (in_head_without_title && (childname == "title")) in_head_without_title = false;
-            if (!in_set(nonbreaking_inline, childname)) {
+            bool child_is_inline = tag_properties(child) & NonbreakingInline;
+            if (in_head_without_title && is_element_tag(child, GUMBO_TAG_TITLE)) in_head_without_title = false;
+            if (!child_is_inline) {
                 contains_block_tags = true;
                 if (last_char != '\n') {
                     contents.append("\n");
-                    if (tagname != "head" && tagname != "html") contents.append("\n");
+                    if (!is_head && !is_html) contents.append("\n");
                     last_char='\n';
                 }
             }
             // if child of a structual element is inline and follows a newline, indent it properly
-            if (is_structural && in_set(nonbreaking_inline, childname) && (last_char == '\n')) {
+            if (is_structural && child_is_inline && (last_char == '\n')) {
                 contents.append(indent_space);
                 ltrim(val);
             }    
@@ -1256,7 +1842,7 @@ std::string GumboInterface::prettyprint_contents(GumboNode* node, int lvl, const
             if (keep_whitespace) {
                 std::string wspace = std::string(child->v.text.text);
                 contents.append(wspace);
-            } else if (is_inline || in_set(other_text_holders, tagname)) {
+            } else if (is_inline || (properties & OtherTextHolder)) {
                 if (std::string(" \t\v\f\r\n").find(last_char) == std::string::npos) {
                     contents.append(std::string(" "));
                 }
@@ -1310,23 +1896,23 @@ std::string GumboInterface::prettyprint(GumboNode* node, int lvl, const std::str
     }
 
     std::string tagname = get_tag_name(node);
-    std::string parentname = get_tag_name(node->parent);
-    bool in_head = (parentname == "head");
+    unsigned int properties = tag_properties(node);
+    bool in_head = is_element_tag(node->parent, GUMBO_TAG_HEAD);
 
-    bool is_structural = in_set(structural_tags, tagname);
-    bool is_inline = in_set(nonbreaking_inline, tagname);
+    bool is_structural = properties & StructuralTag;
+    bool is_inline = properties & NonbreakingInline;
     bool in_xml_ns = node->v.element.tag_namespace != GUMBO_NAMESPACE_HTML;
 
     // build attr string
     std::string atts = "";
-    bool no_entity_substitution = in_set(no_entity_sub, tagname);
+    bool no_entity_substitution = properties & NoEntitySub;
     const GumboVector * attribs = &node->v.element.attributes;
     for (unsigned int i=0; i< attribs->length; ++i) {
         GumboAttribute* at = static_cast<GumboAttribute*>(attribs->data[i]);
-        atts.append(build_attributes(at, no_entity_substitution));
+        build_attributes(atts, at, no_entity_substitution);
     }
 
-    bool is_void_tag = in_set(void_tags, tagname);
+    bool is_void_tag = properties & VoidTag;
 
     // get tag contents
     std::string contents = "";
@@ -1338,15 +1924,14 @@ std::string GumboInterface::prettyprint(GumboNode* node, int lvl, const std::str
         }
     }
 
-    bool keep_whitespace = in_set(preserve_whitespace, tagname);
+    bool keep_whitespace = properties & PreserveWhitespace;
     if (!keep_whitespace && !is_inline) {
         rtrim(contents);
     }
 
-    std::string testcontents = contents;
-    ltrim(testcontents);
+    bool blank = contents.find_first_not_of(" \n\r\t\v\f") == std::string::npos;
 
-    bool single = is_void_tag || (in_xml_ns && testcontents.empty());
+    bool single = is_void_tag || (in_xml_ns && blank);
 
     char c = indent_chars.at(0);
     int  n = indent_chars.length(); 
@@ -1357,7 +1942,7 @@ std::string GumboInterface::prettyprint(GumboNode* node, int lvl, const std::str
         std::string selfclosetag = "<" + tagname + atts + "/>";
         if (is_inline) {
             // always add newline after br tags when they are children of structural tags
-            if ((tagname == "br") && in_set(structural_tags, parentname)) {
+            if ((tagname == "br") && (tag_properties(node->parent) & StructuralTag)) {
               selfclosetag.append("\n");
               if (!in_head && (tagname != "html")) selfclosetag.append("\n");
             }
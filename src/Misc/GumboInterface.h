@@ -29,10 +29,12 @@
 
 #include "gumbo.h"
 #include "gumbo_edit.h"
+#include "Misc/GumboArena.h"
 
 #include <QString>
 #include <QList>
 #include <QHash>
+#include <QSharedPointer>
 
 class QString;
 
@@ -42,15 +44,71 @@ struct GumboWellFormedError {
   QString message;
 };
 
+// A parse tree that is never changed once built, so any number of
+// GumboInterfaces can read it at once, on any thread.  It is kept in
+// gumbo's compact form, so it holds no parse errors.
+class GumboTree
+{
+public:
+
+    GumboTree(const QString &source);
+    ~GumboTree();
+
+    const QString & source() const;
+    // the buffer the tree was parsed from; the original_text of the
+    // nodes points into it
+    const std::string & utf8source() const;
+    GumboOutput * output() const;
+
+    // approximate memory held, in bytes
+    qint64 size() const;
+
+    // the bytes the parser used to build the tree, before it was compacted
+    qint64 parse_size() const;
+
+private:
+
+    Q_DISABLE_COPY(GumboTree)
+
+    QString      m_source;
+    std::string  m_utf8src;
+    GumboOutput* m_output;
+    qint64       m_parsesize;
+};
+
+// Safe for concurrent independent parses: every GumboInterface owns its
+// source, parse tree and arena, and all the tables shared between them
+// are const and built during static initialization.  One instance must
+// not be used from two threads at once, though any number of instances
+// may read the same GumboTree.  The update hashes passed in are held by
+// reference and only read, so they must outlive the instance and not be
+// changed while it is in use.  The gumbo allocator hooks are installed
+// once at startup by GumboArena and must not be changed afterwards.
 class GumboInterface
 {
 public:
 
     GumboInterface(const QString &source, const QString &version);
     GumboInterface(const QString &source, const QString &version, const QHash<QString, QString> &source_updates);
+
+    // source_updates are applied to href/src attributes, style_updates
+    // to the urls in style attributes and style elements
+    GumboInterface(const QString &source, const QString &version,
+                   const QHash<QString, QString> &source_updates,
+                   const QHash<QString, QString> &style_updates);
+
+    // reads a shared tree instead of parsing; only for queries and
+    // serializing, nothing may edit the nodes of a shared tree
+    GumboInterface(const QSharedPointer<const GumboTree> &tree, const QString &version);
     ~GumboInterface();
 
     void    parse();
+
+    // brings a tree built by parse() up to date with an edited source,
+    // reparsing only the element that changed when that is safe and
+    // doing a full parse otherwise; returns true if it was incremental
+    bool    reparse(const QString &source);
+
     QString repair();
     QString getxhtml();
     QString prettyprint(QString indent_chars="  ");
@@ -69,9 +127,24 @@ public:
     GumboNode* get_node_from_qwebpath(QString webpath);
     QString get_qwebpath_to_node(GumboNode* node);
 
+    // builds, in one walk of the tree, the side table the path routines
+    // above use instead of walking the tree on every call; worth it when
+    // many lookups are made on the same parse, it is dropped when the
+    // tree is reparsed
+    void build_node_index();
+
+    // returns the innermost node the source offset (counted in bytes
+    // after any xml header, like the start_pos of the nodes) falls in,
+    // building the node index if need be
+    GumboNode* get_node_at_offset(unsigned int offset);
+
     // routines for updating while serializing (see SourceUpdates and AnchorUpdates
     QString perform_source_updates(const QString & my_current_book_relpath);
     QString perform_style_updates(const QString & my_current_book_relpath);
+    QString perform_source_and_style_updates(const QString & my_current_book_relpath);
+
+    // true if the last perform_*_updates call rewrote any reference
+    bool updates_made() const;
     QString perform_link_updates(const QString & newlinks);
     QString get_body_contents();
     QString perform_body_updates(const QString & new_body);
@@ -81,6 +154,11 @@ public:
     QStringList get_all_values_for_attribute(const QString & attname);
     QHash<QString,QString> get_attributes_of_node(GumboNode* node);
 
+    // returns, undecoded, every reference that perform_source_updates and
+    // perform_style_updates would look at: href/src/poster/data attributes
+    // and the urls in style attributes and head style elements
+    QStringList get_all_references();
+
     // routines for working with nodes with specific tags
     QList<GumboNode*> get_all_nodes_with_tag(GumboTag tag);
     QList<GumboNode*> get_all_nodes_with_tags(const QList<GumboTag> & tags);
@@ -113,10 +191,22 @@ private:
 
     QStringList get_values_for_attr(GumboNode* node, const char* attr_name);
 
+    void get_references(GumboNode* node, QStringList & references);
+
+    // adds the children of node, whose qwebpath is path, to m_nodeindex
+    void index_children(GumboNode* node, const QString & path);
+
     std::string serialize(GumboNode* node, enum UpdateTypes doupdates = NoUpdates);
 
     std::string serialize_contents(GumboNode* node, enum UpdateTypes doupdates = NoUpdates);
 
+    // the same, appending to out instead of building temporaries
+    void serialize(GumboNode* node, enum UpdateTypes doupdates, std::string &out);
+
+    void serialize_contents(GumboNode* node, enum UpdateTypes doupdates, std::string &out);
+
+    size_t estimated_output_size() const;
+
     std::string prettyprint(GumboNode* node, int lvl, const std::string indent_chars);
 
     std::string prettyprint_contents(GumboNode* node, int lvl, const std::string indent_chars);
@@ -125,7 +215,7 @@ private:
 
     std::string get_attribute_name(GumboAttribute * at);
 
-    std::string build_attributes(GumboAttribute * at, bool no_entities, bool run_src_updates = false, bool run_style_updates = false);
+    void build_attributes(std::string &out, GumboAttribute * at, bool no_entities, bool run_src_updates = false, bool run_style_updates = false);
 
     std::string update_attribute_value(const std::string &href);
 
@@ -135,7 +225,14 @@ private:
 
     std::string substitute_xml_entities_into_attributes(char quote, const std::string &text);
 
-    bool in_set(std::unordered_set<std::string> &s, std::string &key);
+    static void append_xml_escaped(std::string &out, const char *text, size_t len, char quote);
+
+    static bool in_set(const std::unordered_set<std::string> &s, const std::string &key);
+
+    // the TagProperty bits of an element, 0 for anything else
+    unsigned int tag_properties(GumboNode *node);
+
+    static bool is_element_tag(GumboNode *node, GumboTag tag);
 
     void rtrim(std::string &s);
 
@@ -153,13 +250,21 @@ private:
     // QString fix_self_closing_tags(const QString & source);
 
     QString                         m_source;
+    QSharedPointer<const GumboTree> m_tree;
     GumboOutput*                    m_output;
     std::string                     m_utf8src;
+    QSharedPointer<GumboArena>      m_arena;
     const QHash<QString, QString> & m_sourceupdates;
+    const QHash<QString, QString> & m_styleupdates;
+    bool                            m_updatesmade;
     std::string                     m_newcsslinks;
     QString                         m_currentdir;
     std::string                     m_newbody;
     QString                         m_version;
+    bool                            m_reparsable;
+
+    struct NodeIndex;
+    QSharedPointer<NodeIndex>       m_nodeindex;
     
 };
 
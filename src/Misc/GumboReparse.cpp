@@ -0,0 +1,768 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include "Misc/GumboReparse.h"
+
+// How many enclosing elements are tried before giving up
+static const int MAX_ATTEMPTS = 3;
+
+struct Region {
+    size_t content_start;
+    size_t content_end;
+};
+
+struct Cursor {
+    size_t offset;
+    unsigned int line;
+    unsigned int column;
+};
+
+struct Splice {
+    const char *old_source;
+    size_t old_length;
+    const char *new_source;
+    size_t new_length;
+    ptrdiff_t delta;
+
+    // Old offsets: the first changed byte, and the end of the content
+    // of the reparsed element, where the unchanged rest begins
+    size_t edit_start;
+    size_t kept_start;
+
+    // Old positions past the first line break after the edit only move
+    // by whole lines; the ones before it are recomputed
+    size_t line_break;
+    int line_delta;
+
+    GumboNode *element;
+    size_t content_start;
+    size_t fragment_length;
+
+    std::vector<GumboSourcePosition *> recompute;
+};
+
+
+// Elements whose contents parse the same however deeply they are nested
+// in one another below body: none of them is closed by a start tag, and
+// nothing inside them looks past them up the stack.
+static bool IsBlockContainer(GumboTag tag)
+{
+    switch (tag) {
+        case GUMBO_TAG_DIV:
+        case GUMBO_TAG_SECTION:
+        case GUMBO_TAG_ARTICLE:
+        case GUMBO_TAG_ASIDE:
+        case GUMBO_TAG_NAV:
+        case GUMBO_TAG_HEADER:
+        case GUMBO_TAG_FOOTER:
+        case GUMBO_TAG_MAIN:
+        case GUMBO_TAG_BLOCKQUOTE:
+        case GUMBO_TAG_FIGURE:
+        case GUMBO_TAG_FIGCAPTION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Inline elements that close nothing above them when they start.
+// <a> does close an open <a>, which is checked for separately.
+static bool IsInlineContent(GumboTag tag)
+{
+    switch (tag) {
+        case GUMBO_TAG_A:
+        case GUMBO_TAG_ABBR:
+        case GUMBO_TAG_ACRONYM:
+        case GUMBO_TAG_B:
+        case GUMBO_TAG_BDI:
+        case GUMBO_TAG_BDO:
+        case GUMBO_TAG_BIG:
+        case GUMBO_TAG_BR:
+        case GUMBO_TAG_CITE:
+        case GUMBO_TAG_CODE:
+        case GUMBO_TAG_DATA:
+        case GUMBO_TAG_DEL:
+        case GUMBO_TAG_DFN:
+        case GUMBO_TAG_EM:
+        case GUMBO_TAG_FONT:
+        case GUMBO_TAG_I:
+        case GUMBO_TAG_IMG:
+        case GUMBO_TAG_INS:
+        case GUMBO_TAG_KBD:
+        case GUMBO_TAG_LABEL:
+        case GUMBO_TAG_MARK:
+        case GUMBO_TAG_Q:
+        case GUMBO_TAG_S:
+        case GUMBO_TAG_SAMP:
+        case GUMBO_TAG_SMALL:
+        case GUMBO_TAG_SPAN:
+        case GUMBO_TAG_STRIKE:
+        case GUMBO_TAG_STRONG:
+        case GUMBO_TAG_SUB:
+        case GUMBO_TAG_SUP:
+        case GUMBO_TAG_TIME:
+        case GUMBO_TAG_TT:
+        case GUMBO_TAG_U:
+        case GUMBO_TAG_VAR:
+        case GUMBO_TAG_WBR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Elements whose contents do not parse as plain body content, either
+// because of their tokenizer state or insertion mode, or because the
+// newline right after their start tag is dropped
+static bool IsSpecialContext(GumboTag tag)
+{
+    switch (tag) {
+        case GUMBO_TAG_HTML:
+        case GUMBO_TAG_HEAD:
+        case GUMBO_TAG_BODY:
+        case GUMBO_TAG_FRAMESET:
+        case GUMBO_TAG_TEMPLATE:
+        case GUMBO_TAG_TABLE:
+        case GUMBO_TAG_TBODY:
+        case GUMBO_TAG_THEAD:
+        case GUMBO_TAG_TFOOT:
+        case GUMBO_TAG_TR:
+        case GUMBO_TAG_COLGROUP:
+        case GUMBO_TAG_SELECT:
+        case GUMBO_TAG_OPTION:
+        case GUMBO_TAG_OPTGROUP:
+        case GUMBO_TAG_RUBY:
+        case GUMBO_TAG_RB:
+        case GUMBO_TAG_RT:
+        case GUMBO_TAG_RTC:
+        case GUMBO_TAG_RP:
+        case GUMBO_TAG_BUTTON:
+        case GUMBO_TAG_SCRIPT:
+        case GUMBO_TAG_STYLE:
+        case GUMBO_TAG_TITLE:
+        case GUMBO_TAG_TEXTAREA:
+        case GUMBO_TAG_XMP:
+        case GUMBO_TAG_IFRAME:
+        case GUMBO_TAG_NOEMBED:
+        case GUMBO_TAG_NOFRAMES:
+        case GUMBO_TAG_NOSCRIPT:
+        case GUMBO_TAG_PLAINTEXT:
+        case GUMBO_TAG_PRE:
+        case GUMBO_TAG_LISTING:
+        case GUMBO_TAG_UNKNOWN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+static bool IsElement(const GumboNode *node)
+{
+    return node->type == GUMBO_NODE_ELEMENT || node->type == GUMBO_NODE_TEMPLATE;
+}
+
+
+// The bytes between the start and end tag, if both were in the source
+static bool FindContent(const GumboNode *node, const char *source, size_t length, Region &region)
+{
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return false;
+    }
+
+    const GumboElement &element = node->v.element;
+
+    // A self-closed element gets its start tag as end tag
+    if (element.original_tag.length == 0 || element.original_end_tag.length == 0 ||
+        element.original_tag.data != source + element.start_pos.offset ||
+        element.original_end_tag.data != source + element.end_pos.offset) {
+        return false;
+    }
+
+    region.content_start = element.start_pos.offset + element.original_tag.length;
+    region.content_end = element.end_pos.offset;
+    return region.content_start <= region.content_end && region.content_end <= length;
+}
+
+
+// Moves a cursor to target the way gumbo's Utf8Iterator counts lines
+// and columns: a CR LF pair is one newline, a lone CR is a newline, tabs
+// go to the next stop and only the first byte of a code point counts.
+static void Advance(const char *source, size_t length, Cursor &cursor, size_t target, int tab_stop)
+{
+    target = std::min(target, length);
+
+    while (cursor.offset < target) {
+        unsigned char c = source[cursor.offset];
+
+        if (c == '\n' || (c == '\r' && !(cursor.offset + 1 < length && source[cursor.offset + 1] == '\n'))) {
+            cursor.line++;
+            cursor.column = 1;
+        } else if (c == '\t') {
+            cursor.column = ((cursor.column / tab_stop) + 1) * tab_stop;
+        } else if (c != '\r' && (c & 0xC0) != 0x80) {
+            cursor.column++;
+        }
+
+        cursor.offset++;
+    }
+}
+
+
+// The old tree outside the reparsed contents: pointers go over to the
+// new buffer and positions after the edit are shifted
+static void MovePiece(Splice &splice, GumboStringPiece &piece)
+{
+    if (piece.data < splice.old_source || piece.data > splice.old_source + splice.old_length) {
+        return;
+    }
+
+    size_t offset = piece.data - splice.old_source;
+
+    if (offset >= splice.kept_start) {
+        offset += splice.delta;
+    }
+
+    piece.data = splice.new_source + std::min(offset, splice.new_length);
+}
+
+
+static void ShiftPosition(Splice &splice, GumboSourcePosition &position)
+{
+    // Positions inside the old contents are never reached; anything
+    // out of range was never set, e.g. the value of an empty attribute
+    if (position.offset < splice.kept_start || position.offset > splice.old_length) {
+        return;
+    }
+
+    bool later_line = position.offset > splice.line_break;
+    position.offset += splice.delta;
+
+    if (later_line) {
+        position.line = (unsigned int)(int(position.line) + splice.line_delta);
+    } else {
+        splice.recompute.push_back(&position);
+    }
+}
+
+
+// The new contents: parsed in place, so only the positions, which are
+// relative to the start of the fragment, need fixing
+static void PlacePosition(Splice &splice, GumboSourcePosition &position)
+{
+    if (position.offset > splice.fragment_length) {
+        return;
+    }
+
+    position.offset += splice.content_start;
+    splice.recompute.push_back(&position);
+}
+
+
+static void FixNode(Splice &splice, GumboNode *node, bool in_fragment)
+{
+    if (node->type == GUMBO_NODE_DOCUMENT) {
+        GumboVector &children = node->v.document.children;
+
+        for (unsigned int i = 0; i < children.length; ++i) {
+            FixNode(splice, static_cast<GumboNode *>(children.data[i]), in_fragment);
+        }
+
+        return;
+    }
+
+    if (!IsElement(node)) {
+        GumboText &text = node->v.text;
+
+        if (in_fragment) {
+            PlacePosition(splice, text.start_pos);
+        } else {
+            MovePiece(splice, text.original_text);
+            ShiftPosition(splice, text.start_pos);
+        }
+
+        return;
+    }
+
+    GumboElement &element = node->v.element;
+
+    if (in_fragment) {
+        PlacePosition(splice, element.start_pos);
+        PlacePosition(splice, element.end_pos);
+    } else {
+        MovePiece(splice, element.original_tag);
+        MovePiece(splice, element.original_end_tag);
+        ShiftPosition(splice, element.start_pos);
+        ShiftPosition(splice, element.end_pos);
+    }
+
+    for (unsigned int i = 0; i < element.attributes.length; ++i) {
+        GumboAttribute *attribute = static_cast<GumboAttribute *>(element.attributes.data[i]);
+
+        if (in_fragment) {
+            PlacePosition(splice, attribute->name_start);
+            PlacePosition(splice, attribute->name_end);
+            PlacePosition(splice, attribute->value_start);
+            PlacePosition(splice, attribute->value_end);
+        } else {
+            MovePiece(splice, attribute->original_name);
+            MovePiece(splice, attribute->original_value);
+            ShiftPosition(splice, attribute->name_start);
+            ShiftPosition(splice, attribute->name_end);
+            ShiftPosition(splice, attribute->value_start);
+            ShiftPosition(splice, attribute->value_end);
+        }
+    }
+
+    bool children_in_fragment = in_fragment || node == splice.element;
+
+    for (unsigned int i = 0; i < element.children.length; ++i) {
+        FixNode(splice, static_cast<GumboNode *>(element.children.data[i]), children_in_fragment);
+    }
+}
+
+
+static bool ComparePositions(const GumboSourcePosition *first, const GumboSourcePosition *second)
+{
+    return first->offset < second->offset;
+}
+
+
+// Every node of the fragment must be just what a full parse would have
+// built in its place
+static bool IsPlainContent(const GumboNode *node, bool inline_only, bool allow_links)
+{
+    if (node->parse_flags != GUMBO_INSERTION_NORMAL) {
+        return false;
+    }
+
+    if (!IsElement(node)) {
+        return true;
+    }
+
+    const GumboElement &element = node->v.element;
+
+    if (inline_only) {
+        if (element.tag_namespace != GUMBO_NAMESPACE_HTML || !IsInlineContent(element.tag)) {
+            return false;
+        }
+
+        if (element.tag == GUMBO_TAG_A && !allow_links) {
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0; i < element.children.length; ++i) {
+        if (!IsPlainContent(static_cast<const GumboNode *>(element.children.data[i]), inline_only, allow_links)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void CollectEndTags(const GumboNode *node, std::vector<const char *> &end_tags)
+{
+    if (!IsElement(node)) {
+        return;
+    }
+
+    const GumboElement &element = node->v.element;
+
+    if (element.original_end_tag.length != 0) {
+        end_tags.push_back(element.original_end_tag.data);
+    }
+
+    for (unsigned int i = 0; i < element.children.length; ++i) {
+        CollectEndTags(static_cast<const GumboNode *>(element.children.data[i]), end_tags);
+    }
+}
+
+
+// A fragment parse drops an end tag with nothing open to match it, and
+// says nothing; a full parse would close an element above the fragment
+// with it. So every end tag in the source must close an element of the
+// fragment. Anything that merely looks like one, in a comment or an
+// attribute, is counted as well, which only costs a full parse.
+static bool HasStrayEndTag(const GumboNode *root, const char *source, size_t length)
+{
+    std::vector<const char *> end_tags;
+
+    for (unsigned int i = 0; i < root->v.element.children.length; ++i) {
+        CollectEndTags(static_cast<const GumboNode *>(root->v.element.children.data[i]), end_tags);
+    }
+
+    std::sort(end_tags.begin(), end_tags.end());
+
+    for (size_t i = 0; i + 2 < length; ++i) {
+        if (source[i] != '<' || source[i + 1] != '/') {
+            continue;
+        }
+
+        char c = source[i + 2];
+
+        if (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) &&
+            !std::binary_search(end_tags.begin(), end_tags.end(), source + i)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static GumboOutput *ParseContents(GumboNode *element, const GumboOptions &options, int depth,
+                                  const char *source, size_t length,
+                                  bool inline_only, bool allow_links)
+{
+    GumboOptions fragment_options = options;
+    fragment_options.max_tree_depth = options.max_tree_depth - depth;
+
+    if (int(fragment_options.max_tree_depth) <= 0) {
+        return NULL;
+    }
+
+    GumboOutput *fragment = gumbo_parse_fragment(&fragment_options, source, length,
+                                                 element->v.element.tag, GUMBO_NAMESPACE_HTML);
+    bool plain = fragment->status == GUMBO_STATUS_OK && fragment->errors.length == 0 && fragment->root;
+
+    if (plain) {
+        const GumboVector &children = fragment->root->v.element.children;
+
+        for (unsigned int i = 0; plain && i < children.length; ++i) {
+            plain = IsPlainContent(static_cast<const GumboNode *>(children.data[i]), inline_only, allow_links);
+        }
+
+        plain = plain && !HasStrayEndTag(fragment->root, source, length);
+    }
+
+    if (!plain) {
+        gumbo_destroy_output(fragment);
+        return NULL;
+    }
+
+    return fragment;
+}
+
+
+bool GumboReparse::Apply(GumboOutput *output, const GumboOptions &options,
+                         const char *old_source, size_t old_length,
+                         const char *new_source, size_t new_length)
+{
+    // A tree with errors may hold reconstructed or foster parented
+    // nodes whose effects reach past any one element.
+    if (output == NULL || output->root == NULL || output->status != GUMBO_STATUS_OK || output->errors.length != 0) {
+        return false;
+    }
+
+    size_t limit = std::min(old_length, new_length);
+    size_t prefix = 0;
+
+    while (prefix < limit && old_source[prefix] == new_source[prefix]) {
+        prefix++;
+    }
+
+    size_t suffix = 0;
+
+    while (suffix < limit - prefix &&
+           old_source[old_length - 1 - suffix] == new_source[new_length - 1 - suffix]) {
+        suffix++;
+    }
+
+    Splice splice;
+    splice.old_source = old_source;
+    splice.old_length = old_length;
+    splice.new_source = new_source;
+    splice.new_length = new_length;
+    splice.delta = ptrdiff_t(new_length) - ptrdiff_t(old_length);
+    splice.edit_start = prefix;
+    splice.line_break = old_length;
+    splice.line_delta = 0;
+    splice.element = NULL;
+    splice.content_start = 0;
+    splice.fragment_length = 0;
+
+    size_t old_end = old_length - suffix;
+
+    if (prefix == old_length && old_length == new_length) {
+        // The same text in another buffer
+        splice.kept_start = old_length;
+        FixNode(splice, output->document, false);
+        return true;
+    }
+
+    // The elements, outermost first, whose contents hold the whole edit
+    std::vector<GumboNode *> enclosing;
+    std::vector<Region> regions;
+    GumboNode *node = output->root;
+
+    while (node) {
+        GumboNode *next = NULL;
+        const GumboVector &children = node->v.element.children;
+
+        for (unsigned int i = 0; i < children.length; ++i) {
+            GumboNode *child = static_cast<GumboNode *>(children.data[i]);
+            Region region;
+
+            if (child->type == GUMBO_NODE_ELEMENT && FindContent(child, old_source, old_length, region) &&
+                region.content_start <= prefix && old_end <= region.content_end) {
+                enclosing.push_back(child);
+                regions.push_back(region);
+                next = child;
+                break;
+            }
+        }
+
+        node = next;
+    }
+
+    GumboOutput *fragment = NULL;
+    int attempts = 0;
+    int index = int(enclosing.size()) - 1;
+
+    for (; index >= 0 && attempts < MAX_ATTEMPTS; --index) {
+        GumboNode *element = enclosing.at(index);
+        const GumboElement &e = element->v.element;
+
+        if (e.tag == GUMBO_TAG_BODY) {
+            break;
+        }
+
+        if (e.tag_namespace != GUMBO_NAMESPACE_HTML || IsSpecialContext(e.tag) ||
+            element->parse_flags != GUMBO_INSERTION_NORMAL) {
+            continue;
+        }
+
+        // What lies above decides what the contents may hold
+        bool blocks_above = true;
+        bool plain_above = true;
+        bool link_above = e.tag == GUMBO_TAG_A;
+
+        for (int i = index - 1; i >= 0; --i) {
+            const GumboNode *ancestor = enclosing.at(i);
+            GumboTag tag = ancestor->v.element.tag;
+
+            if (tag == GUMBO_TAG_BODY) {
+                break;
+            }
+
+            blocks_above = blocks_above && IsBlockContainer(tag);
+            link_above = link_above || tag == GUMBO_TAG_A;
+
+            if (ancestor->v.element.tag_namespace != GUMBO_NAMESPACE_HTML ||
+                ancestor->parse_flags != GUMBO_INSERTION_NORMAL ||
+                tag == GUMBO_TAG_HEAD || tag == GUMBO_TAG_TEMPLATE || tag == GUMBO_TAG_SELECT ||
+                tag == GUMBO_TAG_OPTION || tag == GUMBO_TAG_OPTGROUP || tag == GUMBO_TAG_RUBY) {
+                plain_above = false;
+            }
+        }
+
+        if (!plain_above) {
+            continue;
+        }
+
+        bool inline_only = !(IsBlockContainer(e.tag) && blocks_above);
+        const Region &region = regions.at(index);
+        size_t fragment_length = region.content_end + splice.delta - region.content_start;
+
+        // A fragment that starts on the CR of a CR LF has the text
+        // after it start a byte earlier than a full parse does
+        if (fragment_length > 0 && new_source[region.content_start] == '\r') {
+            continue;
+        }
+        attempts++;
+
+        // html and every enclosing element are open above the contents
+        fragment = ParseContents(element, options, index + 2, new_source + region.content_start,
+                                 fragment_length, inline_only, !link_above);
+
+        if (fragment) {
+            splice.element = element;
+            splice.content_start = region.content_start;
+            splice.kept_start = region.content_end;
+            splice.fragment_length = fragment_length;
+            break;
+        }
+    }
+
+    if (fragment == NULL) {
+        return false;
+    }
+
+    const GumboElement &element = splice.element->v.element;
+    int tab_stop = options.tab_stop;
+    Cursor start;
+    start.offset = element.start_pos.offset;
+    start.line = element.start_pos.line;
+    start.column = element.start_pos.column;
+
+    // The first line break at or after the edit, in the unchanged bytes
+    for (size_t i = old_end; i < old_length; ++i) {
+        if (old_source[i] == '\n' || (old_source[i] == '\r' && !(i + 1 < old_length && old_source[i + 1] == '\n'))) {
+            splice.line_break = i;
+            Cursor old_cursor = start;
+            Cursor new_cursor = start;
+            Advance(old_source, old_length, old_cursor, i + 1, tab_stop);
+            Advance(new_source, new_length, new_cursor, i + 1 + splice.delta, tab_stop);
+            splice.line_delta = int(new_cursor.line) - int(old_cursor.line);
+            break;
+        }
+    }
+
+    // The new children take the place of the old ones, which go with
+    // the fragment
+    GumboNode *root = fragment->root;
+    std::swap(splice.element->v.element.children, root->v.element.children);
+    GumboVector &children = splice.element->v.element.children;
+
+    for (unsigned int i = 0; i < children.length; ++i) {
+        GumboNode *child = static_cast<GumboNode *>(children.data[i]);
+        child->parent = splice.element;
+        child->index_within_parent = i;
+    }
+
+    FixNode(splice, output->document, false);
+
+    // One pass through the new source for the positions that need
+    // their line and column worked out again
+    std::stable_sort(splice.recompute.begin(), splice.recompute.end(), ComparePositions);
+    Cursor cursor = start;
+
+    for (size_t i = 0; i < splice.recompute.size(); ++i) {
+        GumboSourcePosition *position = splice.recompute.at(i);
+
+        Advance(new_source, new_length, cursor, position->offset, tab_stop);
+        position->line = cursor.line;
+        position->column = cursor.column;
+    }
+
+    gumbo_destroy_output(fragment);
+    return true;
+}
+
+
+static bool SamePosition(const GumboSourcePosition &first, const GumboSourcePosition &second)
+{
+    return first.offset == second.offset && first.line == second.line && first.column == second.column;
+}
+
+
+// Both pieces point into the same buffer, or both are unset
+static bool SamePiece(const GumboStringPiece &first, const GumboStringPiece &second)
+{
+    return first.data == second.data && first.length == second.length;
+}
+
+
+static bool SameString(const char *first, const char *second)
+{
+    if (first == NULL || second == NULL) {
+        return first == second;
+    }
+
+    return strcmp(first, second) == 0;
+}
+
+
+static bool SameNode(const GumboNode *first, const GumboNode *second)
+{
+    if (first->type != second->type || first->parse_flags != second->parse_flags ||
+        first->index_within_parent != second->index_within_parent) {
+        return false;
+    }
+
+    const GumboVector *first_children;
+    const GumboVector *second_children;
+
+    if (first->type == GUMBO_NODE_DOCUMENT) {
+        first_children = &first->v.document.children;
+        second_children = &second->v.document.children;
+    } else if (!IsElement(first)) {
+        const GumboText &a = first->v.text;
+        const GumboText &b = second->v.text;
+        return SameString(a.text, b.text) && SamePiece(a.original_text, b.original_text) &&
+               SamePosition(a.start_pos, b.start_pos);
+    } else {
+        const GumboElement &a = first->v.element;
+        const GumboElement &b = second->v.element;
+
+        if (a.tag != b.tag || a.tag_namespace != b.tag_namespace ||
+            !SamePiece(a.original_tag, b.original_tag) || !SamePiece(a.original_end_tag, b.original_end_tag) ||
+            !SamePosition(a.start_pos, b.start_pos) || !SamePosition(a.end_pos, b.end_pos) ||
+            a.attributes.length != b.attributes.length) {
+            return false;
+        }
+
+        for (unsigned int i = 0; i < a.attributes.length; ++i) {
+            const GumboAttribute *x = static_cast<const GumboAttribute *>(a.attributes.data[i]);
+            const GumboAttribute *y = static_cast<const GumboAttribute *>(b.attributes.data[i]);
+
+            if (x->attr_namespace != y->attr_namespace || !SameString(x->name, y->name) ||
+                !SameString(x->value, y->value) ||
+                !SamePiece(x->original_name, y->original_name) || !SamePiece(x->original_value, y->original_value) ||
+                !SamePosition(x->name_start, y->name_start) || !SamePosition(x->name_end, y->name_end)) {
+                return false;
+            }
+
+            // An attribute without a value has its name as original
+            // value, and its value positions are never set
+            if (x->original_value.data != x->original_name.data &&
+                (!SamePosition(x->value_start, y->value_start) || !SamePosition(x->value_end, y->value_end))) {
+                return false;
+            }
+        }
+
+        first_children = &a.children;
+        second_children = &b.children;
+    }
+
+    if (first_children->length != second_children->length) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < first_children->length; ++i) {
+        if (!SameNode(static_cast<const GumboNode *>(first_children->data[i]),
+                      static_cast<const GumboNode *>(second_children->data[i]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+bool GumboReparse::MatchesFullParse(const GumboOutput *output, const GumboOptions &options,
+                                    const char *source, size_t length)
+{
+    GumboOutput *full = gumbo_parse_with_options(&options, source, length);
+    bool same = output->status == full->status && output->errors.length == full->errors.length &&
+                SameNode(output->document, full->document);
+    gumbo_destroy_output(full);
+    return same;
+}
@@ -0,0 +1,77 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef GUMBOREPARSE_H
+#define GUMBOREPARSE_H
+
+#include <stddef.h>
+
+#include "gumbo.h"
+
+/**
+ * Brings a Gumbo parse tree up to date with an edited copy of its source
+ * by reparsing only the element the edit falls in.
+ *
+ * The changed byte range is found by comparing the two buffers. The
+ * smallest element that has explicit start and end tags around that
+ * range is reparsed as a fragment in its own context, and the new
+ * children are spliced in. The rest of the tree is moved over to the new
+ * buffer, and the source positions after the edit are shifted.
+ *
+ * This is only done when a full parse is certain to give the same tree.
+ * The old tree and the fragment must parse without errors or implied
+ * elements. What the fragment may contain depends on the element:
+ * - a plain block container (div, section, ...) that only has block
+ *   containers above it up to body may take any content;
+ * - any other element only takes inline content that can never close
+ *   an element above it.
+ * Everything else, including edits to tags, the head or a table
+ * structure, needs a full parse.
+ */
+class GumboReparse
+{
+public:
+
+    /**
+     * @param output A tree parsed from old_source with options.
+     * @param new_source Must stay alive as long as the tree; on success
+     *        the tree points into it instead of old_source.
+     * @return true if the tree now matches new_source. false if a full
+     *         parse is needed; the tree is then unchanged.
+     */
+    static bool Apply(GumboOutput *output, const GumboOptions &options,
+                      const char *old_source, size_t old_length,
+                      const char *new_source, size_t new_length);
+
+    /**
+     * Checks a tree against a full parse of its source, node by node,
+     * with every source position and original text. The tree must
+     * point into source. Used to test Apply.
+     *
+     * @return true if a full parse with options gives the same tree.
+     */
+    static bool MatchesFullParse(const GumboOutput *output, const GumboOptions &options,
+                                 const char *source, size_t length);
+};
+
+#endif // GUMBOREPARSE_H
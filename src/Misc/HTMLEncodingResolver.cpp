@@ -22,6 +22,7 @@
 *************************************************************************/
 
 #include <string>
+#include <string.h>
 
 #include <QtCore/QFile>
 #include <QtCore/QString>
@@ -137,6 +138,30 @@ const QTextCodec *HTMLEncodingResolver::GetCodecForHTML(const QByteArray &raw_te
 }
 
 
+// Whether all eight bytes are printable ASCII (0x20 to 0x7E),
+// which is most of any HTML file.
+static inline bool IsPrintableAscii(quint64 block)
+{
+    const quint64 ones  = Q_UINT64_C(0x0101010101010101);
+    const quint64 highs = Q_UINT64_C(0x8080808080808080);
+
+    // A byte of 0x80 or above
+    if (block & highs) {
+        return false;
+    }
+
+    // With the high bits clear, a byte below 0x20 borrows into its own high bit
+    // and a byte of 0x7F carries into it; neither can reach the next byte.
+    return !(((block - 0x20 * ones) | (block + ones)) & highs);
+}
+
+
+static inline bool InRange(unsigned char byte, unsigned char low, unsigned char high)
+{
+    return low <= byte && byte <= high;
+}
+
+
 // This function goes through the entire byte array
 // and tries to see whether this is a valid UTF-8 sequence.
 // If it's valid, this is probably a UTF-8 string.
@@ -149,62 +174,65 @@ bool HTMLEncodingResolver::IsValidUtf8(const QByteArray &string)
     // checks if the sent byte-sequence conforms to this pattern.
     // If it does, chances are *very* high that this is UTF-8.
     //
-    // This function is written to be fast, not pretty.
+    // The bytes are read in place; runs of printable ASCII are
+    // checked eight bytes at a time.
     if (string.isNull()) {
         return false;
     }
 
-    int index = 0;
+    const unsigned char *bytes = (const unsigned char *) string.constData();
+    const unsigned char *end = bytes + string.size();
 
-    while (index < string.size()) {
-        QByteArray dword = string.mid(index, 4);
+    while (bytes < end) {
+        if (end - bytes >= 8) {
+            quint64 block;
+            memcpy(&block, bytes, sizeof(block));
 
-        if (dword.size() < 4) {
-            dword = dword.leftJustified(4, '\0');
+            if (IsPrintableAscii(block)) {
+                bytes += 8;
+                continue;
+            }
         }
 
-        const unsigned char *bytes = (const unsigned char *) dword.constData();
+        unsigned char lead = bytes[0];
+        ptrdiff_t left = end - bytes;
 
         // ASCII
-        if (bytes[0] == 0x09 ||
-            bytes[0] == 0x0A ||
-            bytes[0] == 0x0D ||
-            (0x20 <= bytes[0] && bytes[0] <= 0x7E)
-           ) {
-            index += 1;
+        if (lead < 0x80) {
+            if (lead != 0x09 && lead != 0x0A && lead != 0x0D && !InRange(lead, 0x20, 0x7E)) {
+                return false;
+            }
+            bytes += 1;
         }
         // non-overlong 2-byte
-        else if ((0xC2 <= bytes[0] && bytes[0] <= 0xDF) &&
-                 (0x80 <= bytes[1] && bytes[1] <= 0xBF)
-                ) {
-            index += 2;
-        } else if ((bytes[0] == 0xE0                         &&              // excluding overlongs
-                    (0xA0 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF)) ||
-                   (((0xE1 <= bytes[0] && bytes[0] <= 0xEC) ||               // straight 3-byte
-                     bytes[0] == 0xEE                         ||
-                     bytes[0] == 0xEF) &&
-                    (0x80 <= bytes[1] && bytes[1] <= 0xBF)   &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF)) ||
-                   (bytes[0] == 0xED                         &&              // excluding surrogates
-                    (0x80 <= bytes[1] && bytes[1] <= 0x9F) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF))
-                  ) {
-            index += 3;
-        } else if ((bytes[0] == 0xF0                         &&              // planes 1-3
-                    (0x90 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF)) ||
-                   ((0xF1 <= bytes[0] && bytes[0] <= 0xF3) &&              // planes 4-15
-                    (0x80 <= bytes[1] && bytes[1] <= 0xBF) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF)) ||
-                   (bytes[0] == 0xF4                         &&            // plane 16
-                    (0x80 <= bytes[1] && bytes[1] <= 0x8F) &&
-                    (0x80 <= bytes[2] && bytes[2] <= 0xBF) &&
-                    (0x80 <= bytes[3] && bytes[3] <= 0xBF))
-                  ) {
-            index += 4;
+        else if (InRange(lead, 0xC2, 0xDF)) {
+            if (left < 2 || !InRange(bytes[1], 0x80, 0xBF)) {
+                return false;
+            }
+            bytes += 2;
+        }
+        // 3-byte, excluding overlongs (E0) and surrogates (ED)
+        else if (InRange(lead, 0xE0, 0xEF)) {
+            unsigned char low  = lead == 0xE0 ? 0xA0 : 0x80;
+            unsigned char high = lead == 0xED ? 0x9F : 0xBF;
+
+            if (left < 3 || !InRange(bytes[1], low, high) || !InRange(bytes[2], 0x80, 0xBF)) {
+                return false;
+            }
+            bytes += 3;
+        }
+        // 4-byte, planes 1-3 (F0), 4-15 and 16 (F4)
+        else if (InRange(lead, 0xF0, 0xF4)) {
+            unsigned char low  = lead == 0xF0 ? 0x90 : 0x80;
+            unsigned char high = lead == 0xF4 ? 0x8F : 0xBF;
+
+            if (left < 4 ||
+                !InRange(bytes[1], low, high) ||
+                !InRange(bytes[2], 0x80, 0xBF) ||
+                !InRange(bytes[3], 0x80, 0xBF)) {
+                return false;
+            }
+            bytes += 4;
         } else {
             return false;
         }
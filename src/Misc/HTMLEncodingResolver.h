@@ -23,7 +23,9 @@
 #ifndef HTMLEncodingResolver_H
 #define HTMLEncodingResolver_H
 
+class QByteArray;
 class QString;
+class QTextCodec;
 
 class HTMLEncodingResolver
 {
@@ -35,8 +37,6 @@ public:
     // and returns the text converted to Unicode.
     static QString ReadHTMLFile(const QString &fullfilepath);
 
-private:
-
     // Accepts an HTML stream and tries to determine its encoding;
     // if no encoding is detected, the default codec for this locale is returned.
     // We use this function because Qt's QTextCodec::codecForHtml() function
@@ -21,11 +21,12 @@
 
 #include <QtCore/QString>
 #include <QtCore/QTextCodec>
+#include <QtCore/QThreadStorage>
 #include <QRegularExpression>
 
 #include "Misc/HTMLEncodingResolver.h"
 #include "Misc/Utility.h"
-#include "Misc/SettingsStore.h"
+#include "Misc/SettingsSnapshot.h"
 #include "Misc/SpellCheck.h"
 #include "Misc/HTMLSpellCheck.h"
 #include "sigil_constants.h"
@@ -33,12 +34,165 @@
 
 const int MAX_WORD_LENGTH  = 90;
 
+// The text is searched as if it had a space before and after it
+static inline QChar PaddedAt(const QString &text, int i)
+{
+    if (i <= 0 || i > text.length()) {
+        return QChar(' ');
+    }
+
+    return text.at(i - 1);
+}
+
+
+// The end of the <style> block at pos, or -1 if there is none. Blocks
+// are what <style[^<]*</style> matches.
+static int StyleBlockEnd(const QString &text, int pos)
+{
+    static const QString style_start = "<style";
+    static const QString style_end = "</style>";
+
+    if (text.midRef(pos, style_start.length()) != style_start) {
+        return -1;
+    }
+
+    int close = text.indexOf(QChar('<'), pos + style_start.length());
+
+    if (close == -1 || text.midRef(close, style_end.length()) != style_end) {
+        return -1;
+    }
+
+    return close + style_end.length();
+}
+
+
+// An element open at the point the text has been read up to
+struct LanguageScope {
+    QString name;
+    QString lang;
+};
+
+// Elements that have no end tag, so never hold text
+static bool IsVoidElement(const QString &name)
+{
+    static const QStringList void_elements = QStringList() << "area" << "base" << "br" << "col"
+                                             << "embed" << "hr" << "img" << "input" << "link"
+                                             << "meta" << "param" << "source" << "track" << "wbr";
+    return void_elements.contains(name);
+}
+
+// Reads the tag at pos, a '<', into the elements open around the text
+// after it, each with the language its text is in. Comments, doctypes
+// and processing instructions are passed over.
+static void TrackLanguage(const QString &text, int pos, QList<LanguageScope> &scopes)
+{
+    static const QRegularExpression lang_attribute("(?:^|\\s)(?:xml:)?lang\\s*=\\s*(\"|')([^\"']*)\\1");
+    int end = text.indexOf(QChar('>'), pos);
+
+    if (end == -1) {
+        return;
+    }
+
+    int name_start = pos + 1;
+    bool is_end_tag = name_start < end && text.at(name_start) == QChar('/');
+
+    if (is_end_tag) {
+        name_start++;
+    }
+
+    if (name_start >= end || !text.at(name_start).isLetter()) {
+        return;
+    }
+
+    int name_end = name_start;
+
+    while (name_end < end && !text.at(name_end).isSpace() && text.at(name_end) != QChar('/')) {
+        name_end++;
+    }
+
+    QString name = text.mid(name_start, name_end - name_start).toLower();
+
+    if (is_end_tag) {
+        for (int i = scopes.count() - 1; i >= 0; --i) {
+            if (scopes.at(i).name == name) {
+                scopes.erase(scopes.begin() + i, scopes.end());
+                break;
+            }
+        }
+
+        return;
+    }
+
+    if (text.at(end - 1) == QChar('/') || IsVoidElement(name)) {
+        return;
+    }
+
+    LanguageScope scope;
+    scope.name = name;
+
+    if (!scopes.isEmpty()) {
+        scope.lang = scopes.last().lang;
+    }
+
+    if (text.midRef(name_end, end - name_end).contains("lang")) {
+        QRegularExpressionMatch match = lang_attribute.match(text.mid(name_end, end - name_end));
+
+        if (match.hasMatch()) {
+            scope.lang = match.captured(2).trimmed();
+        }
+    }
+
+    scopes.append(scope);
+}
+
+
+struct SearchFilter {
+    QString pattern;
+    QRegularExpression regex;
+};
+
+// The highlighter asks for every block with the same filter, so the
+// last one is kept compiled, one for each thread
+static QThreadStorage<SearchFilter *> s_SearchFilters;
+
+static const QRegularExpression &SearchFilterRegex(const QString &pattern)
+{
+    if (!s_SearchFilters.hasLocalData()) {
+        s_SearchFilters.setLocalData(new SearchFilter());
+    }
+
+    SearchFilter *filter = s_SearchFilters.localData();
+
+    if (filter->pattern != pattern) {
+        filter->pattern = pattern;
+        filter->regex = QRegularExpression(pattern);
+        filter->regex.optimize();
+    }
+
+    return filter->regex;
+}
+
+
 QList<HTMLSpellCheck::MisspelledWord> HTMLSpellCheck::GetMisspelledWords(const QString &orig_text,
         int start_offset,
         int end_offset,
         const QString &search_regex,
         bool first_only,
         bool include_all_words)
+{
+    QList<HTMLSpellCheck::MisspelledWord> misspellings;
+    FindWords(orig_text, start_offset, end_offset, search_regex, first_only, include_all_words, &misspellings);
+    return misspellings;
+}
+
+
+int HTMLSpellCheck::FindWords(const QString &orig_text,
+                              int start_offset,
+                              int end_offset,
+                              const QString &search_regex,
+                              bool first_only,
+                              bool include_all_words,
+                              QList<MisspelledWord> *misspellings)
 {
     SpellCheck *sc = SpellCheck::instance();
     QString wordChars = sc->getWordChars();
@@ -46,29 +200,35 @@ QList<HTMLSpellCheck::MisspelledWord> HTMLSpellCheck::GetMisspelledWords(const Q
     bool in_invalid_word = false;
     bool in_entity = false;
     int word_start = 0;
-    SettingsStore ss;
-    bool use_nums = ss.spellCheckNumbers();
-    QRegularExpression search(search_regex);
-    QList<HTMLSpellCheck::MisspelledWord> misspellings;
-    // Make sure text has beginning/end boundary markers for easier parsing
-    QString text = QChar(' ') + orig_text + QChar(' ');
-    // Ignore <style...</style> wherever it appears - change to spaces to keep text positions
-    QRegularExpression style_re("<style[^<]*</style>");
-
-    QRegularExpressionMatchIterator i = style_re.globalMatch(text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch match = i.next();
-        for (int pos = match.capturedStart(); pos < match.capturedEnd(); pos++) {
-            text[pos] = QChar(' ');
+    bool use_nums = CheckNumbers();
+    int found = 0;
+    // Positions are in the text with the boundary markers around it,
+    // as if it had them. <style...</style> is read as spaces.
+    const int length = orig_text.length() + 2;
+    int style_end = 0;
+    // Points into orig_text; set again for each word
+    QString word;
+    QList<LanguageScope> scopes;
+    QString lang;
+
+    for (int i = 0; i < length; i++) {
+        QChar c = PaddedAt(orig_text, i);
+
+        if (i >= style_end && c == QChar('<')) {
+            int end = StyleBlockEnd(orig_text, i - 1);
+
+            if (end != -1) {
+                style_end = end + 1;
+            }
         }
-    }
 
-    for (int i = 0; i < text.count(); i++) {
-        QChar c = text.at(i);
+        if (i < style_end) {
+            c = QChar(' ');
+        }
 
         if (!in_tag) {
-            QChar prev_c = i > 0 ? text.at(i - 1) : QChar(' ');
-            QChar next_c = i < text.count() - 1 ? text.at(i + 1) : QChar(' ');
+            QChar prev_c = PaddedAt(orig_text, i - 1);
+            QChar next_c = PaddedAt(orig_text, i + 1);
 
             if (IsBoundary(prev_c, c, next_c, wordChars, use_nums)) {
                 // If we're in an entity and we hit a boundary and it isn't
@@ -78,29 +238,26 @@ QList<HTMLSpellCheck::MisspelledWord> HTMLSpellCheck::GetMisspelledWords(const Q
                 }
 
                 // Check possibilities that would mean this isn't a word worth considering.
-                if (!in_invalid_word && !in_entity && word_start != -1 && (i - word_start) > 0) {
-                    QString word = Utility::Substring(word_start, i, text);
+                if (!in_invalid_word && !in_entity && word_start != -1 && (i - word_start) > 0 &&
+                    word_start > start_offset && word_start <= end_offset) {
+                    // Make sure we account for the extra boundary added at the beginning
+                    word.setRawData(orig_text.constData() + word_start - 1, i - word_start);
 
-                    if (!word.isEmpty() && word_start > start_offset && word_start <= end_offset) {
-                        if (include_all_words || !sc->spell(word)) {
-                            int cap_start = -1;
+                    if (include_all_words || !sc->spell(word, lang)) {
+                        if (search_regex.isEmpty() || SearchFilterRegex(search_regex).match(word).capturedStart() != -1) {
+                            found++;
 
-                            if (!search_regex.isEmpty()) {
-                                QRegularExpressionMatch mo = search.match(word);
-                                cap_start = mo.capturedStart();
-                            }
-
-                            if (search_regex.isEmpty() || cap_start != -1) {
+                            if (misspellings) {
                                 struct MisspelledWord misspelled_word;
-                                misspelled_word.text = word;
-                                // Make sure we account for the extra boundary added at the beginning
+                                misspelled_word.text = orig_text.mid(word_start - 1, i - word_start);
                                 misspelled_word.offset = word_start - 1;
                                 misspelled_word.length = i - word_start ;
-                                misspellings.append(misspelled_word);
+                                misspelled_word.lang = lang;
+                                misspellings->append(misspelled_word);
+                            }
 
-                                if (first_only) {
-                                    return misspellings;
-                                }
+                            if (first_only) {
+                                return found;
                             }
                         }
                     }
@@ -128,6 +285,11 @@ QList<HTMLSpellCheck::MisspelledWord> HTMLSpellCheck::GetMisspelledWords(const Q
         }
 
         if (c == QChar('<')) {
+            if (!in_tag) {
+                TrackLanguage(orig_text, i - 1, scopes);
+                lang = scopes.isEmpty() ? QString() : scopes.last().lang;
+            }
+
             in_tag = true;
             word_start = -1;
         }
@@ -138,7 +300,13 @@ QList<HTMLSpellCheck::MisspelledWord> HTMLSpellCheck::GetMisspelledWords(const Q
         }
     }
 
-    return misspellings;
+    return found;
+}
+
+
+bool HTMLSpellCheck::CheckNumbers()
+{
+    return SettingsSnapshot::Current()->spell_check_numbers;
 }
 
 bool HTMLSpellCheck::IsValidChar(const QChar & c, bool use_nums)
@@ -220,7 +388,7 @@ int HTMLSpellCheck::CountMisspelledWords(const QString &text,
         bool first_only,
         bool include_all_words)
 {
-    return GetMisspelledWords(text, start_offset, end_offset, search_regex, first_only, include_all_words).count();
+    return FindWords(text, start_offset, end_offset, search_regex, first_only, include_all_words, NULL);
 }
 
 
@@ -34,6 +34,8 @@ public:
         QString text;
         int offset;
         int length;
+        // What lang or xml:lang says the text is in, or empty
+        QString lang;
     };
 
     static QList<MisspelledWord> GetMisspelledWords(const QString &text,
@@ -74,6 +76,26 @@ public:
 
 private:
 
+    /**
+     * The one pass over the text all of the above are made from. Words
+     * are looked at in place; only the ones reported are copied. Each
+     * is checked in the language of the element it is in, as far as
+     * the text shows it.
+     *
+     * @param misspellings Where the words found are added, or NULL if
+     *        they are only counted.
+     * @return The number of words found.
+     */
+    static int FindWords(const QString &text,
+                         int start_offset,
+                         int end_offset,
+                         const QString &search_regex,
+                         bool first_only,
+                         bool include_all_words,
+                         QList<MisspelledWord> *misspellings);
+
+    static bool CheckNumbers();
+
     static bool IsBoundary(QChar prev_c, QChar c, QChar next_c, const QString & wordChars, bool use_nums);
     static bool IsValidChar(const QChar & c, bool use_nums);
 };
@@ -0,0 +1,319 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <string.h>
+#include <zlib.h>
+
+#include <QtCore/QFile>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSaveFile>
+
+#include "Misc/ImageOptimizer.h"
+
+static const QByteArray PNG_SIGNATURE("\x89PNG\r\n\x1a\n", 8);
+static const QByteArray JPEG_SOI("\xFF\xD8", 2);
+static const QByteArray EXIF_HEADER("Exif\0\0", 6);
+
+static const int INFLATE_CHUNK_SIZE = 256 * 1024;
+
+// Each strategy wins on some images, so both are tried
+static const int DEFLATE_STRATEGIES[] = { Z_DEFAULT_STRATEGY, Z_FILTERED };
+
+static const uchar JPEG_SOS  = 0xDA;
+static const uchar JPEG_COM  = 0xFE;
+static const uchar JPEG_APP0 = 0xE0;
+static const uchar JPEG_APP1 = 0xE1;
+static const uchar JPEG_APP2 = 0xE2;
+static const uchar JPEG_APP14 = 0xEE;
+static const uchar JPEG_APP15 = 0xEF;
+
+
+static quint32 ReadUInt32(const char *data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    return (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16) | (quint32(bytes[2]) << 8) | quint32(bytes[3]);
+}
+
+
+static void AppendUInt32(QByteArray &out, quint32 value)
+{
+    out.append(char((value >> 24) & 0xFF));
+    out.append(char((value >> 16) & 0xFF));
+    out.append(char((value >> 8) & 0xFF));
+    out.append(char(value & 0xFF));
+}
+
+
+static void AppendPNGChunk(QByteArray &out, const QByteArray &type, const QByteArray &data)
+{
+    AppendUInt32(out, data.size());
+    out.append(type);
+    out.append(data);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(type.constData()), type.size());
+    crc = crc32(crc, reinterpret_cast<const Bytef *>(data.constData()), data.size());
+    AppendUInt32(out, crc);
+}
+
+
+// Text and time chunks do not change how the image is shown
+static bool IsDroppedPNGChunk(const QByteArray &type)
+{
+    return type == "tEXt" || type == "zTXt" || type == "iTXt" || type == "tIME";
+}
+
+
+static QByteArray Inflate(const QByteArray &data)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (inflateInit(&stream) != Z_OK) {
+        return QByteArray();
+    }
+
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+    QByteArray out;
+    QByteArray buffer(INFLATE_CHUNK_SIZE, Qt::Uninitialized);
+    int result = Z_OK;
+
+    while (result == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer.data());
+        stream.avail_out = buffer.size();
+        result = inflate(&stream, Z_NO_FLUSH);
+
+        if (result != Z_OK && result != Z_STREAM_END) {
+            break;
+        }
+
+        out.append(buffer.constData(), buffer.size() - stream.avail_out);
+    }
+
+    inflateEnd(&stream);
+    return result == Z_STREAM_END ? out : QByteArray();
+}
+
+
+static QByteArray Deflate(const QByteArray &data, int strategy)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS, MAX_MEM_LEVEL, strategy) != Z_OK) {
+        return QByteArray();
+    }
+
+    QByteArray out(deflateBound(&stream, data.size()), Qt::Uninitialized);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = out.size();
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? out : QByteArray();
+}
+
+
+// Comments, XMP and the other APPn segments are not used to show the
+// image. JFIF, EXIF (orientation), ICC profiles and Adobe (color
+// transform) segments are.
+static bool IsDroppedJPEGSegment(uchar marker, const char *payload, int size)
+{
+    if (marker == JPEG_COM) {
+        return true;
+    }
+
+    if (marker < JPEG_APP0 || marker > JPEG_APP15) {
+        return false;
+    }
+
+    if (marker == JPEG_APP1) {
+        return size < EXIF_HEADER.size() || QByteArray::fromRawData(payload, EXIF_HEADER.size()) != EXIF_HEADER;
+    }
+
+    return marker != JPEG_APP0 && marker != JPEG_APP2 && marker != JPEG_APP14;
+}
+
+
+qint64 ImageOptimizer::OptimizeFile(const QString &path)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+
+    QByteArray data = file.readAll();
+    file.close();
+
+    // Go by the content, the extension may not match it
+    QByteArray optimized;
+    if (data.startsWith(PNG_SIGNATURE)) {
+        optimized = OptimizePNG(data);
+    } else if (data.startsWith(JPEG_SOI)) {
+        optimized = OptimizeJPEG(data);
+    }
+
+    if (optimized.isEmpty()) {
+        return 0;
+    }
+
+    // The old file stays in place unless the new one is written in full
+    QSaveFile out(path);
+    if (!out.open(QIODevice::WriteOnly) ||
+        out.write(optimized) != optimized.size() ||
+        !out.commit()) {
+        return 0;
+    }
+
+    return data.size() - optimized.size();
+}
+
+
+QByteArray ImageOptimizer::OptimizePNG(const QByteArray &data)
+{
+    if (!data.startsWith(PNG_SIGNATURE)) {
+        return QByteArray();
+    }
+
+    QList<QPair<QByteArray, QByteArray>> chunks;
+    QByteArray image_data;
+    int image_data_index = -1;
+    bool ended = false;
+    qint64 pos = PNG_SIGNATURE.size();
+
+    while (pos + 12 <= data.size()) {
+        qint64 length = ReadUInt32(data.constData() + pos);
+
+        if (pos + 12 + length > data.size()) {
+            return QByteArray();
+        }
+
+        QByteArray type = data.mid(pos + 4, 4);
+
+        if (type == "IDAT") {
+            // The image data is one stream split across the IDAT chunks
+            if (image_data_index == -1) {
+                image_data_index = chunks.count();
+                chunks.append(qMakePair(type, QByteArray()));
+            }
+            image_data.append(data.constData() + pos + 8, length);
+        } else if (!IsDroppedPNGChunk(type)) {
+            chunks.append(qMakePair(type, data.mid(pos + 8, length)));
+        }
+
+        pos += 12 + length;
+
+        if (type == "IEND") {
+            ended = true;
+            break;
+        }
+    }
+
+    if (!ended || image_data_index == -1) {
+        return QByteArray();
+    }
+
+    const QByteArray raw = Inflate(image_data);
+    if (raw.isEmpty()) {
+        return QByteArray();
+    }
+
+    QByteArray best = image_data;
+    for (unsigned int i = 0; i < sizeof(DEFLATE_STRATEGIES) / sizeof(DEFLATE_STRATEGIES[0]); ++i) {
+        QByteArray deflated = Deflate(raw, DEFLATE_STRATEGIES[i]);
+
+        if (!deflated.isEmpty() && deflated.size() < best.size()) {
+            best = deflated;
+        }
+    }
+    chunks[image_data_index].second = best;
+
+    QByteArray out;
+    out.reserve(data.size());
+    out.append(PNG_SIGNATURE);
+    for (int i = 0; i < chunks.count(); ++i) {
+        AppendPNGChunk(out, chunks.at(i).first, chunks.at(i).second);
+    }
+
+    return out.size() < data.size() ? out : QByteArray();
+}
+
+
+QByteArray ImageOptimizer::OptimizeJPEG(const QByteArray &data)
+{
+    if (!data.startsWith(JPEG_SOI)) {
+        return QByteArray();
+    }
+
+    QByteArray out;
+    out.reserve(data.size());
+    out.append(JPEG_SOI);
+    bool reached_scan = false;
+    int pos = JPEG_SOI.size();
+
+    while (pos + 4 <= data.size()) {
+        if (uchar(data.at(pos)) != 0xFF) {
+            return QByteArray();
+        }
+
+        uchar marker = data.at(pos + 1);
+
+        if (marker == 0xFF) {
+            // Fill byte before a marker
+            ++pos;
+            continue;
+        }
+
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD9)) {
+            // Markers without a length have no place before the first scan
+            return QByteArray();
+        }
+
+        int length = (uchar(data.at(pos + 2)) << 8) | uchar(data.at(pos + 3));
+
+        if (length < 2 || pos + 2 + length > data.size()) {
+            return QByteArray();
+        }
+
+        if (marker == JPEG_SOS) {
+            // The scans and everything after them are copied as they are
+            out.append(data.constData() + pos, data.size() - pos);
+            reached_scan = true;
+            break;
+        }
+
+        if (!IsDroppedJPEGSegment(marker, data.constData() + pos + 4, length - 2)) {
+            out.append(data.constData() + pos, length + 2);
+        }
+
+        pos += 2 + length;
+    }
+
+    if (!reached_scan || out.size() >= data.size()) {
+        return QByteArray();
+    }
+
+    return out;
+}
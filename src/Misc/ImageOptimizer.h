@@ -0,0 +1,65 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef IMAGEOPTIMIZER_H
+#define IMAGEOPTIMIZER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+/**
+ * Makes PNG and JPEG files smaller without changing a single pixel.
+ *
+ * PNG image data is deflated again at the highest level, as one IDAT
+ * chunk, and text and time chunks are dropped. JPEG files lose their
+ * comments and the APPn segments readers do not use; the JFIF, EXIF,
+ * ICC profile and Adobe segments are kept since they change how the
+ * image is shown. The entropy coded data of a JPEG is copied as is.
+ *
+ * Only files and byte arrays are touched, so the functions are safe
+ * to run on worker threads.
+ */
+class ImageOptimizer
+{
+public:
+
+    /**
+     * Rewrites the file if it can be made smaller.
+     *
+     * @return The number of bytes saved, 0 if the file was left alone.
+     */
+    static qint64 OptimizeFile(const QString &path);
+
+    /**
+     * @return The optimized PNG, or an empty array if data is not
+     *         a PNG that can be made smaller.
+     */
+    static QByteArray OptimizePNG(const QByteArray &data);
+
+    /**
+     * @return The optimized JPEG, or an empty array if data is not
+     *         a JPEG that can be made smaller.
+     */
+    static QByteArray OptimizeJPEG(const QByteArray &data);
+};
+
+#endif // IMAGEOPTIMIZER_H
@@ -0,0 +1,498 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <string.h>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QTextStream>
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
+#include "BookManipulation/Book.h"
+#include "Misc/BatchProcessor.h"
+#include "Misc/GumboInterface.h"
+#include "Misc/JobServer.h"
+#include "Misc/SpellCheck.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/Utility.h"
+#include "MiscEditors/SearchEditorModel.h"
+#include "ResourceObjects/HTMLResource.h"
+#include "ResourceObjects/OPFResource.h"
+
+static const QString SERVE_OPTION = "--serve";
+static const QString WORKER_OPTION = "--serve-worker";
+static const QString JOBS_OPTION = "--jobs";
+static const QString MAX_MEMORY_OPTION = "--max-memory";
+
+// The workers connect to the server under its name with this added
+static const QString WORKER_SOCKET_SUFFIX = "-workers";
+
+static const int DEFAULT_MAX_MEMORY_MB = 1024;
+
+// Workers failing this often in a row means they cannot start at all
+static const int MAX_FAILED_WORKERS = 3;
+
+static const int WORKER_CONNECT_MS = 30000;
+static const int WORKER_EXIT_MS = 5000;
+
+static const int EXIT_OK = 0;
+static const int EXIT_FAILED = 1;
+static const int EXIT_USAGE = 2;
+
+
+static void Print(const QString &message)
+{
+    QTextStream out(stdout);
+    out << message << "\n";
+    out.flush();
+}
+
+
+static void PrintError(const QString &message)
+{
+    QTextStream err(stderr);
+    err << message << "\n";
+    err.flush();
+}
+
+
+JobServer::JobServer(QObject *parent)
+    :
+    QObject(parent),
+    m_IsWorker(false),
+    m_Jobs(TaskScheduler::ThreadCount()),
+    m_MaxMemoryMB(DEFAULT_MAX_MEMORY_MB),
+    m_ClientServer(NULL),
+    m_WorkerServer(NULL),
+    m_FailedWorkers(0),
+    m_ShuttingDown(false)
+{
+}
+
+
+bool JobServer::IsServerRun(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--serve-worker") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+int JobServer::Run(const QStringList &arguments)
+{
+    Utility::SetHeadless(true);
+
+    if (!ParseArguments(arguments)) {
+        return EXIT_USAGE;
+    }
+
+    return m_IsWorker ? Work() : Serve();
+}
+
+
+bool JobServer::ParseArguments(const QStringList &arguments)
+{
+    for (int i = 1; i < arguments.count(); ++i) {
+        const QString &argument = arguments.at(i);
+
+        if (argument != SERVE_OPTION && argument != WORKER_OPTION &&
+            argument != JOBS_OPTION && argument != MAX_MEMORY_OPTION) {
+            PrintError(tr("Unknown option: %1").arg(argument));
+            return false;
+        }
+
+        if (i + 1 >= arguments.count()) {
+            PrintError(tr("Missing value for %1").arg(argument));
+            return false;
+        }
+
+        const QString value = arguments.at(++i);
+
+        if (argument == SERVE_OPTION || argument == WORKER_OPTION) {
+            m_Name = value;
+            m_IsWorker = argument == WORKER_OPTION;
+        } else {
+            bool ok = false;
+            int number = value.toInt(&ok);
+
+            if (!ok || number < (argument == JOBS_OPTION ? 1 : 0)) {
+                PrintError(tr("Invalid value for %1: %2").arg(argument).arg(value));
+                return false;
+            }
+
+            if (argument == JOBS_OPTION) {
+                m_Jobs = number;
+            } else {
+                m_MaxMemoryMB = number;
+            }
+        }
+    }
+
+    if (m_Name.isEmpty()) {
+        PrintError(tr("Usage: sigil --serve NAME [--jobs N] [--max-memory MB] [--threads N] [--memory-limit MB]"));
+        return false;
+    }
+
+    return true;
+}
+
+
+int JobServer::Serve()
+{
+    m_ClientServer = new QLocalServer(this);
+    m_WorkerServer = new QLocalServer(this);
+    // Left behind by a server that did not shut down
+    QLocalServer::removeServer(m_Name);
+    QLocalServer::removeServer(m_Name + WORKER_SOCKET_SUFFIX);
+
+    if (!m_WorkerServer->listen(m_Name + WORKER_SOCKET_SUFFIX) || !m_ClientServer->listen(m_Name)) {
+        PrintError(tr("Cannot listen on %1: %2").arg(m_Name).arg(m_ClientServer->errorString()));
+        return EXIT_FAILED;
+    }
+
+    connect(m_ClientServer, SIGNAL(newConnection()), this, SLOT(ClientConnected()));
+    connect(m_WorkerServer, SIGNAL(newConnection()), this, SLOT(WorkerConnected()));
+
+    for (int i = 0; i < m_Jobs; ++i) {
+        StartWorker();
+    }
+
+    Print(tr("Serving jobs on %1 with %2 workers").arg(m_ClientServer->fullServerName()).arg(m_Jobs));
+    return QCoreApplication::exec() == 0 && m_FailedWorkers < MAX_FAILED_WORKERS ? EXIT_OK : EXIT_FAILED;
+}
+
+
+void JobServer::StartWorker()
+{
+    QProcess *process = new QProcess(this);
+    process->setProcessChannelMode(QProcess::ForwardedChannels);
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(WorkerExited(int, QProcess::ExitStatus)));
+    m_Workers.append(process);
+    // The workers share the CPUs and memory this process may use
+    QStringList arguments;
+    arguments << WORKER_OPTION << m_Name << MAX_MEMORY_OPTION << QString::number(m_MaxMemoryMB);
+    arguments << "--threads" << QString::number(qMax(1, TaskScheduler::ThreadCount() / m_Jobs));
+
+    if (TaskScheduler::MemoryLimit() > 0) {
+        arguments << "--memory-limit" << QString::number(qMax<qint64>(1, TaskScheduler::MemoryLimit() / m_Jobs / (1024 * 1024)));
+    }
+
+    process->start(QCoreApplication::applicationFilePath(), arguments);
+}
+
+
+void JobServer::ClientConnected()
+{
+    while (m_ClientServer->hasPendingConnections()) {
+        QLocalSocket *client = m_ClientServer->nextPendingConnection();
+        connect(client, SIGNAL(readyRead()), this, SLOT(ClientReadyRead()));
+        connect(client, SIGNAL(disconnected()), client, SLOT(deleteLater()));
+    }
+}
+
+
+void JobServer::ClientReadyRead()
+{
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+
+    while (client && client->canReadLine()) {
+        QByteArray request = client->readLine().trimmed();
+
+        if (request.isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError parse_error;
+        QJsonDocument document = QJsonDocument::fromJson(request, &parse_error);
+
+        if (!document.isObject()) {
+            client->write(ErrorReply(QJsonValue(), tr("Not a JSON object: %1").arg(parse_error.errorString())));
+            continue;
+        }
+
+        if (document.object().value("action").toString() == "shutdown") {
+            Shutdown();
+            return;
+        }
+
+        Job job;
+        job.client = client;
+        job.id = document.object().value("id");
+        job.request = request;
+        m_Queue.enqueue(job);
+    }
+
+    Dispatch();
+}
+
+
+void JobServer::WorkerConnected()
+{
+    while (m_WorkerServer->hasPendingConnections()) {
+        QLocalSocket *worker = m_WorkerServer->nextPendingConnection();
+        connect(worker, SIGNAL(readyRead()), this, SLOT(WorkerReadyRead()));
+        connect(worker, SIGNAL(disconnected()), this, SLOT(WorkerDisconnected()));
+        m_IdleWorkers.append(worker);
+    }
+
+    Dispatch();
+}
+
+
+void JobServer::Dispatch()
+{
+    while (!m_Queue.isEmpty() && !m_IdleWorkers.isEmpty()) {
+        Job job = m_Queue.dequeue();
+
+        // Nobody is left to take the reply
+        if (!job.client) {
+            continue;
+        }
+
+        QLocalSocket *worker = m_IdleWorkers.takeFirst();
+        m_RunningJobs.insert(worker, job);
+        worker->write(job.request + "\n");
+    }
+}
+
+
+void JobServer::WorkerReadyRead()
+{
+    QLocalSocket *worker = qobject_cast<QLocalSocket *>(sender());
+
+    while (worker && worker->canReadLine()) {
+        QByteArray reply = worker->readLine();
+        Job job = m_RunningJobs.take(worker);
+
+        if (job.client) {
+            job.client->write(reply);
+        }
+
+        m_FailedWorkers = 0;
+
+        // A retiring worker disconnects next and gets no more jobs
+        if (!QJsonDocument::fromJson(reply).object().value("retiring").toBool()) {
+            m_IdleWorkers.append(worker);
+        }
+    }
+
+    Dispatch();
+}
+
+
+void JobServer::WorkerDisconnected()
+{
+    QLocalSocket *worker = qobject_cast<QLocalSocket *>(sender());
+
+    if (!worker) {
+        return;
+    }
+
+    if (m_RunningJobs.contains(worker)) {
+        Job job = m_RunningJobs.take(worker);
+
+        if (job.client) {
+            job.client->write(ErrorReply(job.id, tr("The worker running the job exited")));
+        }
+    }
+
+    m_IdleWorkers.removeAll(worker);
+    worker->deleteLater();
+}
+
+
+void JobServer::WorkerExited(int exit_code, QProcess::ExitStatus exit_status)
+{
+    QProcess *process = qobject_cast<QProcess *>(sender());
+
+    if (!process) {
+        return;
+    }
+
+    m_Workers.removeAll(process);
+    process->deleteLater();
+
+    if (m_ShuttingDown) {
+        return;
+    }
+
+    // Workers exit with 0 when they have grown too large
+    if (exit_status != QProcess::NormalExit || exit_code != EXIT_OK) {
+        PrintError(tr("A worker exited with code %1").arg(exit_code));
+
+        if (++m_FailedWorkers >= MAX_FAILED_WORKERS) {
+            PrintError(tr("Workers keep failing, shutting down"));
+            Shutdown();
+            return;
+        }
+    }
+
+    StartWorker();
+}
+
+
+void JobServer::Shutdown()
+{
+    m_ShuttingDown = true;
+    m_ClientServer->close();
+
+    foreach(Job job, m_Queue) {
+        if (job.client) {
+            job.client->write(ErrorReply(job.id, tr("The server shut down")));
+        }
+    }
+    m_Queue.clear();
+
+    // A worker exits once the server goes away
+    foreach(QLocalSocket *worker, m_RunningJobs.keys() + m_IdleWorkers) {
+        worker->disconnectFromServer();
+    }
+    foreach(QProcess *process, m_Workers) {
+        if (!process->waitForFinished(WORKER_EXIT_MS)) {
+            process->kill();
+        }
+    }
+
+    m_WorkerServer->close();
+    QCoreApplication::quit();
+}
+
+
+int JobServer::Work()
+{
+    // Loaded now rather than by the first job that needs them
+    SpellCheck::instance();
+    SearchEditorModel::instance();
+
+    QLocalSocket server;
+    server.connectToServer(m_Name + WORKER_SOCKET_SUFFIX);
+
+    if (!server.waitForConnected(WORKER_CONNECT_MS)) {
+        PrintError(tr("Cannot connect to %1: %2").arg(m_Name).arg(server.errorString()));
+        return EXIT_FAILED;
+    }
+
+    const qint64 max_memory = qint64(m_MaxMemoryMB) * 1024 * 1024;
+
+    while (server.state() == QLocalSocket::ConnectedState) {
+        if (!server.canReadLine() && !server.waitForReadyRead(-1)) {
+            break;
+        }
+
+        while (server.canReadLine()) {
+            QByteArray reply = RunJob(server.readLine().trimmed());
+
+            // Replaced by a fresh one, as what was freed is not all
+            // returned. The reply says so, so no job is sent meanwhile.
+            bool retiring = max_memory > 0 && Utility::ProcessResidentBytes() > max_memory;
+
+            if (retiring) {
+                QJsonObject object = QJsonDocument::fromJson(reply).object();
+                object.insert("retiring", true);
+                reply = QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n";
+            }
+
+            server.write(reply);
+
+            while (server.bytesToWrite() > 0 && server.waitForBytesWritten(-1)) {
+            }
+
+            if (retiring) {
+                server.disconnectFromServer();
+                return EXIT_OK;
+            }
+        }
+    }
+
+    return EXIT_OK;
+}
+
+
+QByteArray JobServer::RunJob(const QByteArray &request)
+{
+    QJsonObject job = QJsonDocument::fromJson(request).object();
+    QJsonValue id = job.value("id");
+    const QString path = job.value("book").toString();
+    const QString output_path = job.value("output").toString();
+
+    if (path.isEmpty()) {
+        return ErrorReply(id, tr("No book given"));
+    }
+
+    // A processor of its own for each job, and so a Book of its own
+    BatchProcessor processor;
+    foreach(QJsonValue operation, job.value("operations").toArray()) {
+        QString error;
+
+        if (!processor.AddOperation(operation.toString(), error)) {
+            return ErrorReply(id, error);
+        }
+    }
+
+    QSharedPointer<Book> book;
+    QStringList messages;
+    bool ok = processor.TransformBook(path, output_path, book, messages);
+    QJsonArray problems;
+
+    if (ok && job.value("validate").toBool()) {
+        QString version = book->GetConstOPF()->GetEpubVersion();
+        foreach(HTMLResource *html_resource, book->GetHTMLResources()) {
+            GumboInterface gi = GumboInterface(html_resource->GetText(), version);
+            foreach(GumboWellFormedError error, gi.error_check()) {
+                QJsonObject problem;
+                problem.insert("file", html_resource->GetRelativePath());
+                problem.insert("line", error.line);
+                problem.insert("column", error.column);
+                problem.insert("message", error.message);
+                problems.append(problem);
+            }
+        }
+    }
+
+    QJsonObject reply;
+    reply.insert("id", id);
+    reply.insert("ok", ok);
+    reply.insert("messages", QJsonArray::fromStringList(messages));
+    reply.insert("problems", problems);
+
+    if (ok && !output_path.isEmpty()) {
+        reply.insert("output", output_path);
+    }
+
+    return QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n";
+}
+
+
+QByteArray JobServer::ErrorReply(const QJsonValue &id, const QString &message)
+{
+    QJsonObject reply;
+    reply.insert("id", id);
+    reply.insert("ok", false);
+    reply.insert("messages", QJsonArray() << message);
+    return QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n";
+}
@@ -0,0 +1,152 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QJsonValue>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QPointer>
+#include <QtCore/QProcess>
+#include <QtCore/QQueue>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+class QLocalServer;
+class QLocalSocket;
+
+/**
+ * Runs book jobs sent over a local socket, for pipelines that process
+ * many books and should not start Sigil once for each.
+ *
+ *   sigil --serve NAME [--jobs N] [--max-memory MB]
+ *
+ * Clients connect to the local socket NAME and send one job per line,
+ * each a JSON object:
+ *
+ *   {"id": 7, "book": "/in/a.epub", "operations": ["mend", "search Quotes"],
+ *    "validate": true, "output": "/out/a.epub"}
+ *
+ * The operations are lines of a --batch script. The book is opened, the
+ * operations are applied, with "validate" the well-formedness errors of
+ * its HTML files are listed, and with "output" it is written there. The
+ * reply is one line too, with the id of the job:
+ *
+ *   {"id": 7, "ok": true, "output": "/out/a.epub", "messages": [...],
+ *    "problems": [{"file": "Text/c1.xhtml", "line": 3, "column": 9,
+ *                  "message": "..."}]}
+ *
+ * {"action": "shutdown"} stops the server.
+ *
+ * The jobs are run by N worker processes, started once and kept warm,
+ * so Python, the dictionaries, the saved searches and the settings are
+ * loaded once per worker rather than once per book. Each job gets a
+ * Book of its own, as a batch run does. A worker that is using more than
+ * the given memory after a job is replaced by a new one; its last reply
+ * has "retiring": true.
+ */
+class JobServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    JobServer(QObject *parent = 0);
+
+    /**
+     * @return true if Sigil was started as a job server or as one of its
+     *         workers. Looked at before the application object exists.
+     */
+    static bool IsServerRun(int argc, char *argv[]);
+
+    /**
+     * Serves jobs, or runs them as a worker, until shut down.
+     *
+     * @return 0 once shut down, 1 if serving failed,
+     *         2 if the arguments are unusable.
+     */
+    int Run(const QStringList &arguments);
+
+private slots:
+    void ClientConnected();
+    void ClientReadyRead();
+    void WorkerConnected();
+    void WorkerReadyRead();
+    void WorkerDisconnected();
+    void WorkerExited(int exit_code, QProcess::ExitStatus exit_status);
+
+private:
+
+    struct Job {
+        QPointer<QLocalSocket> client;
+        QJsonValue id;
+        QByteArray request;
+    };
+
+    bool ParseArguments(const QStringList &arguments);
+
+    int Serve();
+
+    void StartWorker();
+
+    /**
+     * Hands queued jobs to the idle workers.
+     */
+    void Dispatch();
+
+    void Shutdown();
+
+    /**
+     * Runs worker jobs read from the server until it goes away.
+     */
+    int Work();
+
+    /**
+     * @return The reply line for a job request.
+     */
+    QByteArray RunJob(const QByteArray &request);
+
+    static QByteArray ErrorReply(const QJsonValue &id, const QString &message);
+
+    QString m_Name;
+    bool m_IsWorker;
+    int m_Jobs;
+    int m_MaxMemoryMB;
+
+    QLocalServer *m_ClientServer;
+    QLocalServer *m_WorkerServer;
+    QList<QProcess *> m_Workers;
+    QList<QLocalSocket *> m_IdleWorkers;
+    QHash<QLocalSocket *, Job> m_RunningJobs;
+    QQueue<Job> m_Queue;
+
+    /**
+     * Workers that failed in a row without a job done between them.
+     */
+    int m_FailedWorkers;
+
+    bool m_ShuttingDown;
+};
+
+#endif // JOBSERVER_H
@@ -25,6 +25,58 @@
 
 #include "Misc/Landmarks.h"
 
+// The epub2 guide type for each epub3 landmark, as ncxgenerator.py maps them
+static QHash<QString, QString> EpubTypeGuideMap()
+{
+    QHash<QString, QString> map;
+    map["acknowledgements"] = "acknowledgments";
+    map["afterword"]        = "other.afterword";
+    map["appendix"]         = "other.appendix";
+    map["backmatter"]       = "other.backmatter";
+    map["bibliography"]     = "bibliography";
+    map["bodymatter"]       = "text";
+    map["chapter"]          = "other.chapter";
+    map["colophon"]         = "colophon";
+    map["conclusion"]       = "other.conclusion";
+    map["contributors"]     = "other.contributors";
+    map["copyright-page"]   = "copyright-page";
+    map["cover"]            = "cover";
+    map["dedication"]       = "dedication";
+    map["division"]         = "other.division";
+    map["epigraph"]         = "epigraph";
+    map["epilogue"]         = "other.epilogue";
+    map["errata"]           = "other.errata";
+    map["footnotes"]        = "other.footnotes";
+    map["foreword"]         = "foreword";
+    map["frontmatter"]      = "other.frontmatter";
+    map["glossary"]         = "glossary";
+    map["halftitlepage"]    = "other.halftitlepage";
+    map["imprint"]          = "other.imprint";
+    map["imprimatur"]       = "other.imprimatur";
+    map["index"]            = "index";
+    map["introduction"]     = "other.introduction";
+    map["landmarks"]        = "other.landmarks";
+    map["loa"]              = "other.loa";
+    map["loi"]              = "loi";
+    map["lot"]              = "lot";
+    map["lov"]              = "other.lov";
+    map["notice"]           = "other.notice";
+    map["other-credits"]    = "other.other-credits";
+    map["part"]             = "other.part";
+    map["preamble"]         = "other.preamble";
+    map["preface"]          = "preface";
+    map["prologue"]         = "other.prologue";
+    map["rearnotes"]        = "other.rearnotes";
+    map["subchapter"]       = "other.subchapter";
+    map["titlepage"]        = "title-page";
+    map["toc"]              = "toc";
+    map["volume"]           = "other.volume";
+    map["warning"]          = "other.warning";
+    return map;
+}
+
+static const QHash<QString, QString> EPUBTYPE_GUIDE_MAP = EpubTypeGuideMap();
+
 Landmarks *Landmarks::m_instance = 0;
 
 Landmarks *Landmarks::instance()
@@ -98,6 +150,11 @@ Landmarks::Landmarks()
     SetGuideLandMap();
 }
 
+QString Landmarks::GuideTypeForLandmark(const QString &code)
+{
+    return EPUBTYPE_GUIDE_MAP.value(code);
+}
+
 QString Landmarks::GuideLandMapping(QString code)
 {
   return m_GuideLandMap.value(code, QString());
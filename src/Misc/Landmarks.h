@@ -56,6 +56,12 @@ public:
     const QHash<QString, DescriptiveInfo> &GetCodeMap();
     QString GuideLandMapping(QString code);
 
+    /**
+     * @return The guide type the landmark code is carried over as
+     *         in the guide, or an empty string if there is none.
+     */
+    static QString GuideTypeForLandmark(const QString &code);
+
 private:
 
     Landmarks();
@@ -0,0 +1,147 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <functional>
+
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include "Misc/MatchOffsets.h"
+#include "PCRE/PCRECache.h"
+#include "PCRE/SPCRE.h"
+#include "ResourceObjects/TextResource.h"
+
+// In bytes
+static const int CACHE_CAPACITY = 8 * 1024 * 1024;
+
+struct CachedOffsets {
+    int revision;
+    QSharedPointer<const MatchOffsets::Offsets> offsets;
+};
+
+static QMutex s_CacheMutex;
+
+// Keyed by search type, resource identifier and regex
+static QCache<QString, CachedOffsets> s_Cache(CACHE_CAPACITY);
+
+
+static bool AddOffsets(MatchOffsets::Offsets &offsets, const int *ovector, int group_count)
+{
+    Q_UNUSED(group_count);
+    offsets.append(qMakePair(ovector[0], ovector[1]));
+    return true;
+}
+
+
+QSharedPointer<const MatchOffsets::Offsets> MatchOffsets::Get(const QString &search_regex,
+                                                              TextResource *text_resource,
+                                                              SearchOperations::SearchType search_type)
+{
+    return Get(search_regex, NULL, text_resource, search_type);
+}
+
+
+QSharedPointer<const MatchOffsets::Offsets> MatchOffsets::Get(SPCRE *spcre,
+                                                              TextResource *text_resource,
+                                                              SearchOperations::SearchType search_type)
+{
+    return Get(spcre->getPattern(), spcre, text_resource, search_type);
+}
+
+
+QSharedPointer<const MatchOffsets::Offsets> MatchOffsets::Get(const QString &search_regex,
+                                                              SPCRE *spcre,
+                                                              TextResource *text_resource,
+                                                              SearchOperations::SearchType search_type)
+{
+    QString key = Key(search_regex, text_resource, search_type);
+    {
+        QMutexLocker locker(&s_CacheMutex);
+        CachedOffsets *cached = s_Cache.object(key);
+
+        if (cached && cached->revision == text_resource->GetTextRevision()) {
+            return cached->offsets;
+        }
+    }
+
+    // Searched without the lock held
+    QSharedPointer<SPCRE> handle;
+
+    if (!spcre) {
+        handle = PCRECache::instance()->getObject(search_regex);
+        spcre = handle.data();
+    }
+
+    TextResource::Snapshot snapshot = text_resource->GetSnapshot();
+    QSharedPointer<Offsets> offsets(new Offsets());
+    spcre->forEachMatch(SearchOperations::SearchedText(text_resource, snapshot, search_type),
+                        std::bind(AddOffsets, std::ref(*offsets), std::placeholders::_1, std::placeholders::_2));
+    QMutexLocker locker(&s_CacheMutex);
+    CachedOffsets *cached = s_Cache.object(key);
+
+    if (!cached || cached->revision < snapshot.revision) {
+        cached = new CachedOffsets;
+        cached->revision = snapshot.revision;
+        cached->offsets = offsets;
+        s_Cache.insert(key, cached, offsets->count() * sizeof(QPair<int, int>) + key.length() * sizeof(QChar));
+    }
+
+    return offsets;
+}
+
+
+int MatchOffsets::CachedCount(const QString &search_regex,
+                              TextResource *text_resource,
+                              SearchOperations::SearchType search_type,
+                              int revision)
+{
+    QMutexLocker locker(&s_CacheMutex);
+    CachedOffsets *cached = s_Cache.object(Key(search_regex, text_resource, search_type));
+
+    if (!cached || cached->revision != revision) {
+        return -1;
+    }
+
+    return cached->offsets->count();
+}
+
+
+qint64 MatchOffsets::CacheSize()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    return s_Cache.totalCost();
+}
+
+
+void MatchOffsets::ClearCache()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    s_Cache.clear();
+}
+
+
+QString MatchOffsets::Key(const QString &search_regex,
+                          TextResource *text_resource,
+                          SearchOperations::SearchType search_type)
+{
+    return QString::number(search_type) + "|" + text_resource->GetIdentifier() + "|" + search_regex;
+}
@@ -0,0 +1,97 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef MATCHOFFSETS_H
+#define MATCHOFFSETS_H
+
+#include <QtCore/QPair>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "Misc/SearchOperations.h"
+
+class SPCRE;
+class TextResource;
+
+/**
+ * Where a search matches in a file: the start and end of every match in
+ * the text the search type matches against, as SearchOperations counts
+ * them. Kept for each search and file until the file is edited, so a
+ * book-wide Find Next, Count and Replace All need not search a file
+ * again that has not changed since one of them last did.
+ *
+ * The search is keyed on its regex, which holds its options too.
+ */
+class MatchOffsets
+{
+public:
+
+    typedef QVector<QPair<int, int> > Offsets;
+
+    /**
+     * @return The matches of search_regex in the current text of the
+     *         resource, from the cache if it has not been edited since.
+     */
+    static QSharedPointer<const Offsets> Get(const QString &search_regex,
+                                             TextResource *text_resource,
+                                             SearchOperations::SearchType search_type);
+
+    /**
+     * As above, searching with spcre if the cache does not have them.
+     */
+    static QSharedPointer<const Offsets> Get(SPCRE *spcre,
+                                             TextResource *text_resource,
+                                             SearchOperations::SearchType search_type);
+
+    /**
+     * @return The number of matches cached for the resource as it was
+     *         at revision, or -1 if there are none cached for it.
+     */
+    static int CachedCount(const QString &search_regex,
+                           TextResource *text_resource,
+                           SearchOperations::SearchType search_type,
+                           int revision);
+
+    /**
+     * @return The size of the cached offsets, in bytes.
+     */
+    static qint64 CacheSize();
+
+    /**
+     * Drops every cached offset.
+     */
+    static void ClearCache();
+
+private:
+
+    static QString Key(const QString &search_regex,
+                       TextResource *text_resource,
+                       SearchOperations::SearchType search_type);
+
+    static QSharedPointer<const Offsets> Get(const QString &search_regex,
+                                             SPCRE *spcre,
+                                             TextResource *text_resource,
+                                             SearchOperations::SearchType search_type);
+};
+
+#endif // MATCHOFFSETS_H
@@ -0,0 +1,638 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QStringBuilder>
+#include <QtCore/QStringList>
+
+#include "Misc/MetadataProcessor.h"
+
+// Record separator, unit separator and the indent that marks a child
+static const QChar RS = QChar(30);
+static const QChar US = QChar(31);
+static const QString IN = "  ";
+
+static const QStringList OPF_PARENT_TAGS = QStringList() << "xml" << "package" << "metadata" << "dc-metadata"
+                                                         << "x-metadata" << "manifest" << "spine" << "tours"
+                                                         << "guide" << "bindings";
+
+static const QStringList RECOGNIZED_DC = QStringList() << "dc:identifier" << "dc:title" << "dc:creator"
+                                                       << "dc:contributor" << "dc:source" << "dc:date"
+                                                       << "dc:language" << "dc:coverage" << "dc:description"
+                                                       << "dc:format" << "dc:publisher" << "dc:relation"
+                                                       << "dc:rights" << "dc:subject" << "dc:type";
+
+// Primary epub3 metas the editor handles
+static const QStringList RECOGNIZED_META = QStringList() << "belongs-to-collection" << "dcterms:issued"
+                                                         << "dcterms:created";
+
+// epub2 metas left alone
+static const QStringList SKIP_META = QStringList() << "cover";
+
+// Attributes an epub3 record keeps on its element; any other child is a refinement
+static const QStringList ELEMENT_ATTRIBUTES = QStringList() << "id" << "xml:lang" << "dir";
+
+// Refinements that are only ever the scheme or language of another one
+static const QStringList REFINEMENT_QUALIFIERS = QStringList() << "scheme" << "altlang";
+
+static const QStringList SCHEMED_REFINEMENTS = QStringList() << "role" << "identifier-type" << "title-type"
+                                                             << "collection-type";
+
+static const QRegularExpression METADATA_PATTERN("(<\\s*metadata[^>]*>.*<\\s*/\\s*metadata\\s*>\\s*)",
+                                                 QRegularExpression::CaseInsensitiveOption |
+                                                 QRegularExpression::DotMatchesEverythingOption);
+
+static QString IdRoot(const QString &name)
+{
+    static QHash<QString, QString> roots;
+    if (roots.isEmpty()) {
+        roots["dc:identifier"]  = "uid";
+        roots["dc:title"]       = "tle";
+        roots["dc:creator"]     = "cre";
+        roots["dc:contributor"] = "con";
+        roots["dc:source"]      = "src";
+        roots["dc:date"]        = "dat";
+        roots["dc:language"]    = "lng";
+        roots["dc:coverage"]    = "cov";
+        roots["dc:description"] = "des";
+        roots["dc:format"]      = "fmt";
+        roots["dc:publisher"]   = "pub";
+        roots["dc:relation"]    = "rln";
+        roots["dc:rights"]      = "rgt";
+        roots["dc:subject"]     = "sub";
+        roots["dc:type"]        = "typ";
+    }
+    return roots.value(name, "num");
+}
+
+namespace
+{
+// Attributes in the order they were written, which is
+// the order they are written back in
+struct Attributes {
+    QStringList keys;
+    QStringList values;
+
+    bool contains(const QString &key) const {
+        return keys.contains(key);
+    }
+
+    QString value(const QString &key, const QString &default_value = QString()) const {
+        int i = keys.indexOf(key);
+        return i < 0 ? default_value : values.at(i);
+    }
+
+    // Replaces in place or appends
+    void set(const QString &key, const QString &value) {
+        int i = keys.indexOf(key);
+        if (i < 0) {
+            keys.append(key);
+            values.append(value);
+        } else {
+            values[i] = value;
+        }
+    }
+
+    QString take(const QString &key, const QString &default_value = QString()) {
+        int i = keys.indexOf(key);
+        if (i < 0) {
+            return default_value;
+        }
+        keys.removeAt(i);
+        return values.takeAt(i);
+    }
+
+    bool isEmpty() const {
+        return keys.isEmpty();
+    }
+};
+
+// A metadata element; a null content is an empty element
+struct MetaElement {
+    QString name;
+    QString content;
+    Attributes attr;
+};
+
+struct OPFMetadata {
+    QString uid;
+    bool has_metadata;
+    Attributes metadata_attr;
+    QList<MetaElement> metadata;
+    // Every id in the OPF
+    QStringList idlist;
+};
+}
+
+static QString XmlEncode(const QString &data)
+{
+    QString newdata = data;
+    newdata.replace("&", "&amp;");
+    newdata.replace("<", "&lt;");
+    newdata.replace(">", "&gt;");
+    newdata.replace("\"", "&quot;");
+    return newdata;
+}
+
+
+static QString XmlDecode(const QString &data)
+{
+    QString newdata = data;
+    newdata.replace("&quot;", "\"");
+    newdata.replace("&gt;", ">");
+    newdata.replace("&lt;", "<");
+    newdata.replace("&amp;", "&");
+    return newdata;
+}
+
+
+// Elements read from the OPF are already escaped, so they are written
+// back as they were; only edited records need encoding.
+static QString BuildXML(const MetaElement &element, bool encode)
+{
+    QString tag = "<" + element.name;
+    for (int i = 0; i < element.attr.keys.count(); i++) {
+        QString val = element.attr.values.at(i);
+        if (encode) {
+            val = XmlEncode(val);
+        } else {
+            // A single quoted value may hold a double quote
+            val.replace("\"", "&quot;");
+        }
+        tag.append(" " + element.attr.keys.at(i) + "=\"" + val + "\"");
+    }
+    if (element.content.isNull()) {
+        tag.append(" />\n");
+    } else {
+        tag.append(">" + (encode ? XmlEncode(element.content) : element.content) + "</" + element.name + ">\n");
+    }
+    return tag;
+}
+
+
+// Makes id unique and reserves it
+static QString ValidId(const QString &id, QStringList &idlist)
+{
+    QString nid = id;
+    int pos = 1;
+    while (idlist.contains(nid)) {
+        nid = id + QString("%1").arg(pos, 3, 10, QChar('0'));
+        pos++;
+    }
+    idlist.append(nid);
+    return nid;
+}
+
+
+static QString RightStripped(const QString &text)
+{
+    int end = text.length();
+    while (end > 0 && (text.at(end - 1) == QChar(' ') || text.at(end - 1) == QChar('\r') || text.at(end - 1) == QChar('\n'))) {
+        end--;
+    }
+    return end == 0 ? QString("") : text.left(end);
+}
+
+
+// Splits off the leading text or the next tag; only one of them is set
+static void NextPiece(const QString &opf, int &pos, QString &text, QString &tag)
+{
+    const int p = pos;
+    const int length = opf.length();
+
+    if (opf.at(p) != QChar('<')) {
+        int res = opf.indexOf(QChar('<'), p);
+        if (res == -1) {
+            res = length;
+        }
+        pos = res;
+        text = opf.mid(p, res - p);
+        return;
+    }
+
+    int te;
+    if (opf.midRef(p, 4) == "<!--") {
+        te = opf.indexOf("-->", p + 1);
+        if (te != -1) {
+            te = te + 2;
+        }
+    } else {
+        te = opf.indexOf(QChar('>'), p + 1);
+        int ntb = opf.indexOf(QChar('<'), p + 1);
+        if (ntb != -1 && (te == -1 || ntb < te)) {
+            pos = ntb;
+            text = opf.mid(p, ntb - p);
+            return;
+        }
+    }
+
+    if (te == -1) {
+        te = length - 1;
+    }
+
+    pos = te + 1;
+    tag = opf.mid(p, te + 1 - p);
+}
+
+
+static void ParseTag(const QString &s, QString &tname, QString &ttype, Attributes &tattr)
+{
+    const int n = s.length();
+    int p = 1;
+
+    while (p < n && s.at(p) == QChar(' ')) {
+        p++;
+    }
+
+    if (p < n && s.at(p) == QChar('/')) {
+        ttype = "end";
+        p++;
+        while (p < n && s.at(p) == QChar(' ')) {
+            p++;
+        }
+    }
+
+    int b = p;
+    while (p < n) {
+        QChar c = s.at(p);
+        if (c == QChar('>') || c == QChar('/') || c == QChar(' ') || c == QChar('"') ||
+            c == QChar('\'') || c == QChar('\r') || c == QChar('\n')) {
+            break;
+        }
+        p++;
+    }
+
+    tname = s.mid(b, p - b).toLower();
+    // Drop redundant opf: prefixes on opf tags
+    if (tname.startsWith("opf:")) {
+        tname = tname.mid(4);
+    }
+
+    // There may be no spaces to delimit a comment's name
+    if (tname.startsWith("!--")) {
+        tname = "!--";
+        ttype = "single";
+        tattr.set("comment", s.mid(4, n - 7).trimmed());
+    }
+
+    if (tname == "?xml") {
+        tname = "xml";
+    }
+
+    if (ttype.isEmpty()) {
+        while (s.indexOf(QChar('='), p) != -1) {
+            while (p < n && s.at(p).isSpace()) {
+                p++;
+            }
+            b = p;
+            while (p < n && s.at(p) != QChar('=')) {
+                p++;
+            }
+            QString aname = s.mid(b, p - b).toLower().trimmed();
+            p++;
+            while (p < n && s.at(p) == QChar(' ')) {
+                p++;
+            }
+            QString val;
+            if (p < n && (s.at(p) == QChar('"') || s.at(p) == QChar('\''))) {
+                QChar qt = s.at(p);
+                p++;
+                b = p;
+                while (p < n && s.at(p) != qt) {
+                    p++;
+                }
+                val = s.mid(b, p - b);
+                p++;
+            } else {
+                b = p;
+                while (p < n && s.at(p) != QChar('>') && s.at(p) != QChar('/') && s.at(p) != QChar(' ')) {
+                    p++;
+                }
+                val = s.mid(b, p - b);
+            }
+            tattr.set(aname, val);
+        }
+
+        ttype = "begin";
+        if (s.indexOf(QChar('/'), p) >= 0) {
+            ttype = "single";
+        }
+    }
+}
+
+
+static void AddElement(OPFMetadata &opf, const QString &prefix, const QString &tname,
+                       Attributes tattr, const QString &tcontent, int &item_count)
+{
+    if (tname == "package") {
+        opf.uid = tattr.take("unique-identifier", "bookid");
+    } else if (tname == "metadata") {
+        opf.has_metadata = true;
+        opf.metadata_attr = tattr;
+    } else if (tname == "meta" || tname == "link" || (tname.startsWith("dc:") && prefix.contains("metadata"))) {
+        MetaElement element;
+        element.name = tname;
+        element.content = tcontent;
+        element.attr = tattr;
+        opf.metadata.append(element);
+    } else if (tname == "item" && prefix.endsWith("manifest")) {
+        // Manifest items always have an id
+        opf.idlist.append(tattr.value("id", QString("xid%1").arg(item_count, 3, 10, QChar('0'))));
+        item_count++;
+        return;
+    } else if (!(tname == "spine" ||
+                 (tname == "itemref" && prefix.endsWith("spine")) ||
+                 (tname == "reference" && prefix.endsWith("guide")) ||
+                 (tname == "mediatypes" && prefix.endsWith("bindings")))) {
+        return;
+    }
+
+    if (tattr.contains("id")) {
+        opf.idlist.append(tattr.value("id"));
+    }
+}
+
+
+static OPFMetadata ParseOPF(const QString &opfdata)
+{
+    OPFMetadata opf;
+    opf.uid = "bookid";
+    opf.has_metadata = false;
+
+    QString tcontent;
+    Attributes last_tattr;
+    QStringList prefix;
+    int item_count = 0;
+    int pos = 0;
+
+    while (pos < opfdata.length()) {
+        QString text;
+        QString tag;
+        NextPiece(opfdata, pos, text, tag);
+
+        if (!text.isNull()) {
+            tcontent = RightStripped(text);
+            continue;
+        }
+
+        QString tname;
+        QString ttype;
+        Attributes tattr;
+        ParseTag(tag, tname, ttype, tattr);
+
+        if (ttype == "begin") {
+            tcontent = QString();
+            prefix.append(tname);
+            if (OPF_PARENT_TAGS.contains(tname)) {
+                AddElement(opf, prefix.join("."), tname, tattr, tcontent, item_count);
+            } else {
+                last_tattr = tattr;
+            }
+            continue;
+        }
+
+        if (ttype == "end") {
+            if (!prefix.isEmpty()) {
+                prefix.removeLast();
+            }
+            // An element's attributes are on its begin tag
+            tattr = last_tattr;
+            last_tattr = Attributes();
+        } else {
+            tcontent = QString();
+        }
+
+        if (ttype == "single" || !OPF_PARENT_TAGS.contains(tname)) {
+            AddElement(opf, prefix.join("."), tname, tattr, tcontent, item_count);
+        }
+        tcontent = QString();
+    }
+
+    return opf;
+}
+
+
+MetadataPieces MetadataProcessor::GetMetadata(const QString &opfdata, const QString &version)
+{
+    MetadataPieces mdp;
+    OPFMetadata opf = ParseOPF(opfdata);
+    if (!opf.has_metadata) {
+        return mdp;
+    }
+
+    const bool epub3 = version.startsWith('3');
+    QStringList idlist = opf.idlist;
+    QList<MetaElement> rec;
+    QList<MetaElement> refines;
+    QList<MetaElement> other;
+    QHash<QString, int> id2rec;
+
+    foreach(MetaElement element, opf.metadata) {
+        bool recognized = false;
+
+        // Keep the unique identifier out of the editor so that
+        // font obfuscation can not be broken by an edit
+        if (element.name == "dc:identifier" && element.attr.value("id", "") == opf.uid) {
+            other.append(element);
+            continue;
+        }
+
+        if (RECOGNIZED_DC.contains(element.name)) {
+            recognized = true;
+        } else if (epub3 && element.name == "meta" && element.attr.contains("refines") && element.attr.contains("property")) {
+            refines.append(element);
+            continue;
+        } else if (epub3 && element.name == "meta" && element.attr.contains("property") &&
+                   RECOGNIZED_META.contains(element.attr.value("property"))) {
+            element.name = element.attr.take("property");
+            recognized = true;
+        } else if (!epub3 && element.name == "meta" && element.attr.contains("name") &&
+                   !SKIP_META.contains(element.attr.value("name"))) {
+            element.name = element.attr.take("name");
+            element.content = element.attr.take("content", "");
+            recognized = true;
+        }
+
+        if (!recognized) {
+            other.append(element);
+            continue;
+        }
+
+        if (element.attr.contains("id")) {
+            QString id = element.attr.value("id");
+            id2rec[id] = rec.count();
+            idlist.removeOne(id);
+        }
+        rec.append(element);
+    }
+
+    // Refinements of recognized metadata become attributes of their target,
+    // the rest are left alone
+    foreach(MetaElement refinement, refines) {
+        QString tid = refinement.attr.value("refines");
+        if (!tid.startsWith("#") || !id2rec.contains(tid.mid(1))) {
+            other.append(refinement);
+            continue;
+        }
+
+        Attributes &target = rec[id2rec.value(tid.mid(1))].attr;
+        QString prop = refinement.attr.value("property");
+        target.set(prop, refinement.content);
+        if (refinement.attr.contains("scheme")) {
+            target.set("scheme", refinement.attr.value("scheme"));
+        }
+        if (prop == "alternate-script" && refinement.attr.contains("xml:lang")) {
+            target.set("altlang", refinement.attr.value("xml:lang"));
+        }
+        if (refinement.attr.contains("id")) {
+            idlist.removeOne(refinement.attr.value("id"));
+        }
+    }
+
+    QStringList data;
+    foreach(MetaElement element, rec) {
+        data << element.name % US % XmlDecode(element.content) % RS;
+        QStringList keys = element.attr.keys;
+        keys.sort();
+        foreach(QString key, keys) {
+            data << IN % key % US % XmlDecode(element.attr.value(key)) % RS;
+        }
+    }
+    mdp.data = data.join("");
+
+    QStringList otherxml;
+    foreach(MetaElement element, other) {
+        otherxml << IN + BuildXML(element, false);
+    }
+    mdp.otherxml = otherxml.join("");
+
+    mdp.idlist = idlist;
+
+    Attributes metadata_attr = opf.metadata_attr;
+    if (!epub3) {
+        // epub2 metadata needs both the opf and dc namespaces
+        metadata_attr.set("xmlns:opf", "http://www.idpf.org/2007/opf");
+        metadata_attr.set("xmlns:dc", "http://purl.org/dc/elements/1.1/");
+    }
+    mdp.metatag = "<metadata";
+    for (int i = 0; i < metadata_attr.keys.count(); i++) {
+        mdp.metatag.append(" " + metadata_attr.keys.at(i) + "=\"" + metadata_attr.values.at(i) + "\"");
+    }
+    mdp.metatag.append(">\n");
+
+    return mdp;
+}
+
+
+QString MetadataProcessor::SetNewMetadata(const MetadataPieces &mdp, const QString &opfdata, const QString &version)
+{
+    if (mdp.metatag.isEmpty()) {
+        return opfdata;
+    }
+
+    const bool epub3 = version.startsWith('3');
+    QStringList idlist = mdp.idlist;
+    QList<MetaElement> newmd;
+
+    QStringList datalst = mdp.data.split(RS);
+    if (!datalst.isEmpty() && datalst.last().isEmpty()) {
+        datalst.removeLast();
+    }
+
+    int pos = 0;
+    const int cnt = datalst.count();
+    while (pos < cnt) {
+        // Each record starts with its element, followed by any children
+        MetaElement element;
+        Attributes refinements;
+        QString id;
+        element.name = datalst.at(pos).section(US, 0, 0).trimmed();
+        element.content = datalst.at(pos).section(US, 1).trimmed();
+
+        if (epub3 && RECOGNIZED_META.contains(element.name)) {
+            element.attr.set("property", element.name);
+            element.name = "meta";
+        } else if (!epub3 && !RECOGNIZED_DC.contains(element.name)) {
+            element.attr.set("name", element.name);
+            element.attr.set("content", element.content);
+            element.name = "meta";
+            element.content = QString();
+        }
+        pos++;
+
+        while (pos < cnt && datalst.at(pos).startsWith(IN)) {
+            QString name = datalst.at(pos).section(US, 0, 0).trimmed();
+            QString value = datalst.at(pos).section(US, 1).trimmed();
+            if (name == "id") {
+                id = ValidId(value, idlist);
+                element.attr.set("id", id);
+            } else if (!epub3 || ELEMENT_ATTRIBUTES.contains(name)) {
+                element.attr.set(name, value);
+            } else {
+                refinements.set(name, value);
+            }
+            pos++;
+        }
+
+        // Refinements need an id to point at
+        if (!refinements.isEmpty() && id.isEmpty()) {
+            id = ValidId(IdRoot(element.name), idlist);
+            element.attr.set("id", id);
+        }
+
+        newmd.append(element);
+
+        for (int i = 0; i < refinements.keys.count(); i++) {
+            QString prop = refinements.keys.at(i);
+            if (REFINEMENT_QUALIFIERS.contains(prop)) {
+                continue;
+            }
+            MetaElement refinement;
+            refinement.name = "meta";
+            refinement.content = refinements.values.at(i);
+            refinement.attr.set("refines", "#" + id);
+            refinement.attr.set("property", prop);
+            if (prop == "alternate-script" && refinements.contains("altlang")) {
+                refinement.attr.set("xml:lang", refinements.value("altlang"));
+            }
+            if (SCHEMED_REFINEMENTS.contains(prop) && refinements.contains("scheme")) {
+                refinement.attr.set("scheme", refinements.value("scheme"));
+            }
+            newmd.append(refinement);
+        }
+    }
+
+    QStringList res;
+    res << mdp.metatag;
+    foreach(MetaElement element, newmd) {
+        res << IN + BuildXML(element, true);
+    }
+    res << mdp.otherxml;
+    res << "</metadata>\n";
+
+    QRegularExpressionMatch match = METADATA_PATTERN.match(opfdata);
+    if (!match.hasMatch()) {
+        return opfdata;
+    }
+    return opfdata.left(match.capturedStart()) + res.join("") + opfdata.mid(match.capturedEnd());
+}
@@ -0,0 +1,57 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef METADATAPROCESSOR_H
+#define METADATAPROCESSOR_H
+
+#include <QtCore/QString>
+
+#include "Misc/PythonRoutines.h"
+
+/**
+ * Splits the metadata of an OPF into the pieces the Metadata Editor
+ * works on, and puts edited pieces back into the OPF.
+ *
+ * This is the native version of metaproc2.py (epub2) and metaproc3.py
+ * (epub3). The recognized metadata is a text tree of records, each
+ * an element followed by its attributes (and for epub3 its refinements)
+ * as indented children. Everything else in the metadata is kept as
+ * written and put back untouched.
+ */
+class MetadataProcessor
+{
+public:
+
+    /**
+     * @param opfdata The text of the OPF.
+     * @param version The epub version of the book.
+     */
+    static MetadataPieces GetMetadata(const QString &opfdata, const QString &version);
+
+    /**
+     * @return The OPF with its metadata rebuilt from the pieces,
+     *         or opfdata unchanged if it has no metadata to replace.
+     */
+    static QString SetNewMetadata(const MetadataPieces &mdp, const QString &opfdata, const QString &version);
+};
+
+#endif // METADATAPROCESSOR_H
@@ -0,0 +1,218 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+#include <QtCore/QUrl>
+
+#include "Misc/Landmarks.h"
+#include "Misc/NCXGenerator.h"
+#include "Misc/QuickParser.h"
+
+static const QString IND = "  ";
+
+static const QStringList BOOK_FOLDERS = QStringList() << "Images" << "Fonts" << "Text" << "Styles"
+                                                      << "Audio" << "Video" << "Misc";
+
+
+QString NCXGenerator::GenerateNCX(const QString &navdata, const QString &navname,
+                                  const QString &doctitle, const QString &mainid)
+{
+    return BuildNCX(doctitle, mainid, ParseNav(navdata, navname));
+}
+
+
+// Parse the nav to extract the toc, the page-list and the landmarks
+NCXGenerator::NavContents NCXGenerator::ParseNav(const QString &navdata, const QString &navname)
+{
+    NavContents nav;
+    nav.maxlvl = -1;
+    nav.pgcnt = 0;
+    int lvl = 0;
+    int play = 0;
+    bool in_nav = false;
+    QString nav_type;
+    QString href;
+    bool has_epubtype = false;
+    QString epubtype;
+    QString title;
+
+    QuickParser qp(navdata);
+    while (!qp.AtEnd()) {
+        QuickParser::MarkupInfo mi = qp.Next();
+
+        if (mi.IsText()) {
+            if (mi.tpath.contains(".a.") || mi.tpath.endsWith(".a")) {
+                title = title + mi.text;
+            } else {
+                title = "";
+            }
+            continue;
+        }
+
+        if (mi.tname == "nav") {
+            if (mi.ttype == "begin") {
+                in_nav = mi.tattr.contains("epub:type");
+                nav_type = mi.tattr.value("epub:type");
+            }
+            if (mi.ttype == "end") {
+                in_nav = false;
+                nav_type = QString();
+            }
+            continue;
+        }
+
+        if (mi.tname == "ol" && in_nav &&
+            (nav_type == "toc" || nav_type == "page-list" || nav_type == "landmarks")) {
+            if (mi.ttype == "begin") {
+                lvl++;
+                if (nav_type == "toc" && lvl > nav.maxlvl) {
+                    nav.maxlvl = lvl;
+                }
+            }
+            if (mi.ttype == "end") {
+                lvl--;
+            }
+            continue;
+        }
+
+        if (mi.tname == "a" && mi.ttype == "begin") {
+            href = FixupHref(mi.tattr.value("href", ""), navname);
+            has_epubtype = mi.tattr.contains("epub:type");
+            epubtype = mi.tattr.value("epub:type");
+            continue;
+        }
+
+        if (mi.tname == "a" && mi.ttype == "end") {
+            if (in_nav && nav_type == "toc") {
+                play++;
+                TOCEntry entry = { play, lvl, href, title };
+                nav.toc.append(entry);
+            } else if (in_nav && nav_type == "page-list") {
+                nav.pgcnt++;
+                PageEntry entry = { nav.pgcnt, href, title };
+                nav.pages.append(entry);
+            } else if (in_nav && nav_type == "landmarks") {
+                if (has_epubtype) {
+                    LandmarkEntry entry = { Landmarks::GuideTypeForLandmark(epubtype),
+                                            QUrl::fromPercentEncoding(href.toUtf8()),
+                                            title };
+                    nav.landmarks.append(entry);
+                }
+            }
+            title = "";
+            continue;
+        }
+    }
+
+    return nav;
+}
+
+
+// The nav lives in OEBPS/Text in Sigil and the ncx in OEBPS/,
+// so fix up the hrefs to be what they need to be for the ncx.
+// They are kept in their quoted form.
+QString NCXGenerator::FixupHref(const QString &href, const QString &navname)
+{
+    QString result = href;
+
+    if (result.startsWith("./")) {
+        result = result.mid(2);
+        if (result.isEmpty()) {
+            result = "Text/" + navname;
+        } else {
+            result = "Text/" + result;
+        }
+    } else if (result.startsWith("#")) {
+        result = "Text/" + navname + result;
+    } else if (result.startsWith("../")) {
+        result = result.mid(3);
+        if (!BOOK_FOLDERS.contains(result.split("/").at(0))) {
+            result = "Text/" + result;
+        }
+    } else {
+        if (!BOOK_FOLDERS.contains(result.split("/").at(0))) {
+            result = "Text/" + result;
+        }
+    }
+
+    return result;
+}
+
+
+QString NCXGenerator::BuildNCX(const QString &doctitle, const QString &mainid, const NavContents &nav)
+{
+    QString ncx;
+    ncx.append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+    ncx.append("<ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\">\n");
+    ncx.append("  <head>\n");
+    ncx.append("    <meta name=\"dtb:uid\" content=\"" + mainid + "\" />\n");
+    ncx.append("    <meta name=\"dtb:depth\" content=\"" + QString::number(nav.maxlvl) + "\" />\n");
+    ncx.append("    <meta name=\"dtb:totalPageCount\" content=\"" + QString::number(nav.pgcnt) + "\" />\n");
+    ncx.append("    <meta name=\"dtb:maxPageNumber\" content=\"" + QString::number(nav.pgcnt) + "\" />\n");
+    ncx.append("  </head>\n");
+    ncx.append("<docTitle>\n");
+    ncx.append("  <text>" + doctitle + "</text>\n");
+    ncx.append("</docTitle>\n");
+    ncx.append("<navMap>\n");
+
+    int plvl = -1;
+    foreach(const TOCEntry &entry, nav.toc) {
+        // First close off any already opened navPoints
+        while (entry.lvl <= plvl) {
+            ncx.append(IND.repeated(plvl) + "</navPoint>\n");
+            plvl--;
+        }
+        // Now append this navPoint
+        QString space = IND.repeated(entry.lvl);
+        ncx.append(space + "<navPoint id=\"navPoint" + QString::number(entry.play_order) + "\">\n");
+        ncx.append(space + "  <navLabel>\n");
+        ncx.append(space + "    <text>" + entry.title + "</text>\n");
+        ncx.append(space + "  </navLabel>\n");
+        ncx.append(space + "  <content src=\"" + entry.href + "\" />\n");
+        plvl = entry.lvl;
+    }
+
+    // Now finish off any open navPoints
+    while (plvl > 0) {
+        ncx.append(IND.repeated(plvl) + "</navPoint>\n");
+        plvl--;
+    }
+    ncx.append("</navMap>\n");
+
+    if (nav.pgcnt > 0) {
+        int play = nav.toc.count();
+        ncx.append("<pageList>\n");
+        foreach(const PageEntry &entry, nav.pages) {
+            QString porder = QString::number(play + entry.count);
+            ncx.append(IND + "<pageTarget id=\"navPoint" + porder + "\" type=\"normal\"" +
+                       " value=\"" + entry.title + "\">\n");
+            ncx.append(IND.repeated(2) + "<navLabel><text>" + entry.title + "</text></navLabel>\n");
+            ncx.append(IND.repeated(2) + "<content src=\"" + entry.href + "\" />\n");
+            ncx.append(IND + "</pageTarget>\n");
+        }
+        ncx.append("</pageList>\n");
+    }
+
+    // Now close it off
+    ncx.append("</ncx>\n");
+    return ncx;
+}
@@ -0,0 +1,89 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef NCXGENERATOR_H
+#define NCXGENERATOR_H
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+/**
+ * Builds an epub2 NCX from an epub3 nav document.
+ *
+ * This is the native version of ncxgenerator.py and produces the
+ * same text. The nav is walked with QuickParser, so titles are copied
+ * as written, entities and inline markup included.
+ */
+class NCXGenerator
+{
+public:
+
+    /**
+     * @param navdata The mended text of the nav document.
+     * @param navname The file name of the nav document.
+     * @param doctitle The dc:title of the book.
+     * @param mainid The unique identifier of the book.
+     */
+    static QString GenerateNCX(const QString &navdata, const QString &navname,
+                               const QString &doctitle, const QString &mainid);
+
+private:
+
+    struct TOCEntry {
+        int play_order;
+        int lvl;
+        QString href;
+        QString title;
+    };
+
+    struct PageEntry {
+        int count;
+        QString href;
+        QString title;
+    };
+
+    struct LandmarkEntry {
+        QString guide_type;
+        QString href;
+        QString title;
+    };
+
+    struct NavContents {
+        QList<TOCEntry> toc;
+        QList<PageEntry> pages;
+        QList<LandmarkEntry> landmarks;
+        int maxlvl;
+        int pgcnt;
+    };
+
+    static NavContents ParseNav(const QString &navdata, const QString &navname);
+
+    /**
+     * @return The href of a nav link made relative to OEBPS,
+     *         where the NCX lives.
+     */
+    static QString FixupHref(const QString &href, const QString &navname);
+
+    static QString BuildNCX(const QString &doctitle, const QString &mainid, const NavContents &nav);
+};
+
+#endif // NCXGENERATOR_H
@@ -20,11 +20,15 @@
 **
 *************************************************************************/
 
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
+#include <QJsonDocument>
 #include <QStringList>
 #include <QXmlStreamReader>
+#include <QtConcurrent/QtConcurrent>
 
 #include "Misc/Plugin.h"
 #include "Misc/PluginDB.h"
@@ -32,6 +36,9 @@
 #include "Misc/Utility.h"
 #include "sigil_constants.h"
 
+static const QString PLUGIN_CACHE_FILE = "plugin_cache.json";
+static const int PLUGIN_CACHE_VERSION = 1;
+
 PluginDB *PluginDB::m_instance = 0;
 
 PluginDB *PluginDB::instance()
@@ -44,6 +51,8 @@ PluginDB *PluginDB::instance()
 }
 
 PluginDB::PluginDB()
+    : m_modify_count(0),
+      m_revalidate_count(0)
 {
     SettingsStore ss;
 
@@ -53,10 +62,14 @@ PluginDB::PluginDB()
     if (!pluginDir.exists()) {
         pluginDir.mkpath(pluginsPath());
     }
+
+    connect(&m_revalidate_watcher, SIGNAL(finished()), this, SLOT(revalidate_finished()));
 }
 
 PluginDB::~PluginDB()
 {
+    m_revalidate_watcher.waitForFinished();
+
     foreach(Plugin *p, m_plugins) {
         delete p;
     }
@@ -130,22 +143,201 @@ QString PluginDB::launcherRoot()
 
 void PluginDB::load_plugins_from_disk(bool force)
 {
-    QDir        d(pluginsPath());
-    QStringList dplugins;
+    QDir d(pluginsPath());
 
     if (!d.exists()) {
         return;
     }
 
-    dplugins = d.entryList(QStringList("*"), QDir::Dirs|QDir::NoDotAndDotDot);
-
-    Q_FOREACH(QString p, dplugins) {
-        add_plugin_int(p, force);
+    // Show the plugins as they were last time and check the folders
+    // for changes in the background.
+    PluginCache cached;
+    if (!force) {
+        cached = read_cache();
+    }
+    if (!cached.isEmpty()) {
+        apply_cache(cached);
+        emit plugins_changed();
+        m_revalidate_count = m_modify_count;
+        m_revalidate_watcher.setFuture(QtConcurrent::run(&PluginDB::scan_plugins, cached));
+        return;
     }
 
+    PluginCache scanned = scan_plugins(PluginCache());
+    apply_cache(scanned);
+    write_cache(scanned);
     emit plugins_changed();
 }
 
+void PluginDB::revalidate_finished()
+{
+    PluginCache scanned = m_revalidate_watcher.result();
+
+    // Plugins were added or removed while the scan ran
+    if (m_revalidate_count != m_modify_count) {
+        return;
+    }
+
+    write_cache(scanned);
+    if (apply_cache(scanned)) {
+        emit plugins_changed();
+    }
+}
+
+PluginCache PluginDB::scan_plugins(const PluginCache &cached)
+{
+    PluginCache scanned;
+    QDir d(pluginsPath());
+    QStringList dplugins = d.entryList(QStringList("*"), QDir::Dirs|QDir::NoDotAndDotDot);
+
+    foreach(QString name, dplugins) {
+        QFileInfo dirinfo(d.absoluteFilePath(name));
+        QFileInfo xmlinfo(dirinfo.absoluteFilePath() + "/plugin.xml");
+        if (!xmlinfo.exists()) {
+            continue;
+        }
+
+        QJsonObject entry = cached.value(name);
+        qint64 dir_mtime = dirinfo.lastModified().toMSecsSinceEpoch();
+        qint64 xml_mtime = xmlinfo.lastModified().toMSecsSinceEpoch();
+        qint64 xml_size = xmlinfo.size();
+        bool unchanged = !entry.isEmpty() &&
+                         entry.value("dir_mtime").toDouble() == dir_mtime &&
+                         entry.value("xml_mtime").toDouble() == xml_mtime &&
+                         entry.value("xml_size").toDouble() == xml_size;
+
+        if (!unchanged) {
+            // A touched but otherwise identical plugin.xml needs no parsing
+            QFile file(xmlinfo.absoluteFilePath());
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
+            QString xml_hash = QString::fromLatin1(QCryptographicHash::hash(file.readAll(), QCryptographicHash::Md5).toHex());
+            if (entry.isEmpty() || entry.value("xml_hash").toString() != xml_hash) {
+                entry = QJsonObject();
+                Plugin *plugin = load_plugin(name);
+                if (plugin) {
+                    QJsonObject info;
+                    QHash<QString, QString> values = plugin->serialize();
+                    foreach(QString key, values.keys()) {
+                        info.insert(key, values.value(key));
+                    }
+                    entry.insert("info", info);
+                    delete plugin;
+                }
+            }
+            entry.insert("dir_mtime", double(dir_mtime));
+            entry.insert("xml_mtime", double(xml_mtime));
+            entry.insert("xml_size", double(xml_size));
+            entry.insert("xml_hash", xml_hash);
+        }
+
+        if (entry.contains("info")) {
+            // A custom icon can be set without touching the plugin folder
+            QJsonObject info = entry.value("info").toObject();
+            info.insert("iconpath", plugin_iconpath(name));
+            entry.insert("info", info);
+        }
+
+        scanned.insert(name, entry);
+    }
+
+    return scanned;
+}
+
+bool PluginDB::apply_cache(const PluginCache &cache)
+{
+    QHash<QString, QHash<QString, QString> > infos;
+
+    foreach(QJsonObject entry, cache) {
+        if (!entry.contains("info")) {
+            continue;
+        }
+        QHash<QString, QString> values;
+        QJsonObject info = entry.value("info").toObject();
+        foreach(QString key, info.keys()) {
+            values.insert(key, info.value(key).toString());
+        }
+        infos.insert(values.value("name"), values);
+    }
+
+    bool changed = false;
+    foreach(QString name, m_plugins.keys()) {
+        if (!infos.contains(name)) {
+            delete m_plugins.take(name);
+            changed = true;
+        }
+    }
+
+    foreach(QString name, infos.keys()) {
+        Plugin plugin(infos.value(name));
+        if (!plugin.isvalid()) {
+            continue;
+        }
+        Plugin *existing = m_plugins.value(name);
+        if (!existing) {
+            m_plugins.insert(name, new Plugin(plugin));
+            changed = true;
+        } else if (existing->serialize() != plugin.serialize()) {
+            *existing = plugin;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+QString PluginDB::cachePath()
+{
+    return Utility::DefinePrefsDir() + "/" + PLUGIN_CACHE_FILE;
+}
+
+PluginCache PluginDB::read_cache()
+{
+    PluginCache cache;
+    QFile file(cachePath());
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return cache;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root.value("version").toInt() != PLUGIN_CACHE_VERSION) {
+        return cache;
+    }
+
+    QJsonObject plugins = root.value("plugins").toObject();
+    foreach(QString name, plugins.keys()) {
+        cache.insert(name, plugins.value(name).toObject());
+    }
+
+    return cache;
+}
+
+void PluginDB::write_cache(const PluginCache &cache)
+{
+    QJsonObject plugins;
+    foreach(QString name, cache.keys()) {
+        plugins.insert(name, cache.value(name));
+    }
+
+    QJsonObject root;
+    root.insert("version", PLUGIN_CACHE_VERSION);
+    root.insert("plugins", plugins);
+
+    QFile file(cachePath());
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    }
+}
+
+void PluginDB::plugins_modified()
+{
+    // The next launch rescans the folders and writes a fresh cache
+    m_modify_count++;
+    QFile::remove(cachePath());
+}
+
 PluginDB::AddResult PluginDB::add_plugin(const QString &path, bool force)
 {
     PluginDB::AddResult ret;
@@ -171,6 +363,7 @@ PluginDB::AddResult PluginDB::add_plugin(const QString &path, bool force)
         // Couldn't load the plugin so remove it.
         Utility::removeDir(pluginsPath() + "/" + name);
     } else {
+        plugins_modified();
         emit plugins_changed();
     }
 
@@ -227,6 +420,7 @@ void PluginDB::remove_plugin(const QString &name)
         delete p;
     }
     Utility::removeDir(pluginsPath() + "/" + name);
+    plugins_modified();
     emit plugins_changed();
 }
 
@@ -239,6 +433,7 @@ void PluginDB::remove_all_plugins()
         Utility::removeDir(pluginsPath() + "/" + k);
     }
     m_plugins.clear();
+    plugins_modified();
     emit plugins_changed();
 }
 
@@ -311,20 +506,9 @@ Plugin *PluginDB::load_plugin(const QString &name)
         }
     }
 
-    // First look for a persistent custom user-specified
-    // icon in the plugin's preference folder.
-    QString iconpath = pluginsPath() + "/../plugins_prefs/" + name + "/plugin.png";
-    QFileInfo fileinfo(iconpath);
-    if (fileinfo.exists() && fileinfo.isFile() && fileinfo.isReadable()) {
+    QString iconpath = plugin_iconpath(name);
+    if (!iconpath.isEmpty()) {
         plugin->set_iconpath(iconpath);
-    } else {
-        // If no custom user-supplied icon, look in the
-        // plugin folder for a plugin dev-supplied icon.
-        iconpath = pluginsPath() + "/" + name + "/plugin.png";
-        QFileInfo fileinfo(iconpath);
-        if (fileinfo.exists() && fileinfo.isFile() && fileinfo.isReadable()) {
-            plugin->set_iconpath(iconpath);
-        }
     }
 
     if (!plugin->isvalid()) {
@@ -334,3 +518,24 @@ Plugin *PluginDB::load_plugin(const QString &name)
 
     return plugin;
 }
+
+QString PluginDB::plugin_iconpath(const QString &name)
+{
+    // First look for a persistent custom user-specified
+    // icon in the plugin's preference folder.
+    QString iconpath = pluginsPath() + "/../plugins_prefs/" + name + "/plugin.png";
+    QFileInfo fileinfo(iconpath);
+    if (fileinfo.exists() && fileinfo.isFile() && fileinfo.isReadable()) {
+        return iconpath;
+    }
+
+    // If no custom user-supplied icon, look in the
+    // plugin folder for a plugin dev-supplied icon.
+    iconpath = pluginsPath() + "/" + name + "/plugin.png";
+    fileinfo.setFile(iconpath);
+    if (fileinfo.exists() && fileinfo.isFile() && fileinfo.isReadable()) {
+        return iconpath;
+    }
+
+    return QString();
+}
@@ -23,11 +23,16 @@
 #ifndef PLUGINDB_H
 #define PLUGINDB_H
 
+#include <QFutureWatcher>
 #include <QHash>
+#include <QJsonObject>
 
 class QString;
 class Plugin;
 
+// Plugin folder name to its cached fingerprint and plugin.xml info
+typedef QHash<QString, QJsonObject> PluginCache;
+
 /**
  * Singleton.
  */
@@ -66,16 +71,52 @@ public:
 signals:
     void plugins_changed();
 
+private slots:
+    void revalidate_finished();
+
 private:
     PluginDB();
 
     PluginDB::AddResult add_plugin_int(const QString &path, bool force=false);
-    Plugin *load_plugin(const QString &name);
+    static Plugin *load_plugin(const QString &name);
+    static QString plugin_iconpath(const QString &name);
     bool verify_plugin_zip(const QString &path, const QString &name);
 
+    /**
+     * Fingerprints every plugin folder, parsing only the plugin.xml
+     * files that changed since the cached fingerprint. Runs on a worker.
+     */
+    static PluginCache scan_plugins(const PluginCache &cached);
+
+    static QString cachePath();
+    static PluginCache read_cache();
+    static void write_cache(const PluginCache &cache);
+
+    /**
+     * Makes m_plugins match the cache. Plugins that are still there
+     * are updated in place so pointers handed out stay valid.
+     *
+     * @return true if any plugin was added, removed or changed.
+     */
+    bool apply_cache(const PluginCache &cache);
+
+    /**
+     * Called whenever plugins are added or removed on disk by us.
+     */
+    void plugins_modified();
+
     QHash<QString, Plugin *> m_plugins;
     QHash<QString, QString> m_engine_paths;
 
+    QFutureWatcher<PluginCache> m_revalidate_watcher;
+
+    /**
+     * Bumped by plugins_modified so a revalidation that started
+     * before the change is not applied.
+     */
+    int m_modify_count;
+    int m_revalidate_count;
+
     static PluginDB *m_instance;
 };
 
@@ -0,0 +1,188 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+
+#include "Misc/PluginHost.h"
+
+// Printed by pluginhost.py on a line of its own after each run
+static const QByteArray RUN_DONE = "\x04SIGIL_PLUGIN_HOST_RUN_DONE\n";
+
+// How long a host that is no longer wanted gets to exit on its own
+static const int HOST_EXIT_WAIT_MS = 1000;
+
+QHash<QString, PluginHost *> PluginHost::s_Hosts;
+
+
+PluginHost *PluginHost::Instance(const QString &executable,
+                                 const QStringList &interpreter_args,
+                                 const QString &host_script,
+                                 const QProcessEnvironment &env,
+                                 const QString &working_dir)
+{
+    QStringList key_parts;
+    key_parts << executable << interpreter_args.join(" ") << host_script
+              << env.toStringList().join("\n") << working_dir;
+    QString key = key_parts.join("\n");
+
+    PluginHost *host = s_Hosts.value(executable);
+    if (host && host->m_Key == key && host->m_Process.state() != QProcess::NotRunning) {
+        return host;
+    }
+    if (host) {
+        delete host;
+    }
+
+    // Owned by the application so hosts are shut down on exit
+    host = new PluginHost(executable, key);
+    host->setParent(QCoreApplication::instance());
+    if (!env.isEmpty()) {
+        host->m_Process.setProcessEnvironment(env);
+    }
+    if (!working_dir.isEmpty()) {
+        host->m_Process.setWorkingDirectory(working_dir);
+    }
+    host->m_Process.start(executable, QStringList(interpreter_args) << host_script);
+    s_Hosts.insert(executable, host);
+    return host;
+}
+
+
+PluginHost::PluginHost(const QString &executable, const QString &key)
+    :
+    QObject(),
+    m_Executable(executable),
+    m_Key(key),
+    m_RunInProgress(false)
+{
+    connect(&m_Process, SIGNAL(readyReadStandardOutput()), this, SLOT(ReadStandardOutput()));
+    connect(&m_Process, SIGNAL(readyReadStandardError()), this, SLOT(ReadStandardError()));
+    connect(&m_Process, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(ProcessFinished(int, QProcess::ExitStatus)));
+    connect(&m_Process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(ProcessError(QProcess::ProcessError)));
+}
+
+
+PluginHost::~PluginHost()
+{
+    if (s_Hosts.value(m_Executable) == this) {
+        s_Hosts.remove(m_Executable);
+    }
+
+    m_Process.disconnect(this);
+    if (m_Process.state() != QProcess::NotRunning) {
+        // Closing its stdin ends the host's wait for the next run
+        m_Process.closeWriteChannel();
+        if (!m_Process.waitForFinished(HOST_EXIT_WAIT_MS)) {
+            m_Process.kill();
+            m_Process.waitForFinished(HOST_EXIT_WAIT_MS);
+        }
+    }
+}
+
+
+void PluginHost::Run(const QStringList &launcher_args)
+{
+    m_Pending.clear();
+    m_RunInProgress = true;
+    QByteArray request = QJsonDocument(QJsonArray::fromStringList(launcher_args)).toJson(QJsonDocument::Compact);
+    // Written before the host has started, the request waits in the write buffer
+    m_Process.write(request + "\n");
+}
+
+
+bool PluginHost::IsRunning() const
+{
+    return m_RunInProgress;
+}
+
+
+void PluginHost::Kill()
+{
+    if (m_Process.state() != QProcess::NotRunning) {
+        m_Process.kill();
+    }
+}
+
+
+void PluginHost::ReadStandardOutput()
+{
+    m_Pending.append(m_Process.readAllStandardOutput());
+
+    int done = m_Pending.indexOf(RUN_DONE);
+    if (done != -1) {
+        QByteArray output = m_Pending.left(done);
+        m_Pending.clear();
+        m_RunInProgress = false;
+        if (!output.isEmpty()) {
+            emit StandardOutput(output);
+        }
+        emit RunFinished();
+        return;
+    }
+
+    // Hold back what may be the start of a marker split across reads
+    int marker_start = m_Pending.lastIndexOf(RUN_DONE.at(0));
+    int shown = marker_start == -1 ? m_Pending.length() : marker_start;
+    if (shown > 0) {
+        emit StandardOutput(m_Pending.left(shown));
+        m_Pending.remove(0, shown);
+    }
+}
+
+
+void PluginHost::ReadStandardError()
+{
+    emit StandardError(m_Process.readAllStandardError());
+}
+
+
+void PluginHost::ProcessFinished(int exitcode, QProcess::ExitStatus exitstatus)
+{
+    if (s_Hosts.value(m_Executable) == this) {
+        s_Hosts.remove(m_Executable);
+    }
+
+    if (m_RunInProgress) {
+        m_RunInProgress = false;
+        if (!m_Pending.isEmpty()) {
+            emit StandardOutput(m_Pending);
+            m_Pending.clear();
+        }
+        emit HostExited(exitcode, exitstatus);
+    }
+
+    deleteLater();
+}
+
+
+void PluginHost::ProcessError(QProcess::ProcessError error)
+{
+    if (m_RunInProgress && error == QProcess::FailedToStart) {
+        m_RunInProgress = false;
+        if (s_Hosts.value(m_Executable) == this) {
+            s_Hosts.remove(m_Executable);
+        }
+        emit HostError(error);
+        deleteLater();
+    }
+}
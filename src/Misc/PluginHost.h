@@ -0,0 +1,123 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef PLUGINHOST_H
+#define PLUGINHOST_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QProcess>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * A long lived interpreter that runs plugins one after another.
+ *
+ * Starting an interpreter and importing the launcher, the bs4, css and
+ * gumbo modules costs more than many light plugins take to run. The host
+ * (pluginhost.py) pays that once and then runs each plugin the way
+ * launcher.py would, printing the same output followed by an end of run
+ * marker. A plugin that brings the host down only ends that run; the
+ * next run starts a new host.
+ */
+class PluginHost : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * @return The host for an interpreter started this way, starting
+     *         one if there is none. A host started differently for the
+     *         same interpreter, e.g. before a settings change, is stopped.
+     */
+    static PluginHost *Instance(const QString &executable,
+                                const QStringList &interpreter_args,
+                                const QString &host_script,
+                                const QProcessEnvironment &env,
+                                const QString &working_dir);
+
+    ~PluginHost();
+
+    /**
+     * Starts a plugin run.
+     *
+     * @param launcher_args The arguments launcher.py would be given.
+     */
+    void Run(const QStringList &launcher_args);
+
+    bool IsRunning() const;
+
+    /**
+     * Ends the current run by stopping the host.
+     */
+    void Kill();
+
+signals:
+    void StandardOutput(const QByteArray &data);
+    void StandardError(const QByteArray &data);
+
+    /**
+     * The run printed all its output and the host waits for the next.
+     */
+    void RunFinished();
+
+    /**
+     * The host ended during a run.
+     */
+    void HostExited(int exitcode, QProcess::ExitStatus exitstatus);
+
+    void HostError(QProcess::ProcessError error);
+
+private slots:
+    void ReadStandardOutput();
+    void ReadStandardError();
+    void ProcessFinished(int exitcode, QProcess::ExitStatus exitstatus);
+    void ProcessError(QProcess::ProcessError error);
+
+private:
+    PluginHost(const QString &executable, const QString &key);
+
+    QProcess m_Process;
+
+    QString m_Executable;
+
+    /**
+     * Everything the host was started with.
+     */
+    QString m_Key;
+
+    /**
+     * Output held back because it may be the start of the end of run marker.
+     */
+    QByteArray m_Pending;
+
+    bool m_RunInProgress;
+
+    /**
+     * The hosts by interpreter executable.
+     */
+    static QHash<QString, PluginHost *> s_Hosts;
+};
+
+#endif // PLUGINHOST_H
@@ -40,11 +40,6 @@ public:
 
     PythonRoutines() {};
 
-    QString GenerateNcxInPython(const QString &navdata, const QString &navname,
-                                const QString &doctitle, const QString & mainid);
-
-    QList<QStringList> UpdateGuideFromNavInPython(const QString &navdata, const QString &navname);
-
     MetadataPieces GetMetadataInPython(const QString& opfdata, const QString& version);
     QString SetNewMetadataInPython(const MetadataPieces& mdp, const QString& opfdata, const QString& version);
 
@@ -0,0 +1,228 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include "Misc/QuickParser.h"
+
+// The special tags and how many characters at their end are not content
+static const QString COMMENT_TAG = "!--";
+static const QString XMLHEADER_TAG = "?xml";
+static const QString DOCTYPE_TAG = "!DOCTYPE";
+
+// Python style slice s[start:len(s)+backstep], which is empty
+// rather than negative when start is past the end
+static QString SliceToBackstep(const QString &s, int start, int backstep)
+{
+    int end = s.length() + backstep;
+    if (start >= end) {
+        return QString("");
+    }
+    return s.mid(start, end - start);
+}
+
+
+QuickParser::QuickParser(const QString &source)
+    :
+    m_Source(source),
+    m_Pos(0)
+{
+    m_TagPath << QString("");
+}
+
+
+bool QuickParser::AtEnd() const
+{
+    return m_Pos >= m_Source.length();
+}
+
+
+QuickParser::MarkupInfo QuickParser::Next()
+{
+    MarkupInfo mi;
+    QString text;
+    QString tag;
+    ParseML(text, tag);
+    mi.tpath = m_TagPath.join(".");
+
+    if (!text.isNull()) {
+        mi.text = text;
+        return mi;
+    }
+
+    if (tag.isNull()) {
+        return mi;
+    }
+
+    ParseTag(tag, mi);
+
+    if (mi.ttype == "begin") {
+        m_TagPath.append(mi.tname);
+    } else if (mi.ttype == "end" && !m_TagPath.isEmpty()) {
+        // Improperly nested tags still close the innermost one
+        m_TagPath.removeLast();
+    }
+
+    return mi;
+}
+
+
+void QuickParser::ParseML(QString &text, QString &tag)
+{
+    const int p = m_Pos;
+    const int length = m_Source.length();
+
+    if (p >= length) {
+        return;
+    }
+
+    if (m_Source.at(p) != QChar('<')) {
+        int res = m_Source.indexOf(QChar('<'), p);
+        if (res == -1) {
+            res = length;
+        }
+        m_Pos = res;
+        text = m_Source.mid(p, res - p);
+        return;
+    }
+
+    int te;
+    // Comments can span lines and hold anything
+    if (m_Source.midRef(p, 4) == "<!--") {
+        te = m_Source.indexOf("-->", p + 1);
+        if (te != -1) {
+            te = te + 2;
+        }
+    } else {
+        te = m_Source.indexOf(QChar('>'), p + 1);
+        int ntb = m_Source.indexOf(QChar('<'), p + 1);
+        if (ntb != -1 && (te == -1 || ntb < te)) {
+            // A stray < is text
+            m_Pos = ntb;
+            text = m_Source.mid(p, ntb - p);
+            return;
+        }
+    }
+
+    if (te == -1) {
+        // Unterminated, so the tag runs to the end
+        te = length - 1;
+    }
+
+    m_Pos = te + 1;
+    tag = m_Source.mid(p, te + 1 - p);
+}
+
+
+void QuickParser::ParseTag(const QString &s, MarkupInfo &mi) const
+{
+    const int n = s.length();
+    int p = 1;
+
+    while (p < n && s.at(p) == QChar(' ')) {
+        p++;
+    }
+
+    if (p < n && s.at(p) == QChar('/')) {
+        mi.ttype = "end";
+        p++;
+        while (p < n && s.at(p) == QChar(' ')) {
+            p++;
+        }
+    }
+
+    int b = p;
+
+    // There may be no spaces to delimit a comment's name
+    if (s.midRef(b).startsWith(COMMENT_TAG)) {
+        p = b + 3;
+        mi.tname = COMMENT_TAG;
+        mi.ttype = "comment";
+        mi.tattr["special"] = SliceToBackstep(s, p, -3).trimmed();
+        return;
+    }
+
+    while (p < n) {
+        QChar c = s.at(p);
+        if (c == QChar('>') || c == QChar('/') || c == QChar(' ') || c == QChar('"') ||
+            c == QChar('\'') || c == QChar('\r') || c == QChar('\n')) {
+            break;
+        }
+        p++;
+    }
+
+    mi.tname = s.mid(b, p - b).toLower();
+    if (mi.tname == "!doctype") {
+        mi.tname = DOCTYPE_TAG;
+    }
+
+    if (mi.tname == XMLHEADER_TAG) {
+        mi.ttype = "xmlheader";
+        mi.tattr["special"] = SliceToBackstep(s, p, -1);
+    } else if (mi.tname == DOCTYPE_TAG) {
+        mi.ttype = "doctype";
+        mi.tattr["special"] = SliceToBackstep(s, p, -1);
+    }
+
+    if (mi.ttype.isEmpty()) {
+        // Parse any attributes
+        while (s.indexOf(QChar('='), p) != -1) {
+            while (p < n && s.at(p) == QChar(' ')) {
+                p++;
+            }
+            b = p;
+            while (p < n && s.at(p) != QChar('=')) {
+                p++;
+            }
+            // Attribute names can be mixed case and are in SVG
+            QString aname = s.mid(b, p - b);
+            while (aname.endsWith(QChar(' '))) {
+                aname.chop(1);
+            }
+            p++;
+            while (p < n && s.at(p) == QChar(' ')) {
+                p++;
+            }
+            QString val;
+            if (p < n && (s.at(p) == QChar('"') || s.at(p) == QChar('\''))) {
+                QChar qt = s.at(p);
+                p++;
+                b = p;
+                while (p < n && s.at(p) != qt) {
+                    p++;
+                }
+                val = s.mid(b, p - b);
+                p++;
+            } else {
+                b = p;
+                while (p < n && s.at(p) != QChar('>') && s.at(p) != QChar('/') && s.at(p) != QChar(' ')) {
+                    p++;
+                }
+                val = s.mid(b, p - b);
+            }
+            mi.tattr[aname] = val;
+        }
+
+        // Label beginning and single tags
+        mi.ttype = "begin";
+        if (s.indexOf(QChar('/'), p) >= 0) {
+            mi.ttype = "single";
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef QUICKPARSER_H
+#define QUICKPARSER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * A C++ port of the QuickXHTMLParser of the Python plugin launcher.
+ *
+ * It splits markup into runs of text and tags without building a tree
+ * and without decoding anything, so text comes back exactly as written.
+ * Code that used to hand a document to Python just to walk it with
+ * QuickXHTMLParser can use this instead and get the same results.
+ */
+class QuickParser
+{
+public:
+
+    struct MarkupInfo {
+        // Leading text; null when this is a tag
+        QString text;
+
+        // Dotted path of the open "begin" tags, e.g. ".html.body.nav"
+        QString tpath;
+
+        // Tag name, tag type and attributes; empty for text.
+        // The types are "begin", "end", "single", "comment",
+        // "xmlheader" and "doctype".
+        QString tname;
+        QString ttype;
+        QHash<QString, QString> tattr;
+
+        bool IsText() const {
+            return !text.isNull();
+        }
+    };
+
+    QuickParser(const QString &source);
+
+    bool AtEnd() const;
+
+    /**
+     * @return The next run of text or the next tag.
+     */
+    MarkupInfo Next();
+
+private:
+
+    void ParseTag(const QString &tag, MarkupInfo &mi) const;
+
+    /**
+     * Splits off the next run of text or the next tag.
+     * Only one of text and tag is set.
+     */
+    void ParseML(QString &text, QString &tag);
+
+    QString m_Source;
+
+    int m_Pos;
+
+    QStringList m_TagPath;
+};
+
+#endif // QUICKPARSER_H
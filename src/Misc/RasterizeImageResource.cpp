@@ -20,15 +20,16 @@
 *************************************************************************/
 
 #include <QtCore>
+#include <QtGui/QImageReader>
 #include <QtGui/QPainter>
 #include <QtGui/QPixmap>
+#include <QtSvg/QSvgRenderer>
 #include <QtWebKitWidgets/QWebPage>
 #include <QtWebKitWidgets/QWebFrame>
 
 #include "Misc/RasterizeImageResource.h"
-#include "Misc/SleepFunctions.h"
 #include "Misc/Utility.h"
-#include "ResourceObjects/ImageResource.h"
+#include "ResourceObjects/Resource.h"
 
 static const QString PAGE_SOURCE =  "<html xmlns=\"http://www.w3.org/1999/xhtml\" xml:lang=\"en\">"
                                     "<head>"
@@ -39,6 +40,10 @@ static const QString PAGE_SOURCE =  "<html xmlns=\"http://www.w3.org/1999/xhtml\
                                     "</body>"
                                     "</html>";
 
+// Outside SVG Tiny, so QSvgRenderer leaves them out of what it draws
+static const QList<QByteArray> FULL_SVG_ELEMENTS = QList<QByteArray>() << "<filter" << "<mask" << "<clipPath"
+                                                                       << "<foreignObject" << "<pattern";
+
 
 RasterizeImageResource::RasterizeImageResource(QWidget *parent)
     :
@@ -59,21 +64,148 @@ RasterizeImageResource::~RasterizeImageResource()
 }
 
 
-// We could use the native QPixmap loading process for JPG, PNG and GIF images.
-// But we have to use webkit to rasterize SVG's since QSvgRenderer supports
-// only SVG Tiny. And if we're going to use webkit, then let's use it for all
-// image types to reduce complexity. It also makes zooming/scaling much simpler.
-QPixmap RasterizeImageResource::operator()(const ImageResource &resource, float zoom_factor)
+QPixmap RasterizeImageResource::operator()(const Resource &resource, float zoom_factor)
+{
+    resource.LoadDeferredContent();
+    const QString path = resource.GetFullPath();
+
+    if (!NeedsWebKit(path)) {
+        QImage image = Render(path, ImageSize(path) * zoom_factor);
+
+        // Only SVGs get a second try, a bitmap Qt can not read is broken
+        if (!image.isNull() || !IsSvg(path)) {
+            return QPixmap::fromImage(image);
+        }
+    }
+
+    return QPixmap::fromImage(RenderWithWebKit(path, zoom_factor));
+}
+
+
+QImage RasterizeImageResource::Thumbnail(const QString &path, int max_side)
+{
+    if (!NeedsWebKit(path)) {
+        QImage image = RenderThumbnail(path, max_side);
+
+        if (!image.isNull() || !IsSvg(path)) {
+            return image;
+        }
+    }
+
+    QImage image = RenderWithWebKit(path, 1.0);
+
+    if (image.width() > max_side || image.height() > max_side) {
+        image = image.scaled(max_side, max_side, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
+    return image;
+}
+
+
+QSize RasterizeImageResource::ImageSize(const QString &path)
+{
+    if (IsSvg(path)) {
+        QSvgRenderer renderer(path);
+        return renderer.isValid() ? renderer.defaultSize() : QSize();
+    }
+
+    QImageReader reader(path);
+    return reader.size();
+}
+
+
+QImage RasterizeImageResource::Render(const QString &path, const QSize &size)
+{
+    if (IsSvg(path)) {
+        QSvgRenderer renderer(path);
+
+        if (!renderer.isValid()) {
+            return QImage();
+        }
+
+        QSize image_size = size.isValid() ? size : renderer.defaultSize();
+
+        if (image_size.isEmpty()) {
+            return QImage();
+        }
+
+        QImage image(image_size, QImage::Format_ARGB32_Premultiplied);
+        image.fill(Qt::transparent);
+        QPainter painter(&image);
+        renderer.render(&painter);
+        painter.end();
+        return image;
+    }
+
+    QImageReader reader(path);
+
+    if (size.isValid() && size != reader.size()) {
+        // Formats that can (jpeg) decode at the smaller size to begin with
+        reader.setScaledSize(size);
+    }
+
+    return reader.read();
+}
+
+
+QImage RasterizeImageResource::RenderThumbnail(const QString &path, int max_side)
+{
+    QSize size = ImageSize(path);
+
+    if (!size.isValid()) {
+        return QImage();
+    }
+
+    if (size.width() > max_side || size.height() > max_side) {
+        size.scale(max_side, max_side, Qt::KeepAspectRatio);
+    }
+
+    return Render(path, size);
+}
+
+
+bool RasterizeImageResource::IsSvg(const QString &path)
 {
+    return path.endsWith(".svg", Qt::CaseInsensitive);
+}
+
+
+bool RasterizeImageResource::NeedsWebKit(const QString &path)
+{
+    if (!IsSvg(path)) {
+        return false;
+    }
+
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray svg = file.readAll();
+    foreach(QByteArray element, FULL_SVG_ELEMENTS) {
+        if (svg.contains(element)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+QImage RasterizeImageResource::RenderWithWebKit(const QString &path, float zoom_factor)
+{
+    QFileInfo info(path);
     QString source(PAGE_SOURCE);
-    source.replace("REPLACEME", Utility::URLEncodePath(resource.Filename()));
-    m_WebPage->mainFrame()->setHtml(source, resource.GetBaseUrl());
+    source.replace("REPLACEME", Utility::URLEncodePath(info.fileName()));
+    m_LoadFinishedFlag = false;
+    m_WebPage->mainFrame()->setHtml(source, QUrl::fromLocalFile(info.absolutePath() + "/"));
     m_WebPage->mainFrame()->setZoomFactor(zoom_factor);
 
-    while (!m_LoadFinishedFlag) {
-        // Make sure Qt processes events, signals and calls slots
-        qApp->processEvents();
-        SleepFunctions::msleep(10);
+    // Waits on the page's own signal instead of polling
+    if (!m_LoadFinishedFlag) {
+        QEventLoop loop;
+        connect(m_WebPage->mainFrame(), SIGNAL(loadFinished(bool)), &loop, SLOT(quit()));
+        loop.exec();
     }
 
     // The flag needs to be reset so the caller
@@ -85,7 +217,7 @@ QPixmap RasterizeImageResource::operator()(const ImageResource &resource, float
     QPainter painter(&image);
     m_WebPage->mainFrame()->render(&painter);
     painter.end();
-    return QPixmap::fromImage(image);
+    return image;
 }
 
 
@@ -24,12 +24,21 @@
 #define RASTERIZEIMAGERESOURCE_H
 
 #include <QtCore/QObject>
+#include <QtCore/QSize>
+#include <QtGui/QImage>
 
 class QWebPage;
 class QPixmap;
-class ImageResource;
+class Resource;
 
 
+/**
+ * Renders image and SVG files to rasters.
+ *
+ * The static functions use QImageReader and QSvgRenderer only, so they
+ * are safe to run on worker threads. The members fall back to a hidden
+ * WebKit page, on the GUI thread, for the SVGs Qt can not render itself.
+ */
 class RasterizeImageResource : public QObject
 {
     Q_OBJECT
@@ -39,7 +48,37 @@ public:
     RasterizeImageResource(QWidget *parent = 0);
     ~RasterizeImageResource();
 
-    QPixmap operator()(const ImageResource &resource, float zoom_factor);
+    /**
+     * Renders an image or SVG resource at zoom_factor times its size.
+     */
+    QPixmap operator()(const Resource &resource, float zoom_factor);
+
+    /**
+     * Renders the file scaled down to fit in max_side x max_side.
+     */
+    QImage Thumbnail(const QString &path, int max_side);
+
+    /**
+     * @return The size of the image, read from the file's header
+     *         only, or an invalid size if it can not be read.
+     */
+    static QSize ImageSize(const QString &path);
+
+    /**
+     * Renders the file at size, or at its own size if size is invalid.
+     * Bitmaps are decoded straight to that size.
+     *
+     * @return A null image if the file can not be rendered without WebKit.
+     */
+    static QImage Render(const QString &path, const QSize &size = QSize());
+
+    /**
+     * Renders the file scaled down, never up, to fit in
+     * max_side x max_side, keeping its aspect ratio.
+     *
+     * @return A null image if the file can not be rendered without WebKit.
+     */
+    static QImage RenderThumbnail(const QString &path, int max_side);
 
 private slots:
 
@@ -47,6 +86,16 @@ private slots:
 
 private:
 
+    static bool IsSvg(const QString &path);
+
+    /**
+     * @return true for SVGs that use features QSvgRenderer,
+     *         which supports SVG Tiny only, does not draw.
+     */
+    static bool NeedsWebKit(const QString &path);
+
+    QImage RenderWithWebKit(const QString &path, float zoom_factor);
+
     QWebPage *m_WebPage;
 
     bool m_LoadFinishedFlag;
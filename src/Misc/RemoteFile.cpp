@@ -0,0 +1,362 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QByteArray>
+#include <QtCore/QCache>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QRegularExpression>
+#include <QtCore/QRegularExpressionMatch>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
+
+#include "Misc/RemoteFile.h"
+
+// Archives are fetched in blocks of this many bytes
+static const qint64 BLOCK_SIZE = 64 * 1024;
+
+// A miss fetches up to this many blocks in one request, since
+// minizip reads entries and the central directory front to back
+static const qint64 READ_AHEAD_BLOCKS = 16;
+
+// The most fetched data kept in memory, in KB
+static const int MAX_CACHED_KB = 64 * 1024;
+
+// A request that has made no progress for this long has failed
+static const int REQUEST_TIMEOUT_MS = 60 * 1000;
+
+static QMutex s_BlocksMutex;
+
+// Keyed by URL, version and block number, with the size in KB as the cost
+static QCache<QString, QByteArray> s_Blocks(MAX_CACHED_KB);
+
+
+struct RemoteHandle {
+    QUrl url;
+
+    // The URL and version of the file, the prefix of its block keys
+    QString key;
+
+    qint64 size;
+    qint64 position;
+    bool failed;
+    QNetworkAccessManager *manager;
+};
+
+
+// Sends request and waits for the whole reply.
+// The reply is returned finished, or aborted once it stalls.
+static QNetworkReply *WaitForReply(QNetworkAccessManager *manager,
+                                   const QNetworkRequest &request,
+                                   const QByteArray &verb = "GET",
+                                   QIODevice *data = NULL)
+{
+    QNetworkRequest sent(request);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+    sent.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+#endif
+    QNetworkReply *reply = manager->sendCustomRequest(sent, verb, data);
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    timer.setInterval(REQUEST_TIMEOUT_MS);
+    QObject::connect(reply, SIGNAL(finished()), &loop, SLOT(quit()));
+    QObject::connect(&timer, SIGNAL(timeout()), &loop, SLOT(quit()));
+
+    // A large upload may take longer than the timeout, so it only
+    // runs while nothing moves either way
+    QObject::connect(reply, SIGNAL(uploadProgress(qint64, qint64)), &timer, SLOT(start()));
+    QObject::connect(reply, SIGNAL(downloadProgress(qint64, qint64)), &timer, SLOT(start()));
+    timer.start();
+
+    loop.exec(QEventLoop::ExcludeUserInputEvents);
+
+    if (!reply->isFinished()) {
+        reply->abort();
+    }
+
+    return reply;
+}
+
+
+// Fetches bytes first to last, both included. Only a partial content
+// reply will do; a server that ignores the range would send everything.
+static bool FetchRange(RemoteHandle *handle, qint64 first, qint64 last, QByteArray &data)
+{
+    QNetworkRequest request(handle->url);
+    request.setRawHeader("Range", "bytes=" + QByteArray::number(first) + "-" + QByteArray::number(last));
+    QNetworkReply *reply = WaitForReply(handle->manager, request);
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool fetched = reply->error() == QNetworkReply::NoError && status == 206;
+
+    if (fetched) {
+        data = reply->readAll();
+        fetched = data.size() == last - first + 1;
+    }
+
+    delete reply;
+    return fetched;
+}
+
+
+// Asks for the first byte, which tells the size from the Content-Range
+// and the version from the ETag or the modification date. A GET rather
+// than a HEAD, as presigned URLs are only good for the one method.
+static bool ProbeFile(RemoteHandle *handle)
+{
+    QNetworkRequest request(handle->url);
+    request.setRawHeader("Range", "bytes=0-0");
+    QNetworkReply *reply = WaitForReply(handle->manager, request);
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool probed = false;
+
+    if (reply->error() == QNetworkReply::NoError && status == 206) {
+        QRegularExpressionMatch match = QRegularExpression("/\\s*(\\d+)\\s*$").match(QString::fromLatin1(reply->rawHeader("Content-Range")));
+
+        if (match.hasMatch()) {
+            handle->size = match.captured(1).toLongLong();
+            QByteArray version = reply->rawHeader("ETag");
+
+            if (version.isEmpty()) {
+                version = reply->rawHeader("Last-Modified");
+            }
+
+            handle->key = handle->url.toString() + "|" + QString::fromLatin1(version) + "|" + QString::number(handle->size) + "#";
+            probed = true;
+        }
+    }
+
+    delete reply;
+    return probed;
+}
+
+
+// Makes sure the block holding offset, and as many uncached blocks
+// after it as a single request covers, are in the cache.
+// Returns a copy of the block holding offset, empty on failure.
+static QByteArray BlockAt(RemoteHandle *handle, qint64 offset)
+{
+    const qint64 block = offset / BLOCK_SIZE;
+    const qint64 last_block = (handle->size - 1) / BLOCK_SIZE;
+    qint64 end_block = block;
+    {
+        QMutexLocker locker(&s_BlocksMutex);
+        QByteArray *cached = s_Blocks.object(handle->key + QString::number(block));
+
+        if (cached) {
+            return *cached;
+        }
+
+        while (end_block < last_block && end_block - block + 1 < READ_AHEAD_BLOCKS &&
+               !s_Blocks.contains(handle->key + QString::number(end_block + 1))) {
+            ++end_block;
+        }
+    }
+
+    QByteArray data;
+
+    if (!FetchRange(handle, block * BLOCK_SIZE, qMin((end_block + 1) * BLOCK_SIZE, handle->size) - 1, data)) {
+        return QByteArray();
+    }
+
+    QMutexLocker locker(&s_BlocksMutex);
+
+    for (qint64 i = block; i <= end_block; ++i) {
+        QByteArray *block_data = new QByteArray(data.mid((i - block) * BLOCK_SIZE, BLOCK_SIZE));
+        s_Blocks.insert(handle->key + QString::number(i), block_data, qMax(block_data->size() / 1024, 1));
+    }
+
+    return data.left(BLOCK_SIZE);
+}
+
+
+static voidpf ZCALLBACK OpenRemote(voidpf opaque, const void *filename, int mode)
+{
+    Q_UNUSED(opaque);
+
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ || filename == NULL) {
+        return NULL;
+    }
+
+    RemoteHandle *handle = new RemoteHandle();
+    handle->url = QUrl(QString::fromUtf8(static_cast<const char *>(filename)));
+    handle->size = 0;
+    handle->position = 0;
+    handle->failed = false;
+    handle->manager = new QNetworkAccessManager();
+
+    if (!ProbeFile(handle)) {
+        delete handle->manager;
+        delete handle;
+        return NULL;
+    }
+
+    return handle;
+}
+
+
+static uLong ZCALLBACK ReadRemote(voidpf opaque, voidpf stream, void *buf, uLong size)
+{
+    Q_UNUSED(opaque);
+    RemoteHandle *handle = static_cast<RemoteHandle *>(stream);
+    char *out = static_cast<char *>(buf);
+    uLong read = 0;
+
+    while (read < size && handle->position < handle->size) {
+        QByteArray block = BlockAt(handle, handle->position);
+        qint64 in_block = handle->position % BLOCK_SIZE;
+
+        if (block.size() <= in_block) {
+            handle->failed = true;
+            break;
+        }
+
+        qint64 count = qMin(qint64(size - read), block.size() - in_block);
+        memcpy(out + read, block.constData() + in_block, count);
+        read += count;
+        handle->position += count;
+    }
+
+    return read;
+}
+
+
+static uLong ZCALLBACK WriteRemote(voidpf opaque, voidpf stream, const void *buf, uLong size)
+{
+    Q_UNUSED(opaque);
+    Q_UNUSED(buf);
+    Q_UNUSED(size);
+    static_cast<RemoteHandle *>(stream)->failed = true;
+    return 0;
+}
+
+
+static ZPOS64_T ZCALLBACK TellRemote(voidpf opaque, voidpf stream)
+{
+    Q_UNUSED(opaque);
+    return static_cast<RemoteHandle *>(stream)->position;
+}
+
+
+static long ZCALLBACK SeekRemote(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    Q_UNUSED(opaque);
+    RemoteHandle *handle = static_cast<RemoteHandle *>(stream);
+    qint64 position = 0;
+
+    switch (origin) {
+        case ZLIB_FILEFUNC_SEEK_SET:
+            position = offset;
+            break;
+
+        case ZLIB_FILEFUNC_SEEK_CUR:
+            position = handle->position + offset;
+            break;
+
+        case ZLIB_FILEFUNC_SEEK_END:
+            position = handle->size + offset;
+            break;
+
+        default:
+            return -1;
+    }
+
+    if (position < 0 || position > handle->size) {
+        return -1;
+    }
+
+    handle->position = position;
+    return 0;
+}
+
+
+static int ZCALLBACK CloseRemote(voidpf opaque, voidpf stream)
+{
+    Q_UNUSED(opaque);
+    RemoteHandle *handle = static_cast<RemoteHandle *>(stream);
+    delete handle->manager;
+    delete handle;
+    return 0;
+}
+
+
+static int ZCALLBACK ErrorRemote(voidpf opaque, voidpf stream)
+{
+    Q_UNUSED(opaque);
+    return static_cast<RemoteHandle *>(stream)->failed ? 1 : 0;
+}
+
+
+bool RemoteFile::IsRemote(const QString &path)
+{
+    return path.startsWith("http://", Qt::CaseInsensitive) || path.startsWith("https://", Qt::CaseInsensitive);
+}
+
+
+QString RemoteFile::Suffix(const QString &path)
+{
+    return QFileInfo(IsRemote(path) ? QUrl(path).path() : path).suffix().toLower();
+}
+
+
+void RemoteFile::FillFileFunc(zlib_filefunc64_def *ffunc)
+{
+    ffunc->zopen64_file = OpenRemote;
+    ffunc->zread_file = ReadRemote;
+    ffunc->zwrite_file = WriteRemote;
+    ffunc->ztell64_file = TellRemote;
+    ffunc->zseek64_file = SeekRemote;
+    ffunc->zclose_file = CloseRemote;
+    ffunc->zerror_file = ErrorRemote;
+    ffunc->opaque = NULL;
+}
+
+
+bool RemoteFile::Upload(const QString &local_path, const QString &url, QString &error)
+{
+    QFile file(local_path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QNetworkAccessManager manager;
+    QNetworkRequest request((QUrl(url)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/epub+zip");
+    request.setHeader(QNetworkRequest::ContentLengthHeader, file.size());
+    QNetworkReply *reply = WaitForReply(&manager, request, "PUT", &file);
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool uploaded = reply->error() == QNetworkReply::NoError && status >= 200 && status < 300;
+
+    if (!uploaded) {
+        error = reply->errorString();
+    }
+
+    delete reply;
+    return uploaded;
+}
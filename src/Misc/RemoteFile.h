@@ -0,0 +1,72 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef REMOTEFILE_H
+#define REMOTEFILE_H
+
+#include <QtCore/QString>
+
+#include "ioapi.h"
+
+/**
+ * Reads archives straight from HTTP(S) storage that serves byte ranges,
+ * so that an EPUB in object storage can be opened without downloading
+ * all of it first.
+ *
+ * The minizip handles opened through FillFileFunc read the archive in
+ * blocks with range requests. The blocks are kept in memory, shared by
+ * every handle on the same URL, so the central directory is fetched once
+ * and an entry read by one handle is not fetched again by another. Each
+ * open asks for the first byte of the file, which also tells its size and
+ * version; blocks of an earlier version of the file are never served.
+ */
+class RemoteFile
+{
+public:
+    /**
+     * @return True if path is an http or https URL rather than a file.
+     */
+    static bool IsRemote(const QString &path);
+
+    /**
+     * Returns the lowercase suffix of the file, without any query
+     * string for a URL, e.g. "epub".
+     */
+    static QString Suffix(const QString &path);
+
+    /**
+     * Sets up ffunc to read archives whose name is a URL. A handle is
+     * only usable in the thread that opened it; writing is not supported.
+     */
+    static void FillFileFunc(zlib_filefunc64_def *ffunc);
+
+    /**
+     * Stores the file at local_path at url with a single PUT, replacing
+     * what was there.
+     *
+     * @param error Set to the reason when the upload fails.
+     * @return True if the server took the file.
+     */
+    static bool Upload(const QString &local_path, const QString &url, QString &error);
+};
+
+#endif // REMOTEFILE_H
@@ -0,0 +1,653 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QLockFile>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#include <QtCore/QUuid>
+
+#include "BookManipulation/Book.h"
+#include "BookManipulation/FolderKeeper.h"
+#include "Misc/SaveJournal.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/TempFolder.h"
+#include "Misc/TextDiff.h"
+#include "Misc/Utility.h"
+#include "ResourceObjects/TextResource.h"
+
+static const quint32 JOURNAL_MAGIC = 0x53474a4e;
+static const quint16 JOURNAL_VERSION = 1;
+static const QString JOURNAL_SUFFIX = ".journal";
+static const QString LOCK_SUFFIX = ".lock";
+
+static const int JOURNAL_INTERVAL_MS = 30 * 1000;
+
+// Lets a burst of changes, e.g. a Replace All, finish first
+static const int BOOK_CHANGE_DELAY_MS = 2000;
+
+// Text files smaller than this, in characters, are always journaled
+// whole; working out the edits is not worth it
+static const int SNAPSHOT_CHARS = 16 * 1024;
+
+// Journals abandoned by other sessions that this one has claimed
+static QHash<QString, QLockFile *> s_Claimed;
+
+
+static bool SyncFile(QFile &file)
+{
+#ifdef _WIN32
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+
+SaveJournal::SaveJournal(QObject *parent)
+    :
+    QObject(parent),
+    m_Timer(new QTimer(this)),
+    m_ChangeTimer(new QTimer(this)),
+    m_File(NULL),
+    m_Lock(NULL),
+    m_Writing(false)
+{
+    m_Timer->setInterval(JOURNAL_INTERVAL_MS);
+    m_ChangeTimer->setInterval(BOOK_CHANGE_DELAY_MS);
+    m_ChangeTimer->setSingleShot(true);
+    connect(m_Timer, SIGNAL(timeout()), this, SLOT(RecordChanges()));
+    connect(m_ChangeTimer, SIGNAL(timeout()), this, SLOT(RecordChanges()));
+}
+
+
+SaveJournal::~SaveJournal()
+{
+    Stop();
+}
+
+
+void SaveJournal::Start(QSharedPointer<Book> book, const QString &epub_path)
+{
+    Stop();
+
+    if (QFileInfo(epub_path).suffix().toLower() != "epub") {
+        return;
+    }
+
+    QFileInfo epub_info(epub_path);
+    m_Header.epub_path = epub_info.absoluteFilePath();
+    m_Header.epub_size = epub_info.size();
+    m_Header.epub_modified = epub_info.lastModified().toMSecsSinceEpoch();
+    // The file and its lock are only made once there is a change to write
+    m_JournalPath = JournalFolder() + "/" + QUuid::createUuid().toString().mid(1, 36) + JOURNAL_SUFFIX;
+    Baseline(book);
+}
+
+
+void SaveJournal::Resume(QSharedPointer<Book> book, const QString &journal_path)
+{
+    Stop();
+    QFile file(journal_path);
+
+    if (!file.open(QIODevice::ReadOnly) || !ReadHeader(file, m_Header)) {
+        return;
+    }
+
+    m_JournalPath = journal_path;
+    m_Lock = s_Claimed.take(journal_path);
+    Baseline(book);
+}
+
+
+void SaveJournal::Stop()
+{
+    m_Timer->stop();
+    m_ChangeTimer->stop();
+    {
+        QMutexLocker locker(&m_QueueMutex);
+        m_Queue.clear();
+    }
+    m_Writer.waitForFinished();
+
+    QSharedPointer<Book> book = m_Book.toStrongRef();
+
+    if (book) {
+        disconnect(book.data(), SIGNAL(Changed()), this, SLOT(BookChanged()));
+    }
+
+    if (m_File) {
+        m_File->close();
+        delete m_File;
+        m_File = NULL;
+    }
+
+    if (!m_JournalPath.isEmpty()) {
+        QFile::remove(m_JournalPath);
+        m_JournalPath.clear();
+    }
+
+    if (m_Lock) {
+        m_Lock->unlock();
+        delete m_Lock;
+        m_Lock = NULL;
+    }
+
+    m_Tracked.clear();
+    m_Book.clear();
+}
+
+
+QStringList SaveJournal::FindAbandoned()
+{
+    QStringList abandoned;
+    QDir folder(JournalFolder());
+    foreach(QString filename, folder.entryList(QStringList() << "*" + JOURNAL_SUFFIX, QDir::Files, QDir::Time)) {
+        const QString journal_path = folder.absoluteFilePath(filename);
+
+        if (!s_Claimed.contains(journal_path)) {
+            // Only the lock of a process that is gone can be taken
+            QLockFile *lock = new QLockFile(journal_path + LOCK_SUFFIX);
+            lock->setStaleLockTime(0);
+
+            if (!lock->tryLock(0)) {
+                delete lock;
+                continue;
+            }
+
+            s_Claimed.insert(journal_path, lock);
+        }
+
+        abandoned.append(journal_path);
+    }
+    return abandoned;
+}
+
+
+QString SaveJournal::JournaledEpub(const QString &journal_path)
+{
+    QFile file(journal_path);
+    Header header;
+
+    if (!file.open(QIODevice::ReadOnly) || !ReadHeader(file, header)) {
+        return QString();
+    }
+
+    return header.epub_path;
+}
+
+
+int SaveJournal::Replay(const QString &journal_path, QSharedPointer<Book> book, QString &error)
+{
+    QFile file(journal_path);
+    Header header;
+
+    if (!file.open(QIODevice::ReadWrite) || !ReadHeader(file, header)) {
+        error = tr("The journal %1 cannot be read.").arg(QDir::toNativeSeparators(journal_path));
+        return -1;
+    }
+
+    QFileInfo epub_info(header.epub_path);
+
+    if (epub_info.size() != header.epub_size ||
+        epub_info.lastModified().toMSecsSinceEpoch() != header.epub_modified) {
+        error = tr("%1 has been changed since the unsaved changes were made to it.")
+                .arg(QDir::toNativeSeparators(header.epub_path));
+        return -1;
+    }
+
+    FolderKeeper *folder_keeper = book->GetFolderKeeper();
+    QHash<QString, Resource *> resources;
+    foreach(Resource * resource, folder_keeper->GetResourceList()) {
+        resources.insert(resource->Filename(), resource);
+    }
+    // New files are written here before they are added to the book
+    TempFolder temp_folder;
+    QDataStream in(&file);
+    qint64 valid_end = file.pos();
+    int applied = 0;
+
+    forever {
+        quint32 length = 0;
+        quint16 checksum = 0;
+        in >> length >> checksum;
+
+        if (in.status() != QDataStream::Ok || qint64(length) > file.size() - file.pos()) {
+            break;
+        }
+
+        QByteArray payload(length, Qt::Uninitialized);
+
+        if (in.readRawData(payload.data(), length) != int(length) ||
+            qChecksum(payload.constData(), length) != checksum) {
+            break;
+        }
+
+        valid_end = file.pos();
+        QDataStream record(payload);
+        quint8 type = 0;
+        QString filename;
+        record >> type >> filename;
+        Resource *resource = resources.value(filename);
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        switch (type) {
+            case Record_Text: {
+                QString text;
+                record >> text;
+
+                if (text_resource) {
+                    text_resource->SetText(text);
+                } else if (!resource) {
+                    const QString new_path = temp_folder.GetPath() + "/" + filename;
+                    Utility::WriteUnicodeTextFile(text, new_path);
+                    resources.insert(filename, folder_keeper->AddContentFileToFolder(new_path, false));
+                }
+                break;
+            }
+
+            case Record_Edits: {
+                qint32 count = 0;
+                record >> count;
+                QList<TextDiff::Edit> edits;
+                for (int i = 0; i < count; ++i) {
+                    TextDiff::Edit edit;
+                    record >> edit.position >> edit.length >> edit.text;
+                    edits.append(edit);
+                }
+
+                if (text_resource) {
+                    QString text = text_resource->GetText();
+                    // From the end so the positions of the edits still to come hold
+                    for (int i = edits.count() - 1; i >= 0; --i) {
+                        text.replace(edits.at(i).position, edits.at(i).length, edits.at(i).text);
+                    }
+                    text_resource->SetText(text);
+                }
+                break;
+            }
+
+            case Record_File: {
+                QByteArray data;
+                record >> data;
+                const QString target_path = resource ? resource->GetFullPath() : temp_folder.GetPath() + "/" + filename;
+                QFile target(target_path);
+
+                if (target.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                    target.write(data);
+                    target.close();
+
+                    if (resource) {
+                        resource->FileReplaced();
+                    } else {
+                        resources.insert(filename, folder_keeper->AddContentFileToFolder(target_path, false));
+                    }
+                }
+                break;
+            }
+
+            case Record_Rename: {
+                QString new_filename;
+                record >> new_filename;
+
+                if (resource && resource->RenameTo(new_filename)) {
+                    resources.remove(filename);
+                    resources.insert(new_filename, resource);
+                }
+                break;
+            }
+
+            case Record_Remove:
+                if (resource) {
+                    folder_keeper->RemoveResource(resource);
+                    resource->Delete();
+                    resources.remove(filename);
+                }
+                break;
+        }
+
+        applied++;
+    }
+
+    // Cut off the entry torn by the crash, so more can be appended
+    file.resize(valid_end);
+    return applied;
+}
+
+
+void SaveJournal::Discard(const QString &journal_path)
+{
+    QFile::remove(journal_path);
+    QLockFile *lock = s_Claimed.take(journal_path);
+
+    if (lock) {
+        lock->unlock();
+        delete lock;
+    }
+}
+
+
+void SaveJournal::RecordChanges()
+{
+    QSharedPointer<Book> book = m_Book.toStrongRef();
+
+    if (!book) {
+        return;
+    }
+
+    QList<Resource *> resources = book->GetFolderKeeper()->GetResourceList();
+    QList<Record> records;
+    QSet<QString> present;
+    foreach(Resource * resource, resources) {
+        present.insert(resource->GetIdentifier());
+    }
+
+    QHash<QString, Tracked>::iterator it = m_Tracked.begin();
+    while (it != m_Tracked.end()) {
+        if (present.contains(it.key())) {
+            ++it;
+            continue;
+        }
+
+        Record record;
+        record.type = Record_Remove;
+        record.filename = it.value().filename;
+        records.append(record);
+        it = m_Tracked.erase(it);
+    }
+
+    // All the renames before any content, so a new file can take
+    // the name another file had
+    foreach(Resource * resource, resources) {
+        it = m_Tracked.find(resource->GetIdentifier());
+
+        if (it != m_Tracked.end() && it.value().filename != resource->Filename()) {
+            Record record;
+            record.type = Record_Rename;
+            record.filename = it.value().filename;
+            record.new_filename = resource->Filename();
+            records.append(record);
+            it.value().filename = resource->Filename();
+        }
+    }
+
+    foreach(Resource * resource, resources) {
+        it = m_Tracked.find(resource->GetIdentifier());
+        bool is_new = it == m_Tracked.end();
+
+        if (is_new) {
+            Tracked tracked;
+            tracked.filename = resource->Filename();
+            tracked.revision = -1;
+            tracked.modified = -1;
+            tracked.size = -1;
+            it = m_Tracked.insert(resource->GetIdentifier(), tracked);
+        }
+
+        Tracked &tracked = it.value();
+        Record record;
+        record.filename = tracked.filename;
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        if (text_resource) {
+            int revision = text_resource->GetTextRevision();
+
+            if (revision == tracked.revision) {
+                continue;
+            }
+
+            record.type = Record_Text;
+            record.old_text = tracked.text;
+            record.text = text_resource->GetText();
+            tracked.text = record.text;
+            tracked.revision = revision;
+        } else {
+            // Still in the epub it was opened from, so unchanged; the
+            // file only holds it once it has been loaded, and the first
+            // look after that takes it as changed
+            if (resource->HasDeferredContent()) {
+                continue;
+            }
+
+            QFileInfo info(resource->GetFullPath());
+            qint64 modified = info.lastModified().toMSecsSinceEpoch();
+
+            if (modified == tracked.modified && info.size() == tracked.size) {
+                continue;
+            }
+
+            // Read by the writer; a newer version by then is as good
+            record.type = Record_File;
+            record.full_path = resource->GetFullPath();
+            tracked.modified = modified;
+            tracked.size = info.size();
+        }
+
+        records.append(record);
+    }
+
+    if (!records.isEmpty()) {
+        Enqueue(records);
+    }
+}
+
+
+void SaveJournal::BookChanged()
+{
+    m_ChangeTimer->start();
+}
+
+
+void SaveJournal::Baseline(QSharedPointer<Book> book)
+{
+    m_Book = book;
+    foreach(Resource * resource, book->GetFolderKeeper()->GetResourceList()) {
+        Tracked tracked;
+        tracked.filename = resource->Filename();
+        tracked.revision = -1;
+        tracked.modified = -1;
+        tracked.size = -1;
+        TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+        if (text_resource) {
+            tracked.revision = text_resource->GetTextRevision();
+        } else if (!resource->HasDeferredContent()) {
+            QFileInfo info(resource->GetFullPath());
+            tracked.modified = info.lastModified().toMSecsSinceEpoch();
+            tracked.size = info.size();
+        }
+
+        m_Tracked.insert(resource->GetIdentifier(), tracked);
+    }
+    connect(book.data(), SIGNAL(Changed()), this, SLOT(BookChanged()));
+    m_Timer->start();
+}
+
+
+void SaveJournal::Enqueue(const QList<Record> &records)
+{
+    QMutexLocker locker(&m_QueueMutex);
+    m_Queue.append(records);
+
+    if (!m_Writing) {
+        m_Writing = true;
+        m_Writer = TaskScheduler::Run(TaskScheduler::Background, "SaveJournal::WritePending", [this]() {
+            WritePending();
+        });
+    }
+}
+
+
+void SaveJournal::WritePending()
+{
+    forever {
+        QList<Record> batch;
+        {
+            QMutexLocker locker(&m_QueueMutex);
+
+            if (m_Queue.isEmpty()) {
+                m_Writing = false;
+                return;
+            }
+
+            batch.swap(m_Queue);
+        }
+
+        if (!OpenJournal()) {
+            continue;
+        }
+
+        QDataStream out(m_File);
+        foreach(Record record, batch) {
+            const QByteArray payload = Encode(record);
+
+            if (!payload.isEmpty()) {
+                out << quint32(payload.size()) << qChecksum(payload.constData(), payload.size());
+                out.writeRawData(payload.constData(), payload.size());
+            }
+        }
+
+        // One sync for the whole batch
+        m_File->flush();
+        SyncFile(*m_File);
+    }
+}
+
+
+bool SaveJournal::OpenJournal()
+{
+    if (m_File) {
+        return true;
+    }
+
+    if (!m_Lock) {
+        QDir().mkpath(JournalFolder());
+        m_Lock = new QLockFile(m_JournalPath + LOCK_SUFFIX);
+        m_Lock->setStaleLockTime(0);
+
+        if (!m_Lock->tryLock(0)) {
+            delete m_Lock;
+            m_Lock = NULL;
+            return false;
+        }
+    }
+
+    m_File = new QFile(m_JournalPath);
+
+    if (!m_File->open(QIODevice::WriteOnly | QIODevice::Append)) {
+        delete m_File;
+        m_File = NULL;
+        return false;
+    }
+
+    if (m_File->size() == 0) {
+        QDataStream out(m_File);
+        out << JOURNAL_MAGIC << JOURNAL_VERSION << m_Header.epub_path << m_Header.epub_size << m_Header.epub_modified;
+    }
+
+    return true;
+}
+
+
+QByteArray SaveJournal::Encode(const Record &record)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+
+    switch (record.type) {
+        case Record_Text: {
+            QList<TextDiff::Edit> edits;
+            int edit_chars = 0;
+
+            if (!record.old_text.isNull() && record.text.size() >= SNAPSHOT_CHARS) {
+                edits = TextDiff::Compute(record.old_text, record.text);
+                foreach(TextDiff::Edit edit, edits) {
+                    edit_chars += edit.text.size();
+                }
+            }
+
+            if (edits.isEmpty() || edit_chars > record.text.size() / 2) {
+                out << quint8(Record_Text) << record.filename << record.text;
+            } else {
+                out << quint8(Record_Edits) << record.filename << qint32(edits.count());
+                foreach(TextDiff::Edit edit, edits) {
+                    out << qint32(edit.position) << qint32(edit.length) << edit.text;
+                }
+            }
+            break;
+        }
+
+        case Record_File: {
+            QFile file(record.full_path);
+
+            // Deleted meanwhile; the removal is on its way
+            if (!file.open(QIODevice::ReadOnly)) {
+                return QByteArray();
+            }
+
+            out << quint8(Record_File) << record.filename << file.readAll();
+            break;
+        }
+
+        case Record_Rename:
+            out << quint8(Record_Rename) << record.filename << record.new_filename;
+            break;
+
+        default:
+            out << quint8(record.type) << record.filename;
+            break;
+    }
+
+    return payload;
+}
+
+
+bool SaveJournal::ReadHeader(QFile &file, Header &header)
+{
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+
+    if (magic != JOURNAL_MAGIC || version != JOURNAL_VERSION) {
+        return false;
+    }
+
+    in >> header.epub_path >> header.epub_size >> header.epub_modified;
+    return in.status() == QDataStream::Ok;
+}
+
+
+QString SaveJournal::JournalFolder()
+{
+    return Utility::DefinePrefsDir() + "/journal";
+}
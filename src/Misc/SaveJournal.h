@@ -0,0 +1,201 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef SAVEJOURNAL_H
+#define SAVEJOURNAL_H
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFuture>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QWeakPointer>
+
+class Book;
+class QFile;
+class QLockFile;
+class QTimer;
+
+/**
+ * Keeps the changes made to a book since it was last saved in an
+ * append-only journal, so they survive a crash without the cost of
+ * writing the whole EPUB again.
+ *
+ * Every few seconds, and shortly after the book is modified, the files
+ * that changed are appended to the journal: whole for small text files,
+ * as the edits since the last entry for large ones, and as they are on
+ * disk for everything else. The entries are written and synced to disk
+ * on a background thread, one sync per batch.
+ *
+ * Each journal is locked by the process writing it. A journal whose
+ * process is gone was left behind by a crash; on the next start it can
+ * be replayed onto the EPUB it was started over to get the changes back.
+ */
+class SaveJournal : public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_TR_FUNCTIONS(SaveJournal)
+
+public:
+    SaveJournal(QObject *parent = 0);
+    ~SaveJournal();
+
+    /**
+     * Starts journaling the changes made to book from now on, over the
+     * EPUB at epub_path as it is now. Drops the previous journal.
+     * Books that are not saved as an EPUB are not journaled.
+     */
+    void Start(QSharedPointer<Book> book, const QString &epub_path);
+
+    /**
+     * Carries on a journal that was just replayed onto book, so a
+     * second crash before the book is saved loses nothing either.
+     */
+    void Resume(QSharedPointer<Book> book, const QString &journal_path);
+
+    /**
+     * Stops journaling and deletes the journal.
+     */
+    void Stop();
+
+    /**
+     * @return The journals left behind by Sigil sessions that ended
+     *         without closing their book. They are claimed for this
+     *         process until they are resumed or discarded.
+     */
+    static QStringList FindAbandoned();
+
+    /**
+     * @return The EPUB the changes in the journal were made to, or an
+     *         empty string if the journal cannot be read.
+     */
+    static QString JournaledEpub(const QString &journal_path);
+
+    /**
+     * Applies the changes in the journal to book, which must have just
+     * been loaded from JournaledEpub(). A torn entry at the end of the
+     * journal, from the crash itself, is cut off.
+     *
+     * @return The number of changes applied, or -1 and error set if
+     *         the EPUB has been changed since the journal was started.
+     */
+    static int Replay(const QString &journal_path, QSharedPointer<Book> book, QString &error);
+
+    /**
+     * Deletes an abandoned journal.
+     */
+    static void Discard(const QString &journal_path);
+
+public slots:
+
+    /**
+     * Queues the files that changed since the last call for writing.
+     */
+    void RecordChanges();
+
+private slots:
+    void BookChanged();
+
+private:
+
+    enum RecordType {
+        Record_Text = 1,
+        Record_Edits,
+        Record_File,
+        Record_Rename,
+        Record_Remove
+    };
+
+    /**
+     * A change as it is queued. Text records carry the text last
+     * journaled for the file as well, to work out the edits from.
+     */
+    struct Record {
+        RecordType type;
+        QString filename;
+        QString new_filename;
+        QString old_text;
+        QString text;
+        QString full_path;
+    };
+
+    /**
+     * What was last journaled for a resource, keyed by identifier.
+     */
+    struct Tracked {
+        QString filename;
+        int revision;
+        // Null until the text has been journaled once
+        QString text;
+        qint64 modified;
+        qint64 size;
+    };
+
+    struct Header {
+        QString epub_path;
+        qint64 epub_size;
+        qint64 epub_modified;
+    };
+
+    /**
+     * Takes the state of every resource as the point to journal from.
+     */
+    void Baseline(QSharedPointer<Book> book);
+
+    void Enqueue(const QList<Record> &records);
+
+    /**
+     * Writes the queued records until there are none left.
+     * Run on the thread pool.
+     */
+    void WritePending();
+
+    bool OpenJournal();
+
+    static QByteArray Encode(const Record &record);
+
+    static bool ReadHeader(QFile &file, Header &header);
+
+    static QString JournalFolder();
+
+    QWeakPointer<Book> m_Book;
+    QHash<QString, Tracked> m_Tracked;
+    QTimer *m_Timer;
+    QTimer *m_ChangeTimer;
+
+    // Set on the GUI thread before anything is queued, then only used
+    // by the writer
+    Header m_Header;
+    QString m_JournalPath;
+    QFile *m_File;
+    QLockFile *m_Lock;
+
+    QMutex m_QueueMutex;
+    QList<Record> m_Queue;
+    bool m_Writing;
+    QFuture<void> m_Writer;
+};
+
+#endif // SAVEJOURNAL_H
@@ -22,31 +22,89 @@
 #include <signal.h>
 
 #include <QtCore/QtCore>
+#include <QtConcurrent/QtConcurrent>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QProgressDialog>
 
 #include "BookManipulation/CleanSource.h"
+#include "Misc/MatchOffsets.h"
 #include "Misc/SearchOperations.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/TaskScheduler.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
+#include "Misc/VisibleText.h"
 #include "PCRE/PCRECache.h"
+#include "PCRE/PCREReplaceTemplate.h"
+#include "PCRE/SPCRE.h"
 #include "Misc/HTMLSpellCheck.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "ResourceObjects/TextResource.h"
 #include "ViewEditors/Searchable.h"
 #include "sigil_constants.h"
 
+// Book wide searches share these threads, as many as the settings allow
+static QThreadPool *SearchPool()
+{
+    static QThreadPool pool;
+    SettingsStore settings;
+    int threads = settings.searchThreads();
+    pool.setMaxThreadCount(threads > 0 ? threads : TaskScheduler::ThreadCount());
+    return &pool;
+}
+
+// Runs the event loop until the worker is done or the progress dialog
+// is cancelled, so the dialog can be used while the GUI thread waits.
+template <typename T>
+static bool WaitForWorker(const QFuture<T> &future, QProgressDialog &progress)
+{
+    if (future.isFinished()) {
+        return !progress.wasCanceled();
+    }
+
+    QEventLoop loop;
+    QFutureWatcher<T> watcher;
+    QObject::connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+    QObject::connect(&progress, SIGNAL(canceled()), &loop, SLOT(quit()));
+    watcher.setFuture(future);
+
+    if (!future.isFinished() && !progress.wasCanceled()) {
+        loop.exec();
+    }
+
+    return !progress.wasCanceled();
+}
+
+// Lets the workers that have not got to their file yet return at once.
+// The ones already searching finish their file, as they read resources
+// that may be gone once this returns.
+template <typename T>
+static void CancelWorkers(QList<QFuture<T>> &futures, TaskScheduler::CancelToken &cancel)
+{
+    cancel.Cancel();
+    foreach(QFuture<T> future, futures) {
+        future.waitForFinished();
+    }
+}
+
+
 int SearchOperations::CountInFiles(const QString &search_regex,
                                    QList<Resource *> resources,
                                    SearchType search_type,
                                    bool check_spelling)
 {
+    if (!check_spelling) {
+        ChainedSearch search;
+        search.search_regex = search_regex;
+        return CountChainInFiles(QList<ChainedSearch>() << search, resources, search_type);
+    }
+
     QProgressDialog progress(QObject::tr("Counting occurrences.."), 0, 0, resources.count(), Utility::GetMainWindow());
     progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
     int progress_value = 0;
     progress.setValue(progress_value);
-    // Count sequentially in order to see if occassional crashes are due to threading
     int count = 0;
+    // The spell checker is not thread safe
     foreach(Resource * resource, resources) {
         progress.setValue(progress_value++);
         qApp->processEvents();
@@ -61,27 +119,276 @@ int SearchOperations::ReplaceInAllFIles(const QString &search_regex,
                                         QList<Resource *> resources,
                                         SearchType search_type)
 {
-    QProgressDialog progress(QObject::tr("Replacing search term..."), 0, 0, resources.count(), Utility::GetMainWindow());
+    ChainedSearch search;
+    search.search_regex = search_regex;
+    search.replacement = replacement;
+    return ReplaceChainInAllFiles(QList<ChainedSearch>() << search, resources, search_type);
+}
+
+
+int SearchOperations::CountChainInFiles(const QList<ChainedSearch> &searches,
+                                        QList<Resource *> resources,
+                                        SearchType search_type)
+{
+    SIGIL_TRACE_SCOPE("Search count");
+    QProgressDialog progress(QObject::tr("Counting occurrences.."), QObject::tr("Cancel"), 0, resources.count(), Utility::GetMainWindow());
     progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
     int progress_value = 0;
     progress.setValue(progress_value);
-    // Replace sequentially in order to see if occassional crashes are due to threading
+    // The workers only read the compiled patterns, which the handles
+    // keep alive even if another search evicts them meanwhile
+    QList<QSharedPointer<SPCRE>> handles;
+    QList<SPCRE *> spcres;
+    foreach(const ChainedSearch &search, searches) {
+        handles.append(PCRECache::instance()->getObject(search.search_regex));
+        spcres.append(handles.last().data());
+    }
+    QThreadPool *pool = SearchPool();
+    TaskScheduler::CancelToken cancel;
+    QList<QFuture<int>> counts;
+    foreach(Resource * resource, resources) {
+        counts.append(QtConcurrent::run(pool, CountMatchesInFile, spcres, resource, search_type, cancel));
+    }
     int count = 0;
+    foreach(QFuture<int> file_count, counts) {
+        progress.setValue(progress_value++);
+
+        if (!WaitForWorker(file_count, progress)) {
+            CancelWorkers(counts, cancel);
+            return -1;
+        }
+
+        count += file_count.result();
+    }
+    return count;
+}
+
+
+int SearchOperations::ReplaceChainInAllFiles(const QList<ChainedSearch> &searches,
+                                             QList<Resource *> resources,
+                                             SearchType search_type)
+{
+    SIGIL_TRACE_SCOPE("Search replace");
+    QProgressDialog progress(QObject::tr("Replacing search term..."), QObject::tr("Cancel"), 0, resources.count(), Utility::GetMainWindow());
+    progress.setMinimumDuration(PROGRESS_BAR_MINIMUM_DURATION);
+    int progress_value = 0;
+    progress.setValue(progress_value);
+    QList<QSharedPointer<SPCRE>> handles;
+    QList<SPCRE *> spcres;
+    QStringList replacements;
+    foreach(const ChainedSearch &search, searches) {
+        handles.append(PCRECache::instance()->getObject(search.search_regex));
+        spcres.append(handles.last().data());
+        replacements.append(search.replacement);
+    }
+    QThreadPool *pool = SearchPool();
+    TaskScheduler::CancelToken cancel;
+    QList<QFuture<Replaced>> replaced_files;
     foreach(Resource * resource, resources) {
+        replaced_files.append(QtConcurrent::run(pool, ReplaceMatchesInCopy, spcres, replacements, resource, search_type, cancel));
+    }
+    // The new text is set here, on the GUI thread, in one go for each file.
+    // Once cancelled the files not yet set are left as they are.
+    int count = 0;
+    foreach(QFuture<Replaced> replaced_file, replaced_files) {
         progress.setValue(progress_value++);
-        qApp->processEvents();
-        count += ReplaceInFile(search_regex, replacement, resource, search_type);
+
+        if (!WaitForWorker(replaced_file, progress)) {
+            CancelWorkers(replaced_files, cancel);
+            break;
+        }
+
+        Replaced replaced = replaced_file.result();
+
+        if (replaced.count == 0) {
+            continue;
+        }
+
+        TextResource *text_resource = qobject_cast<TextResource *>(replaced.resource);
+
+        if (text_resource->SetTextIfUnchanged(replaced.new_text, replaced.revision)) {
+            count += replaced.count;
+        } else {
+            // Edited since the copy was taken
+            foreach(const ChainedSearch &search, searches) {
+                count += ReplaceInFile(search.search_regex, search.replacement, replaced.resource, search_type);
+            }
+        }
+    }
+    return count;
+}
+
+
+int SearchOperations::CountMatchesInFile(const QList<SPCRE *> &spcres,
+                                         Resource *resource,
+                                         SearchType search_type,
+                                         TaskScheduler::CancelToken cancel)
+{
+    TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+    if (!text_resource || cancel.IsCancelled()) {
+        return 0;
+    }
+
+    // Each search is only run if the file changed since it last was
+    int count = 0;
+    foreach(SPCRE *spcre, spcres) {
+        if (cancel.IsCancelled()) {
+            break;
+        }
+
+        count += MatchOffsets::Get(spcre, text_resource, search_type)->count();
     }
     return count;
 }
 
 
+SearchOperations::Replaced SearchOperations::ReplaceMatchesInCopy(const QList<SPCRE *> &spcres,
+                                                                  const QStringList &replacements,
+                                                                  Resource *resource,
+                                                                  SearchType search_type,
+                                                                  TaskScheduler::CancelToken cancel)
+{
+    Replaced replaced;
+    replaced.resource = resource;
+    replaced.revision = -1;
+    replaced.count = 0;
+    TextResource *text_resource = qobject_cast<TextResource *>(resource);
+
+    if (!text_resource || cancel.IsCancelled()) {
+        return replaced;
+    }
+
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
+    bool visible_only = html_resource && search_type == SearchOperations::BookViewSearch;
+    TextResource::Snapshot snapshot = text_resource->GetSnapshot();
+    replaced.revision = snapshot.revision;
+    QString text = snapshot.text;
+    QSharedPointer<const VisibleText> visible;
+
+    if (visible_only) {
+        visible = VisibleText::Get(html_resource);
+
+        // The cached one may already be of a later edit
+        if (text_resource->GetTextRevision() != replaced.revision) {
+            visible.clear();
+        }
+    }
+    // Each search sees the text as the ones before it left it
+    for (int i = 0; i < spcres.count(); ++i) {
+        if (cancel.IsCancelled()) {
+            // Never half way through the chain
+            replaced.count = 0;
+            return replaced;
+        }
+
+        // Nothing to replace in text a search already found no match in
+        if (replaced.count == 0 &&
+            MatchOffsets::CachedCount(spcres.at(i)->getPattern(), text_resource, search_type, replaced.revision) == 0) {
+            continue;
+        }
+
+        QString new_text;
+        int count = 0;
+
+        if (visible_only) {
+            if (!visible) {
+                visible = QSharedPointer<const VisibleText>(new VisibleText(text));
+            }
+
+            count = ReplaceInVisibleText(*visible, text, spcres.at(i), replacements.at(i), new_text);
+        } else {
+            count = spcres.at(i)->replaceEveryMatch(text, replacements.at(i), new_text);
+        }
+
+        if (count > 0) {
+            text = new_text;
+            replaced.count += count;
+            visible.clear();
+        }
+    }
+    replaced.new_text = text;
+    return replaced;
+}
+
+
+QString SearchOperations::SearchedText(TextResource *text_resource,
+                                       const TextResource::Snapshot &snapshot,
+                                       SearchType search_type)
+{
+    HTMLResource *html_resource = qobject_cast<HTMLResource *>(text_resource);
+
+    // Other files are not shown in Book View, so their text is
+    // searched in either view
+    if (html_resource && search_type == SearchOperations::BookViewSearch) {
+        return VisibleText::Get(html_resource, snapshot)->Text();
+    }
+
+    return snapshot.text;
+}
+
+
+// The state of ReplaceInVisibleText between matches
+struct VisibleReplace {
+    const VisibleText *visible;
+    const QString *source;
+    const PCREReplaceTemplate *replace_template;
+    QString *out;
+    // Where the source not yet copied to out starts
+    int copied_to;
+    int count;
+};
+
+static bool ReplaceOneVisibleMatch(VisibleReplace &replace, const int *ovector, int group_count)
+{
+    Q_UNUSED(group_count);
+    int source_start = replace.visible->ToSource(ovector[0], ovector[1]);
+
+    // Matches across tags or entities, or into text the parser moved,
+    // are left alone
+    if (source_start < replace.copied_to) {
+        return true;
+    }
+
+    QString replaced_text;
+    replace.replace_template->Apply(replace.visible->Text(), ovector, replaced_text);
+    replace.out->append(replace.source->midRef(replace.copied_to, source_start - replace.copied_to));
+    // What is inserted is text, not markup
+    replace.out->append(replaced_text.toHtmlEscaped());
+    replace.copied_to = source_start + ovector[1] - ovector[0];
+    replace.count++;
+    return true;
+}
+
+
+int SearchOperations::ReplaceInVisibleText(const VisibleText &visible,
+                                           const QString &source,
+                                           SPCRE *spcre,
+                                           const QString &replacement,
+                                           QString &out)
+{
+    QSharedPointer<PCREReplaceTemplate> replace_template = spcre->getReplaceTemplate(replacement);
+    VisibleReplace replace;
+    replace.visible = &visible;
+    replace.source = &source;
+    replace.replace_template = replace_template.data();
+    replace.out = &out;
+    replace.copied_to = 0;
+    replace.count = 0;
+    out.clear();
+    out.reserve(source.length());
+    spcre->forEachMatch(visible.Text(), std::bind(ReplaceOneVisibleMatch, std::ref(replace), std::placeholders::_1, std::placeholders::_2));
+    out.append(source.midRef(replace.copied_to));
+    return replace.count;
+}
+
+
 int SearchOperations::CountInFile(const QString &search_regex,
                                   Resource *resource,
                                   SearchType search_type,
                                   bool check_spelling)
 {
-    QReadLocker locker(&resource->GetLock());
+    // Searched in a snapshot of the text, without a lock held
     HTMLResource *html_resource = qobject_cast<HTMLResource *>(resource);
 
     if (html_resource) {
@@ -111,18 +418,17 @@ int SearchOperations::CountInHTMLFile(const QString &search_regex,
         if (check_spelling) {
             return HTMLSpellCheck::CountMisspelledWords(text, 0, text.count(), search_regex);
         } else {
-            return PCRECache::instance()->getObject(search_regex)->getEveryMatchInfo(text).count();
+            return PCRECache::instance()->getObject(search_regex)->countMatches(text);
         }
     }
 
-    //TODO: BookViewSearch
-    return 0;
+    // Spell check is not used in Book View
+    return PCRECache::instance()->getObject(search_regex)->countMatches(VisibleText::Get(html_resource)->Text());
 }
 
 int SearchOperations::CountInTextFile(const QString &search_regex, TextResource *text_resource)
 {
-    // TODO
-    return 0;
+    return PCRECache::instance()->getObject(search_regex)->countMatches(text_resource->GetText());
 }
 
 
@@ -165,8 +471,15 @@ int SearchOperations::ReplaceHTMLInFile(const QString &search_regex,
         return count;
     }
 
-    //TODO: BookViewSearch
-    return 0;
+    QString new_text;
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
+    int count = ReplaceInVisibleText(*VisibleText::Get(html_resource), html_resource->GetText(), spcre.data(), replacement, new_text);
+
+    if (count > 0) {
+        html_resource->SetText(new_text);
+    }
+
+    return count;
 }
 
 
@@ -174,8 +487,15 @@ int SearchOperations::ReplaceTextInFile(const QString &search_regex,
                                         const QString &replacement,
                                         TextResource *text_resource)
 {
-    // TODO
-    return 0;
+    int count;
+    QString new_text;
+    std::tie(new_text, count) = PerformGlobalReplace(text_resource->GetText(), search_regex, replacement);
+
+    if (count > 0) {
+        text_resource->SetText(new_text);
+    }
+
+    return count;
 }
 
 
@@ -183,21 +503,16 @@ std::tuple<QString, int> SearchOperations::PerformGlobalReplace(const QString &t
         const QString &search_regex,
         const QString &replacement)
 {
-    QString new_text = text;
-    int count = 0;
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
-    QList<SPCRE::MatchInfo> match_info = spcre->getEveryMatchInfo(text);
-
-    for (int i =  match_info.count() - 1; i >= 0; i--) {
-        QString match_segement = Utility::Substring(match_info.at(i).offset.first, match_info.at(i).offset.second, new_text);
-        QString replacement_text;
+    return PerformGlobalReplace(text, PCRECache::instance()->getObject(search_regex).data(), replacement);
+}
 
-        if (spcre->replaceText(match_segement, match_info.at(i).capture_groups_offsets, replacement, replacement_text)) {
-            new_text.replace(match_info.at(i).offset.first, match_info.at(i).offset.second - match_info.at(i).offset.first, replacement_text);
-            count++;
-        }
-    }
 
+std::tuple<QString, int> SearchOperations::PerformGlobalReplace(const QString &text,
+        SPCRE *spcre,
+        const QString &replacement)
+{
+    QString new_text;
+    int count = spcre->replaceEveryMatch(text, replacement, new_text);
     return std::make_tuple(new_text, count);
 }
 
@@ -209,7 +524,7 @@ std::tuple<QString, int> SearchOperations::PerformHTMLSpellCheckReplace(const QS
     QString new_text = text;
     int count = 0;
     int offset = 0;
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
     QList<HTMLSpellCheck::MisspelledWord> check_spelling = HTMLSpellCheck::GetMisspelledWords(text, 0, text.count(), search_regex);
     foreach(HTMLSpellCheck::MisspelledWord misspelled_word, check_spelling) {
         SPCRE::MatchInfo match_info = spcre->getFirstMatchInfo(misspelled_word.text);
@@ -23,9 +23,17 @@
 #ifndef SEARCHOPERATIONS_H
 #define SEARCHOPERATIONS_H
 
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/TaskScheduler.h"
+#include "ResourceObjects/TextResource.h"
+
 class Resource;
-class TextResource;
 class HTMLResource;
+class SPCRE;
+class VisibleText;
 
 class SearchOperations
 {
@@ -37,11 +45,24 @@ public:
         CodeViewSearch
     };
 
+    /**
+     * One search of a chain, e.g. of a saved search group.
+     */
+    struct ChainedSearch {
+        QString search_regex;
+        QString replacement;
+    };
+
     /**
      * Returns the number of matching occurrences.
      *
+     * The files are searched in parallel, on up to
+     * SettingsStore::searchThreads() threads, except when
+     * checking spelling.
+     *
      * @param search_regex The regex to match with.
-     * @return The number of matching occurrences.
+     * @return The number of matching occurrences, or -1 if the
+     *         count was cancelled from the progress dialog.
      */
     static int CountInFiles(const QString &search_regex,
                             QList<Resource *> resources,
@@ -49,13 +70,83 @@ public:
                             bool check_spelling = false);
 
 
+    /**
+     * Replaces every match in the files. The replacements are worked out
+     * in parallel on copies of the text and then set on the GUI thread,
+     * once per file that changed. If cancelled from the progress dialog
+     * the files not changed by then are left as they are.
+     *
+     * @return The number of replacements made.
+     */
     static int ReplaceInAllFIles(const QString &search_regex,
                                  const QString &replacement,
                                  QList<Resource *> resources,
                                  SearchType search_type);
 
+    /**
+     * The total of what CountInFiles returns for each search,
+     * reading the text of each file once for all of them.
+     */
+    static int CountChainInFiles(const QList<ChainedSearch> &searches,
+                                 QList<Resource *> resources,
+                                 SearchType search_type);
+
+    /**
+     * Runs the searches one after the other, as ReplaceInAllFIles for
+     * each in turn would. Each file is taken through the whole chain in
+     * memory and its text is set once.
+     *
+     * @return The number of replacements made by all of the searches.
+     */
+    static int ReplaceChainInAllFiles(const QList<ChainedSearch> &searches,
+                                      QList<Resource *> resources,
+                                      SearchType search_type);
+
+    /**
+     * The text a search of the resource matches against: for an HTML
+     * file in Book View only its visible text. Taken from the snapshot,
+     * so the matches are those of its revision.
+     */
+    static QString SearchedText(TextResource *text_resource,
+                                const TextResource::Snapshot &snapshot,
+                                SearchType search_type);
+
 private:
 
+    /**
+     * What a worker worked out for one file, from its text as it
+     * was at revision.
+     */
+    struct Replaced {
+        Resource *resource;
+        int revision;
+        QString new_text;
+        int count;
+    };
+
+    static int CountMatchesInFile(const QList<SPCRE *> &spcres,
+                                  Resource *resource,
+                                  SearchType search_type,
+                                  TaskScheduler::CancelToken cancel);
+
+    static Replaced ReplaceMatchesInCopy(const QList<SPCRE *> &spcres,
+                                         const QStringList &replacements,
+                                         Resource *resource,
+                                         SearchType search_type,
+                                         TaskScheduler::CancelToken cancel);
+
+    /**
+     * Replaces the matches in the visible text of source that can be
+     * mapped back to it; the replacements are inserted as text.
+     *
+     * @return The number of replacements made.
+     */
+    static int ReplaceInVisibleText(const VisibleText &visible,
+                                    const QString &source,
+                                    SPCRE *spcre,
+                                    const QString &replacement,
+                                    QString &out);
+
     static int CountInFile(const QString &search_regex,
                            Resource *resource,
                            SearchType search_type,
@@ -89,6 +180,10 @@ private:
             const QString &search_regex,
             const QString &replacement);
 
+    static std::tuple<QString, int> PerformGlobalReplace(const QString &text,
+            SPCRE *spcre,
+            const QString &replacement);
+
     static std::tuple<QString, int> PerformHTMLSpellCheckReplace(const QString &text,
             const QString &search_regex,
             const QString &replacement);
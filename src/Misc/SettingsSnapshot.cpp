@@ -0,0 +1,78 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QReadLocker>
+#include <QtCore/QWriteLocker>
+
+#include "Misc/SettingsSnapshot.h"
+
+SettingsSnapshot *SettingsSnapshot::instance()
+{
+    // Readers may be on any thread
+    static SettingsSnapshot *snapshot = new SettingsSnapshot();
+    return snapshot;
+}
+
+
+QSharedPointer<const SettingsSnapshot::Values> SettingsSnapshot::Current()
+{
+    SettingsSnapshot *snapshot = instance();
+    QReadLocker locker(&snapshot->m_Lock);
+    return snapshot->m_Values;
+}
+
+
+void SettingsSnapshot::Publish(SettingsStore &settings)
+{
+    QSharedPointer<const Values> values = Read(settings);
+    {
+        QWriteLocker locker(&m_Lock);
+        m_Values = values;
+    }
+    emit Changed();
+}
+
+
+SettingsSnapshot::SettingsSnapshot()
+    : QObject()
+{
+    SettingsStore settings;
+    m_Values = Read(settings);
+}
+
+
+QSharedPointer<const SettingsSnapshot::Values> SettingsSnapshot::Read(SettingsStore &settings)
+{
+    QSharedPointer<Values> values(new Values());
+    values->spell_check = settings.spellCheck();
+    values->spell_check_numbers = settings.spellCheckNumbers();
+    values->zoom_text = settings.zoomText();
+    values->large_file_threshold = settings.largeFileThreshold();
+    values->code_view_appearance = settings.codeViewAppearance();
+
+    values->preserve_entity_bits.fill(0, 0x10000 / 32);
+    std::pair<ushort, QString> epair;
+    foreach(epair, settings.preserveEntityCodeNames()) {
+        values->preserve_entity_bits[epair.first >> 5] |= 1u << (epair.first & 31);
+        values->preserve_entities.insert(epair.first, epair.second);
+    }
+    return values;
+}
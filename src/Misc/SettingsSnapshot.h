@@ -0,0 +1,86 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef SETTINGSSNAPSHOT_H
+#define SETTINGSSNAPSHOT_H
+
+#include <QtCore/QHash>
+#include <QtCore/QObject>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
+
+#include "Misc/SettingsStore.h"
+
+/**
+ * Singleton.
+ *
+ * A copy of the settings read on hot paths, so reading them needs
+ * neither a SettingsStore nor QSettings. The copy is never changed:
+ * SettingsStore publishes a new one whenever one of these settings is
+ * written, and Changed() is emitted. Current() may be called from any
+ * thread.
+ */
+class SettingsSnapshot : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Values {
+        bool spell_check;
+        bool spell_check_numbers;
+        float zoom_text;
+        int large_file_threshold;
+        SettingsStore::CodeViewAppearance code_view_appearance;
+
+        /**
+         * The characters written as entities: one bit per UTF-16
+         * code unit, and the entity of each character whose bit is set.
+         */
+        QVector<quint32> preserve_entity_bits;
+        QHash<ushort, QString> preserve_entities;
+    };
+
+    static SettingsSnapshot *instance();
+
+    static QSharedPointer<const Values> Current();
+
+    /**
+     * Replaces the copy with one read from the settings.
+     */
+    void Publish(SettingsStore &settings);
+
+signals:
+    void Changed();
+
+private:
+    SettingsSnapshot();
+
+    static QSharedPointer<const Values> Read(SettingsStore &settings);
+
+    QSharedPointer<const Values> m_Values;
+
+    // Only held to copy or swap the pointer
+    QReadWriteLock m_Lock;
+};
+
+#endif // SETTINGSSNAPSHOT_H
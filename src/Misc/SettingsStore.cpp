@@ -27,6 +27,7 @@
 #include <QDir>
 
 #include "Misc/SettingsStore.h"
+#include "Misc/SettingsSnapshot.h"
 #include "Misc/PluginDB.h"
 #include "Misc/Utility.h"
 
@@ -48,6 +49,22 @@ static QString KEY_DEFAULT_USER_DICTIONARY = SETTINGS_GROUP + "/" + "user_dictio
 static QString KEY_ENABLED_USER_DICTIONARIES = SETTINGS_GROUP + "/" + "enabled_user_dictionaries";
 static QString KEY_PLUGIN_USER_MAP = SETTINGS_GROUP + "/" + "plugin_user_map";
 static QString KEY_CLEAN_ON = SETTINGS_GROUP + "/" + "clean_on";
+static QString KEY_LAZY_LOAD_MEDIA = SETTINGS_GROUP + "/" + "lazy_load_media";
+static QString KEY_DEDUP_MEDIA_ON_IMPORT = SETTINGS_GROUP + "/" + "dedup_media_on_import";
+static QString KEY_TEXT_MEMORY_BUDGET = SETTINGS_GROUP + "/" + "text_memory_budget";
+static QString KEY_SEARCH_THREADS = SETTINGS_GROUP + "/" + "search_threads";
+static QString KEY_REGEX_CACHE_SIZE = SETTINGS_GROUP + "/" + "regex_cache_size";
+static QString KEY_REGEX_MATCH_LIMIT = SETTINGS_GROUP + "/" + "regex_match_limit";
+static QString KEY_LARGE_FILE_THRESHOLD = SETTINGS_GROUP + "/" + "large_file_threshold";
+static QString KEY_UNDO_MEMORY_BUDGET = SETTINGS_GROUP + "/" + "undo_memory_budget";
+static QString KEY_COMPRESS_UNDO_HISTORY = SETTINGS_GROUP + "/" + "compress_undo_history";
+static QString KEY_PREVIEW_PRE_RENDER = SETTINGS_GROUP + "/" + "preview_pre_render";
+static QString KEY_PREVIEW_PRE_RENDER_PAGES = SETTINGS_GROUP + "/" + "preview_pre_render_pages";
+static QString KEY_PREVIEW_PRE_RENDER_BUDGET = SETTINGS_GROUP + "/" + "preview_pre_render_budget";
+static QString KEY_TAB_HIBERNATE_MINUTES = SETTINGS_GROUP + "/" + "tab_hibernate_minutes";
+static QString KEY_TAB_HIBERNATE_BUDGET = SETTINGS_GROUP + "/" + "tab_hibernate_budget";
+static QString KEY_IMPORT_SPLIT_SIZE = SETTINGS_GROUP + "/" + "import_split_size";
+static QString KEY_INDEX_SECTION_SIZE = SETTINGS_GROUP + "/" + "index_section_size";
 static QString KEY_REMOTE_ON = SETTINGS_GROUP + "/" + "remote_on";
 static QString KEY_DEFAULT_VERSION = SETTINGS_GROUP + "/" + "default_version";
 static QString KEY_PRESERVE_ENTITY_NAMES = SETTINGS_GROUP + "/" + "preserve_entity_names";
@@ -57,11 +74,14 @@ static QString KEY_PLUGIN_INFO = SETTINGS_GROUP + "/" + "plugin_info";
 static QString KEY_PLUGIN_ENGINE_PATHS = SETTINGS_GROUP + "/" + "plugin_engine_paths";
 static QString KEY_PLUGIN_LAST_FOLDER = SETTINGS_GROUP + "/" + "plugin_add_last_folder";
 static QString KEY_PLUGIN_USE_BUNDLED_INTERP = SETTINGS_GROUP + "/" + "plugin_use_bundled_interp";
+static QString KEY_PLUGIN_USE_HOST = SETTINGS_GROUP + "/" + "plugin_use_host";
 
 static QString KEY_CSS_EPUB2_VALIDATION_SPEC = SETTINGS_GROUP + "/" + "css_epub2_validation_spec";
 static QString KEY_CSS_EPUB3_VALIDATION_SPEC = SETTINGS_GROUP + "/" + "css_epub3_validation_spec";
 
 static QString KEY_TEMP_FOLDER = SETTINGS_GROUP + "/" + "temp_folder_path";
+static QString KEY_RAM_WORKSPACE = SETTINGS_GROUP + "/" + "ram_workspace";
+static QString KEY_RAM_WORKSPACE_LIMIT = SETTINGS_GROUP + "/" + "ram_workspace_limit";
 
 static QString KEY_APPEARANCE_PREFS_TAB_INDEX = SETTINGS_GROUP + "/" + "appearance_prefs_tab_index";
 static QString KEY_BOOK_VIEW_FONT_FAMILY_STANDARD = SETTINGS_GROUP + "/" + "book_view_font_family_standard";
@@ -98,15 +118,20 @@ static QString KEY_SPECIAL_CHARACTER_FONT_SIZE = SETTINGS_GROUP + "/" + "special
 static QString KEY_MAIN_MENU_ICON_SIZE = SETTINGS_GROUP + "/" + "main_menu_icon_size";
 static QString KEY_CLIPBOARD_HISTORY_LIMIT = SETTINGS_GROUP + "/" + "clipboard_history_limit";
 
+static QString KEY_EXPORT_COMPRESSION = SETTINGS_GROUP + "/" + "export_compression";
+static QString KEY_EXPORT_KEEP_ENTRY_ORDER = SETTINGS_GROUP + "/" + "export_keep_entry_order";
+
 SettingsStore::SettingsStore()
-    : QSettings(Utility::DefinePrefsDir() + "/sigil.ini", QSettings::IniFormat)
+    : QSettings(Utility::DefinePrefsDir() + "/sigil.ini", QSettings::IniFormat),
+      m_IsDefault(true)
 {  
     // See QTBUG-40796 and QTBUG-54510 as using UTF-8 as a codec for ini files is very broken
     // setIniCodec("UTF-8");
 }
 
 SettingsStore::SettingsStore(QString filename)
-    : QSettings(filename, QSettings::IniFormat)
+    : QSettings(filename, QSettings::IniFormat),
+      m_IsDefault(false)
 {
     // See QTBUG-40796 and QTBUG-54510 as using UTF-8 as a codec for ini files is very broken
     // setIniCodec("UTF-8");
@@ -202,6 +227,102 @@ int SettingsStore::cleanOn()
     return value(KEY_CLEAN_ON, (CLEANON_OPEN | CLEANON_SAVE)).toInt();
 }
 
+bool SettingsStore::lazyLoadMedia()
+{
+    clearSettingsGroup();
+    return static_cast<bool>(value(KEY_LAZY_LOAD_MEDIA, false).toBool());
+}
+
+bool SettingsStore::dedupMediaOnImport()
+{
+    clearSettingsGroup();
+    return static_cast<bool>(value(KEY_DEDUP_MEDIA_ON_IMPORT, false).toBool());
+}
+
+int SettingsStore::textMemoryBudget()
+{
+    clearSettingsGroup();
+    return value(KEY_TEXT_MEMORY_BUDGET, 0).toInt();
+}
+
+int SettingsStore::searchThreads()
+{
+    clearSettingsGroup();
+    return value(KEY_SEARCH_THREADS, 0).toInt();
+}
+
+int SettingsStore::regexCacheSize()
+{
+    clearSettingsGroup();
+    return value(KEY_REGEX_CACHE_SIZE, 100).toInt();
+}
+
+int SettingsStore::regexMatchLimit()
+{
+    clearSettingsGroup();
+    return value(KEY_REGEX_MATCH_LIMIT, 5000000).toInt();
+}
+
+int SettingsStore::largeFileThreshold()
+{
+    clearSettingsGroup();
+    return value(KEY_LARGE_FILE_THRESHOLD, 16).toInt();
+}
+
+int SettingsStore::undoMemoryBudget()
+{
+    clearSettingsGroup();
+    return value(KEY_UNDO_MEMORY_BUDGET, 64).toInt();
+}
+
+bool SettingsStore::compressUndoHistory()
+{
+    clearSettingsGroup();
+    return value(KEY_COMPRESS_UNDO_HISTORY, true).toBool();
+}
+
+bool SettingsStore::previewPreRender()
+{
+    clearSettingsGroup();
+    return value(KEY_PREVIEW_PRE_RENDER, false).toBool();
+}
+
+int SettingsStore::previewPreRenderPages()
+{
+    clearSettingsGroup();
+    return value(KEY_PREVIEW_PRE_RENDER_PAGES, 2).toInt();
+}
+
+int SettingsStore::previewPreRenderBudget()
+{
+    clearSettingsGroup();
+    return value(KEY_PREVIEW_PRE_RENDER_BUDGET, 1024).toInt();
+}
+
+int SettingsStore::tabHibernateMinutes()
+{
+    clearSettingsGroup();
+    return value(KEY_TAB_HIBERNATE_MINUTES, 30).toInt();
+}
+
+int SettingsStore::tabHibernateBudget()
+{
+    clearSettingsGroup();
+    return value(KEY_TAB_HIBERNATE_BUDGET, 2048).toInt();
+}
+
+int SettingsStore::importSplitSize()
+{
+    clearSettingsGroup();
+    return value(KEY_IMPORT_SPLIT_SIZE, 512).toInt();
+}
+
+int SettingsStore::indexSectionSize()
+{
+    clearSettingsGroup();
+    return value(KEY_INDEX_SECTION_SIZE, 256).toInt();
+}
+
 QStringList SettingsStore::pluginMap()
 {
     clearSettingsGroup();
@@ -259,6 +380,14 @@ bool SettingsStore::useBundledInterp()
     return static_cast<bool>(value(KEY_PLUGIN_USE_BUNDLED_INTERP, true).toBool());
 }
 
+bool SettingsStore::usePluginHost()
+{
+    clearSettingsGroup();
+    // Defaults to false: plugins that keep global state or
+    // create a QApplication may not survive being run twice.
+    return static_cast<bool>(value(KEY_PLUGIN_USE_HOST, false).toBool());
+}
+
 QString SettingsStore::cssEpub2ValidationSpec()
 {
     clearSettingsGroup();
@@ -284,6 +413,18 @@ QString SettingsStore::tempFolderHome()
     return temp_path;
 }
 
+bool SettingsStore::ramWorkspace()
+{
+    clearSettingsGroup();
+    return static_cast<bool>(value(KEY_RAM_WORKSPACE, false).toBool());
+}
+
+int SettingsStore::ramWorkspaceLimit()
+{
+    clearSettingsGroup();
+    return value(KEY_RAM_WORKSPACE_LIMIT, 512).toInt();
+}
+
 int SettingsStore::appearancePrefsTabIndex() {
     clearSettingsGroup();
     return value(KEY_APPEARANCE_PREFS_TAB_INDEX, 0).toInt();
@@ -355,6 +496,18 @@ int SettingsStore::clipboardHistoryLimit()
     //return value(KEY_CLIPBOARD_HISTORY_LIMIT, CLIPBOARD_HISTORY_MAX).toInt();
 }
 
+QString SettingsStore::exportCompression(const QString &media_class)
+{
+    clearSettingsGroup();
+    return value(KEY_EXPORT_COMPRESSION).toHash().value(media_class).toString();
+}
+
+bool SettingsStore::exportKeepEntryOrder()
+{
+    clearSettingsGroup();
+    return static_cast<bool>(value(KEY_EXPORT_KEEP_ENTRY_ORDER, false).toBool());
+}
+
 void SettingsStore::setDefaultMetadataLang(const QString &lang)
 {
     clearSettingsGroup();
@@ -377,6 +530,7 @@ void SettingsStore::setZoomText(float zoom)
 {
     clearSettingsGroup();
     setValue(KEY_ZOOM_TEXT, zoom);
+    publishSnapshot();
 }
 
 void SettingsStore::setZoomWeb(float zoom)
@@ -413,12 +567,14 @@ void SettingsStore::setSpellCheck(bool enabled)
 {
     clearSettingsGroup();
     setValue(KEY_SPELL_CHECK, enabled);
+    publishSnapshot();
 }
 
 void SettingsStore::setSpellCheckNumbers(bool enabled)
 {
     clearSettingsGroup();
     setValue(KEY_SPELL_CHECK_NUMBERS, enabled);
+    publishSnapshot();
 }
 
 void SettingsStore::setDefaultUserDictionary(const QString &name)
@@ -445,6 +601,103 @@ void SettingsStore::setCleanOn(int on)
     setValue(KEY_CLEAN_ON, on);
 }
 
+void SettingsStore::setLazyLoadMedia(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_LAZY_LOAD_MEDIA, enabled);
+}
+
+void SettingsStore::setDedupMediaOnImport(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_DEDUP_MEDIA_ON_IMPORT, enabled);
+}
+
+void SettingsStore::setTextMemoryBudget(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_TEXT_MEMORY_BUDGET, megabytes);
+}
+
+void SettingsStore::setSearchThreads(int threads)
+{
+    clearSettingsGroup();
+    setValue(KEY_SEARCH_THREADS, threads);
+}
+
+void SettingsStore::setRegexCacheSize(int patterns)
+{
+    clearSettingsGroup();
+    setValue(KEY_REGEX_CACHE_SIZE, patterns);
+}
+
+void SettingsStore::setRegexMatchLimit(int steps)
+{
+    clearSettingsGroup();
+    setValue(KEY_REGEX_MATCH_LIMIT, steps);
+}
+
+void SettingsStore::setLargeFileThreshold(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_LARGE_FILE_THRESHOLD, megabytes);
+    publishSnapshot();
+}
+
+void SettingsStore::setUndoMemoryBudget(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_UNDO_MEMORY_BUDGET, megabytes);
+}
+
+void SettingsStore::setCompressUndoHistory(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_COMPRESS_UNDO_HISTORY, enabled);
+}
+
+void SettingsStore::setPreviewPreRender(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_PREVIEW_PRE_RENDER, enabled);
+}
+
+void SettingsStore::setPreviewPreRenderPages(int pages)
+{
+    clearSettingsGroup();
+    setValue(KEY_PREVIEW_PRE_RENDER_PAGES, pages);
+}
+
+void SettingsStore::setPreviewPreRenderBudget(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_PREVIEW_PRE_RENDER_BUDGET, megabytes);
+}
+
+void SettingsStore::setTabHibernateMinutes(int minutes)
+{
+    clearSettingsGroup();
+    setValue(KEY_TAB_HIBERNATE_MINUTES, minutes);
+}
+
+void SettingsStore::setTabHibernateBudget(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_TAB_HIBERNATE_BUDGET, megabytes);
+}
+
+void SettingsStore::setImportSplitSize(int kilobytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_IMPORT_SPLIT_SIZE, kilobytes);
+}
+
+void SettingsStore::setIndexSectionSize(int kilobytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_INDEX_SECTION_SIZE, kilobytes);
+}
+
 void SettingsStore::setPluginMap(QStringList &map)
 {
     clearSettingsGroup();
@@ -469,6 +722,7 @@ void SettingsStore::setPreserveEntityCodeNames(const QList<std::pair <ushort, QS
     }
     setValue(KEY_PRESERVE_ENTITY_NAMES, names);
     setValue(KEY_PRESERVE_ENTITY_CODES, codes);
+    publishSnapshot();
 }
 
 void SettingsStore::setPluginEnginePaths(const QHash <QString, QString> &enginepaths)
@@ -494,6 +748,12 @@ void SettingsStore::setUseBundledInterp(bool use)
     setValue(KEY_PLUGIN_USE_BUNDLED_INTERP, use);
 }
 
+void SettingsStore::setUsePluginHost(bool use)
+{
+    clearSettingsGroup();
+    setValue(KEY_PLUGIN_USE_HOST, use);
+}
+
 void SettingsStore::setCssEpub2ValidationSpec(const QString &spec)
 {
     clearSettingsGroup();
@@ -516,6 +776,18 @@ void SettingsStore::setTempFolderHome(const QString &path)
     }
 }
 
+void SettingsStore::setRamWorkspace(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_RAM_WORKSPACE, enabled);
+}
+
+void SettingsStore::setRamWorkspaceLimit(int megabytes)
+{
+    clearSettingsGroup();
+    setValue(KEY_RAM_WORKSPACE_LIMIT, megabytes);
+}
+
 void SettingsStore::setAppearancePrefsTabIndex(int index) {
     clearSettingsGroup();
     setValue(KEY_APPEARANCE_PREFS_TAB_INDEX, index);
@@ -556,6 +828,7 @@ void SettingsStore::setCodeViewAppearance(const SettingsStore::CodeViewAppearanc
     setValue(KEY_CODE_VIEW_XHTML_ENTITY_COLOR, code_view_appearance.xhtml_entity_color);
     setValue(KEY_CODE_VIEW_XHTML_HTML_COLOR, code_view_appearance.xhtml_html_color);
     setValue(KEY_CODE_VIEW_XHTML_HTML_COMMENT_COLOR, code_view_appearance.xhtml_html_comment_color);
+    publishSnapshot();
 }
 
 void SettingsStore::setSpecialCharacterAppearance(const SettingsStore::SpecialCharacterAppearance &special_character_appearance)
@@ -577,6 +850,26 @@ void SettingsStore::setClipboardHistoryLimit(int limit)
     setValue(KEY_CLIPBOARD_HISTORY_LIMIT, limit);
 }
 
+void SettingsStore::setExportCompression(const QString &media_class, const QString &policy)
+{
+    clearSettingsGroup();
+    QHash<QString, QVariant> compression = value(KEY_EXPORT_COMPRESSION).toHash();
+
+    if (policy.isEmpty()) {
+        compression.remove(media_class);
+    } else {
+        compression.insert(media_class, policy);
+    }
+
+    setValue(KEY_EXPORT_COMPRESSION, compression);
+}
+
+void SettingsStore::setExportKeepEntryOrder(bool enabled)
+{
+    clearSettingsGroup();
+    setValue(KEY_EXPORT_KEEP_ENTRY_ORDER, enabled);
+}
+
 void SettingsStore::clearAppearanceSettings()
 {
     clearSettingsGroup();
@@ -610,6 +903,7 @@ void SettingsStore::clearAppearanceSettings()
     remove(KEY_SPECIAL_CHARACTER_FONT_FAMILY);
     remove(KEY_SPECIAL_CHARACTER_FONT_SIZE);
     remove(KEY_MAIN_MENU_ICON_SIZE);
+    publishSnapshot();
 }
 
 void SettingsStore::clearSettingsGroup()
@@ -618,3 +912,10 @@ void SettingsStore::clearSettingsGroup()
         endGroup();
     }
 }
+
+void SettingsStore::publishSnapshot()
+{
+    if (m_IsDefault) {
+        SettingsSnapshot::instance()->Publish(*this);
+    }
+}
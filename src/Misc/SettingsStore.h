@@ -94,6 +94,7 @@ public:
     QHash <QString, QString> pluginEnginePaths();
     QString pluginLastFolder();
     bool useBundledInterp();
+    bool usePluginHost();
 
     /**
      * Get version specification for W3C validation
@@ -106,6 +107,17 @@ public:
      * Get path to temp folder home
      */
     QString tempFolderHome();
+
+    /**
+     * Whether books are unpacked to a RAM backed folder when the
+     * system has one with room for them.
+     */
+    bool ramWorkspace();
+
+    /**
+     * The largest unpacked book, in MB, put in the RAM backed folder.
+     */
+    int ramWorkspaceLimit();
     
     /**
      * Whether automatic Spellcheck is enabled or not
@@ -136,6 +148,105 @@ public:
 
     int cleanOn();
 
+    /**
+     * Whether EPUB media (images, fonts, audio, video) are only
+     * extracted from the archive when first used.
+     */
+    bool lazyLoadMedia();
+
+    /**
+     * Whether opening an EPUB offers to keep one copy of media
+     * files that are stored more than once under different names.
+     */
+    bool dedupMediaOnImport();
+
+    /**
+     * The memory, in megabytes, that the text of resources without an
+     * open tab may take before the least recently used is dropped and
+     * reread from disk on demand. 0 means no limit.
+     */
+    int textMemoryBudget();
+
+    /**
+     * The most threads a book wide Count or Replace All searches
+     * with. 0 means one for every core.
+     */
+    int searchThreads();
+
+    /**
+     * How many compiled search patterns PCRECache keeps.
+     */
+    int regexCacheSize();
+
+    /**
+     * How many backtracking steps one search may take in a single
+     * file before it is stopped as too expensive. 0 means PCRE's own.
+     */
+    int regexMatchLimit();
+
+    /**
+     * The size, in megabytes, from which a file opens in Code View's
+     * large file mode: no live spell checking, current line highlighting,
+     * caret syncing or immediate Preview updates. 0 means never.
+     */
+    int largeFileThreshold();
+
+    /**
+     * The undo memory, in megabytes, a Code View document may use before
+     * its older undo history is trimmed. 0 means no limit.
+     */
+    int undoMemoryBudget();
+
+    /**
+     * Whether trimmed undo history is kept as compressed snapshots
+     * that Undo can still go back to, instead of being dropped.
+     */
+    bool compressUndoHistory();
+
+    /**
+     * Whether Preview loads the files before and after the one shown,
+     * in the background, so moving to them shows them at once.
+     */
+    bool previewPreRender();
+
+    /**
+     * The most pages Preview keeps loaded in the background.
+     */
+    int previewPreRenderPages();
+
+    /**
+     * The resident memory, in megabytes, of the whole process above
+     * which Preview loads no more pages in the background.
+     * 0 means no limit.
+     */
+    int previewPreRenderBudget();
+
+    /**
+     * The minutes a background XHTML tab may go unused before its
+     * editors are freed until it is shown again. 0 means never.
+     */
+    int tabHibernateMinutes();
+
+    /**
+     * The resident memory, in megabytes, of the whole process above
+     * which unused background XHTML tabs free their editors early.
+     * 0 means no limit.
+     */
+    int tabHibernateBudget();
+
+    /**
+     * The size, in kilobytes of text, of the sections a text or HTML
+     * file large enough for Code View's large file mode is split into
+     * as it is imported. 0 means the file is imported whole.
+     */
+    int importSplitSize();
+
+    /**
+     * The size, in kilobytes of text, of the pages a generated index
+     * is split into. 0 means the index is written as one page.
+     */
+    int indexSectionSize();
+
     QStringList pluginMap();
 
     QString defaultVersion();
@@ -227,6 +338,20 @@ public:
      */
     int clipboardHistoryLimit();
 
+    /**
+     * The zlib compression used when exporting files of one media class
+     * ("text", "font", "compressed_font", "image", "audio", "video").
+     * The value is "level,strategy"; an empty string means the
+     * built-in default for that class.
+     */
+    QString exportCompression(const QString &media_class);
+
+    /**
+     * Whether exported entries keep the order they have in the EPUB
+     * being replaced, rather than being sorted by their path.
+     */
+    bool exportKeepEntryOrder();
+
     /**
      * Clear all Book View, Code View and Special Characters settings back to their defaults.
      */
@@ -281,6 +406,7 @@ public slots:
     void setPluginEnginePaths(const QHash <QString, QString> &enginepaths);
     void setPluginLastFolder(const QString &lastfolder);
     void setUseBundledInterp(bool use);
+    void setUsePluginHost(bool use);
 
     /**
      * Set which css version to specify to the W3C Validator
@@ -293,6 +419,10 @@ public slots:
      */
     void setTempFolderHome(const QString &path);
 
+    void setRamWorkspace(bool enabled);
+
+    void setRamWorkspaceLimit(int megabytes);
+
     /**
      * Set whether automatic Spellcheck is enabled
      *
@@ -322,6 +452,38 @@ public slots:
 
     void setCleanOn(int on);
 
+    void setLazyLoadMedia(bool enabled);
+
+    void setDedupMediaOnImport(bool enabled);
+
+    void setTextMemoryBudget(int megabytes);
+
+    void setSearchThreads(int threads);
+
+    void setRegexCacheSize(int patterns);
+
+    void setRegexMatchLimit(int steps);
+
+    void setLargeFileThreshold(int megabytes);
+
+    void setUndoMemoryBudget(int megabytes);
+
+    void setCompressUndoHistory(bool enabled);
+
+    void setPreviewPreRender(bool enabled);
+
+    void setPreviewPreRenderPages(int pages);
+
+    void setPreviewPreRenderBudget(int megabytes);
+
+    void setTabHibernateMinutes(int minutes);
+
+    void setTabHibernateBudget(int megabytes);
+
+    void setImportSplitSize(int kilobytes);
+
+    void setIndexSectionSize(int kilobytes);
+
     void setPluginMap(QStringList & map);
 
     void setDefaultVersion(const QString &version);
@@ -354,12 +516,30 @@ public slots:
      */
     void setClipboardHistoryLimit(int limit);
 
+    /**
+     * Set the "level,strategy" export compression of a media class
+     */
+    void setExportCompression(const QString &media_class, const QString &policy);
+
+    /**
+     * Set whether exported entries keep the order of the EPUB being replaced
+     */
+    void setExportKeepEntryOrder(bool enabled);
+
 private:
     /**
      * Ensures there is not an open settings group which will cause the settings
      * this class implements to be set in the wrong place.
      */
     void clearSettingsGroup();
+
+    /**
+     * Lets SettingsSnapshot readers see a change to a setting it copies.
+     */
+    void publishSnapshot();
+
+    // Whether this is sigil.ini rather than another settings file
+    bool m_IsDefault;
 };
 
 #endif // SETTINGSSTORE_H
@@ -25,14 +25,20 @@
 #include <QtCore/QDir>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QFuture>
 #include <QtCore/QIODevice>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QReadLocker>
+#include <QtCore/QWriteLocker>
 #include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
 #include <QtCore/QUrl>
-#include <QtWidgets/QApplication>
+#include <QtConcurrent/QtConcurrent>
 
 #include "Misc/SpellCheck.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/StartupProfiler.h"
+#include "Misc/TaskScheduler.h"
 #include "Misc/Utility.h"
 #include "sigil_constants.h"
 
@@ -42,6 +48,36 @@
 
 SpellCheck *SpellCheck::m_instance = 0;
 
+// More distinct words than a book has; past this the verdicts start over
+static const int MAX_VERDICTS = 200000;
+
+// The words most recently asked about
+static const int MAX_SUGGESTIONS_CACHED = 50;
+
+// Fewer words than this are not worth a worker
+static const int MIN_WORDS_PER_CHUNK = 1000;
+
+// The most dictionary files, in kilobytes, kept loaded for other
+// languages than the current one. Hunspell takes a few times as much.
+static const int MAX_POOLED_DICTIONARY_KB = 64 * 1024;
+
+// What a dictionary counts for in the pool
+static int DictionaryCost(const QString &aff, const QString &dic)
+{
+    return int((QFileInfo(aff).size() + QFileInfo(dic).size()) / 1024) + 1;
+}
+
+// Unlike unite, never keeps a word twice
+static void InsertVerdicts(QHash<QString, bool> &verdicts, const QHash<QString, bool> &more)
+{
+    QHashIterator<QString, bool> it(more);
+
+    while (it.hasNext()) {
+        it.next();
+        verdicts.insert(it.key(), it.value());
+    }
+}
+
 SpellCheck *SpellCheck::instance()
 {
     if (m_instance == 0) {
@@ -52,12 +88,17 @@ SpellCheck *SpellCheck::instance()
 }
 
 SpellCheck::SpellCheck() :
+    QObject(),
     m_hunspell(0),
     m_codec(0),
-    m_wordchars("")
+    m_wordchars(""),
+    m_generation(0),
+    m_loadRequest(0),
+    m_loading(false),
+    m_pool(MAX_POOLED_DICTIONARY_KB),
+    m_poolGeneration(0)
 {
-    // There is a considerable lag involved in loading the Spellcheck dictionaries
-    QApplication::setOverrideCursor(Qt::WaitCursor);
+    m_suggestions.setMaxCost(MAX_SUGGESTIONS_CACHED);
     loadDictionaryNames();
     // Create the user dictionary word list directiory if necessary.
     const QString user_directory = userDictionaryDirectory();
@@ -77,13 +118,88 @@ SpellCheck::SpellCheck() :
     }
 
     // Load the dictionary the user has selected if one was saved.
+    // There is a considerable lag involved in loading the Spellcheck
+    // dictionaries, so it is done in the background.
     SettingsStore settings;
-    setDictionary(settings.dictionary());
-    QApplication::restoreOverrideCursor();
+    QString name = settings.dictionary();
+    m_dictionaryName = name;
+    m_poolWords = allUserDictionaryWords();
+    if (!name.isEmpty() && m_dictionaries.contains(name)) {
+        QString aff = QString("%1%2.aff").arg(m_dictionaries.value(name)).arg(name);
+        QString dic = QString("%1%2.dic").arg(m_dictionaries.value(name)).arg(name);
+        m_loading = true;
+        connect(&m_loadWatcher, SIGNAL(finished()), this, SLOT(backgroundLoadFinished()));
+        m_loadWatcher.setFuture(QtConcurrent::run(this, &SpellCheck::loadDictionary, aff, dic, m_loadRequest));
+    }
+}
+
+SpellCheck::LoadedDictionary SpellCheck::loadDictionary(const QString &aff, const QString &dic, int request)
+{
+    StartupProfiler::Phase phase("Load dictionary (worker thread)");
+    LoadedDictionary loaded;
+    loaded.hunspell = new Hunspell(aff.toLocal8Bit().constData(), dic.toLocal8Bit().constData());
+    loaded.codec = QTextCodec::codecForName(loaded.hunspell->get_dic_encoding());
+
+    if (loaded.codec == 0) {
+        loaded.codec = QTextCodec::codecForName("UTF-8");
+    }
+
+    loaded.wordchars = loaded.codec->toUnicode(loaded.hunspell->get_wordchars());
+    loaded.affPath = aff;
+    loaded.dicPath = dic;
+    loaded.request = request;
+
+    foreach(QString word, allUserDictionaryWords()) {
+        loaded.hunspell->add(loaded.codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+        loaded.addedWords.append(word);
+    }
+    return loaded;
+}
+
+void SpellCheck::backgroundLoadFinished()
+{
+    LoadedDictionary loaded = m_loadWatcher.result();
+    {
+        QMutexLocker locker(&m_hunspellMutex);
+
+        // A dictionary was set in the meantime
+        if (loaded.request != m_loadRequest) {
+            delete loaded.hunspell;
+            return;
+        }
+
+        m_loading = false;
+        clearVerdictsLocked();
+        m_hunspell = loaded.hunspell;
+        m_codec = loaded.codec;
+        m_wordchars = loaded.wordchars;
+        m_affPath = loaded.affPath;
+        m_dicPath = loaded.dicPath;
+        m_addedWords = loaded.addedWords;
+
+        QStringList added_while_loading = m_wordsAddedWhileLoading;
+        m_wordsAddedWhileLoading.clear();
+        foreach(QString word, added_while_loading) {
+            addWordLocked(word);
+        }
+    }
+    emit dictionaryLoaded();
 }
 
 SpellCheck::~SpellCheck()
 {
+    // A dictionary still being loaded is not wanted any more
+    if (m_loading) {
+        m_loadWatcher.waitForFinished();
+        delete m_loadWatcher.result().hunspell;
+    }
+
+    {
+        QMutexLocker locker(&m_hunspellMutex);
+        clearCheckersLocked();
+        resetPoolLocked(QStringList());
+    }
+
     if (m_hunspell) {
         delete m_hunspell;
         m_hunspell = 0;
@@ -120,28 +236,451 @@ QString SpellCheck::currentDictionary() const
 
 bool SpellCheck::spell(const QString &word)
 {
+    {
+        QReadLocker locker(&m_verdictsLock);
+        QHash<QString, bool>::const_iterator it = m_verdicts.constFind(word);
+
+        if (it != m_verdicts.constEnd()) {
+            return it.value();
+        }
+    }
+
+    QMutexLocker locker(&m_hunspellMutex);
+
     if (!m_hunspell) {
         return true;
     }
 
-    return m_hunspell->spell(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData()) != 0;
+    bool correct = m_hunspell->spell(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData()) != 0;
+    QWriteLocker verdicts_locker(&m_verdictsLock);
+
+    if (m_verdicts.count() >= MAX_VERDICTS) {
+        m_verdicts.clear();
+    }
+
+    // The word may only borrow the text it is in
+    m_verdicts.insert(QString(word.constData(), word.length()), correct);
+    return correct;
+}
+
+QHash<QString, bool> SpellCheck::spellWords(const QStringList &words)
+{
+    QHash<QString, bool> verdicts;
+    QStringList unknown;
+    {
+        QReadLocker locker(&m_verdictsLock);
+        foreach(const QString &word, words) {
+            QHash<QString, bool>::const_iterator it = m_verdicts.constFind(word);
+
+            if (it != m_verdicts.constEnd()) {
+                verdicts.insert(word, it.value());
+            } else {
+                unknown.append(word);
+            }
+        }
+    }
+
+    int chunk_count = qMin(TaskScheduler::ThreadCount(), unknown.count() / MIN_WORDS_PER_CHUNK);
+
+    if (chunk_count < 2) {
+        foreach(const QString &word, unknown) {
+            verdicts.insert(word, spell(word));
+        }
+        return verdicts;
+    }
+
+    int generation = 0;
+    {
+        QMutexLocker locker(&m_hunspellMutex);
+
+        if (!m_hunspell) {
+            foreach(const QString &word, unknown) {
+                verdicts.insert(word, true);
+            }
+            return verdicts;
+        }
+
+        generation = m_generation;
+    }
+
+    int chunk_size = (unknown.count() + chunk_count - 1) / chunk_count;
+    QList<QFuture<QHash<QString, bool>>> chunks;
+
+    for (int start = 0; start < unknown.count(); start += chunk_size) {
+        chunks.append(QtConcurrent::run(this, &SpellCheck::spellChunk, unknown.mid(start, chunk_size)));
+    }
+
+    QHash<QString, bool> worked_out;
+    foreach(QFuture<QHash<QString, bool>> chunk, chunks) {
+        InsertVerdicts(worked_out, chunk.result());
+    }
+
+    QMutexLocker locker(&m_hunspellMutex);
+
+    // Only remembered if they are still right
+    if (generation == m_generation) {
+        QWriteLocker verdicts_locker(&m_verdictsLock);
+
+        if (m_verdicts.count() + worked_out.count() >= MAX_VERDICTS) {
+            m_verdicts.clear();
+        }
+
+        InsertVerdicts(m_verdicts, worked_out);
+    }
+
+    InsertVerdicts(verdicts, worked_out);
+    return verdicts;
+}
+
+bool SpellCheck::spell(const QString &word, const QString &lang)
+{
+    QSharedPointer<PooledDictionary> pooled = pooledDictionary(lang);
+
+    if (!pooled) {
+        return spell(word);
+    }
+
+    QMutexLocker locker(&pooled->mutex);
+    return SpellPooled(pooled.data(), word);
+}
+
+QHash<QString, bool> SpellCheck::spellWords(const QStringList &words, const QString &lang)
+{
+    QSharedPointer<PooledDictionary> pooled = pooledDictionary(lang);
+
+    if (!pooled) {
+        return spellWords(words);
+    }
+
+    // Most of a book is in its main language, so the words in another
+    // one are few enough to check with the one Hunspell
+    QHash<QString, bool> verdicts;
+    QMutexLocker locker(&pooled->mutex);
+    foreach(const QString &word, words) {
+        verdicts.insert(word, SpellPooled(pooled.data(), word));
+    }
+    return verdicts;
+}
+
+bool SpellCheck::SpellPooled(PooledDictionary *pooled, const QString &word)
+{
+    QHash<QString, bool>::const_iterator it = pooled->verdicts.constFind(word);
+
+    if (it != pooled->verdicts.constEnd()) {
+        return it.value();
+    }
+
+    bool correct = pooled->hunspell->spell(pooled->codec->fromUnicode(Utility::getSpellingSafeText(word)).constData()) != 0;
+
+    if (pooled->verdicts.count() >= MAX_VERDICTS) {
+        pooled->verdicts.clear();
+    }
+
+    // The word may only borrow the text it is in
+    pooled->verdicts.insert(QString(word.constData(), word.length()), correct);
+    return correct;
+}
+
+QString SpellCheck::dictionaryForLanguage(const QString &lang)
+{
+    QMutexLocker locker(&m_poolMutex);
+    return dictionaryForLanguageLocked(lang);
+}
+
+QString SpellCheck::dictionaryForLanguageLocked(const QString &lang)
+{
+    if (lang.isEmpty()) {
+        return QString();
+    }
+
+    QHash<QString, QString>::const_iterator it = m_languageDictionaries.constFind(lang);
+
+    if (it != m_languageDictionaries.constEnd()) {
+        return it.value();
+    }
+
+    // "pt-BR" is best checked with pt_BR, and failing that with the
+    // current dictionary if it is for Portuguese too, or any other that is
+    QString wanted = lang.trimmed().toLower().replace(QChar('-'), QChar('_'));
+    QString language = wanted.section(QChar('_'), 0, 0);
+    QStringList names = m_dictionaries.keys();
+    names.sort();
+    QString name;
+
+    foreach(const QString &candidate, names) {
+        if (candidate.toLower() == wanted) {
+            name = candidate;
+            break;
+        }
+    }
+
+    if (name.isEmpty() && m_dictionaryName.toLower().section(QChar('_'), 0, 0) != language) {
+        foreach(const QString &candidate, names) {
+            if (candidate.toLower().section(QChar('_'), 0, 0) == language) {
+                name = candidate;
+                break;
+            }
+        }
+    }
+
+    if (name == m_dictionaryName) {
+        name.clear();
+    }
+
+    m_languageDictionaries.insert(lang, name);
+    return name;
+}
+
+QSharedPointer<SpellCheck::PooledDictionary> SpellCheck::pooledDictionary(const QString &lang)
+{
+    QString name;
+    QString aff;
+    QString dic;
+    QStringList words;
+    int generation;
+    {
+        QMutexLocker locker(&m_poolMutex);
+        name = dictionaryForLanguageLocked(lang);
+
+        if (name.isEmpty()) {
+            return QSharedPointer<PooledDictionary>();
+        }
+
+        QSharedPointer<PooledDictionary> *pooled = m_pool.object(name);
+
+        if (pooled) {
+            return *pooled;
+        }
+
+        aff = QString("%1%2.aff").arg(m_dictionaries.value(name)).arg(name);
+        dic = QString("%1%2.dic").arg(m_dictionaries.value(name)).arg(name);
+        words = m_poolWords;
+        generation = m_poolGeneration;
+    }
+
+    // Loading the dictionary takes a while, so it is done unlocked
+    QSharedPointer<PooledDictionary> loaded(new PooledDictionary());
+    loaded->hunspell = new Hunspell(aff.toLocal8Bit().constData(), dic.toLocal8Bit().constData());
+    loaded->codec = QTextCodec::codecForName(loaded->hunspell->get_dic_encoding());
+
+    if (loaded->codec == 0) {
+        loaded->codec = QTextCodec::codecForName("UTF-8");
+    }
+
+    foreach(QString word, words) {
+        loaded->hunspell->add(loaded->codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    }
+
+    QMutexLocker locker(&m_poolMutex);
+    // Another thread may have loaded it in the meantime
+    QSharedPointer<PooledDictionary> *pooled = m_pool.object(name);
+
+    if (pooled) {
+        return *pooled;
+    }
+
+    // Still used for this check if it is out of date
+    if (generation == m_poolGeneration) {
+        m_pool.insert(name, new QSharedPointer<PooledDictionary>(loaded), DictionaryCost(aff, dic));
+    }
+
+    return loaded;
+}
+
+void SpellCheck::addPooledWord(const QString &word)
+{
+    QMutexLocker locker(&m_poolMutex);
+    m_poolWords.append(word);
+    foreach(const QString &name, m_pool.keys()) {
+        PooledDictionary *pooled = m_pool.object(name)->data();
+        QMutexLocker pooled_locker(&pooled->mutex);
+        pooled->hunspell->add(pooled->codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+        // Other forms of it may be correct now too
+        pooled->verdicts.clear();
+    }
+}
+
+void SpellCheck::resetPoolLocked(const QStringList &words)
+{
+    QMutexLocker locker(&m_poolMutex);
+    m_pool.clear();
+    m_languageDictionaries.clear();
+    m_poolWords = words;
+    m_poolGeneration++;
+}
+
+SpellCheck::PooledDictionary::PooledDictionary() :
+    hunspell(0),
+    codec(0)
+{
+}
+
+SpellCheck::PooledDictionary::~PooledDictionary()
+{
+    delete hunspell;
+}
+
+QHash<QString, bool> SpellCheck::spellChunk(const QStringList &words)
+{
+    QHash<QString, bool> verdicts;
+    Checker *checker = acquireChecker();
+
+    foreach(const QString &word, words) {
+        bool correct = true;
+
+        if (checker) {
+            correct = checker->hunspell->spell(checker->codec->fromUnicode(Utility::getSpellingSafeText(word)).constData()) != 0;
+        }
+
+        verdicts.insert(word, correct);
+    }
+
+    if (checker) {
+        releaseChecker(checker);
+    }
+
+    return verdicts;
+}
+
+SpellCheck::Checker *SpellCheck::acquireChecker()
+{
+    QString aff;
+    QString dic;
+    QStringList added_words;
+    int generation;
+    {
+        QMutexLocker locker(&m_hunspellMutex);
+        generation = m_generation;
+        {
+            QMutexLocker checkers_locker(&m_checkersMutex);
+
+            if (!m_idleCheckers.isEmpty()) {
+                return m_idleCheckers.takeLast();
+            }
+        }
+
+        if (!m_hunspell) {
+            return NULL;
+        }
+
+        aff = m_affPath;
+        dic = m_dicPath;
+        added_words = m_addedWords;
+    }
+
+    // Loading the dictionary takes a while, so it is done unlocked
+    Checker *checker = new Checker();
+    checker->hunspell = new Hunspell(aff.toLocal8Bit().constData(), dic.toLocal8Bit().constData());
+    checker->codec = QTextCodec::codecForName(checker->hunspell->get_dic_encoding());
+    checker->generation = generation;
+
+    if (checker->codec == 0) {
+        checker->codec = QTextCodec::codecForName("UTF-8");
+    }
+
+    foreach(QString word, added_words) {
+        checker->hunspell->add(checker->codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    }
+
+    return checker;
+}
+
+void SpellCheck::releaseChecker(Checker *checker)
+{
+    QMutexLocker locker(&m_hunspellMutex);
+
+    if (checker->generation == m_generation) {
+        QMutexLocker checkers_locker(&m_checkersMutex);
+        m_idleCheckers.append(checker);
+        return;
+    }
+
+    delete checker->hunspell;
+    delete checker;
+}
+
+void SpellCheck::clearCheckersLocked()
+{
+    QMutexLocker locker(&m_checkersMutex);
+    foreach(Checker *checker, m_idleCheckers) {
+        delete checker->hunspell;
+        delete checker;
+    }
+    m_idleCheckers.clear();
 }
 
 QStringList SpellCheck::suggest(const QString &word)
 {
+    QStringList suggestions;
+
+    if (cachedSuggestions(word, suggestions)) {
+        return suggestions;
+    }
+
+    QMutexLocker locker(&m_hunspellMutex);
+
     if (!m_hunspell) {
         return QStringList();
     }
 
+    suggestions = Suggest(m_hunspell, m_codec, word);
+    QMutexLocker suggestions_locker(&m_suggestionsMutex);
+    m_suggestions.insert(word, new QStringList(suggestions));
+    return suggestions;
+}
+
+QStringList SpellCheck::suggestInWorker(const QString &word)
+{
+    QStringList suggestions;
+
+    if (cachedSuggestions(word, suggestions)) {
+        return suggestions;
+    }
+
+    Checker *checker = acquireChecker();
+
+    if (!checker) {
+        return QStringList();
+    }
+
+    suggestions = Suggest(checker->hunspell, checker->codec, word);
+    {
+        QMutexLocker locker(&m_hunspellMutex);
+
+        // Not kept if the dictionary changed meanwhile
+        if (checker->generation == m_generation) {
+            QMutexLocker suggestions_locker(&m_suggestionsMutex);
+            m_suggestions.insert(word, new QStringList(suggestions));
+        }
+    }
+    releaseChecker(checker);
+    return suggestions;
+}
+
+bool SpellCheck::cachedSuggestions(const QString &word, QStringList &suggestions)
+{
+    QMutexLocker locker(&m_suggestionsMutex);
+    QStringList *cached = m_suggestions.object(word);
+
+    if (!cached) {
+        return false;
+    }
+
+    suggestions = *cached;
+    return true;
+}
+
+QStringList SpellCheck::Suggest(Hunspell *hunspell, QTextCodec *codec, const QString &word)
+{
     QStringList suggestions;
     char **suggestedWords;
-    int count = m_hunspell->suggest(&suggestedWords, m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    int count = hunspell->suggest(&suggestedWords, codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
 
     for (int i = 0; i < count; ++i) {
-        suggestions << m_codec->toUnicode(suggestedWords[i]);
+        suggestions << codec->toUnicode(suggestedWords[i]);
     }
 
-    m_hunspell->free_list(&suggestedWords, count);
+    hunspell->free_list(&suggestedWords, count);
     return suggestions;
 }
 
@@ -159,29 +698,75 @@ void SpellCheck::ignoreWord(const QString &word)
 }
 
 void SpellCheck::ignoreWordInDictionary(const QString &word)
+{
+    QMutexLocker locker(&m_hunspellMutex);
+    addWordLocked(word);
+    addPooledWord(word);
+}
+
+void SpellCheck::addWordLocked(const QString &word)
 {
     if (!m_hunspell) {
+        if (m_loading) {
+            m_wordsAddedWhileLoading.append(word);
+        }
         return;
     }
 
     m_hunspell->add(m_codec->fromUnicode(Utility::getSpellingSafeText(word)).constData());
+    m_addedWords.append(word);
+    // Other forms of it may be correct now too
+    clearVerdictsLocked();
+}
+
+void SpellCheck::clearVerdictsLocked()
+{
+    {
+        QWriteLocker locker(&m_verdictsLock);
+        m_verdicts.clear();
+    }
+    {
+        QMutexLocker locker(&m_suggestionsMutex);
+        m_suggestions.clear();
+    }
+    // The checkers are out of date as well
+    m_generation++;
+    clearCheckersLocked();
 }
 
 void SpellCheck::setDictionary(const QString &name, bool forceReplace)
 {
+    QMutexLocker locker(&m_hunspellMutex);
+
     // See if we are already using a hunspell object for this language.
     if (!forceReplace && m_dictionaryName == name && m_hunspell) {
         return;
     }
 
+    // What is being loaded in the background is no longer wanted
+    m_loadRequest++;
+    m_loading = false;
+    m_wordsAddedWhileLoading.clear();
+
+    clearVerdictsLocked();
+    m_addedWords.clear();
+    m_affPath.clear();
+    m_dicPath.clear();
+
     // Delete the current hunspell object.
     if (m_hunspell) {
         delete m_hunspell;
         m_hunspell = 0;
     }
 
-    // Save the dictionary name for use later.
-    m_dictionaryName = name;
+    // The other languages may be matched differently now, and the
+    // pooled dictionaries are made again with the words as they are
+    {
+        QMutexLocker pool_locker(&m_poolMutex);
+        // Save the dictionary name for use later.
+        m_dictionaryName = name;
+    }
+    resetPoolLocked(allUserDictionaryWords() + m_ignoredWords);
 
     // If we don't have a dictionary we cannot continue.
     if (name.isEmpty() || !m_dictionaries.contains(name)) {
@@ -193,6 +778,8 @@ void SpellCheck::setDictionary(const QString &name, bool forceReplace)
     QString dic = QString("%1%2.dic").arg(m_dictionaries.value(name)).arg(name);
     // Create a new hunspell object.
     m_hunspell = new Hunspell(aff.toLocal8Bit().constData(), dic.toLocal8Bit().constData());
+    m_affPath = aff;
+    m_dicPath = dic;
 
     // Note: these are encoded hyphenation dictionaries and their entries are not
     // meaningful words in and of themselves.
@@ -218,12 +805,12 @@ void SpellCheck::setDictionary(const QString &name, bool forceReplace)
 
     // Load in the words from the user dictionaries.
     foreach(QString word, allUserDictionaryWords()) {
-        ignoreWordInDictionary(word);
+        addWordLocked(word);
     }
 
     // Reload the words in the "Ignored" dictionary.
     foreach(QString word, m_ignoredWords) {
-        ignoreWordInDictionary(word);
+        addWordLocked(word);
     }
 }
 
@@ -318,7 +905,7 @@ void SpellCheck::loadDictionaryNames()
     QStringList dictExts;
     dictExts << ".aff"
              << ".dic";
-    m_dictionaries.clear();
+    QHash<QString, QString> dictionaries;
     const QString user_directory = dictionaryDirectory();
     QDir userDir(user_directory);
 
@@ -356,11 +943,16 @@ void SpellCheck::loadDictionaryNames()
 
                 // We only include the dictionary if it has a corresponding .aff.
                 if (QFile(udPath + basename + ".aff").exists()) {
-                    m_dictionaries.insert(basename, udPath);
+                    dictionaries.insert(basename, udPath);
                 }
             }
         }
     }
+
+    // Other languages are matched with the dictionaries off the GUI thread
+    QMutexLocker locker(&m_poolMutex);
+    m_dictionaries = dictionaries;
+    m_languageDictionaries.clear();
 }
 
 QString SpellCheck::dictionaryDirectory()
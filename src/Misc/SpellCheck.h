@@ -23,7 +23,13 @@
 #ifndef SPELLCHECK_H
 #define SPELLCHECK_H
 
+#include <QtCore/QCache>
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QReadWriteLock>
+#include <QtCore/QSharedPointer>
 #include <QtCore/QString>
 #include <QtCore/QStringList>
 
@@ -33,9 +39,32 @@ class QTextCodec;
 
 /**
  * Singleton.
+ *
+ * The verdict for each word checked is remembered until the dictionary
+ * or the words added to it change, so a word that repeats across a
+ * book goes through Hunspell only once. spell() may be called from any
+ * thread; whatever changes the dictionary must be on the GUI thread.
+ *
+ * Long word lists can be checked with spellWords(), which spreads them
+ * over the thread pool. Each worker borrows its own Hunspell, made from
+ * the same dictionary and added words as the main one and kept for the
+ * next time until the dictionary changes.
+ *
+ * The dictionary saved in the settings is loaded on a worker thread.
+ * Until it is ready every word passes, and dictionaryLoaded() is emitted
+ * once it is.
+ *
+ * Text in another language can be checked against the dictionary
+ * installed for it. Those dictionaries are loaded the first time a
+ * word in their language is checked and kept, the least recently used
+ * making way, while their files add up to less than a set size. Each
+ * has its verdicts of its own and gets the same added words as the
+ * current one.
  */
-class SpellCheck
+class SpellCheck : public QObject
 {
+    Q_OBJECT
+
 public:
     static SpellCheck *instance();
     ~SpellCheck();
@@ -44,7 +73,44 @@ public:
     QStringList dictionaries();
     QString currentDictionary() const;
     bool spell(const QString &word);
+
+    /**
+     * The same as calling spell() for each word, but in parallel.
+     *
+     * @return Whether each word is spelled correctly.
+     */
+    QHash<QString, bool> spellWords(const QStringList &words);
+
+    /**
+     * The same as spell(), with the dictionary installed for lang, a
+     * language code such as "fr" or "pt-BR". If lang is empty, or is
+     * what the current dictionary is for, or has no dictionary, the
+     * current one is used.
+     */
+    bool spell(const QString &word, const QString &lang);
+
+    /**
+     * The same as calling spell() for each word in the language lang.
+     */
+    QHash<QString, bool> spellWords(const QStringList &words, const QString &lang);
+
+    /**
+     * @return The name of the dictionary used for lang, or an empty
+     *         string if it is the current one.
+     */
+    QString dictionaryForLanguage(const QString &lang);
     QStringList suggest(const QString &word);
+
+    /**
+     * The same as suggest(), for worker threads: it uses a Hunspell of
+     * its own, so spell() is not held up while Hunspell thinks.
+     */
+    QStringList suggestInWorker(const QString &word);
+
+    /**
+     * The suggestions for the word if they were looked up recently.
+     */
+    bool cachedSuggestions(const QString &word, QStringList &suggestions);
     void clearIgnoredWords();
     void ignoreWord(const QString &word);
     void ignoreWordInDictionary(const QString &word);
@@ -68,9 +134,122 @@ public:
 
     void loadDictionaryNames();
 
+signals:
+    /**
+     * The dictionary loaded in the background is ready; words checked
+     * before it was may have been passed wrongly.
+     */
+    void dictionaryLoaded();
+
+private slots:
+    void backgroundLoadFinished();
+
 private:
     SpellCheck();
 
+    /**
+     * A Hunspell made on a worker thread, with the user dictionary
+     * words added to it.
+     */
+    struct LoadedDictionary {
+        Hunspell *hunspell;
+        QTextCodec *codec;
+        QString wordchars;
+        QString affPath;
+        QString dicPath;
+        QStringList addedWords;
+        int request;
+    };
+
+    /**
+     * Runs on a worker thread.
+     */
+    LoadedDictionary loadDictionary(const QString &aff, const QString &dic, int request);
+
+    /**
+     * A Hunspell for one worker, and the dictionary generation it was
+     * made for.
+     */
+    struct Checker {
+        Hunspell *hunspell;
+        QTextCodec *codec;
+        int generation;
+    };
+
+    /**
+     * An idle checker or, if there is none, a new one.
+     * May return NULL if there is no dictionary.
+     */
+    Checker *acquireChecker();
+
+    /**
+     * Keeps the checker for the next worker, unless the dictionary
+     * changed while it was in use.
+     */
+    void releaseChecker(Checker *checker);
+
+    /**
+     * Runs on a worker thread.
+     */
+    QHash<QString, bool> spellChunk(const QStringList &words);
+
+    static QStringList Suggest(Hunspell *hunspell, QTextCodec *codec, const QString &word);
+
+    /**
+     * A dictionary other than the current one, with the verdicts it gave.
+     */
+    struct PooledDictionary {
+        PooledDictionary();
+        ~PooledDictionary();
+
+        Hunspell *hunspell;
+        QTextCodec *codec;
+        QHash<QString, bool> verdicts;
+        // Guards all of the above; Hunspell is not thread safe
+        QMutex mutex;
+    };
+
+    /**
+     * The dictionary for lang from the pool, loading it if it is not
+     * there. NULL if the current dictionary is used for lang.
+     */
+    QSharedPointer<PooledDictionary> pooledDictionary(const QString &lang);
+
+    /**
+     * Called with m_poolMutex held.
+     */
+    QString dictionaryForLanguageLocked(const QString &lang);
+
+    static bool SpellPooled(PooledDictionary *pooled, const QString &word);
+
+    /**
+     * Adds the word to the pooled dictionaries and to those yet to be
+     * loaded.
+     */
+    void addPooledWord(const QString &word);
+
+    /**
+     * Drops the pooled dictionaries and the languages worked out for
+     * them, setting the words the next ones get. Called with
+     * m_hunspellMutex held.
+     */
+    void resetPoolLocked(const QStringList &words);
+
+    /**
+     * Drops the idle checkers. Called with m_hunspellMutex held.
+     */
+    void clearCheckersLocked();
+
+    /**
+     * Called with m_hunspellMutex held.
+     */
+    void addWordLocked(const QString &word);
+
+    /**
+     * Forgets every verdict. Called with m_hunspellMutex held.
+     */
+    void clearVerdictsLocked();
+
     Hunspell *m_hunspell;
     QTextCodec *m_codec;
     QString m_wordchars;
@@ -79,6 +258,49 @@ private:
     QHash<QString, QString> m_dictionaries;
     QStringList m_ignoredWords;
 
+    // Hunspell is not thread safe
+    QMutex m_hunspellMutex;
+    QHash<QString, bool> m_verdicts;
+    // Taken for writing with m_hunspellMutex held, so a verdict worked
+    // out with the old dictionary can not be added after it changes
+    QReadWriteLock m_verdictsLock;
+
+    // What a checker is made from, guarded by m_hunspellMutex. The
+    // generation goes up whenever the dictionary or its words change.
+    QString m_affPath;
+    QString m_dicPath;
+    QStringList m_addedWords;
+    int m_generation;
+
+    // Any setDictionary() call makes a background load that is
+    // still running out of date. Guarded by m_hunspellMutex, as are
+    // the words added while it runs.
+    int m_loadRequest;
+    bool m_loading;
+    QStringList m_wordsAddedWhileLoading;
+    QFutureWatcher<LoadedDictionary> m_loadWatcher;
+
+    QList<Checker *> m_idleCheckers;
+    QMutex m_checkersMutex;
+
+    // Keyed by dictionary name, with the size in kilobytes of its files
+    // as the cost. Guarded by m_poolMutex, as are the languages already
+    // matched to a dictionary ("" for the current one), the words the
+    // dictionaries are made with and, for reading off the GUI thread,
+    // m_dictionaries and m_dictionaryName. Taken with m_hunspellMutex
+    // held, never the other way round.
+    QCache<QString, QSharedPointer<PooledDictionary>> m_pool;
+    QHash<QString, QString> m_languageDictionaries;
+    QStringList m_poolWords;
+    // Goes up when the pool is dropped, so a dictionary loaded for it
+    // meanwhile is not kept
+    int m_poolGeneration;
+    QMutex m_poolMutex;
+
+    // For the words asked about most recently
+    QCache<QString, QStringList> m_suggestions;
+    QMutex m_suggestionsMutex;
+
     static SpellCheck *m_instance;
 };
 
@@ -0,0 +1,94 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <functional>
+
+#include "Misc/SpellCheck.h"
+#include "Misc/SpellingSuggester.h"
+
+
+SpellingSuggester::SpellingSuggester(QObject *parent)
+    :
+    QObject(parent),
+    m_Generation(0)
+{
+}
+
+
+SpellingSuggester::~SpellingSuggester()
+{
+    Cancel();
+    foreach(QFuture<void> future, m_Futures) {
+        future.waitForFinished();
+    }
+}
+
+
+void SpellingSuggester::Start(const QString &word)
+{
+    Cancel();
+    m_Cancel = TaskScheduler::CancelToken();
+    m_Generation++;
+
+    // Lookups are not waited for, only forgotten once they are done
+    QList<QFuture<void>> running;
+    foreach(QFuture<void> future, m_Futures) {
+        if (!future.isFinished()) {
+            running.append(future);
+        }
+    }
+    m_Futures = running;
+
+    m_Futures.append(TaskScheduler::Run(TaskScheduler::Interactive, "SpellingSuggester::Lookup",
+                                        std::bind(&SpellingSuggester::Lookup, this, word, m_Cancel, m_Generation)));
+}
+
+
+void SpellingSuggester::Cancel()
+{
+    m_Cancel.Cancel();
+}
+
+
+void SpellingSuggester::DeliverReady(int generation, const QString &word, const QStringList &suggestions)
+{
+    if (generation == m_Generation) {
+        emit Ready(word, suggestions);
+    }
+}
+
+
+void SpellingSuggester::Lookup(QString word, TaskScheduler::CancelToken cancel, int generation)
+{
+    if (cancel.IsCancelled()) {
+        return;
+    }
+
+    QStringList suggestions = SpellCheck::instance()->suggestInWorker(word);
+
+    if (cancel.IsCancelled()) {
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, "DeliverReady", Qt::QueuedConnection,
+                              Q_ARG(int, generation), Q_ARG(QString, word), Q_ARG(QStringList, suggestions));
+}
@@ -0,0 +1,80 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef SPELLINGSUGGESTER_H
+#define SPELLINGSUGGESTER_H
+
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/TaskScheduler.h"
+
+/**
+ * Looks up spelling suggestions in the background, for menus that
+ * should open before Hunspell has made up its mind.
+ *
+ * Only the latest lookup is reported. A cancelled lookup that is
+ * already running still finishes, and what it found is kept by
+ * SpellCheck for the next time the word is asked about.
+ */
+class SpellingSuggester : public QObject
+{
+    Q_OBJECT
+
+public:
+    SpellingSuggester(QObject *parent = 0);
+
+    /**
+     * Cancels what is running, and waits for it to stop.
+     */
+    ~SpellingSuggester();
+
+    /**
+     * Starts a lookup, replacing any earlier one.
+     */
+    void Start(const QString &word);
+
+    void Cancel();
+
+signals:
+    void Ready(const QString &word, const QStringList &suggestions);
+
+private slots:
+    // Run in this object's thread
+    void DeliverReady(int generation, const QString &word, const QStringList &suggestions);
+
+private:
+    void Lookup(QString word, TaskScheduler::CancelToken cancel, int generation);
+
+    QList<QFuture<void>> m_Futures;
+
+    TaskScheduler::CancelToken m_Cancel;
+
+    // Counts the lookups started
+    int m_Generation;
+};
+
+#endif // SPELLINGSUGGESTER_H
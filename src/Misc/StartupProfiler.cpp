@@ -0,0 +1,162 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QDebug>
+
+#include "Misc/StartupProfiler.h"
+#include "Misc/Utility.h"
+
+static const QString PROFILE_SWITCH = "--profile-startup";
+static const QString PROFILE_VARIABLE = "SIGIL_PROFILE_STARTUP";
+
+namespace
+{
+struct PhaseTiming {
+    QString name;
+    // In microseconds since start-up
+    qint64 start;
+    qint64 end;
+    quintptr thread;
+};
+}
+
+static bool s_Enabled = false;
+static QString s_TracePath;
+static QElapsedTimer s_Clock;
+static QList<PhaseTiming> s_Timings;
+static QMutex s_TimingsMutex;
+
+
+void StartupProfiler::Initialize(QStringList &arguments)
+{
+    bool asked = arguments.removeAll(PROFILE_SWITCH) > 0;
+
+    if (qEnvironmentVariableIsSet(PROFILE_VARIABLE.toLatin1().constData())) {
+        asked = true;
+        s_TracePath = QString::fromLocal8Bit(qgetenv(PROFILE_VARIABLE.toLatin1().constData())).trimmed();
+    }
+
+    if (!asked) {
+        return;
+    }
+
+    if (s_TracePath.isEmpty()) {
+        s_TracePath = Utility::DefinePrefsDir() + "/startup_trace.json";
+    }
+
+    s_Clock.start();
+    s_Enabled = true;
+}
+
+
+bool StartupProfiler::IsEnabled()
+{
+    return s_Enabled;
+}
+
+
+void StartupProfiler::Record(const char *name, qint64 start, qint64 end)
+{
+    PhaseTiming timing;
+    timing.name = QString::fromLatin1(name);
+    timing.start = start;
+    timing.end = end;
+    timing.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    QMutexLocker locker(&s_TimingsMutex);
+    s_Timings.append(timing);
+}
+
+
+void StartupProfiler::Report()
+{
+    if (!s_Enabled) {
+        return;
+    }
+
+    QList<PhaseTiming> timings;
+    {
+        QMutexLocker locker(&s_TimingsMutex);
+        timings = s_Timings;
+    }
+
+    qDebug().noquote() << "Start-up phases (ms):";
+    qDebug().noquote() << "     start   duration   phase";
+    QJsonArray events;
+    foreach(PhaseTiming timing, timings) {
+        qDebug().noquote() << QString("%1 %2   %3")
+                              .arg(timing.start / 1000.0, 10, 'f', 1)
+                              .arg((timing.end - timing.start) / 1000.0, 10, 'f', 1)
+                              .arg(timing.name);
+        QJsonObject event;
+        event["name"] = timing.name;
+        event["ph"] = QString("X");
+        event["ts"] = double(timing.start);
+        event["dur"] = double(timing.end - timing.start);
+        event["pid"] = 1;
+        event["tid"] = double(timing.thread);
+        events.append(event);
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = events;
+    QFile file(s_TracePath);
+
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        file.write(QJsonDocument(trace).toJson());
+        qDebug() << "Start-up trace written to" << s_TracePath;
+    } else {
+        qDebug() << "Could not write start-up trace to" << s_TracePath << file.errorString();
+    }
+}
+
+
+StartupProfiler::Phase::Phase(const char *name)
+    :
+    m_Name(name),
+    m_Start(s_Enabled ? s_Clock.nsecsElapsed() / 1000 : 0),
+    m_Ended(false)
+{
+}
+
+
+StartupProfiler::Phase::~Phase()
+{
+    End();
+}
+
+
+void StartupProfiler::Phase::End()
+{
+    if (s_Enabled && !m_Ended) {
+        Record(m_Name, m_Start, s_Clock.nsecsElapsed() / 1000);
+    }
+    m_Ended = true;
+}
@@ -0,0 +1,75 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+/**
+ * Times the phases of start-up when asked to with --profile-startup or
+ * the SIGIL_PROFILE_STARTUP environment variable, whose value, if any,
+ * is where the trace is written.
+ *
+ * Each phase is timed by a Phase object living as long as it does.
+ * Report() logs a table of the phases and writes them as a Chrome trace
+ * (chrome://tracing) to the prefs folder as startup_trace.json.
+ * When profiling is off a Phase costs a single check.
+ */
+class StartupProfiler
+{
+public:
+
+    /**
+     * Turns profiling on if it was asked for, and starts the clock.
+     *
+     * @param arguments The command line; --profile-startup is removed.
+     */
+    static void Initialize(QStringList &arguments);
+
+    static bool IsEnabled();
+
+    static void Report();
+
+    class Phase
+    {
+    public:
+        Phase(const char *name);
+        ~Phase();
+
+        /**
+         * Ends the phase before the object goes away.
+         */
+        void End();
+
+    private:
+        const char *m_Name;
+        qint64 m_Start;
+        bool m_Ended;
+    };
+
+private:
+    static void Record(const char *name, qint64 start, qint64 end);
+};
+
+#endif // STARTUPPROFILER_H
@@ -109,9 +109,10 @@ void TOCHTMLWriter::WriteBody()
     WriteEntries(m_TOCRootEntry);
 }
 
-void TOCHTMLWriter::WriteEntries(TOCModel::TOCEntry parent_entry, int level)
+void TOCHTMLWriter::WriteEntries(const TOCModel::TOCEntry &parent_entry, int level)
 {
-    foreach(TOCModel::TOCEntry entry, parent_entry.children) {
+    // By reference, so each subtree is not copied once for every level above it
+    foreach(const TOCModel::TOCEntry &entry, parent_entry.children) {
         m_Writer->writeStartElement("div");
         m_Writer->writeAttribute("class", "sgc-toc-level-" % QString::number(level));
         m_Writer->writeCharacters("\n");
@@ -41,7 +41,7 @@ public:
 private:
     void WriteHead();
     void WriteBody();
-    void WriteEntries(TOCModel::TOCEntry entry, int level = 1);
+    void WriteEntries(const TOCModel::TOCEntry &entry, int level = 1);
 
     QXmlStreamWriter *m_Writer;
 
@@ -0,0 +1,289 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+// cpu_set_t and CPU_COUNT are GNU extensions, and must be asked for
+// before any system header is included
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <limits>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "Misc/TaskScheduler.h"
+
+// Tasks that take longer than this are logged
+static const qint64 SLOW_TASK_MS = 2000;
+
+// The background lane gets one thread for every this many cores
+static const int CORES_PER_BACKGROUND_THREAD = 4;
+
+// A parallel stage may hold at most this share of the memory limit
+static const qint64 IN_FLIGHT_MEMORY_SHARE = 16;
+
+static const qint64 MIN_IN_FLIGHT_BYTES = 1024 * 1024;
+
+// cgroup v1 says there is no memory limit with a huge number
+static const qint64 UNLIMITED_MEMORY = Q_INT64_C(1) << 60;
+
+static const QString THREADS_OPTION = "--threads";
+static const QString MEMORY_LIMIT_OPTION = "--memory-limit";
+
+static const char *LANE_NAMES[TaskScheduler::LaneCount] = { "interactive", "foreground", "background" };
+
+struct BackgroundPool : public QThreadPool {
+    BackgroundPool() {
+        setMaxThreadCount(qMax(1, TaskScheduler::ThreadCount() / CORES_PER_BACKGROUND_THREAD));
+    }
+};
+
+// Set by ApplyLimits; 0 until then, or when nothing limits the memory
+static QAtomicInt s_ThreadCount;
+static qint64 s_MemoryLimit = 0;
+
+
+QThreadPool *TaskScheduler::Pool(Lane lane)
+{
+    if (lane == Interactive) {
+        return QThreadPool::globalInstance();
+    }
+
+    if (lane == Foreground) {
+        static QThreadPool foreground;
+        return &foreground;
+    }
+
+    static BackgroundPool background;
+    return &background;
+}
+
+
+#ifdef Q_OS_LINUX
+// The first of the cgroup files of this process named file that exists,
+// trimmed; empty if there is none. A cgroup v2 file is looked for in the
+// unified hierarchy, a v1 file in the hierarchy of controller. Inside a
+// container the process's own cgroup is usually the root one.
+static QByteArray ReadCgroupFile(const QString &controller, const QString &file)
+{
+    QStringList candidates;
+    QFile cgroups("/proc/self/cgroup");
+
+    if (cgroups.open(QIODevice::ReadOnly)) {
+        foreach(QByteArray line, cgroups.readAll().split('\n')) {
+            // hierarchy-ID:controller-list:cgroup-path
+            QString entry = QString::fromUtf8(line);
+            QString controllers = entry.section(':', 1, 1);
+            QString path = entry.section(':', 2);
+
+            if (path.isEmpty()) {
+                continue;
+            }
+
+            if (controllers.isEmpty()) {
+                candidates << "/sys/fs/cgroup" + path + "/" + file;
+            } else if (controllers.split(',').contains(controller)) {
+                candidates << "/sys/fs/cgroup/" + controllers + path + "/" + file;
+                candidates << "/sys/fs/cgroup/" + controller + path + "/" + file;
+            }
+        }
+    }
+
+    candidates << "/sys/fs/cgroup/" + file << "/sys/fs/cgroup/" + controller + "/" + file;
+
+    foreach(QString candidate, candidates) {
+        QFile limit(candidate);
+
+        if (limit.open(QIODevice::ReadOnly)) {
+            return limit.readAll().trimmed();
+        }
+    }
+
+    return QByteArray();
+}
+
+
+// The CPUs a cgroup quota allows, rounded up; 0 if there is no quota
+static int CgroupCpuLimit()
+{
+    qint64 quota = -1;
+    qint64 period = 0;
+    // v2: "quota period", or "max period" when there is none
+    QList<QByteArray> max = ReadCgroupFile("cpu", "cpu.max").split(' ');
+
+    if (max.count() == 2) {
+        quota = max.at(0) == "max" ? -1 : max.at(0).toLongLong();
+        period = max.at(1).toLongLong();
+    } else {
+        // v1: a quota of -1 when there is none
+        quota = ReadCgroupFile("cpu", "cpu.cfs_quota_us").toLongLong();
+        period = ReadCgroupFile("cpu", "cpu.cfs_period_us").toLongLong();
+    }
+
+    if (quota <= 0 || period <= 0) {
+        return 0;
+    }
+
+    return qMax<qint64>(1, (quota + period - 1) / period);
+}
+
+
+// The cgroup memory limit in bytes; 0 if there is none
+static qint64 CgroupMemoryLimit()
+{
+    QByteArray max = ReadCgroupFile("memory", "memory.max");
+
+    if (max.isEmpty()) {
+        max = ReadCgroupFile("memory", "memory.limit_in_bytes");
+    }
+
+    bool ok = false;
+    qint64 limit = max.toLongLong(&ok);
+
+    // v2 says "max" when there is no limit
+    if (!ok || limit <= 0 || limit >= UNLIMITED_MEMORY) {
+        return 0;
+    }
+
+    return limit;
+}
+#endif
+
+
+bool TaskScheduler::ApplyLimits(QStringList &arguments, QString &error)
+{
+    int threads = QThread::idealThreadCount();
+    qint64 memory_limit = 0;
+#ifdef Q_OS_LINUX
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 0) {
+        threads = qMin(threads, CPU_COUNT(&cpus));
+    }
+
+    int quota = CgroupCpuLimit();
+
+    if (quota > 0) {
+        threads = qMin(threads, quota);
+    }
+
+    memory_limit = CgroupMemoryLimit();
+#endif
+
+    for (int i = 1; i < arguments.count(); ++i) {
+        if (arguments.at(i) != THREADS_OPTION && arguments.at(i) != MEMORY_LIMIT_OPTION) {
+            continue;
+        }
+
+        if (i + 1 >= arguments.count()) {
+            error = QObject::tr("Missing value for %1").arg(arguments.at(i));
+            return false;
+        }
+
+        bool ok = false;
+        qint64 value = arguments.at(i + 1).toLongLong(&ok);
+
+        // A count of threads is an int, and a limit in bytes must fit
+        // a qint64
+        const qint64 max_value = arguments.at(i) == THREADS_OPTION ?
+                                 qint64(std::numeric_limits<int>::max()) :
+                                 std::numeric_limits<qint64>::max() / (1024 * 1024);
+
+        if (!ok || value < 1 || value > max_value) {
+            error = QObject::tr("Invalid value for %1: %2").arg(arguments.at(i)).arg(arguments.at(i + 1));
+            return false;
+        }
+
+        if (arguments.at(i) == THREADS_OPTION) {
+            threads = int(value);
+        } else {
+            memory_limit = value * 1024 * 1024;
+        }
+
+        arguments.removeAt(i);
+        arguments.removeAt(i);
+        --i;
+    }
+
+    s_ThreadCount.store(qMax(1, threads));
+    s_MemoryLimit = memory_limit;
+    QThreadPool::globalInstance()->setMaxThreadCount(ThreadCount());
+    Pool(Foreground)->setMaxThreadCount(ThreadCount());
+    Pool(Background)->setMaxThreadCount(qMax(1, ThreadCount() / CORES_PER_BACKGROUND_THREAD));
+    return true;
+}
+
+
+int TaskScheduler::ThreadCount()
+{
+    int threads = s_ThreadCount.load();
+    return threads > 0 ? threads : QThread::idealThreadCount();
+}
+
+
+qint64 TaskScheduler::MemoryLimit()
+{
+    return s_MemoryLimit;
+}
+
+
+qint64 TaskScheduler::InFlightBytes(qint64 preferred)
+{
+    if (s_MemoryLimit <= 0) {
+        return preferred;
+    }
+
+    return qMin(preferred, qMax(MIN_IN_FLIGHT_BYTES, s_MemoryLimit / IN_FLIGHT_MEMORY_SHARE));
+}
+
+
+void TaskScheduler::RecordTiming(Lane lane, const char *name, qint64 elapsed_ms)
+{
+    if (elapsed_ms > SLOW_TASK_MS) {
+        qDebug() << "Slow" << LANE_NAMES[lane] << "task" << name << elapsed_ms << "ms";
+    }
+}
+
+
+TaskScheduler::Timer::Timer(Lane lane, const char *name)
+    :
+    m_Lane(lane),
+    m_Name(name)
+{
+    // Pool threads are reused, so the priority is set for every task
+    QThread::currentThread()->setPriority(lane == Background ? QThread::LowestPriority : QThread::NormalPriority);
+    m_Elapsed.start();
+}
+
+
+TaskScheduler::Timer::~Timer()
+{
+    RecordTiming(m_Lane, m_Name, m_Elapsed.elapsed());
+}
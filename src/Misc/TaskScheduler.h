@@ -0,0 +1,169 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <functional>
+#include <type_traits>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFuture>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtConcurrent/QtConcurrent>
+
+class QThreadPool;
+
+/**
+ * The one place background work is started from.
+ *
+ * Work is run in one of three lanes, each with its own threads, so work
+ * that can wait never holds up work the user is waiting on:
+ *
+ *  - Interactive: short work the user is waiting on. This is the global
+ *    pool, which QtConcurrent::map and mapped also use.
+ *  - Foreground: longer batches the user started, e.g. an import.
+ *  - Background: housekeeping nobody waits on, e.g. deleting temp
+ *    folders. A few threads at the lowest thread priority.
+ *
+ * Every task is timed, and the slow ones are logged by task name.
+ *
+ * The lanes are sized for the CPUs the process may really use, which in
+ * a container with a CPU quota can be far fewer than the host has, and
+ * parallel stages hold no more data at once than the memory limit allows.
+ */
+class TaskScheduler
+{
+public:
+
+    enum Lane {
+        Interactive = 0,
+        Foreground,
+        Background,
+        LaneCount
+    };
+
+    /**
+     * A flag shared between whoever starts a task and the task itself,
+     * which checks it between units of work.
+     */
+    class CancelToken
+    {
+    public:
+        CancelToken() : m_Cancelled(new QAtomicInt(0)) {}
+
+        void Cancel() {
+            m_Cancelled->store(1);
+        }
+
+        bool IsCancelled() const {
+            return m_Cancelled->load() != 0;
+        }
+
+    private:
+        QSharedPointer<QAtomicInt> m_Cancelled;
+    };
+
+    /**
+     * Runs functor() in a lane.
+     *
+     * @param name Names the task in the log of slow tasks, e.g. "TOCModel::GetRootTOCEntry".
+     */
+    template <typename Functor>
+    static QFuture<typename std::result_of<Functor()>::type> Run(Lane lane, const char *name, Functor functor)
+    {
+        return QtConcurrent::run(Pool(lane), TimedTask<Functor>(lane, name, functor));
+    }
+
+    /**
+     * @return The threads of a lane. For callers that need to hand
+     *         QtConcurrent a pool themselves.
+     */
+    static QThreadPool *Pool(Lane lane);
+
+    /**
+     * Sizes the lanes for the CPU and memory limits of the process:
+     * the CPUs it may run on, any cgroup (v1 or v2) CPU quota and any
+     * cgroup memory limit. Call once at start-up, before any work.
+     *
+     * Takes "--threads N" and "--memory-limit MB" out of arguments;
+     * these override what was detected.
+     *
+     * @param error Set to the reason when an override is not valid.
+     * @return False if an override is not valid.
+     */
+    static bool ApplyLimits(QStringList &arguments, QString &error);
+
+    /**
+     * @return How many threads CPU bound work should use at once.
+     *         Use this rather than QThread::idealThreadCount().
+     */
+    static int ThreadCount();
+
+    /**
+     * @return The memory the process may use in bytes, 0 if unlimited.
+     */
+    static qint64 MemoryLimit();
+
+    /**
+     * @return How many bytes a parallel stage that would like to hold
+     *         preferred bytes at once may hold under the memory limit.
+     */
+    static qint64 InFlightBytes(qint64 preferred);
+
+    static void RecordTiming(Lane lane, const char *name, qint64 elapsed_ms);
+
+private:
+
+    template <typename Functor>
+    struct TimedTask {
+        typedef typename std::result_of<Functor()>::type result_type;
+
+        TimedTask(Lane lane, const char *name, Functor functor)
+            : m_Lane(lane), m_Name(name), m_Functor(functor) {}
+
+        result_type operator()() {
+            Timer timer(m_Lane, m_Name);
+            return m_Functor();
+        }
+
+        Lane m_Lane;
+        const char *m_Name;
+        Functor m_Functor;
+    };
+
+    // Records the time when it goes out of scope, so void tasks are timed too
+    struct Timer {
+        Timer(Lane lane, const char *name);
+        ~Timer();
+
+        Lane m_Lane;
+        const char *m_Name;
+        QElapsedTimer m_Elapsed;
+    };
+};
+
+#endif // TASKSCHEDULER_H
@@ -20,14 +20,32 @@
 *************************************************************************/
 
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QTemporaryFile>
 #include <QtConcurrent>
 #include <QDebug>
 
+#if defined(Q_OS_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Misc/TaskScheduler.h"
 #include "Misc/TempFolder.h"
 #include "Misc/SettingsStore.h"
 
-TempFolder::TempFolder()
-    : m_tempDir(GetNewTempFolderTemplate())
+// Opening a book unpacks it once more before it is copied into place
+// and saving writes one more copy, so the RAM workspace needs room for two
+static const int RAM_WORKSPACE_COPIES = 2;
+
+static const int MEASURE_BLOCK_SIZE = 1024 * 1024;
+static const int MEASURE_BLOCK_COUNT = 64;
+
+TempFolder::TempFolder(qint64 expected_size)
+    : m_tempDir(GetNewTempFolderTemplate(expected_size))
 {
     // verify m_tempDir was properly created
     if (!m_tempDir.isValid()) {
@@ -43,7 +61,8 @@ TempFolder::~TempFolder()
     // To be super safe here ...
     // only manually delete things if the temp directory is actually valid
     if (m_tempDir.isValid()) {
-        QtConcurrent::run(DeleteFolderAndFiles, m_tempDir.path());
+        TaskScheduler::Run(TaskScheduler::Background, "TempFolder::DeleteFolderAndFiles",
+                           std::bind(DeleteFolderAndFiles, m_tempDir.path()));
     }
 }
 
@@ -68,17 +87,68 @@ QString TempFolder::GetPathToSigilScratchpad()
 }
 
 
-QString TempFolder::GetNewTempFolderTemplate()
+QString TempFolder::GetPathToRamWorkspace()
+{
+#if defined(Q_OS_LINUX)
+    QFileInfo shm("/dev/shm");
+    if (shm.isDir() && shm.isWritable()) {
+        return shm.absoluteFilePath();
+    }
+#endif
+    return QString();
+}
+
+
+QString TempFolder::GetWorkspaceHome(qint64 expected_size)
 {
     SettingsStore ss;
-    QString temp_path = ss.tempFolderHome();
-    if (temp_path == "<SIGIL_DEFAULT_TEMP_HOME>") {
-        return QDir::tempPath() + "/Sigil-XXXXXX";;
+    QString ram_path = GetPathToRamWorkspace();
+    if (ss.ramWorkspace() && !ram_path.isEmpty() &&
+        expected_size <= qint64(ss.ramWorkspaceLimit()) * 1024 * 1024) {
+        QStorageInfo volume(ram_path);
+        if (volume.isValid() && volume.isReady() &&
+            volume.bytesAvailable() > expected_size * RAM_WORKSPACE_COPIES) {
+            return ram_path;
+        }
     }
-    if (!QDir(temp_path).exists()) {
-        return QDir::tempPath() + "/Sigil-XXXXXX";;
+    return GetPathToSigilScratchpad();
+}
+
+
+double TempFolder::MeasureWriteThroughput(const QString &folder_path)
+{
+    QTemporaryFile file(folder_path + "/sigil_measure_XXXXXX");
+    if (!file.open()) {
+        return -1;
+    }
+
+    QByteArray block(MEASURE_BLOCK_SIZE, 'S');
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < MEASURE_BLOCK_COUNT; ++i) {
+        if (file.write(block) != block.size()) {
+            return -1;
+        }
+    }
+    if (!file.flush()) {
+        return -1;
     }
-    return temp_path + "/Sigil-XXXXXX"; 
+
+    // Without the sync only the page cache would be measured
+#if defined(Q_OS_WIN32)
+    _commit(file.handle());
+#else
+    fsync(file.handle());
+#endif
+
+    double seconds = qMax<qint64>(timer.nsecsElapsed(), 1) / 1e9;
+    return (double(MEASURE_BLOCK_SIZE) * MEASURE_BLOCK_COUNT / (1024 * 1024)) / seconds;
+}
+
+
+QString TempFolder::GetNewTempFolderTemplate(qint64 expected_size)
+{
+    return GetWorkspaceHome(expected_size) + "/Sigil-XXXXXX";
 }
 
 
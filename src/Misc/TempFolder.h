@@ -38,8 +38,12 @@ public:
 
     /**
      * Constructor.
+     *
+     * @param expected_size How much the folder is expected to hold, in
+     *                      bytes. Decides whether the RAM backed
+     *                      workspace, when enabled, has room for it.
      */
-    TempFolder();
+    TempFolder(qint64 expected_size = 0);
 
     /**
      * Destructor. Deletes the temp folder on disk
@@ -64,6 +68,28 @@ public:
      */
     static QString GetPathToSigilScratchpad();
 
+    /**
+     * Returns the full path to a RAM backed folder (tmpfs) Sigil can
+     * write to, or an empty string if the system has none.
+     */
+    static QString GetPathToRamWorkspace();
+
+    /**
+     * Returns the folder new temp folders expected to hold
+     * expected_size bytes are created in: the RAM backed workspace
+     * when it is enabled, the size is under the limit set for it and
+     * its volume has room, else the scratchpad.
+     */
+    static QString GetWorkspaceHome(qint64 expected_size);
+
+    /**
+     * Writes a test file to the folder and syncs it to its device.
+     *
+     * @return The write throughput of the folder's volume in MB/s,
+     *         or a negative number if the test file could not be written.
+     */
+    static double MeasureWriteThroughput(const QString &folder_path);
+
 private:
 
     // We turn these of since TempFolder is an identity class.
@@ -72,11 +98,11 @@ private:
 
     /**
      * Provides the template for QTemporaryDir for new temporary
-     * folders.
+     * folders expected to hold expected_size bytes.
      *
      * @return Absolute path to a new temp folder template.
      */
-    static QString GetNewTempFolderTemplate();
+    static QString GetNewTempFolderTemplate(qint64 expected_size);
 
     /**
      * Deletes the folder specified and all the files
@@ -0,0 +1,240 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtCore/QHash>
+#include <QtCore/QStringRef>
+
+#include "Misc/TextDiff.h"
+
+// Past this many differing lines the texts are treated as one change;
+// the diff costs time and memory in proportion to the square of it.
+static const int MAX_LINE_EDITS = 1000;
+
+
+QList<TextDiff::Edit> TextDiff::Compute(const QString &old_text, const QString &new_text)
+{
+    QList<Edit> edits;
+    const int old_length = old_text.length();
+    const int new_length = new_text.length();
+    const QChar *old_data = old_text.constData();
+    const QChar *new_data = new_text.constData();
+
+    // What the texts have in common at either end is never looked at again
+    int prefix = 0;
+    int shorter = qMin(old_length, new_length);
+
+    while (prefix < shorter && old_data[prefix] == new_data[prefix]) {
+        prefix++;
+    }
+
+    if (prefix == old_length && prefix == new_length) {
+        return edits;
+    }
+
+    int suffix = 0;
+
+    while (suffix < shorter - prefix &&
+           old_data[old_length - suffix - 1] == new_data[new_length - suffix - 1]) {
+        suffix++;
+    }
+
+    const int old_end = old_length - suffix;
+    const int new_end = new_length - suffix;
+
+    // A pure insertion or removal
+    if (prefix == old_end || prefix == new_end) {
+        AddEdit(edits, old_text, prefix, old_end, new_text, prefix, new_end);
+        return edits;
+    }
+
+    const QList<Line> old_lines = SplitLines(old_text, prefix, old_end);
+    const QList<Line> new_lines = SplitLines(new_text, prefix, new_end);
+    QVector<bool> old_removed;
+    QVector<bool> new_inserted;
+
+    if (!DiffLines(old_text, old_lines, new_text, new_lines, old_removed, new_inserted)) {
+        AddEdit(edits, old_text, prefix, old_end, new_text, prefix, new_end);
+        return edits;
+    }
+
+    // Every run of removed and inserted lines becomes one edit
+    int i = 0;
+    int j = 0;
+
+    while (i < old_lines.count() || j < new_lines.count()) {
+        if (i < old_lines.count() && j < new_lines.count() && !old_removed[i] && !new_inserted[j]) {
+            i++;
+            j++;
+            continue;
+        }
+
+        int old_start = i < old_lines.count() ? old_lines[i].start : old_end;
+        int new_start = j < new_lines.count() ? new_lines[j].start : new_end;
+
+        while (i < old_lines.count() && old_removed[i]) {
+            i++;
+        }
+
+        while (j < new_lines.count() && new_inserted[j]) {
+            j++;
+        }
+
+        AddEdit(edits, old_text, old_start, i < old_lines.count() ? old_lines[i].start : old_end,
+                new_text, new_start, j < new_lines.count() ? new_lines[j].start : new_end);
+    }
+
+    return edits;
+}
+
+
+QList<TextDiff::Line> TextDiff::SplitLines(const QString &text, int start, int end)
+{
+    QList<Line> lines;
+    int line_start = start;
+
+    while (line_start < end) {
+        int newline = text.indexOf(QChar('\n'), line_start);
+        int line_end = newline == -1 || newline >= end ? end : newline + 1;
+        Line line;
+        line.start = line_start;
+        line.length = line_end - line_start;
+        line.hash = qHash(text.midRef(line.start, line.length));
+        lines.append(line);
+        line_start = line_end;
+    }
+
+    return lines;
+}
+
+
+bool TextDiff::DiffLines(const QString &old_text, const QList<Line> &old_lines,
+                         const QString &new_text, const QList<Line> &new_lines,
+                         QVector<bool> &old_removed, QVector<bool> &new_inserted)
+{
+    // Myers' greedy algorithm: v[k] is the furthest old line reached
+    // on diagonal k = x - y, and trace keeps v as it was before each
+    // step so the path can be walked back.
+    const int n = old_lines.count();
+    const int m = new_lines.count();
+    const int max = qMin(n + m, MAX_LINE_EDITS);
+    const int offset = max + 1;
+    QVector<int> v(2 * max + 3, 0);
+    QList<QVector<int> > trace;
+    int edit_count = -1;
+
+    for (int d = 0; d <= max && edit_count < 0; ++d) {
+        trace.append(v);
+
+        for (int k = -d; k <= d; k += 2) {
+            int x;
+
+            if (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) {
+                x = v[offset + k + 1];
+            } else {
+                x = v[offset + k - 1] + 1;
+            }
+
+            int y = x - k;
+
+            while (x < n && y < m &&
+                   old_lines[x].hash == new_lines[y].hash &&
+                   old_text.midRef(old_lines[x].start, old_lines[x].length) ==
+                   new_text.midRef(new_lines[y].start, new_lines[y].length)) {
+                x++;
+                y++;
+            }
+
+            v[offset + k] = x;
+
+            if (x >= n && y >= m) {
+                edit_count = d;
+                break;
+            }
+        }
+    }
+
+    if (edit_count < 0) {
+        return false;
+    }
+
+    old_removed.fill(false, n);
+    new_inserted.fill(false, m);
+    int x = n;
+    int y = m;
+
+    for (int d = edit_count; d > 0; --d) {
+        const QVector<int> &previous = trace.at(d);
+        int k = x - y;
+        int previous_k;
+
+        if (k == -d || (k != d && previous[offset + k - 1] < previous[offset + k + 1])) {
+            previous_k = k + 1;
+        } else {
+            previous_k = k - 1;
+        }
+
+        int previous_x = previous[offset + previous_k];
+        int previous_y = previous_x - previous_k;
+
+        while (x > previous_x && y > previous_y) {
+            x--;
+            y--;
+        }
+
+        if (x == previous_x) {
+            new_inserted[previous_y] = true;
+        } else {
+            old_removed[previous_x] = true;
+        }
+
+        x = previous_x;
+        y = previous_y;
+    }
+
+    return true;
+}
+
+
+void TextDiff::AddEdit(QList<Edit> &edits,
+                       const QString &old_text, int old_start, int old_end,
+                       const QString &new_text, int new_start, int new_end)
+{
+    while (old_start < old_end && new_start < new_end && old_text.at(old_start) == new_text.at(new_start)) {
+        old_start++;
+        new_start++;
+    }
+
+    while (old_start < old_end && new_start < new_end && old_text.at(old_end - 1) == new_text.at(new_end - 1)) {
+        old_end--;
+        new_end--;
+    }
+
+    if (old_start == old_end && new_start == new_end) {
+        return;
+    }
+
+    Edit edit;
+    edit.position = old_start;
+    edit.length = old_end - old_start;
+    edit.text = new_text.mid(new_start, new_end - new_start);
+    edits.append(edit);
+}
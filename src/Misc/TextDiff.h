@@ -0,0 +1,94 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef TEXTDIFF_H
+#define TEXTDIFF_H
+
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+/**
+ * Works out the smallest set of replacements, line by line, that turn
+ * one text into another.
+ *
+ * Used to apply a new version of a whole document to an editor so that
+ * only what actually changed is touched: the highlighting, bookmarks,
+ * scroll position and undo memory of the rest of the document survive.
+ */
+class TextDiff
+{
+public:
+
+    /**
+     * Replace length characters of the old text, starting at position,
+     * with text.
+     */
+    struct Edit {
+        int position;
+        int length;
+        QString text;
+    };
+
+    /**
+     * @return The edits in ascending order of position, non-overlapping.
+     *         Positions are in the old text, so the edits have to be
+     *         applied from the last to the first. Empty if the texts
+     *         are the same.
+     */
+    static QList<Edit> Compute(const QString &old_text, const QString &new_text);
+
+private:
+
+    struct Line {
+        int start;
+        int length;
+        uint hash;
+    };
+
+    /**
+     * Splits text[start, end) into lines, each with its newline.
+     */
+    static QList<Line> SplitLines(const QString &text, int start, int end);
+
+    /**
+     * Marks the lines only in old_lines and the lines only in new_lines.
+     *
+     * @return false if the texts differ in too many lines for
+     *         a line diff to be worth it.
+     */
+    static bool DiffLines(const QString &old_text, const QList<Line> &old_lines,
+                          const QString &new_text, const QList<Line> &new_lines,
+                          QVector<bool> &old_removed, QVector<bool> &new_inserted);
+
+    /**
+     * Adds the edit replacing old_text[old_start, old_end) with
+     * new_text[new_start, new_end), less what the two have in common
+     * at either end.
+     */
+    static void AddEdit(QList<Edit> &edits,
+                        const QString &old_text, int old_start, int old_end,
+                        const QString &new_text, int new_start, int new_end);
+};
+
+#endif // TEXTDIFF_H
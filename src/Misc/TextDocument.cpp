@@ -21,13 +21,29 @@
 
 #include <QChar>
 #include <QTextCursor>
+#include <QTimer>
 
+#include "Misc/SettingsStore.h"
+#include "Misc/TextDiff.h"
 #include "Misc/TextDocument.h"
 
+// What an undo command costs besides the characters it holds
+static const int UNDO_STEP_OVERHEAD = 64;
+
 TextDocument::TextDocument(QObject *parent)
  :
-  QTextDocument(parent)
+  QTextDocument(parent),
+  m_UndoBudget(0),
+  m_CompressUndoHistory(true),
+  m_UndoBytes(0),
+  m_TrimPending(false),
+  m_RestoringCheckpoint(false),
+  m_HighlightStatesReady(false)
 {
+    SettingsStore settings;
+    m_UndoBudget = qint64(settings.undoMemoryBudget()) * 1024 * 1024;
+    m_CompressUndoHistory = settings.compressUndoHistory();
+    connect(this, SIGNAL(contentsChange(int, int, int)), this, SLOT(TrackUndoMemory(int, int, int)));
 }
 
 // a faster way to get just the current length of the plain text
@@ -80,3 +96,140 @@ QString TextDocument::toText()
 
     return txt;
 }
+
+
+bool TextDocument::ApplyText(const QString &new_text)
+{
+    const QList<TextDiff::Edit> edits = TextDiff::Compute(toText(), new_text);
+
+    if (edits.isEmpty()) {
+        return false;
+    }
+
+    QTextCursor cursor(this);
+    cursor.beginEditBlock();
+
+    // From the end so the positions of the edits still to come hold
+    for (int i = edits.count() - 1; i >= 0; --i) {
+        const TextDiff::Edit &edit = edits.at(i);
+        cursor.setPosition(edit.position);
+        cursor.setPosition(edit.position + edit.length, QTextCursor::KeepAnchor);
+        cursor.insertText(edit.text);
+    }
+
+    cursor.endEditBlock();
+    return true;
+}
+
+
+qint64 TextDocument::undoMemoryUsage() const
+{
+    qint64 bytes = m_UndoBytes + m_UndoBase.size();
+    foreach(const QByteArray &checkpoint, m_UndoCheckpoints) {
+        bytes += checkpoint.size();
+    }
+    return bytes;
+}
+
+
+bool TextDocument::hasUndoCheckpoint() const
+{
+    return !m_UndoCheckpoints.isEmpty();
+}
+
+
+bool TextDocument::highlightStatesReady() const
+{
+    return m_HighlightStatesReady;
+}
+
+
+void TextDocument::setHighlightStatesReady(bool ready)
+{
+    m_HighlightStatesReady = ready;
+}
+
+
+bool TextDocument::undoToCheckpoint()
+{
+    if (isUndoAvailable() || m_UndoCheckpoints.isEmpty()) {
+        return false;
+    }
+
+    // The snapshot becomes the new bottom of the undo stack; what was
+    // undone on the way here can not be redone.
+    m_UndoBase = m_UndoCheckpoints.takeLast();
+    m_RestoringCheckpoint = true;
+    ApplyText(QString::fromUtf8(qUncompress(m_UndoBase)));
+    clearUndoRedoStacks();
+    m_RestoringCheckpoint = false;
+    m_UndoBytes = 0;
+    emit UndoMemoryChanged(undoMemoryUsage());
+    return true;
+}
+
+
+void TextDocument::TrackUndoMemory(int position, int chars_removed, int chars_added)
+{
+    Q_UNUSED(position);
+    m_HighlightStatesReady = false;
+
+    if (m_RestoringCheckpoint) {
+        return;
+    }
+
+    // setPlainText() and clear() start the history over
+    if (!isUndoAvailable() && !isRedoAvailable()) {
+        m_UndoBytes = 0;
+        m_UndoBase.clear();
+        m_UndoCheckpoints.clear();
+        emit UndoMemoryChanged(0);
+        return;
+    }
+
+    // Undo leaves something to redo, a new edit never does; undoing
+    // and redoing reuse what the stacks already hold.
+    if (!isUndoRedoEnabled() || isRedoAvailable()) {
+        return;
+    }
+
+    // QChars are two bytes, and the removed ones stay in the
+    // document's buffer for the undo stack's sake
+    m_UndoBytes += qint64(chars_removed + chars_added) * 2 + UNDO_STEP_OVERHEAD;
+    emit UndoMemoryChanged(undoMemoryUsage());
+
+    // Not from in here: the edit that got us here may still be adding
+    // to the last undo command
+    if (m_UndoBudget > 0 && m_UndoBytes > m_UndoBudget && !m_TrimPending) {
+        m_TrimPending = true;
+        QTimer::singleShot(0, this, SLOT(TrimUndoHistory()));
+    }
+}
+
+
+void TextDocument::TrimUndoHistory()
+{
+    m_TrimPending = false;
+
+    if (m_UndoBudget <= 0 || m_UndoBytes <= m_UndoBudget || isRedoAvailable()) {
+        return;
+    }
+
+    if (m_CompressUndoHistory) {
+        if (!m_UndoBase.isEmpty()) {
+            m_UndoCheckpoints.append(m_UndoBase);
+        }
+
+        m_UndoBase = qCompress(toText().toUtf8());
+    }
+
+    clearUndoRedoStacks();
+    m_UndoBytes = 0;
+
+    // The snapshots are held to the same budget, oldest dropped first
+    while (!m_UndoCheckpoints.isEmpty() && undoMemoryUsage() > m_UndoBudget) {
+        m_UndoCheckpoints.removeFirst();
+    }
+
+    emit UndoMemoryChanged(undoMemoryUsage());
+}
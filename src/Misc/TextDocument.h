@@ -22,6 +22,8 @@
 #ifndef TEXT_DOCUMENT
 #define TEXT_DOCUMENT
 
+#include <QByteArray>
+#include <QList>
 #include <QString>
 #include <QTextDocument>
 
@@ -50,6 +52,71 @@ class TextDocument : public QTextDocument
 
   QString toText();
 
+  // Turns the document into new_text by replacing only the lines that
+  // differ, as one undo step. Unlike replacing everything this keeps
+  // the highlighting, cursors and scroll position of what did not change.
+  // Returns false if there was nothing to change.
+
+  bool ApplyText(const QString &new_text);
+
+  // The undo and redo stacks of a QTextDocument keep every removed and
+  // inserted character for as long as the document lives. Once their
+  // estimated size goes over SettingsStore::undoMemoryBudget() the
+  // stacks are cleared; with compressUndoHistory() on, the text at each
+  // such trim is kept compressed so that Undo can still go back to it.
+
+  // The estimated bytes held by the undo history, compressed snapshots
+  // included.
+
+  qint64 undoMemoryUsage() const;
+
+  // Goes back to the newest compressed snapshot when no ordinary undo
+  // steps are left. Returns false if there is none.
+
+  bool undoToCheckpoint();
+
+  bool hasUndoCheckpoint() const;
+
+  // Set when the highlighting state of every block was worked out
+  // before the document was shown, see XHTMLHighlighter::PrepareStates().
+  // Any edit clears it.
+
+  bool highlightStatesReady() const;
+
+  void setHighlightStatesReady(bool ready);
+
+signals:
+
+  void UndoMemoryChanged(qint64 bytes);
+
+private slots:
+
+  void TrackUndoMemory(int position, int chars_removed, int chars_added);
+
+  void TrimUndoHistory();
+
+private:
+
+  qint64 m_UndoBudget;
+
+  bool m_CompressUndoHistory;
+
+  // Estimated bytes of the native undo and redo stacks
+  qint64 m_UndoBytes;
+
+  // The text, compressed, at the bottom of the native undo stack
+  // since the last trim
+  QByteArray m_UndoBase;
+
+  // Oldest first, the text at each earlier trim
+  QList<QByteArray> m_UndoCheckpoints;
+
+  bool m_TrimPending;
+
+  bool m_RestoringCheckpoint;
+
+  bool m_HighlightStatesReady;
+
 };
 
 #endif
@@ -0,0 +1,115 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <QtCore/QTextCodec>
+#include <QtCore/QTextDecoder>
+
+#include "Misc/HTMLEncodingResolver.h"
+#include "Misc/TextFileStream.h"
+#include "Misc/Utility.h"
+#include "sigil_exception.h"
+
+static const qint64 CHUNK_SIZE = 1024 * 1024;
+
+static const int MIB_UTF8 = 106;
+
+
+TextFileStream::TextFileStream(const QString &fullfilepath, bool html)
+    :
+    m_File(fullfilepath),
+    m_EntityNbsp(false),
+    m_PendingCR(false)
+{
+    if (!m_File.open(QFile::ReadOnly)) {
+        std::string msg = fullfilepath.toStdString() + ": " + m_File.errorString().toStdString();
+        throw (CannotOpenFile(msg));
+    }
+
+    m_Head = m_File.read(CHUNK_SIZE);
+    const QTextCodec *codec;
+
+    if (html) {
+        codec = HTMLEncodingResolver::GetCodecForHTML(m_Head);
+        // The check stops short of a character the read may have cut in two
+        int whole = m_Head.size();
+
+        while (whole > 0 && static_cast<unsigned char>(m_Head.at(whole - 1)) >= 0x80) {
+            whole--;
+        }
+
+        m_EntityNbsp = codec->mibEnum() == MIB_UTF8 && HTMLEncodingResolver::IsValidUtf8(m_Head.left(whole));
+    } else {
+        // Input should be UTF-8; a BOM switches it to UTF-16 or UTF-32
+        codec = QTextCodec::codecForUtfText(m_Head, QTextCodec::codecForName("UTF-8"));
+    }
+
+    m_Decoder.reset(codec->makeDecoder());
+}
+
+
+TextFileStream::~TextFileStream()
+{
+}
+
+
+bool TextFileStream::AtEnd() const
+{
+    return m_Head.isEmpty() && m_File.atEnd();
+}
+
+
+QString TextFileStream::ReadChunk()
+{
+    QByteArray data;
+
+    if (!m_Head.isEmpty()) {
+        data = m_Head;
+        m_Head.clear();
+    } else {
+        data = m_File.read(CHUNK_SIZE);
+    }
+
+    QString text = m_Decoder->toUnicode(data);
+
+    if (m_PendingCR) {
+        text.prepend(QChar(0x0D));
+        m_PendingCR = false;
+    }
+
+    if (!m_File.atEnd() && text.endsWith(QChar(0x0D))) {
+        text.chop(1);
+        m_PendingCR = true;
+    }
+
+    text = Utility::ConvertLineEndings(text);
+
+    if (m_EntityNbsp) {
+        text.replace(QChar(0xA0), "&#160;");
+    }
+
+    return text;
+}
+
+
+qint64 TextFileStream::Size() const
+{
+    return m_File.size();
+}
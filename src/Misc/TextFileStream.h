@@ -0,0 +1,79 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef TEXTFILESTREAM_H
+#define TEXTFILESTREAM_H
+
+#include <QtCore/QFile>
+#include <QtCore/QScopedPointer>
+#include <QtCore/QString>
+
+class QTextDecoder;
+
+/**
+ * Reads a text file a chunk at a time, for files too large to hold
+ * whole in memory more than once.
+ *
+ * The encoding is detected from the start of the file: for HTML the
+ * way HTMLEncodingResolver::ReadHTMLFile does, otherwise the way
+ * Utility::ReadUnicodeTextFile does. The chunks have their line
+ * endings converted, and a character split across two reads is
+ * returned whole with the second.
+ */
+class TextFileStream
+{
+
+public:
+
+    /**
+     * Opens the file.
+     *
+     * @throws CannotOpenFile if the file cannot be opened.
+     */
+    TextFileStream(const QString &fullfilepath, bool html);
+    ~TextFileStream();
+
+    bool AtEnd() const;
+
+    /**
+     * @return The next piece of the text, or an empty string at the end.
+     */
+    QString ReadChunk();
+
+    qint64 Size() const;
+
+private:
+
+    QFile m_File;
+    QScopedPointer<QTextDecoder> m_Decoder;
+
+    // The first chunk, read to detect the encoding from
+    QByteArray m_Head;
+
+    // Only for UTF-8 HTML, as ReadHTMLFile does
+    bool m_EntityNbsp;
+
+    // A CR that ended the last chunk; it may be half of a CRLF
+    bool m_PendingCR;
+};
+
+#endif // TEXTFILESTREAM_H
@@ -0,0 +1,172 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtConcurrent/QtConcurrent>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QFutureWatcher>
+
+#include "Misc/RasterizeImageResource.h"
+#include "Misc/ThumbnailService.h"
+#include "Misc/Utility.h"
+
+// The most thumbnail pixels kept in memory, in bytes
+static const int MEMORY_CACHE_BYTES = 64 * 1024 * 1024;
+
+ThumbnailService *ThumbnailService::m_instance = 0;
+
+ThumbnailService *ThumbnailService::instance()
+{
+    if (m_instance == 0) {
+        m_instance = new ThumbnailService();
+    }
+
+    return m_instance;
+}
+
+
+ThumbnailService::ThumbnailService()
+    :
+    m_Thumbnails(MEMORY_CACHE_BYTES),
+    m_Rasterizer(NULL)
+{
+    QDir().mkpath(Utility::DefinePrefsDir() + "/thumbnails");
+}
+
+
+bool ThumbnailService::Request(const QString &path, int max_side, QImage &thumbnail)
+{
+    const QString key = Key(path, max_side);
+    QImage *cached = m_Thumbnails.object(key);
+
+    if (cached) {
+        thumbnail = *cached;
+        return true;
+    }
+
+    if (!m_Pending.contains(key)) {
+        m_Pending.insert(key);
+        Job job;
+        job.path = path;
+        job.max_side = max_side;
+        job.key = key;
+        job.cache_path = DiskCachePath(key);
+        QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>(this);
+        connect(watcher, SIGNAL(finished()), this, SLOT(JobFinished()));
+        watcher->setFuture(QtConcurrent::run(MakeThumbnail, job));
+    }
+
+    return false;
+}
+
+
+void ThumbnailService::JobFinished()
+{
+    QFutureWatcher<Result> *watcher = static_cast<QFutureWatcher<Result> *>(sender());
+    Result result = watcher->result();
+    watcher->deleteLater();
+    m_Pending.remove(result.job.key);
+
+    // SVGs beyond what QSvgRenderer draws need WebKit, on this thread
+    if (result.thumbnail.isNull() && result.job.path.endsWith(".svg", Qt::CaseInsensitive)) {
+        if (!m_Rasterizer) {
+            m_Rasterizer = new RasterizeImageResource();
+        }
+
+        result.thumbnail = m_Rasterizer->Thumbnail(result.job.path, result.job.max_side);
+
+        if (!result.thumbnail.isNull()) {
+            result.thumbnail.save(result.job.cache_path, "PNG");
+        }
+    }
+
+    Keep(result.job.key, result.thumbnail);
+    emit ThumbnailReady(result.job.path, result.job.max_side, result.thumbnail);
+}
+
+
+ThumbnailService::Result ThumbnailService::MakeThumbnail(const Job &job)
+{
+    Result result;
+    result.job = job;
+    if (result.thumbnail.load(job.cache_path, "PNG")) {
+        return result;
+    }
+
+    // Also null for the SVGs that need WebKit
+    result.thumbnail = RasterizeImageResource::RenderThumbnail(job.path, job.max_side);
+
+    if (!result.thumbnail.isNull()) {
+        result.thumbnail.save(job.cache_path, "PNG");
+    }
+
+    return result;
+}
+
+
+QString ThumbnailService::DiskCacheFile(const QString &path, int max_side) const
+{
+    const QString cache_path = DiskCachePath(Key(path, max_side));
+    return QFileInfo(cache_path).exists() ? cache_path : QString();
+}
+
+
+qint64 ThumbnailService::MemoryUsage() const
+{
+    return m_Thumbnails.totalCost();
+}
+
+
+void ThumbnailService::ClearMemoryCache()
+{
+    m_Thumbnails.clear();
+}
+
+
+QString ThumbnailService::Key(const QString &path, int max_side)
+{
+    // A file changed on disk gets a new key; its old thumbnail is never read again
+    QFileInfo info(path);
+    return info.absoluteFilePath() + "|" +
+           QString::number(info.lastModified().toMSecsSinceEpoch()) + "|" +
+           QString::number(info.size()) + "|" +
+           QString::number(max_side);
+}
+
+
+QString ThumbnailService::DiskCachePath(const QString &key)
+{
+    QByteArray hash = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return Utility::DefinePrefsDir() + "/thumbnails/" + QString::fromLatin1(hash) + ".png";
+}
+
+
+void ThumbnailService::Keep(const QString &key, const QImage &thumbnail)
+{
+    if (thumbnail.isNull()) {
+        return;
+    }
+
+    m_Thumbnails.insert(key, new QImage(thumbnail), qMax(thumbnail.byteCount(), 1));
+}
@@ -0,0 +1,128 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef THUMBNAILSERVICE_H
+#define THUMBNAILSERVICE_H
+
+#include <QtCore/QCache>
+#include <QtCore/QObject>
+#include <QtCore/QSet>
+#include <QtCore/QString>
+#include <QtGui/QImage>
+
+class RasterizeImageResource;
+
+/**
+ * Makes thumbnails of image files without holding up the GUI thread.
+ *
+ * Thumbnails are decoded at their small size on the thread pool, and
+ * kept both in a memory cache and on disk, keyed by the file's path,
+ * modification time and size, so reopening a report on the same book
+ * costs almost nothing.
+ */
+class ThumbnailService : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ThumbnailService *instance();
+
+    /**
+     * Gets the thumbnail of the file at path, scaled down to fit in
+     * max_side x max_side.
+     *
+     * @param thumbnail Set to the thumbnail when it is already in memory.
+     * @return true if thumbnail was set. Otherwise it is being made and
+     *         ThumbnailReady is emitted once it is.
+     */
+    bool Request(const QString &path, int max_side, QImage &thumbnail);
+
+    /**
+     * @return The PNG file the thumbnail of path at max_side is kept in,
+     *         or an empty string if it has not been made yet.
+     */
+    QString DiskCacheFile(const QString &path, int max_side) const;
+
+    /**
+     * @return The size of the thumbnails held in memory, in bytes.
+     */
+    qint64 MemoryUsage() const;
+
+    /**
+     * Drops the thumbnails held in memory; the disk cache is kept.
+     */
+    void ClearMemoryCache();
+
+signals:
+    /**
+     * Emitted for every Request that could not be answered at once.
+     * thumbnail is null if the file could not be read.
+     */
+    void ThumbnailReady(const QString &path, int max_side, const QImage &thumbnail);
+
+private slots:
+    void JobFinished();
+
+private:
+    ThumbnailService();
+
+    struct Job {
+        QString path;
+        int max_side;
+        QString key;
+        QString cache_path;
+    };
+
+    struct Result {
+        Job job;
+        QImage thumbnail;
+    };
+
+    /**
+     * Reads the thumbnail from the disk cache, or makes it and
+     * adds it there. Run on the thread pool.
+     */
+    static Result MakeThumbnail(const Job &job);
+
+    static QString Key(const QString &path, int max_side);
+
+    static QString DiskCachePath(const QString &key);
+
+    void Keep(const QString &key, const QImage &thumbnail);
+
+    /**
+     * Keyed by Key(), with the size in bytes of each thumbnail as its cost.
+     */
+    QCache<QString, QImage> m_Thumbnails;
+
+    QSet<QString> m_Pending;
+
+    /**
+     * Only made for the SVGs that need WebKit.
+     */
+    RasterizeImageResource *m_Rasterizer;
+
+    static ThumbnailService *m_instance;
+};
+
+#endif // THUMBNAILSERVICE_H
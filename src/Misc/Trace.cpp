@@ -0,0 +1,246 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <algorithm>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVector>
+
+#include "Misc/Trace.h"
+
+#ifdef SIGIL_TRACING
+
+// About a minute of busy work on one thread
+static const int EVENTS_PER_THREAD = 16384;
+
+namespace
+{
+struct TraceEvent {
+    const char *name;
+    // 'X' for an operation, 'C' for a counter
+    char phase;
+    qint64 start;
+    // The duration of an operation, the value of a counter
+    qint64 value;
+    quintptr thread;
+};
+
+struct ThreadBuffer {
+    // Only taken by the thread itself and by WriteChromeTrace()
+    QMutex mutex;
+    QVector<TraceEvent> events;
+    int next;
+    bool full;
+};
+
+// Hands the buffer back when its thread ends, so the threads the pools
+// keep starting and stopping share a few buffers
+struct BufferLease {
+    ThreadBuffer *buffer;
+    ~BufferLease();
+};
+}
+
+static QElapsedTimer StartClock()
+{
+    QElapsedTimer clock;
+    clock.start();
+    return clock;
+}
+
+static const QElapsedTimer s_Clock = StartClock();
+static QMutex s_BuffersMutex;
+static QList<ThreadBuffer *> s_Buffers;
+static QList<ThreadBuffer *> s_FreeBuffers;
+static QThreadStorage<BufferLease *> s_Leases;
+
+
+BufferLease::~BufferLease()
+{
+    QMutexLocker locker(&s_BuffersMutex);
+    s_FreeBuffers.append(buffer);
+}
+
+
+static ThreadBuffer *CurrentBuffer()
+{
+    if (!s_Leases.hasLocalData()) {
+        QMutexLocker locker(&s_BuffersMutex);
+        ThreadBuffer *buffer;
+
+        if (!s_FreeBuffers.isEmpty()) {
+            buffer = s_FreeBuffers.takeLast();
+        } else {
+            buffer = new ThreadBuffer();
+            buffer->events.resize(EVENTS_PER_THREAD);
+            buffer->next = 0;
+            buffer->full = false;
+            s_Buffers.append(buffer);
+        }
+
+        BufferLease *lease = new BufferLease();
+        lease->buffer = buffer;
+        s_Leases.setLocalData(lease);
+    }
+
+    return s_Leases.localData()->buffer;
+}
+
+
+static void Record(const char *name, char phase, qint64 start, qint64 value)
+{
+    ThreadBuffer *buffer = CurrentBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    TraceEvent &event = buffer->events[buffer->next];
+    event.name = name;
+    event.phase = phase;
+    event.start = start;
+    event.value = value;
+    event.thread = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    buffer->next = (buffer->next + 1) % EVENTS_PER_THREAD;
+    buffer->full = buffer->full || buffer->next == 0;
+}
+
+
+static bool StartsBefore(const TraceEvent &first, const TraceEvent &second)
+{
+    return first.start < second.start;
+}
+
+#endif // SIGIL_TRACING
+
+
+bool Trace::IsEnabled()
+{
+#ifdef SIGIL_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+qint64 Trace::Now()
+{
+#ifdef SIGIL_TRACING
+    return s_Clock.nsecsElapsed() / 1000;
+#else
+    return 0;
+#endif
+}
+
+
+void Trace::Complete(const char *name, qint64 start)
+{
+#ifdef SIGIL_TRACING
+    Record(name, 'X', start, Now() - start);
+#else
+    Q_UNUSED(name)
+    Q_UNUSED(start)
+#endif
+}
+
+
+void Trace::Counter(const char *name, qint64 value)
+{
+#ifdef SIGIL_TRACING
+    Record(name, 'C', Now(), value);
+#else
+    Q_UNUSED(name)
+    Q_UNUSED(value)
+#endif
+}
+
+
+bool Trace::WriteChromeTrace(const QString &path, int seconds)
+{
+#ifdef SIGIL_TRACING
+    const qint64 cutoff = Now() - qint64(seconds) * 1000000;
+    QList<TraceEvent> events;
+    {
+        QMutexLocker locker(&s_BuffersMutex);
+        foreach(ThreadBuffer * buffer, s_Buffers) {
+            QMutexLocker buffer_locker(&buffer->mutex);
+            int count = buffer->full ? EVENTS_PER_THREAD : buffer->next;
+            for (int i = 0; i < count; ++i) {
+                const TraceEvent &event = buffer->events.at(i);
+                qint64 end = event.phase == 'X' ? event.start + event.value : event.start;
+                if (end >= cutoff) {
+                    events.append(event);
+                }
+            }
+        }
+    }
+    std::sort(events.begin(), events.end(), StartsBefore);
+
+    QJsonArray trace_events;
+    // Called from a menu, so this is the GUI thread
+    QJsonObject thread_name;
+    thread_name["name"] = QString("thread_name");
+    thread_name["ph"] = QString("M");
+    thread_name["pid"] = 1;
+    thread_name["tid"] = double(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+    QJsonObject thread_args;
+    thread_args["name"] = QString("GUI");
+    thread_name["args"] = thread_args;
+    trace_events.append(thread_name);
+
+    foreach(TraceEvent event, events) {
+        QJsonObject trace_event;
+        trace_event["name"] = QString::fromLatin1(event.name);
+        trace_event["ph"] = QString(QChar(event.phase));
+        trace_event["ts"] = double(event.start);
+        trace_event["pid"] = 1;
+        trace_event["tid"] = double(event.thread);
+        if (event.phase == 'X') {
+            trace_event["dur"] = double(event.value);
+        } else {
+            QJsonObject args;
+            args["value"] = double(event.value);
+            trace_event["args"] = args;
+        }
+        trace_events.append(trace_event);
+    }
+
+    QJsonObject trace;
+    trace["traceEvents"] = trace_events;
+    trace["displayTimeUnit"] = QString("ms");
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    const QByteArray json = QJsonDocument(trace).toJson(QJsonDocument::Compact);
+    return file.write(json) == json.size();
+#else
+    Q_UNUSED(path)
+    Q_UNUSED(seconds)
+    return false;
+#endif
+}
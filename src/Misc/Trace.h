@@ -0,0 +1,87 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtCore/QString>
+
+/**
+ * Always-on timing of the slow operations, for attaching to a report.
+ *
+ * SIGIL_TRACE_SCOPE times the rest of the enclosing scope and
+ * SIGIL_TRACE_COUNTER records a value. Each thread keeps its last
+ * events in a ring buffer of its own, so recording takes no lock
+ * anyone else waits on. WriteChromeTrace() writes the events of the
+ * last seconds of every thread as Chrome trace JSON, which both
+ * chrome://tracing and Perfetto open.
+ *
+ * Names must be string literals; only the pointer is kept. Building
+ * with -DSIGIL_TRACING=0 compiles the macros away.
+ */
+class Trace
+{
+public:
+
+    static bool IsEnabled();
+
+    /**
+     * @return Microseconds on the trace clock.
+     */
+    static qint64 Now();
+
+    /**
+     * Records an operation that started at start, for operations
+     * that do not end in the scope they start in.
+     */
+    static void Complete(const char *name, qint64 start);
+
+    static void Counter(const char *name, qint64 value);
+
+    /**
+     * @return true if the trace was written.
+     */
+    static bool WriteChromeTrace(const QString &path, int seconds);
+
+    class Scope
+    {
+    public:
+        Scope(const char *name) : m_Name(name), m_Start(Now()) {}
+        ~Scope() { Complete(m_Name, m_Start); }
+
+    private:
+        const char *m_Name;
+        qint64 m_Start;
+    };
+};
+
+#ifdef SIGIL_TRACING
+#define SIGIL_TRACE_JOIN2(a, b) a##b
+#define SIGIL_TRACE_JOIN(a, b) SIGIL_TRACE_JOIN2(a, b)
+#define SIGIL_TRACE_SCOPE(name) Trace::Scope SIGIL_TRACE_JOIN(trace_scope_, __LINE__)(name)
+#define SIGIL_TRACE_COUNTER(name, value) Trace::Counter(name, value)
+#else
+#define SIGIL_TRACE_SCOPE(name)
+#define SIGIL_TRACE_COUNTER(name, value)
+#endif
+
+#endif // TRACE_H
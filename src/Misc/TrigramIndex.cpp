@@ -0,0 +1,254 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <algorithm>
+
+#include <QtCore/QRegExp>
+
+#include "Misc/TrigramIndex.h"
+
+// Literals shorter than a trigram tell us nothing
+static const int TRIGRAM_LENGTH = 3;
+
+static const QString QUANTIFIERS = "?*{";
+
+// Outside a character class
+static const QString REGEX_METACHARACTERS = "^$.)+?*";
+
+// What may follow an escape like \x, \p or \g as its argument
+static const QString ESCAPE_ARGUMENT_CHARACTERS = "{}<>'_,=-";
+
+
+static inline bool IsAsciiAlphanumeric(QChar c)
+{
+    return c.unicode() < 128 && c.isLetterOrNumber();
+}
+
+
+static inline quint64 Fold(QChar c)
+{
+    return c.toCaseFolded().unicode();
+}
+
+
+static void AppendTrigrams(const QString &text, TrigramIndex::Trigrams &trigrams)
+{
+    const QChar *chars = text.constData();
+
+    for (int i = 0; i + TRIGRAM_LENGTH <= text.length(); ++i) {
+        trigrams.append((Fold(chars[i]) << 32) | (Fold(chars[i + 1]) << 16) | Fold(chars[i + 2]));
+    }
+}
+
+
+static void SortUnique(TrigramIndex::Trigrams &trigrams)
+{
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    trigrams.squeeze();
+}
+
+
+// A run of literal characters only counts once it is long enough
+static void EndRun(QString &run, QStringList &literals)
+{
+    if (run.length() >= TRIGRAM_LENGTH) {
+        literals.append(run);
+    }
+
+    run.clear();
+}
+
+
+// Returns the position after the group or class that starts at pos,
+// or -1 if it never ends.
+static int SkipBracketed(const QString &pattern, int pos)
+{
+    int depth = 0;
+    bool in_class = false;
+
+    while (pos < pattern.length()) {
+        QChar c = pattern.at(pos);
+
+        if (c == QChar('\\')) {
+            pos += 2;
+            continue;
+        }
+
+        if (in_class) {
+            // A ] straight after the [ or [^ is part of the class
+            if (c == QChar(']') && pattern.at(pos - 1) != QChar('[') &&
+                !(pattern.at(pos - 1) == QChar('^') && pattern.at(pos - 2) == QChar('['))) {
+                in_class = false;
+
+                if (depth == 0) {
+                    return pos + 1;
+                }
+            }
+        } else if (c == QChar('[')) {
+            in_class = true;
+        } else if (c == QChar('(')) {
+            depth++;
+        } else if (c == QChar(')')) {
+            depth--;
+
+            if (depth == 0) {
+                return pos + 1;
+            }
+        }
+
+        pos++;
+    }
+
+    return -1;
+}
+
+
+TrigramIndex::Trigrams TrigramIndex::Extract(const QString &text)
+{
+    Trigrams trigrams;
+    trigrams.reserve(text.length());
+    AppendTrigrams(text, trigrams);
+    SortUnique(trigrams);
+    return trigrams;
+}
+
+
+TrigramIndex::Trigrams TrigramIndex::Extract(const QStringList &literals)
+{
+    Trigrams trigrams;
+    foreach(QString literal, literals) {
+        AppendTrigrams(literal, trigrams);
+    }
+    SortUnique(trigrams);
+    return trigrams;
+}
+
+
+bool TrigramIndex::MayContain(const Trigrams &text_trigrams, const Trigrams &required)
+{
+    foreach(quint64 trigram, required) {
+        if (!std::binary_search(text_trigrams.constBegin(), text_trigrams.constEnd(), trigram)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+QStringList TrigramIndex::RequiredLiterals(const QString &pattern)
+{
+    QStringList literals;
+
+    // Extended mode changes what every character means
+    if (pattern.contains(QRegExp("\\(\\?[a-zA-Z-]*x"))) {
+        return literals;
+    }
+
+    QString run;
+    int pos = 0;
+
+    while (pos < pattern.length()) {
+        QChar c = pattern.at(pos);
+        int next = pos + 1;
+        QChar literal;
+
+        if (c == QChar('(') || c == QChar('[')) {
+            EndRun(run, literals);
+            pos = SkipBracketed(pattern, pos);
+
+            if (pos == -1) {
+                return QStringList();
+            }
+
+            continue;
+        }
+
+        if (c == QChar('{')) {
+            // Skip the repeat count
+            EndRun(run, literals);
+            int end = pattern.indexOf(QChar('}'), pos);
+            pos = end == -1 ? next : end + 1;
+            continue;
+        }
+
+        if (c == QChar('|')) {
+            // Either side may match, so nothing is certain
+            return QStringList();
+        }
+
+        if (c == QChar('\\')) {
+            if (next == pattern.length()) {
+                return QStringList();
+            }
+
+            QChar escaped = pattern.at(next);
+            next++;
+
+            // \d, \w, \Q and the like are not themselves, and some
+            // take arguments, as in \x{263A}. Everything that may be
+            // part of one is skipped.
+            if (IsAsciiAlphanumeric(escaped)) {
+                EndRun(run, literals);
+                pos = next;
+
+                while (pos < pattern.length() && (IsAsciiAlphanumeric(pattern.at(pos)) ||
+                                                  ESCAPE_ARGUMENT_CHARACTERS.contains(pattern.at(pos)))) {
+                    pos++;
+                }
+
+                continue;
+            }
+
+            // Caseless matching of characters beyond the BMP is not
+            // a matter of folding single code units
+            if (escaped.isSurrogate()) {
+                EndRun(run, literals);
+                pos = next;
+                continue;
+            }
+
+            literal = escaped;
+        } else if (REGEX_METACHARACTERS.contains(c) || c.isSurrogate()) {
+            EndRun(run, literals);
+            pos = next;
+            continue;
+        } else {
+            literal = c;
+        }
+
+        // A character that may be left out, or repeated, is not part of the run
+        if (next < pattern.length() && QUANTIFIERS.contains(pattern.at(next))) {
+            EndRun(run, literals);
+        } else if (next < pattern.length() && pattern.at(next) == QChar('+')) {
+            run.append(literal);
+            EndRun(run, literals);
+        } else {
+            run.append(literal);
+        }
+
+        pos = next;
+    }
+
+    EndRun(run, literals);
+    return literals;
+}
@@ -0,0 +1,71 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef TRIGRAMINDEX_H
+#define TRIGRAMINDEX_H
+
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+/**
+ * The trigrams, runs of three characters, that occur in a text.
+ *
+ * A text can only match a search if it has every trigram of the
+ * literals the search requires, so comparing trigrams rules files out
+ * without running the regex on them. Characters are case folded, which
+ * makes that hold for caseless searches as well.
+ */
+class TrigramIndex
+{
+public:
+
+    /**
+     * Sorted, without duplicates. Three UTF-16 code units per entry.
+     */
+    typedef QVector<quint64> Trigrams;
+
+    static Trigrams Extract(const QString &text);
+
+    /**
+     * @return All the trigrams of all the literals.
+     */
+    static Trigrams Extract(const QStringList &literals);
+
+    /**
+     * @return false if text_trigrams lack any of the required ones.
+     */
+    static bool MayContain(const Trigrams &text_trigrams, const Trigrams &required);
+
+    /**
+     * Works out the fixed strings every match of a regex has to contain.
+     * Only what is certain is returned: groups, classes, optional
+     * characters and everything in a pattern with an alternative at the
+     * top level are left out, so the list may well be empty.
+     *
+     * @param pattern A pattern as SPCRE compiles it.
+     */
+    static QStringList RequiredLiterals(const QString &pattern);
+};
+
+#endif // TRIGRAMINDEX_H
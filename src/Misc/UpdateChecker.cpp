@@ -19,11 +19,14 @@
 **
 *************************************************************************/
 
-#include "Misc/EmbeddedPython.h"
-
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
+#include <QtCore/QTimer>
+#include <QtCore/QXmlStreamReader>
 #include <QtGui/QDesktopServices>
+#include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QNetworkReply>
+#include <QtNetwork/QNetworkRequest>
 #include <QtWidgets/QMessageBox>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
@@ -43,14 +46,29 @@ static const QString SETTINGS_GROUP          = "updatechecker";
 // Delta is six hours
 static const int SECONDS_BETWEEN_CHECKS      = 60 * 60 * 6 ;
 
+// Long enough after launch for the first window and anything
+// opened with it to be up
+static const int START_DELAY_MSECS           = 30 * 1000;
+
+// A check that has not finished by then is given up on
+static const int REQUEST_TIMEOUT_MSECS       = 5 * 1000;
+
 
 UpdateChecker::UpdateChecker(QObject *parent)
     :
-    QObject(parent)
+    QObject(parent),
+    m_NetworkManager(NULL),
+    m_Reply(NULL),
+    m_Timeout(NULL)
 {
 }
 
 void UpdateChecker::CheckForUpdate()
+{
+    QTimer::singleShot(START_DELAY_MSECS, this, SLOT(SendRequest()));
+}
+
+void UpdateChecker::SendRequest()
 {
     SettingsStore settings;
     settings.beginGroup(SETTINGS_GROUP);
@@ -58,58 +76,100 @@ void UpdateChecker::CheckForUpdate()
     // The default time is one always longer than the check interval
     QDateTime default_time    = QDateTime::currentDateTime().addSecs(- SECONDS_BETWEEN_CHECKS - 1);
     QDateTime last_check_time = settings.value(LAST_CHECK_TIME_KEY, default_time).toDateTime();
-    QString last_online_version    = settings.value(LAST_ONLINE_VERSION_KEY, QString()).toString();
 
     // We want to check for a new version
     // no sooner than every six hours
-    if (last_check_time.secsTo(QDateTime::currentDateTime()) > SECONDS_BETWEEN_CHECKS) {
-        settings.setValue(LAST_CHECK_TIME_KEY, QDateTime::currentDateTime());
-
-        int rv = 0;
-        QString error_traceback;
-        QList<QVariant> args;
-        args.append(QVariant(UPDATE_XML_LOCATION));
-
-        EmbeddedPython * epython  = EmbeddedPython::instance();
-        QVariant res = epython->runInPython( QString("updatechecker"),
-                                         QString("check_for_updates"),
-                                         args,
-                                         &rv,
-                                         error_traceback);    
-        if (rv != 0) {
-             qDebug() << QString("error in updatechecker check_for_updates: ") + QString::number(rv) + error_traceback;
-            return;
-        }
+    if (last_check_time.secsTo(QDateTime::currentDateTime()) <= SECONDS_BETWEEN_CHECKS) {
+        deleteLater();
+        return;
+    }
 
-        QString current_online_version = res.toString();
+    settings.setValue(LAST_CHECK_TIME_KEY, QDateTime::currentDateTime());
+    settings.endGroup();
+
+    QNetworkRequest request = QNetworkRequest(QUrl(UPDATE_XML_LOCATION));
+#if QT_VERSION >= 0x050600
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+#endif
+    m_NetworkManager = new QNetworkAccessManager(this);
+    m_Reply = m_NetworkManager->get(request);
+    connect(m_Reply, SIGNAL(finished()), this, SLOT(ReplyReceived()));
+
+    m_Timeout = new QTimer(this);
+    m_Timeout->setSingleShot(true);
+    connect(m_Timeout, SIGNAL(timeout()), this, SLOT(RequestTimedOut()));
+    m_Timeout->start(REQUEST_TIMEOUT_MSECS);
+}
 
-        if (current_online_version.isEmpty()) {
-            return;
-        }
+void UpdateChecker::RequestTimedOut()
+{
+    if (m_Reply) {
+        // Finishes the reply with an error
+        m_Reply->abort();
+    }
+}
+
+void UpdateChecker::ReplyReceived()
+{
+    m_Timeout->stop();
+    QNetworkReply *reply = m_Reply;
+    m_Reply = NULL;
+    reply->deleteLater();
+    deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "update check failed:" << reply->errorString();
+        return;
+    }
+
+    QString current_online_version = ParseOnlineVersion(reply->readAll());
+
+    if (current_online_version.isEmpty()) {
+        return;
+    }
 
-        bool is_newer = IsOnlineVersionNewer(SIGIL_VERSION, current_online_version);
-        // The message box is displayed only if the online version is newer
-        // and only if the user hasn't been informed about this release before
-        if (is_newer && (current_online_version != last_online_version)) {
-            QMessageBox::StandardButton button_clicked;
-            button_clicked = QMessageBox::question(
-                                 0,
-                                 QObject::tr("Sigil"),
-                                 QObject::tr("<p>A newer version of Sigil is available, version <b>%1</b>.<br/>"
-                                             "<p>Would you like to go to the download page?</p>")
-                                 .arg(current_online_version),
-                                 QMessageBox::Yes | QMessageBox::No,
-                                 QMessageBox::Yes);
-
-            if (button_clicked == QMessageBox::Yes) {
-                QDesktopServices::openUrl(QUrl(DOWNLOAD_PAGE_LOCATION));
-            }
+    SettingsStore settings;
+    settings.beginGroup(SETTINGS_GROUP);
+    QString last_online_version = settings.value(LAST_ONLINE_VERSION_KEY, QString()).toString();
+
+    bool is_newer = IsOnlineVersionNewer(SIGIL_VERSION, current_online_version);
+    // The message box is displayed only if the online version is newer
+    // and only if the user hasn't been informed about this release before
+    if (is_newer && (current_online_version != last_online_version)) {
+        QMessageBox::StandardButton button_clicked;
+        button_clicked = QMessageBox::question(
+                             0,
+                             QObject::tr("Sigil"),
+                             QObject::tr("<p>A newer version of Sigil is available, version <b>%1</b>.<br/>"
+                                         "<p>Would you like to go to the download page?</p>")
+                             .arg(current_online_version),
+                             QMessageBox::Yes | QMessageBox::No,
+                             QMessageBox::Yes);
+
+        if (button_clicked == QMessageBox::Yes) {
+            QDesktopServices::openUrl(QUrl(DOWNLOAD_PAGE_LOCATION));
         }
+    }
 
-        // Store the current online version as the last one checked
-        settings.setValue(LAST_ONLINE_VERSION_KEY, current_online_version);
-        settings.endGroup();
+    // Store the current online version as the last one checked
+    settings.setValue(LAST_ONLINE_VERSION_KEY, current_online_version);
+    settings.endGroup();
+}
+
+
+QString UpdateChecker::ParseOnlineVersion(const QByteArray &data)
+{
+    QXmlStreamReader reader(data);
+
+    while (!reader.atEnd()) {
+        reader.readNext();
+
+        if (reader.isStartElement() && reader.name() == "current-version") {
+            return reader.readElementText().trimmed();
+        }
     }
+
+    return QString();
 }
 
 
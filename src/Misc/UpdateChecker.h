@@ -25,19 +25,27 @@
 
 #include <QtCore/QObject>
 
+class QNetworkAccessManager;
+class QNetworkReply;
+class QTimer;
+
 /**
  * Responsible for checking the current online version of
  * Sigil against the running one. If a newer version
  * exists, then a dialog is displayed informing the user
  * about it.
  *
+ * The check starts well after launch and the request runs on the
+ * event loop with a short timeout, so a slow or blocked network
+ * never holds up startup or anything else.
+ *
  * Objects of this class should ALWAYS be created on the heap
  * and never explicitly deleted. The reason is that these objects
  * receive replies asynchronously from the web and need to persist.
  * Upon receiving and processing the network reply, the object
  * schedules its own deletion.
  */
-class UpdateChecker : QObject
+class UpdateChecker : public QObject
 {
     Q_OBJECT
 
@@ -51,14 +59,38 @@ public:
     UpdateChecker(QObject *parent);
 
     /**
-     * Sends a request for the online version
+     * Schedules a request for the online version, sent
+     * once the program has been running for a while,
      * if the last check was performed
      * a SECONDS_BETWEEN_CHECKS amount of time ago.
      */
     void CheckForUpdate();
 
+private slots:
+
+    /**
+     * Sends the request for the online version if it is time for one.
+     */
+    void SendRequest();
+
+    /**
+     * Reads the online version from the reply and
+     * tells the user if it is newer.
+     */
+    void ReplyReceived();
+
+    /**
+     * Gives up on a request that is taking too long.
+     */
+    void RequestTimedOut();
+
 private:
 
+    /**
+     * @return The version in the version XML, or an empty string.
+     */
+    static QString ParseOnlineVersion(const QByteArray &data);
+
     /**
      * Compares the two provided version strings.
      *
@@ -70,6 +102,9 @@ private:
     static bool IsOnlineVersionNewer(const QString &current_version_string,
                                      const QString &online_version_string);
 
+    QNetworkAccessManager *m_NetworkManager;
+    QNetworkReply *m_Reply;
+    QTimer *m_Timeout;
 };
 
 #endif // UPDATECHECKER_H
@@ -32,14 +32,23 @@
 #include <time.h>
 #include <string>
 
+#if defined(Q_OS_MAC)
+#include <mach/mach.h>
+#elif !defined(_WIN32)
+#include <unistd.h>
+#endif
+
 #include <QApplication>
 #include <QtCore/QDir>
+#include <QtCore/QDirIterator>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QProcess>
+#include <QtCore/QSet>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QStringList>
 #include <QtCore/QStringRef>
+#include <QtCore/QTextCodec>
 #include <QtCore/QTextStream>
 #include <QtCore/QtGlobal>
 #include <QtCore/QUrl>
@@ -52,20 +61,25 @@
 #include <QFile>
 #include <QFileInfo>
 
+#if defined(Q_OS_LINUX)
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#elif defined(Q_OS_MAC)
+#include <sys/attr.h>
+#include <sys/clonefile.h>
+#endif
+
 #include "sigil_constants.h"
 #include "sigil_exception.h"
-#include "Misc/QCodePage437Codec.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/SleepFunctions.h"
+#include "Misc/ZipIndex.h"
 
-#ifndef MAX_PATH
-// Set Max length to 256 because that's the max path size on many systems.
-#define MAX_PATH 256
-#endif
-// This is the same read buffer size used by Java and Perl.
-#define BUFF_SIZE 8192
+// Files at least this large are mapped rather than read into a buffer
+static const qint64 MAP_FILE_THRESHOLD = 1024 * 1024;
 
-static QCodePage437Codec *cp437 = 0;
+static bool s_Headless = false;
 
 // Subclass QMessageBox for our StdWarningDialog to make any Details Resizable
 class SigilMessageBox: public QMessageBox
@@ -256,21 +270,14 @@ QString Utility::ReplaceFirst(const QString &before, const QString &after, const
 
 QStringList Utility::GetAbsolutePathsToFolderDescendantFiles(const QString &fullfolderpath)
 {
-    QDir folder(fullfolderpath);
     QStringList files;
-    foreach(QFileInfo file, folder.entryInfoList()) {
-        if ((file.fileName() != ".") && (file.fileName() != "..")) {
-            // If it's a file, add it to the list
-            if (file.isFile()) {
-                files.append(Utility::URLEncodePath(file.absoluteFilePath()));
-            }
-            // Else it's a directory, so
-            // we add all files from that dir
-            else {
-                files.append(GetAbsolutePathsToFolderDescendantFiles(file.absoluteFilePath()));
-            }
-        }
+    // One walk over the whole tree rather than a list per folder
+    QDirIterator it(fullfolderpath, QDir::Files, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+
+    while (it.hasNext()) {
+        files.append(Utility::URLEncodePath(it.next()));
     }
+
     return files;
 }
 
@@ -372,6 +379,34 @@ bool Utility::ForceCopyFile(const QString &fullinpath, const QString &fulloutpat
 }
 
 
+bool Utility::CloneFile(const QString &fullinpath, const QString &fulloutpath)
+{
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    int infile = ::open(QFile::encodeName(fullinpath).constData(), O_RDONLY);
+    if (infile != -1) {
+        int outfile = ::open(QFile::encodeName(fulloutpath).constData(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (outfile != -1) {
+            bool cloned = ::ioctl(outfile, FICLONE, infile) == 0;
+            ::close(outfile);
+            ::close(infile);
+            if (cloned) {
+                return true;
+            }
+            // Not supported here, e.g. ext4 or across file systems
+            QFile::remove(fulloutpath);
+        } else {
+            ::close(infile);
+        }
+    }
+#elif defined(Q_OS_MAC)
+    if (::clonefile(QFile::encodeName(fullinpath).constData(), QFile::encodeName(fulloutpath).constData(), 0) == 0) {
+        return true;
+    }
+#endif
+    return QFile::copy(fullinpath, fulloutpath);
+}
+
+
 bool Utility::RenameFile(const QString &oldfilepath, const QString &newfilepath)
 {
     // Make sure the path exists, otherwise very
@@ -456,13 +491,27 @@ QString Utility::ReadUnicodeTextFile(const QString &fullfilepath)
         throw(CannotOpenFile(msg));
     }
 
-    QTextStream in(&file);
-    // Input should be UTF-8
-    in.setCodec("UTF-8");
-    // This will automatically switch reading from
-    // UTF-8 to UTF-16 if a BOM is detected
-    in.setAutoDetectUnicode(true);
-    return ConvertLineEndings(in.readAll());
+    // Decoded straight from the mapped file when it is large,
+    // so the bytes are not copied into a buffer first
+    QByteArray data;
+    qint64 size = file.size();
+    uchar *mapped = size >= MAP_FILE_THRESHOLD ? file.map(0, size) : NULL;
+
+    if (mapped) {
+        data = QByteArray::fromRawData(reinterpret_cast<const char *>(mapped), size);
+    } else {
+        data = file.readAll();
+    }
+
+    // Input should be UTF-8; a BOM switches it to UTF-16 or UTF-32
+    QTextCodec *codec = QTextCodec::codecForUtfText(data, QTextCodec::codecForName("UTF-8"));
+    QString text = ConvertLineEndings(codec->toUnicode(data));
+
+    if (mapped) {
+        file.unmap(mapped);
+    }
+
+    return text;
 }
 
 
@@ -481,10 +530,8 @@ void Utility::WriteUnicodeTextFile(const QString &text, const QString &fullfilep
         throw(CannotOpenFile(msg));
     }
 
-    QTextStream out(&file);
-    // We ALWAYS output in UTF-8
-    out.setCodec("UTF-8");
-    out << text;
+    // We ALWAYS output in UTF-8, in a single write
+    file.write(text.toUtf8());
 }
 
 
@@ -492,8 +539,33 @@ void Utility::WriteUnicodeTextFile(const QString &text, const QString &fullfilep
 // line endings that are expected throughout the Qt framework
 QString Utility::ConvertLineEndings(const QString &text)
 {
+    int first_cr = text.indexOf(QChar(0x0D));
+
+    // Nothing to convert, so no copy either
+    if (first_cr == -1) {
+        return text;
+    }
+
+    // One pass over the text, compacting it in place
     QString newtext(text);
-    return newtext.replace("\x0D\x0A", "\x0A").replace("\x0D", "\x0A");
+    QChar *chars = newtext.data();
+    int length = newtext.length();
+    int out = first_cr;
+
+    for (int in = first_cr; in < length; ++in) {
+        if (chars[in].unicode() == 0x0D) {
+            chars[out++] = QChar(0x0A);
+
+            if (in + 1 < length && chars[in + 1].unicode() == 0x0A) {
+                ++in;
+            }
+        } else {
+            chars[out++] = chars[in];
+        }
+    }
+
+    newtext.truncate(out);
+    return newtext;
 }
 
 
@@ -536,8 +608,37 @@ QString Utility::URLDecodePath(const QString &path)
 }
 
 
+void Utility::SetHeadless(bool headless)
+{
+    s_Headless = headless;
+}
+
+
+bool Utility::IsHeadless()
+{
+    return s_Headless;
+}
+
+
+// Used in place of the dialogs when running headless
+static void PrintMessage(const QString &kind, const QString &message, const QString &detailed_text)
+{
+    QTextStream err(stderr);
+    err << kind << ": " << message << "\n";
+    if (!detailed_text.isEmpty()) {
+        err << detailed_text << "\n";
+    }
+    err.flush();
+}
+
+
 void Utility::DisplayExceptionErrorDialog(const QString &error_info)
 {
+    if (s_Headless) {
+        PrintMessage("Error", error_info, QString());
+        return;
+    }
+
     QMessageBox message_box(QApplication::activeWindow());
     message_box.setWindowFlags(Qt::Window | Qt::WindowStaysOnTopHint);
     message_box.setModal(true);
@@ -566,6 +667,11 @@ void Utility::DisplayExceptionErrorDialog(const QString &error_info)
 
 void Utility::DisplayStdErrorDialog(const QString &error_message, const QString &detailed_text)
 {
+    if (s_Headless) {
+        PrintMessage("Error", error_message, detailed_text);
+        return;
+    }
+
     QMessageBox message_box(QApplication::activeWindow());
     message_box.setWindowFlags(Qt::Window | Qt::WindowStaysOnTopHint);
     message_box.setModal(true);
@@ -584,6 +690,11 @@ void Utility::DisplayStdErrorDialog(const QString &error_message, const QString
 
 void Utility::DisplayStdWarningDialog(const QString &warning_message, const QString &detailed_text)
 {
+    if (s_Headless) {
+        PrintMessage("Warning", warning_message, detailed_text);
+        return;
+    }
+
     SigilMessageBox message_box(QApplication::activeWindow());
     message_box.setWindowFlags(Qt::Window | Qt::WindowStaysOnTopHint);
     message_box.setModal(true);
@@ -617,6 +728,43 @@ QString Utility::GetEnvironmentVar(const QString &variable_name)
 }
 
 
+// Returns the resident memory of this process in bytes, or -1
+// where it can not be read
+qint64 Utility::ProcessResidentBytes()
+{
+#if defined(Q_OS_MAC)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) != KERN_SUCCESS) {
+        return -1;
+    }
+
+    return info.resident_size;
+#elif defined(Q_OS_WIN32)
+    // Would need psapi
+    return -1;
+#else
+    // The second field is the resident set, in pages
+    QFile statm("/proc/self/statm");
+
+    if (!statm.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    bool ok = false;
+    qint64 pages = fields.value(1).toLongLong(&ok);
+
+    if (!ok) {
+        return -1;
+    }
+
+    return pages * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+
 // Returns the same number, but rounded to one decimal place
 float Utility::RoundToOneDecimal(float number)
 {
@@ -683,107 +831,50 @@ QString Utility::stdWStringToQString(const std::wstring &str)
 
 bool Utility::UnZip(const QString &zippath, const QString &destpath)
 {
-    int res = 0;
     QDir dir(destpath);
-    if (!cp437) {
-        cp437 = new QCodePage437Codec();
-    }
-#ifdef Q_OS_WIN32
-    zlib_filefunc64_def ffunc;
-    fill_win32_filefunc64W(&ffunc);
-    unzFile zfile = unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(zippath)).c_str(), &ffunc);
-#else
-    unzFile zfile = unzOpen64(QDir::toNativeSeparators(zippath).toUtf8().constData());
-#endif
+    unzFile zfile = ZipIndex::OpenZip(zippath);
 
-    if ((zfile == NULL) || (!IsFileReadable(zippath)) || (!dir.exists())) {
+    if ((zfile == NULL) || (!dir.exists())) {
+        if (zfile != NULL) {
+            unzClose(zfile);
+        }
         return false;
     }
 
-    res = unzGoToFirstFile(zfile);
-
-    if (res == UNZ_OK) {
-        do {
-            // Get the name of the file in the archive.
-            char file_name[MAX_PATH] = {0};
-            unz_file_info64 file_info;
-            unzGetCurrentFileInfo64(zfile, &file_info, file_name, MAX_PATH, NULL, 0, NULL, 0);
-            QString qfile_name;
-            QString cp437_file_name;
-            qfile_name = QString::fromUtf8(file_name);
-            if (!(file_info.flag & (1<<11))) {
-                // General purpose bit 11 says the filename is utf-8 encoded. If not set then
-                // IBM 437 encoding might be used.
-                cp437_file_name = cp437->toUnicode(file_name);
-            }
-
-            // If there is no file name then we can't do anything with it.
-            if (!qfile_name.isEmpty()) {
-                // We use the dir object to create the path in the temporary directory.
-                // Unfortunately, we need a dir ojbect to do this as it's not a static function.
-                // Full file path in the temporary directory.
-                QString file_path = destpath + "/" + qfile_name;
-                QFileInfo qfile_info(file_path);
-
-                // Is this entry a directory?
-                if (file_info.uncompressed_size == 0 && qfile_name.endsWith('/')) {
-                    dir.mkpath(qfile_name);
-                    continue;
-                } else {
-                    dir.mkpath(qfile_info.path());
-                }
-
-                // Open the file entry in the archive for reading.
-                if (unzOpenCurrentFile(zfile) != UNZ_OK) {
-                    unzClose(zfile);
-                    return false;
-                }
-
-                // Open the file on disk to write the entry in the archive to.
-                QFile entry(file_path);
+    ZipIndex index;
 
-                if (!entry.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    return false;
-                }
-
-                // Buffered reading and writing.
-                char buff[BUFF_SIZE] = {0};
-                int read = 0;
-
-                while ((read = unzReadCurrentFile(zfile, buff, BUFF_SIZE)) > 0) {
-                    entry.write(buff, read);
-                }
+    if (!index.Load(zfile)) {
+        unzClose(zfile);
+        return false;
+    }
 
-                entry.close();
+    QSet<QString> created_paths;
 
-                // Read errors are marked by a negative read amount.
-                if (read < 0) {
-                    unzCloseCurrentFile(zfile);
-                    unzClose(zfile);
-                    return false;
-                }
+    foreach(const ZipIndex::Entry &zentry, index.Entries()) {
+        // We use the dir object to create the path in the temporary directory.
+        // Unfortunately, we need a dir ojbect to do this as it's not a static function.
+        // Full file path in the temporary directory.
+        QString file_path = destpath + "/" + zentry.name;
+        QFileInfo qfile_info(file_path);
 
-                // The file was read but the CRC did not match.
-                // We don't check the read file size vs the uncompressed file size
-                // because if they're different there should be a CRC error.
-                if (unzCloseCurrentFile(zfile) == UNZ_CRCERROR) {
-                    unzClose(zfile);
-                    return false;
-                }
+        // Is this entry a directory?
+        if (zentry.IsDirectory()) {
+            dir.mkpath(zentry.name);
+            continue;
+        } else if (!created_paths.contains(qfile_info.path())) {
+            dir.mkpath(qfile_info.path());
+            created_paths.insert(qfile_info.path());
+        }
 
-                if (!cp437_file_name.isEmpty() && cp437_file_name != qfile_name) {
-                    QString cp437_file_path = destpath + "/" + cp437_file_name;
-                    QFile::copy(file_path, cp437_file_path);
-                }
-            }
-        } while ((res = unzGoToNextFile(zfile)) == UNZ_OK);
-    }
+        if (!ZipIndex::ExtractEntry(zfile, zentry.pos, file_path)) {
+            unzClose(zfile);
+            return false;
+        }
 
-    if (res != UNZ_END_OF_LIST_OF_FILE) {
-        unzClose(zfile);
-        return false;
+        if (!zentry.cp437_name.isEmpty()) {
+            QString cp437_file_path = destpath + "/" + zentry.cp437_name;
+            QFile::copy(file_path, cp437_file_path);
+        }
     }
 
     unzClose(zfile);
@@ -793,47 +884,12 @@ bool Utility::UnZip(const QString &zippath, const QString &destpath)
 QStringList Utility::ZipInspect(const QString &zippath)
 {
     QStringList filelist;
-    int res = 0;
+    ZipIndex index = ZipIndex::Cached(zippath);
 
-    if (!cp437) {
-        cp437 = new QCodePage437Codec();
+    foreach(const ZipIndex::Entry &zentry, index.Entries()) {
+        filelist.append(zentry.DisplayName());
     }
-#ifdef Q_OS_WIN32
-    zlib_filefunc64_def ffunc;
-    fill_win32_filefunc64W(&ffunc);
-    unzFile zfile = unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(zippath)).c_str(), &ffunc);
-#else
-    unzFile zfile = unzOpen64(QDir::toNativeSeparators(zippath).toUtf8().constData());
-#endif
-
-    if ((zfile == NULL) || (!IsFileReadable(zippath))) {
-        return filelist;
-    }
-    res = unzGoToFirstFile(zfile);
-    if (res == UNZ_OK) {
-        do {
-            // Get the name of the file in the archive.
-            char file_name[MAX_PATH] = {0};
-            unz_file_info64 file_info;
-            unzGetCurrentFileInfo64(zfile, &file_info, file_name, MAX_PATH, NULL, 0, NULL, 0);
-            QString qfile_name;
-            QString cp437_file_name;
-            qfile_name = QString::fromUtf8(file_name);
-            if (!(file_info.flag & (1<<11))) {
-                cp437_file_name = cp437->toUnicode(file_name);
-            }
 
-            // If there is no file name then we can't do anything with it.
-            if (!qfile_name.isEmpty()) {
-                if (!cp437_file_name.isEmpty() && cp437_file_name != qfile_name) {
-                    filelist.append(cp437_file_name);
-                } else {
-                    filelist.append(qfile_name);
-                }
-            }
-        } while ((res = unzGoToNextFile(zfile)) == UNZ_OK);
-    }
-    unzClose(zfile);
     return filelist;
 }
 
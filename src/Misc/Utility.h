@@ -92,6 +92,11 @@ public:
 
     static bool ForceCopyFile(const QString &fullinpath, const QString &fulloutpath);
 
+    // Copies a file to a new path, as a copy-on-write clone where the
+    // file system can make one (Btrfs, XFS, APFS) and byte for byte
+    // otherwise. Never a hard link: the book's copy is edited in place.
+    static bool CloneFile(const QString &fullinpath, const QString &fulloutpath);
+
     static bool RenameFile(const QString &oldfilepath, const QString &newfilepath);
 
     // Returns path to a random filename with the specified extension in
@@ -143,6 +148,13 @@ public:
      */
     static QString URLDecodePath(const QString &path);
 
+    /**
+     * In headless mode (batch processing) nothing may wait on a user;
+     * the Display*Dialog functions print to stderr instead.
+     */
+    static void SetHeadless(bool headless);
+    static bool IsHeadless();
+
     static void DisplayStdErrorDialog(const QString &error_message, const QString &detailed_text = QString());
 
     static void DisplayStdWarningDialog(const QString &warning_message, const QString &detailed_text = QString());
@@ -153,6 +165,10 @@ public:
     // if the env var isn't set, it returns an empty string
     static QString GetEnvironmentVar(const QString &variable_name);
 
+    // Returns the resident memory of this process in bytes, or -1
+    // where it can not be read
+    static qint64 ProcessResidentBytes();
+
     // Returns the same number, but rounded to one decimal place
     static float RoundToOneDecimal(float number);
 
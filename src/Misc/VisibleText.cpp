@@ -0,0 +1,300 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include "BookManipulation/XhtmlDoc.h"
+#include "Misc/GumboCache.h"
+#include "Misc/GumboInterface.h"
+#include "Misc/VisibleText.h"
+#include "ResourceObjects/HTMLResource.h"
+
+// In characters of visible text
+static const int CACHE_CAPACITY = 16 * 1024 * 1024;
+
+struct CachedText {
+    int revision;
+    QSharedPointer<const VisibleText> text;
+};
+
+static QMutex s_CacheMutex;
+
+// Keyed by resource identifier
+static QCache<QString, CachedText> s_Cache(CACHE_CAPACITY);
+
+
+// Moves a (byte, character) position in a utf-8 buffer on to a byte
+// offset and returns the character offset there. Text nodes mostly come
+// in source order, so the position is carried from one to the next.
+static int Utf8ToCharOffset(const std::string &utf8, int &byte_pos, int &char_pos, int to_byte)
+{
+    if (to_byte < byte_pos) {
+        byte_pos = 0;
+        char_pos = 0;
+    }
+
+    while (byte_pos < to_byte) {
+        unsigned char c = utf8[byte_pos];
+
+        // Four byte sequences are surrogate pairs in a QString
+        if ((c & 0xC0) != 0x80) {
+            char_pos += c >= 0xF0 ? 2 : 1;
+        }
+
+        byte_pos++;
+    }
+
+    return char_pos;
+}
+
+
+VisibleText::VisibleText(const QString &source)
+{
+    Build(QSharedPointer<const GumboTree>(new GumboTree(source)));
+}
+
+
+VisibleText::VisibleText(const QSharedPointer<const GumboTree> &tree)
+{
+    Build(tree);
+}
+
+
+QSharedPointer<const VisibleText> VisibleText::Get(const HTMLResource *html_resource)
+{
+    QString identifier = html_resource->GetIdentifier();
+    {
+        QMutexLocker locker(&s_CacheMutex);
+        CachedText *cached = s_Cache.object(identifier);
+
+        if (cached && cached->revision == html_resource->GetTextRevision()) {
+            return cached->text;
+        }
+    }
+
+    return Get(html_resource, html_resource->GetSnapshot());
+}
+
+
+QSharedPointer<const VisibleText> VisibleText::Get(const HTMLResource *html_resource,
+                                                   const TextResource::Snapshot &snapshot)
+{
+    QString identifier = html_resource->GetIdentifier();
+    {
+        QMutexLocker locker(&s_CacheMutex);
+        CachedText *cached = s_Cache.object(identifier);
+
+        if (cached && cached->revision == snapshot.revision) {
+            return cached->text;
+        }
+    }
+
+    // Built from the shared parse, without the lock held
+    QSharedPointer<const GumboTree> tree = GumboCache::Get(html_resource, snapshot);
+    QSharedPointer<const VisibleText> text(new VisibleText(tree));
+    QMutexLocker locker(&s_CacheMutex);
+    CachedText *cached = s_Cache.object(identifier);
+
+    if (!cached || cached->revision < snapshot.revision) {
+        cached = new CachedText;
+        cached->revision = snapshot.revision;
+        cached->text = text;
+        s_Cache.insert(identifier, cached, qMax(text->Text().length(), 1));
+    }
+
+    return text;
+}
+
+
+qint64 VisibleText::CacheSize()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    // The cost is in characters; the maps back to the source are
+    // left out
+    return qint64(s_Cache.totalCost()) * sizeof(QChar);
+}
+
+
+void VisibleText::ClearCache()
+{
+    QMutexLocker locker(&s_CacheMutex);
+    s_Cache.clear();
+}
+
+
+const QString &VisibleText::Text() const
+{
+    return m_Text;
+}
+
+
+int VisibleText::ToSource(int start, int end) const
+{
+    // The last run starting at or before start
+    int low = 0;
+    int high = m_Runs.count() - 1;
+    int found = -1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+
+        if (m_Runs.at(middle).text_start <= start) {
+            found = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+
+    if (found == -1) {
+        return -1;
+    }
+
+    const Run &run = m_Runs.at(found);
+
+    if (end > run.text_start + run.length) {
+        return -1;
+    }
+
+    return run.source_start + start - run.text_start;
+}
+
+
+void VisibleText::Build(const QSharedPointer<const GumboTree> &tree)
+{
+    if (!tree->output()) {
+        return;
+    }
+
+    // The same walk BookViewPreview::GetSearchTools makes of the page.
+    // Gumbo adds a body when there is none.
+    GumboInterface gi(tree, "any_version");
+    QList<GumboNode *> bodies = gi.get_all_nodes_with_tag(GUMBO_TAG_BODY);
+
+    if (bodies.isEmpty()) {
+        return;
+    }
+
+    const QString &source = tree->source();
+    const std::string &utf8 = tree->utf8source();
+    int byte_pos = 0;
+    int char_pos = 0;
+    QList<GumboNode *> text_nodes = XhtmlDoc::GetVisibleTextNodes(gi, bodies.at(0));
+    GumboNode *current_block_ancestor = NULL;
+    foreach(GumboNode *node, text_nodes) {
+        GumboNode *new_block_ancestor = XhtmlDoc::GetAncestorBlockElement(gi, node);
+
+        if (new_block_ancestor != current_block_ancestor) {
+            current_block_ancestor = new_block_ancestor;
+            m_Text.append("\n");
+        }
+
+        QString decoded = QString::fromUtf8(node->v.text.text);
+        const GumboStringPiece &original = node->v.text.original_text;
+        const char *begin = utf8.data();
+
+        if (original.data && original.data >= begin && original.data + original.length <= begin + utf8.size()) {
+            int source_start = Utf8ToCharOffset(utf8, byte_pos, char_pos, int(original.data - begin));
+            int source_end = Utf8ToCharOffset(utf8, byte_pos, char_pos, int(original.data - begin + original.length));
+            AddRuns(source, source_start, source_end, decoded);
+        }
+
+        m_Text.append(decoded);
+    }
+}
+
+
+void VisibleText::AddRuns(const QString &source, int source_start, int source_end, const QString &decoded)
+{
+    int text_start = m_Text.length();
+
+    // Most text has no entities in it
+    if (source.midRef(source_start, source_end - source_start) == decoded) {
+        AddRun(text_start, source_start, decoded.length());
+        return;
+    }
+
+    // Otherwise the source and the decoded text are walked side by side;
+    // only the stretches between entities map back.
+    int i = source_start;
+    int j = 0;
+    int run_source = i;
+    int run_text = j;
+
+    while (i < source_end && j < decoded.length()) {
+        QChar c = source.at(i);
+
+        if (c == '&') {
+            AddRun(text_start + run_text, run_source, j - run_text);
+            int semicolon = source.indexOf(';', i);
+
+            if (semicolon == -1 || semicolon >= source_end) {
+                return;
+            }
+
+            i = semicolon + 1;
+            // An entity is at least one character; what follows it in
+            // the source is where the decoded text picks up again.
+            j++;
+
+            if (i < source_end && source.at(i) != '&') {
+                while (j < decoded.length() && decoded.at(j) != source.at(i)) {
+                    j++;
+                }
+            }
+
+            run_source = i;
+            run_text = j;
+        } else if (c == decoded.at(j)) {
+            i++;
+            j++;
+        } else if (c == '\r') {
+            // Line endings are normalized by the parser
+            AddRun(text_start + run_text, run_source, j - run_text);
+            i++;
+            run_source = i;
+            run_text = j;
+        } else {
+            // Lost track of where we are
+            AddRun(text_start + run_text, run_source, j - run_text);
+            return;
+        }
+    }
+
+    AddRun(text_start + run_text, run_source, j - run_text);
+}
+
+
+void VisibleText::AddRun(int text_start, int source_start, int length)
+{
+    if (length <= 0) {
+        return;
+    }
+
+    Run run;
+    run.text_start = text_start;
+    run.source_start = source_start;
+    run.length = length;
+    m_Runs.append(run);
+}
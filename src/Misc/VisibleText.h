@@ -0,0 +1,109 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef VISIBLETEXT_H
+#define VISIBLETEXT_H
+
+#include <QtCore/QSharedPointer>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "ResourceObjects/TextResource.h"
+
+class GumboTree;
+class HTMLResource;
+
+/**
+ * The text of an HTML file as Book View shows it: the visible text
+ * nodes of the body, with a newline wherever a new block starts. This is
+ * what a Book View search matches against.
+ *
+ * The text keeps a map back to the source. Text that is written out
+ * as it is in the source maps back; entities and the added newlines
+ * do not.
+ */
+class VisibleText
+{
+public:
+
+    /**
+     * Builds the visible text of an HTML source.
+     */
+    VisibleText(const QString &source);
+
+    /**
+     * @return The visible text of the current text of the resource, from
+     *         the cache if it has not been edited since it was built.
+     */
+    static QSharedPointer<const VisibleText> Get(const HTMLResource *html_resource);
+
+    /**
+     * @return The visible text of the snapshot of the resource.
+     */
+    static QSharedPointer<const VisibleText> Get(const HTMLResource *html_resource,
+                                                 const TextResource::Snapshot &snapshot);
+
+    /**
+     * @return The approximate size of the cached texts, in bytes.
+     */
+    static qint64 CacheSize();
+
+    /**
+     * Drops every cached text.
+     */
+    static void ClearCache();
+
+    const QString &Text() const;
+
+    /**
+     * Maps a stretch of the visible text to the source.
+     *
+     * @return The offset in the source the stretch starts at, or -1 if
+     *         it is not written out as a whole in one place in the source.
+     */
+    int ToSource(int start, int end) const;
+
+private:
+
+    // Characters that are the same in the text and in the source
+    struct Run {
+        int text_start;
+        int source_start;
+        int length;
+    };
+
+    VisibleText(const QSharedPointer<const GumboTree> &tree);
+
+    void Build(const QSharedPointer<const GumboTree> &tree);
+
+    void AddRuns(const QString &source, int source_start, int source_end, const QString &decoded);
+
+    void AddRun(int text_start, int source_start, int length);
+
+    QString m_Text;
+
+    // In order of text_start
+    QVector<Run> m_Runs;
+};
+
+#endif // VISIBLETEXT_H
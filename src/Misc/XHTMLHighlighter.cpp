@@ -20,114 +20,98 @@
 **
 *************************************************************************/
 
-#include <QRegularExpressionMatch>
 #include <QBrush>
 #include <QColor>
-#include <QDebug>
 
 #include "Misc/SpellCheck.h"
 #include "Misc/Utility.h"
 #include "Misc/XHTMLHighlighter.h"
 #include "Misc/HTMLSpellCheck.h"
+#include "Misc/SettingsSnapshot.h"
 #include "Misc/SettingsStore.h"
-
-// All of our regular expressions
-static const QString DOCTYPE_BEGIN          = "<!(?!--)";
-static const QString HTML_ELEMENT_BEGIN     = "<(/\\?|/|\\?)?(?!!)";
-
-// "(?=[^\\w:-])" emulates a boundary ("\\b") that counts ":" and "-" as word characters
-static const QString HTML_ELEMENT_NAME      = "\\s*[\\w:-]+(?=[^\\w:-])\\s*(?!=)";
-static const QString HTML_ELEMENT_END       = "(\\?|/)?>";
+#include "Misc/TextDocument.h"
 
 static const QString HTML_COMMENT_BEGIN     = "<!--";
 static const QString HTML_COMMENT_END       = "-->";
+static const QString CSS_COMMENT_END        = "*/";
+static const QString STYLE_ELEMENT          = "style";
 
-static const QString CSS_BEGIN              = "<\\s*style[^>]*>";
-static const QString CSS_END                = "</\\s*style[^>]*>";
 
-static const QString CSS_COMMENT_BEGIN      = "/\\*";
-static const QString CSS_COMMENT_END        = "\\*/";
+// The whitespace of "\s" in the old patterns
+static inline bool IsSpaceChar(const QChar &c)
+{
+    ushort u = c.unicode();
+    return u == ' ' || (u >= '\t' && u <= '\r');
+}
 
-static const QString ATTRIBUTE_VALUE        = "\"[^<\"]*\"|'[^<']*'";
-static const QString ATTRIBUTE_NAME         = "[\\w:-]+";
 
-static const QString ENTITY_BEGIN           = "&(?=[^\\s;]+;)";
-static const QString ENTITY_END             = ";";
+// "[\w:-]"
+static inline bool IsNameChar(const QChar &c)
+{
+    return c.isLetterOrNumber() || c == '_' || c == ':' || c == '-' || c.isMark();
+}
+
+
+// "[\x{00A0}\x{2000}-\x{200A}\x{202F}\x{3000}]"
+static inline bool IsSpecialSpace(const QChar &c)
+{
+    ushort u = c.unicode();
+    return u == 0x00A0 || (u >= 0x2000 && u <= 0x200A) || u == 0x202F || u == 0x3000;
+}
 
-static const QString SPECIAL_SPACE_BEGIN    = "[\\x{00A0}\\x{2000}-\\x{200A}\\x{202F}\\x{3000}]+";
 
 // Constructor
 XHTMLHighlighter::XHTMLHighlighter(bool checkSpelling, QObject *parent)
     : QSyntaxHighlighter(parent),
-      m_checkSpelling(checkSpelling)
-
+      m_checkSpelling(checkSpelling),
+      m_Detail(Detail_Full)
 {
-    SettingsStore settings;
-    m_codeViewAppearance = settings.codeViewAppearance();
-    QTextCharFormat html_format;
-    QTextCharFormat doctype_format;
-    QTextCharFormat html_comment_format;
-    QTextCharFormat css_format;
-    QTextCharFormat css_comment_format;
-    QTextCharFormat attribute_name_format;
-    QTextCharFormat attribute_value_format;
-    QTextCharFormat entity_format;
-    QTextCharFormat special_space_format;
-
-    doctype_format        .setForeground(m_codeViewAppearance.xhtml_doctype_color);
-    html_format           .setForeground(m_codeViewAppearance.xhtml_html_color);
-    html_comment_format   .setForeground(m_codeViewAppearance.xhtml_html_comment_color);
-    css_format            .setForeground(m_codeViewAppearance.xhtml_css_color);
-    css_comment_format    .setForeground(m_codeViewAppearance.xhtml_css_comment_color);
-    attribute_name_format .setForeground(m_codeViewAppearance.xhtml_attribute_name_color);
-    attribute_value_format.setForeground(m_codeViewAppearance.xhtml_attribute_value_color);
-    entity_format         .setForeground(m_codeViewAppearance.xhtml_entity_color);
+    QSharedPointer<const SettingsSnapshot::Values> settings = SettingsSnapshot::Current();
+    m_codeViewAppearance = settings->code_view_appearance;
+    m_enableSpellCheck = settings->spell_check;
+    m_DoctypeFormat       .setForeground(m_codeViewAppearance.xhtml_doctype_color);
+    m_HTMLFormat          .setForeground(m_codeViewAppearance.xhtml_html_color);
+    m_HTMLCommentFormat   .setForeground(m_codeViewAppearance.xhtml_html_comment_color);
+    m_CSSFormat           .setForeground(m_codeViewAppearance.xhtml_css_color);
+    m_CSSCommentFormat    .setForeground(m_codeViewAppearance.xhtml_css_comment_color);
+    m_AttributeNameFormat .setForeground(m_codeViewAppearance.xhtml_attribute_name_color);
+    m_AttributeValueFormat.setForeground(m_codeViewAppearance.xhtml_attribute_value_color);
+    m_EntityFormat        .setForeground(m_codeViewAppearance.xhtml_entity_color);
     // use the same color as for entities but as an underline since they are "spaces"
-    special_space_format  .setUnderlineColor(m_codeViewAppearance.xhtml_entity_color);
-    special_space_format  .setUnderlineStyle(QTextCharFormat::DashUnderline);
-    HighlightingRule rule;
-    rule.pattern = QRegularExpression(DOCTYPE_BEGIN);
-    rule.format  = doctype_format;
-    m_Rules[ "DOCTYPE_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_ELEMENT_BEGIN);
-    rule.format  = html_format;
-    m_Rules[ "HTML_ELEMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_ELEMENT_END);
-    rule.format  = html_format;
-    m_Rules[ "HTML_ELEMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(HTML_COMMENT_BEGIN);
-    rule.format  = html_comment_format;
-    m_Rules[ "HTML_COMMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(HTML_COMMENT_END);
-    rule.format  = html_comment_format;
-    m_Rules[ "HTML_COMMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(CSS_BEGIN);
-    rule.format  = css_format;
-    m_Rules[ "CSS_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(CSS_END);
-    rule.format  = css_format;
-    m_Rules[ "CSS_END" ] = rule;
-    rule.pattern = QRegularExpression(CSS_COMMENT_BEGIN);
-    rule.format  = css_comment_format;
-    m_Rules[ "CSS_COMMENT_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(CSS_COMMENT_END);
-    rule.format  = css_comment_format;
-    m_Rules[ "CSS_COMMENT_END" ] = rule;
-    rule.pattern = QRegularExpression(ATTRIBUTE_NAME);
-    rule.format  = attribute_name_format;
-    m_Rules[ "ATTRIBUTE_NAME" ] = rule;
-    rule.pattern = QRegularExpression(ATTRIBUTE_VALUE);
-    rule.format  = attribute_value_format;
-    m_Rules[ "ATTRIBUTE_VALUE" ] = rule;
-    rule.pattern = QRegularExpression(ENTITY_BEGIN);
-    rule.format  = entity_format;
-    m_Rules[ "ENTITY_BEGIN" ] = rule;
-    rule.pattern = QRegularExpression(ENTITY_END);
-    rule.format  = entity_format;
-    m_Rules[ "ENTITY_END" ] = rule;
-    rule.pattern = QRegularExpression(SPECIAL_SPACE_BEGIN);
-    rule.format  = special_space_format;
-    m_Rules[ "SPECIAL_SPACE_BEGIN" ] = rule;
+    m_SpecialSpaceFormat  .setUnderlineColor(m_codeViewAppearance.xhtml_entity_color);
+    m_SpecialSpaceFormat  .setUnderlineStyle(QTextCharFormat::DashUnderline);
+}
+
+
+void XHTMLHighlighter::SetCheckSpelling(bool checkSpelling)
+{
+    m_checkSpelling = checkSpelling;
+}
+
+
+void XHTMLHighlighter::SetDetail(Detail detail)
+{
+    m_Detail = detail;
+}
+
+
+void XHTMLHighlighter::PrepareStates(TextDocument &document)
+{
+    // The states stay with the blocks when the highlighter lets go
+    // of the document; only formats are cleared then, and none are set
+    {
+        XHTMLHighlighter highlighter(false);
+        highlighter.SetDetail(Detail_StateOnly);
+        highlighter.setDocument(&document);
+        highlighter.rehighlight();
+    }
+    document.setHighlightStatesReady(true);
+}
+
+
+void XHTMLHighlighter::ReloadSettings()
+{
+    m_enableSpellCheck = SettingsSnapshot::Current()->spell_check;
 }
 
 
@@ -136,309 +120,275 @@ XHTMLHighlighter::XHTMLHighlighter(bool checkSpelling, QObject *parent)
 // a block (line of text) needs to be repainted
 void XHTMLHighlighter::highlightBlock(const QString &text)
 {
+    if (m_Detail == Detail_KeepState && currentBlockState() != -1) {
+        return;
+    }
+
     // By default, all block states are -1;
     // in our implementation regular text is state == 1
-    if (previousBlockState() == -1) {
-        setCurrentBlockState(State_Text);
-    }
+    int state = previousBlockState() == -1 ? State_Text : previousBlockState();
     // Propagate previous state; needed for state tracking
-    else {
-        setCurrentBlockState(previousBlockState());
-    }
+    setCurrentBlockState(state);
 
     if (text.isEmpty()) {
         return;
     }
 
-    SettingsStore settings;
-    m_enableSpellCheck = settings.spellCheck();
-
-    // Run spell check over the text.
-    if (m_enableSpellCheck && m_checkSpelling) {
+    // Run spell check over the text. The lexer below only formats
+    // markup over it, so the underlines stay on the text.
+    if (m_Detail == Detail_Full && m_enableSpellCheck && m_checkSpelling) {
         CheckSpelling(text);
     }
 
-    // The order of these operations is important
-    // because some states format text over previous states!
-    HighlightLine(text, State_SpSpace);
-    HighlightLine(text, State_Entity);
-    HighlightLine(text, State_CSS);
-    HighlightLine(text, State_HTML);
-    HighlightLine(text, State_CSSComment);
-    HighlightLine(text, State_HTMLComment);
-    HighlightLine(text, State_DOCTYPE);
+    setCurrentBlockState(LexLine(text, state));
 }
 
 
-// Returns the regex that matches the left bracket of a state
-QRegularExpression XHTMLHighlighter::GetLeftBracketRegEx(int state) const
+// Formats the line in a single pass, left to right. Only one construct
+// can be open at a time, so the state at the start of the line says
+// which one the previous line left open (if any) and whether we are
+// inside a style element.
+int XHTMLHighlighter::LexLine(const QString &text, int state)
 {
-    QRegularExpression empty;
+    const QChar *chars = text.constData();
+    const int length = text.length();
+    int i = 0;
+
+    if (state & State_DOCTYPE) {
+        i = LexDoctype(text, 0, false, state);
+    } else if (state & State_HTMLComment) {
+        i = LexHTMLComment(text, 0, false, state);
+    } else if (state & State_CSSComment) {
+        i = LexCSSComment(text, 0, false, state);
+    } else if (state & State_HTML) {
+        i = LexTag(text, 0, false, state);
+    }
 
-    switch (state) {
-        case State_Entity:
-            return m_Rules.value("ENTITY_BEGIN").pattern;
+    while (i < length) {
+        if (state & State_CSS) {
+            // Style sheet text runs up to the next tag or comment
+            int css_end = i;
+
+            while (css_end < length && chars[css_end] != '<' &&
+                   !(chars[css_end] == '/' && css_end + 1 < length && chars[css_end + 1] == '*')) {
+                css_end++;
+            }
 
-        case State_HTML:
-            return m_Rules.value("HTML_ELEMENT_BEGIN").pattern;
+            if (css_end > i) {
+                Format(i, css_end - i, m_CSSFormat);
+                i = css_end;
+            }
 
-        case State_HTMLComment:
-            return m_Rules.value("HTML_COMMENT_BEGIN").pattern;
+            if (i == length) {
+                break;
+            }
 
-        case State_CSS:
-            return m_Rules.value("CSS_BEGIN").pattern;
+            if (chars[i] == '/') {
+                i = LexCSSComment(text, i, true, state);
+                continue;
+            }
+        }
 
-        case State_CSSComment:
-            return m_Rules.value("CSS_COMMENT_BEGIN").pattern;
+        const QChar c = chars[i];
 
-        case State_DOCTYPE:
-            return m_Rules.value("DOCTYPE_BEGIN").pattern;
+        if (c == '<') {
+            if (text.midRef(i, HTML_COMMENT_BEGIN.length()) == HTML_COMMENT_BEGIN) {
+                i = LexHTMLComment(text, i, true, state);
+            } else if (i + 1 < length && chars[i + 1] == '!') {
+                i = LexDoctype(text, i, true, state);
+            } else {
+                i = LexTag(text, i, true, state);
+            }
 
-        case State_SpSpace:
-            return m_Rules.value("SPECIAL_SPACE_BEGIN").pattern;
+            continue;
+        }
 
-        default:
-            return empty;
-    }
-}
+        if (c == '&') {
+            // "&[^\s;]+;"
+            int entity_end = i + 1;
 
+            while (entity_end < length && chars[entity_end] != ';' && !IsSpaceChar(chars[entity_end])) {
+                entity_end++;
+            }
 
-// Returns the regex that matches the right bracket of a state
-QRegularExpression XHTMLHighlighter::GetRightBracketRegEx(int state) const
-{
-    QRegularExpression empty;
+            if (entity_end > i + 1 && entity_end < length && chars[entity_end] == ';') {
+                Format(i, entity_end - i + 1, m_EntityFormat);
+                i = entity_end + 1;
+                continue;
+            }
+        } else if (IsSpecialSpace(c)) {
+            int space_end = i + 1;
 
-    switch (state) {
-        case State_Entity:
-            return m_Rules.value("ENTITY_END").pattern;
+            while (space_end < length && IsSpecialSpace(chars[space_end])) {
+                space_end++;
+            }
 
-        case State_DOCTYPE:
-        case State_HTML:
-            return m_Rules.value("HTML_ELEMENT_END").pattern;
+            Format(i, space_end - i, m_SpecialSpaceFormat);
+            i = space_end;
+            continue;
+        }
 
-        case State_HTMLComment:
-            return m_Rules.value("HTML_COMMENT_END").pattern;
+        i++;
+    }
 
-        case State_CSS:
-            return m_Rules.value("CSS_END").pattern;
+    return state;
+}
 
-        case State_CSSComment:
-            return m_Rules.value("CSS_COMMENT_END").pattern;
 
-        default:
-            return empty;
+void XHTMLHighlighter::Format(int start, int count, const QTextCharFormat &format)
+{
+    if (m_Detail != Detail_StateOnly) {
+        setFormat(start, count, format);
     }
 }
 
 
-// Sets the requested state for the current text block
-void XHTMLHighlighter::SetState(int state)
+// The Lex functions below format one construct starting at "start";
+// "at_begin" says whether its opening bracket is there or whether it
+// was opened on a previous line. They set or clear the construct's bit
+// in "state" and return the index just past the construct's end,
+// or the line length if it continues on the next line.
+
+int XHTMLHighlighter::LexHTMLComment(const QString &text, int start, bool at_begin, int &state)
+{
+    return LexDelimited(text, start, at_begin ? HTML_COMMENT_BEGIN.length() : 0,
+                        HTML_COMMENT_END, State_HTMLComment, m_HTMLCommentFormat, state);
+}
+
+
+int XHTMLHighlighter::LexCSSComment(const QString &text, int start, bool at_begin, int &state)
 {
-    int current_state = currentBlockState();
-    // Add the current state to the list
-    current_state = current_state | state;
-    setCurrentBlockState(current_state);
+    // The opening "/*" is two characters
+    return LexDelimited(text, start, at_begin ? 2 : 0,
+                        CSS_COMMENT_END, State_CSSComment, m_CSSCommentFormat, state);
 }
 
 
-// Clears the requested state for the current text block
-void XHTMLHighlighter::ClearState(int state)
+int XHTMLHighlighter::LexDoctype(const QString &text, int start, bool at_begin, int &state)
 {
-    int current_state = currentBlockState();
-    // Remove the current state from the list
-    current_state = current_state & ~state;
-    setCurrentBlockState(current_state);
+    // The opening "<!" is two characters
+    return LexDelimited(text, start, at_begin ? 2 : 0,
+                        QString(">"), State_DOCTYPE, m_DoctypeFormat, state);
 }
 
 
-// Checks if the requested state is set
-// for the current text block
-bool XHTMLHighlighter::StateChecked(int state) const
+int XHTMLHighlighter::LexDelimited(const QString &text, int start, int opening_length, const QString &closing,
+                                   int construct, const QTextCharFormat &format, int &state)
 {
-    int current_state = currentBlockState();
+    int close = text.indexOf(closing, start + opening_length);
+    int end;
 
-    // Check if our state is in the list
-    if ((current_state & state) != 0) {
-        return true;
+    if (close == -1) {
+        end = text.length();
+        state |= construct;
     } else {
-        return false;
+        end = close + closing.length();
+        state &= ~construct;
     }
+
+    Format(start, end - start, format);
+    return end;
 }
 
-// Formats the inside of a node;
-// "text" is the textblock/line of text;
-// "state" describes the node;
-// "index" is the index to start formatting from;
-// "length" is the length of chars to format.
-void XHTMLHighlighter::FormatBody(const QString &text, int state, int index, int length)
+
+int XHTMLHighlighter::LexTag(const QString &text, int start, bool at_begin, int &state)
 {
-    if (state == State_HTML) {
-        // First paint everything the color of the brackets
-        setFormat(index, length, m_Rules.value("HTML_ELEMENT_BEGIN").format);
-        QRegularExpression name  = m_Rules.value("ATTRIBUTE_NAME").pattern;
-        QRegularExpression value = m_Rules.value("ATTRIBUTE_VALUE").pattern;
-        // Used to move over the line
-        int main_index = index;
-
-        // We skip over the left bracket (if it's present)
-        QRegularExpression bracket(HTML_ELEMENT_BEGIN);
-        QRegularExpressionMatch bracket_match = bracket.match(text, main_index);
-        if (bracket_match.hasMatch() && bracket_match.capturedStart() == main_index) {
-            main_index += bracket_match.capturedLength();
+    const QChar *chars = text.constData();
+    const int length = text.length();
+    int i = start;
+    // Where the next run of bracket colored text starts
+    int html_start = start;
+    bool is_style_open = false;
+    bool is_style_close = false;
+
+    if (at_begin) {
+        // "<(/\?|/|\?)?"
+        i++;
+        bool is_closing = false;
+
+        if (i < length && chars[i] == '/') {
+            is_closing = true;
+            i++;
+
+            if (i < length && chars[i] == '?') {
+                i++;
+            }
+        } else if (i < length && chars[i] == '?') {
+            i++;
         }
 
-        // We skip over the element name (if it's present)
-        // because we want it to be the same color as the brackets
-        QRegularExpression elem_name(HTML_ELEMENT_NAME);
-        QRegularExpressionMatch elem_name_match = elem_name.match(text, main_index);
-        if (elem_name_match.hasMatch() && elem_name_match.capturedStart() == main_index) {
-            main_index += elem_name_match.capturedLength();
+        // The element name is the same color as the brackets
+        while (i < length && IsSpaceChar(chars[i])) {
+            i++;
         }
 
-        while (true) {
-            // Get the indexes of the attribute names and values
-            int name_index = -1;
-            int name_len = 0;
-            QRegularExpressionMatch name_match = name.match(text, main_index);
-            if (name_match.hasMatch()) {
-                name_index = name_match.capturedStart();
-                name_len = name_match.capturedLength();
-            }
-
-            int value_index = -1;
-            int value_len = 0;
-            QRegularExpressionMatch value_match = value.match(text, main_index);
-            if (value_match.hasMatch()) {
-                value_index = value_match.capturedStart();
-                value_len = value_match.capturedLength();
-            }
+        int name_start = i;
 
-            // If we can't find the names and values or we found them
-            // outside of the area we are formatting, we exit
-            if (((name_index  != -1) && (name_index  < index + length)) ||
-                ((value_index != -1) && (value_index < index + length))) {
-                // ... otherwise format the found sections
-                setFormat(name_index,  name_len,  m_Rules.value("ATTRIBUTE_NAME").format);
-                setFormat(value_index, value_len, m_Rules.value("ATTRIBUTE_VALUE").format);
-            } else {
-                break;
-            }
+        while (i < length && IsNameChar(chars[i])) {
+            i++;
+        }
 
-            // Update the main index with the regex that matched "further down the line"
-            if (name_index + name_len > value_index + value_len) {
-                main_index = name_index + name_len;
-            } else {
-                main_index = value_index + value_len;
-            }
+        if (text.midRef(name_start, i - name_start) == STYLE_ELEMENT) {
+            is_style_close = is_closing;
+            is_style_open = !is_closing && chars[start + 1] != '?';
         }
-    } else if (state == State_HTMLComment) {
-        setFormat(index, length, m_Rules.value("HTML_COMMENT_BEGIN").format);
-    } else if (state == State_CSS) {
-        setFormat(index, length, m_Rules.value("CSS_BEGIN").format);
-    } else if (state == State_CSSComment) {
-        setFormat(index, length, m_Rules.value("CSS_COMMENT_BEGIN").format);
-    } else if (state == State_Entity) {
-        setFormat(index, length, m_Rules.value("ENTITY_BEGIN").format);
-    } else if (state == State_SpSpace) {
-        setFormat(index, length, m_Rules.value("SPECIAL_SPACE_BEGIN").format);
-    } else if (state == State_DOCTYPE) {
-        setFormat(index, length, m_Rules.value("DOCTYPE_BEGIN").format);
     }
-}
 
+    while (i < length) {
+        const QChar c = chars[i];
 
-// Highlights the current line according to the state requested;
-// check to see if the node of type "state" is present;
-// if it is, the node is formatted
-void XHTMLHighlighter::HighlightLine(const QString &text, int state)
-{
-    QRegularExpression left_bracket_regex  = GetLeftBracketRegEx(state);
-    QRegularExpression right_bracket_regex = GetRightBracketRegEx(state);
-    int main_index = 0;
-
-    // We loop over the line several times
-    // because we could have several nodes on it
-    while (main_index < text.length()) {
-        int left_bracket_index  = -1;
-        int left_bracket_len = 0;
-        int right_bracket_index = -1;
-        int right_bracket_len = 0;
-
-        if (!left_bracket_regex.pattern().isEmpty()) {
-            QRegularExpressionMatch left_bracket_match = left_bracket_regex.match(text, main_index);
-            if (left_bracket_match.hasMatch()) {
-                left_bracket_index = left_bracket_match.capturedStart();
-                left_bracket_len = left_bracket_match.capturedLength();
-            }
-        }
+        if (c == '>') {
+            bool self_closing = i > start && chars[i - 1] == '/';
+            i++;
+            Format(html_start, i - html_start, m_HTMLFormat);
+            state &= ~State_HTML;
 
-        if (!right_bracket_regex.pattern().isEmpty()) {
-            QRegularExpressionMatch right_bracket_match = right_bracket_regex.match(text, main_index);
-            if (right_bracket_match.hasMatch()) {
-                right_bracket_index = right_bracket_match.capturedStart();
-                right_bracket_len = right_bracket_match.capturedLength();
+            if (is_style_open && !self_closing) {
+                state |= State_CSS;
+            } else if (is_style_close) {
+                state &= ~State_CSS;
             }
-        }
 
-        // If we are not starting our state and our state is
-        // not already set, we don't format; see the four cases explanation below
-        if (left_bracket_index == -1 && !StateChecked(state)) {
-            return;
+            return i;
         }
 
-        // Special Spaces State should always be case (1) but has no ending regex
-        if (state == State_SpSpace) {
-  	    right_bracket_index = left_bracket_index + left_bracket_len;
-	    right_bracket_len = 0;
-	}
-
-        // Every node/state has a left "bracket", a right "bracket" and the inside body.
-        // This example uses HTML tags, but the principle is the same for every node/state.
-        // There are four possible cases:
-        // (1)  <......>    (both brackets on the same line; state starts and stops here)
-        // (2)  <.......    (only the left bracket; next line continues state)
-        // (3)  .......>    (only the right bracket; current line ends state)
-        // (4)  ........    (no brackets; a line between (2) and (3))
-
-        // We also check the state because we don't want to start a new node
-        // if the current node of the same type hasn't finished
-        if (left_bracket_index != -1 && !StateChecked(state)) {
-            main_index = left_bracket_index + left_bracket_len;
-
-            // (1)
-            if (right_bracket_index != -1) {
-                main_index = right_bracket_index + right_bracket_len;
-                int length = right_bracket_index - left_bracket_index + right_bracket_len;
-                FormatBody(text, state, left_bracket_index, length);
-                // There's no point in setting the state here because the state
-                // starts and ends on this line.
-            }
-            // (2)
-            else {
-                int length = text.length() - left_bracket_index;
-                FormatBody(text, state, left_bracket_index, length);
-                main_index += length;
-                // Set the current state so the next line can continue
-                // with the formatting.
-                SetState(state);
+        if (c == '"' || c == '\'') {
+            // "\"[^<\"]*\"|'[^<']*'"; a value with no closing quote on
+            // this line is left plain, as before
+            int close = i + 1;
+
+            while (close < length && chars[close] != c && chars[close] != '<') {
+                close++;
             }
-        } else {
-            // (3)
-            if (right_bracket_index != -1) {
-                main_index = right_bracket_index + right_bracket_len;
-                int length = right_bracket_index + right_bracket_len;
-                FormatBody(text, state, 0, length);
-                // Clear the current state because our state has just ended.
-                ClearState(state);
+
+            if (close < length && chars[close] == c) {
+                Format(html_start, i - html_start, m_HTMLFormat);
+                Format(i, close - i + 1, m_AttributeValueFormat);
+                i = close + 1;
+                html_start = i;
+                continue;
             }
-            // (4)
-            else {
-                int length = text.length();
-                FormatBody(text, state, 0, length);
-                main_index += length;
+        } else if (IsNameChar(c)) {
+            int name_end = i + 1;
+
+            while (name_end < length && IsNameChar(chars[name_end])) {
+                name_end++;
             }
+
+            Format(html_start, i - html_start, m_HTMLFormat);
+            Format(i, name_end - i, m_AttributeNameFormat);
+            i = name_end;
+            html_start = i;
+            continue;
         }
+
+        i++;
     }
+
+    // The tag continues on the next line
+    Format(html_start, length - html_start, m_HTMLFormat);
+    state |= State_HTML;
+    return length;
 }
 
 
@@ -24,18 +24,45 @@
 #define XHTMLHIGHLIGHTER_H
 
 #include <QtGui/QSyntaxHighlighter>
-#include <QRegularExpression>
+#include <QtGui/QTextCharFormat>
 
 #include "Misc/SettingsStore.h"
 
+class TextDocument;
+
 class XHTMLHighlighter : public QSyntaxHighlighter
 {
 
 public:
 
+    // How much of a block highlightBlock works out
+    enum Detail {
+        Detail_Full,        // formats and spelling
+        Detail_NoSpelling,  // formats only
+        Detail_StateOnly,   // only the block state, so the next block
+                            // starts right; the block is left plain
+        Detail_KeepState    // nothing; the block states were worked
+                            // out ahead by PrepareStates
+    };
+
     // Constructor
     XHTMLHighlighter(bool checkSpelling, QObject *parent = 0);
 
+    // Re-reads the settings used while highlighting;
+    // call before rehighlighting when they have changed
+    void ReloadSettings();
+
+    // Turns spelling underlines on or off for the document
+    void SetCheckSpelling(bool checkSpelling);
+
+    // Applies to the blocks highlighted from now on
+    void SetDetail(Detail detail);
+
+    // Works out the state of every block of the document, on any
+    // thread, and marks its states as ready for the highlighter the
+    // document is given to next
+    static void PrepareStates(TextDocument &document);
+
 protected:
 
     // Overrides the function from QSyntaxHighlighter;
@@ -45,33 +72,23 @@ protected:
 
 private:
 
-    // Returns the regex that matches the left bracket of a state
-    QRegularExpression GetLeftBracketRegEx(int state) const;
+    // Formats the line in one pass; "state" is the state
+    // the previous line ended in, the state this line ends in is returned
+    int LexLine(const QString &text, int state);
 
-    // Returns the regex that matches the right bracket of a state
-    QRegularExpression GetRightBracketRegEx(int state) const;
+    // Format one construct of the line and update "state";
+    // return the index just past the end of the construct
+    int LexTag(const QString &text, int start, bool at_begin, int &state);
+    int LexHTMLComment(const QString &text, int start, bool at_begin, int &state);
+    int LexCSSComment(const QString &text, int start, bool at_begin, int &state);
+    int LexDoctype(const QString &text, int start, bool at_begin, int &state);
 
-    // Sets the requested state for the current text block
-    void SetState(int state);
+    // Formats from "start" up to and including "closing"
+    int LexDelimited(const QString &text, int start, int opening_length, const QString &closing,
+                     int construct, const QTextCharFormat &format, int &state);
 
-    // Clears the requested state for the current text block
-    void ClearState(int state);
-
-    // Checks if the requested state is set
-    // for the current text block
-    bool StateChecked(int state) const;
-
-    // Formats the inside of a node;
-    // "text" is the textblock/line;
-    // "state" describes the node;
-    // "index" is the index to start formatting from
-    // "length" is the length of chars to format
-    void FormatBody(const QString &text, int state, int index, int length);
-
-    // Highlights the current line according to the state requested;
-    // check to see if the node of type "state" is present;
-    // if it is, the node is formatted
-    void HighlightLine(const QString &text, int state);
+    // setFormat unless only the state is being worked out
+    void Format(int start, int count, const QTextCharFormat &format);
 
     void CheckSpelling(const QString &text);
 
@@ -92,14 +109,16 @@ private:
         State_DOCTYPE       = 1 << 7
     };
 
-    struct HighlightingRule {
-        QRegularExpression pattern;
-        QTextCharFormat format;
-    };
-
-    // Stores all of our highlighting rules
-    // and the text formats used
-    QHash<QString, HighlightingRule> m_Rules;
+    // The text formats used
+    QTextCharFormat m_HTMLFormat;
+    QTextCharFormat m_DoctypeFormat;
+    QTextCharFormat m_HTMLCommentFormat;
+    QTextCharFormat m_CSSFormat;
+    QTextCharFormat m_CSSCommentFormat;
+    QTextCharFormat m_AttributeNameFormat;
+    QTextCharFormat m_AttributeValueFormat;
+    QTextCharFormat m_EntityFormat;
+    QTextCharFormat m_SpecialSpaceFormat;
 
     // Determine if spell check should be used on the document.
     bool m_checkSpelling;
@@ -107,6 +126,8 @@ private:
     // Determine if automatic spell check is enabled
     bool m_enableSpellCheck;
 
+    Detail m_Detail;
+
     SettingsStore::CodeViewAppearance m_codeViewAppearance;
 };
 
@@ -19,11 +19,323 @@
 **
 *************************************************************************/
 
+#include <algorithm>
+#include <string.h>
+
+#include <QtCore/QByteArray>
 #include <QtCore/QString>
-#include <QtCore/QStringList>
 
 #include "Misc/XMLEntities.h"
 
+namespace
+{
+
+struct EntityEntry {
+    ushort code;
+    const char *name;
+    const char *description;
+};
+
+// Sorted by code
+const EntityEntry ENTITIES[] = {
+    { 34, "quot", QT_TRANSLATE_NOOP("XMLEntities", "quotation mark") },
+    { 38, "amp", QT_TRANSLATE_NOOP("XMLEntities", "ampersand") },
+    { 39, "apos", QT_TRANSLATE_NOOP("XMLEntities", "apostrophe") },
+    { 60, "lt", QT_TRANSLATE_NOOP("XMLEntities", "less-than sign") },
+    { 62, "gt", QT_TRANSLATE_NOOP("XMLEntities", "greater-than sign") },
+    { 160, "nbsp", QT_TRANSLATE_NOOP("XMLEntities", "no-break space") },
+    { 161, "iexcl", QT_TRANSLATE_NOOP("XMLEntities", "inverted exclamation mark") },
+    { 162, "cent", QT_TRANSLATE_NOOP("XMLEntities", "cent sign") },
+    { 163, "pound", QT_TRANSLATE_NOOP("XMLEntities", "pound sign") },
+    { 164, "curren", QT_TRANSLATE_NOOP("XMLEntities", "currency sign") },
+    { 165, "yen", QT_TRANSLATE_NOOP("XMLEntities", "yen sign") },
+    { 166, "brvbar", QT_TRANSLATE_NOOP("XMLEntities", "broken bar") },
+    { 167, "sect", QT_TRANSLATE_NOOP("XMLEntities", "section sign") },
+    { 168, "uml", QT_TRANSLATE_NOOP("XMLEntities", "diaeresis") },
+    { 169, "copy", QT_TRANSLATE_NOOP("XMLEntities", "copyright symbol") },
+    { 170, "ordf", QT_TRANSLATE_NOOP("XMLEntities", "feminine ordinal indicator") },
+    { 171, "laquo", QT_TRANSLATE_NOOP("XMLEntities", "left-pointing double angle quotation mark") },
+    { 172, "not", QT_TRANSLATE_NOOP("XMLEntities", "not sign") },
+    { 173, "shy", QT_TRANSLATE_NOOP("XMLEntities", "soft hyphen") },
+    { 174, "reg", QT_TRANSLATE_NOOP("XMLEntities", "registered sign") },
+    { 175, "macr", QT_TRANSLATE_NOOP("XMLEntities", "macron") },
+    { 176, "deg", QT_TRANSLATE_NOOP("XMLEntities", "degree symbol") },
+    { 177, "plusmn", QT_TRANSLATE_NOOP("XMLEntities", "plus-minus sign") },
+    { 178, "sup2", QT_TRANSLATE_NOOP("XMLEntities", "superscript two") },
+    { 179, "sup3", QT_TRANSLATE_NOOP("XMLEntities", "superscript three") },
+    { 180, "acute", QT_TRANSLATE_NOOP("XMLEntities", "acute accent") },
+    { 181, "micro", QT_TRANSLATE_NOOP("XMLEntities", "micro sign") },
+    { 182, "para", QT_TRANSLATE_NOOP("XMLEntities", "pilcrow sign") },
+    { 183, "middot", QT_TRANSLATE_NOOP("XMLEntities", "middle dot") },
+    { 184, "cedil", QT_TRANSLATE_NOOP("XMLEntities", "cedilla") },
+    { 185, "sup1", QT_TRANSLATE_NOOP("XMLEntities", "superscript one") },
+    { 186, "ordm", QT_TRANSLATE_NOOP("XMLEntities", "masculine ordinal indicator") },
+    { 187, "raquo", QT_TRANSLATE_NOOP("XMLEntities", "right-pointing double angle quotation mark") },
+    { 188, "frac14", QT_TRANSLATE_NOOP("XMLEntities", "vulgar fraction one quarter") },
+    { 189, "frac12", QT_TRANSLATE_NOOP("XMLEntities", "vulgar fraction one half") },
+    { 190, "frac34", QT_TRANSLATE_NOOP("XMLEntities", "vulgar fraction three quarters") },
+    { 191, "iquest", QT_TRANSLATE_NOOP("XMLEntities", "inverted question mark") },
+    { 192, "Agrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with grave accent") },
+    { 193, "Aacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with acute accent") },
+    { 194, "Acirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with circumflex") },
+    { 195, "Atilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with tilde") },
+    { 196, "Auml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with diaeresis") },
+    { 197, "Aring", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter A with ring above") },
+    { 198, "AElig", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter AE") },
+    { 199, "Ccedil", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter C with cedilla") },
+    { 200, "Egrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter E with grave accent") },
+    { 201, "Eacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter E with acute accent") },
+    { 202, "Ecirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter E with circumflex") },
+    { 203, "Euml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter E with diaeresis") },
+    { 204, "Igrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter I with grave accent") },
+    { 205, "Iacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter I with acute accent") },
+    { 206, "Icirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter I with circumflex") },
+    { 207, "Iuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter I with diaeresis") },
+    { 208, "ETH", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter Eth") },
+    { 209, "Ntilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter N with tilde") },
+    { 210, "Ograve", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with grave accent") },
+    { 211, "Oacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with acute accent") },
+    { 212, "Ocirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with circumflex") },
+    { 213, "Otilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with tilde") },
+    { 214, "Ouml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with diaeresis") },
+    { 215, "times", QT_TRANSLATE_NOOP("XMLEntities", "multiplication sign") },
+    { 216, "Oslash", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter O with stroke") },
+    { 217, "Ugrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter U with grave accent") },
+    { 218, "Uacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter U with acute accent") },
+    { 219, "Ucirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter U with circumflex") },
+    { 220, "Uuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter U with diaeresis") },
+    { 221, "Yacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter Y with acute accent") },
+    { 222, "THORN", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter THORN") },
+    { 223, "szlig", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter sharp s") },
+    { 224, "agrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with grave accent") },
+    { 225, "aacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with acute accent") },
+    { 226, "acirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with circumflex") },
+    { 227, "atilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with tilde") },
+    { 228, "auml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with diaeresis") },
+    { 229, "aring", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter a with ring above") },
+    { 230, "aelig", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter ae") },
+    { 231, "ccedil", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter c with cedilla") },
+    { 232, "egrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter e with grave accent") },
+    { 233, "eacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter e with acute accent") },
+    { 234, "ecirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter e with circumflex") },
+    { 235, "euml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter e with diaeresis") },
+    { 236, "igrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter i with grave accent") },
+    { 237, "iacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter i with acute accent") },
+    { 238, "icirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter i with circumflex") },
+    { 239, "iuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter i with diaeresis") },
+    { 240, "eth", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter eth") },
+    { 241, "ntilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter n with tilde") },
+    { 242, "ograve", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with grave accent") },
+    { 243, "oacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with acute accent") },
+    { 244, "ocirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with circumflex") },
+    { 245, "otilde", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with tilde") },
+    { 246, "ouml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with diaeresis") },
+    { 247, "divide", QT_TRANSLATE_NOOP("XMLEntities", "division sign") },
+    { 248, "oslash", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter o with stroke") },
+    { 249, "ugrave", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter u with grave accent") },
+    { 250, "uacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter u with acute accent") },
+    { 251, "ucirc", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter u with circumflex") },
+    { 252, "uuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter u with diaeresis") },
+    { 253, "yacute", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter y with acute accent") },
+    { 254, "thorn", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter thorn") },
+    { 255, "yuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter y with diaeresis") },
+    { 338, "OElig", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital ligature oe") },
+    { 339, "oelig", QT_TRANSLATE_NOOP("XMLEntities", "Latin small ligature oe") },
+    { 352, "Scaron", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter s with caron") },
+    { 353, "scaron", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter s with caron") },
+    { 376, "Yuml", QT_TRANSLATE_NOOP("XMLEntities", "Latin capital letter y with diaeresis") },
+    { 402, "fnof", QT_TRANSLATE_NOOP("XMLEntities", "Latin small letter f with hook") },
+    { 710, "circ", QT_TRANSLATE_NOOP("XMLEntities", "modifier letter circumflex accent") },
+    { 732, "tilde", QT_TRANSLATE_NOOP("XMLEntities", "small tilde") },
+    { 913, "Alpha", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Alpha") },
+    { 914, "Beta", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Beta") },
+    { 915, "Gamma", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Gamma") },
+    { 916, "Delta", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Delta") },
+    { 917, "Epsilon", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Epsilon") },
+    { 918, "Zeta", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Zeta") },
+    { 919, "Eta", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Eta") },
+    { 920, "Theta", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Theta") },
+    { 921, "Iota", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Iota") },
+    { 922, "Kappa", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Kappa") },
+    { 923, "Lambda", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Lambda") },
+    { 924, "Mu", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Mu") },
+    { 925, "Nu", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Nu") },
+    { 926, "Xi", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Xi") },
+    { 927, "Omicron", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Omicron") },
+    { 928, "Pi", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Pi") },
+    { 929, "Rho", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Rho") },
+    { 931, "Sigma", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Sigma") },
+    { 932, "Tau", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Tau") },
+    { 933, "Upsilon", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Upsilon") },
+    { 934, "Phi", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Phi") },
+    { 935, "Chi", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Chi") },
+    { 936, "Psi", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Psi") },
+    { 937, "Omega", QT_TRANSLATE_NOOP("XMLEntities", "Greek capital letter Omega") },
+    { 945, "alpha", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter alpha") },
+    { 946, "beta", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter beta") },
+    { 947, "gamma", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter gamma") },
+    { 948, "delta", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter delta") },
+    { 949, "epsilon", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter epsilon") },
+    { 950, "zeta", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter zeta") },
+    { 951, "eta", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter eta") },
+    { 952, "theta", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter theta") },
+    { 953, "iota", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter iota") },
+    { 954, "kappa", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter kappa") },
+    { 955, "lambda", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter lambda") },
+    { 956, "mu", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter mu") },
+    { 957, "nu", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter nu") },
+    { 958, "xi", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter xi") },
+    { 959, "omicron", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter omicron") },
+    { 960, "pi", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter pi") },
+    { 961, "rho", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter rho") },
+    { 962, "sigmaf", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter final sigma") },
+    { 963, "sigma", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter sigma") },
+    { 964, "tau", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter tau") },
+    { 965, "upsilon", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter upsilon") },
+    { 966, "phi", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter phi") },
+    { 967, "chi", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter chi") },
+    { 968, "psi", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter psi") },
+    { 969, "omega", QT_TRANSLATE_NOOP("XMLEntities", "Greek small letter omega") },
+    { 977, "thetasym", QT_TRANSLATE_NOOP("XMLEntities", "Greek theta symbol") },
+    { 978, "upsih", QT_TRANSLATE_NOOP("XMLEntities", "Greek Upsilon with hook symbol") },
+    { 982, "piv", QT_TRANSLATE_NOOP("XMLEntities", "Greek pi symbol") },
+    { 8194, "ensp", QT_TRANSLATE_NOOP("XMLEntities", "en space") },
+    { 8195, "emsp", QT_TRANSLATE_NOOP("XMLEntities", "em space") },
+    { 8201, "thinsp", QT_TRANSLATE_NOOP("XMLEntities", "thin space") },
+    { 8204, "zwnj", QT_TRANSLATE_NOOP("XMLEntities", "zero-width non-joiner") },
+    { 8205, "zwj", QT_TRANSLATE_NOOP("XMLEntities", "zero-width joiner") },
+    { 8206, "lrm", QT_TRANSLATE_NOOP("XMLEntities", "left-to-right mark") },
+    { 8207, "rlm", QT_TRANSLATE_NOOP("XMLEntities", "right-to-left mark") },
+    { 8211, "ndash", QT_TRANSLATE_NOOP("XMLEntities", "en dash") },
+    { 8212, "mdash", QT_TRANSLATE_NOOP("XMLEntities", "em dash") },
+    { 8216, "lsquo", QT_TRANSLATE_NOOP("XMLEntities", "left single quotation mark") },
+    { 8217, "rsquo", QT_TRANSLATE_NOOP("XMLEntities", "right single quotation mark") },
+    { 8218, "sbquo", QT_TRANSLATE_NOOP("XMLEntities", "single low-9 quotation mark") },
+    { 8220, "ldquo", QT_TRANSLATE_NOOP("XMLEntities", "left double quotation mark") },
+    { 8221, "rdquo", QT_TRANSLATE_NOOP("XMLEntities", "right double quotation mark") },
+    { 8222, "bdquo", QT_TRANSLATE_NOOP("XMLEntities", "double low-9 quotation mark") },
+    { 8224, "dagger", QT_TRANSLATE_NOOP("XMLEntities", "dagger, obelisk") },
+    { 8225, "Dagger", QT_TRANSLATE_NOOP("XMLEntities", "double dagger, double obelisk") },
+    { 8226, "bull", QT_TRANSLATE_NOOP("XMLEntities", "bullet") },
+    { 8230, "hellip", QT_TRANSLATE_NOOP("XMLEntities", "horizontal ellipsis") },
+    { 8240, "permil", QT_TRANSLATE_NOOP("XMLEntities", "per mille sign") },
+    { 8242, "prime", QT_TRANSLATE_NOOP("XMLEntities", "prime") },
+    { 8243, "Prime", QT_TRANSLATE_NOOP("XMLEntities", "double prime") },
+    { 8249, "lsaquo", QT_TRANSLATE_NOOP("XMLEntities", "single left-pointing angle quotation mark") },
+    { 8250, "rsaquo", QT_TRANSLATE_NOOP("XMLEntities", "single right-pointing angle quotation mark") },
+    { 8254, "oline", QT_TRANSLATE_NOOP("XMLEntities", "overline") },
+    { 8260, "frasl", QT_TRANSLATE_NOOP("XMLEntities", "fraction slash") },
+    { 8364, "euro", QT_TRANSLATE_NOOP("XMLEntities", "euro sign") },
+    { 8465, "image", QT_TRANSLATE_NOOP("XMLEntities", "black-letter capital I") },
+    { 8472, "weierp", QT_TRANSLATE_NOOP("XMLEntities", "script capital P") },
+    { 8476, "real", QT_TRANSLATE_NOOP("XMLEntities", "black-letter capital R") },
+    { 8482, "trade", QT_TRANSLATE_NOOP("XMLEntities", "trademark symbol") },
+    { 8501, "alefsym", QT_TRANSLATE_NOOP("XMLEntities", "alef symbol") },
+    { 8592, "larr", QT_TRANSLATE_NOOP("XMLEntities", "leftwards arrow") },
+    { 8593, "uarr", QT_TRANSLATE_NOOP("XMLEntities", "upwards arrow") },
+    { 8594, "rarr", QT_TRANSLATE_NOOP("XMLEntities", "rightwards arrow") },
+    { 8595, "darr", QT_TRANSLATE_NOOP("XMLEntities", "downwards arrow") },
+    { 8596, "harr", QT_TRANSLATE_NOOP("XMLEntities", "left right arrow") },
+    { 8629, "crarr", QT_TRANSLATE_NOOP("XMLEntities", "downwards arrow with corner leftwards") },
+    { 8656, "lArr", QT_TRANSLATE_NOOP("XMLEntities", "leftwards double arrow") },
+    { 8657, "uArr", QT_TRANSLATE_NOOP("XMLEntities", "upwards double arrow") },
+    { 8658, "rArr", QT_TRANSLATE_NOOP("XMLEntities", "rightwards double arrow") },
+    { 8659, "dArr", QT_TRANSLATE_NOOP("XMLEntities", "downwards double arrow") },
+    { 8660, "hArr", QT_TRANSLATE_NOOP("XMLEntities", "left right double arrow") },
+    { 8704, "forall", QT_TRANSLATE_NOOP("XMLEntities", "for all") },
+    { 8706, "part", QT_TRANSLATE_NOOP("XMLEntities", "partial differential") },
+    { 8707, "exist", QT_TRANSLATE_NOOP("XMLEntities", "there exists") },
+    { 8709, "empty", QT_TRANSLATE_NOOP("XMLEntities", "empty set") },
+    { 8711, "nabla", QT_TRANSLATE_NOOP("XMLEntities", "nabla") },
+    { 8712, "isin", QT_TRANSLATE_NOOP("XMLEntities", "element of") },
+    { 8713, "notin", QT_TRANSLATE_NOOP("XMLEntities", "not an element of") },
+    { 8715, "ni", QT_TRANSLATE_NOOP("XMLEntities", "contains as member") },
+    { 8719, "prod", QT_TRANSLATE_NOOP("XMLEntities", "n-ary product") },
+    { 8721, "sum", QT_TRANSLATE_NOOP("XMLEntities", "n-ary summation") },
+    { 8722, "minus", QT_TRANSLATE_NOOP("XMLEntities", "minus sign") },
+    { 8727, "lowast", QT_TRANSLATE_NOOP("XMLEntities", "asterisk operator") },
+    { 8730, "radic", QT_TRANSLATE_NOOP("XMLEntities", "square root") },
+    { 8733, "prop", QT_TRANSLATE_NOOP("XMLEntities", "proportional to") },
+    { 8734, "infin", QT_TRANSLATE_NOOP("XMLEntities", "infinity") },
+    { 8736, "ang", QT_TRANSLATE_NOOP("XMLEntities", "angle") },
+    { 8743, "and", QT_TRANSLATE_NOOP("XMLEntities", "logical and") },
+    { 8744, "or", QT_TRANSLATE_NOOP("XMLEntities", "logical or") },
+    { 8745, "cap", QT_TRANSLATE_NOOP("XMLEntities", "intersection") },
+    { 8746, "cup", QT_TRANSLATE_NOOP("XMLEntities", "union") },
+    { 8747, "int", QT_TRANSLATE_NOOP("XMLEntities", "integral") },
+    { 8756, "there4", QT_TRANSLATE_NOOP("XMLEntities", "therefore sign") },
+    { 8764, "sim", QT_TRANSLATE_NOOP("XMLEntities", "tilde operator") },
+    { 8773, "cong", QT_TRANSLATE_NOOP("XMLEntities", "congruent to") },
+    { 8776, "asymp", QT_TRANSLATE_NOOP("XMLEntities", "almost equal to") },
+    { 8800, "ne", QT_TRANSLATE_NOOP("XMLEntities", "not equal to") },
+    { 8801, "equiv", QT_TRANSLATE_NOOP("XMLEntities", "identical to") },
+    { 8804, "le", QT_TRANSLATE_NOOP("XMLEntities", "less-than or equal to") },
+    { 8805, "ge", QT_TRANSLATE_NOOP("XMLEntities", "greater-than or equal to") },
+    { 8834, "sub", QT_TRANSLATE_NOOP("XMLEntities", "subset of") },
+    { 8835, "sup", QT_TRANSLATE_NOOP("XMLEntities", "superset of") },
+    { 8836, "nsub", QT_TRANSLATE_NOOP("XMLEntities", "not a subset of") },
+    { 8838, "sube", QT_TRANSLATE_NOOP("XMLEntities", "subset of or equal to") },
+    { 8839, "supe", QT_TRANSLATE_NOOP("XMLEntities", "superset of or equal to") },
+    { 8853, "oplus", QT_TRANSLATE_NOOP("XMLEntities", "circled plus") },
+    { 8855, "otimes", QT_TRANSLATE_NOOP("XMLEntities", "circled times") },
+    { 8869, "perp", QT_TRANSLATE_NOOP("XMLEntities", "up tack") },
+    { 8901, "sdot", QT_TRANSLATE_NOOP("XMLEntities", "dot operator") },
+    { 8968, "lceil", QT_TRANSLATE_NOOP("XMLEntities", "left ceiling") },
+    { 8969, "rceil", QT_TRANSLATE_NOOP("XMLEntities", "right ceiling") },
+    { 8970, "lfloor", QT_TRANSLATE_NOOP("XMLEntities", "left floor") },
+    { 8971, "rfloor", QT_TRANSLATE_NOOP("XMLEntities", "right floor") },
+    { 9001, "lang", QT_TRANSLATE_NOOP("XMLEntities", "left-pointing angle bracket") },
+    { 9002, "rang", QT_TRANSLATE_NOOP("XMLEntities", "right-pointing angle bracket") },
+    { 9674, "loz", QT_TRANSLATE_NOOP("XMLEntities", "lozenge") },
+    { 9824, "spades", QT_TRANSLATE_NOOP("XMLEntities", "black spade suit") },
+    { 9827, "clubs", QT_TRANSLATE_NOOP("XMLEntities", "black club suit") },
+    { 9829, "hearts", QT_TRANSLATE_NOOP("XMLEntities", "black heart suit") },
+    { 9830, "diams", QT_TRANSLATE_NOOP("XMLEntities", "black diamond suit") },
+};
+
+const int ENTITY_COUNT = sizeof(ENTITIES) / sizeof(ENTITIES[0]);
+
+// The slots in ENTITIES sorted by name (byte order)
+const ushort ENTITIES_BY_NAME[] = {
+    43, 38, 39, 37, 109, 42, 40, 41, 110, 44, 130, 177, 112, 53, 46, 47, 45, 113,
+    115, 48, 111, 50, 51, 49, 117, 52, 118, 119, 120, 54, 121, 101, 56, 57, 55, 132,
+    123, 61, 58, 59, 129, 124, 182, 131, 125, 103, 126, 67, 127, 116, 63, 64, 62,
+    128, 65, 122, 66, 105, 114, 70, 71, 25, 75, 69, 192, 133, 1, 220, 219, 2, 74,
+    228, 72, 73, 175, 134, 11, 178, 222, 76, 29, 7, 155, 107, 250, 227, 14, 198,
+    223, 9, 202, 176, 196, 21, 136, 252, 92, 78, 79, 77, 207, 162, 161, 137, 230,
+    139, 85, 80, 187, 206, 106, 204, 34, 33, 35, 186, 135, 232, 4, 203, 197, 251,
+    179, 82, 83, 6, 81, 188, 218, 224, 141, 36, 209, 84, 142, 199, 143, 246, 16,
+    193, 242, 173, 231, 244, 215, 248, 166, 183, 170, 3, 20, 169, 26, 28, 214, 144,
+    208, 5, 168, 229, 211, 17, 210, 235, 86, 145, 88, 89, 102, 87, 185, 157, 147,
+    238, 221, 15, 31, 93, 90, 239, 91, 27, 205, 180, 240, 154, 148, 160, 22, 8, 181,
+    212, 217, 156, 0, 201, 216, 247, 32, 195, 243, 174, 190, 19, 245, 149, 167, 184,
+    171, 172, 104, 241, 12, 18, 151, 150, 226, 249, 233, 236, 213, 234, 30, 23, 24,
+    237, 68, 152, 225, 140, 158, 163, 99, 108, 60, 191, 200, 95, 194, 96, 94, 13,
+    159, 153, 97, 189, 146, 98, 10, 100, 138, 165, 164,
+};
+
+bool CodeLess(const EntityEntry &entry, ushort code)
+{
+    return entry.code < code;
+}
+
+struct NameLess {
+    bool operator()(ushort index, const char *name) const
+    {
+        return strcmp(ENTITIES[index].name, name) < 0;
+    }
+};
+
+// The entry for code, or NULL
+const EntityEntry *FindByCode(ushort code)
+{
+    const EntityEntry *end = ENTITIES + ENTITY_COUNT;
+    const EntityEntry *entry = std::lower_bound(ENTITIES, end, code, CodeLess);
+    return (entry != end && entry->code == code) ? entry : NULL;
+}
+
+}
+
 XMLEntities *XMLEntities::m_instance = 0;
 
 XMLEntities *XMLEntities::instance()
@@ -37,20 +349,14 @@ XMLEntities *XMLEntities::instance()
 
 QString XMLEntities::GetEntityName(ushort code)
 {
-    QString name;
-    if (m_EntityName.contains(code)) {
-        name = m_EntityName.value(code, QString());
-    }
-    return name;
+    const EntityEntry *entry = FindByCode(code);
+    return entry ? QString::fromLatin1(entry->name) : QString();
 }
 
 QString XMLEntities::GetEntityDescription(ushort code)
 {
-    QString name;
-    if (m_EntityDescription.contains(code)) {
-        name = m_EntityDescription.value(code, QString());
-    }
-    return name;
+    const EntityEntry *entry = FindByCode(code);
+    return entry ? tr(entry->description) : QString();
 }
 
 ushort XMLEntities::GetEntityCode(const QString name)
@@ -73,287 +379,23 @@ ushort XMLEntities::GetEntityCode(const QString name)
                 code = rcode;
             }
         } else {
-            if (m_EntityCode.contains(root)) {
-                code = m_EntityCode.value(root, 0);
-            }
+            code = GetNamedEntityCode(root);
         }
     }
     return code;
 }
 
-XMLEntities::XMLEntities()
+ushort XMLEntities::GetNamedEntityCode(const QString &name)
 {
-    SetXMLEntities();
+    QByteArray key = name.toLatin1();
+    const ushort *end = ENTITIES_BY_NAME + ENTITY_COUNT;
+    const ushort *slot = std::lower_bound(ENTITIES_BY_NAME, end, key.constData(), NameLess());
+    if (slot != end && strcmp(ENTITIES[*slot].name, key.constData()) == 0) {
+        return ENTITIES[*slot].code;
+    }
+    return 0;
 }
 
-void XMLEntities::SetXMLEntities()
+XMLEntities::XMLEntities()
 {
-    if (!m_EntityName.isEmpty()) {
-        return;
-    }
-
-    QStringList data;
-    data <<
-         "34" << "quot" << tr("quotation mark") <<
-         "38" << "amp" << tr("ampersand") <<
-         "39" << "apos" << tr("apostrophe") <<
-         "60" << "lt" << tr("less-than sign") <<
-         "62" << "gt" << tr("greater-than sign") <<
-         "160" << "nbsp" << tr("no-break space") <<
-         "161" << "iexcl" << tr("inverted exclamation mark") <<
-         "162" << "cent" << tr("cent sign") <<
-         "163" << "pound" << tr("pound sign") <<
-         "164" << "curren" << tr("currency sign") <<
-         "165" << "yen" << tr("yen sign") <<
-         "166" << "brvbar" << tr("broken bar") <<
-         "167" << "sect" << tr("section sign") <<
-         "168" << "uml" << tr("diaeresis") <<
-         "169" << "copy" << tr("copyright symbol") <<
-         "170" << "ordf" << tr("feminine ordinal indicator") <<
-         "171" << "laquo" << tr("left-pointing double angle quotation mark") <<
-         "172" << "not" << tr("not sign") <<
-         "173" << "shy" << tr("soft hyphen") <<
-         "174" << "reg" << tr("registered sign") <<
-         "175" << "macr" << tr("macron") <<
-         "176" << "deg" << tr("degree symbol") <<
-         "177" << "plusmn" << tr("plus-minus sign") <<
-         "178" << "sup2" << tr("superscript two") <<
-         "179" << "sup3" << tr("superscript three") <<
-         "180" << "acute" << tr("acute accent") <<
-         "181" << "micro" << tr("micro sign") <<
-         "182" << "para" << tr("pilcrow sign") <<
-         "183" << "middot" << tr("middle dot") <<
-         "184" << "cedil" << tr("cedilla") <<
-         "185" << "sup1" << tr("superscript one") <<
-         "186" << "ordm" << tr("masculine ordinal indicator") <<
-         "187" << "raquo" << tr("right-pointing double angle quotation mark") <<
-         "188" << "frac14" << tr("vulgar fraction one quarter") <<
-         "189" << "frac12" << tr("vulgar fraction one half") <<
-         "190" << "frac34" << tr("vulgar fraction three quarters") <<
-         "191" << "iquest" << tr("inverted question mark") <<
-         "192" << "Agrave" << tr("Latin capital letter A with grave accent") <<
-         "193" << "Aacute" << tr("Latin capital letter A with acute accent") <<
-         "194" << "Acirc" << tr("Latin capital letter A with circumflex") <<
-         "195" << "Atilde" << tr("Latin capital letter A with tilde") <<
-         "196" << "Auml" << tr("Latin capital letter A with diaeresis") <<
-         "197" << "Aring" << tr("Latin capital letter A with ring above") <<
-         "198" << "AElig" << tr("Latin capital letter AE") <<
-         "199" << "Ccedil" << tr("Latin capital letter C with cedilla") <<
-         "200" << "Egrave" << tr("Latin capital letter E with grave accent") <<
-         "201" << "Eacute" << tr("Latin capital letter E with acute accent") <<
-         "202" << "Ecirc" << tr("Latin capital letter E with circumflex") <<
-         "203" << "Euml" << tr("Latin capital letter E with diaeresis") <<
-         "204" << "Igrave" << tr("Latin capital letter I with grave accent") <<
-         "205" << "Iacute" << tr("Latin capital letter I with acute accent") <<
-         "206" << "Icirc" << tr("Latin capital letter I with circumflex") <<
-         "207" << "Iuml" << tr("Latin capital letter I with diaeresis") <<
-         "208" << "ETH" << tr("Latin capital letter Eth") <<
-         "209" << "Ntilde" << tr("Latin capital letter N with tilde") <<
-         "210" << "Ograve" << tr("Latin capital letter O with grave accent") <<
-         "211" << "Oacute" << tr("Latin capital letter O with acute accent") <<
-         "212" << "Ocirc" << tr("Latin capital letter O with circumflex") <<
-         "213" << "Otilde" << tr("Latin capital letter O with tilde") <<
-         "214" << "Ouml" << tr("Latin capital letter O with diaeresis") <<
-         "215" << "times" << tr("multiplication sign") <<
-         "216" << "Oslash" << tr("Latin capital letter O with stroke") <<
-         "217" << "Ugrave" << tr("Latin capital letter U with grave accent") <<
-         "218" << "Uacute" << tr("Latin capital letter U with acute accent") <<
-         "219" << "Ucirc" << tr("Latin capital letter U with circumflex") <<
-         "220" << "Uuml" << tr("Latin capital letter U with diaeresis") <<
-         "221" << "Yacute" << tr("Latin capital letter Y with acute accent") <<
-         "222" << "THORN" << tr("Latin capital letter THORN") <<
-         "223" << "szlig" << tr("Latin small letter sharp s") <<
-         "224" << "agrave" << tr("Latin small letter a with grave accent") <<
-         "225" << "aacute" << tr("Latin small letter a with acute accent") <<
-         "226" << "acirc" << tr("Latin small letter a with circumflex") <<
-         "227" << "atilde" << tr("Latin small letter a with tilde") <<
-         "228" << "auml" << tr("Latin small letter a with diaeresis") <<
-         "229" << "aring" << tr("Latin small letter a with ring above") <<
-         "230" << "aelig" << tr("Latin small letter ae") <<
-         "231" << "ccedil" << tr("Latin small letter c with cedilla") <<
-         "232" << "egrave" << tr("Latin small letter e with grave accent") <<
-         "233" << "eacute" << tr("Latin small letter e with acute accent") <<
-         "234" << "ecirc" << tr("Latin small letter e with circumflex") <<
-         "235" << "euml" << tr("Latin small letter e with diaeresis") <<
-         "236" << "igrave" << tr("Latin small letter i with grave accent") <<
-         "237" << "iacute" << tr("Latin small letter i with acute accent") <<
-         "238" << "icirc" << tr("Latin small letter i with circumflex") <<
-         "239" << "iuml" << tr("Latin small letter i with diaeresis") <<
-         "240" << "eth" << tr("Latin small letter eth") <<
-         "241" << "ntilde" << tr("Latin small letter n with tilde") <<
-         "242" << "ograve" << tr("Latin small letter o with grave accent") <<
-         "243" << "oacute" << tr("Latin small letter o with acute accent") <<
-         "244" << "ocirc" << tr("Latin small letter o with circumflex") <<
-         "245" << "otilde" << tr("Latin small letter o with tilde") <<
-         "246" << "ouml" << tr("Latin small letter o with diaeresis") <<
-         "247" << "divide" << tr("division sign") <<
-         "248" << "oslash" << tr("Latin small letter o with stroke") <<
-         "249" << "ugrave" << tr("Latin small letter u with grave accent") <<
-         "250" << "uacute" << tr("Latin small letter u with acute accent") <<
-         "251" << "ucirc" << tr("Latin small letter u with circumflex") <<
-         "252" << "uuml" << tr("Latin small letter u with diaeresis") <<
-         "253" << "yacute" << tr("Latin small letter y with acute accent") <<
-         "254" << "thorn" << tr("Latin small letter thorn") <<
-         "255" << "yuml" << tr("Latin small letter y with diaeresis") <<
-         "338" << "OElig" << tr("Latin capital ligature oe") <<
-         "339" << "oelig" << tr("Latin small ligature oe") <<
-         "352" << "Scaron" << tr("Latin capital letter s with caron") <<
-         "353" << "scaron" << tr("Latin small letter s with caron") <<
-         "376" << "Yuml" << tr("Latin capital letter y with diaeresis") <<
-         "402" << "fnof" << tr("Latin small letter f with hook") <<
-         "710" << "circ" << tr("modifier letter circumflex accent") <<
-         "732" << "tilde" << tr("small tilde") <<
-         "913" << "Alpha" << tr("Greek capital letter Alpha") <<
-         "914" << "Beta" << tr("Greek capital letter Beta") <<
-         "915" << "Gamma" << tr("Greek capital letter Gamma") <<
-         "916" << "Delta" << tr("Greek capital letter Delta") <<
-         "917" << "Epsilon" << tr("Greek capital letter Epsilon") <<
-         "918" << "Zeta" << tr("Greek capital letter Zeta") <<
-         "919" << "Eta" << tr("Greek capital letter Eta") <<
-         "920" << "Theta" << tr("Greek capital letter Theta") <<
-         "921" << "Iota" << tr("Greek capital letter Iota") <<
-         "922" << "Kappa" << tr("Greek capital letter Kappa") <<
-         "923" << "Lambda" << tr("Greek capital letter Lambda") <<
-         "924" << "Mu" << tr("Greek capital letter Mu") <<
-         "925" << "Nu" << tr("Greek capital letter Nu") <<
-         "926" << "Xi" << tr("Greek capital letter Xi") <<
-         "927" << "Omicron" << tr("Greek capital letter Omicron") <<
-         "928" << "Pi" << tr("Greek capital letter Pi") <<
-         "929" << "Rho" << tr("Greek capital letter Rho") <<
-         "931" << "Sigma" << tr("Greek capital letter Sigma") <<
-         "932" << "Tau" << tr("Greek capital letter Tau") <<
-         "933" << "Upsilon" << tr("Greek capital letter Upsilon") <<
-         "934" << "Phi" << tr("Greek capital letter Phi") <<
-         "935" << "Chi" << tr("Greek capital letter Chi") <<
-         "936" << "Psi" << tr("Greek capital letter Psi") <<
-         "937" << "Omega" << tr("Greek capital letter Omega") <<
-         "945" << "alpha" << tr("Greek small letter alpha") <<
-         "946" << "beta" << tr("Greek small letter beta") <<
-         "947" << "gamma" << tr("Greek small letter gamma") <<
-         "948" << "delta" << tr("Greek small letter delta") <<
-         "949" << "epsilon" << tr("Greek small letter epsilon") <<
-         "950" << "zeta" << tr("Greek small letter zeta") <<
-         "951" << "eta" << tr("Greek small letter eta") <<
-         "952" << "theta" << tr("Greek small letter theta") <<
-         "953" << "iota" << tr("Greek small letter iota") <<
-         "954" << "kappa" << tr("Greek small letter kappa") <<
-         "955" << "lambda" << tr("Greek small letter lambda") <<
-         "956" << "mu" << tr("Greek small letter mu") <<
-         "957" << "nu" << tr("Greek small letter nu") <<
-         "958" << "xi" << tr("Greek small letter xi") <<
-         "959" << "omicron" << tr("Greek small letter omicron") <<
-         "960" << "pi" << tr("Greek small letter pi") <<
-         "961" << "rho" << tr("Greek small letter rho") <<
-         "962" << "sigmaf" << tr("Greek small letter final sigma") <<
-         "963" << "sigma" << tr("Greek small letter sigma") <<
-         "964" << "tau" << tr("Greek small letter tau") <<
-         "965" << "upsilon" << tr("Greek small letter upsilon") <<
-         "966" << "phi" << tr("Greek small letter phi") <<
-         "967" << "chi" << tr("Greek small letter chi") <<
-         "968" << "psi" << tr("Greek small letter psi") <<
-         "969" << "omega" << tr("Greek small letter omega") <<
-         "977" << "thetasym" << tr("Greek theta symbol") <<
-         "978" << "upsih" << tr("Greek Upsilon with hook symbol") <<
-         "982" << "piv" << tr("Greek pi symbol") <<
-         "8194" << "ensp" << tr("en space") <<
-         "8195" << "emsp" << tr("em space") <<
-         "8201" << "thinsp" << tr("thin space") <<
-         "8204" << "zwnj" << tr("zero-width non-joiner") <<
-         "8205" << "zwj" << tr("zero-width joiner") <<
-         "8206" << "lrm" << tr("left-to-right mark") <<
-         "8207" << "rlm" << tr("right-to-left mark") <<
-         "8211" << "ndash" << tr("en dash") <<
-         "8212" << "mdash" << tr("em dash") <<
-         "8216" << "lsquo" << tr("left single quotation mark") <<
-         "8217" << "rsquo" << tr("right single quotation mark") <<
-         "8218" << "sbquo" << tr("single low-9 quotation mark") <<
-         "8220" << "ldquo" << tr("left double quotation mark") <<
-         "8221" << "rdquo" << tr("right double quotation mark") <<
-         "8222" << "bdquo" << tr("double low-9 quotation mark") <<
-         "8224" << "dagger" << tr("dagger, obelisk") <<
-         "8225" << "Dagger" << tr("double dagger, double obelisk") <<
-         "8226" << "bull" << tr("bullet") <<
-         "8230" << "hellip" << tr("horizontal ellipsis") <<
-         "8240" << "permil" << tr("per mille sign") <<
-         "8242" << "prime" << tr("prime") <<
-         "8243" << "Prime" << tr("double prime") <<
-         "8249" << "lsaquo" << tr("single left-pointing angle quotation mark") <<
-         "8250" << "rsaquo" << tr("single right-pointing angle quotation mark") <<
-         "8254" << "oline" << tr("overline") <<
-         "8260" << "frasl" << tr("fraction slash") <<
-         "8364" << "euro" << tr("euro sign") <<
-         "8465" << "image" << tr("black-letter capital I") <<
-         "8472" << "weierp" << tr("script capital P") <<
-         "8476" << "real" << tr("black-letter capital R") <<
-         "8482" << "trade" << tr("trademark symbol") <<
-         "8501" << "alefsym" << tr("alef symbol") <<
-         "8592" << "larr" << tr("leftwards arrow") <<
-         "8593" << "uarr" << tr("upwards arrow") <<
-         "8594" << "rarr" << tr("rightwards arrow") <<
-         "8595" << "darr" << tr("downwards arrow") <<
-         "8596" << "harr" << tr("left right arrow") <<
-         "8629" << "crarr" << tr("downwards arrow with corner leftwards") <<
-         "8656" << "lArr" << tr("leftwards double arrow") <<
-         "8657" << "uArr" << tr("upwards double arrow") <<
-         "8658" << "rArr" << tr("rightwards double arrow") <<
-         "8659" << "dArr" << tr("downwards double arrow") <<
-         "8660" << "hArr" << tr("left right double arrow") <<
-         "8704" << "forall" << tr("for all") <<
-         "8706" << "part" << tr("partial differential") <<
-         "8707" << "exist" << tr("there exists") <<
-         "8709" << "empty" << tr("empty set") <<
-         "8711" << "nabla" << tr("nabla") <<
-         "8712" << "isin" << tr("element of") <<
-         "8713" << "notin" << tr("not an element of") <<
-         "8715" << "ni" << tr("contains as member") <<
-         "8719" << "prod" << tr("n-ary product") <<
-         "8721" << "sum" << tr("n-ary summation") <<
-         "8722" << "minus" << tr("minus sign") <<
-         "8727" << "lowast" << tr("asterisk operator") <<
-         "8730" << "radic" << tr("square root") <<
-         "8733" << "prop" << tr("proportional to") <<
-         "8734" << "infin" << tr("infinity") <<
-         "8736" << "ang" << tr("angle") <<
-         "8743" << "and" << tr("logical and") <<
-         "8744" << "or" << tr("logical or") <<
-         "8745" << "cap" << tr("intersection") <<
-         "8746" << "cup" << tr("union") <<
-         "8747" << "int" << tr("integral") <<
-         "8756" << "there4" << tr("therefore sign") <<
-         "8764" << "sim" << tr("tilde operator") <<
-         "8773" << "cong" << tr("congruent to") <<
-         "8776" << "asymp" << tr("almost equal to") <<
-         "8800" << "ne" << tr("not equal to") <<
-         "8801" << "equiv" << tr("identical to") <<
-         "8804" << "le" << tr("less-than or equal to") <<
-         "8805" << "ge" << tr("greater-than or equal to") <<
-         "8834" << "sub" << tr("subset of") <<
-         "8835" << "sup" << tr("superset of") <<
-         "8836" << "nsub" << tr("not a subset of") <<
-         "8838" << "sube" << tr("subset of or equal to") <<
-         "8839" << "supe" << tr("superset of or equal to") <<
-         "8853" << "oplus" << tr("circled plus") <<
-         "8855" << "otimes" << tr("circled times") <<
-         "8869" << "perp" << tr("up tack") <<
-         "8901" << "sdot" << tr("dot operator") <<
-         "8968" << "lceil" << tr("left ceiling") <<
-         "8969" << "rceil" << tr("right ceiling") <<
-         "8970" << "lfloor" << tr("left floor") <<
-         "8971" << "rfloor" << tr("right floor") <<
-         "9001" << "lang" << tr("left-pointing angle bracket") <<
-         "9002" << "rang" << tr("right-pointing angle bracket") <<
-         "9674" << "loz" << tr("lozenge") <<
-         "9824" << "spades" << tr("black spade suit") <<
-         "9827" << "clubs" << tr("black club suit") <<
-         "9829" << "hearts" << tr("black heart suit") <<
-         "9830" << "diams" << tr("black diamond suit");
-
-    for (int i = 0; i < data.count(); i++) {
-        ushort code = data.at(i++).toInt();
-        QString name = data.at(i++);
-        QString description = data.at(i);
-        m_EntityName.insert(code, name);
-        m_EntityDescription.insert(code, description);
-        m_EntityCode.insert(name, code);
-    }
 }
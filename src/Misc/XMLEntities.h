@@ -24,15 +24,17 @@
 #define XMLENTITIES_H
 
 #include <QtCore/QCoreApplication>
-#include <QtCore/QHash>
 
 class QString;
-class QStringList;
 
 /**
  * Singleton.
  *
  * XMLEntities routines
+ *
+ * The entities live in constant tables compiled into the program, one
+ * sorted by code and one by name, so there is nothing to build at
+ * startup and each lookup is a binary search.
  */
 class XMLEntities
 {
@@ -45,15 +47,15 @@ public:
     QString GetEntityDescription(ushort code);
     ushort GetEntityCode(const QString name);
 
+    /**
+     * @return The code of the named entity, e.g. "nbsp" without the
+     *         & and ;, or 0 if there is no such entity.
+     */
+    static ushort GetNamedEntityCode(const QString &name);
+
 private:
     XMLEntities();
 
-    void SetXMLEntities();
-
-    QHash<ushort, QString> m_EntityName;
-    QHash<ushort, QString> m_EntityDescription;
-    QHash<QString, ushort> m_EntityCode;
-
     static XMLEntities *m_instance;
 };
 
@@ -0,0 +1,312 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "unzip.h"
+#ifdef _WIN32
+#include "iowin32.h"
+#endif
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include "Misc/QCodePage437Codec.h"
+#include "Misc/RemoteFile.h"
+#include "Misc/Utility.h"
+#include "Misc/ZipIndex.h"
+
+// The file name field of a central directory record has a 16 bit length.
+static const int MAX_ZIP_NAME = 0xFFFF;
+
+static const int BUFF_SIZE = 8192;
+
+// Made once, even when the first indexes are loaded on several threads
+// at the same time. Qt keeps the codecs it registers, so it is not deleted.
+static QCodePage437Codec *Cp437Codec()
+{
+    static QCodePage437Codec *codec = new QCodePage437Codec();
+    return codec;
+}
+
+static QMutex s_CacheMutex;
+
+static ZipIndex s_Cache;
+
+
+QString ZipIndex::Entry::DisplayName() const
+{
+    if (!cp437_name.isEmpty()) {
+        return cp437_name;
+    }
+
+    return name;
+}
+
+
+bool ZipIndex::Entry::IsDirectory() const
+{
+    return uncompressed_size == 0 && name.endsWith('/');
+}
+
+
+bool ZipIndex::Entry::IsUtf8Name() const
+{
+    // General purpose bit 11 says the filename is utf-8 encoded.
+    return flag & (1<<11);
+}
+
+
+bool ZipIndex::Entry::IsEncrypted() const
+{
+    return flag & 1;
+}
+
+
+ZipIndex::ZipIndex()
+    :
+    m_IsValid(false),
+    m_FileSize(-1)
+{
+}
+
+
+bool ZipIndex::Load(const QString &zippath)
+{
+    unzFile zfile = OpenZip(zippath);
+
+    if (zfile == NULL) {
+        *this = ZipIndex();
+        return false;
+    }
+
+    bool loaded = Load(zfile);
+    unzClose(zfile);
+    QFileInfo info(zippath);
+    m_Path = info.absoluteFilePath();
+    m_FileSize = info.size();
+    m_LastModified = info.lastModified();
+    return loaded;
+}
+
+
+bool ZipIndex::Load(unzFile zfile)
+{
+    QCodePage437Codec *cp437 = Cp437Codec();
+    m_Entries.clear();
+    m_NameIndex.clear();
+    m_IsValid = false;
+
+    unz_global_info64 global_info;
+
+    if (unzGetGlobalInfo64(zfile, &global_info) == UNZ_OK) {
+        m_Entries.reserve(global_info.number_entry);
+        m_NameIndex.reserve(global_info.number_entry);
+    }
+
+    // The whole name is read; a single buffer of the largest possible
+    // length is reused for every record.
+    QByteArray file_name(MAX_ZIP_NAME + 1, '\0');
+    int res = unzGoToFirstFile(zfile);
+
+    while (res == UNZ_OK) {
+        unz_file_info64 file_info;
+
+        if (unzGetCurrentFileInfo64(zfile, &file_info, file_name.data(), MAX_ZIP_NAME, NULL, 0, NULL, 0) != UNZ_OK) {
+            return false;
+        }
+
+        QByteArray raw_name(file_name.constData(), file_info.size_filename);
+        Entry entry;
+        entry.name = QString::fromUtf8(raw_name);
+        entry.compressed_size = file_info.compressed_size;
+        entry.uncompressed_size = file_info.uncompressed_size;
+        entry.crc = file_info.crc;
+        entry.method = file_info.compression_method;
+        entry.flag = file_info.flag;
+
+        if (!entry.IsUtf8Name()) {
+            // If not set then IBM 437 encoding might be used.
+            QString cp437_name = cp437->toUnicode(raw_name);
+
+            if (cp437_name != entry.name) {
+                entry.cp437_name = cp437_name;
+            }
+        }
+
+        if (unzGetFilePos64(zfile, &entry.pos) != UNZ_OK) {
+            return false;
+        }
+
+        // If there is no file name then we can't do anything with it.
+        if (!entry.name.isEmpty()) {
+            m_NameIndex.insert(entry.name, m_Entries.count());
+
+            if (!entry.cp437_name.isEmpty()) {
+                m_NameIndex.insert(entry.cp437_name, m_Entries.count());
+            }
+
+            m_Entries.append(entry);
+        }
+
+        res = unzGoToNextFile(zfile);
+    }
+
+    m_IsValid = res == UNZ_END_OF_LIST_OF_FILE;
+    return m_IsValid;
+}
+
+
+ZipIndex ZipIndex::Cached(const QString &zippath)
+{
+    // There is no cheap way to tell whether a remote file changed
+    if (RemoteFile::IsRemote(zippath)) {
+        ZipIndex index;
+        index.Load(zippath);
+        return index;
+    }
+
+    QFileInfo info(zippath);
+    QMutexLocker locker(&s_CacheMutex);
+
+    if (!s_Cache.IsValid() ||
+        s_Cache.m_Path != info.absoluteFilePath() ||
+        s_Cache.m_FileSize != info.size() ||
+        s_Cache.m_LastModified != info.lastModified()) {
+        s_Cache.Load(zippath);
+    }
+
+    return s_Cache;
+}
+
+
+bool ZipIndex::IsValid() const
+{
+    return m_IsValid;
+}
+
+
+int ZipIndex::Count() const
+{
+    return m_Entries.count();
+}
+
+
+const ZipIndex::Entry &ZipIndex::At(int index) const
+{
+    return m_Entries.at(index);
+}
+
+
+const QVector<ZipIndex::Entry> &ZipIndex::Entries() const
+{
+    return m_Entries;
+}
+
+
+int ZipIndex::IndexOf(const QString &name) const
+{
+    return m_NameIndex.value(name, -1);
+}
+
+
+bool ZipIndex::Contains(const QString &name) const
+{
+    return m_NameIndex.contains(name);
+}
+
+
+const ZipIndex::Entry *ZipIndex::Find(const QString &name) const
+{
+    int index = IndexOf(name);
+
+    if (index < 0) {
+        return NULL;
+    }
+
+    return &m_Entries.at(index);
+}
+
+
+unzFile ZipIndex::OpenZip(const QString &zippath)
+{
+    if (RemoteFile::IsRemote(zippath)) {
+        zlib_filefunc64_def ffunc;
+        RemoteFile::FillFileFunc(&ffunc);
+        return unzOpen2_64(zippath.toUtf8().constData(), &ffunc);
+    }
+
+    if (!Utility::IsFileReadable(zippath)) {
+        return NULL;
+    }
+
+#ifdef Q_OS_WIN32
+    zlib_filefunc64_def ffunc;
+    fill_win32_filefunc64W(&ffunc);
+    return unzOpen2_64(Utility::QStringToStdWString(QDir::toNativeSeparators(zippath)).c_str(), &ffunc);
+#else
+    return unzOpen64(QDir::toNativeSeparators(zippath).toUtf8().constData());
+#endif
+}
+
+
+bool ZipIndex::ExtractEntry(unzFile zfile, const unz64_file_pos &pos, const QString &file_path)
+{
+    // Open the file entry in the archive for reading.
+    if (unzGoToFilePos64(zfile, &pos) != UNZ_OK || unzOpenCurrentFile(zfile) != UNZ_OK) {
+        return false;
+    }
+
+    // Open the file on disk to write the entry in the archive to.
+    QFile entry(file_path);
+
+    if (!entry.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        unzCloseCurrentFile(zfile);
+        return false;
+    }
+
+    // Buffered reading and writing.
+    char buff[BUFF_SIZE] = {0};
+    int read = 0;
+
+    while ((read = unzReadCurrentFile(zfile, buff, BUFF_SIZE)) > 0) {
+        entry.write(buff, read);
+    }
+
+    entry.close();
+
+    // Read errors are marked by a negative read amount.
+    if (read < 0) {
+        unzCloseCurrentFile(zfile);
+        return false;
+    }
+
+    // The file was read but the CRC did not match.
+    // We don't check the read file size vs the uncompressed file size
+    // because if they're different there should be a CRC error.
+    return unzCloseCurrentFile(zfile) != UNZ_CRCERROR;
+}
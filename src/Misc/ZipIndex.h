@@ -0,0 +1,161 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef ZIPINDEX_H
+#define ZIPINDEX_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "unzip.h"
+
+/**
+ * The central directory of a zip archive, read once.
+ *
+ * The entries are kept in archive order in a flat array and
+ * a hash maps every entry name (and its code page 437 reading,
+ * when that differs) to its slot, so lookups do not rescan
+ * the archive. Copies are cheap: the data is implicitly shared.
+ */
+class ZipIndex
+{
+public:
+
+    /**
+     * One file entry of the archive.
+     */
+    struct Entry {
+        /**
+         * The name read as UTF-8.
+         */
+        QString name;
+
+        /**
+         * The name read as IBM code page 437 when general purpose
+         * bit 11 is not set and that reading differs, else empty.
+         */
+        QString cp437_name;
+
+        /**
+         * Where the entry lives, for unzGoToFilePos64.
+         */
+        unz64_file_pos pos;
+
+        quint64 compressed_size;
+        quint64 uncompressed_size;
+        quint32 crc;
+        int method;
+        int flag;
+
+        /**
+         * The name used by the rest of Sigil: the cp437 reading
+         * when there is one, else the UTF-8 one.
+         */
+        QString DisplayName() const;
+
+        bool IsDirectory() const;
+
+        bool IsUtf8Name() const;
+
+        bool IsEncrypted() const;
+    };
+
+    /**
+     * Constructs an empty, invalid index.
+     */
+    ZipIndex();
+
+    /**
+     * Reads the central directory of the archive at zippath.
+     *
+     * @return True if the whole directory could be read.
+     */
+    bool Load(const QString &zippath);
+
+    /**
+     * Reads the central directory of an archive that is already open.
+     * The current file of zfile is moved.
+     */
+    bool Load(unzFile zfile);
+
+    /**
+     * Returns the index of the archive at zippath, reusing the one read
+     * last time if the file has not changed since.
+     */
+    static ZipIndex Cached(const QString &zippath);
+
+    bool IsValid() const;
+
+    int Count() const;
+
+    const Entry &At(int index) const;
+
+    const QVector<Entry> &Entries() const;
+
+    /**
+     * @return The slot of the entry with that name, or -1.
+     */
+    int IndexOf(const QString &name) const;
+
+    bool Contains(const QString &name) const;
+
+    /**
+     * @return The entry with that name, or NULL.
+     */
+    const Entry *Find(const QString &name) const;
+
+    /**
+     * Opens the archive at zippath for reading, with wide character
+     * paths on Windows. zippath may also be an http or https URL
+     * of a server that serves byte ranges; see RemoteFile.
+     *
+     * @return The handle, or NULL.
+     */
+    static unzFile OpenZip(const QString &zippath);
+
+    /**
+     * Inflates the entry at pos to file_path.
+     *
+     * @return False on a read, write or CRC error.
+     */
+    static bool ExtractEntry(unzFile zfile, const unz64_file_pos &pos, const QString &file_path);
+
+private:
+
+    QVector<Entry> m_Entries;
+
+    QHash<QString, int> m_NameIndex;
+
+    bool m_IsValid;
+
+    /**
+     * The file the index was read from, used by Cached().
+     */
+    QString m_Path;
+    qint64 m_FileSize;
+    QDateTime m_LastModified;
+};
+
+#endif // ZIPINDEX_H
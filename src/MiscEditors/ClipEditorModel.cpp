@@ -23,6 +23,7 @@
 *************************************************************************/
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QFileInfo>
 #include <QByteArray>
 #include <QDataStream>
 #include <QtCore/QTime>
@@ -41,6 +42,7 @@ const int COLUMNS = 2;
 
 static const int IS_GROUP_ROLE = Qt::UserRole + 1;
 static const int FULLNAME_ROLE = Qt::UserRole + 2;
+static const int PENDING_ROLE = Qt::UserRole + 3;
 
 static const QString CLIP_EXAMPLES_FILE = "clip_entries.ini";
 
@@ -58,16 +60,21 @@ ClipEditorModel *ClipEditorModel::instance()
 ClipEditorModel::ClipEditorModel(QObject *parent)
     : QStandardItemModel(parent),
       m_FSWatcher(new QFileSystemWatcher()),
-      m_IsDataModified(false)
+      m_IsDataModified(false),
+      m_NextPendingId(0)
 {
     m_SettingsPath = Utility::DefinePrefsDir() + "/" + SETTINGS_FILE;
     QStringList header;
     header.append(tr("Name"));
     header.append(tr("Text"));
     setHorizontalHeaderLabels(header);
+    bool has_settings_file = QFile::exists(m_SettingsPath);
     LoadInitialData();
+
     // Save it to make sure we have a file in case it was loaded from examples
-    SaveData();
+    if (!has_settings_file) {
+        SaveData();
+    }
 
     if (!m_FSWatcher->files().contains(m_SettingsPath)) {
         m_FSWatcher->addPath(m_SettingsPath);
@@ -248,6 +255,11 @@ void ClipEditorModel::SettingsFileChanged(const QString &path) const
             m_FSWatcher->addPath(path);
         }
 
+        // Nothing to do if it is still as it was last loaded or saved
+        if (FileStamp(path) == m_SettingsStamp) {
+            return;
+        }
+
         instance()->LoadInitialData();
         emit SettingsFileUpdated();
     }
@@ -312,6 +324,8 @@ QStandardItem *ClipEditorModel::GetItemFromName(QString name, QStandardItem *ite
 {
     QStandardItem *found_item = NULL;
 
+    FetchAllEntries(item);
+
     if (!item) {
         item = invisibleRootItem();
     }
@@ -335,6 +349,8 @@ QStandardItem *ClipEditorModel::GetItemFromName(QString name, QStandardItem *ite
 void ClipEditorModel::LoadInitialData()
 {
     removeRows(0, rowCount());
+    m_PendingEntries.clear();
+    m_SettingsStamp = FileStamp(m_SettingsPath);
     LoadData();
 
     if (invisibleRootItem()->rowCount() == 0) {
@@ -344,6 +360,84 @@ void ClipEditorModel::LoadInitialData()
     SetDataModified(false);
 }
 
+void ClipEditorModel::FetchEntries(QStandardItem *item)
+{
+    if (!item || m_PendingEntries.isEmpty()) {
+        return;
+    }
+
+    QVariant pending_id = item->data(PENDING_ROLE);
+
+    if (!pending_id.isValid() || !m_PendingEntries.contains(pending_id.toInt())) {
+        return;
+    }
+
+    QList<ClipEditorModel::clipEntry> entries = m_PendingEntries.take(pending_id.toInt());
+    // Reading in entries already saved is not a change to them
+    bool modified = m_IsDataModified;
+
+    for (int i = 0; i < entries.count(); i++) {
+        AddFullNameEntry(&entries[i], item);
+    }
+
+    m_IsDataModified = modified;
+}
+
+void ClipEditorModel::FetchAllEntries(QStandardItem *item)
+{
+    if (m_PendingEntries.isEmpty()) {
+        return;
+    }
+
+    if (!item) {
+        item = invisibleRootItem();
+    }
+
+    FetchEntries(item);
+
+    for (int row = 0; row < item->rowCount(); row++) {
+        FetchAllEntries(item->child(row, 0));
+    }
+}
+
+bool ClipEditorModel::hasChildren(const QModelIndex &parent) const
+{
+    QStandardItem *item = itemFromIndex(parent);
+
+    if (item && item->data(PENDING_ROLE).isValid() && m_PendingEntries.contains(item->data(PENDING_ROLE).toInt())) {
+        return true;
+    }
+
+    return QStandardItemModel::hasChildren(parent);
+}
+
+bool ClipEditorModel::canFetchMore(const QModelIndex &parent) const
+{
+    QStandardItem *item = itemFromIndex(parent);
+
+    if (item && item->data(PENDING_ROLE).isValid()) {
+        return m_PendingEntries.contains(item->data(PENDING_ROLE).toInt());
+    }
+
+    return false;
+}
+
+void ClipEditorModel::fetchMore(const QModelIndex &parent)
+{
+    FetchEntries(itemFromIndex(parent));
+}
+
+QString ClipEditorModel::FileStamp(const QString &path)
+{
+    QFileInfo info(path);
+
+    if (!info.exists()) {
+        return QString();
+    }
+
+    return QString::number(info.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(info.size());
+}
+
 void ClipEditorModel::LoadData(const QString &filename, QStandardItem *item)
 {
     QString settings_path = filename;
@@ -353,6 +447,8 @@ void ClipEditorModel::LoadData(const QString &filename, QStandardItem *item)
 
     int size = ss.beginReadArray(SETTINGS_GROUP);
 
+    QHash<QString, QStandardItem *> top_groups;
+
     // Add one entry at a time to the list
     for (int i = 0; i < size; ++i) {
         ss.setArrayIndex(i);
@@ -365,6 +461,33 @@ void ClipEditorModel::LoadData(const QString &filename, QStandardItem *item)
         entry->name = fullname;
         entry->fullname = fullname;
         entry->text = ss.value(ENTRY_TEXT).toString();
+
+        // Entries in top level groups wait until the group is expanded
+        if (!item && fullname.indexOf("/") > 0) {
+            QString group_name = fullname.left(fullname.indexOf("/"));
+            QStandardItem *group_item = top_groups.value(group_name);
+
+            if (!group_item) {
+                ClipEditorModel::clipEntry *group_entry = new ClipEditorModel::clipEntry();
+                group_entry->is_group = true;
+                group_entry->name = group_name;
+                group_item = AddEntryToModel(group_entry, true);
+                delete group_entry;
+                group_item->setData(m_NextPendingId++, PENDING_ROLE);
+                top_groups.insert(group_name, group_item);
+            }
+
+            entry->name = fullname.mid(group_name.length() + 1);
+
+            if (!entry->name.isEmpty()) {
+                int pending_id = group_item->data(PENDING_ROLE).toInt();
+                m_PendingEntries[pending_id].append(*entry);
+            }
+
+            delete entry;
+            continue;
+        }
+
         AddFullNameEntry(entry, item);
 	delete entry;
     }
@@ -532,6 +655,8 @@ QList<QStandardItem *> ClipEditorModel::GetNonGroupItems(QStandardItem *item)
 {
     QList<QStandardItem *> items;
 
+    FetchAllEntries(item);
+
     if (!item->data(IS_GROUP_ROLE).toBool()) {
         items.append(item);
     }
@@ -556,6 +681,8 @@ QList<QStandardItem *> ClipEditorModel::GetNonParentItems(QStandardItem *item)
 {
     QList<QStandardItem *> items;
 
+    FetchAllEntries(item);
+
     if (item->rowCount() == 0) {
         if (item != invisibleRootItem()) {
             items.append(item);
@@ -658,6 +785,7 @@ QString ClipEditorModel::SaveData(QList<ClipEditorModel::clipEntry *> entries, c
 
     // Save everything if no entries selected
     if (entries.isEmpty()) {
+        FetchAllEntries();
         QList<QStandardItem *> items = GetNonParentItems(invisibleRootItem());
 
         if (!items.isEmpty()) {
@@ -715,6 +843,10 @@ QString ClipEditorModel::SaveData(QList<ClipEditorModel::clipEntry *> entries, c
     }
 
 
+    if (settings_path == m_SettingsPath) {
+        m_SettingsStamp = FileStamp(settings_path);
+    }
+
     // Watch the file again
     m_FSWatcher->addPath(settings_path);
     SetDataModified(false);
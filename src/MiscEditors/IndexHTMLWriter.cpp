@@ -20,6 +20,8 @@
 **
 *************************************************************************/
 
+#include <QRegularExpression>
+
 #include "MiscEditors/IndexHTMLWriter.h"
 #include "MiscEditors/IndexEntries.h"
 #include "sigil_constants.h"
@@ -54,29 +56,142 @@ static const QString TEMPLATE_END_TEXT =
 
 
 IndexHTMLWriter::IndexHTMLWriter()
-    :
-    m_IndexHTMLFile(QString())
 {
 }
 
 QString IndexHTMLWriter::WriteXML(const QString &version)
 {
-    if (version.startsWith('2')) {
-        m_IndexHTMLFile += TEMPLATE_BEGIN_TEXT;
-    } else {
-        m_IndexHTMLFile += TEMPLATE3_BEGIN_TEXT;
+    return WriteSections(version, 0, QString()).first();
+}
+
+QStringList IndexHTMLWriter::WriteSections(const QString &version, int max_section_length, const QString &filename)
+{
+    m_Blocks.clear();
+    // Entries ahead of the first letter, if any
+    QString before;
+    WriteEntries(before);
+    if (!before.isEmpty() || m_Blocks.isEmpty()) {
+        LetterBlock block;
+        block.html = before;
+        m_Blocks.prepend(block);
     }
-    m_IndexHTMLFile += "<div class=\"sgc-index-title\">";
-    m_IndexHTMLFile += QObject::tr("Index");
-    m_IndexHTMLFile += "</div>\n";
-    m_IndexHTMLFile += "<div class=\"sgc-index-body\">";
-    WriteEntries();
-    m_IndexHTMLFile += "</div>";
-    m_IndexHTMLFile += TEMPLATE_END_TEXT;
-    return m_IndexHTMLFile;
+
+    // Whole letters go to each page until the next would take it over the limit
+    QList<QPair<int, int> > sections;
+    int first = 0;
+    int length = 0;
+    for (int i = 0; i < m_Blocks.count(); i++) {
+        if (max_section_length > 0 && i > first && length + m_Blocks.at(i).html.length() > max_section_length) {
+            sections.append(qMakePair(first, i - 1));
+            first = i;
+            length = 0;
+        }
+        length += m_Blocks.at(i).html.length();
+    }
+    sections.append(qMakePair(first, m_Blocks.count() - 1));
+
+    QStringList labels;
+    for (int i = 0; i < sections.count(); i++) {
+        QStringList letters;
+        for (int j = sections.at(i).first; j <= sections.at(i).second; j++) {
+            if (!m_Blocks.at(j).letter.isEmpty()) {
+                letters.append(m_Blocks.at(j).letter);
+            }
+        }
+        if (letters.isEmpty()) {
+            labels.append(QString(QChar(0x2026)));
+        } else if (letters.count() == 1) {
+            labels.append(letters.first().toHtmlEscaped());
+        } else {
+            labels.append(letters.first().toHtmlEscaped() % QChar(0x2013) % letters.last().toHtmlEscaped());
+        }
+    }
+
+    QStringList pages;
+    for (int i = 0; i < sections.count(); i++) {
+        QString links;
+        if (sections.count() > 1) {
+            links += "<div class=\"sgc-index-sections\">";
+            for (int j = 0; j < sections.count(); j++) {
+                if (j > 0) {
+                    links += " | ";
+                }
+                if (j == i) {
+                    links += labels.at(j);
+                } else {
+                    links += "<a href=\"" % SectionFilename(filename, j).toHtmlEscaped() % "\">" % labels.at(j) % "</a>";
+                }
+            }
+            links += "</div>\n";
+        }
+        pages.append(WritePage(version, links, m_Blocks, sections.at(i).first, sections.at(i).second));
+    }
+    m_Blocks.clear();
+    return pages;
 }
 
-void IndexHTMLWriter::WriteEntries(QStandardItem *parent_item)
+QString IndexHTMLWriter::SectionFilename(const QString &filename, int section)
+{
+    if (section == 0) {
+        return filename;
+    }
+
+    int dot = filename.lastIndexOf('.');
+    if (dot < 0) {
+        dot = filename.length();
+    }
+    return filename.left(dot) % "_" % QString::number(section + 1) % filename.mid(dot);
+}
+
+int IndexHTMLWriter::SectionNumber(const QString &filename, const QString &section_filename)
+{
+    if (section_filename == filename) {
+        return 0;
+    }
+
+    int dot = filename.lastIndexOf('.');
+    if (dot < 0) {
+        dot = filename.length();
+    }
+    QRegularExpression section_name("^" % QRegularExpression::escape(filename.left(dot)) % "_([0-9]+)" %
+                                    QRegularExpression::escape(filename.mid(dot)) % "$");
+    QRegularExpressionMatch match = section_name.match(section_filename);
+    if (!match.hasMatch()) {
+        return -1;
+    }
+
+    int number = match.captured(1).toInt();
+    return number >= 2 ? number - 1 : -1;
+}
+
+QString IndexHTMLWriter::WritePage(const QString &version, const QString &links, const QList<LetterBlock> &blocks,
+                                   int first, int last)
+{
+    const QString &begin_text = version.startsWith('2') ? TEMPLATE_BEGIN_TEXT : TEMPLATE3_BEGIN_TEXT;
+    const QString title = QObject::tr("Index");
+    int length = begin_text.length() + title.length() + links.length() + TEMPLATE_END_TEXT.length() + 100;
+    for (int i = first; i <= last; i++) {
+        length += blocks.at(i).html.length();
+    }
+
+    // Sized once up front rather than grown entry by entry
+    QString page;
+    page.reserve(length);
+    page += begin_text;
+    page += "<div class=\"sgc-index-title\">";
+    page += title;
+    page += "</div>\n";
+    page += links;
+    page += "<div class=\"sgc-index-body\">";
+    for (int i = first; i <= last; i++) {
+        page += blocks.at(i).html;
+    }
+    page += "</div>";
+    page += TEMPLATE_END_TEXT;
+    return page;
+}
+
+void IndexHTMLWriter::WriteEntries(QString &out, QStandardItem *parent_item)
 {
     QStandardItem *root_item = IndexEntries::instance()->GetRootItem();
 
@@ -97,6 +212,8 @@ void IndexHTMLWriter::WriteEntries(QStandardItem *parent_item)
             continue;
         }
 
+        QString html;
+
         // Need to html escape entry text
         // If the first letter of this entry is different than the last
         // entry then insert a special separator.
@@ -104,17 +221,21 @@ void IndexHTMLWriter::WriteEntries(QStandardItem *parent_item)
         QChar new_letter = item->text()[0].toLower();
         if (new_letter != letter && parent_item == root_item) {
             letter = new_letter;
-            m_IndexHTMLFile += "<div class=\"sgc-index-new-letter\">";
+            // Each letter is kept apart so the index can be split between them
+            LetterBlock block;
+            block.letter = QString(letter.toUpper());
+            m_Blocks.append(block);
+            html += "<div class=\"sgc-index-new-letter\">";
             // starting letter may be an & or > or < - therefore html escape it
-            m_IndexHTMLFile += QString(letter.toUpper()).toHtmlEscaped();
-            m_IndexHTMLFile += "</div>";
+            html += QString(letter.toUpper()).toHtmlEscaped();
+            html += "</div>";
         }
 
-        m_IndexHTMLFile += "<div class=\"sgc-index-entry\">";
+        html += "<div class=\"sgc-index-entry\">";
         // make sure to use the html escaped text here for entry
         QString etext = item->text().toHtmlEscaped();
-        m_IndexHTMLFile += etext % "\n";
-        m_IndexHTMLFile += " ";
+        html += etext % "\n";
+        html += " ";
 
         // Print all the targets for this entry
         int ref_count = 1;
@@ -123,16 +244,22 @@ void IndexHTMLWriter::WriteEntries(QStandardItem *parent_item)
             if (item->child(j, 0)->rowCount() == 0) {
                 QString target = "../Text/" % item->child(j, 0)->text();
                 if (ref_count > 1) {
-                    m_IndexHTMLFile += ", ";
+                    html += ", ";
                 }
-                m_IndexHTMLFile += "<a href=\"" % target % "\">" % QString::number(ref_count) % "</a>";
+                html += "<a href=\"" % target % "\">" % QString::number(ref_count) % "</a>";
                 ref_count++;
 
             }
         }
 
         // Print any subentries and their targets
-        WriteEntries(item);
-        m_IndexHTMLFile += "</div>";
+        WriteEntries(html, item);
+        html += "</div>";
+
+        if (parent_item == root_item && !m_Blocks.isEmpty()) {
+            m_Blocks.last().html += html;
+        } else {
+            out += html;
+        }
     }
 }
@@ -24,9 +24,13 @@
 #define INDEXWRITER_H
 
 #include <QStandardItem>
+#include <QStringList>
 
 /**
- * Writes the Index into an HTML file of the EPUB publication.
+ * Writes the Index into HTML files of the EPUB publication.
+ *
+ * A large index is written as several pages, split only between
+ * letters, each starting with links to all of them.
  */
 class IndexHTMLWriter
 {
@@ -35,10 +39,40 @@ public:
 
     QString WriteXML(const QString &version);
 
+    /**
+     * Writes the index as pages of about max_section_length characters
+     * each; 0 writes it as one page. A letter is never split.
+     *
+     * @param filename The file name of the first page. The names of
+     *                 the others are given by SectionFilename().
+     * @return The text of each page, in order.
+     */
+    QStringList WriteSections(const QString &version, int max_section_length, const QString &filename);
+
+    /**
+     * @return The file name of page section (counted from 0) of the
+     *         index whose first page is filename.
+     */
+    static QString SectionFilename(const QString &filename, int section);
+
+    /**
+     * @return The page of the index whose first page is filename that
+     *         section_filename names, or -1 if it names none.
+     */
+    static int SectionNumber(const QString &filename, const QString &section_filename);
+
 private:
-    void WriteEntries(QStandardItem *parent_item = NULL);
+    struct LetterBlock {
+        QString letter;
+        QString html;
+    };
+
+    void WriteEntries(QString &out, QStandardItem *parent_item = NULL);
+
+    QString WritePage(const QString &version, const QString &links, const QList<LetterBlock> &blocks,
+                      int first, int last);
 
-    QString m_IndexHTMLFile;
+    QList<LetterBlock> m_Blocks;
 };
 
 #endif // INDEXWRITER_H
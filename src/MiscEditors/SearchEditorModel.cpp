@@ -23,6 +23,7 @@
 *************************************************************************/
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QFileInfo>
 #include <QByteArray>
 #include <QDataStream>
 #include <QtCore/QTime>
@@ -42,6 +43,7 @@ const int COLUMNS = 3;
 
 static const int IS_GROUP_ROLE = Qt::UserRole + 1;
 static const int FULLNAME_ROLE = Qt::UserRole + 2;
+static const int PENDING_ROLE = Qt::UserRole + 3;
 
 static const QString SEARCH_EXAMPLES_FILE = "search_entries.ini";
 
@@ -59,7 +61,8 @@ SearchEditorModel *SearchEditorModel::instance()
 SearchEditorModel::SearchEditorModel(QObject *parent)
     : QStandardItemModel(parent),
       m_FSWatcher(new QFileSystemWatcher()),
-      m_IsDataModified(false)
+      m_IsDataModified(false),
+      m_NextPendingId(0)
 {
     m_SettingsPath = Utility::DefinePrefsDir() + "/" + SETTINGS_FILE;
     QStringList header;
@@ -67,9 +70,13 @@ SearchEditorModel::SearchEditorModel(QObject *parent)
     header.append(tr("Find"));
     header.append(tr("Replace"));
     setHorizontalHeaderLabels(header);
+    bool has_settings_file = QFile::exists(m_SettingsPath);
     LoadInitialData();
+
     // Save it to make sure we have a file in case it was loaded from examples
-    SaveData();
+    if (!has_settings_file) {
+        SaveData();
+    }
 
     if (!m_FSWatcher->files().contains(m_SettingsPath)) {
         m_FSWatcher->addPath(m_SettingsPath);
@@ -235,6 +242,11 @@ void SearchEditorModel::SettingsFileChanged(const QString &path) const
             m_FSWatcher->addPath(path);
         }
 
+        // Nothing to do if it is still as it was last loaded or saved
+        if (FileStamp(path) == m_SettingsStamp) {
+            return;
+        }
+
         instance()->LoadInitialData();
         emit SettingsFileUpdated();
     }
@@ -259,6 +271,8 @@ QStandardItem *SearchEditorModel::GetItemFromName(const QString &name, QStandard
 {
     QStandardItem *found_item = NULL;
 
+    FetchAllEntries(item);
+
     if (!item) {
         item = invisibleRootItem();
     }
@@ -282,6 +296,8 @@ QStandardItem *SearchEditorModel::GetItemFromName(const QString &name, QStandard
 void SearchEditorModel::LoadInitialData()
 {
     removeRows(0, rowCount());
+    m_PendingEntries.clear();
+    m_SettingsStamp = FileStamp(m_SettingsPath);
     LoadData();
 
     if (invisibleRootItem()->rowCount() == 0) {
@@ -291,6 +307,84 @@ void SearchEditorModel::LoadInitialData()
     SetDataModified(false);
 }
 
+void SearchEditorModel::FetchEntries(QStandardItem *item)
+{
+    if (!item || m_PendingEntries.isEmpty()) {
+        return;
+    }
+
+    QVariant pending_id = item->data(PENDING_ROLE);
+
+    if (!pending_id.isValid() || !m_PendingEntries.contains(pending_id.toInt())) {
+        return;
+    }
+
+    QList<SearchEditorModel::searchEntry> entries = m_PendingEntries.take(pending_id.toInt());
+    // Reading in entries already saved is not a change to them
+    bool modified = m_IsDataModified;
+
+    for (int i = 0; i < entries.count(); i++) {
+        AddFullNameEntry(&entries[i], item);
+    }
+
+    m_IsDataModified = modified;
+}
+
+void SearchEditorModel::FetchAllEntries(QStandardItem *item)
+{
+    if (m_PendingEntries.isEmpty()) {
+        return;
+    }
+
+    if (!item) {
+        item = invisibleRootItem();
+    }
+
+    FetchEntries(item);
+
+    for (int row = 0; row < item->rowCount(); row++) {
+        FetchAllEntries(item->child(row, 0));
+    }
+}
+
+bool SearchEditorModel::hasChildren(const QModelIndex &parent) const
+{
+    QStandardItem *item = itemFromIndex(parent);
+
+    if (item && item->data(PENDING_ROLE).isValid() && m_PendingEntries.contains(item->data(PENDING_ROLE).toInt())) {
+        return true;
+    }
+
+    return QStandardItemModel::hasChildren(parent);
+}
+
+bool SearchEditorModel::canFetchMore(const QModelIndex &parent) const
+{
+    QStandardItem *item = itemFromIndex(parent);
+
+    if (item && item->data(PENDING_ROLE).isValid()) {
+        return m_PendingEntries.contains(item->data(PENDING_ROLE).toInt());
+    }
+
+    return false;
+}
+
+void SearchEditorModel::fetchMore(const QModelIndex &parent)
+{
+    FetchEntries(itemFromIndex(parent));
+}
+
+QString SearchEditorModel::FileStamp(const QString &path)
+{
+    QFileInfo info(path);
+
+    if (!info.exists()) {
+        return QString();
+    }
+
+    return QString::number(info.lastModified().toMSecsSinceEpoch()) + "|" + QString::number(info.size());
+}
+
 void SearchEditorModel::LoadData(const QString &filename, QStandardItem *item)
 {
     QString settings_path = filename;
@@ -300,6 +394,8 @@ void SearchEditorModel::LoadData(const QString &filename, QStandardItem *item)
 
     int size = ss.beginReadArray(SETTINGS_GROUP);
 
+    QHash<QString, QStandardItem *> top_groups;
+
     // Add one entry at a time to the list
     for (int i = 0; i < size; ++i) {
         ss.setArrayIndex(i);
@@ -313,6 +409,33 @@ void SearchEditorModel::LoadData(const QString &filename, QStandardItem *item)
         entry->fullname = fullname;
         entry->find = ss.value(ENTRY_FIND).toString();
         entry->replace = ss.value(ENTRY_REPLACE).toString();
+
+        // Entries in top level groups wait until the group is expanded
+        if (!item && fullname.indexOf("/") > 0) {
+            QString group_name = fullname.left(fullname.indexOf("/"));
+            QStandardItem *group_item = top_groups.value(group_name);
+
+            if (!group_item) {
+                SearchEditorModel::searchEntry *group_entry = new SearchEditorModel::searchEntry();
+                group_entry->is_group = true;
+                group_entry->name = group_name;
+                group_item = AddEntryToModel(group_entry, true);
+                delete group_entry;
+                group_item->setData(m_NextPendingId++, PENDING_ROLE);
+                top_groups.insert(group_name, group_item);
+            }
+
+            entry->name = fullname.mid(group_name.length() + 1);
+
+            if (!entry->name.isEmpty()) {
+                int pending_id = group_item->data(PENDING_ROLE).toInt();
+                m_PendingEntries[pending_id].append(*entry);
+            }
+
+            delete entry;
+            continue;
+        }
+
         AddFullNameEntry(entry, item);
 	// done with the temporary entry so remove it
 	delete entry;
@@ -476,6 +599,8 @@ QList<QStandardItem *> SearchEditorModel::GetNonGroupItems(QStandardItem *item)
 {
     QList<QStandardItem *> items;
 
+    FetchAllEntries(item);
+
     if (!item->data(IS_GROUP_ROLE).toBool()) {
         items.append(item);
     }
@@ -500,6 +625,8 @@ QList<QStandardItem *> SearchEditorModel::GetNonParentItems(QStandardItem *item)
 {
     QList<QStandardItem *> items;
 
+    FetchAllEntries(item);
+
     if (item->rowCount() == 0) {
         if (item != invisibleRootItem()) {
             items.append(item);
@@ -580,6 +707,7 @@ QString SearchEditorModel::SaveData(QList<SearchEditorModel::searchEntry *> entr
 
     // Save everything if no entries selected
     if (entries.isEmpty()) {
+        FetchAllEntries();
         QList<QStandardItem *> items = GetNonParentItems(invisibleRootItem());
 
         if (!items.isEmpty()) {
@@ -640,6 +768,10 @@ QString SearchEditorModel::SaveData(QList<SearchEditorModel::searchEntry *> entr
         ss.sync();
     }
 
+    if (settings_path == m_SettingsPath) {
+        m_SettingsStamp = FileStamp(settings_path);
+    }
+
     // Watch the file again
     m_FSWatcher->addPath(settings_path);
     SetDataModified(false);
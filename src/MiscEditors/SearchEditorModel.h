@@ -25,6 +25,7 @@
 #ifndef SEARCHEDITORMODEL_H
 #define SEARCHEDITORMODEL_H
 
+#include <QtCore/QHash>
 #include <QtGui/QStandardItemModel>
 #include <QFileSystemWatcher>
 #include <QDropEvent>
@@ -56,6 +57,18 @@ public:
     QString GetFullName(QStandardItem *item);
 
     void LoadInitialData();
+
+    /**
+     * The entries in the top level groups are only read into the model
+     * when a group is first expanded. Fills in every group not yet
+     * expanded, for anything that walks the whole tree.
+     */
+    void FetchAllEntries(QStandardItem *item = NULL);
+
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+
     void LoadData(const QString &filename = QString(), QStandardItem *parent_item = NULL);
 
     void AddFullNameEntry(SearchEditorModel::searchEntry *entry = NULL, QStandardItem *parent_item = NULL, int row = -1);
@@ -95,6 +108,16 @@ private slots:
 private:
     void SetDataModified(bool modified);
 
+    /**
+     * Fills in the entries of item, if they have not been yet.
+     */
+    void FetchEntries(QStandardItem *item);
+
+    /**
+     * @return The modification time and size of the file at path.
+     */
+    static QString FileStamp(const QString &path);
+
     bool dropMimeData(const QMimeData *data, Qt::DropAction action, int row, int column, const QModelIndex &parent);
     Qt::DropActions supportedDropActions() const;
 
@@ -111,6 +134,19 @@ private:
     QFileSystemWatcher *m_FSWatcher;
 
     bool m_IsDataModified;
+
+    /**
+     * The entries of the groups not yet expanded, by the group's
+     * PENDING_ROLE, with names relative to the group.
+     */
+    QHash<int, QList<SearchEditorModel::searchEntry> > m_PendingEntries;
+    int m_NextPendingId;
+
+    /**
+     * The stamp of the settings file as last loaded or saved, so
+     * notifications for the model's own writes do not reload it.
+     */
+    QString m_SettingsStamp;
 };
 
 #endif // SEARCHEDITORMODEL_H
@@ -0,0 +1,209 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <pcre.h>
+
+#include "PCRE/LiteralSearch.h"
+
+// The option settings FindReplace::GetSearchRegex may put in front
+static const QString OPTION_UCP = "(*UCP)";
+static const QString OPTION_IGNORE_CASE = "(?i)";
+static const QString OPTION_DOT_ALL = "(?s)";
+static const QString OPTION_MINIMAL_MATCH = "(?U)";
+
+// Outside a character class
+static const QString REGEX_METACHARACTERS = "^$.[|()?*+{";
+
+static const ushort KELVIN_SIGN = 0x212A;
+static const ushort LATIN_SMALL_LONG_S = 0x017F;
+
+
+// With Unicode properties, PCRE also matches two non-ASCII
+// characters caselessly against ASCII letters.
+static bool HasUnicodeCaseSets()
+{
+    static int unicode_properties = -1;
+
+    if (unicode_properties == -1) {
+        int supported = 0;
+        pcre16_config(PCRE_CONFIG_UNICODE_PROPERTIES, &supported);
+        unicode_properties = supported;
+    }
+
+    return unicode_properties == 1;
+}
+
+
+LiteralSearch *LiteralSearch::FromPattern(const QString &pattern)
+{
+    QString literal;
+    bool caseless = false;
+
+    if (!ToLiteral(pattern, literal, caseless)) {
+        return NULL;
+    }
+
+    // Caseless matching beyond ASCII is left to PCRE
+    if (caseless) {
+        for (int i = 0; i < literal.length(); ++i) {
+            if (literal.at(i).unicode() >= 128) {
+                return NULL;
+            }
+        }
+    }
+
+    return new LiteralSearch(literal, caseless);
+}
+
+
+bool LiteralSearch::ToLiteral(const QString &pattern, QString &literal, bool &caseless)
+{
+    int pos = 0;
+    caseless = false;
+
+    if (pattern.startsWith(OPTION_UCP)) {
+        pos += OPTION_UCP.length();
+    }
+
+    while (true) {
+        QStringRef option = pattern.midRef(pos, OPTION_IGNORE_CASE.length());
+
+        if (option == OPTION_IGNORE_CASE) {
+            caseless = true;
+        } else if (option != OPTION_DOT_ALL && option != OPTION_MINIMAL_MATCH) {
+            break;
+        }
+
+        pos += option.length();
+    }
+
+    literal.clear();
+    literal.reserve(pattern.length() - pos);
+
+    while (pos < pattern.length()) {
+        QChar c = pattern.at(pos);
+
+        if (c == QChar('\\')) {
+            // Escaped letters and digits have a meaning of their own,
+            // any other escaped character stands for itself
+            if (pos + 1 == pattern.length()) {
+                return false;
+            }
+
+            QChar escaped = pattern.at(pos + 1);
+
+            if (escaped.unicode() < 128 && escaped.isLetterOrNumber()) {
+                return false;
+            }
+
+            literal.append(escaped);
+            pos += 2;
+            continue;
+        }
+
+        if (REGEX_METACHARACTERS.contains(c)) {
+            return false;
+        }
+
+        literal.append(c);
+        pos++;
+    }
+
+    return !literal.isEmpty();
+}
+
+
+LiteralSearch::LiteralSearch(const QString &literal, bool caseless)
+    :
+    m_Literal(caseless ? literal.toLower() : literal),
+    m_Caseless(caseless)
+{
+    int length = m_Literal.length();
+
+    for (int i = 0; i < 256; ++i) {
+        m_Shift[i] = length;
+    }
+
+    const ushort *chars = m_Literal.utf16();
+
+    for (int i = 0; i < length - 1; ++i) {
+        m_Shift[chars[i] & 0xFF] = length - 1 - i;
+    }
+}
+
+
+int LiteralSearch::IndexIn(const QString &text, int from) const
+{
+    int length = m_Literal.length();
+    int last = text.length() - length;
+    const ushort *chars = m_Literal.utf16();
+    const ushort *haystack = text.utf16();
+    ushort final_char = chars[length - 1];
+
+    for (int pos = qMax(from, 0); pos <= last;) {
+        ushort c = Fold(haystack[pos + length - 1]);
+
+        if (c == final_char) {
+            int i = length - 2;
+
+            while (i >= 0 && Fold(haystack[pos + i]) == chars[i]) {
+                i--;
+            }
+
+            if (i < 0) {
+                return pos;
+            }
+        }
+
+        pos += m_Shift[c & 0xFF];
+    }
+
+    return -1;
+}
+
+
+int LiteralSearch::Length() const
+{
+    return m_Literal.length();
+}
+
+
+ushort LiteralSearch::Fold(ushort c) const
+{
+    if (!m_Caseless) {
+        return c;
+    }
+
+    if (c >= 'A' && c <= 'Z') {
+        return c + ('a' - 'A');
+    }
+
+    if (c == KELVIN_SIGN && HasUnicodeCaseSets()) {
+        return 'k';
+    }
+
+    if (c == LATIN_SMALL_LONG_S && HasUnicodeCaseSets()) {
+        return 's';
+    }
+
+    return c;
+}
@@ -0,0 +1,84 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef LITERALSEARCH_H
+#define LITERALSEARCH_H
+
+#include <QtCore/QString>
+
+/**
+ * Finds a fixed string in UTF-16 text, without going through PCRE.
+ *
+ * Normal and Case Sensitive searches are escaped into a regex before
+ * they reach SPCRE. When a pattern turns out to only ever match its own
+ * text, SPCRE hands the matching to this instead. It uses the
+ * Boyer-Moore-Horspool algorithm, which skips over most of the text
+ * without looking at it, and finds exactly what PCRE would.
+ */
+class LiteralSearch
+{
+public:
+
+    /**
+     * @param pattern A pattern as SPCRE compiles it.
+     * @return A search for the text the pattern matches, or NULL if the
+     *         pattern may match anything else. The caller owns it.
+     */
+    static LiteralSearch *FromPattern(const QString &pattern);
+
+    /**
+     * The text a pattern matches, when it only ever matches that.
+     *
+     * @param literal Set to the unescaped text.
+     * @param caseless Set to whether the pattern ignores case.
+     * @return false if the pattern may match anything else.
+     */
+    static bool ToLiteral(const QString &pattern, QString &literal, bool &caseless);
+
+    /**
+     * @param caseless Whether to ignore case; literal must then be ASCII.
+     */
+    LiteralSearch(const QString &literal, bool caseless);
+
+    /**
+     * @return The offset of the first match at or after from, or -1.
+     */
+    int IndexIn(const QString &text, int from) const;
+
+    int Length() const;
+
+private:
+
+    ushort Fold(ushort c) const;
+
+    // Folded to lower case when caseless
+    QString m_Literal;
+
+    bool m_Caseless;
+
+    // How far the search can move on, by the low byte of the last
+    // character looked at
+    int m_Shift[256];
+};
+
+#endif // LITERALSEARCH_H
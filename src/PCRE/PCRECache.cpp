@@ -20,40 +20,100 @@
 **
 *************************************************************************/
 
-#include "PCRE/PCRECache.h"
+#include <QtCore/QMutexLocker>
 
-PCRECache *PCRECache::m_instance = 0;
+#include "Misc/SettingsStore.h"
+#include "PCRE/PCRECache.h"
 
 PCRECache *PCRECache::instance()
 {
-    if (m_instance == 0) {
-        m_instance = new PCRECache();
-    }
-
-    return m_instance;
+    // Initialized once, by whichever thread gets here first
+    static PCRECache cache;
+    return &cache;
 }
 
 PCRECache::PCRECache()
 {
-  // defaults to maxCacheCost of 100
+    // every entry costs 1, so the cost is the number of patterns
+    SettingsStore settings;
+    m_cache.setMaxCost(qMax(settings.regexCacheSize(), 1));
+    m_matchLimit = qMax(settings.regexMatchLimit(), 0);
+}
+
+PCRECache::~PCRECache()
+{
 }
 
 bool PCRECache::insert(const QString &key, SPCRE *object)
 {
-    // raise cost of each entry to 5 to reduce memory footprint
-    return m_cache.insert(key, object, 5);
+    QMutexLocker locker(&m_mutex);
+    return m_cache.insert(key, new QSharedPointer<SPCRE>(object), 1);
 }
 
-SPCRE *PCRECache::getObject(const QString &key)
+QSharedPointer<SPCRE> PCRECache::getObject(const QString &key)
 {
+    {
+        QMutexLocker locker(&m_mutex);
+        QSharedPointer<SPCRE> *cached = m_cache.object(key);
+
+        if (cached) {
+            return *cached;
+        }
+    }
+
     // Create a new SPCRE if it doesn't already exist.
     // The key is the pattern for initializing the SPCRE.
-    if (!m_cache.contains(key)) {
-        SPCRE *spcre = new SPCRE(key);
-        // raise cost of each entry to 5 to reduce memory footprint
-        m_cache.insert(key, spcre, 5);
-        return spcre;
+    QSharedPointer<SPCRE> spcre(new SPCRE(key, matchLimit()));
+    QMutexLocker locker(&m_mutex);
+    QSharedPointer<SPCRE> *cached = m_cache.object(key);
+
+    // Another thread compiled it meanwhile
+    if (cached) {
+        return *cached;
+    }
+
+    m_cache.insert(key, new QSharedPointer<SPCRE>(spcre), 1);
+    return spcre;
+}
+
+void PCRECache::setCapacity(int patterns)
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.setMaxCost(qMax(patterns, 1));
+}
+
+int PCRECache::capacity()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_cache.maxCost();
+}
+
+void PCRECache::setMatchLimit(int steps)
+{
+    QMutexLocker locker(&m_mutex);
+    m_matchLimit = qMax(steps, 0);
+    // The limit is set when a pattern is compiled
+    m_cache.clear();
+}
+
+int PCRECache::matchLimit()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_matchLimit;
+}
+
+qint64 PCRECache::memoryUsage()
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 bytes = 0;
+    foreach(QString key, m_cache.keys()) {
+        bytes += (*m_cache.object(key))->memoryUsage();
     }
+    return bytes;
+}
 
-    return m_cache.object(key);
+void PCRECache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
 }
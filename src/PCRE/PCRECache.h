@@ -26,6 +26,8 @@
 #define PCRECACHE_H
 
 #include <QtCore/QCache>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
 #include <QtCore/QString>
 
 #include "PCRE/SPCRE.h"
@@ -33,7 +35,10 @@
 /**
  * Singleton. A cache of SPCRE regular expression objects.
  *
- * The SPCRE's are cached to improve performance.
+ * The SPCRE's are cached to improve performance. The cache may be used
+ * from any thread. What it hands out is shared with the cache, so an
+ * SPCRE stays alive for as long as someone holds on to it, even once
+ * it has been dropped from the cache to make room.
  */
 class PCRECache
 {
@@ -49,7 +54,7 @@ public:
      * pattern by the SPCRE as a string.
      *
      * @param key The key associated with the SPCRE.
-     * @param object The SPCRE to store.
+     * @param object The SPCRE to store. The cache takes ownership.
      *
      * @return True if the object was successfully inserted.
      */
@@ -62,7 +67,32 @@ public:
      *
      * @param key The key associated with the SPCRE.
      */
-    SPCRE *getObject(const QString &key);
+    QSharedPointer<SPCRE> getObject(const QString &key);
+
+    /**
+     * Sets how many patterns are kept. The least recently used go first.
+     */
+    void setCapacity(int patterns);
+
+    int capacity();
+
+    /**
+     * Sets the match limit the patterns are compiled with, see
+     * SettingsStore::regexMatchLimit(). Drops every cached pattern.
+     */
+    void setMatchLimit(int steps);
+
+    int matchLimit();
+
+    /**
+     * The memory held by the cached patterns, in bytes.
+     */
+    qint64 memoryUsage();
+
+    /**
+     * Drops every cached pattern.
+     */
+    void clear();
 
 private:
     /**
@@ -71,9 +101,10 @@ private:
     PCRECache();
 
     // The cache that we store the SPCRE's.
-    QCache<QString, SPCRE> m_cache;
-    // The single instance of the cache.
-    static PCRECache *m_instance;
+    QCache<QString, QSharedPointer<SPCRE>> m_cache;
+    // Guards m_cache; patterns are compiled without it held.
+    QMutex m_mutex;
+    int m_matchLimit;
 };
 
 #endif // PCRECACHE_H
@@ -0,0 +1,304 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtCore/QChar>
+
+#include "PCRE/PCREReplaceTemplate.h"
+#include "PCRE/SPCRE.h"
+
+#define is_hex(a) (((a) >= '0' && (a) <= '9') || ((a) >= 'a' && (a) <= 'f') || ((a) >= 'A' && (a) <= 'F') ? true : false)
+
+PCREReplaceTemplate::PCREReplaceTemplate(SPCRE &sre, const QString &replacement_pattern)
+    :
+    m_Pattern(replacement_pattern),
+    m_HasCaseChanges(false)
+{
+    Compile(sre);
+}
+
+
+const QString &PCREReplaceTemplate::Pattern() const
+{
+    return m_Pattern;
+}
+
+
+void PCREReplaceTemplate::Apply(const QString &text, const int *ovector, QString &out) const
+{
+    // The common case has nothing to change case, so it only copies
+    if (!m_HasCaseChanges) {
+        foreach(const Op &op, m_Ops) {
+            if (op.code == Op_Literal) {
+                out.append(m_Literals.midRef(op.first, op.second));
+            } else if (op.code == Op_Group && ovector[2 * op.first] >= 0) {
+                out.append(text.midRef(ovector[2 * op.first], ovector[2 * op.first + 1] - ovector[2 * op.first]));
+            }
+        }
+        return;
+    }
+
+    CaseChange state = CaseChange_None;
+    foreach(const Op &op, m_Ops) {
+        switch (op.code) {
+            case Op_Literal:
+                AppendSegment(m_Literals, op.first, op.second, state, out);
+                break;
+
+            case Op_Group:
+                // A group that did not take part in the match is empty
+                if (ovector[2 * op.first] >= 0) {
+                    AppendSegment(text, ovector[2 * op.first], ovector[2 * op.first + 1] - ovector[2 * op.first], state, out);
+                }
+                break;
+
+            case Op_CaseChange:
+                // Case changes cannot stop within a segment
+                if (state == CaseChange_None) {
+                    state = static_cast<CaseChange>(op.first);
+                }
+                break;
+
+            case Op_EndCaseChange:
+                state = CaseChange_None;
+                break;
+        }
+    }
+}
+
+
+void PCREReplaceTemplate::Compile(SPCRE &sre)
+{
+    if (!sre.isValid()) {
+        return;
+    }
+
+    // The same quick check PCREReplaceTextBuilder makes
+    if (!m_Pattern.contains("\\")) {
+        AddLiteral(m_Pattern);
+        return;
+    }
+
+    // The groups a match has; references past them are left as text
+    const int group_count = sre.getMatchGroupCount() + 1;
+    // The parse is the one PCREReplaceTextBuilder::BuildReplacementText
+    // runs for every match. What it would add to the replacement is
+    // recorded instead: text as literals, back references as groups.
+    QChar c;
+    QChar backref_bracket_start_char;
+    QChar control_char;
+    QString backref_name;
+    QString invalid_contol;
+    QString control_x_hex;
+    bool in_control = false;
+
+    for (int i = 0; i < m_Pattern.length(); i++) {
+        c = m_Pattern.at(i);
+
+        if (in_control) {
+            invalid_contol += c;
+
+            if (control_char.isNull()) {
+                control_char = c;
+
+                if (c.isDigit()) {
+                    int backref_number = c.digitValue();
+
+                    if (backref_number >= 0 && backref_number < group_count) {
+                        AddOp(Op_Group, backref_number);
+                    } else {
+                        AddLiteral(invalid_contol);
+                    }
+
+                    in_control = false;
+                }
+                // Metacharacters
+                else if (c == 'a') {
+                    AddLiteral("\a");
+                    in_control = false;
+                } else if (c == 'b') {
+                    AddLiteral("\b");
+                    in_control = false;
+                } else if (c == 'f') {
+                    AddLiteral("\f");
+                    in_control = false;
+                } else if (c == 'n') {
+                    AddLiteral("\n");
+                    in_control = false;
+                } else if (c == 'r') {
+                    AddLiteral("\r");
+                    in_control = false;
+                } else if (c == 't') {
+                    AddLiteral("\t");
+                    in_control = false;
+                } else if (c == 'v') {
+                    AddLiteral("\v");
+                    in_control = false;
+                } else if (c == '\\') {
+                    AddLiteral("\\");
+                    in_control = false;
+                } else if (c == 'E') {
+                    AddOp(Op_EndCaseChange, 0);
+                    in_control = false;
+                } else if (c == 'g') {
+                    backref_bracket_start_char = QChar();
+                } else if (c == 'l') {
+                    AddOp(Op_CaseChange, CaseChange_LowerNext);
+                    in_control = false;
+                } else if (c == 'L') {
+                    AddOp(Op_CaseChange, CaseChange_Lower);
+                    in_control = false;
+                } else if (c == 'u') {
+                    AddOp(Op_CaseChange, CaseChange_UpperNext);
+                    in_control = false;
+                } else if (c == 'U') {
+                    AddOp(Op_CaseChange, CaseChange_Upper);
+                    in_control = false;
+                }
+            } else {
+                if (control_char == 'g') {
+                    if (backref_bracket_start_char.isNull()) {
+                        if (c == '{' || c == '<') {
+                            backref_bracket_start_char = c;
+                            backref_name.clear();
+                        } else {
+                            in_control = false;
+                            AddLiteral(invalid_contol);
+                        }
+                    } else {
+                        if ((c == '}' && backref_bracket_start_char == '{') ||
+                            (c == '>' && backref_bracket_start_char == '<')) {
+                            int backref_number = backref_name.toInt();
+
+                            if (backref_number == 0 && backref_name != "0") {
+                                backref_number = sre.getCaptureStringNumber(backref_name);
+                            }
+
+                            if (backref_number >= 0 && backref_number < group_count) {
+                                AddOp(Op_Group, backref_number);
+                            } else {
+                                AddLiteral(invalid_contol);
+                            }
+
+                            in_control = false;
+                        } else {
+                            backref_name += c;
+                        }
+                    }
+                } else if (control_char == 'x') {
+                    if (is_hex(c)) {
+                        control_x_hex += c;
+
+                        if (control_x_hex.count() == 2) {
+                            AddLiteral(QString(QChar(control_x_hex.toUInt(NULL, 16))));
+                            in_control = false;
+                        }
+                    } else {
+                        AddLiteral(invalid_contol);
+                        in_control = false;
+                    }
+                } else {
+                    AddLiteral(invalid_contol);
+                    in_control = false;
+                }
+            }
+        } else {
+            if (c == '\\') {
+                invalid_contol = c;
+                control_char = QChar();
+                control_x_hex = QString();
+                in_control = true;
+            } else {
+                AddLiteral(QString(c));
+            }
+        }
+    }
+
+    // An unfinished control is left as text
+    if (in_control) {
+        AddLiteral(invalid_contol);
+    }
+}
+
+
+void PCREReplaceTemplate::AddLiteral(const QString &text)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+
+    // Runs of text are kept as one slice
+    if (!m_Ops.isEmpty() && m_Ops.last().code == Op_Literal) {
+        m_Ops.last().second += text.length();
+    } else {
+        AddOp(Op_Literal, m_Literals.length(), text.length());
+    }
+
+    m_Literals.append(text);
+}
+
+
+void PCREReplaceTemplate::AddOp(OpCode code, int first, int second)
+{
+    if (code == Op_CaseChange || code == Op_EndCaseChange) {
+        m_HasCaseChanges = true;
+    }
+
+    Op op;
+    op.code = code;
+    op.first = first;
+    op.second = second;
+    m_Ops.append(op);
+}
+
+
+void PCREReplaceTemplate::AppendSegment(const QString &source, int position, int length, CaseChange &state, QString &out)
+{
+    if (length <= 0) {
+        return;
+    }
+
+    switch (state) {
+        case CaseChange_LowerNext:
+            out.append(source.at(position).toLower());
+            out.append(source.midRef(position + 1, length - 1));
+            state = CaseChange_None;
+            break;
+
+        case CaseChange_Lower:
+            out.append(source.mid(position, length).toLower());
+            break;
+
+        case CaseChange_UpperNext:
+            out.append(source.at(position).toUpper());
+            out.append(source.midRef(position + 1, length - 1));
+            state = CaseChange_None;
+            break;
+
+        case CaseChange_Upper:
+            out.append(source.mid(position, length).toUpper());
+            break;
+
+        default:
+            out.append(source.midRef(position, length));
+            break;
+    }
+}
@@ -0,0 +1,107 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef PCREREPLACETEMPLATE_H
+#define PCREREPLACETEMPLATE_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class SPCRE;
+
+/**
+ * A replacement pattern parsed once for a given SPCRE, so that it can be
+ * applied to many matches without being parsed again.
+ *
+ * The pattern is turned into a list of operations: copy a slice of
+ * literal text, copy a capture group, and change case. It understands
+ * exactly what PCREReplaceTextBuilder does, and gives the same text.
+ */
+class PCREReplaceTemplate
+{
+public:
+    PCREReplaceTemplate(SPCRE &sre, const QString &replacement_pattern);
+
+    /**
+     * The replacement pattern this was compiled from.
+     */
+    const QString &Pattern() const;
+
+    /**
+     * Appends the replacement for one match to out.
+     *
+     * @param text The text that was matched against.
+     * @param ovector The offsets of the match, as SPCRE::forEachMatch
+     * hands them to its visitor.
+     */
+    void Apply(const QString &text, const int *ovector, QString &out) const;
+
+private:
+
+    enum OpCode {
+        Op_Literal,     // first and second are the slice of m_Literals
+        Op_Group,       // first is the group number
+        Op_CaseChange,  // first is the CaseChange
+        Op_EndCaseChange
+    };
+
+    /**
+     * The states of case changes, as in PCREReplaceTextBuilder.
+     */
+    enum CaseChange {
+        CaseChange_LowerNext,
+        CaseChange_Lower,
+        CaseChange_UpperNext,
+        CaseChange_Upper,
+        CaseChange_None
+    };
+
+    struct Op {
+        OpCode code;
+        int first;
+        int second;
+    };
+
+    void Compile(SPCRE &sre);
+
+    void AddLiteral(const QString &text);
+
+    void AddOp(OpCode code, int first, int second = 0);
+
+    /**
+     * Appends length characters of source from position, changed as
+     * the case change state says.
+     */
+    static void AppendSegment(const QString &source, int position, int length, CaseChange &state, QString &out);
+
+    QString m_Pattern;
+
+    // All of the literal text, one slice after the other
+    QString m_Literals;
+
+    QVector<Op> m_Ops;
+
+    bool m_HasCaseChanges;
+};
+
+#endif // PCREREPLACETEMPLATE_H
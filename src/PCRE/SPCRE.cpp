@@ -19,19 +19,65 @@
 **
 *************************************************************************/
 
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+#include <QtCore/QVarLengthArray>
+
 #include "PCRE/SPCRE.h"
+#include "PCRE/LiteralSearch.h"
+#include "PCRE/PCREReplaceTemplate.h"
 #include "PCRE/PCREReplaceTextBuilder.h"
 #include "sigil_constants.h"
 
 // The maximum number of catpures that we will allow.
 const int PCRE_MAX_CAPTURE_GROUPS = 30;
 
-SPCRE::SPCRE(const QString &patten)
+// The JIT stack of a thread starts this small and grows up to the
+// maximum, which leaves room for heavy backtracking in patterns run
+// over a whole file.
+const int JIT_STACK_START_SIZE = 32 * 1024;
+const int JIT_STACK_MAX_SIZE = 4 * 1024 * 1024;
+
+// How deep the interpreter may nest while matching. Its frames are on
+// the thread's stack, which is far smaller on worker threads than
+// PCRE's default of allowing the whole match limit.
+const unsigned long MATCH_LIMIT_RECURSION = 20000;
+
+// Freed with the thread
+struct JitStack {
+    JitStack() : stack(pcre16_jit_stack_alloc(JIT_STACK_START_SIZE, JIT_STACK_MAX_SIZE)) {}
+    ~JitStack() {
+        if (stack) {
+            pcre16_jit_stack_free(stack);
+        }
+    }
+
+    pcre16_jit_stack *stack;
+};
+
+static QThreadStorage<JitStack *> s_JitStacks;
+
+// A pattern may be matched from several threads at once, so every
+// thread matches on its own stack.
+static pcre16_jit_stack *ThreadJitStack(void *)
+{
+    if (!s_JitStacks.hasLocalData()) {
+        s_JitStacks.setLocalData(new JitStack());
+    }
+
+    return s_JitStacks.localData()->stack;
+}
+
+SPCRE::SPCRE(const QString &patten, unsigned long match_limit)
+    :
+    m_matchLimitExceeded(0)
 {
     m_pattern = patten;
     m_re = NULL;
     m_study = NULL;
     m_captureSubpatternCount = 0;
+    m_jit = false;
+    m_literal = NULL;
     const char *error;
     int erroroffset;
     m_re = pcre16_compile(m_pattern.utf16(), PCRE_UTF16 | PCRE_MULTILINE, &error, &erroroffset, NULL);
@@ -39,10 +85,32 @@ SPCRE::SPCRE(const QString &patten)
     // Pattern is valid.
     if (m_re != NULL) {
         m_valid = true;
-        // Study the pattern and save the results of the study.
-        m_study = pcre16_study(m_re, 0, &error);
+        // Study the pattern and save the results of the study. Where the
+        // library was built with JIT support the pattern is also compiled
+        // to machine code; pcre16_exec then runs that instead of the
+        // interpreter.
+        // The limits are kept in the study, so one is always made.
+        m_study = pcre16_study(m_re, PCRE_STUDY_EXTRA_NEEDED | (JitAvailable() ? PCRE_STUDY_JIT_COMPILE : 0), &error);
+
+        if (m_study != NULL && match_limit > 0) {
+            m_study->flags |= PCRE_EXTRA_MATCH_LIMIT | PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+            m_study->match_limit = match_limit;
+            m_study->match_limit_recursion = qMin(match_limit, MATCH_LIMIT_RECURSION);
+        }
+
+        if (m_study != NULL) {
+            int jit = 0;
+            pcre16_fullinfo(m_re, m_study, PCRE_INFO_JIT, &jit);
+            m_jit = jit == 1;
+
+            if (m_jit) {
+                pcre16_assign_jit_stack(m_study, ThreadJitStack, NULL);
+            }
+        }
+
         // Store the number of capture subpatterns.
         pcre16_fullinfo(m_re, m_study, PCRE_INFO_CAPTURECOUNT, &m_captureSubpatternCount);
+        m_literal = LiteralSearch::FromPattern(m_pattern);
     }
     // Pattern is not valid.
     else {
@@ -52,13 +120,17 @@ SPCRE::SPCRE(const QString &patten)
 
 SPCRE::~SPCRE()
 {
+    delete m_literal;
+    m_literal = NULL;
+
     if (m_re != NULL) {
         pcre16_free(m_re);
         m_re = NULL;
     }
 
     if (m_study != NULL) {
-        pcre16_free(m_study);
+        // Also frees the JIT code
+        pcre16_free_study(m_study);
         m_study = NULL;
     }
 }
@@ -68,6 +140,52 @@ bool SPCRE::isValid()
     return m_valid;
 }
 
+bool SPCRE::isJitCompiled()
+{
+    return m_jit;
+}
+
+bool SPCRE::takeMatchLimitExceeded()
+{
+    return m_matchLimitExceeded.fetchAndStoreOrdered(0) != 0;
+}
+
+void SPCRE::checkMatchLimit(int rc)
+{
+    if (rc == PCRE_ERROR_MATCHLIMIT || rc == PCRE_ERROR_RECURSIONLIMIT || rc == PCRE_ERROR_JIT_STACKLIMIT) {
+        m_matchLimitExceeded.store(1);
+    }
+}
+
+qint64 SPCRE::memoryUsage()
+{
+    if (!m_valid) {
+        return 0;
+    }
+
+    size_t size = 0;
+    size_t study_size = 0;
+    size_t jit_size = 0;
+    pcre16_fullinfo(m_re, m_study, PCRE_INFO_SIZE, &size);
+
+    if (m_study != NULL) {
+        pcre16_fullinfo(m_re, m_study, PCRE_INFO_STUDYSIZE, &study_size);
+
+        if (m_jit) {
+            pcre16_fullinfo(m_re, m_study, PCRE_INFO_JITSIZE, &jit_size);
+        }
+    }
+
+    return qint64(size + study_size + jit_size);
+}
+
+bool SPCRE::JitAvailable()
+{
+    int jit = 0;
+    pcre16_config(PCRE_CONFIG_JIT, &jit);
+    return jit == 1;
+}
+
 QString SPCRE::getPattern()
 {
     return m_pattern;
@@ -88,6 +206,11 @@ int SPCRE::getCaptureSubpatternCount()
     return m_captureSubpatternCount;
 }
 
+int SPCRE::getMatchGroupCount()
+{
+    return qMin(m_captureSubpatternCount, PCRE_MAX_CAPTURE_GROUPS);
+}
+
 int SPCRE::getCaptureStringNumber(const QString &name)
 {
     if (m_re == NULL) {
@@ -103,16 +226,52 @@ int SPCRE::getCaptureStringNumber(const QString &name)
     return number;
 }
 
+// Collects the matches for getEveryMatchInfo
+static bool AppendMatchInfo(QList<SPCRE::MatchInfo> &info, const int *ovector, int group_count)
+{
+    SPCRE::MatchInfo match_info;
+    SPCRE::toMatchInfo(ovector, group_count, match_info);
+    info.append(match_info);
+    return true;
+}
+
 QList<SPCRE::MatchInfo> SPCRE::getEveryMatchInfo(const QString &text)
 {
-    // This function is very similar to getNextMatchInfo but we don't
-    // want to put a call to getNextMatchInfo in a loop because it allocates
-    // a new ovector. We want to avoid this and only do one allocation so we
-    // reuse the logic and put the call to generateMatchInfo in the loop.
     QList<SPCRE::MatchInfo> info;
+    forEachMatch(text, std::bind(AppendMatchInfo, std::ref(info), std::placeholders::_1, std::placeholders::_2));
+    return info;
+}
+
+int SPCRE::countMatches(const QString &text)
+{
+    return forEachMatch(text, MatchVisitor());
+}
+
+int SPCRE::forEachMatch(const QString &text, const MatchVisitor &visitor)
+{
+    int count = 0;
 
     if (m_re == NULL || text.isEmpty()) {
-        return info;
+        return count;
+    }
+
+    if (m_literal) {
+        int literal_ovector[2];
+        int offset = m_literal->IndexIn(text, 0);
+
+        while (offset != -1) {
+            count++;
+            literal_ovector[0] = offset;
+            literal_ovector[1] = offset + m_literal->Length();
+
+            if (visitor && !visitor(literal_ovector, 0)) {
+                break;
+            }
+
+            offset = m_literal->IndexIn(text, offset + m_literal->Length());
+        }
+
+        return count;
     }
 
     int rc = 0;
@@ -125,14 +284,11 @@ QList<SPCRE::MatchInfo> SPCRE::getEveryMatchInfo(const QString &text)
     }
 
     // The vector needs to be a multiple of 3 and have at least one location
-    // for the full matched string.
+    // for the full matched string. Even the largest fits on the stack, and
+    // the one vector is reused for every match.
     int ovector_size = (1 + ovector_count) * 3;
-    // Allocate only the amount of memory we need for the search pattern and
-    // the number of capture patterns it contains.
-    // Can't use dynamic array alloction (int ovector[ovector_size]) because
-    // MSVC doesn't support it.
-    int *ovector = new int[ovector_size];
-    memset(ovector, 0, sizeof(int)*ovector_size);
+    QVarLengthArray<int, (1 + PCRE_MAX_CAPTURE_GROUPS) * 3> ovector(ovector_size);
+    memset(ovector.data(), 0, sizeof(int)*ovector_size);
     // We keep track of the last offsets as we move though the string matching
     // sub strings.
     int last_offset[2] = {0};
@@ -146,15 +302,19 @@ QList<SPCRE::MatchInfo> SPCRE::getEveryMatchInfo(const QString &text)
 
         // We only care about matches that have text in it.
         if (last_offset[0] != last_offset[1]) {
-            // Add the matched information to the list.
-            info.append(generateMatchInfo(ovector, ovector_count));
+            count++;
+
+            if (visitor && !visitor(ovector.constData(), ovector_count)) {
+                break;
+            }
         }
 
-        rc = pcre16_exec(m_re, m_study, text.utf16(), text.length(), last_offset[1], 0, ovector, ovector_size);
+        rc = pcre16_exec(m_re, m_study, text.utf16(), text.length(), last_offset[1], 0, ovector.data(), ovector_size);
     } while (rc >= 0 && ovector[0] != ovector[1] && ovector[1] != last_offset[1] && ovector[0] < ovector[1]);
 
-    delete[] ovector;
-    return info;
+    checkMatchLimit(rc);
+
+    return count;
 }
 
 SPCRE::MatchInfo SPCRE::getFirstMatchInfo(const QString &text)
@@ -165,6 +325,16 @@ SPCRE::MatchInfo SPCRE::getFirstMatchInfo(const QString &text)
         return match_info;
     }
 
+    if (m_literal) {
+        int offset = m_literal->IndexIn(text, 0);
+
+        if (offset != -1) {
+            match_info = literalMatchInfo(offset);
+        }
+
+        return match_info;
+    }
+
     int rc = 0;
     // Set the size of the array based on the number of capture subpatterns
     // if it does not exceed our maximum size.
@@ -184,6 +354,7 @@ SPCRE::MatchInfo SPCRE::getFirstMatchInfo(const QString &text)
     int *ovector = new int[ovector_size];
     memset(ovector, 0, sizeof(int)*ovector_size);
     rc = pcre16_exec(m_re, m_study, text.utf16(), text.length(), 0, 0, ovector, ovector_size);
+    checkMatchLimit(rc);
 
     if (rc >= 0 && ovector[0] != ovector[1]) {
         match_info = generateMatchInfo(ovector, ovector_count);
@@ -211,28 +382,111 @@ bool SPCRE::replaceText(const QString &text, const QList<std::pair<int, int>> &c
     return builder.BuildReplacementText(*this, text, capture_groups_offsets, replacement_pattern, out);
 }
 
+QSharedPointer<PCREReplaceTemplate> SPCRE::getReplaceTemplate(const QString &replacement_pattern)
+{
+    QMutexLocker locker(&m_replaceTemplateMutex);
+
+    if (!m_replaceTemplate || m_replaceTemplate->Pattern() != replacement_pattern) {
+        m_replaceTemplate = QSharedPointer<PCREReplaceTemplate>(new PCREReplaceTemplate(*this, replacement_pattern));
+    }
+
+    return m_replaceTemplate;
+}
+
+// The state of replaceEveryMatch between matches
+struct EveryMatchReplace {
+    const PCREReplaceTemplate *replace_template;
+    const QString *text;
+    QString *out;
+    int from;
+    int to;
+    // Where the text not yet copied to out starts
+    int copied_to;
+    int count;
+};
+
+static bool ReplaceOneMatch(EveryMatchReplace &replace, const int *ovector, int group_count)
+{
+    Q_UNUSED(group_count);
+
+    if (ovector[0] > replace.to) {
+        return false;
+    }
+
+    if (ovector[1] < replace.from) {
+        return true;
+    }
+
+    replace.out->append(replace.text->midRef(replace.copied_to, ovector[0] - replace.copied_to));
+    replace.replace_template->Apply(*replace.text, ovector, *replace.out);
+    replace.copied_to = ovector[1];
+    replace.count++;
+    return true;
+}
+
+int SPCRE::replaceEveryMatch(const QString &text, const QString &replacement_pattern, QString &out, int from, int to)
+{
+    QSharedPointer<PCREReplaceTemplate> replace_template = getReplaceTemplate(replacement_pattern);
+    EveryMatchReplace replace;
+    replace.replace_template = replace_template.data();
+    replace.text = &text;
+    replace.out = &out;
+    replace.from = from;
+    replace.to = to;
+    replace.copied_to = 0;
+    replace.count = 0;
+    out.clear();
+    out.reserve(text.length());
+    forEachMatch(text, std::bind(ReplaceOneMatch, std::ref(replace), std::placeholders::_1, std::placeholders::_2));
+    out.append(text.midRef(replace.copied_to));
+    return replace.count;
+}
+
 SPCRE::MatchInfo SPCRE::generateMatchInfo(int ovector[], int ovector_count)
 {
     MatchInfo match_info;
+    toMatchInfo(ovector, ovector_count, match_info);
+    return match_info;
+}
+
+void SPCRE::toMatchInfo(const int *ovector, int group_count, MatchInfo &match_info)
+{
     // Store the offsets in the QString text that we ar matching
     // against.
     int match_start = ovector[0];
     int match_end = ovector[1];
     match_info.offset = std::pair<int, int>(match_start, match_end);
+
+    // Only the entries are overwritten when the list already has the
+    // right length.
+    if (match_info.capture_groups_offsets.count() != group_count + 1) {
+        match_info.capture_groups_offsets.clear();
+
+        for (int i = 0; i <= group_count; i++) {
+            match_info.capture_groups_offsets.append(std::pair<int, int>(0, 0));
+        }
+    }
+
     // We keep a list of the substrings within the matched string that
     // are captured by capture patterns.
     //
     // The first match is always the string itself.
-    match_info.capture_groups_offsets.append(std::pair<int, int>(0, match_end - match_start));
+    match_info.capture_groups_offsets[0] = std::pair<int, int>(0, match_end - match_start);
 
     // Translate the subpattern offsets into locations within the
     // matched substring.
-    for (int i = 1; i <= ovector_count; i++) {
+    for (int i = 1; i <= group_count; i++) {
         int subpattern_start = ovector[2 * i] - match_start;
         int subpattern_end = ovector[2 * i + 1] - match_start;
-        match_info.capture_groups_offsets.append(std::pair<int, int>(subpattern_start, subpattern_end));
+        match_info.capture_groups_offsets[i] = std::pair<int, int>(subpattern_start, subpattern_end);
     }
+}
 
+SPCRE::MatchInfo SPCRE::literalMatchInfo(int offset)
+{
+    // What generateMatchInfo makes of a match without capture groups
+    MatchInfo match_info;
+    match_info.offset = std::pair<int, int>(offset, offset + m_literal->Length());
+    match_info.capture_groups_offsets.append(std::pair<int, int>(0, m_literal->Length()));
     return match_info;
 }
-
@@ -24,14 +24,22 @@
 #ifndef SPCRE_H
 #define SPCRE_H
 
+#include <limits.h>
 #include <pcre.h>
+#include <functional>
 #include <utility>
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
 #include <QtCore/QString>
 
 using std::pair;
 
+class LiteralSearch;
+class PCREReplaceTemplate;
+
 /**
  * Sigil Regular Expression object.
  *
@@ -48,8 +56,10 @@ public:
      * Constructor.
      *
      * @param pattern The search pattern.
+     * @param match_limit The most backtracking steps one search may
+     * take before it gives up; 0 keeps the limit PCRE was built with.
      */
-    SPCRE(const QString &patten);
+    SPCRE(const QString &patten, unsigned long match_limit = 0);
     ~SPCRE();
 
     /**
@@ -72,6 +82,17 @@ public:
         }
     };
 
+    /**
+     * Called by forEachMatch for every match. ovector holds the offsets
+     * in the text of the match (ovector[0] to ovector[1]) and of each
+     * capture group n (ovector[2n] to ovector[2n+1]); a group that did
+     * not take part in the match is -1 to -1. The array is reused for
+     * the next match.
+     *
+     * @return false to stop at this match.
+     */
+    typedef std::function<bool(const int *ovector, int group_count)> MatchVisitor;
+
     /**
      * Is the pattern valid.
      *
@@ -79,6 +100,30 @@ public:
      */
     bool isValid();
 
+    /**
+     * Whether the pattern was compiled to machine code, rather than
+     * being run by the PCRE interpreter.
+     */
+    bool isJitCompiled();
+
+    /**
+     * Whether a search gave up since the last call because it went over
+     * the match limit, e.g. on a pattern with nested quantifiers. Every
+     * match found before that point has been reported. Clears the flag.
+     */
+    bool takeMatchLimitExceeded();
+
+    /**
+     * The memory held by the compiled pattern, its study data and
+     * its machine code, in bytes.
+     */
+    qint64 memoryUsage();
+
+    /**
+     * Whether the PCRE library was built with JIT support.
+     */
+    static bool JitAvailable();
+
     /**
      * The string that was used to create the regular expression.
      *
@@ -105,6 +150,11 @@ public:
      * pattern.
      */
     int getCaptureSubpatternCount();
+    /**
+     * The number of capture groups a match reports, which is capped for
+     * patterns with very many.
+     */
+    int getMatchGroupCount();
     /**
      * Convert a named capture group to its absolute numbered group equivelent.
      *
@@ -126,6 +176,27 @@ public:
     MatchInfo getFirstMatchInfo(const QString &text);
     MatchInfo getLastMatchInfo(const QString &text);
 
+    /**
+     * The number of matches getEveryMatchInfo would find, without
+     * building any MatchInfo.
+     */
+    int countMatches(const QString &text);
+
+    /**
+     * Visits the matches getEveryMatchInfo would find, in order, with a
+     * single offsets array for the whole text.
+     *
+     * @return The number of matches visited.
+     */
+    int forEachMatch(const QString &text, const MatchVisitor &visitor);
+
+    /**
+     * Fills in match_info from the offsets a MatchVisitor is given.
+     * The capture groups list of match_info is reused, so filling the
+     * same MatchInfo match after match does not allocate.
+     */
+    static void toMatchInfo(const int *ovector, int group_count, MatchInfo &match_info);
+
     /**
      * Replaces the given text using a replacement pattern. The matched text is
      * required because the replacement pattern can references the capture
@@ -142,9 +213,33 @@ public:
      */
     bool replaceText(const QString &text, const QList<std::pair<int, int>> &capture_groups_offsets, const QString &replacement_pattern, QString &out);
 
+    /**
+     * The replacement pattern compiled for this pattern. The template
+     * last asked for is kept, so every file of a Replace All shares one
+     * compile.
+     */
+    QSharedPointer<PCREReplaceTemplate> getReplaceTemplate(const QString &replacement_pattern);
+
+    /**
+     * Replaces every match in one forward pass over the text.
+     *
+     * Only the matches that end at or after from and start at or before
+     * to are replaced; by default that is all of them.
+     *
+     * @param[out] out The text with the replacements made.
+     *
+     * @return The number of replacements made.
+     */
+    int replaceEveryMatch(const QString &text, const QString &replacement_pattern, QString &out, int from = 0, int to = INT_MAX);
+
 private:
     MatchInfo generateMatchInfo(int ovector[], int ovector_count);
 
+    MatchInfo literalMatchInfo(int offset);
+
+    // Records that a pcre16_exec gave up on a limit
+    void checkMatchLimit(int rc);
+
     // Store if the pattern is valid.
     bool m_valid;
     // The regular expression as a string.
@@ -155,6 +250,17 @@ private:
     pcre16_extra *m_study;
     // The number of capture subpatterns with the expression.
     int m_captureSubpatternCount;
+    // Whether the study compiled the pattern to machine code.
+    bool m_jit;
+    // Set when the pattern only matches a fixed string, which is then
+    // searched for without PCRE.
+    LiteralSearch *m_literal;
+    // Set by any thread whose search went over the match limit.
+    QAtomicInt m_matchLimitExceeded;
+    // The last replacement compiled, and the mutex that guards it, as
+    // the expression may be shared by several threads.
+    QSharedPointer<PCREReplaceTemplate> m_replaceTemplate;
+    QMutex m_replaceTemplateMutex;
 };
 
 #endif // SPCRE_H
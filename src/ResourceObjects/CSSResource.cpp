@@ -22,6 +22,7 @@
 **
 *************************************************************************/
 
+#include <QtCore/QMutexLocker>
 #include <QtGui/QDesktopServices>
 
 #include "Misc/Utility.h"
@@ -50,7 +51,8 @@ static const QString W3C_HTML_FORM = "<html>"
 
 CSSResource::CSSResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
     : TextResource(mainfolder, fullfilepath, parent),
-      m_TemporaryValidationFiles(QList<QString>())
+      m_TemporaryValidationFiles(QList<QString>()),
+      m_CSSInfoRevision(-1)
 {
 }
 
@@ -77,6 +79,19 @@ bool CSSResource::DeleteCSStyles(QList<CSSInfo::CSSSelector *> css_selectors)
     return false;
 }
 
+QSharedPointer<CSSInfo> CSSResource::GetCSSInfo()
+{
+    QMutexLocker locker(&m_CSSInfoMutex);
+
+    if (!m_CSSInfo || m_CSSInfoRevision != GetTextRevision()) {
+        Snapshot snapshot = GetSnapshot();
+        m_CSSInfo = QSharedPointer<CSSInfo>(new CSSInfo(snapshot.text, true));
+        m_CSSInfoRevision = snapshot.revision;
+    }
+
+    return m_CSSInfo;
+}
+
 Resource::ResourceType CSSResource::Type() const
 {
     return Resource::CSSResourceType;
@@ -26,6 +26,9 @@
 #ifndef CSSRESOURCE_H
 #define CSSRESOURCE_H
 
+#include <QtCore/QMutex>
+#include <QtCore/QSharedPointer>
+
 #include "Misc/CSSInfo.h"
 #include "ResourceObjects/TextResource.h"
 
@@ -51,6 +54,13 @@ public:
 
     bool DeleteCSStyles(QList<CSSInfo::CSSSelector *> css_selectors);
 
+    /**
+     * @return The parse of the current text, shared by everyone who
+     *         asks until the text changes. Thread safe; the parse
+     *         must only be read.
+     */
+    QSharedPointer<CSSInfo> GetCSSInfo();
+
     // inherited
     virtual ResourceType Type() const;
 
@@ -59,6 +69,15 @@ public:
 private:
 
     QList<QString> m_TemporaryValidationFiles;
+
+    QSharedPointer<CSSInfo> m_CSSInfo;
+
+    /**
+     * The text revision m_CSSInfo was parsed from.
+     */
+    int m_CSSInfoRevision;
+
+    QMutex m_CSSInfoMutex;
 };
 
 #endif // CSSRESOURCE_H
@@ -32,6 +32,7 @@
 #include "BookManipulation/XhtmlDoc.h"
 #include "Misc/Utility.h"
 #include "Misc/GumboInterface.h"
+#include "Misc/XHTMLHighlighter.h"
 #include "ResourceObjects/HTMLResource.h"
 #include "sigil_exception.h"
 
@@ -47,7 +48,8 @@ HTMLResource::HTMLResource(const QString &mainfolder, const QString &fullfilepat
     :
     XMLResource(mainfolder, fullfilepath, parent),
     m_Resources(resources),
-    m_TOCCache("")
+    m_TOCCache(""),
+    m_ManifestPropertiesRevision(-1)
 {
 }
 
@@ -71,6 +73,12 @@ bool HTMLResource::LoadFromDisk()
     return false;
 }
 
+
+void HTMLResource::PrepareTextDocumentOffThread(TextDocument &document) const
+{
+    XHTMLHighlighter::PrepareStates(document);
+}
+
 void HTMLResource::SetText(const QString &text)
 {
     emit TextChanging();
@@ -82,6 +90,23 @@ void HTMLResource::SetText(const QString &text)
     TrackNewResources(GetPathsToLinkedResources());
 }
 
+bool HTMLResource::SetTextIfUnchanged(const QString &text, int revision)
+{
+    // Views only get ready for a change that is going to be made
+    if (GetTextRevision() != revision) {
+        return false;
+    }
+
+    emit TextChanging();
+
+    if (!XMLResource::SetTextIfUnchanged(text, revision)) {
+        return false;
+    }
+
+    TrackNewResources(GetPathsToLinkedResources());
+    return true;
+}
+
 QString HTMLResource::GetTOCCache()
 {
     if (m_TOCCache.isEmpty()) {
@@ -110,9 +135,17 @@ QStringList HTMLResource::GetLinkedStylesheets()
 
 QStringList HTMLResource::GetManifestProperties() const
 {
+    // Parsed from a snapshot of the text, without a lock held
+    const TextResource::Snapshot snapshot = GetSnapshot();
+    {
+        QMutexLocker locker(&m_ManifestPropertiesMutex);
+        if (m_ManifestPropertiesRevision == snapshot.revision) {
+            return m_ManifestProperties;
+        }
+    }
+
     QStringList properties;
-    QReadLocker locker(&GetLock());
-    GumboInterface gi = GumboInterface(GetText(), GetEpubVersion());
+    GumboInterface gi = GumboInterface(snapshot.text, GetEpubVersion());
     gi.parse();
     QStringList props = gi.get_all_properties();
     props.removeDuplicates();
@@ -123,14 +156,22 @@ QStringList HTMLResource::GetManifestProperties() const
     if (props.contains("script")) properties.append("scripted");
     if (props.contains("epub:switch")) properties.append("switch");
     if (props.contains("remote-resources")) properties.append("remote-resources");
+
+    QMutexLocker locker(&m_ManifestPropertiesMutex);
+    m_ManifestProperties = properties;
+    m_ManifestPropertiesRevision = snapshot.revision;
     return properties;
 }
 
 
-QStringList HTMLResource::SplitOnSGFSectionMarkers()
+XhtmlDoc::SGFSections HTMLResource::SplitOnSGFSectionMarkers()
 {
-    QStringList sections = XhtmlDoc::GetSGFSectionSplits(GetText());
-    SetText(CleanSource::Mend(sections.takeFirst(),GetEpubVersion()));
+    XhtmlDoc::SGFSections sections = XhtmlDoc::GetSGFSections(GetText());
+    if (sections.isEmpty()) {
+        return sections;
+    }
+    SetText(CleanSource::Mend(sections.Section(0), GetEpubVersion()));
+    sections.bodies.removeFirst();
     return sections;
 }
 
@@ -25,7 +25,10 @@
 #define HTMLRESOURCE_H
 
 #include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
 
+#include "BookManipulation/XhtmlDoc.h"
 #include "Misc/CSSInfo.h"
 #include "ResourceObjects/XMLResource.h"
 
@@ -66,6 +69,8 @@ public:
 
     virtual void SetText(const QString &text);
 
+    virtual bool SetTextIfUnchanged(const QString &text, int revision);
+
     virtual bool LoadFromDisk();
 
     void SaveToDisk(bool book_wide_save = false);
@@ -76,9 +81,9 @@ public:
      * The first section is set as the content of the resource,
      * and the others are returned.
      *
-     * @return The content of all the sections except the first.
+     * @return All the sections except the first.
      */
-    QStringList SplitOnSGFSectionMarkers();
+    XhtmlDoc::SGFSections SplitOnSGFSectionMarkers();
 
     /**
      * Returns the paths to all the linked resources
@@ -95,6 +100,10 @@ public:
      */
     QStringList GetLinkedStylesheets();
 
+    /**
+     * Returns the EPUB3 manifest properties the content calls for,
+     * e.g. scripted or svg. Worked out once per text revision.
+     */
     QStringList GetManifestProperties() const;
 
     bool DeleteCSStyles(QList<CSSInfo::CSSSelector *> css_selectors);
@@ -104,6 +113,13 @@ signals:
     void TextChanging();
     void LoadedFromDisk();
 
+protected:
+    /**
+     * Works out the XHTML highlighting states of the blocks,
+     * so Code View can show the document without a pass over it.
+     */
+    virtual void PrepareTextDocumentOffThread(TextDocument &document) const;
+
 private:
     /**
      * Makes sure the given paths are watched for updates.
@@ -122,6 +138,11 @@ private:
      */
     const QHash<QString, Resource *> &m_Resources;
     QString m_TOCCache;
+
+    // The manifest properties and the text revision they are from
+    mutable QMutex m_ManifestPropertiesMutex;
+    mutable QStringList m_ManifestProperties;
+    mutable int m_ManifestPropertiesRevision;
 };
 
 #endif // HTMLRESOURCE_H
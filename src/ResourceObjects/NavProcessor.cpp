@@ -26,6 +26,8 @@
 #include <QDir>
 #include <QUrl>
 #include <QFileInfo>
+#include <QMutex>
+#include <QSet>
 
 #include "Misc/Utility.h"
 #include "Misc/SettingsStore.h"
@@ -42,6 +44,19 @@ static const QString NAV_TOC_PATTERN = "\\s*<!--\\s*SIGIL_REPLACE_TOC_HERE\\s*--
 static const QStringList SIGIL_FOLDERS = QStringList() << "Images" << "Fonts" << "Text" << "Styles" 
                                                        << "Audio" << "Video" << "Misc";
 
+// The parsed nav of each book, by nav resource identifier. Book Browser
+// menus, the OPF model and reports all ask about landmarks, so the nav
+// is parsed once per edit rather than once per question.
+struct CachedNavModel {
+    int revision;
+    QString nav_path;
+    QSharedPointer<const NavModel> model;
+};
+
+static QMutex s_NavModelsMutex;
+
+static QHash<QString, CachedNavModel> s_NavModels;
+
 
 NavProcessor::NavProcessor(HTMLResource * nav_resource)
   : m_NavResource(nav_resource)
@@ -82,13 +97,128 @@ NavProcessor::~NavProcessor()
 }
 
 
+QSharedPointer<const NavModel> NavProcessor::Model()
+{
+    QString identifier = m_NavResource->GetIdentifier();
+    // Landmark paths are resolved against the nav's own path
+    QString nav_path = m_NavResource->GetRelativePathToOEBPS();
+    {
+        QMutexLocker locker(&s_NavModelsMutex);
+        QHash<QString, CachedNavModel>::const_iterator it = s_NavModels.constFind(identifier);
+        if (it != s_NavModels.constEnd() && it.value().revision == m_NavResource->GetTextRevision() &&
+            it.value().nav_path == nav_path) {
+            return it.value().model;
+        }
+    }
+
+    TextResource::Snapshot snapshot = m_NavResource->GetSnapshot();
+    const QString &source = snapshot.text;
+
+    QSharedPointer<NavModel> model(new NavModel());
+    model->toc = ParseTOC(source);
+    model->landmarks = ParseLandmarks(source);
+    model->pagelist = ParsePageList(source);
+    for (int i = 0; i < model->landmarks.count(); ++i) {
+        const NavLandmarkEntry &le = model->landmarks.at(i);
+        QString href = ConvertHREFToOEBPSRelative(le.href);
+        QString path = href.split('#', QString::KeepEmptyParts).at(0);
+        if (!model->landmark_pos.contains(path)) {
+            model->landmark_pos[path] = i;
+        }
+        model->landmark_codes[path] = le.etype;
+    }
+
+    QMutexLocker locker(&s_NavModelsMutex);
+    QHash<QString, CachedNavModel>::iterator it = s_NavModels.find(identifier);
+    // Another thread may already have cached a newer text
+    if (it == s_NavModels.end() || it.value().revision <= snapshot.revision) {
+        CachedNavModel entry;
+        entry.revision = snapshot.revision;
+        entry.nav_path = nav_path;
+        entry.model = model;
+        s_NavModels.insert(identifier, entry);
+    }
+    return model;
+}
+
+
 QList<NavLandmarkEntry> NavProcessor::GetLandmarks()
 {
+    if (!m_NavResource) return QList<NavLandmarkEntry>();
+    return Model()->landmarks;
+}
+
+
+QList<NavPageListEntry> NavProcessor::GetPageList()
+{
+    if (!m_NavResource) return QList<NavPageListEntry>();
+    return Model()->pagelist;
+}
+
+
+QList<NavTOCEntry> NavProcessor::GetTOC()
+{
+    if (!m_NavResource) return QList<NavTOCEntry>();
+    return Model()->toc;
+}
+
+
+QString NavProcessor::GetTextWithout(const QSet<QString> & excluded_paths)
+{
+    if (!m_NavResource) return QString();
+
+    QSharedPointer<const NavModel> model = Model();
+    QString nav_text = m_NavResource->GetText();
+
+    // Entries nested under one that is left out go with it
+    QList<NavTOCEntry> toclist;
+    int skip_below = 0;
+    foreach(NavTOCEntry te, model->toc) {
+        if (skip_below > 0) {
+            if (te.lvl > skip_below) continue;
+            skip_below = 0;
+        }
+        QString path = ConvertHREFToOEBPSRelative(te.href).split('#', QString::KeepEmptyParts).at(0);
+        if (excluded_paths.contains(path)) {
+            skip_below = te.lvl;
+            continue;
+        }
+        toclist.append(te);
+    }
+    // Sections that lose nothing are left exactly as they are
+    if (toclist.count() != model->toc.count()) {
+        nav_text = WithTOC(nav_text, toclist);
+    }
+
     QList<NavLandmarkEntry> landlist;
-    if (!m_NavResource) return landlist; 
+    foreach(NavLandmarkEntry le, model->landmarks) {
+        QString path = ConvertHREFToOEBPSRelative(le.href).split('#', QString::KeepEmptyParts).at(0);
+        if (!excluded_paths.contains(path)) {
+            landlist.append(le);
+        }
+    }
+    if (landlist.count() != model->landmarks.count()) {
+        nav_text = WithLandmarks(nav_text, landlist);
+    }
 
-    QReadLocker locker(&m_NavResource->GetLock());
-    QString source = m_NavResource->GetText();
+    QList<NavPageListEntry> pagelist;
+    foreach(NavPageListEntry pe, model->pagelist) {
+        QString path = ConvertHREFToOEBPSRelative(pe.href).split('#', QString::KeepEmptyParts).at(0);
+        if (!excluded_paths.contains(path)) {
+            pagelist.append(pe);
+        }
+    }
+    if (pagelist.count() != model->pagelist.count()) {
+        nav_text = WithPageList(nav_text, pagelist);
+    }
+
+    return nav_text;
+}
+
+
+QList<NavLandmarkEntry> NavProcessor::ParseLandmarks(QString source)
+{
+    QList<NavLandmarkEntry> landlist;
 
     // user may leave nav in unparseable state so use
     // regular expressions to try and extract just the landmarks code only from main nav
@@ -128,13 +258,9 @@ QList<NavLandmarkEntry> NavProcessor::GetLandmarks()
 }
 
 
-QList<NavPageListEntry> NavProcessor::GetPageList()
+QList<NavPageListEntry> NavProcessor::ParsePageList(QString source)
 {
     QList<NavPageListEntry> pagelist;
-    if (!m_NavResource) return pagelist; 
-        
-    QReadLocker locker(&m_NavResource->GetLock());
-    QString source = m_NavResource->GetText();
 
     // user may leave nav in unparseable state so use
     // regular expressions to try and extract just the page-list code only from main nav
@@ -172,13 +298,9 @@ QList<NavPageListEntry> NavProcessor::GetPageList()
 }
 
 
-QList<NavTOCEntry> NavProcessor::GetTOC()
+QList<NavTOCEntry> NavProcessor::ParseTOC(QString source)
 {
     QList<NavTOCEntry> toclist;
-    if (!m_NavResource) return toclist; 
-        
-    QReadLocker locker(&m_NavResource->GetLock());
-    QString source = m_NavResource->GetText();
 
     // user may leave nav in unparseable state so use
     // regular expressions to try and extract just the toc code only from main nav
@@ -348,10 +470,15 @@ QString NavProcessor::BuildPageList(const QList<NavPageListEntry> & pagelist)
 void NavProcessor::SetPageList(const QList<NavPageListEntry> & pagelist)
 {
     if (!m_NavResource) return; 
-        
+
+    m_NavResource->SetText(WithPageList(m_NavResource->GetText(), pagelist));
+}
+
+
+QString NavProcessor::WithPageList(const QString & nav_text, const QList<NavPageListEntry> & pagelist)
+{
     bool found_pagelist = false;
-    // QWriteLocker locker(&m_NavResource->GetLock());
-    GumboInterface gi = GumboInterface(m_NavResource->GetText(), "3.0");
+    GumboInterface gi = GumboInterface(nav_text, "3.0");
     gi.parse();
     QList<GumboNode*> nav_nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_NAV);
     for (int i = 0; i < nav_nodes.length(); ++i) {
@@ -384,7 +511,7 @@ void NavProcessor::SetPageList(const QList<NavPageListEntry> & pagelist)
     if (mo.hasMatch()) {
         nav_data.replace(mo.capturedStart(), mo.capturedLength(), page_xml);
     }
-    m_NavResource->SetText(nav_data);
+    return nav_data;
 }
 
 
@@ -392,9 +519,14 @@ void NavProcessor::SetLandmarks(const QList<NavLandmarkEntry> & landlist)
 {
     if (!m_NavResource) return; 
 
+    m_NavResource->SetText(WithLandmarks(m_NavResource->GetText(), landlist));
+}
+
+
+QString NavProcessor::WithLandmarks(const QString & nav_text, const QList<NavLandmarkEntry> & landlist)
+{
     bool found_landmarks = false;
-    // QWriteLocker locker(&m_NavResource->GetLock());
-    GumboInterface gi = GumboInterface(m_NavResource->GetText(), "3.0");
+    GumboInterface gi = GumboInterface(nav_text, "3.0");
     gi.parse();
     const QList<GumboNode*> nav_nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_NAV);
     for (int i = 0; i < nav_nodes.length(); ++i) {
@@ -427,7 +559,7 @@ void NavProcessor::SetLandmarks(const QList<NavLandmarkEntry> & landlist)
     if (mo.hasMatch()) {
         nav_data.replace(mo.capturedStart(), mo.capturedLength(), land_xml);
     }
-    m_NavResource->SetText(nav_data);
+    return nav_data;
 }
 
 
@@ -436,9 +568,14 @@ void NavProcessor::SetTOC(const QList<NavTOCEntry> & toclist)
 {
     if (!m_NavResource) return; 
 
+    m_NavResource->SetText(WithTOC(m_NavResource->GetText(), toclist));
+}
+
+
+QString NavProcessor::WithTOC(const QString & nav_text, const QList<NavTOCEntry> & toclist)
+{
     bool found_toc = false;
-    // QWriteLocker locker(&m_NavResource->GetLock());
-    GumboInterface gi = GumboInterface(m_NavResource->GetText(), "3.0");
+    GumboInterface gi = GumboInterface(nav_text, "3.0");
     gi.parse();
     const QList<GumboNode*> nav_nodes = gi.get_all_nodes_with_tag(GUMBO_TAG_NAV);
     for (int i = 0; i < nav_nodes.length(); ++i) {
@@ -471,16 +608,17 @@ void NavProcessor::SetTOC(const QList<NavTOCEntry> & toclist)
     if (mo.hasMatch()) {
         nav_data.replace(mo.capturedStart(), mo.capturedLength(), toc_xml);
     }
-    m_NavResource->SetText(nav_data);
+    return nav_data;
 }
 
 
 void NavProcessor::AddLandmarkCode(const Resource *resource, QString new_code, bool toggle)
 {
     if (new_code.isEmpty()) return;
-    QList<NavLandmarkEntry> landlist = GetLandmarks();
+    QSharedPointer<const NavModel> model = Model();
+    QList<NavLandmarkEntry> landlist = model->landmarks;
     QWriteLocker locker(&m_NavResource->GetLock());
-    int pos = GetResourceLandmarkPos(resource, landlist);
+    int pos = model->landmark_pos.value(resource->GetRelativePathToOEBPS(), -1);
     QString current_code;
     if (pos > -1) {
         NavLandmarkEntry le = landlist.at(pos);
@@ -509,40 +647,42 @@ void NavProcessor::AddLandmarkCode(const Resource *resource, QString new_code, b
 
 void NavProcessor::RemoveLandmarkForResource(const Resource * resource) 
 {
-    QList<NavLandmarkEntry> landlist = GetLandmarks();
-    QWriteLocker locker(&m_NavResource->GetLock());
-    int pos = GetResourceLandmarkPos(resource, landlist);
-    if (pos > -1) {
-        landlist.removeAt(pos);
-        SetLandmarks(landlist);
-    }
+    RemoveLandmarksForResources(QList<const Resource *>() << resource);
 }
 
-int NavProcessor::GetResourceLandmarkPos(const Resource *resource, const QList<NavLandmarkEntry> & landlist)
+void NavProcessor::RemoveLandmarksForResources(const QList<const Resource *> &resources)
 {
-    QString resource_oebps_path = resource->GetRelativePathToOEBPS();
-    for (int i=0; i < landlist.count(); ++i) {
-        NavLandmarkEntry le = landlist.at(i);
-        QString href = ConvertHREFToOEBPSRelative(le.href);
-        QStringList parts = href.split('#', QString::KeepEmptyParts);
-        if (parts.at(0) == resource_oebps_path) {
-            return i;
+    QSharedPointer<const NavModel> model = Model();
+    QSet<int> positions;
+    foreach(const Resource *resource, resources) {
+        int pos = model->landmark_pos.value(resource->GetRelativePathToOEBPS(), -1);
+        if (pos > -1) {
+            positions.insert(pos);
+        }
+    }
+    if (positions.isEmpty()) {
+        return;
+    }
+
+    // The nav is rewritten once however many landmarks go
+    QList<NavLandmarkEntry> landlist;
+    for (int i = 0; i < model->landmarks.count(); ++i) {
+        if (!positions.contains(i)) {
+            landlist.append(model->landmarks.at(i));
         }
     }
-    return -1;
+    QWriteLocker locker(&m_NavResource->GetLock());
+    SetLandmarks(landlist);
 }
 
 QString NavProcessor::GetLandmarkCodeForResource(const Resource *resource)
 {
-    const QList<NavLandmarkEntry> landlist = GetLandmarks();
-    QReadLocker locker(&m_NavResource->GetLock());
-    int pos = GetResourceLandmarkPos(resource, landlist);
-    QString etype;
-    if (pos > -1) {
-        NavLandmarkEntry le = landlist.at(pos);
-        etype = le.etype;
+    QSharedPointer<const NavModel> model = Model();
+    int pos = model->landmark_pos.value(resource->GetRelativePathToOEBPS(), -1);
+    if (pos < 0) {
+        return QString();
     }
-    return etype;
+    return model->landmarks.at(pos).etype;
 }
 
 QString NavProcessor::GetLandmarkNameForResource(const Resource *resource)
@@ -557,30 +697,31 @@ QString NavProcessor::GetLandmarkNameForResource(const Resource *resource)
 
 QHash <QString, QString> NavProcessor::GetLandmarkNameForPaths()
 {
-    const QList<NavLandmarkEntry> landlist = GetLandmarks();
-    QReadLocker locker(&m_NavResource->GetLock());
-    QHash <QString, QString> semantic_types;
-    foreach(NavLandmarkEntry le, landlist) {
-        QString href = ConvertHREFToOEBPSRelative(le.href);
-        QStringList parts = href.split('#', QString::KeepEmptyParts);
-        QString etype = le.etype;
-        semantic_types[parts.at(0)] = Landmarks::instance()->GetName(etype);
+    QHash <QString, QString> semantic_types = Model()->landmark_codes;
+    QHash <QString, QString>::iterator it;
+    for (it = semantic_types.begin(); it != semantic_types.end(); ++it) {
+        it.value() = Landmarks::instance()->GetName(it.value());
     }
     return semantic_types;
 }
 
 QHash <QString, QString> NavProcessor::GetLandmarkCodeForPaths()
 {
-  const QList<NavLandmarkEntry> landlist = GetLandmarks();
-  QReadLocker locker(&m_NavResource->GetLock());
-  QHash <QString, QString> semantic_types;
-  foreach(NavLandmarkEntry le, landlist) {
-    QString href = ConvertHREFToOEBPSRelative(le.href);
-    QStringList parts = href.split('#', QString::KeepEmptyParts);
-    QString etype = le.etype;
-    semantic_types[parts.at(0)] = etype;
-  }
-  return semantic_types;
+    return Model()->landmark_codes;
+}
+
+
+QList<QPair<QString, QString> > NavProcessor::GetLandmarkGuideTypes()
+{
+    QList<QPair<QString, QString> > guide_types;
+    if (!m_NavResource) return guide_types;
+    foreach(NavLandmarkEntry le, Model()->landmarks) {
+        QString gtype = Landmarks::GuideTypeForLandmark(le.etype);
+        if (gtype.isEmpty()) continue;
+        QString href = ConvertHREFToOEBPSRelative(le.href);
+        guide_types.append(qMakePair(href.split('#', QString::KeepEmptyParts).at(0), gtype));
+    }
+    return guide_types;
 }
 
 
@@ -23,6 +23,10 @@
 
 #include <QString>
 #include <QList>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QSharedPointer>
 #include "BookManipulation/Book.h"
 #include "BookManipulation/Headings.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -48,6 +52,17 @@ struct NavLandmarkEntry {
     QString href;
 };
 
+// The parsed sections of one revision of a nav
+struct NavModel {
+    QList<NavTOCEntry> toc;
+    QList<NavLandmarkEntry> landmarks;
+    QList<NavPageListEntry> pagelist;
+    // The first landmark of each file, by OEBPS relative path
+    QHash<QString, int> landmark_pos;
+    // The last landmark code of each file, by OEBPS relative path
+    QHash<QString, QString> landmark_codes;
+};
+
 class NavProcessor
 {
 public:
@@ -61,6 +76,10 @@ public:
     // Set Nav Section from Actual Book Headings
     bool GenerateTOCFromBookContents(const Book* book);
 
+    // The nav's text with the entries pointing into any of the files
+    // given by OEBPS relative path left out; the nav itself is not changed
+    QString GetTextWithout(const QSet<QString> & excluded_paths);
+
     // Set Nav Section from TOCEntry Tree
     void GenerateNavTOCFromTOCEntries(const TOCModel::TOCEntry& root);
 
@@ -70,13 +89,26 @@ public:
     // For Working with Landmarks
     void AddLandmarkCode(const Resource * resource, QString new_code, bool toggle = true);
     void RemoveLandmarkForResource(const Resource * resource);
+    void RemoveLandmarksForResources(const QList<const Resource *> &resources);
     QString GetLandmarkCodeForResource(const Resource * resource);
     QString GetLandmarkNameForResource(const Resource * resource);
     QHash<QString, QString> GetLandmarkCodeForPaths();
     QHash<QString, QString> GetLandmarkNameForPaths();
 
+    // The guide type each landmark carries over as, in nav order, with the
+    // OEBPS relative path of its file; landmarks with no guide type are left out
+    QList<QPair<QString, QString> > GetLandmarkGuideTypes();
+
 
 private:    
+    // The parsed nav, shared by all NavProcessors and parsed
+    // again only when the nav's text or path changes
+    QSharedPointer<const NavModel> Model();
+
+    QList<NavTOCEntry> ParseTOC(QString source);
+    QList<NavLandmarkEntry> ParseLandmarks(QString source);
+    QList<NavPageListEntry> ParsePageList(QString source);
+
     QString BuildTOC(const QList<NavTOCEntry> & toclist);
     QString BuildLandmarks(const QList<NavLandmarkEntry> & landlist);
     QString BuildPageList(const QList<NavPageListEntry> & pagelist);
@@ -84,8 +116,12 @@ private:
     void SetTOC(const QList<NavTOCEntry> & toclist);
     void SetLandmarks(const QList<NavLandmarkEntry> & landlist);
     void SetPageList(const QList<NavPageListEntry> & pagelist);
+
+    // The nav text given with one of its sections replaced
+    QString WithTOC(const QString & nav_text, const QList<NavTOCEntry> & toclist);
+    QString WithLandmarks(const QString & nav_text, const QList<NavLandmarkEntry> & landlist);
+    QString WithPageList(const QString & nav_text, const QList<NavPageListEntry> & pagelist);
 	
-    int GetResourceLandmarkPos(const Resource * resource, const QList<NavLandmarkEntry> & landlist);
     QList<NavTOCEntry> GetNodeTOC(GumboInterface & gi, const GumboNode* node, int lvl);
     QList<NavTOCEntry> HeadingWalker(const Headings::Heading & heading, int lvl);
 
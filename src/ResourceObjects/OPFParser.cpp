@@ -19,7 +19,6 @@
 **
 *************************************************************************/
 
-#include "Misc/EmbeddedPython.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/OPFParser.h"
 
@@ -372,76 +371,255 @@ QString BindingsEntry::convert_to_xml() const
 }
 
 
-void OPFParser::parse(const QString& source)
-{
-  int rv = 0;
-  QString traceback;
+/**
+ * the parser
+ *
+ * This is the tag scanner of opf_newparser.py rather than an XML reader:
+ * attribute values and text are kept exactly as they are written, so
+ * they are written back byte for byte, and an OPF that is not quite
+ * well-formed still loads.
+ */
 
-  QList<QVariant> args;
-  args.append(QVariant(source));
-  EmbeddedPython* epp = EmbeddedPython::instance();
-  QVariant res = epp->runInPython( QString("opf_newparser"), QString("parseopf"), args, &rv, traceback, true);
-  if (rv) fprintf(stderr, "setext parseropf error %d traceback %s\n",rv, traceback.toStdString().c_str());
+enum OPFTagType {
+    OPFTag_Begin,
+    OPFTag_End,
+    OPFTag_Single,
+    OPFTag_Special
+};
 
-  PyObjectPtr mpo = PyObjectPtr(res);
+static const QStringList OPF_PARENT_TAGS = QStringList() << "package" << "metadata" << "dc-metadata"
+                                                         << "x-metadata" << "manifest" << "spine"
+                                                         << "tours" << "guide" << "bindings";
 
-  args.clear();
-  res = epp->callPyObjMethod(mpo, QString("get_package"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext package error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_package = PackageEntry(res);
+static const QString TAG_NAME_END = ">/ \"'\r\n";
 
-  res = epp->callPyObjMethod(mpo, QString("get_metadata_attr"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext meta_attr error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_metans = MetaNSEntry(res);
+// Reads the text or the tag at pos and moves pos past it.
+// Returns false at the end of the source.
+static bool NextToken(const QString& opf, int& pos, QString& token, bool& is_tag)
+{
+    int p = pos;
+    int n = opf.length();
+    if (p >= n) {
+        return false;
+    }
+    if (opf.at(p) != '<') {
+        int res = opf.indexOf('<', p);
+        if (res == -1) {
+            res = n;
+        }
+        pos = res;
+        token = opf.mid(p, res - p);
+        is_tag = false;
+        return true;
+    }
+    int te;
+    // handle comment as a special case
+    if (opf.midRef(p, 4) == QLatin1String("<!--")) {
+        te = opf.indexOf("-->", p + 1);
+        if (te != -1) {
+            te = te + 2;
+        }
+    } else {
+        te = opf.indexOf('>', p + 1);
+        int ntb = opf.indexOf('<', p + 1);
+        if ((ntb != -1) && (ntb < te)) {
+            pos = ntb;
+            token = opf.mid(p, ntb - p);
+            is_tag = false;
+            return true;
+        }
+    }
+    // an unclosed tag runs to the end
+    if (te == -1) {
+        te = n - 1;
+    }
+    pos = te + 1;
+    token = opf.mid(p, te + 1 - p);
+    is_tag = true;
+    return true;
+}
 
-  res = epp->callPyObjMethod(mpo, QString("get_metadata"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext metadata error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_metadata.clear();
-  QList<QVariant> lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_metadata.append(MetaEntry(qv));
-  }
+// Splits a tag into its lower cased name, without any opf: prefix,
+// and its attributes; the attributes of end tags are not read.
+static OPFTagType ParseTag(const QString& s, QString& tname, QHash<QString,QString>& tattr)
+{
+    int n = s.length();
+    int p = 1;
+    bool end = false;
+    while ((p < n) && (s.at(p) == ' ')) p++;
+    if ((p < n) && (s.at(p) == '/')) {
+        end = true;
+        p++;
+        while ((p < n) && (s.at(p) == ' ')) p++;
+    }
+    int b = p;
+    if (s.midRef(b).startsWith(QLatin1String("!--"))) {
+        return OPFTag_Special;
+    }
+    while ((p < n) && !TAG_NAME_END.contains(s.at(p))) p++;
+    tname = s.mid(b, p - b).toLower();
+    if (tname.startsWith("opf:")) {
+        tname = tname.mid(4);
+    }
+    if ((tname == "?xml") || (tname == "!doctype")) {
+        return OPFTag_Special;
+    }
+    if (end) {
+        return OPFTag_End;
+    }
+    while (s.indexOf('=', p) != -1) {
+        while ((p < n) && (s.at(p) == ' ')) p++;
+        b = p;
+        while ((p < n) && (s.at(p) != '=')) p++;
+        QString aname = s.mid(b, p - b).toLower();
+        while (aname.endsWith(' ')) {
+            aname.chop(1);
+        }
+        p++;
+        while ((p < n) && (s.at(p) == ' ')) p++;
+        QString val;
+        if ((p < n) && ((s.at(p) == '"') || (s.at(p) == '\''))) {
+            QChar qt = s.at(p);
+            p++;
+            b = p;
+            // try to work around missing end quotes
+            while ((p < n) && (s.at(p) != '>') && (s.at(p) != '<') && (s.at(p) != qt)) p++;
+            val = s.mid(b, p - b);
+            p++;
+        } else {
+            b = p;
+            while ((p < n) && (s.at(p) != '>') && (s.at(p) != '/') && (s.at(p) != ' ')) p++;
+            val = s.mid(b, p - b);
+        }
+        tattr[aname] = val;
+    }
+    if (s.indexOf('/', p) >= 0) {
+        return OPFTag_Single;
+    }
+    return OPFTag_Begin;
+}
+
+static QString TakeAttribute(QHash<QString,QString>& atts, const QString& key, const QString& def)
+{
+    if (atts.contains(key)) {
+        return atts.take(key);
+    }
+    return def;
+}
 
-  m_idpos.clear();
-  m_hrefpos.clear();
 
-  res = epp->callPyObjMethod(mpo, QString("get_manifest"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext manifest error %d traceback %s\n",rv, traceback.toStdString().c_str());
+void OPFParser::parse(const QString& source)
+{
+  // an OPF without a package tag gets an empty one, as it always has
+  m_package = PackageEntry("", "", QStringList(), QStringList());
+  m_metans = MetaNSEntry();
+  m_metadata.clear();
   m_manifest.clear();
-  lst = res.toList();
-  for (int i = 0; i < lst.count(); i++) {
-    ManifestEntry me = ManifestEntry(lst.at(i));
-    m_idpos[me.m_id] = i;
-    m_hrefpos[me.m_href] = i;
-    m_manifest.append(me);
-  }
+  m_spineattr = SpineAttrEntry();
+  m_spine.clear();
+  m_guide.clear();
+  m_bindings.clear();
+  m_idpos.clear();
+  m_hrefpos.clear();
 
-  res = epp->callPyObjMethod(mpo, QString("get_spine_attr"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext spineattr error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_spineattr = SpineAttrEntry(res);
+  QStringList prefix;
+  QString tcontent;
+  QHash<QString,QString> last_tattr;
+  int cnt = 0;
+  int pos = 0;
+  QString token;
+  bool is_tag;
+
+  while (NextToken(source, pos, token, is_tag)) {
+    if (!is_tag) {
+      int len = token.length();
+      while ((len > 0) && ((token.at(len - 1) == ' ') || (token.at(len - 1) == '\r') || (token.at(len - 1) == '\n'))) {
+        len--;
+      }
+      tcontent = token.left(len);
+      continue;
+    }
 
-  res = epp->callPyObjMethod(mpo, QString("get_spine"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext spine error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_spine.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_spine.append(SpineEntry(qv));
-  }
+    QString tname;
+    QHash<QString,QString> tattr;
+    OPFTagType ttype = ParseTag(token, tname, tattr);
+    bool is_parent = OPF_PARENT_TAGS.contains(tname);
+    bool found = false;
+    QString content;
+
+    if (ttype == OPFTag_Begin) {
+      tcontent = QString();
+      prefix.append(tname);
+      if (is_parent) {
+        found = true;
+      } else {
+        last_tattr = tattr;
+      }
+    } else {
+      if (ttype == OPFTag_End) {
+        if (!prefix.isEmpty()) {
+          prefix.removeLast();
+        }
+        tattr = last_tattr;
+        last_tattr.clear();
+      } else if (ttype == OPFTag_Single) {
+        tcontent = QString();
+      }
+      if ((ttype == OPFTag_Single) || ((ttype == OPFTag_End) && !is_parent)) {
+        found = true;
+        content = tcontent;
+      }
+      tcontent = QString();
+    }
 
-  res = epp->callPyObjMethod(mpo, QString("get_guide"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext guide error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_guide.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_guide.append(GuideEntry(qv));
-  }
+    if (!found) {
+      continue;
+    }
 
-  res = epp->callPyObjMethod(mpo, QString("get_bindings"), args, &rv, traceback);
-  if (rv) fprintf(stderr, "setext bindings error %d traceback %s\n",rv, traceback.toStdString().c_str());
-  m_bindings.clear();
-  lst = res.toList();
-  foreach(QVariant qv, lst) {
-    m_bindings.append(BindingsEntry(qv));
+    QString tpath = prefix.join(".");
+
+    if (tname == "package") {
+      m_package.m_version = TakeAttribute(tattr, "version", "2.0");
+      m_package.m_uniqueid = TakeAttribute(tattr, "unique-identifier", "bookid");
+      m_package.m_atts = tattr;
+    } else if (tname == "metadata") {
+      m_metans.m_atts = tattr;
+    } else if ((tname == "meta") || (tname == "link") || (tname.startsWith("dc:") && tpath.contains("metadata"))) {
+      MetaEntry me;
+      me.m_name = tname;
+      me.m_content = content.isNull() ? QString("") : content;
+      me.m_atts = tattr;
+      m_metadata.append(me);
+    } else if ((tname == "item") && tpath.contains("manifest")) {
+      QString nid = QString("xid%1").arg(cnt, 3, 10, QChar('0'));
+      cnt++;
+      ManifestEntry me;
+      me.m_id = TakeAttribute(tattr, "id", nid);
+      me.m_href = Utility::URLDecodePath(TakeAttribute(tattr, "href", ""));
+      me.m_mtype = TakeAttribute(tattr, "media-type", "");
+      me.m_atts = tattr;
+      m_idpos[me.m_id] = m_manifest.count();
+      m_hrefpos[me.m_href] = m_manifest.count();
+      m_manifest.append(me);
+    } else if (tname == "spine") {
+      m_spineattr.m_atts = tattr;
+    } else if ((tname == "itemref") && tpath.contains("spine")) {
+      SpineEntry sp;
+      sp.m_idref = TakeAttribute(tattr, "idref", "");
+      sp.m_atts = tattr;
+      m_spine.append(sp);
+    } else if ((tname == "reference") && tpath.contains("guide")) {
+      GuideEntry ge;
+      ge.m_type = TakeAttribute(tattr, "type", "");
+      ge.m_title = TakeAttribute(tattr, "title", "");
+      ge.m_href = Utility::URLDecodePath(TakeAttribute(tattr, "href", ""));
+      m_guide.append(ge);
+    } else if ((tname == "mediatype") && tpath.contains("bindings")) {
+      BindingsEntry be;
+      be.m_mtype = TakeAttribute(tattr, "media-type", "");
+      be.m_handler = TakeAttribute(tattr, "handler", "");
+      m_bindings.append(be);
+    }
   }
 }
 
@@ -27,7 +27,9 @@
 #include <QtCore/QDate>
 #include <QtCore/QDir>
 #include <QtCore/QFileInfo>
+#include <QtCore/QSet>
 #include <QtCore/QUuid>
+#include <QtConcurrent/QtConcurrent>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 #include <QDateTime>
@@ -122,7 +124,10 @@ static const QString TEMPLATE3_TEXT =
 OPFResource::OPFResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
   : XMLResource(mainfolder, fullfilepath, parent),
     m_NavResource(NULL),
-    m_WarnedAboutVersion(false)
+    m_WarnedAboutVersion(false),
+    m_ParsedOPFRevision(-1),
+    m_TransactionDepth(0),
+    m_TransactionPending(false)
 {
     CreateMimetypes();
     FillWithDefaultText();
@@ -155,17 +160,37 @@ QString OPFResource::GetText() const
 void OPFResource::SetText(const QString &text)
 {
     QWriteLocker locker(&GetLock());
+    {
+        // The new text replaces whatever an open transaction collected.
+        QMutexLocker model_locker(&m_ParsedOPFMutex);
+        m_TransactionPending = false;
+        m_TransactionOPF = OPFParser();
+    }
     QString source = ValidatePackageVersion(text);
     TextResource::SetText(source);
 }
 
 
+bool OPFResource::SetTextIfUnchanged(const QString &text, int revision)
+{
+    QWriteLocker locker(&GetLock());
+
+    if (!TextResource::SetTextIfUnchanged(ValidatePackageVersion(text), revision)) {
+        return false;
+    }
+
+    // As in SetText, the new text replaces an open transaction
+    QMutexLocker model_locker(&m_ParsedOPFMutex);
+    m_TransactionPending = false;
+    m_TransactionOPF = OPFParser();
+    return true;
+}
+
+
 QHash <Resource *, int>  OPFResource::GetReadingOrderAll( const QList <Resource *> resources)
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QHash <Resource *, int> reading_order;
     QHash<QString, int> id_order;
     for (int i = 0; i < p.m_spine.count(); ++i) {
@@ -181,9 +206,7 @@ QHash <Resource *, int>  OPFResource::GetReadingOrderAll( const QList <Resource
 int OPFResource::GetReadingOrder(const HTMLResource *html_resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     const Resource *resource = static_cast<const Resource *>(html_resource);
     QString resource_id = GetResourceManifestID(resource, p);
     for (int i = 0; i < p.m_spine.count(); ++i) {
@@ -198,9 +221,7 @@ int OPFResource::GetReadingOrder(const HTMLResource *html_resource) const
 QString OPFResource::GetMainIdentifierValue() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     int i = GetMainIdentifier(p);
     if (i > -1) {
         return QString(p.m_metadata.at(i).m_content);
@@ -210,6 +231,7 @@ QString OPFResource::GetMainIdentifierValue() const
 
 void OPFResource::SaveToDisk(bool book_wide_save)
 {
+  FlushTransaction();
   QString source = ValidatePackageVersion(CleanSource::ProcessXML(GetText(),"application/oebps-package+xml"));
     // Work around for covers appearing on the Nook. Issue 942.
     source = source.replace(QRegularExpression("<meta content=\"([^\"]+)\" name=\"cover\""), "<meta name=\"cover\" content=\"\\1\"");
@@ -246,9 +268,7 @@ QString OPFResource::GetUUIDIdentifierValue()
 {
     EnsureUUIDIdentifierPresent();
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if(me.m_name.startsWith("dc:identifier")) {
@@ -268,9 +288,7 @@ QString OPFResource::GetUUIDIdentifierValue()
 void OPFResource::EnsureUUIDIdentifierPresent()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if(me.m_name.startsWith("dc:identifier")) {
@@ -288,9 +306,7 @@ void OPFResource::EnsureUUIDIdentifierPresent()
 QString OPFResource::AddNCXItem(const QString &ncx_path)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString path_to_oebps_folder = QFileInfo(GetFullPath()).absolutePath() + "/";
     QString ncx_oebps_path  = QString(ncx_path).remove(path_to_oebps_folder);
     int n = p.m_manifest.count();
@@ -309,9 +325,7 @@ QString OPFResource::AddNCXItem(const QString &ncx_path)
 void OPFResource::UpdateNCXOnSpine(const QString &new_ncx_id)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString ncx_id = p.m_spineattr.m_atts.value(QString("toc"),"");
     if (new_ncx_id != ncx_id) {
         p.m_spineattr.m_atts[QString("toc")] = new_ncx_id;
@@ -323,9 +337,7 @@ void OPFResource::UpdateNCXOnSpine(const QString &new_ncx_id)
 void OPFResource::UpdateNCXLocationInManifest(const NCXResource *ncx)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString ncx_id = p.m_spineattr.m_atts.value(QString("toc"), "");
     int pos = p.m_idpos.value(ncx_id, -1);
     if (pos > -1) {
@@ -343,9 +355,7 @@ void OPFResource::UpdateNCXLocationInManifest(const NCXResource *ncx)
 void OPFResource::AddSigilVersionMeta()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     for (int i=0; i < p.m_metadata.count(); ++i) {
         MetaEntry me = p.m_metadata.at(i);
         if ((me.m_name == "meta") && (me.m_atts.contains("name"))) {  
@@ -370,9 +380,7 @@ void OPFResource::AddSigilVersionMeta()
 bool OPFResource::IsCoverImage(const ImageResource *image_resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString resource_id = GetResourceManifestID(image_resource, p);
     return IsCoverImageCheck(resource_id, p);
 }
@@ -392,9 +400,7 @@ bool OPFResource::IsCoverImageCheck(QString resource_id, const OPFParser & p) co
 bool OPFResource::CoverImageExists() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     return GetCoverMeta(p) > -1;
 }
 
@@ -410,9 +416,7 @@ void OPFResource::AutoFixWellFormedErrors()
 QStringList OPFResource::GetSpineOrderFilenames() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QStringList filenames_in_reading_order;
     for (int i=0; i < p.m_spine.count(); ++i) {
         SpineEntry sp = p.m_spine.at(i);
@@ -431,9 +435,7 @@ QStringList OPFResource::GetSpineOrderFilenames() const
 QList<MetaEntry> OPFResource::GetDCMetadata() const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QList<MetaEntry> metadata;
     for (int i=0; i < p.m_metadata.count(); ++i) {
         if (p.m_metadata.at(i).m_name.startsWith("dc:")) {
@@ -460,9 +462,7 @@ QList<QVariant> OPFResource::GetDCMetadataValues(QString text) const
 void OPFResource::SetDCMetadata(const QList<MetaEntry> &metadata)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     // this will not work with refines so it needs to be fixed
     RemoveDCElements(p);
     foreach(MetaEntry book_meta, metadata) {
@@ -477,9 +477,7 @@ void OPFResource::SetDCMetadata(const QList<MetaEntry> &metadata)
 void OPFResource::AddResource(const Resource *resource)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     ManifestEntry me;
     me.m_id = GetUniqueID(GetValidID(resource->Filename()),p);
     me.m_href = resource->GetRelativePathToOEBPS();
@@ -507,6 +505,32 @@ void OPFResource::AddResource(const Resource *resource)
     UpdateText(p);
 }
 
+void OPFResource::AddResources(const QList<const Resource *> &resources)
+{
+    if (resources.isEmpty()) {
+        return;
+    }
+
+    QWriteLocker locker(&GetLock());
+    OPFParser p = GetParsedOPF();
+    foreach(const Resource *resource, resources) {
+        ManifestEntry me;
+        me.m_id = GetUniqueID(GetValidID(resource->Filename()),p);
+        me.m_href = resource->GetRelativePathToOEBPS();
+        me.m_mtype = GetResourceMimetype(resource);
+        int n = p.m_manifest.count();
+        p.m_manifest.append(me);
+        p.m_idpos[me.m_id] = n;
+        p.m_hrefpos[me.m_href] = n;
+        if (resource->Type() == Resource::HTMLResourceType) {
+            SpineEntry se;
+            se.m_idref = me.m_id;
+            p.m_spine.append(se);
+        }
+    }
+    UpdateText(p);
+}
+
 void OPFResource::RemoveCoverImageProperty(QString& resource_id, OPFParser& p)
 {
     // remove the cover image property from manifest with resource_id
@@ -583,40 +607,61 @@ void OPFResource::AddCoverMetaForImage(const Resource *resource, OPFParser &p)
 
 void OPFResource::RemoveResource(const Resource *resource)
 {
+    RemoveResources(QList<const Resource *>() << resource);
+}
+
+
+void OPFResource::RemoveResources(const QList<const Resource *> &resources)
+{
+    if (resources.isEmpty()) {
+        return;
+    }
+
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     if (p.m_manifest.isEmpty()) return;
 
-    QString resource_oebps_path = resource->GetRelativePathToOEBPS();
-    int pos = p.m_hrefpos.value(resource_oebps_path, -1);
-    QString item_id = "";
+    QSet<QString> item_ids;
+    QSet<QString> spine_ids;
+    QList<const Resource *> html_resources;
+    foreach(const Resource *resource, resources) {
+        int pos = p.m_hrefpos.value(resource->GetRelativePathToOEBPS(), -1);
 
-    // Delete the meta tag for cover images before deleting the manifest entry
-    if (resource->Type() == Resource::ImageResourceType) {
-      RemoveCoverMetaForImage(resource, p);
-    }
-    if (pos > -1) {
-        item_id = p.m_manifest.at(pos).m_id;
-    }
-    if (resource->Type() == Resource::HTMLResourceType) {
-        for (int i=0; i < p.m_spine.count(); ++i) {
-            QString idref = p.m_spine.at(i).m_idref;
-            if (idref == item_id) {
-                p.m_spine.removeAt(i);
-                break;
+        // Delete the meta tag for cover images before deleting the manifest entry
+        if (resource->Type() == Resource::ImageResourceType) {
+            RemoveCoverMetaForImage(resource, p);
+        }
+        if (pos > -1) {
+            item_ids.insert(p.m_manifest.at(pos).m_id);
+        }
+        if (resource->Type() == Resource::HTMLResourceType) {
+            if (pos > -1) {
+                spine_ids.insert(p.m_manifest.at(pos).m_id);
             }
+            RemoveGuideReferenceForResource(resource, p);
+            html_resources.append(resource);
         }
-        RemoveGuideReferenceForResource(resource, p);
+    }
+    for (int i = 0; i < p.m_spine.count() && !spine_ids.isEmpty(); ++i) {
+        if (spine_ids.remove(p.m_spine.at(i).m_idref)) {
+            p.m_spine.removeAt(i--);
+        }
+    }
+    if (!html_resources.isEmpty()) {
         QString version = GetEpubVersion();
         if (version.startsWith('3')) {
             NavProcessor navproc(GetNavResource());
-            navproc.RemoveLandmarkForResource(resource);
+            navproc.RemoveLandmarksForResources(html_resources);
         }
     }
-    if (pos > -1) {
-        p.m_manifest.removeAt(pos);
+    if (!item_ids.isEmpty()) {
+        QList<ManifestEntry> manifest;
+        foreach(const ManifestEntry &me, p.m_manifest) {
+            if (!item_ids.contains(me.m_id)) {
+                manifest.append(me);
+            }
+        }
+        p.m_manifest = manifest;
         // rebuild the maps since updating them item by item would be slower
         p.m_idpos.clear();
         p.m_hrefpos.clear();
@@ -632,9 +677,7 @@ void OPFResource::RemoveResource(const Resource *resource)
 void OPFResource::AddGuideSemanticCode(HTMLResource *html_resource, QString new_code, bool toggle)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString current_code = GetGuideSemanticCodeForResource(html_resource, p);
 
     if ((current_code != new_code) || !toggle) {
@@ -648,6 +691,46 @@ void OPFResource::AddGuideSemanticCode(HTMLResource *html_resource, QString new_
     UpdateText(p);
 }
 
+bool OPFResource::UpdateGuideFromNav()
+{
+    HTMLResource *nav_resource = GetNavResource();
+    if (!nav_resource) return false;
+
+    NavProcessor navproc(nav_resource);
+    QList<QPair<QString, QString> > guide_types = navproc.GetLandmarkGuideTypes();
+    if (guide_types.isEmpty()) return false;
+
+    QWriteLocker locker(&GetLock());
+    OPFParser p = GetParsedOPF();
+    QStringList old_guide;
+    foreach(GuideEntry ge, p.m_guide) {
+        old_guide.append(ge.convert_to_xml());
+    }
+
+    // Applied in nav order just as AddGuideSemanticCode would be,
+    // to the entries already there rather than to a new guide
+    for (int i = 0; i < guide_types.count(); ++i) {
+        const QString &path = guide_types.at(i).first;
+        int pos = p.m_hrefpos.value(path, -1);
+        if ((pos < 0) || (pos >= p.m_manifest.count()) ||
+            (p.m_manifest.at(pos).m_mtype != "application/xhtml+xml")) {
+            continue;
+        }
+        RemoveDuplicateGuideCodes(guide_types.at(i).second, p);
+        SetGuideSemanticCodeForPath(guide_types.at(i).second, path, p);
+    }
+
+    QStringList new_guide;
+    foreach(GuideEntry ge, p.m_guide) {
+        new_guide.append(ge.convert_to_xml());
+    }
+    if (new_guide == old_guide) {
+        return false;
+    }
+    UpdateText(p);
+    return true;
+}
+
 QString OPFResource::GetGuideSemanticCodeForResource(const Resource *resource, const OPFParser &p) const
 {
     QString gtype;
@@ -661,12 +744,16 @@ QString OPFResource::GetGuideSemanticCodeForResource(const Resource *resource, c
 
 int OPFResource::GetGuideReferenceForResourcePos(const Resource *resource, const OPFParser &p) const
 {
-    QString resource_oebps_path = resource->GetRelativePathToOEBPS();
+    return GetGuideReferenceForPathPos(resource->GetRelativePathToOEBPS(), p);
+}
+
+int OPFResource::GetGuideReferenceForPathPos(const QString &oebps_path, const OPFParser &p) const
+{
     for (int i=0; i < p.m_guide.count(); ++i) {
         GuideEntry ge = p.m_guide.at(i);
         QString href = ge.m_href;
         QStringList parts = href.split('#', QString::KeepEmptyParts);
-        if (parts.at(0) == resource_oebps_path) {
+        if (parts.at(0) == oebps_path) {
             return i;
         }
     }
@@ -707,9 +794,15 @@ void OPFResource::RemoveGuideReferenceForResource(const Resource *resource, OPFP
 
 
 void OPFResource::SetGuideSemanticCodeForResource(QString code, const Resource *resource, OPFParser& p)
+{
+    SetGuideSemanticCodeForPath(code, resource->GetRelativePathToOEBPS(), p);
+}
+
+
+void OPFResource::SetGuideSemanticCodeForPath(QString code, const QString &oebps_path, OPFParser& p)
 {
     if (code.isEmpty()) return;
-    int pos = GetGuideReferenceForResourcePos(resource, p);
+    int pos = GetGuideReferenceForPathPos(oebps_path, p);
     QString title = GuideItems::instance()->GetName(code);
     if (pos > -1) {
         GuideEntry ge = p.m_guide.at(pos);
@@ -720,7 +813,7 @@ void OPFResource::SetGuideSemanticCodeForResource(QString code, const Resource *
         GuideEntry ge;
         ge.m_type = code;
         ge.m_title = title;
-        ge.m_href = resource->GetRelativePathToOEBPS();
+        ge.m_href = oebps_path;
         p.m_guide.append(ge);
     }
 }
@@ -729,9 +822,7 @@ void OPFResource::SetGuideSemanticCodeForResource(QString code, const Resource *
 QString OPFResource::GetGuideSemanticCodeForResource(const Resource *resource) const
 {
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     return GetGuideSemanticCodeForResource(resource, p);
 }
 
@@ -751,9 +842,7 @@ QHash <QString, QString>  OPFResource::GetSemanticCodeForPaths()
   }
 
   QReadLocker locker(&GetLock());
-  QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-  OPFParser p;
-  p.parse(source);
+  OPFParser p = GetParsedOPF();
 
   QHash <QString, QString> semantic_types;
   foreach(GuideEntry ge, p.m_guide) {
@@ -774,9 +863,7 @@ QHash <QString, QString>  OPFResource::GetGuideSemanticNameForPaths()
     }
 
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
 
     QHash <QString, QString> semantic_types;
     foreach(GuideEntry ge, p.m_guide) {
@@ -802,9 +889,7 @@ QHash <QString, QString>  OPFResource::GetGuideSemanticNameForPaths()
 void OPFResource::SetResourceAsCoverImage(ImageResource *image_resource)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString resource_id = GetResourceManifestID(image_resource, p);
 
     // First deal with any previous covers by removing 
@@ -839,20 +924,21 @@ void OPFResource::SetResourceAsCoverImage(ImageResource *image_resource)
 void OPFResource::UpdateSpineOrder(const QList<::HTMLResource *> html_files)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
+    // The first spine entry for each idref, found once instead of per file
+    QHash<QString, int> spine_pos;
+    for (int i = p.m_spine.count() - 1; i >= 0; --i) {
+        spine_pos[p.m_spine.at(i).m_idref] = i;
+    }
     QList<SpineEntry> new_spine;
+    new_spine.reserve(html_files.count());
+    bool unchanged = html_files.count() == p.m_spine.count();
     foreach(HTMLResource * html_resource, html_files) {
         const Resource *resource = static_cast<const Resource *>(html_resource);
         QString id = GetResourceManifestID(resource, p);
-        int found = -1;
-        for (int i = 0; i < p.m_spine.count(); ++i) {
-           SpineEntry se = p.m_spine.at(i);
-           if (se.m_idref == id) {
-               found = i;
-               break;
-           }
+        int found = spine_pos.value(id, -1);
+        if (found != new_spine.count()) {
+            unchanged = false;
         }
         if (found > -1) {
             new_spine.append(p.m_spine.at(found));
@@ -862,6 +948,11 @@ void OPFResource::UpdateSpineOrder(const QList<::HTMLResource *> html_files)
             new_spine.append(se);
         }
     }
+    // The Book Browser sends the order on every refresh; most of the time
+    // nothing moved and the OPF is left alone
+    if (unchanged) {
+        return;
+    }
     p.m_spine.clear();
     p.m_spine = new_spine;
     UpdateText(p);
@@ -871,29 +962,24 @@ void OPFResource::UpdateSpineOrder(const QList<::HTMLResource *> html_files)
 void OPFResource::ResourceRenamed(const Resource *resource, QString old_full_path)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString path_to_oebps_folder = QFileInfo(GetFullPath()).absolutePath() + "/";
     QString resource_oebps_path  = QString(old_full_path).remove(path_to_oebps_folder);
     QString old_id;
     QString new_id;
-    for (int i=0; i < p.m_manifest.count(); ++i) {
-        QString href = p.m_manifest.at(i).m_href;
-        if (href == resource_oebps_path) {
-            ManifestEntry me = p.m_manifest.at(i);
-            QString old_href = me.m_href;
-            me.m_href = resource->GetRelativePathToOEBPS();
-            old_id = me.m_id;
-            p.m_idpos.remove(old_id);
-            new_id = GetUniqueID(GetValidID(resource->Filename()),p);
-            me.m_id = new_id;
-            p.m_idpos[new_id] = i;
-            p.m_hrefpos.remove(old_href);
-            p.m_hrefpos[me.m_href] = i;
-            p.m_manifest.replace(i, me);
-            break;
-        }
+    int i = p.m_hrefpos.value(resource_oebps_path, -1);
+    if (i > -1) {
+        ManifestEntry me = p.m_manifest.at(i);
+        QString old_href = me.m_href;
+        me.m_href = resource->GetRelativePathToOEBPS();
+        old_id = me.m_id;
+        p.m_idpos.remove(old_id);
+        new_id = GetUniqueID(GetValidID(resource->Filename()),p);
+        me.m_id = new_id;
+        p.m_idpos[new_id] = i;
+        p.m_hrefpos.remove(old_href);
+        p.m_hrefpos[me.m_href] = i;
+        p.m_manifest.replace(i, me);
     }
     for (int i=0; i < p.m_spine.count(); ++i) {
         QString idref = p.m_spine.at(i).m_idref;
@@ -1030,9 +1116,7 @@ void OPFResource::WriteIdentifier(const QString &metaname, const QString &metava
 void OPFResource::AddModificationDateMeta()
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
 
     QString epubversion = GetEpubVersion();
     if (epubversion.startsWith('3')) {
@@ -1210,7 +1294,118 @@ QString OPFResource::GetRelativePathToRoot() const
 
 void OPFResource::UpdateText(const OPFParser &p)
 {
+    {
+        QMutexLocker locker(&m_ParsedOPFMutex);
+
+        if (m_TransactionDepth > 0) {
+            m_TransactionOPF = p;
+            m_TransactionPending = true;
+            return;
+        }
+    }
+    SetTextFromModel(p);
+}
+
+
+void OPFResource::SetTextFromModel(const OPFParser &p)
+{
+    QWriteLocker locker(&GetLock());
     TextResource::SetText(p.convert_to_xml());
+    QMutexLocker model_locker(&m_ParsedOPFMutex);
+    m_ParsedOPF = p;
+    m_ParsedOPFRevision = GetTextRevision();
+}
+
+
+void OPFResource::BeginTransaction()
+{
+    QWriteLocker locker(&GetLock());
+    QMutexLocker model_locker(&m_ParsedOPFMutex);
+    ++m_TransactionDepth;
+}
+
+
+void OPFResource::CommitTransaction()
+{
+    QWriteLocker locker(&GetLock());
+    {
+        QMutexLocker model_locker(&m_ParsedOPFMutex);
+
+        if (m_TransactionDepth > 0) {
+            --m_TransactionDepth;
+        }
+
+        if (m_TransactionDepth > 0) {
+            return;
+        }
+    }
+    FlushTransaction();
+}
+
+
+void OPFResource::FlushTransaction()
+{
+    QWriteLocker locker(&GetLock());
+    OPFParser p;
+    {
+        QMutexLocker model_locker(&m_ParsedOPFMutex);
+
+        if (!m_TransactionPending) {
+            return;
+        }
+
+        p = m_TransactionOPF;
+        m_TransactionPending = false;
+        m_TransactionOPF = OPFParser();
+    }
+    SetTextFromModel(p);
+}
+
+
+OPFResource::Transaction::Transaction(OPFResource *opf)
+    : m_OPF(opf)
+{
+    m_OPF->BeginTransaction();
+}
+
+
+OPFResource::Transaction::~Transaction()
+{
+    Commit();
+}
+
+
+void OPFResource::Transaction::Commit()
+{
+    if (m_OPF) {
+        m_OPF->CommitTransaction();
+        m_OPF = NULL;
+    }
+}
+
+
+OPFParser OPFResource::GetParsedOPF() const
+{
+    QMutexLocker locker(&m_ParsedOPFMutex);
+
+    if (m_TransactionPending) {
+        return m_TransactionOPF;
+    }
+
+    // The revision is read before the text: if the text changes in
+    // between, the stored revision is the older one and the next call
+    // parses again.
+    int revision = GetTextRevision();
+
+    if (revision != m_ParsedOPFRevision) {
+        QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
+        m_ParsedOPF = OPFParser();
+        m_ParsedOPF.parse(source);
+        m_ParsedOPFRevision = revision;
+    }
+
+    // A cheap copy, the lists and hashes are implicitly shared
+    return m_ParsedOPF;
 }
 
 
@@ -1235,30 +1430,55 @@ QString OPFResource::ValidatePackageVersion(const QString& source)
 }
 
 
-void OPFResource::UpdateManifestProperties(const QList<Resource*> resources)
+static QStringList GetManifestPropertiesOfOneFile(HTMLResource *html_resource)
+{
+    return html_resource->GetManifestProperties();
+}
+
+
+// true if the properties attribute of entry already says properties
+static bool HasManifestProperties(const ManifestEntry &entry, const QString &properties)
+{
+    return entry.m_atts.contains("properties") == !properties.isEmpty() &&
+           entry.m_atts.value("properties") == properties;
+}
+
+
+bool OPFResource::UpdateManifestProperties(const QList<Resource*> resources)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     if (p.m_package.m_version != "3.0") {
-        return;
+        return false;
     }
+    QList<HTMLResource *> html_resources;
     foreach(Resource* resource, resources) {
-        const HTMLResource* html_resource = static_cast<const HTMLResource *>(resource);
+        HTMLResource* html_resource = qobject_cast<HTMLResource *>(resource);
         // do not overwrite the nav property, it must stay no matter what
-        if (html_resource != m_NavResource) {
-            QString href = html_resource->GetRelativePathToOEBPS();
-            int pos = p.m_hrefpos.value(href, -1);
-            if ((pos >= 0) && (pos < p.m_manifest.count())) {
-                ManifestEntry me = p.m_manifest.at(pos);
-                QStringList properties = html_resource->GetManifestProperties();
-                me.m_atts.remove("properties");
-                if (properties.count() > 0) {
-                    me.m_atts["properties"] = properties.join(QString(" "));
-                }
-                p.m_manifest.replace(pos, me);
+        if (html_resource && html_resource != m_NavResource) {
+            html_resources.append(html_resource);
+        }
+    }
+    // Each file's properties are kept with the text revision they are
+    // from, so only files edited since the last update are parsed
+    const QList<QStringList> properties_by_file =
+        QtConcurrent::blockingMapped<QList<QStringList> >(html_resources, GetManifestPropertiesOfOneFile);
+    bool changed = false;
+    for (int i = 0; i < html_resources.count(); ++i) {
+        QString href = html_resources.at(i)->GetRelativePathToOEBPS();
+        int pos = p.m_hrefpos.value(href, -1);
+        if ((pos >= 0) && (pos < p.m_manifest.count())) {
+            QString properties = properties_by_file.at(i).join(QString(" "));
+            if (HasManifestProperties(p.m_manifest.at(pos), properties)) {
+                continue;
             }
+            ManifestEntry me = p.m_manifest.at(pos);
+            me.m_atts.remove("properties");
+            if (!properties.isEmpty()) {
+                me.m_atts["properties"] = properties;
+            }
+            p.m_manifest.replace(pos, me);
+            changed = true;
         }
     }
     // now add the cover-image properties
@@ -1268,15 +1488,19 @@ void OPFResource::UpdateManifestProperties(const QList<Resource*> resources)
         QString cover_id = cmeta.m_atts.value(QString("content"),QString(""));
         if (!cover_id.isEmpty()) {
             int pos = p.m_idpos.value(cover_id, -1);
-            if (pos >= 0 ) {
+            if (pos >= 0 && !HasManifestProperties(p.m_manifest.at(pos), "cover-image")) {
                 ManifestEntry me = p.m_manifest.at(p.m_idpos[cover_id]);
                 me.m_atts.remove("properties");
                 me.m_atts["properties"] = QString("cover-image");
                 p.m_manifest.replace(pos, me);
+                changed = true;
             }
         }
     }
-    UpdateText(p);
+    if (changed) {
+        UpdateText(p);
+    }
+    return changed;
 }
 
 
@@ -1285,9 +1509,7 @@ QString OPFResource::GetManifestPropertiesForResource(const Resource * resource)
     QString properties;
     if (!resource) return properties;
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     if (!p.m_package.m_version.startsWith("3")) {
         return properties;
     }
@@ -1309,9 +1531,7 @@ QHash <QString, QString>  OPFResource::GetManifestPropertiesForPaths()
         return manifest_properties_all;
     }
     QReadLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     foreach(ManifestEntry me, p.m_manifest) {
         QString href = me.m_href;
         if (me.m_atts.contains("properties")){
@@ -1335,9 +1555,7 @@ void OPFResource::SetNavResource(HTMLResource * nav_resource)
     // Make sure the proper nav property is set in the opf manifest
     if (m_NavResource) { 
         QWriteLocker locker(&GetLock());
-        QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-        OPFParser p;
-        p.parse(source);
+        OPFParser p = GetParsedOPF();
         QString href = m_NavResource->GetRelativePathToOEBPS();
         int pos = p.m_hrefpos.value(href, -1);
         if ((pos >= 0) && (pos < p.m_manifest.count())) {
@@ -1353,9 +1571,7 @@ void OPFResource::SetNavResource(HTMLResource * nav_resource)
 void OPFResource::SetItemRefLinear(Resource * resource, bool linear)
 {
     QWriteLocker locker(&GetLock());
-    QString source = CleanSource::ProcessXML(GetText(),"application/oebps-package+xml");
-    OPFParser p;
-    p.parse(source);
+    OPFParser p = GetParsedOPF();
     QString resource_oebps_path = resource->GetRelativePathToOEBPS();
     int pos = p.m_hrefpos.value(resource_oebps_path, -1);
     QString item_id = "";
@@ -24,6 +24,7 @@
 #define OPFRESOURCE_H
 
 #include <memory>
+#include <QtCore/QMutex>
 #include "Misc/GuideItems.h"
 #include "ResourceObjects/XMLResource.h"
 #include "ResourceObjects/OPFParser.h"
@@ -58,6 +59,8 @@ public:
 
     virtual void SetText(const QString &text);
 
+    virtual bool SetTextIfUnchanged(const QString &text, int revision);
+
     QString GetGuideSemanticCodeForResource(const Resource *resource) const;
     QString GetGuideSemanticNameForResource(Resource *resource);
     QHash <QString, QString> GetSemanticCodeForPaths();
@@ -123,6 +126,43 @@ public:
     void SetNavResource(HTMLResource* nav);
     HTMLResource* GetNavResource() const;
 
+    /**
+     * Starts collecting OPF edits. Until the matching CommitTransaction
+     * the mutators work on a pending model instead of parsing and
+     * writing the text each time, and the getters read that model.
+     * Transactions nest; only the outermost commit writes the text.
+     * GetText() keeps returning the last written text meanwhile.
+     */
+    void BeginTransaction();
+
+    /**
+     * Ends a transaction, writing all pending edits in one go
+     * when it is the outermost one.
+     */
+    void CommitTransaction();
+
+    /**
+     * Begins a transaction on construction and commits it on
+     * destruction, so it is committed on every way out of a scope.
+     */
+    class Transaction
+    {
+    public:
+        Transaction(OPFResource *opf);
+        ~Transaction();
+
+        /**
+         * Commits before the end of the scope; the destructor
+         * then does nothing.
+         */
+        void Commit();
+
+    private:
+        Q_DISABLE_COPY(Transaction)
+
+        OPFResource *m_OPF;
+    };
+
 public slots:
 
     /**
@@ -135,17 +175,45 @@ public slots:
 
     void AddResource(const Resource *resource);
 
+    /**
+     * Adds manifest (and for HTML, spine) entries for several
+     * resources with a single parse and write of the OPF.
+     */
+    void AddResources(const QList<const Resource *> &resources);
+
     void RemoveResource(const Resource *resource);
 
+    /**
+     * Removes the manifest, spine, guide and landmark entries of
+     * several resources with a single parse and write of the OPF.
+     */
+    void RemoveResources(const QList<const Resource *> &resources);
+
     void AddGuideSemanticCode(HTMLResource *html_resource, QString code, bool toggle = true);
 
+    /**
+     * Gives each file with a landmark in the nav the guide type of
+     * that landmark, and takes the type from any other file that has
+     * it. Guide entries the landmarks say nothing about are kept.
+     *
+     * @return true if the OPF was changed.
+     */
+    bool UpdateGuideFromNav();
+
     void SetResourceAsCoverImage(ImageResource *image_resource);
 
     void UpdateSpineOrder(const QList<HTMLResource *> html_files);
 
     void ResourceRenamed(const Resource *resource, QString old_full_path);
 
-    void UpdateManifestProperties(const QList<Resource *> resources);
+    /**
+     * Sets the manifest properties of the given HTML files to what their
+     * content calls for. Only the entries whose properties differ are
+     * rewritten.
+     *
+     * @return true if the OPF was changed.
+     */
+    bool UpdateManifestProperties(const QList<Resource *> resources);
 
     QString GetManifestPropertiesForResource(const Resource * resource);
 
@@ -181,12 +249,14 @@ private:
 
     // CAN BE -1 which means no reference for resource
     int GetGuideReferenceForResourcePos(const Resource *resource, const OPFParser &p) const;
+    int GetGuideReferenceForPathPos(const QString &oebps_path, const OPFParser &p) const;
 
     void RemoveGuideReferenceForResource(const Resource *resource, OPFParser &p);
 
     QString GetGuideSemanticCodeForResource(const Resource *resource, const OPFParser &p) const;
 
     void SetGuideSemanticCodeForResource(QString code, const Resource *resource, OPFParser &p);
+    void SetGuideSemanticCodeForPath(QString code, const QString &oebps_path, OPFParser &p);
 
     void RemoveDuplicateGuideCodes(QString code, OPFParser &p);
 
@@ -232,6 +302,24 @@ private:
 
     void UpdateText(const OPFParser &p);
 
+    /**
+     * Returns the OPF parsed from the current text. The parse is
+     * cached and only redone once the text revision has moved on,
+     * so getters no longer run ProcessXML and the parser per call.
+     */
+    OPFParser GetParsedOPF() const;
+
+    /**
+     * Writes the pending edits of an open transaction to the text.
+     */
+    void FlushTransaction();
+
+    /**
+     * Writes p as the text and keeps p as the parse of that text,
+     * so the next getter does not parse what was just written.
+     */
+    void SetTextFromModel(const OPFParser &p);
+
     QString ValidatePackageVersion(const QString &source);
 
     /**
@@ -251,6 +339,21 @@ private:
 
     HTMLResource * m_NavResource;
     bool m_WarnedAboutVersion;
+
+    /**
+     * The parse of the text at revision m_ParsedOPFRevision.
+     */
+    mutable OPFParser m_ParsedOPF;
+    mutable int m_ParsedOPFRevision;
+    mutable QMutex m_ParsedOPFMutex;
+
+    /**
+     * The nesting depth of open transactions, and the model holding
+     * their edits when m_TransactionPending is set.
+     */
+    int m_TransactionDepth;
+    bool m_TransactionPending;
+    OPFParser m_TransactionOPF;
 };
 
 #endif // OPFRESOURCE_H
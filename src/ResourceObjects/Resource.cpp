@@ -19,8 +19,11 @@
 **
 *************************************************************************/
 
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QDir>
 #include <QtCore/QDateTime>
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QString>
 #include <QtCore/QTimer>
@@ -43,7 +46,10 @@ Resource::Resource(const QString &mainfolder, const QString &fullfilepath, QObje
     m_CurrentBookRelPath(""),
     m_EpubVersion("2.0"),
     m_MediaType(""),
-    m_ReadWriteLock(QReadWriteLock::Recursive)
+    m_ReadWriteLock(QReadWriteLock::Recursive),
+    m_HasDeferredContent(0),
+    m_ContentHashModified(0),
+    m_ContentHashSize(0)
 {
 }
 
@@ -101,6 +107,170 @@ QString Resource::GetFullPath() const
 }
 
 
+void Resource::SetDeferredContent(std::function<bool (const QString &)> loader,
+                                  const QString &source_path,
+                                  const QString &source_name)
+{
+    QMutexLocker locker(&m_DeferredMutex);
+    m_DeferredLoader = loader;
+    m_DeferredSourcePath = source_path;
+    m_DeferredSourceName = source_name;
+    m_HasDeferredContent.storeRelease(loader ? 1 : 0);
+}
+
+
+bool Resource::HasDeferredContent() const
+{
+    return m_HasDeferredContent.loadAcquire() != 0;
+}
+
+
+bool Resource::IsDeferredFrom(const QString &source_path, const QString &source_name) const
+{
+    if (!m_HasDeferredContent.loadAcquire()) {
+        return false;
+    }
+
+    QMutexLocker locker(&m_DeferredMutex);
+    return m_DeferredLoader && !m_DeferredSourcePath.isEmpty() &&
+           m_DeferredSourceName == source_name &&
+           QFileInfo(m_DeferredSourcePath) == QFileInfo(source_path);
+}
+
+
+std::function<bool (const QString &)> Resource::GetDeferredContent() const
+{
+    QMutexLocker locker(&m_DeferredMutex);
+    return m_DeferredLoader;
+}
+
+
+bool Resource::LoadDeferredContent() const
+{
+    // Cheap check first, this is on the path of every read of the file
+    if (!m_HasDeferredContent.loadAcquire()) {
+        return true;
+    }
+
+    QMutexLocker locker(&m_DeferredMutex);
+
+    if (!m_DeferredLoader) {
+        return true;
+    }
+
+    // Deliberately not taking m_ReadWriteLock here: callers commonly
+    // hold a read lock while reading the file.
+    if (!m_DeferredLoader(m_FullFilePath)) {
+        // Whatever was written is not the content; the EPUB may have
+        // been moved or a range request failed, so it can be tried again
+        QFile placeholder(m_FullFilePath);
+        placeholder.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        placeholder.close();
+        qDebug() << "Cannot load the content of" << m_FullFilePath;
+        return false;
+    }
+
+    m_DeferredLoader = nullptr;
+    m_HasDeferredContent.storeRelease(0);
+
+    // A hash given for the content still to be written is its hash now
+    QMutexLocker hash_locker(&m_ContentHashMutex);
+
+    if (m_ContentHashSize == -1) {
+        QFileInfo info(m_FullFilePath);
+        m_ContentHashModified = info.lastModified().toMSecsSinceEpoch();
+        m_ContentHashSize = info.size();
+    }
+
+    return true;
+}
+
+
+QByteArray Resource::GetContentHash() const
+{
+    QMutexLocker locker(&m_ContentHashMutex);
+
+    if (HasDeferredContent() && m_ContentHashSize == -1) {
+        return m_ContentHash;
+    }
+
+    locker.unlock();
+
+    // Writes out a lazily opened file first; a placeholder has no hash
+    if (!LoadDeferredContent()) {
+        return QByteArray();
+    }
+
+    QFileInfo info(m_FullFilePath);
+    const qint64 modified = info.lastModified().toMSecsSinceEpoch();
+    const qint64 size = info.size();
+    locker.relock();
+
+    if (!m_ContentHash.isEmpty() && m_ContentHashModified == modified && m_ContentHashSize == size) {
+        return m_ContentHash;
+    }
+
+    locker.unlock();
+    QByteArray hash;
+    QFile file(info.filePath());
+
+    if (file.open(QIODevice::ReadOnly)) {
+        QCryptographicHash content_hash(QCryptographicHash::Sha1);
+
+        if (content_hash.addData(&file)) {
+            hash = content_hash.result();
+        }
+    }
+
+    locker.relock();
+    m_ContentHash = hash;
+    m_ContentHashModified = modified;
+    m_ContentHashSize = size;
+    return hash;
+}
+
+
+void Resource::SetContentHash(const QByteArray &hash)
+{
+    QMutexLocker locker(&m_ContentHashMutex);
+    m_ContentHash = hash;
+
+    if (HasDeferredContent()) {
+        m_ContentHashModified = -1;
+        m_ContentHashSize = -1;
+        return;
+    }
+
+    QFileInfo info(m_FullFilePath);
+    m_ContentHashModified = info.lastModified().toMSecsSinceEpoch();
+    m_ContentHashSize = info.size();
+}
+
+
+bool Resource::HasContentHash() const
+{
+    QMutexLocker locker(&m_ContentHashMutex);
+
+    if (m_ContentHash.isEmpty()) {
+        return false;
+    }
+
+    if (HasDeferredContent()) {
+        return m_ContentHashSize == -1;
+    }
+
+    QFileInfo info(m_FullFilePath);
+    return m_ContentHashModified == info.lastModified().toMSecsSinceEpoch() && m_ContentHashSize == info.size();
+}
+
+
+void Resource::ClearContentHash()
+{
+    QMutexLocker locker(&m_ContentHashMutex);
+    m_ContentHash.clear();
+}
+
+
 QUrl Resource::GetBaseUrl() const
 {
     return QUrl::fromLocalFile(QFileInfo(m_FullFilePath).absolutePath() + "/");
@@ -178,21 +348,30 @@ bool Resource::RenameTo(const QString &new_filename)
 
 bool Resource::Delete()
 {
-    bool successful = false;
-    {
-        QWriteLocker locker(&m_ReadWriteLock);
-        successful = Utility::SDeleteFile(m_FullFilePath);
-    }
+    bool successful = DeleteFromDisk();
 
     if (successful) {
-        emit Deleted(this);
-        deleteLater();
+        NotifyDeleted();
     }
 
     return successful;
 }
 
 
+bool Resource::DeleteFromDisk()
+{
+    QWriteLocker locker(&m_ReadWriteLock);
+    return Utility::SDeleteFile(m_FullFilePath);
+}
+
+
+void Resource::NotifyDeleted()
+{
+    emit Deleted(this);
+    deleteLater();
+}
+
+
 Resource::ResourceType Resource::Type() const
 {
     return Resource::GenericResourceType;
@@ -205,6 +384,7 @@ bool Resource::LoadFromDisk()
 
 void Resource::SaveToDisk(bool book_wide_save)
 {
+    ClearContentHash();
     const QDateTime lastModifiedDate = QFileInfo(m_FullFilePath).lastModified();
 
     if (lastModifiedDate.isValid()) {
@@ -212,8 +392,19 @@ void Resource::SaveToDisk(bool book_wide_save)
     }
 }
 
+bool Resource::IsDirty() const
+{
+    return HasDeferredContent();
+}
+
+qint64 Resource::MemoryUsage() const
+{
+    return 0;
+}
+
 void Resource::FileChangedOnDisk()
 {
+    ClearContentHash();
     QFileInfo latestFileInfo(m_FullFilePath);
     const QDateTime lastModifiedDate = latestFileInfo.lastModified();
     m_LastWrittenTo = lastModifiedDate.isValid() ? lastModifiedDate.toMSecsSinceEpoch() : 0;
@@ -221,6 +412,19 @@ void Resource::FileChangedOnDisk()
     QTimer::singleShot(WAIT_FOR_WRITE_DELAY, this, SLOT(ResourceFileModified()));
 }
 
+void Resource::FileReplaced()
+{
+    ClearContentHash();
+    const QDateTime lastModifiedDate = QFileInfo(m_FullFilePath).lastModified();
+
+    if (lastModifiedDate.isValid()) {
+        m_LastSaved = lastModifiedDate.toMSecsSinceEpoch();
+    }
+
+    LoadFromDisk();
+    emit ResourceUpdatedOnDisk();
+}
+
 void Resource::ResourceFileModified()
 {
     QFileInfo newFileInfo(m_FullFilePath);
@@ -23,6 +23,10 @@
 #ifndef RESOURCE_H
 #define RESOURCE_H
 
+#include <functional>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QUrl>
@@ -122,10 +126,77 @@ public:
      * We \em really shouldn't be using this,
      * it kinda breaks encapsulation.
      *
+     * Only the path: a lazily opened file is still a placeholder until
+     * LoadDeferredContent() is called, so callers that read the file
+     * call that first.
+     *
      * @return The resource's full file path.
      */
     QString GetFullPath() const;
 
+    /**
+     * Defers loading the resource's content. Until the content is first
+     * needed the file on disk is only a placeholder; the loader is then
+     * called once to write the real content to the resource's path.
+     *
+     * @param loader Writes the content to the path it is given and
+     *               returns \c true on success.
+     * @param source_path The archive the loader reads the content from, if any.
+     * @param source_name The name of the content's entry in that archive.
+     */
+    void SetDeferredContent(std::function<bool (const QString &)> loader,
+                            const QString &source_path = QString(),
+                            const QString &source_name = QString());
+
+    /**
+     * Returns \c true while the file on disk is still a placeholder.
+     */
+    bool HasDeferredContent() const;
+
+    /**
+     * Returns \c true while the content is still deferred and is
+     * the entry source_name of the archive at source_path.
+     */
+    bool IsDeferredFrom(const QString &source_path, const QString &source_name) const;
+
+    /**
+     * Returns the loader given to SetDeferredContent(), or an empty
+     * function once the content has been written.
+     */
+    std::function<bool (const QString &)> GetDeferredContent() const;
+
+    /**
+     * Writes any deferred content to disk now. If the loader fails the
+     * file is left an empty placeholder and the loader is kept, so the
+     * content is still deferred and can be tried again.
+     *
+     * @return \c true if the file on disk has the content.
+     */
+    bool LoadDeferredContent() const;
+
+    /**
+     * Returns a hash of the content of the file on disk. It is worked
+     * out the first time it is asked for and kept until the file is
+     * written, or is found to have a different size or modification
+     * time. Safe to call from any thread.
+     *
+     * @return The hash, or an empty array if the file cannot be read.
+     */
+    QByteArray GetContentHash() const;
+
+    /**
+     * Takes hash as the hash of the content of the file as it is now,
+     * e.g. one kept from when the book was last open, so it is not
+     * worked out again. For a lazily opened file it is the hash of the
+     * content still to be written.
+     */
+    void SetContentHash(const QByteArray &hash);
+
+    /**
+     * Returns \c true if the content hash is known and up to date.
+     */
+    bool HasContentHash() const;
+
     /**
      * Returns the URL to the parent folder ("base URL") of this resource.
      *
@@ -186,6 +257,20 @@ public:
      */
     virtual bool Delete();
 
+    /**
+     * The first half of Delete(): removes the file from disk.
+     * Safe to call from any thread.
+     *
+     * @return \c true if the file was removed.
+     */
+    bool DeleteFromDisk();
+
+    /**
+     * The second half of Delete(), for a resource whose file is gone:
+     * emits Deleted() and schedules the object for deletion.
+     */
+    void NotifyDeleted();
+
     /**
      * Returns the resource's type.
      *
@@ -203,12 +288,33 @@ public:
      */
     virtual void SaveToDisk(bool book_wide_save = false);
 
+    /**
+     * Returns \c true if SaveToDisk() has something to write, i.e. the
+     * file on disk is not up to date with the resource. The default
+     * implementation only reports deferred content.
+     */
+    virtual bool IsDirty() const;
+
+    /**
+     * Returns an estimate, in bytes, of the memory the resource holds.
+     * The default implementation returns 0, for resources whose
+     * content is only read from disk when it is needed.
+     */
+    virtual qint64 MemoryUsage() const;
+
     /**
      * Called by FolderKeeper when files get changed on disk.
      * May trigger a resource internal update if the files were not changed by Sigil.
      */
     void FileChangedOnDisk();
 
+    /**
+     * Called when Sigil itself has rewritten the file, e.g. to make it
+     * smaller. Whatever shows the file is refreshed as for a change made
+     * outside Sigil, but the change is not reported as one.
+     */
+    void FileReplaced();
+
 signals:
 
     /**
@@ -311,6 +417,31 @@ private:
      * The ReadWriteLock guarding access to the resource's data.
      */
     mutable QReadWriteLock m_ReadWriteLock;
+
+    /**
+     * Writes the real content over the placeholder file
+     * of a lazily opened resource; empty once loaded.
+     */
+    mutable std::function<bool (const QString &)> m_DeferredLoader;
+    QString m_DeferredSourcePath;
+    QString m_DeferredSourceName;
+    mutable QAtomicInt m_HasDeferredContent;
+    mutable QMutex m_DeferredMutex;
+
+    /**
+     * Forgets the content hash; called whenever Sigil writes the file.
+     */
+    void ClearContentHash();
+
+    /**
+     * The content hash and the modification time and size of the file
+     * it was worked out from, or -1 for a lazily opened file not yet
+     * written. Guarded by m_ContentHashMutex.
+     */
+    mutable QByteArray m_ContentHash;
+    mutable qint64 m_ContentHashModified;
+    mutable qint64 m_ContentHashSize;
+    mutable QMutex m_ContentHashMutex;
 };
 
 #endif // RESOURCE_H
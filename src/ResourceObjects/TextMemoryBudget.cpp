@@ -0,0 +1,171 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#include <list>
+
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include "Misc/SettingsStore.h"
+#include "ResourceObjects/TextMemoryBudget.h"
+#include "ResourceObjects/TextResource.h"
+
+struct ResidentText {
+    std::list<TextResource *>::iterator lru_pos;
+    qint64 bytes;
+    int resource_type;
+};
+
+static QMutex s_BudgetMutex;
+
+// Most recently used first
+static std::list<TextResource *> s_LRU;
+
+static QHash<const TextResource *, ResidentText> s_Resident;
+
+static QHash<int, qint64> s_BytesByType;
+
+static qint64 s_TotalBytes = 0;
+
+// -1 until read from the settings
+static qint64 s_Budget = -1;
+
+
+static qint64 BudgetLocked()
+{
+    if (s_Budget < 0) {
+        SettingsStore settings;
+        s_Budget = qint64(settings.textMemoryBudget()) * 1024 * 1024;
+    }
+
+    return s_Budget;
+}
+
+
+static void ForgetLocked(const TextResource *resource)
+{
+    QHash<const TextResource *, ResidentText>::iterator it = s_Resident.find(resource);
+
+    if (it == s_Resident.end()) {
+        return;
+    }
+
+    s_TotalBytes -= it.value().bytes;
+    s_BytesByType[ it.value().resource_type ] -= it.value().bytes;
+    s_LRU.erase(it.value().lru_pos);
+    s_Resident.erase(it);
+}
+
+
+void TextMemoryBudget::Touch(TextResource *resource, qint64 bytes, int resource_type)
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    QHash<const TextResource *, ResidentText>::iterator it = s_Resident.find(resource);
+
+    if (it == s_Resident.end()) {
+        s_LRU.push_front(resource);
+        ResidentText resident;
+        resident.lru_pos = s_LRU.begin();
+        resident.bytes = 0;
+        resident.resource_type = resource_type;
+        it = s_Resident.insert(resource, resident);
+    } else {
+        s_LRU.splice(s_LRU.begin(), s_LRU, it.value().lru_pos);
+    }
+
+    s_TotalBytes += bytes - it.value().bytes;
+    s_BytesByType[ resource_type ] += bytes - it.value().bytes;
+    it.value().bytes = bytes;
+    qint64 budget = BudgetLocked();
+
+    if (budget > 0 && s_TotalBytes > budget) {
+        EvictLocked(resource, budget);
+    }
+}
+
+
+void TextMemoryBudget::Forget(const TextResource *resource)
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    ForgetLocked(resource);
+}
+
+
+void TextMemoryBudget::SetBudget(qint64 bytes)
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    s_Budget = qMax(bytes, qint64(0));
+
+    if (s_Budget > 0 && s_TotalBytes > s_Budget) {
+        EvictLocked(NULL, s_Budget);
+    }
+}
+
+
+qint64 TextMemoryBudget::Budget()
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    return BudgetLocked();
+}
+
+
+qint64 TextMemoryBudget::ResidentBytes()
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    return s_TotalBytes;
+}
+
+
+QHash<int, qint64> TextMemoryBudget::ResidentBytesByType()
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    return s_BytesByType;
+}
+
+
+void TextMemoryBudget::EvictAll()
+{
+    QMutexLocker locker(&s_BudgetMutex);
+    EvictLocked(NULL, 0);
+}
+
+
+void TextMemoryBudget::EvictLocked(const TextResource *keep, qint64 target)
+{
+    // From the cold end. Resources that are dirty, open in a tab or
+    // busy in another thread refuse and stay where they are.
+    std::list<TextResource *>::iterator it = s_LRU.end();
+
+    while (it != s_LRU.begin() && s_TotalBytes > target) {
+        --it;
+        TextResource *resource = *it;
+
+        if (resource == keep || !resource->TryEvictText()) {
+            continue;
+        }
+
+        // Step back over the entry before it is erased
+        std::list<TextResource *>::iterator next = it;
+        ++next;
+        ForgetLocked(resource);
+        it = next;
+    }
+}
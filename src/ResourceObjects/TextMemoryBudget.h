@@ -0,0 +1,87 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+#pragma once
+#ifndef TEXTMEMORYBUDGET_H
+#define TEXTMEMORYBUDGET_H
+
+#include <QtCore/QHash>
+#include <QtCore/QtGlobal>
+
+class TextResource;
+
+/**
+ * Keeps the text held in memory by TextResources under a budget.
+ *
+ * Resources report their resident text as it is used. When the total
+ * goes over the budget, the text of the least recently used resources
+ * that are clean (the same as on disk) and not open in a tab is
+ * dropped; it is read back from disk the next time it is needed.
+ */
+class TextMemoryBudget
+{
+public:
+
+    /**
+     * Records that a resource holds bytes of text and has just been used.
+     */
+    static void Touch(TextResource *resource, qint64 bytes, int resource_type);
+
+    /**
+     * Stops tracking a resource, e.g. because it was evicted or deleted.
+     */
+    static void Forget(const TextResource *resource);
+
+    /**
+     * Sets the budget in bytes; 0 means no limit. Until this is called
+     * the budget comes from SettingsStore::textMemoryBudget().
+     */
+    static void SetBudget(qint64 bytes);
+
+    static qint64 Budget();
+
+    /**
+     * @return The tracked resident text, in bytes.
+     */
+    static qint64 ResidentBytes();
+
+    /**
+     * @return The tracked resident text in bytes, keyed by
+     *         Resource::ResourceType.
+     */
+    static QHash<int, qint64> ResidentBytesByType();
+
+    /**
+     * Drops the text of every resource that could be evicted,
+     * whatever the budget.
+     */
+    static void EvictAll();
+
+private:
+
+    /**
+     * Drops cold text until the total is at most target bytes.
+     * Called with the budget mutex held.
+     */
+    static void EvictLocked(const TextResource *keep, qint64 target);
+};
+
+#endif // TEXTMEMORYBUDGET_H
@@ -27,31 +27,117 @@
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QPlainTextDocumentLayout>
 
+#include "Misc/TaskScheduler.h"
 #include "Misc/Utility.h"
+#include "ResourceObjects/TextMemoryBudget.h"
 #include "ResourceObjects/TextResource.h"
 #include "sigil_exception.h"
 
+// A QTextBlock with its layout and format, roughly
+static const int DOCUMENT_BYTES_PER_BLOCK = 200;
+
+// Below this many characters a document is built on the GUI thread
+// in less time than it takes to hand the work over and back
+static const int PREPARE_DOCUMENT_OFF_THREAD_CHARS = 256 * 1024;
+
+
 TextResource::TextResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent)
     :
     Resource(mainfolder, fullfilepath, parent),
     m_CacheInUse(false),
-    m_TextDocument(new TextDocument(this)),
-    m_IsLoaded(false)
+    m_TextDocument(NULL),
+    m_DocumentUsers(0),
+    m_DocumentWatcher(NULL),
+    m_DocumentWatcherRevision(-1),
+    m_IsLoaded(false),
+    m_TextRevision(0),
+    m_DiskRevision(-1),
+    m_Evicted(false),
+    m_SnapshotRevision(-1)
+{
+}
+
+
+TextResource::~TextResource()
 {
-    m_TextDocument->setDocumentLayout(new QPlainTextDocumentLayout(m_TextDocument));
-    connect(m_TextDocument, SIGNAL(contentsChanged()), this, SIGNAL(Modified()));
+    if (m_DocumentWatcher) {
+        // The document is nobody's but ours until it is taken
+        m_DocumentWatcher->waitForFinished();
+        delete m_DocumentWatcher->result();
+    }
+
+    TextMemoryBudget::Forget(this);
 }
 
 
 QString TextResource::GetText() const
 {
-    QMutexLocker locker(&m_CacheAccessMutex);
+    return GetSnapshot().text;
+}
+
+
+TextResource::Snapshot TextResource::GetSnapshot() const
+{
+    Snapshot snapshot;
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+        // Writes other than edits of the document, which are made on
+        // the GUI thread, move the revision on under this lock.
+        snapshot.revision = m_TextRevision.load();
+
+        if (m_CacheInUse) {
+            snapshot.text = m_Cache;
+            return snapshot;
+        }
+
+        if (m_TextDocument) {
+            // Rebuilding the string from the block list is the expensive
+            // part, so it is done once per revision of the document.
+            if (m_SnapshotRevision != snapshot.revision) {
+                m_Snapshot = m_TextDocument->toText();
+                m_SnapshotRevision = snapshot.revision;
+            }
+
+            snapshot.text = m_Snapshot;
+            return snapshot;
+        }
+
+        if (m_Evicted) {
+            // Dropped to stay under the memory budget; the file on
+            // disk still holds exactly this text.
+            try {
+                m_Text = Utility::ReadUnicodeTextFile(GetFullPath());
+            } catch (CannotOpenFile) {
+                m_Text = QString();
+            }
+            m_Evicted = false;
+        }
+
+        snapshot.text = m_Text;
+    }
+    TextMemoryBudget::Touch(const_cast<TextResource *>(this), snapshot.text.size() * sizeof(QChar), Type());
+    return snapshot;
+}
+
+
+bool TextResource::TryEvictText()
+{
+    // Never wait here: the budget lock is held by the caller
+    if (!m_CacheAccessMutex.tryLock()) {
+        return false;
+    }
+
+    bool evicted = false;
 
-    if (m_CacheInUse) {
-        return m_Cache;
+    if (!m_TextDocument && !m_CacheInUse && !m_Evicted && m_IsLoaded &&
+        m_DiskRevision == m_TextRevision.load()) {
+        m_Text = QString();
+        m_Evicted = true;
+        evicted = true;
     }
 
-    return m_TextDocument->toText();
+    m_CacheAccessMutex.unlock();
+    return evicted;
 }
 
 
@@ -67,11 +153,18 @@ void TextResource::SetText(const QString &text)
     //   So we cache the text update into m_Cache and update the QTextDocument
     // when we return to the GUI thread. The single-shot timer makes sure
     // of that.
+    //   Without a document (no tab has the file open) the plain text
+    // storage is simply replaced, from any thread.
+    if (StoreTextWithoutDocument(text, false)) {
+        return;
+    }
+
     if (QThread::currentThread() == QApplication::instance()->thread()) {
         SetTextInternal(text);
     } else {
         QMutexLocker locker(&m_CacheAccessMutex);
         m_Cache = text;
+        m_TextRevision.ref();
 
         // We want to make sure we schedule only one delayed update
         if (!m_CacheInUse) {
@@ -82,13 +175,236 @@ void TextResource::SetText(const QString &text)
 }
 
 
+bool TextResource::SetTextIfUnchanged(const QString &text, int revision)
+{
+    bool gui_thread = QThread::currentThread() == QApplication::instance()->thread();
+    bool stored = false;
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+
+        if (m_TextRevision.load() != revision) {
+            return false;
+        }
+
+        if (m_TextDocument) {
+            // Queued the way a write from another thread is, so the
+            // revision has moved on before the lock is let go. On the
+            // GUI thread the document is updated straight away below.
+            m_Cache = text;
+
+            if (!m_CacheInUse && !gui_thread) {
+                QTimer::singleShot(0, this, SLOT(DelayedUpdateToTextDocument()));
+            }
+
+            m_CacheInUse = true;
+        } else {
+            m_Text = text;
+            m_Evicted = false;
+            m_IsLoaded = true;
+            stored = true;
+        }
+
+        m_TextRevision.ref();
+    }
+
+    if (stored) {
+        TextMemoryBudget::Touch(this, text.size() * sizeof(QChar), Type());
+        emit Modified();
+    } else if (gui_thread) {
+        DelayedUpdateToTextDocument();
+    }
+
+    return true;
+}
+
+
 TextDocument& TextResource::GetTextDocumentForWriting()
 {
-    Q_ASSERT(m_TextDocument);
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+    QMutexLocker locker(&m_CacheAccessMutex);
+
+    if (!m_TextDocument) {
+        // The document gets the current text before any signal is
+        // connected: nothing has changed, so nothing is emitted.
+        TextDocument *document = new TextDocument(this);
+        document->setDocumentLayout(new QPlainTextDocumentLayout(document));
+        if (m_Evicted && !m_CacheInUse) {
+            try {
+                m_Text = Utility::ReadUnicodeTextFile(GetFullPath());
+            } catch (CannotOpenFile) {
+                m_Text = QString();
+            }
+            m_Evicted = false;
+        }
+
+        document->setPlainText(m_CacheInUse ? m_Cache : m_Text);
+        document->setModified(false);
+        AdoptTextDocument(document);
+    }
+
     return *m_TextDocument;
 }
 
 
+void TextResource::AdoptTextDocument(TextDocument *document)
+{
+    m_CacheInUse = false;
+    m_Text.clear();
+    m_Evicted = false;
+    connect(document, SIGNAL(contentsChanged()), this, SIGNAL(Modified()));
+    connect(document, SIGNAL(contentsChanged()), this, SLOT(TextDocumentChanged()), Qt::DirectConnection);
+    m_TextDocument = document;
+    // Text in a document is not evictable
+    TextMemoryBudget::Forget(this);
+}
+
+
+bool TextResource::PrepareTextDocument()
+{
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+
+    if (m_DocumentWatcher) {
+        return false;
+    }
+
+    if (HasTextDocument()) {
+        return true;
+    }
+
+    Snapshot snapshot = GetSnapshot();
+
+    if (snapshot.text.size() < PREPARE_DOCUMENT_OFF_THREAD_CHARS) {
+        return true;
+    }
+
+    m_DocumentWatcher = new QFutureWatcher<TextDocument *>(this);
+    m_DocumentWatcherRevision = snapshot.revision;
+    connect(m_DocumentWatcher, SIGNAL(finished()), this, SLOT(TextDocumentPrepared()));
+    m_DocumentWatcher->setFuture(TaskScheduler::Run(TaskScheduler::Interactive, "TextResource::BuildTextDocument",
+                                 std::bind(&TextResource::BuildTextDocument, this, snapshot.text)));
+    return false;
+}
+
+
+TextDocument *TextResource::BuildTextDocument(const QString &text) const
+{
+    // Filling the document splits the text into blocks, which is
+    // most of the time a large file takes to open
+    TextDocument *document = new TextDocument();
+    document->setDocumentLayout(new QPlainTextDocumentLayout(document));
+    document->setPlainText(text);
+    document->setModified(false);
+    PrepareTextDocumentOffThread(*document);
+    // Only the thread an object lives in can give it away
+    document->moveToThread(QApplication::instance()->thread());
+    return document;
+}
+
+
+void TextResource::PrepareTextDocumentOffThread(TextDocument &document) const
+{
+    Q_UNUSED(document);
+}
+
+
+void TextResource::TextDocumentPrepared()
+{
+    TextDocument *document = m_DocumentWatcher->result();
+    m_DocumentWatcher->deleteLater();
+    m_DocumentWatcher = NULL;
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+
+        // Tabs that are closed in the meantime, or edits made without a
+        // document, leave it out of date; GetTextDocumentForWriting()
+        // builds a fresh one if it is still needed.
+        if (!m_TextDocument && !m_CacheInUse && m_DocumentUsers > 0 &&
+            m_TextRevision.load() == m_DocumentWatcherRevision) {
+            document->setParent(this);
+            AdoptTextDocument(document);
+            document = NULL;
+        }
+    }
+    delete document;
+    emit TextDocumentReady();
+}
+
+
+bool TextResource::HasTextDocument() const
+{
+    QMutexLocker locker(&m_CacheAccessMutex);
+    return m_TextDocument != NULL;
+}
+
+
+void TextResource::RetainTextDocument()
+{
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+    ++m_DocumentUsers;
+}
+
+
+void TextResource::ReleaseTextDocument()
+{
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+
+    if (m_DocumentUsers > 0) {
+        --m_DocumentUsers;
+    }
+
+    if (m_DocumentUsers > 0) {
+        return;
+    }
+
+    qint64 bytes = 0;
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+
+        if (!m_TextDocument) {
+            return;
+        }
+
+        // Back to plain storage. A pending delayed update is folded in
+        // here and the delayed slot then finds nothing left to do.
+        m_Text = m_CacheInUse ? m_Cache : m_TextDocument->toText();
+        m_CacheInUse = false;
+        m_Cache.clear();
+        m_Snapshot.clear();
+        m_SnapshotRevision = -1;
+        disconnect(m_TextDocument, 0, this, 0);
+        // Views may still hold the document until they are destroyed
+        m_TextDocument->deleteLater();
+        m_TextDocument = NULL;
+        bytes = m_Text.size() * sizeof(QChar);
+    }
+    TextMemoryBudget::Touch(this, bytes, Type());
+}
+
+
+bool TextResource::StoreTextWithoutDocument(const QString &text, bool from_disk)
+{
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+
+        if (m_TextDocument) {
+            return false;
+        }
+
+        m_Text = text;
+        m_Evicted = false;
+        m_IsLoaded = true;
+        m_TextRevision.ref();
+
+        if (from_disk) {
+            m_DiskRevision = m_TextRevision.load();
+        }
+    }
+    TextMemoryBudget::Touch(this, text.size() * sizeof(QChar), Type());
+    emit Modified();
+    return true;
+}
+
+
 void TextResource::SaveToDisk(bool book_wide_save)
 {
     {
@@ -98,25 +414,39 @@ void TextResource::SaveToDisk(bool book_wide_save)
             return;
         }
 
+        {
+            // An evicted text is by definition the one on disk
+            QMutexLocker cache_locker(&m_CacheAccessMutex);
+
+            if (m_Evicted) {
+                return;
+            }
+        }
+
         // We can't perform the document modified check
         // here because that causes problems with epub export
         // when the user has not changed the text file.
         // (some text files have placeholder text on disk)
 
         // But we always want to save the most up to date version
+        Snapshot snapshot = GetSnapshot();
+        Utility::WriteUnicodeTextFile(snapshot.text, GetFullPath());
 
-        if (m_CacheInUse) {
-            Utility::WriteUnicodeTextFile(m_Cache, GetFullPath());
-        } else {
-            Utility::WriteUnicodeTextFile(GetText(), GetFullPath());
-        }
+        QMutexLocker cache_locker(&m_CacheAccessMutex);
+        m_DiskRevision = snapshot.revision;
     }
 
     if (!book_wide_save) {
         emit ResourceUpdatedOnDisk();
     }
 
-    m_TextDocument->setModified(false);
+    {
+        QMutexLocker locker(&m_CacheAccessMutex);
+
+        if (m_TextDocument) {
+            m_TextDocument->setModified(false);
+        }
+    }
     Resource::SaveToDisk(book_wide_save);
 }
 
@@ -144,10 +474,12 @@ void TextResource::InitialLoad()
       * it had been opened in a tab first.
       */
     QWriteLocker locker(&GetLock());
-    Q_ASSERT(m_TextDocument);
 
-    if (m_TextDocument->isEmpty() && QFile::exists(GetFullPath())) {
+    if (GetText().isEmpty() && QFile::exists(GetFullPath())) {
         SetText(Utility::ReadUnicodeTextFile(GetFullPath()));
+        // What was just read is what is on disk
+        QMutexLocker cache_locker(&m_CacheAccessMutex);
+        m_DiskRevision = m_TextRevision.load();
     }
 }
 
@@ -161,8 +493,14 @@ bool TextResource::LoadFromDisk()
 {
     try {
         const QString &text = Utility::ReadUnicodeTextFile(GetFullPath());
+
+        if (StoreTextWithoutDocument(text, true)) {
+            return true;
+        }
+
         QMutexLocker locker(&m_CacheAccessMutex);
         m_Cache = text;
+        m_TextRevision.ref();
 
         // We want to make sure we schedule only one delayed update
         if (!m_CacheInUse) {
@@ -183,7 +521,7 @@ void TextResource::DelayedUpdateToTextDocument()
 {
     QMutexLocker locker(&m_CacheAccessMutex);
 
-    if (!m_CacheInUse) {
+    if (!m_CacheInUse || !m_TextDocument) {
         return;
     }
 
@@ -191,8 +529,21 @@ void TextResource::DelayedUpdateToTextDocument()
 }
 
 
+void TextResource::TextDocumentChanged()
+{
+    m_TextRevision.ref();
+}
+
+
+int TextResource::GetTextRevision() const
+{
+    return m_TextRevision.load();
+}
+
+
 void TextResource::SetTextInternal(const QString &text)
 {
+    Q_ASSERT(m_TextDocument);
     m_TextDocument->setPlainText(text);
     m_TextDocument->setModified(false);
     // Our resource has now been loaded with some text
@@ -206,3 +557,47 @@ bool TextResource::IsLoaded()
 {
     return m_IsLoaded;
 }
+
+bool TextResource::IsDirty() const
+{
+    QMutexLocker locker(&m_CacheAccessMutex);
+
+    if (m_Evicted || (!m_CacheInUse && !m_IsLoaded)) {
+        return false;
+    }
+
+    return m_DiskRevision != m_TextRevision.load();
+}
+
+qint64 TextResource::MemoryUsage() const
+{
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+    QMutexLocker locker(&m_CacheAccessMutex);
+    // Shared copies of the same text are counted once per member,
+    // which overstates a little right after a GetText()
+    qint64 bytes = (qint64(m_Text.capacity()) + m_Cache.capacity() + m_Snapshot.capacity()) * sizeof(QChar);
+
+    if (m_TextDocument) {
+        // The text is kept in the document's piece table, plus a
+        // block and its layout for every line
+        bytes += qint64(m_TextDocument->characterCount()) * sizeof(QChar) +
+                 qint64(m_TextDocument->blockCount()) * DOCUMENT_BYTES_PER_BLOCK +
+                 m_TextDocument->undoMemoryUsage();
+    }
+
+    return bytes;
+}
+
+
+qint64 TextResource::UndoMemoryUsage() const
+{
+    Q_ASSERT(QThread::currentThread() == QApplication::instance()->thread());
+    QMutexLocker locker(&m_CacheAccessMutex);
+    return m_TextDocument ? m_TextDocument->undoMemoryUsage() : 0;
+}
+
+bool TextResource::HasTextInMemory() const
+{
+    QMutexLocker locker(&m_CacheAccessMutex);
+    return m_CacheInUse || (m_IsLoaded && !m_Evicted);
+}
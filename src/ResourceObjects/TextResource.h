@@ -24,6 +24,8 @@
 #ifndef TEXTRESOURCE_H
 #define TEXTRESOURCE_H
 
+#include <QtCore/QAtomicInt>
+#include <QtCore/QFutureWatcher>
 #include <QtCore/QMutex>
 #include "Misc/TextDocument.h"
 #include "ResourceObjects/Resource.h"
@@ -50,6 +52,8 @@ public:
      */
     TextResource(const QString &mainfolder, const QString &fullfilepath, QObject *parent = NULL);
 
+    virtual ~TextResource();
+
     /**
      * Returns the text stored in the resource.
      *
@@ -57,14 +61,42 @@ public:
      */
     virtual QString GetText() const;
 
+    /**
+     * The text at one revision, as GetText() and GetTextRevision()
+     * give them with nothing written in between.
+     */
+    struct Snapshot {
+        QString text;
+        int revision;
+    };
+
+    /**
+     * Returns the text with its revision. The text is an implicitly
+     * shared copy that later writes replace rather than change, so it
+     * can be worked on for as long as needed without holding GetLock().
+     */
+    Snapshot GetSnapshot() const;
+
     /**
      * Sets the text of the resource, replacing the stored content.
      */
     virtual void SetText(const QString &text);
 
+    /**
+     * Sets the text only if the resource is still at revision, checked
+     * and written in one step. Lets work done on a snapshot be written
+     * back without a lock held while it was done.
+     *
+     * @return \c false, with the text left as it is, if it was changed
+     *         after the revision.
+     */
+    virtual bool SetTextIfUnchanged(const QString &text, int revision);
+
     /**
      * Returns a reference to the QTextDocument that can be read and written to
-     * in consumers. If you need just read access, use GetTextDocumentForReading().
+     * in consumers. If you need just read access, use GetText().
+     * The document is only created here, on first use: until then the
+     * text is kept as a plain string. GUI thread only.
      *
      * @warning Make sure to get a write lock externally before calling this function!
      *
@@ -72,9 +104,58 @@ public:
      */
     TextDocument &GetTextDocumentForWriting();
 
+    /**
+     * Returns \c true if the QTextDocument currently exists.
+     */
+    bool HasTextDocument() const;
+
+    /**
+     * Starts building the document on the thread pool, so that
+     * GetTextDocumentForWriting() later finds it done instead of
+     * filling and laying it out on the GUI thread. Small texts are
+     * not worth the round trip and are left to be built there.
+     * TextDocumentReady() is emitted when the build has finished,
+     * whether or not its result could be kept. GUI thread only.
+     *
+     * @return \c true if there is nothing to wait for.
+     */
+    bool PrepareTextDocument();
+
+    /**
+     * Tabs showing the resource hold the document while they are open.
+     * When the last holder releases it, its text goes back to plain
+     * storage and the document is deleted. GUI thread only.
+     */
+    void RetainTextDocument();
+    void ReleaseTextDocument();
+
+    /**
+     * Drops the text from memory if it is the same as on disk, no
+     * document exists and nobody is using the resource right now.
+     * It is read back by the next GetText(). Called by TextMemoryBudget.
+     *
+     * @return \c true if the text was dropped.
+     */
+    bool TryEvictText();
+
     // inherited
     void SaveToDisk(bool book_wide_save = false);
 
+    /**
+     * The text is dirty when its revision has moved on since
+     * it was last read from or written to disk.
+     */
+    bool IsDirty() const;
+
+    // inherited
+    qint64 MemoryUsage() const;
+
+    /**
+     * Returns the size in bytes of the undo history of the document,
+     * which MemoryUsage() includes. GUI thread only.
+     */
+    qint64 UndoMemoryUsage() const;
+
     /**
      * Loads the text content into the QTextDocument cache if
      * nothing has been loaded so far. This is not done automatically
@@ -84,12 +165,40 @@ public:
 
     bool IsLoaded();
 
+    /**
+     * Returns \c true if GetText() returns the current content,
+     * i.e. the text was loaded or set and does not need reading
+     * from disk.
+     */
+    bool HasTextInMemory() const;
+
+    /**
+     * Returns a counter that moves on every time the text changes,
+     * whether through SetText, a reload or an edit of the text document.
+     * Lets consumers cache what they derive from the text.
+     */
+    int GetTextRevision() const;
+
     // inherited
     virtual ResourceType Type() const;
 
+signals:
+    /**
+     * Emitted when a build started by PrepareTextDocument() is over.
+     */
+    void TextDocumentReady();
+
 protected:
     virtual bool LoadFromDisk();
 
+    /**
+     * Called on the thread pool for a document built by
+     * PrepareTextDocument(), once it holds the text. Lets a subclass
+     * work out there what the views would otherwise work out on the
+     * GUI thread.
+     */
+    virtual void PrepareTextDocumentOffThread(TextDocument &document) const;
+
 private slots:
 
     /**
@@ -98,8 +207,31 @@ private slots:
      */
     void DelayedUpdateToTextDocument();
 
+    /**
+     * Moves the text revision on after an edit of m_TextDocument.
+     */
+    void TextDocumentChanged();
+
+    /**
+     * Takes the document built by PrepareTextDocument(), unless the
+     * text has changed or every tab has let go of it since.
+     */
+    void TextDocumentPrepared();
+
 private:
 
+    /**
+     * Fills a new document with text. Run on the thread pool; the
+     * document is handed to the GUI thread before it is returned.
+     */
+    TextDocument *BuildTextDocument(const QString &text) const;
+
+    /**
+     * Makes document the one holding the text. Called with
+     * m_CacheAccessMutex held.
+     */
+    void AdoptTextDocument(TextDocument *document);
+
     /**
      * Actually sets the text to m_TextDocument.
      *
@@ -107,6 +239,13 @@ private:
      */
     void SetTextInternal(const QString &text);
 
+    /**
+     * Replaces the plain text storage if there is no document.
+     *
+     * @return \c false if there is a document to update instead.
+     */
+    bool StoreTextWithoutDocument(const QString &text, bool from_disk);
+
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -128,11 +267,53 @@ private:
     mutable QMutex m_CacheAccessMutex;
 
     /**
-     * The syntax colored cache of the TextResource text content.
+     * The text content while there is no document.
+     * Empty while m_Evicted is set.
+     */
+    mutable QString m_Text;
+
+    /**
+     * The syntax colored cache of the TextResource text content,
+     * or NULL while no tab has needed it.
      */
     TextDocument *m_TextDocument;
 
+    /**
+     * The number of tabs holding m_TextDocument.
+     */
+    int m_DocumentUsers;
+
+    /**
+     * Watches the build started by PrepareTextDocument(), and the
+     * revision of the text it was started from. NULL when none runs.
+     */
+    QFutureWatcher<TextDocument *> *m_DocumentWatcher;
+    int m_DocumentWatcherRevision;
+
     bool m_IsLoaded;
+
+    /**
+     * @see GetTextRevision()
+     */
+    QAtomicInt m_TextRevision;
+
+    /**
+     * The revision last written to or read from disk.
+     * The text is clean, and may be evicted, when it is current.
+     */
+    int m_DiskRevision;
+
+    /**
+     * Set while the text is dropped and only on disk.
+     */
+    mutable bool m_Evicted;
+
+    /**
+     * The text of m_TextDocument at m_SnapshotRevision. Handed out by
+     * GetText() as an implicitly shared copy until the next edit.
+     */
+    mutable QString m_Snapshot;
+    mutable int m_SnapshotRevision;
 };
 
 #endif // TEXTRESOURCE_H
@@ -40,27 +40,28 @@ Resource::ResourceType XMLResource::Type() const
 bool XMLResource::FileIsWellFormed() const
 {
     // TODO: expand this with a dialog to fix the problem
-    QReadLocker locker(&GetLock());
+    // Checked on a snapshot of the text, without a lock held
+    QString text = GetText();
     QString mtype = GetMediaType();
     if ((mtype == "application/xhtml+xml") || (mtype == "application/x-dtbook+xml")) { 
-        XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(GetText());
+        XhtmlDoc::WellFormedError error = XhtmlDoc::WellFormedErrorForSource(text);
         bool well_formed = error.line == -1;
         return well_formed;
     }
-    bool well_formed = CleanSource::IsWellFormedXML(GetText(),mtype);
+    bool well_formed = CleanSource::IsWellFormedXML(text, mtype);
     return well_formed;
 }
 
 
 XhtmlDoc::WellFormedError XMLResource::WellFormedErrorLocation() const
 {
-    QReadLocker locker(&GetLock());
+    QString text = GetText();
     QString mtype = GetMediaType();
     XhtmlDoc::WellFormedError error;
     if ((mtype == "application/xhtml+xml") || (mtype == "application/x-dtbook+xml")) { 
-        error = XhtmlDoc::WellFormedErrorForSource(GetText());
+        error = XhtmlDoc::WellFormedErrorForSource(text);
     } else {
-        error = CleanSource::WellFormedXMLCheck(GetText(), mtype);
+        error = CleanSource::WellFormedXMLCheck(text, mtype);
     }
     return error;
 }
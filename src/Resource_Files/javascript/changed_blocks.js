@@ -0,0 +1,37 @@
+// Lists the nodes directly in the body for the text to be made from:
+// the tracked index of a node that has not changed since it was
+// tracked, the serialized node for the rest. Evaluates to false when
+// the body tag itself changed or no element is left in it.
+(function () {
+    var blocks = window.sigil_blocks;
+    var body = document.body;
+
+    if (!blocks || !body) {
+        return false;
+    }
+
+    blocks.mark(blocks.observer.takeRecords());
+    var serializer = new XMLSerializer();
+
+    if (serializer.serializeToString(body.cloneNode(false)) != blocks.shell) {
+        return false;
+    }
+
+    var parts = [];
+    var has_element = false;
+    var nodes = body.childNodes;
+
+    for (var i = 0; i < nodes.length; i++) {
+        var node = nodes[i];
+        var index = blocks.index_of(node);
+        has_element = has_element || node.nodeType == 1;
+
+        if (index != -1 && !blocks.changed[index]) {
+            parts.push(index);
+        } else {
+            parts.push(serializer.serializeToString(node));
+        }
+    }
+
+    return has_element ? parts : false;
+})();
@@ -0,0 +1,137 @@
+// Brings the body of the loaded page in line with a new version of the
+// document by replacing only the nodes that differ. Evaluates to false,
+// leaving the page alone, when it can not.
+//
+// On a page with math the diff is against the copy of the source body
+// kept by track_math_source.js, as MathJax has rewritten the page's own,
+// and the copy is patched along with the page. Math is only ever added
+// or removed with its parent, and MathJax typesets just what was added.
+(function () {
+    var parsed = new DOMParser().parseFromString($NEW_DOCUMENT, "application/xhtml+xml");
+
+    if (!parsed || parsed.getElementsByTagName("parsererror").length > 0) {
+        return false;
+    }
+
+    var source_body = document.sigil_source_body;
+    var old_body = source_body || document.body;
+    var new_body = parsed.getElementsByTagName("body")[0];
+
+    if (!old_body || !new_body) {
+        return false;
+    }
+
+    // Where a node of the source copy is in the page
+    function live(node) {
+        return node.sigil_live || node;
+    }
+
+    // MathJax puts nodes of its own next to the math it typesets
+    function has_math_children(node) {
+        for (var child = node.firstChild; child; child = child.nextSibling) {
+            if (child.nodeType == 1 && child.localName == "math") {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    function has_math(node) {
+        return node.nodeType == 1 &&
+               (node.localName == "math" || node.getElementsByTagNameNS("*", "math").length > 0);
+    }
+
+    var typeset = [];
+
+    // The same node, children aside
+    function same_shell(a, b) {
+        if (a.nodeType != b.nodeType || a.nodeName != b.nodeName) {
+            return false;
+        }
+        if (a.nodeType != 1) {
+            return a.nodeValue == b.nodeValue;
+        }
+        if (a.attributes.length != b.attributes.length) {
+            return false;
+        }
+        for (var i = 0; i < a.attributes.length; i++) {
+            var attr = a.attributes[i];
+            if (b.getAttributeNS(attr.namespaceURI, attr.localName) !== attr.value) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    function patch(old_node, new_node) {
+        var old_children = old_node.childNodes;
+        var new_children = new_node.childNodes;
+        var old_count = old_children.length;
+        var new_count = new_children.length;
+        var prefix = 0;
+        var suffix = 0;
+
+        while (prefix < old_count && prefix < new_count &&
+               old_children[prefix].isEqualNode(new_children[prefix])) {
+            prefix++;
+        }
+
+        while (suffix < old_count - prefix && suffix < new_count - prefix &&
+               old_children[old_count - 1 - suffix].isEqualNode(new_children[new_count - 1 - suffix])) {
+            suffix++;
+        }
+
+        // A single element changed inside: go down into it
+        if (old_count - prefix - suffix == 1 && new_count - prefix - suffix == 1 &&
+            old_children[prefix].nodeType == 1 && same_shell(old_children[prefix], new_children[prefix]) &&
+            !has_math_children(old_children[prefix])) {
+            patch(old_children[prefix], new_children[prefix]);
+            return;
+        }
+
+        var live_node = live(old_node);
+        var before = null;
+        var live_before = null;
+
+        if (suffix > 0) {
+            before = old_children[old_count - suffix];
+            live_before = live(before);
+        } else if (old_count > 0) {
+            live_before = live(old_children[old_count - 1]).nextSibling;
+        }
+
+        for (var i = old_count - suffix - 1; i >= prefix; i--) {
+            var gone = old_children[i];
+            live_node.removeChild(live(gone));
+
+            if (gone.parentNode == old_node) {
+                old_node.removeChild(gone);
+            }
+        }
+
+        for (var j = prefix; j < new_count - suffix; j++) {
+            var added = document.importNode(new_children[j], true);
+            live_node.insertBefore(added, live_before);
+
+            if (source_body) {
+                old_node.insertBefore(document.sigil_mirror(added), before);
+
+                if (has_math(added) && typeset.indexOf(live_node) == -1) {
+                    typeset.push(live_node);
+                }
+            }
+        }
+    }
+
+    if (!same_shell(old_body, new_body) || (source_body && has_math_children(old_body))) {
+        return false;
+    }
+
+    patch(old_body, new_body);
+
+    for (var k = 0; k < typeset.length; k++) {
+        MathJax.Hub.Queue(["Typeset", MathJax.Hub, typeset[k]]);
+    }
+
+    return true;
+})();
@@ -0,0 +1,46 @@
+// Puts a new version of a stylesheet into the loaded page without
+// reloading it. Each <link> to the stylesheet is swapped in place for a
+// <style> holding the new text, and later versions replace the text of
+// that <style>. Evaluates to false, leaving the page alone, when the
+// page does not link to the stylesheet.
+(function () {
+    var url = $STYLESHEET_URL;
+    var text = $STYLESHEET_TEXT;
+    var xhtml = "http://www.w3.org/1999/xhtml";
+    var found = false;
+
+    var styles = document.getElementsByTagNameNS(xhtml, "style");
+
+    for (var i = 0; i < styles.length; i++) {
+        if (styles[i].getAttribute("data-sigil-stylesheet") == url) {
+            styles[i].textContent = text;
+            found = true;
+        }
+    }
+
+    // The list is live and shrinks as links are replaced
+    var links = document.getElementsByTagNameNS(xhtml, "link");
+
+    for (var j = links.length - 1; j >= 0; j--) {
+        var link = links[j];
+        var rel = (link.getAttribute("rel") || "").toLowerCase().split(/\s+/);
+
+        if (rel.indexOf("stylesheet") == -1 || rel.indexOf("alternate") != -1 || link.href != url) {
+            continue;
+        }
+
+        var style = document.createElementNS(xhtml, "style");
+        style.setAttribute("type", "text/css");
+        style.setAttribute("data-sigil-stylesheet", url);
+
+        if (link.hasAttribute("media")) {
+            style.setAttribute("media", link.getAttribute("media"));
+        }
+
+        style.textContent = text;
+        link.parentNode.replaceChild(style, link);
+        found = true;
+    }
+
+    return found;
+})();
@@ -0,0 +1,66 @@
+// Remembers the nodes directly in the body as they are now, which the
+// saved text was made from, and watches for changes inside them.
+// Evaluates to the names of the nodes, to be checked against the text.
+(function () {
+    var body = document.body;
+
+    if (window.sigil_blocks) {
+        window.sigil_blocks.observer.disconnect();
+        window.sigil_blocks = null;
+    }
+
+    if (!body || !window.MutationObserver) {
+        return "";
+    }
+
+    var blocks = {
+        nodes: Array.prototype.slice.call(body.childNodes),
+        changed: [],
+        shell: new XMLSerializer().serializeToString(body.cloneNode(false)),
+
+        index_of: function (node) {
+            var index = node.sigil_block_index;
+
+            if (typeof index == "number" && this.nodes[index] === node) {
+                return index;
+            }
+
+            return this.nodes.indexOf(node);
+        },
+
+        // Nodes added to or removed from the body itself need no marking:
+        // only the nodes that are still tracked are taken from the text
+        mark: function (records) {
+            for (var i = 0; i < records.length; i++) {
+                var node = records[i].target;
+
+                while (node && node.parentNode !== body) {
+                    node = node.parentNode;
+                }
+
+                if (node) {
+                    var index = this.index_of(node);
+
+                    if (index != -1) {
+                        this.changed[index] = true;
+                    }
+                }
+            }
+        }
+    };
+
+    var names = [];
+
+    for (var i = 0; i < blocks.nodes.length; i++) {
+        var node = blocks.nodes[i];
+        node.sigil_block_index = i;
+        blocks.changed.push(false);
+        names.push(node.nodeType == 1 ? node.nodeName : "#" + node.nodeType);
+    }
+
+    blocks.observer = new MutationObserver(function (records) { blocks.mark(records); });
+    blocks.observer.observe(body, { childList: true, subtree: true,
+                                    characterData: true, attributes: true });
+    window.sigil_blocks = blocks;
+    return names.join(" ");
+})();
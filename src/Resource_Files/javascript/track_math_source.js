@@ -0,0 +1,31 @@
+// Runs in the head of Preview pages with math, before MathJax.js loads.
+// Just before MathJax first typesets the page, it keeps a copy of the
+// body as it was in the source, each node linked to the node it was
+// copied from in the page, so patch_body.js can diff new versions of
+// the document against the source rather than against the typeset math.
+window.MathJax = {
+    AuthorInit: function () {
+        // MathJax adds its own message and hidden divs to the body
+        function mirror(live) {
+            var copy = live.cloneNode(false);
+            copy.sigil_live = live;
+
+            for (var child = live.firstChild; child; child = child.nextSibling) {
+                if (child.nodeType == 1 && /^MathJax/.test(child.getAttribute("id") || "")) {
+                    continue;
+                }
+                copy.appendChild(mirror(child));
+            }
+
+            return copy;
+        }
+
+        document.sigil_mirror = mirror;
+
+        MathJax.Hub.Register.StartupHook("Begin Typeset", function () {
+            if (document.body) {
+                document.sigil_source_body = mirror(document.body);
+            }
+        });
+    }
+};
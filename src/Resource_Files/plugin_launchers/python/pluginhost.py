@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# vim:ts=4:sw=4:softtabstop=4:smarttab:expandtab
+
+# Copyright (c) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+# 1. Redistributions of source code must retain the above copyright notice, this list of
+# conditions and the following disclaimer.
+#
+# 2. Redistributions in binary form must reproduce the above copyright notice, this list
+# of conditions and the following disclaimer in the documentation and/or other materials
+# provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+# SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+# TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+# BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+# CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+# WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Sigil Python Plugin Host
+#
+# A long lived alternative to starting the interpreter and launcher.py
+# for every plugin run.  The host imports the launcher and the modules
+# plugins commonly use once, then waits on stdin for run requests.
+#
+# Each request is one line holding a JSON list of the arguments
+# launcher.py would be given: ebook_root, output directory, script
+# type and path to the target script.  The run writes to stdout exactly
+# what launcher.py would, followed by a line holding only RUN_DONE.
+#
+# A plugin that brings down the interpreter only takes the host with
+# it; Sigil starts a new host for the next run.
+
+import sys
+import os
+import json
+
+import launcher
+
+# Warm the modules plugins commonly import
+for _module in ['sigil_bs4', 'sigil_gumbo_bs4_adapter', 'css_parser', 'quickparser',
+                'epub_utils', 'pluginhunspell', 'preferences']:
+    try:
+        __import__(_module)
+    except Exception:
+        pass
+
+RUN_DONE = b'\x04SIGIL_PLUGIN_HOST_RUN_DONE\n'
+
+
+# Every plugin's entry module is named plugin, so the modules a run
+# imported from its plugin's folder are forgotten before the next run
+def forget_plugin_modules(script_home, preloaded):
+    script_home = os.path.abspath(script_home) + os.sep
+    for name, module in list(sys.modules.items()):
+        if name in preloaded:
+            continue
+        path = getattr(module, '__file__', None)
+        if path and os.path.abspath(path).startswith(script_home):
+            del sys.modules[name]
+
+
+def main():
+    while True:
+        line = sys.stdin.buffer.readline()
+        if not line:
+            # Sigil closed the pipe
+            break
+        line = line.decode('utf-8').strip()
+        if not line:
+            continue
+        args = json.loads(line)
+        script_home = os.path.dirname(args[-1]) if args else ''
+        preloaded = set(sys.modules.keys())
+        saved_path = list(sys.path)
+        launcher.main([launcher.__file__] + args)
+        sys.path[:] = saved_path
+        forget_plugin_modules(script_home, preloaded)
+        sys.stdout.buffer.write(RUN_DONE)
+        sys.stdout.flush()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
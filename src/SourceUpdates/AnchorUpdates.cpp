@@ -29,6 +29,7 @@
 #include <QtConcurrent/QtConcurrent>
 
 #include "Misc/Utility.h"
+#include "Misc/GumboCache.h"
 #include "Misc/GumboInterface.h"
 #include "BookManipulation/CleanSource.h"
 #include "ResourceObjects/HTMLResource.h"
@@ -87,10 +88,8 @@ std::tuple<QString, QList<QString>> AnchorUpdates::GetOneFileIDs(HTMLResource *h
 {
     Q_ASSERT(html_resource);
     QReadLocker locker(&html_resource->GetLock());
-    QString newsource = html_resource->GetText();
     QString version = html_resource->GetEpubVersion();
-    GumboInterface gi = GumboInterface(newsource, version);
-    gi.parse();
+    GumboInterface gi(GumboCache::Get(html_resource), version);
     QList<QString> ids = gi.get_all_values_for_attribute(QString("id"));
     return std::make_tuple(html_resource->Filename(), ids);
 }
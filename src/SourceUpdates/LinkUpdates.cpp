@@ -24,7 +24,6 @@
 
 #include <QtCore/QtCore>
 #include <QtCore/QString>
-#include <QtConcurrent/QtConcurrent>
 
 #include "ResourceObjects/HTMLResource.h"
 #include "Misc/Utility.h"
@@ -32,13 +31,19 @@
 #include "BookManipulation/CleanSource.h"
 #include "sigil_constants.h"
 #include "SourceUpdates/LinkUpdates.h"
+#include "SourceUpdates/UpdateJob.h"
 
 void LinkUpdates::UpdateLinksInAllFiles(const QList<HTMLResource *> &html_resources, const QList<QString> new_stylesheets)
 {
-    QtConcurrent::blockingMap(html_resources, std::bind(UpdateLinksInOneFile, std::placeholders::_1, new_stylesheets));
+    QList<TextResource *> text_resources;
+    foreach(HTMLResource * html_resource, html_resources) {
+        text_resources.append(html_resource);
+    }
+    UpdateJob job(text_resources, std::bind(UpdateLinksInOneFile, std::placeholders::_1, std::placeholders::_2, new_stylesheets));
+    job.Run(QObject::tr("Updating stylesheet links..."));
 }
 
-void LinkUpdates::UpdateLinksInOneFile(HTMLResource *html_resource, QList<QString> new_stylesheets)
+QString LinkUpdates::UpdateLinksInOneFile(TextResource *html_resource, const QString &text, QList<QString> new_stylesheets)
 {
     Q_ASSERT(html_resource);
 
@@ -48,11 +53,92 @@ void LinkUpdates::UpdateLinksInOneFile(HTMLResource *html_resource, QList<QStrin
         stylesheet = Utility::URLEncodePath(stylesheet);
         newcsslinks += "<link href=\"" + stylesheet + "\" type=\"text/css\" rel=\"stylesheet\"/>\n";
     }
-    QWriteLocker locker(&html_resource->GetLock());
-    QString newsource = html_resource->GetText();
+
+    // Only the head is looked at and changed; the body is left as it is
+    QList<XhtmlDoc::XMLElement> links;
+    QList<QPair<int, int>> ranges;
+    int head_close;
+
+    if (XhtmlDoc::GetLinksInHead(text, links, ranges, head_close)) {
+        if (LinksAre(links, new_stylesheets)) {
+            return text;
+        }
+        return SpliceLinks(text, ranges, head_close, newcsslinks);
+    }
+
+    // A head without an end tag is rebuilt from a parse
     QString version = html_resource->GetEpubVersion();
-    GumboInterface gi = GumboInterface(newsource, version);
+    GumboInterface gi = GumboInterface(text, version);
     gi.parse();
-    newsource = gi.perform_link_updates(newcsslinks);
-    html_resource->SetText(CleanSource::CharToEntity(newsource));
+    QString newsource = gi.perform_link_updates(newcsslinks);
+    return CleanSource::CharToEntity(newsource);
+}
+
+
+bool LinkUpdates::LinksAre(const QList<XhtmlDoc::XMLElement> &links, const QList<QString> &stylesheets)
+{
+    if (links.count() != stylesheets.count()) {
+        return false;
+    }
+
+    for (int i = 0; i < links.count(); ++i) {
+        const QHash<QString, QString> &attributes = links.at(i).attributes;
+
+        if (attributes.value("type").toLower() != "text/css" ||
+            attributes.value("rel").toLower() != "stylesheet" ||
+            Utility::URLDecodePath(attributes.value("href")) != stylesheets.at(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+QString LinkUpdates::SpliceLinks(const QString &text, const QList<QPair<int, int>> &ranges, int head_close,
+                                 const QString &newcsslinks)
+{
+    QString result;
+    result.reserve(text.length() + newcsslinks.length());
+    int pos = 0;
+
+    // Every link in the head goes, as perform_link_updates drops them,
+    // and a link alone on its line takes the line with it
+    for (int i = 0; i < ranges.count(); ++i) {
+        int from = ranges.at(i).first;
+        int to = from + ranges.at(i).second;
+        int line_start = from;
+        int line_end = to;
+
+        while (line_start > pos && (text.at(line_start - 1) == ' ' || text.at(line_start - 1) == '\t')) {
+            line_start--;
+        }
+        while (line_end < text.length() && (text.at(line_end) == ' ' || text.at(line_end) == '\t')) {
+            line_end++;
+        }
+        if ((line_start == 0 || text.at(line_start - 1) == '\n') &&
+            line_end < text.length() && text.at(line_end) == '\n') {
+            from = line_start;
+            to = line_end + 1;
+        }
+
+        result.append(text.midRef(pos, from - pos));
+        pos = to;
+    }
+
+    // The new links go in at the end of the head, on lines of their own
+    int insert = head_close;
+
+    while (insert > pos && (text.at(insert - 1) == ' ' || text.at(insert - 1) == '\t')) {
+        insert--;
+    }
+
+    result.append(text.midRef(pos, insert - pos));
+
+    if (!newcsslinks.isEmpty() && !result.isEmpty() && !result.endsWith('\n')) {
+        result.append('\n');
+    }
+
+    result.append(newcsslinks);
+    result.append(text.midRef(insert));
+    return result;
 }
@@ -24,7 +24,14 @@
 #ifndef LINKUPDATES_H
 #define LINKUPDATES_H
 
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QString>
+
+#include "BookManipulation/XhtmlDoc.h"
+
 class HTMLResource;
+class TextResource;
 
 class LinkUpdates
 {
@@ -43,7 +50,20 @@ public:
 
 private:
 
-    static void UpdateLinksInOneFile(HTMLResource *html_resource, const QList<QString> new_stylesheets);
+    static QString UpdateLinksInOneFile(TextResource *html_resource, const QString &text, QList<QString> new_stylesheets);
+
+    /**
+     * @return true if the links are the stylesheets, linked in that
+     *         order, and nothing else.
+     */
+    static bool LinksAre(const QList<XhtmlDoc::XMLElement> &links, const QList<QString> &stylesheets);
+
+    /**
+     * Takes the links at ranges out of text and puts newcsslinks in
+     * just before the </head> at head_close.
+     */
+    static QString SpliceLinks(const QString &text, const QList<QPair<int, int>> &ranges, int head_close,
+                               const QString &newcsslinks);
 };
 
 #endif // LINKUPDATES_H
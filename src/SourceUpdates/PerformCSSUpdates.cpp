@@ -21,17 +21,21 @@
 *************************************************************************/
 
 #include <QDir>
-#include <QUrl>
 #include <QFileInfo>
+#include <QSet>
 #include <QString>
-#include <QRegularExpression>
-#include <QRegularExpressionMatch>
 
+#include "Misc/CSSTokenizer.h"
 #include "Misc/Utility.h"
 #include "SourceUpdates/PerformCSSUpdates.h"
 
 static const QChar FORWARD_SLASH = QChar::fromLatin1('/');
 
+// The properties whose values may reference other files
+static const QSet<QString> REFERENCE_PROPERTIES = QSet<QString>()
+        << "src" << "background" << "background-image" << "list-style" << "list-style-image"
+        << "border-image" << "border-image-source" << "content" << "shape-outside" << "-webkit-shape-outside";
+
 PerformCSSUpdates::PerformCSSUpdates(const QString &source, const QHash<QString, QString> &css_updates, const QString &currentpath)
     :
     m_Source(source),
@@ -43,76 +47,74 @@ PerformCSSUpdates::PerformCSSUpdates(const QString &source, const QHash<QString,
 
 QString PerformCSSUpdates::operator()()
 {
-    QString result(m_Source);
-    QString origDir = QFileInfo(m_CurrentPath).dir().path();
-    const QList<QString> &keys = m_CSSUpdates.keys();
-    int num_keys = keys.count();
-    if (num_keys == 0) return result;
+    if (m_CSSUpdates.isEmpty()) {
+        return m_Source;
+    }
 
-    // Now parse the text once looking for keys and replacing them where needed
-    QRegularExpression reference(
-        "(?:(?:src|background|background-image|list-style|list-style-image|border-image|border-image-source|content|(?:-webkit-)?shape-outside)\\s*:|@import)\\s*"
-        "("
-        "[^;\\}]*"
-        ")"
-        "(?:;|\\})");
+    QString origDir = QFileInfo(m_CurrentPath).dir().path();
+    // One pass over the tokens. The result is only built once the first
+    // reference needs replacing, from the unchanged slices in between.
+    QString result;
+    int last = 0;
+    bool changed = false;
+    bool in_reference = false;
+    QString last_name;
+    CSSTokenizer tokenizer(m_Source);
 
-    QRegularExpression urls(
-        "(?:"
-        "url\\([\"']?([^\\(\\)\"']*)[\"']?\\)"
-        "|"
-        "[\"']([^\\(\\)\"']*)[\"']"
-        ")");
+    while (!tokenizer.AtEnd()) {
+        CSSTokenizer::Token token = tokenizer.Next();
 
-    int start_index = 0;
-    // this next line is what is crashing
-    QRegularExpressionMatch mo = reference.match(result, start_index);
-    // handle case if no initial match at all
-    if (!mo.hasMatch()) return result;
-    do {
-        bool changes_made = false;
-        for (int i = 1; i <= reference.captureCount(); ++i) {
-            if (mo.captured(i).trimmed().isEmpty()) {
+        switch (token.type) {
+            case CSSTokenizer::Whitespace:
+            case CSSTokenizer::Comment:
                 continue;
+            case CSSTokenizer::Name:
+                last_name = tokenizer.Value(token).toString().toLower();
+                continue;
+            case CSSTokenizer::Colon:
+                if (!in_reference) {
+                    in_reference = REFERENCE_PROPERTIES.contains(last_name);
+                }
+                break;
+            case CSSTokenizer::AtKeyword:
+                in_reference = tokenizer.Value(token).compare(QLatin1String("import"), Qt::CaseInsensitive) == 0;
+                break;
+            case CSSTokenizer::Semicolon:
+            case CSSTokenizer::LeftBrace:
+            case CSSTokenizer::RightBrace:
+                in_reference = false;
+                break;
+            case CSSTokenizer::String:
+            case CSSTokenizer::Url: {
+                if (!in_reference || tokenizer.Value(token).trimmed().isEmpty()) {
+                    break;
+                }
+                QString apath = Utility::URLDecodePath(tokenizer.Value(token).toString());
+                QString search_key = QDir::cleanPath(origDir + FORWARD_SLASH + apath);
+                QString new_href = m_CSSUpdates.value(search_key);
+                if (new_href.isEmpty()) {
+                    break;
+                }
+                if (!changed) {
+                    result.reserve(m_Source.length());
+                    changed = true;
+                }
+                result.append(m_Source.midRef(last, token.valueStart - last));
+                result.append(Utility::URLEncodePath(new_href));
+                last = token.valueStart + token.valueLength;
+                break;
             }
-            // Check the captured property attribute string fragment for multiple urls
-            int frag_start_index = 0;
-            QString fragment = mo.captured(i);
-            QRegularExpressionMatch frag_mo = urls.match(fragment, frag_start_index);
-	    // only loop if at least one match was found
-	    if (frag_mo.hasMatch()) {
-                do {
-                    for (int j = 1; j <= urls.captureCount(); ++j) {
-                        if (frag_mo.captured(j).trimmed().isEmpty()) {
-                            continue;
-                        }
-                        QString apath = Utility::URLDecodePath(frag_mo.captured(j));
-                        QString search_key = QDir::cleanPath(origDir + FORWARD_SLASH + apath);
-                        QString new_href;
-                        if (m_CSSUpdates.contains(search_key)) {
-                            new_href = m_CSSUpdates.value(search_key);
-                        }
-                        if (!new_href.isEmpty()) {
-                            new_href = Utility::URLEncodePath(new_href);
-                            // Replace the old url with the new one
-                            fragment.replace(frag_mo.capturedStart(j), frag_mo.capturedLength(j), new_href);
-                            changes_made = true;
-                        }
-    
-                    }
-                    frag_start_index += frag_mo.capturedLength();
-                    frag_mo = urls.match(fragment, frag_start_index);
-                } while (frag_mo.hasMatch());
-	    }
-            // Replace the original attribute string fragment with the new one
-            if (changes_made) {
-                result.replace(mo.capturedStart(i), mo.capturedLength(i), fragment);
-            }
-
+            default:
+                break;
         }
-        start_index += mo.capturedLength();
-        mo = reference.match(result, start_index);
-    } while (mo.hasMatch());
 
+        last_name.clear();
+    }
+
+    if (!changed) {
+        return m_Source;
+    }
+
+    result.append(m_Source.midRef(last));
     return result;
 }
@@ -34,7 +34,8 @@ PerformHTMLUpdates::PerformHTMLUpdates(const QString &source,
   m_CSSUpdates(css_updates),
   m_CurrentPath(currentpath),
   m_source(source),
-  m_version(version)
+  m_version(version),
+  m_UpdatesMade(false)
 {
 }
 
@@ -42,16 +43,21 @@ PerformHTMLUpdates::PerformHTMLUpdates(const QString &source,
 QString PerformHTMLUpdates::operator()()
 {
     QString newsource = CleanSource::PreprocessSpecialCases(m_source);
-    { 
-        GumboInterface gi = GumboInterface(newsource, m_version, m_HTMLUpdates);
-        gi.parse();
+    // One parse and one serialization for both the href/src and the style updates
+    GumboInterface gi = GumboInterface(newsource, m_version, m_HTMLUpdates, m_CSSUpdates);
+    gi.parse();
+    if (m_CSSUpdates.isEmpty()) {
         newsource = gi.perform_source_updates(m_CurrentPath);
+    } else {
+        newsource = gi.perform_source_and_style_updates(m_CurrentPath);
     }
-    if (!m_CSSUpdates.isEmpty()) {
-        GumboInterface gi = GumboInterface(newsource, m_version, m_CSSUpdates);
-        gi.parse();
-        newsource = gi.perform_style_updates(m_CurrentPath);
-    }
+    m_UpdatesMade = gi.updates_made();
     return CleanSource::CharToEntity(newsource);
 }
 
+
+bool PerformHTMLUpdates::UpdatesMade() const
+{
+    return m_UpdatesMade;
+}
+
@@ -37,6 +37,10 @@ public:
 
     QString operator()();
 
+    // True if the last run rewrote any reference; when false the
+    // result differs from the source only by reserialization
+    bool UpdatesMade() const;
+
 private:
 
     ///////////////////////////////
@@ -48,6 +52,7 @@ private:
     const QString& m_CurrentPath;
     const QString& m_source;
     const QString& m_version;
+    bool m_UpdatesMade;
 };
 
 #endif // PERFORMHTMLUPDATES_H
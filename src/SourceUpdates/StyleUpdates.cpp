@@ -0,0 +1,52 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <functional>
+
+#include <QtCore/QtCore>
+#include <QtCore/QString>
+
+#include "ResourceObjects/CSSResource.h"
+#include "SourceUpdates/StyleUpdates.h"
+#include "SourceUpdates/UpdateJob.h"
+
+int StyleUpdates::DeleteStylesInAllFiles(const QList<TextResource *> &resources,
+                                         const QHash<QString, QList<CSSInfo::CSSSelector *>> &selectors)
+{
+    if (resources.isEmpty()) {
+        return 0;
+    }
+    UpdateJob job(resources, std::bind(DeleteStylesInOneFile, std::placeholders::_1, std::placeholders::_2, selectors));
+    job.Run(QObject::tr("Deleting styles..."));
+    return job.ChangedCount();
+}
+
+QString StyleUpdates::DeleteStylesInOneFile(TextResource *resource, const QString &text,
+                                            const QHash<QString, QList<CSSInfo::CSSSelector *>> &selectors)
+{
+    Q_ASSERT(resource);
+    // Removing selectors moves the ones after them, so each file gets a
+    // parse of its own rather than the shared one CSSResource keeps
+    CSSInfo css_info(text, qobject_cast<CSSResource *>(resource) != NULL);
+    // Null if none of the selectors was found
+    return css_info.removeMatchingSelectors(selectors.value(resource->Filename()));
+}
@@ -0,0 +1,57 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef STYLEUPDATES_H
+#define STYLEUPDATES_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "Misc/CSSInfo.h"
+
+class TextResource;
+
+class StyleUpdates
+{
+
+public:
+
+    /**
+     * Removes selectors from the stylesheets and the inline style blocks
+     * of HTML files, every file in parallel and all as one job.
+     *
+     * @param resources The files to remove selectors from.
+     * @param selectors The selectors to remove, keyed by the filename
+     *                  of the file they are in.
+     * @return The number of files changed.
+     */
+    static int DeleteStylesInAllFiles(const QList<TextResource *> &resources,
+                                      const QHash<QString, QList<CSSInfo::CSSSelector *>> &selectors);
+
+private:
+    static QString DeleteStylesInOneFile(TextResource *resource, const QString &text,
+                                         const QHash<QString, QList<CSSInfo::CSSSelector *>> &selectors);
+};
+
+#endif // STYLEUPDATES_H
@@ -32,6 +32,7 @@
 #include "BookManipulation/XhtmlDoc.h"
 #include "Misc/HTMLEncodingResolver.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/Trace.h"
 #include "Misc/Utility.h"
 #include "ResourceObjects/OPFResource.h"
 #include "ResourceObjects/NCXResource.h"
@@ -47,6 +48,7 @@
 #include "SourceUpdates/PerformOPFUpdates.h"
 #include "SourceUpdates/PerformXMLUpdates.h"
 #include "SourceUpdates/UniversalUpdates.h"
+#include "SourceUpdates/UpdateJob.h"
 
 #define NON_WELL_FORMED_MESSAGE "Cannot perform HTML updates since the file is not well formed"
 
@@ -55,6 +57,8 @@ QStringList UniversalUpdates::PerformUniversalUpdates(bool resources_already_loa
         const QHash<QString, QString> &updates,
         const QList<XMLResource *> &non_well_formed)
 {
+    SIGIL_TRACE_SCOPE("Universal updates");
+    SIGIL_TRACE_COUNTER("Universal updates resources", resources.count());
     QStringList updatekeys = updates.keys();
     QHash<QString, QString> html_updates;
     QHash<QString, QString> css_updates;
@@ -84,21 +88,60 @@ QStringList UniversalUpdates::PerformUniversalUpdates(bool resources_already_loa
         }
     }
 
-    QFutureSynchronizer<void> sync;
-    QFuture<QString> html_future;
-    QFuture<void> css_future;
-
     if (resources_already_loaded) {
-        html_future = QtConcurrent::mapped(html_resources, std::bind(UpdateOneHTMLFile, std::placeholders::_1, html_updates, css_updates));
-        css_future = QtConcurrent::map(css_resources,  std::bind(UpdateOneCSSFile,  std::placeholders::_1, css_updates));
-    } else {
-        html_future = QtConcurrent::mapped(html_resources, std::bind(LoadAndUpdateOneHTMLFile, std::placeholders::_1, html_updates, css_updates, non_well_formed));
-        css_future = QtConcurrent::map(css_resources,  std::bind(LoadAndUpdateOneCSSFile,  std::placeholders::_1, css_updates));
+        // Every file is worked out before any is written, and nothing is
+        // written unless all of them succeed.
+        QList<TextResource *> text_resources;
+        foreach(HTMLResource * html_resource, html_resources) {
+            text_resources.append(html_resource);
+        }
+        foreach(CSSResource * css_resource, css_resources) {
+            text_resources.append(css_resource);
+        }
+        UpdateJob job(text_resources, std::bind(ComputeOneFile, std::placeholders::_1, std::placeholders::_2, html_updates, css_updates));
+        bool committed = job.Run(QObject::tr("Updating references..."));
+        foreach(TextResource * text_resource, text_resources) {
+            text_resource->SetCurrentBookRelPath("");
+        }
+        if (!committed) {
+            return job.Errors();
+        }
+        return UpdateXMLFiles(opf_resource, ncx_resource, xml_resources, xml_updates);
     }
 
+    QFutureSynchronizer<void> sync;
+    QFuture<QString> html_future = QtConcurrent::mapped(html_resources, std::bind(LoadAndUpdateOneHTMLFile, std::placeholders::_1, html_updates, css_updates, non_well_formed));
+    QFuture<void> css_future = QtConcurrent::map(css_resources,  std::bind(LoadAndUpdateOneCSSFile,  std::placeholders::_1, css_updates));
+
     sync.addFuture(html_future);
     sync.addFuture(css_future);
 
+    const QStringList xml_errors = UpdateXMLFiles(opf_resource, ncx_resource, xml_resources, xml_updates);
+
+    sync.waitForFinished();
+
+    // Now assemble our list of errors if any.
+    QStringList load_update_errors;
+
+    for (int i = 0; i < html_future.results().count(); i++) {
+        const QString html_error = html_future.resultAt(i);
+
+        if (!html_error.isEmpty()) {
+            load_update_errors.append(html_error);
+        }
+    }
+
+    load_update_errors.append(xml_errors);
+    return load_update_errors;
+}
+
+
+QStringList UniversalUpdates::UpdateXMLFiles(OPFResource *opf_resource,
+        NCXResource *ncx_resource,
+        const QList<XMLResource *> &xml_resources,
+        const QHash<QString, QString> &xml_updates)
+{
+    QStringList errors;
     // We can't schedule these with QtConcurrent because they
     // will (indirectly) call QTextDocument::setPlainText, and if
     // a tab is open for the ncx/opf, then an event needs to be sent
@@ -117,28 +160,15 @@ QStringList UniversalUpdates::PerformUniversalUpdates(bool resources_already_loa
         xml_resource->SaveToDisk();
     }
 
-    sync.waitForFinished();
-
-    // Now assemble our list of errors if any.
-    QStringList load_update_errors;
-
-    for (int i = 0; i < html_future.results().count(); i++) {
-        const QString html_error = html_future.resultAt(i);
-
-        if (!html_error.isEmpty()) {
-            load_update_errors.append(html_error);
-        }
-    }
-
     if (!ncx_result.isEmpty()) {
-        load_update_errors.append(ncx_result);
+        errors.append(ncx_result);
     }
 
     if (!opf_result.isEmpty()) {
-        load_update_errors.append(opf_result);
+        errors.append(opf_result);
     }
 
-    return load_update_errors;
+    return errors;
 }
 
 
@@ -182,47 +212,32 @@ std::tuple <QHash<QString, QString>,
 }
 
 
-QString UniversalUpdates::UpdateOneHTMLFile(HTMLResource *html_resource,
+QString UniversalUpdates::ComputeOneFile(TextResource *text_resource,
+        const QString &source,
         const QHash<QString, QString> &html_updates,
         const QHash<QString, QString> &css_updates)
 {
-    if (!html_resource) {
-        return QString();
+    QString currentpath = text_resource->GetCurrentBookRelPath();
+
+    if (text_resource->Type() == Resource::CSSResourceType) {
+        return PerformCSSUpdates(source, css_updates, currentpath)();
     }
 
     try {
-        QWriteLocker locker(&html_resource->GetLock());
-        QString currentpath = html_resource->GetCurrentBookRelPath();
-        QString version = html_resource->GetEpubVersion();
-        QString source = html_resource->GetText();
-        QString newsource = source;
-        newsource = PerformHTMLUpdates(newsource, html_updates, css_updates, currentpath, version)();
-        html_resource->SetText(newsource);
-        html_resource->SetCurrentBookRelPath("");
-        return QString();
+        QString version = text_resource->GetEpubVersion();
+        PerformHTMLUpdates html_update(source, html_updates, css_updates, currentpath, version);
+        QString newsource = html_update();
+        // A file with no reference to any updated path is left as it is
+        if (!html_update.UpdatesMade()) {
+            return QString();
+        }
+        return newsource;
     } catch (ErrorBuildingDOM) {
-        // It would be great if we could just let this exception bubble up,
-        // but we can't since QtConcurrent doesn't let exceptions cross threads.
-        // So we just leave the old source in the resource.
-        return QString(QObject::tr("Invalid HTML file: %1")).arg(html_resource->Filename());
+        throw QString(QObject::tr("Invalid HTML file: %1")).arg(text_resource->Filename());
     }
 }
 
 
-void UniversalUpdates::UpdateOneCSSFile(CSSResource *css_resource,
-                                        const QHash<QString, QString> &css_updates)
-{
-    if (!css_resource) {
-        return;
-    }
-    QWriteLocker locker(&css_resource->GetLock());
-    QString currentpath = css_resource->GetCurrentBookRelPath();
-    const QString &source = css_resource->GetText();
-    css_resource->SetText(PerformCSSUpdates(source, css_updates, currentpath)());
-    css_resource->SetCurrentBookRelPath("");
-}
-
-
 QString UniversalUpdates::LoadAndUpdateOneHTMLFile(HTMLResource *html_resource,
         const QHash<QString, QString> &html_updates,
         const QHash<QString, QString> &css_updates,
@@ -29,6 +29,7 @@ class XMLResource;
 class NCXResource;
 class OPFResource;
 class Resource;
+class TextResource;
 
 
 class UniversalUpdates
@@ -52,12 +53,14 @@ public:
 
 private:
 
-    static QString UpdateOneHTMLFile(HTMLResource *html_resource,
-                                     const QHash<QString, QString> &html_updates,
-                                     const QHash<QString, QString> &css_updates);
-
-    static void UpdateOneCSSFile(CSSResource *css_resource,
-                                 const QHash<QString, QString> &css_updates);
+    /**
+     * @return The updated text of an HTML or CSS file, or a null
+     *         QString if nothing in it needs updating.
+     */
+    static QString ComputeOneFile(TextResource *text_resource,
+                                  const QString &source,
+                                  const QHash<QString, QString> &html_updates,
+                                  const QHash<QString, QString> &css_updates);
 
     static QString LoadAndUpdateOneHTMLFile(HTMLResource *html_resource,
                                             const QHash<QString, QString> &html_updates,
@@ -69,6 +72,11 @@ private:
 
     static QString UpdateNCXFile(NCXResource *ncx_resource,
                                  const QHash<QString, QString> &xml_updates);
+
+    static QStringList UpdateXMLFiles(OPFResource *opf_resource,
+                                      NCXResource *ncx_resource,
+                                      const QList<XMLResource *> &xml_resources,
+                                      const QHash<QString, QString> &xml_updates);
 };
 
 #endif // UNIVERSALUPDATES_H
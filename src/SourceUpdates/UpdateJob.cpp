@@ -0,0 +1,194 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <exception>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFutureWatcher>
+#include <QtCore/QThread>
+#include <QtCore/QWriteLocker>
+#include <QtConcurrent/QtConcurrent>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QProgressDialog>
+
+#include "ResourceObjects/TextResource.h"
+#include "SourceUpdates/UpdateJob.h"
+
+// Short jobs finish before the progress dialog would show
+static const int PROGRESS_DELAY_MS = 500;
+
+UpdateJob::UpdateJob(const QList<TextResource *> &resources, Transform transform, QObject *parent)
+    :
+    QObject(parent),
+    m_Resources(resources),
+    m_Transform(transform),
+    m_ChangedCount(0),
+    m_DoneCount(0)
+{
+}
+
+
+bool UpdateJob::Run(const QString &label)
+{
+    m_Errors.clear();
+    m_ChangedCount = 0;
+    m_DoneCount.store(0);
+
+    if (m_Resources.isEmpty()) {
+        return true;
+    }
+
+    QFuture<Outcome> future = QtConcurrent::mapped(m_Resources,
+                              std::bind(RunOne, this, std::placeholders::_1, m_Transform, m_Cancel));
+
+    if (qobject_cast<QApplication *>(QCoreApplication::instance()) &&
+        QThread::currentThread() == QCoreApplication::instance()->thread()) {
+        QFutureWatcher<Outcome> watcher;
+        QProgressDialog progress(label, tr("Cancel"), 0, m_Resources.count(), QApplication::activeWindow());
+        progress.setWindowModality(Qt::ApplicationModal);
+        progress.setMinimumDuration(PROGRESS_DELAY_MS);
+        progress.setAutoClose(false);
+        progress.setAutoReset(false);
+        connect(this, SIGNAL(Progress(int, int)), &progress, SLOT(setValue(int)));
+        connect(&progress, SIGNAL(canceled()), this, SLOT(Cancel()));
+        QEventLoop loop;
+        connect(&watcher, SIGNAL(finished()), &loop, SLOT(quit()));
+        watcher.setFuture(future);
+
+        if (!future.isFinished()) {
+            loop.exec();
+        }
+
+        future.waitForFinished();
+    } else {
+        future.waitForFinished();
+    }
+
+    return Commit(future.results());
+}
+
+
+QStringList UpdateJob::Errors() const
+{
+    return m_Errors;
+}
+
+
+bool UpdateJob::WasCancelled() const
+{
+    return m_Cancel.IsCancelled();
+}
+
+
+int UpdateJob::ChangedCount() const
+{
+    return m_ChangedCount;
+}
+
+
+void UpdateJob::Cancel()
+{
+    m_Cancel.Cancel();
+}
+
+
+void UpdateJob::FileDone()
+{
+    emit Progress(m_DoneCount.fetchAndAddOrdered(1) + 1, m_Resources.count());
+}
+
+
+UpdateJob::Outcome UpdateJob::RunOne(UpdateJob *job, TextResource *resource, Transform transform, TaskScheduler::CancelToken cancel)
+{
+    Outcome outcome;
+    outcome.resource = resource;
+    outcome.revision = -1;
+    outcome.changed = false;
+    outcome.skipped = cancel.IsCancelled();
+
+    if (outcome.skipped || !resource) {
+        job->FileDone();
+        return outcome;
+    }
+
+    try {
+        // The transform works on a snapshot with no lock held; an edit
+        // made meanwhile moves the revision on and shows up at commit
+        TextResource::Snapshot snapshot = resource->GetSnapshot();
+        outcome.revision = snapshot.revision;
+        const QString &text = snapshot.text;
+        outcome.text = transform(resource, text);
+        outcome.changed = !outcome.text.isNull() && outcome.text != text;
+    } catch (const QString &error) {
+        outcome.error = error;
+    } catch (const std::exception &error) {
+        outcome.error = QString("%1: %2").arg(resource->Filename()).arg(QString::fromUtf8(error.what()));
+    }
+
+    job->FileDone();
+    return outcome;
+}
+
+
+bool UpdateJob::Commit(const QList<Outcome> &outcomes)
+{
+    foreach(const Outcome &outcome, outcomes) {
+        if (!outcome.error.isEmpty()) {
+            m_Errors.append(outcome.error);
+        }
+    }
+
+    if (WasCancelled()) {
+        m_Errors.append(tr("The update was cancelled. No files were changed."));
+        return false;
+    }
+
+    if (!m_Errors.isEmpty()) {
+        return false;
+    }
+
+    // Nothing is written unless nothing was edited while the job ran
+    QList<QWriteLocker *> lockers;
+    foreach(const Outcome &outcome, outcomes) {
+        if (!outcome.changed) {
+            continue;
+        }
+        lockers.append(new QWriteLocker(&outcome.resource->GetLock()));
+        if (outcome.resource->GetTextRevision() != outcome.revision) {
+            m_Errors.append(tr("%1 was changed during the update. No files were changed.").arg(outcome.resource->Filename()));
+            break;
+        }
+    }
+
+    if (m_Errors.isEmpty()) {
+        foreach(const Outcome &outcome, outcomes) {
+            if (outcome.changed) {
+                outcome.resource->SetText(outcome.text);
+                m_ChangedCount++;
+            }
+        }
+    }
+
+    qDeleteAll(lockers);
+    return m_Errors.isEmpty();
+}
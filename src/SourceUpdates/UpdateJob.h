@@ -0,0 +1,129 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef UPDATEJOB_H
+#define UPDATEJOB_H
+
+#include <functional>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+#include "Misc/TaskScheduler.h"
+
+class TextResource;
+
+/**
+ * Rewrites the text of a set of resources on the thread pool, as one
+ * transaction.
+ *
+ * The new text of every file is worked out first, without touching the
+ * resources. Only when every file succeeded, nothing was cancelled and no
+ * file was edited in the meantime are the results written back, all
+ * together and on the calling thread. Otherwise no file is changed.
+ *
+ * While the job runs the event loop keeps turning and a progress dialog
+ * with a Cancel button is shown if the job takes a while. The cancel
+ * request is checked between files.
+ */
+class UpdateJob : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /**
+     * Works out the new text of one resource. Returns a null QString if
+     * the resource should be left as it is. May throw a QString or a
+     * std::exception to fail the file, and with it the job.
+     * Called with the resource's read lock held.
+     */
+    typedef std::function<QString(TextResource *resource, const QString &text)> Transform;
+
+    UpdateJob(const QList<TextResource *> &resources, Transform transform, QObject *parent = 0);
+
+    /**
+     * Runs the job until it is done.
+     *
+     * @param label The text shown in the progress dialog.
+     * @return true if the results were written to the resources.
+     */
+    bool Run(const QString &label);
+
+    /**
+     * @return Why the results were not written; empty if they were.
+     */
+    QStringList Errors() const;
+
+    bool WasCancelled() const;
+
+    /**
+     * @return The number of resources whose text was changed.
+     */
+    int ChangedCount() const;
+
+public slots:
+
+    void Cancel();
+
+signals:
+
+    /**
+     * Emitted from the thread that finished a file, after each file.
+     */
+    void Progress(int done, int total);
+
+private:
+
+    struct Outcome {
+        TextResource *resource;
+        int revision;
+        bool changed;
+        bool skipped;
+        QString text;
+        QString error;
+    };
+
+    static Outcome RunOne(UpdateJob *job, TextResource *resource, Transform transform, TaskScheduler::CancelToken cancel);
+
+    void FileDone();
+
+    bool Commit(const QList<Outcome> &outcomes);
+
+    QList<TextResource *> m_Resources;
+
+    Transform m_Transform;
+
+    TaskScheduler::CancelToken m_Cancel;
+
+    QStringList m_Errors;
+
+    int m_ChangedCount;
+
+    QAtomicInt m_DoneCount;
+};
+
+#endif // UPDATEJOB_H
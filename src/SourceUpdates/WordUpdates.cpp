@@ -23,31 +23,52 @@
 
 #include <QtCore/QtCore>
 #include <QtCore/QString>
-#include <QtConcurrent/QtConcurrent>
 
 #include "Misc/HTMLSpellCheck.h"
 #include "ResourceObjects/HTMLResource.h"
+#include "SourceUpdates/UpdateJob.h"
 #include "SourceUpdates/WordUpdates.h"
 
-void WordUpdates::UpdateWordInAllFiles(const QList<HTMLResource *> &html_resources, const QString old_word, QString new_word)
+void WordUpdates::UpdateWordsInAllFiles(const QList<HTMLResource *> &html_resources, const QHash<QString, QString> &substitutions)
 {
-    QtConcurrent::blockingMap(html_resources, std::bind(UpdateWordsInOneFile, std::placeholders::_1, old_word, new_word));
+    if (substitutions.isEmpty()) {
+        return;
+    }
+    QList<TextResource *> text_resources;
+    foreach(HTMLResource * html_resource, html_resources) {
+        text_resources.append(html_resource);
+    }
+    UpdateJob job(text_resources, std::bind(UpdateWordsInOneFile, std::placeholders::_1, std::placeholders::_2, substitutions));
+    job.Run(QObject::tr("Updating words..."));
 }
 
-void WordUpdates::UpdateWordsInOneFile(HTMLResource *html_resource, QString old_word, QString new_word)
+QString WordUpdates::UpdateWordsInOneFile(TextResource *html_resource, const QString &text, const QHash<QString, QString> &substitutions)
 {
     Q_ASSERT(html_resource);
-    QWriteLocker locker(&html_resource->GetLock());
-    QString text = html_resource->GetText();
     QList<HTMLSpellCheck::MisspelledWord> words = HTMLSpellCheck::GetWords(text);
 
-    // Change in reverse to preserve location information
-    for (int i = words.count() - 1; i >= 0; i--) {
-        HTMLSpellCheck::MisspelledWord word = words[i];
-        if (word.text != old_word) {
+    // The words are already split on HTMLSpellCheck's boundaries, so each
+    // one is a single lookup in the table, however many entries it has.
+    // Build the result front to back from the unchanged slices.
+    QString result;
+    int last = 0;
+    bool changed = false;
+    foreach(HTMLSpellCheck::MisspelledWord word, words) {
+        QHash<QString, QString>::const_iterator it = substitutions.constFind(word.text);
+        if (it == substitutions.constEnd()) {
             continue;
         }
-        text.replace(word.offset, word.length, new_word);
+        if (!changed) {
+            result.reserve(text.length());
+            changed = true;
+        }
+        result.append(text.midRef(last, word.offset - last));
+        result.append(it.value());
+        last = word.offset + word.length;
+    }
+    if (!changed) {
+        return QString();
     }
-    html_resource->SetText(text);
+    result.append(text.midRef(last));
+    return result;
 }
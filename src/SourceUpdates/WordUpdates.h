@@ -23,17 +23,27 @@
 #ifndef WORDUPDATES_H
 #define WORDUPDATES_H
 
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
 class HTMLResource;
+class TextResource;
 
 class WordUpdates
 {
 
 public:
 
-    static void UpdateWordInAllFiles(const QList<HTMLResource *> &html_resources, const QString old_word, QString new_word);
+    /**
+     * Applies a whole table of word substitutions, keyed by the old word,
+     * in one pass over each file. Only whole words as split by
+     * HTMLSpellCheck are replaced.
+     */
+    static void UpdateWordsInAllFiles(const QList<HTMLResource *> &html_resources, const QHash<QString, QString> &substitutions);
 
 private:
-    static void UpdateWordsInOneFile(HTMLResource *html_resource, QString old_word, QString new_word);
+    static QString UpdateWordsInOneFile(TextResource *html_resource, const QString &text, const QHash<QString, QString> &substitutions);
 };
 
 #endif // WORDUPDATES_H
@@ -67,6 +67,7 @@ void AVTab::RefreshContent()
 {
     MainWindow::clearMemoryCaches();
     QString html;
+    m_Resource->LoadDeferredContent();
     const QString path = m_Resource->GetFullPath();
     const QUrl resourceUrl = QUrl::fromLocalFile(path);
     if (m_Resource->Type() == Resource::AudioResourceType) {
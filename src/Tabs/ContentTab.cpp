@@ -32,8 +32,11 @@ ContentTab::ContentTab(Resource *resource, QWidget *parent)
     :
     QWidget(parent),
     m_Resource(resource),
-    m_Layout(new QVBoxLayout(this))
+    m_Layout(new QVBoxLayout(this)),
+    m_ContentGeneration(0),
+    m_FlushedGeneration(-1)
 {
+    connect(this, SIGNAL(ContentChanged()), this, SLOT(MarkContentModified()));
     connect(resource, SIGNAL(Deleted(const Resource *)),          this, SLOT(EmitDeleteMe()));
     connect(resource, SIGNAL(Renamed(const Resource *, QString)), this, SLOT(EmitTabRenamed()));
     m_Layout->setContentsMargins(0, 0, 0, 0);
@@ -83,6 +86,19 @@ void ContentTab::SaveTabContent()
 }
 
 
+bool ContentTab::FlushTabContent()
+{
+    if (m_FlushedGeneration == m_ContentGeneration) {
+        return false;
+    }
+
+    SaveTabContent();
+    // What the save itself changes is flushed with it
+    m_FlushedGeneration = m_ContentGeneration;
+    return true;
+}
+
+
 void ContentTab::LoadTabContent()
 {
 }
@@ -118,6 +134,12 @@ void ContentTab::EmitTabRenamed()
 }
 
 
+void ContentTab::MarkContentModified()
+{
+    m_ContentGeneration++;
+}
+
+
 void ContentTab::focusInEvent(QFocusEvent *event)
 {
     QWidget::focusInEvent(event);
@@ -195,6 +195,14 @@ public:
         return 0;
     }
 
+    /**
+     * @return The estimated bytes held by the undo history of the tab's
+     *         text, or -1 if it has none to show.
+     */
+    virtual qint64 GetUndoMemory() const {
+        return -1;
+    }
+
     virtual float GetZoomFactor() const {
         return 1.0;
     }
@@ -334,6 +342,14 @@ public slots:
      */
     virtual void SaveTabContent();
 
+    /**
+     * Calls SaveTabContent() unless nothing was edited in the tab
+     * since the last time it was called from here.
+     *
+     * @return \c false if the tab was skipped.
+     */
+    bool FlushTabContent();
+
     /**
      * Loads the resource content when the user enters the tab.
      */
@@ -402,6 +418,13 @@ signals:
      */
     void UpdateCursorPosition(int line, int column);
 
+    /**
+     * Emitted when the estimated memory of the tab's undo history changes.
+     *
+     * @param bytes As GetUndoMemory() returns it.
+     */
+    void UpdateUndoMemory(qint64 bytes);
+
     /**
      * Emitted when we want to do some operations with the clipboard
      * to paste things into Book View, but restoring state afterwards
@@ -434,6 +457,12 @@ protected slots:
      */
     void EmitTabRenamed();
 
+    /**
+     * Moves the edit generation on. Connected to ContentChanged(), and
+     * by tabs to whatever else edits their content.
+     */
+    void MarkContentModified();
+
 protected:
 
     /**
@@ -468,6 +497,15 @@ protected:
      * The main layout of the widget.
      */
     QLayout *m_Layout;
+
+private:
+
+    /**
+     * Counts the edits made in the tab. FlushTabContent() skips the tab
+     * while it is the same as when the tab was last flushed.
+     */
+    int m_ContentGeneration;
+    int m_FlushedGeneration;
 };
 
 #endif // CONTENTTAB_H
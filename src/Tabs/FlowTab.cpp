@@ -28,6 +28,7 @@
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QAction>
 #include <QtWidgets/QDialog>
+#include <QtWidgets/QLabel>
 #include <QtWidgets/QLayout>
 #include <QtPrintSupport/QPrinter>
 #include <QtPrintSupport/QPrintDialog>
@@ -64,6 +65,8 @@ FlowTab::FlowTab(HTMLResource *resource,
     m_CaretLocationToScrollTo(caret_location_to_scroll_to),
     m_HTMLResource(resource),
     m_views(new QStackedWidget(this)),
+    m_LargeFileNotice(new QLabel(this)),
+    m_LoadingNotice(new QLabel(this)),
     m_wBookView(NULL),
     m_wCodeView(NULL),
     m_ViewState(view_state),
@@ -72,14 +75,17 @@ FlowTab::FlowTab(HTMLResource *resource,
     m_safeToLoad(false),
     m_initialLoad(true),
     m_bookViewNeedsReload(false),
+    m_bookViewRevision(-1),
     m_grabFocus(grab_focus),
     m_suspendTabReloading(false),
     m_defaultCaretLocationToTop(false),
-    m_LastPosition(-1)
+    m_LastPosition(-1),
+    m_hibernated(false)
 {
     // Loading a flow tab can take a while. We set the wait
     // cursor and clear it at the end of the delayed initialization.
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    m_HTMLResource->RetainTextDocument();
 
     if (view_state == MainWindow::ViewState_BookView) {
         CreateBookViewIfRequired(false);
@@ -87,6 +93,15 @@ FlowTab::FlowTab(HTMLResource *resource,
         CreateCodeViewIfRequired(false);
     }
 
+    m_LargeFileNotice->setText(tr("This file is open in large file mode: spell checking, current line "
+                                  "highlighting, caret syncing and immediate Preview updates are turned off."));
+    m_LargeFileNotice->setWordWrap(true);
+    m_LargeFileNotice->setMargin(4);
+    m_LargeFileNotice->hide();
+    m_Layout->addWidget(m_LargeFileNotice);
+    m_LoadingNotice->setText(tr("Loading..."));
+    m_LoadingNotice->setAlignment(Qt::AlignCenter);
+    m_views->addWidget(m_LoadingNotice);
     m_Layout->addWidget(m_views);
     LoadSettings();
 
@@ -103,7 +118,7 @@ FlowTab::FlowTab(HTMLResource *resource,
 
     // We perform delayed initialization after the widget is on
     // the screen. This way, the user perceives less load time.
-    QTimer::singleShot(0, this, SLOT(DelayedInitialization()));
+    QTimer::singleShot(0, this, SLOT(PrepareInitialization()));
 }
 
 FlowTab::~FlowTab()
@@ -136,6 +151,7 @@ FlowTab::~FlowTab()
         m_views = 0;
     }
 
+    m_HTMLResource->ReleaseTextDocument();
     m_HTMLResource = NULL;
 
 }
@@ -150,6 +166,7 @@ void FlowTab::CreateBookViewIfRequired(bool is_delayed_load)
     m_wBookView = new BookViewEditor(this);
     m_views->addWidget(m_wBookView);
     m_bookViewNeedsReload = true;
+    m_bookViewRevision = -1;
 
     if (is_delayed_load) {
         ConnectBookViewSignalsToSlots();
@@ -183,6 +200,28 @@ void FlowTab::CreateCodeViewIfRequired(bool is_delayed_load)
     QApplication::restoreOverrideCursor();
 }
 
+void FlowTab::PrepareInitialization()
+{
+    // Book View reads the text without the document
+    if (m_wCodeView && !m_HTMLResource->PrepareTextDocument()) {
+        m_views->setCurrentWidget(m_LoadingNotice);
+        connect(m_HTMLResource, SIGNAL(TextDocumentReady()), this, SLOT(TextDocumentReady()));
+        // The GUI is free to use in the meantime
+        QApplication::restoreOverrideCursor();
+        return;
+    }
+
+    DelayedInitialization();
+}
+
+void FlowTab::TextDocumentReady()
+{
+    disconnect(m_HTMLResource, SIGNAL(TextDocumentReady()), this, SLOT(TextDocumentReady()));
+    // Cleared at the end of the delayed initialization
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    DelayedInitialization();
+}
+
 void FlowTab::DelayedInitialization()
 {
     if (m_wBookView) {
@@ -340,6 +379,7 @@ void FlowTab::BookView()
     }
 
     m_wBookView->ExecuteCaretUpdate();
+    UpdateLargeFileNotice();
     QApplication::restoreOverrideCursor();
 }
 
@@ -365,7 +405,7 @@ void FlowTab::CodeView()
     }
 
     m_wCodeView->ExecuteCaretUpdate();
-    
+    UpdateLargeFileNotice();
     QApplication::restoreOverrideCursor();
 }
 
@@ -375,9 +415,20 @@ void FlowTab::LoadTabContent()
     //        The only exception is initial load when control is created, done elsewhere.
     // In BV, we will only allow loading if the document is well formed, since loading the
     //        resource into BV and then saving will alter badly formed sections of text.
-    if (m_ViewState == MainWindow::ViewState_BookView) {
+    if (m_ViewState == MainWindow::ViewState_BookView && m_wBookView) {
         if (m_safeToLoad && m_bookViewNeedsReload) {
-            m_wBookView->CustomSetDocument(m_HTMLResource->GetFullPath(), m_HTMLResource->GetText());
+            // Nothing to do if the page already shows this text, as after
+            // saving it from BV. Otherwise only the parts of the body that
+            // changed are replaced where the page allows it.
+            int revision = m_HTMLResource->GetTextRevision();
+            if (revision != m_bookViewRevision) {
+                QString path = m_HTMLResource->GetFullPath();
+                QString text = m_HTMLResource->GetText();
+                if (m_bookViewRevision == -1 || !m_wBookView->PatchDocument(path, text)) {
+                    m_wBookView->CustomSetDocument(path, text);
+                }
+                m_bookViewRevision = revision;
+            }
             m_bookViewNeedsReload = false;
         }
     }
@@ -390,15 +441,27 @@ void FlowTab::SaveTabContent()
     //        means the resource already is "saved". We just need to reset modified state.
     // In BV, we only need to save the BV HTML into the resource if user has modified it,
     //        which will trigger ResourceModified() to set flag to say PV needs reloading.
+    // A hibernated tab saved everything before freeing its editors.
+    if (m_hibernated) {
+        return;
+    }
+
     if (m_ViewState == MainWindow::ViewState_BookView && m_wBookView && m_wBookView->IsModified()) {
-        SettingsStore ss;
-        QString html = m_wBookView->GetHtml();
-        if (ss.cleanOn() & CLEANON_OPEN) {
-            QString version = m_HTMLResource->GetEpubVersion();
-            html = CleanSource::Mend(html, version);
+        // Where only some blocks changed, they are spliced into the text
+        // as it was and the rest of it is left alone.
+        QString html;
+        if (!m_wBookView->GetChangedHtml(html)) {
+            SettingsStore ss;
+            html = m_wBookView->GetHtml();
+            if (ss.cleanOn() & CLEANON_OPEN) {
+                QString version = m_HTMLResource->GetEpubVersion();
+                html = CleanSource::Mend(html, version);
+            }
         }
         m_HTMLResource->SetText(html);
+        m_wBookView->SetSavedHtml(html);
         m_wBookView->ResetModified();
+        m_bookViewRevision = m_HTMLResource->GetTextRevision();
         m_safeToLoad = true;
     }
 
@@ -432,6 +495,8 @@ void FlowTab::ResourceModified()
 void FlowTab::LinkedResourceModified()
 {
     MainWindow::clearMemoryCaches();
+    // Stylesheets only take effect on a load
+    m_bookViewRevision = -1;
     ResourceModified();
     ReloadTabIfPending();
 }
@@ -456,7 +521,7 @@ void FlowTab::ResourceTextChanging()
 
 void FlowTab::ReloadTabIfPending()
 {
-    if (!isVisible()) {
+    if (!isVisible() || m_hibernated) {
         return;
     }
 
@@ -511,14 +576,35 @@ void FlowTab::EmitUpdatePreview()
 
 void FlowTab::EmitUpdatePreviewImmediately()
 {
+    // A large file waits for the Preview timer like any other change
+    if (IsLargeFileMode()) {
+        emit UpdatePreview();
+        return;
+    }
+
     emit UpdatePreviewImmediately();
 }
 
 void FlowTab::EmitScrollPreviewImmediately()
 {
+    // There is no caret location to scroll to in large file mode
+    if (IsLargeFileMode()) {
+        return;
+    }
+
     emit ScrollPreviewImmediately();
 }
 
+bool FlowTab::IsLargeFileMode() const
+{
+    return m_ViewState == MainWindow::ViewState_CodeView && m_wCodeView && m_wCodeView->IsLargeFileMode();
+}
+
+void FlowTab::UpdateLargeFileNotice()
+{
+    m_LargeFileNotice->setVisible(IsLargeFileMode());
+}
+
 void FlowTab::EmitUpdateCursorPosition()
 {
     emit UpdateCursorPosition(GetCursorLine(), GetCursorColumn());
@@ -770,6 +856,15 @@ int FlowTab::GetCursorColumn() const
     return -1;
 }
 
+qint64 FlowTab::GetUndoMemory() const
+{
+    if (m_ViewState == MainWindow::ViewState_CodeView) {
+        return m_wCodeView->GetUndoMemory();
+    }
+
+    return -1;
+}
+
 float FlowTab::GetZoomFactor() const
 {
     if (m_ViewState == MainWindow::ViewState_BookView) {
@@ -913,7 +1008,7 @@ void FlowTab::Undo()
     if (m_ViewState == MainWindow::ViewState_BookView) {
         m_wBookView->Undo();
     } else if (m_ViewState == MainWindow::ViewState_CodeView) {
-        m_wCodeView->undo();
+        m_wCodeView->Undo();
     }
 }
 
@@ -1580,6 +1675,82 @@ void FlowTab::ResumeTabReloading()
     }
 }
 
+void FlowTab::Hibernate()
+{
+    if (m_hibernated || m_initialLoad || !IsLoadingFinished()) {
+        return;
+    }
+
+    SaveTabContent();
+
+    // Come back to the same place the way a newly opened tab would
+    m_LineToScrollTo = -1;
+    m_PositionToScrollTo = -1;
+    m_CaretLocationToScrollTo = QString();
+    if (m_ViewState == MainWindow::ViewState_CodeView) {
+        m_PositionToScrollTo = m_wCodeView->GetCursorPosition();
+        m_LineToScrollTo = 1;
+    } else if (m_ViewState == MainWindow::ViewState_BookView) {
+        m_CaretLocationToScrollTo = m_wBookView->GetCaretLocationUpdate();
+    }
+
+    // Resource changes are picked up when the editors are recreated
+    disconnect(m_HTMLResource, SIGNAL(TextChanging()), this, SLOT(ResourceTextChanging()));
+    disconnect(m_HTMLResource, SIGNAL(LinkedResourceUpdated()), this, SLOT(LinkedResourceModified()));
+    disconnect(m_HTMLResource, SIGNAL(Modified()), this, SLOT(ResourceModified()));
+    disconnect(m_HTMLResource, SIGNAL(LoadedFromDisk()), this, SLOT(ReloadTabIfPending()));
+
+    setFocusProxy(NULL);
+
+    if (m_wBookView) {
+        delete m_wBookView;
+        m_wBookView = NULL;
+    }
+
+    if (m_wCodeView) {
+        delete m_wCodeView;
+        m_wCodeView = NULL;
+    }
+
+    m_previousViewState = m_ViewState;
+    m_bookViewNeedsReload = false;
+    m_bookViewRevision = -1;
+    m_safeToLoad = false;
+    m_initialLoad = true;
+    m_hibernated = true;
+}
+
+void FlowTab::WakeUp()
+{
+    if (!m_hibernated) {
+        return;
+    }
+
+    m_hibernated = false;
+
+    // Cleared at the end of the delayed initialization
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    if (m_ViewState == MainWindow::ViewState_BookView) {
+        CreateBookViewIfRequired(false);
+        setFocusProxy(m_wBookView);
+        ConnectBookViewSignalsToSlots();
+    } else {
+        CreateCodeViewIfRequired(false);
+        setFocusProxy(m_wCodeView);
+        ConnectCodeViewSignalsToSlots();
+    }
+
+    // Done now rather than on a timer so the tab is usable
+    // by whoever asked for it to be shown
+    DelayedInitialization();
+}
+
+bool FlowTab::IsHibernated() const
+{
+    return m_hibernated;
+}
+
 void FlowTab::DelayedConnectSignalsToSlots()
 {
     connect(m_HTMLResource, SIGNAL(TextChanging()), this, SLOT(ResourceTextChanging()));
@@ -1613,6 +1784,7 @@ void FlowTab::ConnectBookViewSignalsToSlots()
 void FlowTab::ConnectCodeViewSignalsToSlots()
 {
     connect(m_wCodeView, SIGNAL(cursorPositionChanged()), this, SLOT(EmitUpdateCursorPosition()));
+    connect(m_wCodeView, SIGNAL(UndoMemoryChanged(qint64)), this, SIGNAL(UpdateUndoMemory(qint64)));
     connect(m_wCodeView, SIGNAL(ZoomFactorChanged(float)), this, SIGNAL(ZoomFactorChanged(float)));
     connect(m_wCodeView, SIGNAL(selectionChanged()), this, SIGNAL(SelectionChanged()));
     connect(m_wCodeView, SIGNAL(FocusLost(QWidget *)), this, SLOT(LeaveEditor(QWidget *)));
@@ -1625,6 +1797,8 @@ void FlowTab::ConnectCodeViewSignalsToSlots()
     connect(m_wCodeView, SIGNAL(SpellingHighlightRefreshRequest()), this, SIGNAL(SpellingHighlightRefreshRequest()));
     connect(m_wCodeView, SIGNAL(ShowStatusMessageRequest(const QString &)), this, SIGNAL(ShowStatusMessageRequest(const QString &)));
     connect(m_wCodeView, SIGNAL(FilteredTextChanged()), this, SLOT(EmitContentChanged()));
+    // Undoing back to where the document was loaded is not filtered through
+    connect(m_wCodeView, SIGNAL(textChanged()), this, SLOT(MarkContentModified()));
     //  This is needed to capture scroll from arrow keys and the like                        
     connect(m_wCodeView, SIGNAL(FilteredCursorMoved()), this, SLOT(EmitScrollPreviewImmediately()));
     connect(m_wCodeView, SIGNAL(PageUpdated()), this, SLOT(EmitUpdatePreview()));
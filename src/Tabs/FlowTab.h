@@ -35,6 +35,7 @@
 #include "Tabs/ContentTab.h"
 #include "Tabs/WellFormedContent.h"
 
+class QLabel;
 class QStackedWidget;
 class QUrl;
 class BookViewEditor;
@@ -117,6 +118,8 @@ public:
     int GetCursorLine() const;
     int GetCursorColumn() const;
 
+    qint64 GetUndoMemory() const;
+
     float GetZoomFactor() const;
 
     void SetZoomFactor(float new_zoom_factor);
@@ -179,6 +182,15 @@ public:
     void SuspendTabReloading();
     void ResumeTabReloading();
 
+    /**
+     * Frees the editors of a tab that is not shown, keeping only where
+     * its caret was. WakeUp() recreates them the way the tab was first
+     * loaded. Nothing is done while the tab is still loading.
+     */
+    void Hibernate();
+    void WakeUp();
+    bool IsHibernated() const;
+
 public slots:
 
     bool IsDataWellFormed();
@@ -318,6 +330,15 @@ private slots:
      */
     void DelayedInitialization();
 
+    /**
+     * Runs the delayed initialization once the document of a large
+     * file opening in Code View has been built off the GUI thread,
+     * showing a notice in place of the view until then.
+     */
+    void PrepareInitialization();
+
+    void TextDocumentReady();
+
     /**
      * Any slots to do with changing of the underlying resource/content should
      * only be connected after the resource has loaded. Otherwise we do a
@@ -366,6 +387,16 @@ private:
     void ConnectBookViewSignalsToSlots();
     void ConnectCodeViewSignalsToSlots();
 
+    /**
+     * @return \c true if Code View has the file open in its large file mode.
+     */
+    bool IsLargeFileMode() const;
+
+    /**
+     * Shows the large file notice while in Code View in that mode.
+     */
+    void UpdateLargeFileNotice();
+
 
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
@@ -395,6 +426,17 @@ private:
      */
     QStackedWidget *m_views;
 
+    /**
+     * Tells the user the file is open in Code View's large file mode,
+     * and what that turns off. Hidden otherwise.
+     */
+    QLabel *m_LargeFileNotice;
+
+    /**
+     * Stands in for Code View while the document is being built.
+     */
+    QLabel *m_LoadingNotice;
+
     /**
      * The Book View Editor.
      * Displays and edits the rendered state of the HTML.
@@ -435,6 +477,12 @@ private:
 
     bool m_bookViewNeedsReload;
 
+    /**
+     * The text revision of the resource the Book View page shows,
+     * or -1 if the page has to be loaded in full.
+     */
+    int m_bookViewRevision;
+
     bool m_grabFocus;
 
     bool m_suspendTabReloading;
@@ -442,6 +490,8 @@ private:
     bool m_defaultCaretLocationToTop;
 
     int m_LastPosition;
+
+    bool m_hibernated;
 };
 
 #endif // FLOWTAB_H
@@ -27,7 +27,10 @@
 #include <QtCore/QSignalMapper>
 #include <QtCore/QString>
 #include <QtCore/QUrl>
+#include <QtCore/QtMath>
 #include <QtGui/QClipboard>
+#include <QtGui/QImageReader>
+#include <QtGui/QPixelFormat>
 #include <QtWidgets/QLayout>
 #include <QtWidgets/QMenu>
 #include <QtWebKitWidgets/QWebView>
@@ -39,6 +42,7 @@
 #include "MainUI/MainWindow.h"
 #include "Misc/OpenExternally.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/ThumbnailService.h"
 #include "ResourceObjects/ImageResource.h"
 #include "Tabs/ImageTab.h"
 
@@ -58,13 +62,49 @@ const QString IMAGE_HTML_BASE =
     "</body>"
     "</html>";
 
+// The same, for a scaled down rendition shown at width %7 and height %8
+const QString IMAGE_RENDITION_HTML_BASE =
+    "<html>"
+    "<head>"
+    "<style type=\"text/css\">"
+    "body { -webkit-user-select: none; }"
+    "img { display: block; margin-left: auto; margin-right: auto; border-style: solid; border-width: 1px; }"
+    "hr { width: 75%; }"
+    "div { text-align: center; }"
+    "</style>"
+    "<body>"
+    "<p><img src=\"%1\" width=\"%7\" height=\"%8\" /></p>"
+    "<hr />"
+    "<div>%2&times;%3px | %4 KB | %5%6</div>"
+    "</body>"
+    "</html>";
+
+// Images with more pixels than this are shown as a rendition
+// the size of the view rather than decoded in full
+static const qint64 LARGE_IMAGE_PIXELS = 4096 * 4096;
+
+// Shown first, while the rendition for the view is made
+static const int FIRST_RENDITION_SIDE = 256;
+
+// Renditions are made in steps of this, so a resize does not
+// always need a new one
+static const int RENDITION_SIDE_STEP = 512;
+
+// Room around the image for the margins and the details line
+static const int RENDITION_MARGIN_WIDTH = 40;
+static const int RENDITION_MARGIN_HEIGHT = 80;
+
 ImageTab::ImageTab(ImageResource *resource, QWidget *parent)
     :
     ContentTab(resource, parent),
     m_WebView(new QWebView(this)),
     m_ContextMenu(new QMenu(this)),
     m_OpenWithContextMenu(new QMenu(this)),
-    m_openWithMapper(new QSignalMapper(this))
+    m_openWithMapper(new QSignalMapper(this)),
+    m_ImageFormat(QImage::Format_Invalid),
+    m_RequestedSide(0),
+    m_ShownSide(0),
+    m_IsReleased(false)
 {
     m_WebView->setContextMenuPolicy(Qt::CustomContextMenu);
     m_WebView->setFocusPolicy(Qt::NoFocus);
@@ -168,10 +208,30 @@ void ImageTab::UpdateDisplay()
 void ImageTab::RefreshContent()
 {
     MainWindow::clearMemoryCaches();
+    m_Resource->LoadDeferredContent();
     const QString path = m_Resource->GetFullPath();
     const QFileInfo fileInfo = QFileInfo(path);
     const double ffsize = fileInfo.size() / 1024.0;
     const QString fsize = QLocale().toString(ffsize, 'f', 2);
+    // Read from the header only
+    QImageReader reader(path);
+    const QSize image_size = reader.size();
+    m_IsReleased = false;
+
+    if (image_size.isValid() && qint64(image_size.width()) * image_size.height() > LARGE_IMAGE_PIXELS) {
+        m_RenditionPath = path;
+        m_ImageSize = image_size;
+        m_ImageFormat = reader.imageFormat();
+        m_FileSize = fsize;
+        m_RequestedSide = 0;
+        m_ShownSide = 0;
+        m_WebView->setHtml("", QUrl());
+        RequestRendition(FIRST_RENDITION_SIDE);
+        UpdateRendition();
+        return;
+    }
+
+    m_RenditionPath.clear();
     const QImage img(path);
     const QUrl imgUrl = QUrl::fromLocalFile(path);
     QString colors_shades = img.isGrayscale() ? tr("shades") : tr("colors");
@@ -189,6 +249,111 @@ void ImageTab::RefreshContent()
     m_WebView->setHtml(html, imgUrl);
 }
 
+void ImageTab::UpdateRendition()
+{
+    if (m_RenditionPath.isEmpty() || m_IsReleased) {
+        return;
+    }
+
+    int side = RenditionSide();
+
+    if (side > m_RequestedSide) {
+        m_RequestedSide = side;
+        RequestRendition(side);
+    }
+}
+
+void ImageTab::RequestRendition(int side)
+{
+    QImage rendition;
+
+    if (ThumbnailService::instance()->Request(m_RenditionPath, side, rendition)) {
+        RenditionReady(m_RenditionPath, side, rendition);
+    }
+}
+
+void ImageTab::RenditionReady(const QString &path, int side, const QImage &rendition)
+{
+    // Only ever replaced by a sharper one
+    if (path != m_RenditionPath || m_IsReleased || rendition.isNull() || side <= m_ShownSide ||
+        (side != FIRST_RENDITION_SIDE && side != m_RequestedSide)) {
+        return;
+    }
+
+    // Shown from the disk cache, so the view never holds the original
+    const QString rendition_path = ThumbnailService::instance()->DiskCacheFile(path, side);
+
+    if (rendition_path.isEmpty()) {
+        return;
+    }
+
+    m_ShownSide = side;
+    QString colors_shades = rendition.allGray() ? tr("shades") : tr("colors");
+    QString grayscale_color = rendition.allGray() ? tr("Grayscale") : tr("Color");
+    QString colorsInfo = "";
+
+    if (m_ImageFormat != QImage::Format_Invalid) {
+        const QPixelFormat pixel_format = QImage::toPixelFormat(m_ImageFormat);
+
+        if (pixel_format.bitsPerPixel() == 32) {
+            colorsInfo = QString(" %1bpp").arg(pixel_format.alphaUsage() == QPixelFormat::UsesAlpha ? 32 : 24);
+        } else if (pixel_format.bitsPerPixel() > 0) {
+            colorsInfo = QString(" %1bpp (%2)").arg(pixel_format.bitsPerPixel()).arg(colors_shades);
+        }
+    }
+
+    // Every rendition is shown at the size of the last one asked for
+    const QSize display_size = m_ImageSize.scaled(DisplaySize(), Qt::KeepAspectRatio).boundedTo(m_ImageSize);
+    const QUrl renditionUrl = QUrl::fromLocalFile(rendition_path);
+    const QString html = IMAGE_RENDITION_HTML_BASE.arg(renditionUrl.toString()).arg(m_ImageSize.width())
+                         .arg(m_ImageSize.height()).arg(m_FileSize).arg(grayscale_color).arg(colorsInfo)
+                         .arg(display_size.width()).arg(display_size.height());
+    m_WebView->setHtml(html, renditionUrl);
+}
+
+QSize ImageTab::DisplaySize() const
+{
+    return QSize(qMax(m_WebView->width() - RENDITION_MARGIN_WIDTH, FIRST_RENDITION_SIDE),
+                 qMax(m_WebView->height() - RENDITION_MARGIN_HEIGHT, FIRST_RENDITION_SIDE));
+}
+
+int ImageTab::RenditionSide() const
+{
+    const QSize display_size = DisplaySize();
+    const double scale = m_CurrentZoomFactor * devicePixelRatio();
+    int side = qCeil(qMax(display_size.width(), display_size.height()) * scale);
+    side = (side + RENDITION_SIDE_STEP - 1) / RENDITION_SIDE_STEP * RENDITION_SIDE_STEP;
+    return qMin(side, qMax(m_ImageSize.width(), m_ImageSize.height()));
+}
+
+void ImageTab::showEvent(QShowEvent *event)
+{
+    ContentTab::showEvent(event);
+
+    if (m_IsReleased) {
+        RefreshContent();
+    }
+}
+
+void ImageTab::hideEvent(QHideEvent *event)
+{
+    ContentTab::hideEvent(event);
+
+    // The rendition is read back from the disk cache when shown again
+    if (!m_RenditionPath.isEmpty()) {
+        m_WebView->setHtml("", QUrl());
+        m_ShownSide = 0;
+        m_RequestedSide = 0;
+        m_IsReleased = true;
+    }
+}
+
+void ImageTab::resizeEvent(QResizeEvent *event)
+{
+    ContentTab::resizeEvent(event);
+    UpdateRendition();
+}
+
 void ImageTab::saveAs()
 {
     const QVariant &data = m_SaveAs->data();
@@ -201,6 +366,7 @@ void ImageTab::saveAs()
 
 void ImageTab::copyImage()
 {
+    m_Resource->LoadDeferredContent();
     const QImage img(m_Resource->GetFullPath());
     QApplication::clipboard()->setImage(img);
 }
@@ -378,11 +544,14 @@ void ImageTab::ConnectSignalsToSlots()
     connect(m_openWithMapper, SIGNAL(mapped(int)), this, SLOT(openWithEditor(int)));
     connect(m_SaveAs,         SIGNAL(triggered()),   this, SLOT(saveAs()));
     connect(m_CopyImage,      SIGNAL(triggered()),   this, SLOT(copyImage()));
+    connect(ThumbnailService::instance(), SIGNAL(ThumbnailReady(const QString &, int, const QImage &)),
+            this,                         SLOT(RenditionReady(const QString &, int, const QImage &)));
 }
 
 void ImageTab::Zoom()
 {
     m_WebView->setZoomFactor(m_CurrentZoomFactor);
+    UpdateRendition();
 }
 
 void ImageTab::PrintPreview()
@@ -23,7 +23,9 @@
 #ifndef IMAGETAB_H
 #define IMAGETAB_H
 
+#include <QtCore/QSize>
 #include <QtCore/QUrl>
+#include <QtGui/QImage>
 
 #include "Tabs/ContentTab.h"
 
@@ -69,6 +71,17 @@ private slots:
      */
     void OpenContextMenu(const QPoint &point);
 
+    /**
+     * Shows a rendition of a large image once it has been made,
+     * if it is sharper than the one shown.
+     */
+    void RenditionReady(const QString &path, int side, const QImage &rendition);
+
+protected:
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+    void resizeEvent(QResizeEvent *event);
+
 private:
 
     /**
@@ -89,6 +102,23 @@ private:
 
     void Zoom();
 
+    /**
+     * Asks for a rendition of a large image sharp enough
+     * for the view at its size and zoom, if not asked for yet.
+     */
+    void UpdateRendition();
+    void RequestRendition(int side);
+
+    /**
+     * @return The size a large image is shown at, in CSS pixels.
+     */
+    QSize DisplaySize() const;
+
+    /**
+     * @return The longest side of the rendition the view needs.
+     */
+    int RenditionSide() const;
+
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
     ///////////////////////////////
@@ -110,6 +140,23 @@ private:
     QAction *m_CopyImage;
 
     float m_CurrentZoomFactor;
+
+    /**
+     * The path of the large image shown as a rendition, empty when
+     * the image is shown as it is.
+     */
+    QString m_RenditionPath;
+    QSize m_ImageSize;
+    QImage::Format m_ImageFormat;
+    QString m_FileSize;
+
+    int m_RequestedSide;
+    int m_ShownSide;
+
+    /**
+     * Set while the tab is hidden and the rendition let go.
+     */
+    bool m_IsReleased;
 };
 
 #endif // IMAGETAB_H
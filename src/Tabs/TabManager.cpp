@@ -20,7 +20,16 @@
 **
 *************************************************************************/
 
+#include <algorithm>
+#include <functional>
+
+#include <QtCore/QTimer>
+#include <QtConcurrent/QtConcurrent>
+
 #include "BookManipulation/CleanSource.h"
+#include "BookManipulation/XhtmlDoc.h"
+#include "Misc/SettingsStore.h"
+#include "Misc/Utility.h"
 #include "ResourceObjects/Resource.h"
 #include "ResourceObjects/CSSResource.h"
 #include "ResourceObjects/OPFResource.h"
@@ -41,9 +50,18 @@
 #include "Tabs/WellFormedContent.h"
 #include "Tabs/TabBar.h"
 
+// How often idle tabs are looked for
+static const int HIBERNATE_CHECK_INTERVAL_MS = 60 * 1000;
+
+// How long a tab must go unused before memory use alone hibernates it
+static const qint64 HIBERNATE_PRESSURE_IDLE_MS = 60 * 1000;
+
 TabManager::TabManager(QWidget *parent)
     :
-    QTabWidget(parent)
+    QTabWidget(parent),
+    m_HibernateTimer(new QTimer(this)),
+    m_TabFlushes(0),
+    m_TabFlushesSkipped(0)
 {
     QTabBar *tab_bar = new TabBar(this);
     setTabBar(tab_bar);
@@ -66,6 +84,10 @@ TabManager::TabManager(QWidget *parent)
     setTabsClosable(true);
     // setElideMode(Qt::ElideRight); this is the default after qt-5.6
     setUsesScrollButtons(true);
+
+    m_Clock.start();
+    connect(m_HibernateTimer, SIGNAL(timeout()), this, SLOT(HibernateIdleTabs()));
+    m_HibernateTimer->start(HIBERNATE_CHECK_INTERVAL_MS);
 }
 
 
@@ -102,6 +124,10 @@ QList<Resource *> TabManager::GetTabResources()
 
 void TabManager::tabInserted(int index)
 {
+    ContentTab *tab = qobject_cast<ContentTab *>(widget(index));
+    if (tab) {
+        m_LastUsed.insert(tab, m_Clock.elapsed());
+    }
     emit TabCountChanged();
 }
 
@@ -126,20 +152,66 @@ void TabManager::CloseTabForResource(const Resource *resource)
     }
 }
 
+static bool IsSnapshotWellFormed(const std::pair<QString, QString> &text_and_version)
+{
+    return XhtmlDoc::IsDataWellFormed(text_and_version.first, text_and_version.second);
+}
+
 bool TabManager::IsAllTabDataWellFormed()
 {
-    QList<Resource *> resources = GetTabResources();
-    foreach(Resource *resource, resources) {
-        int index = ResourceTabIndex(resource);
-        WellFormedContent *content = dynamic_cast<WellFormedContent *>(widget(index));
+    // Tabs whose text changed since it was last found well-formed are
+    // checked in parallel on snapshots of their text. Only a tab that
+    // fails is checked again by the tab itself, to tell the user.
+    QList<int> to_check;
+    QList<std::pair<QString, QString> > snapshots;
+    QList<int> to_ask;
+    for (int i = 0; i < count(); ++i) {
+        ContentTab *tab = qobject_cast<ContentTab *>(widget(i));
+        WellFormedContent *content = dynamic_cast<WellFormedContent *>(widget(i));
 
         // Only check Xhtml for now.
-        if (content && resource->Type() == Resource::HTMLResourceType) {
-            if (!content->IsDataWellFormed()) {
-                return false;
-            }
+        if (!tab || !content || tab->GetLoadedResource()->Type() != Resource::HTMLResourceType) {
+            continue;
+        }
+
+        // Book View keeps the XHTML well formed, nothing to parse
+        FlowTab *flow_tab = qobject_cast<FlowTab *>(tab);
+        if (flow_tab && flow_tab->GetViewState() == MainWindow::ViewState_BookView) {
+            to_ask.append(i);
+            continue;
+        }
+
+        HTMLResource *html_resource = qobject_cast<HTMLResource *>(tab->GetLoadedResource());
+        if (m_WellFormedRevisions.value(html_resource->GetIdentifier(), -1) == html_resource->GetTextRevision()) {
+            continue;
+        }
+
+        to_check.append(i);
+        snapshots.append(std::make_pair(html_resource->GetText(), html_resource->GetEpubVersion()));
+    }
+
+    QList<bool> results = QtConcurrent::blockingMapped<QList<bool> >(snapshots, IsSnapshotWellFormed);
+
+    for (int i = 0; i < to_check.count(); ++i) {
+        ContentTab *tab = qobject_cast<ContentTab *>(widget(to_check.at(i)));
+        if (results.at(i)) {
+            Resource *resource = tab->GetLoadedResource();
+            m_WellFormedRevisions.insert(resource->GetIdentifier(),
+                                         qobject_cast<HTMLResource *>(resource)->GetTextRevision());
+        } else {
+            to_ask.append(to_check.at(i));
+        }
+    }
+
+    // Report the first failing tab, as the tabs would one by one
+    std::sort(to_ask.begin(), to_ask.end());
+    foreach(int index, to_ask) {
+        WellFormedContent *content = dynamic_cast<WellFormedContent *>(widget(index));
+        if (!content->IsDataWellFormed()) {
+            return false;
         }
     }
+
     return true;
 }
 
@@ -178,11 +250,27 @@ void TabManager::SaveTabData()
         ContentTab *tab = qobject_cast<ContentTab *>(widget(i));
 
         if (tab) {
-            tab->SaveTabContent();
+            m_TabFlushes++;
+
+            if (!tab->FlushTabContent()) {
+                m_TabFlushesSkipped++;
+            }
         }
     }
 }
 
+
+int TabManager::GetTabFlushCount() const
+{
+    return m_TabFlushes;
+}
+
+
+int TabManager::GetSkippedTabFlushCount() const
+{
+    return m_TabFlushesSkipped;
+}
+
 void TabManager::LinkClicked(const QUrl &url)
 {
     if (url.toString().isEmpty()) {
@@ -318,6 +406,18 @@ void TabManager::EmitTabChanged()
 {
     ContentTab *current_tab = qobject_cast<ContentTab *>(currentWidget());
 
+    if (m_LastContentTab) {
+        m_LastUsed.insert(m_LastContentTab.data(), m_Clock.elapsed());
+    }
+
+    if (current_tab) {
+        m_LastUsed.insert(current_tab, m_Clock.elapsed());
+        FlowTab *flow_tab = qobject_cast<FlowTab *>(current_tab);
+        if (flow_tab) {
+            flow_tab->WakeUp();
+        }
+    }
+
     if (m_LastContentTab.data() != current_tab) {
         emit TabChanged(m_LastContentTab.data(), current_tab);
         m_LastContentTab = QPointer<ContentTab>(current_tab);
@@ -328,6 +428,7 @@ void TabManager::EmitTabChanged()
 void TabManager::DeleteTab(ContentTab *tab_to_delete)
 {
     Q_ASSERT(tab_to_delete);
+    m_LastUsed.remove(tab_to_delete);
     removeTab(indexOf(tab_to_delete));
     tab_to_delete->deleteLater();
 }
@@ -364,6 +465,57 @@ void TabManager::SetFocusInTab()
 }
 
 
+void TabManager::HibernateIdleTabs()
+{
+    SettingsStore settings;
+    qint64 idle_limit = qint64(settings.tabHibernateMinutes()) * 60 * 1000;
+    qint64 budget = qint64(settings.tabHibernateBudget()) * 1024 * 1024;
+    bool under_pressure = false;
+
+    if (budget > 0) {
+        qint64 resident = Utility::ProcessResidentBytes();
+        under_pressure = resident >= budget;
+    }
+
+    if (idle_limit <= 0 && !under_pressure) {
+        return;
+    }
+
+    qint64 now = m_Clock.elapsed();
+    for (int i = 0; i < count(); ++i) {
+        if (i == currentIndex()) {
+            continue;
+        }
+
+        FlowTab *flow_tab = qobject_cast<FlowTab *>(widget(i));
+        if (!flow_tab || flow_tab->IsHibernated()) {
+            continue;
+        }
+
+        qint64 idle = now - m_LastUsed.value(flow_tab, now);
+        if ((idle_limit > 0 && idle >= idle_limit) ||
+            (under_pressure && idle >= HIBERNATE_PRESSURE_IDLE_MS)) {
+            flow_tab->Hibernate();
+        }
+    }
+}
+
+
+void TabManager::HibernateInactiveTabs()
+{
+    for (int i = 0; i < count(); ++i) {
+        if (i == currentIndex()) {
+            continue;
+        }
+
+        FlowTab *flow_tab = qobject_cast<FlowTab *>(widget(i));
+        if (flow_tab && !flow_tab->IsHibernated()) {
+            flow_tab->Hibernate();
+        }
+    }
+}
+
+
 WellFormedContent *TabManager::GetWellFormedContent(int index)
 {
     return dynamic_cast<WellFormedContent *>(widget(index));
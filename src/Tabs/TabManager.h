@@ -24,6 +24,8 @@
 #ifndef TABMANAGER_H
 #define TABMANAGER_H
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
 #include <QtCore/QUrl>
 #include <QtCore/QPointer>
 #include <QtWidgets/QTabWidget>
@@ -31,6 +33,7 @@
 #include "MainUI/MainWindow.h"
 #include "Tabs/ContentTab.h"
 
+class QTimer;
 class Resource;
 class HTMLResource;
 class WellFormedContent;
@@ -86,6 +89,9 @@ public:
 
     void UpdateTabDisplay();
 
+    int GetTabFlushCount() const;
+    int GetSkippedTabFlushCount() const;
+
     /**
      * Close the OPF tab if it's currently open.
      * Returns true if the OPF had to be closed.
@@ -96,6 +102,7 @@ public slots:
 
     /**
      * Saves any unsaved data in the all the open tabs.
+     * Tabs with no edits since they were last saved here are skipped.
      */
     void SaveTabData();
 
@@ -221,6 +228,18 @@ private slots:
 
     void SetFocusInTab();
 
+    /**
+     * Frees the editors of XHTML tabs that have not been shown for
+     * a while, sooner when the process uses a lot of memory.
+     */
+    void HibernateIdleTabs();
+
+    /**
+     * Frees the editors of every XHTML tab but the current one,
+     * however recently they were shown.
+     */
+    void HibernateInactiveTabs();
+
 private:
 
     /**
@@ -296,6 +315,28 @@ private:
 
     bool m_CheckWellFormedErrors;
 
+    QTimer *m_HibernateTimer;
+
+    /**
+     * When each tab was last the current one, on m_Clock.
+     */
+    QHash<ContentTab *, qint64> m_LastUsed;
+
+    QElapsedTimer m_Clock;
+
+    /**
+     * The text revision of each resource, by identifier, at which
+     * its tab's text was last found well-formed.
+     */
+    QHash<QString, int> m_WellFormedRevisions;
+
+    /**
+     * How many tabs SaveTabData() has been through, and how many
+     * of them it skipped. Shown by the memory diagnostics.
+     */
+    int m_TabFlushes;
+    int m_TabFlushesSkipped;
+
 };
 
 #endif // TABMANAGER_H
@@ -46,6 +46,7 @@ TextTab::TextTab(TextResource *resource,
     // Make sure the resource is loaded as its file doesn't seem
     // to exist when the resource tries to do an initial load.
     m_TextResource->InitialLoad();
+    m_TextResource->RetainTextDocument();
     // We perform delayed initialization after the widget is on
     // the screen. This way, the user perceives less load time.
     QTimer::singleShot(0, this, SLOT(DelayedInitialization()));
@@ -57,6 +58,8 @@ TextTab::~TextTab()
         delete m_wCodeView;
         m_wCodeView = 0;
     }
+
+    m_TextResource->ReleaseTextDocument();
 }
 
 
@@ -116,6 +119,12 @@ int TextTab::GetCursorColumn() const
 }
 
 
+qint64 TextTab::GetUndoMemory() const
+{
+    return m_wCodeView->GetUndoMemory();
+}
+
+
 float TextTab::GetZoomFactor() const
 {
     return m_wCodeView->GetZoomFactor();
@@ -143,7 +152,7 @@ Searchable *TextTab::GetSearchableContent()
 void TextTab::Undo()
 {
     if (m_wCodeView->hasFocus()) {
-        m_wCodeView->undo();
+        m_wCodeView->Undo();
     }
 }
 
@@ -285,7 +294,10 @@ void TextTab::ConnectSignalsToSlots()
     connect(m_wCodeView, SIGNAL(FocusGained(QWidget *)),    this, SLOT(LoadTabContent(QWidget *)));
     connect(m_wCodeView, SIGNAL(FocusLost(QWidget *)),      this, SLOT(SaveTabContent(QWidget *)));
     connect(m_wCodeView, SIGNAL(FilteredTextChanged()),      this, SIGNAL(ContentChanged()));
+    // Undoing back to where the document was loaded is not filtered through
+    connect(m_wCodeView, SIGNAL(textChanged()),              this, SLOT(MarkContentModified()));
     connect(m_wCodeView, SIGNAL(cursorPositionChanged()),     this, SLOT(EmitUpdateCursorPosition()));
+    connect(m_wCodeView, SIGNAL(UndoMemoryChanged(qint64)),  this, SIGNAL(UpdateUndoMemory(qint64)));
     connect(m_wCodeView, SIGNAL(ZoomFactorChanged(float)), this, SIGNAL(ZoomFactorChanged(float)));
     connect(m_wCodeView, SIGNAL(selectionChanged()),         this, SIGNAL(SelectionChanged()));
     connect(m_wCodeView, SIGNAL(OpenClipEditorRequest(ClipEditorModel::clipEntry *)), this, SIGNAL(OpenClipEditorRequest(ClipEditorModel::clipEntry *)));
@@ -66,6 +66,8 @@ public:
     int GetCursorLine() const;
     int GetCursorColumn() const;
 
+    qint64 GetUndoMemory() const;
+
     float GetZoomFactor() const;
 
     void SetZoomFactor(float new_zoom_factor);
@@ -35,6 +35,7 @@
 #include <QtWidgets/QMenu>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QShortcut>
+#include <QtWidgets/QUndoStack>
 #include <QtWebKit/QWebElement>
 #include <QtWebKit/QWebSettings>
 #include <QtWebKitWidgets/QWebFrame>
@@ -85,10 +86,187 @@ const QString XHTML_NAMESPACE = "http://www.w3.org/1999/xhtml";
 
 static const QString GET_BODY_TAG_HTML = "new XMLSerializer().serializeToString( document.body.cloneNode(false) );";
 
+static const QRegularExpression NAMESPACE_DECLARATION(" xmlns(:[\\w.-]+)?=\"[^\"]*\"");
+
+
+// Returns the position just past the markup starting at the '<' at pos:
+// a comment, CDATA section, processing instruction or tag.
+static int MarkupEnd(const QString &html, int pos)
+{
+    if (html.midRef(pos, 4) == QLatin1String("<!--")) {
+        int end = html.indexOf("-->", pos + 4);
+        return end == -1 ? -1 : end + 3;
+    }
+
+    if (html.midRef(pos, 9) == QLatin1String("<![CDATA[")) {
+        int end = html.indexOf("]]>", pos + 9);
+        return end == -1 ? -1 : end + 3;
+    }
+
+    if (html.midRef(pos, 2) == QLatin1String("<?")) {
+        int end = html.indexOf("?>", pos + 2);
+        return end == -1 ? -1 : end + 2;
+    }
+
+    QChar quote;
+
+    for (int i = pos + 1; i < html.length(); i++) {
+        QChar c = html.at(i);
+
+        if (!quote.isNull()) {
+            if (c == quote) {
+                quote = QChar();
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+        } else if (c == '>') {
+            return i + 1;
+        }
+    }
+
+    return -1;
+}
+
+
+// The name of the start tag from pos to end, empty for other markup
+static QString StartTagName(const QString &html, int pos, int end)
+{
+    int i = pos + 1;
+
+    if (i >= end || html.at(i) == '/' || html.at(i) == '!' || html.at(i) == '?') {
+        return QString();
+    }
+
+    while (i < end && !html.at(i).isSpace() && html.at(i) != '/' && html.at(i) != '>') {
+        i++;
+    }
+
+    return html.mid(pos + 1, i - pos - 1);
+}
+
+
+// Returns the position just past the end tag of the element whose
+// start tag ends at pos
+static int ElementEnd(const QString &html, int pos)
+{
+    int depth = 1;
+    pos = html.indexOf('<', pos);
+
+    while (pos != -1) {
+        int end = MarkupEnd(html, pos);
+
+        if (end == -1) {
+            return -1;
+        }
+
+        if (html.at(pos + 1) == '/') {
+            depth--;
+        } else if (!StartTagName(html, pos, end).isEmpty() && html.at(end - 2) != '/') {
+            depth++;
+        }
+
+        if (depth == 0) {
+            return end;
+        }
+
+        pos = html.indexOf('<', end);
+    }
+
+    return -1;
+}
+
+
+// Splits the body of well-formed xhtml into the nodes directly in it the
+// way an XML parser does, setting the range of the body's content, the
+// ranges of the nodes and their names as track_blocks.js gives them.
+static bool ScanBodyChildren(const QString &html, int &body_start, int &body_end,
+                             QList<QPair<int, int> > &ranges, QStringList &names)
+{
+    body_start = -1;
+    int pos = html.indexOf('<');
+
+    while (pos != -1 && body_start == -1) {
+        int end = MarkupEnd(html, pos);
+
+        if (end == -1) {
+            return false;
+        }
+
+        if (StartTagName(html, pos, end) == "body") {
+            if (html.at(end - 2) == '/') {
+                return false;
+            }
+
+            body_start = end;
+        }
+
+        pos = html.indexOf('<', end);
+    }
+
+    if (body_start == -1) {
+        return false;
+    }
+
+    pos = body_start;
+
+    while (pos < html.length()) {
+        if (html.at(pos) != '<') {
+            int end = html.indexOf('<', pos);
+
+            if (end == -1) {
+                return false;
+            }
+
+            ranges.append(qMakePair(pos, end));
+            names.append("#3");
+            pos = end;
+            continue;
+        }
+
+        if (pos + 1 < html.length() && html.at(pos + 1) == '/') {
+            body_end = pos;
+            return true;
+        }
+
+        int end = MarkupEnd(html, pos);
+
+        if (end == -1) {
+            return false;
+        }
+
+        QString name = StartTagName(html, pos, end);
+
+        if (!name.isEmpty()) {
+            if (html.at(end - 2) != '/') {
+                end = ElementEnd(html, end);
+
+                if (end == -1) {
+                    return false;
+                }
+            }
+        } else if (html.at(pos + 1) == '?') {
+            name = "#7";
+        } else if (html.midRef(pos, 4) == QLatin1String("<!--")) {
+            name = "#8";
+        } else {
+            name = "#4";
+        }
+
+        ranges.append(qMakePair(pos, end));
+        names.append(name);
+        pos = end;
+    }
+
+    return false;
+}
+
 BookViewEditor::BookViewEditor(QWidget *parent)
     :
     BookViewPreview(parent),
     m_WebPageModified(false),
+    m_BodyStart(-1),
+    m_BodyEnd(-1),
+    m_BlocksTracked(false),
     m_clipMapper(new QSignalMapper(this)),
     m_openWithMapper(new QSignalMapper(this)),
     m_OpenWithContextMenu(new QMenu(this)),
@@ -103,7 +281,9 @@ BookViewEditor::BookViewEditor(QWidget *parent)
     c_FormatBlock(Utility::ReadUnicodeTextFile(":/javascript/format_block.js")),
     c_GetAncestor(Utility::ReadUnicodeTextFile(":/javascript/get_ancestor.js")),
     c_GetAncestorAttribute(Utility::ReadUnicodeTextFile(":/javascript/get_ancestor_attribute.js")),
-    c_SetAncestorAttribute(Utility::ReadUnicodeTextFile(":/javascript/set_ancestor_attribute.js"))
+    c_SetAncestorAttribute(Utility::ReadUnicodeTextFile(":/javascript/set_ancestor_attribute.js")),
+    c_TrackBlocks(Utility::ReadUnicodeTextFile(":/javascript/track_blocks.js")),
+    c_ChangedBlocks(Utility::ReadUnicodeTextFile(":/javascript/changed_blocks.js"))
 {
     setContextMenuPolicy(Qt::CustomContextMenu);
     page()->settings()->setAttribute(QWebSettings::DeveloperExtrasEnabled, false);
@@ -215,6 +395,9 @@ void BookViewEditor::CustomSetDocument(const QString &path, const QString &html)
 {
     m_isLoadFinished = false;
     m_path = path;
+    // The blocks are tracked once the page has loaded
+    m_SavedHtml = html;
+    m_BlocksTracked = false;
     BookViewPreview::CustomSetDocument(m_path, html);
     page()->setContentEditable(true);
     SetWebPageModified(false);
@@ -245,6 +428,102 @@ QString BookViewEditor::GetHtml()
     return html_from_Qt;
 }
 
+bool BookViewEditor::PatchDocument(const QString &path, const QString &html)
+{
+    if (!BookViewPreview::PatchDocument(path, html)) {
+        return false;
+    }
+
+    // As after a load, there is nothing to undo
+    page()->undoStack()->clear();
+    SetSavedHtml(html);
+    SetWebPageModified(false);
+    return true;
+}
+
+bool BookViewEditor::GetChangedHtml(QString &html)
+{
+    if (!m_BlocksTracked || !IsLoadingFinished()) {
+        return false;
+    }
+
+    RemoveWebkitCruft();
+    QVariant result = EvaluateJavascript(c_ChangedBlocks);
+
+    if (result.type() != QVariant::List) {
+        return false;
+    }
+
+    QString body;
+    body.reserve(m_BodyEnd - m_BodyStart);
+    foreach(const QVariant &part, result.toList()) {
+        if (part.type() == QVariant::String) {
+            body.append(CleanBlock(part.toString()));
+            continue;
+        }
+
+        int index = part.toInt();
+
+        if (index < 0 || index >= m_BlockRanges.count()) {
+            return false;
+        }
+
+        const QPair<int, int> &range = m_BlockRanges.at(index);
+        body.append(m_SavedHtml.midRef(range.first, range.second - range.first));
+    }
+
+    html = m_SavedHtml.left(m_BodyStart) % body % m_SavedHtml.midRef(m_BodyEnd);
+    return true;
+}
+
+void BookViewEditor::SetSavedHtml(const QString &html)
+{
+    m_SavedHtml = html;
+    TrackBlocks();
+}
+
+void BookViewEditor::TrackBlocks()
+{
+    m_BlockRanges.clear();
+    QStringList names;
+    bool scanned = ScanBodyChildren(m_SavedHtml, m_BodyStart, m_BodyEnd, m_BlockRanges, names);
+    // Run even when the text could not be split, to stop watching the old blocks
+    QString tracked = EvaluateJavascript(c_TrackBlocks).toString();
+    m_BlocksTracked = scanned && tracked == names.join(" ");
+
+    if (!m_BlocksTracked) {
+        m_BlockRanges.clear();
+    }
+}
+
+QString BookViewEditor::CleanBlock(const QString &block)
+{
+    QString cleaned = block;
+
+    // Serialized on its own, an element declares every namespace it uses
+    if (cleaned.startsWith('<') && cleaned.length() > 1 && cleaned.at(1).isLetter()) {
+        int tag_end = cleaned.indexOf('>');
+        QStringRef declared = m_SavedHtml.leftRef(m_BodyStart);
+        QList<QRegularExpressionMatch> repeated;
+        QRegularExpressionMatchIterator i = NAMESPACE_DECLARATION.globalMatch(cleaned.left(tag_end));
+
+        while (i.hasNext()) {
+            QRegularExpressionMatch match = i.next();
+
+            if (declared.contains(match.captured())) {
+                repeated.prepend(match);
+            }
+        }
+
+        foreach(const QRegularExpressionMatch &match, repeated) {
+            cleaned.remove(match.capturedStart(), match.capturedLength());
+        }
+    }
+
+    cleaned = RemoveBookViewReplaceSpans(cleaned);
+    return CleanSource::CharToEntity(cleaned);
+}
+
 #if 0
 QString BookViewEditor::GetXHtml11()
 {
@@ -1042,6 +1321,7 @@ void BookViewEditor::AddClipContextMenu(QMenu *menu)
         menu->addMenu(clips_menu);
     }
 
+    ClipEditorModel::instance()->FetchAllEntries();
     CreateMenuEntries(clips_menu, 0, ClipEditorModel::instance()->invisibleRootItem());
 
     QAction *saveClipAction = new QAction(tr("Add To Clips") + "...", menu);
@@ -1180,6 +1460,7 @@ void BookViewEditor::ConnectSignalsToSlots()
     connect(page(), SIGNAL(contentsChanged()),      this,   SIGNAL(textChanged()));
     connect(page(), SIGNAL(selectionChanged()),      this,   SIGNAL(selectionChanged()));
     connect(page(), SIGNAL(contentsChanged()),      this,   SLOT(SetWebPageModified()));
+    connect(this,   SIGNAL(DocumentLoaded()),       this,   SLOT(TrackBlocks()));
     connect(m_InsertFile,     SIGNAL(triggered()),  this, SLOT(insertFile()));
     connect(m_Undo,           SIGNAL(triggered()),  this, SLOT(Undo()));
     connect(m_Redo,           SIGNAL(triggered()),  this, SLOT(Redo()));
@@ -23,6 +23,8 @@
 #ifndef BOOKVIEWEDITOR_H
 #define BOOKVIEWEDITOR_H
 
+#include <QtCore/QList>
+#include <QtCore/QPair>
 #include <QtCore/QVariant>
 #include <QtWebKit/QWebElement>
 
@@ -68,7 +70,32 @@ public:
      */
     void CustomSetDocument(const QString &path, const QString &html);
 
+    /**
+     * Updates the loaded page to a new version of the same document
+     * the way BookViewPreview::PatchDocument does, and takes the new
+     * version as the text the page shows.
+     */
+    bool PatchDocument(const QString &path, const QString &html);
+
     QString GetHtml();
+
+    /**
+     * Makes the text of the edited page from the text it was loaded or
+     * last saved with, serializing again only the blocks of the body
+     * that were changed since.
+     *
+     * @param html Set to the text of the page.
+     * @return \c false if the page has to be serialized as a whole with
+     *         GetHtml(): the body tag changed, the body was left empty
+     *         or the nodes of the page could not be matched to the text.
+     */
+    bool GetChangedHtml(QString &html);
+
+    /**
+     * Takes html, just saved from the page, as the text the page shows.
+     */
+    void SetSavedHtml(const QString &html);
+
     //QString GetXHtml11();
     //QString GetHtml5();
 
@@ -289,6 +316,12 @@ private slots:
 
     void EmitPageUpdated();
 
+    /**
+     * Matches the nodes directly in the body of the page to their text
+     * and starts watching them for changes.
+     */
+    void TrackBlocks();
+
     /**
      * Wrapper slot for the Page Up shortcut.
      */
@@ -373,6 +406,13 @@ private:
      */
     QString RemoveBookViewReplaceSpans(const QString &source);
 
+    /**
+     * Cleans a block serialized on its own the way GetHtml() cleans
+     * the whole page, and drops the namespace declarations it repeats
+     * from the html and body tags.
+     */
+    QString CleanBlock(const QString &block);
+
     bool InsertTagAttribute(const QString &element_name, const QString &attribute_name, const QString &attribute_value, const QStringList &tag_list, bool ignore_selection = false);
 
     bool SetAncestorTagAttributeValue(const QString &attribute_name, const QString &attribute_value, const QStringList &tag_list);
@@ -417,6 +457,20 @@ private:
      */
     bool m_WebPageModified;
 
+    /**
+     * The text the page was loaded or last saved with, the range of the
+     * content of its body and the ranges of the nodes directly in it.
+     */
+    QString m_SavedHtml;
+    int m_BodyStart;
+    int m_BodyEnd;
+    QList<QPair<int, int> > m_BlockRanges;
+
+    /**
+     * \c true if the nodes of the page match m_BlockRanges.
+     */
+    bool m_BlocksTracked;
+
     QSignalMapper *m_clipMapper;
     QSignalMapper *m_openWithMapper;
 
@@ -506,6 +560,14 @@ private:
      */
     const QString c_SetAncestorAttribute;
 
+    /**
+     * Javascript source that remembers the nodes directly in the body
+     * and watches them for changes, and the source that lists them
+     * for GetChangedHtml().
+     */
+    const QString c_TrackBlocks;
+    const QString c_ChangedBlocks;
+
 };
 
 
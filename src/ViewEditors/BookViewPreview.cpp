@@ -21,6 +21,7 @@
 *************************************************************************/
 
 #include <QtCore/QEvent>
+#include <QtCore/QRegularExpression>
 #include <QtCore/QSize>
 #include <QtCore/QTimer>
 #include <QtCore/QUrl>
@@ -38,6 +39,18 @@
 #include "ViewEditors/BookViewPreview.h"
 #include "ViewEditors/ViewWebPage.h"
 
+// Counts the changes to the page's DOM, so what was read from it can be
+// told apart from what is there now
+const QString DOM_REVISION_OBSERVER_JS =
+    "if (window.MutationObserver && !window.sigil_dom_observer) {"
+    "    window.sigil_dom_revision = 0;"
+    "    window.sigil_dom_observer = new MutationObserver(function () { window.sigil_dom_revision++; });"
+    "    window.sigil_dom_observer.observe(document, { childList: true, subtree: true,"
+    "                                                  characterData: true, attributes: true });"
+    "}";
+
+const QString DOM_REVISION_JS = "window.sigil_dom_revision || 0;";
+
 const QString SET_CURSOR_JS =
     "var range = document.createRange();"
     "range.setStart(element, 0);"
@@ -60,9 +73,13 @@ BookViewPreview::BookViewPreview(QWidget *parent)
       c_GetRange(Utility::ReadUnicodeTextFile(":/javascript/get_range.js")),
       c_NewSelection(Utility::ReadUnicodeTextFile(":/javascript/new_selection.js")),
       c_GetParentTags(Utility::ReadUnicodeTextFile(":/javascript/get_parent_tags.js")),
+      c_PatchBody(Utility::ReadUnicodeTextFile(":/javascript/patch_body.js")),
+      c_ReplaceStylesheet(Utility::ReadUnicodeTextFile(":/javascript/replace_stylesheet.js")),
       m_CaretLocationUpdate(QString()),
       m_pendingLoadCount(0),
-      m_pendingScrollToFragment(QString())
+      m_pendingScrollToFragment(QString()),
+      m_SearchToolsValid(false),
+      m_SearchToolsRevision(0)
 {
     setContextMenuPolicy(Qt::CustomContextMenu);
     // Set the Zoom factor but be sure no signals are set because of this.
@@ -70,22 +87,28 @@ BookViewPreview::BookViewPreview(QWidget *parent)
     SetCurrentZoomFactor(settings.zoomPreview());
     // use our web page that can be used for debugging javascript
     setPage(m_ViewWebPage);
+    ConfigurePage(page());
+    CreateContextMenuActions();
+    ConnectSignalsToSlots();
+}
+
+void BookViewPreview::ConfigurePage(QWebPage *web_page)
+{
+    SettingsStore settings;
     // Enable our link filter.
-    page()->setLinkDelegationPolicy(QWebPage::DelegateAllLinks);
-    page()->settings()->setAttribute(QWebSettings::DeveloperExtrasEnabled, true);
-    // page()->settings()->setAttribute(QWebSettings::PluginsEnabled, false);
+    web_page->setLinkDelegationPolicy(QWebPage::DelegateAllLinks);
+    web_page->settings()->setAttribute(QWebSettings::DeveloperExtrasEnabled, true);
+    // web_page->settings()->setAttribute(QWebSettings::PluginsEnabled, false);
     // Allow epubs to access remote resources via the net
-    page()->settings()->setAttribute(QWebSettings::LocalContentCanAccessRemoteUrls, (settings.remoteOn() == 1));
+    web_page->settings()->setAttribute(QWebSettings::LocalContentCanAccessRemoteUrls, (settings.remoteOn() == 1));
     // Enable local-storage for epub3
-    page()->settings()->setAttribute(QWebSettings::LocalStorageEnabled, true);
+    web_page->settings()->setAttribute(QWebSettings::LocalStorageEnabled, true);
     QString localStorePath = Utility::DefinePrefsDir() + "/local-storage";
     QDir storageDir(localStorePath);
     if (!storageDir.exists()) {
         storageDir.mkpath(localStorePath);
     }
-    page()->settings()->setLocalStoragePath(localStorePath);
-    CreateContextMenuActions();
-    ConnectSignalsToSlots();
+    web_page->settings()->setLocalStoragePath(localStorePath);
 }
 
 BookViewPreview::~BookViewPreview()
@@ -159,18 +182,157 @@ void BookViewPreview::CustomSetDocument(const QString &path, const QString &html
     }
 
     m_isLoadFinished = false;
+    QString replaced_html = ToLoadableXhtml(html);
+    m_LoadedHead = HeadOf(replaced_html);
+    setContent(replaced_html.toUtf8(), "application/xhtml+xml;charset=utf-8", QUrl::fromLocalFile(path));
+}
+
+void BookViewPreview::LoadIntoPage(QWebPage *web_page, const QString &path, const QString &html)
+{
+    web_page->mainFrame()->setContent(ToLoadableXhtml(html).toUtf8(), "application/xhtml+xml;charset=utf-8",
+                                      QUrl::fromLocalFile(path));
+}
+
+void BookViewPreview::SwapInPage(ViewWebPage *web_page, const QString &html)
+{
+    disconnect(page(), 0, this, 0);
+    // The page being replaced is a child of this view, so setPage deletes it
+    web_page->setParent(this);
+    m_ViewWebPage = web_page;
+    setPage(m_ViewWebPage);
+    ConnectPageSignals();
+    Zoom();
+    m_LoadedHead = HeadOf(ToLoadableXhtml(html));
+    // What was pending was for the page that is gone
+    m_pendingLoadCount = 0;
+    m_pendingScrollToFragment.clear();
+    InjectJavascript();
+    m_isLoadFinished = true;
+    emit DocumentLoaded();
+}
+
+bool BookViewPreview::IsLoadingFinished()
+{
+    return m_isLoadFinished;
+}
+
+bool BookViewPreview::PatchDocument(const QString &path, const QString &html)
+{
+    if (!m_isLoadFinished || html.isEmpty() || url().toLocalFile() != path) {
+        return false;
+    }
+
+    QString replaced_html = ToLoadableXhtml(html);
+
+    // Stylesheets, scripts and the like only take effect on a load
+    if (m_LoadedHead.isEmpty() || HeadOf(replaced_html) != m_LoadedHead) {
+        return false;
+    }
+
+    QString javascript = c_PatchBody;
+    javascript.replace("$NEW_DOCUMENT", ToJavascriptString(replaced_html));
+    InvalidateSearchTools();
+    return EvaluateJavascript(javascript).toBool();
+}
+
+bool BookViewPreview::ReplaceStylesheet(const QString &css_path, const QString &css)
+{
+    if (!m_isLoadFinished) {
+        return false;
+    }
+
+    QUrl css_url = QUrl::fromLocalFile(css_path);
+    QString javascript = c_ReplaceStylesheet;
+    javascript.replace("$STYLESHEET_URL", ToJavascriptString(css_url.toString(QUrl::FullyEncoded)));
+    javascript.replace("$STYLESHEET_TEXT", ToJavascriptString(WithAbsoluteUrls(css, css_url)));
+    InvalidateSearchTools();
+    return EvaluateJavascript(javascript).toBool();
+}
+
+QString BookViewPreview::WithAbsoluteUrls(const QString &css, const QUrl &base)
+{
+    // In a <style> they would be taken relative to the page instead
+    static const QRegularExpression url_reference("(url\\(\\s*)(['\"]?)([^'\")]*?)\\2(\\s*\\))|(@import\\s+)(['\"])([^'\"]*)\\6",
+                                                  QRegularExpression::CaseInsensitiveOption);
+    QString absolute;
+    int last = 0;
+    QRegularExpressionMatchIterator references = url_reference.globalMatch(css);
+
+    while (references.hasNext()) {
+        QRegularExpressionMatch reference = references.next();
+        bool is_url = reference.capturedStart(1) != -1;
+        int group = is_url ? 3 : 7;
+        QUrl url(reference.captured(group));
+
+        if (!url.isRelative() || reference.captured(group).startsWith('#')) {
+            continue;
+        }
+
+        absolute.append(css.midRef(last, reference.capturedStart(group) - last));
+        absolute.append(base.resolved(url).toString(QUrl::FullyEncoded));
+        last = reference.capturedEnd(group);
+    }
+
+    absolute.append(css.midRef(last));
+    return absolute;
+}
+
+QString BookViewPreview::ToLoadableXhtml(const QString &html)
+{
     // If Tidy is turned off, then Sigil will explode if there is no xmlns
     // on the <html> element. So we will silently add it if needed to ensure
     // no errors occur, to allow loading of documents created outside of
     // Sigil as well as catering for section splits etc.
     QString replaced_html = html;
-    replaced_html = replaced_html.replace("<html>", "<html xmlns=\"http://www.w3.org/1999/xhtml\">");
-    setContent(replaced_html.toUtf8(), "application/xhtml+xml;charset=utf-8", QUrl::fromLocalFile(path));
+    return replaced_html.replace("<html>", "<html xmlns=\"http://www.w3.org/1999/xhtml\">");
 }
 
-bool BookViewPreview::IsLoadingFinished()
+QString BookViewPreview::HeadOf(const QString &html)
 {
-    return m_isLoadFinished;
+    int body = html.indexOf("<body");
+
+    if (body == -1) {
+        return QString();
+    }
+
+    return html.left(body);
+}
+
+QString BookViewPreview::ToJavascriptString(const QString &text)
+{
+    QString literal;
+    literal.reserve(text.length() + text.length() / 8 + 2);
+    literal.append('"');
+
+    foreach(QChar c, text) {
+        switch (c.unicode()) {
+            case '\\':
+                literal.append("\\\\");
+                break;
+            case '"':
+                literal.append("\\\"");
+                break;
+            case '\n':
+                literal.append("\\n");
+                break;
+            case '\r':
+                literal.append("\\r");
+                break;
+            // Line terminators to JavaScript, even inside a string
+            case 0x2028:
+                literal.append("\\u2028");
+                break;
+            case 0x2029:
+                literal.append("\\u2029");
+                break;
+            default:
+                literal.append(c);
+                break;
+        }
+    }
+
+    literal.append('"');
+    return literal;
 }
 
 void BookViewPreview::SetZoomFactor(float factor)
@@ -275,7 +437,7 @@ bool BookViewPreview::FindNext(SearchTools &search_tools,
         return false;
     }
 
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
     SPCRE::MatchInfo match_info;
     int start_offset = 0;
     int selection_offset = -1;
@@ -330,8 +492,8 @@ bool BookViewPreview::FindNext(SearchTools &search_tools,
 int BookViewPreview::Count(const QString &search_regex, Searchable::Direction direction, bool wrap, bool selected_text)
 {
     // Spell check not actually used
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
-    return spcre->getEveryMatchInfo(GetSearchTools().fulltext).count();
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
+    return spcre->countMatches(GetSearchTools().fulltext);
 }
 
 bool BookViewPreview::ReplaceSelected(const QString &search_regex, const QString &replacement, Searchable::Direction direction, bool keep_selection)
@@ -361,6 +523,7 @@ void BookViewPreview::SetUpFindForSelectedText(const QString &search_regex)
 void BookViewPreview::LoadingStarted()
 {
     m_isLoadFinished = false;
+    InvalidateSearchTools();
 }
 
 void BookViewPreview::UpdateFinishedState(bool okay)
@@ -403,11 +566,18 @@ void BookViewPreview::GrabFocus()
     QWebView::setFocus();
 }
 
-void BookViewPreview::WebPageJavascriptOnLoad()
+void BookViewPreview::InjectJavascript()
 {
     page()->mainFrame()->evaluateJavaScript(c_jQuery);
     page()->mainFrame()->evaluateJavaScript(c_jQueryScrollTo);
     page()->mainFrame()->evaluateJavaScript(c_jQueryWrapSelection);
+    page()->mainFrame()->evaluateJavaScript(DOM_REVISION_OBSERVER_JS);
+    InvalidateSearchTools();
+}
+
+void BookViewPreview::WebPageJavascriptOnLoad()
+{
+    InjectJavascript();
     m_pendingLoadCount -= 1;
 
     if (m_pendingLoadCount == 0) {
@@ -480,6 +650,12 @@ int BookViewPreview::GetSelectionOffset(const QMap<int, QString> &node_offsets,
 
 BookViewPreview::SearchTools BookViewPreview::GetSearchTools() const
 {
+    int revision = page()->mainFrame()->evaluateJavaScript(DOM_REVISION_JS).toInt();
+
+    if (m_SearchToolsValid && revision == m_SearchToolsRevision) {
+        return m_SearchTools;
+    }
+
     SearchTools search_tools;
     search_tools.fulltext = "";
     QString source = page()->mainFrame()->toHtml();
@@ -490,26 +666,75 @@ BookViewPreview::SearchTools BookViewPreview::GetSearchTools() const
     // start with body node
     // Gumbo adds body tag if missing (unless parsing a fragment which we are not doing)
     GumboNode* node = gi.get_all_nodes_with_tag(GUMBO_TAG_BODY).at(0);
-    QList<GumboNode *> text_nodes = XhtmlDoc::GetVisibleTextNodes(gi, node);
-    GumboNode *  current_block_ancestor = NULL;
+    GumboNode *last_block = NULL;
 
     // We concatenate all text nodes that have the same
     // block level ancestor element. A newline is added
     // when a new block element starts.
     // We also record the starting offset of every text node.
-    for (int i = 0; i < text_nodes.count(); ++i) {
-        GumboNode * anode = text_nodes.at(i);
-        GumboNode *new_block_ancestor = XhtmlDoc::GetAncestorBlockElement(gi, anode);
-        QString webpath = gi.get_qwebpath_to_node(anode); 
-        if (new_block_ancestor != current_block_ancestor) {
-            current_block_ancestor = new_block_ancestor;
+    CollectSearchText(gi, node, gi.get_qwebpath_to_node(node), node, last_block, search_tools);
+    search_tools.textlen = search_tools.fulltext.length();
+    m_SearchTools = search_tools;
+    m_SearchToolsRevision = revision;
+    m_SearchToolsValid = true;
+    return search_tools;
+}
+
+
+void BookViewPreview::CollectSearchText(GumboInterface &gi, GumboNode *node, const QString &path,
+                                        GumboNode *block, GumboNode *&last_block, SearchTools &search_tools)
+{
+    // The same text nodes XhtmlDoc::GetVisibleTextNodes finds, and the
+    // same paths and block ancestors as get_qwebpath_to_node and
+    // GetAncestorBlockElement, carried down instead of looked up again
+    // from every text node.
+    if ((node->type == GUMBO_NODE_TEXT) || (node->type == GUMBO_NODE_WHITESPACE)) {
+        if (block != last_block) {
+            last_block = block;
             search_tools.fulltext.append("\n");
         }
-        search_tools.node_offsets[ search_tools.fulltext.length() ] = webpath;
-        search_tools.fulltext.append(QString::fromUtf8(anode->v.text.text));
+        search_tools.node_offsets[ search_tools.fulltext.length() ] = path;
+        search_tools.fulltext.append(QString::fromUtf8(node->v.text.text));
+        return;
     }
-    search_tools.textlen = search_tools.fulltext.length();
-    return search_tools;
+
+    if ((node->type != GUMBO_NODE_ELEMENT) && (node->type != GUMBO_NODE_TEMPLATE)) {
+        return;
+    }
+
+    QString node_name = QString::fromStdString(gi.get_tag_name(node));
+
+    if ((node_name == "script") || (node_name == "style")) {
+        return;
+    }
+
+    GumboNode *child_block = BLOCK_LEVEL_TAGS.contains(node_name) ? node : block;
+    QString prefix = path;
+    if (!prefix.isEmpty()) {
+        prefix.append(",");
+    }
+    prefix.append(node_name + " ");
+    GumboVector* children = &node->v.element.children;
+    int element_number = 0;
+
+    for (unsigned int i = 0; i < children->length; ++i) {
+        GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+        bool is_element = (child->type == GUMBO_NODE_ELEMENT) || (child->type == GUMBO_NODE_TEMPLATE);
+        // Elements are numbered among their element siblings,
+        // text nodes among all of them
+        int index = is_element ? element_number : child->index_within_parent;
+        CollectSearchText(gi, child, prefix + QString::number(index), child_block, last_block, search_tools);
+        if (is_element) {
+            element_number++;
+        }
+    }
+}
+
+
+void BookViewPreview::InvalidateSearchTools()
+{
+    m_SearchToolsValid = false;
+    m_SearchTools = SearchTools();
 }
 
 
@@ -792,7 +1017,14 @@ void BookViewPreview::ConnectSignalsToSlots()
 {
     connect(this,  SIGNAL(customContextMenuRequested(const QPoint &)), this, SLOT(OpenContextMenu(const QPoint &)));
     connect(m_InspectElement,    SIGNAL(triggered()),  this, SLOT(InspectElement()));
+    ConnectPageSignals();
+}
+
+void BookViewPreview::ConnectPageSignals()
+{
     connect(page(), SIGNAL(loadStarted()), this, SLOT(LoadingStarted()));
+    // Edits in Book View; script changes are caught by the DOM revision
+    connect(page(), SIGNAL(contentsChanged()), this, SLOT(InvalidateSearchTools()));
     connect(page(), SIGNAL(loadFinished(bool)), this, SLOT(UpdateFinishedState(bool)));
     connect(page(), SIGNAL(linkClicked(const QUrl &)), this, SIGNAL(LinkClicked(const QUrl &)));
     connect(page(), SIGNAL(loadFinished(bool)), this, SLOT(WebPageJavascriptOnLoad()));
@@ -26,9 +26,11 @@
 #include <memory>
 #include <QtCore/QMap>
 #include <QtWebKitWidgets/QWebView>
+#include "Misc/GumboInterface.h"
 #include "ViewEditors/ViewEditor.h"
 
 class QSize;
+class QWebPage;
 class ViewWebPage;
 
 class BookViewPreview : public QWebView, public ViewEditor
@@ -50,6 +52,45 @@ public:
 
     bool IsLoadingFinished();
 
+    /**
+     * Updates the loaded page to a new version of the same document
+     * without reloading it: only the parts of the body that changed
+     * are replaced, so WebKit restyles and relayouts just those.
+     *
+     * @return \c false, with the page left as it was, if the page is
+     *         still loading, is another file, its head changed or the
+     *         new text does not parse. CustomSetDocument is needed then.
+     */
+    bool PatchDocument(const QString &path, const QString &html);
+
+    /**
+     * Shows css as the text of the stylesheet at css_path on the loaded
+     * page, without reloading it. Relative URLs in css are made absolute
+     * so they still point where they did from the stylesheet's file.
+     *
+     * @return \c false, with the page left as it was, if the page is
+     *         still loading or does not link to the stylesheet.
+     */
+    bool ReplaceStylesheet(const QString &css_path, const QString &css);
+
+    /**
+     * Shows a page that was already loaded elsewhere, with LoadIntoPage,
+     * in place of the current one, which is deleted. html is the text
+     * it was loaded with.
+     */
+    void SwapInPage(ViewWebPage *web_page, const QString &html);
+
+    /**
+     * Sets up a page the way the pages of this view are, so one
+     * loaded in the background renders the same.
+     */
+    static void ConfigurePage(QWebPage *web_page);
+
+    /**
+     * Loads html into a page the way CustomSetDocument does.
+     */
+    static void LoadIntoPage(QWebPage *web_page, const QString &path, const QString &html);
+
     void SetZoomFactor(float factor);
 
     void SetCurrentZoomFactor(float factor);
@@ -161,6 +202,28 @@ protected:
      */
     QVariant EvaluateJavascript(const QString &javascript);
 
+    /**
+     * @return html with the xhtml namespace on a bare <html> tag.
+     */
+    static QString ToLoadableXhtml(const QString &html);
+
+    /**
+     * Makes the relative url() and @import references in css
+     * absolute against base, the stylesheet's own URL.
+     */
+    static QString WithAbsoluteUrls(const QString &css, const QUrl &base);
+
+    /**
+     * @return The text before the body tag, or an empty string
+     *         if there is no body.
+     */
+    static QString HeadOf(const QString &html);
+
+    /**
+     * @return text as a double quoted JavaScript string literal.
+     */
+    static QString ToJavascriptString(const QString &text);
+
     /**
      * Javascript source that implements a function to find the
      * first block-level parent of a node in the source.
@@ -192,6 +255,11 @@ private slots:
      */
     void WebPageJavascriptOnLoad();
 
+    /**
+     * Drops the cached search tools.
+     */
+    void InvalidateSearchTools();
+
     void executeCaretUpdateInternal() {
         ExecuteCaretUpdate();
     }
@@ -357,12 +425,21 @@ private:
 
     /**
      * Returns the all the necessary tools for searching.
-     * Reads from the QWebPage source.
+     * Reads from the QWebPage source, only when the page was
+     * loaded or its DOM changed since the last call.
      *
      * @return The necessary tools for searching.
      */
     SearchTools GetSearchTools() const;
 
+    /**
+     * Appends the visible text under node to the search tools, starting
+     * a new line for every new block element, in a single walk down the
+     * tree. path is the QWebPath of node.
+     */
+    static void CollectSearchText(GumboInterface &gi, GumboNode *node, const QString &path,
+                                  GumboNode *block, GumboNode *&last_block, SearchTools &search_tools);
+
     void CreateContextMenuActions();
 
     /**
@@ -379,6 +456,17 @@ private:
      */
     void ConnectSignalsToSlots();
 
+    /**
+     * Connects the signals of the current page, which changes
+     * when a page is swapped in.
+     */
+    void ConnectPageSignals();
+
+    /**
+     * Loads jQuery and the DOM revision counter into a loaded page.
+     */
+    void InjectJavascript();
+
     ///////////////////////////////
     // PRIVATE MEMBER VARIABLES
     ///////////////////////////////
@@ -430,6 +518,24 @@ private:
      */
     const QString c_GetParentTags;
 
+    /**
+     * The JavaScript source code that patches the body
+     * of the page to match a new version of the document.
+     */
+    const QString c_PatchBody;
+
+    /**
+     * The JavaScript source code that puts a new version
+     * of a linked stylesheet into the page.
+     */
+    const QString c_ReplaceStylesheet;
+
+    /**
+     * The text before the body of the last document set,
+     * which a patch can not change.
+     */
+    QString m_LoadedHead;
+
     /**
      * Stores the JavaScript source code for the
      * caret location update. Used when switching from
@@ -442,6 +548,14 @@ private:
 
     QAction *m_InspectElement;
 
+    /**
+     * What GetSearchTools last read, reused while m_SearchToolsValid
+     * and the page's DOM revision is m_SearchToolsRevision.
+     */
+    mutable SearchTools m_SearchTools;
+    mutable bool m_SearchToolsValid;
+    mutable int m_SearchToolsRevision;
+
 };
 
 #endif // BOOKVIEWPREVIEW_H
@@ -28,6 +28,7 @@
 
 #include <QChar>
 #include <QString>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFileInfo>
 #include <QtGui/QContextMenuEvent>
 #include <QtCore/QSignalMapper>
@@ -36,7 +37,6 @@
 #include <QtGui/QPainter>
 #include <QtWidgets/QScrollBar>
 #include <QtWidgets/QShortcut>
-#include <QtCore/QXmlStreamReader>
 #include <QRegularExpression>
 #include <QRegularExpressionMatch>
 #include <QRegularExpressionMatchIterator>
@@ -49,9 +49,12 @@
 #include "Misc/XHTMLHighlighter.h"
 #include "Dialogs/ClipEditor.h"
 #include "Misc/CSSHighlighter.h"
+#include "Misc/SettingsSnapshot.h"
 #include "Misc/SettingsStore.h"
 #include "Misc/SpellCheck.h"
+#include "Misc/SpellingSuggester.h"
 #include "Misc/TextDocument.h"
+#include "Misc/Trace.h"
 #include "Misc/HTMLSpellCheck.h"
 #include "Misc/Utility.h"
 #include "PCRE/PCRECache.h"
@@ -62,7 +65,6 @@
 static const int TAB_SPACES_WIDTH        = 4;
 static const int LINE_NUMBER_MARGIN      = 5;
 
-static const QString XML_OPENING_TAG        = "(<[^>/][^>]*[^>/]>|<[^>/]>)";
 static const QString NEXT_CLOSE_TAG_LOCATION = "</\\s*[^>]+>";
 static const QString NEXT_TAG_LOCATION      = "<[^!>]+>";
 static const QString TAG_NAME_SEARCH        = "<\\s*([^\\s>]+)";
@@ -75,6 +77,13 @@ static const QString STARTING_INDENT_USED = "(^\\s*)[^\\s]";
 
 static const int MAX_SPELLING_SUGGESTIONS = 10;
 
+// Documents at least this long (in characters) are highlighted progressively
+static const int PROGRESSIVE_HIGHLIGHT_CHARS = 1024 * 1024;
+// How long one slice of background highlighting may hold the GUI
+static const int PROGRESSIVE_HIGHLIGHT_SLICE_MS = 15;
+// How long scrolling has to settle before the view is spell checked
+static const int VISIBLE_HIGHLIGHT_DELAY_MS = 100;
+
 
 CodeViewEditor::CodeViewEditor(HighlighterType high_type, bool check_spelling, QWidget *parent)
     :
@@ -97,9 +106,12 @@ CodeViewEditor::CodeViewEditor(HighlighterType high_type, bool check_spelling, Q
     m_addDictMapper(new QSignalMapper(this)),
     m_ignoreSpellingMapper(new QSignalMapper(this)),
     m_clipMapper(new QSignalMapper(this)),
+    m_spellingSuggester(new SpellingSuggester(this)),
     m_MarkedTextStart(-1),
     m_MarkedTextEnd(-1),
-    m_ReplacingInMarkedText(false)
+    m_ReplacingInMarkedText(false),
+    m_ProgressiveHighlight(false),
+    m_LargeFileMode(false)
 {
     if (high_type == CodeViewEditor::Highlight_XHTML) {
         m_Highlighter = new XHTMLHighlighter(check_spelling, this);
@@ -109,10 +121,14 @@ CodeViewEditor::CodeViewEditor(HighlighterType high_type, bool check_spelling, Q
         m_Highlighter = NULL;
     }
 
+    // A zero timer fires once the GUI has no other events to handle
+    m_ProgressiveHighlightTimer.setInterval(0);
+    m_VisibleHighlightTimer.setSingleShot(true);
+    m_VisibleHighlightTimer.setInterval(VISIBLE_HIGHLIGHT_DELAY_MS);
+    m_NestingIndex.SetDocument(document());
     setFocusPolicy(Qt::StrongFocus);
     ConnectSignalsToSlots();
-    SettingsStore settings;
-    m_codeViewAppearance = settings.codeViewAppearance();
+    m_codeViewAppearance = SettingsSnapshot::Current()->code_view_appearance;
     SetAppearanceColors();
     UpdateLineNumberAreaMargin();
     HighlightCurrentLine();
@@ -136,8 +152,28 @@ QSize CodeViewEditor::sizeHint() const
 
 void CodeViewEditor::CustomSetDocument(TextDocument &document)
 {
+    disconnect(this->document(), SIGNAL(contentsChange(int, int, int)),
+               this, SLOT(UpdateNestingIndex(int, int, int)));
+    TextDocument *old_document = qobject_cast<TextDocument *>(this->document());
+
+    if (old_document) {
+        disconnect(old_document, SIGNAL(UndoMemoryChanged(qint64)), this, SIGNAL(UndoMemoryChanged(qint64)));
+    }
+
     setDocument(&document);
+    m_NestingIndex.SetDocument(&document);
+    connect(&document, SIGNAL(contentsChange(int, int, int)), this, SLOT(UpdateNestingIndex(int, int, int)));
+    connect(&document, SIGNAL(UndoMemoryChanged(qint64)), this, SIGNAL(UndoMemoryChanged(qint64)));
     document.setModified(false);
+    qint64 large_file_threshold = qint64(SettingsSnapshot::Current()->large_file_threshold) * 1024 * 1024;
+    m_LargeFileMode = large_file_threshold > 0 && document.characterCount() >= large_file_threshold;
+    XHTMLHighlighter *xhtml_highlighter = dynamic_cast<XHTMLHighlighter *>(m_Highlighter);
+
+    if (xhtml_highlighter) {
+        xhtml_highlighter->SetCheckSpelling(m_checkSpelling && !m_LargeFileMode);
+    }
+
+    HighlightCurrentLine();
 
     if (m_Highlighter) {
         m_Highlighter->setDocument(&document);
@@ -155,6 +191,38 @@ void CodeViewEditor::CustomSetDocument(TextDocument &document)
     emit DocumentSet();
 }
 
+bool CodeViewEditor::IsLargeFileMode() const
+{
+    return m_LargeFileMode;
+}
+
+void CodeViewEditor::Undo()
+{
+    // Past the ordinary undo steps lie the compressed snapshots
+    // kept when the undo history went over its budget
+    if (document()->isUndoAvailable()) {
+        undo();
+        return;
+    }
+
+    TextDocument *doc = qobject_cast<TextDocument *>(document());
+
+    if (doc) {
+        doc->undoToCheckpoint();
+    }
+}
+
+qint64 CodeViewEditor::GetUndoMemory() const
+{
+    TextDocument *doc = qobject_cast<TextDocument *>(document());
+
+    if (!doc) {
+        return 0;
+    }
+
+    return doc->undoMemoryUsage();
+}
+
 void CodeViewEditor::DeleteLine()
 {
     if (document()->isEmpty()) {
@@ -336,7 +404,7 @@ QString CodeViewEditor::SplitSection()
     int split_position = textCursor().position();
 
     // Abort splitting the section if user is within a tag - MainWindow will display a status message
-    if (IsPositionInTag(split_position, text)) {
+    if (IsPositionInTag(split_position)) {
         return QString();
     }
 
@@ -458,12 +526,19 @@ void CodeViewEditor::LineNumberAreaPaintEvent(QPaintEvent *event)
     // Blocks are numbered from zero,
     // but we count lines of text from one
     int blockNumber  = block.blockNumber() + 1;
+    qreal top = blockBoundingGeometry(block).translated(contentOffset()).top();
 
     // We loop through all the visible and
     // unobscured blocks and paint line numbers for each
     while (block.isValid()) {
         // Getting the Y coordinates for the top of a block.
-        int topY = (int) blockBoundingGeometry(block).translated(contentOffset()).top();
+        // In large files it is worked out from the block above
+        // rather than mapped from the document for every line.
+        if (!m_LargeFileMode) {
+            top = blockBoundingGeometry(block).translated(contentOffset()).top();
+        }
+
+        int topY = (int) top;
 
         // Ignore blocks that are not visible.
         if (!block.isVisible() || (topY > event->rect().bottom())) {
@@ -481,6 +556,7 @@ void CodeViewEditor::LineNumberAreaPaintEvent(QPaintEvent *event)
                          number_to_paint
                         );
         // Move to the next block and block number.
+        top += blockBoundingRect(block).height();
         block = block.next();
         blockNumber++;
     }
@@ -552,23 +628,10 @@ int CodeViewEditor::CalculateLineNumberAreaWidth()
 
 void CodeViewEditor::ReplaceDocumentText(const QString &new_text)
 {
-    QTextCursor cursor = textCursor();
-    cursor.beginEditBlock();
-    cursor.select(QTextCursor::Document);
-    cursor.removeSelectedText();
-    cursor.insertText(new_text);
-    cursor.endEditBlock();
-
-#if 0
-    // should we instead be calling clear on the underlying document
-    // and then inserting the new text?  Does this impact memory consumption?
-    document()->clear();
-    QTextCursor cursor = textCursor();
-    cursor.beginEditBlock();
-    cursor.setPosition(0);
-    cursor.insertText(new_text);
-    cursor.endEditBlock();
-#endif
+    // Only the lines that differ are replaced, so the highlighting,
+    // caret and scroll position of the rest of the document are kept
+    TextDocument *doc = qobject_cast<TextDocument *>(document());
+    doc->ApplyText(new_text);
 }
 
 
@@ -706,8 +769,7 @@ void CodeViewEditor::SetZoomFactor(float factor)
 
 float CodeViewEditor::GetZoomFactor() const
 {
-    SettingsStore settings;
-    return settings.zoomText();
+    return SettingsSnapshot::Current()->zoom_text;
 }
 
 
@@ -722,8 +784,7 @@ void CodeViewEditor::Zoom()
 
 void CodeViewEditor::UpdateDisplay()
 {
-    SettingsStore settings;
-    float stored_factor = settings.zoomText();
+    float stored_factor = SettingsSnapshot::Current()->zoom_text;
 
     if (stored_factor != m_CurrentZoomFactor) {
         m_CurrentZoomFactor = stored_factor;
@@ -761,7 +822,7 @@ bool CodeViewEditor::FindNext(const QString &search_regex,
                               bool wrap,
                               bool marked_text)
 {
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
     SPCRE::MatchInfo match_info;
     QString txt = toPlainText();
     int start_offset = 0;
@@ -825,7 +886,7 @@ bool CodeViewEditor::FindNext(const QString &search_regex,
 
 int CodeViewEditor::Count(const QString &search_regex, Searchable::Direction direction, bool wrap, bool marked_text)
 {
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
     QString text= toPlainText();
     int start = 0;
     int end = text.length();
@@ -846,13 +907,13 @@ int CodeViewEditor::Count(const QString &search_regex, Searchable::Direction dir
     } else if (marked_text) {
         text = Utility::Substring(start, end, text);
     }
-    return spcre->getEveryMatchInfo(text).count();
+    return spcre->countMatches(text);
 }
 
 
 bool CodeViewEditor::ReplaceSelected(const QString &search_regex, const QString &replacement, Searchable::Direction direction, bool replace_current)
 {
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
     int selection_start = textCursor().selectionStart();
     int selection_end = textCursor().selectionEnd();
 
@@ -928,7 +989,8 @@ int CodeViewEditor::ReplaceAll(const QString &search_regex,
                                bool marked_text)
 {
     int count = 0;
-    QString text = toPlainText();
+    const QString document_text = toPlainText();
+    QString text = document_text;
     int original_position = textCursor().position();
     int position = original_position;
     if (marked_text) {
@@ -942,55 +1004,43 @@ int CodeViewEditor::ReplaceAll(const QString &search_regex,
     }
     int marked_text_length = text.length();
 
-    SPCRE *spcre = PCRECache::instance()->getObject(search_regex);
-    QList<SPCRE::MatchInfo> match_info = spcre->getEveryMatchInfo(text);
+    QSharedPointer<SPCRE> spcre = PCRECache::instance()->getObject(search_regex);
+    // Without wrap only the matches on the search direction's side of
+    // the caret are replaced.
+    int from = 0;
+    int to = INT_MAX;
 
-    // Run though all match offsets making the replacement in reverse order.
-    // This way changes in text length won't change the offsets as we make
-    // our changes.
-    for (int i = match_info.count() - 1; i >= 0; i--) {
-        QString replaced_text;
-        if (!wrap) {
-            if (direction == Searchable::Direction_Up) {
-                if (match_info.at(i).offset.first > position) {
-                    break;
-                }
-            } else { 
-                if (match_info.at(i).offset.second < position) {
-                    break;
-                }
-            }
+    if (!wrap) {
+        if (direction == Searchable::Direction_Up) {
+            to = position;
+        } else {
+            from = position;
         }
+    }
 
-        bool replacement_made = spcre->replaceText(Utility::Substring(match_info.at(i).offset.first, match_info.at(i).offset.second, text), match_info.at(i).capture_groups_offsets, replacement, replaced_text);
+    // The whole result is built in one pass over the text and handed to
+    // the document at once; replacing the matches one by one through a
+    // cursor relayouts and rehighlights after every single one.
+    QString new_text;
+    count = spcre->replaceEveryMatch(text, replacement, new_text, from, to);
 
-        if (replacement_made) {
-            // Replace the text.
-            text = text.replace(match_info.at(i).offset.first, match_info.at(i).offset.second - match_info.at(i).offset.first, replaced_text);
-            count++;
-        }
-    }
     if (marked_text) {
         // Merge the replaced marked text into the original text and adjust the marker.
-        QString replaced_text = toPlainText();
-        replaced_text.replace(m_MarkedTextStart, m_MarkedTextEnd - m_MarkedTextStart, text);
-        m_MarkedTextEnd += text.length() - marked_text_length;
-        text = replaced_text;
+        m_MarkedTextEnd += new_text.length() - marked_text_length;
+        new_text = document_text.left(m_MarkedTextStart) + new_text +
+                   document_text.mid(m_MarkedTextStart + marked_text_length);
     }
 
-    QTextCursor cursor = textCursor();
-    // Store the cursor position
-    int cursor_position = cursor.selectionStart();
-    cursor.beginEditBlock();
-    // Replace all text in the document with the new text.
-    cursor.setPosition(cursor_position);
-    cursor.select(QTextCursor::Document);
-    cursor.insertText(text);
-    cursor.endEditBlock();
+    if (count > 0) {
+        // Store the cursor position
+        QTextCursor cursor = textCursor();
+        int cursor_position = cursor.selectionStart();
+        ReplaceDocumentText(new_text);
 
-    // Restore the cursor position
-    cursor.setPosition(cursor_position);
-    setTextCursor(cursor);
+        // Restore the cursor position
+        cursor.setPosition(qMin(cursor_position, new_text.length()));
+        setTextCursor(cursor);
+    }
 
     HighlightCurrentLine();
 
@@ -1149,6 +1199,8 @@ void CodeViewEditor::contextMenuEvent(QContextMenuEvent *event)
     }
 
     menu->exec(event->globalPos());
+    // A lookup still running is of no use once the menu is gone
+    m_spellingSuggester->Cancel();
     delete menu;
 }
 
@@ -1190,28 +1242,29 @@ bool CodeViewEditor::AddSpellCheckContextMenu(QMenu *menu)
         // If a misspelled word is selected try to offer spelling suggestions.
         if (offer_spelling) {
             SpellCheck *sc = SpellCheck::instance();
-            QStringList suggestions = sc->suggest(selected_word);
-            QAction *suggestAction = 0;
+            QStringList suggestions;
 
-            // We want to limit the number of suggestions so we don't
-            // get a huge context menu.
-            for (int i = 0; i < std::min(suggestions.length(), MAX_SPELLING_SUGGESTIONS); ++i) {
-                suggestAction = new QAction(suggestions.at(i), menu);
-                connect(suggestAction, SIGNAL(triggered()), m_spellingMapper, SLOT(map()));
-                m_spellingMapper->setMapping(suggestAction, suggestions.at(i));
+            if (sc->cachedSuggestions(selected_word, suggestions)) {
+                AddSpellingSuggestions(menu, topAction, suggestions);
+
+                // Add a separator to keep our spelling actions differentiated from
+                // the default menu actions.
+                if (!suggestions.isEmpty() && topAction) {
+                    menu->insertSeparator(topAction);
+                }
+            } else {
+                // Hunspell can take a while, so the menu opens without them
+                m_suggestionsPlaceholder = new QAction(tr("Looking up suggestions..."), menu);
+                m_suggestionsPlaceholder->setEnabled(false);
 
-                // If the menu is empty we need to append rather than insert our actions.
                 if (!topAction) {
-                    menu->addAction(suggestAction);
+                    menu->addAction(m_suggestionsPlaceholder);
                 } else {
-                    menu->insertAction(topAction, suggestAction);
+                    menu->insertAction(topAction, m_suggestionsPlaceholder);
+                    m_suggestionsSeparator = menu->insertSeparator(topAction);
                 }
-            }
 
-            // Add a separator to keep our spelling actions differentiated from
-            // the default menu actions.
-            if (!suggestions.isEmpty() && topAction) {
-                menu->insertSeparator(topAction);
+                m_spellingSuggester->Start(selected_word);
             }
 
             // Allow the user to add the misspelled word to their default user dictionary.
@@ -1261,6 +1314,43 @@ bool CodeViewEditor::AddSpellCheckContextMenu(QMenu *menu)
     return offer_spelling;
 }
 
+void CodeViewEditor::AddSpellingSuggestions(QMenu *menu, QAction *before, const QStringList &suggestions)
+{
+    // We want to limit the number of suggestions so we don't
+    // get a huge context menu.
+    for (int i = 0; i < std::min(suggestions.length(), MAX_SPELLING_SUGGESTIONS); ++i) {
+        QAction *suggestAction = new QAction(suggestions.at(i), menu);
+        connect(suggestAction, SIGNAL(triggered()), m_spellingMapper, SLOT(map()));
+        m_spellingMapper->setMapping(suggestAction, suggestions.at(i));
+
+        // If the menu is empty we need to append rather than insert our actions.
+        if (!before) {
+            menu->addAction(suggestAction);
+        } else {
+            menu->insertAction(before, suggestAction);
+        }
+    }
+}
+
+void CodeViewEditor::SpellingSuggestionsReady(const QString &word, const QStringList &suggestions)
+{
+    Q_UNUSED(word);
+
+    // The menu was closed meanwhile
+    if (!m_suggestionsPlaceholder) {
+        return;
+    }
+
+    QMenu *menu = qobject_cast<QMenu *>(m_suggestionsPlaceholder->parent());
+    AddSpellingSuggestions(menu, m_suggestionsPlaceholder, suggestions);
+
+    if (suggestions.isEmpty() && m_suggestionsSeparator) {
+        delete m_suggestionsSeparator;
+    }
+
+    delete m_suggestionsPlaceholder;
+}
+
 QString CodeViewEditor::GetCurrentWordAtCaret(bool select_word)
 {
     QTextCursor c = textCursor();
@@ -1454,6 +1544,7 @@ void CodeViewEditor::AddClipContextMenu(QMenu *menu)
         menu->addMenu(clips_menu);
     }
 
+    ClipEditorModel::instance()->FetchAllEntries();
     CreateMenuEntries(clips_menu, 0, ClipEditorModel::instance()->invisibleRootItem());
 
     QAction *saveClipAction = new QAction(tr("Add To Clips") + "...", menu);
@@ -1710,12 +1801,13 @@ bool CodeViewEditor::IsAddToIndexAllowed()
 bool CodeViewEditor::IsInsertIdAllowed()
 {
     int pos = textCursor().selectionStart();
-    QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         return false;
     }
 
+    QString text = toPlainText();
+
     // Only allow if the closing tag we're in is an "a" tag
     QString closing_tag_name = GetClosingTagName(pos, text);
 
@@ -1736,12 +1828,13 @@ bool CodeViewEditor::IsInsertIdAllowed()
 bool CodeViewEditor::IsInsertHyperlinkAllowed()
 {
     int pos = textCursor().selectionStart();
-    QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         return false;
     }
 
+    QString text = toPlainText();
+
     // Only allow if the closing tag we're in is an "a" tag
     QString closing_tag_name = GetClosingTagName(pos, text);
 
@@ -1762,8 +1855,7 @@ bool CodeViewEditor::IsInsertHyperlinkAllowed()
 bool CodeViewEditor::IsInsertFileAllowed()
 {
     int pos = textCursor().selectionStart();
-    QString text = toPlainText();
-    return IsPositionInBody(pos, text) && !IsPositionInTag(pos, text);
+    return IsPositionInBody(pos) && !IsPositionInTag(pos);
 }
 
 bool CodeViewEditor::InsertId(const QString &attribute_value)
@@ -1889,6 +1981,27 @@ void CodeViewEditor::TextChangedFilter()
 
 void CodeViewEditor::RehighlightDocument()
 {
+    // The highlighter caches its settings instead of reading them per line
+    XHTMLHighlighter *xhtml_highlighter = dynamic_cast<XHTMLHighlighter *>(m_Highlighter);
+
+    if (xhtml_highlighter) {
+        xhtml_highlighter->ReloadSettings();
+
+        TextDocument *text_document = qobject_cast<TextDocument *>(document());
+
+        // Done even when hidden, so the full pass QSyntaxHighlighter
+        // queues on setDocument is never left to run. A document built
+        // off the GUI thread comes with its states, so it is shown
+        // without waiting for any of it to be highlighted.
+        if (document()->characterCount() >= PROGRESSIVE_HIGHLIGHT_CHARS ||
+            (text_document && text_document->highlightStatesReady())) {
+            StartProgressiveHighlight(xhtml_highlighter);
+            return;
+        }
+    }
+
+    StopProgressiveHighlight();
+
     if (!isVisible()) {
         return;
     }
@@ -1897,6 +2010,7 @@ void CodeViewEditor::RehighlightDocument()
         // We block signals from the document while highlighting takes place,
         // because we do not want the contentsChanged() signal to be fired
         // which would mark the underlying resource as needing saving.
+        SIGIL_TRACE_SCOPE("Highlight document");
         document()->blockSignals(true);
         m_Highlighter->rehighlight();
         document()->blockSignals(false);
@@ -1904,6 +2018,139 @@ void CodeViewEditor::RehighlightDocument()
 }
 
 
+void CodeViewEditor::StartProgressiveHighlight(XHTMLHighlighter *highlighter)
+{
+    m_ProgressiveHighlight = true;
+    // Working out only the states is a plain scan of the text. With every
+    // state in place, highlighting a block later on changes nothing after
+    // it, so each block is done once.
+    // The pass is still made when they were worked out ahead, as it
+    // is what keeps QSyntaxHighlighter from queuing a full one, but
+    // then each block is only stepped over.
+    TextDocument *text_document = qobject_cast<TextDocument *>(document());
+    bool states_ready = text_document && text_document->highlightStatesReady();
+    SIGIL_TRACE_SCOPE("Highlight states");
+    document()->blockSignals(true);
+    highlighter->SetDetail(states_ready ? XHTMLHighlighter::Detail_KeepState : XHTMLHighlighter::Detail_StateOnly);
+    m_Highlighter->rehighlight();
+    highlighter->SetDetail(XHTMLHighlighter::Detail_Full);
+    document()->blockSignals(false);
+
+    if (text_document) {
+        text_document->setHighlightStatesReady(false);
+    }
+
+    HighlightVisibleBlocks();
+    m_ProgressiveHighlightCursor = QTextCursor(document());
+    m_ProgressiveHighlightTimer.start();
+}
+
+
+void CodeViewEditor::StopProgressiveHighlight()
+{
+    m_ProgressiveHighlight = false;
+    m_ProgressiveHighlightTimer.stop();
+    m_VisibleHighlightTimer.stop();
+    m_ProgressiveHighlightCursor = QTextCursor();
+}
+
+
+void CodeViewEditor::HighlightNextChunk()
+{
+    XHTMLHighlighter *xhtml_highlighter = dynamic_cast<XHTMLHighlighter *>(m_Highlighter);
+
+    if (!m_ProgressiveHighlight || !xhtml_highlighter || m_ProgressiveHighlightCursor.isNull()) {
+        m_ProgressiveHighlightTimer.stop();
+        return;
+    }
+
+    int first_near = 0;
+    int last_near = -1;
+    GetNearVisibleBlockRange(first_near, last_near);
+    QTextBlock block = m_ProgressiveHighlightCursor.block();
+    SIGIL_TRACE_SCOPE("Highlight chunk");
+    QElapsedTimer slice;
+    slice.start();
+    document()->blockSignals(true);
+
+    while (block.isValid() && slice.elapsed() < PROGRESSIVE_HIGHLIGHT_SLICE_MS) {
+        int block_number = block.blockNumber();
+
+        // Spelling is left for when the block is scrolled to
+        if (block_number >= first_near && block_number <= last_near) {
+            xhtml_highlighter->SetDetail(XHTMLHighlighter::Detail_Full);
+        } else {
+            xhtml_highlighter->SetDetail(XHTMLHighlighter::Detail_NoSpelling);
+        }
+
+        m_Highlighter->rehighlightBlock(block);
+        block = block.next();
+    }
+
+    xhtml_highlighter->SetDetail(XHTMLHighlighter::Detail_Full);
+    document()->blockSignals(false);
+
+    if (!block.isValid()) {
+        m_ProgressiveHighlightTimer.stop();
+        return;
+    }
+
+    m_ProgressiveHighlightCursor.setPosition(block.position());
+}
+
+
+void CodeViewEditor::HighlightVisibleBlocks()
+{
+    if (!m_ProgressiveHighlight || !m_Highlighter || !isVisible()) {
+        return;
+    }
+
+    int first_near = 0;
+    int last_near = -1;
+    GetNearVisibleBlockRange(first_near, last_near);
+    QTextBlock block = document()->findBlockByNumber(first_near);
+    SIGIL_TRACE_SCOPE("Highlight visible blocks");
+    document()->blockSignals(true);
+
+    while (block.isValid() && block.blockNumber() <= last_near) {
+        m_Highlighter->rehighlightBlock(block);
+        block = block.next();
+    }
+
+    document()->blockSignals(false);
+}
+
+
+void CodeViewEditor::DelayHighlightVisibleBlocks()
+{
+    if (m_ProgressiveHighlight) {
+        m_VisibleHighlightTimer.start();
+    }
+}
+
+
+void CodeViewEditor::GetNearVisibleBlockRange(int &first, int &last)
+{
+    QTextBlock block = firstVisibleBlock();
+    first = block.blockNumber();
+    last = first;
+    int bottom = viewport()->height();
+
+    while (block.isValid()) {
+        if (blockBoundingGeometry(block).translated(contentOffset()).top() > bottom) {
+            break;
+        }
+
+        last = block.blockNumber();
+        block = block.next();
+    }
+
+    int margin = last - first + 1;
+    first = qMax(0, first - margin);
+    last += margin;
+}
+
+
 void CodeViewEditor::UpdateUndoAvailable(bool available)
 {
     m_isUndoAvailable = available;
@@ -1926,7 +2173,9 @@ void CodeViewEditor::UpdateLineNumberArea(const QRect &area_to_update, int verti
         m_LineNumberArea->update(0, area_to_update.y(), m_LineNumberArea->width(), area_to_update.height());
     }
 
-    if (area_to_update.contains(viewport()->rect())) {
+    // In large files the margin only follows blockCountChanged,
+    // since setting it lays out the viewport again
+    if (!m_LargeFileMode && area_to_update.contains(viewport()->rect())) {
         UpdateLineNumberAreaMargin();
     }
 }
@@ -1937,12 +2186,14 @@ void CodeViewEditor::HighlightCurrentLine()
     QList<QTextEdit::ExtraSelection> extraSelections;
 
     // Draw the full width line color.
-    QTextEdit::ExtraSelection selection_line;
-    selection_line.format.setBackground(m_codeViewAppearance.line_highlight_color);
-    selection_line.format.setProperty(QTextFormat::FullWidthSelection, true);
-    selection_line.cursor = textCursor();
-    selection_line.cursor.clearSelection();
-    extraSelections.append(selection_line);
+    if (!m_LargeFileMode) {
+        QTextEdit::ExtraSelection selection_line;
+        selection_line.format.setBackground(m_codeViewAppearance.line_highlight_color);
+        selection_line.format.setProperty(QTextFormat::FullWidthSelection, true);
+        selection_line.cursor = textCursor();
+        selection_line.cursor.clearSelection();
+        extraSelections.append(selection_line);
+    }
 
     // Add highlighting of the marked text
     if (IsMarkedText()) {
@@ -2214,26 +2465,13 @@ QString CodeViewEditor::GetCaretElementName()
 
 QList<ViewEditor::ElementIndex> CodeViewEditor::GetCaretLocation()
 {
-    // We search for the first opening tag *behind* the caret.
-    // This specifies the element the caret is located in.
-    int pos = textCursor().position();
-    int offset = 0;
-    int len = 0;
-    QRegularExpression tag(XML_OPENING_TAG);
-    QRegularExpressionMatchIterator i = tag.globalMatch(toPlainText());
-    // There is no way to search for the last match (str.lastIndexOf) in a string and also have
-    // the matched text length. So we search forward for every match (QRegularExpression doesn't
-    // have a way to search backwards) and only use the last match's info.
-    while (i.hasNext()) {
-        QRegularExpressionMatch mo = i.next();
-        int start = mo.capturedStart();
-        if (start > pos) {
-            break;
-        }
-        offset = start;
-        len = mo.capturedLength();
+    // Working out the location means parsing the text up to the caret
+    if (m_LargeFileMode) {
+        m_element_name.clear();
+        return QList<ViewEditor::ElementIndex>();
     }
-    QList<ViewEditor::ElementIndex> hierarchy = ConvertStackToHierarchy(GetCaretLocationStack(offset + len));
+
+    QList<ViewEditor::ElementIndex> hierarchy = ConvertStackToHierarchy(GetCaretLocationStack(textCursor().position()));
 
     // determine last block element containing caret
     QString element_name;
@@ -2254,48 +2492,19 @@ void CodeViewEditor::StoreCaretLocationUpdate(const QList<ViewEditor::ElementInd
 }
 
 
-QStack<CodeViewEditor::StackElement> CodeViewEditor::GetCaretLocationStack(int offset) const
+QStack<CodeViewEditor::StackElement> CodeViewEditor::GetCaretLocationStack(int position)
 {
-    QString source = toPlainText();
-    QXmlStreamReader reader(source);
     QStack<StackElement> stack;
-
-    while (!reader.atEnd()) {
-        reader.readNext();
-
-        if (reader.isStartElement()) {
-            // If we detected the start of a new element, then
-            // the element currently on the top of the stack
-            // has one more child element
-            if (!stack.isEmpty()) {
-                stack.top().num_children++;
-            }
-
-            StackElement new_element;
-            new_element.name         = reader.name().toString();
-            new_element.num_children = 0;
-            stack.push(new_element);
-
-            // Check if this is the element start tag
-            // we are looking for
-            if (reader.characterOffset() == offset) {
-                break;
-            }
-        }
-        // If we detect the end tag of an element,
-        // we remove it from the top of the stack
-        else if (reader.isEndElement()) {
-            stack.pop();
-        }
+    foreach(StackElement element, m_NestingIndex.StackAfterLastStartTag(position)) {
+        stack.push(element);
     }
+    return stack;
+}
 
-    if (reader.hasError()) {
-        // Just return an empty location.
-        // Maybe we could return the stack we currently have?
-        return QStack<StackElement>();
-    }
 
-    return stack;
+void CodeViewEditor::UpdateNestingIndex(int position, int chars_removed, int chars_added)
+{
+    m_NestingIndex.ContentsChanged(position, chars_removed, chars_added);
 }
 
 
@@ -2326,11 +2535,17 @@ QList<ViewEditor::ElementIndex> CodeViewEditor::ConvertStackToHierarchy(const QS
 std::tuple<int, int> CodeViewEditor::ConvertHierarchyToCaretMove(const QList<ViewEditor::ElementIndex> &hierarchy) const
 {
     QString source = toPlainText();
-    QString version = "any_version";
-    GumboInterface gi = GumboInterface(source, version);
-    gi.parse();
+    if (m_CaretParse.isNull()) {
+        QString version = "any_version";
+        m_CaretParse = QSharedPointer<GumboInterface>(new GumboInterface(source, version));
+        m_CaretParse->parse();
+    } else {
+        m_CaretParse->reparse(source);
+    }
+    // kept until the next edit, like the parse itself
+    m_CaretParse->build_node_index();
     QString webpath = ConvertHierarchyToQWebPath(hierarchy);
-    GumboNode* end_node = gi.get_node_from_qwebpath(webpath);
+    GumboNode* end_node = m_CaretParse->get_node_from_qwebpath(webpath);
     if (!end_node) {
       return std::make_tuple(0, 0);
     }
@@ -2354,6 +2569,10 @@ bool CodeViewEditor::ExecuteCaretUpdate(bool default_to_top)
 {
     // If there's a cursor/caret update waiting (from BookView),
     // we update the caret location and reset the update variable
+    if (m_LargeFileMode) {
+        m_CaretUpdate.clear();
+    }
+
     if (m_CaretUpdate.isEmpty()) {
         if (default_to_top) {
             QTextCursor cursor = textCursor();
@@ -2400,7 +2619,7 @@ void CodeViewEditor::FormatBlock(const QString &element_name, bool preserve_attr
     int pos = textCursor().selectionStart();
     QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         // User is outside the body so not allowed to change or insert a block tag
         return;
     }
@@ -2541,7 +2760,7 @@ void CodeViewEditor::InsertHTMLTagAroundSelection(const QString &left_element_na
     setTextCursor(cursor);
 }
 
-bool CodeViewEditor::IsPositionInBody(const int &pos, const QString &text)
+bool CodeViewEditor::IsPositionInBody(const int &pos)
 {
     int search_pos = pos;
 
@@ -2549,27 +2768,10 @@ bool CodeViewEditor::IsPositionInBody(const int &pos, const QString &text)
         search_pos = textCursor().selectionStart();
     }
 
-    QString search_text = text;
-
-    if (text.isEmpty()) {
-        search_text = toPlainText();
-    }
-
-    QRegularExpression body_search(BODY_START, QRegularExpression::CaseInsensitiveOption);
-    QRegularExpressionMatch mo = body_search.match(search_text);
-    int body_tag_end   = mo.capturedEnd();
-
-    QRegularExpression body_end_search(BODY_END, QRegularExpression::CaseInsensitiveOption);
-    int body_contents_end = search_text.indexOf(body_end_search);
-
-    if ((search_pos < body_tag_end) || (search_pos > body_contents_end)) {
-        return false;
-    }
-
-    return true;
+    return m_NestingIndex.IsInElement(search_pos, "body");
 }
 
-bool CodeViewEditor::IsPositionInTag(const int &pos, const QString &text)
+bool CodeViewEditor::IsPositionInTag(const int &pos)
 {
     int search_pos = pos;
 
@@ -2577,34 +2779,10 @@ bool CodeViewEditor::IsPositionInTag(const int &pos, const QString &text)
         search_pos = textCursor().selectionStart();
     }
 
-    QString search_text = text;
-
-    if (text.isEmpty()) {
-        search_text = toPlainText();
-    }
-
-    int tag_start = -1;
-    int tag_end = -1;
-    QRegularExpression tag_search(NEXT_TAG_LOCATION);
-    QRegularExpressionMatchIterator i = tag_search.globalMatch(search_text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch mo = i.next();
-        int start = mo.capturedStart();
-        if (start > search_pos-1) {
-            break;
-        }
-        tag_start = start;
-        tag_end = mo.capturedEnd();
-    }
-
-    if ((search_pos >= tag_start) && (search_pos < tag_end)) {
-        return true;
-    }
-
-    return false;
+    return m_NestingIndex.IsInTag(search_pos);
 }
 
-bool CodeViewEditor::IsPositionInOpeningTag(const int &pos, const QString &text)
+bool CodeViewEditor::IsPositionInOpeningTag(const int &pos)
 {
     int search_pos = pos;
 
@@ -2612,34 +2790,10 @@ bool CodeViewEditor::IsPositionInOpeningTag(const int &pos, const QString &text)
         search_pos = textCursor().selectionStart();
     }
 
-    QString search_text = text;
-
-    if (text.isEmpty()) {
-        search_text = toPlainText();
-    }
-
-    int tag_start = -1;
-    int tag_end = -1;
-    QRegularExpression tag_search("<\\s*[^/][^>]*>");
-    QRegularExpressionMatchIterator i = tag_search.globalMatch(search_text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch mo = i.next();
-        int start = mo.capturedStart();
-        if (start > search_pos-1) {
-            break;
-        }
-        tag_start = start;
-        tag_end = mo.capturedEnd();
-    }
-
-    if ((search_pos >= tag_start) && (search_pos < tag_end)) {
-        return true;
-    }
-
-    return false;
+    return m_NestingIndex.IsInStartTag(search_pos);
 }
 
-bool CodeViewEditor::IsPositionInClosingTag(const int &pos, const QString &text)
+bool CodeViewEditor::IsPositionInClosingTag(const int &pos)
 {
     int search_pos = pos;
 
@@ -2647,31 +2801,7 @@ bool CodeViewEditor::IsPositionInClosingTag(const int &pos, const QString &text)
         search_pos = textCursor().selectionStart();
     }
 
-    QString search_text = text;
-
-    if (text.isEmpty()) {
-        search_text = toPlainText();
-    }
-
-    int tag_start = -1;
-    int tag_end = -1;
-    QRegularExpression tag_search("<\\s*/[^>]*>");
-    QRegularExpressionMatchIterator i = tag_search.globalMatch(search_text);
-    while (i.hasNext()) {
-        QRegularExpressionMatch mo = i.next();
-        int start = mo.capturedStart();
-        if (start > search_pos-1) {
-            break;
-        }
-        tag_start = start;
-        tag_end = mo.capturedEnd();
-    }
-
-    if ((search_pos >= tag_start) && (search_pos < tag_end)) {
-        return true;
-    }
-
-    return false;
+    return m_NestingIndex.IsInEndTag(search_pos);
 }
 
 QString CodeViewEditor::GetOpeningTagName(const int &pos, const QString &text)
@@ -2753,7 +2883,7 @@ void CodeViewEditor::ToggleFormatSelection(const QString &element_name, const QS
     int pos = textCursor().selectionStart();
     QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         // We are in an HTML file outside the body element. We might possibly be in an
         // inline CSS style so attempt to format that.
         if (!property_name.isEmpty()) {
@@ -2764,8 +2894,8 @@ void CodeViewEditor::ToggleFormatSelection(const QString &element_name, const QS
     }
 
     // We might have a selection that begins or ends in a tag < > itself
-    if (IsPositionInTag(textCursor().selectionStart(), text) ||
-        IsPositionInTag(textCursor().selectionEnd(), text)) {
+    if (IsPositionInTag(textCursor().selectionStart()) ||
+        IsPositionInTag(textCursor().selectionEnd())) {
         // Not allowed to toggle style if caret placed on a tag
         return;
     }
@@ -3030,7 +3160,7 @@ QString CodeViewEditor::ProcessAttribute(const QString &attribute_name, QStringL
     int original_position = textCursor().position();
     QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         return QString();
     }
 
@@ -3052,7 +3182,7 @@ QString CodeViewEditor::ProcessAttribute(const QString &attribute_name, QStringL
 
     // If we're in a closing tag, move to the text between tags
     // just before/at < to make parsing easier.
-    if (IsPositionInClosingTag(pos, text)) {
+    if (IsPositionInClosingTag(pos)) {
         while (pos > 0 && text[pos] != QChar('<')) {
             pos--;
         }
@@ -3210,8 +3340,7 @@ void CodeViewEditor::FormatTextDir(const QString &attribute_value)
     // Going to assume that the user is allowed to click anywhere within or just after the block
     // Also makes assumptions about being well formed, or else crazy things may happen...
     int pos = textCursor().selectionStart();
-    QString text = toPlainText();
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         return;
     }
     // Apply the modified attribute.
@@ -3230,9 +3359,8 @@ void CodeViewEditor::FormatStyle(const QString &property_name, const QString &pr
     // Going to assume that the user is allowed to click anywhere within or just after the block
     // Also makes assumptions about being well formed, or else crazy things may happen...
     int pos = textCursor().selectionStart();
-    QString text = toPlainText();
 
-    if (!IsPositionInBody(pos, text)) {
+    if (!IsPositionInBody(pos)) {
         // Either we are in a CSS file, or we are in an HTML file outside the body element.
         // Treat both these cases as trying to find a CSS style on the current line
         FormatCSSStyle(property_name, property_value);
@@ -3383,11 +3511,7 @@ void CodeViewEditor::ReformatCSS(bool multiple_line_format)
     const QString &new_text = css_info.getReformattedCSSText(multiple_line_format);
 
     if (original_text != new_text) {
-        QTextCursor cursor = textCursor();
-        cursor.beginEditBlock();
-        cursor.select(QTextCursor::Document);
-        cursor.insertText(new_text);
-        cursor.endEditBlock();
+        ReplaceDocumentText(new_text);
     }
 }
 
@@ -3417,11 +3541,7 @@ void CodeViewEditor::ReformatHTML(bool all, bool to_valid)
 
         if (original_text != new_text) {
 	    StoreCaretLocationUpdate(GetCaretLocation());
-            QTextCursor cursor = textCursor();
-            cursor.beginEditBlock();
-            cursor.select(QTextCursor::Document);
-            cursor.insertText(new_text);
-            cursor.endEditBlock();
+            ReplaceDocumentText(new_text);
 	    ExecuteCaretUpdate();
         }
     }
@@ -3802,10 +3922,16 @@ void CodeViewEditor::ConnectSignalsToSlots()
     connect(this, SIGNAL(textChanged()), this, SIGNAL(PageUpdated()));
     connect(this, SIGNAL(textChanged()), this, SLOT(TextChangedFilter()));
     connect(this, SIGNAL(undoAvailable(bool)), this, SLOT(UpdateUndoAvailable(bool)));
+    connect(document(), SIGNAL(contentsChange(int, int, int)), this, SLOT(UpdateNestingIndex(int, int, int)));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(DelayHighlightVisibleBlocks()));
+    connect(&m_ProgressiveHighlightTimer, SIGNAL(timeout()), this, SLOT(HighlightNextChunk()));
+    connect(&m_VisibleHighlightTimer, SIGNAL(timeout()), this, SLOT(HighlightVisibleBlocks()));
     connect(this, SIGNAL(selectionChanged()), this, SLOT(ResetLastFindMatch()));
     connect(m_ScrollOneLineUp,   SIGNAL(activated()), this, SLOT(ScrollOneLineUp()));
     connect(m_ScrollOneLineDown, SIGNAL(activated()), this, SLOT(ScrollOneLineDown()));
     connect(m_spellingMapper, SIGNAL(mapped(const QString &)), this, SLOT(InsertText(const QString &)));
+    connect(m_spellingSuggester, SIGNAL(Ready(const QString &, const QStringList &)),
+            this, SLOT(SpellingSuggestionsReady(const QString &, const QStringList &)));
     connect(m_addSpellingMapper, SIGNAL(mapped(const QString &)), this, SLOT(addToDefaultDictionary(const QString &)));
     connect(m_addDictMapper, SIGNAL(mapped(const QString &)), this, SLOT(addToUserDictionary(const QString &)));
     connect(m_ignoreSpellingMapper, SIGNAL(mapped(const QString &)), this, SLOT(ignoreWord(const QString &)));
@@ -25,7 +25,10 @@
 #define CODEVIEWEDITOR_H
 
 #include <QtCore/QList>
+#include <QtCore/QPointer>
+#include <QtCore/QSharedPointer>
 #include <QtCore/QStack>
+#include <QtCore/QTimer>
 #include <QtWidgets/QPlainTextEdit>
 #include <QtGui/QStandardItem>
 #include <QtCore/QUrl>
@@ -37,6 +40,7 @@
 #include "Misc/TextDocument.h"
 #include "MiscEditors/ClipEditorModel.h"
 #include "MiscEditors/IndexEditorModel.h"
+#include "ViewEditors/TagNestingIndex.h"
 #include "ViewEditors/ViewEditor.h"
 
 class QResizeEvent;
@@ -48,6 +52,9 @@ class LineNumberArea;
 class QSyntaxHighlighter;
 class QContextMenuEvent;
 class QSignalMapper;
+class GumboInterface;
+class SpellingSuggester;
+class XHTMLHighlighter;
 
 /**
  * A text editor for source code.
@@ -88,6 +95,23 @@ public:
      */
     void CustomSetDocument(TextDocument &document);
 
+    /**
+     * @return \c true if the document was large enough when it was set
+     *         for the view to run in its reduced, large file mode.
+     */
+    bool IsLargeFileMode() const;
+
+    /**
+     * Undoes the last edit or, once there are no undo steps left, goes
+     * back to the newest compressed snapshot of the trimmed history.
+     */
+    void Undo();
+
+    /**
+     * @return The estimated bytes held by the document's undo history.
+     */
+    qint64 GetUndoMemory() const;
+
     void DeleteLine();
 
     void HighlightMarkedText();
@@ -183,6 +207,7 @@ public:
     /**
      * Replaces the text of the entire document with the new text.
      * Records the replacement as one action for the undo stack.
+     * Only the lines that differ are touched.
      *
      * @param new_text The new text of the document.
      */
@@ -382,6 +407,11 @@ signals:
      */
     void ZoomFactorChanged(float new_zoom_factor);
 
+    /**
+     * Emitted when the estimated memory of the undo history changes.
+     */
+    void UndoMemoryChanged(qint64 bytes);
+
     /**
      * Emitted when the focus is lost.
      */
@@ -504,6 +534,26 @@ private slots:
 
     void RehighlightDocument();
 
+    /**
+     * Highlights the next slice of a large document in the background.
+     */
+    void HighlightNextChunk();
+
+    /**
+     * Highlights, spelling included, the blocks in and around the view.
+     */
+    void HighlightVisibleBlocks();
+
+    /**
+     * Waits for scrolling to settle before HighlightVisibleBlocks.
+     */
+    void DelayHighlightVisibleBlocks();
+
+    /**
+     * Keeps m_NestingIndex in step with the document.
+     */
+    void UpdateNestingIndex(int position, int chars_removed, int chars_added);
+
     void PasteClipEntryFromName(const QString &name);
 
     /**
@@ -545,6 +595,12 @@ private slots:
 
     void InsertText(const QString &text);
 
+    /**
+     * Puts the suggestions looked up for the open context menu
+     * in place of its placeholder.
+     */
+    void SpellingSuggestionsReady(const QString &word, const QStringList &suggestions);
+
     void addToUserDictionary(const QString &text);
     void addToDefaultDictionary(const QString &text);
     void ignoreWord(const QString &text);
@@ -564,6 +620,21 @@ private slots:
 private:
     bool IsMarkedText();
 
+    /**
+     * Highlights a large document without blocking: every block gets
+     * its state at once, the view is highlighted next and the rest of
+     * the document in timed slices while the GUI is idle.
+     */
+    void StartProgressiveHighlight(XHTMLHighlighter *highlighter);
+
+    void StopProgressiveHighlight();
+
+    /**
+     * The numbers of the blocks in the view, widened by
+     * as many again above and below.
+     */
+    void GetNearVisibleBlockRange(int &first, int &last);
+
     QString RemoveFirstTag(const QString &text, const QString &tagname);
     QString RemoveLastTag(const QString &text, const QString &tagname);
 
@@ -633,6 +704,8 @@ private:
 
     bool AddSpellCheckContextMenu(QMenu *menu);
 
+    void AddSpellingSuggestions(QMenu *menu, QAction *before, const QStringList &suggestions);
+
     void AddViewImageContextMenu(QMenu *menu);
 
     bool CreateMenuEntries(QMenu *parent_menu, QAction *topAction, QStandardItem *item);
@@ -643,28 +716,17 @@ private:
      * An element on the stack when searching for
      * the current caret location.
      */
-    struct StackElement {
-        /**
-         * The tag name.
-         */
-        QString name;
-
-        /**
-         * The number of child elements
-         * detected for the element, so far.
-         */
-        int num_children;
-    };
+    typedef TagNestingIndex::Element StackElement;
 
     /**
      * Returns a stack of elements representing the
      * current location of the caret in the document.
      *
-     * @param offset The number of characters from document start to the end of
-     *               the start tag of the element the caret is residing in.
+     * @param position The caret position. The caret is taken to be in the
+     *                 element of the last start tag beginning at or before it.
      * @return The element location stack.
      */
-    QStack<StackElement> GetCaretLocationStack(int offset) const;
+    QStack<StackElement> GetCaretLocationStack(int position);
 
     /**
      * Takes the stack provided by GetCaretLocationStack()
@@ -699,10 +761,10 @@ private:
     /**
      * Is this position within the <body> tag of this text.
      */
-    bool IsPositionInBody(const int &pos = -1, const QString &text = QString());
-    bool IsPositionInTag(const int &pos = -1, const QString &text = QString());
-    bool IsPositionInOpeningTag(const int &pos = -1, const QString &text = QString());
-    bool IsPositionInClosingTag(const int &pos = -1, const QString &text = QString());
+    bool IsPositionInBody(const int &pos = -1);
+    bool IsPositionInTag(const int &pos = -1);
+    bool IsPositionInOpeningTag(const int &pos = -1);
+    bool IsPositionInClosingTag(const int &pos = -1);
     QString GetOpeningTagName(const int &pos, const QString &text);
     QString GetClosingTagName(const int &pos, const QString &text);
 
@@ -814,6 +876,12 @@ private:
      */
     QList<ViewEditor::ElementIndex> m_CaretUpdate;
 
+    /**
+     * The parse the caret update was last worked out on. It is
+     * brought up to date with an edit by only reparsing what changed.
+     */
+    mutable QSharedPointer<GumboInterface> m_CaretParse;
+
     /**
      * Whether spell checking is enabled on this view.
      * Misspellings are marked by the QSyntaxHighlighter used.
@@ -850,10 +918,46 @@ private:
     QSignalMapper *m_ignoreSpellingMapper;
     QSignalMapper *m_clipMapper;
 
+    SpellingSuggester *m_spellingSuggester;
+
+    /**
+     * What stands in for the suggestions in the open context menu
+     * until they are looked up, and the separator after it.
+     */
+    QPointer<QAction> m_suggestionsPlaceholder;
+    QPointer<QAction> m_suggestionsSeparator;
+
     int m_MarkedTextStart;
     int m_MarkedTextEnd;
     bool m_ReplacingInMarkedText;
 
+    /**
+     * Set while the document is too large to highlight in one go.
+     * Spelling is then only underlined in and around the view.
+     */
+    bool m_ProgressiveHighlight;
+
+    /**
+     * Set when the document was at least SettingsStore::largeFileThreshold()
+     * when it was set. Live spell checking, current line highlighting and
+     * caret location parsing are then turned off.
+     */
+    bool m_LargeFileMode;
+
+    /**
+     * The open elements at the start of every line, for working out
+     * the caret location and whether a position is in a tag or the body.
+     */
+    TagNestingIndex m_NestingIndex;
+
+    /**
+     * The first block the background highlighting has yet to do.
+     */
+    QTextCursor m_ProgressiveHighlightCursor;
+
+    QTimer m_ProgressiveHighlightTimer;
+    QTimer m_VisibleHighlightTimer;
+
     /**
      * The fonts and colors for appearance of xhtml and text.
      */
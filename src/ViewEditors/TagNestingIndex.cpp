@@ -0,0 +1,471 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#include <QtGui/QTextDocument>
+
+#include "ViewEditors/TagNestingIndex.h"
+
+// What separates one block from the next
+static const QString BLOCK_SEPARATOR = "\n";
+
+static const QString COMMENT_START = "<!--";
+static const QString CDATA_START   = "<![CDATA[";
+
+
+static inline bool IsTagNameEnd(const QChar &c)
+{
+    return c.isSpace() || c == '>' || c == '/';
+}
+
+
+bool TagNestingIndex::Element::operator==(const Element &other) const
+{
+    return num_children == other.num_children && name == other.name;
+}
+
+
+TagNestingIndex::State::State()
+    :
+    mode(Mode_Text),
+    name_done(false),
+    run(0)
+{
+}
+
+
+bool TagNestingIndex::State::operator==(const State &other) const
+{
+    return mode == other.mode &&
+           name_done == other.name_done &&
+           quote == other.quote &&
+           previous == other.previous &&
+           run == other.run &&
+           tag_name == other.tag_name &&
+           stack == other.stack &&
+           after_last_start_tag == other.after_last_start_tag;
+}
+
+
+TagNestingIndex::TagNestingIndex()
+    :
+    m_Document(NULL),
+    m_ValidBlocks(0)
+{
+}
+
+
+void TagNestingIndex::SetDocument(QTextDocument *document)
+{
+    m_Document = document;
+    m_ValidBlocks = 0;
+}
+
+
+void TagNestingIndex::ContentsChanged(int position, int chars_removed, int chars_added)
+{
+    Q_UNUSED(chars_removed);
+
+    if (!m_Document) {
+        return;
+    }
+
+    QTextBlock block = m_Document->findBlock(position);
+
+    if (!block.isValid()) {
+        block = m_Document->lastBlock();
+    }
+
+    m_ValidBlocks = qMin(m_ValidBlocks, block.blockNumber());
+    // The changed blocks are dropped rather than trusted to
+    // have had their revision bumped
+    int end = position + chars_added;
+
+    while (block.isValid() && block.position() <= end) {
+        block.setUserData(NULL);
+        block = block.next();
+    }
+}
+
+
+QVector<TagNestingIndex::Element> TagNestingIndex::StackAfterLastStartTag(int position)
+{
+    if (!m_Document) {
+        return QVector<Element>();
+    }
+
+    QTextBlock block = m_Document->findBlock(position);
+
+    if (!block.isValid()) {
+        block = m_Document->lastBlock();
+        position = block.position() + block.length() - 1;
+    }
+
+    State state = StartStateOf(block);
+    QString text = block.text();
+    int offset = qMin(position - block.position(), text.length());
+
+    // A tag starting right at the position counts too
+    if (offset < text.length() && text.at(offset) == '<') {
+        offset++;
+    }
+
+    int index = Scan(state, text, 0, offset);
+
+    // When the position is in a start tag, that one is the last;
+    // read on to its end, to the following lines if need be.
+    while (state.mode == Mode_StartTag) {
+        index = Scan(state, text, index, text.length(), true);
+
+        if (state.mode != Mode_StartTag) {
+            break;
+        }
+
+        block = block.next();
+
+        if (!block.isValid()) {
+            break;
+        }
+
+        Scan(state, BLOCK_SEPARATOR, 0, 1, true);
+        text = block.text();
+        index = 0;
+    }
+
+    return state.after_last_start_tag;
+}
+
+
+bool TagNestingIndex::IsInTag(int position)
+{
+    Mode mode = StateAt(position).mode;
+    return mode == Mode_StartTag || mode == Mode_EndTag || mode == Mode_PI;
+}
+
+
+bool TagNestingIndex::IsInStartTag(int position)
+{
+    return StateAt(position).mode == Mode_StartTag;
+}
+
+
+bool TagNestingIndex::IsInEndTag(int position)
+{
+    return StateAt(position).mode == Mode_EndTag;
+}
+
+
+bool TagNestingIndex::IsInElement(int position, const QString &name)
+{
+    State state = StateAt(position);
+
+    // An end tag closes the innermost element
+    int open = state.stack.count();
+
+    if (state.mode == Mode_EndTag) {
+        open--;
+    }
+
+    for (int i = 0; i < open; ++i) {
+        if (state.stack.at(i).name.compare(name, Qt::CaseInsensitive) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+TagNestingIndex::State TagNestingIndex::StateAt(int position)
+{
+    if (!m_Document) {
+        return State();
+    }
+
+    QTextBlock block = m_Document->findBlock(position);
+
+    if (!block.isValid()) {
+        block = m_Document->lastBlock();
+        position = block.position() + block.length() - 1;
+    }
+
+    State state = StartStateOf(block);
+    QString text = block.text();
+    Scan(state, text, 0, qMin(position - block.position(), text.length()));
+    return state;
+}
+
+
+TagNestingIndex::State TagNestingIndex::StartStateOf(const QTextBlock &target)
+{
+    int target_number = target.blockNumber();
+
+    if (target_number < m_ValidBlocks) {
+        BlockData *data = FreshData(target);
+
+        if (data) {
+            return data->start;
+        }
+
+        m_ValidBlocks = target_number;
+    }
+
+    QTextBlock block = m_Document->firstBlock();
+    State state;
+
+    if (m_ValidBlocks > 0) {
+        QTextBlock previous = m_Document->findBlockByNumber(m_ValidBlocks - 1);
+        BlockData *previous_data = FreshData(previous);
+
+        if (previous_data) {
+            state = EndStateOf(previous, previous_data->start);
+            block = previous.next();
+        } else {
+            m_ValidBlocks = 0;
+        }
+    }
+
+    int number = m_ValidBlocks;
+
+    // Every pair of neighbouring blocks with fresh data is kept
+    // consistent: the second starts the way the first ends. That is
+    // what lets an unchanged block hand over to the next without
+    // being scanned.
+    while (block.isValid()) {
+        BlockData *data = FreshData(block);
+        bool rewritten = false;
+
+        if (!data || !(data->start == state)) {
+            if (!data) {
+                data = new BlockData();
+                // Deletes any stale data
+                block.setUserData(data);
+            }
+
+            data->start = state;
+            data->revision = block.revision();
+            rewritten = true;
+        }
+
+        m_ValidBlocks = number + 1;
+        QTextBlock next = block.next();
+        BlockData *next_data = next.isValid() ? FreshData(next) : NULL;
+
+        if (number == target_number) {
+            if (rewritten && next_data && !(next_data->start == EndStateOf(block, state))) {
+                next.setUserData(NULL);
+            }
+
+            return state;
+        }
+
+        if (!rewritten && next_data) {
+            state = next_data->start;
+        } else {
+            state = EndStateOf(block, state);
+        }
+
+        block = next;
+        number++;
+    }
+
+    return state;
+}
+
+
+TagNestingIndex::State TagNestingIndex::EndStateOf(const QTextBlock &block, const State &start) const
+{
+    State state = start;
+    QString text = block.text();
+    Scan(state, text, 0, text.length());
+
+    if (block.next().isValid()) {
+        Scan(state, BLOCK_SEPARATOR, 0, 1);
+    }
+
+    return state;
+}
+
+
+TagNestingIndex::BlockData *TagNestingIndex::FreshData(const QTextBlock &block)
+{
+    BlockData *data = dynamic_cast<BlockData *>(block.userData());
+
+    if (!data || data->revision != block.revision()) {
+        return NULL;
+    }
+
+    return data;
+}
+
+
+int TagNestingIndex::Scan(State &state, const QString &text, int from, int to, bool stop_at_tag_end)
+{
+    const QChar *chars = text.constData();
+    const int length = text.length();
+    int i = from;
+
+    while (i < to) {
+        const QChar c = chars[i];
+
+        switch (state.mode) {
+            case Mode_Text:
+                if (c == '<') {
+                    QChar next = i + 1 < length ? chars[i + 1] : QChar();
+
+                    if (next == '!' && text.midRef(i, COMMENT_START.length()) == COMMENT_START) {
+                        state.mode = Mode_Comment;
+                        state.run = 0;
+                        i += COMMENT_START.length();
+                    } else if (next == '!' && text.midRef(i, CDATA_START.length()) == CDATA_START) {
+                        state.mode = Mode_CDATA;
+                        state.run = 0;
+                        i += CDATA_START.length();
+                    } else if (next == '!') {
+                        state.mode = Mode_Doctype;
+                        i += 2;
+                    } else if (next == '?') {
+                        state.mode = Mode_PI;
+                        state.previous = QChar();
+                        i += 2;
+                    } else {
+                        state.mode = next == '/' ? Mode_EndTag : Mode_StartTag;
+                        state.tag_name.clear();
+                        state.name_done = false;
+                        state.quote = QChar();
+                        state.previous = QChar();
+                        i += next == '/' ? 2 : 1;
+                    }
+
+                    continue;
+                }
+
+                break;
+
+            case Mode_StartTag:
+            case Mode_EndTag:
+                if (!state.quote.isNull()) {
+                    if (c == state.quote) {
+                        state.quote = QChar();
+                    }
+
+                    break;
+                }
+
+                if (!state.name_done) {
+                    if (!IsTagNameEnd(c)) {
+                        state.tag_name.append(c);
+                        break;
+                    }
+
+                    state.name_done = true;
+                }
+
+                if (c == '>') {
+                    EndTag(state);
+                    i++;
+
+                    if (stop_at_tag_end) {
+                        return i;
+                    }
+
+                    continue;
+                }
+
+                if ((c == '"' || c == '\'') && state.mode == Mode_StartTag) {
+                    state.quote = c;
+                }
+
+                if (!c.isSpace()) {
+                    state.previous = c;
+                }
+
+                break;
+
+            case Mode_Comment:
+                if (c == '>' && state.run >= 2) {
+                    state.mode = Mode_Text;
+                }
+
+                state.run = c == '-' ? state.run + 1 : 0;
+                break;
+
+            case Mode_CDATA:
+                if (c == '>' && state.run >= 2) {
+                    state.mode = Mode_Text;
+                }
+
+                state.run = c == ']' ? state.run + 1 : 0;
+                break;
+
+            case Mode_PI:
+                if (c == '>' && state.previous == '?') {
+                    state.mode = Mode_Text;
+                }
+
+                state.previous = c;
+                break;
+
+            case Mode_Doctype:
+                // XHTML doctypes have no internal subset
+                if (c == '>') {
+                    state.mode = Mode_Text;
+                }
+
+                break;
+        }
+
+        i++;
+    }
+
+    return i;
+}
+
+
+void TagNestingIndex::EndTag(State &state)
+{
+    if (state.mode == Mode_StartTag) {
+        if (!state.stack.isEmpty()) {
+            state.stack.last().num_children++;
+        }
+
+        // QXmlStreamReader::name() is the local name
+        int colon = state.tag_name.indexOf(':');
+        Element element;
+        element.name = colon == -1 ? state.tag_name : state.tag_name.mid(colon + 1);
+        element.num_children = 0;
+        state.stack.append(element);
+
+        if (state.previous == '/') {
+            state.stack.removeLast();
+        } else {
+            state.after_last_start_tag = state.stack;
+        }
+    } else if (!state.stack.isEmpty()) {
+        state.stack.removeLast();
+    }
+
+    state.mode = Mode_Text;
+    state.tag_name.clear();
+    state.name_done = false;
+    state.quote = QChar();
+    state.previous = QChar();
+}
@@ -0,0 +1,176 @@
+/************************************************************************
+**
+**  Copyright (C) 2019 Kevin B. Hendricks, Stratford, Ontario Canada
+**
+**  This file is part of Sigil.
+**
+**  Sigil is free software: you can redistribute it and/or modify
+**  it under the terms of the GNU General Public License as published by
+**  the Free Software Foundation, either version 3 of the License, or
+**  (at your option) any later version.
+**
+**  Sigil is distributed in the hope that it will be useful,
+**  but WITHOUT ANY WARRANTY; without even the implied warranty of
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**  GNU General Public License for more details.
+**
+**  You should have received a copy of the GNU General Public License
+**  along with Sigil.  If not, see <http://www.gnu.org/licenses/>.
+**
+*************************************************************************/
+
+
+#pragma once
+#ifndef TAGNESTINGINDEX_H
+#define TAGNESTINGINDEX_H
+
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <QtGui/QTextBlock>
+
+class QTextDocument;
+
+/**
+ * The open element stack at the start of every block (line) of a
+ * Code View document, kept in the blocks' QTextBlockUserData.
+ *
+ * Nothing is worked out until asked for. A query reads the stack of the
+ * block the position is in and scans just that line up to the position.
+ * Edits only move back the point up to which every block is known to be
+ * right; the next query rescans from there, and stops rescanning as soon
+ * as a block starts the same way it did before.
+ */
+class TagNestingIndex
+{
+public:
+
+    /**
+     * An element on the stack.
+     */
+    struct Element {
+        /**
+         * The tag name, without any namespace prefix.
+         */
+        QString name;
+
+        /**
+         * The number of child elements
+         * detected for the element, so far.
+         */
+        int num_children;
+
+        bool operator==(const Element &other) const;
+    };
+
+    TagNestingIndex();
+
+    /**
+     * Starts over on a new document.
+     */
+    void SetDocument(QTextDocument *document);
+
+    /**
+     * Must be called for every QTextDocument::contentsChange.
+     */
+    void ContentsChanged(int position, int chars_removed, int chars_added);
+
+    /**
+     * The stack just after the last start tag that begins at or before
+     * position, self closing ones excepted. This is where the caret is
+     * taken to be, the same as the old QXmlStreamReader pass worked out.
+     */
+    QVector<Element> StackAfterLastStartTag(int position);
+
+    /**
+     * @return \c true if position is in a tag (between its "<" and
+     *         up to its ">"), a processing instruction included.
+     */
+    bool IsInTag(int position);
+    bool IsInStartTag(int position);
+    bool IsInEndTag(int position);
+
+    /**
+     * @return \c true if position is inside an element called name
+     *         (compared without case), past its start tag and not yet
+     *         in its end tag.
+     */
+    bool IsInElement(int position, const QString &name);
+
+private:
+
+    enum Mode {
+        Mode_Text,
+        Mode_StartTag,
+        Mode_EndTag,
+        Mode_Comment,
+        Mode_CDATA,
+        Mode_PI,
+        Mode_Doctype
+    };
+
+    /**
+     * Everything needed to resume the scan at a given point.
+     */
+    struct State {
+        State();
+
+        bool operator==(const State &other) const;
+
+        QVector<Element> stack;
+        QVector<Element> after_last_start_tag;
+        Mode mode;
+
+        // The tag being read
+        QString tag_name;
+        bool name_done;
+        QChar quote;
+
+        // The last character that matters for ending the current
+        // construct, and how many "-" or "]" in a row were just seen
+        QChar previous;
+        int run;
+    };
+
+    class BlockData : public QTextBlockUserData
+    {
+    public:
+        State start;
+        int revision;
+    };
+
+    State StateAt(int position);
+
+    /**
+     * Brings the blocks up to target up to date and
+     * returns the state target starts in.
+     */
+    State StartStateOf(const QTextBlock &target);
+
+    State EndStateOf(const QTextBlock &block, const State &start) const;
+
+    /**
+     * @return The block's data if it was worked out
+     *         for the current text of the block.
+     */
+    static BlockData *FreshData(const QTextBlock &block);
+
+    /**
+     * Advances state over text[from, to). Stops early, just past
+     * the ">", if stop_at_tag_end is set and a tag is ended.
+     *
+     * @return The index scanning stopped at, which can be past "to"
+     *         when a multi-character token starts just before it.
+     */
+    static int Scan(State &state, const QString &text, int from, int to, bool stop_at_tag_end = false);
+
+    static void EndTag(State &state);
+
+    QTextDocument *m_Document;
+
+    /**
+     * The number of leading blocks whose start state is known to be right.
+     */
+    int m_ValidBlocks;
+};
+
+#endif // TAGNESTINGINDEX_H
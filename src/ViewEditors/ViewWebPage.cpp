@@ -25,11 +25,14 @@
 #include <QDebug>
 #endif
 
+#include "Misc/BookNetworkAccess.h"
 #include "ViewEditors/ViewWebPage.h"
 
 ViewWebPage::ViewWebPage(QObject *parent)
     : QWebPage(parent)
 {
+    // Book files come from memory, with the edits not yet saved
+    setNetworkAccessManager(BookNetworkAccess::instance());
 }
 
 void ViewWebPage::javaScriptConsoleMessage(const QString &message, int lineNumber, const QString &sourceID)
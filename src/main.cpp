@@ -28,6 +28,7 @@
 #include <QtCore/QLibraryInfo>
 #include <QtCore/QTextCodec>
 #include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
 #include <QtCore/QTranslator>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QMessageBox>
@@ -40,10 +41,18 @@
 #include "MainUI/MainApplication.h"
 #include "MainUI/MainWindow.h"
 #include "Misc/AppEventFilter.h"
+#include "Misc/BatchProcessor.h"
+#include "Misc/Benchmark.h"
+#include "Misc/GumboArena.h"
+#include "Misc/GumboCache.h"
+#include "Misc/JobServer.h"
 #include "Misc/SettingsStore.h"
+#include "Misc/StartupProfiler.h"
+#include "Misc/TaskScheduler.h"
 #include "Misc/TempFolder.h"
 #include "Misc/UpdateChecker.h"
 #include "Misc/Utility.h"
+#include "ResourceObjects/TextMemoryBudget.h"
 #include "sigil_constants.h"
 #include "sigil_exception.h"
 
@@ -63,6 +72,15 @@ static const int RETRY_DELAY_MS = 5;
 # include <QAction>
 #endif
 
+// The share of a memory limit the text held in memory may take
+static const int TEXT_MEMORY_SHARE = 4;
+
+// and the cached parse trees
+static const int GUMBO_CACHE_MEMORY_SHARE = 16;
+
+// and the parse memory every thread keeps for reuse, all threads together
+static const int GUMBO_ARENA_MEMORY_SHARE = 64;
+
 // Creates a MainWindow instance depending
 // on command line arguments
 static MainWindow *GetMainWindow(const QStringList &arguments)
@@ -247,17 +265,50 @@ int main(int argc, char *argv[])
         QThreadPool::globalInstance()->setExpiryTimeout(-1);
 #endif
 
+    // Batch, benchmark and server runs never show a window, so they need no display
+    const bool batch_run = BatchProcessor::IsBatchRun(argc, argv);
+    const bool benchmark_run = Benchmark::IsBenchmarkRun(argc, argv);
+    const bool server_run = JobServer::IsServerRun(argc, argv);
+    if ((batch_run || benchmark_run || server_run) && !qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     MainApplication app(argc, argv);
 
+    QStringList arguments = QCoreApplication::arguments();
+    StartupProfiler::Initialize(arguments);
+
+    // Size the thread pools for the CPUs and memory the process may really
+    // use, before anything is run on them
+    QString limits_error;
+    if (!TaskScheduler::ApplyLimits(arguments, limits_error)) {
+        std::cerr << limits_error.toStdString() << std::endl;
+        return 2;
+    }
+
+    // Under a memory limit the caches keep to a share of it
+    const qint64 memory_limit = TaskScheduler::MemoryLimit();
+    if (memory_limit > 0) {
+        const qint64 text_budget = TextMemoryBudget::Budget();
+        TextMemoryBudget::SetBudget(text_budget > 0 ? qMin(text_budget, memory_limit / TEXT_MEMORY_SHARE) :
+                                                      memory_limit / TEXT_MEMORY_SHARE);
+        GumboCache::SetCapacity(qMin(GumboCache::Capacity(), memory_limit / GUMBO_CACHE_MEMORY_SHARE));
+        GumboArena::SetThreadCacheLimit(qMin(GumboArena::ThreadCacheLimit(),
+                                             memory_limit / GUMBO_ARENA_MEMORY_SHARE / TaskScheduler::ThreadCount()));
+    }
+
     // drag and drop in main tab bar is too touchy and that can cause problems.
     // default drag distance limit is much too small especially for hpi displays
     // startDragDistance default is just 10 pixels
     if (app.startDragDistance() < 50) app.setStartDragDistance(50);
 
-    // Set up embedded python integration first thing
-    EmbeddedPython* epython = EmbeddedPython::instance();
-    epython->addToPythonSysPath(epython->embeddedRoot());
-    epython->addToPythonSysPath(PluginDB::launcherRoot() + "/python");
+    // Set up embedded python integration first thing, off the GUI
+    // thread; the first use of Python waits for it to be ready
+    {
+        StartupProfiler::Phase phase("Queue Python start-up");
+        EmbeddedPython::initializeInBackground(QStringList() << EmbeddedPython::embeddedRoot()
+                                                             << PluginDB::launcherRoot() + "/python");
+    }
 
     try {
 
@@ -268,6 +319,7 @@ int main(int argc, char *argv[])
         app.addLibraryPath("imageformats");
 
         QTextCodec::setCodecForLocale(QTextCodec::codecForName("utf8"));
+        StartupProfiler::Phase translators_phase("Load translations");
         SettingsStore settings;
         // Setup the qtbase_ translator and load the translation for the selected language
         QTranslator qtbaseTranslator;
@@ -296,11 +348,23 @@ int main(int argc, char *argv[])
             }
         }
         app.installTranslator(&sigilTranslator);
+        translators_phase.End();
+
+        if (batch_run) {
+            return BatchProcessor().Run(arguments);
+        }
+        if (benchmark_run) {
+            return Benchmark().Run(arguments);
+        }
+        if (server_run) {
+            return JobServer().Run(arguments);
+        }
 
         // Check for existing qt_styles.qss in Prefs dir and load it if present
         QString qt_stylesheet_path = Utility::DefinePrefsDir() + "/qt_styles.qss";
         QFileInfo QtStylesheetInfo(qt_stylesheet_path);
         if (QtStylesheetInfo.exists() && QtStylesheetInfo.isFile() && QtStylesheetInfo.isReadable()) {
+            StartupProfiler::Phase phase("Load Qt style sheet");
             QString qtstyles = Utility::ReadUnicodeTextFile(qt_stylesheet_path);
             app.setStyleSheet(qtstyles);
         }
@@ -337,8 +401,6 @@ int main(int argc, char *argv[])
         AppEventFilter *filter = new AppEventFilter(&app);
         app.installEventFilter(filter);
 
-        QStringList arguments = QCoreApplication::arguments();
-
 #ifdef Q_OS_MAC
         // now process main app events so that any startup 
         // FileOpen event will be processed for macOS
@@ -406,10 +468,28 @@ int main(int argc, char *argv[])
             basemw->show();
 #endif
 
-            VerifyPlugins();
-            MainWindow *widget = GetMainWindow(arguments);
-            widget->show();
-            return app.exec();
+            {
+                StartupProfiler::Phase phase("Load plugins");
+                VerifyPlugins();
+            }
+            MainWindow *widget;
+            {
+                StartupProfiler::Phase phase("Create main window");
+                widget = GetMainWindow(arguments);
+            }
+            {
+                StartupProfiler::Phase phase("Show main window");
+                widget->show();
+            }
+            // Once the window is up, so the question has somewhere to go
+            QTimer::singleShot(0, widget, SLOT(RecoverUnsavedChanges()));
+            if (StartupProfiler::IsEnabled()) {
+                StartupProfiler::Phase *first_events = new StartupProfiler::Phase("Until the first event loop turn");
+                QTimer::singleShot(0, [first_events]() { delete first_events; });
+            }
+            int result = app.exec();
+            StartupProfiler::Report();
+            return result;
         }
     } catch (std::exception e) {
         Utility::DisplayExceptionErrorDialog(e.what());